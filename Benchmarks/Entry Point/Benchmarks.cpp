@@ -0,0 +1,312 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Entry point and main benchmarking logic
+//
+
+#include "pch.h"
+
+#include "Harness/Suite.h"
+#include "Harness/Runner.h"
+#include "Harness/History.h"
+#include "Harness/Primitives.h"
+
+#include "DLL Access/Exceptions.h"
+#include "DLL Access/FugueVMDLL.h"
+#include "DLL Access/FugueASMDLL.h"
+
+#include "Utility/Files/SpecialPaths.h"
+#include "Utility/Strings.h"
+
+
+// Prototypes
+namespace
+{
+	void Usage();
+	int RunSuite(const std::vector<std::wstring>& params);
+}
+
+
+//
+// Entry point for the benchmark harness
+//
+int _tmain(int argc, _TCHAR* argv[])
+{
+	std::vector<std::wstring> commandlineparams(argc);
+	for(int i = 0; i < argc; ++i)
+		commandlineparams[i] = argv[i];
+
+	try
+	{
+		if(commandlineparams.size() > 1 && commandlineparams[1] == L"/child")
+			return BenchmarkRunner::RunChildProcess(commandlineparams);
+
+		std::wcout << L"BENCHMARKS - Epoch performance test suite\n\n";
+		return RunSuite(commandlineparams);
+	}
+	catch(DLLAccessException& e)
+	{
+		std::wcout << L"Error: " << e.GetMessage() << std::endl;
+	}
+	catch(std::exception& e)
+	{
+		std::wcout << L"Error: " << e.what() << std::endl;
+	}
+	catch(...)
+	{
+		std::wcout << L"Unknown exception!" << std::endl;
+	}
+
+	return 2;
+}
+
+
+namespace
+{
+
+	//
+	// Helper function for displaying the utility's command-line usage
+	//
+	void Usage()
+	{
+		std::wcout << L"Benchmarks.exe [options]\n\n";
+		std::wcout << L"   /programs <dir>       Directory holding the benchmark programs (default: Programs)\n";
+		std::wcout << L"   /history <file>       File used to track results across builds (default: benchmarks.history)\n";
+		std::wcout << L"   /build <label>        Label identifying this build in the history (default: current time)\n";
+		std::wcout << L"   /runs <count>         Number of times to run each benchmark (default: 5)\n";
+		std::wcout << L"   /threshold <percent>  Change which counts as a regression (default: 5)\n";
+		std::wcout << L"   /only <name>          Only run benchmarks whose names begin with the given text\n";
+		std::wcout << L"   /primitives <file>    Run the VM primitive microbenchmarks instead, writing JSON results to the file\n";
+		std::wcout << L"   /threads <count>      Most threads used by the primitive microbenchmarks (default: one per processor)\n";
+		std::wcout << L"\nThe exit code is 0 if all benchmarks ran without regressions, and 1 otherwise.\n";
+		std::wcout << L"Primitive microbenchmarks are not checked for regressions; the exit code only reflects failures.\n";
+		std::wcout << std::endl;
+	}
+
+	//
+	// Generate a default build label from the current time
+	//
+	std::wstring GetDefaultBuildLabel()
+	{
+		SYSTEMTIME now;
+		::GetLocalTime(&now);
+
+		std::wostringstream label;
+		label << std::setfill(L'0') << now.wYear << L"-" << std::setw(2) << now.wMonth << L"-" << std::setw(2) << now.wDay
+			  << L" " << std::setw(2) << now.wHour << L":" << std::setw(2) << now.wMinute << L":" << std::setw(2) << now.wSecond;
+		return label.str();
+	}
+
+	//
+	// Obtain the directory used for generated programs and compiled binaries
+	//
+	std::wstring GetWorkingDirectory()
+	{
+		std::wstring path = SpecialPaths::GetTemporaryPath() + L"Epoch Benchmarks\\";
+		::CreateDirectory(path.c_str(), NULL);
+		return path;
+	}
+
+	//
+	// Write out the final source of a benchmark program
+	//
+	void WriteSource(const std::wstring& filename, const std::wstring& source)
+	{
+		std::ofstream outfile(filename.c_str(), std::ios::trunc);
+		if(!outfile)
+			throw FileException("Failed to write benchmark program " + narrow(filename));
+
+		outfile << narrow(source);
+	}
+
+	//
+	// Display a single result as a row of the report table
+	//
+	void DisplayResult(const BenchmarkResult& result)
+	{
+		std::wcout << std::left << std::setw(18) << result.BenchmarkName << std::setw(10) << GetExecutionModeName(result.Mode) << std::right;
+
+		if(!result.Succeeded)
+		{
+			std::wcout << L"  FAILED" << std::endl;
+			return;
+		}
+
+		std::wcout << std::fixed
+				   << std::setprecision(4) << std::setw(12) << result.Seconds
+				   << std::setprecision(0) << std::setw(16) << result.OperationsPerSecond
+				   << std::setw(14) << (result.PeakWorkingSet / 1024)
+				   << std::setw(14) << (result.PeakPrivateBytes / 1024)
+				   << std::endl;
+	}
+
+
+	//
+	// Run the microbenchmarks of the VM's threading and memory primitives
+	//
+	int RunPrimitives(const std::wstring& outputfile, const std::wstring& buildlabel, unsigned maxthreads, unsigned numruns)
+	{
+		FugueVMDLLAccess vmaccess;
+
+		PrimitiveResultList results;
+		if(!Primitives::Run(vmaccess, maxthreads, numruns, results))
+		{
+			std::wcout << L"Primitive benchmarks FAILED" << std::endl;
+			return 1;
+		}
+
+		std::wcout << std::left << std::setw(28) << L"Primitive" << std::right << std::setw(8) << L"Threads"
+				   << std::setw(12) << L"ms" << std::setw(16) << L"Ops/sec" << std::setw(12) << L"ns/op" << std::endl;
+
+		for(PrimitiveResultList::const_iterator iter = results.begin(); iter != results.end(); ++iter)
+		{
+			std::wcout << std::left << std::setw(28) << iter->BenchmarkName << std::right << std::setw(8) << iter->NumThreads << std::fixed
+					   << std::setprecision(2) << std::setw(12) << iter->Milliseconds;
+
+			if(iter->Milliseconds > 0.0 && iter->NumOperations > 0)
+			{
+				std::wcout << std::setprecision(0) << std::setw(16) << (static_cast<double>(iter->NumOperations) * 1000.0 / iter->Milliseconds)
+						   << std::setprecision(2) << std::setw(12) << (iter->Milliseconds * 1000000.0 / static_cast<double>(iter->NumOperations));
+			}
+
+			std::wcout << std::endl;
+		}
+
+		Primitives::WriteJSON(outputfile, buildlabel, numruns, results);
+		std::wcout << std::endl << L"Results written to " << outputfile << std::endl;
+		return 0;
+	}
+
+
+	//
+	// Run the benchmark suite as directed by the command line
+	//
+	int RunSuite(const std::vector<std::wstring>& params)
+	{
+		std::wstring programdirectory = L"Programs\\";
+		std::wstring historyfile = L"benchmarks.history";
+		std::wstring buildlabel = GetDefaultBuildLabel();
+		std::wstring filter;
+		std::wstring primitivesfile;
+		unsigned maxthreads = 0;
+		unsigned numruns = 5;
+		double threshold = 5.0;
+
+		for(size_t i = 1; i < params.size(); ++i)
+		{
+			if(i + 1 >= params.size())
+			{
+				Usage();
+				return 1;
+			}
+
+			if(params[i] == L"/programs")
+			{
+				programdirectory = params[++i];
+				if(!programdirectory.empty() && programdirectory[programdirectory.length() - 1] != L'\\')
+					programdirectory += L'\\';
+			}
+			else if(params[i] == L"/history")
+				historyfile = params[++i];
+			else if(params[i] == L"/build")
+				buildlabel = params[++i];
+			else if(params[i] == L"/runs")
+				std::wistringstream(params[++i]) >> numruns;
+			else if(params[i] == L"/threshold")
+				std::wistringstream(params[++i]) >> threshold;
+			else if(params[i] == L"/only")
+				filter = params[++i];
+			else if(params[i] == L"/primitives")
+				primitivesfile = params[++i];
+			else if(params[i] == L"/threads")
+				std::wistringstream(params[++i]) >> maxthreads;
+			else
+			{
+				Usage();
+				return 1;
+			}
+		}
+
+		if(!primitivesfile.empty())
+			return RunPrimitives(primitivesfile, buildlabel, maxthreads, numruns);
+
+		FugueVMDLLAccess vmaccess;
+		FugueASMDLLAccess asmaccess;
+
+		std::wstring workingdirectory = GetWorkingDirectory();
+		BenchmarkRunner runner(workingdirectory, numruns);
+
+		// Prepare and compile all programs up front, so that the compiler's
+		// output is kept separate from the table of results
+		BenchmarkList benchmarks;
+		std::vector<bool> compiled;
+		{
+			BenchmarkList allbenchmarks = Suite::GetBenchmarks();
+			for(BenchmarkList::const_iterator iter = allbenchmarks.begin(); iter != allbenchmarks.end(); ++iter)
+			{
+				if(iter->Name.compare(0, filter.length(), filter) != 0)
+					continue;
+
+				std::wstring sourcefile = workingdirectory + iter->Name + L".epoch";
+				std::wstring binaryfile = workingdirectory + iter->Name + L".epb";
+				WriteSource(sourcefile, Suite::PrepareSource(*iter, programdirectory));
+
+				benchmarks.push_back(*iter);
+				compiled.push_back(vmaccess.CompileToBinary(narrow(sourcefile).c_str(), narrow(binaryfile).c_str(), true, asmaccess));
+			}
+		}
+
+		std::vector<BenchmarkResult> results;
+		bool anyfailed = false;
+
+		std::wcout << std::endl;
+		std::wcout << std::left << std::setw(18) << L"Benchmark" << std::setw(10) << L"Mode" << std::right
+				   << std::setw(12) << L"Seconds" << std::setw(16) << L"Ops/sec"
+				   << std::setw(14) << L"Peak WS (KB)" << std::setw(14) << L"Private (KB)" << std::endl;
+
+		for(size_t i = 0; i < benchmarks.size(); ++i)
+		{
+			results.push_back(runner.Run(benchmarks[i], workingdirectory + benchmarks[i].Name + L".epoch", ExecutionMode_Source));
+			DisplayResult(results.back());
+			anyfailed |= !results.back().Succeeded;
+
+			if(compiled[i])
+				results.push_back(runner.Run(benchmarks[i], workingdirectory + benchmarks[i].Name + L".epb", ExecutionMode_Binary));
+			else
+			{
+				BenchmarkResult failure = results.back();
+				failure.Mode = ExecutionMode_Binary;
+				failure.Succeeded = false;
+				results.push_back(failure);
+			}
+			DisplayResult(results.back());
+			anyfailed |= !results.back().Succeeded;
+
+			if(benchmarks[i].ProfileFrontEnd)
+			{
+				std::vector<BenchmarkResult> stages = runner.ProfileFrontEnd(benchmarks[i], workingdirectory + benchmarks[i].Name + L".epoch");
+				for(std::vector<BenchmarkResult>::const_iterator iter = stages.begin(); iter != stages.end(); ++iter)
+				{
+					results.push_back(*iter);
+					DisplayResult(results.back());
+					anyfailed |= !results.back().Succeeded;
+				}
+			}
+		}
+
+		ResultHistory history(historyfile);
+		std::wcout << std::endl;
+		unsigned numregressions = history.ReportRegressions(buildlabel, results, threshold / 100.0, std::wcout);
+		history.Record(buildlabel, results);
+
+		if(numregressions)
+			std::wcout << numregressions << L" regression(s) found compared to earlier builds." << std::endl;
+		else
+			std::wcout << L"No regressions found compared to earlier builds." << std::endl;
+
+		return (anyfailed || numregressions) ? 1 : 0;
+	}
+
+}
+
@@ -0,0 +1,141 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Tracking of benchmark results across builds
+//
+
+#include "pch.h"
+
+#include "Harness/History.h"
+
+
+//
+// Construct the history wrapper and load any previously recorded results
+//
+// Lines which cannot be parsed are skipped, so that a damaged or hand
+// edited history file does not prevent benchmarking.
+//
+ResultHistory::ResultHistory(const std::wstring& filename)
+	: FileName(filename)
+{
+	std::wifstream infile(filename.c_str());
+
+	std::wstring line;
+	while(std::getline(infile, line))
+	{
+		std::vector<std::wstring> fields;
+		std::wistringstream stream(line);
+		std::wstring field;
+		while(std::getline(stream, field, L'\t'))
+			fields.push_back(field);
+
+		if(fields.size() < 7)
+			continue;
+
+		Entry entry;
+		entry.BuildLabel = fields[0];
+		entry.BenchmarkName = fields[1];
+		entry.ModeName = fields[2];
+
+		if(!(std::wistringstream(fields[3]) >> entry.Seconds)
+		|| !(std::wistringstream(fields[4]) >> entry.OperationsPerSecond)
+		|| !(std::wistringstream(fields[5]) >> entry.PeakWorkingSet)
+		|| !(std::wistringstream(fields[6]) >> entry.PeakPrivateBytes))
+			continue;
+
+		Entries.push_back(entry);
+	}
+}
+
+
+//
+// Append a set of results to the history
+//
+// Failed benchmarks are not recorded, so that they are never used as
+// the baseline for later comparisons.
+//
+void ResultHistory::Record(const std::wstring& buildlabel, const std::vector<BenchmarkResult>& results)
+{
+	std::wofstream outfile(FileName.c_str(), std::ios::app);
+	if(!outfile)
+		throw FileException("Failed to open the benchmark history file for writing");
+
+	for(std::vector<BenchmarkResult>::const_iterator iter = results.begin(); iter != results.end(); ++iter)
+	{
+		if(!iter->Succeeded)
+			continue;
+
+		Entry entry;
+		entry.BuildLabel = buildlabel;
+		entry.BenchmarkName = iter->BenchmarkName;
+		entry.ModeName = GetExecutionModeName(iter->Mode);
+		entry.Seconds = iter->Seconds;
+		entry.OperationsPerSecond = iter->OperationsPerSecond;
+		entry.PeakWorkingSet = static_cast<double>(iter->PeakWorkingSet);
+		entry.PeakPrivateBytes = static_cast<double>(iter->PeakPrivateBytes);
+
+		outfile << std::setprecision(12)
+				<< entry.BuildLabel << L"\t" << entry.BenchmarkName << L"\t" << entry.ModeName << L"\t"
+				<< entry.Seconds << L"\t" << entry.OperationsPerSecond << L"\t"
+				<< entry.PeakWorkingSet << L"\t" << entry.PeakPrivateBytes << L"\n";
+
+		Entries.push_back(entry);
+	}
+}
+
+
+//
+// Compare a set of results against the previous build's results, and report any regressions
+//
+// A regression is a drop in throughput, or a rise in peak memory usage,
+// by more than the given fraction. Returns the number of regressions.
+//
+unsigned ResultHistory::ReportRegressions(const std::wstring& buildlabel, const std::vector<BenchmarkResult>& results, double threshold, std::wostream& output) const
+{
+	unsigned numregressions = 0;
+
+	for(std::vector<BenchmarkResult>::const_iterator iter = results.begin(); iter != results.end(); ++iter)
+	{
+		if(!iter->Succeeded)
+			continue;
+
+		const Entry* baseline = FindBaseline(buildlabel, *iter);
+		if(!baseline)
+			continue;
+
+		if(iter->OperationsPerSecond < baseline->OperationsPerSecond * (1.0 - threshold))
+		{
+			output << L"REGRESSION: " << iter->BenchmarkName << L" (" << GetExecutionModeName(iter->Mode) << L") throughput fell from "
+				   << baseline->OperationsPerSecond << L" to " << iter->OperationsPerSecond << L" ops/sec since build " << baseline->BuildLabel << L"\n";
+			++numregressions;
+		}
+
+		if(static_cast<double>(iter->PeakWorkingSet) > baseline->PeakWorkingSet * (1.0 + threshold))
+		{
+			output << L"REGRESSION: " << iter->BenchmarkName << L" (" << GetExecutionModeName(iter->Mode) << L") peak working set rose from "
+				   << (baseline->PeakWorkingSet / 1024.0) << L" to " << (iter->PeakWorkingSet / 1024.0) << L" KB since build " << baseline->BuildLabel << L"\n";
+			++numregressions;
+		}
+	}
+
+	return numregressions;
+}
+
+
+//
+// Locate the most recent result for the same benchmark recorded by a different build
+//
+const ResultHistory::Entry* ResultHistory::FindBaseline(const std::wstring& buildlabel, const BenchmarkResult& result) const
+{
+	const std::wstring modename = GetExecutionModeName(result.Mode);
+
+	for(std::vector<Entry>::const_reverse_iterator iter = Entries.rbegin(); iter != Entries.rend(); ++iter)
+	{
+		if(iter->BuildLabel != buildlabel && iter->BenchmarkName == result.BenchmarkName && iter->ModeName == modename)
+			return &(*iter);
+	}
+
+	return NULL;
+}
+
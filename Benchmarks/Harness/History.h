@@ -0,0 +1,58 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Tracking of benchmark results across builds
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Harness/Runner.h"
+
+
+//
+// History of benchmark results
+//
+// Results are kept in a plain text file, with one tab separated line per
+// benchmark and mode, tagged with the label of the build which produced
+// them. New results are appended, so the file accumulates a complete
+// record of performance over time which can easily be loaded into other
+// tools for graphing.
+//
+// Regressions are detected by comparing each result against the most
+// recent result recorded for the same benchmark and mode by a different
+// build.
+//
+class ResultHistory
+{
+// Construction
+public:
+	explicit ResultHistory(const std::wstring& filename);
+
+// History interface
+public:
+	void Record(const std::wstring& buildlabel, const std::vector<BenchmarkResult>& results);
+
+	unsigned ReportRegressions(const std::wstring& buildlabel, const std::vector<BenchmarkResult>& results, double threshold, std::wostream& output) const;
+
+// Internal tracking
+private:
+	struct Entry
+	{
+		std::wstring BuildLabel;
+		std::wstring BenchmarkName;
+		std::wstring ModeName;
+		double Seconds;
+		double OperationsPerSecond;
+		double PeakWorkingSet;
+		double PeakPrivateBytes;
+	};
+
+	const Entry* FindBaseline(const std::wstring& buildlabel, const BenchmarkResult& result) const;
+
+	std::wstring FileName;
+	std::vector<Entry> Entries;
+};
+
@@ -0,0 +1,143 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Microbenchmarks of the virtual machine's threading and memory primitives
+//
+
+#include "pch.h"
+
+#include "Harness/Primitives.h"
+
+#include "DLL Access/FugueVMDLL.h"
+
+#include "Utility/Strings.h"
+
+
+namespace
+{
+
+	//
+	// Timings gathered for each measurement over all runs, in the order first seen
+	//
+	struct TimingTable
+	{
+		typedef std::pair<std::wstring, unsigned> KeyType;
+
+		std::vector<PrimitiveResult> Results;
+		std::map<KeyType, std::vector<double> > Timings;
+	};
+
+	//
+	// Callback invoked by the VM DLL with each measurement
+	//
+	void __stdcall RecordPrimitiveResult(const wchar_t* name, unsigned numthreads, unsigned __int64 numoperations, double milliseconds, void* userdata)
+	{
+		TimingTable& table = *reinterpret_cast<TimingTable*>(userdata);
+
+		std::vector<double>& timings = table.Timings[TimingTable::KeyType(name, numthreads)];
+		if(timings.empty())
+		{
+			PrimitiveResult result;
+			result.BenchmarkName = name;
+			result.NumThreads = numthreads;
+			result.NumOperations = numoperations;
+			result.Milliseconds = 0.0;
+			table.Results.push_back(result);
+		}
+
+		timings.push_back(milliseconds);
+	}
+
+	//
+	// Escape a string for inclusion in a JSON document
+	//
+	std::string EscapeJSON(const std::string& str)
+	{
+		std::ostringstream escaped;
+		for(std::string::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+		{
+			if(*iter == '"' || *iter == '\\')
+				escaped << '\\' << *iter;
+			else if(static_cast<unsigned char>(*iter) < 0x20)
+				escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned>(static_cast<unsigned char>(*iter)) << std::dec;
+			else
+				escaped << *iter;
+		}
+
+		return escaped.str();
+	}
+
+}
+
+
+//
+// Run the primitive benchmarks the given number of times, and produce
+// the median time of each measurement
+//
+// Benchmarks of shared structures use up to maxthreads threads, or one
+// per processor if zero is given. Returns false if the VM reported a
+// failure during any of the runs.
+//
+bool Primitives::Run(FugueVMDLLAccess& vmaccess, unsigned maxthreads, unsigned numruns, PrimitiveResultList& results)
+{
+	TimingTable table;
+	for(unsigned i = 0; i < numruns; ++i)
+	{
+		if(!vmaccess.RunPrimitiveBenchmarks(maxthreads, RecordPrimitiveResult, &table))
+			return false;
+	}
+
+	for(std::vector<PrimitiveResult>::iterator iter = table.Results.begin(); iter != table.Results.end(); ++iter)
+	{
+		std::vector<double>& timings = table.Timings[TimingTable::KeyType(iter->BenchmarkName, iter->NumThreads)];
+		std::sort(timings.begin(), timings.end());
+		iter->Milliseconds = timings[timings.size() / 2];
+	}
+
+	results.swap(table.Results);
+	return true;
+}
+
+//
+// Write out a set of results as a JSON document
+//
+// Rates are included alongside the raw measurements for convenience;
+// they are derived from the median times, and are zero for any result
+// whose time was too short to measure.
+//
+void Primitives::WriteJSON(const std::wstring& filename, const std::wstring& buildlabel, unsigned numruns, const PrimitiveResultList& results)
+{
+	std::ofstream outfile(filename.c_str(), std::ios::trunc);
+	if(!outfile)
+		throw FileException("Failed to write primitive benchmark results to " + narrow(filename));
+
+	outfile << "{\n";
+	outfile << "\t\"build\": \"" << EscapeJSON(narrow(buildlabel)) << "\",\n";
+	outfile << "\t\"runs\": " << numruns << ",\n";
+	outfile << "\t\"results\": [";
+
+	outfile << std::fixed;
+	for(PrimitiveResultList::const_iterator iter = results.begin(); iter != results.end(); ++iter)
+	{
+		double opspersecond = 0.0;
+		double nanosecondsperop = 0.0;
+		if(iter->Milliseconds > 0.0 && iter->NumOperations > 0)
+		{
+			opspersecond = static_cast<double>(iter->NumOperations) * 1000.0 / iter->Milliseconds;
+			nanosecondsperop = iter->Milliseconds * 1000000.0 / static_cast<double>(iter->NumOperations);
+		}
+
+		outfile << (iter == results.begin() ? "\n" : ",\n");
+		outfile << "\t\t{ \"name\": \"" << EscapeJSON(narrow(iter->BenchmarkName)) << "\""
+				<< ", \"threads\": " << iter->NumThreads
+				<< ", \"operations\": " << iter->NumOperations
+				<< std::setprecision(4) << ", \"milliseconds\": " << iter->Milliseconds
+				<< std::setprecision(0) << ", \"ops_per_second\": " << opspersecond
+				<< std::setprecision(2) << ", \"ns_per_op\": " << nanosecondsperop
+				<< " }";
+	}
+
+	outfile << "\n\t]\n";
+	outfile << "}\n";
+}
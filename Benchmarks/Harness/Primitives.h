@@ -0,0 +1,47 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Microbenchmarks of the virtual machine's threading and memory primitives
+//
+// Unlike the rest of the suite, these benchmarks do not run Epoch code;
+// the VM DLL exercises its mailboxes, thread pools, allocators, stacks
+// and handle pools directly, and hands back the raw measurements. The
+// whole set is run several times in the same process, and the median
+// time of each measurement is reported. Results are written as JSON so
+// that they can be compared across builds by external tools.
+//
+
+#pragma once
+
+
+// Forward declarations
+class FugueVMDLLAccess;
+
+
+//
+// Measurement of a single primitive at a single thread count
+//
+// For the thread pool latency benchmark, Milliseconds is the total time
+// the work items spent waiting to be claimed, so that the time per operation
+// is the mean latency.
+//
+struct PrimitiveResult
+{
+	std::wstring BenchmarkName;
+	unsigned NumThreads;
+	unsigned __int64 NumOperations;
+	double Milliseconds;
+};
+
+typedef std::vector<PrimitiveResult> PrimitiveResultList;
+
+
+namespace Primitives
+{
+
+	bool Run(FugueVMDLLAccess& vmaccess, unsigned maxthreads, unsigned numruns, PrimitiveResultList& results);
+
+	void WriteJSON(const std::wstring& filename, const std::wstring& buildlabel, unsigned numruns, const PrimitiveResultList& results);
+
+}
@@ -0,0 +1,366 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Logic for running benchmarks and measuring their performance
+//
+
+#include "pch.h"
+
+#include "Harness/Runner.h"
+#include "Harness/Suite.h"
+
+#include "DLL Access/FugueVMDLL.h"
+#include "DLL Access/FugueASMDLL.h"
+
+#include "Utility/Strings.h"
+
+
+namespace
+{
+
+	//
+	// Helper for quoting parameters on a command line
+	//
+	std::wstring Quote(const std::wstring& param)
+	{
+		return L"\"" + param + L"\"";
+	}
+
+	//
+	// Read an entire file into memory
+	//
+	void LoadFile(const std::wstring& filename, std::vector<Byte>& buffer)
+	{
+		std::ifstream infile(filename.c_str(), std::ios::binary);
+		if(!infile)
+			throw FileException("Failed to open " + narrow(filename));
+
+		infile.seekg(0, std::ios::end);
+		buffer.resize(static_cast<size_t>(infile.tellg()));
+		infile.seekg(0, std::ios::beg);
+
+		if(buffer.empty() || !infile.read(&buffer[0], static_cast<std::streamsize>(buffer.size())))
+			throw FileException("Failed to read " + narrow(filename));
+	}
+
+	// Name under which child processes are asked to profile the front end
+	const wchar_t* FrontEndModeName = L"frontend";
+
+	//
+	// Callback which records the time taken by a stage of the front end,
+	// along with the peak memory usage of the process once it finished
+	//
+	void __stdcall RecordStage(const wchar_t* stagename, double milliseconds, void* userdata)
+	{
+		PROCESS_MEMORY_COUNTERS memory;
+		::ZeroMemory(&memory, sizeof(memory));
+		memory.cb = sizeof(memory);
+		::GetProcessMemoryInfo(::GetCurrentProcess(), &memory, sizeof(memory));
+
+		std::wostream& output = *reinterpret_cast<std::wostream*>(userdata);
+		output << stagename << L" " << std::setprecision(9) << (milliseconds / 1000.0) << L" " << memory.PeakWorkingSetSize << L" " << memory.PeakPagefileUsage << L"\n";
+	}
+
+	//
+	// Compile, assemble, and load a source program in a child process,
+	// timing each stage and writing out one line of results per stage
+	//
+	int RunFrontEndChildProcess(const std::wstring& programfile, const std::wstring& resultfile)
+	{
+		FugueVMDLLAccess vmaccess;
+		FugueASMDLLAccess asmaccess;
+
+		std::wostringstream stages;
+
+		std::wstring assembly;
+		if(!vmaccess.ProfileCompilation(narrow(programfile).c_str(), RecordStage, &stages, assembly))
+			return 1;
+
+		LARGE_INTEGER frequency, start, end;
+		::QueryPerformanceFrequency(&frequency);
+		::QueryPerformanceCounter(&start);
+
+		std::vector<unsigned char> binary;
+		bool assembled = asmaccess.AssembleToMemory(assembly.c_str(), assembly.length(), binary);
+
+		::QueryPerformanceCounter(&end);
+
+		if(!assembled || binary.empty())
+			return 1;
+
+		RecordStage(GetExecutionModeName(ExecutionMode_Assemble), static_cast<double>(end.QuadPart - start.QuadPart) * 1000.0 / static_cast<double>(frequency.QuadPart), &stages);
+
+		if(!vmaccess.ProfileLoading(&binary[0], RecordStage, &stages))
+			return 1;
+
+		std::wofstream outfile(resultfile.c_str(), std::ios::trunc);
+		outfile << stages.str();
+
+		return outfile ? 0 : 1;
+	}
+
+}
+
+
+//
+// Retrieve a readable name for an execution mode
+//
+const wchar_t* GetExecutionModeName(ExecutionMode mode)
+{
+	switch(mode)
+	{
+	case ExecutionMode_Binary:		return L"binary";
+	case ExecutionMode_Pass1:		return L"pass1";
+	case ExecutionMode_Pass2:		return L"pass2";
+	case ExecutionMode_Validate:	return L"validate";
+	case ExecutionMode_Serialize:	return L"serialize";
+	case ExecutionMode_Assemble:	return L"assemble";
+	case ExecutionMode_Load:		return L"load";
+	case ExecutionMode_Prepare:		return L"prepare";
+	}
+
+	return L"source";
+}
+
+
+//
+// Construct and initialize the benchmark runner
+//
+BenchmarkRunner::BenchmarkRunner(const std::wstring& workingdirectory, unsigned numruns)
+	: WorkingDirectory(workingdirectory),
+	  NumRuns(numruns ? numruns : 1)
+{
+	wchar_t filename[MAX_PATH];
+	if(!::GetModuleFileName(NULL, filename, MAX_PATH))
+		throw Exception("Failed to determine the location of the benchmark harness");
+
+	HarnessFileName = filename;
+}
+
+
+//
+// Run a benchmark program the requested number of times, and measure the results
+//
+BenchmarkResult BenchmarkRunner::Run(const Benchmark& benchmark, const std::wstring& programfile, ExecutionMode mode)
+{
+	BenchmarkResult result;
+	result.BenchmarkName = benchmark.Name;
+	result.Mode = mode;
+	result.Succeeded = true;
+	result.Seconds = 0.0;
+	result.OperationsPerSecond = 0.0;
+	result.PeakWorkingSet = 0;
+	result.PeakPrivateBytes = 0;
+
+	std::vector<double> timings;
+	for(unsigned i = 0; i < NumRuns; ++i)
+	{
+		double seconds;
+		PROCESS_MEMORY_COUNTERS memory;
+		if(!RunOnce(programfile, mode, seconds, memory))
+		{
+			result.Succeeded = false;
+			return result;
+		}
+
+		timings.push_back(seconds);
+		result.PeakWorkingSet = std::max(result.PeakWorkingSet, memory.PeakWorkingSetSize);
+		result.PeakPrivateBytes = std::max(result.PeakPrivateBytes, memory.PeakPagefileUsage);
+	}
+
+	std::sort(timings.begin(), timings.end());
+	result.Seconds = timings[timings.size() / 2];
+	if(result.Seconds > 0.0)
+		result.OperationsPerSecond = benchmark.OperationsPerRun / result.Seconds;
+
+	return result;
+}
+
+//
+// Profile the compilation and loading of a benchmark's source the requested
+// number of times, and measure each stage of the front end
+//
+// One result is produced for each stage. A failure in any run fails all
+// of the stages, just as a failed run fails a benchmark.
+//
+std::vector<BenchmarkResult> BenchmarkRunner::ProfileFrontEnd(const Benchmark& benchmark, const std::wstring& sourcefile)
+{
+	std::vector<BenchmarkResult> results;
+	for(int mode = ExecutionMode_Pass1; mode < NumExecutionModes; ++mode)
+	{
+		BenchmarkResult result;
+		result.BenchmarkName = benchmark.Name;
+		result.Mode = static_cast<ExecutionMode>(mode);
+		result.Succeeded = true;
+		result.Seconds = 0.0;
+		result.OperationsPerSecond = 0.0;
+		result.PeakWorkingSet = 0;
+		result.PeakPrivateBytes = 0;
+		results.push_back(result);
+	}
+
+	std::vector<std::vector<double> > timings(results.size());
+	std::wstring resultfile = WorkingDirectory + L"stages.txt";
+
+	for(unsigned i = 0; i < NumRuns; ++i)
+	{
+		::DeleteFile(resultfile.c_str());
+
+		PROCESS_MEMORY_COUNTERS memory;
+		if(!RunChild(FrontEndModeName, sourcefile, resultfile, memory))
+			break;
+
+		std::wifstream infile(resultfile.c_str());
+
+		std::wstring stagename;
+		double seconds;
+		SIZE_T peakworkingset, peakprivatebytes;
+		while(infile >> stagename >> seconds >> peakworkingset >> peakprivatebytes)
+		{
+			for(size_t j = 0; j < results.size(); ++j)
+			{
+				if(stagename != GetExecutionModeName(results[j].Mode))
+					continue;
+
+				timings[j].push_back(seconds);
+				results[j].PeakWorkingSet = std::max(results[j].PeakWorkingSet, peakworkingset);
+				results[j].PeakPrivateBytes = std::max(results[j].PeakPrivateBytes, peakprivatebytes);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		if(timings[i].size() < NumRuns)
+		{
+			results[i].Succeeded = false;
+			continue;
+		}
+
+		std::sort(timings[i].begin(), timings[i].end());
+		results[i].Seconds = timings[i][timings[i].size() / 2];
+		if(results[i].Seconds > 0.0)
+			results[i].OperationsPerSecond = benchmark.OperationsPerRun / results[i].Seconds;
+	}
+
+	return results;
+}
+
+//
+// Run a benchmark program once in a child process
+//
+// The child's console output is discarded, so that the output of the
+// benchmark programs does not interfere with the harness' own report.
+//
+bool BenchmarkRunner::RunOnce(const std::wstring& programfile, ExecutionMode mode, double& seconds, PROCESS_MEMORY_COUNTERS& memory)
+{
+	std::wstring resultfile = WorkingDirectory + L"result.txt";
+	::DeleteFile(resultfile.c_str());
+
+	if(!RunChild(GetExecutionModeName(mode), programfile, resultfile, memory))
+		return false;
+
+	std::ifstream infile(resultfile.c_str());
+	if(!(infile >> seconds))
+		return false;
+
+	return true;
+}
+
+//
+// Run a child process in the given mode, and wait for it to finish
+//
+// The child's console output is discarded. Returns true if the child
+// reported success; its peak memory usage is returned in any case.
+//
+bool BenchmarkRunner::RunChild(const std::wstring& modename, const std::wstring& programfile, const std::wstring& resultfile, PROCESS_MEMORY_COUNTERS& memory)
+{
+	::ZeroMemory(&memory, sizeof(memory));
+	memory.cb = sizeof(memory);
+
+	std::wstring commandline = Quote(HarnessFileName) + L" /child " + modename + L" " + Quote(programfile) + L" " + Quote(resultfile);
+	std::vector<wchar_t> commandlinebuffer(commandline.begin(), commandline.end());
+	commandlinebuffer.push_back(0);
+
+	SECURITY_ATTRIBUTES security;
+	security.nLength = sizeof(security);
+	security.lpSecurityDescriptor = NULL;
+	security.bInheritHandle = TRUE;
+
+	HANDLE nullfile = ::CreateFile(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &security, OPEN_EXISTING, 0, NULL);
+
+	STARTUPINFO startupinfo;
+	::ZeroMemory(&startupinfo, sizeof(startupinfo));
+	startupinfo.cb = sizeof(startupinfo);
+	startupinfo.dwFlags = STARTF_USESTDHANDLES;
+	startupinfo.hStdInput = ::GetStdHandle(STD_INPUT_HANDLE);
+	startupinfo.hStdOutput = nullfile;
+	startupinfo.hStdError = nullfile;
+
+	PROCESS_INFORMATION processinfo;
+	BOOL created = ::CreateProcess(NULL, &commandlinebuffer[0], NULL, NULL, TRUE, 0, NULL, WorkingDirectory.c_str(), &startupinfo, &processinfo);
+	::CloseHandle(nullfile);
+
+	if(!created)
+		return false;
+
+	::WaitForSingleObject(processinfo.hProcess, INFINITE);
+
+	DWORD exitcode = 1;
+	::GetExitCodeProcess(processinfo.hProcess, &exitcode);
+
+	::GetProcessMemoryInfo(processinfo.hProcess, &memory, sizeof(memory));
+
+	::CloseHandle(processinfo.hThread);
+	::CloseHandle(processinfo.hProcess);
+
+	return (exitcode == 0);
+}
+
+
+//
+// Entry point for child processes, which run a single benchmark program
+//
+// Expected parameters are the execution mode, the program file, and the
+// name of the file which receives the elapsed time.
+//
+int BenchmarkRunner::RunChildProcess(const std::vector<std::wstring>& params)
+{
+	if(params.size() < 5)
+		return 1;
+
+	const std::wstring& modename = params[2];
+	const std::wstring& programfile = params[3];
+	const std::wstring& resultfile = params[4];
+
+	if(modename == FrontEndModeName)
+		return RunFrontEndChildProcess(programfile, resultfile);
+
+	FugueVMDLLAccess vmaccess;
+
+	std::vector<Byte> binary;
+	if(modename == GetExecutionModeName(ExecutionMode_Binary))
+		LoadFile(programfile, binary);
+
+	LARGE_INTEGER frequency, start, end;
+	::QueryPerformanceFrequency(&frequency);
+	::QueryPerformanceCounter(&start);
+
+	bool succeeded;
+	if(binary.empty())
+		succeeded = vmaccess.ExecuteSourceCode(narrow(programfile).c_str());
+	else
+		succeeded = vmaccess.ExecuteBinaryBuffer(&binary[0]);
+
+	::QueryPerformanceCounter(&end);
+
+	if(!succeeded)
+		return 1;
+
+	std::ofstream outfile(resultfile.c_str(), std::ios::trunc);
+	outfile << std::setprecision(9) << (static_cast<double>(end.QuadPart - start.QuadPart) / static_cast<double>(frequency.QuadPart)) << std::endl;
+
+	return outfile ? 0 : 1;
+}
+
@@ -0,0 +1,101 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Logic for running benchmarks and measuring their performance
+//
+
+#pragma once
+
+
+// Forward declarations
+struct Benchmark;
+
+
+//
+// Ways in which a benchmark program can be executed
+//
+// Besides running the program, the compilation and loading of a program
+// can be profiled; each stage of the front end is then timed on its own
+// and reported as a mode of its own.
+//
+enum ExecutionMode
+{
+	ExecutionMode_Source,		// Parse and run the source via ExecuteSourceCode
+	ExecutionMode_Binary,		// Run a precompiled binary via ExecuteBinaryBuffer
+
+	ExecutionMode_Pass1,		// First parser pass, over the raw source
+	ExecutionMode_Pass2,		// Second parser pass, which builds the program
+	ExecutionMode_Validate,		// Static safety validation
+	ExecutionMode_Serialize,	// Serialization of the program into assembly code
+	ExecutionMode_Assemble,		// Assembly of the code into a binary by FugueASM
+	ExecutionMode_Load,			// Decoding of the binary by the bytecode loader
+	ExecutionMode_Prepare,		// Optimization of the loaded program, ready to run
+
+	NumExecutionModes
+};
+
+const wchar_t* GetExecutionModeName(ExecutionMode mode);
+
+
+//
+// Measurements taken for a single benchmark in a single mode
+//
+struct BenchmarkResult
+{
+	std::wstring BenchmarkName;
+	ExecutionMode Mode;
+	bool Succeeded;
+
+	double Seconds;
+	double OperationsPerSecond;
+
+	SIZE_T PeakWorkingSet;
+	SIZE_T PeakPrivateBytes;
+};
+
+
+//
+// Benchmark runner
+//
+// Every run takes place in a separate child process, so that each run
+// starts from a freshly loaded virtual machine and the peak memory usage
+// of each run can be measured in isolation. The child process times only
+// the call into the virtual machine, excluding process startup and the
+// loading of the DLL; the reported time is the median of all runs, and
+// the reported memory usage is the largest seen in any run.
+//
+// Front end profiles also run in child processes, one per run. Each of
+// the child's stages is timed separately, and the peak memory usage of
+// the child is sampled as each stage finishes. Since the results of the
+// earlier stages are still held in memory while later stages run, the
+// peak reported for a stage is that of the whole front end up to and
+// including the stage.
+//
+class BenchmarkRunner
+{
+// Construction
+public:
+	BenchmarkRunner(const std::wstring& workingdirectory, unsigned numruns);
+
+// Benchmark interface
+public:
+	BenchmarkResult Run(const Benchmark& benchmark, const std::wstring& programfile, ExecutionMode mode);
+	std::vector<BenchmarkResult> ProfileFrontEnd(const Benchmark& benchmark, const std::wstring& sourcefile);
+
+// Child process interface
+public:
+	static int RunChildProcess(const std::vector<std::wstring>& params);
+
+// Internal helpers
+private:
+	bool RunOnce(const std::wstring& programfile, ExecutionMode mode, double& seconds, PROCESS_MEMORY_COUNTERS& memory);
+	bool RunChild(const std::wstring& modename, const std::wstring& programfile, const std::wstring& resultfile, PROCESS_MEMORY_COUNTERS& memory);
+
+// Internal tracking
+private:
+	std::wstring WorkingDirectory;
+	std::wstring HarnessFileName;
+	unsigned NumRuns;
+};
+
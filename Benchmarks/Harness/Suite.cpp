@@ -0,0 +1,265 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Definitions of the benchmarks making up the suite
+//
+
+#include "pch.h"
+
+#include "Harness/Suite.h"
+
+#include "Utility/Threading/MachineInfo.h"
+#include "Utility/Strings.h"
+
+
+namespace
+{
+
+	//
+	// Helper for converting parameter values to text
+	//
+	template <typename T>
+	std::wstring ToString(T value)
+	{
+		std::wostringstream stream;
+		stream << value;
+		return stream.str();
+	}
+
+	//
+	// Build a comma separated list of integers, for initializing arrays
+	//
+	std::wstring MakeIntegerList(unsigned count)
+	{
+		std::wostringstream stream;
+		for(unsigned i = 0; i < count; ++i)
+		{
+			if(i)
+				stream << L", ";
+			stream << (i % 100);
+		}
+		return stream.str();
+	}
+
+	//
+	// Count the calls made by the naive recursive Fibonacci benchmark
+	//
+	double CountFibonacciCalls(unsigned n)
+	{
+		double previous = 1.0;
+		double current = 1.0;
+		for(unsigned i = 1; i < n; ++i)
+		{
+			double next = previous + current + 1.0;
+			previous = current;
+			current = next;
+		}
+		return current;
+	}
+
+	//
+	// Retrieve a numeric parameter of a generated benchmark
+	//
+	unsigned GetParameter(const Benchmark::ParameterMap& parameters, const std::wstring& name)
+	{
+		unsigned value = 0;
+		std::wistringstream(parameters.find(name)->second) >> value;
+		return value;
+	}
+
+	//
+	// Generate a large program, for measuring parsing and loading
+	//
+	// Each generated function contains a handful of declarations, an if
+	// statement, and some arithmetic, so that most of the grammar is
+	// exercised; the entry point calls every function once.
+	//
+	// Functions also declare an instance of one of the generated
+	// structures and work on its members, and build a nested expression
+	// DEPTH levels deep. The grammar has no parenthesized subexpressions,
+	// so the nesting is made of calls to a small leaf function, followed
+	// by a long chain of infix operators.
+	//
+	std::wstring GenerateLargeSource(const Benchmark::ParameterMap& parameters)
+	{
+		unsigned numfunctions = GetParameter(parameters, L"FUNCTIONS");
+		unsigned numstructures = GetParameter(parameters, L"STRUCTURES");
+		unsigned depth = GetParameter(parameters, L"DEPTH");
+
+		std::wostringstream source;
+		source << L"//\n// Generated source for the parse and load benchmark\n//\n\n";
+
+		for(unsigned i = 0; i < numstructures; ++i)
+			source << L"structure record" << i << L" : (integer(left), integer(right), integer(weight))\n";
+		source << L"\n";
+
+		source << L"leaf : (integer(x), integer(y)) -> (integer(r, 0))\n";
+		source << L"{\n\tr = x + y\n}\n\n";
+
+		for(unsigned i = 0; i < numfunctions; ++i)
+		{
+			source << L"generated" << i << L" : (integer(a), integer(b)) -> (integer(r, 0))\n";
+			source << L"{\n";
+			source << L"\tinteger(t, a * " << (i % 7 + 2) << L")\n";
+			if(numstructures)
+			{
+				source << L"\trecord" << (i % numstructures) << L"(s, a, b, t)\n";
+				source << L"\ts.weight = s.left + s.right\n";
+			}
+
+			source << L"\tinteger(e, ";
+			for(unsigned j = 0; j < depth; ++j)
+				source << L"leaf(";
+			source << L"t";
+			for(unsigned j = 0; j < depth; ++j)
+				source << L", " << j << L")";
+			source << L")\n";
+
+			source << L"\te = e";
+			for(unsigned j = 0; j < depth; ++j)
+				source << ((j % 2) ? L" - " : L" + ") << (numstructures ? L"s.weight" : L"a");
+			source << L"\n";
+
+			source << L"\tif(t > b)\n\t{\n\t\tr = t - b\n\t}\n";
+			source << L"\telse\n\t{\n\t\tr = b - t\n\t}\n";
+			source << L"\tr += " << i << L"\n";
+			source << L"}\n\n";
+		}
+
+		source << L"entrypoint : () -> ()\n{\n\tinteger(total, 0)\n";
+		for(unsigned i = 0; i < numfunctions; ++i)
+			source << L"\ttotal += generated" << i << L"(" << i << L", " << (numfunctions - i) << L")\n";
+		source << L"\tdebugwritestring(cast(string, total))\n}\n";
+
+		return source.str();
+	}
+
+
+	//
+	// Helpers for adding benchmarks to the suite
+	//
+	Benchmark& AddTemplate(BenchmarkList& benchmarks, const std::wstring& name, const std::wstring& templatefile, double operations)
+	{
+		Benchmark benchmark;
+		benchmark.Name = name;
+		benchmark.TemplateFileName = templatefile;
+		benchmark.OperationsPerRun = operations;
+		benchmarks.push_back(benchmark);
+		return benchmarks.back();
+	}
+
+	Benchmark& AddGenerated(BenchmarkList& benchmarks, const std::wstring& name, Benchmark::GeneratorFunction generator, double operations)
+	{
+		Benchmark benchmark;
+		benchmark.Name = name;
+		benchmark.Generator = generator;
+		benchmark.OperationsPerRun = operations;
+		benchmarks.push_back(benchmark);
+		return benchmarks.back();
+	}
+
+}
+
+
+//
+// Retrieve the full list of benchmarks
+//
+// Workload sizes are chosen so that each benchmark runs for a reasonable
+// fraction of a second on a release build; the parallel loop benchmark
+// is repeated for each power of two up to the number of processors, so
+// that its scaling can be tracked.
+//
+BenchmarkList Suite::GetBenchmarks()
+{
+	BenchmarkList benchmarks;
+
+	const unsigned arithmeticiterations = 1000000;
+	AddTemplate(benchmarks, L"arithmetic", L"Arithmetic.epoch", arithmeticiterations).Parameters[L"ITERATIONS"] = ToString(arithmeticiterations);
+
+	const unsigned fibonaccidepth = 24;
+	AddTemplate(benchmarks, L"recursion", L"Recursion.epoch", CountFibonacciCalls(fibonaccidepth)).Parameters[L"DEPTH"] = ToString(fibonaccidepth);
+
+	const unsigned concatenations = 20000;
+	AddTemplate(benchmarks, L"strings", L"Strings.epoch", concatenations).Parameters[L"ITERATIONS"] = ToString(concatenations);
+
+	const unsigned arrayelements = 1000;
+	const unsigned arraypasses = 200;
+	{
+		Benchmark& benchmark = AddTemplate(benchmarks, L"mapreduce", L"MapReduce.epoch", static_cast<double>(arrayelements) * arraypasses);
+		benchmark.Parameters[L"ELEMENTS"] = MakeIntegerList(arrayelements);
+		benchmark.Parameters[L"ITERATIONS"] = ToString(arraypasses);
+	}
+
+	const unsigned structureiterations = 500000;
+	AddTemplate(benchmarks, L"structures", L"Structures.epoch", structureiterations).Parameters[L"ITERATIONS"] = ToString(structureiterations);
+
+	const unsigned roundtrips = 20000;
+	AddTemplate(benchmarks, L"messages", L"Messages.epoch", roundtrips).Parameters[L"ITERATIONS"] = ToString(roundtrips);
+
+	const unsigned parallelchunks = 64;
+	const unsigned parallelinner = 20000;
+	for(unsigned threads = 1; ; threads *= 2)
+	{
+		if(threads > Threads::GetCPUCount())
+			threads = Threads::GetCPUCount();
+
+		Benchmark& benchmark = AddTemplate(benchmarks, L"parallelfor-" + ToString(threads), L"ParallelFor.epoch", static_cast<double>(parallelchunks) * parallelinner);
+		benchmark.Parameters[L"ITERATIONS"] = ToString(parallelchunks);
+		benchmark.Parameters[L"INNERITERATIONS"] = ToString(parallelinner);
+		benchmark.Parameters[L"THREADS"] = ToString(threads);
+
+		if(threads >= Threads::GetCPUCount())
+			break;
+	}
+
+	const unsigned externalcalls = 100000;
+	AddTemplate(benchmarks, L"calldll", L"CallDLL.epoch", externalcalls * 2.0).Parameters[L"ITERATIONS"] = ToString(externalcalls);
+
+	const unsigned generatedfunctions = 2000;
+	Benchmark& largesource = AddGenerated(benchmarks, L"largesource", GenerateLargeSource, generatedfunctions);
+	largesource.Parameters[L"FUNCTIONS"] = ToString(generatedfunctions);
+	largesource.Parameters[L"STRUCTURES"] = ToString(generatedfunctions / 10);
+	largesource.Parameters[L"DEPTH"] = ToString(8);
+	largesource.ProfileFrontEnd = true;
+
+	const unsigned hugefunctions = 10000;
+	Benchmark& hugesource = AddGenerated(benchmarks, L"hugesource", GenerateLargeSource, hugefunctions);
+	hugesource.Parameters[L"FUNCTIONS"] = ToString(hugefunctions);
+	hugesource.Parameters[L"STRUCTURES"] = ToString(hugefunctions / 10);
+	hugesource.Parameters[L"DEPTH"] = ToString(32);
+	hugesource.ProfileFrontEnd = true;
+
+	return benchmarks;
+}
+
+
+//
+// Produce the final source code for a benchmark
+//
+std::wstring Suite::PrepareSource(const Benchmark& benchmark, const std::wstring& programdirectory)
+{
+	if(benchmark.Generator)
+		return benchmark.Generator(benchmark.Parameters);
+
+	std::wifstream infile((programdirectory + benchmark.TemplateFileName).c_str());
+	if(!infile)
+		throw FileException("Failed to open benchmark program template " + narrow(programdirectory + benchmark.TemplateFileName));
+
+	std::wostringstream contents;
+	contents << infile.rdbuf();
+	std::wstring source = contents.str();
+
+	for(Benchmark::ParameterMap::const_iterator iter = benchmark.Parameters.begin(); iter != benchmark.Parameters.end(); ++iter)
+	{
+		std::wstring placeholder = L"@" + iter->first + L"@";
+		for(size_t pos = source.find(placeholder); pos != std::wstring::npos; pos = source.find(placeholder, pos + iter->second.length()))
+			source.replace(pos, placeholder.length(), iter->second);
+	}
+
+	if(source.find(L'@') != std::wstring::npos)
+		throw Exception("Benchmark program template " + narrow(benchmark.TemplateFileName) + " contains an unknown placeholder");
+
+	return source;
+}
+
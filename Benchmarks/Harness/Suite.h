@@ -0,0 +1,56 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Definitions of the benchmarks making up the suite
+//
+
+#pragma once
+
+
+//
+// Description of a single benchmark
+//
+// Each benchmark is an Epoch program, either taken from a template in
+// the programs directory or produced by a generator. Templates contain
+// placeholders of the form @NAME@, which are replaced by the given
+// parameter values before the program is run; this allows the same
+// template to be run at several different sizes.
+//
+struct Benchmark
+{
+	typedef std::map<std::wstring, std::wstring> ParameterMap;
+	typedef std::wstring (*GeneratorFunction)(const ParameterMap& parameters);
+
+	Benchmark()
+		: Generator(NULL),
+		  OperationsPerRun(0.0),
+		  ProfileFrontEnd(false)
+	{ }
+
+	std::wstring Name;
+	std::wstring TemplateFileName;
+	GeneratorFunction Generator;
+	ParameterMap Parameters;
+
+	// Number of units of work (loop iterations, calls, messages...)
+	// performed by one run, used for reporting throughput
+	double OperationsPerRun;
+
+	// Whether the individual stages of compiling and loading the
+	// program should also be timed; see BenchmarkRunner::ProfileFrontEnd
+	bool ProfileFrontEnd;
+};
+
+typedef std::vector<Benchmark> BenchmarkList;
+
+
+namespace Suite
+{
+
+	BenchmarkList GetBenchmarks();
+
+	std::wstring PrepareSource(const Benchmark& benchmark, const std::wstring& programdirectory);
+
+}
+
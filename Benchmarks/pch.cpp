@@ -0,0 +1,12 @@
+//
+// The Epoch Language Project
+// Benchmark Suite
+//
+// Precompiled header generator stub.
+//
+// The compiler builds this file (and only this file) in order to
+// generate the precompiled header, which is then used by all the
+// other code modules.
+//
+
+#include "pch.h"
@@ -24,9 +24,13 @@ FugueASMDLLAccess::FugueASMDLLAccess()
 	// Obtain interface into DLL
 	DoAssemble = reinterpret_cast<DoAssemblePtr>(::GetProcAddress(DLLHandle, "DoAssemble"));
 	DoDisassemble = reinterpret_cast<DoDisassemblePtr>(::GetProcAddress(DLLHandle, "DoDisassemble"));
+	DoAssembleBuffer = reinterpret_cast<DoAssembleBufferPtr>(::GetProcAddress(DLLHandle, "DoAssembleBuffer"));
+	DoDisassembleParallel = reinterpret_cast<DoDisassemblePtr>(::GetProcAddress(DLLHandle, "DoDisassembleParallel"));
+	DoAssembleToMemory = reinterpret_cast<DoAssembleToMemoryPtr>(::GetProcAddress(DLLHandle, "DoAssembleToMemory"));
+	DoDisassembleBuffer = reinterpret_cast<DoDisassembleBufferPtr>(::GetProcAddress(DLLHandle, "DoDisassembleBuffer"));
 
 	// Validate interface to be sure
-	if(!DoAssemble || !DoDisassemble)
+	if(!DoAssemble || !DoDisassemble || !DoAssembleBuffer || !DoDisassembleParallel || !DoAssembleToMemory || !DoDisassembleBuffer)
 		throw DLLAccessException(L"One or more Epoch service functions could not be loaded from FugueASM.DLL; please ensure the latest version of Fugue is present.");
 }
 
@@ -46,6 +50,14 @@ bool FugueASMDLLAccess::Assemble(const char* filename, const char* outputfilenam
 	return DoAssemble(filename, outputfilename);
 }
 
+//
+// Invoke the DLL function to assemble Epoch ASM code held in memory into Epoch Binary format
+//
+bool FugueASMDLLAccess::AssembleBuffer(const wchar_t* assembly, size_t length, const char* outputfilename)
+{
+	return DoAssembleBuffer(assembly, length, outputfilename);
+}
+
 //
 // Invoke the DLL function to disassemble Epoch Binary code back to Epoch ASM format
 //
@@ -54,3 +66,52 @@ bool FugueASMDLLAccess::Disassemble(const char* filename, const char* outputfile
 	return DoDisassemble(filename, outputfilename);
 }
 
+//
+// Invoke the DLL function to disassemble Epoch Binary code, translating functions on multiple threads
+//
+bool FugueASMDLLAccess::DisassembleParallel(const char* filename, const char* outputfilename)
+{
+	return DoDisassembleParallel(filename, outputfilename);
+}
+
+
+//
+// Invoke the DLL function to assemble Epoch ASM code held in memory into a binary held in memory
+//
+bool FugueASMDLLAccess::AssembleToMemory(const wchar_t* assembly, size_t length, std::vector<unsigned char>& binary)
+{
+	binary.clear();
+	return DoAssembleToMemory(assembly, length, &FugueASMDLLAccess::StoreBinary, &binary);
+}
+
+//
+// Invoke the DLL function to disassemble a binary held in memory back to Epoch ASM format
+//
+bool FugueASMDLLAccess::DisassembleBuffer(const void* binary, size_t size, bool parallel, std::wstring& assembly)
+{
+	assembly.clear();
+	return DoDisassembleBuffer(binary, size, parallel, &FugueASMDLLAccess::StoreAssembly, &assembly);
+}
+
+//
+// Callback invoked by the assembler DLL with the assembled binary
+//
+bool __stdcall FugueASMDLLAccess::StoreBinary(const unsigned char* binary, size_t size, void* userdata)
+{
+	std::vector<unsigned char>* storage = reinterpret_cast<std::vector<unsigned char>*>(userdata);
+	if(size)
+		storage->assign(binary, binary + size);
+
+	return true;
+}
+
+//
+// Callback invoked by the assembler DLL with the disassembled code
+//
+bool __stdcall FugueASMDLLAccess::StoreAssembly(const wchar_t* assembly, size_t length, void* userdata)
+{
+	std::wstring* storage = reinterpret_cast<std::wstring*>(userdata);
+	storage->assign(assembly, length);
+
+	return true;
+}
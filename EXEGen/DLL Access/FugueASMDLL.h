@@ -18,12 +18,27 @@ public:
 // Assembler DLL interface
 public:
 	bool Assemble(const char* filename, const char* outputfilename);
+	bool AssembleBuffer(const wchar_t* assembly, size_t length, const char* outputfilename);
 	bool Disassemble(const char* filename, const char* outputfilename);
+	bool DisassembleParallel(const char* filename, const char* outputfilename);
+
+	bool AssembleToMemory(const wchar_t* assembly, size_t length, std::vector<unsigned char>& binary);
+	bool DisassembleBuffer(const void* binary, size_t size, bool parallel, std::wstring& assembly);
 
 // Internal type definitions for function pointers
 private:
 	typedef bool (__stdcall *DoAssemblePtr)(const char*, const char*);
 	typedef bool (__stdcall *DoDisassemblePtr)(const char*, const char*);
+	typedef bool (__stdcall *DoAssembleBufferPtr)(const wchar_t*, size_t, const char*);
+	typedef bool (__stdcall *BinaryCallbackPtr)(const unsigned char*, size_t, void*);
+	typedef bool (__stdcall *AssemblyCallbackPtr)(const wchar_t*, size_t, void*);
+	typedef bool (__stdcall *DoAssembleToMemoryPtr)(const wchar_t*, size_t, BinaryCallbackPtr, void*);
+	typedef bool (__stdcall *DoDisassembleBufferPtr)(const void*, size_t, bool, AssemblyCallbackPtr, void*);
+
+// Internal helpers
+private:
+	static bool __stdcall StoreBinary(const unsigned char* binary, size_t size, void* userdata);
+	static bool __stdcall StoreAssembly(const wchar_t* assembly, size_t length, void* userdata);
 
 // Internal bindings to the DLL
 private:
@@ -31,4 +46,8 @@ private:
 
 	DoAssemblePtr DoAssemble;
 	DoDisassemblePtr DoDisassemble;
+	DoDisassemblePtr DoDisassembleParallel;
+	DoAssembleBufferPtr DoAssembleBuffer;
+	DoAssembleToMemoryPtr DoAssembleToMemory;
+	DoDisassembleBufferPtr DoDisassembleBuffer;
 };
@@ -8,6 +8,7 @@
 #include "pch.h"
 
 #include "DLL Access/FugueVMDLL.h"
+#include "DLL Access/FugueASMDLL.h"
 #include "DLL Access/Exceptions.h"
 
 
@@ -26,9 +27,18 @@ FugueVMDLLAccess::FugueVMDLLAccess()
 	ExecBinary = reinterpret_cast<ExecuteBinaryFilePtr>(::GetProcAddress(DLLHandle, "ExecuteBinaryFile"));
 	ExecBuffer = reinterpret_cast<ExecuteBinaryBufferPtr>(::GetProcAddress(DLLHandle, "ExecuteBinaryBuffer"));
 	SerializeSource = reinterpret_cast<SerializeSourceCodePtr>(::GetProcAddress(DLLHandle, "SerializeSourceCode"));
+	SerializeSourceToMemory = reinterpret_cast<SerializeSourceCodeToMemoryPtr>(::GetProcAddress(DLLHandle, "SerializeSourceCodeToMemory"));
+
+	// Ahead of time compilation is optional, so older DLLs without it are still accepted
+	GenNativeImage = reinterpret_cast<GenerateNativeImagePtr>(::GetProcAddress(DLLHandle, "GenerateNativeImage"));
+
+	// Likewise for the diagnostics used by the benchmark suite
+	RunPrimitives = reinterpret_cast<RunPrimitiveBenchmarksPtr>(::GetProcAddress(DLLHandle, "RunPrimitiveBenchmarks"));
+	ProfileCompile = reinterpret_cast<ProfileCompilationPtr>(::GetProcAddress(DLLHandle, "ProfileCompilation"));
+	ProfileLoad = reinterpret_cast<ProfileLoadingPtr>(::GetProcAddress(DLLHandle, "ProfileLoading"));
 
 	// Validate interface to be sure
-	if(!ExecSource || !ExecBinary || !SerializeSource)
+	if(!ExecSource || !ExecBinary || !SerializeSource || !SerializeSourceToMemory)
 		throw DLLAccessException(L"One or more Epoch service functions could not be loaded from FugueDLL.DLL; please ensure the latest version of Fugue is present.");
 }
 
@@ -72,3 +82,136 @@ bool FugueVMDLLAccess::SerializeSourceCode(const char* filename, const char* out
 	return SerializeSource(filename, outputfilename, usesconsole);
 }
 
+
+namespace
+{
+	//
+	// Parameters handed through the VM DLL to the assembly callback
+	//
+	// If a binary buffer is given, the assembled code is stored there
+	// instead of being written to the named file.
+	//
+	struct AssembleRequest
+	{
+		FugueASMDLLAccess* ASMAccess;
+		const char* BinaryFileName;
+		std::vector<unsigned char>* Binary;
+	};
+}
+
+//
+// Compile source code directly into a binary file
+//
+// The assembly code produced by the VM is passed to the assembler in
+// memory, so no intermediate assembly file is written to disk.
+//
+bool FugueVMDLLAccess::CompileToBinary(const char* filename, const char* binaryfilename, bool usesconsole, FugueASMDLLAccess& asmaccess)
+{
+	AssembleRequest request;
+	request.ASMAccess = &asmaccess;
+	request.BinaryFileName = binaryfilename;
+	request.Binary = NULL;
+	return SerializeSourceToMemory(filename, usesconsole, &FugueVMDLLAccess::AssembleSerializedCode, &request);
+}
+
+//
+// Compile source code into a binary held in memory
+//
+// Neither the assembly code nor the binary is written to disk.
+//
+bool FugueVMDLLAccess::CompileToMemory(const char* filename, bool usesconsole, FugueASMDLLAccess& asmaccess, std::vector<unsigned char>& binary)
+{
+	AssembleRequest request;
+	request.ASMAccess = &asmaccess;
+	request.BinaryFileName = NULL;
+	request.Binary = &binary;
+	return SerializeSourceToMemory(filename, usesconsole, &FugueVMDLLAccess::AssembleSerializedCode, &request);
+}
+
+//
+// Callback invoked by the VM DLL with the serialized assembly code
+//
+bool __stdcall FugueVMDLLAccess::AssembleSerializedCode(const wchar_t* assembly, size_t length, void* userdata)
+{
+	AssembleRequest* request = reinterpret_cast<AssembleRequest*>(userdata);
+	if(request->Binary)
+		return request->ASMAccess->AssembleToMemory(assembly, length, *request->Binary);
+
+	return request->ASMAccess->AssembleBuffer(assembly, length, request->BinaryFileName);
+}
+
+
+//
+// Compile the functions of a binary file into native code ahead of time
+//
+// The resulting image is empty if no function could be compiled.
+//
+bool FugueVMDLLAccess::GenerateNativeImage(const char* binaryfilename, std::vector<unsigned char>& image)
+{
+	if(!GenNativeImage)
+		throw DLLAccessException(L"The loaded FugueDLL.DLL cannot compile native code; please ensure the latest version of Fugue is present.");
+
+	image.clear();
+	return GenNativeImage(binaryfilename, &FugueVMDLLAccess::StoreNativeImage, &image);
+}
+
+//
+// Callback invoked by the VM DLL with the native code image
+//
+bool __stdcall FugueVMDLLAccess::StoreNativeImage(const unsigned char* image, size_t size, void* userdata)
+{
+	std::vector<unsigned char>* storage = reinterpret_cast<std::vector<unsigned char>*>(userdata);
+	if(size)
+		storage->assign(image, image + size);
+
+	return true;
+}
+
+
+//
+// Run the VM's microbenchmarks of its threading and memory primitives
+//
+// The callback receives each result as it is measured.
+//
+bool FugueVMDLLAccess::RunPrimitiveBenchmarks(unsigned maxthreads, PrimitiveBenchmarkCallbackPtr callback, void* userdata)
+{
+	if(!RunPrimitives)
+		throw DLLAccessException(L"The loaded FugueDLL.DLL cannot run primitive benchmarks; please ensure the latest version of Fugue is present.");
+
+	return RunPrimitives(maxthreads, callback, userdata);
+}
+
+//
+// Compile source code to assembly code, timing each stage of the front end
+//
+// The callback receives the time taken by each stage as it finishes.
+//
+bool FugueVMDLLAccess::ProfileCompilation(const char* filename, StageTimingCallbackPtr stagecallback, void* userdata, std::wstring& assembly)
+{
+	if(!ProfileCompile)
+		throw DLLAccessException(L"The loaded FugueDLL.DLL cannot profile compilation; please ensure the latest version of Fugue is present.");
+
+	assembly.clear();
+	return ProfileCompile(filename, stagecallback, userdata, &FugueVMDLLAccess::StoreSerializedCode, &assembly);
+}
+
+//
+// Load a binary program without running it, timing each stage of loading
+//
+bool FugueVMDLLAccess::ProfileLoading(const void* buffer, StageTimingCallbackPtr stagecallback, void* userdata)
+{
+	if(!ProfileLoad)
+		throw DLLAccessException(L"The loaded FugueDLL.DLL cannot profile loading; please ensure the latest version of Fugue is present.");
+
+	return ProfileLoad(buffer, stagecallback, userdata);
+}
+
+//
+// Callback invoked by the VM DLL with the serialized assembly code
+//
+bool __stdcall FugueVMDLLAccess::StoreSerializedCode(const wchar_t* assembly, size_t length, void* userdata)
+{
+	reinterpret_cast<std::wstring*>(userdata)->assign(assembly, length);
+	return true;
+}
+
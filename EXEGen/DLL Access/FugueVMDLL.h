@@ -8,6 +8,10 @@
 #pragma once
 
 
+// Forward declarations
+class FugueASMDLLAccess;
+
+
 class FugueVMDLLAccess
 {
 // Construction and destruction
@@ -21,6 +25,20 @@ public:
 	bool ExecuteBinaryFile(const char* filename);
 	bool ExecuteBinaryBuffer(const void* buffer);
 	bool SerializeSourceCode(const char* filename, const char* outputfilename, bool usesconsole);
+	bool CompileToBinary(const char* filename, const char* binaryfilename, bool usesconsole, FugueASMDLLAccess& asmaccess);
+	bool CompileToMemory(const char* filename, bool usesconsole, FugueASMDLLAccess& asmaccess, std::vector<unsigned char>& binary);
+	bool GenerateNativeImage(const char* binaryfilename, std::vector<unsigned char>& image);
+
+// Diagnostics interface
+public:
+	typedef void (__stdcall *PrimitiveBenchmarkCallbackPtr)(const wchar_t* name, unsigned numthreads, unsigned __int64 numoperations, double milliseconds, void* userdata);
+
+	bool RunPrimitiveBenchmarks(unsigned maxthreads, PrimitiveBenchmarkCallbackPtr callback, void* userdata);
+
+	typedef void (__stdcall *StageTimingCallbackPtr)(const wchar_t* stagename, double milliseconds, void* userdata);
+
+	bool ProfileCompilation(const char* filename, StageTimingCallbackPtr stagecallback, void* userdata, std::wstring& assembly);
+	bool ProfileLoading(const void* buffer, StageTimingCallbackPtr stagecallback, void* userdata);
 
 // Internal type definitions for function pointers
 private:
@@ -28,6 +46,19 @@ private:
 	typedef bool (__stdcall *ExecuteBinaryFilePtr)(const char*);
 	typedef bool (__stdcall *ExecuteBinaryBufferPtr)(const void*);
 	typedef bool (__stdcall *SerializeSourceCodePtr)(const char*, const char*, bool);
+	typedef bool (__stdcall *SerializedCodeCallbackPtr)(const wchar_t*, size_t, void*);
+	typedef bool (__stdcall *SerializeSourceCodeToMemoryPtr)(const char*, bool, SerializedCodeCallbackPtr, void*);
+	typedef bool (__stdcall *NativeImageCallbackPtr)(const unsigned char*, size_t, void*);
+	typedef bool (__stdcall *GenerateNativeImagePtr)(const char*, NativeImageCallbackPtr, void*);
+	typedef bool (__stdcall *RunPrimitiveBenchmarksPtr)(unsigned, PrimitiveBenchmarkCallbackPtr, void*);
+	typedef bool (__stdcall *ProfileCompilationPtr)(const char*, StageTimingCallbackPtr, void*, SerializedCodeCallbackPtr, void*);
+	typedef bool (__stdcall *ProfileLoadingPtr)(const void*, StageTimingCallbackPtr, void*);
+
+// Internal helpers
+private:
+	static bool __stdcall AssembleSerializedCode(const wchar_t* assembly, size_t length, void* userdata);
+	static bool __stdcall StoreNativeImage(const unsigned char* image, size_t size, void* userdata);
+	static bool __stdcall StoreSerializedCode(const wchar_t* assembly, size_t length, void* userdata);
 
 // Internal bindings to the DLL
 private:
@@ -37,4 +68,9 @@ private:
 	ExecuteBinaryFilePtr ExecBinary;
 	ExecuteBinaryBufferPtr ExecBuffer;
 	SerializeSourceCodePtr SerializeSource;
+	SerializeSourceCodeToMemoryPtr SerializeSourceToMemory;
+	GenerateNativeImagePtr GenNativeImage;
+	RunPrimitiveBenchmarksPtr RunPrimitives;
+	ProfileCompilationPtr ProfileCompile;
+	ProfileLoadingPtr ProfileLoad;
 };
@@ -27,6 +27,8 @@
 
 #include "Debugging/EXEDebugger.h"
 
+#include "Parse Cache/ParseCache.h"
+
 
 // Prototypes
 namespace
@@ -103,6 +105,7 @@ namespace
 		output << L"\nEPOCH ASSEMBLY LANGUAGE UTILITIES\n";
 		output << L"   Exegen.exe /assemble c:\\path\\to\\assembly.easm c:\\path\\to\\output.epb\n";
 		output << L"   Exegen.exe /disassemble c:\\path\\to\\binary.epb c:\\path\\to\\output.easm\n";
+		output << L"   Exegen.exe /disassemble c:\\path\\to\\binary.epb c:\\path\\to\\output.easm /parallel\n";
 
 		output << L"\nExegen can also be passed wildcards to process all matching files in a\n";
 		output << L"directory. In this mode, the output parameter must be a path to a directory\n";
@@ -121,6 +124,29 @@ namespace
 	}
 
 
+	//
+	// Helpers for moving compiled binaries between memory and disk
+	//
+	void ReadBinaryFile(const std::wstring& filename, std::vector<unsigned char>& binary)
+	{
+		std::ifstream infile(narrow(filename).c_str(), std::ios::binary);
+		if(!infile)
+			throw Exception("Failed to open binary file:\n" + narrow(filename));
+
+		binary.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+	}
+
+	void WriteBinaryFile(const std::wstring& filename, const std::vector<unsigned char>& binary)
+	{
+		std::ofstream outfile(narrow(filename).c_str(), std::ios::binary);
+		if(!outfile)
+			throw Exception("Failed to create binary file:\n" + narrow(filename));
+
+		if(!binary.empty())
+			outfile.write(reinterpret_cast<const char*>(&binary[0]), static_cast<std::streamsize>(binary.size()));
+	}
+
+
 	//
 	// Helper functions for analyzing the command line and validating the input
 	//
@@ -179,7 +205,7 @@ namespace
 	//
 	// Helper for batching calls to /execsource
 	//
-	void ExecuteSource(const std::wstring& inpath, FugueVMDLLAccess& vmaccess)
+	void ExecuteSource(const std::wstring& inpath, FugueVMDLLAccess& vmaccess, FugueASMDLLAccess& asmaccess)
 	{
 		unsigned success = 0;
 		unsigned count = 0;
@@ -204,7 +230,14 @@ namespace
 		do
 		{
 			std::wstring filename = inpathstripped + data.cFileName;
-			if(vmaccess.ExecuteSourceCode(narrow(filename).c_str()))
+
+			bool executed;
+			if(Config::CacheParsedSources)
+				executed = ParseCache::ExecuteSourceCode(filename, vmaccess, asmaccess);
+			else
+				executed = vmaccess.ExecuteSourceCode(narrow(filename).c_str());
+
+			if(executed)
 				++success;
 
 			++count;
@@ -342,7 +375,7 @@ namespace
 	//
 	// Helper for batching disassemble commands
 	//
-	void Disassemble(const std::wstring& inpath, const std::wstring& outpath, FugueASMDLLAccess& asmaccess)
+	void Disassemble(const std::wstring& inpath, const std::wstring& outpath, bool parallel, FugueASMDLLAccess& asmaccess)
 	{
 		unsigned success = 0;
 		unsigned count = 0;
@@ -368,7 +401,13 @@ namespace
 		{
 			std::wstring filename = inpathstripped + data.cFileName;
 			std::wstring outfilename = (HasWildcards(inpath) ? outpath + StripExtension(data.cFileName) + L".easm" : outpath);
-			if(asmaccess.Disassemble(narrow(filename).c_str(), narrow(outfilename).c_str()))
+			bool disassembled;
+			if(parallel)
+				disassembled = asmaccess.DisassembleParallel(narrow(filename).c_str(), narrow(outfilename).c_str());
+			else
+				disassembled = asmaccess.Disassemble(narrow(filename).c_str(), narrow(outfilename).c_str());
+
+			if(disassembled)
 				++success;
 			++count;
 		} while(::FindNextFile(resulthandle, &data));
@@ -382,19 +421,52 @@ namespace
 	//
 	// Helper function for taking a project wrapper object and generating the corresponding .EXE
 	//
+	// Each source file is compiled straight to a binary in memory, which
+	// the linker then embeds; intermediate files are only written when
+	// assembly listings are requested for debugging, or when something
+	// else needs to read the binary from disk.
+	//
 	void BuildProject(Projects::Project& project, FugueVMDLLAccess& vmaccess, FugueASMDLLAccess& asmaccess)
 	{
+		// Only the first source file's bytecode is embedded
+		std::vector<unsigned char> bytecode;
+
 		const std::list<std::wstring>& sourcefiles = project.GetSourceFileList();
 		for(std::list<std::wstring>::const_iterator iter = sourcefiles.begin(); iter != sourcefiles.end(); ++iter)
 		{
-			if(!Compile(*iter, project.GetIntermediatesPath() + StripPath(StripExtension(*iter)) + L".easm", vmaccess, project.GetUsesConsoleFlag()))
+			std::wstring intermediatename = project.GetIntermediatesPath() + StripPath(StripExtension(*iter));
+			std::vector<unsigned char> binary;
+
+			if(Config::KeepAssemblyListings)
+			{
+				if(!Compile(*iter, intermediatename + L".easm", vmaccess, project.GetUsesConsoleFlag()))
+					return;
+
+				if(!Assemble(intermediatename + L".easm", intermediatename + L".epb", asmaccess))
+					return;
+
+				ReadBinaryFile(intermediatename + L".epb", binary);
+			}
+			else if(!vmaccess.CompileToMemory(narrow(*iter).c_str(), project.GetUsesConsoleFlag(), asmaccess, binary))
 				return;
 
-			if(!Assemble(project.GetIntermediatesPath() + StripPath(StripExtension(*iter)) + L".easm", project.GetIntermediatesPath() + StripPath(StripExtension(*iter)) + L".epb", asmaccess))
+			if(iter == sourcefiles.begin())
+				bytecode.swap(binary);
+		}
+
+		// Only the embedded bytecode is precompiled; the VM reads it from disk to do so
+		std::vector<unsigned char> nativeimage;
+		if(Config::EmbedNativeCode)
+		{
+			std::wstring binaryfilename = project.GetBinaryFileName(*sourcefiles.begin());
+			if(!Config::KeepAssemblyListings)
+				WriteBinaryFile(binaryfilename, bytecode);
+
+			if(!vmaccess.GenerateNativeImage(narrow(binaryfilename).c_str(), nativeimage))
 				return;
 		}
-		
-		Linker link(project);
+
+		Linker link(project, bytecode, nativeimage);
 		link.GenerateSections();
 		link.CommitFile();
 	}
@@ -451,7 +523,7 @@ namespace
 			if(!VerifyCommandLine(params, false))
 				return;
 
-			ExecuteSource(params[2], vmaccess);
+			ExecuteSource(params[2], vmaccess, asmaccess);
 		}
 		else if(commandswitch == L"/execbinary")
 		{
@@ -515,7 +587,16 @@ namespace
 			if(!VerifyCommandLine(params, true))
 				return;
 
-			Disassemble(params[2], params[3], asmaccess);
+			bool parallel = false;
+			if(params.size() > 4)
+			{
+				if(params[4] == L"/parallel")
+					parallel = true;
+				else
+					throw Exception("Invalid option; the only supported disassembly option is /parallel");
+			}
+
+			Disassemble(params[2], params[3], parallel, asmaccess);
 		}
 		else if(commandswitch == L"/debug")
 		{
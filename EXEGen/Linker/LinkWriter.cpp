@@ -16,7 +16,7 @@
 //
 // Construct and initialize the file writer wrapper
 //
-LinkWriter::LinkWriter(std::ofstream& outputstream)
+LinkWriter::LinkWriter(std::ostream& outputstream)
 	: OutputStream(outputstream)
 {
 }
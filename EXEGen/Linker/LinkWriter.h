@@ -16,7 +16,7 @@ class LinkWriter
 {
 // Construction
 public:
-	explicit LinkWriter(std::ofstream& outputstream);
+	explicit LinkWriter(std::ostream& outputstream);
 
 // Writing interface
 public:
@@ -34,7 +34,7 @@ public:
 
 // Internal tracking
 private:
-	std::ofstream &OutputStream;
+	std::ostream &OutputStream;
 };
 
 
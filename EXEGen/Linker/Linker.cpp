@@ -16,12 +16,13 @@
 #include "Section Managers/Data.h"
 #include "Section Managers/Resources.h"
 #include "Section Managers/EpochData.h"
+#include "Section Managers/NativeCode.h"
 
 #include "Embedded Resources/EmbeddedStrings.h"
 
 #include "Project Files/Project.h"
 
-#include <boost/filesystem/operations.hpp>
+#include "Configuration/RuntimeOptions.h"
 
 
 //-------------------------------------------------------------------------------
@@ -40,7 +41,12 @@ const DWORD Linker::ImageBaseAddress = 0x400000;
 //
 // Construct and initialize the link operation manager
 //
-Linker::Linker(const Projects::Project& project)
+// The bytecode is the binary of the project's first source file, which
+// is embedded in the executable. The native code image holds precompiled
+// code for the program's functions; if it is empty, the program is only
+// ever interpreted.
+//
+Linker::Linker(const Projects::Project& project, const std::vector<unsigned char>& bytecode, const std::vector<unsigned char>& nativeimage)
 	: TheProject(project),
 
 	  CodeSize(0),
@@ -74,7 +80,9 @@ Linker::Linker(const Projects::Project& project)
 	SectionManagers.push_back(new Resources(*this));
 	TheResourceManager = dynamic_cast<Resources*>(SectionManagers.back());
 
-	SectionManagers.push_back(new EpochCode(TheProject.GetBinaryFileName(*TheProject.GetSourceFileList().begin())));
+	SectionManagers.push_back(new EpochCode(bytecode));
+
+	SectionManagers.push_back(new NativeCode(nativeimage));
 }
 
 //
@@ -104,21 +112,99 @@ void Linker::GenerateSections()
 //
 // Output the final linked file to disk
 //
+// The complete image is produced in memory first. In incremental mode,
+// an existing output file is then patched in place where possible, so
+// that sections which have not changed since the last build are not
+// written again.
+//
 void Linker::CommitFile()
 {
+	if(TheProject.GetUsesConsoleFlag())
+		HeaderManager->SetConsoleMode();
+
+	std::ostringstream imagestream(std::ios::out | std::ios::binary);
+	imagestream.unsetf(std::ios::skipws);
+
+	LinkWriter writer(imagestream);
+
+	for(std::list<LinkerSectionManager*>::iterator iter = SectionManagers.begin(); iter != SectionManagers.end(); ++iter)
+		(*iter)->Emit(*this, writer);
+
+	std::string image = imagestream.str();
+	if(Config::IncrementalLinking && PatchExistingFile(image))
+	{
+		std::wcout << L"Updated existing executable in place\n";
+		return;
+	}
+
 	std::ofstream outstream((TheProject.GetQualifiedOutputFilename()).c_str(), std::ios::binary);
 	if(!outstream)
 		throw FileException("Cannot open output file for writing");
 
-	outstream.unsetf(std::ios::skipws);
+	outstream.write(image.data(), static_cast<std::streamsize>(image.length()));
+	if(!outstream)
+		throw FileException("Failed to write output file");
+}
 
-	if(TheProject.GetUsesConsoleFlag())
-		HeaderManager->SetConsoleMode();
+//
+// Bring an existing executable up to date with the given image
+//
+// Only runs of bytes which differ from the existing file are written,
+// and the file is then cut to the length of the new image. When only
+// the bytecode has changed, this leaves the resource, thunk and code
+// sections untouched on disk. Returns false if there is no existing
+// file to patch, in which case the caller writes the file normally.
+//
+bool Linker::PatchExistingFile(const std::string& image) const
+{
+	HANDLE file = ::CreateFile(TheProject.GetQualifiedOutputFilename().c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
 
-	LinkWriter writer(outstream);
+	try
+	{
+		DWORD existingsize = ::GetFileSize(file, NULL);
+		if(existingsize == INVALID_FILE_SIZE)
+			throw FileException("Cannot determine size of existing output file");
+
+		std::vector<char> existing(existingsize + 1);
+		DWORD bytesread = 0;
+		if(!::ReadFile(file, &existing[0], existingsize, &bytesread, NULL) || bytesread != existingsize)
+			throw FileException("Cannot read existing output file");
+
+		size_t offset = 0;
+		while(offset < image.length())
+		{
+			if(offset < existingsize && existing[offset] == image[offset])
+			{
+				++offset;
+				continue;
+			}
+
+			size_t runend = offset + 1;
+			while(runend < image.length() && (runend >= existingsize || existing[runend] != image[runend]))
+				++runend;
+
+			DWORD byteswritten = 0;
+			DWORD runlength = static_cast<DWORD>(runend - offset);
+			if(::SetFilePointer(file, static_cast<LONG>(offset), NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER
+			|| !::WriteFile(file, image.data() + offset, runlength, &byteswritten, NULL) || byteswritten != runlength)
+				throw FileException("Failed to patch existing output file");
+
+			offset = runend;
+		}
+
+		if(::SetFilePointer(file, static_cast<LONG>(image.length()), NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER || !::SetEndOfFile(file))
+			throw FileException("Failed to resize existing output file");
+	}
+	catch(...)
+	{
+		::CloseHandle(file);
+		throw;
+	}
 
-	for(std::list<LinkerSectionManager*>::iterator iter = SectionManagers.begin(); iter != SectionManagers.end(); ++iter)
-		(*iter)->Emit(*this, writer);
+	::CloseHandle(file);
+	return true;
 }
 
 
@@ -169,15 +255,6 @@ DWORD Linker::GetBaseAddress() const
 	return ImageBaseAddress;
 }
 
-//
-// Determine how much space the Epoch bytecode consumes
-//
-DWORD Linker::GetEpochCodeSize() const
-{
-	boost::intmax_t size = boost::filesystem::file_size(TheProject.GetBinaryFileName(*TheProject.GetSourceFileList().begin()));
-	return RoundUpToFilePadding(static_cast<DWORD>(size));
-}
-
 
 //
 // Round a given value up to the nearest multiple of the file padding size
@@ -51,7 +51,7 @@ class Linker
 {
 // Construction and destruction
 public:
-	Linker(const Projects::Project& project);
+	Linker(const Projects::Project& project, const std::vector<unsigned char>& bytecode, const std::vector<unsigned char>& nativeimage);
 	~Linker();
 
 // EXE generation interface
@@ -59,6 +59,10 @@ public:
 	void GenerateSections();
 	void CommitFile();
 
+// Internal helpers
+private:
+	bool PatchExistingFile(const std::string& image) const;
+
 // Access to the controlling project settings
 public:
 	const Projects::Project& GetProject() const
@@ -71,7 +75,6 @@ public:
 	DWORD GetDataSize() const;
 	DWORD GetEntryPoint() const;
 	DWORD GetBaseAddress() const;
-	DWORD GetEpochCodeSize() const;
 
 	PESectionManager& GetSectionManager()
 	{ return *SectionManager; }
@@ -0,0 +1,152 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Cache of compiled binaries for previously executed source files
+//
+// Running a source file normally parses it twice, validates it, and
+// optimizes it before any code is executed. When the cache is enabled,
+// the program is instead compiled to a binary the first time it is run,
+// and the binary is stored under a name derived from a hash of the
+// source file's contents. Subsequent runs of an unchanged file load the
+// binary directly, skipping the parser and validator entirely.
+//
+// The hash also covers the time stamps of the loaded VM and assembler
+// DLLs, so that rebuilding either DLL invalidates all cached binaries,
+// and the runtime options which change the contents of the binary. The
+// remaining optimizer options are applied when a binary is loaded, so
+// they do not need to be part of the hash.
+//
+
+#include "pch.h"
+
+#include "Parse Cache/ParseCache.h"
+
+#include "DLL Access/FugueVMDLL.h"
+#include "DLL Access/FugueASMDLL.h"
+
+#include "Utility/Files/SpecialPaths.h"
+#include "Utility/Strings.h"
+#include "Utility/Hashing.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include <iomanip>
+#include <fstream>
+
+
+namespace
+{
+
+	typedef Hashing::Hash64 HashType;
+
+	//
+	// Hash the last modification time of the given loaded module
+	//
+	HashType HashModuleTimeStamp(HashType hash, const wchar_t* modulename)
+	{
+		HMODULE module = ::GetModuleHandle(modulename);
+		if(!module)
+			return hash;
+
+		return Hashing::HashModuleTimeStamp64(hash, module);
+	}
+
+	//
+	// Hash the runtime options which affect the compiled binary
+	//
+	HashType HashCompilerOptions(HashType hash)
+	{
+		bool options[] = { Config::PreoptimizeBinaries, Config::CompactBytecode };
+		return Hashing::HashBytes64(hash, options, sizeof(options));
+	}
+
+	//
+	// Compute the cache key for the given source file
+	//
+	// Returns false if the source file could not be read.
+	//
+	bool HashSourceFile(const std::wstring& filename, HashType& hash)
+	{
+		hash = Hashing::FNV64OffsetBasis;
+		if(!Hashing::HashFileContents64(hash, filename))
+			return false;
+
+		hash = HashModuleTimeStamp(hash, L"fuguedll.dll");
+		hash = HashModuleTimeStamp(hash, L"fugueasm.dll");
+		hash = HashCompilerOptions(hash);
+		return true;
+	}
+
+	//
+	// Retrieve the directory used to store cached binaries, creating it if needed
+	//
+	std::wstring GetCacheDirectory()
+	{
+		std::wstring path = SpecialPaths::GetTemporaryPath() + L"Epoch Parse Cache\\";
+		::CreateDirectory(path.c_str(), NULL);
+		return path;
+	}
+
+	//
+	// Determine if a file exists
+	//
+	bool FileExists(const std::wstring& filename)
+	{
+		DWORD attributes = ::GetFileAttributes(filename.c_str());
+		return (attributes != INVALID_FILE_ATTRIBUTES) && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+	}
+
+	//
+	// Store a compiled binary in the cache
+	//
+	// A partially written file is removed, so that it is not mistaken
+	// for a valid binary on the next run.
+	//
+	void StoreBinary(const std::wstring& binaryname, const std::vector<unsigned char>& binary)
+	{
+		std::ofstream outfile(binaryname.c_str(), std::ios::binary | std::ios::trunc);
+		if(!outfile)
+			return;
+
+		outfile.write(reinterpret_cast<const char*>(&binary[0]), static_cast<std::streamsize>(binary.size()));
+		outfile.close();
+
+		if(!outfile)
+			::DeleteFile(binaryname.c_str());
+	}
+
+}
+
+
+//
+// Execute a source file, reusing a previously compiled binary if the file has not changed
+//
+// If the source cannot be hashed, the program is simply executed from
+// source as usual. Otherwise the program is compiled only once: if the
+// compile fails, its errors have already been reported and the failure
+// is returned, and if the binary cannot be stored in the cache, it is
+// executed straight from memory.
+//
+bool ParseCache::ExecuteSourceCode(const std::wstring& filename, FugueVMDLLAccess& vmaccess, FugueASMDLLAccess& asmaccess)
+{
+	HashType hash;
+	if(!HashSourceFile(filename, hash))
+		return vmaccess.ExecuteSourceCode(narrow(filename).c_str());
+
+	std::wostringstream basename;
+	basename << GetCacheDirectory() << std::hex << std::setw(16) << std::setfill(L'0') << hash;
+
+	std::wstring binaryname = basename.str() + L".epb";
+	if(FileExists(binaryname))
+		return vmaccess.ExecuteBinaryFile(narrow(binaryname).c_str());
+
+	// Cache miss: compile the program and keep the binary for next time
+	std::vector<unsigned char> binary;
+	if(!vmaccess.CompileToMemory(narrow(filename).c_str(), true, asmaccess, binary) || binary.empty())
+		return false;
+
+	StoreBinary(binaryname, binary);
+	return vmaccess.ExecuteBinaryBuffer(&binary[0]);
+}
+
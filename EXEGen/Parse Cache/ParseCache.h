@@ -0,0 +1,22 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Cache of compiled binaries for previously executed source files
+//
+
+#pragma once
+
+
+// Forward declarations
+class FugueVMDLLAccess;
+class FugueASMDLLAccess;
+
+
+namespace ParseCache
+{
+
+	bool ExecuteSourceCode(const std::wstring& filename, FugueVMDLLAccess& vmaccess, FugueASMDLLAccess& asmaccess);
+
+}
+
@@ -0,0 +1,170 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Cache of compiled resource sections
+//
+// Compiling resources means parsing each resource script, loading and
+// re-encoding every icon and menu, and laying out the resource directory.
+// The result only depends on the contents of the scripts and the files
+// they refer to, so the compiled section is stored under a name derived
+// from a hash of those contents. Rebuilding an executable whose resources
+// have not changed then only needs to read the section back in.
+//
+// The hash also covers the time stamp of EXEGen itself, so that changes
+// to the resource compiler invalidate all cached sections.
+//
+
+#include "pch.h"
+
+#include "Resource Compiler/ResourceCache.h"
+
+#include "Utility/Files/SpecialPaths.h"
+#include "Utility/Hashing.h"
+
+#include <iomanip>
+
+
+using namespace ResourceCompiler;
+
+
+namespace
+{
+
+	const char CacheCookie[] = "EpochRES";
+
+	//
+	// Fixed header at the start of each cached section
+	//
+	struct CacheHeader
+	{
+		char Cookie[sizeof(CacheCookie) - 1];
+		DWORD DataSize;
+		DWORD NumRelocations;
+	};
+
+
+	//
+	// Hash the name and contents of the given file into an existing hash value
+	//
+	// Returns false if the file could not be read.
+	//
+	bool HashFile(ResourceCache::KeyType& hash, const std::wstring& filename)
+	{
+		// The terminator separates the name from the contents
+		hash = Hashing::HashBytes64(hash, filename.c_str(), (filename.length() + 1) * sizeof(wchar_t));
+		return Hashing::HashFileContents64(hash, filename);
+	}
+
+	//
+	// Retrieve the file name used to cache the section with the given key, creating the cache directory if needed
+	//
+	std::wstring GetCacheFileName(ResourceCache::KeyType key)
+	{
+		std::wstring path = SpecialPaths::GetTemporaryPath() + L"Epoch Resource Cache\\";
+		::CreateDirectory(path.c_str(), NULL);
+
+		std::wostringstream filename;
+		filename << path << std::hex << std::setw(16) << std::setfill(L'0') << key << L".res";
+		return filename.str();
+	}
+
+}
+
+
+//
+// Compute the cache key for the resources described by the given scripts
+//
+// The referenced files are those named by the scripts, such as icon
+// source files. Returns false if any of the files could not be read,
+// in which case the resources should simply be compiled as usual.
+//
+bool ResourceCache::ComputeKey(const std::list<std::wstring>& scriptfiles, const std::list<std::wstring>& referencedfiles, KeyType& key)
+{
+	KeyType hash = Hashing::FNV64OffsetBasis;
+
+	for(std::list<std::wstring>::const_iterator iter = scriptfiles.begin(); iter != scriptfiles.end(); ++iter)
+	{
+		if(!HashFile(hash, *iter))
+			return false;
+	}
+
+	for(std::list<std::wstring>::const_iterator iter = referencedfiles.begin(); iter != referencedfiles.end(); ++iter)
+	{
+		if(!HashFile(hash, *iter))
+			return false;
+	}
+
+	key = Hashing::HashModuleTimeStamp64(hash, NULL);
+	return true;
+}
+
+//
+// Retrieve a previously compiled resource section from the cache
+//
+// Returns false if there is no usable section cached under the key.
+//
+bool ResourceCache::Load(KeyType key, CompiledResources& resources)
+{
+	std::ifstream infile(GetCacheFileName(key).c_str(), std::ios::in | std::ios::binary);
+	if(!infile)
+		return false;
+
+	CacheHeader header;
+	if(!infile.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if(memcmp(header.Cookie, CacheCookie, sizeof(header.Cookie)) != 0)
+		return false;
+
+	std::vector<DWORD> relocations(header.NumRelocations);
+	if(header.NumRelocations && !infile.read(reinterpret_cast<char*>(&relocations[0]), header.NumRelocations * sizeof(DWORD)))
+		return false;
+
+	std::vector<unsigned char> data(header.DataSize);
+	if(header.DataSize && !infile.read(reinterpret_cast<char*>(&data[0]), header.DataSize))
+		return false;
+
+	for(std::vector<DWORD>::const_iterator iter = relocations.begin(); iter != relocations.end(); ++iter)
+	{
+		if(*iter > header.DataSize || header.DataSize - *iter < sizeof(DWORD))
+			return false;
+	}
+
+	resources.Data.swap(data);
+	resources.Relocations.swap(relocations);
+	return true;
+}
+
+//
+// Store a compiled resource section in the cache
+//
+// Failing to write the cache is not an error; the section will just be
+// compiled again next time. A partially written file is removed, so that
+// it cannot be mistaken for a complete one.
+//
+void ResourceCache::Store(KeyType key, const CompiledResources& resources)
+{
+	std::wstring filename = GetCacheFileName(key);
+
+	CacheHeader header;
+	memcpy(header.Cookie, CacheCookie, sizeof(header.Cookie));
+	header.DataSize = static_cast<DWORD>(resources.Data.size());
+	header.NumRelocations = static_cast<DWORD>(resources.Relocations.size());
+
+	bool written;
+	{
+		std::ofstream outfile(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if(!resources.Relocations.empty())
+			outfile.write(reinterpret_cast<const char*>(&resources.Relocations[0]), resources.Relocations.size() * sizeof(DWORD));
+		if(!resources.Data.empty())
+			outfile.write(reinterpret_cast<const char*>(&resources.Data[0]), resources.Data.size());
+
+		outfile.flush();
+		written = outfile.good();
+	}
+
+	if(!written)
+		::DeleteFile(filename.c_str());
+}
@@ -0,0 +1,39 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Cache of compiled resource sections
+//
+
+#pragma once
+
+
+namespace ResourceCompiler
+{
+
+	//
+	// Contents of a compiled resource section
+	//
+	// The data is compiled as if the section were located at virtual
+	// address zero. The relocations give the offsets of each DWORD in
+	// the data which holds a virtual address, and must be adjusted once
+	// the real location of the section is known.
+	//
+	struct CompiledResources
+	{
+		std::vector<unsigned char> Data;
+		std::vector<DWORD> Relocations;
+	};
+
+
+	namespace ResourceCache
+	{
+		typedef unsigned __int64 KeyType;
+
+		bool ComputeKey(const std::list<std::wstring>& scriptfiles, const std::list<std::wstring>& referencedfiles, KeyType& key);
+
+		bool Load(KeyType key, CompiledResources& resources);
+		void Store(KeyType key, const CompiledResources& resources);
+	}
+
+}
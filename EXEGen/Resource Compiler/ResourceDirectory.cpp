@@ -278,3 +278,20 @@ void ResourceDirectory::Emit(LinkWriter& writer, DWORD virtualbaseaddress)
 		iter->second->Emit(writer);
 }
 
+//
+// Retrieve the offsets of all emitted fields which hold virtual addresses
+//
+// Only the leaf entries refer to the resource data by virtual address;
+// they are emitted last in the directory, ahead of the data itself. The
+// first field of each leaf holds the address.
+//
+void ResourceDirectory::GetRelocations(std::vector<DWORD>& relocations) const
+{
+	DWORD offset = DirectorySize - static_cast<DWORD>(LeafTier.size()) * DirectoryLeaf::GetSizeStatic();
+	for(std::list<DirectoryBase*>::const_iterator iter = LeafTier.begin(); iter != LeafTier.end(); ++iter)
+	{
+		relocations.push_back(offset);
+		offset += DirectoryLeaf::GetSizeStatic();
+	}
+}
+
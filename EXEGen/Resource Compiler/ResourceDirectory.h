@@ -128,6 +128,8 @@ namespace ResourceCompiler
 		void Emit(LinkWriter& writer, DWORD virtualbaseaddress);
 		DWORD GetSize() const;
 
+		void GetRelocations(std::vector<DWORD>& relocations) const;
+
 	// Internal tracking
 	private:
 		std::list<DirectoryBase*> RootTier;
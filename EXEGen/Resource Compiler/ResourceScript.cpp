@@ -20,6 +20,7 @@ using namespace ResourceCompiler;
 
 // Prototypes
 std::wstring StripQuotes(const std::wstring& str);
+bool ParseSourceDirective(const std::wstring& line, std::wstring& sourcefile);
 
 
 //
@@ -71,9 +72,14 @@ void ResourceScript::ProcessScriptFile(const std::wstring& filename)
 
 		ResourceOffsets.insert(std::make_pair(restype, OffsetInfo(filename, infile.tellg())));
 
+		// Note any files the resource is compiled from, for dependency tracking
 		do
 		{
 			std::getline(infile, line);
+
+			std::wstring sourcefile;
+			if(ParseSourceDirective(line, sourcefile))
+				ReferencedFiles.push_back(sourcefile);
 		} while(!line.empty() && !infile.eof());
 	}
 }
@@ -179,3 +185,23 @@ std::wstring StripQuotes(const std::wstring& str)
 	return ret;
 }
 
+//
+// Helper for extracting the file named by a source directive
+//
+// The file name is read exactly as LoadResourceIntoDirectory reads it.
+//
+bool ParseSourceDirective(const std::wstring& line, std::wstring& sourcefile)
+{
+	std::wistringstream stream(line);
+
+	std::wstring directive;
+	stream >> directive;
+	if(directive != L"source")
+		return false;
+
+	stream.ignore();
+	std::getline(stream, sourcefile);
+	sourcefile = StripQuotes(sourcefile);
+	return !sourcefile.empty();
+}
+
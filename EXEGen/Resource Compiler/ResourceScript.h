@@ -27,6 +27,14 @@ namespace ResourceCompiler
 	public:
 		void AddResourcesToDirectory(ResourceDirectory& directory);
 
+	// Dependency information
+	public:
+		const std::list<std::wstring>& GetScriptFiles() const
+		{ return Filenames; }
+
+		const std::list<std::wstring>& GetReferencedFiles() const
+		{ return ReferencedFiles; }
+
 	// Internal helpers
 	private:
 		void ProcessScriptFile(const std::wstring& filename);
@@ -35,6 +43,7 @@ namespace ResourceCompiler
 	// Internal tracking
 	private:
 		std::list<std::wstring> Filenames;
+		std::list<std::wstring> ReferencedFiles;
 
 		struct OffsetInfo
 		{
@@ -12,27 +12,44 @@
 
 #include "Linker/LinkWriter.h"
 
+#include "Bytecode/Compression.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 
 //
 // Construct the bytecode writer
 //
-EpochCode::EpochCode(const std::wstring& filename)
-	: Filename(filename)
+EpochCode::EpochCode(const std::vector<unsigned char>& bytecode)
+	: CodeData(bytecode.begin(), bytecode.end())
 {
 }
 
 //
 // Generate any information needed to fill in the file section
 //
+// If compression is enabled, the bytecode is compressed here so that the
+// section can be sized to fit the compressed form. Compression is skipped
+// for code which does not shrink; the loader recognizes either.
+//
 void EpochCode::Generate(Linker& linker)
 {
 	std::wcout << L"Generating Epoch bytecode... ";
-	
+
+	if(Config::CompressEmbeddedBytecode && !CodeData.empty())
+	{
+		std::vector<Byte> compressed;
+		if(BytecodeCompression::Compress(&CodeData[0], CodeData.size(), compressed))
+			CodeData.swap(compressed);
+	}
+
+	DWORD codesize = static_cast<DWORD>(CodeData.size());
+
 	PESectionInfo sectioninfo;
 	sectioninfo.SectionName = ".epoch";
-	sectioninfo.Size = linker.RoundUpToFilePadding(linker.GetEpochCodeSize());
-	sectioninfo.VirtualSize = linker.GetEpochCodeSize();
+	sectioninfo.Size = linker.RoundUpToFilePadding(codesize);
+	sectioninfo.VirtualSize = codesize;
 	sectioninfo.Location = linker.RoundUpToFilePadding(linker.GetSectionManager().GetEndOfLastSection());
 	sectioninfo.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ; 
 	linker.GetSectionManager().AddSection(sectioninfo, linker);
@@ -49,14 +66,10 @@ void EpochCode::Emit(Linker& linker, LinkWriter& writer)
 
 	writer.Pad(linker.GetSectionManager().GetSection(".epoch").Location);
 
-	std::ifstream infile(Filename.c_str(), std::ios::binary);
-	infile.unsetf(std::ios::skipws);
-
-	unsigned char byte;
-	while(infile >> byte)
-		writer.EmitByte(byte);
+	for(std::vector<Byte>::const_iterator iter = CodeData.begin(); iter != CodeData.end(); ++iter)
+		writer.EmitByte(static_cast<unsigned char>(*iter));
 
-	writer.Pad(linker.RoundUpToFilePadding(linker.GetSectionManager().GetSection(".epoch").Location + linker.GetEpochCodeSize()));
+	writer.Pad(linker.RoundUpToFilePadding(linker.GetSectionManager().GetSection(".epoch").Location + static_cast<DWORD>(CodeData.size())));
 
 	std::wcout << L"OK\n";
 }
@@ -19,7 +19,7 @@ class EpochCode : public LinkerSectionManager
 {
 // Construction and destruction
 public:
-	explicit EpochCode(const std::wstring& filename);
+	explicit EpochCode(const std::vector<unsigned char>& bytecode);
 
 // Section manager interface
 public:
@@ -30,6 +30,6 @@ public:
 
 // Internal tracking
 private:
-	std::wstring Filename;
+	std::vector<Byte> CodeData;
 };
 
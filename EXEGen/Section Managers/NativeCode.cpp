@@ -0,0 +1,75 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Wrapper objects for embedding precompiled native code in the executable
+//
+
+#include "pch.h"
+
+#include "Section Managers/NativeCode.h"
+#include "Section Managers/PESections.h"
+
+#include "Linker/LinkWriter.h"
+
+
+
+//
+// Construct the native code writer
+//
+NativeCode::NativeCode(const std::vector<unsigned char>& image)
+	: Image(image)
+{
+}
+
+//
+// Generate any information needed to fill in the file section
+//
+// The section name must match the one the VM searches for when the
+// executable is run.
+//
+void NativeCode::Generate(Linker& linker)
+{
+	if(Image.empty())
+		return;
+
+	std::wcout << L"Generating native code... ";
+
+	PESectionInfo sectioninfo;
+	sectioninfo.SectionName = ".native";
+	sectioninfo.Size = linker.RoundUpToFilePadding(static_cast<DWORD>(Image.size()));
+	sectioninfo.VirtualSize = static_cast<DWORD>(Image.size());
+	sectioninfo.Location = linker.RoundUpToFilePadding(linker.GetSectionManager().GetEndOfLastSection());
+	sectioninfo.Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+	linker.GetSectionManager().AddSection(sectioninfo, linker);
+
+	std::wcout << L"OK\n";
+}
+
+//
+// Write the native code image into the executable
+//
+void NativeCode::Emit(Linker& linker, LinkWriter& writer)
+{
+	if(Image.empty())
+		return;
+
+	std::wcout << L"Writing native code block... ";
+
+	const PESectionInfo& section = linker.GetSectionManager().GetSection(".native");
+	writer.Pad(section.Location);
+	writer.EmitBlob(&Image[0], Image.size());
+	writer.Pad(section.Location + section.Size);
+
+	std::wcout << L"OK\n";
+}
+
+
+//
+// Determine if this manager is in charge of a PE section
+//
+bool NativeCode::RepresentsPESection() const
+{
+	return !Image.empty();
+}
+
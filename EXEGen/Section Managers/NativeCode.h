@@ -0,0 +1,41 @@
+//
+// The Epoch Language Project
+// Win32 EXE Generator
+//
+// Wrapper objects for embedding precompiled native code in the executable
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Linker/Linker.h"
+
+
+//
+// Wrapper class for writing the native code image produced by the VM
+//
+// The image holds code for the functions of the program which could be
+// compiled ahead of time, and is written into an executable section of
+// its own; when the program runs, the VM binds the code to the functions
+// loaded from the bytecode section. If there is no image, no section
+// is written at all.
+//
+class NativeCode : public LinkerSectionManager
+{
+// Construction and destruction
+public:
+	explicit NativeCode(const std::vector<unsigned char>& image);
+
+// Section manager interface
+public:
+	virtual void Generate(Linker& linker);
+	virtual void Emit(Linker& linker, LinkWriter& writer);
+
+	virtual bool RepresentsPESection() const;
+
+// Internal tracking
+private:
+	std::vector<unsigned char> Image;
+};
+
@@ -17,6 +17,8 @@
 
 #include "Project Files/Project.h"
 
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace ResourceCompiler;
 
@@ -32,18 +34,26 @@ Resources::Resources(Linker& linker)
 //
 // Generate any information needed to fill in the file section
 //
+// When resource caching is enabled, a section compiled by an earlier
+// build from the same scripts and files is reused as-is.
+//
 void Resources::Generate(Linker& linker)
 {
 	std::wcout << L"Generating resource table... ";
 
-	// Load resource directory from resource script
-	Script.AddResourcesToDirectory(Directory);
-	Directory.ComputeOffsets();
+	ResourceCache::KeyType key;
+	bool cacheable = (Config::CacheCompiledResources && ResourceCache::ComputeKey(Script.GetScriptFiles(), Script.GetReferencedFiles(), key));
+	if(!cacheable || !ResourceCache::Load(key, Compiled))
+	{
+		CompileResources();
+		if(cacheable)
+			ResourceCache::Store(key, Compiled);
+	}
 
 	// Set up the PE resource segment
 	PESectionInfo sectioninfo;
 	sectioninfo.SectionName = ".rsrc";
-	sectioninfo.Size = Directory.GetSize();
+	sectioninfo.Size = static_cast<DWORD>(Compiled.Data.size());
 	sectioninfo.VirtualSize = sectioninfo.Size;
 	sectioninfo.Location = linker.RoundUpToFilePadding(linker.GetSectionManager().GetEndOfLastSection());
 	sectioninfo.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ; 
@@ -63,12 +73,47 @@ void Resources::Emit(Linker& linker, LinkWriter& writer)
 	DWORD virtualstart = linker.GetSectionManager().GetSection(".rsrc").VirtualLocation;
 	writer.Pad(start);
 
-	Directory.Emit(writer, virtualstart);
+	// Point the compiled section at its actual location
+	std::vector<unsigned char> data(Compiled.Data);
+	for(std::vector<DWORD>::const_iterator iter = Compiled.Relocations.begin(); iter != Compiled.Relocations.end(); ++iter)
+	{
+		DWORD address;
+		memcpy(&address, &data[*iter], sizeof(address));
+		address += virtualstart;
+		memcpy(&data[*iter], &address, sizeof(address));
+	}
+
+	if(!data.empty())
+		writer.EmitBlob(&data[0], data.size());
 
 	std::wcout << L"OK\n";
 }
 
 
+//
+// Compile the resources listed in the resource scripts
+//
+// The section is laid out as if it were located at virtual address
+// zero; see ResourceCompiler::CompiledResources.
+//
+void Resources::CompileResources()
+{
+	// Load resource directory from resource script
+	Script.AddResourcesToDirectory(Directory);
+	Directory.ComputeOffsets();
+
+	std::ostringstream stream(std::ios::out | std::ios::binary);
+	LinkWriter writer(stream);
+	Directory.Emit(writer, 0);
+
+	std::string data = stream.str();
+	Compiled.Data.assign(data.begin(), data.end());
+
+	Compiled.Relocations.clear();
+	Directory.GetRelocations(Compiled.Relocations);
+}
+
+
 //
 // Determine if this manager is in charge of a PE section
 //
@@ -82,7 +127,7 @@ bool Resources::RepresentsPESection() const
 //
 DWORD Resources::GetSize() const
 {
-	return Directory.GetSize();
+	return static_cast<DWORD>(Compiled.Data.size());
 }
 
 
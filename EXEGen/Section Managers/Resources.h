@@ -12,6 +12,7 @@
 #include "Linker/Linker.h"
 #include "Resource Compiler/ResourceDirectory.h"
 #include "Resource Compiler/ResourceScript.h"
+#include "Resource Compiler/ResourceCache.h"
 
 
 //
@@ -32,9 +33,14 @@ public:
 
 	DWORD GetSize() const;
 
+// Internal helpers
+private:
+	void CompileResources();
+
 // Internal tracking
 private:
 	ResourceCompiler::ResourceDirectory Directory;
 	ResourceCompiler::ResourceScript Script;
+	ResourceCompiler::CompiledResources Compiled;
 };
 
@@ -0,0 +1,154 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Routines for running map and reduce operations on the CUDA device
+//
+// Array operations are always run on the first device. Unlike code blocks,
+// the data for these operations is handed over directly by the VM, so there
+// are no variables to marshal; the input array is copied to the device as a
+// single chunk, and the results are copied back once the kernels finish.
+//
+
+#include "pch.h"
+
+#include "CUDA Wrapper/ArrayOperations.h"
+#include "CUDA Wrapper/Initialization.h"
+#include "CUDA Wrapper/FunctionCall.h"
+#include "CUDA Wrapper/Module.h"
+#include "CUDA Wrapper/Naming.h"
+
+#include "Code Generation/CompiledCodeManager.h"
+
+#include "Language Extensions/FunctionPointerTypes.h"
+
+#include "FugueVMAccess.h"
+
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Strings.h"
+
+#include <algorithm>
+
+
+extern bool CUDAAvailableForExecution;
+
+
+namespace
+{
+	// Parameters are held by the function handles themselves, so launches must be serialized
+	Threads::CriticalSection ArrayOperationCriticalSection;
+
+
+	//
+	// RAII wrapper for a temporary allocation of device memory
+	//
+	struct DeviceMemory
+	{
+		explicit DeviceMemory(size_t size)
+		{
+			if(cuMemAlloc(&Pointer, static_cast<unsigned>(size)) != CUDA_SUCCESS)
+				throw std::exception("Failed to allocate CUDA device memory for an array operation");
+		}
+
+		~DeviceMemory()
+		{
+			cuMemFree(Pointer);
+		}
+
+		CUdeviceptr Pointer;
+	};
+
+
+	//
+	// Retrieve the size of an element of the given type, as stored on the device
+	//
+	size_t GetElementSize(VM::EpochVariableTypeID type)
+	{
+		if(type == VM::EpochVariableType_Real)
+			return sizeof(float);
+
+		return sizeof(int);
+	}
+
+}
+
+
+//
+// Run a previously compiled map or reduce operation over the given array
+//
+// Reductions are done in several passes, each of which leaves one partial
+// result per block of the previous pass; the passes alternate between two
+// device buffers until a single value remains. Returns false if no kernel
+// was compiled for the operation, in which case the output is untouched.
+//
+bool RunArrayOperation(const Extensions::ArrayOperationInfo& info, const void* input, size_t count, void* output)
+{
+	if(!CUDAAvailableForExecution || !count)
+		return false;
+
+	std::string kernelname = GenerateArrayOperationName(info);
+
+	Extensions::CompileSessionHandle session;
+	if(!Compiler::LookupArrayOperation(kernelname, session))
+		return false;
+
+	Compiler::WaitForCompilation(session);
+
+	Module& module = Module::LoadCUDAModule(Compiler::GetGeneratedModuleName(session));
+
+	size_t elementsize = GetElementSize(info.ElementType);
+	size_t resultsize = GetElementSize(info.ResultType);
+
+	Threads::CriticalSection::Auto mutex(ArrayOperationCriticalSection);
+	MakeDeviceCurrent(0);
+
+	DeviceMemory inputmemory(count * elementsize);
+	{
+		FugueVMAccess::TraceSpan trace("CUDA transfer to device", count * elementsize);
+		if(cuMemcpyHtoD(inputmemory.Pointer, input, static_cast<unsigned>(count * elementsize)) != CUDA_SUCCESS)
+			throw std::exception("Failed to transfer array data to the CUDA device");
+	}
+
+	if(info.Operation == Extensions::ArrayOperation_Map)
+	{
+		DeviceMemory outputmemory(count * resultsize);
+
+		FunctionCall call = module.CreateFunctionCall(kernelname);
+		call.AddPointerParameter(inputmemory.Pointer);
+		call.AddPointerParameter(outputmemory.Pointer);
+		call.AddNumericParameter(count);
+		call.ExecuteForLoop(count, 0);
+
+		// This also waits for the kernel to finish before copying
+		FugueVMAccess::TraceSpan trace("CUDA transfer from device", count * resultsize);
+		if(cuMemcpyDtoH(output, outputmemory.Pointer, static_cast<unsigned>(count * resultsize)) != CUDA_SUCCESS)
+			throw std::exception("Failed to transfer array data from the CUDA device");
+	}
+	else
+	{
+		// Each block reduces at least two elements, so this is enough room for any pass
+		DeviceMemory partialmemory(((count + 1) / 2) * elementsize);
+
+		CUdeviceptr source = inputmemory.Pointer;
+		CUdeviceptr destination = partialmemory.Pointer;
+
+		size_t remaining = count;
+		while(remaining > 1)
+		{
+			FunctionCall call = module.CreateFunctionCall(kernelname);
+			call.AddPointerParameter(source);
+			call.AddPointerParameter(destination);
+			call.AddNumericParameter(remaining);
+			remaining = call.ExecuteReduction(remaining, elementsize, 0);
+
+			std::swap(source, destination);
+		}
+
+		FugueVMAccess::TraceSpan trace("CUDA transfer from device", resultsize);
+		if(cuMemcpyDtoH(output, source, static_cast<unsigned>(resultsize)) != CUDA_SUCCESS)
+			throw std::exception("Failed to transfer array data from the CUDA device");
+	}
+
+	return true;
+}
+
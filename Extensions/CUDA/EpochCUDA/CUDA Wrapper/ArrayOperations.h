@@ -0,0 +1,19 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Routines for running map and reduce operations on the CUDA device
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace Extensions
+{
+	struct ArrayOperationInfo;
+}
+
+
+bool RunArrayOperation(const Extensions::ArrayOperationInfo& info, const void* input, size_t count, void* output);
+
@@ -9,6 +9,11 @@
 
 #include "CUDA Wrapper/FunctionCall.h"
 #include "CUDA Wrapper/Module.h"
+#include "CUDA Wrapper/Initialization.h"
+
+#include "FugueVMAccess.h"
+
+#include <algorithm>
 
 
 #define ALIGN_UP(offset, alignment) (offset) = ((offset) + (alignment) - 1) & ~((alignment) - 1)
@@ -18,12 +23,24 @@ extern bool CUDAAvailableForExecution;
 extern bool CUDALibraryLoaded;
 
 
+namespace
+{
+	// Number of threads we prefer to run in each block of a cudafor loop;
+	// this is clamped to what the device and the compiled kernel support
+	const unsigned PreferredThreadsPerBlock = 256;
+}
+
+
 //
 // Construct and initialize a function call wrapper
 //
-FunctionCall::FunctionCall(CUfunction handle)
+// Function handles belong to the context of a single device; the device
+// index is retained so that launches can be shaped to fit that device.
+//
+FunctionCall::FunctionCall(CUfunction handle, size_t deviceindex)
 	: ParamOffset(0),
-	  FunctionHandle(handle)
+	  FunctionHandle(handle),
+	  DeviceIndex(deviceindex)
 {
 }
 
@@ -55,23 +72,106 @@ void FunctionCall::AddNumericParameter(size_t size)
 //
 // Actually perform the function call
 //
-void FunctionCall::ExecuteNormal()
+// Launches are queued on the given stream and return immediately; the
+// parameters are captured at launch time, so the function handle may be
+// prepared for another call as soon as this returns. Traced launches thus
+// only cover the queuing; the time taken by the kernel itself shows up in
+// whichever transfer or synchronization next waits on the stream.
+//
+void FunctionCall::ExecuteNormal(CUstream stream)
 {
 	if(!CUDAAvailableForExecution)
 		return;
 
 	cuParamSetSize(FunctionHandle, ParamOffset);
 	cuFuncSetBlockShape(FunctionHandle, 1, 1, 1);
-	cuLaunch(FunctionHandle);
+
+	FugueVMAccess::TraceSpan trace("CUDA kernel launch", 1);
+	cuLaunchGridAsync(FunctionHandle, 1, 1, stream);
 }
 
-void FunctionCall::ExecuteForLoop(size_t count)
+//
+// Perform the function call once for each iteration of a cudafor loop
+//
+// Iterations are spread across blocks of several threads each. Since the grid
+// width is limited, large iteration counts are tiled across a two dimensional
+// grid; the generated code flattens the grid coordinates back into a single
+// iteration index, and threads past the end of the final block exit early.
+//
+void FunctionCall::ExecuteForLoop(size_t count, CUstream stream)
 {
 	if(!CUDAAvailableForExecution)
 		return;
 
+	if(!count)
+		return;
+
+	const CUDADevice& device = CUDADevices[DeviceIndex];
+
+	unsigned threadsperblock = GetThreadsPerBlock();
+
+	size_t numblocks = (count + threadsperblock - 1) / threadsperblock;
+	unsigned gridwidth = static_cast<unsigned>(std::min(numblocks, static_cast<size_t>(device.MaxGridWidth)));
+	unsigned gridheight = static_cast<unsigned>((numblocks + gridwidth - 1) / gridwidth);
+
 	cuParamSetSize(FunctionHandle, ParamOffset);
-	cuFuncSetBlockShape(FunctionHandle, 1, 1, 1);
-	cuLaunchGrid(FunctionHandle, static_cast<unsigned>(count), 1);
+	cuFuncSetBlockShape(FunctionHandle, threadsperblock, 1, 1);
+
+	FugueVMAccess::TraceSpan trace("CUDA kernel launch", numblocks);
+	cuLaunchGridAsync(FunctionHandle, gridwidth, gridheight, stream);
+}
+
+//
+// Perform one pass of a parallel reduction over the given number of elements
+//
+// Each block reduces twice as many elements as it has threads, using shared
+// memory for the intermediate values; the reduction tree requires the number
+// of threads per block to be a power of two. Returns the number of partial
+// results written by the pass, one per block.
+//
+size_t FunctionCall::ExecuteReduction(size_t count, size_t elementsize, CUstream stream)
+{
+	if(!CUDAAvailableForExecution)
+		return 0;
+
+	if(!count)
+		return 0;
+
+	const CUDADevice& device = CUDADevices[DeviceIndex];
+
+	unsigned threadsperblock = 1;
+	while(threadsperblock * 2 <= GetThreadsPerBlock())
+		threadsperblock *= 2;
+
+	size_t elementsperblock = threadsperblock * 2;
+	size_t numblocks = (count + elementsperblock - 1) / elementsperblock;
+	unsigned gridwidth = static_cast<unsigned>(std::min(numblocks, static_cast<size_t>(device.MaxGridWidth)));
+	unsigned gridheight = static_cast<unsigned>((numblocks + gridwidth - 1) / gridwidth);
+
+	cuParamSetSize(FunctionHandle, ParamOffset);
+	cuFuncSetBlockShape(FunctionHandle, threadsperblock, 1, 1);
+	cuFuncSetSharedSize(FunctionHandle, static_cast<unsigned>(threadsperblock * elementsize));
+
+	FugueVMAccess::TraceSpan trace("CUDA kernel launch", numblocks);
+	cuLaunchGridAsync(FunctionHandle, gridwidth, gridheight, stream);
+
+	return numblocks;
+}
+
+
+//
+// Determine how many threads to run in each block of a multi-threaded launch
+//
+// This is clamped to what both the device and the compiled kernel support.
+//
+unsigned FunctionCall::GetThreadsPerBlock() const
+{
+	unsigned threadsperblock = std::min(PreferredThreadsPerBlock, CUDADevices[DeviceIndex].MaxThreadsPerBlock);
+
+	int functionmaxthreads = 0;
+	if(cuFuncGetAttribute(&functionmaxthreads, CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK, FunctionHandle) == CUDA_SUCCESS && functionmaxthreads > 0)
+		threadsperblock = std::min(threadsperblock, static_cast<unsigned>(functionmaxthreads));
+
+	return threadsperblock;
 }
 
@@ -20,7 +20,7 @@ class FunctionCall
 {
 // Construction
 public:
-	FunctionCall(CUfunction handle);
+	FunctionCall(CUfunction handle, size_t deviceindex);
 
 // Parameter management
 public:
@@ -29,12 +29,18 @@ public:
 
 // Execution interface
 public:
-	void ExecuteNormal();
-	void ExecuteForLoop(size_t count);
+	void ExecuteNormal(CUstream stream);
+	void ExecuteForLoop(size_t count, CUstream stream);
+	size_t ExecuteReduction(size_t count, size_t elementsize, CUstream stream);
+
+// Internal helpers
+private:
+	unsigned GetThreadsPerBlock() const;
 
 // Internal tracking
 private:
 	CUfunction FunctionHandle;
+	size_t DeviceIndex;
 	unsigned ParamOffset;
 };
 
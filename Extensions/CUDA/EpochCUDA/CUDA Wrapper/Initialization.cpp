@@ -8,14 +8,75 @@
 
 #include "pch.h"
 
+#include "CUDA Wrapper/Initialization.h"
 #include "CUDA Wrapper/Module.h"
+#include "CUDA Wrapper/InvokeCode.h"
 #include "Code Generation/EASMToCUDA.h"
 
 #include <cuda.h>
 
 
-// We create a single context per process; this variable holds the handle to that context
-CUcontext ContextHandle = 0;
+// We create one context per device in the process; this list holds the handles to those contexts
+std::vector<CUDADevice> CUDADevices;
+
+
+namespace
+{
+
+	//
+	// Query an attribute of a device, substituting the given default on failure
+	//
+	unsigned GetDeviceAttribute(CUdevice devicehandle, CUdevice_attribute attribute, unsigned defaultvalue)
+	{
+		int value = 0;
+		if(cuDeviceGetAttribute(&value, attribute, devicehandle) != CUDA_SUCCESS || value <= 0)
+			return defaultvalue;
+
+		return static_cast<unsigned>(value);
+	}
+
+	//
+	// Create a context for the given device and record its capabilities
+	//
+	// Contexts are detached from the initializing thread once created, so
+	// that any thread may make them current via MakeDeviceCurrent().
+	//
+	bool CreateDeviceContext(int deviceordinal)
+	{
+		CUdevice devicehandle;
+		if(cuDeviceGet(&devicehandle, deviceordinal) != CUDA_SUCCESS)
+			return false;
+
+		CUDADevice device;
+		if(cuCtxCreate(&device.Context, CU_CTX_MAP_HOST, devicehandle) != CUDA_SUCCESS)
+			return false;
+
+		device.MaxThreadsPerBlock = GetDeviceAttribute(devicehandle, CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK, 1);
+		device.MaxGridWidth = GetDeviceAttribute(devicehandle, CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_X, 1);
+		device.Throughput = GetDeviceAttribute(devicehandle, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, 1) * (GetDeviceAttribute(devicehandle, CU_DEVICE_ATTRIBUTE_CLOCK_RATE, 1000) / 1000);
+
+		CUcontext ignored;
+		cuCtxPopCurrent(&ignored);
+
+		CUDADevices.push_back(device);
+		return true;
+	}
+
+	//
+	// Create contexts for all devices in the system
+	//
+	// Devices which cannot be initialized are skipped; returns false only
+	// if no device at all is usable.
+	//
+	bool CreateDeviceContexts(int devicecount)
+	{
+		for(int i = 0; i < devicecount; ++i)
+			CreateDeviceContext(i);
+
+		return !CUDADevices.empty();
+	}
+
+}
 
 
 //
@@ -34,17 +95,12 @@ bool InitializeCUDA()
 		if(cuInit(0) != CUDA_SUCCESS)
 			return false;
 
-		CUdevice devicehandle;
-
 		int devicecount = 0;
 		cuDeviceGetCount(&devicecount);
 		if(devicecount <= 0)
 			return false;
 
-		if(cuDeviceGet(&devicehandle, 0) != CUDA_SUCCESS)
-			return false;
-
-		if(cuCtxCreate(&ContextHandle, CU_CTX_MAP_HOST, devicehandle) != CUDA_SUCCESS)
+		if(!CreateDeviceContexts(devicecount))
 			return false;
 
 		CUDALibraryLoaded = true;
@@ -63,8 +119,29 @@ bool InitializeCUDA()
 //
 void ShutdownCUDA()
 {
+	CUDACodeInvoker::ReleasePreparedBlocks();
 	Module::ReleaseAllModules();
 	if(CUDALibraryLoaded)
-		cuCtxDestroy(ContextHandle);
+	{
+		for(std::vector<CUDADevice>::const_iterator iter = CUDADevices.begin(); iter != CUDADevices.end(); ++iter)
+			cuCtxDestroy(iter->Context);
+	}
+
+	CUDADevices.clear();
+}
+
+
+//
+// Bind the given device's context to the calling thread
+//
+// All subsequent driver calls on this thread apply to that device, until
+// another device is made current.
+//
+void MakeDeviceCurrent(size_t deviceindex)
+{
+	if(!CUDAAvailableForExecution)
+		return;
+
+	cuCtxSetCurrent(CUDADevices[deviceindex].Context);
 }
 
@@ -8,7 +8,31 @@
 #pragma once
 
 
+// Dependencies
+#include <cuda.h>
+
+
+//
+// Tracking for each CUDA device available to the process
+//
+// A separate context is created for each device. All driver calls made on
+// behalf of a device must be made while that device's context is current.
+//
+struct CUDADevice
+{
+	CUcontext Context;
+
+	unsigned MaxThreadsPerBlock;
+	unsigned MaxGridWidth;
+
+	// Relative measure of the device's processing power, used for dividing work between devices
+	unsigned Throughput;
+};
+
+extern std::vector<CUDADevice> CUDADevices;
+
+
 bool InitializeCUDA();
 void ShutdownCUDA();
 
-
+void MakeDeviceCurrent(size_t deviceindex);
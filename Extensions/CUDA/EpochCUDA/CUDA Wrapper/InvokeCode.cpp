@@ -8,6 +8,7 @@
 #include "pch.h"
 
 #include "CUDA Wrapper/InvokeCode.h"
+#include "CUDA Wrapper/Initialization.h"
 #include "CUDA Wrapper/VariableBuffer.h"
 #include "CUDA Wrapper/FunctionCall.h"
 #include "CUDA Wrapper/Module.h"
@@ -19,8 +20,325 @@
 
 #include "Utility/Threading/Synchronization.h"
 
+#include <memory>
+#include <algorithm>
 
-namespace { Threads::CriticalSection InvocationCriticalSection; }
+
+//
+// Everything needed to launch a compiled code block
+//
+// Blocks are prepared once, so that the module and function lookups do not
+// need to be repeated on each execution.
+//
+// Each execution borrows a variable buffer (and thus a stream) from the
+// block for its duration; buffers are returned to the block afterwards so
+// their device allocations can be reused. Concurrent executions of the same
+// block simply use separate buffers, allowing their transfers and kernels
+// to overlap on the device. Only setting up the function parameters and
+// queueing the launch need to be serialized, since the parameter state is
+// held by the function handle itself.
+//
+// cudafor loops may be spread across all devices in the system, so their
+// launch state is kept separately for each device; other blocks only ever
+// run on the first device.
+//
+struct CUDACodeInvoker::PreparedBlock
+{
+	struct DeviceState
+	{
+		explicit DeviceState(const FunctionCall& call)
+			: Call(call)
+		{ }
+
+		~DeviceState()
+		{
+			for(std::vector<VariableBuffer*>::iterator iter = IdleBuffers.begin(); iter != IdleBuffers.end(); ++iter)
+				delete *iter;
+		}
+
+		FunctionCall Call;
+		Threads::CriticalSection LaunchCriticalSection;
+
+		std::vector<VariableBuffer*> IdleBuffers;
+		Threads::CriticalSection BufferCriticalSection;
+	};
+
+	explicit PreparedBlock(Extensions::CodeBlockHandle codehandle)
+		: CodeHandle(codehandle),
+		  IsForLoop(Compiler::GetCodeControlKeyword(codehandle) == L"cudafor"),
+		  Variables(Compiler::GetRegisteredVariables(codehandle)),
+		  Usage(Compiler::GetVariableUsage(codehandle))
+	{
+		Module& module = Module::LoadCUDAModule(Compiler::GetBlockModuleName(codehandle));
+		std::string functionname = GenerateFunctionName(Compiler::GetOriginalCodeHandle(codehandle));
+
+		size_t numdevices = IsForLoop ? std::max<size_t>(CUDADevices.size(), 1) : 1;
+		for(size_t i = 0; i < numdevices; ++i)
+		{
+			std::auto_ptr<DeviceState> device(new DeviceState(module.CreateFunctionCall(functionname, i)));
+			Devices.push_back(device.get());
+			device.release();
+		}
+	}
+
+	~PreparedBlock()
+	{
+		for(std::vector<DeviceState*>::iterator iter = Devices.begin(); iter != Devices.end(); ++iter)
+			delete *iter;
+	}
+
+	VariableBuffer* AcquireBuffer(size_t deviceindex)
+	{
+		DeviceState& device = *Devices[deviceindex];
+
+		{
+			Threads::CriticalSection::Auto mutex(device.BufferCriticalSection);
+			if(!device.IdleBuffers.empty())
+			{
+				VariableBuffer* buffer = device.IdleBuffers.back();
+				device.IdleBuffers.pop_back();
+				return buffer;
+			}
+		}
+
+		return new VariableBuffer(Variables, Usage, deviceindex);
+	}
+
+	void ReturnBuffer(VariableBuffer* buffer)
+	{
+		DeviceState& device = *Devices[buffer->GetDeviceIndex()];
+
+		Threads::CriticalSection::Auto mutex(device.BufferCriticalSection);
+		device.IdleBuffers.push_back(buffer);
+	}
+
+	Extensions::CodeBlockHandle CodeHandle;
+	bool IsForLoop;
+
+	const std::list<Traverser::ScopeContents>& Variables;
+	const Compiler::VariableUsageTable& Usage;
+
+	std::vector<DeviceState*> Devices;
+};
+
+
+namespace
+{
+
+	//
+	// Determine if two code blocks lay out their variables identically on the device
+	//
+	bool HaveSameVariableLayout(const CUDACodeInvoker::PreparedBlock& first, const CUDACodeInvoker::PreparedBlock& second)
+	{
+		if(first.Variables.size() != second.Variables.size())
+			return false;
+
+		std::list<Traverser::ScopeContents>::const_iterator seconditer = second.Variables.begin();
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = first.Variables.begin(); iter != first.Variables.end(); ++iter, ++seconditer)
+		{
+			if(iter->Type != seconditer->Type || iter->ContainedType != seconditer->ContainedType || iter->Identifier != seconditer->Identifier)
+				return false;
+		}
+
+		return true;
+	}
+
+	//
+	// Determine if any variable written by one of the given blocks is used by another
+	//
+	bool HaveSharedWrites(const std::vector<CUDACodeInvoker::PreparedBlock*>& blocks)
+	{
+		const std::list<Traverser::ScopeContents>& variables = blocks.front()->Variables;
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+		{
+			size_t users = 0;
+			bool written = false;
+			for(std::vector<CUDACodeInvoker::PreparedBlock*>::const_iterator blockiter = blocks.begin(); blockiter != blocks.end(); ++blockiter)
+			{
+				unsigned flags = Compiler::LookupVariableUsage((*blockiter)->Usage, iter->Identifier);
+				if(flags)
+					++users;
+				if(flags & Compiler::VariableUsage_Written)
+					written = true;
+			}
+
+			if(written && users > 1)
+				return true;
+		}
+
+		return false;
+	}
+
+}
+
+
+//
+// Everything needed to launch a run of consecutive cudafor loops at once
+//
+// The optimizer in the VM gathers cudafor loops which directly follow one
+// another over the same iteration range (see HandoffFusion.cpp in FUGUE).
+// When all of the loops lay out their variables identically, a single set
+// of variable buffers can serve them all: the variables are uploaded once,
+// the kernels of every loop are queued back to back on the same stream, so
+// each one sees the results of the ones before it on the device, and the
+// results are downloaded once after the last kernel has finished.
+//
+// When the range is split across several devices, each device only holds
+// the results of its own share of the earlier loops, so the loops can only
+// be fused if none of them writes a variable which another one uses. Runs
+// which cannot be fused are simply executed one loop at a time.
+//
+struct CUDACodeInvoker::PreparedSequence
+{
+	explicit PreparedSequence(const std::vector<PreparedBlock*>& blocks)
+		: Blocks(blocks),
+		  Fused(true),
+		  Variables(blocks.front()->Variables),
+		  IdleBuffers(blocks.front()->Devices.size())
+	{
+		for(std::vector<PreparedBlock*>::const_iterator iter = Blocks.begin(); Fused && iter != Blocks.end(); ++iter)
+			Fused = ((*iter)->IsForLoop && (*iter)->Devices.size() == IdleBuffers.size() && HaveSameVariableLayout(*Blocks.front(), **iter));
+
+		if(Fused && IdleBuffers.size() > 1)
+			Fused = !HaveSharedWrites(Blocks);
+
+		if(!Fused)
+			return;
+
+		// The shared buffers must carry every variable used by any of the loops
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = Variables.begin(); iter != Variables.end(); ++iter)
+		{
+			unsigned& flags = Usage[iter->Identifier];
+			for(std::vector<PreparedBlock*>::const_iterator blockiter = Blocks.begin(); blockiter != Blocks.end(); ++blockiter)
+				flags |= Compiler::LookupVariableUsage((*blockiter)->Usage, iter->Identifier);
+		}
+	}
+
+	~PreparedSequence()
+	{
+		for(std::vector<std::vector<VariableBuffer*> >::iterator iter = IdleBuffers.begin(); iter != IdleBuffers.end(); ++iter)
+		{
+			for(std::vector<VariableBuffer*>::iterator bufferiter = iter->begin(); bufferiter != iter->end(); ++bufferiter)
+				delete *bufferiter;
+		}
+	}
+
+	VariableBuffer* AcquireBuffer(size_t deviceindex)
+	{
+		{
+			Threads::CriticalSection::Auto mutex(BufferCriticalSection);
+			std::vector<VariableBuffer*>& idle = IdleBuffers[deviceindex];
+			if(!idle.empty())
+			{
+				VariableBuffer* buffer = idle.back();
+				idle.pop_back();
+				return buffer;
+			}
+		}
+
+		return new VariableBuffer(Variables, Usage, deviceindex);
+	}
+
+	void ReturnBuffer(VariableBuffer* buffer)
+	{
+		Threads::CriticalSection::Auto mutex(BufferCriticalSection);
+		IdleBuffers[buffer->GetDeviceIndex()].push_back(buffer);
+	}
+
+	std::vector<PreparedBlock*> Blocks;
+	bool Fused;
+
+	const std::list<Traverser::ScopeContents>& Variables;
+	Compiler::VariableUsageTable Usage;
+
+	std::vector<std::vector<VariableBuffer*> > IdleBuffers;
+	Threads::CriticalSection BufferCriticalSection;
+};
+
+
+namespace
+{
+	// Prepared blocks are retained for the lifetime of the compiled code; the
+	// lock only guards the map itself, never an actual launch
+	std::map<Extensions::CodeBlockHandle, CUDACodeInvoker::PreparedBlock*> PreparedBlocks;
+	std::map<std::vector<Extensions::CodeBlockHandle>, CUDACodeInvoker::PreparedSequence*> PreparedSequences;
+	Threads::CriticalSection PreparedBlocksCriticalSection;
+
+
+	//
+	// RAII helper for borrowing variable buffers from a prepared block or sequence
+	//
+	template <class OwnerType>
+	struct BorrowedBuffers
+	{
+		explicit BorrowedBuffers(OwnerType& block)
+			: Block(block)
+		{ }
+
+		~BorrowedBuffers()
+		{
+			for(std::vector<VariableBuffer*>::iterator iter = Buffers.begin(); iter != Buffers.end(); ++iter)
+				Block.ReturnBuffer(*iter);
+		}
+
+		VariableBuffer& Borrow(size_t deviceindex)
+		{
+			Buffers.reserve(Buffers.size() + 1);
+			Buffers.push_back(Block.AcquireBuffer(deviceindex));
+			return *Buffers.back();
+		}
+
+		OwnerType& Block;
+		std::vector<VariableBuffer*> Buffers;
+	};
+
+
+	//
+	// Report an execution of a code block to the VM telemetry, along with
+	// the transfers and device time measured by the given buffers
+	//
+	void ReportActivity(Extensions::CodeBlockHandle codehandle, const std::vector<VariableBuffer*>& buffers)
+	{
+		Extensions::CodeBlockActivity activity = Extensions::CodeBlockActivity();
+		activity.NumExecutions = 1;
+
+		for(std::vector<VariableBuffer*>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
+			(*iter)->CollectActivity(activity);
+
+		FugueVMAccess::RecordActivity(codehandle, activity);
+	}
+
+
+	//
+	// Divide the iterations of a cudafor loop between the given number of devices
+	//
+	// Each device receives a share in proportion to its estimated throughput;
+	// any iterations left over from rounding go to the last device.
+	//
+	std::vector<size_t> DivideIterations(size_t count, size_t numdevices)
+	{
+		std::vector<size_t> shares(numdevices, 0);
+		if(numdevices == 1)
+		{
+			shares[0] = count;
+			return shares;
+		}
+
+		double totalthroughput = 0.0;
+		for(size_t i = 0; i < numdevices; ++i)
+			totalthroughput += CUDADevices[i].Throughput;
+
+		size_t assigned = 0;
+		for(size_t i = 0; i < numdevices - 1; ++i)
+		{
+			shares[i] = std::min(static_cast<size_t>(static_cast<double>(count) * CUDADevices[i].Throughput / totalthroughput), count - assigned);
+			assigned += shares[i];
+		}
+
+		shares[numdevices - 1] = count - assigned;
+		return shares;
+	}
+}
 
 
 //
@@ -28,9 +346,7 @@ namespace { Threads::CriticalSection InvocationCriticalSection; }
 //
 CUDACodeInvoker::CUDACodeInvoker(Extensions::CodeBlockHandle codehandle, HandleType activatedscopehandle)
 	: ActivatedScopeHandle(activatedscopehandle),
-	  CodeHandle(codehandle),
-	  RegisteredVariables(Compiler::GetRegisteredVariables(codehandle)),
-	  FunctionName(GenerateFunctionName(Compiler::GetOriginalCodeHandle(codehandle)))
+	  Block(GetPreparedBlock(codehandle))
 {
 }
 
@@ -38,29 +354,200 @@ CUDACodeInvoker::CUDACodeInvoker(Extensions::CodeBlockHandle codehandle, HandleT
 //
 // Execute the bound CUDA code block
 //
+// The iteration range of a cudafor loop is split across the available
+// devices. Every device receives a copy of all variables, and runs its
+// portion of the range concurrently with the others; the modifications
+// made by each device are merged once all of them have finished.
+//
+// The transfers and device time of each execution are reported to the
+// VM telemetry; the times of all devices involved are added together.
+//
 void CUDACodeInvoker::Execute(size_t lowerbound, size_t upperbound)
 {
-	VariableBuffer varbuffer(RegisteredVariables);
-	varbuffer.CopyToDevice(ActivatedScopeHandle);
+	BorrowedBuffers<PreparedBlock> borrowed(Block);
+
+	if(!Block.IsForLoop)
+	{
+		VariableBuffer& varbuffer = borrowed.Borrow(0);
+		varbuffer.CopyToDevice(ActivatedScopeHandle);
+
+		{
+			PreparedBlock::DeviceState& device = *Block.Devices[0];
+			Threads::CriticalSection::Auto mutex(device.LaunchCriticalSection);
+
+			FunctionCall call(device.Call);
+			varbuffer.PrepareFunctionCall(call, 0, 1);
+			call.ExecuteNormal(varbuffer.GetStream());
+		}
+
+		varbuffer.CopyFromDevice(ActivatedScopeHandle);
+		ReportActivity(Block.CodeHandle, borrowed.Buffers);
+		return;
+	}
 
+	std::vector<size_t> shares = DivideIterations(upperbound - lowerbound, Block.Devices.size());
+
+	size_t rangestart = lowerbound;
+	for(size_t i = 0; i < shares.size(); ++i)
 	{
-		Threads::CriticalSection::Auto mutex(InvocationCriticalSection);
+		if(!shares[i])
+			continue;
+
+		VariableBuffer& varbuffer = borrowed.Borrow(i);
+		varbuffer.CopyToDevice(ActivatedScopeHandle);
 
-		FunctionCall call = Module::LoadCUDAModule(narrow(Compiler::GetGeneratedPTXFileName(Compiler::GetAssociatedSession(CodeHandle)))).CreateFunctionCall(FunctionName);
+		{
+			PreparedBlock::DeviceState& device = *Block.Devices[i];
+			Threads::CriticalSection::Auto mutex(device.LaunchCriticalSection);
 
-		if(Compiler::GetCodeControlKeyword(CodeHandle) == L"cudafor")
+			// The upload leaves this device current, ready for the launch
+			FunctionCall call(device.Call);
+			varbuffer.PrepareFunctionCall(call, rangestart, shares[i]);
+			call.ExecuteForLoop(shares[i], varbuffer.GetStream());
+		}
+
+		rangestart += shares[i];
+	}
+
+	VariableBuffer::CopyFromDevices(borrowed.Buffers, ActivatedScopeHandle);
+	ReportActivity(Block.CodeHandle, borrowed.Buffers);
+}
+
+//
+// Static helper: execute a run of consecutive cudafor loops over the same range
+//
+// See PreparedSequence for details on when the loops share a single
+// transfer to and from the devices. Since the kernels of fused loops are
+// all timed together, the transfers and device time of a fused run are
+// charged to its first loop; every loop is still counted as executed.
+//
+void CUDACodeInvoker::ExecuteSequence(const std::vector<Extensions::CodeBlockHandle>& codehandles, HandleType activatedscopehandle, size_t lowerbound, size_t upperbound)
+{
+	PreparedSequence& sequence = GetPreparedSequence(codehandles);
+	if(!sequence.Fused)
+	{
+		for(std::vector<Extensions::CodeBlockHandle>::const_iterator iter = codehandles.begin(); iter != codehandles.end(); ++iter)
 		{
-			varbuffer.PrepareFunctionCall(call, lowerbound);
-			call.ExecuteForLoop(upperbound - lowerbound);
+			CUDACodeInvoker invoker(*iter, activatedscopehandle);
+			invoker.Execute(lowerbound, upperbound);
 		}
-		else
+		return;
+	}
+
+	BorrowedBuffers<PreparedSequence> borrowed(sequence);
+	std::vector<size_t> shares = DivideIterations(upperbound - lowerbound, sequence.IdleBuffers.size());
+
+	size_t rangestart = lowerbound;
+	for(size_t i = 0; i < shares.size(); ++i)
+	{
+		if(!shares[i])
+			continue;
+
+		VariableBuffer& varbuffer = borrowed.Borrow(i);
+		varbuffer.CopyToDevice(activatedscopehandle);
+
+		for(std::vector<PreparedBlock*>::const_iterator iter = sequence.Blocks.begin(); iter != sequence.Blocks.end(); ++iter)
 		{
-			varbuffer.PrepareFunctionCall(call, 0);
-			call.ExecuteNormal();
+			PreparedBlock::DeviceState& device = *(*iter)->Devices[i];
+			Threads::CriticalSection::Auto mutex(device.LaunchCriticalSection);
+
+			FunctionCall call(device.Call);
+			varbuffer.PrepareFunctionCall(call, rangestart, shares[i]);
+			call.ExecuteForLoop(shares[i], varbuffer.GetStream());
 		}
+
+		rangestart += shares[i];
 	}
 
-	varbuffer.CopyFromDevice(ActivatedScopeHandle);
+	VariableBuffer::CopyFromDevices(borrowed.Buffers, activatedscopehandle);
+
+	ReportActivity(sequence.Blocks.front()->CodeHandle, borrowed.Buffers);
+	for(std::vector<PreparedBlock*>::const_iterator iter = sequence.Blocks.begin() + 1; iter != sequence.Blocks.end(); ++iter)
+		ReportActivity((*iter)->CodeHandle, std::vector<VariableBuffer*>());
+}
+
+
+//
+// Static helper: resolve everything needed to launch a code block ahead of time
+//
+void CUDACodeInvoker::PrepareBlock(Extensions::CodeBlockHandle codehandle)
+{
+	GetPreparedBlock(codehandle);
 }
 
+//
+// Static helper: retrieve the prepared launch data for a code block,
+// preparing the block first if this has not already been done
+//
+// Preparing a block waits for its code to finish compiling; the lock is not
+// held meanwhile, so that blocks which are already prepared can still run.
+//
+CUDACodeInvoker::PreparedBlock& CUDACodeInvoker::GetPreparedBlock(Extensions::CodeBlockHandle codehandle)
+{
+	{
+		Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+		std::map<Extensions::CodeBlockHandle, PreparedBlock*>::const_iterator iter = PreparedBlocks.find(codehandle);
+		if(iter != PreparedBlocks.end())
+			return *(iter->second);
+	}
+
+	Compiler::WaitForCompilation(Compiler::GetAssociatedSession(codehandle));
+
+	Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
 
+	std::map<Extensions::CodeBlockHandle, PreparedBlock*>::const_iterator iter = PreparedBlocks.find(codehandle);
+	if(iter != PreparedBlocks.end())
+		return *(iter->second);
+
+	std::auto_ptr<PreparedBlock> block(new PreparedBlock(codehandle));
+	PreparedBlocks.insert(std::make_pair(codehandle, block.get()));
+	return *(block.release());
+}
+
+//
+// Static helper: retrieve the prepared launch data for a run of cudafor loops,
+// preparing each of the loops first if this has not already been done
+//
+CUDACodeInvoker::PreparedSequence& CUDACodeInvoker::GetPreparedSequence(const std::vector<Extensions::CodeBlockHandle>& codehandles)
+{
+	{
+		Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+		std::map<std::vector<Extensions::CodeBlockHandle>, PreparedSequence*>::const_iterator iter = PreparedSequences.find(codehandles);
+		if(iter != PreparedSequences.end())
+			return *(iter->second);
+	}
+
+	std::vector<PreparedBlock*> blocks;
+	for(std::vector<Extensions::CodeBlockHandle>::const_iterator iter = codehandles.begin(); iter != codehandles.end(); ++iter)
+		blocks.push_back(&GetPreparedBlock(*iter));
+
+	Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+	std::map<std::vector<Extensions::CodeBlockHandle>, PreparedSequence*>::const_iterator iter = PreparedSequences.find(codehandles);
+	if(iter != PreparedSequences.end())
+		return *(iter->second);
+
+	std::auto_ptr<PreparedSequence> sequence(new PreparedSequence(blocks));
+	PreparedSequences.insert(std::make_pair(codehandles, sequence.get()));
+	return *(sequence.release());
+}
+
+//
+// Static helper: free the launch data and device storage retained for all code blocks
+//
+void CUDACodeInvoker::ReleasePreparedBlocks()
+{
+	Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+	for(std::map<std::vector<Extensions::CodeBlockHandle>, PreparedSequence*>::iterator iter = PreparedSequences.begin(); iter != PreparedSequences.end(); ++iter)
+		delete iter->second;
+
+	PreparedSequences.clear();
+
+	for(std::map<Extensions::CodeBlockHandle, PreparedBlock*>::iterator iter = PreparedBlocks.begin(); iter != PreparedBlocks.end(); ++iter)
+		delete iter->second;
+
+	PreparedBlocks.clear();
+}
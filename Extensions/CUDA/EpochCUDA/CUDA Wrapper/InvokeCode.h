@@ -28,13 +28,24 @@ public:
 public:
 	void Execute(size_t lowerbound, size_t upperbound);
 
+	static void ExecuteSequence(const std::vector<Extensions::CodeBlockHandle>& codehandles, HandleType activatedscopehandle, size_t lowerbound, size_t upperbound);
+
+// Code block preparation and cleanup
+public:
+	struct PreparedBlock;
+	struct PreparedSequence;
+
+	static void PrepareBlock(Extensions::CodeBlockHandle codehandle);
+	static void ReleasePreparedBlocks();
+
+// Internal helpers
+private:
+	static PreparedBlock& GetPreparedBlock(Extensions::CodeBlockHandle codehandle);
+	static PreparedSequence& GetPreparedSequence(const std::vector<Extensions::CodeBlockHandle>& codehandles);
+
 // Internal tracking
 private:
-	Extensions::CodeBlockHandle CodeHandle;
 	HandleType ActivatedScopeHandle;
-
-	std::string FunctionName;
-
-	const std::list<Traverser::ScopeContents>& RegisteredVariables;
+	PreparedBlock& Block;
 };
 
@@ -9,11 +9,9 @@
 
 #include "CUDA Wrapper/Module.h"
 #include "CUDA Wrapper/FunctionCall.h"
+#include "CUDA Wrapper/Initialization.h"
 
 #include "Utility/Threading/Synchronization.h"
-#include "Utility/Strings.h"
-#include "Utility/Files/FilesAndPaths.h"
-#include "Utility/Files/Files.h"
 
 
 // TODO - centralize the declarations of these variables
@@ -26,48 +24,32 @@ namespace
 	// Internal tracking of loaded CUDA modules; used to avoid loading modules more than once
 	std::map<std::string, Module*> LoadedModules;
 
+	// PTX images which have been generated, but not yet loaded
+	std::map<std::string, std::string> RegisteredImages;
+
 	Threads::CriticalSection ModuleListCriticalSection;
 }
 
 
 //
-// Construct and initialize a module wrapper (loads the module file from disk)
+// Construct and initialize a module wrapper from a PTX image held in memory
 //
-Module::Module(const std::string& modulefilename)
+Module::Module(const std::string& image)
+	: Image(image)
 {
 	if(!CUDAAvailableForExecution)
 		return;
 
-	FullFileName = modulefilename;
-
-	HANDLE FileHandle = ::CreateFile(widen(modulefilename).c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
-	if(FileHandle == INVALID_HANDLE_VALUE)
-		throw std::exception("Failed to load CUDA assembly module - file not found");
-
-	HANDLE Mapping = ::CreateFileMapping(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
-	if(!Mapping)
-	{
-		::CloseHandle(FileHandle);
-		throw std::exception("Cannot map CUDA file for execution");
-	}
-
-	void* EntireFileBuffer = ::MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
-
-	if(cuModuleLoadData(&ModuleHandle, EntireFileBuffer) != CUDA_SUCCESS)
-		throw std::exception("Failed to load CUDA assembly module");
-
-	::UnmapViewOfFile(EntireFileBuffer);
-	::CloseHandle(Mapping);
-	::CloseHandle(FileHandle);
+	LoadIntoAllDevices();
 }
 
-Module::Module(const std::vector<std::string>& functionnames, const void* codebuffer)
+Module::Module(const std::vector<std::string>& functionnames, const void* codebuffer, size_t codesize)
+	: Image(reinterpret_cast<const char*>(codebuffer), codesize)
 {
 	if(!CUDAAvailableForExecution)
 		return;
 
-	if(cuModuleLoadData(&ModuleHandle, codebuffer) != CUDA_SUCCESS)
-		throw std::exception("Failed to load CUDA assembly module");
+	LoadIntoAllDevices();
 
 	for(std::vector<std::string>::const_iterator iter = functionnames.begin(); iter != functionnames.end(); ++iter)
 		CreateFunctionCall(*iter);
@@ -79,61 +61,126 @@ Module::Module(const std::vector<std::string>& functionnames, const void* codebu
 //
 Module::~Module()
 {
-	for(std::map<std::string, FunctionCall*>::iterator iter = LoadedFunctions.begin(); iter != LoadedFunctions.end(); ++iter)
-		delete iter->second;
+	for(std::map<std::string, std::vector<FunctionCall*> >::iterator iter = LoadedFunctions.begin(); iter != LoadedFunctions.end(); ++iter)
+	{
+		for(std::vector<FunctionCall*>::iterator funciter = iter->second.begin(); funciter != iter->second.end(); ++funciter)
+			delete *funciter;
+	}
 
 	if(CUDAAvailableForExecution)
-		cuModuleUnload(ModuleHandle);
+	{
+		for(size_t i = 0; i < ModuleHandles.size(); ++i)
+		{
+			MakeDeviceCurrent(i);
+			cuModuleUnload(ModuleHandles[i]);
+		}
+	}
+}
+
+
+//
+// Load the module's image into the context of each CUDA device
+//
+// The image is NUL terminated by the string holding it, as required by
+// the driver for PTX images.
+//
+void Module::LoadIntoAllDevices()
+{
+	for(size_t i = 0; i < CUDADevices.size(); ++i)
+	{
+		MakeDeviceCurrent(i);
+
+		CUmodule modulehandle;
+		if(cuModuleLoadData(&modulehandle, Image.c_str()) != CUDA_SUCCESS)
+			throw std::exception("Failed to load CUDA assembly module");
+
+		ModuleHandles.push_back(modulehandle);
+	}
 }
 
 
 //
 // Create a wrapper object that can be used for calling functions in this module
 //
-FunctionCall Module::CreateFunctionCall(const std::string& functionname)
+// The first request for a function resolves its handle on every device, so
+// that the function can subsequently be launched on any of them.
+//
+FunctionCall Module::CreateFunctionCall(const std::string& functionname, size_t deviceindex)
 {
 	if(!CUDAAvailableForExecution)
-		return FunctionCall(0);
+		return FunctionCall(0, deviceindex);
 
 	Threads::CriticalSection::Auto mutex(CritSec);
 
-	std::map<std::string, FunctionCall*>::const_iterator iter = LoadedFunctions.find(functionname);
+	std::map<std::string, std::vector<FunctionCall*> >::const_iterator iter = LoadedFunctions.find(functionname);
 	if(iter != LoadedFunctions.end())
-		return *(iter->second);
+		return *(iter->second.at(deviceindex));
 
-	CUfunction functionhandle;
-	CUresult result = cuModuleGetFunction(&functionhandle, ModuleHandle, functionname.c_str());
-	if(result != CUDA_SUCCESS)
-		throw std::exception("Failed to locate the requested CUDA interop function");
+	std::vector<FunctionCall*>& calls = LoadedFunctions[functionname];
+	for(size_t i = 0; i < ModuleHandles.size(); ++i)
+	{
+		MakeDeviceCurrent(i);
 
-	return *(LoadedFunctions.insert(std::make_pair(functionname, new FunctionCall(functionhandle))).first->second);
+		CUfunction functionhandle;
+		CUresult result = cuModuleGetFunction(&functionhandle, ModuleHandles[i], functionname.c_str());
+		if(result != CUDA_SUCCESS)
+		{
+			for(std::vector<FunctionCall*>::iterator funciter = calls.begin(); funciter != calls.end(); ++funciter)
+				delete *funciter;
+
+			LoadedFunctions.erase(functionname);
+			throw std::exception("Failed to locate the requested CUDA interop function");
+		}
+
+		calls.push_back(new FunctionCall(functionhandle, i));
+	}
+
+	return *(calls.at(deviceindex));
 }
 
 
 //
-// Static helper: retrieve (or load) the requested module, given a module filename
+// Static helper: record the PTX image generated for a module
+//
+// The module is not loaded until it is first requested. This may be
+// called from any thread.
 //
-Module& Module::LoadCUDAModule(const std::string& filename)
+void Module::RegisterImage(const std::string& modulename, const std::string& image)
+{
+	Threads::CriticalSection::Auto mutex(ModuleListCriticalSection);
+	RegisteredImages[modulename] = image;
+}
+
+//
+// Static helper: retrieve (or load) the requested module, given a module name
+//
+Module& Module::LoadCUDAModule(const std::string& modulename)
 {
 	Threads::CriticalSection::Auto mutex(ModuleListCriticalSection);
 
-	std::string filenopath = narrow(StripPath(widen(filename)));
-	std::map<std::string, Module*>::const_iterator iter = LoadedModules.find(filenopath);
+	std::map<std::string, Module*>::const_iterator iter = LoadedModules.find(modulename);
 	if(iter != LoadedModules.end())
 		return *(iter->second);
 
-	return *(LoadedModules.insert(std::make_pair(filenopath, new Module(filename))).first->second);
+	std::map<std::string, std::string>::iterator imageiter = RegisteredImages.find(modulename);
+	if(imageiter == RegisteredImages.end())
+		throw std::exception("Failed to load CUDA assembly module - no code has been generated for the module");
+
+	Module* module = new Module(imageiter->second);
+	RegisteredImages.erase(imageiter);
+
+	return *(LoadedModules.insert(std::make_pair(modulename, module)).first->second);
 }
 
-Module& Module::LoadCUDAModule(const std::string& filename, const std::vector<std::string>& functionnames, const void* buffer)
+Module& Module::LoadCUDAModule(const std::string& modulename, const std::vector<std::string>& functionnames, const void* buffer, size_t buffersize)
 {
 	Threads::CriticalSection::Auto mutex(ModuleListCriticalSection);
 
-	std::map<std::string, Module*>::const_iterator iter = LoadedModules.find(filename);
+	std::map<std::string, Module*>::const_iterator iter = LoadedModules.find(modulename);
 	if(iter != LoadedModules.end())
 		return *(iter->second);
 
-	return *(LoadedModules.insert(std::make_pair(filename, new Module(functionnames, buffer))).first->second);
+	return *(LoadedModules.insert(std::make_pair(modulename, new Module(functionnames, buffer, buffersize))).first->second);
 }
 
 
@@ -146,6 +193,9 @@ void Module::ReleaseAllModules()
 
 	for(std::map<std::string, Module*>::iterator iter = LoadedModules.begin(); iter != LoadedModules.end(); ++iter)
 		delete iter->second;
+
+	LoadedModules.clear();
+	RegisteredImages.clear();
 }
 
 
@@ -159,14 +209,12 @@ std::string Module::BuildSerializationData()
 	for(std::map<std::string, Module*>::const_iterator iter = LoadedModules.begin(); iter != LoadedModules.end(); ++iter)
 	{
 		stream << iter->first << " " << iter->second->LoadedFunctions.size() << "\n";
-		for(std::map<std::string, FunctionCall*>::const_iterator funciter = iter->second->LoadedFunctions.begin(); funciter != iter->second->LoadedFunctions.end(); ++funciter)
+		for(std::map<std::string, std::vector<FunctionCall*> >::const_iterator funciter = iter->second->LoadedFunctions.begin(); funciter != iter->second->LoadedFunctions.end(); ++funciter)
 			stream << funciter->first << "\n";
 
-		std::vector<Byte> temp;
-		stream << Files::GetFileSize(iter->second->FullFileName.c_str()) << "\n";
-		Files::Load(iter->second->FullFileName.c_str(), temp);
-
-		stream.write(&temp[0], static_cast<std::streamsize>(temp.size()));
+		const std::string& image = iter->second->Image;
+		stream << image.length() << "\n";
+		stream.write(image.data(), static_cast<std::streamsize>(image.length()));
 		stream << "\n";
 	}
 
@@ -4,6 +4,11 @@
 //
 // Wrapper class for handling CUDA modules
 //
+// Modules are loaded from PTX images held in memory. Generated PTX is
+// registered under a module name as soon as it is available, and loaded
+// the first time the module is requested; the image is kept so that the
+// module can be serialized along with the program.
+//
 
 #pragma once
 
@@ -22,29 +27,37 @@ class Module
 {
 // Construction and destruction
 private:
-	explicit Module(const std::string& modulefilename);
-	Module(const std::vector<std::string>& functionnames, const void* codebuffer);
+	explicit Module(const std::string& image);
+	Module(const std::vector<std::string>& functionnames, const void* codebuffer, size_t codesize);
 	~Module();
 
 // Function access interface
 public:
-	FunctionCall CreateFunctionCall(const std::string& functionname);
+	FunctionCall CreateFunctionCall(const std::string& functionname, size_t deviceindex = 0);
 
 // Module wrapper creation and management
 public:
-	static Module& LoadCUDAModule(const std::string& filename);
-	static Module& LoadCUDAModule(const std::string& filename, const std::vector<std::string>& functionnames, const void* buffer);
+	static void RegisterImage(const std::string& modulename, const std::string& image);
+	static Module& LoadCUDAModule(const std::string& modulename);
+	static Module& LoadCUDAModule(const std::string& modulename, const std::vector<std::string>& functionnames, const void* buffer, size_t buffersize);
 	static void ReleaseAllModules();
 
 // Compilation/serialization helpers
 public:
 	static std::string BuildSerializationData();
 
+// Internal helpers
+private:
+	void LoadIntoAllDevices();
+
 // Internal tracking
 private:
-	std::string FullFileName;
-	CUmodule ModuleHandle;
-	std::map<std::string, FunctionCall*> LoadedFunctions;
+	std::string Image;
+
+	// Modules are loaded separately into the context of each device; function
+	// handles are likewise resolved once per device, in the same order
+	std::vector<CUmodule> ModuleHandles;
+	std::map<std::string, std::vector<FunctionCall*> > LoadedFunctions;
 	Threads::CriticalSection CritSec;
 };
 
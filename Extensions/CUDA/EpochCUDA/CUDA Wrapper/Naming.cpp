@@ -9,6 +9,9 @@
 
 #include "CUDA Wrapper/Naming.h"
 
+#include "Language Extensions/FunctionPointerTypes.h"
+
+#include "Utility/Strings.h"
 
 
 //
@@ -24,3 +27,23 @@ std::string GenerateFunctionName(Extensions::OriginalCodeHandle handle)
 	return stream.str();
 }
 
+//
+// Create a unique kernel name for a map or reduce operation
+//
+// Array operations are not attached to any code block, so they are identified
+// by the mapped function (or reduction operator) and the types involved. This
+// lets the VM request an operation at run time using only information which
+// is already available from the map or reduce in the program.
+//
+std::string GenerateArrayOperationName(const Extensions::ArrayOperationInfo& info)
+{
+	std::ostringstream stream;
+	if(info.Operation == Extensions::ArrayOperation_Map)
+		stream << "epoch_map_";
+	else
+		stream << "epoch_reduce_";
+
+	stream << narrow(info.FunctionName) << "_" << info.ElementType << "_" << info.ResultType;
+	return stream.str();
+}
+
@@ -12,6 +12,14 @@
 #include "Language Extensions/HandleTypes.h"
 
 
+// Forward declarations
+namespace Extensions
+{
+	struct ArrayOperationInfo;
+}
+
+
 std::string GenerateFunctionName(Extensions::OriginalCodeHandle handle);
+std::string GenerateArrayOperationName(const Extensions::ArrayOperationInfo& info);
 
 
@@ -9,38 +9,264 @@
 
 #include "CUDA Wrapper/VariableBuffer.h"
 #include "CUDA Wrapper/FunctionCall.h"
+#include "CUDA Wrapper/Initialization.h"
+
+
+namespace
+{
+
+	//
+	// Gather the given synchronization buffer from each of a set of variable buffers
+	//
+	template <class SyncBufferType>
+	std::vector<const SyncBufferType*> CollectDeviceBuffers(const std::vector<VariableBuffer*>& buffers, SyncBufferType VariableBuffer::* syncbuffer)
+	{
+		std::vector<const SyncBufferType*> ret;
+		for(std::vector<VariableBuffer*>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
+			ret.push_back(&((*iter)->*syncbuffer));
+		return ret;
+	}
+
+	//
+	// Retrieve the device time between two events, or zero if it cannot be measured
+	//
+	double GetElapsedMilliseconds(CUevent start, CUevent end)
+	{
+		float milliseconds = 0.0f;
+		if(cuEventElapsedTime(&milliseconds, start, end) != CUDA_SUCCESS)
+			return 0.0;
+
+		return milliseconds;
+	}
+
+}
 
 
 //
 // Construct and initialize a variable marshalling wrapper
 //
-VariableBuffer::VariableBuffer(const std::list<Traverser::ScopeContents>& variables)
-	: Variables(variables)
+VariableBuffer::VariableBuffer(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, size_t deviceindex)
+	: Variables(variables),
+	  Usage(usage),
+	  DeviceIndex(deviceindex),
+	  Stream(0),
+	  TimingPending(false),
+	  PendingBytesToDevice(0),
+	  PendingBytesFromDevice(0),
+	  Activity()
 {
+	std::fill(Events, Events + NumTimingEvents, static_cast<CUevent>(NULL));
+
+	MakeDeviceCurrent(DeviceIndex);
+
+	SyncBufferForReals.BindVariables(Variables, Usage);
+	SyncBufferForInts.BindVariables(Variables, Usage);
+
+	if(!CUDAAvailableForExecution)
+		return;
+
+	if(cuStreamCreate(&Stream, 0) != CUDA_SUCCESS)
+		throw std::exception("Failed to create a CUDA stream for transferring variable data");
+
+	for(size_t i = 0; i < NumTimingEvents; ++i)
+	{
+		if(cuEventCreate(&Events[i], CU_EVENT_DEFAULT) != CUDA_SUCCESS)
+			throw std::exception("Failed to create a CUDA event for timing variable transfers");
+	}
+}
+
+//
+// Release the device-side storage held by the wrapper
+//
+VariableBuffer::~VariableBuffer()
+{
+	MakeDeviceCurrent(DeviceIndex);
+
+	SyncBufferForReals.ReleaseDeviceMemory();
+	SyncBufferForInts.ReleaseDeviceMemory();
+
+	SyncBufferForRealArrays.ReleaseDeviceMemory();
+	SyncBufferForIntArrays.ReleaseDeviceMemory();
+
+	for(size_t i = 0; i < NumTimingEvents; ++i)
+	{
+		if(Events[i])
+			cuEventDestroy(Events[i]);
+	}
+
+	if(Stream)
+		cuStreamDestroy(Stream);
 }
 
 //
 // Copy host-side variable contents to the CUDA device
 //
+// The transfers are only queued on the buffer's stream; they are performed
+// asynchronously, ahead of any kernel launched on the same stream.
+//
 void VariableBuffer::CopyToDevice(HandleType activatedscopehandle)
 {
-	SyncBufferForReals.PassVariablesToDevice(Variables, activatedscopehandle);
-	SyncBufferForInts.PassVariablesToDevice(Variables, activatedscopehandle);
+	MakeDeviceCurrent(DeviceIndex);
+	FugueVMAccess::TraceSpan trace("CUDA queue transfers to device", DeviceIndex);
+
+	if(CUDAAvailableForExecution)
+		cuEventRecord(Events[Event_UploadStart], Stream);
 
-	SyncBufferForRealArrays.PassVariablesToDevice(Variables, activatedscopehandle);
-	SyncBufferForIntArrays.PassVariablesToDevice(Variables, activatedscopehandle);
+	PendingBytesToDevice = SyncBufferForReals.PassVariablesToDevice(Variables, Usage, activatedscopehandle, Stream);
+	PendingBytesToDevice += SyncBufferForInts.PassVariablesToDevice(Variables, Usage, activatedscopehandle, Stream);
+
+	PendingBytesToDevice += SyncBufferForRealArrays.PassVariablesToDevice(Variables, Usage, activatedscopehandle, Stream);
+	PendingBytesToDevice += SyncBufferForIntArrays.PassVariablesToDevice(Variables, Usage, activatedscopehandle, Stream);
+
+	if(CUDAAvailableForExecution)
+	{
+		cuEventRecord(Events[Event_UploadEnd], Stream);
+		TimingPending = true;
+	}
 }
 
 //
 // Read back variable contents from the CUDA device
 //
+// All transfers are queued behind any pending work on the stream, which is
+// then synchronized once before the results are passed back to the host.
+//
 void VariableBuffer::CopyFromDevice(HandleType activatedscopehandle)
 {
-	SyncBufferForReals.RetrieveVariablesFromDevice(Variables, activatedscopehandle);
-	SyncBufferForInts.RetrieveVariablesFromDevice(Variables, activatedscopehandle);
+	CopyFromDevices(std::vector<VariableBuffer*>(1, this), activatedscopehandle);
+}
+
+//
+// Read back variable contents from several CUDA devices at once
+//
+// Each buffer must have been uploaded from the same host variables. The
+// retrievals are queued on all devices before waiting on any of them, so
+// the transfers proceed in parallel; the values changed on each device are
+// then merged and written back to the host in a single pass.
+//
+void VariableBuffer::CopyFromDevices(const std::vector<VariableBuffer*>& buffers, HandleType activatedscopehandle)
+{
+	if(buffers.empty())
+		return;
+
+	for(std::vector<VariableBuffer*>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
+		(*iter)->QueueRetrieval();
+
+	for(std::vector<VariableBuffer*>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
+		(*iter)->CompleteRetrieval();
+
+	VariableBuffer& primary = *buffers.front();
+
+	primary.SyncBufferForReals.WriteBack(primary.Variables, primary.Usage, activatedscopehandle, CollectDeviceBuffers(buffers, &VariableBuffer::SyncBufferForReals));
+	primary.SyncBufferForInts.WriteBack(primary.Variables, primary.Usage, activatedscopehandle, CollectDeviceBuffers(buffers, &VariableBuffer::SyncBufferForInts));
+
+	primary.SyncBufferForRealArrays.WriteBack(primary.Variables, primary.Usage, activatedscopehandle, CollectDeviceBuffers(buffers, &VariableBuffer::SyncBufferForRealArrays));
+	primary.SyncBufferForIntArrays.WriteBack(primary.Variables, primary.Usage, activatedscopehandle, CollectDeviceBuffers(buffers, &VariableBuffer::SyncBufferForIntArrays));
+}
+
+//
+// Queue the transfers of all device contents back to the host
+//
+void VariableBuffer::QueueRetrieval()
+{
+	MakeDeviceCurrent(DeviceIndex);
+
+	if(TimingPending)
+		cuEventRecord(Events[Event_DownloadStart], Stream);
+
+	PendingBytesFromDevice = SyncBufferForReals.QueueRetrieval(Variables, Usage, Stream);
+	PendingBytesFromDevice += SyncBufferForInts.QueueRetrieval(Variables, Usage, Stream);
+
+	PendingBytesFromDevice += SyncBufferForRealArrays.QueueRetrieval(Variables, Usage, Stream);
+	PendingBytesFromDevice += SyncBufferForIntArrays.QueueRetrieval(Variables, Usage, Stream);
+
+	if(TimingPending)
+		cuEventRecord(Events[Event_DownloadEnd], Stream);
+}
+
+//
+// Wait for queued transfers to finish, and move the results into place
+//
+void VariableBuffer::CompleteRetrieval()
+{
+	MakeDeviceCurrent(DeviceIndex);
+
+	if(CUDAAvailableForExecution)
+	{
+		{
+			FugueVMAccess::TraceSpan trace("CUDA stream wait", DeviceIndex);
+			cuStreamSynchronize(Stream);
+		}
+
+		MeasureTransfers();
+	}
+
+	SyncBufferForReals.CompleteRetrieval(Variables, Usage);
+	SyncBufferForInts.CompleteRetrieval(Variables, Usage);
+
+	SyncBufferForRealArrays.CompleteRetrieval(Variables, Usage);
+	SyncBufferForIntArrays.CompleteRetrieval(Variables, Usage);
+}
+
+
+//
+// Measure the device time taken by the transfers and kernels of the last
+// invocation, once the stream has been synchronized
+//
+// The device times are also placed on the timeline trace. They cannot be
+// related exactly to the host's clock, so the spans are laid out backwards
+// from the moment the stream was found to have finished; the trace thus
+// shows their durations faithfully, but their start times only roughly.
+//
+void VariableBuffer::MeasureTransfers()
+{
+	if(!TimingPending)
+		return;
+
+	TimingPending = false;
+
+	double uploadms = GetElapsedMilliseconds(Events[Event_UploadStart], Events[Event_UploadEnd]);
+	double kernelms = GetElapsedMilliseconds(Events[Event_UploadEnd], Events[Event_DownloadStart]);
+	double downloadms = GetElapsedMilliseconds(Events[Event_DownloadStart], Events[Event_DownloadEnd]);
+
+	if(PendingBytesToDevice)
+		++Activity.NumTransfersToDevice;
+	if(PendingBytesFromDevice)
+		++Activity.NumTransfersFromDevice;
+
+	Activity.BytesToDevice += PendingBytesToDevice;
+	Activity.BytesFromDevice += PendingBytesFromDevice;
+	Activity.TransferToDeviceMilliseconds += uploadms;
+	Activity.KernelMilliseconds += kernelms;
+	Activity.TransferFromDeviceMilliseconds += downloadms;
 
-	SyncBufferForRealArrays.RetrieveVariablesFromDevice(Variables, activatedscopehandle);
-	SyncBufferForIntArrays.RetrieveVariablesFromDevice(Variables, activatedscopehandle);
+	unsigned __int64 downloadend = FugueVMAccess::GetTimestamp();
+	unsigned __int64 kernelend = downloadend - FugueVMAccess::MillisecondsToTicks(downloadms);
+	unsigned __int64 uploadend = kernelend - FugueVMAccess::MillisecondsToTicks(kernelms);
+	unsigned __int64 uploadstart = uploadend - FugueVMAccess::MillisecondsToTicks(uploadms);
+
+	FugueVMAccess::RecordSpan("CUDA transfer to device", uploadstart, uploadend, PendingBytesToDevice);
+	FugueVMAccess::RecordSpan("CUDA kernel", uploadend, kernelend, DeviceIndex);
+	FugueVMAccess::RecordSpan("CUDA transfer from device", kernelend, downloadend, PendingBytesFromDevice);
+
+	PendingBytesToDevice = 0;
+	PendingBytesFromDevice = 0;
+}
+
+//
+// Add the measurements gathered since the last collection to the given totals
+//
+void VariableBuffer::CollectActivity(Extensions::CodeBlockActivity& activity)
+{
+	activity.NumTransfersToDevice += Activity.NumTransfersToDevice;
+	activity.NumTransfersFromDevice += Activity.NumTransfersFromDevice;
+	activity.BytesToDevice += Activity.BytesToDevice;
+	activity.BytesFromDevice += Activity.BytesFromDevice;
+	activity.TransferToDeviceMilliseconds += Activity.TransferToDeviceMilliseconds;
+	activity.TransferFromDeviceMilliseconds += Activity.TransferFromDeviceMilliseconds;
+	activity.KernelMilliseconds += Activity.KernelMilliseconds;
+
+	Activity = Extensions::CodeBlockActivity();
 }
 
 
@@ -51,19 +277,21 @@ void VariableBuffer::CopyFromDevice(HandleType activatedscopehandle)
 // of data (where blocks are allocated for each necessary data type). Each pointer is
 // therefore passed as a function parameter to allow easy access.
 //
-void VariableBuffer::PrepareFunctionCall(FunctionCall& func, size_t lowerbound)
+// The lower bound and iteration count describe the index range covered by
+// a cudafor loop; threads launched beyond the end of the range do nothing.
+//
+void VariableBuffer::PrepareFunctionCall(FunctionCall& func, size_t lowerbound, size_t count)
 {
 	func.AddNumericParameter(lowerbound);
+	func.AddNumericParameter(count);
 
 	func.AddPointerParameter(SyncBufferForReals.GetDevicePointer());
 	func.AddPointerParameter(SyncBufferForInts.GetDevicePointer());
 
-	SyncBufferForRealArrays.PrepareArraySizesBuffer();
 	func.AddPointerParameter(SyncBufferForRealArrays.GetDevicePointer());
 	func.AddNumericParameter(SyncBufferForRealArrays.GetNumArrays());
 	func.AddPointerParameter(SyncBufferForRealArrays.GetSizesBufferPointer());
 
-	SyncBufferForIntArrays.PrepareArraySizesBuffer();
 	func.AddPointerParameter(SyncBufferForIntArrays.GetDevicePointer());
 	func.AddNumericParameter(SyncBufferForIntArrays.GetNumArrays());
 	func.AddPointerParameter(SyncBufferForIntArrays.GetSizesBufferPointer());
@@ -12,8 +12,11 @@
 #include <cuda.h>
 
 #include "Traverser/TraversalInterface.h"
+#include "Code Generation/CompiledCodeManager.h"
 #include "FugueVMAccess.h"
 
+#include <algorithm>
+
 
 // Forward declarations
 class FunctionCall;
@@ -24,76 +27,119 @@ extern bool CUDALibraryLoaded;
 
 
 //
-// Helper class for storing data buffers of specific types; used internally by the VariableBuffer
+// Helper class for maintaining a device-side copy of a block of host data
 //
-template <typename T, VM::EpochVariableTypeID DataType>
-class SynchronizableBuffer
+// Device allocations are kept alive between invocations of a code block, along
+// with a shadow copy of what the device currently holds. Uploads then only need
+// to transfer the runs of elements which differ from the shadow; the allocation
+// itself is only replaced when the required size changes.
+//
+// All transfers are queued asynchronously on the given stream, and go through
+// a page-locked staging buffer, since the driver can only perform asynchronous
+// copies to and from page-locked host memory. Downloads are completed in two
+// steps: once the stream has been synchronized, the downloaded data is moved
+// from the staging buffer into the shadow copy. The staging buffer must not be
+// touched while transfers are in flight, so the stream must be synchronized
+// before the next upload is queued.
+//
+// Uploads and downloads return the number of bytes they queued, for the
+// benefit of the telemetry.
+//
+template <typename T>
+class DeviceArray
 {
-// Construction
+// Construction and destruction
 public:
-	SynchronizableBuffer()
-		: DevicePointer(0)
+	DeviceArray()
+		: DevicePointer(0),
+		  StagingBuffer(NULL)
 	{ }
 
+	~DeviceArray()
+	{ Release(); }
+
 // Data transfer operations
 public:
-	void PassVariablesToDevice(const std::list<Traverser::ScopeContents>& variables, HandleType activatedscopehandle)
+	size_t Upload(const std::vector<T>& hostcontents, CUstream stream)
 	{
-		if(!CUDAAvailableForExecution)
-			return;
+		if(hostcontents.size() != Contents.size())
+		{
+			Release();
 
-		InternalBuffer.clear();
+			if(hostcontents.empty())
+				return 0;
 
-		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+			unsigned int buffersizeinbytes = static_cast<unsigned int>(sizeof(T) * hostcontents.size());
+			if(cuMemAlloc(&DevicePointer, buffersizeinbytes) != CUDA_SUCCESS)
+				throw std::exception("Failed to allocate CUDA device memory for variable data");
+
+			void* staging = NULL;
+			if(cuMemAllocHost(&staging, buffersizeinbytes) != CUDA_SUCCESS)
+				throw std::exception("Failed to allocate page-locked host memory for CUDA variable data");
+
+			StagingBuffer = static_cast<T*>(staging);
+			std::copy(hostcontents.begin(), hostcontents.end(), StagingBuffer);
+			cuMemcpyHtoDAsync(DevicePointer, StagingBuffer, buffersizeinbytes, stream);
+			Contents = hostcontents;
+			return buffersizeinbytes;
+		}
+
+		size_t bytesqueued = 0;
+		size_t i = 0;
+		while(i < hostcontents.size())
 		{
-			if(iter->Type == DataType)
+			if(hostcontents[i] == Contents[i])
 			{
-				Traverser::Payload payload;
-				FugueVMAccess::Interface.MarshalRead(activatedscopehandle, iter->Identifier.c_str(), &payload);
-				InternalBuffer.push_back(payload.GetValueByType<T>());
+				++i;
+				continue;
 			}
-		}
 
-		if(DevicePointer)
-		{
-			cuMemFree(DevicePointer);
-			DevicePointer = 0;
-		}
+			size_t runstart = i;
+			while(i < hostcontents.size() && !(hostcontents[i] == Contents[i]))
+			{
+				Contents[i] = StagingBuffer[i] = hostcontents[i];
+				++i;
+			}
 
-		if(!InternalBuffer.empty())
-		{
-			unsigned int buffersizeinbytes = static_cast<unsigned int>(sizeof(T) * InternalBuffer.size());
-			cuMemAlloc(&DevicePointer, buffersizeinbytes);
-			cuMemcpyHtoD(DevicePointer, &InternalBuffer[0], buffersizeinbytes);
+			cuMemcpyHtoDAsync(DevicePointer + static_cast<unsigned int>(sizeof(T) * runstart), StagingBuffer + runstart, static_cast<unsigned int>(sizeof(T) * (i - runstart)), stream);
+			bytesqueued += sizeof(T) * (i - runstart);
 		}
+
+		return bytesqueued;
 	}
 
-	void RetrieveVariablesFromDevice(const std::list<Traverser::ScopeContents>& variables, HandleType activatedscopehandle)
+	size_t QueueDownload(size_t offset, size_t count, CUstream stream)
 	{
-		if(!CUDAAvailableForExecution)
-			return;
+		if(!count)
+			return 0;
 
-		if(InternalBuffer.empty())
+		cuMemcpyDtoHAsync(StagingBuffer + offset, DevicePointer + static_cast<unsigned int>(sizeof(T) * offset), static_cast<unsigned int>(sizeof(T) * count), stream);
+		return sizeof(T) * count;
+	}
+
+	void CompleteDownload(size_t offset, size_t count)
+	{
+		if(!count)
 			return;
 
-		unsigned int buffersizeinbytes = static_cast<unsigned int>(sizeof(T) * InternalBuffer.size());
-		cuMemcpyDtoH(&InternalBuffer[0], DevicePointer, buffersizeinbytes);
+		std::copy(StagingBuffer + offset, StagingBuffer + offset + count, Contents.begin() + offset);
+	}
 
-		unsigned index = 0;
+	void Release()
+	{
+		if(DevicePointer)
+		{
+			cuMemFree(DevicePointer);
+			DevicePointer = 0;
+		}
 
-		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+		if(StagingBuffer)
 		{
-			if(iter->Type == DataType)
-			{
-				Traverser::Payload payload;
-				payload.Type = iter->Type;
-				payload.SetValue(InternalBuffer[index++]);
-				FugueVMAccess::Interface.MarshalWrite(activatedscopehandle, iter->Identifier.c_str(), &payload);
-			}
+			cuMemFreeHost(StagingBuffer);
+			StagingBuffer = NULL;
 		}
 
-		cuMemFree(DevicePointer);
-		DevicePointer = 0;
+		Contents.clear();
 	}
 
 // Additional accessors
@@ -101,59 +147,257 @@ public:
 	CUdeviceptr GetDevicePointer() const
 	{ return DevicePointer; }
 
+	const std::vector<T>& GetContents() const
+	{ return Contents; }
+
 // Internal tracking
 private:
 	CUdeviceptr DevicePointer;
-	std::vector<T> InternalBuffer;
+	T* StagingBuffer;
+	std::vector<T> Contents;
+
+// Copying is not permitted, since the device allocations are owned by the wrapper
+private:
+	DeviceArray(const DeviceArray&);
+	DeviceArray& operator = (const DeviceArray&);
 };
 
 
 //
-// Helper class for storing data buffers of specific array types; used internally by the VariableBuffer
+// Helper class for storing data buffers of specific types; used internally by the VariableBuffer
+//
+// The variables of the buffer's type are assigned consecutive slots in the
+// device buffer. Which slots must be read from and written back to the host
+// is worked out once, when the buffer is bound to its variable list; each
+// transfer then moves all of the affected values through the VM's bulk
+// marshalling interface in a single call, rather than one call per variable.
 //
 template <typename T, VM::EpochVariableTypeID DataType>
-class SynchronizableArrayBuffer
+class SynchronizableBuffer
 {
 // Construction
 public:
-	SynchronizableArrayBuffer()
-		: DevicePointer(0), SizesDevicePointer(0)
+	SynchronizableBuffer()
+		: PendingRetrieval(false),
+		  NumSlots(0)
 	{ }
 
-// Preparation operations
+// Setup
+public:
+	//
+	// Precompute the slots and identifiers of the variables handled by this buffer
+	//
+	// The identifier pointers refer to the strings held in the variable list,
+	// which must therefore outlive the buffer.
+	//
+	void BindVariables(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage)
+	{
+		NumSlots = 0;
+		ReadSlots.clear();
+		ReadIdentifiers.clear();
+		WrittenSlots.clear();
+		WrittenIdentifiers.clear();
+
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+		{
+			if(iter->Type == DataType)
+			{
+				unsigned flags = Compiler::LookupVariableUsage(usage, iter->Identifier);
+				if(flags)
+				{
+					ReadSlots.push_back(NumSlots);
+					ReadIdentifiers.push_back(iter->Identifier.c_str());
+				}
+
+				if(flags & Compiler::VariableUsage_Written)
+				{
+					WrittenSlots.push_back(NumSlots);
+					WrittenIdentifiers.push_back(iter->Identifier.c_str());
+				}
+
+				++NumSlots;
+			}
+		}
+	}
+
+// Data transfer operations
 public:
-	void PrepareArraySizesBuffer()
+	//
+	// Pass the values of variables used by the device code to the device
+	//
+	// Variables which the device code never touches still occupy a slot in
+	// the device buffer; their slots are simply left with whatever the device
+	// already holds, so that they do not need to be read from the host.
+	//
+	size_t PassVariablesToDevice(const std::list<Traverser::ScopeContents>&, const Compiler::VariableUsageTable&, HandleType activatedscopehandle, CUstream stream)
+	{
+		if(!CUDAAvailableForExecution)
+			return 0;
+
+		const std::vector<T>& devicecontents = Device.GetContents();
+
+		InternalBuffer.assign(NumSlots, T());
+		std::copy(devicecontents.begin(), devicecontents.begin() + std::min(devicecontents.size(), NumSlots), InternalBuffer.begin());
+
+		if(!ReadIdentifiers.empty())
+		{
+			MarshalledValues.resize(ReadIdentifiers.size());
+			FugueVMAccess::Interface.MarshalReadBulk(activatedscopehandle, ReadIdentifiers.size(), &ReadIdentifiers[0], DataType, &MarshalledValues[0]);
+
+			for(size_t i = 0; i < ReadSlots.size(); ++i)
+				InternalBuffer[ReadSlots[i]] = MarshalledValues[i];
+		}
+
+		return Device.Upload(InternalBuffer, stream);
+	}
+
+	//
+	// Queue the transfer of device contents back to the host
+	//
+	// The device leaves variables it does not write unchanged, so the
+	// transfer is skipped entirely if no variable of this type is written.
+	//
+	size_t QueueRetrieval(const std::list<Traverser::ScopeContents>&, const Compiler::VariableUsageTable&, CUstream stream)
 	{
+		PendingRetrieval = false;
+
 		if(!CUDAAvailableForExecution)
+			return 0;
+
+		if(InternalBuffer.empty())
+			return 0;
+
+		PendingRetrieval = !WrittenSlots.empty();
+
+		if(!PendingRetrieval)
+			return 0;
+
+		return Device.QueueDownload(0, InternalBuffer.size(), stream);
+	}
+
+	//
+	// Once queued transfers have finished, move the downloaded values into place
+	//
+	void CompleteRetrieval(const std::list<Traverser::ScopeContents>&, const Compiler::VariableUsageTable&)
+	{
+		if(!PendingRetrieval)
 			return;
 
-		if(SizesDevicePointer)
+		Device.CompleteDownload(0, InternalBuffer.size());
+	}
+
+	//
+	// Pass any values which were modified by the device code back to the host variables
+	//
+	// When a code block is split across several devices, each device holds
+	// its own copy of the variables; the results of all devices are merged,
+	// with later devices taking precedence if several modified the same value.
+	//
+	void WriteBack(const std::list<Traverser::ScopeContents>&, const Compiler::VariableUsageTable&, HandleType activatedscopehandle, const std::vector<const SynchronizableBuffer*>& devicebuffers)
+	{
+		if(!PendingRetrieval)
+			return;
+
+		PendingRetrieval = false;
+
+		std::vector<T> merged;
+		const std::vector<T>* results = &Device.GetContents();
+		if(devicebuffers.size() > 1)
 		{
-			cuMemFree(SizesDevicePointer);
-			SizesDevicePointer = 0;
+			merged = InternalBuffer;
+			for(typename std::vector<const SynchronizableBuffer*>::const_iterator iter = devicebuffers.begin(); iter != devicebuffers.end(); ++iter)
+				(*iter)->MergeResults(merged, 0, merged.size());
+			results = &merged;
 		}
 
-		if(!InternalBuffer.empty())
+		// Only the values which actually changed are passed back
+		std::vector<const wchar_t*> changedidentifiers;
+		MarshalledValues.clear();
+
+		for(size_t i = 0; i < WrittenSlots.size(); ++i)
 		{
-			unsigned sizeinbytes = static_cast<unsigned>(sizeof(unsigned) * InternalBuffer.size());
+			size_t slot = WrittenSlots[i];
+			if(!((*results)[slot] == InternalBuffer[slot]))
+			{
+				changedidentifiers.push_back(WrittenIdentifiers[i]);
+				MarshalledValues.push_back((*results)[slot]);
+			}
+		}
 
-			std::vector<unsigned> sizebuffer;
-			for(std::vector<std::vector<T> >::const_iterator iter = InternalBuffer.begin(); iter != InternalBuffer.end(); ++iter)
-				sizebuffer.push_back(static_cast<unsigned>(iter->size()));
+		if(!changedidentifiers.empty())
+			FugueVMAccess::Interface.MarshalWriteBulk(activatedscopehandle, changedidentifiers.size(), &changedidentifiers[0], DataType, &MarshalledValues[0]);
+	}
 
-			cuMemAlloc(&SizesDevicePointer, sizeinbytes);
-			cuMemcpyHtoD(SizesDevicePointer, &sizebuffer[0], sizeinbytes);
+	//
+	// Overlay the values this buffer's device changed onto the given results
+	//
+	void MergeResults(std::vector<T>& merged, size_t offset, size_t count) const
+	{
+		if(!PendingRetrieval)
+			return;
+
+		const std::vector<T>& devicecontents = Device.GetContents();
+		for(size_t i = offset; i < offset + count; ++i)
+		{
+			if(!(devicecontents[i] == InternalBuffer[i]))
+				merged[i] = devicecontents[i];
 		}
 	}
 
+	void ReleaseDeviceMemory()
+	{
+		Device.Release();
+	}
+
+// Additional accessors
+public:
+	CUdeviceptr GetDevicePointer() const
+	{ return Device.GetDevicePointer(); }
+
+// Internal tracking
+private:
+	DeviceArray<T> Device;
+	std::vector<T> InternalBuffer;
+	std::vector<T> MarshalledValues;
+	bool PendingRetrieval;
+
+	size_t NumSlots;
+	std::vector<size_t> ReadSlots;
+	std::vector<const wchar_t*> ReadIdentifiers;
+	std::vector<size_t> WrittenSlots;
+	std::vector<const wchar_t*> WrittenIdentifiers;
+};
+
+
+//
+// Helper class for storing data buffers of specific array types; used internally by the VariableBuffer
+//
+// All arrays of the given type are flattened into a single device buffer; a
+// second device buffer holds the length of each array.
+//
+template <typename T, VM::EpochVariableTypeID DataType>
+class SynchronizableArrayBuffer
+{
 // Data transfer operations
 public:
-	void PassVariablesToDevice(const std::list<Traverser::ScopeContents>& variables, HandleType activatedscopehandle)
+	//
+	// Pass the contents of arrays used by the device code to the device
+	//
+	// Every array must be read to determine the buffer layout; however, if
+	// the layout has not changed since the previous invocation, the contents
+	// of arrays which the device code never touches are taken from what the
+	// device already holds rather than copied from the host.
+	//
+	size_t PassVariablesToDevice(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle, CUstream stream)
 	{
 		if(!CUDAAvailableForExecution)
-			return;
+			return 0;
 
-		InternalBuffer.clear();
+		std::vector<Traverser::Payload> payloads;
+		std::vector<bool> used;
+
+		ArraySizes.clear();
+		size_t buffersize = 0;
 
 		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
 		{
@@ -161,121 +405,256 @@ public:
 			{
 				Traverser::Payload payload;
 				FugueVMAccess::Interface.MarshalRead(activatedscopehandle, iter->Identifier.c_str(), &payload);
-				InternalBuffer.push_back(std::vector<T>(payload.ParameterCount));
-				for(size_t i = 0; i < payload.ParameterCount; ++i)
-					InternalBuffer.back()[i] = *(reinterpret_cast<T*>(payload.PointerValue) + i);
+				payloads.push_back(payload);
+				used.push_back(Compiler::LookupVariableUsage(usage, iter->Identifier) != 0);
+				ArraySizes.push_back(static_cast<unsigned>(payload.ParameterCount));
+				buffersize += payload.ParameterCount;
 			}
 		}
 
-		if(DevicePointer)
+		const std::vector<T>& devicecontents = Device.GetContents();
+		bool layoutunchanged = (ArraySizes == Sizes.GetContents() && buffersize == devicecontents.size());
+
+		InternalBuffer.resize(buffersize);
+
+		size_t index = 0;
+		for(size_t i = 0; i < payloads.size(); ++i)
 		{
-			cuMemFree(DevicePointer);
-			DevicePointer = 0;
+			if(used[i] || !layoutunchanged)
+			{
+				const T* elements = reinterpret_cast<const T*>(payloads[i].PointerValue);
+				std::copy(elements, elements + ArraySizes[i], InternalBuffer.begin() + index);
+			}
+			else
+				std::copy(devicecontents.begin() + index, devicecontents.begin() + index + ArraySizes[i], InternalBuffer.begin() + index);
+
+			index += ArraySizes[i];
 		}
 
-		if(!InternalBuffer.empty())
-		{
-			size_t buffersize = 0;
-			for(std::vector<std::vector<T> >::const_iterator iter = InternalBuffer.begin(); iter != InternalBuffer.end(); ++iter)
-				buffersize += iter->size();
+		size_t bytesqueued = Device.Upload(InternalBuffer, stream);
+		bytesqueued += Sizes.Upload(ArraySizes, stream);
+		return bytesqueued;
+	}
 
-			unsigned buffersizeinbytes = static_cast<unsigned>(buffersize * sizeof(T));
+	//
+	// Queue the transfer of arrays written by the device code back to the host
+	//
+	size_t QueueRetrieval(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, CUstream stream)
+	{
+		if(!CUDAAvailableForExecution)
+			return 0;
+
+		size_t bytesqueued = 0;
+		size_t index = 0;
+		size_t internalindex = 0;
 
-			unsigned index = 0;
-			std::vector<T> flatbuffer(buffersize);
-			for(std::vector<std::vector<T> >::const_iterator iter = InternalBuffer.begin(); iter != InternalBuffer.end(); ++iter)
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+		{
+			if(iter->Type == VM::EpochVariableType_Array && iter->ContainedType == DataType)
 			{
-				for(std::vector<T>::const_iterator inneriter = iter->begin(); inneriter != iter->end(); ++inneriter)
-				{
-					flatbuffer[index] = *inneriter;
-					++index;
-				}
+				if(Compiler::LookupVariableUsage(usage, iter->Identifier) & Compiler::VariableUsage_Written)
+					bytesqueued += Device.QueueDownload(index, ArraySizes[internalindex], stream);
+
+				index += ArraySizes[internalindex];
+				++internalindex;
 			}
-			
-			cuMemAlloc(&DevicePointer, buffersizeinbytes);
-			cuMemcpyHtoD(DevicePointer, &flatbuffer[0], buffersizeinbytes);
 		}
+
+		return bytesqueued;
 	}
 
-	void RetrieveVariablesFromDevice(const std::list<Traverser::ScopeContents>& variables, HandleType activatedscopehandle)
+	//
+	// Once queued transfers have finished, move the downloaded arrays into place
+	//
+	void CompleteRetrieval(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage)
 	{
 		if(!CUDAAvailableForExecution)
 			return;
 
-		if(InternalBuffer.empty())
-			return;
+		size_t index = 0;
+		size_t internalindex = 0;
 
-		size_t buffersize = 0;
-		for(std::vector<std::vector<T> >::const_iterator iter = InternalBuffer.begin(); iter != InternalBuffer.end(); ++iter)
-			buffersize += iter->size();
+		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+		{
+			if(iter->Type == VM::EpochVariableType_Array && iter->ContainedType == DataType)
+			{
+				if(Compiler::LookupVariableUsage(usage, iter->Identifier) & Compiler::VariableUsage_Written)
+					Device.CompleteDownload(index, ArraySizes[internalindex]);
 
-		unsigned buffersizeinbytes = static_cast<unsigned>(buffersize * sizeof(T));
+				index += ArraySizes[internalindex];
+				++internalindex;
+			}
+		}
+	}
 
-		std::vector<T> flatbuffer(buffersize);
-		cuMemcpyDtoH(&flatbuffer[0], DevicePointer, buffersizeinbytes);
+	//
+	// Pass any arrays which were modified by the device code back to the host variables
+	//
+	// When a code block is split across several devices, each device holds
+	// its own copy of the arrays; the elements modified by each device are
+	// merged into a single result before it is written back to the host.
+	//
+	void WriteBack(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle, const std::vector<const SynchronizableArrayBuffer*>& devicebuffers)
+	{
+		if(!CUDAAvailableForExecution)
+			return;
 
 		size_t index = 0;
 		size_t internalindex = 0;
 
+		std::vector<T> merged;
+		if(devicebuffers.size() > 1)
+			merged = InternalBuffer;
+
+		const std::vector<T>& results = (devicebuffers.size() > 1) ? merged : Device.GetContents();
+
 		for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
 		{
 			if(iter->Type == VM::EpochVariableType_Array && iter->ContainedType == DataType)
 			{
-				Traverser::Payload payload;
-				payload.Type = VM::EpochVariableType_Array;
-				payload.PointerValue = &(flatbuffer[index]);
-				payload.ParameterCount = InternalBuffer[internalindex].size();
-				payload.ParameterType = iter->ContainedType;
-				FugueVMAccess::Interface.MarshalWrite(activatedscopehandle, iter->Identifier.c_str(), &payload);
-				index += InternalBuffer[internalindex].size();
+				size_t arraysize = ArraySizes[internalindex];
+				if((Compiler::LookupVariableUsage(usage, iter->Identifier) & Compiler::VariableUsage_Written) && arraysize)
+				{
+					if(devicebuffers.size() > 1)
+					{
+						for(typename std::vector<const SynchronizableArrayBuffer*>::const_iterator bufferiter = devicebuffers.begin(); bufferiter != devicebuffers.end(); ++bufferiter)
+							(*bufferiter)->MergeResults(merged, index, arraysize);
+					}
+
+					if(!std::equal(results.begin() + index, results.begin() + index + arraysize, InternalBuffer.begin() + index))
+					{
+						Traverser::Payload payload;
+						payload.Type = VM::EpochVariableType_Array;
+						payload.PointerValue = const_cast<T*>(&(results[index]));
+						payload.ParameterCount = arraysize;
+						payload.ParameterType = iter->ContainedType;
+						FugueVMAccess::Interface.MarshalWrite(activatedscopehandle, iter->Identifier.c_str(), &payload);
+					}
+				}
+
+				index += arraysize;
 				++internalindex;
 			}
 		}
+	}
+
+	//
+	// Overlay the elements this buffer's device changed onto the given results
+	//
+	void MergeResults(std::vector<T>& merged, size_t offset, size_t count) const
+	{
+		const std::vector<T>& devicecontents = Device.GetContents();
+		for(size_t i = offset; i < offset + count; ++i)
+		{
+			if(!(devicecontents[i] == InternalBuffer[i]))
+				merged[i] = devicecontents[i];
+		}
+	}
 
-		cuMemFree(DevicePointer);
-		DevicePointer = 0;
+	void ReleaseDeviceMemory()
+	{
+		Device.Release();
+		Sizes.Release();
 	}
 
 // Additional accessors
 public:
 	CUdeviceptr GetDevicePointer() const
-	{ return DevicePointer; }
+	{ return Device.GetDevicePointer(); }
 
 	size_t GetNumArrays() const
-	{ return InternalBuffer.size(); }
+	{ return ArraySizes.size(); }
 
 	CUdeviceptr GetSizesBufferPointer() const
-	{ return SizesDevicePointer; }
+	{ return Sizes.GetDevicePointer(); }
 
 // Internal tracking
 private:
-	CUdeviceptr DevicePointer;
-	CUdeviceptr SizesDevicePointer;
-	std::vector<std::vector<T> > InternalBuffer;
+	DeviceArray<T> Device;
+	DeviceArray<unsigned> Sizes;
+
+	std::vector<T> InternalBuffer;
+	std::vector<unsigned> ArraySizes;
 };
 
 
 //
 // Wrapper class for batch-copying variable data back and forth to the CUDA device
 //
+// Buffers are retained by their code block and reused across invocations, so
+// that the device allocations do not need to be repeated. Each buffer owns a
+// stream on which all of its transfers (and the kernel launches using it) are
+// queued, so invocations using different buffers can overlap on the device.
+//
+// A buffer belongs to a single device. When a code block is split across
+// several devices, one buffer is used per device, and the results of all of
+// the buffers are merged when they are copied back to the host.
+//
+// Events are recorded on the stream around the uploads and the downloads,
+// so that the time the device spends on the transfers, and on the kernels
+// queued between them, can be measured once the stream is synchronized.
+// The measurements accumulate in the buffer until they are collected for
+// the telemetry; see CollectActivity.
+//
 class VariableBuffer
 {
-// Construction
+// Construction and destruction
 public:
-	VariableBuffer(const std::list<Traverser::ScopeContents>& variables);
+	VariableBuffer(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, size_t deviceindex);
+	~VariableBuffer();
 
 // Data copy operations
 public:
 	void CopyToDevice(HandleType activatedscopehandle);
 	void CopyFromDevice(HandleType activatedscopehandle);
 
+	static void CopyFromDevices(const std::vector<VariableBuffer*>& buffers, HandleType activatedscopehandle);
+
 // Helpers for function calls
 public:
-	void PrepareFunctionCall(FunctionCall& func, size_t lowerbound);
+	void PrepareFunctionCall(FunctionCall& func, size_t lowerbound, size_t count);
+
+	CUstream GetStream() const
+	{ return Stream; }
+
+	size_t GetDeviceIndex() const
+	{ return DeviceIndex; }
+
+// Telemetry
+public:
+	void CollectActivity(Extensions::CodeBlockActivity& activity);
+
+// Internal helpers
+private:
+	void QueueRetrieval();
+	void CompleteRetrieval();
+
+	void MeasureTransfers();
+
+// Events recorded on the stream for timing purposes
+private:
+	enum TimingEvent
+	{
+		Event_UploadStart,
+		Event_UploadEnd,
+		Event_DownloadStart,
+		Event_DownloadEnd,
+		NumTimingEvents
+	};
 
 // Internal tracking
 private:
 	const std::list<Traverser::ScopeContents>& Variables;
+	const Compiler::VariableUsageTable& Usage;
+
+	size_t DeviceIndex;
+	CUstream Stream;
+
+	CUevent Events[NumTimingEvents];
+	bool TimingPending;
+	size_t PendingBytesToDevice;
+	size_t PendingBytesFromDevice;
+	Extensions::CodeBlockActivity Activity;
 
 	SynchronizableBuffer<Real, VM::EpochVariableType_Real> SyncBufferForReals;
 	SynchronizableBuffer<Integer32, VM::EpochVariableType_Integer> SyncBufferForInts;
@@ -0,0 +1,31 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// In-memory buffer for generated code
+//
+// Code is generated into memory rather than into temporary files; the
+// pieces of a translation unit are only combined and written out once the
+// whole unit is ready to be handed to the compiler.
+//
+
+#pragma once
+
+
+// Dependencies
+#include <sstream>
+
+
+namespace Compiler
+{
+
+	struct GeneratedCodeBuffer
+	{
+		std::wostringstream OutputStream;
+
+		std::wstring GetCode() const
+		{ return OutputStream.str(); }
+	};
+
+}
+
@@ -0,0 +1,230 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Background invocation of the NVCC compiler
+//
+
+#include "pch.h"
+
+#include "Code Generation/CompileJobs.h"
+#include "Code Generation/PTXCache.h"
+#include "CUDA Wrapper/Module.h"
+
+#include "FugueVMAccess.h"
+
+#include "Utility/Files/SpecialPaths.h"
+#include "Utility/Process.h"
+
+#include <algorithm>
+#include <fstream>
+
+
+using namespace Compiler;
+
+
+namespace
+{
+
+	//
+	// Read the PTX written by NVCC into memory
+	//
+	bool LoadGeneratedPTX(const std::wstring& filename, std::string& ptx)
+	{
+		std::ifstream infile(filename.c_str(), std::ios::in | std::ios::binary);
+		if(!infile)
+			return false;
+
+		std::ostringstream contents;
+		contents << infile.rdbuf();
+		ptx = contents.str();
+		return !ptx.empty();
+	}
+
+}
+
+
+//
+// Construct the batch; no compilation takes place until the batch is started
+//
+CompileJobBatch::CompileJobBatch(const std::vector<CompileJob>& jobs, const std::wstring& nvccpath, const std::wstring& clpath)
+	: Jobs(jobs),
+	  NVCCPath(nvccpath),
+	  CLPath(clpath),
+	  ThreadHandle(NULL)
+{
+}
+
+//
+// Destroy the batch, waiting for any compilation still in progress
+//
+CompileJobBatch::~CompileJobBatch()
+{
+	if(ThreadHandle)
+	{
+		::WaitForSingleObject(ThreadHandle, INFINITE);
+		::CloseHandle(ThreadHandle);
+	}
+}
+
+
+//
+// Begin running the batch's jobs on a background thread
+//
+// If the thread cannot be created, the jobs are run immediately instead.
+//
+void CompileJobBatch::Start()
+{
+	ThreadHandle = ::CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+	if(!ThreadHandle)
+		RunJobs();
+}
+
+//
+// Wait for all of the batch's jobs to finish
+//
+// Throws if any of the jobs failed; this may be called any number of
+// times, from any thread.
+//
+void CompileJobBatch::Wait()
+{
+	if(ThreadHandle)
+		::WaitForSingleObject(ThreadHandle, INFINITE);
+
+	if(!ErrorMessage.empty())
+		throw std::exception(ErrorMessage.c_str());
+}
+
+
+DWORD WINAPI CompileJobBatch::ThreadProc(LPVOID param)
+{
+	reinterpret_cast<CompileJobBatch*>(param)->RunJobs();
+	return 0;
+}
+
+//
+// Run each job of the batch, with up to one NVCC process per processor at a time
+//
+// Jobs whose PTX is found in the cache are completed without running NVCC;
+// the source file written for them is simply discarded. Failures are recorded for Wait() to report, rather than thrown, since
+// there is nobody to catch them on the background thread.
+//
+void CompileJobBatch::RunJobs()
+{
+	try
+	{
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+		size_t maxrunning = std::min<size_t>(std::max<DWORD>(info.dwNumberOfProcessors, 1), MAXIMUM_WAIT_OBJECTS);
+
+		CachedFileNames.resize(Jobs.size());
+
+		std::vector<HANDLE> running;
+		std::vector<size_t> runningjobs;
+		std::vector<unsigned __int64> runningstartticks;
+		size_t nextjob = 0;
+
+		while(nextjob < Jobs.size() || !running.empty())
+		{
+			while(running.size() < maxrunning && nextjob < Jobs.size())
+			{
+				const CompileJob& job = Jobs[nextjob];
+				unsigned __int64 startticks = FugueVMAccess::GetTimestamp();
+				CachedFileNames[nextjob] = PTXCache::GetCachedFileName(job.SourceCode, NVCCPath, CLPath);
+
+				std::string ptx;
+				if(PTXCache::Fetch(CachedFileNames[nextjob], ptx))
+					FinishJob(nextjob, ptx, startticks);
+				else
+				{
+					running.push_back(LaunchJob(job));
+					runningjobs.push_back(nextjob);
+					runningstartticks.push_back(startticks);
+				}
+
+				++nextjob;
+			}
+
+			if(running.empty())
+				continue;
+
+			DWORD result = ::WaitForMultipleObjects(static_cast<DWORD>(running.size()), &running[0], FALSE, INFINITE);
+			size_t finished = result - WAIT_OBJECT_0;
+			if(finished >= running.size())
+				throw std::exception("Failed to wait for the NVCC compiler to finish");
+
+			size_t jobindex = runningjobs[finished];
+			std::string ptx;
+			if(WaitForProcess(running[finished]) != 0 || !LoadGeneratedPTX(Jobs[jobindex].PTXFileName, ptx))
+				ErrorMessage = "NVCC compiler encountered errors";
+			else
+			{
+				PTXCache::Store(ptx, CachedFileNames[jobindex]);
+				FinishJob(jobindex, ptx, runningstartticks[finished]);
+			}
+
+			::DeleteFile(Jobs[jobindex].PTXFileName.c_str());
+
+			running.erase(running.begin() + finished);
+			runningjobs.erase(runningjobs.begin() + finished);
+			runningstartticks.erase(runningstartticks.begin() + finished);
+		}
+	}
+	catch(std::exception& e)
+	{
+		ErrorMessage = e.what();
+	}
+	catch(...)
+	{
+		ErrorMessage = "An unrecognized exception was thrown while running the NVCC compiler";
+	}
+}
+
+//
+// Launch the NVCC process for a single job
+//
+// Note that we launch indirectly by invoking CMD.EXE; this is the
+// only way I could find to get the stdout and stderr outputs to
+// display correctly when using the Epoch command line tools.
+// Simply trying to redirect the handles via CreateProcess doesn't
+// work; something internally in NVCC changes and only minimal
+// error/status output is produced. It would be nice if we could
+// just invoke the compiler directly.
+//
+HANDLE CompileJobBatch::LaunchJob(const CompileJob& job) const
+{
+	std::wstring args = L"/c " + NVCCPath + L" --compiler-bindir=" + CLPath + L" --ptx " + job.SourceFileName + L" --output-file=" + job.PTXFileName;
+	std::wstring cmdpath = SpecialPaths::GetSystemPath() + L"\\cmd.exe";
+
+	try
+	{
+		return LaunchProcess(cmdpath, args);
+	}
+	catch(ProcessLaunchException&)
+	{
+		throw std::exception("Could not locate or launch CMD.EXE; unable to invoke NVCC compiler");
+	}
+}
+
+//
+// Hand the PTX of a completed job over for loading, discard the job's
+// source file, and report the time the job took
+//
+void CompileJobBatch::FinishJob(size_t jobindex, const std::string& ptx, unsigned __int64 startticks)
+{
+	const CompileJob& job = Jobs[jobindex];
+
+	Module::RegisterImage(job.ModuleName, ptx);
+	::DeleteFile(job.SourceFileName.c_str());
+
+	unsigned __int64 endticks = FugueVMAccess::GetTimestamp();
+	FugueVMAccess::RecordSpan("CUDA compile", startticks, endticks, job.CodeHandle);
+
+	if(job.CodeHandle)
+	{
+		Extensions::CodeBlockActivity activity = Extensions::CodeBlockActivity();
+		activity.NumCompilations = 1;
+		activity.CompileMilliseconds = FugueVMAccess::TicksToMilliseconds(endticks - startticks);
+		FugueVMAccess::RecordActivity(job.CodeHandle, activity);
+	}
+}
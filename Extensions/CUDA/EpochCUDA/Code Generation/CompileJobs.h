@@ -0,0 +1,94 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Background invocation of the NVCC compiler
+//
+// Each code block of a program is generated into a translation unit of
+// its own, so that the blocks can be compiled by separate NVCC processes.
+// All of the processes a program needs are run from a background thread,
+// several at a time, while the VM carries on with the rest of the program;
+// the compiled code is only waited for once it is actually needed.
+//
+// NVCC can only read its input from a named source file, and only writes
+// PTX to a named output file, so each translation unit is written out
+// once, immediately before it is compiled, and the PTX is read straight
+// back into memory; both files are deleted as soon as NVCC is done with
+// them. The PTX is then loaded from memory; see Module::RegisterImage.
+//
+// The time taken by each job, from launching NVCC (or looking up the PTX
+// cache) to registering the PTX, is reported to the VM telemetry under the
+// code block the job was compiled for.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Language Extensions/HandleTypes.h"
+
+
+namespace Compiler
+{
+
+	//
+	// A single NVCC invocation, compiling one translation unit to PTX
+	//
+	// The PTX is registered under the given module name once it has been
+	// generated. Jobs which do not belong to a single code block, such as
+	// the shared module of map and reduce kernels, have no code handle.
+	//
+	struct CompileJob
+	{
+		Extensions::CodeBlockHandle CodeHandle;
+		std::wstring SourceCode;
+		std::wstring SourceFileName;
+		std::wstring PTXFileName;
+		std::string ModuleName;
+	};
+
+
+	//
+	// Set of NVCC invocations run together on a background thread
+	//
+	// PTX previously generated for identical code is reused from the cache
+	// instead of running NVCC; see PTXCache.h.
+	//
+	class CompileJobBatch
+	{
+	// Construction and destruction
+	public:
+		CompileJobBatch(const std::vector<CompileJob>& jobs, const std::wstring& nvccpath, const std::wstring& clpath);
+		~CompileJobBatch();
+
+	// Batch interface
+	public:
+		void Start();
+		void Wait();
+
+	// Internal helpers
+	private:
+		static DWORD WINAPI ThreadProc(LPVOID param);
+		void RunJobs();
+
+		HANDLE LaunchJob(const CompileJob& job) const;
+		void FinishJob(size_t jobindex, const std::string& ptx, unsigned __int64 startticks);
+
+	// Internal tracking
+	private:
+		std::vector<CompileJob> Jobs;
+		std::vector<std::wstring> CachedFileNames;
+
+		std::wstring NVCCPath;
+		std::wstring CLPath;
+
+		HANDLE ThreadHandle;
+		std::string ErrorMessage;
+
+	// Copying is not permitted, since the batch owns its thread
+	private:
+		CompileJobBatch(const CompileJobBatch&);
+		CompileJobBatch& operator = (const CompileJobBatch&);
+	};
+
+}
@@ -9,19 +9,28 @@
 
 #include "Code Generation/CompiledCodeManager.h"
 #include "Code Generation/EASMToCUDA.h"
+#include "Code Generation/CompileJobs.h"
+#include "Code Generation/CodeBuffer.h"
 #include "CUDA Wrapper/Module.h"
+#include "CUDA Wrapper/Naming.h"
+#include "CUDA Wrapper/FunctionCall.h"
+#include "Host Code/HostCodeInvoker.h"
 
 #include "FugueVMAccess.h"
 #include "Exports.h"
 
+#include "Language Extensions/FunctionPointerTypes.h"
+
 #include "Configuration/ConfigFile.h"
 
 #include "Utility/Files/FilesAndPaths.h"
 #include "Utility/Files/SpecialPaths.h"
-#include "Utility/Files/Files.h"
+#include "Utility/Files/TempFile.h"
 #include "Utility/Process.h"
 #include "Utility/Strings.h"
 
+#include "Utility/Threading/Synchronization.h"
+
 #include <fstream>
 
 
@@ -45,40 +54,50 @@ std::map<CodeBlockHandle, std::wstring> CodeHandleToKeywordMap;
 // Track the known variables for each generated code block
 std::map<CodeBlockHandle, std::list<Traverser::ScopeContents> > RegisteredVariablesMap;
 
+// Track how each generated code block uses its known variables
+std::map<CodeBlockHandle, VariableUsageTable> VariableUsageMap;
+
+// Track which compile session generated the kernel for each supported map/reduce operation
+std::map<std::string, CompileSessionHandle> ArrayOperationToSessionMap;
+
+// Track the CUDA module generated for each code block
+std::map<CodeBlockHandle, std::string> CodeHandleToModuleMap;
+
+// Keep track of the CUDA module names we have generated
+unsigned ModuleNameCounter = 0;
+
 
 // We need to use the config file to locate the NVCC and CL compilers
 extern Config::ConfigReader Configuration;
 
 
-// Helpers/tracking for creating temporary intermediate files
+// Tracking for the code generated by a compile session
 struct CompileSessionData
 {
-	CompileSessionData(TemporaryFileWriter* writer, HandleType programhandle)
-		: CompilationTempFile(writer),
-		  BoundProgramHandle(programhandle)
+	explicit CompileSessionData(HandleType programhandle)
+		: BoundProgramHandle(programhandle)
 	{ }
 
-	~CompileSessionData()
-	{
-		delete CompilationTempFile;
-	}
-
-	void CloseTempFile()
-	{
-		delete CompilationTempFile;
-		CompilationTempFile = NULL;
-	}
-
-	void AttachToTempFile(TemporaryFileWriter* writer)
+	// Map and reduce kernels requested during parsing; see CompileArrayOperation
+	struct PendingArrayOperation
 	{
-		CloseTempFile();
-		CompilationTempFile = writer;
-	}
+		std::wstring FunctionName;
+		std::wstring KernelCode;
+	};
 
-	TemporaryFileWriter* CompilationTempFile;
-	std::wstring GeneratedPTXFileName;
+	std::string GeneratedModuleName;
+	std::wstring GeneratedHostLibraryFileName;
 	std::set<std::wstring> InvokedFunctionList;
+	std::map<std::string, PendingArrayOperation> PendingArrayOperations;
 	HandleType BoundProgramHandle;
+
+	// Each code block is generated separately, and held in memory until the session is committed; see GetCompiledBlock
+	std::map<CodeBlockHandle, std::wstring> BlockSources;
+
+	// NVCC runs in the background once the session is committed; see WaitForCompilation
+	std::auto_ptr<Compiler::CompileJobBatch> PendingCompilation;
+	std::string CompilationError;
+	Threads::CriticalSection CompilationCriticalSection;
 };
 
 // Track active compile sessions
@@ -88,6 +107,248 @@ std::map<CompileSessionHandle, CompileSessionData*> CompileSessionMap;
 std::map<CodeBlockHandle, CompileSessionHandle> CodeHandleToSessionMap;
 
 
+namespace
+{
+
+	//
+	// Retrieve the CUDA type used for elements of the given type, or NULL if the type cannot be used
+	//
+	const wchar_t* GetDeviceTypeName(VM::EpochVariableTypeID type)
+	{
+		switch(type)
+		{
+		case VM::EpochVariableType_Integer:		return L"int";
+		case VM::EpochVariableType_Real:		return L"float";
+		}
+
+		return NULL;
+	}
+
+	//
+	// Generate a kernel which applies a function to each element of an array
+	//
+	std::wstring GenerateMapKernel(const std::string& kernelname, const ArrayOperationInfo& info)
+	{
+		std::wostringstream out;
+		out << L"extern \"C\" __global__ void " << widen(kernelname) << L"(" << GetDeviceTypeName(info.ElementType) << L"* __input, " << GetDeviceTypeName(info.ResultType) << L"* __output, unsigned __count)\n";
+		out << L"{\n";
+		out << L"\tunsigned __index = (blockIdx.y * gridDim.x + blockIdx.x) * blockDim.x + threadIdx.x;\n";
+		out << L"\tif(__index >= __count) return;\n\n";
+		out << L"\t__output[__index] = " << info.FunctionName << L"(__input[__index]);\n";
+		out << L"}\n\n";
+		return out.str();
+	}
+
+	//
+	// Generate a kernel which performs one pass of a parallel reduction
+	//
+	// Each block loads two elements per thread and combines them pairwise in
+	// shared memory, halving the number of active threads at each step; the
+	// block's result is written to the output for the next pass. Elements past
+	// the end of the array are replaced by the operator's identity value.
+	//
+	std::wstring GenerateReduceKernel(const std::string& kernelname, const ArrayOperationInfo& info, const wchar_t* op, const wchar_t* identity)
+	{
+		const wchar_t* type = GetDeviceTypeName(info.ElementType);
+
+		std::wostringstream out;
+		out << L"extern \"C\" __global__ void " << widen(kernelname) << L"(" << type << L"* __input, " << type << L"* __output, unsigned __count)\n";
+		out << L"{\n";
+		out << L"\textern __shared__ " << type << L" __partial[];\n\n";
+		out << L"\tunsigned __block = blockIdx.y * gridDim.x + blockIdx.x;\n";
+		out << L"\tunsigned __index = __block * blockDim.x * 2 + threadIdx.x;\n\n";
+		out << L"\t" << type << L" __value = " << identity << L";\n";
+		out << L"\tif(__index < __count) __value = __input[__index];\n";
+		out << L"\tif(__index + blockDim.x < __count) __value = __value " << op << L" __input[__index + blockDim.x];\n";
+		out << L"\t__partial[threadIdx.x] = __value;\n";
+		out << L"\t__syncthreads();\n\n";
+		out << L"\tfor(unsigned __stride = blockDim.x / 2; __stride > 0; __stride >>= 1)\n";
+		out << L"\t{\n";
+		out << L"\t\tif(threadIdx.x < __stride) __partial[threadIdx.x] = __partial[threadIdx.x] " << op << L" __partial[threadIdx.x + __stride];\n";
+		out << L"\t\t__syncthreads();\n";
+		out << L"\t}\n\n";
+		out << L"\tif(threadIdx.x == 0) __output[__block] = __partial[0];\n";
+		out << L"}\n\n";
+		return out.str();
+	}
+
+	//
+	// Check that a function, and every function it invokes, can be translated to CUDA
+	//
+	// The translation is done in a scratch session, so that a function which
+	// cannot run on the device leaves no partial code in the real output. On
+	// success, the functions are recorded in the given session so that they
+	// are emitted along with all other invoked functions.
+	//
+	bool TranslateInvokedFunctions(CompileSessionData& data, const std::wstring& functionname)
+	{
+		CompileSessionHandle scratchid = Compiler::StartNewCompilation(data.BoundProgramHandle);
+		CompileSessionData* scratch = CompileSessionMap[scratchid];
+		scratch->InvokedFunctionList.insert(functionname);
+
+		bool translated = true;
+		try
+		{
+			Traverser::Interface traversal;
+			traversal.NodeEntryCallback = NodeEntryCallback;
+			traversal.NodeExitCallback = NodeExitCallback;
+			traversal.NodeTraversalCallback = LeafCallback;
+			traversal.ScopeTraversalCallback = ScopeCallback;
+			traversal.FunctionTraversalCallback = FunctionCallback;
+
+			GeneratedCodeBuffer scratchcode;
+			GeneratedCodeBuffer scratchprototypes;
+
+			// Traversing a function may record further invoked functions
+			std::set<std::wstring> traversed;
+			while(traversed.size() < scratch->InvokedFunctionList.size())
+			{
+				std::set<std::wstring>::const_iterator funciter = scratch->InvokedFunctionList.begin();
+				while(traversed.find(*funciter) != traversed.end())
+					++funciter;
+
+				traversed.insert(*funciter);
+
+				CompilationSession compilesession(scratchcode, scratchprototypes, scratchid);
+				FugueVMAccess::Interface.TraverseFunction(funciter->c_str(), &traversal, reinterpret_cast<HandleType>(&compilesession), scratch->BoundProgramHandle);
+			}
+		}
+		catch(...)
+		{
+			translated = false;
+		}
+
+		if(translated)
+			data.InvokedFunctionList.insert(scratch->InvokedFunctionList.begin(), scratch->InvokedFunctionList.end());
+
+		CompileSessionMap.erase(scratchid);
+		delete scratch;
+
+		return translated;
+	}
+
+	//
+	// Write out the complete text of a translation unit, so that it can be handed to a compiler
+	//
+	// This is the only point at which generated code touches the disk.
+	//
+	std::wstring WriteTranslationUnit(const std::wstring& code, const wchar_t* extension)
+	{
+		TemporaryFileWriter destoutfile(std::ios_base::trunc, extension);
+		destoutfile.OutputStream << code;
+		return destoutfile.GetFileName();
+	}
+
+	//
+	// Reserve a file name for PTX to be generated by NVCC
+	//
+	std::wstring ReservePTXFileName()
+	{
+		TemporaryFileWriter destoutfile(std::ios_base::trunc, L"ptx");
+		return destoutfile.GetFileName();
+	}
+
+	//
+	// Generate a name for a CUDA module which is unique within this process
+	//
+	// Modules are loaded and serialized under these names; including the
+	// process ID keeps them distinct from the names of modules loaded from
+	// a serialized program.
+	//
+	std::string GenerateModuleName()
+	{
+		std::ostringstream name;
+		name << "epoch" << ::GetCurrentProcessId() << "-" << ++ModuleNameCounter;
+		return name.str();
+	}
+
+	//
+	// Prepare an NVCC invocation which compiles the given translation unit into a module
+	//
+	CompileJob CreateCompileJob(const std::wstring& code, const std::string& modulename, CodeBlockHandle codehandle)
+	{
+		CompileJob job;
+		job.CodeHandle = codehandle;
+		job.SourceCode = code;
+		job.SourceFileName = WriteTranslationUnit(code, L"cu");
+		job.PTXFileName = ReservePTXFileName();
+		job.ModuleName = modulename;
+		return job;
+	}
+
+	//
+	// Build the host version of a session's code into a DLL using CL
+	//
+	// The DLL is linked against the static runtime library, so that it does
+	// not depend on any particular runtime being installed. If CL reports
+	// errors, no library is recorded for the session, and its code blocks
+	// are simply left for the VM to execute.
+	//
+	void BuildHostLibrary(CompileSessionData& data, const std::wstring& code)
+	{
+		std::wstring clpath = ShortenPathName(Configuration.ReadConfig<std::wstring>(L"cl"));
+		if(clpath.empty())
+			return;
+
+		std::wstring sourcefilename = WriteTranslationUnit(code, L"cpp");
+
+		std::wstring libraryfilename;
+		{
+			TemporaryFileWriter destoutfile(std::ios_base::trunc, L"dll");
+			libraryfilename = destoutfile.GetFileName();
+		}
+
+		std::wstring objectfilename;
+		{
+			TemporaryFileWriter destoutfile(std::ios_base::trunc, L"obj");
+			objectfilename = destoutfile.GetFileName();
+		}
+
+		// CL is launched via CMD.EXE for the same reasons as NVCC; see CommitCompile
+		std::wstring args = L"/c " + clpath + L"\\cl.exe /nologo /TP /O2 /Oi /fp:fast /arch:SSE2 /MT /LD " + sourcefilename + L" /Fo" + objectfilename + L" /Fe" + libraryfilename;
+		std::wstring cmdpath = SpecialPaths::GetSystemPath() + L"\\cmd.exe";
+
+		unsigned exitcode;
+		try
+		{
+			exitcode = LaunchProcessSynchronous(cmdpath, args);
+		}
+		catch(ProcessLaunchException&)
+		{
+			throw std::exception("Could not locate or launch CMD.EXE; unable to invoke CL compiler");
+		}
+
+		if(exitcode == 0)
+			data.GeneratedHostLibraryFileName = libraryfilename;
+	}
+
+	//
+	// Compile the host version of a session's code, for use when no CUDA device is present
+	//
+	// Map and reduce kernels rely on device features, and are never built
+	// for the host; the VM performs those operations itself.
+	//
+	void CommitHostCompile(CompileSessionHandle sessionid, CompileSessionData& data)
+	{
+		data.PendingArrayOperations.clear();
+
+		// All blocks go into a single DLL; CL is quick enough that there is nothing to gain from splitting them
+		std::wstring code = TraverseInvokedFunctions(sessionid);
+		for(std::map<CodeBlockHandle, std::wstring>::const_iterator iter = data.BlockSources.begin(); iter != data.BlockSources.end(); ++iter)
+			code += iter->second;
+
+		BuildHostLibrary(data, code);
+
+		for(std::map<CodeBlockHandle, CompileSessionHandle>::const_iterator iter = CodeHandleToSessionMap.begin(); iter != CodeHandleToSessionMap.end(); ++iter)
+		{
+			if(iter->second == sessionid)
+				HostCodeInvoker::PrepareBlock(iter->first);
+		}
+	}
+
+}
+
+
 //
 // Given a handle to an original Epoch code block, return a handle to the compiled code
 //
@@ -110,10 +371,14 @@ CodeBlockHandle Compiler::GetCompiledBlock(CompileSessionHandle sessionid, Origi
 		throw std::exception("Invalid compile session handle");
 
 	std::list<Traverser::ScopeContents> registeredvariables;
+	VariableUsageTable variableusage;
 
-	// Perform the code traversal and compilation pass
+	// Perform the code traversal and compilation pass; each block is
+	// generated into a buffer of its own, so that it can be compiled
+	// separately from the other blocks
+	GeneratedCodeBuffer blockcode;
 	{
-		CompilationSession session(*(sessioniter->second->CompilationTempFile), registeredvariables, sessionid);
+		CompilationSession session(blockcode, registeredvariables, variableusage, sessionid);
 		session.FunctionPreamble(handle);
 
 		Traverser::Interface traversal;
@@ -131,9 +396,11 @@ CodeBlockHandle Compiler::GetCompiledBlock(CompileSessionHandle sessionid, Origi
 	++CodeHandleCounter;
 	CodeHandleMap[CodeHandleCounter] = handle;
 	RegisteredVariablesMap[CodeHandleCounter].swap(registeredvariables);
+	VariableUsageMap[CodeHandleCounter].swap(variableusage);
 
 	CodeHandleToSessionMap[CodeHandleCounter] = sessionid;
 	CodeHandleToKeywordMap[CodeHandleCounter] = keyword;
+	sessioniter->second->BlockSources[CodeHandleCounter] = blockcode.GetCode();
 
 	return CodeHandleCounter;
 }
@@ -150,8 +417,40 @@ const std::list<Traverser::ScopeContents>& Compiler::GetRegisteredVariables(Exte
 	return iter->second;
 }
 
+//
+// Retrieve the recorded usage of each variable for the given code block
+//
+const VariableUsageTable& Compiler::GetVariableUsage(Extensions::CodeBlockHandle handle)
+{
+	std::map<CodeBlockHandle, VariableUsageTable>::const_iterator iter = VariableUsageMap.find(handle);
+	if(iter == VariableUsageMap.end())
+		throw std::exception("Invalid code block handle");
 
-void Compiler::TraverseInvokedFunctions(CompileSessionHandle session)
+	return iter->second;
+}
+
+//
+// Look up the usage flags of a single variable
+//
+// Variables with no recorded usage are conservatively assumed to be both read and written.
+//
+unsigned Compiler::LookupVariableUsage(const VariableUsageTable& usage, const std::wstring& identifier)
+{
+	VariableUsageTable::const_iterator iter = usage.find(identifier);
+	if(iter == usage.end())
+		return VariableUsage_Read | VariableUsage_Written;
+
+	return iter->second;
+}
+
+
+//
+// Generate the code of all functions invoked by a session's code blocks
+//
+// Prototypes of all of the functions come first, so that the functions may
+// invoke each other regardless of the order in which they are emitted.
+//
+std::wstring Compiler::TraverseInvokedFunctions(CompileSessionHandle session)
 {
 	std::map<CompileSessionHandle, CompileSessionData*>::iterator iter = CompileSessionMap.find(session);
 	if(iter == CompileSessionMap.end())
@@ -164,14 +463,76 @@ void Compiler::TraverseInvokedFunctions(CompileSessionHandle session)
 	traversal.ScopeTraversalCallback = ScopeCallback;
 	traversal.FunctionTraversalCallback = FunctionCallback;
 
-	TemporaryFileWriter headerfilewriter(std::ios_base::trunc, L"cu");
-	iter->second->CompilationTempFile->OutputStream << L"#include \"" << headerfilewriter.GetFileName() << L"\"\n";
+	GeneratedCodeBuffer functions;
+	GeneratedCodeBuffer prototypes;
 
 	for(std::set<std::wstring>::const_iterator funciter = iter->second->InvokedFunctionList.begin(); funciter != iter->second->InvokedFunctionList.end(); ++funciter)
 	{
-		CompilationSession compilesession(*(iter->second->CompilationTempFile), headerfilewriter, session);
+		CompilationSession compilesession(functions, prototypes, session);
 		FugueVMAccess::Interface.TraverseFunction(funciter->c_str(), &traversal, reinterpret_cast<HandleType>(&compilesession), iter->second->BoundProgramHandle);
 	}
+
+	return prototypes.GetCode() + functions.GetCode();
+}
+
+
+//
+// Request a kernel for a map or reduce operation in the program being compiled
+//
+// Only maps from and to scalar numeric types, and integer sums or products,
+// can be generated. Whether the mapped function itself can be translated is
+// not known until the whole program has been parsed, so the kernel is only
+// held as pending here; CommitCompile discards it if the translation fails,
+// and the VM then simply performs the operation itself.
+//
+bool Compiler::CompileArrayOperation(CompileSessionHandle sessionid, const ArrayOperationInfo& info)
+{
+	std::map<CompileSessionHandle, CompileSessionData*>::iterator iter = CompileSessionMap.find(sessionid);
+	if(iter == CompileSessionMap.end())
+		throw std::exception("Invalid compile session handle");
+
+	if(!GetDeviceTypeName(info.ElementType) || !GetDeviceTypeName(info.ResultType))
+		return false;
+
+	std::string kernelname = GenerateArrayOperationName(info);
+	std::wstring functionname(info.FunctionName);
+
+	CompileSessionData::PendingArrayOperation pending;
+	if(info.Operation == ArrayOperation_Map)
+	{
+		pending.FunctionName = functionname;
+		pending.KernelCode = GenerateMapKernel(kernelname, info);
+	}
+	else
+	{
+		if(info.ElementType != VM::EpochVariableType_Integer || info.ResultType != info.ElementType)
+			return false;
+
+		if(functionname == L"add")
+			pending.KernelCode = GenerateReduceKernel(kernelname, info, L"+", L"0");
+		else if(functionname == L"multiply")
+			pending.KernelCode = GenerateReduceKernel(kernelname, info, L"*", L"1");
+		else
+			return false;
+	}
+
+	iter->second->PendingArrayOperations[kernelname] = pending;
+	return true;
+}
+
+//
+// Find the compile session which generated the kernel for a map or reduce operation
+//
+// Returns false if no kernel was generated for the operation.
+//
+bool Compiler::LookupArrayOperation(const std::string& kernelname, CompileSessionHandle& session)
+{
+	std::map<std::string, CompileSessionHandle>::const_iterator iter = ArrayOperationToSessionMap.find(kernelname);
+	if(iter == ArrayOperationToSessionMap.end())
+		return false;
+
+	session = iter->second;
+	return true;
 }
 
 
@@ -189,114 +550,171 @@ OriginalCodeHandle Compiler::GetOriginalCodeHandle(CodeBlockHandle handle)
 
 
 //
-// Prepare temporary intermediate files and tracking for a compile session
+// Prepare tracking for a compile session
 //
 CompileSessionHandle Compiler::StartNewCompilation(HandleType programhandle)
 {
 	CompileSessionHandle ret = ++CompileHandleCounter;
-	CompileSessionMap.insert(std::make_pair(ret, new CompileSessionData(new TemporaryFileWriter(std::ios_base::out | std::ios_base::trunc, L"cu"), programhandle)));
+	CompileSessionMap.insert(std::make_pair(ret, new CompileSessionData(programhandle)));
 	return ret;
 }
 
 //
 // Hand off the CUDA code to the NVCC compiler for generation of the final .PTX code
 //
+// Each code block is compiled as a translation unit of its own, along with
+// the functions it may invoke; the map and reduce kernels share one more
+// translation unit. Each translation unit is assembled in memory from the
+// generated code, and only written out for NVCC to read. NVCC is run on a
+// background thread, so this returns before the PTX is available; see
+// WaitForCompilation.
+//
+// If there is no CUDA device but host code can be built, the code is
+// compiled for the host instead.
+//
 void Compiler::CommitCompile(CompileSessionHandle sessionid)
 {
-	if(!CUDAAvailableForExecution)
+	if(!CUDAAvailableForExecution && !HostCodeAvailable)
 		return;
 
 	std::map<CompileSessionHandle, CompileSessionData*>::iterator iter = CompileSessionMap.find(sessionid);
 
 	if(iter == CompileSessionMap.end())
-		throw std::exception("No intermediate .cu file has been generated; call Compiler::StartNewCompilation() before invoking Compiler::CommitCompile()");
+		throw std::exception("No code has been generated; call Compiler::StartNewCompilation() before invoking Compiler::CommitCompile()");
 
-	// Acquire the filename of the output .cu file and close the temp
-	// file object's handle on the file so we can write to it
-	std::wstring tempfilename = iter->second->CompilationTempFile->GetFileName();
-	iter->second->CloseTempFile();
-
-	// Generate the file that contains all functions invoked by the root CUDA code
-	std::wstring functionsfilename;
+	if(!CUDAAvailableForExecution)
 	{
-		std::auto_ptr<TemporaryFileWriter> destoutfile(new TemporaryFileWriter(std::ios_base::trunc, L"cu"));
-		functionsfilename = destoutfile->GetFileName();
-		iter->second->AttachToTempFile(destoutfile.release());
+		CommitHostCompile(sessionid, *(iter->second));
+		return;
+	}
 
-		TraverseInvokedFunctions(sessionid);
+	std::wstring clpath = ShortenPathName(Configuration.ReadConfig<std::wstring>(L"cl"));
+	std::wstring nvccpath = ShortenPathName(Configuration.ReadConfig<std::wstring>(L"nvcc"));
 
-		iter->second->CloseTempFile();
-	}
+	if(clpath.empty() || nvccpath.empty())
+		throw std::exception("Compiling this program requires that the CUDA SDK be installed, and a suitable configuration file for Fugue must be set up. Please see the SDK installation guide for details.");
 
-	// Generate the "master" file which #includes all of the generated CUDA code
-	std::wstring masterfilename;
+	// Keep only the map and reduce kernels whose functions can be translated;
+	// this must be done before the invoked functions are emitted, since the
+	// mapped functions are emitted along with them
+	std::wstring arrayoperationcode;
+	for(std::map<std::string, CompileSessionData::PendingArrayOperation>::const_iterator pendingiter = iter->second->PendingArrayOperations.begin(); pendingiter != iter->second->PendingArrayOperations.end(); ++pendingiter)
 	{
-		TemporaryFileWriter destoutfile(std::ios_base::trunc, L"cu");
-		destoutfile.OutputStream << L"#include \"" << functionsfilename << "\"\n";
-		destoutfile.OutputStream << L"#include \"" << tempfilename << "\"\n";
-		masterfilename = destoutfile.GetFileName();
+		if(!pendingiter->second.FunctionName.empty() && !TranslateInvokedFunctions(*(iter->second), pendingiter->second.FunctionName))
+			continue;
+
+		arrayoperationcode += pendingiter->second.KernelCode;
+		ArrayOperationToSessionMap[pendingiter->first] = sessionid;
 	}
+	iter->second->PendingArrayOperations.clear();
 
-	// Generate a filename for the intermediate .ptx file, which
-	// will receive the output of NVCC's pass over the .cu file.
+	std::wstring functionscode = TraverseInvokedFunctions(sessionid);
+	std::vector<CompileJob> jobs;
+
+	for(std::map<CodeBlockHandle, std::wstring>::const_iterator blockiter = iter->second->BlockSources.begin(); blockiter != iter->second->BlockSources.end(); ++blockiter)
 	{
-		TemporaryFileWriter destoutfile(std::ios_base::trunc, L"ptx");
-		iter->second->GeneratedPTXFileName = destoutfile.GetFileName();
+		std::string modulename = GenerateModuleName();
+		CodeHandleToModuleMap[blockiter->first] = modulename;
+		jobs.push_back(CreateCompileJob(functionscode + blockiter->second, modulename, blockiter->first));
 	}
+	iter->second->BlockSources.clear();
 
+	if(!arrayoperationcode.empty())
+		jobs.push_back(CreateCompileJob(functionscode + arrayoperationcode, GetGeneratedModuleName(sessionid), 0));
 
-	// Prepare the command line for launching the NVCC compiler
-	//
-	// Note that we launch indirectly by invoking CMD.EXE; this is the
-	// only way I could find to get the stdout and stderr outputs to
-	// display correctly when using the Epoch command line tools.
-	// Simply trying to redirect the handles via CreateProcess doesn't
-	// work; something internally in NVCC changes and only minimal
-	// error/status output is produced. It would be nice if we could
-	// just invoke the compiler directly.
-	std::wstring clpath = ShortenPathName(Configuration.ReadConfig<std::wstring>(L"cl"));
-	std::wstring nvccpath = ShortenPathName(Configuration.ReadConfig<std::wstring>(L"nvcc"));
-	std::wstring args = L"/c " + nvccpath + L" --compiler-bindir=" + clpath + L" --ptx " + masterfilename + L" --output-file=" + iter->second->GeneratedPTXFileName;
-	std::wstring cmdpath = SpecialPaths::GetSystemPath() + L"\\cmd.exe";
+	Threads::CriticalSection::Auto lock(iter->second->CompilationCriticalSection);
+	iter->second->PendingCompilation.reset(new CompileJobBatch(jobs, nvccpath, clpath));
+	iter->second->PendingCompilation->Start();
+}
 
-	if(clpath.empty() || nvccpath.empty())
-		throw std::exception("Compiling this program requires that the CUDA SDK be installed, and a suitable configuration file for Fugue must be set up. Please see the SDK installation guide for details.");
 
-	// Invoke the compiler
-	unsigned exitcode;
-	try
-	{
-		exitcode = LaunchProcessSynchronous(cmdpath, args);
-	}
-	catch(ProcessLaunchException&)
+//
+// Block until the background compilation of a session's code has finished
+//
+// Once the PTX is available, the map and reduce kernels are resolved, so
+// that they are included whenever the loaded modules are serialized. If
+// NVCC failed, the error is raised here, and again on every later call.
+//
+void Compiler::WaitForCompilation(CompileSessionHandle sessionid)
+{
+	std::map<CompileSessionHandle, CompileSessionData*>::iterator iter = CompileSessionMap.find(sessionid);
+	if(iter == CompileSessionMap.end())
+		throw std::exception("Invalid compile session handle");
+
+	CompileSessionData& data = *(iter->second);
+	Threads::CriticalSection::Auto lock(data.CompilationCriticalSection);
+
+	if(data.PendingCompilation.get())
 	{
-		throw std::exception("Could not locate or launch CMD.EXE; unable to invoke NVCC compiler");
+		try
+		{
+			data.PendingCompilation->Wait();
+		}
+		catch(std::exception& e)
+		{
+			data.CompilationError = e.what();
+		}
+		data.PendingCompilation.reset();
+
+		if(data.CompilationError.empty())
+		{
+			for(std::map<std::string, CompileSessionHandle>::const_iterator operationiter = ArrayOperationToSessionMap.begin(); operationiter != ArrayOperationToSessionMap.end(); ++operationiter)
+			{
+				if(operationiter->second == sessionid)
+					Module::LoadCUDAModule(data.GeneratedModuleName).CreateFunctionCall(operationiter->first);
+			}
+		}
 	}
 
-	if(exitcode != 0)
-		throw std::exception("NVCC compiler encountered errors");
+	if(!data.CompilationError.empty())
+		throw std::exception(data.CompilationError.c_str());
+}
+
 
-	for(std::map<CodeBlockHandle, CompileSessionHandle>::const_iterator iter = CodeHandleToSessionMap.begin(); iter != CodeHandleToSessionMap.end(); ++iter)
-		PrepareBlock(iter->first);
+//
+// Retrieve the name of the CUDA module holding the compiled code of a block
+//
+// Code which was not compiled per block, such as the map and reduce
+// kernels, is found in the module of its session.
+//
+const std::string& Compiler::GetBlockModuleName(CodeBlockHandle codehandle)
+{
+	std::map<CodeBlockHandle, std::string>::const_iterator iter = CodeHandleToModuleMap.find(codehandle);
+	if(iter == CodeHandleToModuleMap.end())
+		return GetGeneratedModuleName(GetAssociatedSession(codehandle));
+
+	return iter->second;
 }
 
 
 //
-// Retrieve the name of the .PTX file generated by the current compile session
+// Retrieve the name of the CUDA module generated by the current compile session
 //
-const std::wstring& Compiler::GetGeneratedPTXFileName(CompileSessionHandle sessionid)
+const std::string& Compiler::GetGeneratedModuleName(CompileSessionHandle sessionid)
 {
 	std::map<CompileSessionHandle, CompileSessionData*>::const_iterator iter = CompileSessionMap.find(sessionid);
 	if(iter == CompileSessionMap.end())
 		throw std::exception("Invalid compile session handle");
 
-	if(iter->second->GeneratedPTXFileName.empty())
-	{
-		TemporaryFileWriter destoutfile(std::ios_base::trunc, L"ptx");
-		iter->second->GeneratedPTXFileName = destoutfile.GetFileName();
-	}
+	if(iter->second->GeneratedModuleName.empty())
+		iter->second->GeneratedModuleName = GenerateModuleName();
+
+	return iter->second->GeneratedModuleName;
+}
+
 
-	return iter->second->GeneratedPTXFileName;
+//
+// Retrieve the name of the host code DLL built for a compile session
+//
+// The name is empty if no host code was built for the session.
+//
+const std::wstring& Compiler::GetGeneratedHostLibraryFileName(CompileSessionHandle sessionid)
+{
+	std::map<CompileSessionHandle, CompileSessionData*>::const_iterator iter = CompileSessionMap.find(sessionid);
+	if(iter == CompileSessionMap.end())
+		throw std::exception("Invalid compile session handle");
+
+	return iter->second->GeneratedHostLibraryFileName;
 }
 
 
@@ -347,6 +765,16 @@ void Compiler::CopyGeneratedCodeToMemoryBuffers(std::vector<std::vector<Byte> >&
 {
 	buffers.clear();
 
+	// All code must be compiled and loaded for the modules to be serialized
+	for(std::map<CompileSessionHandle, CompileSessionData*>::const_iterator iter = CompileSessionMap.begin(); iter != CompileSessionMap.end(); ++iter)
+		WaitForCompilation(iter->first);
+
+	if(CUDAAvailableForExecution)
+	{
+		for(std::map<CodeBlockHandle, CompileSessionHandle>::const_iterator iter = CodeHandleToSessionMap.begin(); iter != CodeHandleToSessionMap.end(); ++iter)
+			PrepareBlock(iter->first);
+	}
+
 	buffers.push_back(std::vector<Byte>());
 	std::vector<Byte> temp;
 
@@ -374,14 +802,30 @@ void Compiler::CopyGeneratedCodeToMemoryBuffers(std::vector<std::vector<Byte> >&
 		}
 	}
 
+	stream << VariableUsageMap.size() << "\n";
+	for(std::map<CodeBlockHandle, VariableUsageTable>::const_iterator iter = VariableUsageMap.begin(); iter != VariableUsageMap.end(); ++iter)
+	{
+		stream << iter->first << " " << iter->second.size() << "\n";
+		for(VariableUsageTable::const_iterator usageiter = iter->second.begin(); usageiter != iter->second.end(); ++usageiter)
+			stream << narrow(usageiter->first) << " " << usageiter->second << "\n";
+	}
+
 	stream << CompileSessionMap.size() << "\n";
 	for(std::map<CompileSessionHandle, CompileSessionData*>::const_iterator iter = CompileSessionMap.begin(); iter != CompileSessionMap.end(); ++iter)
-		stream << iter->first << " " << narrow(StripPath(iter->second->GeneratedPTXFileName)) << "\n";
+		stream << iter->first << " " << GetGeneratedModuleName(iter->first) << "\n";
 
 	stream << CodeHandleToSessionMap.size() << "\n";
 	for(std::map<CodeBlockHandle, CompileSessionHandle>::const_iterator iter = CodeHandleToSessionMap.begin(); iter != CodeHandleToSessionMap.end(); ++iter)
 		stream << iter->first << " " << iter->second << "\n";
 
+	stream << ArrayOperationToSessionMap.size() << "\n";
+	for(std::map<std::string, CompileSessionHandle>::const_iterator iter = ArrayOperationToSessionMap.begin(); iter != ArrayOperationToSessionMap.end(); ++iter)
+		stream << iter->first << " " << iter->second << "\n";
+
+	stream << CodeHandleToModuleMap.size() << "\n";
+	for(std::map<CodeBlockHandle, std::string>::const_iterator iter = CodeHandleToModuleMap.begin(); iter != CodeHandleToModuleMap.end(); ++iter)
+		stream << iter->first << " " << iter->second << "\n";
+
 	stream << Module::BuildSerializationData();
 
 	stream.unsetf(std::ios::skipws);
@@ -453,17 +897,36 @@ void Compiler::LoadSerializedState(const char* buffer, size_t buffersize)
 		RegisteredVariablesMap.insert(std::make_pair(codehandle, contents));
 	}
 
+	stream >> size;
+	for(size_t i = 0; i < size; ++i)
+	{
+		CodeBlockHandle codehandle;
+		size_t numentries;
+		VariableUsageTable usage;
+
+		stream >> codehandle >> numentries;
+		for(size_t j = 0; j < numentries; ++j)
+		{
+			std::string identifier;
+			unsigned flags;
+			stream >> identifier >> flags;
+			usage.insert(std::make_pair(widen(identifier), flags));
+		}
+
+		VariableUsageMap.insert(std::make_pair(codehandle, usage));
+	}
+
 	stream >> size;
 	for(size_t i = 0; i < size; ++i)
 	{
 		CompileSessionHandle sessionhandle;
 		stream >> sessionhandle;
 
-		std::string ptxname;
-		stream >> ptxname;
+		std::string modulename;
+		stream >> modulename;
 
-		std::auto_ptr<CompileSessionData> sessiondata(new CompileSessionData(NULL, 0));
-		sessiondata->GeneratedPTXFileName = widen(ptxname);
+		std::auto_ptr<CompileSessionData> sessiondata(new CompileSessionData(0));
+		sessiondata->GeneratedModuleName = modulename;
 
 		CompileSessionMap.insert(std::make_pair(sessionhandle, sessiondata.release()));
 	}
@@ -477,6 +940,24 @@ void Compiler::LoadSerializedState(const char* buffer, size_t buffersize)
 		CodeHandleToSessionMap.insert(std::make_pair(codehandle, sessionhandle));
 	}
 
+	stream >> size;
+	for(size_t i = 0; i < size; ++i)
+	{
+		std::string kernelname;
+		CompileSessionHandle sessionhandle;
+		stream >> kernelname >> sessionhandle;
+		ArrayOperationToSessionMap.insert(std::make_pair(kernelname, sessionhandle));
+	}
+
+	stream >> size;
+	for(size_t i = 0; i < size; ++i)
+	{
+		CodeBlockHandle codehandle;
+		std::string modulename;
+		stream >> codehandle >> modulename;
+		CodeHandleToModuleMap.insert(std::make_pair(codehandle, modulename));
+	}
+
 	stream >> size;
 	for(size_t i = 0; i < size; ++i)
 	{
@@ -500,7 +981,7 @@ void Compiler::LoadSerializedState(const char* buffer, size_t buffersize)
 		std::string ignored;
 		getline(stream, ignored);
 
-		Module::LoadCUDAModule(modulename, functionids, buffer + stream.tellg());
+		Module::LoadCUDAModule(modulename, functionids, buffer + stream.tellg(), buffersize);
 
 		stream.seekg(stream.tellg() + static_cast<std::streamoff>(buffersize));
 	}
@@ -514,8 +995,12 @@ void Compiler::Clear()
 	CodeHandleMap.clear();
 	CodeHandleToKeywordMap.clear();
 	RegisteredVariablesMap.clear();
+	VariableUsageMap.clear();
 	CodeHandleToSessionMap.clear();
+	ArrayOperationToSessionMap.clear();
+	CodeHandleToModuleMap.clear();
 
+	// Deleting a session waits for any compile still running in the background
 	for(std::map<CompileSessionHandle, CompileSessionData*>::iterator iter = CompileSessionMap.begin(); iter != CompileSessionMap.end(); ++iter)
 		delete iter->second;
 	CompileSessionMap.clear();
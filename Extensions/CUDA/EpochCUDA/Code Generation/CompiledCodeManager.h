@@ -15,21 +15,52 @@
 #include <set>
 
 
+// Forward declarations
+namespace Extensions
+{
+	struct ArrayOperationInfo;
+}
+
+
 namespace Compiler
 {
 
+	//
+	// Flags recording how a generated code block uses each of its registered variables
+	//
+	// Variables which are neither read nor written by the block do not need to be
+	// transferred to the device at all, and only written variables need to be
+	// transferred back to the host afterwards.
+	//
+	enum VariableUsageFlags
+	{
+		VariableUsage_Read		= 0x01,
+		VariableUsage_Written	= 0x02
+	};
+
+	typedef std::map<std::wstring, unsigned> VariableUsageTable;
+
+
 	Extensions::CompileSessionHandle StartNewCompilation(HandleType programhandle);
 	void CommitCompile(Extensions::CompileSessionHandle sessionid);
-	const std::wstring& GetGeneratedPTXFileName(Extensions::CompileSessionHandle sessionid);
+	void WaitForCompilation(Extensions::CompileSessionHandle sessionid);
+	const std::string& GetGeneratedModuleName(Extensions::CompileSessionHandle sessionid);
+	const std::string& GetBlockModuleName(Extensions::CodeBlockHandle codehandle);
+	const std::wstring& GetGeneratedHostLibraryFileName(Extensions::CompileSessionHandle sessionid);
 	Extensions::CompileSessionHandle GetAssociatedSession(Extensions::CodeBlockHandle codehandle);
 
 	Extensions::CodeBlockHandle GetCompiledBlock(Extensions::CompileSessionHandle sessionid, Extensions::OriginalCodeHandle handle, const std::wstring& keyword);
 	Extensions::OriginalCodeHandle GetOriginalCodeHandle(Extensions::CodeBlockHandle handle);
 	
 	const std::list<Traverser::ScopeContents>& GetRegisteredVariables(Extensions::CodeBlockHandle handle);
+	const VariableUsageTable& GetVariableUsage(Extensions::CodeBlockHandle handle);
+	unsigned LookupVariableUsage(const VariableUsageTable& usage, const std::wstring& identifier);
 
 	void RecordInvokedFunction(Extensions::CompileSessionHandle session, const std::wstring& functionname);
-	void TraverseInvokedFunctions(Extensions::CompileSessionHandle session);
+	std::wstring TraverseInvokedFunctions(Extensions::CompileSessionHandle session);
+
+	bool CompileArrayOperation(Extensions::CompileSessionHandle session, const Extensions::ArrayOperationInfo& info);
+	bool LookupArrayOperation(const std::string& kernelname, Extensions::CompileSessionHandle& session);
 
 	void DestroyTempFiles();
 
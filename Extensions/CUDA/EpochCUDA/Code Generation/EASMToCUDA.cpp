@@ -20,15 +20,56 @@ using namespace Compiler;
 using namespace Extensions;
 
 
+namespace
+{
+
+	// Parameters received by the code generated for each block; see VariableBuffer::PrepareFunctionCall
+	const wchar_t* BlockParameterList = L"(unsigned __cudafor_lower_bound, unsigned __cudafor_count, float* __marshal_input_floats, int* __marshal_input_ints, float* __marshal_input_float_arrays, unsigned __num_float_arrays, unsigned* __float_array_sizes, int* __marshal_input_int_arrays, unsigned __num_int_arrays, unsigned* __int_array_sizes)";
+
+
+	//
+	// Retrieve the CUDA type used for a member of a structure or tuple
+	//
+	const wchar_t* GetMemberTypeToken(VM::EpochVariableTypeID type)
+	{
+		switch(type)
+		{
+		case VM::EpochVariableType_Integer:		return L"int";
+		case VM::EpochVariableType_Real:		return L"float";
+		}
+
+		throw std::exception("Cannot pass structures or tuples with members of this type");
+	}
+
+	//
+	// Build a pseudo-variable describing a single member of a structure or tuple
+	//
+	// Members are marshalled exactly like standalone variables; the member
+	// values of all composites are therefore split into the plain integer
+	// and real buffers, giving a struct-of-arrays layout on the device.
+	//
+	Traverser::ScopeContents MakeMemberContents(const Traverser::ScopeContents& composite, const Traverser::CompositeMember& member)
+	{
+		Traverser::ScopeContents ret;
+		ret.Identifier = composite.Identifier + L"." + member.Identifier;
+		ret.Type = member.Type;
+		return ret;
+	}
+
+}
+
+
 //
 // Construct and initialize a wrapper for a compile session
 //
-CompilationSession::CompilationSession(TemporaryFileWriter& codefile, std::list<Traverser::ScopeContents>& registeredvariables, Extensions::CompileSessionHandle sessionhandle)
+CompilationSession::CompilationSession(GeneratedCodeBuffer& code, std::list<Traverser::ScopeContents>& registeredvariables, VariableUsageTable& variableusage, Extensions::CompileSessionHandle sessionhandle)
 	: SessionHandle(sessionhandle),
+	  GenerateHostCode(!CUDAAvailableForExecution && HostCodeAvailable),
 	  TabDepth(0),
 	  RegisteredVariables(&registeredvariables),
-	  TemporaryCodeFile(codefile),
-	  PrototypeHeaderFile(NULL),
+	  VariableUsage(&variableusage),
+	  GeneratedCode(code),
+	  PrototypeHeader(NULL),
 	  ExpectingFunctionReturns(false),
 	  ExpectingFunctionParams(false),
 	  ExpectingFunctionBlock(false),
@@ -42,12 +83,14 @@ CompilationSession::CompilationSession(TemporaryFileWriter& codefile, std::list<
 }
 
 
-CompilationSession::CompilationSession(TemporaryFileWriter& codefile, TemporaryFileWriter& prototypesheaderfile, Extensions::CompileSessionHandle sessionhandle)
+CompilationSession::CompilationSession(GeneratedCodeBuffer& code, GeneratedCodeBuffer& prototypesheader, Extensions::CompileSessionHandle sessionhandle)
 	: SessionHandle(sessionhandle),
+	  GenerateHostCode(!CUDAAvailableForExecution && HostCodeAvailable),
 	  TabDepth(0),
 	  RegisteredVariables(NULL),
-	  TemporaryCodeFile(codefile),
-	  PrototypeHeaderFile(&prototypesheaderfile),
+	  VariableUsage(NULL),
+	  GeneratedCode(code),
+	  PrototypeHeader(&prototypesheader),
 	  ExpectingFunctionReturns(false),
 	  ExpectingFunctionParams(false),
 	  ExpectingFunctionBlock(false),
@@ -73,15 +116,15 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 {
 	if(ExpectingFunctionReturns)
 	{
-		TemporaryCodeFile.OutputStream << L"__device__ ";
-		if(PrototypeHeaderFile)
-			PrototypeHeaderFile->OutputStream << L"__device__ ";
+		GeneratedCode.OutputStream << GetFunctionQualifier();
+		if(PrototypeHeader)
+			PrototypeHeader->OutputStream << GetFunctionQualifier();
 
 		if(numcontents == 0)
 		{
-			TemporaryCodeFile.OutputStream << L"void ";
-			if(PrototypeHeaderFile)
-				PrototypeHeaderFile->OutputStream << L"void ";
+			GeneratedCode.OutputStream << L"void ";
+			if(PrototypeHeader)
+				PrototypeHeader->OutputStream << L"void ";
 		}
 		else if(numcontents > 1)
 			throw std::exception("Functions with multiple returns cannot be invoked from a CUDA code segment");
@@ -90,14 +133,14 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 			switch(contents->Type)
 			{
 			case VM::EpochVariableType_Integer:
-				TemporaryCodeFile.OutputStream << L"int ";
-				if(PrototypeHeaderFile)
-					PrototypeHeaderFile->OutputStream << L"int ";
+				GeneratedCode.OutputStream << L"int ";
+				if(PrototypeHeader)
+					PrototypeHeader->OutputStream << L"int ";
 				break;
 			case VM::EpochVariableType_Real:
-				TemporaryCodeFile.OutputStream << L"float ";
-				if(PrototypeHeaderFile)
-					PrototypeHeaderFile->OutputStream << L"float ";
+				GeneratedCode.OutputStream << L"float ";
+				if(PrototypeHeader)
+					PrototypeHeader->OutputStream << L"float ";
 				break;
 
 			default:
@@ -114,9 +157,9 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 
 	if(ExpectingFunctionParams)
 	{
-		TemporaryCodeFile.OutputStream << PendingFunctionName << L"(";
-		if(PrototypeHeaderFile)
-			PrototypeHeaderFile->OutputStream << PendingFunctionName << L"(";
+		GeneratedCode.OutputStream << PendingFunctionName << L"(";
+		if(PrototypeHeader)
+			PrototypeHeader->OutputStream << PendingFunctionName << L"(";
 
 		for(size_t i = 0; i < numcontents; ++i)
 		{
@@ -125,30 +168,30 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 			switch(contents[reversedindex].Type)
 			{
 			case VM::EpochVariableType_Integer:
-				TemporaryCodeFile.OutputStream << L"int ";
-				if(PrototypeHeaderFile)
-					PrototypeHeaderFile->OutputStream << L"int ";
+				GeneratedCode.OutputStream << L"int ";
+				if(PrototypeHeader)
+					PrototypeHeader->OutputStream << L"int ";
 				break;
 
 			case VM::EpochVariableType_Real:
-				TemporaryCodeFile.OutputStream << L"float ";
-				if(PrototypeHeaderFile)
-					PrototypeHeaderFile->OutputStream << L"float ";
+				GeneratedCode.OutputStream << L"float ";
+				if(PrototypeHeader)
+					PrototypeHeader->OutputStream << L"float ";
 				break;
 
 			case VM::EpochVariableType_Array:
 				switch(contents[reversedindex].ContainedType)
 				{
 				case VM::EpochVariableType_Integer:
-					TemporaryCodeFile.OutputStream << L"int* ";
-					if(PrototypeHeaderFile)
-						PrototypeHeaderFile->OutputStream << L"int* ";
+					GeneratedCode.OutputStream << L"int* ";
+					if(PrototypeHeader)
+						PrototypeHeader->OutputStream << L"int* ";
 					break;
 
 				case VM::EpochVariableType_Real:
-					TemporaryCodeFile.OutputStream << L"float* ";
-					if(PrototypeHeaderFile)
-						PrototypeHeaderFile->OutputStream << L"float* ";
+					GeneratedCode.OutputStream << L"float* ";
+					if(PrototypeHeader)
+						PrototypeHeader->OutputStream << L"float* ";
 					break;
 
 				default:
@@ -160,21 +203,21 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 				throw std::exception("Cannot pass this type to a function invoked via a CUDA code segment");
 			}
 
-			TemporaryCodeFile.OutputStream << contents[reversedindex].Identifier;
-			if(PrototypeHeaderFile)
-				PrototypeHeaderFile->OutputStream << contents[reversedindex].Identifier;
+			GeneratedCode.OutputStream << contents[reversedindex].Identifier;
+			if(PrototypeHeader)
+				PrototypeHeader->OutputStream << contents[reversedindex].Identifier;
 
 			if(i < numcontents - 1)
 			{
-				TemporaryCodeFile.OutputStream << L", ";
-				if(PrototypeHeaderFile)
-					PrototypeHeaderFile->OutputStream << L", ";
+				GeneratedCode.OutputStream << L", ";
+				if(PrototypeHeader)
+					PrototypeHeader->OutputStream << L", ";
 			}
 		}
 
-		TemporaryCodeFile.OutputStream << L")\n";
-		if(PrototypeHeaderFile)
-			PrototypeHeaderFile->OutputStream << L");\n";
+		GeneratedCode.OutputStream << L")\n";
+		if(PrototypeHeader)
+			PrototypeHeader->OutputStream << L");\n";
 
 		ExpectingFunctionParams = false;
 		return;
@@ -192,6 +235,18 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 			{
 			case VM::EpochVariableType_Integer:				MarshalInts = true;			break;
 			case VM::EpochVariableType_Real:				MarshalFloats = true;		break;
+			case VM::EpochVariableType_Structure:
+			case VM::EpochVariableType_Tuple:
+				{
+					for(std::vector<Traverser::CompositeMember>::const_iterator iter = contents[i].Members.begin(); iter != contents[i].Members.end(); ++iter)
+					{
+						if(iter->Type == VM::EpochVariableType_Integer)
+							MarshalInts = true;
+						else if(iter->Type == VM::EpochVariableType_Real)
+							MarshalFloats = true;
+					}
+					break;
+				}
 			case VM::EpochVariableType_Array:
 				{
 					switch(contents[i].ContainedType)
@@ -207,34 +262,34 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 		if(MarshalFloats)
 		{
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"unsigned int __marshal_float_index = 0;\n";
+			GeneratedCode.OutputStream << L"unsigned int __marshal_float_index = 0;\n";
 		}
 
 		if(MarshalInts)
 		{
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"unsigned int __marshal_int_index = 0;\n";
+			GeneratedCode.OutputStream << L"unsigned int __marshal_int_index = 0;\n";
 		}
 
 		if(MarshalFloatArrays)
 		{
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"unsigned int __marshal_float_array_index = 0;\n";
+			GeneratedCode.OutputStream << L"unsigned int __marshal_float_array_index = 0;\n";
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"float* __marshal_float_array_ptr = __marshal_input_float_arrays;\n";
+			GeneratedCode.OutputStream << L"float* __marshal_float_array_ptr = __marshal_input_float_arrays;\n";
 		}
 
 		if(MarshalIntArrays)
 		{
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"unsigned int __marshal_int_array_index = 0;\n";
+			GeneratedCode.OutputStream << L"unsigned int __marshal_int_array_index = 0;\n";
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"int* __marshal_int_array_ptr = __marshal_input_int_arrays;\n";
+			GeneratedCode.OutputStream << L"int* __marshal_int_array_ptr = __marshal_input_int_arrays;\n";
 		}
 	}
 
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"// Define variables in the current scope\n";
+	GeneratedCode.OutputStream << L"// Define variables in the current scope\n";
 
 	unsigned FloatArrayMarshalIndex = 0;
 	unsigned IntArrayMarshalIndex = 0;
@@ -243,22 +298,26 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 	{
 		bool appendsemicolon = true;
 
-		if(toplevel)
+		bool iscomposite = (contents[i].Type == VM::EpochVariableType_Structure || contents[i].Type == VM::EpochVariableType_Tuple);
+		if(toplevel && !iscomposite)
+		{
 			RegisteredVariables->push_back(contents[i]);
+			VariableUsage->insert(std::make_pair(contents[i].Identifier, 0));
+		}
 
 		PadTabs();
 		switch(contents[i].Type)
 		{
 		case VM::EpochVariableType_Integer:
-			TemporaryCodeFile.OutputStream << L"int " << contents[i].Identifier;
+			GeneratedCode.OutputStream << L"int " << contents[i].Identifier;
 			if(toplevel)
-				TemporaryCodeFile.OutputStream << L" = __marshal_input_ints[__marshal_int_index++]";
+				GeneratedCode.OutputStream << L" = __marshal_input_ints[__marshal_int_index++]";
 			break;
 
 		case VM::EpochVariableType_Real:
-			TemporaryCodeFile.OutputStream << L"float " << contents[i].Identifier;
+			GeneratedCode.OutputStream << L"float " << contents[i].Identifier;
 			if(toplevel)
-				TemporaryCodeFile.OutputStream << L" = __marshal_input_floats[__marshal_float_index++]";
+				GeneratedCode.OutputStream << L" = __marshal_input_floats[__marshal_float_index++]";
 			break;
 
 		case VM::EpochVariableType_Array:
@@ -282,11 +341,40 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 					throw std::exception("Cannot pass arrays of this type");
 				}
 
-				TemporaryCodeFile.OutputStream << arraytypetoken << L"* " << contents[i].Identifier << L" = __marshal_" << arraytypetoken << L"_array_ptr;\n";
+				GeneratedCode.OutputStream << arraytypetoken << L"* " << contents[i].Identifier << L" = __marshal_" << arraytypetoken << L"_array_ptr;\n";
 				PadTabs();
-				TemporaryCodeFile.OutputStream << L"__marshal_" << arraytypetoken << L"_array_ptr += __" << arraytypetoken << L"_array_sizes[__marshal_" << arraytypetoken << L"_array_index];\n";
+				GeneratedCode.OutputStream << L"__marshal_" << arraytypetoken << L"_array_ptr += __" << arraytypetoken << L"_array_sizes[__marshal_" << arraytypetoken << L"_array_index];\n";
 				PadTabs();
-				TemporaryCodeFile.OutputStream << L"++__marshal_" << arraytypetoken << L"_array_index;\n";
+				GeneratedCode.OutputStream << L"++__marshal_" << arraytypetoken << L"_array_index;\n";
+
+				appendsemicolon = false;
+			}
+			break;
+
+		case VM::EpochVariableType_Structure:
+		case VM::EpochVariableType_Tuple:
+			{
+				GeneratedCode.OutputStream << L"struct {";
+				for(std::vector<Traverser::CompositeMember>::const_iterator iter = contents[i].Members.begin(); iter != contents[i].Members.end(); ++iter)
+					GeneratedCode.OutputStream << L" " << GetMemberTypeToken(iter->Type) << L" " << iter->Identifier << L";";
+				GeneratedCode.OutputStream << L" } " << contents[i].Identifier << L";\n";
+
+				// Each member is registered and marshalled as a variable in its own right
+				if(toplevel)
+				{
+					for(std::vector<Traverser::CompositeMember>::const_iterator iter = contents[i].Members.begin(); iter != contents[i].Members.end(); ++iter)
+					{
+						Traverser::ScopeContents member = MakeMemberContents(contents[i], *iter);
+						RegisteredVariables->push_back(member);
+						VariableUsage->insert(std::make_pair(member.Identifier, 0));
+
+						PadTabs();
+						if(iter->Type == VM::EpochVariableType_Integer)
+							GeneratedCode.OutputStream << member.Identifier << L" = __marshal_input_ints[__marshal_int_index++];\n";
+						else
+							GeneratedCode.OutputStream << member.Identifier << L" = __marshal_input_floats[__marshal_float_index++];\n";
+					}
+				}
 
 				appendsemicolon = false;
 			}
@@ -297,10 +385,10 @@ void CompilationSession::WriteScopeContents(bool toplevel, size_t numcontents, c
 		}
 
 		if(appendsemicolon)
-			TemporaryCodeFile.OutputStream << L";\n";
+			GeneratedCode.OutputStream << L";\n";
 	}
 
-	TemporaryCodeFile.OutputStream << L"\n";
+	GeneratedCode.OutputStream << L"\n";
 }
 
 
@@ -328,7 +416,7 @@ void CompilationSession::EnterNode()
 	LeafStack.push(LeafBlock(ExpectingFunctionBlock, ExpectingDoWhileBlock));
 
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"{\n";
+	GeneratedCode.OutputStream << L"{\n";
 	++TabDepth;
 
 	if(ExpectingFunctionBlock)
@@ -338,14 +426,14 @@ void CompilationSession::EnterNode()
 		PadTabs();
 		switch(PendingFunctionReturnValueType)
 		{
-		case VM::EpochVariableType_Integer:			TemporaryCodeFile.OutputStream << L"int ";		break;
-		case VM::EpochVariableType_Real:			TemporaryCodeFile.OutputStream << L"float ";	break;
+		case VM::EpochVariableType_Integer:			GeneratedCode.OutputStream << L"int ";		break;
+		case VM::EpochVariableType_Real:			GeneratedCode.OutputStream << L"float ";	break;
 
 		default:
 			throw std::exception("Cannot return this type from a function invoked via a CUDA code segment");
 		}
 
-		TemporaryCodeFile.OutputStream << PendingFunctionReturnValueName << L";\n";
+		GeneratedCode.OutputStream << PendingFunctionReturnValueName << L";\n";
 	}
 
 	ExpectingDoWhileBlock = false;
@@ -362,12 +450,12 @@ void CompilationSession::ExitNode()
 		WriteLeaves(LeafStack.top().Leaves, true);
 		--TabDepth;
 		PadTabs();
-		TemporaryCodeFile.OutputStream << L"} while(";
+		GeneratedCode.OutputStream << L"} while(";
 		bool oldvalue = IgnoreIndentation;
 		IgnoreIndentation = true;
 		WriteLeaves(conditionleaves, false);
 		IgnoreIndentation = oldvalue;
-		TemporaryCodeFile.OutputStream << L");\n";
+		GeneratedCode.OutputStream << L");\n";
 	}
 	else
 	{
@@ -376,12 +464,12 @@ void CompilationSession::ExitNode()
 		if(LeafStack.top().IsFunction)
 		{
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"return " << PendingFunctionReturnValueName << L";\n";
+			GeneratedCode.OutputStream << L"return " << PendingFunctionReturnValueName << L";\n";
 		}
 
 		--TabDepth;
 		PadTabs();
-		TemporaryCodeFile.OutputStream << L"}\n";
+		GeneratedCode.OutputStream << L"}\n";
 	}
 
 	LeafStack.pop();
@@ -425,7 +513,15 @@ void CompilationSession::PadTabs()
 		return;
 
 	for(unsigned i = 0; i < TabDepth; ++i)
-		TemporaryCodeFile.OutputStream << L"\t";
+		GeneratedCode.OutputStream << L"\t";
+}
+
+//
+// Retrieve the qualifier placed before functions invoked by generated code
+//
+const wchar_t* CompilationSession::GetFunctionQualifier() const
+{
+	return GenerateHostCode ? L"static " : L"__device__ ";
 }
 
 //
@@ -433,15 +529,42 @@ void CompilationSession::PadTabs()
 //
 // This code includes preparatory steps for marshalling Epoch data into CUDA variables
 //
+// Host code runs each index of its share of the loop in turn, rather than
+// one index per device thread; the marshalling is repeated for each index,
+// so the body of the loop is the same on both targets.
+//
 void CompilationSession::FunctionPreamble(Extensions::OriginalCodeHandle handle)
 {
+	if(GenerateHostCode)
+	{
+		PadTabs();
+		GeneratedCode.OutputStream << L"extern \"C\" __declspec(dllexport) void " << widen(GenerateFunctionName(handle)) << BlockParameterList << L"\n";
+		PadTabs();
+		GeneratedCode.OutputStream << L"{\n";
+		++TabDepth;
+		PadTabs();
+		GeneratedCode.OutputStream << L"for(unsigned __cudafor_thread_index = 0; __cudafor_thread_index < __cudafor_count; ++__cudafor_thread_index)\n";
+		PadTabs();
+		GeneratedCode.OutputStream << L"{\n";
+		++TabDepth;
+		PadTabs();
+		GeneratedCode.OutputStream << L"// Copy variable values from the host into local variables\n";
+		return;
+	}
+
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"extern \"C\" __global__ void " << widen(GenerateFunctionName(handle)) << L"(unsigned __cudafor_lower_bound, float* __marshal_input_floats, int* __marshal_input_ints, float* __marshal_input_float_arrays, unsigned __num_float_arrays, unsigned* __float_array_sizes, int* __marshal_input_int_arrays, unsigned __num_int_arrays, unsigned* __int_array_sizes)\n";
+	GeneratedCode.OutputStream << L"extern \"C\" __global__ void " << widen(GenerateFunctionName(handle)) << BlockParameterList << L"\n";
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"{\n";
+	GeneratedCode.OutputStream << L"{\n";
 	++TabDepth;
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"// Copy variable values from the host into local variables\n";
+	GeneratedCode.OutputStream << L"// Flatten the grid coordinates into a loop index, and discard threads past the end of the loop\n";
+	PadTabs();
+	GeneratedCode.OutputStream << L"unsigned __cudafor_thread_index = (blockIdx.y * gridDim.x + blockIdx.x) * blockDim.x + threadIdx.x;\n";
+	PadTabs();
+	GeneratedCode.OutputStream << L"if(__cudafor_thread_index >= __cudafor_count) return;\n\n";
+	PadTabs();
+	GeneratedCode.OutputStream << L"// Copy variable values from the host into local variables\n";
 }
 
 //
@@ -454,20 +577,20 @@ void CompilationSession::FunctionPreamble(Extensions::OriginalCodeHandle handle)
 //
 void CompilationSession::MarshalOut()
 {
-	TemporaryCodeFile.OutputStream << L"\n";
+	GeneratedCode.OutputStream << L"\n";
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"// Copy final variable values back into the data buffer for retrieval by the host\n";
+	GeneratedCode.OutputStream << L"// Copy final variable values back into the data buffer for retrieval by the host\n";
 	
 	if(MarshalFloats)
 	{
 		PadTabs();
-		TemporaryCodeFile.OutputStream << L"__marshal_float_index = 0;\n";
+		GeneratedCode.OutputStream << L"__marshal_float_index = 0;\n";
 	}
 
 	if(MarshalInts)
 	{
 		PadTabs();
-		TemporaryCodeFile.OutputStream << L"__marshal_int_index = 0;\n";
+		GeneratedCode.OutputStream << L"__marshal_int_index = 0;\n";
 	}
 
 	for(std::list<Traverser::ScopeContents>::const_iterator iter = RegisteredVariables->begin(); iter != RegisteredVariables->end(); ++iter)
@@ -476,12 +599,12 @@ void CompilationSession::MarshalOut()
 		{
 		case VM::EpochVariableType_Integer:
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"__marshal_input_ints[__marshal_int_index++] = " << iter->Identifier << L";\n";
+			GeneratedCode.OutputStream << L"__marshal_input_ints[__marshal_int_index++] = " << iter->Identifier << L";\n";
 			break;
 
 		case VM::EpochVariableType_Real:
 			PadTabs();
-			TemporaryCodeFile.OutputStream << L"__marshal_input_floats[__marshal_float_index++] = " << iter->Identifier << L";\n";
+			GeneratedCode.OutputStream << L"__marshal_input_floats[__marshal_float_index++] = " << iter->Identifier << L";\n";
 			break;
 
 		case VM::EpochVariableType_Array:
@@ -493,9 +616,16 @@ void CompilationSession::MarshalOut()
 		}
 	}
 
+	if(GenerateHostCode)
+	{
+		--TabDepth;
+		PadTabs();
+		GeneratedCode.OutputStream << L"}\n";
+	}
+
 	--TabDepth;
 	PadTabs();
-	TemporaryCodeFile.OutputStream << L"}\n\n";
+	GeneratedCode.OutputStream << L"}\n\n";
 }
 
 
@@ -523,9 +653,9 @@ void CompilationSession::WriteLeaves(LeafList& leaves, bool leavesarestatements)
 	for(std::list<std::wstring>::const_iterator iter = OutputLines.begin(); iter != OutputLines.end(); ++iter)
 	{
 		PadTabs();
-		TemporaryCodeFile.OutputStream << (*iter);
+		GeneratedCode.OutputStream << (*iter);
 		if(!IgnoreIndentation)
-			TemporaryCodeFile.OutputStream << L"\n";
+			GeneratedCode.OutputStream << L"\n";
 	}
 }
 
@@ -539,6 +669,7 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 	if(iter->Token == Serialization::InitializeValue ||
 	   iter->Token == Serialization::AssignValue)
 	{
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Written);
 		OutputPayload(iter->Payload, out);
 		out << L" = ";
 
@@ -605,8 +736,27 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 	}
 	else if(iter->Token == Serialization::GetValue)
 	{
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Read);
+		return iter->Payload.StringValue;
+	}
+	else if(iter->Token == Serialization::ReadStructure ||
+			iter->Token == Serialization::ReadTuple)
+	{
+		// The payload holds the qualified "variable.member" identifier, which is also valid CUDA
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Read);
 		return iter->Payload.StringValue;
 	}
+	else if(iter->Token == Serialization::AssignStructure ||
+			iter->Token == Serialization::AssignTuple)
+	{
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Written);
+		out << iter->Payload.StringValue << L" = ";
+
+		AdvanceLeafIterator(iter);
+		out << GenerateLeafCode(iter, enditer);
+		out << L";";
+		return out.str();
+	}
 	else if(iter->Token == Serialization::WhileCondition)
 	{
 		AdvanceLeafIterator(iter);
@@ -639,6 +789,7 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 	else if(iter->Token == Serialization::WriteArray)
 	{
 		std::wstring arrayidentifier = iter->Payload.StringValue;
+		RecordVariableUsage(arrayidentifier, VariableUsage_Written);
 		AdvanceLeafIterator(iter);
 		std::wstring rhs = GenerateLeafCode(iter, enditer);
 		AdvanceLeafIterator(iter);
@@ -649,6 +800,7 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 	}
 	else if(iter->Token == Serialization::ReadArray)
 	{
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Read);
 		out << iter->Payload.StringValue << L"[";
 		AdvanceLeafIterator(iter);
 		out << GenerateLeafCode(iter, enditer) << L"]";
@@ -660,7 +812,7 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 
 		if(funcname == L"CUDAGetThreadIndex")
 		{
-			out << L"(blockIdx.x * blockDim.x + threadIdx.x + __cudafor_lower_bound)";
+			out << L"(__cudafor_thread_index + __cudafor_lower_bound)";
 		}
 		else
 		{
@@ -696,7 +848,11 @@ std::wstring CompilationSession::GenerateLeafCode(LeafList::const_iterator& iter
 		return L"do";
 	}
 	else if(iter->Token == Serialization::BindReference)
+	{
+		// The bound function may modify the variable via the reference
+		RecordVariableUsage(iter->Payload.StringValue, VariableUsage_Read | VariableUsage_Written);
 		return iter->Payload.StringValue;
+	}
 	
 	throw std::exception("Cannot generate CUDA code for the given EASM instruction");
 }
@@ -754,3 +910,21 @@ unsigned CompilationSession::GetNamedArrayMarshalIndex(const std::wstring& array
 	return iter->second.MarshalIndex;
 }
 
+
+//
+// Track how the code block makes use of a registered variable
+//
+// Usage is recorded by name only, so a nested variable which shadows a registered
+// variable causes the registered variable to be treated as used as well; this is
+// harmless, as it simply causes additional data to be transferred.
+//
+void CompilationSession::RecordVariableUsage(const std::wstring& identifier, unsigned flags)
+{
+	if(!VariableUsage)
+		return;
+
+	VariableUsageTable::iterator iter = VariableUsage->find(identifier);
+	if(iter != VariableUsage->end())
+		iter->second |= flags;
+}
+
@@ -9,6 +9,10 @@
 // code. Multiple sessions may be performed before finally compiling to
 // PTX code via NVCC.
 //
+// When no CUDA device is present, the same sessions can instead produce
+// plain C++ for the host, which is built into a DLL using CL; see the
+// HostCodeInvoker for how such code is run.
+//
 
 #pragma once
 
@@ -16,11 +20,14 @@
 // Dependencies
 #include "Language Extensions/HandleTypes.h"
 #include "Traverser/TraversalInterface.h"
-#include "Utility/Files/TempFile.h"
+
+#include "Code Generation/CompiledCodeManager.h"
+#include "Code Generation/CodeBuffer.h"
 
 
 extern bool CUDAAvailableForExecution;
 extern bool CUDALibraryLoaded;
+extern bool HostCodeAvailable;
 
 
 namespace Compiler
@@ -59,8 +66,8 @@ namespace Compiler
 
 	// Construction
 	public:
-		CompilationSession(TemporaryFileWriter& codefile, std::list<Traverser::ScopeContents>& registeredvariables, Extensions::CompileSessionHandle sessionhandle);
-		CompilationSession(TemporaryFileWriter& codefile, TemporaryFileWriter& prototypesheaderfile, Extensions::CompileSessionHandle sessionhandle);
+		CompilationSession(GeneratedCodeBuffer& code, std::list<Traverser::ScopeContents>& registeredvariables, VariableUsageTable& variableusage, Extensions::CompileSessionHandle sessionhandle);
+		CompilationSession(GeneratedCodeBuffer& code, GeneratedCodeBuffer& prototypesheader, Extensions::CompileSessionHandle sessionhandle);
 
 	// Preparation and data loading
 	public:
@@ -94,9 +101,14 @@ namespace Compiler
 		void SetNamedArrayMarshalIndex(const std::wstring& arrayname, unsigned index);
 		unsigned GetNamedArrayMarshalIndex(const std::wstring& arrayname) const;
 
+		void RecordVariableUsage(const std::wstring& identifier, unsigned flags);
+
+		const wchar_t* GetFunctionQualifier() const;
+
 	// Internal tracking
 	private:
 		Extensions::CompileSessionHandle SessionHandle;
+		bool GenerateHostCode;
 
 		unsigned TabDepth;
 
@@ -104,9 +116,10 @@ namespace Compiler
 		std::wostringstream ExpressionConstruction;
 
 		std::list<Traverser::ScopeContents>* RegisteredVariables;
+		VariableUsageTable* VariableUsage;
 
-		TemporaryFileWriter& TemporaryCodeFile;
-		TemporaryFileWriter* PrototypeHeaderFile;
+		GeneratedCodeBuffer& GeneratedCode;
+		GeneratedCodeBuffer* PrototypeHeader;
 
 		LeafListStack LeafStack;
 
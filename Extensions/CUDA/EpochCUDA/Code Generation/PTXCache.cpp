@@ -0,0 +1,113 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Persistent cache of PTX code generated by NVCC
+//
+// Invoking NVCC takes several seconds, and has to be done every time a
+// program using CUDA is compiled. Since the generated CUDA code is the
+// same for an unchanged program, the resulting PTX is stored under a name
+// derived from a hash of the generated source; subsequent compiles of the
+// same code can then reuse the stored PTX and skip NVCC entirely.
+//
+// Each translation unit is hashed from its complete text, as held in
+// memory before being handed to NVCC. The hash also covers the NVCC
+// executable's time stamp and the host compiler location, so that changing
+// either compiler invalidates all cached PTX.
+//
+
+#include "pch.h"
+
+#include "Code Generation/PTXCache.h"
+
+#include "Utility/Files/SpecialPaths.h"
+#include "Utility/Hashing.h"
+
+#include <fstream>
+#include <iomanip>
+
+
+namespace
+{
+
+	//
+	// Retrieve the directory used to store cached PTX files, creating it if needed
+	//
+	std::wstring GetCacheDirectory()
+	{
+		std::wstring appdatapath = SpecialPaths::GetAppDataPath();
+		if(appdatapath == SpecialPaths::InvalidPath)
+			return std::wstring();
+
+		std::wstring path = appdatapath + L"\\Epoch PTX Cache\\";
+		::CreateDirectory(path.c_str(), NULL);
+		return path;
+	}
+
+}
+
+
+//
+// Determine the name under which PTX generated from the given source code is cached
+//
+// Returns an empty string if there is no location available for the
+// cache, in which case caching is skipped.
+//
+std::wstring PTXCache::GetCachedFileName(const std::wstring& sourcecode, const std::wstring& nvccpath, const std::wstring& clpath)
+{
+	Hashing::Hash64 hash = Hashing::HashString64(Hashing::FNV64OffsetBasis, sourcecode);
+	hash = Hashing::HashFileTimeStamp64(hash, nvccpath);
+	hash = Hashing::HashString64(hash, nvccpath);
+	hash = Hashing::HashString64(hash, clpath);
+
+	std::wstring directory = GetCacheDirectory();
+	if(directory.empty())
+		return std::wstring();
+
+	std::wostringstream filename;
+	filename << directory << std::hex << std::setw(16) << std::setfill(L'0') << hash << L".ptx";
+	return filename.str();
+}
+
+//
+// Read previously cached PTX into memory, returning false on a cache miss
+//
+bool PTXCache::Fetch(const std::wstring& cachedfilename, std::string& ptx)
+{
+	if(cachedfilename.empty())
+		return false;
+
+	std::ifstream infile(cachedfilename.c_str(), std::ios::in | std::ios::binary);
+	if(!infile)
+		return false;
+
+	std::ostringstream contents;
+	contents << infile.rdbuf();
+	if(!infile)
+		return false;
+
+	ptx = contents.str();
+	return true;
+}
+
+//
+// Keep a copy of freshly generated PTX for future compiles
+//
+// Failure to store the file is not an error; the next compile will
+// simply need to invoke NVCC again.
+//
+void PTXCache::Store(const std::string& ptx, const std::wstring& cachedfilename)
+{
+	if(cachedfilename.empty())
+		return;
+
+	bool stored;
+	{
+		std::ofstream outfile(cachedfilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		outfile.write(ptx.data(), static_cast<std::streamsize>(ptx.length()));
+		stored = outfile.good();
+	}
+
+	if(!stored)
+		::DeleteFile(cachedfilename.c_str());
+}
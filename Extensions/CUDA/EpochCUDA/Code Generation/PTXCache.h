@@ -0,0 +1,19 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Persistent cache of PTX code generated by NVCC
+//
+
+#pragma once
+
+
+namespace PTXCache
+{
+
+	std::wstring GetCachedFileName(const std::wstring& sourcecode, const std::wstring& nvccpath, const std::wstring& clpath);
+
+	bool Fetch(const std::wstring& cachedfilename, std::string& ptx);
+	void Store(const std::string& ptx, const std::wstring& cachedfilename);
+
+}
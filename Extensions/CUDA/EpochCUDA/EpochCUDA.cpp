@@ -8,6 +8,7 @@
 #include "pch.h"
 
 #include "CUDA Wrapper/Initialization.h"
+#include "Host Code/HostCodeInvoker.h"
 
 #include "Code Generation/CompiledCodeManager.h"
 
@@ -34,6 +35,7 @@ BOOL APIENTRY DllMain(HMODULE, DWORD reason, LPVOID)
 		if(reason == DLL_PROCESS_DETACH)
 		{
 			ShutdownCUDA();
+			HostCodeInvoker::ReleasePreparedBlocks();
 			Compiler::DestroyTempFiles();
 			TemporaryFileWriter::RemoveAllFiles();
 		}
@@ -9,7 +9,9 @@
 
 #include "Traverser/TraversalInterface.h"
 #include "CUDA Wrapper/InvokeCode.h"
+#include "CUDA Wrapper/ArrayOperations.h"
 #include "CUDA Wrapper/Initialization.h"
+#include "Host Code/HostCodeInvoker.h"
 #include "Configuration/ConfigFile.h"
 
 #include "Code Generation/CompiledCodeManager.h"
@@ -37,12 +39,16 @@ RequestMarshalBufferPtr RequestMarshalBuffer = NULL;
 
 bool CUDAAvailableForExecution = false;
 bool CUDALibraryLoaded = false;
+bool HostCodeAvailable = false;
 
 
 bool __stdcall Initialize()
 {
 	InitializeCUDA();
-	return (CUDALibraryLoaded && CUDAAvailableForExecution);
+	if(!CUDAAvailableForExecution)
+		HostCodeAvailable = InitializeHostCode();
+
+	return (CUDALibraryLoaded && CUDAAvailableForExecution) || HostCodeAvailable;
 }
 
 
@@ -110,6 +116,33 @@ CodeBlockHandle __stdcall LoadSourceBlock(CompileSessionHandle sessionid, Origin
 	return 0;
 }
 
+//
+// Determine whether a compiled block of language-extended code can be executed
+//
+// Without a CUDA device, only the blocks for which host code was built can
+// be run by the extension; the VM executes all other blocks itself.
+//
+bool __stdcall IsBlockAvailableForExecution(CodeBlockHandle handle)
+{
+	if(CUDAAvailableForExecution)
+		return true;
+
+	try
+	{
+		return HostCodeInvoker::IsBlockAvailable(handle);
+	}
+	catch(std::exception& e)
+	{
+		FugueVMAccess::Interface.Error(widen(e.what()).c_str());
+	}
+	catch(...)
+	{
+		FugueVMAccess::Interface.Error(L"An unrecognized exception was thrown while trying to prepare a code block for execution");
+	}
+
+	return false;
+}
+
 //
 // Invoke execution of a compiled block of language-extended code
 //
@@ -117,8 +150,16 @@ void __stdcall ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedsc
 {
 	try
 	{
-		CUDACodeInvoker invoker(handle, activatedscopehandle);
-		invoker.Execute(0, 0);
+		if(CUDAAvailableForExecution)
+		{
+			CUDACodeInvoker invoker(handle, activatedscopehandle);
+			invoker.Execute(0, 0);
+		}
+		else
+		{
+			HostCodeInvoker invoker(handle, activatedscopehandle);
+			invoker.Execute(0, 0);
+		}
 	}
 	catch(std::exception& e)
 	{
@@ -140,8 +181,56 @@ void __stdcall ExecuteControl(CodeBlockHandle handle, HandleType activatedscopeh
 
 	try
 	{
-		CUDACodeInvoker invoker(handle, activatedscopehandle);
-		invoker.Execute(params[0].Int32Value, params[1].Int32Value);
+		if(CUDAAvailableForExecution)
+		{
+			CUDACodeInvoker invoker(handle, activatedscopehandle);
+			invoker.Execute(params[0].Int32Value, params[1].Int32Value);
+		}
+		else
+		{
+			HostCodeInvoker invoker(handle, activatedscopehandle);
+			invoker.Execute(params[0].Int32Value, params[1].Int32Value);
+		}
+	}
+	catch(std::exception& e)
+	{
+		FugueVMAccess::Interface.Error(widen(e.what()).c_str());
+	}
+	catch(...)
+	{
+		FugueVMAccess::Interface.Error(L"An unrecognized exception was thrown while trying to execute a CUDA code block");
+	}
+}
+
+//
+// Execute a run of consecutive control blocks which share the same parameters
+//
+// The VM gathers cudafor loops which directly follow one another over the
+// same range, so that their kernels can share a single transfer of the
+// variables to and from the device where possible.
+//
+void __stdcall ExecuteControlSequence(size_t numhandles, const CodeBlockHandle* handles, HandleType activatedscopehandle, size_t numparams, const Traverser::Payload* params)
+{
+	if(numparams != 2)
+	{
+		FugueVMAccess::Interface.Error(L"Incorrect number of parameters supplied to control block");
+		return;
+	}
+
+	try
+	{
+		std::vector<CodeBlockHandle> codehandles(handles, handles + numhandles);
+
+		if(CUDAAvailableForExecution)
+			CUDACodeInvoker::ExecuteSequence(codehandles, activatedscopehandle, params[0].Int32Value, params[1].Int32Value);
+		else
+		{
+			for(std::vector<CodeBlockHandle>::const_iterator iter = codehandles.begin(); iter != codehandles.end(); ++iter)
+			{
+				HostCodeInvoker invoker(*iter, activatedscopehandle);
+				invoker.Execute(params[0].Int32Value, params[1].Int32Value);
+			}
+		}
 	}
 	catch(std::exception& e)
 	{
@@ -186,14 +275,20 @@ CompileSessionHandle __stdcall StartNewProgramCompilation(HandleType programhand
 // provided to the extension, we can batch-compile them into a form that is more
 // suitable for execution. For instance, this extension library compiles from the
 // original EpochASM code into CUDA; during the commit process, we pass the CUDA
-// code to NVCC in order to produce a .PTX file. The CUDA drivers then load the
+// code to NVCC in order to produce .PTX files. NVCC runs in the background, and
+// the generated code is only waited for once it is first executed, or when the
+// program is serialized. The CUDA drivers then load the
 // .PTX, assemble it to appropriate bytecode for the available CUDA device, and
 // then execute the generated code on the CUDA device itself.
 //
+// Only the time taken to hand the code off is traced here; the NVCC jobs
+// themselves are timed as they finish, see CompileJobBatch.
+//
 void __stdcall CommitCompilation(CompileSessionHandle sessionid)
 {
 	try
 	{
+		FugueVMAccess::TraceSpan trace("CUDA commit compilation", sessionid);
 		Compiler::CommitCompile(sessionid);
 	}
 	catch(std::exception& e)
@@ -396,7 +491,22 @@ bool __stdcall IsCUDAAvailable()
 void __stdcall FillSerializationBuffer(wchar_t** buffer, size_t* buffersize)
 {
 	std::vector<std::vector<Byte> > buffers;
-	Compiler::CopyGeneratedCodeToMemoryBuffers(buffers);
+
+	// Serializing waits for any code still being compiled, so compile errors may surface here
+	try
+	{
+		Compiler::CopyGeneratedCodeToMemoryBuffers(buffers);
+	}
+	catch(std::exception& e)
+	{
+		FugueVMAccess::Interface.Error(widen(e.what()).c_str());
+		buffers.clear();
+	}
+	catch(...)
+	{
+		FugueVMAccess::Interface.Error(L"An unrecognized exception was thrown while trying to serialize CUDA code");
+		buffers.clear();
+	}
 
 	size_t totalsize = 0;
 	for(std::vector<std::vector<Byte> >::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
@@ -430,13 +540,65 @@ void __stdcall LoadDataBuffer(const char* buffer, size_t size)
 
 void __stdcall PrepareBlock(CodeBlockHandle handle)
 {
-	std::string funcname = GenerateFunctionName(Compiler::GetOriginalCodeHandle(handle));
-	std::string filename = narrow(Compiler::GetGeneratedPTXFileName(Compiler::GetAssociatedSession(handle)));
-	Module::LoadCUDAModule(filename).CreateFunctionCall(funcname);
+	if(CUDAAvailableForExecution)
+		CUDACodeInvoker::PrepareBlock(handle);
+	else
+		HostCodeInvoker::PrepareBlock(handle);
 }
 
 void __stdcall ClearEverything()
 {
+	CUDACodeInvoker::ReleasePreparedBlocks();
+	HostCodeInvoker::ReleasePreparedBlocks();
 	Compiler::Clear();
 }
 
+
+//
+// Compiler callback: generate a kernel for a map or reduce in the program
+//
+// The VM offers large array operations to extensions while parsing, so that
+// they can run on the device instead of being processed element by element.
+//
+bool __stdcall CompileArrayOperation(CompileSessionHandle sessionid, const ArrayOperationInfo* info)
+{
+	try
+	{
+		return Compiler::CompileArrayOperation(sessionid, *info);
+	}
+	catch(std::exception& e)
+	{
+		FugueVMAccess::Interface.Error(widen(e.what()).c_str());
+	}
+	catch(...)
+	{
+		FugueVMAccess::Interface.Error(L"An unrecognized exception was thrown while compiling an array operation to CUDA");
+	}
+
+	return false;
+}
+
+//
+// Run a map or reduce operation on the device
+//
+// Returns false if the operation was not compiled, in which case the VM runs
+// the operation itself.
+//
+bool __stdcall ExecuteArrayOperation(const ArrayOperationInfo* info, const void* input, size_t count, void* output)
+{
+	try
+	{
+		return RunArrayOperation(*info, input, count, output);
+	}
+	catch(std::exception& e)
+	{
+		FugueVMAccess::Interface.Error(widen(e.what()).c_str());
+	}
+	catch(...)
+	{
+		FugueVMAccess::Interface.Error(L"An unrecognized exception was thrown while running an array operation on the CUDA device");
+	}
+
+	return false;
+}
+
@@ -11,3 +11,74 @@
 
 Extensions::ExtensionInterface FugueVMAccess::Interface;
 
+
+namespace
+{
+	double GetTicksPerMillisecond()
+	{
+		LARGE_INTEGER frequency;
+		::QueryPerformanceFrequency(&frequency);
+		return static_cast<double>(frequency.QuadPart) / 1000.0;
+	}
+
+	const double TicksPerMillisecond = GetTicksPerMillisecond();
+}
+
+
+//
+// Hand a report of work done for a code block over to the VM telemetry
+//
+// VMs which predate the telemetry callback simply do not receive reports.
+//
+void FugueVMAccess::RecordActivity(Extensions::CodeBlockHandle handle, const Extensions::CodeBlockActivity& activity)
+{
+	if(Interface.RecordActivity)
+		Interface.RecordActivity(handle, &activity);
+}
+
+//
+// Hand a span of work with known start and end times over to the VM's timeline trace
+//
+void FugueVMAccess::RecordSpan(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value)
+{
+	if(Interface.Trace)
+		Interface.Trace(name, startticks, endticks, value);
+}
+
+
+unsigned __int64 FugueVMAccess::GetTimestamp()
+{
+	LARGE_INTEGER value;
+	::QueryPerformanceCounter(&value);
+	return static_cast<unsigned __int64>(value.QuadPart);
+}
+
+double FugueVMAccess::TicksToMilliseconds(unsigned __int64 ticks)
+{
+	return static_cast<double>(ticks) / TicksPerMillisecond;
+}
+
+unsigned __int64 FugueVMAccess::MillisecondsToTicks(double milliseconds)
+{
+	return static_cast<unsigned __int64>(milliseconds * TicksPerMillisecond);
+}
+
+
+//
+// Begin timing a span of work
+//
+FugueVMAccess::TraceSpan::TraceSpan(const char* name, unsigned __int64 value)
+	: Name(name),
+	  Value(value),
+	  StartTicks(GetTimestamp())
+{
+}
+
+//
+// Hand the span over to the VM; the VM ignores it unless tracing is enabled
+//
+FugueVMAccess::TraceSpan::~TraceSpan()
+{
+	RecordSpan(Name, StartTicks, GetTimestamp(), Value);
+}
+
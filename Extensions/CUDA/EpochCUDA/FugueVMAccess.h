@@ -17,5 +17,31 @@ namespace FugueVMAccess
 
 	extern Extensions::ExtensionInterface Interface;
 
+
+	// Reporting of work done for each code block; see CodeBlockActivity
+	void RecordActivity(Extensions::CodeBlockHandle handle, const Extensions::CodeBlockActivity& activity);
+	void RecordSpan(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value);
+
+	// Timing helpers; timestamps are QueryPerformanceCounter ticks, as expected by the VM
+	unsigned __int64 GetTimestamp();
+	double TicksToMilliseconds(unsigned __int64 ticks);
+	unsigned __int64 MillisecondsToTicks(double milliseconds);
+
+
+	//
+	// RAII helper for reporting a span of work to the VM's timeline trace
+	//
+	class TraceSpan
+	{
+	public:
+		TraceSpan(const char* name, unsigned __int64 value);
+		~TraceSpan();
+
+	private:
+		const char* Name;
+		unsigned __int64 Value;
+		unsigned __int64 StartTicks;
+	};
+
 }
 
@@ -0,0 +1,497 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Wrapper class for invoking generated host code
+//
+
+#include "pch.h"
+
+#include "Host Code/HostCodeInvoker.h"
+#include "CUDA Wrapper/Naming.h"
+
+#include "Code Generation/CompiledCodeManager.h"
+
+#include "Configuration/ConfigFile.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+#include "FugueVMAccess.h"
+
+#include <memory>
+#include <algorithm>
+
+
+// We need to use the config file to locate the CL compiler
+extern Config::ConfigReader Configuration;
+
+
+namespace
+{
+
+	//
+	// Signature of the entry point generated for each code block; see CompilationSession::FunctionPreamble
+	//
+	typedef void (__cdecl *HostEntryPoint)(unsigned lowerbound, unsigned count, Real* reals, Integer32* ints, Real* realarrays, unsigned numrealarrays, unsigned* realarraysizes, Integer32* intarrays, unsigned numintarrays, unsigned* intarraysizes);
+
+	// Loops are only split into shares of at least this many iterations, so that short loops are not scattered across the pool
+	const size_t MinIterationsPerShare = 64;
+
+
+	//
+	// Host-side copy of the scalar variables of a single type used by a code block
+	//
+	// Variables are assigned consecutive slots, in the order expected by the
+	// generated code. Variables which the code never touches still occupy a
+	// slot, but are not read from the VM.
+	//
+	template <typename T, VM::EpochVariableTypeID DataType>
+	class ScalarVariables
+	{
+	public:
+		void Read(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle)
+		{
+			Values.clear();
+
+			std::vector<size_t> slots;
+			std::vector<const wchar_t*> identifiers;
+
+			for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+			{
+				if(iter->Type != DataType)
+					continue;
+
+				if(Compiler::LookupVariableUsage(usage, iter->Identifier))
+				{
+					slots.push_back(Values.size());
+					identifiers.push_back(iter->Identifier.c_str());
+				}
+
+				Values.push_back(T());
+			}
+
+			if(identifiers.empty())
+				return;
+
+			std::vector<T> marshalled(identifiers.size());
+			FugueVMAccess::Interface.MarshalReadBulk(activatedscopehandle, identifiers.size(), &identifiers[0], DataType, &marshalled[0]);
+
+			for(size_t i = 0; i < slots.size(); ++i)
+				Values[slots[i]] = marshalled[i];
+		}
+
+		//
+		// Pass back the values changed by any share of an execution
+		//
+		// This object must hold the values as they were before the shares ran;
+		// where several shares changed the same value, later shares win.
+		//
+		void WriteBack(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle, const std::vector<const ScalarVariables*>& shares) const
+		{
+			std::vector<const wchar_t*> identifiers;
+			std::vector<T> changedvalues;
+
+			size_t slot = 0;
+			for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+			{
+				if(iter->Type != DataType)
+					continue;
+
+				if(Compiler::LookupVariableUsage(usage, iter->Identifier) & Compiler::VariableUsage_Written)
+				{
+					const T* result = NULL;
+					for(typename std::vector<const ScalarVariables*>::const_iterator shareiter = shares.begin(); shareiter != shares.end(); ++shareiter)
+					{
+						if(!((*shareiter)->Values[slot] == Values[slot]))
+							result = &((*shareiter)->Values[slot]);
+					}
+
+					if(result)
+					{
+						identifiers.push_back(iter->Identifier.c_str());
+						changedvalues.push_back(*result);
+					}
+				}
+
+				++slot;
+			}
+
+			if(!identifiers.empty())
+				FugueVMAccess::Interface.MarshalWriteBulk(activatedscopehandle, identifiers.size(), &identifiers[0], DataType, &changedvalues[0]);
+		}
+
+		T* GetBuffer()
+		{ return Values.empty() ? NULL : &Values[0]; }
+
+	private:
+		std::vector<T> Values;
+	};
+
+
+	//
+	// Host-side copy of the arrays of a single element type used by a code block
+	//
+	// All arrays are flattened into a single buffer, alongside a buffer
+	// holding the length of each array, exactly as on the device. Arrays
+	// which the code never touches keep their place in the layout, but
+	// their contents are not copied.
+	//
+	template <typename T, VM::EpochVariableTypeID DataType>
+	class ArrayVariables
+	{
+	public:
+		void Read(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle)
+		{
+			Values.clear();
+			Sizes.clear();
+
+			for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+			{
+				if(iter->Type != VM::EpochVariableType_Array || iter->ContainedType != DataType)
+					continue;
+
+				Traverser::Payload payload;
+				FugueVMAccess::Interface.MarshalRead(activatedscopehandle, iter->Identifier.c_str(), &payload);
+
+				if(Compiler::LookupVariableUsage(usage, iter->Identifier))
+				{
+					const T* elements = reinterpret_cast<const T*>(payload.PointerValue);
+					Values.insert(Values.end(), elements, elements + payload.ParameterCount);
+				}
+				else
+					Values.resize(Values.size() + payload.ParameterCount, T());
+
+				Sizes.push_back(static_cast<unsigned>(payload.ParameterCount));
+			}
+
+			OriginalValues = Values;
+		}
+
+		//
+		// Pass back the arrays which were changed by the code
+		//
+		void WriteBack(const std::list<Traverser::ScopeContents>& variables, const Compiler::VariableUsageTable& usage, HandleType activatedscopehandle) const
+		{
+			size_t index = 0;
+			size_t internalindex = 0;
+
+			for(std::list<Traverser::ScopeContents>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+			{
+				if(iter->Type != VM::EpochVariableType_Array || iter->ContainedType != DataType)
+					continue;
+
+				size_t arraysize = Sizes[internalindex];
+				if((Compiler::LookupVariableUsage(usage, iter->Identifier) & Compiler::VariableUsage_Written) && arraysize)
+				{
+					if(!std::equal(Values.begin() + index, Values.begin() + index + arraysize, OriginalValues.begin() + index))
+					{
+						Traverser::Payload payload;
+						payload.Type = VM::EpochVariableType_Array;
+						payload.PointerValue = const_cast<T*>(&(Values[index]));
+						payload.ParameterCount = arraysize;
+						payload.ParameterType = iter->ContainedType;
+						FugueVMAccess::Interface.MarshalWrite(activatedscopehandle, iter->Identifier.c_str(), &payload);
+					}
+				}
+
+				index += arraysize;
+				++internalindex;
+			}
+		}
+
+		T* GetBuffer()
+		{ return Values.empty() ? NULL : &Values[0]; }
+
+		unsigned GetNumArrays() const
+		{ return static_cast<unsigned>(Sizes.size()); }
+
+		unsigned* GetSizesBuffer()
+		{ return Sizes.empty() ? NULL : &Sizes[0]; }
+
+	private:
+		std::vector<T> Values;
+		std::vector<T> OriginalValues;
+		std::vector<unsigned> Sizes;
+	};
+
+
+	typedef ScalarVariables<Real, VM::EpochVariableType_Real> RealVariables;
+	typedef ScalarVariables<Integer32, VM::EpochVariableType_Integer> IntVariables;
+	typedef ArrayVariables<Real, VM::EpochVariableType_Real> RealArrayVariables;
+	typedef ArrayVariables<Integer32, VM::EpochVariableType_Integer> IntArrayVariables;
+
+
+	//
+	// A portion of the iterations of a code block, run by a single thread
+	//
+	struct Share
+	{
+		Share(HostEntryPoint entrypoint, size_t lowerbound, size_t count, const RealVariables& reals, const IntVariables& ints, RealArrayVariables& realarrays, IntArrayVariables& intarrays, Threads::CountdownLatch& finished)
+			: EntryPoint(entrypoint),
+			  LowerBound(lowerbound),
+			  Count(count),
+			  Reals(reals),
+			  Ints(ints),
+			  RealArrays(&realarrays),
+			  IntArrays(&intarrays),
+			  Finished(&finished)
+		{ }
+
+		void Run()
+		{
+			EntryPoint(static_cast<unsigned>(LowerBound), static_cast<unsigned>(Count), Reals.GetBuffer(), Ints.GetBuffer(),
+				RealArrays->GetBuffer(), RealArrays->GetNumArrays(), RealArrays->GetSizesBuffer(),
+				IntArrays->GetBuffer(), IntArrays->GetNumArrays(), IntArrays->GetSizesBuffer());
+		}
+
+		HostEntryPoint EntryPoint;
+		size_t LowerBound;
+		size_t Count;
+
+		RealVariables Reals;
+		IntVariables Ints;
+		RealArrayVariables* RealArrays;
+		IntArrayVariables* IntArrays;
+
+		Threads::CountdownLatch* Finished;
+	};
+
+	//
+	// Thread pool callback: run a share and signal its completion
+	//
+	DWORD WINAPI RunShare(LPVOID param)
+	{
+		Share* share = reinterpret_cast<Share*>(param);
+		share->Run();
+		share->Finished->CountDown();
+		return 0;
+	}
+
+
+	//
+	// Divide the iterations of a code block into one share per processor
+	//
+	// Any iterations left over from rounding go to the last share.
+	//
+	std::vector<size_t> DivideIterations(size_t count)
+	{
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+
+		size_t numshares = std::min<size_t>(std::max<DWORD>(info.dwNumberOfProcessors, 1), std::max<size_t>(count / MinIterationsPerShare, 1));
+
+		std::vector<size_t> shares(numshares, count / numshares);
+		shares.back() += count % numshares;
+		return shares;
+	}
+
+}
+
+
+//
+// Everything needed to run a compiled code block
+//
+// Blocks are prepared once, so that the DLL and entry point lookups do not
+// need to be repeated on each execution. Blocks for which no host code was
+// built have no entry point; the VM runs such blocks itself.
+//
+struct HostCodeInvoker::PreparedBlock
+{
+	PreparedBlock(Extensions::CodeBlockHandle codehandle, HMODULE library)
+		: IsForLoop(Compiler::GetCodeControlKeyword(codehandle) == L"cudafor"),
+		  Variables(Compiler::GetRegisteredVariables(codehandle)),
+		  Usage(Compiler::GetVariableUsage(codehandle)),
+		  EntryPoint(NULL)
+	{
+		if(library)
+			EntryPoint = reinterpret_cast<HostEntryPoint>(::GetProcAddress(library, GenerateFunctionName(Compiler::GetOriginalCodeHandle(codehandle)).c_str()));
+	}
+
+	bool IsForLoop;
+
+	const std::list<Traverser::ScopeContents>& Variables;
+	const Compiler::VariableUsageTable& Usage;
+
+	HostEntryPoint EntryPoint;
+};
+
+
+namespace
+{
+	// Prepared blocks are retained for the lifetime of the compiled code; the
+	// lock guards the map and the loaded DLLs, never an actual execution
+	std::map<Extensions::CodeBlockHandle, HostCodeInvoker::PreparedBlock*> PreparedBlocks;
+	std::map<std::wstring, HMODULE> LoadedLibraries;
+	Threads::CriticalSection PreparedBlocksCriticalSection;
+
+
+	//
+	// Load the host code DLL built for the given code block's session
+	//
+	// Returns NULL if no DLL was built. The lock must already be held.
+	//
+	HMODULE LoadHostLibrary(Extensions::CodeBlockHandle codehandle)
+	{
+		const std::wstring& libraryname = Compiler::GetGeneratedHostLibraryFileName(Compiler::GetAssociatedSession(codehandle));
+		if(libraryname.empty())
+			return NULL;
+
+		std::map<std::wstring, HMODULE>::const_iterator iter = LoadedLibraries.find(libraryname);
+		if(iter != LoadedLibraries.end())
+			return iter->second;
+
+		HMODULE library = ::LoadLibrary(libraryname.c_str());
+		LoadedLibraries[libraryname] = library;
+		return library;
+	}
+}
+
+
+//
+// Construct and initialize the execution wrapper
+//
+HostCodeInvoker::HostCodeInvoker(Extensions::CodeBlockHandle codehandle, HandleType activatedscopehandle)
+	: ActivatedScopeHandle(activatedscopehandle),
+	  Block(GetPreparedBlock(codehandle))
+{
+}
+
+
+//
+// Execute the bound host code block
+//
+// The iteration range of a cudafor loop is split into shares, which are
+// run concurrently on the system thread pool; the calling thread runs the
+// last share itself rather than sitting idle. Other blocks are run once,
+// directly on the calling thread.
+//
+void HostCodeInvoker::Execute(size_t lowerbound, size_t upperbound)
+{
+	if(!Block.EntryPoint)
+		throw std::exception("No host code is available for this code block");
+
+	size_t count = Block.IsForLoop ? upperbound - lowerbound : 1;
+	if(!Block.IsForLoop)
+		lowerbound = 0;
+
+	FugueVMAccess::TraceSpan trace("CUDA host code", count);
+
+	RealVariables reals;
+	IntVariables ints;
+	RealArrayVariables realarrays;
+	IntArrayVariables intarrays;
+
+	reals.Read(Block.Variables, Block.Usage, ActivatedScopeHandle);
+	ints.Read(Block.Variables, Block.Usage, ActivatedScopeHandle);
+	realarrays.Read(Block.Variables, Block.Usage, ActivatedScopeHandle);
+	intarrays.Read(Block.Variables, Block.Usage, ActivatedScopeHandle);
+
+	std::vector<size_t> sharesizes = DivideIterations(count);
+	Threads::CountdownLatch finished(static_cast<unsigned>(sharesizes.size() - 1));
+
+	std::vector<Share> shares;
+	shares.reserve(sharesizes.size());
+
+	size_t rangestart = lowerbound;
+	for(size_t i = 0; i < sharesizes.size(); ++i)
+	{
+		shares.push_back(Share(Block.EntryPoint, rangestart, sharesizes[i], reals, ints, realarrays, intarrays, finished));
+		rangestart += sharesizes[i];
+	}
+
+	for(size_t i = 0; i < shares.size() - 1; ++i)
+	{
+		if(!::QueueUserWorkItem(RunShare, &shares[i], WT_EXECUTEDEFAULT))
+		{
+			shares[i].Run();
+			finished.CountDown();
+		}
+	}
+
+	shares.back().Run();
+	finished.Wait();
+
+	std::vector<const RealVariables*> realshares;
+	std::vector<const IntVariables*> intshares;
+	for(std::vector<Share>::const_iterator iter = shares.begin(); iter != shares.end(); ++iter)
+	{
+		realshares.push_back(&iter->Reals);
+		intshares.push_back(&iter->Ints);
+	}
+
+	reals.WriteBack(Block.Variables, Block.Usage, ActivatedScopeHandle, realshares);
+	ints.WriteBack(Block.Variables, Block.Usage, ActivatedScopeHandle, intshares);
+	realarrays.WriteBack(Block.Variables, Block.Usage, ActivatedScopeHandle);
+	intarrays.WriteBack(Block.Variables, Block.Usage, ActivatedScopeHandle);
+}
+
+
+//
+// Static helper: resolve everything needed to run a code block ahead of time
+//
+void HostCodeInvoker::PrepareBlock(Extensions::CodeBlockHandle codehandle)
+{
+	GetPreparedBlock(codehandle);
+}
+
+//
+// Static helper: determine whether host code was built for a code block
+//
+bool HostCodeInvoker::IsBlockAvailable(Extensions::CodeBlockHandle codehandle)
+{
+	return (GetPreparedBlock(codehandle).EntryPoint != NULL);
+}
+
+//
+// Static helper: retrieve the prepared data for a code block,
+// preparing the block first if this has not already been done
+//
+HostCodeInvoker::PreparedBlock& HostCodeInvoker::GetPreparedBlock(Extensions::CodeBlockHandle codehandle)
+{
+	Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+	std::map<Extensions::CodeBlockHandle, PreparedBlock*>::const_iterator iter = PreparedBlocks.find(codehandle);
+	if(iter != PreparedBlocks.end())
+		return *(iter->second);
+
+	std::auto_ptr<PreparedBlock> block(new PreparedBlock(codehandle, LoadHostLibrary(codehandle)));
+	PreparedBlocks.insert(std::make_pair(codehandle, block.get()));
+	return *(block.release());
+}
+
+//
+// Static helper: free the data retained for all code blocks, and unload the host code DLLs
+//
+void HostCodeInvoker::ReleasePreparedBlocks()
+{
+	Threads::CriticalSection::Auto mutex(PreparedBlocksCriticalSection);
+
+	for(std::map<Extensions::CodeBlockHandle, PreparedBlock*>::iterator iter = PreparedBlocks.begin(); iter != PreparedBlocks.end(); ++iter)
+		delete iter->second;
+
+	PreparedBlocks.clear();
+
+	for(std::map<std::wstring, HMODULE>::iterator iter = LoadedLibraries.begin(); iter != LoadedLibraries.end(); ++iter)
+	{
+		if(iter->second)
+			::FreeLibrary(iter->second);
+	}
+
+	LoadedLibraries.clear();
+}
+
+
+//
+// Determine whether host code can be built in place of CUDA code
+//
+// Host code is built with the same CL compiler that NVCC is configured to
+// use; it can be switched off with the "cudahostcode" setting, in which
+// case the VM runs all code blocks itself when there is no CUDA device.
+//
+bool InitializeHostCode()
+{
+	bool enabled = true;
+	Configuration.ReadConfig(L"cudahostcode", enabled);
+
+	return (enabled && !Configuration.ReadConfig<std::wstring>(L"cl").empty());
+}
@@ -0,0 +1,60 @@
+//
+// The Epoch Language Project
+// CUDA Interoperability Library
+//
+// Wrapper class for invoking generated host code
+//
+// When the system has no CUDA device, the code generated for each block is
+// compiled for the host instead, into a DLL built by CL. Such code runs on
+// the host's processors: the iterations of a cudafor loop are divided into
+// one share per processor, and the shares are run concurrently on the
+// system thread pool, in place of the device's threads.
+//
+// Each share works on its own copy of the scalar variables, much as each
+// device does when a loop is split across several devices; the changes
+// made by all shares are merged once they have finished, with later shares
+// taking precedence. Arrays are shared by all shares, just as all threads
+// on a device share its memory.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Traverser/TraversalInterface.h"
+#include "Language Extensions/HandleTypes.h"
+
+
+//
+// Wrapper class for invoking host code
+//
+class HostCodeInvoker
+{
+// Construction
+public:
+	HostCodeInvoker(Extensions::CodeBlockHandle codehandle, HandleType activatedscopehandle);
+
+// Host execution interface
+public:
+	void Execute(size_t lowerbound, size_t upperbound);
+
+// Code block preparation and cleanup
+public:
+	struct PreparedBlock;
+
+	static void PrepareBlock(Extensions::CodeBlockHandle codehandle);
+	static bool IsBlockAvailable(Extensions::CodeBlockHandle codehandle);
+	static void ReleasePreparedBlocks();
+
+// Internal helpers
+private:
+	static PreparedBlock& GetPreparedBlock(Extensions::CodeBlockHandle codehandle);
+
+// Internal tracking
+private:
+	HandleType ActivatedScopeHandle;
+	PreparedBlock& Block;
+};
+
+
+bool InitializeHostCode();
@@ -22,6 +22,7 @@
 #include "Translation Table/AssemblyTable.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Files/BufferedWriter.h"
 
 #include "Utility/Types/IDTypes.h"
 #include "Utility/Types/IntegerTypes.h"
@@ -34,7 +35,7 @@
 
 
 // Prototypes
-namespace { bool Assemble(std::wifstream& infile, std::wofstream& outfile); }
+namespace { bool Assemble(std::wistream& infile, Files::BufferedWriter& outfile); }
 
 
 // Constants
@@ -50,69 +51,101 @@ enum AssembleSingleResult
 namespace
 {
 
+	// Set while assembling a binary whose header requests compact numbers
+	bool CompactNumbers = false;
+
+
 	//
 	// Wrapper for writing an instruction to the binary output file
 	//
-	void WriteInstruction(std::wofstream& outfile, unsigned char instructionbyte)
+	void WriteInstruction(Files::BufferedWriter& outfile, unsigned char instructionbyte)
 	{
-		outfile << static_cast<Byte>(instructionbyte);
+		outfile.WriteByte(instructionbyte);
 	}
 
 	//
 	// Wrapper for writing integer literals to the binary output file
 	//
-	void WriteLiteral(std::wofstream& outfile, UINT_PTR value)
+	// Compact binaries store seven bits of the value per byte, least
+	// significant first, with the high bit set on all but the last byte.
+	//
+	void WriteLiteral(Files::BufferedWriter& outfile, UINT_PTR value)
 	{
-		outfile << static_cast<Byte>(static_cast<unsigned char>(value & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((value >> 8) & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((value >> 16) & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((value >> 24) & 0xff));
+		if(CompactNumbers)
+		{
+			UInteger32 remaining = static_cast<UInteger32>(value);
+			while(remaining >= 0x80)
+			{
+				outfile.WriteByte(static_cast<unsigned char>((remaining & 0x7f) | 0x80));
+				remaining >>= 7;
+			}
+
+			outfile.WriteByte(static_cast<unsigned char>(remaining));
+			return;
+		}
+
+		outfile.WriteByte(static_cast<unsigned char>(value & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((value >> 8) & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((value >> 16) & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((value >> 24) & 0xff));
 	}
 
 	//
 	// Wrapper for writing real literals to the binary output file
 	//
-	void WriteLiteral(std::wofstream& outfile, Real value)
+	void WriteLiteral(Files::BufferedWriter& outfile, Real value)
 	{
 		Integer32 temp;
 		temp = *reinterpret_cast<Integer32*>(&value);
-		outfile << static_cast<Byte>(static_cast<unsigned char>(temp & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((temp >> 8) & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((temp >> 16) & 0xff));
-		outfile << static_cast<Byte>(static_cast<unsigned char>((temp >> 24) & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>(temp & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((temp >> 8) & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((temp >> 16) & 0xff));
+		outfile.WriteByte(static_cast<unsigned char>((temp >> 24) & 0xff));
 	}
 
 	//
 	// Wrapper for writing a boolean literal to the binary output file
 	//
-	void WriteLiteral(std::wofstream& outfile, bool value)
+	void WriteLiteral(Files::BufferedWriter& outfile, bool value)
+	{
+		outfile.WriteByte(value ? 1 : 0);
+	}
+
+	//
+	// Wrapper for writing narrow characters to the binary output file
+	//
+	// Assembly code only ever holds single-byte characters, so each wide
+	// character is simply truncated to its low byte.
+	//
+	void WriteCharacters(Files::BufferedWriter& outfile, const wchar_t* str, size_t length)
 	{
-		outfile << static_cast<Byte>(value ? 1 : 0);
+		for(size_t i = 0; i < length; ++i)
+			outfile.WriteByte(static_cast<unsigned char>(str[i]));
 	}
 
 	//
 	// Wrapper for writing a null-terminated string to the binary output file
 	//
-	void WriteTerminatedString(std::wofstream& outfile, const std::wstring& str)
+	void WriteTerminatedString(Files::BufferedWriter& outfile, const std::wstring& str)
 	{
-		outfile << str;
+		WriteCharacters(outfile, str.c_str(), str.length());
 		if(str[str.length() - 1] != '\0')
-			outfile << '\0';
+			outfile.WriteByte(0);
 	}
 
 	//
 	// Wrapper for writing a raw string to the binary output file
 	//
-	void WriteRawString(std::wofstream& outfile, const std::wstring& str)
+	void WriteRawString(Files::BufferedWriter& outfile, const std::wstring& str)
 	{
-		outfile.write(str.c_str(), static_cast<std::streamsize>(str.length()));
+		WriteCharacters(outfile, str.c_str(), str.length());
 	}
 
 
 	//
 	// Helper function for loading integers
 	//
-	UINT_PTR RetrieveNumber(std::wifstream& stream)
+	UINT_PTR RetrieveNumber(std::wistream& stream)
 	{
 		std::wstring opidstr;
 
@@ -137,7 +170,7 @@ namespace
 	//
 	// Helper function for loading reals
 	//
-	Real RetrieveFloat(std::wifstream& stream)
+	Real RetrieveFloat(std::wistream& stream)
 	{
 		std::wstring opidstr;
 
@@ -157,7 +190,7 @@ namespace
 	//
 	// Helper function for loading booleans
 	//
-	bool RetrieveBoolean(std::wifstream& stream)
+	bool RetrieveBoolean(std::wistream& stream)
 	{
 		std::wstring str;
 		if(!(stream >> str))
@@ -172,7 +205,7 @@ namespace
 	//
 	// Helper function for loading hex-encoded IDs
 	//
-	UINT_PTR RetrieveHexNumber(std::wifstream& stream)
+	UINT_PTR RetrieveHexNumber(std::wistream& stream)
 	{
 		std::streamsize pos = stream.tellg();
 
@@ -198,7 +231,7 @@ namespace
 	//
 	// Helper functions for loading assembly language strings
 	//
-	std::wstring RetrieveString(std::wifstream& stream)
+	std::wstring RetrieveString(std::wistream& stream)
 	{
 		std::wstring ret;
 	
@@ -208,7 +241,7 @@ namespace
 		return ret;
 	}
 
-	std::wstring RetrieveStringWithLength(std::wifstream& stream, size_t len)
+	std::wstring RetrieveStringWithLength(std::wistream& stream, size_t len)
 	{
 		std::wstring ret(L"\0", len);
 		stream.read(&ret[0], static_cast<std::streamsize>(len));
@@ -218,7 +251,7 @@ namespace
 	//
 	// Helper function for confirming that expected tokens are present
 	//
-	void ExpectToken(std::wifstream& stream, const std::wstring& token)
+	void ExpectToken(std::wistream& stream, const std::wstring& token)
 	{
 		std::streampos pos = stream.tellg();
 
@@ -237,7 +270,7 @@ namespace
 	//
 	// Actual implementation of the assembler, using our macro-based table system
 	//
-	AssembleSingleResult AssembleSingle(const std::wstring& str, std::wifstream& infile, std::wofstream& outfile)
+	AssembleSingleResult AssembleSingle(const std::wstring& str, std::wistream& infile, Files::BufferedWriter& outfile)
 	{
 	#define DEFINE_INSTRUCTION(bytecode, serializedtoken)	\
 		if(str == serializedtoken)							\
@@ -346,6 +379,10 @@ namespace
 	#define RECURSE											\
 		Assemble(infile, outfile);							\
 
+	#define FUNCTION_BODY									\
+		Assemble(infile, outfile);							\
+		Assemble(infile, outfile);							\
+
 	#define RETURN											\
 		return RECURSIVE_RETURN;							\
 
@@ -369,11 +406,11 @@ namespace
 	//
 	// Driver loop that repeatedly reads and processes instructions to assemble
 	//
-	bool Assemble(std::wifstream& infile, std::wofstream& outfile)
+	bool Assemble(std::wistream& infile, Files::BufferedWriter& outfile)
 	{
 		while(true)
 		{
-			std::wifstream::pos_type pos = infile.tellg();
+			std::wistream::pos_type pos = infile.tellg();
 			std::wstring str = RetrieveString(infile);
 
 			if(infile.eof())
@@ -400,7 +437,7 @@ namespace
 	}
 
 	
-	void CopyExtensionBlock(std::wifstream& infile, std::wofstream& outfile)
+	void CopyExtensionBlock(std::wistream& infile, Files::BufferedWriter& outfile)
 	{
 		WriteTerminatedString(outfile, RetrieveString(infile));
 		UINT_PTR bytesize = RetrieveNumber(infile);
@@ -411,37 +448,27 @@ namespace
 
 		std::vector<wchar_t> widebuffer(bytesize, L'\0');
 		infile.read(&widebuffer[0], static_cast<std::streamsize>(bytesize));
-		outfile.write(&widebuffer[0], static_cast<std::streamsize>(bytesize));
+		WriteCharacters(outfile, &widebuffer[0], bytesize);
 	}
 
 }
 
 
-//
-// Main function for assembling a code file
-//
-bool Assembler::AssembleFile(const std::wstring& inputfile, const std::wstring& outputfile)
+namespace
 {
-	std::wcout << L"Epoch Assembler Utility" << std::endl;
-	std::wcout << L"I: " << inputfile << std::endl;
-	std::wcout << L"O: " << outputfile << std::endl;
 
-	try
+	//
+	// Assemble a complete program from the given assembly source
+	//
+	void AssembleProgram(std::wistream& infile, Files::BufferedWriter& outfile)
 	{
-		std::wifstream infile(narrow(inputfile).c_str(), std::ios::in);
-
-		if(!infile)
-			throw Exception("Failed to load source file!");
-
-		std::wofstream outfile(narrow(outputfile).c_str(), std::ios::binary);
-
-		if(!outfile)
-			throw Exception("Failed to open destination file for writing!");
-
 		UINT_PTR flags = RetrieveHexNumber(infile);
 
-		outfile << Bytecode::HeaderCookie;
+		// The flags themselves are always written in the fixed width form
+		CompactNumbers = false;
+		outfile.Write(Bytecode::HeaderCookie, strlen(Bytecode::HeaderCookie));
 		WriteLiteral(outfile, flags);
+		CompactNumbers = ((flags & Bytecode::Flags::CompactNumbers) != 0);
 		
 		UINT_PTR numextensions = RetrieveNumber(infile);
 		WriteLiteral(outfile, numextensions);
@@ -468,13 +495,101 @@ bool Assembler::AssembleFile(const std::wstring& inputfile, const std::wstring&
 		WriteLiteral(outfile, numextdatablocks);
 		for(UINT_PTR i = 0; i < numextdatablocks; ++i)
 			CopyExtensionBlock(infile, outfile);
+	}
+
+	//
+	// Open the destination binary and assemble the given source into it
+	//
+	bool AssembleToFile(std::wistream& infile, const std::wstring& outputfile)
+	{
+		try
+		{
+			{
+				Files::BufferedWriter outfile(narrow(outputfile).c_str());
+				AssembleProgram(infile, outfile);
+				outfile.Flush();
+			}
+
+			std::wcout << L"Successfully assembled.\n" << std::endl;
+			return true;
+		}
+		catch(std::exception& err)
+		{
+			::DeleteFile(outputfile.c_str());
+
+			std::wcout << L"ERROR - " << err.what() << std::endl;
+			std::wcout << L"ASSEMBLY FAILED!\n" << std::endl;
+			return false;
+		}
+	}
+
+}
+
+
+//
+// Main function for assembling a code file
+//
+bool Assembler::AssembleFile(const std::wstring& inputfile, const std::wstring& outputfile)
+{
+	std::wcout << L"Epoch Assembler Utility" << std::endl;
+	std::wcout << L"I: " << inputfile << std::endl;
+	std::wcout << L"O: " << outputfile << std::endl;
+
+	std::wifstream infile(narrow(inputfile).c_str(), std::ios::in);
+	if(!infile)
+	{
+		std::wcout << L"ERROR - Failed to load source file!" << std::endl;
+		std::wcout << L"ASSEMBLY FAILED!\n" << std::endl;
+		return false;
+	}
+
+	return AssembleToFile(infile, outputfile);
+}
+
+//
+// Assemble code held in memory, such as the output of the serializer
+//
+// This allows a program to be compiled straight to a binary without
+// writing its assembly code out to disk and reading it back in again.
+//
+bool Assembler::AssembleBuffer(const wchar_t* assembly, size_t length, const std::wstring& outputfile)
+{
+	std::wcout << L"Epoch Assembler Utility" << std::endl;
+	std::wcout << L"I: (memory)" << std::endl;
+	std::wcout << L"O: " << outputfile << std::endl;
+
+	std::wistringstream infile(std::wstring(assembly, length));
+	return AssembleToFile(infile, outputfile);
+}
+
+//
+// Assemble code held in memory into a binary which is also held in memory
+//
+// Together with the memory-based serializer this lets a build go from
+// source code to bytecode without any intermediate files on disk.
+//
+bool Assembler::AssembleToMemory(const wchar_t* assembly, size_t length, std::vector<unsigned char>& binary)
+{
+	std::wcout << L"Epoch Assembler Utility" << std::endl;
+	std::wcout << L"I: (memory)" << std::endl;
+	std::wcout << L"O: (memory)" << std::endl;
+
+	binary.clear();
+
+	try
+	{
+		std::wistringstream infile(std::wstring(assembly, length));
+
+		Files::BufferedWriter outfile(binary);
+		AssembleProgram(infile, outfile);
+		outfile.Flush();
 
 		std::wcout << L"Successfully assembled.\n" << std::endl;
 		return true;
 	}
 	catch(std::exception& err)
 	{
-		::DeleteFile(outputfile.c_str());
+		binary.clear();
 
 		std::wcout << L"ERROR - " << err.what() << std::endl;
 		std::wcout << L"ASSEMBLY FAILED!\n" << std::endl;
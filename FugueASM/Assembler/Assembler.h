@@ -11,4 +11,6 @@
 namespace Assembler
 {
 	bool AssembleFile(const std::wstring& inputfile, const std::wstring& outputfile);
+	bool AssembleBuffer(const wchar_t* assembly, size_t length, const std::wstring& outputfile);
+	bool AssembleToMemory(const wchar_t* assembly, size_t length, std::vector<unsigned char>& binary);
 }
@@ -14,6 +14,11 @@
 
 
 
+// Callbacks used to hand results held in memory back to the caller
+typedef bool (__stdcall *BinaryCallback)(const unsigned char* binary, size_t size, void* userdata);
+typedef bool (__stdcall *AssemblyCallback)(const wchar_t* assembly, size_t length, void* userdata);
+
+
 //
 // Assemble the file requested by the user
 //
@@ -22,6 +27,29 @@ bool __stdcall DoAssemble(const char* inputfilename, const char* outputfilename)
 	return Assembler::AssembleFile(widen(inputfilename), widen(outputfilename));
 }
 
+//
+// Assemble code held in memory into the requested binary file
+//
+bool __stdcall DoAssembleBuffer(const wchar_t* assembly, size_t length, const char* outputfilename)
+{
+	return Assembler::AssembleBuffer(assembly, length, widen(outputfilename));
+}
+
+//
+// Assemble code held in memory, and hand the resulting binary to the given callback
+//
+// The binary is only valid for the duration of the callback. The
+// callback's result is returned as the overall result.
+//
+bool __stdcall DoAssembleToMemory(const wchar_t* assembly, size_t length, BinaryCallback callback, void* userdata)
+{
+	std::vector<unsigned char> binary;
+	if(!Assembler::AssembleToMemory(assembly, length, binary))
+		return false;
+
+	return callback(binary.empty() ? NULL : &binary[0], binary.size(), userdata);
+}
+
 //
 // Disassemble the file requested by the user
 //
@@ -29,3 +57,28 @@ bool __stdcall DoDisassemble(const char* inputfilename, const char* outputfilena
 {
 	return Disassembler::DisassembleFile(widen(inputfilename), widen(outputfilename));
 }
+
+//
+// Disassemble the file requested by the user, translating functions on multiple threads
+//
+bool __stdcall DoDisassembleParallel(const char* inputfilename, const char* outputfilename)
+{
+	return Disassembler::DisassembleFile(widen(inputfilename), widen(outputfilename), true);
+}
+
+//
+// Disassemble a binary held in memory, and hand the resulting code to the given callback
+//
+// The code is only valid for the duration of the callback, and is in the
+// same form accepted by DoAssembleToMemory. The callback's result is
+// returned as the overall result.
+//
+bool __stdcall DoDisassembleBuffer(const void* binary, size_t size, bool parallel, AssemblyCallback callback, void* userdata)
+{
+	std::string assembly;
+	if(!Disassembler::DisassembleBuffer(binary, size, assembly, parallel))
+		return false;
+
+	std::wstring wideassembly(widen(assembly));
+	return callback(wideassembly.c_str(), wideassembly.length(), userdata);
+}
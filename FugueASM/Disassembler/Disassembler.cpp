@@ -16,15 +16,21 @@
 #include "Serialization/SerializationTokens.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Files/BufferedWriter.h"
 
 #include <fstream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 
 
 
 // Prototypes
-namespace { bool Disassemble(std::ifstream& infile, std::ofstream& outfile); }
+namespace
+{
+	bool Disassemble(std::istream& infile, std::ostream& outfile);
+	void DisassembleFunctionBody(std::istream& infile, std::ostream& outfile);
+}
 
 // Constants
 enum DisassembleSingleResult
@@ -39,17 +45,79 @@ enum DisassembleSingleResult
 namespace
 {
 
+	// Set while disassembling a binary whose header requests compact numbers
+	bool CompactNumbers = false;
+
+
+	//
+	// Read-only stream buffer over a block of memory
+	//
+	// Positions reported by the stream are offsets from the start of the
+	// whole block, even when reading is confined to a smaller range; this
+	// keeps the locations quoted in error messages meaningful when only a
+	// single function body is being read.
+	//
+	class MemoryStreamBuffer : public std::streambuf
+	{
+	public:
+		MemoryStreamBuffer(const char* data, size_t begin, size_t end)
+		{
+			char* base = const_cast<char*>(data);
+			setg(base, base + begin, base + end);
+		}
+
+	protected:
+		virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode)
+		{
+			char* target;
+			if(direction == std::ios_base::beg)
+				target = eback() + offset;
+			else if(direction == std::ios_base::cur)
+				target = gptr() + offset;
+			else
+				target = egptr() + offset;
+
+			if(target < eback() || target > egptr())
+				return pos_type(off_type(-1));
+
+			setg(eback(), target, egptr());
+			return pos_type(target - eback());
+		}
+
+		virtual pos_type seekpos(pos_type position, std::ios_base::openmode which)
+		{
+			return seekoff(off_type(position), std::ios_base::beg, which);
+		}
+	};
+
+
+	//
+	// Function body which is disassembled separately from the rest of the program
+	//
+	struct FunctionChunk
+	{
+		size_t Begin;
+		size_t End;
+		std::string::size_type OutputPosition;
+		std::string Output;
+		std::string ErrorMessage;
+	};
+
+	// Set while scanning a program for function bodies to disassemble in parallel
+	std::vector<FunctionChunk>* PendingChunks = NULL;
+
+
 	//
 	// Write a string to the output file
 	//
-	void WriteString(std::ofstream& outfile, const std::wstring& str)
+	void WriteString(std::ostream& outfile, const std::wstring& str)
 	{
 		std::string raw = narrow(str);
 		raw = raw.substr(0, raw.find('\0'));
 		outfile << raw;
 	}
 
-	void WriteString(std::ofstream& outfile, const std::string& str)
+	void WriteString(std::ostream& outfile, const std::string& str)
 	{
 		outfile.write(str.c_str(), static_cast<std::streamsize>(str.length()));
 	}
@@ -57,7 +125,7 @@ namespace
 	//
 	// Write a hex-encoded number to the output file
 	//
-	void WriteHexNumber(std::ofstream& outfile, UINT_PTR value)
+	void WriteHexNumber(std::ostream& outfile, UINT_PTR value)
 	{
 		outfile << std::hex << std::uppercase << std::setfill('0') << std::setw(sizeof(value) * 2);
 		outfile << value;
@@ -66,13 +134,13 @@ namespace
 	//
 	// Write a number to the output file
 	//
-	void WriteNumber(std::ofstream& outfile, UINT_PTR value)
+	void WriteNumber(std::ostream& outfile, UINT_PTR value)
 	{
 		outfile << std::dec << std::setw(0);
 		outfile << static_cast<Integer32>(value);
 	}
 
-	void WriteNumber(std::ofstream& outfile, Real value)
+	void WriteNumber(std::ostream& outfile, Real value)
 	{
 		outfile << std::dec << std::setw(0);
 		outfile << value;
@@ -81,7 +149,7 @@ namespace
 	//
 	// Write a boolean constant to the output file
 	//
-	void WriteFlag(std::ofstream& outfile, bool value)
+	void WriteFlag(std::ostream& outfile, bool value)
 	{
 		outfile << narrow(value ? Serialization::True : Serialization::False);
 	}
@@ -89,7 +157,7 @@ namespace
 	//
 	// Write a newline to the output file
 	//
-	void WriteNewline(std::ofstream& outfile)
+	void WriteNewline(std::ostream& outfile)
 	{
 		outfile << std::endl;		// This does double duty - we get the needed newline, plus a buffer flush
 	}
@@ -97,7 +165,7 @@ namespace
 	//
 	// Write a space to the output file
 	//
-	void WriteSpace(std::ofstream& outfile)
+	void WriteSpace(std::ostream& outfile)
 	{
 		outfile << " ";
 	}
@@ -106,8 +174,26 @@ namespace
 	//
 	// Helper function for reading a multi-byte encoded number from the source file
 	//
-	UINT_PTR RetrieveNumber(std::ifstream& infile)
+	UINT_PTR RetrieveNumber(std::istream& infile)
 	{
+		if(CompactNumbers)
+		{
+			UInteger32 value = 0;
+			for(unsigned shift = 0; ; shift += 7)
+			{
+				if(shift > 28)
+					throw Exception("Compact number is longer than 32 bits!");
+
+				char byte = 0;
+				infile.read(&byte, 1);
+				value |= static_cast<UInteger32>(static_cast<unsigned char>(byte) & 0x7f) << shift;
+				if(!(byte & 0x80))
+					break;
+			}
+
+			return static_cast<UINT_PTR>(value);
+		}
+
 		UINT_PTR ret;
 		infile.read(reinterpret_cast<Byte*>(&ret), sizeof(ret));
 		return ret;
@@ -116,7 +202,7 @@ namespace
 	//
 	// Helper function for reading a float from the source file
 	//
-	Real RetrieveReal(std::ifstream& infile)
+	Real RetrieveReal(std::istream& infile)
 	{
 		Real ret;
 		infile.read(reinterpret_cast<Byte*>(&ret), sizeof(ret));
@@ -126,7 +212,7 @@ namespace
 	//
 	// Helper function for reading a boolean flag
 	//
-	bool RetrieveFlag(std::ifstream& infile)
+	bool RetrieveFlag(std::istream& infile)
 	{
 		bool ret;
 		infile.read(reinterpret_cast<Byte*>(&ret), 1);
@@ -136,7 +222,7 @@ namespace
 	//
 	// Helper function for reading a null-terminated string
 	//
-	std::string RetrieveNullTerminatedString(std::ifstream& infile)
+	std::string RetrieveNullTerminatedString(std::istream& infile)
 	{
 		std::string str;
 		while(true)
@@ -155,7 +241,7 @@ namespace
 	//
 	// Helper function for reading a string given its expected length
 	//
-	std::string RetrieveStringByLength(std::ifstream& infile, size_t len)
+	std::string RetrieveStringByLength(std::istream& infile, size_t len)
 	{
 		std::string str("\0", len);
 		infile.read(&str[0], static_cast<std::streamsize>(len));
@@ -165,7 +251,7 @@ namespace
 	//
 	// Helper function for reading a single-byte instruction from the source file
 	//
-	unsigned char RetrieveInstruction(std::ifstream& infile)
+	unsigned char RetrieveInstruction(std::istream& infile)
 	{
 		char ret = 0;
 		infile.read(&ret, 1);
@@ -176,7 +262,7 @@ namespace
 	// Retrieve the next instruction from the input file, and ensure that
 	// it matches our expectations. If not, an exception is thrown.
 	//
-	void ExpectInstruction(std::ifstream& infile, unsigned char instruction)
+	void ExpectInstruction(std::istream& infile, unsigned char instruction)
 	{
 		unsigned char retrieved = RetrieveInstruction(infile);
 		if(retrieved != instruction)
@@ -197,7 +283,7 @@ namespace
 	// effectively remain stateless, and only needs to do input-output
 	// translation of instructions without "understanding" their context.
 	//
-	DisassembleSingleResult DisassembleSingle(unsigned char instruction, std::ifstream& infile, std::ofstream& outfile)
+	DisassembleSingleResult DisassembleSingle(unsigned char instruction, std::istream& infile, std::ostream& outfile)
 	{
 
 	#define DEFINE_INSTRUCTION(bytecode, serializedtoken)	\
@@ -314,6 +400,9 @@ namespace
 	#define RECURSE											\
 		Disassemble(infile, outfile);						\
 
+	#define FUNCTION_BODY									\
+		DisassembleFunctionBody(infile, outfile);			\
+
 	#define RETURN											\
 		return RECURSIVE_RETURN;							\
 
@@ -340,7 +429,7 @@ namespace
 	// traversing the bytecode and converting operations back into
 	// the original EpochASM instructions.
 	//
-	bool Disassemble(std::ifstream& infile, std::ofstream& outfile)
+	bool Disassemble(std::istream& infile, std::ostream& outfile)
 	{
 		// Disassemble instructions until we run out
 		while(true)
@@ -367,42 +456,153 @@ namespace
 		}
 	}
 
-	void CopyExtensionBlock(std::ifstream& infile, std::ofstream& outfile)
+	//
+	// Disassemble the local scope and code block of a function
+	//
+	// When a program is being scanned for parallel disassembly, the body
+	// is only decoded far enough to find where it ends, and its location
+	// is queued so that a worker thread can produce the actual text later.
+	// Any functions nested inside the body are handled by that worker.
+	//
+	void DisassembleFunctionBody(std::istream& infile, std::ostream& outfile)
 	{
-		outfile << RetrieveNullTerminatedString(infile) << " ";
-		UINT_PTR bytesize = RetrieveNumber(infile);
-		outfile << bytesize << "\n";
+		if(!PendingChunks)
+		{
+			Disassemble(infile, outfile);
+			Disassemble(infile, outfile);
+			return;
+		}
 
-		std::vector<Byte> buffer(bytesize + 1, '0');
-		infile.read(&buffer[0], static_cast<std::streamsize>(bytesize));
-		outfile.write(&buffer[0], static_cast<std::streamsize>(bytesize));
+		std::vector<FunctionChunk>* chunks = PendingChunks;
+		PendingChunks = NULL;
+
+		FunctionChunk chunk;
+		chunk.Begin = static_cast<size_t>(infile.tellg());
+		chunk.OutputPosition = static_cast<std::string::size_type>(outfile.tellp());
+
+		try
+		{
+			// A stream without a buffer discards everything, without formatting it
+			std::ostream discard(NULL);
+			Disassemble(infile, discard);
+			Disassemble(infile, discard);
+		}
+		catch(...)
+		{
+			PendingChunks = chunks;
+			throw;
+		}
+
+		chunk.End = static_cast<size_t>(infile.tellg());
+		chunks->push_back(chunk);
+		PendingChunks = chunks;
 	}
 
-}
 
+	//
+	// Shared state for the threads disassembling function bodies
+	//
+	struct ChunkWorkerState
+	{
+		const char* Data;
+		std::vector<FunctionChunk>* Chunks;
+		volatile LONG NextChunk;
+	};
 
-//
-// Main function for disassembling a binary code file
-//
-bool Disassembler::DisassembleFile(const std::wstring& inputfile, const std::wstring& outputfile)
-{
-	std::wcout << L"Epoch Disassembler Utility" << std::endl;
-	std::wcout << L"I: " << inputfile << std::endl;
-	std::wcout << L"O: " << outputfile << std::endl;
+	//
+	// Worker thread which disassembles function bodies until none remain
+	//
+	DWORD WINAPI ChunkWorkerThread(LPVOID param)
+	{
+		ChunkWorkerState* state = reinterpret_cast<ChunkWorkerState*>(param);
 
-	try
+		while(true)
+		{
+			LONG index = ::InterlockedIncrement(&state->NextChunk) - 1;
+			if(index >= static_cast<LONG>(state->Chunks->size()))
+				return 0;
+
+			FunctionChunk& chunk = (*state->Chunks)[index];
+			try
+			{
+				MemoryStreamBuffer buffer(state->Data, chunk.Begin, chunk.End);
+				std::istream infile(&buffer);
+
+				// Numbers are written as they would be part way into the file
+				std::ostringstream outfile;
+				outfile << std::uppercase << std::setfill('0');
+
+				Disassemble(infile, outfile);
+				Disassemble(infile, outfile);
+				chunk.Output = outfile.str();
+			}
+			catch(std::exception& e)
+			{
+				chunk.ErrorMessage = e.what();
+			}
+			catch(...)
+			{
+				chunk.ErrorMessage = "Unknown error while disassembling function body";
+			}
+		}
+	}
+
+	//
+	// Disassemble all of the queued function bodies on as many threads as there are processors
+	//
+	void DisassembleChunks(const char* data, std::vector<FunctionChunk>& chunks)
 	{
-		// We do not use wide streams here because we have to do a lot of single-byte operations
-		std::ifstream infile(narrow(inputfile).c_str(), std::ios::binary);
+		ChunkWorkerState state;
+		state.Data = data;
+		state.Chunks = &chunks;
+		state.NextChunk = 0;
+
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+		size_t numthreads = std::min(static_cast<size_t>(info.dwNumberOfProcessors), chunks.size());
+
+		// The calling thread also does its share of the work
+		std::vector<HANDLE> threads;
+		for(size_t i = 1; i < numthreads; ++i)
+		{
+			HANDLE thread = ::CreateThread(NULL, 0, ChunkWorkerThread, &state, 0, NULL);
+			if(thread)
+				threads.push_back(thread);
+		}
 
-		if(!infile)
-			throw FileException("Could not open input file!");
+		ChunkWorkerThread(&state);
 
-		std::ofstream outfile(narrow(outputfile).c_str());
+		for(std::vector<HANDLE>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+		{
+			::WaitForSingleObject(*iter, INFINITE);
+			::CloseHandle(*iter);
+		}
 
-		if(!outfile)
-			throw FileException("Could not open output file!");
+		for(std::vector<FunctionChunk>::const_iterator iter = chunks.begin(); iter != chunks.end(); ++iter)
+		{
+			if(!iter->ErrorMessage.empty())
+				throw Exception(iter->ErrorMessage);
+		}
+	}
+
+
+	void CopyExtensionBlock(std::istream& infile, std::ostream& outfile)
+	{
+		outfile << RetrieveNullTerminatedString(infile) << " ";
+		UINT_PTR bytesize = RetrieveNumber(infile);
+		outfile << bytesize << "\n";
 
+		std::vector<Byte> buffer(bytesize + 1, '0');
+		infile.read(&buffer[0], static_cast<std::streamsize>(bytesize));
+		outfile.write(&buffer[0], static_cast<std::streamsize>(bytesize));
+	}
+
+
+	//
+	// Translate an entire binary program into assembly code
+	//
+	void DisassembleProgram(std::istream& infile, std::ostream& outfile)
+	{
 		// Validate cookie
 		char cookie[10] = {0,};
 		if(strlen(Bytecode::HeaderCookie) >= sizeof(cookie))
@@ -411,7 +611,12 @@ bool Disassembler::DisassembleFile(const std::wstring& inputfile, const std::wst
 		if(memcmp(cookie, Bytecode::HeaderCookie, strlen(Bytecode::HeaderCookie)) != 0)
 			throw Exception("Input file is missing header cookie!");
 
-		WriteHexNumber(outfile, RetrieveNumber(infile));
+		// The flags themselves are always stored in the fixed width form
+		CompactNumbers = false;
+		UINT_PTR flags = RetrieveNumber(infile);
+		CompactNumbers = ((flags & Bytecode::Flags::CompactNumbers) != 0);
+
+		WriteHexNumber(outfile, flags);
 		WriteNewline(outfile);
 
 		UINT_PTR extensioncount = RetrieveNumber(infile);
@@ -442,6 +647,141 @@ bool Disassembler::DisassembleFile(const std::wstring& inputfile, const std::wst
 		WriteNewline(outfile);
 		for(UINT_PTR i = 0; i < extensiondatacount; ++i)
 			CopyExtensionBlock(infile, outfile);
+	}
+
+	//
+	// Disassemble a file in a single pass through the input stream
+	//
+	void DisassembleSequential(const std::wstring& inputfile, const std::wstring& outputfile)
+	{
+		// We do not use wide streams here because we have to do a lot of single-byte operations
+		// Both streams get large buffers, since nearly every access is a single byte
+		std::vector<char> inbuffer(Files::OutputBufferSize);
+		std::ifstream infile;
+		infile.rdbuf()->pubsetbuf(&inbuffer[0], static_cast<std::streamsize>(inbuffer.size()));
+		infile.open(narrow(inputfile).c_str(), std::ios::binary);
+
+		if(!infile)
+			throw FileException("Could not open input file!");
+
+		std::vector<char> outbuffer(Files::OutputBufferSize);
+		std::ofstream outfile;
+		outfile.rdbuf()->pubsetbuf(&outbuffer[0], static_cast<std::streamsize>(outbuffer.size()));
+		outfile.open(narrow(outputfile).c_str());
+
+		if(!outfile)
+			throw FileException("Could not open output file!");
+
+		DisassembleProgram(infile, outfile);
+	}
+
+	//
+	// Disassemble a program held in memory in a single pass
+	//
+	std::string DisassembleSequential(const char* data, size_t size)
+	{
+		MemoryStreamBuffer buffer(data, 0, size);
+		std::istream infile(&buffer);
+
+		std::ostringstream outfile;
+		DisassembleProgram(infile, outfile);
+		return outfile.str();
+	}
+
+	//
+	// Disassemble a program held in memory, translating function bodies on multiple threads
+	//
+	// The program is scanned once to produce the text of everything outside
+	// of function bodies. The bodies found during the scan are translated
+	// independently, and their text is spliced back in at the recorded
+	// positions, so the output is exactly the same as that of a sequential
+	// disassembly.
+	//
+	std::string DisassembleParallel(const char* data, size_t size)
+	{
+		std::ostringstream skeleton;
+		std::vector<FunctionChunk> chunks;
+		{
+			MemoryStreamBuffer buffer(data, 0, size);
+			std::istream memorystream(&buffer);
+
+			PendingChunks = &chunks;
+			try
+			{
+				DisassembleProgram(memorystream, skeleton);
+			}
+			catch(...)
+			{
+				PendingChunks = NULL;
+				throw;
+			}
+			PendingChunks = NULL;
+		}
+
+		DisassembleChunks(data, chunks);
+
+		std::string text = skeleton.str();
+		std::string output;
+		output.reserve(text.length() + chunks.size() * 64);
+
+		std::string::size_type position = 0;
+		for(std::vector<FunctionChunk>::const_iterator iter = chunks.begin(); iter != chunks.end(); ++iter)
+		{
+			output.append(text, position, iter->OutputPosition - position);
+			output.append(iter->Output);
+			position = iter->OutputPosition;
+		}
+		output.append(text, position, std::string::npos);
+
+		return output;
+	}
+
+	//
+	// Disassemble a file, translating function bodies on multiple threads
+	//
+	// The whole file is read into memory first, so that the worker threads
+	// can each read their own function bodies from it.
+	//
+	void DisassembleParallel(const std::wstring& inputfile, const std::wstring& outputfile)
+	{
+		std::ifstream infile(narrow(inputfile).c_str(), std::ios::binary);
+		if(!infile)
+			throw FileException("Could not open input file!");
+
+		infile.seekg(0, std::ios::end);
+		std::vector<char> data(static_cast<size_t>(infile.tellg()) + 1, 0);
+		infile.seekg(0, std::ios::beg);
+		infile.read(&data[0], static_cast<std::streamsize>(data.size() - 1));
+		infile.close();
+
+		std::string text = DisassembleParallel(&data[0], data.size() - 1);
+
+		// Text mode is used just as for sequential output, so line endings match
+		std::ofstream outfile(narrow(outputfile).c_str());
+		if(!outfile)
+			throw FileException("Could not open output file!");
+
+		outfile.write(text.data(), static_cast<std::streamsize>(text.length()));
+	}
+
+}
+
+
+//
+// Main function for disassembling a binary code file
+//
+bool Disassembler::DisassembleFile(const std::wstring& inputfile, const std::wstring& outputfile, bool parallel)
+{
+	std::wcout << L"Epoch Disassembler Utility" << std::endl;
+	std::wcout << L"I: " << inputfile << std::endl;
+	std::wcout << L"O: " << outputfile << std::endl;
+
+	try
+	{
+		if(parallel)
+			DisassembleParallel(inputfile, outputfile);
+		else
+			DisassembleSequential(inputfile, outputfile);
 
 		std::wcout << L"Successfully disassembled.\n" << std::endl;
 		return true;
@@ -456,3 +796,36 @@ bool Disassembler::DisassembleFile(const std::wstring& inputfile, const std::wst
 	}
 }
 
+//
+// Disassemble a binary program held in memory
+//
+// The assembly code is produced in memory as well, with each line ending
+// in a single newline character.
+//
+bool Disassembler::DisassembleBuffer(const void* binary, size_t size, std::string& assembly, bool parallel)
+{
+	std::wcout << L"Epoch Disassembler Utility" << std::endl;
+	std::wcout << L"I: (memory)" << std::endl;
+	std::wcout << L"O: (memory)" << std::endl;
+
+	try
+	{
+		const char* data = reinterpret_cast<const char*>(binary);
+		if(parallel)
+			assembly = DisassembleParallel(data, size);
+		else
+			assembly = DisassembleSequential(data, size);
+
+		std::wcout << L"Successfully disassembled.\n" << std::endl;
+		return true;
+	}
+	catch(std::exception& err)
+	{
+		assembly.clear();
+
+		std::wcout << L"ERROR - " << err.what() << std::endl;
+		std::wcout << L"DISASSEMBLY FAILED!\n" << std::endl;
+		return false;
+	}
+}
+
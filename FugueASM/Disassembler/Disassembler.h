@@ -10,6 +10,7 @@
 
 namespace Disassembler
 {
-	bool DisassembleFile(const std::wstring& inputfile, const std::wstring& outputfile);
+	bool DisassembleFile(const std::wstring& inputfile, const std::wstring& outputfile, bool parallel = false);
+	bool DisassembleBuffer(const void* binary, size_t size, std::string& assembly, bool parallel = false);
 }
 
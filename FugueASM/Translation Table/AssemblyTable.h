@@ -151,8 +151,7 @@ DEFINE_INSTRUCTION(Bytecode::Functions, Serialization::Functions)											\
 				READ_HEX(innerscopeid)																		\
 				EXPECT(Bytecode::Scope, Serialization::Scope)												\
 				WRITE_HEX(innerscopeid)																		\
-				RECURSE																						\
-				RECURSE																						\
+				FUNCTION_BODY																				\
 			ELSE																							\
 				READ_HEX(scopeid)																			\
 				RECURSE																						\
@@ -169,8 +168,7 @@ DEFINE_INSTRUCTION(Bytecode::Functions, Serialization::Functions)											\
 				SPACE																						\
 				WRITE_STRING(Serialization::Scope)															\
 				NEWLINE																						\
-				RECURSE																						\
-				RECURSE																						\
+				FUNCTION_BODY																				\
 			END_IF																							\
 		END_IF																								\
 	ENDLOOP																									\
@@ -221,6 +219,12 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::PushOperation, Serialization::PushOperati
 	SPACE																									\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::TypedPushOperation, Serialization::TypedPushOperation)				\
+	SPACE																									\
+	COPY_UINT(type)																							\
+	SPACE																									\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::PushIntegerLiteral, Serialization::PushIntegerLiteral) 				\
 	PARAM_UINT(literalvalue)																				\
 END_INSTRUCTION																								\
@@ -242,6 +246,10 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::GetValue, Serialization::GetValue)
 	PARAM_STR(varname)																						\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::MoveValue, Serialization::MoveValue)									\
+	PARAM_STR(varname)																						\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::BindFunctionReference, Serialization::BindFunctionReference)			\
 	PARAM_STR(funcname)																						\
 END_INSTRUCTION																								\
@@ -684,6 +692,22 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Concat, Serialization::Concat)										\
 	NEWLINE																									\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::FindString, Serialization::FindString)								\
+	NEWLINE																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::StringStartsWith, Serialization::StringStartsWith)					\
+	NEWLINE																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::CompareStrings, Serialization::CompareStrings)						\
+	NEWLINE																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SplitString, Serialization::SplitString)								\
+	NEWLINE																									\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::IsGreaterEqual, Serialization::IsGreaterEqual)						\
 	PARAM_UINT(type)																						\
 END_INSTRUCTION																								\
@@ -979,6 +1003,26 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::AcceptMessageFromMap, Serialization::Acce
 	PARAM_STR(handlermapid)																					\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::DelayedSendTaskMessage, Serialization::DelayedSendTaskMessage)		\
+	SPACE																									\
+	COPY_BOOL(explicittaskname)																				\
+	SPACE																									\
+	COPY_BOOL(periodic)																						\
+	SPACE																									\
+	COPY_STR(messagename)																					\
+	SPACE																									\
+	COPY_UINT(signaturecount)																				\
+	NEWLINE																									\
+	LOOP(signaturecount)																					\
+		COPY_UINT(type)																						\
+		NEWLINE																								\
+	ENDLOOP																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::AcceptMessageWithTimeout, Serialization::AcceptMessageWithTimeout)	\
+	PARAM_STR(handlermapid)																					\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SendTaskMessage, Serialization::SendTaskMessage)						\
 	SPACE																									\
 	COPY_BOOL(explicittaskname)																				\
@@ -993,6 +1037,40 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SendTaskMessage, Serialization::SendTaskM
 	ENDLOOP																									\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::BroadcastTaskMessage, Serialization::BroadcastTaskMessage)			\
+	SPACE																									\
+	COPY_STR(messagename)																					\
+	SPACE																									\
+	COPY_UINT(signaturecount)																				\
+	NEWLINE																									\
+	LOOP(signaturecount)																					\
+		COPY_UINT(type)																						\
+		NEWLINE																								\
+	ENDLOOP																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SendTaskRequest, Serialization::SendTaskRequest)						\
+	SPACE																									\
+	COPY_STR(futurename)																					\
+	SPACE																									\
+	COPY_STR(messagename)																					\
+	SPACE																									\
+	COPY_UINT(signaturecount)																				\
+	NEWLINE																									\
+	LOOP(signaturecount)																					\
+		COPY_UINT(type)																						\
+		NEWLINE																								\
+	ENDLOOP																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ReplyToRequest, Serialization::ReplyToRequest)						\
+	PARAM_UINT(type)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::PendingReply, Serialization::PendingReply)							\
+	PARAM_UINT(type)																						\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::TypeCast, Serialization::TypeCast)									\
 	SPACE																									\
 	COPY_UINT(origintype)																					\
@@ -1048,6 +1126,22 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Future, Serialization::ForkFuture)
     NEWLINE																									\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::DependentFuture, Serialization::ForkDependentFuture)					\
+	SPACE																									\
+	COPY_STR(futurename)																					\
+	SPACE																									\
+	COPY_UINT(futuretype)																					\
+	SPACE																									\
+	COPY_BOOL(waitforany)																					\
+	SPACE																									\
+	COPY_UINT(count)																						\
+	NEWLINE																									\
+	LOOP(count)																								\
+		COPY_STR(dependencyname)																			\
+		NEWLINE																								\
+	ENDLOOP																									\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Map, Serialization::Map)												\
 	SPACE																									\
 	COPY_INSTRUCTION																						\
@@ -1058,6 +1152,16 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Reduce, Serialization::Reduce)										\
 	COPY_INSTRUCTION																						\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::MapGenerator, Serialization::MapGenerator)							\
+	SPACE																									\
+	COPY_INSTRUCTION																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ReduceGenerator, Serialization::ReduceGenerator)						\
+	SPACE																									\
+	COPY_INSTRUCTION																						\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::IntegerLiteral, Serialization::IntegerConstant)						\
 	PARAM_UINT(value)																						\
 END_INSTRUCTION																								\
@@ -1113,10 +1217,37 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::WriteArray, Serialization::WriteArray)
 	PARAM_STR(arrayname)																					\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::AppendArray, Serialization::AppendArray)								\
+	PARAM_STR(arrayname)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ElementwiseArithmetic, Serialization::ElementwiseArithmetic)			\
+	PARAM_UINT(optype)																						\
+	PARAM_UINT(elementtype)																					\
+	PARAM_BOOL(firstisarray)																				\
+	PARAM_BOOL(secondisarray)																				\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ArrayLength, Serialization::ArrayLength)								\
 	PARAM_STR(arrayname)																					\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SortArray, Serialization::SortArray)									\
+	PARAM_STR(arrayname)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::SearchArray, Serialization::SearchArray)								\
+	PARAM_STR(arrayname)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ArrayMinIndex, Serialization::ArrayMinIndex)							\
+	PARAM_STR(arrayname)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ArrayMaxIndex, Serialization::ArrayMaxIndex)							\
+	PARAM_STR(arrayname)																					\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Length, Serialization::Length)										\
 	PARAM_STR(varname)																						\
 END_INSTRUCTION																								\
@@ -1130,8 +1261,63 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ConsArray, Serialization::ConsArray)
 	PARAM_UINT(elementcount)																				\
 END_INSTRUCTION																								\
 																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ConsMappedArray, Serialization::ConsMappedArray)						\
+	PARAM_UINT(elementtype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ConsHashMap, Serialization::ConsHashMap)								\
+	PARAM_UINT(keytype)																						\
+	PARAM_UINT(valuetype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapInsert, Serialization::HashMapInsert)							\
+	PARAM_STR(mapname)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapLookup, Serialization::HashMapLookup)							\
+	PARAM_STR(mapname)																						\
+	PARAM_UINT(valuetype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapContains, Serialization::HashMapContains)						\
+	PARAM_STR(mapname)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapErase, Serialization::HashMapErase)							\
+	PARAM_STR(mapname)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapKeys, Serialization::HashMapKeys)								\
+	PARAM_STR(mapname)																						\
+	PARAM_UINT(keytype)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HashMapSize, Serialization::HashMapSize)								\
+	PARAM_STR(mapname)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::Channel, Serialization::CreateChannel)								\
+	PARAM_UINT(elementtype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ChannelSend, Serialization::SendChannel)								\
+	PARAM_UINT(elementtype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ChannelReceive, Serialization::ReceiveChannel)						\
+	PARAM_UINT(elementtype)																					\
+END_INSTRUCTION																								\
+																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ParallelFor, Serialization::ParallelFor)								\
 	PARAM_STR(countername)																					\
+	COPY_UINT(reductioncount)																				\
+	NEWLINE																									\
+	LOOP(reductioncount)																					\
+		COPY_UINT(reductionop)																				\
+		SPACE																								\
+		COPY_STR(reductionvar)																				\
+		NEWLINE																								\
+	ENDLOOP																									\
 	EXPECT(Bytecode::BeginBlock, Serialization::BeginBlock)													\
 	NEWLINE																									\
 	IF_ASSEMBLING																							\
@@ -1147,6 +1333,49 @@ DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ParallelFor, Serialization::ParallelFor)
 	END_IF																									\
 	RECURSE																									\
 	RECURSE																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::ParallelInvoke, Serialization::ParallelInvoke)						\
+	PARAM_STR(tuplename)																					\
+	COPY_UINT(branchcount)																					\
+	NEWLINE																									\
+	LOOP(branchcount)																						\
+		COPY_UINT(opcount)																					\
+		NEWLINE																								\
+	ENDLOOP																									\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::CreateGenerator, Serialization::CreateGenerator)						\
+	PARAM_UINT(elementtype)																					\
+	PARAM_UINT(opcount)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::YieldValue, Serialization::YieldValue)								\
+	PARAM_UINT(valuetype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::GeneratorHasNext, Serialization::GeneratorHasNext)					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::GeneratorNextValue, Serialization::GeneratorNextValue)				\
+	PARAM_UINT(elementtype)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::AtomicUpdate, Serialization::AtomicUpdate)							\
+	PARAM_STR(varname)																						\
+	PARAM_UINT(optype)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::AtomicUpdateArray, Serialization::AtomicUpdateArray)					\
+	PARAM_STR(arrayname)																					\
+	PARAM_UINT(optype)																						\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::CancelFuture, Serialization::CancelFuture)							\
+	PARAM_STR(futurename)																					\
+END_INSTRUCTION																								\
+																											\
+DEFINE_ADDRESSED_INSTRUCTION(Bytecode::CancelPoolWork, Serialization::CancelPoolWork)						\
 END_INSTRUCTION																								\
 																											\
 DEFINE_ADDRESSED_INSTRUCTION(Bytecode::HandoffControl, Serialization::HandoffControl)						\
@@ -11,6 +11,7 @@
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 // Platform-specific stuff
 #ifndef _WIN32_WINNT
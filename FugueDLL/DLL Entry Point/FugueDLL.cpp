@@ -8,6 +8,7 @@
 #include "pch.h"
 
 #include "User Interface/Input.h"
+#include "User Interface/TraceLog.h"
 
 #include "Utility/Threading/Threads.h"
 
@@ -30,11 +31,18 @@ BOOL APIENTRY DllMain(HMODULE, DWORD reason, LPVOID)
 #endif
 
 		Config::LoadFromConfigFile();
+		TraceLog::Init();
 		Threads::Init();
 	}
+	else if(reason == DLL_THREAD_DETACH)
+	{
+		// Host threads which ran programs must release their tracking on the way out
+		Threads::DetachHostThread();
+	}
 	else if(reason == DLL_PROCESS_DETACH)
 	{
 		Threads::Shutdown();
+		TraceLog::Shutdown();
 	}
 	
 	return TRUE;
@@ -11,15 +11,33 @@
 #include "Parser/Parser State Machine/ParserState.h"
 
 #include "User Interface/Output.h"
+#include "User Interface/TraceLog.h"
 
 #include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/JIT/NativeImages.h"
+#include "Virtual Machine/Profiling/Profiler.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
+#include "Virtual Machine/Profiling/PrimitiveBenchmarks.h"
 #include "Virtual Machine/VMExceptions.h"
 
 #include "Validator/Validator.h"
 
+#include "Language Extensions/ExtensionTelemetry.h"
+
+#include "Optimizer/Optimizer.h"
+
 #include "Serialization/SerializationTraverser.h"
 
 #include "Bytecode/Services.h"
+#include "Bytecode/Loading.h"
+#include "Bytecode/Compression.h"
+#include "Bytecode/BytecodeExceptions.h"
+
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Tracing.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Files/Files.h"
 
 #include "Configuration/RuntimeOptions.h"
 
@@ -36,7 +54,7 @@ namespace
 		for(std::list<Validator::ValidationError>::const_iterator iter = errors.begin(); iter != errors.end(); ++iter)
 		{
 			output << L"Validation error: " << iter->ErrorText << L"\n";
-			const FileLocationInfo& location = state.DebugInfo.GetInstructionLocation(iter->Operation);
+			FileLocationInfo location = state.DebugInfo.GetInstructionLocation(iter->Operation);
 					
 			output << L"\nFile: " << location.FileName << L" Line: " << location.Line << L" Column: " << location.Column << L"\n";
 			output << std::endl;
@@ -45,6 +63,199 @@ namespace
 			output << L"\n" << std::endl;
 		}
 	}
+
+	//
+	// Dump the findings of the auto-parallelization analysis
+	//
+	void ReportParallelization(const std::list<Optimizer::ParallelizationReport>& reports, const Parser::ParserState& state)
+	{
+		UI::OutputStream output;
+
+		for(std::list<Optimizer::ParallelizationReport>::const_iterator iter = reports.begin(); iter != reports.end(); ++iter)
+		{
+			FileLocationInfo location = state.DebugInfo.GetInstructionLocation(iter->Operation);
+			output << L"Auto-parallelization: " << iter->Description << L"\n";
+			output << L"File: " << location.FileName << L" Line: " << location.Line << L" Column: " << location.Column << std::endl;
+		}
+	}
+
+	//
+	// Write out a parsed and validated program, along with any extension data
+	//
+	// If requested, constant expressions are folded before the program is
+	// written, so that programs loaded from the binary need not do it.
+	//
+	void SerializeProgram(Parser::ParserState& state, Serialization::SerializationTraverser& serializer)
+	{
+		if(Config::PreoptimizeBinaries)
+		{
+			Optimizer::OptimizationTraverser optimizer(Optimizer::OptimizationTraverser::SerializableOptimization);
+			state.GetParsedProgram()->Traverse(optimizer);
+			state.GetParsedProgram()->SetPreoptimized();
+		}
+
+		state.GetParsedProgram()->Traverse(serializer);
+		Extensions::PrepareForExecution();
+		Extensions::TraverseExtensions(serializer);
+	}
+
+
+	//
+	// Program which has been compiled once for repeated execution
+	//
+	// Programs compiled from source keep their parser state, which owns
+	// the program; programs loaded from bytecode keep a private copy of
+	// the bytecode along with the loader, since function bodies may be
+	// decoded from the bytecode on demand.
+	//
+	// The global storage and stack are set up afresh by every execution.
+	// If the global init block permits, the state it produces is captured
+	// during the first execution and simply restored from then on.
+	//
+	class CompiledProgram
+	{
+	// Construction
+	public:
+		CompiledProgram(std::auto_ptr<Parser::ParserState> state, std::vector<Byte>& sourcecode)
+			: State(state),
+			  FirstRun(true)
+		{
+			SourceCode.swap(sourcecode);
+		}
+
+		explicit CompiledProgram(std::vector<Byte>& bytecode)
+			: FirstRun(true)
+		{
+			Bytecode.swap(bytecode);
+			Program.reset(new VM::Program);
+			Loader.reset(new FileLoader(&Bytecode[0], *Program));
+			BinaryServices::PrepareLoadedProgram(*Loader, &Bytecode[0]);
+		}
+
+	// Execution
+	public:
+		void Execute()
+		{
+			VM::Program& program = *GetProgram();
+
+			bool capture = (FirstRun && program.CanSnapshotGlobalStorage());
+			if(capture)
+				program.CaptureGlobalStorageSnapshot();
+
+			FirstRun = false;
+			program.Execute();
+
+			if(capture)
+				program.RestoreGlobalStorageSnapshot(program.GetGlobalStorageSnapshot());
+		}
+
+	// Internal helpers
+	private:
+		VM::Program* GetProgram()
+		{ return State.get() ? State->GetParsedProgram() : Program.get(); }
+
+	// Internal tracking
+	private:
+		std::vector<Byte> SourceCode;
+		std::auto_ptr<Parser::ParserState> State;
+
+		std::vector<Byte> Bytecode;
+		std::auto_ptr<VM::Program> Program;
+		std::auto_ptr<FileLoader> Loader;
+
+		bool FirstRun;
+	};
+
+
+	//
+	// Tracking of compiled programs by handle
+	//
+	// Handles are never reused, so a stale handle is simply rejected.
+	//
+	std::map<HandleType, CompiledProgram*> CompiledPrograms;
+	HandleType NextCompiledProgramHandle = 1;
+	Threads::CriticalSection CompiledProgramsCriticalSection;
+
+	HandleType TrackCompiledProgram(std::auto_ptr<CompiledProgram> program)
+	{
+		Threads::CriticalSection::Auto mutex(CompiledProgramsCriticalSection);
+		HandleType handle = NextCompiledProgramHandle++;
+		CompiledPrograms[handle] = program.release();
+		return handle;
+	}
+
+	CompiledProgram* GetCompiledProgram(HandleType handle)
+	{
+		Threads::CriticalSection::Auto mutex(CompiledProgramsCriticalSection);
+		std::map<HandleType, CompiledProgram*>::const_iterator iter = CompiledPrograms.find(handle);
+		if(iter == CompiledPrograms.end())
+			throw VM::ExecutionException("Invalid compiled program handle");
+
+		return iter->second;
+	}
+
+	bool UntrackCompiledProgram(HandleType handle)
+	{
+		CompiledProgram* program;
+		{
+			Threads::CriticalSection::Auto mutex(CompiledProgramsCriticalSection);
+			std::map<HandleType, CompiledProgram*>::iterator iter = CompiledPrograms.find(handle);
+			if(iter == CompiledPrograms.end())
+				return false;
+
+			program = iter->second;
+			CompiledPrograms.erase(iter);
+		}
+
+		delete program;
+		return true;
+	}
+}
+
+
+// Callback which receives serialized assembly code held in memory
+typedef bool (__stdcall *SerializedCodeCallback)(const wchar_t* assembly, size_t length, void* userdata);
+
+// Callback which receives a native code image held in memory
+typedef bool (__stdcall *NativeImageCallback)(const UByte* image, size_t size, void* userdata);
+
+// Callback which receives the time taken by each stage of the front end
+typedef void (__stdcall *StageTimingCallback)(const wchar_t* stagename, double milliseconds, void* userdata);
+
+
+namespace
+{
+	//
+	// Helper for timing the stages of the front end, one after another
+	//
+	// Each call to Finish reports the time since the previous stage
+	// finished (or since the timer was created) to the callback. Work
+	// done between stages, such as handing over results, can be left
+	// out by calling Restart first.
+	//
+	class StageTimer
+	{
+	public:
+		StageTimer(StageTimingCallback callback, void* userdata)
+			: Callback(callback),
+			  UserData(userdata),
+			  Start(Threads::Telemetry::GetTimestamp())
+		{ }
+
+		void Restart()
+		{ Start = Threads::Telemetry::GetTimestamp(); }
+
+		void Finish(const wchar_t* stagename)
+		{
+			Callback(stagename, Threads::Telemetry::TicksToMilliseconds(Threads::Telemetry::GetTimestamp() - Start), UserData);
+			Restart();
+		}
+
+	private:
+		StageTimingCallback Callback;
+		void* UserData;
+		unsigned __int64 Start;
+	};
 }
 
 
@@ -70,15 +281,27 @@ bool __stdcall ExecuteSourceCode(const char* filename)
 		output << L"Performing static safety validations..." << std::endl;
 		Validator::ValidationTraverser walker;
 		state.GetParsedProgram()->Traverse(walker);
+		TraceLog::Flush();
 		if(!walker.IsValid())
 		{
 			ReportValidationErrors(walker.GetErrorList(), state);
 			throw VM::ExecutionException("Program failed validation.");
 		}
+		state.GetParsedProgram()->SetValidated();
+
+		Optimizer::OptimizationTraverser optimizer;
+		state.GetParsedProgram()->Traverse(optimizer);
+		ReportParallelization(optimizer.GetParallelizationReports(), state);
 
 		output << L"Executing program..." << std::endl;
 		Extensions::PrepareForExecution();
-		state.GetParsedProgram()->Execute();
+		{
+			VM::Profiler::Session profiling(*state.GetParsedProgram(), state.DebugInfo, std::string(filename) + ".profile");
+			VM::Instrumentation::Session instrumentation(&state.DebugInfo, std::string(filename) + ".instrumentation");
+			VM::MemoryAccounting::Session memoryreport(&state.DebugInfo, std::string(filename) + ".memory");
+			Threads::Tracing::Session tracing(std::string(filename) + ".trace.json");
+			state.GetParsedProgram()->Execute();
+		}
 		return true;
 	}
 	catch(const Exception& e)
@@ -110,6 +333,7 @@ bool __stdcall ExecuteBinaryFile(const char* filename)
 {
 	try
 	{
+		Threads::Tracing::Session tracing(std::string(filename) + ".trace.json");
 		return BinaryServices::ExecuteFile(filename);
 	}
 	catch(const std::exception& e)
@@ -179,11 +403,13 @@ bool __stdcall SerializeSourceCode(const char* filename, const char* outputfilen
 		output << L"Performing static safety validations..." << std::endl;
 		Validator::ValidationTraverser walker;
 		state.GetParsedProgram()->Traverse(walker);
+		TraceLog::Flush();
 		if(!walker.IsValid())
 		{
 			ReportValidationErrors(walker.GetErrorList(), state);
 			throw VM::ExecutionException("Program failed validation.");
 		}
+		state.GetParsedProgram()->SetValidated();
 
 		output << L"Compiling program..." << std::endl;
 		
@@ -191,14 +417,303 @@ bool __stdcall SerializeSourceCode(const char* filename, const char* outputfilen
 			state.GetParsedProgram()->SetUsesConsole();
 
 		Serialization::SerializationTraverser serializer(outputfilename);
-		state.GetParsedProgram()->Traverse(serializer);
-		Extensions::PrepareForExecution();
-		Extensions::TraverseExtensions(serializer);
+		SerializeProgram(state, serializer);
+		output << L"Compiled successfully!\n" << std::endl;
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+//
+// Convert raw source code into assembly language format, and hand the
+// assembly code to the given callback instead of writing it to a file
+//
+// This lets the caller feed the code straight into the assembler in
+// memory. The callback's result is returned as the overall result.
+//
+bool __stdcall SerializeSourceCodeToMemory(const char* filename, bool usesconsole, SerializedCodeCallback callback, void* userdata)
+{
+	UI::OutputStream output;
+	output << L"Fugue - Epoch Compiler" << std::endl;
+
+	try
+	{
+		Parser::ParserState state;
+		std::vector<Byte> codememorybuffer;
+
+		if(!Parser::ParseFile(filename, state, codememorybuffer))
+		{
+			output << UI::lightred << L"ERROR: " << UI::resetcolor;
+			output << L"parsing failed" << std::endl;
+			return false;
+		}
+
+		output << L"Performing static safety validations..." << std::endl;
+		Validator::ValidationTraverser walker;
+		state.GetParsedProgram()->Traverse(walker);
+		TraceLog::Flush();
+		if(!walker.IsValid())
+		{
+			ReportValidationErrors(walker.GetErrorList(), state);
+			throw VM::ExecutionException("Program failed validation.");
+		}
+		state.GetParsedProgram()->SetValidated();
+
+		output << L"Compiling program..." << std::endl;
+		
+		if(usesconsole)
+			state.GetParsedProgram()->SetUsesConsole();
+
+		std::wostringstream assembly;
+		Serialization::SerializationTraverser serializer(assembly);
+		SerializeProgram(state, serializer);
 		output << L"Compiled successfully!\n" << std::endl;
+
+		std::wstring code = assembly.str();
+		return callback(code.c_str(), code.length(), userdata);
+	}
+	catch(const std::exception& e)
+	{
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+
+//
+// Parse and validate a program from raw Epoch source code, and hold on
+// to it so that it can be executed any number of times
+//
+// The handle of the compiled program is written to the given location;
+// see ExecuteCompiledProgram and ReleaseCompiledProgram.
+//
+bool __stdcall CompileSourceCode(const char* filename, HandleType* handle)
+{
+	if(!handle)
+		return false;
+
+	UI::OutputStream output;
+
+	try
+	{
+		std::auto_ptr<Parser::ParserState> state(new Parser::ParserState);
+		std::vector<Byte> codememorybuffer;
+
+		if(!Parser::ParseFile(filename, *state, codememorybuffer))
+		{
+			output << UI::lightred << L"ERROR: " << UI::resetcolor;
+			output << L"parsing failed" << std::endl;
+			return false;
+		}
+
+		output << L"Performing static safety validations..." << std::endl;
+		Validator::ValidationTraverser walker;
+		state->GetParsedProgram()->Traverse(walker);
+		TraceLog::Flush();
+		if(!walker.IsValid())
+		{
+			ReportValidationErrors(walker.GetErrorList(), *state);
+			throw VM::ExecutionException("Program failed validation.");
+		}
+		state->GetParsedProgram()->SetValidated();
+
+		Optimizer::OptimizationTraverser optimizer;
+		state->GetParsedProgram()->Traverse(optimizer);
+		ReportParallelization(optimizer.GetParallelizationReports(), *state);
+
+		Extensions::PrepareForExecution();
+
+		*handle = TrackCompiledProgram(std::auto_ptr<CompiledProgram>(new CompiledProgram(state, codememorybuffer)));
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+//
+// Load a binary compiled Epoch program, and hold on to it so that it can
+// be executed any number of times
+//
+// The buffer is copied, and need not outlive the call.
+//
+bool __stdcall CompileBinaryBuffer(const Byte* buffer, size_t size, HandleType* handle)
+{
+	if(!buffer || !size || !handle)
+		return false;
+
+	try
+	{
+		std::vector<Byte> bytecode(buffer, buffer + size);
+		*handle = TrackCompiledProgram(std::auto_ptr<CompiledProgram>(new CompiledProgram(bytecode)));
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+//
+// Load a binary compiled Epoch program from disk, and hold on to it so
+// that it can be executed any number of times
+//
+bool __stdcall CompileBinaryFile(const char* filename, HandleType* handle)
+{
+	if(!handle)
+		return false;
+
+	try
+	{
+		std::vector<Byte> bytecode;
+		Files::Load(filename, bytecode);
+		if(bytecode.empty())
+			throw FileException("Input file is empty");
+
+		*handle = TrackCompiledProgram(std::auto_ptr<CompiledProgram>(new CompiledProgram(bytecode)));
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+//
+// Execute a program previously compiled by one of the functions above
+//
+// Only the global state and the stack are set up again; the program is
+// not parsed or loaded a second time. A compiled program must not be
+// executed by several threads at once, but separate compiled programs
+// may be executed concurrently.
+//
+bool __stdcall ExecuteCompiledProgram(HandleType handle)
+{
+	try
+	{
+		GetCompiledProgram(handle)->Execute();
 		return true;
 	}
 	catch(const std::exception& e)
 	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+	catch(...)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+		return false;
+	}
+}
+
+//
+// Release a compiled program
+//
+// The handle is no longer valid afterwards. Returns false if the handle
+// does not refer to a compiled program.
+//
+bool __stdcall ReleaseCompiledProgram(HandleType handle)
+{
+	try
+	{
+		return UntrackCompiledProgram(handle);
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+
+//
+// Compile the functions of a binary program into native code ahead of time,
+// and hand the resulting image to the given callback
+//
+// The program is loaded and optimized exactly as it is before being run,
+// so that the image can be bound to the functions of the program when it
+// is loaded from the same binary later on; see NativeImages.h. The image
+// handed to the callback is empty if no function could be compiled. The
+// callback's result is returned as the overall result.
+//
+bool __stdcall GenerateNativeImage(const char* binaryfilename, NativeImageCallback callback, void* userdata)
+{
+	try
+	{
+		std::vector<Byte> memory;
+		Files::Load(binaryfilename, memory);
+		if(memory.empty())
+			throw FileException("Input file is empty");
+
+		std::auto_ptr<VM::Program> program(new VM::Program);
+		FileLoader loader(&memory[0], *program.get());
+
+		Optimizer::OptimizationTraverser optimizer;
+		loader.GetProgram()->Traverse(optimizer);
+
+		std::vector<UByte> image;
+		VM::JIT::NativeImages::Build(optimizer.GetOptimizedFunctions(), &memory[0], memory.size(), image);
+		return callback(image.empty() ? NULL : &image[0], image.size(), userdata);
+	}
+	catch(const std::exception& e)
+	{
+		UI::OutputStream output;
 		output << UI::lightred << L"ERROR: " << UI::resetcolor;
 		output << e.what() << std::endl;
 		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
@@ -206,9 +721,281 @@ bool __stdcall SerializeSourceCode(const char* filename, const char* outputfilen
 	}
 	catch(...)
 	{
+		UI::OutputStream output;
 		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
 		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
 		return false;
 	}
 }
 
+
+//
+// Retrieve a snapshot of the concurrency statistics gathered so far
+//
+// See Utility/Threading/Telemetry.h for details of the statistics.
+//
+bool __stdcall GetConcurrencyStatistics(Threads::Telemetry::Statistics* stats)
+{
+	if(!stats)
+		return false;
+
+	try
+	{
+		*stats = Threads::Telemetry::GetStatistics();
+		return true;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+//
+// Retrieve the work done by language extensions for each of their code blocks
+//
+// Up to maxentries blocks are copied into the given buffer; the total
+// number of blocks with recorded activity is returned, so the buffer may
+// be sized by calling first with no buffer at all. See the header
+// Language Extensions/ExtensionTelemetry.h for details.
+//
+size_t __stdcall GetExtensionStatistics(Extensions::Telemetry::CodeBlockStatistics* stats, size_t maxentries)
+{
+	try
+	{
+		return Extensions::Telemetry::GetStatistics(stats, maxentries);
+	}
+	catch(...)
+	{
+		return 0;
+	}
+}
+
+//
+// Retrieve a snapshot of the memory held by each part of the VM
+//
+// See Virtual Machine/Profiling/MemoryAccounting.h for details.
+//
+bool __stdcall GetMemoryStatistics(VM::MemoryAccounting::Snapshot* snapshot)
+{
+	if(!snapshot)
+		return false;
+
+	try
+	{
+		*snapshot = VM::MemoryAccounting::GetSnapshot();
+		return true;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+
+//
+// Change one of the runtime options which may be adjusted while the VM is running
+//
+// Options are named as in the config file; boolean options take zero or
+// nonzero values. See Config::SetRuntimeOption for the available options.
+//
+bool __stdcall SetRuntimeOption(const wchar_t* name, unsigned value)
+{
+	if(!name)
+		return false;
+
+	try
+	{
+		return Config::SetRuntimeOption(name, value);
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+//
+// Retrieve the current value of one of the runtime options which may be adjusted
+//
+// The value reflects any changes made by the auto-tuning logic.
+//
+bool __stdcall GetRuntimeOption(const wchar_t* name, unsigned* value)
+{
+	if(!name || !value)
+		return false;
+
+	try
+	{
+		return Config::GetRuntimeOption(name, *value);
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+
+//
+// Run the microbenchmarks of the VM's threading and memory primitives
+//
+// Each result is handed to the callback as soon as it is measured; see
+// Virtual Machine/Profiling/PrimitiveBenchmarks.h for what is measured.
+// Benchmarks of shared structures use up to maxthreads threads, or one
+// thread per processor if zero is given.
+//
+bool __stdcall RunPrimitiveBenchmarks(unsigned maxthreads, VM::PrimitiveBenchmarks::ResultCallbackPtr callback, void* userdata)
+{
+	if(!callback)
+		return false;
+
+	try
+	{
+		VM::PrimitiveBenchmarks::RunAll(maxthreads, callback, userdata);
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		return false;
+	}
+	catch(...)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		return false;
+	}
+}
+
+
+//
+// Compile source code into assembly code exactly as SerializeSourceCodeToMemory
+// does, reporting the time taken by each stage of the front end as it goes
+//
+// The stages are the two parser passes ("pass1" and "pass2"), validation
+// ("validate"), and serialization ("serialize"). Reading the source file
+// happens before the first stage, and handing the assembly code to the
+// callback after the last one, so neither is included in any stage. This
+// is meant for measuring the front end, so failures are reported on the
+// console only.
+//
+bool __stdcall ProfileCompilation(const char* filename, StageTimingCallback stagecallback, void* stageuserdata, SerializedCodeCallback callback, void* userdata)
+{
+	if(!filename || !stagecallback || !callback)
+		return false;
+
+	UI::OutputStream output;
+
+	try
+	{
+		Parser::ParserState state;
+		std::vector<Byte> codememorybuffer;
+
+		Files::Load(filename, codememorybuffer);
+		state.SetCodeBuffer(&codememorybuffer[0]);
+		state.IndexSourceLines(codememorybuffer, filename);
+
+		StageTimer timer(stagecallback, stageuserdata);
+
+		if(!Parser::ParseMemoryPass1(state, codememorybuffer, filename))
+		{
+			TraceLog::Flush();
+			output << UI::lightred << L"ERROR: " << UI::resetcolor << L"parsing failed" << std::endl;
+			return false;
+		}
+		timer.Finish(L"pass1");
+
+		bool parsed = Parser::ParseMemoryPass2(state, codememorybuffer, filename);
+		TraceLog::Flush();
+		state.DebugInfo.Finalize();
+		if(!parsed)
+		{
+			output << UI::lightred << L"ERROR: " << UI::resetcolor << L"parsing failed" << std::endl;
+			return false;
+		}
+		timer.Finish(L"pass2");
+
+		Validator::ValidationTraverser walker;
+		state.GetParsedProgram()->Traverse(walker);
+		TraceLog::Flush();
+		if(!walker.IsValid())
+		{
+			ReportValidationErrors(walker.GetErrorList(), state);
+			return false;
+		}
+		state.GetParsedProgram()->SetValidated();
+		timer.Finish(L"validate");
+
+		std::wostringstream assembly;
+		Serialization::SerializationTraverser serializer(assembly);
+		SerializeProgram(state, serializer);
+		std::wstring code = assembly.str();
+		timer.Finish(L"serialize");
+
+		return callback(code.c_str(), code.length(), userdata);
+	}
+	catch(const std::exception& e)
+	{
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		return false;
+	}
+	catch(...)
+	{
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		return false;
+	}
+}
+
+//
+// Load a binary program exactly as ExecuteBinaryBuffer does, without running it,
+// reporting the time taken by each stage of loading
+//
+// The stages are decoding the bytecode into a program ("load", which
+// includes expanding compressed bytecode) and the optimization pass
+// which readies the program to run ("prepare"). Note that function
+// bodies whose loading is deferred are not decoded by either stage.
+//
+bool __stdcall ProfileLoading(const void* buffer, StageTimingCallback stagecallback, void* stageuserdata)
+{
+	if(!buffer || !stagecallback)
+		return false;
+
+	try
+	{
+		std::vector<Byte> decompressed;
+		std::auto_ptr<VM::Program> program(new VM::Program);
+
+		StageTimer timer(stagecallback, stageuserdata);
+
+		if(BytecodeCompression::IsCompressed(buffer))
+		{
+			BytecodeCompression::Decompress(buffer, decompressed);
+			if(decompressed.empty())
+				throw InvalidBytecodeException("Compressed bytecode is empty");
+			buffer = &decompressed[0];
+		}
+
+		FileLoader loader(buffer, *program.get());
+		timer.Finish(L"load");
+
+		BinaryServices::PrepareLoadedProgram(loader, buffer);
+		timer.Finish(L"prepare");
+
+		return true;
+	}
+	catch(const std::exception& e)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: " << UI::resetcolor;
+		output << e.what() << std::endl;
+		return false;
+	}
+	catch(...)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+		return false;
+	}
+}
+
@@ -9,6 +9,7 @@
 
 #include "Language Extensions/DLLAccess.h"
 #include "Language Extensions/ExtensionCatalog.h"
+#include "Language Extensions/ExtensionTelemetry.h"
 
 #include "Traverser/TraversalInterface.h"
 
@@ -18,10 +19,15 @@
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
+#include "Virtual Machine/Core Entities/Variables/TupleVariable.h"
+#include "Virtual Machine/Core Entities/Types/Structure.h"
+#include "Virtual Machine/Core Entities/Types/Tuple.h"
 
 #include "Marshalling/DLLPool.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Threading/Tracing.h"
 
 
 using namespace Extensions;
@@ -35,6 +41,7 @@ ExtensionDLLAccess::ExtensionDLLAccess(const std::wstring& dllname, VM::Program&
 	: SessionHandle(0),
 	  DLLName(dllname),
 	  ExtensionValid(false),
+	  PreparationPending(false),
 	  DLLHandle(NULL)
 {
 	// Load the DLL
@@ -55,6 +62,10 @@ ExtensionDLLAccess::ExtensionDLLAccess(const std::wstring& dllname, VM::Program&
 	DoLoadDataBuffer = reinterpret_cast<LoadDataBufferPtr>(::GetProcAddress(DLLHandle, "LoadDataBuffer"));
 	DoPrepareBlock = reinterpret_cast<PrepareBlockPtr>(::GetProcAddress(DLLHandle, "PrepareBlock"));
 	DoClearEverything = reinterpret_cast<ClearEverythingPtr>(::GetProcAddress(DLLHandle, "ClearEverything"));
+	DoCompileArrayOperation = reinterpret_cast<CompileArrayOperationPtr>(::GetProcAddress(DLLHandle, "CompileArrayOperation"));
+	DoExecuteArrayOperation = reinterpret_cast<ExecuteArrayOperationPtr>(::GetProcAddress(DLLHandle, "ExecuteArrayOperation"));
+	DoIsBlockAvailable = reinterpret_cast<IsBlockAvailablePtr>(::GetProcAddress(DLLHandle, "IsBlockAvailableForExecution"));
+	DoExecuteControlSequence = reinterpret_cast<ExecuteControlSequencePtr>(::GetProcAddress(DLLHandle, "ExecuteControlSequence"));
 
 	// Validate interface to be sure
 	if(!DoInitialize || !DoRegistration || !DoLoadSource || !DoExecuteSource || !DoExecuteControl || !DoPrepare ||
@@ -81,6 +92,23 @@ CodeBlockHandle ExtensionDLLAccess::LoadSourceBlock(const std::wstring& keyword,
 	return DoLoadSource(SessionHandle, handle, keyword.c_str());
 }
 
+//
+// Determine whether the extension can run the given code block
+//
+// An extension may be usable while still being unable to run some of its
+// blocks; the VM must then execute those blocks itself.
+//
+bool ExtensionDLLAccess::IsAvailableForExecution(CodeBlockHandle handle) const
+{
+	if(!ExtensionValid)
+		return false;
+
+	if(!DoIsBlockAvailable)
+		return true;
+
+	return DoIsBlockAvailable(handle);
+}
+
 //
 // Invoke the code generated for the specified language extension code block
 //
@@ -89,12 +117,28 @@ void ExtensionDLLAccess::ExecuteSourceBlock(CodeBlockHandle handle, HandleType a
 	return DoExecuteSource(handle, activatedscopehandle);
 }
 
-void ExtensionDLLAccess::ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedscopehandle, const std::vector<Traverser::Payload>& payloads)
+void ExtensionDLLAccess::ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedscopehandle, const Traverser::Payload* payloads, size_t numpayloads)
 {
-	if(payloads.empty())
-		return DoExecuteControl(handle, activatedscopehandle, 0, NULL);
-	else
-		return DoExecuteControl(handle, activatedscopehandle, payloads.size(), &payloads[0]);
+	return DoExecuteControl(handle, activatedscopehandle, numpayloads, numpayloads ? payloads : NULL);
+}
+
+//
+// Invoke the code generated for a run of consecutive control blocks, all
+// of which receive the same parameters
+//
+// Extensions which cannot run such a run in one go are simply asked to
+// execute each of the blocks in turn.
+//
+void ExtensionDLLAccess::ExecuteSourceBlockSequence(const std::vector<CodeBlockHandle>& handles, HandleType activatedscopehandle, const Traverser::Payload* payloads, size_t numpayloads)
+{
+	if(!DoExecuteControlSequence)
+	{
+		for(std::vector<CodeBlockHandle>::const_iterator iter = handles.begin(); iter != handles.end(); ++iter)
+			ExecuteSourceBlock(*iter, activatedscopehandle, payloads, numpayloads);
+		return;
+	}
+
+	DoExecuteControlSequence(handles.size(), &handles[0], activatedscopehandle, numpayloads, numpayloads ? payloads : NULL);
 }
 
 
@@ -150,6 +194,7 @@ namespace
 			Traversal->FunctionTraversalCallback(SessionHandle, funcname.c_str());
 			targetfunction->GetReturns().TraverseExternal(*this);
 			targetfunction->GetParams().TraverseExternal(*this);
+			targetfunction->LoadDeferredCodeBlock();
 			targetfunction->GetCodeBlock()->TraverseExternal(*this);
 		}
 
@@ -169,6 +214,10 @@ namespace
 					content.ContainedType = description->GetArrayType(*iter);
 					content.ContainedSize = 0;
 				}
+				else if(content.Type == VM::EpochVariableType_Structure)
+					DescribeMembers(content, description->GetStructureType(description->GetVariableStructureTypeID(*iter)));
+				else if(content.Type == VM::EpochVariableType_Tuple)
+					DescribeMembers(content, description->GetTupleType(description->GetVariableTupleTypeID(*iter)));
 
 				contents.push_back(content);
 			}
@@ -190,6 +239,18 @@ namespace
 			return ActiveScopes.top();
 		}
 
+	private:
+		static void DescribeMembers(Traverser::ScopeContents& content, const VM::CompositeType& type)
+		{
+			for(std::vector<std::wstring>::const_iterator iter = type.GetMemberOrder().begin(); iter != type.GetMemberOrder().end(); ++iter)
+			{
+				Traverser::CompositeMember member;
+				member.Identifier = *iter;
+				member.Type = type.GetMemberType(*iter);
+				content.Members.push_back(member);
+			}
+		}
+
 	private:
 		Traverser::Interface* Traversal;
 		HandleType SessionHandle;
@@ -251,12 +312,63 @@ namespace
 	}
 
 
+	//
+	// Split a qualified identifier of the form "variable.member" into its parts
+	//
+	// Returns false if the identifier does not refer to a member of a
+	// structure or tuple variable.
+	//
+	bool SplitMemberIdentifier(const std::wstring& identifier, std::wstring& variablename, std::wstring& membername)
+	{
+		std::wstring::size_type separator = identifier.find(L'.');
+		if(separator == std::wstring::npos)
+			return false;
+
+		variablename = identifier.substr(0, separator);
+		membername = identifier.substr(separator + 1);
+		return true;
+	}
+
+	//
+	// Access a member of a structure or tuple variable on behalf of the language extension
+	//
+	VM::RValuePtr ReadCompositeMember(VM::ActivatedScope& activatedscope, const std::wstring& variablename, const std::wstring& membername)
+	{
+		switch(activatedscope.GetVariableType(variablename))
+		{
+		case VM::EpochVariableType_Structure:	return activatedscope.GetVariableRef<VM::StructureVariable>(variablename).ReadMember(membername);
+		case VM::EpochVariableType_Tuple:		return activatedscope.GetVariableRef<VM::TupleVariable>(variablename).ReadMember(membername);
+		}
+
+		throw Exception("Cannot access members of this variable through a language extension library; it is not a structure or tuple");
+	}
+
+	void WriteCompositeMember(VM::ActivatedScope& activatedscope, const std::wstring& variablename, const std::wstring& membername, VM::RValuePtr value)
+	{
+		switch(activatedscope.GetVariableType(variablename))
+		{
+		case VM::EpochVariableType_Structure:	activatedscope.GetVariableRef<VM::StructureVariable>(variablename).WriteMember(membername, value, false);	return;
+		case VM::EpochVariableType_Tuple:		activatedscope.GetVariableRef<VM::TupleVariable>(variablename).WriteMember(membername, value, false);		return;
+		}
+
+		throw Exception("Cannot access members of this variable through a language extension library; it is not a structure or tuple");
+	}
+
+
 	//
 	// Callback: the language extension wishes to set the value of an Epoch variable
 	//
 	void __stdcall MarshalCallbackWrite(HandleType handle, const wchar_t* identifier, Traverser::Payload* payload)
 	{
 		VM::ActivatedScope* activatedscope = reinterpret_cast<VM::ActivatedScope*>(handle);						// This is safe since we issued the handle to begin with!
+
+		std::wstring variablename, membername;
+		if(SplitMemberIdentifier(identifier, variablename, membername))
+		{
+			WriteCompositeMember(*activatedscope, variablename, membername, PayloadToRValue(*payload));
+			return;
+		}
+
 		VM::EpochVariableTypeID desttype = activatedscope->GetVariableType(identifier);
 		activatedscope->SetVariableValue(identifier, PayloadToRValue(*payload));
 	}
@@ -267,6 +379,23 @@ namespace
 	void __stdcall MarshalCallbackRead(HandleType activatedscopehandle, const wchar_t* identifier, Traverser::Payload* payload)
 	{
 		VM::ActivatedScope* activatedscope = reinterpret_cast<VM::ActivatedScope*>(activatedscopehandle);		// This is safe since we issued the handle to begin with!
+
+		std::wstring variablename, membername;
+		if(SplitMemberIdentifier(identifier, variablename, membername))
+		{
+			VM::RValuePtr value = ReadCompositeMember(*activatedscope, variablename, membername);
+			switch(value->GetType())
+			{
+			case VM::EpochVariableType_Integer:		payload->SetValue(value->CastTo<VM::IntegerRValue>().GetValue());		break;
+			case VM::EpochVariableType_Integer16:	payload->SetValue(value->CastTo<VM::Integer16RValue>().GetValue());	break;
+			case VM::EpochVariableType_Real:		payload->SetValue(value->CastTo<VM::RealRValue>().GetValue());			break;
+
+			default:
+				throw Exception("Unsupported member type, cannot pass a member of this type through a language extension library");
+			}
+			return;
+		}
+
 		payload->Type = activatedscope->GetVariableType(identifier);
 
 		// TODO - support additional types
@@ -298,6 +427,75 @@ namespace
 		}
 	}
 
+	//
+	// Helpers for moving values of a single type between named variables and a contiguous buffer
+	//
+	template <class RValueType>
+	void ReadValuesIntoBuffer(VM::ActivatedScope& activatedscope, size_t numvariables, const wchar_t* const* identifiers, typename RValueType::BaseStorageType* buffer)
+	{
+		std::wstring variablename, membername;
+		for(size_t i = 0; i < numvariables; ++i)
+		{
+			if(SplitMemberIdentifier(identifiers[i], variablename, membername))
+				buffer[i] = ReadCompositeMember(activatedscope, variablename, membername)->CastTo<RValueType>().GetValue();
+			else
+				buffer[i] = activatedscope.GetVariableValue(identifiers[i])->CastTo<RValueType>().GetValue();
+		}
+	}
+
+	template <class RValueType>
+	void WriteValuesFromBuffer(VM::ActivatedScope& activatedscope, size_t numvariables, const wchar_t* const* identifiers, const typename RValueType::BaseStorageType* buffer)
+	{
+		std::wstring variablename, membername;
+		for(size_t i = 0; i < numvariables; ++i)
+		{
+			VM::RValuePtr value(new RValueType(buffer[i]));
+			if(SplitMemberIdentifier(identifiers[i], variablename, membername))
+				WriteCompositeMember(activatedscope, variablename, membername, value);
+			else
+				activatedscope.SetVariableValue(identifiers[i], value);
+		}
+	}
+
+	//
+	// Callback: the language extension wishes to retrieve the values of several Epoch variables at once
+	//
+	// All of the variables must have the given type; their values are stored
+	// consecutively in the buffer, in the order the identifiers are listed.
+	// This saves the extension from crossing the DLL boundary (and filling
+	// in a payload) for each individual variable.
+	//
+	void __stdcall MarshalCallbackReadBulk(HandleType activatedscopehandle, size_t numvariables, const wchar_t* const* identifiers, VM::EpochVariableTypeID type, void* buffer)
+	{
+		VM::ActivatedScope* activatedscope = reinterpret_cast<VM::ActivatedScope*>(activatedscopehandle);		// This is safe since we issued the handle to begin with!
+
+		switch(type)
+		{
+		case VM::EpochVariableType_Integer:		ReadValuesIntoBuffer<VM::IntegerRValue>(*activatedscope, numvariables, identifiers, static_cast<Integer32*>(buffer));	break;
+		case VM::EpochVariableType_Real:		ReadValuesIntoBuffer<VM::RealRValue>(*activatedscope, numvariables, identifiers, static_cast<Real*>(buffer));			break;
+
+		default:
+			throw Exception("Unsupported type, cannot pass blocks of variables of this type through a language extension library");
+		}
+	}
+
+	//
+	// Callback: the language extension wishes to set the values of several Epoch variables at once
+	//
+	void __stdcall MarshalCallbackWriteBulk(HandleType activatedscopehandle, size_t numvariables, const wchar_t* const* identifiers, VM::EpochVariableTypeID type, const void* buffer)
+	{
+		VM::ActivatedScope* activatedscope = reinterpret_cast<VM::ActivatedScope*>(activatedscopehandle);		// This is safe since we issued the handle to begin with!
+
+		switch(type)
+		{
+		case VM::EpochVariableType_Integer:		WriteValuesFromBuffer<VM::IntegerRValue>(*activatedscope, numvariables, identifiers, static_cast<const Integer32*>(buffer));	break;
+		case VM::EpochVariableType_Real:		WriteValuesFromBuffer<VM::RealRValue>(*activatedscope, numvariables, identifiers, static_cast<const Real*>(buffer));			break;
+
+		default:
+			throw Exception("Unsupported type, cannot pass blocks of variables of this type through a language extension library");
+		}
+	}
+
 	//
 	// Callback: register that an error occurred during some operation in the language extension library
 	//
@@ -309,6 +507,27 @@ namespace
 		throw std::exception(narrow(errormessage).c_str());
 	}
 
+	//
+	// Callback: the language extension reports a span of work for the timeline trace
+	//
+	// The name belongs to the library, which may be unloaded before the trace
+	// is written, so it is interned first.
+	//
+	void __stdcall TraceCallback(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value)
+	{
+		if(Threads::Tracing::IsEnabled())
+			Threads::Tracing::RecordSpan(Threads::Tracing::InternName(name), startticks, endticks, value);
+	}
+
+	//
+	// Callback: the language extension reports work done on behalf of one of its code blocks
+	//
+	void __stdcall ActivityCallback(CodeBlockHandle handle, const CodeBlockActivity* activity)
+	{
+		if(activity)
+			Telemetry::RecordActivity(handle, *activity);
+	}
+
 }
 
 
@@ -328,6 +547,10 @@ void ExtensionDLLAccess::RegisterExtensionKeywords(ExtensionLibraryHandle token)
 	eif.MarshalRead = MarshalCallbackRead;
 	eif.MarshalWrite = MarshalCallbackWrite;
 	eif.Error = ErrorCallback;
+	eif.MarshalReadBulk = MarshalCallbackReadBulk;
+	eif.MarshalWriteBulk = MarshalCallbackWriteBulk;
+	eif.Trace = TraceCallback;
+	eif.RecordActivity = ActivityCallback;
 
 	DoRegistration(&eif, token);
 }
@@ -338,6 +561,7 @@ void ExtensionDLLAccess::RegisterExtensionKeywords(ExtensionLibraryHandle token)
 void ExtensionDLLAccess::PrepareForExecution()
 {
 	DoPrepare(SessionHandle);
+	PreparationPending = false;
 }
 
 
@@ -366,3 +590,32 @@ void ExtensionDLLAccess::ClearEverything()
 {
 	DoClearEverything();
 }
+
+
+//
+// Offer a map or reduce to the extension, so that it can generate code for the operation
+//
+// Returns true if the extension is able to run the operation when asked.
+// This is only possible while the extension is compiling a program.
+//
+bool ExtensionDLLAccess::CompileArrayOperation(const ArrayOperationInfo& info)
+{
+	if(!DoCompileArrayOperation || !SessionHandle)
+		return false;
+
+	return DoCompileArrayOperation(SessionHandle, &info);
+}
+
+//
+// Ask the extension to run a previously compiled map or reduce
+//
+// Returns false if the extension cannot handle the operation, in which
+// case the output has not been touched and the VM must do the work.
+//
+bool ExtensionDLLAccess::ExecuteArrayOperation(const ArrayOperationInfo& info, const void* input, size_t count, void* output)
+{
+	if(!DoExecuteArrayOperation || !ExtensionValid)
+		return false;
+
+	return DoExecuteArrayOperation(&info, input, count, output);
+}
@@ -31,16 +31,26 @@ namespace Extensions
 		void RegisterExtensionKeywords(ExtensionLibraryHandle token);
 		CodeBlockHandle LoadSourceBlock(const std::wstring& keyword, OriginalCodeHandle handle);
 		void ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedscopehandle);
-		void ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedscopehandle, const std::vector<Traverser::Payload>& payloads);
+		void ExecuteSourceBlock(CodeBlockHandle handle, HandleType activatedscopehandle, const Traverser::Payload* payloads, size_t numpayloads);
+		void ExecuteSourceBlockSequence(const std::vector<CodeBlockHandle>& handles, HandleType activatedscopehandle, const Traverser::Payload* payloads, size_t numpayloads);
 		void PrepareForExecution();
 		void PrepareCodeBlock(CodeBlockHandle handle);
 
+		void RequestPreparation()
+		{ PreparationPending = true; }
+
+		bool IsPreparationPending() const
+		{ return PreparationPending; }
+
 		void FillSerializationBuffer(wchar_t*& buffer, size_t& buffersize);
 		void FreeSerializationBuffer(wchar_t* buffer);
 		void LoadDataBuffer(const std::string& buffer);
 
 		void ClearEverything();
 
+		bool CompileArrayOperation(const ArrayOperationInfo& info);
+		bool ExecuteArrayOperation(const ArrayOperationInfo& info, const void* input, size_t count, void* output);
+
 		CompileSessionHandle GetCompileSession() const
 		{ return SessionHandle; }
 
@@ -50,6 +60,8 @@ namespace Extensions
 		bool IsAvailableForExecution() const
 		{ return ExtensionValid; }
 
+		bool IsAvailableForExecution(CodeBlockHandle handle) const;
+
 	// Internal type definitions for function pointers
 	private:
 		typedef bool (__stdcall *InitializePtr)();
@@ -57,6 +69,7 @@ namespace Extensions
 		typedef CodeBlockHandle (__stdcall *LoadSourceBlockPtr)(CompileSessionHandle sessionid, OriginalCodeHandle handle, const wchar_t* keyword);
 		typedef void (__stdcall *ExecuteSourceBlockPtr)(CodeBlockHandle handle, HandleType activatedscopehandle);
 		typedef void (__stdcall *ExecuteControlPtr)(CodeBlockHandle handle, HandleType activatedscopehandle, size_t numparams, const Traverser::Payload* params);
+		typedef void (__stdcall *ExecuteControlSequencePtr)(size_t numhandles, const CodeBlockHandle* handles, HandleType activatedscopehandle, size_t numparams, const Traverser::Payload* params);
 		typedef void (__stdcall *LoadDataBufferPtr)(const char* buffer, size_t buffersize);
 
 		typedef CompileSessionHandle (__stdcall *StartCompileSessionPtr)(HandleType programhandle);
@@ -68,6 +81,11 @@ namespace Extensions
 
 		typedef void (__stdcall *ClearEverythingPtr)();
 
+		typedef bool (__stdcall *CompileArrayOperationPtr)(CompileSessionHandle sessionid, const ArrayOperationInfo* info);
+		typedef bool (__stdcall *ExecuteArrayOperationPtr)(const ArrayOperationInfo* info, const void* input, size_t count, void* output);
+
+		typedef bool (__stdcall *IsBlockAvailablePtr)(CodeBlockHandle handle);
+
 	// Internal bindings to the DLL
 	private:
 		std::wstring DLLName;
@@ -90,9 +108,24 @@ namespace Extensions
 
 		ClearEverythingPtr DoClearEverything;
 
+		// Optional; extensions which cannot run array operations do not export these
+		CompileArrayOperationPtr DoCompileArrayOperation;
+		ExecuteArrayOperationPtr DoExecuteArrayOperation;
+
+		// Optional; extensions which can always run their code blocks do not export this
+		IsBlockAvailablePtr DoIsBlockAvailable;
+
+		// Optional; extensions which gain nothing from running consecutive control blocks together do not export this
+		ExecuteControlSequencePtr DoExecuteControlSequence;
+
 		CompileSessionHandle SessionHandle;
 
 		bool ExtensionValid;
+
+		// Set when the program has asked for the extension to be prepared, but
+		// it has not yet been; see Extensions::PrepareForExecution. Read without
+		// locking by threads checking whether they need to do the preparation.
+		volatile bool PreparationPending;
 	};
 
 }
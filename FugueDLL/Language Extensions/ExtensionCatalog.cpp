@@ -12,6 +12,9 @@
 
 #include "Utility/Files/FilesAndPaths.h"
 #include "Utility/Strings.h"
+#include "Utility/Threading/Synchronization.h"
+
+#include "Configuration/RuntimeOptions.h"
 
 #include "Serialization/SerializationTraverser.h"
 #include "Serialization/SerializationTokens.h"
@@ -29,6 +32,66 @@ std::map<std::wstring, std::vector<ExtensionControlParamInfo> > Extensions::Exte
 ExtensionLibraryHandle handlecounter = 0;
 
 
+namespace
+{
+
+	// Serializes preparation of libraries between the program's threads
+	// and the background warm-up thread
+	Threads::CriticalSection PreparationCritSec;
+
+	HANDLE WarmUpThread = NULL;
+	std::vector<ExtensionDLLAccess*> WarmUpLibraries;
+
+
+	//
+	// Locate a library and ensure that it is ready to run code
+	//
+	ExtensionDLLAccess& GetPreparedLibrary(ExtensionLibraryHandle libhandle)
+	{
+		ExtensionDLLAccess& library = GetLibraryAccess(libhandle);
+		EnsurePrepared(library);
+		return library;
+	}
+
+	//
+	// Prepare each pending library ahead of its first use
+	//
+	// Failures are left for the first use of the library to
+	// report, since the library remains pending in that case.
+	//
+	DWORD __stdcall WarmUpThreadProc(void* param)
+	{
+		for(std::vector<ExtensionDLLAccess*>::iterator iter = WarmUpLibraries.begin(); iter != WarmUpLibraries.end(); ++iter)
+		{
+			try
+			{
+				EnsurePrepared(**iter);
+			}
+			catch(...)
+			{
+			}
+		}
+
+		return 0;
+	}
+
+	//
+	// Wait for any running warm-up pass to finish
+	//
+	void FinishWarmUp()
+	{
+		if(!WarmUpThread)
+			return;
+
+		::WaitForSingleObject(WarmUpThread, INFINITE);
+		::CloseHandle(WarmUpThread);
+		WarmUpThread = NULL;
+		WarmUpLibraries.clear();
+	}
+
+}
+
+
 //
 // Load a given extension DLL and have the extension register any new keywords
 //
@@ -80,28 +143,34 @@ CodeBlockHandle Extensions::BindLibraryToCode(ExtensionLibraryHandle libhandle,
 }
 
 //
-// Execute the processed contents of an extension block
+// Retrieve the access wrapper of a library, so that code which invokes
+// the library repeatedly can bind to it once rather than looking it up
+// on every use
 //
-// Once an extension has processed a block of code, that code can be
-// invoked via this function.
+// The wrapper remains valid until the catalog is reset; callers must
+// pass it to EnsurePrepared before running any code through it.
 //
-void Extensions::ExecuteBoundCodeBlock(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle, HandleType activatedscopehandle)
+ExtensionDLLAccess& Extensions::GetLibraryAccess(ExtensionLibraryHandle libhandle)
 {
 	std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.find(libhandle);
 	if(iter == ExtensionLibraryMap.end())
 		throw Exception("Language extension library handle is invalid; has the library been unloaded?");
 
-	iter->second.ExecuteSourceBlock(codehandle, activatedscopehandle);
+	return iter->second;
 }
 
-
-void Extensions::ExecuteBoundCodeBlock(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle, HandleType activatedscopehandle, const std::vector<Traverser::Payload>& payloads)
+//
+// Prepare a library for execution, if the program has asked
+// for this and it has not yet been done
+//
+void Extensions::EnsurePrepared(ExtensionDLLAccess& library)
 {
-	std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.find(libhandle);
-	if(iter == ExtensionLibraryMap.end())
-		throw Exception("Language extension library handle is invalid; has the library been unloaded?");
+	if(!library.IsPreparationPending())
+		return;
 
-	iter->second.ExecuteSourceBlock(codehandle, activatedscopehandle, payloads);
+	Threads::CriticalSection::Auto mutex(PreparationCritSec);
+	if(library.IsPreparationPending())
+		library.PrepareForExecution();
 }
 
 
@@ -135,10 +204,26 @@ void Extensions::RegisterExtensionControl(const std::wstring& keyword, Extension
 //
 // Signal all extensions to do any required preparatory work prior to executing the program
 //
+// The work itself is deferred until each library is first used, so
+// that programs which never reach their extension code do not pay to
+// prepare it. If so configured, a background thread prepares all of
+// the libraries in the meantime, so that the first use does not stall.
+//
 void Extensions::PrepareForExecution()
 {
+	FinishWarmUp();
+
 	for(std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.begin(); iter != ExtensionLibraryMap.end(); ++iter)
-		iter->second.PrepareForExecution();
+	{
+		iter->second.RequestPreparation();
+		WarmUpLibraries.push_back(&iter->second);
+	}
+
+	if(Config::WarmUpExtensions && !WarmUpLibraries.empty())
+		WarmUpThread = ::CreateThread(NULL, 0, WarmUpThreadProc, NULL, 0, NULL);
+
+	if(!WarmUpThread)
+		WarmUpLibraries.clear();
 }
 
 const std::wstring& Extensions::GetDLLFileOfLibrary(ExtensionLibraryHandle handle)
@@ -176,6 +261,16 @@ bool Extensions::ExtensionIsAvailableForExecution(ExtensionLibraryHandle handle)
 	return iter->second.IsAvailableForExecution();
 }
 
+bool Extensions::ExtensionIsAvailableForExecution(ExtensionLibraryHandle handle, CodeBlockHandle codehandle)
+{
+	std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.find(handle);
+	if(iter == ExtensionLibraryMap.end())
+		return false;
+
+	EnsurePrepared(iter->second);
+	return iter->second.IsAvailableForExecution(codehandle);
+}
+
 
 
 template <>
@@ -191,6 +286,7 @@ void Extensions::TraverseExtensions<Serialization::SerializationTraverser>(Seria
 
 		// TODO - exception safety with external buffers (just RAII-wrap the buffers)
 
+		EnsurePrepared(iter->second);
 		iter->second.FillSerializationBuffer(buffer, datasize);
 		traverser.WriteExtensionData(iter->second.GetDLLFileName(), buffer, datasize);
 		iter->second.FreeSerializationBuffer(buffer);
@@ -212,15 +308,41 @@ void Extensions::LoadDataBuffer(const std::string& libraryname, const std::strin
 
 void Extensions::PrepareCodeBlockForExecution(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle)
 {
-	std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.find(libhandle);
-	if(iter == ExtensionLibraryMap.end())
-		throw Exception("Language extension library handle is invalid; has the library been unloaded?");
+	GetPreparedLibrary(libhandle).PrepareCodeBlock(codehandle);
+}
 
-	iter->second.PrepareCodeBlock(codehandle);
+//
+// Offer a map or reduce to every loaded extension which is compiling the program
+//
+// Any number of extensions may accept the operation; see ExecuteArrayOperation.
+//
+void Extensions::OfferArrayOperation(const ArrayOperationInfo& info)
+{
+	for(std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.begin(); iter != ExtensionLibraryMap.end(); ++iter)
+		iter->second.CompileArrayOperation(info);
+}
+
+//
+// Run a map or reduce using the first extension which is able to do so
+//
+// Returns false if no loaded extension can run the operation.
+//
+bool Extensions::ExecuteArrayOperation(const ArrayOperationInfo& info, const void* input, size_t count, void* output)
+{
+	for(std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.begin(); iter != ExtensionLibraryMap.end(); ++iter)
+	{
+		EnsurePrepared(iter->second);
+		if(iter->second.ExecuteArrayOperation(info, input, count, output))
+			return true;
+	}
+
+	return false;
 }
 
 void Extensions::Reset()
 {
+	FinishWarmUp();
+
 	for(std::map<ExtensionLibraryHandle, ExtensionDLLAccess>::iterator iter = ExtensionLibraryMap.begin(); iter != ExtensionLibraryMap.end(); ++iter)
 		iter->second.ClearEverything();
 
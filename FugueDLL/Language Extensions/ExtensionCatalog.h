@@ -32,11 +32,14 @@ namespace Extensions
 
 	// Forward declarations
 	struct ExtensionControlParamInfo;
+	struct ArrayOperationInfo;
+	class ExtensionDLLAccess;
 
 	void PrepareForExecution();
 	void Reset();
 
 	bool ExtensionIsAvailableForExecution(ExtensionLibraryHandle handle);
+	bool ExtensionIsAvailableForExecution(ExtensionLibraryHandle handle, CodeBlockHandle codehandle);
 
 	ExtensionLibraryHandle RegisterExtensionLibrary(const std::wstring& libraryname, VM::Program& program, bool startsession);
 	ExtensionLibraryHandle GetLibraryProvidingExtension(const std::wstring& extensionname);
@@ -47,8 +50,9 @@ namespace Extensions
 	void RegisterExtensionControl(const std::wstring& keyword, ExtensionLibraryHandle token, size_t numparams, ExtensionControlParamInfo* params);
 
 	CodeBlockHandle BindLibraryToCode(ExtensionLibraryHandle libhandle, const std::wstring& keyword, VM::Block* codeblock);
-	void ExecuteBoundCodeBlock(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle, HandleType activatedscopehandle);
-	void ExecuteBoundCodeBlock(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle, HandleType activatedscopehandle, const std::vector<Traverser::Payload>& payloads);
+
+	ExtensionDLLAccess& GetLibraryAccess(ExtensionLibraryHandle libhandle);
+	void EnsurePrepared(ExtensionDLLAccess& library);
 
 	const std::vector<ExtensionControlParamInfo>& GetParamsForControl(const std::wstring& keyword);
 
@@ -56,6 +60,9 @@ namespace Extensions
 
 	void PrepareCodeBlockForExecution(ExtensionLibraryHandle libhandle, CodeBlockHandle codehandle);
 
+	void OfferArrayOperation(const ArrayOperationInfo& info);
+	bool ExecuteArrayOperation(const ArrayOperationInfo& info, const void* input, size_t count, void* output);
+
 
 	template <typename EnumCallback>
 	void EnumerateExtensionKeywords(EnumCallback callback)
@@ -0,0 +1,76 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Telemetry of the work done by language extensions
+//
+
+#include "pch.h"
+
+#include "Language Extensions/ExtensionTelemetry.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+
+using namespace Extensions;
+
+
+namespace
+{
+	typedef std::map<CodeBlockHandle, CodeBlockActivity> ActivityMap;
+
+	Threads::CriticalSection ActivityCritSec;
+	ActivityMap BlockActivity;
+}
+
+
+//
+// Add a report of work done by an extension to the totals of its code block
+//
+void Telemetry::RecordActivity(CodeBlockHandle handle, const CodeBlockActivity& activity)
+{
+	Threads::CriticalSection::Auto mutex(ActivityCritSec);
+
+	ActivityMap::iterator iter = BlockActivity.find(handle);
+	if(iter == BlockActivity.end())
+	{
+		BlockActivity.insert(std::make_pair(handle, activity));
+		return;
+	}
+
+	CodeBlockActivity& totals = iter->second;
+	totals.NumExecutions += activity.NumExecutions;
+	totals.NumCompilations += activity.NumCompilations;
+	totals.NumTransfersToDevice += activity.NumTransfersToDevice;
+	totals.NumTransfersFromDevice += activity.NumTransfersFromDevice;
+	totals.BytesToDevice += activity.BytesToDevice;
+	totals.BytesFromDevice += activity.BytesFromDevice;
+	totals.CompileMilliseconds += activity.CompileMilliseconds;
+	totals.TransferToDeviceMilliseconds += activity.TransferToDeviceMilliseconds;
+	totals.TransferFromDeviceMilliseconds += activity.TransferFromDeviceMilliseconds;
+	totals.KernelMilliseconds += activity.KernelMilliseconds;
+}
+
+//
+// Copy out the totals of up to the given number of code blocks, in order of handle
+//
+// Returns the number of code blocks with recorded activity, which may be
+// more than were copied; passing no buffer simply retrieves the count.
+//
+size_t Telemetry::GetStatistics(CodeBlockStatistics* stats, size_t maxentries)
+{
+	Threads::CriticalSection::Auto mutex(ActivityCritSec);
+
+	if(stats)
+	{
+		size_t i = 0;
+		for(ActivityMap::const_iterator iter = BlockActivity.begin(); iter != BlockActivity.end() && i < maxentries; ++iter, ++i)
+		{
+			stats[i].Handle = iter->first;
+			stats[i].Activity = iter->second;
+		}
+	}
+
+	return BlockActivity.size();
+}
+
@@ -0,0 +1,48 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Telemetry of the work done by language extensions
+//
+// Extensions report what they did for each code block they run (counts,
+// bytes moved to and from devices, and time spent compiling, transferring
+// and executing) through the RecordActivity callback. The reports are
+// increments, and are accumulated here for each code block handle, so it
+// becomes possible to tell whether a block is bound by its transfers, its
+// compilation or its actual computation.
+//
+// Reports may arrive from any thread, including background compilation
+// threads owned by the extension itself.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Language Extensions/FunctionPointerTypes.h"
+
+
+namespace Extensions
+{
+	namespace Telemetry
+	{
+
+		//
+		// Accumulated activity of a single code block
+		//
+		// This structure is handed out by the VM DLL as is, so any
+		// changes to its layout must be made with care.
+		//
+		struct CodeBlockStatistics
+		{
+			CodeBlockHandle Handle;
+			CodeBlockActivity Activity;
+		};
+
+		void RecordActivity(CodeBlockHandle handle, const CodeBlockActivity& activity);
+
+		size_t GetStatistics(CodeBlockStatistics* stats, size_t maxentries);
+
+	}
+}
+
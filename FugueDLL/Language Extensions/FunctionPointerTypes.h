@@ -31,13 +31,61 @@ namespace Extensions
 	};
 
 
+	//
+	// Description of a map or reduce which an extension may offer to run on behalf of the VM
+	//
+	// Maps name the user function applied to each element. Reduces name the
+	// built-in operator keyword (such as "add") used to combine elements.
+	//
+	enum ArrayOperationType
+	{
+		ArrayOperation_Map,
+		ArrayOperation_Reduce
+	};
+
+	struct ArrayOperationInfo
+	{
+		ArrayOperationType Operation;
+		const wchar_t* FunctionName;
+		VM::EpochVariableTypeID ElementType;
+		VM::EpochVariableTypeID ResultType;
+	};
+
+
+	//
+	// Work done on behalf of a single code block, as reported by an extension
+	//
+	// Extensions report increments, which the VM accumulates separately for
+	// each code block; see Language Extensions/ExtensionTelemetry.h. Kernel
+	// and transfer times are measured on the device where possible, and so
+	// may not add up to the time the host spent waiting on the device.
+	//
+	struct CodeBlockActivity
+	{
+		unsigned __int64 NumExecutions;
+		unsigned __int64 NumCompilations;
+		unsigned __int64 NumTransfersToDevice;
+		unsigned __int64 NumTransfersFromDevice;
+		unsigned __int64 BytesToDevice;
+		unsigned __int64 BytesFromDevice;
+		double CompileMilliseconds;
+		double TransferToDeviceMilliseconds;
+		double TransferFromDeviceMilliseconds;
+		double KernelMilliseconds;
+	};
+
+
 	typedef void (__stdcall *RegistrationCallbackPtr)(ExtensionLibraryHandle token, const wchar_t* keyword);
 	typedef void (__stdcall *ControlRegistrationCallbackPtr)(ExtensionLibraryHandle token, const wchar_t* keyword, size_t numparams, ExtensionControlParamInfo* params);
 	typedef void (__stdcall *TraversalCallbackPtr)(OriginalCodeHandle handle, Traverser::Interface* traversal, HandleType session);
 	typedef void (__stdcall *TraverseFunctionCallbackPtr)(const wchar_t* functionname, Traverser::Interface* traversal, HandleType session, HandleType program);
 	typedef void (__stdcall *MarshalCallbackReadPtr)(HandleType activatedscopehandle, const wchar_t* identifier, Traverser::Payload* payload);
 	typedef void (__stdcall *MarshalCallbackWritePtr)(HandleType activatedscopehandle, const wchar_t* identifier, Traverser::Payload* payload);
+	typedef void (__stdcall *MarshalCallbackReadBulkPtr)(HandleType activatedscopehandle, size_t numvariables, const wchar_t* const* identifiers, VM::EpochVariableTypeID type, void* buffer);
+	typedef void (__stdcall *MarshalCallbackWriteBulkPtr)(HandleType activatedscopehandle, size_t numvariables, const wchar_t* const* identifiers, VM::EpochVariableTypeID type, const void* buffer);
 	typedef void (__stdcall *ErrorCallbackPtr)(const wchar_t* errorstring);
+	typedef void (__stdcall *TraceCallbackPtr)(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value);
+	typedef void (__stdcall *ActivityCallbackPtr)(CodeBlockHandle handle, const CodeBlockActivity* activity);
 
 
 	//
@@ -52,6 +100,16 @@ namespace Extensions
 		MarshalCallbackReadPtr MarshalRead;
 		MarshalCallbackWritePtr MarshalWrite;
 		ErrorCallbackPtr Error;
+
+		// Bulk marshalling of several variables of a single type through a contiguous buffer
+		MarshalCallbackReadBulkPtr MarshalReadBulk;
+		MarshalCallbackWriteBulkPtr MarshalWriteBulk;
+
+		// Timeline tracing of work done by the extension; timestamps are QueryPerformanceCounter ticks
+		TraceCallbackPtr Trace;
+
+		// Telemetry of the work done for each code block; see CodeBlockActivity
+		ActivityCallbackPtr RecordActivity;
 	};
 
 }
@@ -10,6 +10,7 @@
 #include "Language Extensions/Handoff.h"
 #include "Language Extensions/FunctionPointerTypes.h"
 #include "Language Extensions/ExtensionCatalog.h"
+#include "Language Extensions/DLLAccess.h"
 
 #include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
@@ -35,6 +36,7 @@ HandoffOperation::HandoffOperation(const std::wstring& extensionname, std::auto_
 	  CodeBlock(codeblock)
 {
 	ExtensionHandle = Extensions::GetLibraryProvidingExtension(extensionname);
+	Library = &Extensions::GetLibraryAccess(ExtensionHandle);
 	
 	CodeHandle = Extensions::BindLibraryToCode(ExtensionHandle, extensionname, CodeBlock.get());
 	if(!CodeHandle)
@@ -47,6 +49,7 @@ HandoffOperation::HandoffOperation(const std::wstring& extensionname, std::auto_
 	  CodeHandle(codehandle)
 {
 	ExtensionHandle = Extensions::GetLibraryProvidingExtension(extensionname);
+	Library = &Extensions::GetLibraryAccess(ExtensionHandle);
 }
 
 
@@ -55,8 +58,10 @@ HandoffOperation::HandoffOperation(const std::wstring& extensionname, std::auto_
 //
 void HandoffOperation::ExecuteFast(ExecutionContext& context)
 {
-	if(Extensions::ExtensionIsAvailableForExecution(ExtensionHandle))
-		Extensions::ExecuteBoundCodeBlock(ExtensionHandle, CodeHandle, reinterpret_cast<HandleType>(&context.Scope));
+	Extensions::EnsurePrepared(*Library);
+
+	if(Library->IsAvailableForExecution(CodeHandle))
+		Library->ExecuteSourceBlock(CodeHandle, reinterpret_cast<HandleType>(&context.Scope));
 	else
 	{
 		std::auto_ptr<ActivatedScope> codescope(new ActivatedScope(*CodeBlock->GetBoundScope()));
@@ -64,7 +69,7 @@ void HandoffOperation::ExecuteFast(ExecutionContext& context)
 		codescope->LastMessageOrigin = context.Scope.LastMessageOrigin;
 		codescope->ParentScope = &context.Scope;
 
-		CodeBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *codescope, context.Stack, context.FlowResult), NULL);
+		CodeBlock->ExecuteBlock(ExecutionContext(context, *codescope), NULL);
 		codescope->Exit(context.Stack);
 	}
 }
@@ -94,6 +99,11 @@ void HandoffOperation::Traverse(Serialization::SerializationTraverser& traverser
 	TraverseHelper(traverser);
 }
 
+void HandoffOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 
 
@@ -102,7 +112,7 @@ HandoffControlOperation::HandoffControlOperation(const std::wstring& controlkeyw
 	  CounterVariableName(countervarname),
 	  ExtensionName(controlkeyword)
 {
-	ExtensionHandle = Extensions::GetLibraryProvidingExtension(controlkeyword);
+	BindToLibrary();
 	
 	// TODO - better bindings of local variables to the actual stuff the language extension expects
 	Body->InsertHeadOperation(VM::OperationPtr(new VM::Operations::InitializeValue(countervarname)));
@@ -120,7 +130,27 @@ HandoffControlOperation::HandoffControlOperation(const std::wstring& controlkeyw
 	  ExtensionName(controlkeyword),
 	  CodeHandle(codehandle)
 {
-	ExtensionHandle = Extensions::GetLibraryProvidingExtension(controlkeyword);
+	BindToLibrary();
+}
+
+//
+// Resolve the library and parameter list of the control keyword
+//
+void HandoffControlOperation::BindToLibrary()
+{
+	ExtensionHandle = Extensions::GetLibraryProvidingExtension(ExtensionName);
+	Library = &Extensions::GetLibraryAccess(ExtensionHandle);
+	ControlParams = &Extensions::GetParamsForControl(ExtensionName);
+
+	size_t numpassed = 0;
+	for(std::vector<ExtensionControlParamInfo>::const_iterator iter = ControlParams->begin(); iter != ControlParams->end(); ++iter)
+	{
+		if(!iter->CreatesLocalVariable)
+			++numpassed;
+	}
+
+	if(numpassed > MaxParameters)
+		throw Exception("Language extension control block has too many parameters");
 }
 
 
@@ -139,65 +169,13 @@ RValuePtr HandoffControlOperation::ExecuteAndStoreRValue(ExecutionContext& conte
 
 void HandoffControlOperation::ExecuteFast(ExecutionContext& context)
 {
-	if(Extensions::ExtensionIsAvailableForExecution(ExtensionHandle))
-	{
-		std::vector<Traverser::Payload> convertedparams;
-
-		const std::vector<Extensions::ExtensionControlParamInfo>& params = Extensions::GetParamsForControl(ExtensionName);
-		for(std::vector<Extensions::ExtensionControlParamInfo>::const_iterator iter = params.begin(); iter != params.end(); ++iter)
-		{
-			if(iter->CreatesLocalVariable)
-				continue;
-
-			switch(iter->LocalVariableType)
-			{
-			case VM::EpochVariableType_Integer:
-				{
-					IntegerVariable var(context.Stack.GetCurrentTopOfStack());
-					Traverser::Payload payload;
-					payload.SetValue(var.GetValue());
-					convertedparams.push_back(payload);
-					context.Stack.Pop(IntegerVariable::GetBaseStorageSize());
-				}
-				break;
-
-			case VM::EpochVariableType_Integer16:
-				{
-					Integer16Variable var(context.Stack.GetCurrentTopOfStack());
-					Traverser::Payload payload;
-					payload.SetValue(var.GetValue());
-					convertedparams.push_back(payload);
-					context.Stack.Pop(Integer16Variable::GetBaseStorageSize());
-				}
-				break;
-
-			case VM::EpochVariableType_Real:
-				{
-					RealVariable var(context.Stack.GetCurrentTopOfStack());
-					Traverser::Payload payload;
-					payload.SetValue(var.GetValue());
-					convertedparams.push_back(payload);
-					context.Stack.Pop(RealVariable::GetBaseStorageSize());
-				}
-				break;
-
-			case VM::EpochVariableType_Boolean:
-				{
-					BooleanVariable var(context.Stack.GetCurrentTopOfStack());
-					Traverser::Payload payload;
-					payload.SetValue(var.GetValue());
-					convertedparams.push_back(payload);
-					context.Stack.Pop(BooleanVariable::GetBaseStorageSize());
-				}
-				break;
-
-			default:
-				throw VM::NotImplementedException("Support for passing parameters of this type to a language extension is not implemented");
-			}
-		}
+	Extensions::EnsurePrepared(*Library);
 
-		std::reverse(convertedparams.begin(), convertedparams.end());
-		Extensions::ExecuteBoundCodeBlock(ExtensionHandle, CodeHandle, reinterpret_cast<HandleType>(&context.Scope), convertedparams);
+	if(Library->IsAvailableForExecution(CodeHandle))
+	{
+		Traverser::Payload params[MaxParameters];
+		size_t numparams = PopParameters(context, params);
+		Library->ExecuteSourceBlock(CodeHandle, reinterpret_cast<HandleType>(&context.Scope), params, numparams);
 	}
 	else
 	{
@@ -211,6 +189,55 @@ void HandoffControlOperation::ExecuteFast(ExecutionContext& context)
 	}
 }
 
+//
+// Pop the parameters of the control block off the stack, converting
+// them into the form expected by the extension
+//
+// The parameters are stored in the order the extension expects, which
+// is the reverse of the order in which they are popped; the caller must
+// provide room for MaxParameters entries. Returns the number stored.
+//
+size_t HandoffControlOperation::PopParameters(ExecutionContext& context, Traverser::Payload* params) const
+{
+	size_t numparams = 0;
+	for(std::vector<ExtensionControlParamInfo>::const_iterator iter = ControlParams->begin(); iter != ControlParams->end(); ++iter)
+	{
+		if(iter->CreatesLocalVariable)
+			continue;
+
+		Traverser::Payload& payload = params[numparams++];
+
+		switch(iter->LocalVariableType)
+		{
+		case VM::EpochVariableType_Integer:
+			payload.SetValue(IntegerVariable(context.Stack.GetCurrentTopOfStack()).GetValue());
+			context.Stack.Pop(IntegerVariable::GetBaseStorageSize());
+			break;
+
+		case VM::EpochVariableType_Integer16:
+			payload.SetValue(Integer16Variable(context.Stack.GetCurrentTopOfStack()).GetValue());
+			context.Stack.Pop(Integer16Variable::GetBaseStorageSize());
+			break;
+
+		case VM::EpochVariableType_Real:
+			payload.SetValue(RealVariable(context.Stack.GetCurrentTopOfStack()).GetValue());
+			context.Stack.Pop(RealVariable::GetBaseStorageSize());
+			break;
+
+		case VM::EpochVariableType_Boolean:
+			payload.SetValue(BooleanVariable(context.Stack.GetCurrentTopOfStack()).GetValue());
+			context.Stack.Pop(BooleanVariable::GetBaseStorageSize());
+			break;
+
+		default:
+			throw VM::NotImplementedException("Support for passing parameters of this type to a language extension is not implemented");
+		}
+	}
+
+	std::reverse(params, params + numparams);
+	return numparams;
+}
+
 template <typename TraverserT>
 void HandoffControlOperation::TraverseHelper(TraverserT& traverser)
 {
@@ -231,3 +258,75 @@ void HandoffControlOperation::Traverse(Serialization::SerializationTraverser& tr
 	TraverseHelper(traverser);
 }
 
+void HandoffControlOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+
+
+
+//
+// Construct a fused handoff, taking ownership of the original operations
+//
+// The operations must begin with a control handoff; each further handoff
+// must be preceded by the operations which push its parameters.
+//
+FusedHandoffControlOperation::FusedHandoffControlOperation(const std::vector<VM::Operation*>& operations)
+	: OriginalOperations(operations)
+{
+	for(std::vector<VM::Operation*>::const_iterator iter = OriginalOperations.begin(); iter != OriginalOperations.end(); ++iter)
+	{
+		HandoffControlOperation* handoff = dynamic_cast<HandoffControlOperation*>(*iter);
+		if(handoff)
+		{
+			Handoffs.push_back(handoff);
+			CodeHandles.push_back(handoff->GetCodeHandle());
+		}
+	}
+
+	if(Handoffs.empty() || Handoffs.front() != OriginalOperations.front())
+		throw Exception("Fused control handoffs must begin with a handoff operation");
+}
+
+FusedHandoffControlOperation::~FusedHandoffControlOperation()
+{
+	for(std::vector<VM::Operation*>::iterator iter = OriginalOperations.begin(); iter != OriginalOperations.end(); ++iter)
+		delete *iter;
+}
+
+
+//
+// Hand all of the fused control blocks over to the extension at once
+//
+// The parameters of the first block are on the stack; the parameters of
+// the others are known to be identical, so they are never evaluated.
+//
+void FusedHandoffControlOperation::ExecuteFast(ExecutionContext& context)
+{
+	const HandoffControlOperation& first = *Handoffs.front();
+	ExtensionDLLAccess& library = first.GetLibrary();
+
+	Extensions::EnsurePrepared(library);
+
+	for(std::vector<Extensions::CodeBlockHandle>::const_iterator iter = CodeHandles.begin(); iter != CodeHandles.end(); ++iter)
+	{
+		if(!library.IsAvailableForExecution(*iter))
+		{
+			for(std::vector<VM::Operation*>::iterator opiter = OriginalOperations.begin(); opiter != OriginalOperations.end(); ++opiter)
+				(*opiter)->ExecuteFast(context);
+			return;
+		}
+	}
+
+	Traverser::Payload params[HandoffControlOperation::MaxParameters];
+	size_t numparams = first.PopParameters(context, params);
+	library.ExecuteSourceBlockSequence(CodeHandles, reinterpret_cast<HandleType>(&context.Scope), params, numparams);
+}
+
+RValuePtr FusedHandoffControlOperation::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
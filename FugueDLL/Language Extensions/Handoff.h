@@ -10,6 +10,7 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Operations/FusedOps.h"
 #include "Language Extensions/ExtensionCatalog.h"
 
 
@@ -23,6 +24,11 @@ namespace VM
 namespace Extensions
 {
 
+	// Forward declarations
+	class ExtensionDLLAccess;
+	struct ExtensionControlParamInfo;
+
+
 	//
 	// Virtual machine operation that wraps the logic for handing
 	// off program execution to an external extension module
@@ -60,6 +66,7 @@ namespace Extensions
 
 		virtual void Traverse(Validator::ValidationTraverser& traverser);
 		virtual void Traverse(Serialization::SerializationTraverser& traverser);
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		virtual VM::Block* GetAttachedCodeBlock() const
 		{
@@ -70,6 +77,7 @@ namespace Extensions
 	protected:
 		const std::wstring& ExtensionName;
 		Extensions::ExtensionLibraryHandle ExtensionHandle;
+		Extensions::ExtensionDLLAccess* Library;
 		std::auto_ptr<VM::Block> CodeBlock;
 		Extensions::CodeBlockHandle CodeHandle;
 	};
@@ -105,6 +113,7 @@ namespace Extensions
 
 		virtual void Traverse(Validator::ValidationTraverser& traverser);
 		virtual void Traverse(Serialization::SerializationTraverser& traverser);
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		virtual VM::Block* GetAttachedCodeBlock() const
 		{
@@ -122,6 +131,22 @@ namespace Extensions
 		Extensions::CodeBlockHandle GetCodeHandle() const
 		{ return CodeHandle; }
 
+		Extensions::ExtensionLibraryHandle GetExtensionHandle() const
+		{ return ExtensionHandle; }
+
+		Extensions::ExtensionDLLAccess& GetLibrary() const
+		{ return *Library; }
+
+		size_t PopParameters(VM::ExecutionContext& context, Traverser::Payload* params) const;
+
+	// Limit on the number of parameters passed to an extension control block
+	public:
+		static const size_t MaxParameters = 16;
+
+	// Internal helpers
+	protected:
+		void BindToLibrary();
+
 	// Internal tracking
 	protected:
 		const std::wstring& ExtensionName;
@@ -131,6 +156,48 @@ namespace Extensions
 
 		Extensions::CodeBlockHandle CodeHandle;
 		Extensions::ExtensionLibraryHandle ExtensionHandle;
+
+		// Resolved once at construction, so that each execution
+		// of the handoff can skip the catalog lookups
+		Extensions::ExtensionDLLAccess* Library;
+		const std::vector<ExtensionControlParamInfo>* ControlParams;
+	};
+
+
+	//
+	// Operation for handing several consecutive control blocks over to a
+	// language extension at once
+	//
+	// This is generated by the optimizer only, in place of a run of control
+	// handoffs which all receive the same literal parameters; see
+	// HandoffFusion.cpp for details. The operation takes ownership of the
+	// original handoffs, along with the parameter pushes between them, and
+	// falls back on executing them in order if the extension cannot run all
+	// of the blocks itself.
+	//
+	class FusedHandoffControlOperation : public VM::Operations::FusedOperation
+	{
+	// Construction and destruction
+	public:
+		explicit FusedHandoffControlOperation(const std::vector<VM::Operation*>& operations);
+		~FusedHandoffControlOperation();
+
+	// Operation interface
+	public:
+		virtual void ExecuteFast(VM::ExecutionContext& context);
+		virtual VM::RValuePtr ExecuteAndStoreRValue(VM::ExecutionContext& context);
+
+		virtual VM::EpochVariableTypeID GetType(const VM::ScopeDescription& scope) const
+		{ return VM::EpochVariableType_Null; }
+
+		virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+		{ return Handoffs.front()->GetNumParameters(scope); }
+
+	// Internal tracking
+	private:
+		std::vector<VM::Operation*> OriginalOperations;
+		std::vector<HandoffControlOperation*> Handoffs;
+		std::vector<Extensions::CodeBlockHandle> CodeHandles;
 	};
 
 }
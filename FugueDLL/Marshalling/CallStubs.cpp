@@ -0,0 +1,187 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Generated machine code stubs for calling functions in external DLLs
+//
+// WARNING - all marshalling code is platform-specific!
+//
+// Calling an external function means pushing its parameters onto the
+// machine stack, which cannot be done from ordinary C++ code. Rather
+// than interpreting a list of parameters in inline assembly on every
+// call, we generate a small piece of machine code for each distinct
+// parameter signature. The stub pushes each parameter with a single
+// instruction at a fixed offset, with no looping or branching, then
+// calls the target. Stubs are shared by all calls with the same
+// parameter layout, regardless of which function is being called.
+//
+// The stack pointer is restored from the frame pointer after the call,
+// so stubs work correctly for both __stdcall and __cdecl targets.
+//
+
+#include "pch.h"
+
+#include "Marshalling/CallStubs.h"
+
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+
+namespace
+{
+
+	//
+	// Track generated stubs by the parameter signature they handle
+	//
+	typedef std::map<std::vector<bool>, Marshalling::CallStub> CallStubMapT;
+	CallStubMapT CallStubMap;
+
+	struct StubSpaceRecord
+	{
+		UByte* StartOfSpace;
+		UByte* NextAvailableByte;
+	};
+
+	std::vector<StubSpaceRecord> StubSpaceList;
+
+	Threads::CriticalSection CallStubCriticalSection;
+
+	const size_t StubSpaceSize = 4096;
+
+
+	//
+	// Reserve executable memory for a stub of the given size
+	//
+	UByte* GetStubSpace(size_t numbytes)
+	{
+		if(numbytes > StubSpaceSize)
+			throw VM::NotImplementedException("Too many parameters for external DLL call");
+
+		if(!StubSpaceList.empty())
+		{
+			StubSpaceRecord& rec = StubSpaceList.back();
+			if(rec.NextAvailableByte + numbytes <= rec.StartOfSpace + StubSpaceSize)
+			{
+				UByte* ret = rec.NextAvailableByte;
+				rec.NextAvailableByte += numbytes;
+				return ret;
+			}
+		}
+
+		StubSpaceRecord rec;
+		rec.StartOfSpace = reinterpret_cast<UByte*>(::VirtualAlloc(NULL, StubSpaceSize, MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+		if(!rec.StartOfSpace)
+			throw MemoryException("Failed to allocate space for external DLL call stub");
+
+		rec.NextAvailableByte = rec.StartOfSpace + numbytes;
+		StubSpaceList.push_back(rec);
+		return rec.StartOfSpace;
+	}
+
+
+	//
+	// Helper for emitting machine code into a stub
+	//
+	class StubWriter
+	{
+	public:
+		explicit StubWriter(UByte* buffer)
+			: Buffer(buffer), Position(0)
+		{ }
+
+		void Emit(UByte byte)
+		{ Buffer[Position++] = byte; }
+
+		void Emit32(UInteger32 value)
+		{
+			Emit(static_cast<UByte>(value & 0xFF));
+			Emit(static_cast<UByte>((value >> 8) & 0xFF));
+			Emit(static_cast<UByte>((value >> 16) & 0xFF));
+			Emit(static_cast<UByte>((value >> 24) & 0xFF));
+		}
+
+	private:
+		UByte* Buffer;
+		size_t Position;
+	};
+
+
+	// Sizes of the fixed portions of each stub
+	const size_t PrologueSize = 7;
+	const size_t EpilogueSize = 11;
+	const size_t MaxPushSize = 7;
+
+}
+
+
+//
+// Retrieve a call stub for the given parameter layout, generating it if needed
+//
+// Each entry in the list indicates whether the corresponding parameter
+// is passed as a 16-bit value; all other parameters are 32-bit values.
+//
+Marshalling::CallStub Marshalling::RequestCallStub(const std::vector<bool>& is16bitparams)
+{
+	Threads::CriticalSection::Auto mutex(CallStubCriticalSection);
+
+	CallStubMapT::const_iterator iter = CallStubMap.find(is16bitparams);
+	if(iter != CallStubMap.end())
+		return iter->second;
+
+	UByte* stub = GetStubSpace(PrologueSize + EpilogueSize + MaxPushSize * is16bitparams.size());
+	StubWriter writer(stub);
+
+	// push ebp
+	// mov ebp, esp
+	// push esi
+	// mov esi, [ebp + 8]			(arguments)
+	writer.Emit(0x55);
+	writer.Emit(0x8B);	writer.Emit(0xEC);
+	writer.Emit(0x56);
+	writer.Emit(0x8B);	writer.Emit(0x75);	writer.Emit(0x08);
+
+	for(size_t i = 0; i < is16bitparams.size(); ++i)
+	{
+		// push word [esi + offset]		(with operand size prefix)
+		// push dword [esi + offset]
+		if(is16bitparams[i])
+			writer.Emit(0x66);
+
+		writer.Emit(0xFF);	writer.Emit(0xB6);
+		writer.Emit32(static_cast<UInteger32>(i * sizeof(UINT_PTR)));
+	}
+
+	// mov eax, [ebp + 12]			(target)
+	// call eax
+	// lea esp, [ebp - 4]
+	// pop esi
+	// pop ebp
+	// ret
+	writer.Emit(0x8B);	writer.Emit(0x45);	writer.Emit(0x0C);
+	writer.Emit(0xFF);	writer.Emit(0xD0);
+	writer.Emit(0x8D);	writer.Emit(0x65);	writer.Emit(0xFC);
+	writer.Emit(0x5E);
+	writer.Emit(0x5D);
+	writer.Emit(0xC3);
+
+	CallStub ret = reinterpret_cast<CallStub>(stub);
+	CallStubMap[is16bitparams] = ret;
+	return ret;
+}
+
+//
+// Discard all generated call stubs
+//
+void Marshalling::CleanCallStubs()
+{
+	Threads::CriticalSection::Auto mutex(CallStubCriticalSection);
+
+	CallStubMap.clear();
+
+	for(std::vector<StubSpaceRecord>::iterator iter = StubSpaceList.begin(); iter != StubSpaceList.end(); ++iter)
+		::VirtualFree(iter->StartOfSpace, 0, MEM_RELEASE);
+
+	StubSpaceList.clear();
+}
+
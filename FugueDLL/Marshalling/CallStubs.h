@@ -0,0 +1,31 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Generated machine code stubs for calling functions in external DLLs
+//
+// WARNING - all marshalling code is platform-specific!
+//
+
+#pragma once
+
+
+namespace Marshalling
+{
+
+	//
+	// Signature of a generated call stub
+	//
+	// The stub pushes each of the given arguments onto the machine stack,
+	// in order, and then calls the target function; the target's return
+	// value is passed back unaltered.
+	//
+	typedef UINT_PTR (__cdecl *CallStub)(const UINT_PTR* arguments, void* target);
+
+
+	CallStub RequestCallStub(const std::vector<bool>& is16bitparams);
+
+	void CleanCallStubs();
+
+}
+
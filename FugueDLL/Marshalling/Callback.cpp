@@ -18,6 +18,7 @@
 #include "pch.h"
 
 #include "Marshalling/Callback.h"
+#include "Marshalling/CallStubs.h"
 
 #include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/Core Entities/RValue.h"
@@ -40,8 +41,16 @@ namespace
 	// Track the mapping between generated callback stubs and
 	// the Epoch functions they are intended to invoke
 	//
+	// Stubs are requested far more often than they are created, so
+	// the map is published as an immutable snapshot which can be read
+	// without taking the lock. Creating a stub publishes a new copy of
+	// the map; superseded copies are retired rather than deleted, since
+	// other threads may still be reading them, and are only released
+	// when the marshalling layer is cleaned up.
+	//
 	typedef std::map<VM::Function*, void*> MarshallingMapT;
-	MarshallingMapT MarshalledCallbackMap;
+	const MarshallingMapT* volatile MarshalledCallbackMap = NULL;
+	std::vector<const MarshallingMapT*> RetiredCallbackMaps;
 
 	struct StubSpaceRecord
 	{
@@ -155,12 +164,25 @@ namespace
 //
 void* Marshalling::RequestMarshalledCallback(VM::Function* callbackfunction)
 {
+	// Check if we have already generated a stub for this function
+	const MarshallingMapT* snapshot = MarshalledCallbackMap;
+	if(snapshot)
+	{
+		MarshallingMapT::const_iterator iter = snapshot->find(callbackfunction);
+		if(iter != snapshot->end())
+			return iter->second;
+	}
+
 	Threads::CriticalSection::Auto mutex(MarshallingCriticalSection);
 
-	// Check if we have already generated a stub for this function
-	MarshallingMapT::const_iterator iter = MarshalledCallbackMap.find(callbackfunction);
-	if(iter != MarshalledCallbackMap.end())
-		return iter->second;
+	// Another thread may have generated the stub in the meantime
+	snapshot = MarshalledCallbackMap;
+	if(snapshot)
+	{
+		MarshallingMapT::const_iterator iter = snapshot->find(callbackfunction);
+		if(iter != snapshot->end())
+			return iter->second;
+	}
 
 	// Generate a new callback stub
 	void* stubspace = GetStubSpace();
@@ -187,7 +209,13 @@ void* Marshalling::RequestMarshalledCallback(VM::Function* callbackfunction)
 	rawbytes[10] = 0xFF;
 	rawbytes[11] = 0xE1;
 
-	MarshalledCallbackMap[callbackfunction] = &rawbytes[0];
+	std::auto_ptr<MarshallingMapT> newsnapshot(snapshot ? new MarshallingMapT(*snapshot) : new MarshallingMapT);
+	(*newsnapshot)[callbackfunction] = &rawbytes[0];
+
+	if(snapshot)
+		RetiredCallbackMaps.push_back(snapshot);
+
+	MarshalledCallbackMap = newsnapshot.release();
 
 	return (&rawbytes[0]);
 }
@@ -199,12 +227,20 @@ void Marshalling::Clean()
 {
 	Threads::CriticalSection::Auto mutex(MarshallingCriticalSection);
 
-	MarshalledCallbackMap.clear();
+	delete MarshalledCallbackMap;
+	MarshalledCallbackMap = NULL;
+
+	for(std::vector<const MarshallingMapT*>::iterator iter = RetiredCallbackMaps.begin(); iter != RetiredCallbackMaps.end(); ++iter)
+		delete *iter;
+
+	RetiredCallbackMaps.clear();
 
 	for(std::vector<StubSpaceRecord>::iterator iter = StubSpaceList.begin(); iter != StubSpaceList.end(); ++iter)
 		::VirtualFree(iter->StartOfSpace, 0, MEM_RELEASE);
 
 	StubSpaceList.clear();
+
+	CleanCallStubs();
 }
 
 
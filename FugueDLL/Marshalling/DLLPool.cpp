@@ -8,6 +8,161 @@
 #include "pch.h"
 #include "Marshalling/DLLPool.h"
 
+#include "Utility/Threading/MachineInfo.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace Marshalling;
+
+
 // Global shared pool
 Marshalling::DLLPool Marshalling::TheDLLPool;
 
+
+
+DLLPool::DLLPool()
+	: NextPreload(0)
+{
+}
+
+DLLPool::~DLLPool()
+{
+	for(std::map<std::wstring, HINSTANCE>::iterator iter = LoadedDLLs.begin(); iter != LoadedDLLs.end(); ++iter)
+		::FreeLibrary(iter->second);
+}
+
+
+//
+// Retrieve a handle to the given library, loading it if needed
+//
+// The library is loaded outside of the pool's lock, so that several
+// threads can load different libraries at once. If two threads race to
+// load the same library, the OS hands both the same module; the extra
+// reference taken by the losing thread is simply released again.
+//
+HINSTANCE DLLPool::OpenDLL(const std::wstring& name)
+{
+	{
+		Threads::CriticalSection::Auto mutex(CritSec);
+		std::map<std::wstring, HINSTANCE>::const_iterator iter = LoadedDLLs.find(name);
+		if(iter != LoadedDLLs.end())
+			return iter->second;
+	}
+
+	HINSTANCE hdll = ::LoadLibrary(name.c_str());
+	if(!hdll)
+		throw VM::ExecutionException("Failed to load external DLL file \"" + narrow(name) + "\"");
+
+	Threads::CriticalSection::Auto mutex(CritSec);
+	std::pair<std::map<std::wstring, HINSTANCE>::iterator, bool> result = LoadedDLLs.insert(std::make_pair(name, hdll));
+	if(!result.second)
+		::FreeLibrary(hdll);
+
+	return result.first->second;
+}
+
+bool DLLPool::HasOpenedDLL(const std::wstring& name) const
+{
+	Threads::CriticalSection::Auto mutex(CritSec);
+	return (LoadedDLLs.find(name) != LoadedDLLs.end());
+}
+
+
+//
+// Note that the program calls into the given library, so that
+// it can be loaded before the first call is actually made
+//
+void DLLPool::RequireDLL(const std::wstring& name)
+{
+	Threads::CriticalSection::Auto mutex(CritSec);
+	if(LoadedDLLs.find(name) == LoadedDLLs.end())
+		RequiredDLLs.insert(name);
+}
+
+//
+// Start loading all required libraries on background threads
+//
+// Libraries which fail to load are skipped; the failure is
+// reported when the program first calls into the library.
+//
+void DLLPool::BeginPreload()
+{
+	WaitForPreload();
+
+	if(!Config::PreloadDLLs)
+		return;
+
+	{
+		Threads::CriticalSection::Auto mutex(CritSec);
+		for(std::set<std::wstring>::const_iterator iter = RequiredDLLs.begin(); iter != RequiredDLLs.end(); ++iter)
+		{
+			if(LoadedDLLs.find(*iter) == LoadedDLLs.end())
+				PreloadQueue.push_back(*iter);
+		}
+		RequiredDLLs.clear();
+	}
+
+	NextPreload = 0;
+
+	size_t numthreads = std::min<size_t>(PreloadQueue.size(), Threads::GetCPUCount());
+	for(size_t i = 0; i < numthreads; ++i)
+	{
+		HANDLE thread = ::CreateThread(NULL, 0, PreloadThreadProc, this, 0, NULL);
+		if(thread)
+			PreloadThreads.push_back(thread);
+	}
+}
+
+//
+// Wait for any running preload threads to finish
+//
+void DLLPool::WaitForPreload()
+{
+	for(std::vector<HANDLE>::iterator iter = PreloadThreads.begin(); iter != PreloadThreads.end(); ++iter)
+	{
+		::WaitForSingleObject(*iter, INFINITE);
+		::CloseHandle(*iter);
+	}
+
+	PreloadThreads.clear();
+	PreloadQueue.clear();
+}
+
+//
+// Load queued libraries until none remain
+//
+DWORD __stdcall DLLPool::PreloadThreadProc(void* param)
+{
+	DLLPool* pool = reinterpret_cast<DLLPool*>(param);
+
+	while(true)
+	{
+		size_t index = static_cast<size_t>(::InterlockedIncrement(&pool->NextPreload) - 1);
+		if(index >= pool->PreloadQueue.size())
+			break;
+
+		try
+		{
+			pool->OpenDLL(pool->PreloadQueue[index]);
+		}
+		catch(...)
+		{
+		}
+	}
+
+	return 0;
+}
+
+
+DLLPool::PreloadSession::PreloadSession(DLLPool& pool)
+	: BoundPool(pool)
+{
+	BoundPool.BeginPreload();
+}
+
+DLLPool::PreloadSession::~PreloadSession()
+{
+	BoundPool.WaitForPreload();
+}
+
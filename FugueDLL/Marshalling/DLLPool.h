@@ -10,6 +10,7 @@
 
 // Dependencies
 #include "Utility/Strings.h"
+#include "Utility/Threading/Synchronization.h"
 #include "Virtual Machine/VMExceptions.h"
 
 
@@ -21,44 +22,61 @@ namespace Marshalling
 	// active once it has been loaded. This interface ensures that the library
 	// is only opened once, regardless of how many calls are made.
 	//
+	// The pool may be used by any number of threads at once. Libraries which
+	// the program is known to call into can be loaded ahead of time on a set
+	// of background threads; see PreloadSession.
+	//
 	class DLLPool
 	{
-	// Destruction
+	// Construction and destruction
 	public:
-		~DLLPool()
-		{
-			for(std::map<std::wstring, HINSTANCE>::iterator iter = LoadedDLLs.begin(); iter != LoadedDLLs.end(); ++iter)
-				::FreeLibrary(iter->second);
-		}
+		DLLPool();
+		~DLLPool();
 
 	// DLL loading interface
 	public:
-		HINSTANCE OpenDLL(const std::wstring& name)
-		{
-			std::map<std::wstring, HINSTANCE>::const_iterator iter = LoadedDLLs.find(name);
-			if(iter != LoadedDLLs.end())
-				return iter->second;
+		HINSTANCE OpenDLL(const std::wstring& name);
+		bool HasOpenedDLL(const std::wstring& name) const;
 
-			HINSTANCE hdll = ::LoadLibrary(name.c_str());
-			if(!hdll)
-				throw VM::ExecutionException("Failed to load external DLL file \"" + narrow(name) + "\"");
+	// Preloading interface
+	public:
+		void RequireDLL(const std::wstring& name);
 
-			LoadedDLLs.insert(std::make_pair(name, hdll));
-			return hdll;
-		}
+		void BeginPreload();
+		void WaitForPreload();
 
-		bool HasOpenedDLL(const std::wstring& name) const
+		//
+		// RAII helper for preloading libraries while a program runs; the
+		// preload threads are always finished by the time the session ends
+		//
+		struct PreloadSession
 		{
-			return (LoadedDLLs.find(name) != LoadedDLLs.end());
-		}
+			explicit PreloadSession(DLLPool& pool);
+			~PreloadSession();
+
+		private:
+			DLLPool& BoundPool;
+		};
+
+	// Internal helpers
+	private:
+		static DWORD __stdcall PreloadThreadProc(void* param);
 
 	// Internal tracking
 	private:
 		std::map<std::wstring, HINSTANCE> LoadedDLLs;
+		mutable Threads::CriticalSection CritSec;
+
+		// Libraries named by external function calls which have not yet been preloaded
+		std::set<std::wstring> RequiredDLLs;
+
+		std::vector<std::wstring> PreloadQueue;
+		volatile LONG NextPreload;
+		std::vector<HANDLE> PreloadThreads;
 	};
 
 
 	// Global shared pool
 	extern DLLPool TheDLLPool;
 
-}
\ No newline at end of file
+}
@@ -22,6 +22,8 @@
 #include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 #include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
 #include "Virtual Machine/SelfAware.inl"
 
 
@@ -32,9 +34,14 @@ using namespace VM;
 //
 // Construct a DLL call operation
 //
-CallDLL::CallDLL(const std::wstring& dllname, const std::wstring& functionname, ScopeDescription* paramlist, EpochVariableTypeID returntype, VM::EpochVariableTypeID returntypehint)
-	: DLLName(dllname), FunctionName(functionname), Params(paramlist), ReturnType(returntype), ReturnTypeHint(returntypehint)
+CallDLL::CallDLL(const std::wstring& dllname, const std::wstring& functionname, ScopeDescription* paramlist, EpochVariableTypeID returntype, VM::EpochVariableTypeID returntypehint, bool batched)
+	: DLLName(dllname), FunctionName(functionname), Params(paramlist), ReturnType(returntype), ReturnTypeHint(returntypehint),
+	  Batched(batched),
+	  Prepared(false),
+	  FunctionAddress(NULL),
+	  Stub(NULL)
 {
+	TheDLLPool.RequireDLL(DLLName);
 }
 
 //
@@ -46,14 +53,135 @@ CallDLL::~CallDLL()
 }
 
 
+
+//
+// Locate the target function and work out how to marshal each parameter
+//
+// This is done once, the first time the function is called; subsequent
+// calls only need to copy the parameter values out of the VM stack.
+//
+void CallDLL::PrepareCall()
+{
+	Threads::CriticalSection::Auto mutex(PrepareCriticalSection);
+	if(Prepared)
+		return;
+
+	HINSTANCE hdll = TheDLLPool.OpenDLL(DLLName);
+	if(!hdll)
+		throw ExecutionException("Invalid DLL call - could not load library");
+
+	void* address = ::GetProcAddress(hdll, narrow(FunctionName).c_str());
+	if(!address)
+		throw ExecutionException("Invalid DLL call - could not locate function");
+
+	std::vector<MarshalledParam> plan;
+	std::vector<bool> is16bitparams;
+
+	const std::vector<std::wstring>& paramorder = Params->GetMemberOrder();
+	plan.reserve(paramorder.size());
+	for(std::vector<std::wstring>::const_iterator iter = paramorder.begin(); iter != paramorder.end(); ++iter)
+	{
+		MarshalledParam param;
+		param.Name = &(*iter);
+		param.Type = Params->GetVariableType(*iter);
+		param.Slot = Params->ResolveVariableSlot(*iter);
+		param.ElementType = EpochVariableType_Error;
+		param.InPlaceStructureTypeID = 0;
+		param.PassInPlace = false;
+
+		if(Batched)
+		{
+			if(param.Type != EpochVariableType_Array)
+				throw ExecutionException("Batched DLL calls must take only array arguments");
+
+			param.ElementType = Params->GetArrayType(*iter);
+			switch(param.ElementType)
+			{
+			case EpochVariableType_Integer:
+			case EpochVariableType_Integer16:
+			case EpochVariableType_Real:
+			case EpochVariableType_Boolean:
+				break;
+
+			default:
+				throw ExecutionException("Cannot pass arrays of this type to a batched DLL call");
+			}
+
+			plan.push_back(param);
+			continue;
+		}
+
+		switch(param.Type)
+		{
+		case EpochVariableType_Structure:
+			param.InPlaceStructureTypeID = Params->GetVariableStructureTypeID(*iter);
+			param.PassInPlace = IsStructureLayoutCompatible(param.InPlaceStructureTypeID);
+			break;
+
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_String:
+		case EpochVariableType_Function:
+		case EpochVariableType_Buffer:
+			break;
+
+		default:
+			throw ExecutionException("Cannot pass this argument type to a DLL call");
+		}
+
+		plan.push_back(param);
+		is16bitparams.push_back(param.Type == EpochVariableType_Integer16);
+	}
+
+	if(Batched)
+	{
+		if(ReturnType == EpochVariableType_Array)
+		{
+			switch(ReturnTypeHint)
+			{
+			case EpochVariableType_Integer:
+			case EpochVariableType_Integer16:
+			case EpochVariableType_Real:
+			case EpochVariableType_Boolean:
+				break;
+
+			default:
+				throw VM::NotImplementedException("Batched DLL calls cannot return arrays of this type; no function call was made");
+			}
+		}
+		else if(ReturnType != EpochVariableType_Null)
+			throw VM::NotImplementedException("Batched DLL calls must return an array or nothing; no function call was made");
+	}
+	else
+	{
+		switch(ReturnType)
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Boolean:
+		case EpochVariableType_Null:
+		case EpochVariableType_Array:
+			break;
+
+		default:
+			throw VM::NotImplementedException("Not sure what to do with return value from DLL call; no function call was made");
+		}
+
+		Stub = RequestCallStub(is16bitparams);
+	}
+
+	MarshalPlan.swap(plan);
+	FunctionAddress = address;
+	Prepared = true;
+}
+
+
 //
 // Invoke a function in a separate DLL
 //
-// Note that we must do the invocation by hand in assembly, because
-// pushing parameters onto the machine stack disrupts the ESP pointer,
-// which in turn disrupts accessing local variables in the current
-// stack frame. To avoid this, we save off the information we need
-// into registers, and work from there to invoke the function.
+// The parameters are gathered into a flat list of machine words, which
+// is handed to a generated stub that pushes them onto the machine stack
+// and calls the target function; see CallStubs.cpp for details.
 //
 RValuePtr CallDLL::Invoke(ExecutionContext& context)
 {
@@ -71,83 +199,66 @@ RValuePtr CallDLL::Invoke(ExecutionContext& context)
 		std::vector<VM::StructureVariable*> Variables;
 	} Buffers;
 
-	std::auto_ptr<ActivatedScope> paramclone(new ActivatedScope(*Params));
-	paramclone->BindToStack(context.Stack);
-
-	Integer32 integerret = 0;
-	Integer16 integer16ret = 0;
-	LibraryArrayReturnInfo* arrayret = NULL;
-
-	HINSTANCE hdll = TheDLLPool.OpenDLL(DLLName);
-	if(!hdll)
-		throw ExecutionException("Invalid DLL call - could not load library");
+	if(!Prepared)
+		PrepareCall();
 
-	void* address = ::GetProcAddress(hdll, narrow(FunctionName).c_str());
-	if(!address)
-		throw ExecutionException("Invalid DLL call - could not locate function");
+	if(Batched)
+		return InvokeBatch(context);
 
-	struct pushrec
-	{
-		UINT_PTR Contents;
-		int Is16Bit;
+	std::auto_ptr<ActivatedScope> paramclone(new ActivatedScope(*Params));
+	paramclone->BindToStack(context.Stack);
 
-		pushrec(UINT_PTR contents, int is16bit)
-			: Contents(contents), Is16Bit(is16bit)
-		{ }
-	};
-	std::vector<pushrec> StuffToPush;
+	std::vector<UINT_PTR> arguments;
+	arguments.reserve(MarshalPlan.size());
 
-	const std::vector<std::wstring>& paramorder = Params->GetMemberOrder();
-	for(std::vector<std::wstring>::const_iterator iter = paramorder.begin(); iter != paramorder.end(); ++iter)
+	for(std::vector<MarshalledParam>::const_iterator iter = MarshalPlan.begin(); iter != MarshalPlan.end(); ++iter)
 	{
-		switch(paramclone->GetVariableType(*iter))
+		switch(iter->Type)
 		{
 		case EpochVariableType_Integer:
-			{
-				Integer32 intval = paramclone->GetVariableRef<VM::IntegerVariable>(*iter).GetValue();
-				StuffToPush.push_back(pushrec(intval, false));
-			}
+			arguments.push_back(static_cast<UINT_PTR>(paramclone->GetVariableRef<VM::IntegerVariable>(iter->Slot, *iter->Name).GetValue()));
 			break;
 
 		case EpochVariableType_Integer16:
-			{
-				Integer16 intval = paramclone->GetVariableRef<VM::Integer16Variable>(*iter).GetValue();
-				StuffToPush.push_back(pushrec(intval, true));
-			}
+			arguments.push_back(static_cast<UINT_PTR>(paramclone->GetVariableRef<VM::Integer16Variable>(iter->Slot, *iter->Name).GetValue()));
+			break;
 
 		case EpochVariableType_String:
-			{
-				const wchar_t* strval = paramclone->GetVariableRef<VM::StringVariable>(*iter).GetValue().c_str();
-				StuffToPush.push_back(pushrec(reinterpret_cast<UINT_PTR>(strval), false));
-			}
+			arguments.push_back(reinterpret_cast<UINT_PTR>(paramclone->GetVariableRef<VM::StringVariable>(iter->Slot, *iter->Name).GetValue().c_str()));
 			break;
 
 		case EpochVariableType_Structure:
 			{
-				VM::StructureVariable& structvar = paramclone->GetVariableRef<VM::StructureVariable>(*iter);
+				VM::StructureVariable& structvar = paramclone->GetVariableRef<VM::StructureVariable>(iter->Slot, *iter->Name);
+				if(iter->PassInPlace && structvar.GetValue() == iter->InPlaceStructureTypeID)
+				{
+					void* inplace = GetInPlaceCStruct(structvar);
+					if(inplace)
+					{
+						arguments.push_back(reinterpret_cast<UINT_PTR>(inplace));
+						break;
+					}
+				}
+
 				void* buffer = EpochToCStruct(structvar, *paramclone);
 				Buffers.BufferSet.push_back(reinterpret_cast<Byte*>(buffer));
 				Buffers.Variables.push_back(&structvar);
-				StuffToPush.push_back(pushrec(reinterpret_cast<UINT_PTR>(buffer), false));
+				arguments.push_back(reinterpret_cast<UINT_PTR>(buffer));
 			}
 			break;
 
 		case EpochVariableType_Function:
 			{
-				Function* func = dynamic_cast<Function*>(paramclone->GetFunction(*iter));
+				Function* func = dynamic_cast<Function*>(paramclone->GetFunction(*iter->Name));
 				if(!func)
 					throw ExecutionException("Only user defined functions can be passed to external DLL functions");
 
-				void* marshallptr = RequestMarshalledCallback(func);
-				StuffToPush.push_back(pushrec(reinterpret_cast<UINT_PTR>(marshallptr), false));
+				arguments.push_back(reinterpret_cast<UINT_PTR>(RequestMarshalledCallback(func)));
 			}
 			break;
 
 		case EpochVariableType_Buffer:
-			{
-				Byte* bufferptr = paramclone->GetVariableRef<VM::BufferVariable>(*iter).GetValue();
-				StuffToPush.push_back(pushrec(reinterpret_cast<UINT_PTR>(bufferptr), false));
-			}
+			arguments.push_back(reinterpret_cast<UINT_PTR>(paramclone->GetVariableRef<VM::BufferVariable>(iter->Slot, *iter->Name).GetValue()));
 			break;
 
 		default:
@@ -155,112 +266,82 @@ RValuePtr CallDLL::Invoke(ExecutionContext& context)
 		}
 	}
 
-	EpochVariableTypeID rettype = ReturnType;
+	UINT_PTR result = Stub(arguments.empty() ? NULL : &arguments[0], FunctionAddress);
+
+	CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
+	paramclone->Exit(context.Stack);
 
-	if(!StuffToPush.empty())
+	switch(ReturnType)
 	{
-		size_t pushstuffsize = StuffToPush.size();
-		void* theptr = &StuffToPush[0];
+	case EpochVariableType_Integer:
+		return RValuePtr(new IntegerRValue(static_cast<Integer32>(result)));
 
-		_asm
+	case EpochVariableType_Integer16:
+		return RValuePtr(new Integer16RValue(static_cast<Integer16>(result & 0xFFFF)));
+
+	case EpochVariableType_Boolean:
+		return RValuePtr(new BooleanRValue(result != 0));
+
+	case EpochVariableType_Array:
 		{
-			mov ebx, address		// We do this here just in case one of the above function calls uses ebx
-
-			mov eax, [theptr]
-			mov edx, eax
-			add edx, 4
-			mov ecx, pushstuffsize
-
-	BatchPushLoop:
-			cmp [edx], 0
-			jnz Push16
-			push [eax]
-			jmp FinishLoop
-	Push16:
-			mov edx, [eax]
-			push dx
-
-	FinishLoop:
-			add eax, 8
-			dec ecx
-			jnz BatchPushLoop
+			LibraryArrayReturnInfo* arrayret = reinterpret_cast<LibraryArrayReturnInfo*>(result);
+			RValuePtr ret(new ArrayRValue(*arrayret));
+			delete [] (reinterpret_cast<char*>(arrayret));
+			return ret;
 		}
 	}
-	else
-		__asm mov ebx, address
 
-	_asm
+	return RValuePtr(new NullRValue);
+}
+
+//
+// Invoke a library batch function
+//
+// The argument arrays are handed to the library in place, so the
+// entire batch is processed with a single transition into the DLL.
+//
+RValuePtr CallDLL::InvokeBatch(ExecutionContext& context)
+{
+	std::auto_ptr<ActivatedScope> paramclone(new ActivatedScope(*Params));
+	paramclone->BindToStack(context.Stack);
+
+	std::vector<const void*> arguments;
+	arguments.reserve(MarshalPlan.size());
+
+	size_t count = 0;
+	for(std::vector<MarshalledParam>::const_iterator iter = MarshalPlan.begin(); iter != MarshalPlan.end(); ++iter)
 	{
-		cmp rettype, EpochVariableType_Integer
-		jne TypeIsInteger16
-		call ebx
-		mov integerret, eax
-		jmp IntegerReturn
-
-TypeIsInteger16:
-		cmp rettype, EpochVariableType_Integer16
-		jne TypeIsBoolean
-		call ebx
-		mov integer16ret, ax
-		jmp Integer16Return
-
-TypeIsBoolean:
-		cmp rettype, EpochVariableType_Boolean
-		jne TypeIsNull
-		call ebx
-		test eax, eax
-		jz BoolIsFalse
-		mov integerret, 1
-		jmp BooleanReturn
-BoolIsFalse:
-		mov integerret, 0
-		jmp BooleanReturn
-
-TypeIsNull:
-		cmp rettype, EpochVariableType_Null
-		jne TypeIsArray
-		call ebx
-		jmp NullReturn
-
-TypeIsArray:
-		cmp rettype, EpochVariableType_Array
-		jne Vomit
-		call ebx
-		mov arrayret, eax
-		jmp ArrayReturn
-	}
+		EpochVariableTypeID elementtype;
+		size_t numelements;
+		const void* storage = paramclone->GetVariableRef<VM::ArrayVariable>(iter->Slot, *iter->Name).GetArrayInfo(elementtype, numelements);
 
-IntegerReturn:
-	CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
-	paramclone->Exit(context.Stack);
-	return RValuePtr(new IntegerRValue(integerret));
+		if(elementtype != iter->ElementType)
+			throw ExecutionException("Batched DLL call was given an array with the wrong element type");
 
-Integer16Return:
-	CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
-	paramclone->Exit(context.Stack);
-	return RValuePtr(new Integer16RValue(integer16ret));
+		if(iter == MarshalPlan.begin())
+			count = numelements;
+		else if(numelements != count)
+			throw ExecutionException("Batched DLL call arrays must all have the same number of elements");
 
-BooleanReturn:
-	CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
-	paramclone->Exit(context.Stack);
-	return RValuePtr(new BooleanRValue(integerret ? true : false));
+		arguments.push_back(storage);
+	}
 
-NullReturn:
-	CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
-	paramclone->Exit(context.Stack);
-	return RValuePtr(new NullRValue);
+	std::vector<Byte> results;
+	if(ReturnType == EpochVariableType_Array)
+		results.resize(TypeInfo::GetStorageSize(ReturnTypeHint) * count);
 
-ArrayReturn:
+	if(count)
 	{
-		CStructToEpoch(Buffers.BufferSet, Buffers.Variables);
-		paramclone->Exit(context.Stack);
-		RValuePtr ret(new ArrayRValue(*arrayret));
-		delete [] (reinterpret_cast<char*>(arrayret));
-		return ret;
+		LibraryBatchFuncPtr batchfunc = reinterpret_cast<LibraryBatchFuncPtr>(FunctionAddress);
+		batchfunc(arguments.empty() ? NULL : &arguments[0], results.empty() ? NULL : &results[0], count);
 	}
 
-Vomit:
-	throw VM::NotImplementedException("Not sure what to do with return value from DLL call; no function call was made");
+	paramclone->Exit(context.Stack);
+
+	if(ReturnType != EpochVariableType_Array)
+		return RValuePtr(new NullRValue);
+
+	return RValuePtr(new ArrayRValue(ReturnTypeHint, count, results.empty() ? NULL : &results[0]));
 }
 
 
@@ -295,3 +376,11 @@ void CallDLL::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+//
+// Traverse the call for optimization purposes
+//
+void CallDLL::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
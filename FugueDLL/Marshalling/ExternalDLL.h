@@ -11,6 +11,9 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+#include "Marshalling/CallStubs.h"
+#include "Utility/Threading/Synchronization.h"
 
 
 namespace Marshalling
@@ -19,11 +22,14 @@ namespace Marshalling
 	//
 	// Operation for invoking functions in external DLLs
 	//
+	// Batched calls invoke a library batch function once for an
+	// entire set of argument arrays; see LibraryBatchFuncPtr.
+	//
 	class CallDLL : public VM::FunctionBase, public VM::SelfAware<CallDLL>
 	{
 	// Construction and destruction
 	public:
-		CallDLL(const std::wstring& dllname, const std::wstring& functionname, VM::ScopeDescription* params, VM::EpochVariableTypeID returntype, VM::EpochVariableTypeID returntypehint);
+		CallDLL(const std::wstring& dllname, const std::wstring& functionname, VM::ScopeDescription* params, VM::EpochVariableTypeID returntype, VM::EpochVariableTypeID returntypehint, bool batched = false);
 		virtual ~CallDLL();
 
 	// Function/operation interface
@@ -48,6 +54,7 @@ namespace Marshalling
 		const std::wstring& GetFunctionName() const			{ return FunctionName; }
 		VM::EpochVariableTypeID GetReturnType() const		{ return ReturnType; }
 		VM::EpochVariableTypeID GetReturnTypeHint() const	{ return ReturnTypeHint; }
+		bool IsBatched() const								{ return Batched; }
 
 	// Traversal
 	public:
@@ -56,6 +63,12 @@ namespace Marshalling
 
 		virtual void Traverse(Validator::ValidationTraverser& traverser);
 		virtual void Traverse(Serialization::SerializationTraverser& traverser);
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
+
+	// Internal helpers
+	private:
+		void PrepareCall();
+		VM::RValuePtr InvokeBatch(VM::ExecutionContext& context);
 
 	// Internal storage
 	private:
@@ -64,6 +77,29 @@ namespace Marshalling
 		VM::ScopeDescription* Params;
 		VM::EpochVariableTypeID ReturnType;
 		VM::EpochVariableTypeID ReturnTypeHint;
+		bool Batched;
+
+	// Call information resolved on first invocation
+	private:
+		struct MarshalledParam
+		{
+			const std::wstring* Name;
+			VM::EpochVariableTypeID Type;
+			VM::VariableSlot Slot;
+
+			// Element type of batched call arguments
+			VM::EpochVariableTypeID ElementType;
+
+			// Structures which can be passed without conversion
+			IDType InPlaceStructureTypeID;
+			bool PassInPlace;
+		};
+
+		Threads::CriticalSection PrepareCriticalSection;
+		volatile bool Prepared;
+		void* FunctionAddress;
+		CallStub Stub;
+		std::vector<MarshalledParam> MarshalPlan;
 	};
 
 }
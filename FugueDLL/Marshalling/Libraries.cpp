@@ -19,6 +19,7 @@
 #include "Virtual Machine/VMExceptions.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Threading/Threads.h"
 
 
 
@@ -186,12 +187,62 @@ void __stdcall RegistrationSignature(const wchar_t* name, const ParamData* param
 	scope.AddFunctionSignature(name, signature, true);
 }
 
+//
+// This function is called by the external library DLL
+// to register a batch function with the VM.
+//
+// Each parameter is exposed to Epoch code as an array of
+// the registered type, and the function returns an array
+// of results; see LibraryBatchFuncPtr for details.
+//
+void __stdcall RegistrationBatchFunc(const wchar_t* name, const char* internalname, const ParamData* params, size_t numparams, VM::EpochVariableTypeID returntype, void* bindrecord)
+{
+	BindRec* realbindrecord = reinterpret_cast<BindRec*>(bindrecord);
+
+	std::auto_ptr<VM::ScopeDescription> paramscope(new VM::ScopeDescription);
+	const ParamData* p = params;
+	for(UInteger32 i = 0; i < numparams; ++i)
+	{
+		paramscope->AddVariable(p[i].Name, VM::EpochVariableType_Array);
+		paramscope->SetArrayType(p[i].Name, p[i].Type);
+	}
+
+	VM::EpochVariableTypeID batchreturntype = VM::EpochVariableType_Null;
+	VM::EpochVariableTypeID batchreturntypehint = VM::EpochVariableType_Error;
+	if(returntype != VM::EpochVariableType_Null)
+	{
+		batchreturntype = VM::EpochVariableType_Array;
+		batchreturntypehint = returntype;
+	}
+
+	VM::ScopeDescription& scope = realbindrecord->TheProgram->GetGlobalScope();
+	std::auto_ptr<VM::FunctionBase> func(new Marshalling::CallDLL(realbindrecord->DLLName, widen(internalname), paramscope.release(), batchreturntype, batchreturntypehint, true));
+	scope.AddFunction(name, func);
+}
+
 
 void* __stdcall RequestMarshalBuffer(size_t numbytes)
 {
 	return new char[numbytes];
 }
 
+Integer32 __stdcall WaitForTaskOrWindowMessage(UInteger32 timeoutms)
+{
+	switch(Threads::WaitForEventOrWindowMessage(timeoutms))
+	{
+	case Threads::WindowWait_TaskMessage:
+		return LibraryWait_TaskMessage;
+
+	case Threads::WindowWait_WindowMessage:
+		return LibraryWait_WindowMessage;
+
+	case Threads::WindowWait_TimedOut:
+		return LibraryWait_TimedOut;
+	}
+
+	return LibraryWait_Unsupported;
+}
+
 
 //
 // Call the specified DLL and ask it to register with the VM
@@ -214,8 +265,10 @@ void Marshalling::BindToLibrary(const std::wstring& filename, VM::Program& progr
 	regtable.RegisterStructure = RegistrationStructure;
 	regtable.RegisterExternal = RegistrationExternal;
 	regtable.RegisterSignature = RegistrationSignature;
+	regtable.RegisterBatchFunction = RegistrationBatchFunc;
 
 	regtable.RequestMarshalBuffer = RequestMarshalBuffer;
+	regtable.WaitForTaskOrWindowMessage = WaitForTaskOrWindowMessage;
 
 	BindRec bindrec;
 	bindrec.TheProgram = &program;
@@ -245,8 +298,10 @@ void Marshalling::BindToLanguageExtension(const std::wstring& filename, VM::Prog
 	regtable.RegisterStructure = RegistrationStructure;
 	regtable.RegisterExternal = RegistrationExternal;
 	regtable.RegisterSignature = RegistrationSignature;
+	regtable.RegisterBatchFunction = RegistrationBatchFunc;
 
 	regtable.RequestMarshalBuffer = RequestMarshalBuffer;
+	regtable.WaitForTaskOrWindowMessage = WaitForTaskOrWindowMessage;
 
 	regtable.ShouldRegisterEverything = registereverything;
 
@@ -173,3 +173,52 @@ void* Marshalling::EpochToCStruct(const StructureVariable& structvar, ActivatedS
 
 	return buffer;
 }
+
+
+//
+// Determine if a structure can be passed to external code in place
+//
+// Members are laid out at the same offsets in the C form of a structure
+// as in the Epoch form, so a structure made up purely of plain scalar
+// members is already in C form; only strings and function references
+// (which are stored as handles) and nested structures (which carry an
+// extra type identifier in Epoch form) need converting.
+//
+bool Marshalling::IsStructureLayoutCompatible(IDType structuretypeid)
+{
+	const StructureType& structtype = StructureTrackerClass::GetOwnerOfStructureType(structuretypeid)->GetStructureType(structuretypeid);
+	const std::vector<std::wstring>& members = structtype.GetMemberOrder();
+	for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
+	{
+		switch(structtype.GetMemberType(*iter))
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// Retrieve the C form of a layout compatible structure, without copying
+//
+// External code writes straight into the Epoch structure, so there is no
+// need to convert the structure back after the call. Returns NULL if the
+// structure's storage is not suitably aligned for the C side, in which
+// case the structure must be converted as usual.
+//
+void* Marshalling::GetInPlaceCStruct(StructureVariable& structvar)
+{
+	Byte* members = reinterpret_cast<Byte*>(structvar.GetStorage()) + structvar.GetBaseStorageSize();
+	if(reinterpret_cast<UINT_PTR>(members) % sizeof(Integer32))
+		return NULL;
+
+	return members;
+}
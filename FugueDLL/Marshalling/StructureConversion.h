@@ -21,5 +21,8 @@ namespace Marshalling
 {
 	void CStructToEpoch(const std::vector<Byte*>& buffers, const std::vector<VM::StructureVariable*> variables);
 	void* EpochToCStruct(const VM::StructureVariable& structvar, VM::ActivatedScope& params);
+
+	bool IsStructureLayoutCompatible(IDType structuretypeid);
+	void* GetInPlaceCStruct(VM::StructureVariable& structvar);
 }
 
@@ -0,0 +1,60 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for finding code which can be spread across threads
+//
+// This pass is opt-in (see the autoparallelize option) and relies on the
+// validator's task safety checks to decide whether a piece of code could
+// run concurrently with other code. Map operations whose functions pass
+// the checks are committed to parallel execution up front, instead of the
+// check being made when the map first runs. While loops whose bodies pass
+// the checks are reported as candidates for parallelfor(); they are not
+// rewritten, since the task safety checks do not rule out dependencies
+// between iterations through the loop counter or other local variables.
+// All findings are recorded on the traverser for reporting to the user.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Auto Parallelization/AutoParallelization.h"
+#include "Optimizer/Optimizer.h"
+
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+
+#include "Virtual Machine/Core Entities/Program.h"
+
+#include "Validator/Task Safety/TaskSafety.h"
+
+
+using namespace Optimizer;
+
+
+//
+// Decide whether a map operation will be split across the shared worker pool
+//
+void AutoParallelizationWrapper::AnalyzeMap(OptimizationTraverser& traverser, VM::Operations::MapOperation& op)
+{
+	if(!traverser.CurrentProgram)
+		throw VM::InternalFailureException("Tried to analyze a map operation, but no program is currently set");
+
+	if(op.CanRunInParallel(*traverser.CurrentProgram))
+		traverser.RecordParallelization(&op, L"map() will be split across the shared worker pool for large arrays");
+	else
+		traverser.RecordParallelization(&op, L"map() must run sequentially; the mapped function is not task safe");
+}
+
+//
+// Determine whether a while loop is a candidate for parallel execution
+//
+void AutoParallelizationWrapper::AnalyzeWhileLoop(OptimizationTraverser& traverser, VM::Operations::WhileLoop& op)
+{
+	if(!traverser.CurrentProgram)
+		throw VM::InternalFailureException("Tried to analyze a while loop, but no program is currently set");
+
+	VM::Block* body = op.GetBody();
+	if(body && Validator::IsTaskSafe(*traverser.CurrentProgram, *body))
+		traverser.RecordParallelization(&op, L"while() loop body is task safe; consider parallelfor() if its iterations are independent");
+}
+
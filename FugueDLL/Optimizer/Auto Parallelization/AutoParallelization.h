@@ -0,0 +1,57 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for finding code which can be spread across threads
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	namespace Operations
+	{
+		class MapOperation;
+		class WhileLoop;
+	}
+}
+
+
+namespace Optimizer
+{
+
+	class OptimizationTraverser;
+
+	//
+	// Explicit specializations of this function examine the operations
+	// which may be able to run in parallel; the general case is a no-op,
+	// since most operations are of no interest to the analysis.
+	//
+	template <class OperationClass>
+	void FindParallelism(OperationClass& op, OptimizationTraverser& traverser)
+	{ }
+
+
+	//
+	// This class provides a handy way to pass "friend" access over to
+	// the analysis logic from the traverser code.
+	//
+	class AutoParallelizationWrapper
+	{
+	// Analysis helpers
+	public:
+		static void AnalyzeMap(OptimizationTraverser& traverser, VM::Operations::MapOperation& op);
+		static void AnalyzeWhileLoop(OptimizationTraverser& traverser, VM::Operations::WhileLoop& op);
+	};
+
+
+	template <> inline void FindParallelism<VM::Operations::MapOperation>(VM::Operations::MapOperation& op, OptimizationTraverser& traverser)
+	{ AutoParallelizationWrapper::AnalyzeMap(traverser, op); }
+
+	template <> inline void FindParallelism<VM::Operations::WhileLoop>(VM::Operations::WhileLoop& op, OptimizationTraverser& traverser)
+	{ AutoParallelizationWrapper::AnalyzeWhileLoop(traverser, op); }
+
+}
+
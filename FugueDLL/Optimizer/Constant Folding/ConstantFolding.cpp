@@ -0,0 +1,304 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for folding constant expressions
+//
+// Arithmetic on literal values is evaluated every time the containing
+// block runs, which can add up quickly inside loops. This pass scans
+// each block for arithmetic and negation operations whose operands are
+// all literals, and replaces the whole sequence with a single push of
+// the precomputed result. Results of folding are themselves literals,
+// so nested constant expressions collapse completely in a single pass.
+//
+// The pass also removes standalone operations which have no effects on
+// program state at all, such as arithmetic operations whose results are
+// never used and bare constants; their ExecuteFast implementations do
+// nothing, so the only cost of keeping them around is the dispatch.
+//
+// Divisions which would fail at runtime are deliberately left alone, so
+// that the error is still reported when (and if) the code executes.
+//
+// As with operation fusion, blocks executed with some leading operations
+// skipped are unaffected, because the skipped operations are neither
+// foldable nor dead, and therefore keep their positions.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Constant Folding/ConstantFolding.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/UtilityOps.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+
+#include <limits>
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Retrieve the operation nested in a push operation, if any
+	//
+	const Operation* GetPushedOperation(const Operation* op)
+	{
+		if(!dynamic_cast<const PushOperation*>(op))
+			return NULL;
+
+		return op->GetNestedOperation();
+	}
+
+
+	//
+	// Helpers for reading literal values; both direct literal
+	// pushes and pushed constant operations are recognized
+	//
+	template <class LiteralOperationClass, class ConstantOperationClass, typename ValueType>
+	bool ReadLiteralOperation(const Operation* op, ValueType& value)
+	{
+		if(const LiteralOperationClass* literal = dynamic_cast<const LiteralOperationClass*>(op))
+		{
+			value = literal->GetValue();
+			return true;
+		}
+
+		if(const ConstantOperationClass* constant = dynamic_cast<const ConstantOperationClass*>(GetPushedOperation(op)))
+		{
+			value = constant->GetValue();
+			return true;
+		}
+
+		return false;
+	}
+
+	bool ReadLiteral(const Operation* op, Integer32& value)
+	{ return ReadLiteralOperation<PushIntegerLiteral, IntegerConstant>(op, value); }
+
+	bool ReadLiteral(const Operation* op, Integer16& value)
+	{ return ReadLiteralOperation<PushInteger16Literal, Integer16Constant>(op, value); }
+
+	bool ReadLiteral(const Operation* op, Real& value)
+	{ return ReadLiteralOperation<PushRealLiteral, RealConstant>(op, value); }
+
+
+	//
+	// Helpers for creating literal pushes of folded values
+	//
+	Operation* CreateLiteral(Integer32 value)
+	{ return new PushIntegerLiteral(value); }
+
+	Operation* CreateLiteral(Integer16 value)
+	{ return new PushInteger16Literal(value); }
+
+	Operation* CreateLiteral(Real value)
+	{ return new PushRealLiteral(value); }
+
+
+	//
+	// Determine if dividing by the given value can be safely done ahead of time
+	//
+	template <typename ValueType>
+	bool CanFoldDivision(ValueType dividend, ValueType divisor)
+	{
+		if(divisor == 0)
+			return false;
+
+		if(std::numeric_limits<ValueType>::is_integer && divisor == -1 && dividend == std::numeric_limits<ValueType>::min())
+			return false;
+
+		return true;
+	}
+
+
+	//
+	// Wrapper for tracking the results of the folding process
+	//
+	// Operations are appended to the output list as they are scanned, so
+	// when an operation which consumes stack values is reached, the ops
+	// that produce those values are always at the tail of the output.
+	//
+	class FoldingState
+	{
+	// Construction
+	public:
+		explicit FoldingState(size_t numoperations)
+		{ Output.reserve(numoperations); }
+
+	// Folding interface
+	public:
+		template <typename ValueType>
+		bool ReadTailLiteral(size_t offsetfromend, ValueType& value) const
+		{
+			if(offsetfromend >= Output.size())
+				return false;
+
+			return ReadLiteral(Output[Output.size() - offsetfromend - 1], value);
+		}
+
+		void Replace(size_t numtailops, Operation* original, Operation* replacement)
+		{
+			Discarded.insert(Discarded.end(), Output.end() - numtailops, Output.end());
+			Output.erase(Output.end() - numtailops, Output.end());
+			Discarded.push_back(original);
+			Output.push_back(replacement);
+		}
+
+		void Keep(Operation* op)
+		{ Output.push_back(op); }
+
+		void Discard(Operation* op)
+		{ Discarded.push_back(op); }
+
+	// Folding results
+	public:
+		std::vector<Operation*> Output;
+		std::vector<Operation*> Discarded;
+	};
+
+
+	//
+	// Attempt to fold an arithmetic operation with constant scalar operands
+	//
+	template <ArithmeticOpType OpType, class VarType, class RValueType>
+	bool FoldArithmetic(FoldingState& state, Operation* pushop, const Operation* nested)
+	{
+		const ArithmeticOp<OpType, VarType, RValueType>* arithmeticop = dynamic_cast<const ArithmeticOp<OpType, VarType, RValueType>*>(nested);
+		if(!arithmeticop)
+			return false;
+
+		if(arithmeticop->GetNumParameters() != 2 || arithmeticop->IsFirstArray() || arithmeticop->IsSecondArray())
+			return false;
+
+		typename VarType::BaseStorage one, two;
+		if(!state.ReadTailLiteral(1, one) || !state.ReadTailLiteral(0, two))
+			return false;
+
+		if(OpType == Arithmetic_Divide && !CanFoldDivision(one, two))
+			return false;
+
+		typename VarType::BaseStorage result = ApplyArithmeticOperator<OpType, typename VarType::BaseStorage>(one, two);
+		state.Replace(2, pushop, CreateLiteral(result));
+		return true;
+	}
+
+	template <class VarType, class RValueType>
+	bool FoldArithmetic(FoldingState& state, Operation* pushop, const Operation* nested)
+	{
+		return FoldArithmetic<Arithmetic_Add, VarType, RValueType>(state, pushop, nested)
+			|| FoldArithmetic<Arithmetic_Subtract, VarType, RValueType>(state, pushop, nested)
+			|| FoldArithmetic<Arithmetic_Multiply, VarType, RValueType>(state, pushop, nested)
+			|| FoldArithmetic<Arithmetic_Divide, VarType, RValueType>(state, pushop, nested);
+	}
+
+	//
+	// Attempt to fold the negation of a constant value
+	//
+	template <typename ValueType>
+	bool FoldNegation(FoldingState& state, Operation* pushop)
+	{
+		ValueType value;
+		if(!state.ReadTailLiteral(0, value))
+			return false;
+
+		state.Replace(1, pushop, CreateLiteral(static_cast<ValueType>(-value)));
+		return true;
+	}
+
+	bool FoldNegation(FoldingState& state, Operation* pushop, const Negate& negate)
+	{
+		switch(negate.GetOperandType())
+		{
+		case EpochVariableType_Integer:		return FoldNegation<Integer32>(state, pushop);
+		case EpochVariableType_Integer16:	return FoldNegation<Integer16>(state, pushop);
+		case EpochVariableType_Real:		return FoldNegation<Real>(state, pushop);
+		}
+
+		return false;
+	}
+
+	//
+	// Attempt to fold a pushed operation with constant operands
+	//
+	bool FoldPushedOperation(FoldingState& state, Operation* pushop)
+	{
+		const Operation* nested = pushop->GetNestedOperation();
+		if(!nested)
+			return false;
+
+		if(const Negate* negate = dynamic_cast<const Negate*>(nested))
+			return FoldNegation(state, pushop, *negate);
+
+		return FoldArithmetic<IntegerVariable, IntegerRValue>(state, pushop, nested)
+			|| FoldArithmetic<Integer16Variable, Integer16RValue>(state, pushop, nested)
+			|| FoldArithmetic<RealVariable, RealRValue>(state, pushop, nested);
+	}
+
+
+	//
+	// Determine if an operation is an arithmetic operation on the given type
+	//
+	template <class VarType, class RValueType>
+	bool IsArithmeticOperation(const Operation* op)
+	{
+		return dynamic_cast<const ArithmeticOp<Arithmetic_Add, VarType, RValueType>*>(op)
+			|| dynamic_cast<const ArithmeticOp<Arithmetic_Subtract, VarType, RValueType>*>(op)
+			|| dynamic_cast<const ArithmeticOp<Arithmetic_Multiply, VarType, RValueType>*>(op)
+			|| dynamic_cast<const ArithmeticOp<Arithmetic_Divide, VarType, RValueType>*>(op);
+	}
+
+	//
+	// Determine if an operation has no effect when executed standalone
+	//
+	// Note that the parameters of a standalone arithmetic operation are
+	// still evaluated and pushed onto the stack; only the arithmetic
+	// operation itself is a no-op.
+	//
+	bool IsDeadOperation(const Operation* op)
+	{
+		if(op->IsNode<NoOp>())
+			return true;
+
+		if(op->IsNode<IntegerConstant>() || op->IsNode<Integer16Constant>()
+		|| op->IsNode<RealConstant>() || op->IsNode<BooleanConstant>())
+			return true;
+
+		return IsArithmeticOperation<IntegerVariable, IntegerRValue>(op)
+			|| IsArithmeticOperation<Integer16Variable, Integer16RValue>(op)
+			|| IsArithmeticOperation<RealVariable, RealRValue>(op);
+	}
+
+}
+
+
+//
+// Fold constant expressions and remove dead operations in the given block
+//
+void Optimizer::FoldConstants(VM::Block& block)
+{
+	const std::vector<Operation*>& originalops = static_cast<const VM::Block&>(block).GetAllOperations();
+
+	FoldingState state(originalops.size());
+	for(std::vector<Operation*>::const_iterator iter = originalops.begin(); iter != originalops.end(); ++iter)
+	{
+		if(IsDeadOperation(*iter))
+			state.Discard(*iter);
+		else if(!dynamic_cast<const PushOperation*>(*iter) || !FoldPushedOperation(state, *iter))
+			state.Keep(*iter);
+	}
+
+	if(state.Discarded.empty())
+		return;
+
+	block.GetAllOperations().swap(state.Output);
+
+	for(std::vector<Operation*>::iterator iter = state.Discarded.begin(); iter != state.Discarded.end(); ++iter)
+		delete *iter;
+}
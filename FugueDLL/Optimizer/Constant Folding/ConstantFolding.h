@@ -0,0 +1,24 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for folding constant expressions
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Block;
+}
+
+
+namespace Optimizer
+{
+
+	void FoldConstants(VM::Block& block);
+
+}
+
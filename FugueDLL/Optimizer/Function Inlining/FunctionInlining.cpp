@@ -0,0 +1,145 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for calling small functions inline
+//
+// Every ordinary function call builds activated scopes for the function's
+// parameters, return values, and code, each with its own copy of the frame
+// layout. For small accessor-style functions this setup costs far
+// more than running the body itself. Functions which pass the checks below
+// are switched over to inline calls: their activated scopes are built once
+// and then kept with the function, so that each call only needs to bind the
+// scopes to the stack and run the body.
+//
+// Operations are owned by the block that contains them, and function bodies
+// are shared by every call site, so the body is not copied into each caller;
+// the operations (and their entries in the debug table) therefore remain in
+// exactly one place.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Function Inlining/FunctionInlining.h"
+#include "Optimizer/Optimizer.h"
+
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Operations/Concurrency/Tasks.h"
+#include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+
+
+using namespace Optimizer;
+
+
+namespace
+{
+
+	//
+	// Largest function body (in operations, counting nested
+	// operations) which is considered for inline calls
+	//
+	const size_t MaxInlinedOperations = 16;
+
+
+	//
+	// Check an operation (and any operations nested in it) for
+	// constructs that rule out inline calls to the given function
+	//
+	// Operations are counted as they are checked, so that bodies
+	// which turn out to be too large can be rejected early.
+	//
+	bool CanRunInline(const VM::Operation* op, const VM::Function& function, size_t& numoperations)
+	{
+		for(; op; op = op->GetNestedOperation())
+		{
+			if(++numoperations > MaxInlinedOperations)
+				return false;
+
+			// Nested blocks cover control flow and task bodies
+			if(op->GetAttachedCodeBlock())
+				return false;
+
+			const VM::Operations::Invoke* invoke = op->AsNode<VM::Operations::Invoke>();
+			if(invoke && invoke->GetFunction() == &function)
+				return false;
+
+			if(op->IsNode<VM::Operations::ForkTask>()
+			|| op->IsNode<VM::Operations::ForkThread>()
+			|| op->IsNode<VM::Operations::CreateThreadPool>()
+			|| op->IsNode<VM::Operations::ForkFuture>()
+			|| op->IsNode<VM::Operations::ForkDependentFuture>()
+			|| op->IsNode<VM::Operations::ParallelInvoke>()
+			|| op->IsNode<VM::Operations::CreateGenerator>()
+			|| op->IsNode<VM::Operations::YieldValue>()
+			|| op->IsNode<VM::Operations::SendTaskMessage>()
+			|| op->IsNode<VM::Operations::BroadcastTaskMessage>()
+			|| op->IsNode<VM::Operations::DelayedSendTaskMessage>()
+			|| op->IsNode<VM::Operations::SendTaskRequest>()
+			|| op->IsNode<VM::Operations::ReplyToRequest>()
+			|| op->IsNode<VM::Operations::AcceptMessage>()
+			|| op->IsNode<VM::Operations::AcceptMessageFromResponseMap>()
+			|| op->IsNode<VM::Operations::AcceptMessageWithTimeout>()
+			|| op->IsNode<VM::Operations::GetTaskCaller>()
+			|| op->IsNode<VM::Operations::GetMessageSender>())
+				return false;
+		}
+
+		return true;
+	}
+
+}
+
+
+//
+// Switch the function called by an invocation over to inline calls, if possible
+//
+void FunctionInliningWrapper::AnalyzeInvoke(OptimizationTraverser& traverser, VM::Operations::Invoke& op)
+{
+	VM::Function* function = dynamic_cast<VM::Function*>(op.GetFunction());
+	if(!function || function->IsCalledInline())
+		return;
+
+	if(IsInlineCandidate(*function))
+		function->EnableInlineCalls();
+}
+
+//
+// Determine if a function is small and simple enough to be called inline
+//
+// Functions whose code has not been loaded yet are left alone, as are
+// functions which take other functions as parameters; those parameters
+// are added to the parameter scope each time it is bound, and so the
+// scope cannot be carried over from one call to the next.
+//
+bool FunctionInliningWrapper::IsInlineCandidate(const VM::Function& function)
+{
+	const VM::Block* body = function.GetCodeBlock();
+	if(!body || !body->GetBoundScope())
+		return false;
+
+	const VM::ScopeDescription& params = function.GetParams();
+	const std::vector<std::wstring>& members = params.GetMemberOrder();
+	for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
+	{
+		if(params.IsFunctionSignature(*iter))
+			return false;
+	}
+
+	size_t numoperations = 0;
+	const std::vector<VM::Operation*>& ops = body->GetAllOperations();
+	for(std::vector<VM::Operation*>::const_iterator iter = ops.begin(); iter != ops.end(); ++iter)
+	{
+		if(!CanRunInline(*iter, function, numoperations))
+			return false;
+	}
+
+	return true;
+}
+
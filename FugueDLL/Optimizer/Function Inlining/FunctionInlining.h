@@ -0,0 +1,57 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for calling small functions inline
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Function;
+
+	namespace Operations
+	{
+		class Invoke;
+	}
+}
+
+
+namespace Optimizer
+{
+
+	class OptimizationTraverser;
+
+	//
+	// Explicit specializations of this function examine the operations
+	// which call functions that may be invoked inline; the general case
+	// is a no-op, since most operations do not call any functions.
+	//
+	template <class OperationClass>
+	void InlineFunctionCalls(OperationClass& op, OptimizationTraverser& traverser)
+	{ }
+
+
+	//
+	// This class provides a handy way to pass "friend" access over to
+	// the inlining logic from the traverser code.
+	//
+	class FunctionInliningWrapper
+	{
+	// Analysis helpers
+	public:
+		static void AnalyzeInvoke(OptimizationTraverser& traverser, VM::Operations::Invoke& op);
+
+	private:
+		static bool IsInlineCandidate(const VM::Function& function);
+	};
+
+
+	template <> inline void InlineFunctionCalls<VM::Operations::Invoke>(VM::Operations::Invoke& op, OptimizationTraverser& traverser)
+	{ FunctionInliningWrapper::AnalyzeInvoke(traverser, op); }
+
+}
+
@@ -0,0 +1,154 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for running consecutive extension control blocks together
+//
+// Programs using the CUDA extension frequently contain several cudafor
+// loops in a row over the same range, each operating on the results of
+// the one before. Handing each loop to the extension separately means
+// each one pays for copying all of its variables to the device and back.
+// This pass finds runs of control handoffs to the same extension keyword
+// which directly follow one another, and whose parameters are pushed as
+// identical literals, and replaces each run by a single operation which
+// hands all of the blocks to the extension at once. The extension is then
+// free to keep the data on the device between the blocks.
+//
+// Only literal parameters are considered, so that the ranges are known to
+// match without evaluating anything; constant expressions have already
+// been folded into literals by the time this pass runs. Whether the blocks
+// can actually share their data is up to the extension, which knows which
+// variables each block reads and writes; see FusedHandoffControlOperation.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Handoff Fusion/HandoffFusion.h"
+
+#include "Language Extensions/Handoff.h"
+#include "Language Extensions/FunctionPointerTypes.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+
+#include "Virtual Machine/Operations/StackOps.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Determine if two operations push the same literal value
+	//
+	template <class LiteralOperationClass>
+	bool IsSameLiteral(const Operation* first, const Operation* second, bool& matched)
+	{
+		const LiteralOperationClass* firstliteral = dynamic_cast<const LiteralOperationClass*>(first);
+		if(!firstliteral)
+			return false;
+
+		const LiteralOperationClass* secondliteral = dynamic_cast<const LiteralOperationClass*>(second);
+		matched = (secondliteral && firstliteral->GetValue() == secondliteral->GetValue());
+		return true;
+	}
+
+	bool PushSameLiteral(const Operation* first, const Operation* second)
+	{
+		bool matched = false;
+		if(IsSameLiteral<PushIntegerLiteral>(first, second, matched)
+		|| IsSameLiteral<PushInteger16Literal>(first, second, matched)
+		|| IsSameLiteral<PushRealLiteral>(first, second, matched)
+		|| IsSameLiteral<PushBooleanLiteral>(first, second, matched))
+			return matched;
+
+		return false;
+	}
+
+	//
+	// Count the parameters pushed onto the stack for a control handoff
+	//
+	size_t CountPushedParameters(const Extensions::HandoffControlOperation& handoff)
+	{
+		size_t count = 0;
+
+		const std::vector<Extensions::ExtensionControlParamInfo>& params = Extensions::GetParamsForControl(handoff.GetExtensionName());
+		for(std::vector<Extensions::ExtensionControlParamInfo>::const_iterator iter = params.begin(); iter != params.end(); ++iter)
+		{
+			if(!iter->CreatesLocalVariable)
+				++count;
+		}
+
+		return count;
+	}
+
+	//
+	// Determine if a handoff can join a run begun by another handoff
+	//
+	// The parameters of each handoff are pushed by the operations directly
+	// preceding it; the later handoff's pushes must match the earlier's.
+	//
+	bool CanJoinRun(const std::vector<Operation*>& operations, size_t firstindex, size_t laterindex, size_t numparams)
+	{
+		const Extensions::HandoffControlOperation& first = *dynamic_cast<const Extensions::HandoffControlOperation*>(operations[firstindex]);
+		const Extensions::HandoffControlOperation* later = dynamic_cast<const Extensions::HandoffControlOperation*>(operations[laterindex]);
+		if(!later || later->GetExtensionHandle() != first.GetExtensionHandle() || later->GetExtensionName() != first.GetExtensionName())
+			return false;
+
+		for(size_t i = 1; i <= numparams; ++i)
+		{
+			if(!PushSameLiteral(operations[firstindex - i], operations[laterindex - i]))
+				return false;
+		}
+
+		return true;
+	}
+
+}
+
+
+//
+// Replace all runs of matching control handoffs in the given block
+//
+void Optimizer::FuseHandoffs(VM::Block& block)
+{
+	const std::vector<Operation*>& originalops = static_cast<const VM::Block&>(block).GetAllOperations();
+
+	std::vector<Operation*> fusedops;
+	fusedops.reserve(originalops.size());
+	bool fusedany = false;
+
+	for(size_t i = 0; i < originalops.size(); )
+	{
+		const Extensions::HandoffControlOperation* handoff = dynamic_cast<const Extensions::HandoffControlOperation*>(originalops[i]);
+		if(!handoff)
+		{
+			fusedops.push_back(originalops[i++]);
+			continue;
+		}
+
+		size_t numparams = CountPushedParameters(*handoff);
+		size_t runend = i + 1;
+		if(i >= numparams)
+		{
+			while(runend + numparams < originalops.size() && CanJoinRun(originalops, i, runend + numparams, numparams))
+				runend += numparams + 1;
+		}
+
+		if(runend == i + 1)
+		{
+			fusedops.push_back(originalops[i++]);
+			continue;
+		}
+
+		std::vector<Operation*> run(originalops.begin() + i, originalops.begin() + runend);
+		fusedops.push_back(new Extensions::FusedHandoffControlOperation(run));
+		fusedany = true;
+		i = runend;
+	}
+
+	if(fusedany)
+		block.GetAllOperations().swap(fusedops);
+}
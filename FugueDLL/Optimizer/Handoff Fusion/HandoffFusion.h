@@ -0,0 +1,23 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for running consecutive extension control blocks together
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Block;
+}
+
+
+namespace Optimizer
+{
+
+	void FuseHandoffs(VM::Block& block);
+
+}
@@ -0,0 +1,145 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for lowering if/elseif chains into jump tables
+//
+// Dispatch on message types or state machine states is usually written
+// as a long if/elseif chain, each clause comparing the same variable
+// against a different literal. Executing such a chain tests every
+// condition in turn until one matches, so the cost grows with the number
+// of clauses. This pass recognizes chains in which every condition is an
+// integer equality test on the same variable, and replaces the chain with
+// a single switch operation which finds the right clause directly (see
+// FusedIntegerSwitch for details).
+//
+// The conditions are recognized in their fused form, so this pass must
+// run after operation fusion. Fused comparisons have no side effects, so
+// skipping the tests of the clauses before the matching one does not
+// change the program's behavior.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Jump Tables/JumpTables.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Virtual Machine/Operations/FusedOps.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Smallest number of clauses (counting the initial if)
+	// for which a chain is replaced by a switch
+	//
+	const size_t MinJumpTableClauses = 4;
+
+
+	typedef FusedVariableLiteralComparison<FusedComparison_Equal, IntegerVariable> IntegerEqualityTest;
+
+
+	//
+	// Retrieve the integer equality test performed by an operation, if any
+	//
+	const IntegerEqualityTest* GetEqualityTest(const Operation* op)
+	{
+		const IntegerEqualityTest* test = dynamic_cast<const IntegerEqualityTest*>(op);
+		if(!test || !test->GetVariableSlot().IsResolved())
+			return NULL;
+
+		return test;
+	}
+
+	//
+	// Determine if an equality test examines the given variable
+	//
+	bool TestsSameVariable(const IntegerEqualityTest& test, const VariableSlot& slot)
+	{
+		return (test.GetVariableSlot().OwnerScope == slot.OwnerScope && test.GetVariableSlot().MemberIndex == slot.MemberIndex);
+	}
+
+	//
+	// Collect the clauses of an if/elseif chain which tests the given variable
+	//
+	// Returns false if any clause of the chain does not fit the pattern.
+	//
+	bool CollectClauses(If& ifop, const IntegerEqualityTest& firsttest, std::vector<FusedIntegerSwitch::Case>& cases)
+	{
+		ElseIfWrapper* wrapper = ifop.GetElseIfBlock();
+		if(!wrapper || !wrapper->GetBlock())
+			return false;
+
+		// The switch enters the elseif bodies directly, skipping the
+		// wrapper's own scope; this is only possible if that scope is empty
+		const Block& wrapperblock = *wrapper->GetBlock();
+		if(!wrapperblock.GetBoundScope() || wrapperblock.GetBoundScope()->GetNumMembers() != 0)
+			return false;
+
+		const std::vector<Operation*>& ops = wrapperblock.GetAllOperations();
+		if(ops.size() % 2 != 0)
+			return false;
+
+		FusedIntegerSwitch::Case firstcase;
+		firstcase.Value = firsttest.GetLiteralValue();
+		firstcase.Body = ifop.GetTrueBlock();
+		cases.push_back(firstcase);
+
+		for(size_t i = 0; i < ops.size(); i += 2)
+		{
+			const IntegerEqualityTest* test = GetEqualityTest(ops[i]);
+			ElseIf* elseif = dynamic_cast<ElseIf*>(ops[i + 1]);
+			if(!test || !elseif || !elseif->GetBlock() || !TestsSameVariable(*test, firsttest.GetVariableSlot()))
+				return false;
+
+			FusedIntegerSwitch::Case clause;
+			clause.Value = test->GetLiteralValue();
+			clause.Body = elseif->GetBlock();
+			cases.push_back(clause);
+		}
+
+		return true;
+	}
+
+}
+
+
+//
+// Replace all suitable if/elseif chains in the given block with switches
+//
+void Optimizer::BuildJumpTables(VM::Block& block)
+{
+	const std::vector<Operation*>& originalops = static_cast<const VM::Block&>(block).GetAllOperations();
+
+	std::vector<Operation*> loweredops;
+	bool lowered = false;
+	loweredops.reserve(originalops.size());
+
+	for(size_t i = 0; i < originalops.size(); ++i)
+	{
+		const IntegerEqualityTest* test = GetEqualityTest(originalops[i]);
+		If* ifop = (i + 1 < originalops.size()) ? dynamic_cast<If*>(originalops[i + 1]) : NULL;
+
+		std::vector<FusedIntegerSwitch::Case> cases;
+		if(test && ifop && CollectClauses(*ifop, *test, cases) && cases.size() >= MinJumpTableClauses)
+		{
+			std::vector<Operation*> replacedops(originalops.begin() + i, originalops.begin() + i + 2);
+			loweredops.push_back(new FusedIntegerSwitch(test->GetAssociatedIdentifier(), test->GetVariableSlot(), cases, ifop->GetFalseBlock(), replacedops));
+			lowered = true;
+			++i;
+		}
+		else
+			loweredops.push_back(originalops[i]);
+	}
+
+	if(lowered)
+		block.GetAllOperations().swap(loweredops);
+}
@@ -0,0 +1,23 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for lowering if/elseif chains into jump tables
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Block;
+}
+
+
+namespace Optimizer
+{
+
+	void BuildJumpTables(VM::Block& block);
+
+}
@@ -0,0 +1,447 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for hoisting loop invariant values out of while loops
+//
+// The body of a while loop is executed in full on every iteration, even
+// though some of the values it computes cannot change from one iteration
+// to the next; a loop which walks an array typically reads the length of
+// the array each time around, for instance. While the body of a loop is
+// traversed, we record the names of all variables which the body may
+// write to. Once the body has been fully processed, any pure reads of
+// variables outside that set (array and string lengths, storage sizes,
+// and structure members) are moved out of the body, and computed once
+// before the loop starts; the body then simply copies the precomputed
+// values (see FusedPushLoopInvariant for details).
+//
+// Only reads of local variables owned by an enclosing scope are hoisted.
+// Globals may be changed by any function called from the loop, and
+// references may alias variables which are written under another name.
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
+#include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Operations/Concurrency/Tasks.h"
+#include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/Bitwise.h"
+#include "Virtual Machine/Operations/Operators/Comparison.h"
+#include "Virtual Machine/Operations/Operators/CompoundOperator.h"
+#include "Virtual Machine/Operations/Operators/Logical.h"
+#include "Virtual Machine/Operations/Variables/StringOps.h"
+#include "Virtual Machine/Operations/Variables/StructureOps.h"
+#include "Virtual Machine/Operations/Variables/TupleOps.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+#include "Virtual Machine/Operations/Debugging.h"
+#include "Virtual Machine/Operations/FusedOps.h"
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/UtilityOps.h"
+#include "Virtual Machine/Operations/Typedefs.h"
+
+#include "Marshalling/ExternalDLL.h"
+
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/Block.h"
+
+#include "Virtual Machine/Types Management/TypeInfo.h"
+
+#include "Language Extensions/Handoff.h"
+
+#include "Optimizer/Loop Invariants/LoopInvariants.h"
+#include "Optimizer/Optimizer.h"
+
+
+using namespace Optimizer;
+
+
+namespace
+{
+
+	//
+	// Retrieve the variable read by an operation which is a candidate
+	// for hoisting, or NULL if the operation is not a pure read
+	//
+	template <class OperationClass>
+	const std::wstring* GetPureReadIdentifier(const VM::Operation* op)
+	{
+		const OperationClass* readop = dynamic_cast<const OperationClass*>(op);
+		if(!readop)
+			return NULL;
+
+		return &readop->GetAssociatedIdentifier();
+	}
+
+	const std::wstring* GetPureReadIdentifier(const VM::Operation* op)
+	{
+		const std::wstring* varname = GetPureReadIdentifier<VM::Operations::ArrayLength>(op);
+		if(!varname)
+			varname = GetPureReadIdentifier<VM::Operations::Length>(op);
+		if(!varname)
+			varname = GetPureReadIdentifier<VM::Operations::SizeOf>(op);
+		if(!varname)
+			varname = GetPureReadIdentifier<VM::Operations::ReadStructure>(op);
+
+		return varname;
+	}
+
+	//
+	// Create the operation which replaces a hoisted value in the loop body
+	//
+	VM::Operation* CreateInvariantPush(VM::EpochVariableTypeID type, size_t offset)
+	{
+		switch(type)
+		{
+		case VM::EpochVariableType_Integer:		return new VM::Operations::FusedPushLoopInvariant<VM::IntegerVariable>(offset);
+		case VM::EpochVariableType_Integer16:	return new VM::Operations::FusedPushLoopInvariant<VM::Integer16Variable>(offset);
+		case VM::EpochVariableType_Real:		return new VM::Operations::FusedPushLoopInvariant<VM::RealVariable>(offset);
+		case VM::EpochVariableType_Boolean:		return new VM::Operations::FusedPushLoopInvariant<VM::BooleanVariable>(offset);
+		}
+
+		throw VM::InternalFailureException("Cannot hoist a loop invariant value of this type");
+	}
+
+}
+
+
+//
+// Begin tracking writes for the body of a while loop
+//
+// Loops whose bodies have already been traversed are left alone, since
+// the traverser will not visit their contents (and therefore never exit
+// them) a second time.
+//
+void LoopInvariantWrapper::EnterLoop(OptimizationTraverser& traverser, VM::Operations::WhileLoop& op)
+{
+	const VM::Block* body = op.GetBody();
+	if(!body || !body->GetBoundScope() || traverser.HasAlreadySeenBlock(*body))
+		return;
+
+	LoopWriteSet writes;
+	writes.Loop = &op;
+	writes.Body = body;
+	writes.WritesUnknownVariables = false;
+
+	traverser.ActiveLoops.push_back(writes);
+}
+
+//
+// Record that the innermost loop being traversed may write the given variable
+//
+void LoopInvariantWrapper::RecordWrite(OptimizationTraverser& traverser, const std::wstring& varname)
+{
+	if(!traverser.ActiveLoops.empty())
+		traverser.ActiveLoops.back().WrittenVariables.insert(varname);
+}
+
+//
+// Record that the innermost loop being traversed may write to variables
+// which cannot be determined ahead of time
+//
+void LoopInvariantWrapper::RecordUnknownWrites(OptimizationTraverser& traverser)
+{
+	if(!traverser.ActiveLoops.empty())
+		traverser.ActiveLoops.back().WritesUnknownVariables = true;
+}
+
+//
+// Hoist invariant values out of a loop body once it is fully processed
+//
+// Writes made by the body of a nested loop are also writes made by the
+// enclosing loop, so they are passed along to the outer loop's set.
+//
+void LoopInvariantWrapper::ExitBlock(OptimizationTraverser& traverser, VM::Block& block)
+{
+	if(traverser.ActiveLoops.empty() || traverser.ActiveLoops.back().Body != &block)
+		return;
+
+	LoopWriteSet writes = traverser.ActiveLoops.back();
+	traverser.ActiveLoops.pop_back();
+
+	if(!writes.WritesUnknownVariables)
+		HoistInvariants(traverser, writes);
+
+	if(!traverser.ActiveLoops.empty())
+	{
+		LoopWriteSet& outer = traverser.ActiveLoops.back();
+		outer.WrittenVariables.insert(writes.WrittenVariables.begin(), writes.WrittenVariables.end());
+		outer.WritesUnknownVariables = outer.WritesUnknownVariables || writes.WritesUnknownVariables;
+	}
+}
+
+//
+// Determine if an operation in a loop body computes a loop invariant value
+//
+bool LoopInvariantWrapper::IsHoistable(OptimizationTraverser& traverser, const LoopWriteSet& writes, const VM::Operation* op)
+{
+	const VM::Operations::PushOperation* pushop = dynamic_cast<const VM::Operations::PushOperation*>(op);
+	if(!pushop || !pushop->GetNestedOperation())
+		return false;
+
+	const std::wstring* varname = GetPureReadIdentifier(pushop->GetNestedOperation());
+	if(!varname || writes.WrittenVariables.find(*varname) != writes.WrittenVariables.end())
+		return false;
+
+	const VM::ScopeDescription& bodyscope = *writes.Body->GetBoundScope();
+	switch(pushop->GetType(bodyscope))
+	{
+	case VM::EpochVariableType_Integer:
+	case VM::EpochVariableType_Integer16:
+	case VM::EpochVariableType_Real:
+	case VM::EpochVariableType_Boolean:
+		break;
+
+	default:
+		return false;
+	}
+
+	const VM::ScopeDescription* owner = bodyscope.GetScopeOwningVariable(*varname);
+	if(!owner || owner == &bodyscope || owner->IsReference(*varname))
+		return false;
+
+	if(!traverser.CurrentProgram || owner == &traverser.CurrentProgram->GetGlobalScope())
+		return false;
+
+	return true;
+}
+
+//
+// Move all invariant values out of the given loop's body
+//
+// The hoisted operations are executed in order before the loop starts,
+// so the last value hoisted sits at the top of the stack; the offset of
+// each value is the total size of the values hoisted after it.
+//
+void LoopInvariantWrapper::HoistInvariants(OptimizationTraverser& traverser, const LoopWriteSet& writes)
+{
+	VM::Block& body = *writes.Loop->GetBody();
+	const VM::ScopeDescription& bodyscope = *body.GetBoundScope();
+	std::vector<VM::Operation*>& ops = body.GetAllOperations();
+
+	std::vector<size_t> hoistedindices;
+	for(size_t i = 0; i < ops.size(); ++i)
+	{
+		if(IsHoistable(traverser, writes, ops[i]))
+			hoistedindices.push_back(i);
+	}
+
+	if(hoistedindices.empty())
+		return;
+
+	std::vector<VM::Operation*> hoistedops;
+	hoistedops.reserve(hoistedindices.size());
+
+	size_t offset = 0;
+	for(std::vector<size_t>::const_reverse_iterator iter = hoistedindices.rbegin(); iter != hoistedindices.rend(); ++iter)
+	{
+		VM::Operation* op = ops[*iter];
+		VM::EpochVariableTypeID type = op->GetType(bodyscope);
+
+		ops[*iter] = CreateInvariantPush(type, offset);
+		hoistedops.insert(hoistedops.begin(), op);
+		offset += TypeInfo::GetStorageSize(type);
+	}
+
+	writes.Loop->SetHoistedOperations(hoistedops, offset);
+}
+
+
+
+#define TRACKER_TEMPLATE(operationname) \
+	template <> void Optimizer::TrackLoopInvariants<operationname>(operationname& op, OptimizationTraverser& traverser)
+
+
+#define TRACK_NO_WRITES(operationname) \
+	TRACKER_TEMPLATE(operationname) { }
+
+#define TRACK_ASSOCIATED_IDENTIFIER(operationname) \
+	TRACKER_TEMPLATE(operationname) { LoopInvariantWrapper::RecordWrite(traverser, op.GetAssociatedIdentifier()); }
+
+#define TRACK_UNKNOWN_WRITES(operationname) \
+	TRACKER_TEMPLATE(operationname) { LoopInvariantWrapper::RecordUnknownWrites(traverser); }
+
+
+
+// Operations which do not write to any variables
+TRACK_NO_WRITES(VM::Operations::AcceptMessage)
+TRACK_NO_WRITES(VM::Operations::AcceptMessageFromResponseMap)
+TRACK_NO_WRITES(VM::Operations::AcceptMessageWithTimeout)
+TRACK_NO_WRITES(VM::Operations::BitwiseAnd)
+TRACK_NO_WRITES(VM::Operations::BitwiseNot)
+TRACK_NO_WRITES(VM::Operations::BitwiseOr)
+TRACK_NO_WRITES(VM::Operations::BitwiseXor)
+TRACK_NO_WRITES(VM::Operations::BooleanConstant)
+TRACK_NO_WRITES(VM::Operations::Break)
+TRACK_NO_WRITES(VM::Operations::BroadcastTaskMessage)
+TRACK_NO_WRITES(VM::Operations::CompareStrings)
+TRACK_NO_WRITES(VM::Operations::Concatenate)
+TRACK_NO_WRITES(VM::Operations::ConsArray)
+TRACK_NO_WRITES(VM::Operations::CreateChannel)
+TRACK_NO_WRITES(VM::Operations::CreateGenerator)
+TRACK_NO_WRITES(VM::Operations::CreateThreadPool)
+TRACK_NO_WRITES(VM::Operations::CancelPoolWork)
+TRACK_NO_WRITES(VM::Operations::DebugCrashVM)
+TRACK_NO_WRITES(VM::Operations::DelayedSendTaskMessage)
+TRACK_NO_WRITES(VM::Operations::DivideInteger16s)
+TRACK_NO_WRITES(VM::Operations::DivideIntegers)
+TRACK_NO_WRITES(VM::Operations::DivideReals)
+TRACK_NO_WRITES(VM::Operations::DoWhileLoop)
+TRACK_NO_WRITES(VM::Operations::ElseIf)
+TRACK_NO_WRITES(VM::Operations::ElseIfWrapper)
+TRACK_NO_WRITES(VM::Operations::ExecuteBlock)
+TRACK_NO_WRITES(VM::Operations::ExitIfChain)
+TRACK_NO_WRITES(VM::Operations::FindSubstring)
+TRACK_NO_WRITES(VM::Operations::ForkTask)
+TRACK_NO_WRITES(VM::Operations::ForkThread)
+TRACK_NO_WRITES(VM::Operations::GetMessageSender)
+TRACK_NO_WRITES(VM::Operations::GetTaskCaller)
+TRACK_NO_WRITES(VM::Operations::GetVariableValue)
+TRACK_NO_WRITES(VM::Operations::If)
+TRACK_NO_WRITES(VM::Operations::IntegerConstant)
+TRACK_NO_WRITES(VM::Operations::Integer16Constant)
+TRACK_NO_WRITES(VM::Operations::Invoke)
+TRACK_NO_WRITES(VM::Operations::InvokeIndirect)
+TRACK_NO_WRITES(VM::Operations::IsEqual)
+TRACK_NO_WRITES(VM::Operations::IsGreater)
+TRACK_NO_WRITES(VM::Operations::IsGreaterOrEqual)
+TRACK_NO_WRITES(VM::Operations::IsLesser)
+TRACK_NO_WRITES(VM::Operations::IsLesserOrEqual)
+TRACK_NO_WRITES(VM::Operations::IsNotEqual)
+TRACK_NO_WRITES(VM::Operations::LogicalAnd)
+TRACK_NO_WRITES(VM::Operations::LogicalNot)
+TRACK_NO_WRITES(VM::Operations::LogicalOr)
+TRACK_NO_WRITES(VM::Operations::LogicalXor)
+TRACK_NO_WRITES(VM::Operations::MapOperation)
+TRACK_NO_WRITES(VM::Operations::MapReduceOperation)
+TRACK_NO_WRITES(VM::Operations::MultiplyInteger16s)
+TRACK_NO_WRITES(VM::Operations::MultiplyIntegers)
+TRACK_NO_WRITES(VM::Operations::MultiplyReals)
+TRACK_NO_WRITES(VM::Operations::Negate)
+TRACK_NO_WRITES(VM::Operations::ElementwiseArithmetic)
+TRACK_NO_WRITES(VM::Operations::NoOp)
+TRACK_NO_WRITES(VM::Operations::PendingReply)
+TRACK_NO_WRITES(VM::Operations::PushBooleanLiteral)
+TRACK_NO_WRITES(VM::Operations::PushInteger16Literal)
+TRACK_NO_WRITES(VM::Operations::PushIntegerLiteral)
+TRACK_NO_WRITES(VM::Operations::PushOperation)
+TRACK_NO_WRITES(VM::Operations::PushRealLiteral)
+TRACK_NO_WRITES(VM::Operations::PushStringLiteral)
+TRACK_NO_WRITES(VM::Operations::ReadArray)
+TRACK_NO_WRITES(VM::Operations::ReadStructure)
+TRACK_NO_WRITES(VM::Operations::ReadStructureIndirect)
+TRACK_NO_WRITES(VM::Operations::RealConstant)
+TRACK_NO_WRITES(VM::Operations::ReceiveChannel)
+TRACK_NO_WRITES(VM::Operations::SplitString)
+TRACK_NO_WRITES(VM::Operations::StartsWith)
+TRACK_NO_WRITES(VM::Operations::YieldValue)
+TRACK_NO_WRITES(VM::Operations::GeneratorHasNext)
+TRACK_NO_WRITES(VM::Operations::GeneratorNextValue)
+TRACK_NO_WRITES(VM::Operations::ReduceOperation)
+TRACK_NO_WRITES(VM::Operations::ReplyToRequest)
+TRACK_NO_WRITES(VM::Operations::Return)
+TRACK_NO_WRITES(VM::Operations::SendChannel)
+TRACK_NO_WRITES(VM::Operations::SendTaskMessage)
+TRACK_NO_WRITES(VM::Operations::SubtractInteger16s)
+TRACK_NO_WRITES(VM::Operations::SubtractIntegers)
+TRACK_NO_WRITES(VM::Operations::SubtractReals)
+TRACK_NO_WRITES(VM::Operations::SumInteger16s)
+TRACK_NO_WRITES(VM::Operations::SumIntegers)
+TRACK_NO_WRITES(VM::Operations::SumReals)
+TRACK_NO_WRITES(VM::Operations::TypeCastBooleanToString)
+TRACK_NO_WRITES(VM::Operations::TypeCastBufferToString)
+TRACK_NO_WRITES(VM::Operations::WhileLoopConditional)
+TRACK_NO_WRITES(VM::Operations::ConsArrayIndirect)
+TRACK_NO_WRITES(VM::Operations::ConsMappedArray)
+TRACK_NO_WRITES(VM::Operations::TypeCastStringToInteger)
+TRACK_NO_WRITES(VM::Operations::TypeCastRealToInteger)
+TRACK_NO_WRITES(VM::Operations::TypeCastInteger16ToInteger)
+TRACK_NO_WRITES(VM::Operations::TypeCastBooleanToInteger)
+TRACK_NO_WRITES(VM::Operations::TypeCastStringToInteger16)
+TRACK_NO_WRITES(VM::Operations::TypeCastRealToInteger16)
+TRACK_NO_WRITES(VM::Operations::TypeCastIntegerToInteger16)
+TRACK_NO_WRITES(VM::Operations::TypeCastBooleanToInteger16)
+TRACK_NO_WRITES(VM::Operations::TypeCastStringToReal)
+TRACK_NO_WRITES(VM::Operations::TypeCastInteger16ToReal)
+TRACK_NO_WRITES(VM::Operations::TypeCastIntegerToReal)
+TRACK_NO_WRITES(VM::Operations::TypeCastBooleanToReal)
+TRACK_NO_WRITES(VM::Operations::TypeCastRealToString)
+TRACK_NO_WRITES(VM::Operations::TypeCastInteger16ToString)
+TRACK_NO_WRITES(VM::Operations::TypeCastIntegerToString)
+TRACK_NO_WRITES(VM::Operations::DebugReadStaticString)
+TRACK_NO_WRITES(VM::Operations::DebugWriteStringExpression)
+TRACK_NO_WRITES(VM::Operations::BindFunctionReference)
+TRACK_NO_WRITES(VM::Operations::Length)
+TRACK_NO_WRITES(VM::Operations::ReadTuple)
+TRACK_NO_WRITES(VM::Operations::SizeOf)
+TRACK_NO_WRITES(VM::Operations::ArrayLength)
+TRACK_NO_WRITES(VM::Operations::SearchArray)
+TRACK_NO_WRITES(VM::Operations::ArrayMinIndex)
+TRACK_NO_WRITES(VM::Operations::ArrayMaxIndex)
+TRACK_NO_WRITES(VM::Operations::ConsHashMap)
+TRACK_NO_WRITES(VM::Operations::HashMapLookup)
+TRACK_NO_WRITES(VM::Operations::HashMapContains)
+TRACK_NO_WRITES(VM::Operations::HashMapKeys)
+TRACK_NO_WRITES(VM::Operations::HashMapSize)
+
+
+// Operations which write to (or hand out a reference to) a single named variable
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AssignValue)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AssignStructure)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AssignTuple)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::BindReference)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::InitializeValue)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::MoveVariable)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::WriteArray)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AppendArray)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::SortArray)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapInsert)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapErase)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AtomicUpdate)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::AtomicUpdateArray)
+TRACK_ASSOCIATED_IDENTIFIER(VM::Operations::ParallelInvoke)
+
+
+// Operations whose writes cannot be pinned down to a named variable
+TRACK_UNKNOWN_WRITES(VM::Operations::AssignStructureIndirect)
+TRACK_UNKNOWN_WRITES(VM::Operations::ForkFuture)
+TRACK_UNKNOWN_WRITES(VM::Operations::ForkDependentFuture)
+TRACK_UNKNOWN_WRITES(VM::Operations::CancelFuture)
+TRACK_UNKNOWN_WRITES(VM::Operations::FusedOperation)
+TRACK_UNKNOWN_WRITES(VM::Operations::ParallelFor)
+TRACK_UNKNOWN_WRITES(VM::Operations::SendTaskRequest)
+TRACK_UNKNOWN_WRITES(Extensions::HandoffOperation)
+TRACK_UNKNOWN_WRITES(Extensions::HandoffControlOperation)
+TRACK_UNKNOWN_WRITES(Marshalling::CallDLL)
+
+
+//
+// Loops start a new write set for their bodies
+//
+TRACKER_TEMPLATE(VM::Operations::WhileLoop)
+{
+	LoopInvariantWrapper::EnterLoop(traverser, op);
+}
+
+//
+// Chained member references operate on an address computed at runtime,
+// so only the first link of the chain names the variable being bound
+//
+TRACKER_TEMPLATE(VM::Operations::BindStructMemberReference)
+{
+	if(op.IsChained())
+		LoopInvariantWrapper::RecordUnknownWrites(traverser);
+	else
+		LoopInvariantWrapper::RecordWrite(traverser, op.GetAssociatedIdentifier());
+}
@@ -0,0 +1,74 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for hoisting loop invariant values out of while loops
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Block;
+	class Operation;
+
+	namespace Operations
+	{
+		class WhileLoop;
+	}
+}
+
+
+namespace Optimizer
+{
+
+	class OptimizationTraverser;
+
+	//
+	// Explicit specializations of this function record the variables
+	// which each operation may write to, so that the optimizer knows
+	// which values may change within the body of a loop. As with slot
+	// resolution, there is deliberately no general case: every operation
+	// class must state its effects, so that no writes are overlooked.
+	//
+	template <class OperationClass>
+	void TrackLoopInvariants(OperationClass& op, OptimizationTraverser& traverser);
+
+
+	//
+	// Variables written by the body of a while loop which is being traversed
+	//
+	struct LoopWriteSet
+	{
+		VM::Operations::WhileLoop* Loop;
+		const VM::Block* Body;
+
+		std::set<std::wstring> WrittenVariables;
+		bool WritesUnknownVariables;
+	};
+
+
+	//
+	// This class provides a handy way to pass "friend" access over to
+	// the hoisting logic from the traverser code.
+	//
+	class LoopInvariantWrapper
+	{
+	// Write tracking
+	public:
+		static void EnterLoop(OptimizationTraverser& traverser, VM::Operations::WhileLoop& op);
+		static void RecordWrite(OptimizationTraverser& traverser, const std::wstring& varname);
+		static void RecordUnknownWrites(OptimizationTraverser& traverser);
+
+	// Hoisting
+	public:
+		static void ExitBlock(OptimizationTraverser& traverser, VM::Block& block);
+
+	private:
+		static bool IsHoistable(OptimizationTraverser& traverser, const LoopWriteSet& writes, const VM::Operation* op);
+		static void HoistInvariants(OptimizationTraverser& traverser, const LoopWriteSet& writes);
+	};
+
+}
@@ -0,0 +1,231 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for fusing common operation sequences
+//
+// Compiled code is full of short, stereotyped sequences of operations;
+// reading a variable, pushing a literal, and combining the two values
+// is particularly common, for example in loop counters and conditions.
+// This pass scans each block for such sequences and replaces them with
+// single fused operations (see FusedOps.h for details).
+//
+// Sequences are only ever collapsed in place, never reordered, and all
+// patterns begin with a variable read. This matters for blocks that are
+// executed with some leading operations skipped: the skipped operations
+// do not begin with a variable read, so they keep their positions.
+//
+// Note that fusion relies on the variable slots computed earlier in the
+// optimization process, and must therefore run after slot resolution.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Operation Fusion/OperationFusion.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Virtual Machine/Operations/FusedOps.h"
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/Comparison.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+
+#include "Virtual Machine/SelfAware.inl"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Retrieve the type of a variable accessed via a resolved slot
+	//
+	EpochVariableTypeID GetSlotVariableType(const VariableSlot& slot, const std::wstring& varname)
+	{
+		return slot.OwnerScope->GetVariableType(varname);
+	}
+
+	//
+	// Retrieve the operation nested in a push operation, if any
+	//
+	const Operation* GetPushedOperation(const Operation* op)
+	{
+		if(!dynamic_cast<const PushOperation*>(op))
+			return NULL;
+
+		return op->GetNestedOperation();
+	}
+
+	//
+	// Determine if an operation is an arithmetic operation on two scalars
+	//
+	template<ArithmeticOpType OpType, class VarType, class RValueType>
+	bool IsScalarArithmetic(const Operation* op)
+	{
+		const ArithmeticOp<OpType, VarType, RValueType>* arithmeticop = dynamic_cast<const ArithmeticOp<OpType, VarType, RValueType>*>(op);
+		if(!arithmeticop)
+			return false;
+
+		return (arithmeticop->GetNumParameters() == 2 && !arithmeticop->IsFirstArray() && !arithmeticop->IsSecondArray());
+	}
+
+
+	//
+	// Fuse a variable read, literal push, and arithmetic operation,
+	// along with a subsequent assignment of the result if present
+	//
+	template<ArithmeticOpType OpType, class VarType>
+	Operation* FuseArithmetic(const std::vector<Operation*>& operations, size_t index, size_t& consumed, const GetVariableValue& source, typename VarType::BaseStorage literalvalue)
+	{
+		if(index + 3 < operations.size())
+		{
+			const AssignValue* assign = dynamic_cast<const AssignValue*>(operations[index + 3]);
+			if(assign && assign->GetVariableSlot().IsResolved() && GetSlotVariableType(assign->GetVariableSlot(), assign->GetAssociatedIdentifier()) == VarType::GetStaticType())
+			{
+				consumed = 4;
+				return new FusedVariableLiteralArithmeticAssign<OpType, VarType>(source.GetAssociatedIdentifier(), source.GetVariableSlot(), literalvalue, assign->GetAssociatedIdentifier(), assign->GetVariableSlot());
+			}
+		}
+
+		consumed = 3;
+		return new FusedVariableLiteralArithmetic<OpType, VarType>(source.GetAssociatedIdentifier(), source.GetVariableSlot(), literalvalue);
+	}
+
+	//
+	// Fuse a variable read, literal push, and comparison
+	//
+	template<class VarType>
+	Operation* FuseComparison(const Operation* op, size_t& consumed, const GetVariableValue& source, typename VarType::BaseStorage literalvalue)
+	{
+		const Comparator* comparator = dynamic_cast<const Comparator*>(op);
+		if(!comparator || comparator->GetOperandType() != VarType::GetStaticType())
+			return NULL;
+
+		const std::wstring& varname = source.GetAssociatedIdentifier();
+		const VariableSlot& slot = source.GetVariableSlot();
+
+		consumed = 3;
+		if(op->IsNode<IsEqual>())
+			return new FusedVariableLiteralComparison<FusedComparison_Equal, VarType>(varname, slot, literalvalue);
+		else if(op->IsNode<IsNotEqual>())
+			return new FusedVariableLiteralComparison<FusedComparison_NotEqual, VarType>(varname, slot, literalvalue);
+		else if(op->IsNode<IsGreater>())
+			return new FusedVariableLiteralComparison<FusedComparison_Greater, VarType>(varname, slot, literalvalue);
+		else if(op->IsNode<IsGreaterOrEqual>())
+			return new FusedVariableLiteralComparison<FusedComparison_GreaterOrEqual, VarType>(varname, slot, literalvalue);
+		else if(op->IsNode<IsLesser>())
+			return new FusedVariableLiteralComparison<FusedComparison_Lesser, VarType>(varname, slot, literalvalue);
+		else if(op->IsNode<IsLesserOrEqual>())
+			return new FusedVariableLiteralComparison<FusedComparison_LesserOrEqual, VarType>(varname, slot, literalvalue);
+
+		consumed = 0;
+		return NULL;
+	}
+
+	//
+	// Attempt to fuse a sequence which reads a numeric variable and
+	// combines it with a literal of the same type
+	//
+	template<class VarType, class RValueType, class LiteralOperationClass>
+	Operation* FuseNumericSequence(const std::vector<Operation*>& operations, size_t index, size_t& consumed, const GetVariableValue& source, bool allowcomparison)
+	{
+		const LiteralOperationClass* literal = dynamic_cast<const LiteralOperationClass*>(operations[index + 1]);
+		if(!literal)
+			return NULL;
+
+		typename VarType::BaseStorage literalvalue = literal->GetValue();
+
+		const Operation* op = GetPushedOperation(operations[index + 2]);
+		if(!op)
+			return NULL;
+
+		if(IsScalarArithmetic<Arithmetic_Add, VarType, RValueType>(op))
+			return FuseArithmetic<Arithmetic_Add, VarType>(operations, index, consumed, source, literalvalue);
+		else if(IsScalarArithmetic<Arithmetic_Subtract, VarType, RValueType>(op))
+			return FuseArithmetic<Arithmetic_Subtract, VarType>(operations, index, consumed, source, literalvalue);
+		else if(IsScalarArithmetic<Arithmetic_Multiply, VarType, RValueType>(op))
+			return FuseArithmetic<Arithmetic_Multiply, VarType>(operations, index, consumed, source, literalvalue);
+		else if(IsScalarArithmetic<Arithmetic_Divide, VarType, RValueType>(op))
+			return FuseArithmetic<Arithmetic_Divide, VarType>(operations, index, consumed, source, literalvalue);
+		else if(allowcomparison)
+			return FuseComparison<VarType>(op, consumed, source, literalvalue);
+
+		return NULL;
+	}
+
+	//
+	// Attempt to fuse the sequence of operations at the given index
+	//
+	// Returns the fused operation, or NULL if no fusion is possible;
+	// on success, the number of original operations replaced by the
+	// fused operation is returned in the consumed parameter.
+	//
+	Operation* FuseSequence(const std::vector<Operation*>& operations, size_t index, size_t& consumed)
+	{
+		if(index + 2 >= operations.size())
+			return NULL;
+
+		const GetVariableValue* source = dynamic_cast<const GetVariableValue*>(GetPushedOperation(operations[index]));
+		if(!source || !source->GetVariableSlot().IsResolved())
+			return NULL;
+
+		// Comparators do not support 16-bit integers, so sequences of
+		// that type are deliberately left alone here; they would fail
+		// at runtime, and fusing them would hide the error.
+		switch(GetSlotVariableType(source->GetVariableSlot(), source->GetAssociatedIdentifier()))
+		{
+		case EpochVariableType_Integer:
+			return FuseNumericSequence<IntegerVariable, IntegerRValue, PushIntegerLiteral>(operations, index, consumed, *source, true);
+
+		case EpochVariableType_Integer16:
+			return FuseNumericSequence<Integer16Variable, Integer16RValue, PushInteger16Literal>(operations, index, consumed, *source, false);
+
+		case EpochVariableType_Real:
+			return FuseNumericSequence<RealVariable, RealRValue, PushRealLiteral>(operations, index, consumed, *source, true);
+		}
+
+		return NULL;
+	}
+
+}
+
+
+//
+// Replace all fusable operation sequences in the given block
+//
+void Optimizer::FuseOperations(VM::Block& block)
+{
+	const std::vector<Operation*>& originalops = static_cast<const VM::Block&>(block).GetAllOperations();
+
+	std::vector<Operation*> fusedops;
+	std::vector<Operation*> replacedops;
+	fusedops.reserve(originalops.size());
+
+	for(size_t i = 0; i < originalops.size(); )
+	{
+		size_t consumed = 0;
+		Operation* fused = FuseSequence(originalops, i, consumed);
+		if(fused)
+		{
+			fusedops.push_back(fused);
+			replacedops.insert(replacedops.end(), originalops.begin() + i, originalops.begin() + i + consumed);
+			i += consumed;
+		}
+		else
+			fusedops.push_back(originalops[i++]);
+	}
+
+	if(replacedops.empty())
+		return;
+
+	block.GetAllOperations().swap(fusedops);
+
+	for(std::vector<Operation*>::iterator iter = replacedops.begin(); iter != replacedops.end(); ++iter)
+		delete *iter;
+}
+
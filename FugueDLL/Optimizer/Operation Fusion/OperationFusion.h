@@ -0,0 +1,24 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for fusing common operation sequences
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Block;
+}
+
+
+namespace Optimizer
+{
+
+	void FuseOperations(VM::Block& block);
+
+}
+
@@ -0,0 +1,237 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Wrappers for transforming a code tree prior to execution. The
+// optimizer runs once a program has been parsed and validated (or
+// loaded from bytecode), and precomputes information which would
+// otherwise need to be recalculated each time an operation runs.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/Constant Folding/ConstantFolding.h"
+#include "Optimizer/Operation Fusion/OperationFusion.h"
+#include "Optimizer/Handoff Fusion/HandoffFusion.h"
+#include "Optimizer/Jump Tables/JumpTables.h"
+#include "Optimizer/Tail Calls/TailCalls.h"
+
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace Optimizer;
+
+
+//
+// Construct and initialize an optimization traverser
+//
+OptimizationTraverser::OptimizationTraverser(Mode mode)
+	: CurrentProgram(NULL),
+	  CurrentScope(NULL),
+	  SerializableOnly(mode == SerializableOptimization),
+	  ConstantsFolded(false),
+	  InlineFunctions(Config::InlineFunctions && mode == FullOptimization),
+	  HoistLoopInvariants(Config::HoistLoopInvariants && mode == FullOptimization),
+	  AutoParallelize(Config::AutoParallelize && mode == FullOptimization)
+{
+}
+
+//
+// Link the traverser to a program representation object
+//
+// Programs loaded from preoptimized binaries had their constants folded
+// when the binary was built, so folding is not attempted a second time.
+//
+void OptimizationTraverser::SetProgram(VM::Program& program)
+{
+	CurrentProgram = &program;
+	ConstantsFolded = program.IsPreoptimized();
+}
+
+//
+// Record a finding of the auto-parallelization analysis, for later reporting
+//
+void OptimizationTraverser::RecordParallelization(const VM::Operation* op, const std::wstring& description)
+{
+	ParallelizationReport report;
+	report.Operation = op;
+	report.Description = description;
+
+	ParallelizationReports.push_back(report);
+}
+
+//
+// Register that we are handling the global variable initialization block
+//
+void OptimizationTraverser::TraverseGlobalInitBlock(VM::Block* block)
+{
+	// Nothing to do; the block will be traversed normally
+}
+
+//
+// Register that we have entered a code block/lexical scope
+//
+bool OptimizationTraverser::EnterBlock(const VM::Block& block)
+{
+	if(HasAlreadySeenBlock(block))
+		return false;
+
+	RecordTraversedBlock(block);
+	return true;
+}
+
+//
+// Register that we have left a code block/lexical scope
+//
+// At this point all of the block's operations (and any nested blocks)
+// have been processed, so constant expressions can be folded, runs of
+// matching extension control blocks can be handed off together, common
+// operation sequences can be fused, suitable if/elseif chains can be
+// turned into switches, loop invariant values can be moved out of loop
+// bodies, and the block can then be lowered into its linear instruction
+// stream form if that engine is enabled.
+//
+void OptimizationTraverser::ExitBlock(VM::Block& block)
+{
+	if(SerializableOnly)
+	{
+		FoldConstants(block);
+		return;
+	}
+
+	if(Config::FoldConstants && !ConstantsFolded)
+		FoldConstants(block);
+
+	if(Config::FuseHandoffs)
+		FuseHandoffs(block);
+
+	if(Config::FuseOperations)
+	{
+		FuseOperations(block);
+
+		if(Config::BuildJumpTables)
+			BuildJumpTables(block);
+	}
+
+	if(HoistLoopInvariants)
+		LoopInvariantWrapper::ExitBlock(*this, block);
+
+	if(Config::UseInstructionStreams)
+		block.GenerateInstructionStream();
+}
+
+//
+// Register that we have finished processing a function
+//
+// The function's body has been fully optimized by now, so the operations
+// which remain at the end of the body are final.
+//
+void OptimizationTraverser::ExitFunction(VM::Function& function)
+{
+	if(SerializableOnly)
+		return;
+
+	MarkTailCalls(function);
+	OptimizedFunctions.push_back(&function);
+}
+
+//
+// Register that an optional code block has not been supplied
+//
+void OptimizationTraverser::NullBlock()
+{
+	// Nothing to do for optimization.
+}
+
+//
+// Record the type and parameter count of an operation, now that its code is final
+//
+void OptimizationTraverser::CacheTypeInfo(VM::Operation* op, const VM::ScopeDescription* scope)
+{
+	if(scope)
+		op->ResolveTypeInfo(*scope);
+}
+
+//
+// Set the currently processed lexical scope and optimize its contents
+//
+void OptimizationTraverser::RegisterScope(VM::ScopeDescription& scope)
+{
+	CurrentScope = &scope;
+	TraverseScope(scope);
+}
+
+//
+// Optimize the functions and response handlers owned by a lexical scope
+//
+void OptimizationTraverser::TraverseScope(VM::ScopeDescription& scope)
+{
+	if(HasAlreadySeenScope(scope))
+		return;
+
+	// Record the scope up front, so that recursive functions
+	// do not cause us to traverse the same scope repeatedly
+	RecordTraversedScope(scope);
+
+	// Lay out activation frames up front, so that the first
+	// activation of each scope does not need to do it lazily
+	if(!SerializableOnly)
+		scope.PrepareFrameLayout();
+
+	for(VM::ScopeDescription::FunctionMap::iterator iter = scope.Functions.begin(); iter != scope.Functions.end(); ++iter)
+	{
+		VM::SelfAwareBase* func = dynamic_cast<VM::SelfAwareBase*>(iter->second);
+		if(func)
+			func->Traverse(*this);
+	}
+
+	for(VM::ScopeDescription::ResponseMapList::const_iterator iter = scope.ResponseMaps.begin(); iter != scope.ResponseMaps.end(); ++iter)
+	{
+		VM::ResponseMap* themap = iter->second;
+		const std::vector<VM::ResponseMapEntry*>& responses = themap->GetEntries();
+		for(std::vector<VM::ResponseMapEntry*>::const_iterator inner_iter = responses.begin(); inner_iter != responses.end(); ++inner_iter)
+			(*inner_iter)->GetResponseBlock()->Traverse(*this);
+	}
+
+	CurrentScope = &scope;
+}
+
+
+//
+// Register that we have entered an asynchronous task block
+//
+void OptimizationTraverser::EnterTask()
+{
+	// Nothing to do for optimization.
+}
+
+//
+// Register that we have left an asynchronous task block
+//
+void OptimizationTraverser::ExitTask()
+{
+	// Nothing to do for optimization.
+}
+
+//
+// Register that we have entered an asynchronous thread block
+//
+void OptimizationTraverser::EnterThread()
+{
+	// Nothing to do for optimization.
+}
+
+//
+// Register that we have left an asynchronous thread block
+//
+void OptimizationTraverser::ExitThread()
+{
+	// Nothing to do for optimization.
+}
+
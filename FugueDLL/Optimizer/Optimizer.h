@@ -0,0 +1,183 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Wrappers for transforming a code tree prior to execution. The
+// optimizer runs once a program has been parsed and validated (or
+// loaded from bytecode), and precomputes information which would
+// otherwise need to be recalculated each time an operation runs.
+// Note that the optimizer must not be used on programs that are
+// destined for serialization, as the precomputed information is
+// only meaningful for the program instance currently in memory.
+// The exception is the serializable mode, which is restricted to
+// transformations that can be expressed in bytecode, and is used to
+// do that work once when a binary is built.
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Program;
+	class ScopeDescription;
+	class Block;
+	class Operation;
+	class Function;
+}
+
+
+// Dependencies
+#include "Optimizer/Slot Resolution/SlotResolution.h"
+#include "Optimizer/Auto Parallelization/AutoParallelization.h"
+#include "Optimizer/Function Inlining/FunctionInlining.h"
+#include "Optimizer/Loop Invariants/LoopInvariants.h"
+
+
+namespace Optimizer
+{
+
+	//
+	// Record of a finding made by the auto-parallelization analysis
+	//
+	struct ParallelizationReport
+	{
+		const VM::Operation* Operation;
+		std::wstring Description;
+	};
+
+
+	//
+	// Helper object used with the program traversal interface
+	//
+	// The traversal interface takes care of invoking this helper class
+	// for each element of a loaded program, such as lexical scopes,
+	// individual operations, and so on.
+	//
+	class OptimizationTraverser
+	{
+	// Optimization modes
+	public:
+		enum Mode
+		{
+			FullOptimization,			// Prepare the program for execution
+			SerializableOptimization	// Only fold constants, leaving the program fit for serialization
+		};
+
+	// Construction
+	public:
+		explicit OptimizationTraverser(Mode mode = FullOptimization);
+
+	// Traversal interface
+	public:
+		void SetProgram(VM::Program& program);
+
+		void TraverseGlobalInitBlock(VM::Block* block);
+
+		template <class OperationClass>
+		void TraverseNode(OperationClass& op)
+		{
+			if(SerializableOnly)
+				return;
+
+			ResolveVariableSlots(op, *this);
+
+			if(InlineFunctions)
+				InlineFunctionCalls(op, *this);
+
+			if(HoistLoopInvariants)
+				TrackLoopInvariants(op, *this);
+
+			if(AutoParallelize)
+				FindParallelism(op, *this);
+
+			CacheTypeInfo(&op, CurrentScope);
+		}
+
+		bool EnterBlock(const VM::Block& block);
+		void ExitBlock(VM::Block& block);
+		void NullBlock();
+
+		void ExitFunction(VM::Function& function);
+
+		void RegisterScope(VM::ScopeDescription& scope);
+
+		void EnterTask();
+		void ExitTask();
+
+		void EnterThread();
+		void ExitThread();
+
+	// State query interface
+	public:
+		VM::ScopeDescription* GetCurrentScope()		{ return CurrentScope; }
+
+		void SetCurrentScope(VM::ScopeDescription* scope)
+		{ CurrentScope = scope; }
+
+		bool HasAlreadySeenScope(const VM::ScopeDescription& scope) const
+		{ return (SeenScopes.find(&scope) != SeenScopes.end()); }
+
+		void RecordTraversedScope(const VM::ScopeDescription& scope)
+		{ SeenScopes.insert(&scope); }
+
+
+		bool HasAlreadySeenBlock(const VM::Block& block) const
+		{ return (SeenBlocks.find(&block) != SeenBlocks.end()); }
+
+		void RecordTraversedBlock(const VM::Block& block)
+		{ SeenBlocks.insert(&block); }
+
+	// Auto-parallelization results
+	public:
+		const std::list<ParallelizationReport>& GetParallelizationReports() const
+		{ return ParallelizationReports; }
+
+		void RecordParallelization(const VM::Operation* op, const std::wstring& description);
+
+	// Functions seen during traversal, in the order they were optimized
+	public:
+		const std::vector<VM::Function*>& GetOptimizedFunctions() const
+		{ return OptimizedFunctions; }
+
+	// Internal helpers
+	private:
+		void TraverseScope(VM::ScopeDescription& scope);
+
+		// Only operations carry type information; other nodes select the second overload
+		static void CacheTypeInfo(VM::Operation* op, const VM::ScopeDescription* scope);
+		static void CacheTypeInfo(const void* node, const VM::ScopeDescription* scope)
+		{ }
+
+	// Internal tracking
+	private:
+		VM::Program* CurrentProgram;
+		VM::ScopeDescription* CurrentScope;
+
+		std::set<const VM::Block*> SeenBlocks;
+		std::set<const VM::ScopeDescription*> SeenScopes;
+
+		bool SerializableOnly;
+		bool ConstantsFolded;
+
+		bool InlineFunctions;
+
+		bool HoistLoopInvariants;
+		std::vector<LoopWriteSet> ActiveLoops;
+
+		bool AutoParallelize;
+		std::list<ParallelizationReport> ParallelizationReports;
+
+		std::vector<VM::Function*> OptimizedFunctions;
+
+	// Access to specific optimization wrappers
+	public:
+		friend class SlotResolutionWrapper;
+		friend class AutoParallelizationWrapper;
+		friend class FunctionInliningWrapper;
+		friend class LoopInvariantWrapper;
+	};
+
+}
+
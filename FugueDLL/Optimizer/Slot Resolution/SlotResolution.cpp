@@ -0,0 +1,293 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for resolving variable names to scope slots
+//
+// Variable access operations normally locate their variables by name,
+// which involves a map lookup in each scope along the chain of parents
+// and ghosts. Since the owner of each variable is fixed once the scope
+// tree has been built, we resolve each name to a slot in its owning
+// scope ahead of time; at runtime the operation only needs to find the
+// activation of that scope and index directly into its slot table.
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
+#include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Operations/Concurrency/Tasks.h"
+#include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/Bitwise.h"
+#include "Virtual Machine/Operations/Operators/Comparison.h"
+#include "Virtual Machine/Operations/Operators/CompoundOperator.h"
+#include "Virtual Machine/Operations/Operators/Logical.h"
+#include "Virtual Machine/Operations/Variables/StringOps.h"
+#include "Virtual Machine/Operations/Variables/StructureOps.h"
+#include "Virtual Machine/Operations/Variables/TupleOps.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+#include "Virtual Machine/Operations/Debugging.h"
+#include "Virtual Machine/Operations/FusedOps.h"
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/UtilityOps.h"
+#include "Virtual Machine/Operations/Typedefs.h"
+
+#include "Marshalling/ExternalDLL.h"
+
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Program.h"
+
+#include "Virtual Machine/Types Management/RuntimeCasts.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+
+#include "Language Extensions/Handoff.h"
+
+#include "Optimizer/Slot Resolution/SlotResolution.h"
+#include "Optimizer/Optimizer.h"
+
+
+
+using namespace Optimizer;
+
+
+//
+// Resolve the name of the variable accessed by the given operation
+//
+VM::VariableSlot SlotResolutionWrapper::ResolveIdentifier(OptimizationTraverser& traverser, const std::wstring& varname)
+{
+	if(!traverser.CurrentScope)
+		throw VM::InternalFailureException("Tried to resolve a variable access operation, but no variable scope is currently set");
+
+	return traverser.CurrentScope->ResolveVariableSlot(varname);
+}
+
+//
+// Resolve and store the slot of the variable accessed by the given operation
+//
+template <class OperationClass>
+void SlotResolutionWrapper::ResolveAssociatedIdentifier(OptimizationTraverser& traverser, OperationClass& op)
+{
+	op.SetVariableSlot(ResolveIdentifier(traverser, op.GetAssociatedIdentifier()));
+}
+
+//
+// Resolve the slot of the structure variable accessed by the given operation,
+// as well as the location of the member within the structure
+//
+template <class OperationClass>
+void SlotResolutionWrapper::ResolveStructureMember(OptimizationTraverser& traverser, OperationClass& op)
+{
+	ResolveAssociatedIdentifier(traverser, op);
+
+	IDType structid = traverser.CurrentScope->GetVariableStructureTypeID(op.GetAssociatedIdentifier());
+	op.SetMemberSlot(traverser.CurrentScope->GetStructureType(structid).ResolveMemberSlot(op.GetMemberName(), structid));
+}
+
+//
+// Resolve the location of a member read from a structure on the stack
+//
+// The type of the structure is fixed by the chain of reads which produced
+// it, so each level of a nested member access is resolved ahead of time.
+//
+void SlotResolutionWrapper::ResolveIndirectStructureMember(OptimizationTraverser& traverser, VM::Operations::ReadStructureIndirect& op)
+{
+	if(!traverser.CurrentScope)
+		throw VM::InternalFailureException("Tried to resolve a structure member access, but no variable scope is currently set");
+
+	IDType structid = op.WalkInstructionsForReadStruct(*traverser.CurrentScope, op.GetPriorOperation());
+	const VM::StructureType& structtype = VM::StructureTrackerClass::GetOwnerOfStructureType(structid)->GetStructureType(structid);
+	op.SetMemberSlot(structtype.ResolveMemberSlot(op.GetMemberName(), structid));
+}
+
+
+#define RESOLVER_TEMPLATE(operationname) \
+	template <> void Optimizer::ResolveVariableSlots<operationname>(operationname& op, OptimizationTraverser& traverser)
+
+
+#define RESOLVE_NOTHING(operationname) \
+	RESOLVER_TEMPLATE(operationname) { }
+
+#define RESOLVE_ASSOCIATED_IDENTIFIER(operationname) \
+	RESOLVER_TEMPLATE(operationname) { SlotResolutionWrapper::ResolveAssociatedIdentifier(traverser, op); }
+
+#define RESOLVE_STRUCTURE_MEMBER(operationname) \
+	RESOLVER_TEMPLATE(operationname) { SlotResolutionWrapper::ResolveStructureMember(traverser, op); }
+
+
+
+// Operations which do not access variables by name, or which do not yet support slots
+RESOLVE_NOTHING(VM::Operations::AcceptMessage)
+RESOLVE_NOTHING(VM::Operations::AcceptMessageFromResponseMap)
+RESOLVE_NOTHING(VM::Operations::AcceptMessageWithTimeout)
+RESOLVE_NOTHING(VM::Operations::AssignStructureIndirect)
+RESOLVE_NOTHING(VM::Operations::BitwiseAnd)
+RESOLVE_NOTHING(VM::Operations::BitwiseNot)
+RESOLVE_NOTHING(VM::Operations::BitwiseOr)
+RESOLVE_NOTHING(VM::Operations::BitwiseXor)
+RESOLVE_NOTHING(VM::Operations::BooleanConstant)
+RESOLVE_NOTHING(VM::Operations::Break)
+RESOLVE_NOTHING(VM::Operations::BroadcastTaskMessage)
+RESOLVE_NOTHING(VM::Operations::CompareStrings)
+RESOLVE_NOTHING(VM::Operations::Concatenate)
+RESOLVE_NOTHING(VM::Operations::ConsArray)
+RESOLVE_NOTHING(VM::Operations::CreateChannel)
+RESOLVE_NOTHING(VM::Operations::CreateGenerator)
+RESOLVE_NOTHING(VM::Operations::CreateThreadPool)
+RESOLVE_NOTHING(VM::Operations::CancelPoolWork)
+RESOLVE_NOTHING(VM::Operations::DebugCrashVM)
+RESOLVE_NOTHING(VM::Operations::DelayedSendTaskMessage)
+RESOLVE_NOTHING(VM::Operations::DivideInteger16s)
+RESOLVE_NOTHING(VM::Operations::DivideIntegers)
+RESOLVE_NOTHING(VM::Operations::DivideReals)
+RESOLVE_NOTHING(VM::Operations::DoWhileLoop)
+RESOLVE_NOTHING(VM::Operations::ElseIf)
+RESOLVE_NOTHING(VM::Operations::ElseIfWrapper)
+RESOLVE_NOTHING(VM::Operations::ExecuteBlock)
+RESOLVE_NOTHING(VM::Operations::ExitIfChain)
+RESOLVE_NOTHING(VM::Operations::FindSubstring)
+RESOLVE_NOTHING(VM::Operations::ForkFuture)
+RESOLVE_NOTHING(VM::Operations::ForkDependentFuture)
+RESOLVE_NOTHING(VM::Operations::CancelFuture)
+RESOLVE_NOTHING(VM::Operations::ForkTask)
+RESOLVE_NOTHING(VM::Operations::ForkThread)
+RESOLVE_NOTHING(VM::Operations::FusedOperation)
+RESOLVE_NOTHING(VM::Operations::GetMessageSender)
+RESOLVE_NOTHING(VM::Operations::GetTaskCaller)
+RESOLVE_NOTHING(VM::Operations::If)
+RESOLVE_NOTHING(VM::Operations::IntegerConstant)
+RESOLVE_NOTHING(VM::Operations::Integer16Constant)
+RESOLVE_NOTHING(VM::Operations::Invoke)
+RESOLVE_NOTHING(VM::Operations::InvokeIndirect)
+RESOLVE_NOTHING(VM::Operations::IsEqual)
+RESOLVE_NOTHING(VM::Operations::IsGreater)
+RESOLVE_NOTHING(VM::Operations::IsGreaterOrEqual)
+RESOLVE_NOTHING(VM::Operations::IsLesser)
+RESOLVE_NOTHING(VM::Operations::IsLesserOrEqual)
+RESOLVE_NOTHING(VM::Operations::IsNotEqual)
+RESOLVE_NOTHING(VM::Operations::LogicalAnd)
+RESOLVE_NOTHING(VM::Operations::LogicalNot)
+RESOLVE_NOTHING(VM::Operations::LogicalOr)
+RESOLVE_NOTHING(VM::Operations::LogicalXor)
+RESOLVE_NOTHING(VM::Operations::MapOperation)
+RESOLVE_NOTHING(VM::Operations::MapReduceOperation)
+RESOLVE_NOTHING(VM::Operations::MultiplyInteger16s)
+RESOLVE_NOTHING(VM::Operations::MultiplyIntegers)
+RESOLVE_NOTHING(VM::Operations::MultiplyReals)
+RESOLVE_NOTHING(VM::Operations::Negate)
+RESOLVE_NOTHING(VM::Operations::ElementwiseArithmetic)
+RESOLVE_NOTHING(VM::Operations::NoOp)
+RESOLVE_NOTHING(VM::Operations::PendingReply)
+RESOLVE_NOTHING(VM::Operations::PushBooleanLiteral)
+RESOLVE_NOTHING(VM::Operations::PushInteger16Literal)
+RESOLVE_NOTHING(VM::Operations::PushIntegerLiteral)
+RESOLVE_NOTHING(VM::Operations::PushOperation)
+RESOLVE_NOTHING(VM::Operations::PushRealLiteral)
+RESOLVE_NOTHING(VM::Operations::PushStringLiteral)
+RESOLVE_NOTHING(VM::Operations::RealConstant)
+RESOLVE_NOTHING(VM::Operations::ReceiveChannel)
+RESOLVE_NOTHING(VM::Operations::SplitString)
+RESOLVE_NOTHING(VM::Operations::StartsWith)
+RESOLVE_NOTHING(VM::Operations::YieldValue)
+RESOLVE_NOTHING(VM::Operations::GeneratorHasNext)
+RESOLVE_NOTHING(VM::Operations::GeneratorNextValue)
+RESOLVE_NOTHING(VM::Operations::ReduceOperation)
+RESOLVE_NOTHING(VM::Operations::ReplyToRequest)
+RESOLVE_NOTHING(VM::Operations::Return)
+RESOLVE_NOTHING(VM::Operations::SendChannel)
+RESOLVE_NOTHING(VM::Operations::SendTaskMessage)
+RESOLVE_NOTHING(VM::Operations::SendTaskRequest)
+RESOLVE_NOTHING(VM::Operations::SubtractInteger16s)
+RESOLVE_NOTHING(VM::Operations::SubtractIntegers)
+RESOLVE_NOTHING(VM::Operations::SubtractReals)
+RESOLVE_NOTHING(VM::Operations::SumInteger16s)
+RESOLVE_NOTHING(VM::Operations::SumIntegers)
+RESOLVE_NOTHING(VM::Operations::SumReals)
+RESOLVE_NOTHING(VM::Operations::TypeCastBooleanToString)
+RESOLVE_NOTHING(VM::Operations::TypeCastBufferToString)
+RESOLVE_NOTHING(VM::Operations::WhileLoop)
+RESOLVE_NOTHING(VM::Operations::WhileLoopConditional)
+RESOLVE_NOTHING(VM::Operations::ConsArrayIndirect)
+RESOLVE_NOTHING(VM::Operations::ConsMappedArray)
+RESOLVE_NOTHING(VM::Operations::TypeCastStringToInteger)
+RESOLVE_NOTHING(VM::Operations::TypeCastRealToInteger)
+RESOLVE_NOTHING(VM::Operations::TypeCastInteger16ToInteger)
+RESOLVE_NOTHING(VM::Operations::TypeCastBooleanToInteger)
+RESOLVE_NOTHING(VM::Operations::TypeCastStringToInteger16)
+RESOLVE_NOTHING(VM::Operations::TypeCastRealToInteger16)
+RESOLVE_NOTHING(VM::Operations::TypeCastIntegerToInteger16)
+RESOLVE_NOTHING(VM::Operations::TypeCastBooleanToInteger16)
+RESOLVE_NOTHING(VM::Operations::TypeCastStringToReal)
+RESOLVE_NOTHING(VM::Operations::TypeCastInteger16ToReal)
+RESOLVE_NOTHING(VM::Operations::TypeCastIntegerToReal)
+RESOLVE_NOTHING(VM::Operations::TypeCastBooleanToReal)
+RESOLVE_NOTHING(VM::Operations::TypeCastRealToString)
+RESOLVE_NOTHING(VM::Operations::TypeCastInteger16ToString)
+RESOLVE_NOTHING(VM::Operations::TypeCastIntegerToString)
+RESOLVE_NOTHING(Extensions::HandoffOperation)
+RESOLVE_NOTHING(Extensions::HandoffControlOperation)
+RESOLVE_NOTHING(Marshalling::CallDLL)
+RESOLVE_NOTHING(VM::Operations::DebugReadStaticString)
+RESOLVE_NOTHING(VM::Operations::DebugWriteStringExpression)
+RESOLVE_NOTHING(VM::Operations::AssignTuple)
+RESOLVE_NOTHING(VM::Operations::BindFunctionReference)
+RESOLVE_NOTHING(VM::Operations::Length)
+RESOLVE_NOTHING(VM::Operations::ReadTuple)
+RESOLVE_NOTHING(VM::Operations::SizeOf)
+RESOLVE_NOTHING(VM::Operations::ArrayLength)
+RESOLVE_NOTHING(VM::Operations::ParallelFor)
+RESOLVE_NOTHING(VM::Operations::ParallelInvoke)
+RESOLVE_NOTHING(VM::Operations::ConsHashMap)
+
+
+// Operations which access a single named variable
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::AssignValue)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::BindReference)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::GetVariableValue)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::InitializeValue)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::MoveVariable)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::ReadArray)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::WriteArray)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::AppendArray)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::SortArray)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::SearchArray)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::ArrayMinIndex)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::ArrayMaxIndex)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapInsert)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapLookup)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapContains)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapErase)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapKeys)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::HashMapSize)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::AtomicUpdate)
+RESOLVE_ASSOCIATED_IDENTIFIER(VM::Operations::AtomicUpdateArray)
+
+
+// Operations which access a member of a named structure variable
+RESOLVE_STRUCTURE_MEMBER(VM::Operations::AssignStructure)
+RESOLVE_STRUCTURE_MEMBER(VM::Operations::ReadStructure)
+
+RESOLVER_TEMPLATE(VM::Operations::ReadStructureIndirect)
+{
+	SlotResolutionWrapper::ResolveIndirectStructureMember(traverser, op);
+}
+
+//
+// Chained member references operate on an address computed at runtime,
+// so only the first link of the chain can be resolved ahead of time
+//
+RESOLVER_TEMPLATE(VM::Operations::BindStructMemberReference)
+{
+	if(!op.IsChained())
+		SlotResolutionWrapper::ResolveStructureMember(traverser, op);
+}
+
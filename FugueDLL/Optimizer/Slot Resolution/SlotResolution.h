@@ -0,0 +1,65 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for resolving variable names to scope slots
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Operation;
+	struct VariableSlot;
+
+	namespace Operations
+	{
+		class ReadStructureIndirect;
+	}
+}
+
+
+namespace Optimizer
+{
+
+	class OptimizationTraverser;
+
+	//
+	// Explicit specializations of this function are used to perform
+	// the actual resolution. Using a template makes it easier to
+	// expose the logic to OptimizationTraverser::TraverseNode, i.e. we
+	// don't have to define lots of overloads by hand for every
+	// operation class.
+	//
+	template <class OperationClass>
+	void ResolveVariableSlots(OperationClass& op, OptimizationTraverser& traverser);
+
+
+	//
+	// This class provides a handy way to pass "friend" access over to
+	// the resolution logic from the traverser code. All the functions
+	// needed in the resolution process are defined here as members of
+	// the class; all of them can obtain access to the traverser class
+	// internals with one easy friend declaration.
+	//
+	class SlotResolutionWrapper
+	{
+	// Resolution helpers
+	public:
+		template <class OperationClass>
+		static void ResolveAssociatedIdentifier(OptimizationTraverser& traverser, OperationClass& op);
+
+		template <class OperationClass>
+		static void ResolveStructureMember(OptimizationTraverser& traverser, OperationClass& op);
+
+		static void ResolveIndirectStructureMember(OptimizationTraverser& traverser, VM::Operations::ReadStructureIndirect& op);
+
+	// Internal helpers
+	private:
+		static VM::VariableSlot ResolveIdentifier(OptimizationTraverser& traverser, const std::wstring& varname);
+	};
+
+}
+
@@ -0,0 +1,121 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for turning self-recursive tail calls into loops
+//
+// A function which calls itself as the very last thing it does has no
+// further use for its current frames once the call is made. Rather than
+// nesting a fresh set of frames for each such call, the new parameters
+// are copied over the current parameter frame and the function's body is
+// simply run again; deep recursion thus runs in constant stack space, and
+// skips the cost of setting up and tearing down a call each time around.
+//
+// Two forms of tail call are recognized, both only at the top level of
+// the function's body (calls inside nested blocks such as if/else bodies
+// still have the nested block's frame to unwind, and are left alone):
+//
+//  - a call whose return value is assigned directly to the function's
+//    sole return variable, followed by a return or the end of the body
+//  - a call to a function without return values, followed by a return
+//    or the end of the body
+//
+// Functions taking references or other functions as parameters are not
+// considered, since the new parameters might refer to the very frames
+// which are about to be reused.
+//
+
+#include "pch.h"
+
+#include "Optimizer/Tail Calls/TailCalls.h"
+
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Determine if the function's parameters can safely be overwritten in place
+	//
+	bool CanReuseParameterFrame(const Function& function)
+	{
+		const ScopeDescription& params = function.GetParams();
+		for(unsigned i = 0; i < params.GetNumMembers(); ++i)
+		{
+			if(params.IsReference(i) || params.IsFunctionSignature(i))
+				return false;
+		}
+
+		return true;
+	}
+
+	//
+	// Retrieve the invocation of the given function performed by an operation, if any
+	//
+	Invoke* GetSelfInvoke(Operation* op, const Function& function)
+	{
+		Invoke* invoke = op ? op->AsNode<Invoke>() : NULL;
+		if(invoke && invoke->GetFunction() == &function)
+			return invoke;
+
+		return NULL;
+	}
+
+	//
+	// Determine if the operation at the given index ends the function's body
+	//
+	bool IsEndOfBody(const std::vector<Operation*>& ops, size_t index)
+	{
+		if(index >= ops.size())
+			return true;
+
+		return ops[index]->IsNode<Return>();
+	}
+
+}
+
+
+//
+// Mark any calls made by the function to itself in tail position
+//
+void Optimizer::MarkTailCalls(Function& function)
+{
+	const Block* body = function.GetCodeBlock();
+	if(!body || !CanReuseParameterFrame(function))
+		return;
+
+	const ScopeDescription& returns = function.GetReturns();
+	const std::vector<Operation*>& ops = body->GetAllOperations();
+	for(size_t i = 0; i < ops.size(); ++i)
+	{
+		if(returns.GetNumMembers() == 0)
+		{
+			Invoke* invoke = GetSelfInvoke(ops[i], function);
+			if(invoke && IsEndOfBody(ops, i + 1))
+				invoke->MarkAsTailCall(&function);
+		}
+		else if(returns.GetNumMembers() == 1 && i + 1 < ops.size())
+		{
+			PushOperation* push = ops[i]->AsNode<PushOperation>();
+			if(!push)
+				continue;
+
+			Invoke* invoke = GetSelfInvoke(push->GetNestedOperation(), function);
+			const AssignValue* assign = ops[i + 1]->AsNode<AssignValue>();
+			if(invoke && assign && assign->GetAssociatedIdentifier() == returns.GetMemberOrder()[0] && IsEndOfBody(ops, i + 2))
+				invoke->MarkAsTailCall(&function);
+		}
+	}
+}
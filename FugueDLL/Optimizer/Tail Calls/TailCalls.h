@@ -0,0 +1,23 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Optimization logic for turning self-recursive tail calls into loops
+//
+
+#pragma once
+
+
+// Forward declarations
+namespace VM
+{
+	class Function;
+}
+
+
+namespace Optimizer
+{
+
+	void MarkTailCalls(VM::Function& function);
+
+}
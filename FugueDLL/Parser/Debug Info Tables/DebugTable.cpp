@@ -14,28 +14,70 @@
 
 
 //
-// Store the file position corresponding to a given operation
+// Store the file position and enclosing function corresponding to a given operation
 //
-void DebugTable::TrackInstruction(const VM::Operation* op, const FileLocationInfo& fileinfo)
+// If an operation is tracked more than once, the most recent
+// position takes precedence.
+//
+void DebugTable::TrackInstruction(const VM::Operation* op, const FileLocationInfo& fileinfo, const std::wstring& functionname)
 {
+	InstructionRecord record;
+	record.FileIndex = GetNameIndex(FileNames, fileinfo.FileName);
+	record.FunctionIndex = GetNameIndex(FunctionNames, functionname);
+	record.Line = fileinfo.Line;
+	record.Column = fileinfo.Column;
+
 	while(op != NULL)
 	{
-		InstructionLocationTable[op] = fileinfo;
+		record.Op = op;
+		InstructionRecords.push_back(record);
 		op = op->GetNestedOperation();
 	}
+
+	IsFinalized = false;
 }
 
 
 //
 // Retrieve the file position that corresponds to a given operation
 //
-const FileLocationInfo& DebugTable::GetInstructionLocation(const VM::Operation* op) const
+FileLocationInfo DebugTable::GetInstructionLocation(const VM::Operation* op) const
 {
-	std::map<const VM::Operation*, FileLocationInfo>::const_iterator iter = InstructionLocationTable.find(op);
-	if(iter == InstructionLocationTable.end())
+	FileLocationInfo location;
+	if(!FindInstructionLocation(op, location))
 		throw Parser::ParserFailureException("Instruction is not recorded in the debug table");
 
-	return iter->second;
+	return location;
+}
+
+//
+// Retrieve the file position that corresponds to a given operation;
+// returns false if the operation is not recorded in the debug table
+//
+bool DebugTable::FindInstructionLocation(const VM::Operation* op, FileLocationInfo& location) const
+{
+	const InstructionRecord* record = FindRecord(op);
+	if(!record)
+		return false;
+
+	location.FileName = FileNames[record->FileIndex];
+	location.Line = record->Line;
+	location.Column = record->Column;
+	return true;
+}
+
+//
+// Retrieve the name of the function whose code contains a given operation;
+// returns false if the operation is not recorded in the debug table
+//
+bool DebugTable::FindInstructionFunction(const VM::Operation* op, std::wstring& functionname) const
+{
+	const InstructionRecord* record = FindRecord(op);
+	if(!record)
+		return false;
+
+	functionname = FunctionNames[record->FunctionIndex];
+	return true;
 }
 
 
@@ -64,3 +106,80 @@ const std::wstring& DebugTable::GetTaskName(const VM::Operation* forkop) const
 	return iter->second;
 }
 
+
+//
+// Sort the recorded operation locations for fast lookup
+//
+// This should be done once parsing is complete. The sort is stable, so
+// that when an operation was tracked more than once, the last position
+// recorded for it can be kept and the rest discarded.
+//
+void DebugTable::Finalize()
+{
+	if(IsFinalized)
+		return;
+
+	std::stable_sort(InstructionRecords.begin(), InstructionRecords.end());
+
+	std::vector<InstructionRecord>::iterator output = InstructionRecords.begin();
+	for(std::vector<InstructionRecord>::const_iterator iter = InstructionRecords.begin(); iter != InstructionRecords.end(); ++iter)
+	{
+		std::vector<InstructionRecord>::const_iterator next = iter + 1;
+		if(next == InstructionRecords.end() || next->Op != iter->Op)
+			*output++ = *iter;
+	}
+
+	InstructionRecords.erase(output, InstructionRecords.end());
+	IsFinalized = true;
+}
+
+
+//
+// Retrieve the index of the given name in a file or function name
+// table, adding the name if it has not been seen before
+//
+// Operations are almost always tracked in runs from the same file
+// and function, so the most recently added name is checked first.
+//
+unsigned DebugTable::GetNameIndex(std::vector<std::wstring>& names, const std::wstring& name)
+{
+	if(!names.empty() && names.back() == name)
+		return static_cast<unsigned>(names.size() - 1);
+
+	std::vector<std::wstring>::const_iterator iter = std::find(names.begin(), names.end(), name);
+	if(iter != names.end())
+		return static_cast<unsigned>(iter - names.begin());
+
+	names.push_back(name);
+	return static_cast<unsigned>(names.size() - 1);
+}
+
+//
+// Locate the record that holds the position of a given operation
+//
+// Until the table is finalized, the records are searched from the end,
+// so that the most recently tracked position is still found first.
+//
+const DebugTable::InstructionRecord* DebugTable::FindRecord(const VM::Operation* op) const
+{
+	if(!IsFinalized)
+	{
+		for(std::vector<InstructionRecord>::const_reverse_iterator iter = InstructionRecords.rbegin(); iter != InstructionRecords.rend(); ++iter)
+		{
+			if(iter->Op == op)
+				return &(*iter);
+		}
+
+		return NULL;
+	}
+
+	InstructionRecord key;
+	key.Op = op;
+
+	std::vector<InstructionRecord>::const_iterator iter = std::lower_bound(InstructionRecords.begin(), InstructionRecords.end(), key);
+	if(iter == InstructionRecords.end() || iter->Op != op)
+		return NULL;
+
+	return &(*iter);
+}
+
@@ -28,19 +28,61 @@ struct FileLocationInfo
 };
 
 
+//
+// One entry is recorded for each operation generated by the parser, so
+// the table is kept compact: operation locations are appended to a flat
+// list during parsing, with file and function names stored once in
+// separate tables, and the list is sorted by operation when parsing is
+// complete so that lookups can use a binary search.
+//
+// Each operation also records the name of the Epoch function whose code
+// it belongs to; operations outside of any function (such as global
+// initializers) record an empty name.
+//
 class DebugTable
 {
+// Construction
+public:
+	DebugTable()
+		: IsFinalized(true)
+	{ }
+
 // Information interface
 public:
-	void TrackInstruction(const VM::Operation* op, const FileLocationInfo& fileinfo);
-	const FileLocationInfo& GetInstructionLocation(const VM::Operation* op) const;
+	void TrackInstruction(const VM::Operation* op, const FileLocationInfo& fileinfo, const std::wstring& functionname);
+	FileLocationInfo GetInstructionLocation(const VM::Operation* op) const;
+	bool FindInstructionLocation(const VM::Operation* op, FileLocationInfo& location) const;
+	bool FindInstructionFunction(const VM::Operation* op, std::wstring& functionname) const;
 
 	void TrackTaskName(const VM::Operation* forkop, const std::wstring& taskname);
 	const std::wstring& GetTaskName(const VM::Operation* forkop) const;
 
+	void Finalize();
+
+// Internal helpers
+private:
+	struct InstructionRecord
+	{
+		const VM::Operation* Op;
+		unsigned FileIndex;
+		unsigned FunctionIndex;
+		unsigned Line;
+		unsigned Column;
+
+		bool operator < (const InstructionRecord& rhs) const
+		{ return Op < rhs.Op; }
+	};
+
+	static unsigned GetNameIndex(std::vector<std::wstring>& names, const std::wstring& name);
+	const InstructionRecord* FindRecord(const VM::Operation* op) const;
+
 // Internal tracking
 private:
-	std::map<const VM::Operation*, FileLocationInfo> InstructionLocationTable;
+	std::vector<InstructionRecord> InstructionRecords;
+	std::vector<std::wstring> FileNames;
+	std::vector<std::wstring> FunctionNames;
+	bool IsFinalized;
+
 	std::map<const VM::Operation*, std::wstring> TaskNameTable;
 };
 
@@ -0,0 +1,78 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Index of line positions within a source code buffer
+//
+
+#include "pch.h"
+
+#include "Parser/Debug Info Tables/SourceLineTable.h"
+
+#include "Utility/Strings.h"
+
+
+//
+// Record the start of each line in the given source buffer
+//
+void SourceLineTable::Index(const Byte* begin, const Byte* end, const std::string& filename)
+{
+	CodeBegin = begin;
+	CodeEnd = end;
+	FileName = widen(filename);
+
+	LineStarts.clear();
+	LineStarts.push_back(begin);
+
+	for(const Byte* pos = begin; pos != end; ++pos)
+	{
+		if(*pos == '\n')
+			LineStarts.push_back(pos + 1);
+	}
+}
+
+
+//
+// Compute the file location of the given position in the source buffer
+//
+// Lines and columns are numbered from 1; tabs advance the column to the
+// next tab stop, matching the display performed by DumpCodeLine.
+//
+FileLocationInfo SourceLineTable::Locate(const Byte* pos, unsigned tabwidth) const
+{
+	FileLocationInfo fileinfo;
+	fileinfo.FileName = FileName;
+	fileinfo.Line = 1;
+	fileinfo.Column = 1;
+
+	if(!pos || LineStarts.empty() || pos < CodeBegin || pos > CodeEnd)
+		return fileinfo;
+
+	std::vector<const Byte*>::const_iterator iter = std::upper_bound(LineStarts.begin(), LineStarts.end(), pos);
+	--iter;
+
+	fileinfo.Line = static_cast<unsigned>(iter - LineStarts.begin()) + 1;
+
+	for(const Byte* linepos = *iter; linepos != pos; ++linepos)
+	{
+		if(*linepos == '\t' && tabwidth)
+			fileinfo.Column += tabwidth - ((fileinfo.Column - 1) % tabwidth);
+		else
+			++fileinfo.Column;
+	}
+
+	return fileinfo;
+}
+
+//
+// Retrieve the position just past the end of the line containing the given position
+//
+const Byte* SourceLineTable::GetEndOfLine(const Byte* pos) const
+{
+	std::vector<const Byte*>::const_iterator iter = std::upper_bound(LineStarts.begin(), LineStarts.end(), pos);
+	if(iter == LineStarts.end())
+		return CodeEnd;
+
+	return *iter;
+}
+
@@ -0,0 +1,50 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Index of line positions within a source code buffer
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Parser/Debug Info Tables/DebugTable.h"
+
+
+//
+// The parser grammars operate directly on raw character pointers into
+// the source buffer, rather than on iterators which track the line and
+// column of every character they pass over. This sidesteps the cost of
+// position tracking during backtracking, which re-scans characters many
+// times over. Instead, the start of each line is found once, up front,
+// and file locations are computed on demand from a raw pointer when an
+// operation is recorded in the debug table or an error is reported.
+//
+class SourceLineTable
+{
+// Construction
+public:
+	SourceLineTable()
+		: CodeBegin(NULL),
+		  CodeEnd(NULL)
+	{ }
+
+// Indexing interface
+public:
+	void Index(const Byte* begin, const Byte* end, const std::string& filename);
+
+// Location interface
+public:
+	FileLocationInfo Locate(const Byte* pos, unsigned tabwidth) const;
+
+	const Byte* GetEndOfLine(const Byte* pos) const;
+
+// Internal tracking
+private:
+	const Byte* CodeBegin;
+	const Byte* CodeEnd;
+	std::wstring FileName;
+	std::vector<const Byte*> LineStarts;
+};
+
@@ -33,7 +33,7 @@ void ParserState::ReportFatalError(const char* what)
 
 	UI::OutputStream output;
 	output << UI::lightred << what << UI::resetcolor << std::endl;
-	const boost::spirit::classic::file_position pos = GetParsePosition().get_position();
-	output << L"File: " << widen(pos.file) << L" Line: " << pos.line << L" Column: " << pos.column << std::endl;
-	DumpCodeLine(pos.line, pos.column, Config::TabWidth);
+	const FileLocationInfo location = GetFileLocationInfo();
+	output << L"File: " << location.FileName << L" Line: " << location.Line << L" Column: " << location.Column << std::endl;
+	DumpCodeLine(location.Line, location.Column, Config::TabWidth);
 }
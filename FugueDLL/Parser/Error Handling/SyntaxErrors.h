@@ -55,8 +55,7 @@ namespace Parser
 		template <typename ScannerType, typename ErrorType>
 		boost::spirit::classic::error_status<> operator () (const ScannerType& scanner, const ErrorType& error) const
 		{
-			boost::spirit::classic::file_position pos = error.where.get_position();
-			std::wstring filename = widen(pos.file);
+			FileLocationInfo pos = State.GetSourceLocation(error.where);
 
 			UI::OutputStream output;
 
@@ -119,14 +118,15 @@ namespace Parser
 				break;
 			}
 
-			output << L"File: " << filename << L" Line: " << pos.line << L" Column: " << pos.column << std::endl;
+			output << L"File: " << pos.FileName << L" Line: " << pos.Line << L" Column: " << pos.Column << std::endl;
 
-			State.DumpCodeLine(pos.line, pos.column, Config::TabWidth);
+			State.DumpCodeLine(pos.Line, pos.Column, Config::TabWidth);
 			State.ParseFailed = true;
 
 			// Move past the broken line and continue parsing
-			while(scanner.first.get_position().line <= pos.line)
-				++scanner;
+			Parser::ParsePosIter nextline = State.GetEndOfSourceLine(error.where);
+			if(scanner.first < nextline)
+				scanner.first = nextline;
 
 			return boost::spirit::classic::error_status<>(boost::spirit::classic::error_status<>::retry);
 		}
@@ -43,13 +43,22 @@ namespace Parser
 	// manages the bulk of syntax error detection and provides an
 	// early-out path for programs that are not well-formed.
 	//
+	// The grammar can optionally skim over the contents of function
+	// bodies, matching only braces, string literals, and any nested
+	// tuple or structure definitions. Everything the second pass needs
+	// to know in advance is declared outside of function bodies, so
+	// this still provides the full set of forward declarations, while
+	// avoiding a complete parse of the code which the second pass is
+	// going to parse again anyways.
+	//
 	struct EpochGrammarPreProcess : public EpochGrammarBase, public boost::spirit::classic::grammar<EpochGrammarPreProcess>
 	{
 		//
 		// Construct the grammar and bind it to a state tracker
 		//
-		EpochGrammarPreProcess(Parser::ParserState& state)
-			: EpochGrammarBase(state)
+		EpochGrammarPreProcess(Parser::ParserState& state, bool skimfunctionbodies = false)
+			: EpochGrammarBase(state),
+			  SkimFunctionBodies(skimfunctionbodies)
 		{ }
 
 		//
@@ -79,7 +88,8 @@ namespace Parser
 
 				  // String tokens: types
 				  INTEGER(KEYWORD(Integer)), INTEGER16(KEYWORD(Integer16)), STRING(KEYWORD(String)), BOOLEAN(KEYWORD(Boolean)), REAL(KEYWORD(Real)),
-				  TUPLE(KEYWORD(Tuple)), STRUCTURE(KEYWORD(Structure)), BUFFER(KEYWORD(Buffer)), ARRAY(KEYWORD(Array)),
+				  TUPLE(KEYWORD(Tuple)), STRUCTURE(KEYWORD(Structure)), BUFFER(KEYWORD(Buffer)), ARRAY(KEYWORD(Array)), HASHMAP(KEYWORD(HashMap)),
+				  MAPARRAY(KEYWORD(MapArray)),
 
 				  // String tokens: parameter annotations
 				  REFERENCE(KEYWORD(Reference)),
@@ -97,6 +107,10 @@ namespace Parser
 				  LENGTH(KEYWORD(Length)),
 				  MEMBER(KEYWORD(Member)),
 				  MESSAGE(KEYWORD(Message)),
+				  BROADCAST(KEYWORD(Broadcast)),
+				  SENDAFTER(KEYWORD(SendAfter)),
+				  SENDEVERY(KEYWORD(SendEvery)),
+				  REQUEST(KEYWORD(Request)),
 				  MAP(KEYWORD(Map)),
 				  REDUCE(KEYWORD(Reduce)),
 
@@ -114,10 +128,15 @@ namespace Parser
 				  CALLER(KEYWORD(Caller)),
 				  SENDER(KEYWORD(Sender)),
 				  ACCEPTMESSAGE(KEYWORD(AcceptMessage)),
+				  ACCEPTMESSAGETIMEOUT(KEYWORD(AcceptMessageTimeout)),
 				  RESPONSEMAP(KEYWORD(ResponseMap)),
 				  FUTURE(KEYWORD(Future)),
+				  PARALLELINVOKE(KEYWORD(ParallelInvoke)),
 				  THREAD(KEYWORD(Thread)),
 				  THREADPOOL(KEYWORD(ThreadPool)),
+				  CHANNEL(KEYWORD(Channel)),
+				  CHANNELRECEIVE(KEYWORD(ChannelReceive)),
+				  NEXTVALUE(KEYWORD(NextValue)),
 
 				  // String tokens: dynamic syntax
 				  INFIXDECL(KEYWORD(Infix)),
@@ -239,8 +258,43 @@ namespace Parser
 						CLOSEPARENS >> CLOSEPARENS
 					;
 
+				BroadcastHelper
+					= BROADCAST >> OPENPARENS >>
+						PassedParameter >>
+						COMMA >> StringIdentifier >>
+						OPENPARENS >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS
+					;
+
+				DelayedMessageHelper
+					= (SENDAFTER | SENDEVERY) >> OPENPARENS >>
+						PassedParameter >> COMMA >>
+						(
+						    (CALLER >> OPENPARENS >> CLOSEPARENS)
+						  | (SENDER >> OPENPARENS >> CLOSEPARENS)
+						  |	PassedParameter
+						) >>
+						COMMA >> StringIdentifier >>
+						OPENPARENS >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS
+					;
+
+				RequestHelper
+					= REQUEST >> OPENPARENS >>
+						StringIdentifier >> COMMA >>
+						(TypeKeywords) >> COMMA >>
+						PassedParameter >>
+						COMMA >> StringIdentifier >>
+						OPENPARENS >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS
+					;
+
 				AcceptMessageHelper
-					= (ACCEPTMESSAGE >> OPENPARENS >>
+					= (ACCEPTMESSAGETIMEOUT >> OPENPARENS >> PassedParameter >> COMMA >> StringIdentifier >> CLOSEPARENS)
+					| (ACCEPTMESSAGE >> OPENPARENS >>
 						(
 							((StringIdentifier) >> CLOSEPARENS)
 						  | (MessageDispatch >> CLOSEPARENS)
@@ -302,9 +356,14 @@ namespace Parser
 					| (SIZEOF >> OPENPARENS >> StringIdentifier >> CLOSEPARENS)
 					| (LENGTH >> OPENPARENS >> StringIdentifier >> CLOSEPARENS)
 					| (FUTURE >> OPENPARENS >> StringIdentifier >> COMMA >> PassedParameter >> CLOSEPARENS)
+					| (PARALLELINVOKE >> OPENPARENS >> StringIdentifier >> +(COMMA >> PassedParameter) >> CLOSEPARENS)
+					| ((CHANNELRECEIVE | CHANNEL | NEXTVALUE) >> OPENPARENS >> (TypeKeywords) >> COMMA >> PassedParameter >> CLOSEPARENS)
 					| ((MAP | REDUCE) >> OPENPARENS >> PassedParameter >> COMMA >> StringIdentifier >> CLOSEPARENS)
 					| MemberHelper
 					| MessageHelper
+					| BroadcastHelper
+					| DelayedMessageHelper
+					| RequestHelper
 					| AcceptMessageHelper
 					| IncrementDecrementHelper
 					| OpAssignmentHelper
@@ -394,13 +453,22 @@ namespace Parser
 					| MEMBER
 					| TASK
 					| MESSAGE
+					| BROADCAST
+					| SENDAFTER
+					| SENDEVERY
+					| REQUEST
 					| ACCEPTMESSAGE
+					| ACCEPTMESSAGETIMEOUT
 					| RESPONSEMAP
 					| FUTURE
+					| PARALLELINVOKE
 					| MAP
 					| REDUCE
 					| THREAD
 					| THREADPOOL
+					| CHANNELRECEIVE
+					| CHANNEL
+					| NEXTVALUE
 					| LanguageExtensionKeywords
 					;
 
@@ -416,6 +484,8 @@ namespace Parser
 					| !CONSTANT >> BOOLEAN >> (OPENPARENS >> StringIdentifier >> ExpectComma(COMMA) >> PassedParameter >> CLOSEPARENS)
 					| !CONSTANT >> REAL >> (OPENPARENS >> StringIdentifier >> ExpectComma(COMMA) >> PassedParameter >> CLOSEPARENS)
 					| !CONSTANT >> ARRAY >> (OPENPARENS >> StringIdentifier >> ExpectComma(COMMA) >> (TypeKeywords | OperationParameter) >> CLOSEPARENS)
+					| !CONSTANT >> HASHMAP >> (OPENPARENS >> StringIdentifier >> ExpectComma(COMMA) >> TypeKeywords >> ExpectComma(COMMA) >> TypeKeywords >> CLOSEPARENS)
+					| !CONSTANT >> MAPARRAY >> (OPENPARENS >> StringIdentifier >> ExpectComma(COMMA) >> TypeKeywords >> ExpectComma(COMMA) >> PassedParameter >> CLOSEPARENS)
 					;
 
 				TupleDefinition
@@ -509,10 +579,30 @@ namespace Parser
 									  |
 										(OPENPARENS >> CLOSEPARENS[RegisterNullReturn(self.State)])
 									)
-							) >> CodeBlock
+							) >> FunctionBody
 					)[SyntaxErrorHandler(self.State)]
 					;
 
+				SkimmedFunctionBody
+					= OPENBRACE[EnterBlockPP(self.State)] >>
+						(*SkimmedBlockContents) >>
+					  CLOSEBRACE[ExitBlockPP(self.State)]
+					;
+
+				SkimmedBlockContents
+					= TupleDefinition
+					| StructureDefinition
+					| (OPENBRACE >> (*SkimmedBlockContents) >> CLOSEBRACE)
+					| StringLiteral
+					| StringIdentifier
+					| (anychar_p - OPENBRACE - CLOSEBRACE - QUOTE)
+					;
+
+				if(self.SkimFunctionBodies)
+					FunctionBody = SkimmedFunctionBody;
+				else
+					FunctionBody = CodeBlock;
+
 				ExternalDeclaration
 					= EXTERNAL >> StringLiteral[RegisterExternalFunctionDLL(self.State)] >> StringIdentifier[RegisterExternalFunctionName(self.State)] >> COLON
 					  >> OPENPARENS >> 
@@ -601,6 +691,8 @@ namespace Parser
 			boost::spirit::classic::strlit<> RESPONSEMAP, INFIXDECL, CRASHPARSER, NOT, BUFFER, ASSIGN, CAST, READTUPLE, WRITETUPLE, READSTRUCTURE, WRITESTRUCTURE;
 			boost::spirit::classic::strlit<> SIZEOF, LENGTH, MEMBER, MESSAGE, FUTURE, MAP, REDUCE, CALLER, SENDER, ALIASDECL, INCREMENT, DECREMENT, THREADPOOL;
 			boost::spirit::classic::strlit<> ADDASSIGN, SUBTRACTASSIGN, MULTIPLYASSIGN, DIVIDEASSIGN, CONCATASSIGN, ARRAY, MEMBEROPERATOR, EXTENSION, THREAD, PARALLELFOR;
+			boost::spirit::classic::strlit<> CHANNEL, CHANNELRECEIVE, BROADCAST, REQUEST, HASHMAP, SENDAFTER, SENDEVERY, ACCEPTMESSAGETIMEOUT, PARALLELINVOKE, NEXTVALUE;
+			boost::spirit::classic::strlit<> MAPARRAY;
 
 			// Parser rules
 			boost::spirit::classic::rule<ScannerType> StringIdentifier, FunctionDefinition, PassedParameter, OperationParameter, Operation, CodeBlock, Program;
@@ -608,8 +700,10 @@ namespace Parser
 			boost::spirit::classic::rule<ScannerType> ControlKeywords, TypeKeywords, VariableDefinition, BooleanLiteral, CodeBlockContents, GlobalBlock, PassedParameterInfixList;
 			boost::spirit::classic::rule<ScannerType> ExternalDeclaration, RealLiteral, TupleDefinition, StructureDefinition, HigherOrderFunctionHelper, MessageDispatch;
 			boost::spirit::classic::rule<ScannerType> HexLiteral, Task, AcceptMessageHelper, ResponseMapHelper, PassedParameterBase, InfixOperator, ThreadPool, ThreadBlock;
-			boost::spirit::classic::rule<ScannerType> InfixAssignmentHelper, OtherKeywords, ReadStructureHelper, WriteStructureHelper, MemberHelper, MessageHelper;
+			boost::spirit::classic::rule<ScannerType> InfixAssignmentHelper, OtherKeywords, ReadStructureHelper, WriteStructureHelper, MemberHelper, MessageHelper, BroadcastHelper, RequestHelper;
+			boost::spirit::classic::rule<ScannerType> DelayedMessageHelper;
 			boost::spirit::classic::rule<ScannerType> IncrementDecrementHelper, OpAssignmentHelper, LanguageExtensionBlock, ExtensionImport, FunctionReturns;
+			boost::spirit::classic::rule<ScannerType> FunctionBody, SkimmedFunctionBody, SkimmedBlockContents;
 
 			boost::spirit::classic::stored_rule<ScannerType> LanguageExtensionKeywords;
 
@@ -635,10 +729,14 @@ namespace Parser
 				LanguageExtensionKeywords = LanguageExtensionKeywords.copy() | boost::spirit::classic::strlit<>(Keywords::GetNarrowedKeyword(blockkeyword.c_str()));
 			}
 		};
+
+	// Internal tracking
+	private:
+		bool SkimFunctionBodies;
 	};
 
 
 }
 
 #undef KEYWORD
-#undef OPERATOR
\ No newline at end of file
+#undef OPERATOR
\ No newline at end of file
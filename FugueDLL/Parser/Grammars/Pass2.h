@@ -89,7 +89,15 @@ namespace Parser
 				  FUTURE(KEYWORD(Future)), REDUCE(KEYWORD(Reduce)), ARRAY(KEYWORD(Array)), MAP(KEYWORD(Map)), VAR(KEYWORD(Var)),
 				  NOT(OPERATOR(Not)), BUFFER(KEYWORD(Buffer)), ALIASDECL(KEYWORD(Alias)), MEMBEROPERATOR(OPERATOR(Member)),
 				  EXTENSION(KEYWORD(Extension)), THREAD(KEYWORD(Thread)), THREADPOOL(KEYWORD(ThreadPool)),
-				  READARRAY(KEYWORD(ReadArray)), WRITEARRAY(KEYWORD(WriteArray)), PARALLELFOR(KEYWORD(ParallelFor)),
+				  READARRAY(KEYWORD(ReadArray)), WRITEARRAY(KEYWORD(WriteArray)), APPENDARRAY(KEYWORD(AppendArray)), PARALLELFOR(KEYWORD(ParallelFor)),
+				  SORTARRAY(KEYWORD(SortArray)), SEARCHARRAY(KEYWORD(SearchArray)), MININDEX(KEYWORD(MinIndex)), MAXINDEX(KEYWORD(MaxIndex)),
+				  CHANNEL(KEYWORD(Channel)), CHANNELRECEIVE(KEYWORD(ChannelReceive)), BROADCAST(KEYWORD(Broadcast)), REQUEST(KEYWORD(Request)),
+				  HASHMAP(KEYWORD(HashMap)), MAPARRAY(KEYWORD(MapArray)), MAPINSERT(KEYWORD(MapInsert)), MAPLOOKUP(KEYWORD(MapLookup)), MAPCONTAINS(KEYWORD(MapContains)),
+				  MAPERASE(KEYWORD(MapErase)), MAPKEYS(KEYWORD(MapKeys)), SENDAFTER(KEYWORD(SendAfter)), SENDEVERY(KEYWORD(SendEvery)),
+				  ACCEPTMESSAGETIMEOUT(KEYWORD(AcceptMessageTimeout)), PARALLELINVOKE(KEYWORD(ParallelInvoke)), NEXTVALUE(KEYWORD(NextValue)),
+				  MOVE(KEYWORD(Move)), ATOMICADD(KEYWORD(AtomicAdd)), ATOMICMIN(KEYWORD(AtomicMin)), ATOMICMAX(KEYWORD(AtomicMax)),
+				  COMPAREEXCHANGE(KEYWORD(CompareExchange)), CANCEL(KEYWORD(Cancel)),
+				  WHENALL(KEYWORD(WhenAll)), WHENANY(KEYWORD(WhenAny)),
 
 				  // String tokens: special arithmetic operators
 				  INCREMENT(OPERATOR(Increment)),
@@ -181,6 +189,25 @@ namespace Parser
 					= (WRITEARRAY >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> COMMA[ResetInfixTracking(self.State)] >> PassedParameter >> CLOSEPARENS)
 					;
 
+				AppendArrayHelper
+					= (APPENDARRAY >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> CLOSEPARENS)
+					;
+
+				ArrayAlgorithmHelper
+					= ((SORTARRAY | MININDEX | MAXINDEX) >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
+					| (SEARCHARRAY >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> CLOSEPARENS)
+					;
+
+				HashMapHelper
+					= (MAPINSERT >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> COMMA[ResetInfixTracking(self.State)] >> PassedParameter >> CLOSEPARENS)
+					| ((MAPLOOKUP | MAPCONTAINS | MAPERASE) >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> CLOSEPARENS)
+					| (MAPKEYS >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
+					;
+
+				AtomicHelper
+					= ((ATOMICADD | ATOMICMIN | ATOMICMAX | COMPAREEXCHANGE) >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> +(COMMA[ResetInfixTracking(self.State)] >> PassedParameter) >> CLOSEPARENS)
+					;
+
 				MemberHelper
 					= (MEMBER >> OPENPARENS[StartCountingParams(self.State)] >> (StringIdentifier - MEMBER)[PushIdentifierNoStack(self.State)] >> COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
 					| (MEMBER >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
@@ -199,8 +226,43 @@ namespace Parser
 						CLOSEPARENS >> CLOSEPARENS[PushCachedOperations(self.State)]
 					;
 
+				BroadcastHelper
+					= BROADCAST >> OPENPARENS[StartCountingParams(self.State)] >>
+						(PassedParameter)[CacheTailOperations(self.State)] >>
+						COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >>
+						OPENPARENS[StartCountingParams(self.State)] >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS[PushCachedOperations(self.State)]
+					;
+
+				DelayedMessageHelper
+					= (SENDAFTER | SENDEVERY) >> OPENPARENS[StartCountingParams(self.State)] >>
+						PassedParameter >> COMMA >>
+						(
+						    (CALLER >> OPENPARENS >> CLOSEPARENS)[PushCallerOperation(self.State)]
+						  | (SENDER >> OPENPARENS >> CLOSEPARENS)[PushSenderOperation(self.State)]
+						  |	(PassedParameter)[CacheTailOperations(self.State)]
+						) >>
+						COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >>
+						OPENPARENS[StartCountingParams(self.State)] >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS[PushCachedOperations(self.State)]
+					;
+
+				RequestHelper
+					= REQUEST >> OPENPARENS[StartCountingParams(self.State)] >>
+						StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >>
+						(TypeKeywords[PushRawStringNoStack(self.State)] | UserDefinedTypeAliases[ResolveAliasAndPushNoStack(self.State)]) >> COMMA >>
+						(PassedParameter)[CacheTailOperations(self.State)] >>
+						COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >>
+						OPENPARENS[StartCountingParams(self.State)] >>
+							!OperationParameter >>
+						CLOSEPARENS >> CLOSEPARENS[PushCachedOperations(self.State)]
+					;
+
 				AcceptMessageHelper
-					= (ACCEPTMESSAGE >> OPENPARENS[StartCountingParams(self.State)] >>
+					= (ACCEPTMESSAGETIMEOUT >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
+					| (ACCEPTMESSAGE >> OPENPARENS[StartCountingParams(self.State)] >>
 						(
 							((StringIdentifier[SaveStringIdentifier(self.State, SavedStringSlot_AcceptMsg)]) >> CLOSEPARENS)[PushSavedIdentifier(self.State, SavedStringSlot_AcceptMsg)]
 						  | (MessageDispatch >> CLOSEPARENS)
@@ -261,12 +323,24 @@ namespace Parser
 					| WriteStructureHelper
 					| ReadArrayHelper
 					| WriteArrayHelper
+					| AppendArrayHelper
+					| ArrayAlgorithmHelper
+					| HashMapHelper
+					| AtomicHelper
 					| (SIZEOF >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)[TerminateInfixExpression(self.State)]
 					| (LENGTH >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)[TerminateInfixExpression(self.State)]
+					| (MOVE >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)[TerminateInfixExpression(self.State)]
+					| (CANCEL >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
 					| (FUTURE >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> !(COMMA[ResetInfixTracking(self.State)] >> PassedParameter) >> CLOSEPARENS)
+					| ((WHENALL | WHENANY) >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> COMMA[ResetInfixTracking(self.State)] >> PassedParameter >> +(COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)]) >> CLOSEPARENS)
+					| (PARALLELINVOKE >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> +(COMMA[ResetInfixTracking(self.State)] >> PassedParameter) >> CLOSEPARENS)
 					| ((MAP | REDUCE) >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> COMMA >> StringIdentifier[PushIdentifierNoStack(self.State)] >> CLOSEPARENS)
+					| ((CHANNELRECEIVE | CHANNEL | NEXTVALUE) >> OPENPARENS[StartCountingParams(self.State)] >> (TypeKeywords[PushRawStringNoStack(self.State)] | UserDefinedTypeAliases[ResolveAliasAndPushNoStack(self.State)]) >> COMMA >> PassedParameter >> CLOSEPARENS)
 					| MemberHelper[IncrementMemberLevel(self.State)]
 					| MessageHelper
+					| BroadcastHelper
+					| DelayedMessageHelper
+					| RequestHelper
 					| AcceptMessageHelper
 					| IncrementDecrementHelper
 					| (((StringIdentifier - ControlKeywords) - OtherKeywords) >> OPENPARENS[StartCountingParams(self.State)] >> *OperationParameter >> CLOSEPARENS)
@@ -317,10 +391,14 @@ namespace Parser
 				ControlSimple
 					= (IF[RegisterControl(self.State, false)] >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> CLOSEPARENS[PopParameterCount(self.State)] >> CodeBlock >> *(ELSEIF[RegisterControl(self.State, false)] >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> CLOSEPARENS[PopParameterCount(self.State)] >> CodeBlock) >> !(ELSE[RegisterControl(self.State, false)] >> CodeBlock))
 					| (WHILE[RegisterControl(self.State, false)] >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> CLOSEPARENS[RegisterEndOfWhileLoopConditional(self.State)] >> CodeBlock)
-					| (PARALLELFOR[RegisterControl(self.State, false)] >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> COMMA >> PassedParameter >> COMMA >> PassedParameter >> CLOSEPARENS[RegisterEndOfParallelFor(self.State)] >> CodeBlock)
+					| (PARALLELFOR[RegisterControl(self.State, false)] >> OPENPARENS[StartCountingParams(self.State)] >> StringIdentifier[PushIdentifierNoStack(self.State)] >> COMMA >> PassedParameter >> COMMA >> PassedParameter >> COMMA >> PassedParameter >> *(COMMA >> ParallelForReduction) >> CLOSEPARENS[RegisterEndOfParallelFor(self.State)] >> CodeBlock)
 					| LanguageExtensionControls
 					;
 
+				ParallelForReduction
+					= (StringIdentifier >> OPENPARENS >> StringIdentifier >> CLOSEPARENS)[RegisterParallelForReduction(self.State)]
+					;
+
 				ControlWithEnding
 					= DO[RegisterControl(self.State, false)] >> CodeBlock >> WHILE >> OPENPARENS[StartCountingParams(self.State)] >> PassedParameter >> CLOSEPARENS[PopDoWhileLoop(self.State)]
 					;
@@ -353,16 +431,26 @@ namespace Parser
 					| WRITESTRUCTURE
 					| SIZEOF
 					| LENGTH
+					| MOVE
 					| MEMBER
 					| TASK
 					| MESSAGE
+					| BROADCAST
+					| SENDAFTER
+					| SENDEVERY
+					| REQUEST
 					| ACCEPTMESSAGE
+					| ACCEPTMESSAGETIMEOUT
 					| RESPONSEMAP
 					| FUTURE
+					| PARALLELINVOKE
 					| MAP
 					| REDUCE
 					| THREAD
 					| THREADPOOL
+					| CHANNELRECEIVE
+					| CHANNEL
+					| NEXTVALUE
 					| LanguageExtensionKeywords
 					;
 
@@ -403,6 +491,16 @@ namespace Parser
 					| !CONSTANT[RegisterUpcomingConstant(self.State)] >> ARRAY >> OPENPARENS[RegisterUpcomingArrayVariable(self.State)][StartCountingParams(self.State)]
 						>> StringIdentifier[RegisterVariableName(self.State)]
 						>> COMMA >> (TypeKeywords[RegisterArrayType(self.State)] | OperationParameter) >> CLOSEPARENS[RegisterArrayVariable(self.State)]
+
+					| !CONSTANT[RegisterUpcomingConstant(self.State)] >> HASHMAP >> OPENPARENS[RegisterUpcomingHashMapVariable(self.State)][StartCountingParams(self.State)]
+						>> StringIdentifier[RegisterVariableName(self.State)]
+						>> COMMA >> TypeKeywords[RegisterHashMapKeyType(self.State)]
+						>> COMMA >> TypeKeywords[RegisterHashMapValueType(self.State)] >> CLOSEPARENS[RegisterHashMapVariable(self.State)]
+
+					| !CONSTANT[RegisterUpcomingConstant(self.State)] >> MAPARRAY >> OPENPARENS[RegisterUpcomingArrayVariable(self.State)][StartCountingParams(self.State)]
+						>> StringIdentifier[RegisterVariableName(self.State)]
+						>> COMMA >> TypeKeywords[RegisterArrayType(self.State)]
+						>> COMMA >> PassedParameter >> CLOSEPARENS[RegisterMappedArrayVariable(self.State)]
 					;
 
 				TupleDefinition
@@ -468,7 +566,7 @@ namespace Parser
 										(OPENPARENS >> CLOSEPARENS)
 									)
 							) >> CodeBlock
-					)
+					)[RecordFunctionSource(self.State)]
 					;
 
 				ExternalDeclaration
@@ -549,6 +647,7 @@ namespace Parser
 				BOOST_SPIRIT_DEBUG_RULE(StringLiteral);
 				BOOST_SPIRIT_DEBUG_RULE(Control);
 				BOOST_SPIRIT_DEBUG_RULE(ControlSimple);
+				BOOST_SPIRIT_DEBUG_RULE(ParallelForReduction);
 				BOOST_SPIRIT_DEBUG_RULE(ControlWithEnding);
 				BOOST_SPIRIT_DEBUG_RULE(LibraryImport);
 
@@ -572,6 +671,9 @@ namespace Parser
 				BOOST_SPIRIT_DEBUG_RULE(HexLiteral);
 				BOOST_SPIRIT_DEBUG_RULE(Task);
 				BOOST_SPIRIT_DEBUG_RULE(MessageHelper);
+				BOOST_SPIRIT_DEBUG_RULE(BroadcastHelper);
+				BOOST_SPIRIT_DEBUG_RULE(DelayedMessageHelper);
+				BOOST_SPIRIT_DEBUG_RULE(RequestHelper);
 				BOOST_SPIRIT_DEBUG_RULE(AcceptMessageHelper);
 
 				BOOST_SPIRIT_DEBUG_RULE(ResponseMapHelper);
@@ -602,17 +704,22 @@ namespace Parser
 			boost::spirit::classic::strlit<> TUPLE, READTUPLE, WRITETUPLE, STRUCTURE, READSTRUCTURE, WRITESTRUCTURE, SIZEOF, INTEGER16, REFERENCE, FUNCTION, LENGTH, GLOBAL, MEMBER;
 			boost::spirit::classic::strlit<> CONSTANT, HEXPREFIX, TASK, MESSAGE, ACCEPTMESSAGE, NULLFUNCTIONARROW, CALLER, SENDER, RESPONSEMAP, INFIXDECL, CRASHPARSER, FUTURE;
 			boost::spirit::classic::strlit<> ARRAY, MAP, REDUCE, VAR, NOT, BUFFER, ALIASDECL, ADDASSIGN, SUBTRACTASSIGN, MULTIPLYASSIGN, DIVIDEASSIGN, INCREMENT, DECREMENT;
-			boost::spirit::classic::strlit<> CONCATASSIGN, MEMBEROPERATOR, EXTENSION, THREAD, THREADPOOL, READARRAY, WRITEARRAY, PARALLELFOR;
+			boost::spirit::classic::strlit<> CONCATASSIGN, MEMBEROPERATOR, EXTENSION, THREAD, THREADPOOL, READARRAY, WRITEARRAY, APPENDARRAY, PARALLELFOR;
+			boost::spirit::classic::strlit<> SORTARRAY, SEARCHARRAY, MININDEX, MAXINDEX;
+			boost::spirit::classic::strlit<> CHANNEL, CHANNELRECEIVE, BROADCAST, REQUEST, HASHMAP, MAPARRAY, MAPINSERT, MAPLOOKUP, MAPCONTAINS, MAPERASE, MAPKEYS;
+			boost::spirit::classic::strlit<> SENDAFTER, SENDEVERY, ACCEPTMESSAGETIMEOUT, PARALLELINVOKE, NEXTVALUE, MOVE;
+			boost::spirit::classic::strlit<> ATOMICADD, ATOMICMIN, ATOMICMAX, COMPAREEXCHANGE, CANCEL, WHENALL, WHENANY;
 
 			// Parser rules
 			boost::spirit::classic::rule<ScannerType> StringIdentifier, FunctionDefinition, PassedParameter, OperationParameter, Operation, CodeBlock, Program;
 			boost::spirit::classic::rule<ScannerType> LiteralValue, IntegerLiteral, StringLiteral, Control, ControlSimple, ControlWithEnding, LibraryImport;
 			boost::spirit::classic::rule<ScannerType> ControlKeywords, TypeKeywords, BooleanLiteral, CodeBlockContents, GlobalBlock, InfixHelper;
 			boost::spirit::classic::rule<ScannerType> ExternalDeclaration, RealLiteral, OtherKeywords, TupleDefinition, StructureDefinition, HigherOrderFunctionHelper;
-			boost::spirit::classic::rule<ScannerType> ReadStructureHelper, WriteStructureHelper, MemberHelper, HexLiteral, Task, MessageHelper, AcceptMessageHelper;
+			boost::spirit::classic::rule<ScannerType> ReadStructureHelper, WriteStructureHelper, MemberHelper, HexLiteral, Task, MessageHelper, BroadcastHelper, RequestHelper, AcceptMessageHelper;
+			boost::spirit::classic::rule<ScannerType> DelayedMessageHelper;
 			boost::spirit::classic::rule<ScannerType> ResponseMapHelper, MessageDispatch, PassedParameterBase, Thread, ThreadPool;
 			boost::spirit::classic::rule<ScannerType> PassedParameterInfixList, InfixAssignmentHelper, AliasDeclaration, IncrementDecrementHelper, OpAssignmentHelper;
-			boost::spirit::classic::rule<ScannerType> LanguageExtensionBlock, ExtensionImport, ReadArrayHelper, WriteArrayHelper;
+			boost::spirit::classic::rule<ScannerType> LanguageExtensionBlock, ExtensionImport, ReadArrayHelper, WriteArrayHelper, AppendArrayHelper, ArrayAlgorithmHelper, ParallelForReduction, HashMapHelper, AtomicHelper;
 
 			// Dynamic parser rules
 			boost::spirit::classic::stored_rule<ScannerType> InfixOperator, VariableDefinition, UserDefinedTypeAliases, LanguageExtensionKeywords, LanguageExtensionControls;
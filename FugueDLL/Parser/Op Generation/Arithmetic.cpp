@@ -13,6 +13,9 @@
 #include "Virtual Machine/Operations/Operators/Arithmetic.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
 #include "Virtual Machine/Operations/UtilityOps.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Strings.h"
 
 
 using namespace Parser;
@@ -49,11 +52,11 @@ VM::OperationPtr ParserState::CreateOperation_Add()
 
 		TheStack.pop_back();
 		if(consop->GetElementType() == VM::EpochVariableType_Integer)
-			return VM::OperationPtr(new VM::Operations::SumIntegers);
+			return VM::OperationPtr(VM::Operations::SumIntegers::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Integer16)
-			return VM::OperationPtr(new VM::Operations::SumInteger16s);
+			return VM::OperationPtr(VM::Operations::SumInteger16s::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Real)
-			return VM::OperationPtr(new VM::Operations::SumReals);
+			return VM::OperationPtr(VM::Operations::SumReals::Create());
 		else
 		{
 			ReportFatalError("Cannot add() an array of this type of element");
@@ -85,11 +88,11 @@ VM::OperationPtr ParserState::CreateOperation_Add()
 	}
 
 	if(firsttype == VM::EpochVariableType_Integer)
-		return VM::OperationPtr(new VM::Operations::SumIntegers(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SumIntegers::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Integer16)
-		return VM::OperationPtr(new VM::Operations::SumInteger16s(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SumInteger16s::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Real)
-		return VM::OperationPtr(new VM::Operations::SumReals(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SumReals::Create(first.IsArray(), second.IsArray()));
 
 	ReportFatalError("add() cannot use parameters of this type");
 	return VM::OperationPtr(new VM::Operations::NoOp);
@@ -127,11 +130,11 @@ VM::OperationPtr ParserState::CreateOperation_Subtract()
 
 		TheStack.pop_back();
 		if(consop->GetElementType() == VM::EpochVariableType_Integer)
-			return VM::OperationPtr(new VM::Operations::SubtractIntegers);
+			return VM::OperationPtr(VM::Operations::SubtractIntegers::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Integer16)
-			return VM::OperationPtr(new VM::Operations::SubtractInteger16s);
+			return VM::OperationPtr(VM::Operations::SubtractInteger16s::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Real)
-			return VM::OperationPtr(new VM::Operations::SubtractReals);
+			return VM::OperationPtr(VM::Operations::SubtractReals::Create());
 		else
 		{
 			ReportFatalError("Cannot subtract() an array of this type of element");
@@ -163,11 +166,11 @@ VM::OperationPtr ParserState::CreateOperation_Subtract()
 	}
 
 	if(firsttype == VM::EpochVariableType_Integer)
-		return VM::OperationPtr(new VM::Operations::SubtractIntegers(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SubtractIntegers::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Integer16)
-		return VM::OperationPtr(new VM::Operations::SubtractInteger16s(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SubtractInteger16s::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Real)
-		return VM::OperationPtr(new VM::Operations::SubtractReals(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::SubtractReals::Create(first.IsArray(), second.IsArray()));
 
 	ReportFatalError("subtract() cannot use parameters of this type");
 	return VM::OperationPtr(new VM::Operations::NoOp);
@@ -205,11 +208,11 @@ VM::OperationPtr ParserState::CreateOperation_Multiply()
 
 		TheStack.pop_back();
 		if(consop->GetElementType() == VM::EpochVariableType_Integer)
-			return VM::OperationPtr(new VM::Operations::MultiplyIntegers);
+			return VM::OperationPtr(VM::Operations::MultiplyIntegers::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Integer16)
-			return VM::OperationPtr(new VM::Operations::MultiplyInteger16s);
+			return VM::OperationPtr(VM::Operations::MultiplyInteger16s::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Real)
-			return VM::OperationPtr(new VM::Operations::MultiplyReals);
+			return VM::OperationPtr(VM::Operations::MultiplyReals::Create());
 		else
 		{
 			ReportFatalError("Cannot multiply() an array of this type of element");
@@ -241,11 +244,11 @@ VM::OperationPtr ParserState::CreateOperation_Multiply()
 	}
 
 	if(firsttype == VM::EpochVariableType_Integer)
-		return VM::OperationPtr(new VM::Operations::MultiplyIntegers(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::MultiplyIntegers::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Integer16)
-		return VM::OperationPtr(new VM::Operations::MultiplyInteger16s(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::MultiplyInteger16s::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Real)
-		return VM::OperationPtr(new VM::Operations::MultiplyReals(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::MultiplyReals::Create(first.IsArray(), second.IsArray()));
 
 	ReportFatalError("multiply() cannot use parameters of this type");
 	return VM::OperationPtr(new VM::Operations::NoOp);
@@ -283,11 +286,11 @@ VM::OperationPtr ParserState::CreateOperation_Divide()
 
 		TheStack.pop_back();
 		if(consop->GetElementType() == VM::EpochVariableType_Integer)
-			return VM::OperationPtr(new VM::Operations::DivideIntegers);
+			return VM::OperationPtr(VM::Operations::DivideIntegers::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Integer16)
-			return VM::OperationPtr(new VM::Operations::DivideInteger16s);
+			return VM::OperationPtr(VM::Operations::DivideInteger16s::Create());
 		else if(consop->GetElementType() == VM::EpochVariableType_Real)
-			return VM::OperationPtr(new VM::Operations::DivideReals);
+			return VM::OperationPtr(VM::Operations::DivideReals::Create());
 		else
 		{
 			ReportFatalError("Cannot divide() an array of this type of element");
@@ -319,12 +322,74 @@ VM::OperationPtr ParserState::CreateOperation_Divide()
 	}
 
 	if(firsttype == VM::EpochVariableType_Integer)
-		return VM::OperationPtr(new VM::Operations::DivideIntegers(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::DivideIntegers::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Integer16)
-		return VM::OperationPtr(new VM::Operations::DivideInteger16s(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::DivideInteger16s::Create(first.IsArray(), second.IsArray()));
 	else if(firsttype == VM::EpochVariableType_Real)
-		return VM::OperationPtr(new VM::Operations::DivideReals(first.IsArray(), second.IsArray()));
+		return VM::OperationPtr(VM::Operations::DivideReals::Create(first.IsArray(), second.IsArray()));
 
 	ReportFatalError("divide() cannot use parameters of this type");
 	return VM::OperationPtr(new VM::Operations::NoOp);
-}
\ No newline at end of file
+}
+
+
+//
+// Create an element-wise arithmetic operation
+//
+// At least one of the two parameters must be an array; the result is
+// a new array rather than a single reduced value as with add() etc.
+//
+VM::OperationPtr ParserState::CreateOperation_ArrayArithmetic(const std::wstring& operationname)
+{
+	VM::Operations::ArithmeticOpType optype;
+	if(operationname == Keywords::ArrayAdd)
+		optype = VM::Operations::Arithmetic_Add;
+	else if(operationname == Keywords::ArraySubtract)
+		optype = VM::Operations::Arithmetic_Subtract;
+	else if(operationname == Keywords::ArrayMultiply)
+		optype = VM::Operations::Arithmetic_Multiply;
+	else if(operationname == Keywords::ArrayDivide)
+		optype = VM::Operations::Arithmetic_Divide;
+	else
+		throw VM::InternalFailureException("Unrecognized element-wise arithmetic function");
+
+	std::string functionname = narrow(operationname);
+
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError((functionname + "() function expects 2 parameters").c_str());
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry second = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry first = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID firsttype, secondtype;
+	bool firstisarray = GetArrayOperandElementType(first, firsttype);
+	bool secondisarray = GetArrayOperandElementType(second, secondtype);
+
+	if(!firstisarray && !secondisarray)
+	{
+		ReportFatalError((std::string("At least one parameter to ") + functionname + "() must be an array").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(firsttype != secondtype)
+	{
+		ReportFatalError((std::string("Parameters to ") + functionname + "() must have the same element type").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(firsttype != VM::EpochVariableType_Integer && firsttype != VM::EpochVariableType_Integer16 && firsttype != VM::EpochVariableType_Real)
+	{
+		ReportFatalError((functionname + "() cannot use parameters of this type").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::ElementwiseArithmetic(optype, firsttype, firstisarray, secondisarray));
+}
@@ -45,7 +45,7 @@ VM::OperationPtr ParserState::CreateOperation_Equal()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsEqual(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsEqual>(firsttype));
 }
 
 
@@ -77,7 +77,7 @@ VM::OperationPtr ParserState::CreateOperation_NotEqual()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsNotEqual(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsNotEqual>(firsttype));
 }
 
 
@@ -109,7 +109,7 @@ VM::OperationPtr ParserState::CreateOperation_Less()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsLesser(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsLesser>(firsttype));
 }
 
 
@@ -141,7 +141,7 @@ VM::OperationPtr ParserState::CreateOperation_Greater()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsGreater(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsGreater>(firsttype));
 }
 
 
@@ -173,7 +173,7 @@ VM::OperationPtr ParserState::CreateOperation_LessEqual()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsLesserOrEqual(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsLesserOrEqual>(firsttype));
 }
 
 
@@ -205,5 +205,5 @@ VM::OperationPtr ParserState::CreateOperation_GreaterEqual()
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	return VM::OperationPtr(new VM::Operations::IsGreaterOrEqual(firsttype));
+	return VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsGreaterOrEqual>(firsttype));
 }
@@ -14,15 +14,103 @@
 #include "Virtual Machine/Operations/Concurrency/Tasks.h"
 #include "Virtual Machine/Operations/Concurrency/Messaging.h"
 #include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
 #include "Virtual Machine/Operations/StackOps.h"
 #include "Virtual Machine/Operations/UtilityOps.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
 
+#include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/Core Entities/Program.h"
 
+#include "Utility/Strings.h"
+
 
 using namespace Parser;
 
 
+namespace
+{
+	//
+	// Determine the element type of a channel from the type keyword given in the code
+	//
+	// Only scalar values can travel over channels; returns EpochVariableType_Error
+	// for any other type.
+	//
+	VM::EpochVariableTypeID GetChannelElementType(const std::wstring& typekeyword)
+	{
+		if(typekeyword == Keywords::Integer)
+			return VM::EpochVariableType_Integer;
+		else if(typekeyword == Keywords::Integer16)
+			return VM::EpochVariableType_Integer16;
+		else if(typekeyword == Keywords::Real)
+			return VM::EpochVariableType_Real;
+		else if(typekeyword == Keywords::Boolean)
+			return VM::EpochVariableType_Boolean;
+
+		return VM::EpochVariableType_Error;
+	}
+
+	bool IsValidChannelElementType(VM::EpochVariableTypeID type)
+	{
+		return (type == VM::EpochVariableType_Integer || type == VM::EpochVariableType_Integer16
+			 || type == VM::EpochVariableType_Real || type == VM::EpochVariableType_Boolean);
+	}
+
+	//
+	// Determine the type of reply expected by a request from the type keyword given in the code
+	//
+	// Replies may be any scalar value or a string; returns EpochVariableType_Error
+	// for any other type.
+	//
+	VM::EpochVariableTypeID GetReplyType(const std::wstring& typekeyword)
+	{
+		if(typekeyword == Keywords::String)
+			return VM::EpochVariableType_String;
+
+		return GetChannelElementType(typekeyword);
+	}
+
+	bool IsValidReplyType(VM::EpochVariableTypeID type)
+	{
+		return (type == VM::EpochVariableType_String || IsValidChannelElementType(type));
+	}
+}
+
+
+//
+// Ensure that a message payload value is not left aliased between tasks
+//
+// Arrays sent in the usual way are protected by copy-on-write, but
+// buffers are not, so they must be handed over with move() instead.
+// Messages which are delivered more than once (broadcasts and repeating
+// messages) share a single payload between every delivery, so nothing
+// can be moved into them, and buffers cannot be passed at all.
+//
+void ParserState::ValidatePayloadOwnership(const StackEntry& entry, VM::EpochVariableTypeID type, bool multipledeliveries)
+{
+	bool moved = false;
+	if(entry.Type == StackEntry::STACKENTRYTYPE_OPERATION)
+	{
+		VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(entry.OperationPointer);
+		moved = (pushop && dynamic_cast<VM::Operations::MoveVariable*>(pushop->GetNestedOperation()) != NULL);
+	}
+
+	if(multipledeliveries)
+	{
+		if(moved)
+			ReportFatalError("Values cannot be moved into a message which is delivered more than once");
+		else if(type == VM::EpochVariableType_Buffer)
+			ReportFatalError("Buffers cannot be passed in a message which is delivered more than once");
+	}
+	else if(type == VM::EpochVariableType_Buffer && !moved)
+		ReportFatalError("Buffers must be handed over with move() when passed in a message");
+}
+
+
 //
 // Create an operation to send a message to a task
 //
@@ -45,7 +133,9 @@ VM::OperationPtr ParserState::CreateOperation_Message()
 	std::list<VM::EpochVariableTypeID> payloadtypes;
 	for(size_t i = 0; i < messageparamcount; ++i)
 	{
-		payloadtypes.push_front(TheStack.back().DetermineEffectiveType(*CurrentScope));
+		VM::EpochVariableTypeID type = TheStack.back().DetermineEffectiveType(*CurrentScope);
+		ValidatePayloadOwnership(TheStack.back(), type, false);
+		payloadtypes.push_front(type);
 		TheStack.pop_back();
 	}
 
@@ -105,6 +195,235 @@ VM::OperationPtr ParserState::CreateOperation_Message()
 }
 
 
+//
+// Create an operation to send a message to every task in a group
+//
+VM::OperationPtr ParserState::CreateOperation_Broadcast()
+{
+	size_t messageparamcount = PassedParameterCount.top();
+	PopParameterCount();
+	size_t paramcount = PassedParameterCount.top();
+
+	if(paramcount != 2)
+	{
+		ReportFatalError("broadcast() function expects 2 parameters");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::list<VM::EpochVariableTypeID> payloadtypes;
+	for(size_t i = 0; i < messageparamcount; ++i)
+	{
+		VM::EpochVariableTypeID type = TheStack.back().DetermineEffectiveType(*CurrentScope);
+		ValidatePayloadOwnership(TheStack.back(), type, true);
+		payloadtypes.push_front(type);
+		TheStack.pop_back();
+	}
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError("Expected the name of a message for second parameter to broadcast()");
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring messagename = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_STRING_LITERAL && TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_String)
+	{
+		ReportFatalError("Expected name of a task group for the first parameter to broadcast()");
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	TheStack.pop_back();
+
+	return VM::OperationPtr(new VM::Operations::BroadcastTaskMessage(ParsedProgram->PoolStaticString(messagename), payloadtypes));
+}
+
+//
+// Create an operation to send a message to a task after a delay, or repeatedly
+//
+// The target may be given in any of the forms accepted by message(). The
+// delay is computed before the payload, so at runtime it sits beneath
+// both the payload and the target on the stack.
+//
+VM::OperationPtr ParserState::CreateOperation_DelayedMessage(bool periodic)
+{
+	const char* errormessage = periodic ? "sendevery() function expects 3 parameters" : "sendafter() function expects 3 parameters";
+
+	size_t messageparamcount = PassedParameterCount.top();
+	PopParameterCount();
+	size_t paramcount = PassedParameterCount.top();
+
+	if(paramcount != 3)
+	{
+		ReportFatalError(errormessage);
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::list<VM::EpochVariableTypeID> payloadtypes;
+	for(size_t i = 0; i < messageparamcount; ++i)
+	{
+		VM::EpochVariableTypeID type = TheStack.back().DetermineEffectiveType(*CurrentScope);
+		ValidatePayloadOwnership(TheStack.back(), type, periodic);
+		payloadtypes.push_front(type);
+		TheStack.pop_back();
+	}
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError("Expected the name of a message for third parameter");
+		TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring messagename = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	bool usestaskid = true;
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_STRING_LITERAL && TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_String)
+	{
+		VM::Operations::PushOperation* pushop = NULL;
+		if(TheStack.back().Type == StackEntry::STACKENTRYTYPE_OPERATION)
+			pushop = dynamic_cast<VM::Operations::PushOperation*>(TheStack.back().OperationPointer);
+
+		if(!pushop || (!dynamic_cast<VM::Operations::GetTaskCaller*>(pushop->GetNestedOperation()) && !dynamic_cast<VM::Operations::GetMessageSender*>(pushop->GetNestedOperation())))
+		{
+			ReportFatalError("Expected name of a task for the second parameter");
+			TheStack.pop_back();
+			TheStack.pop_back();
+			return VM::OperationPtr(new VM::Operations::NoOp);
+		}
+
+		usestaskid = false;
+		AddOperationToCurrentBlock(VM::OperationPtr(TheStack.back().OperationPointer));
+	}
+
+	TheStack.pop_back();
+
+	if(TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError(periodic ? "Expected an integer period in milliseconds for the first parameter to sendevery()" : "Expected an integer delay in milliseconds for the first parameter to sendafter()");
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	TheStack.pop_back();
+
+	return VM::OperationPtr(new VM::Operations::DelayedSendTaskMessage(usestaskid, periodic, ParsedProgram->PoolStaticString(messagename), payloadtypes));
+}
+
+//
+// Create an operation to send a request to a task
+//
+// The request is answered through a future, which is declared here with
+// the given reply type; see CreateOperation_Reply for the other side.
+//
+VM::OperationPtr ParserState::CreateOperation_Request()
+{
+	size_t messageparamcount = PassedParameterCount.top();
+	PopParameterCount();
+	size_t paramcount = PassedParameterCount.top();
+
+	if(paramcount != 4)
+	{
+		ReportFatalError("request() function expects 4 parameters");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::list<VM::EpochVariableTypeID> payloadtypes;
+	for(size_t i = 0; i < messageparamcount; ++i)
+	{
+		VM::EpochVariableTypeID type = TheStack.back().DetermineEffectiveType(*CurrentScope);
+		ValidatePayloadOwnership(TheStack.back(), type, false);
+		payloadtypes.push_front(type);
+		TheStack.pop_back();
+	}
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError("Expected the name of a message for fourth parameter to request()");
+		TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring messagename = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	bool validtarget = (TheStack.back().Type == StackEntry::STACKENTRYTYPE_STRING_LITERAL || TheStack.back().DetermineEffectiveType(*CurrentScope) == VM::EpochVariableType_String);
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID replytype = GetReplyType(TheStack.back().StringValue);
+	TheStack.pop_back();
+
+	std::wstring futurename = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	if(!validtarget)
+	{
+		ReportFatalError("Expected name of a task for the third parameter to request()");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(replytype == VM::EpochVariableType_Error)
+	{
+		ReportFatalError("Replies to requests can only be integer, integer16, real, boolean, or string values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	const std::wstring& pooledfuturename = ParsedProgram->PoolStaticString(futurename);
+	CurrentScope->AddFuture(pooledfuturename, VM::OperationPtr(new VM::Operations::PendingReply(replytype)));
+
+	return VM::OperationPtr(new VM::Operations::SendTaskRequest(pooledfuturename, ParsedProgram->PoolStaticString(messagename), payloadtypes));
+}
+
+//
+// Create an operation to answer the request currently being handled
+//
+VM::OperationPtr ParserState::CreateOperation_Reply()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("reply() function expects a single value");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID replytype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	if(!IsValidReplyType(replytype))
+	{
+		ReportFatalError("Replies to requests can only be integer, integer16, real, boolean, or string values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::ReplyToRequest(replytype));
+}
+
 //
 // Create an operation that waits for a particular message
 //
@@ -144,6 +463,34 @@ VM::OperationPtr ParserState::CreateOperation_AcceptMessage()
 	return VM::OperationPtr(new VM::Operations::AcceptMessage(ParsedProgram->PoolStaticString(messagename), body, auxscope));
 }
 
+//
+// Create an operation that accepts a message from a response map, or gives up after a timeout
+//
+VM::OperationPtr ParserState::CreateOperation_AcceptMessageTimeout()
+{
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError("acceptmsgtimeout() function expects a timeout in milliseconds and the name of a response map");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring responsemapname = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	if(TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("Expected an integer timeout in milliseconds for the first parameter to acceptmsgtimeout()");
+		TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	TheStack.pop_back();
+
+	return VM::OperationPtr(new VM::Operations::AcceptMessageWithTimeout(ParsedProgram->PoolStaticString(responsemapname)));
+}
+
 
 //
 // Create an operation that generates a future
@@ -184,37 +531,117 @@ VM::OperationPtr ParserState::CreateOperation_Future()
 		TheStack.pop_back();
 	}
 
+	std::wstring varname;
+	VM::EpochVariableTypeID type;
+	if(!BindFutureExpression(threadpool, varname, type))
+		return VM::OperationPtr(new VM::Operations::NoOp);
 
-	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_OPERATION)
+	return VM::OperationPtr(new VM::Operations::ForkFuture(ParsedProgram->PoolStaticString(varname), type, threadpool));
+}
+
+//
+// Create an operation that generates a future once other futures have completed
+//
+// The parameters are the name of the new future, its value, the name of the
+// thread pool which computes it, and the names of the futures it depends on.
+// The value is not computed until all of those futures have completed, or
+// any one of them for whenany(), so it can read them without blocking a
+// thread in the pool.
+//
+VM::OperationPtr ParserState::CreateOperation_DependentFuture(bool waitforany)
+{
+	if(PassedParameterCount.top() < 4)
 	{
-		ReportFatalError("Futures must be bound to an operation, not just a constant");
+		ReportFatalError("whenall() and whenany() require a variable name, a value, a target thread pool name, and at least one future");
 
-		TheStack.pop_back();
-		TheStack.pop_back();
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
 
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	VM::OperationPtr theop(TheStack.back().OperationPointer);
-	TheStack.pop_back();
+	size_t numfutures = PassedParameterCount.top() - 3;
+	std::vector<std::wstring> futurenames(numfutures);
+	for(size_t i = numfutures; i > 0; --i)
+	{
+		futurenames[i - 1] = TheStack.back().StringValue;
+		TheStack.pop_back();
 
+		if(!CurrentScope->HasFuture(futurenames[i - 1]))
+		{
+			ReportFatalError("whenall() and whenany() can only depend on futures");
 
-	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+			for(size_t j = i + 2; j > 0; --j)
+				TheStack.pop_back();
+
+			return VM::OperationPtr(new VM::Operations::NoOp);
+		}
+	}
+
+	if(TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_String)
 	{
-		ReportFatalError("Futures must be attached to a variable name");
+		ReportFatalError("Third parameter to whenall() and whenany() must be a string");
+
+		TheStack.pop_back();
+		TheStack.pop_back();
 		TheStack.pop_back();
+
 		return VM::OperationPtr(new VM::Operations::NoOp);
 	}
 
-	std::wstring varname = TheStack.back().StringValue;
 	TheStack.pop_back();
 
-	VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(theop.get());
-	if(pushop)
-	{
-		VM::OperationPtr finalop(pushop->GetNestedOperation());
-		pushop->UnlinkOperation();
-		theop.release();		// TODO - is this really supposed to be here??
+	std::wstring varname;
+	VM::EpochVariableTypeID type;
+	if(!BindFutureExpression(true, varname, type))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	for(std::vector<std::wstring>::iterator iter = futurenames.begin(); iter != futurenames.end(); ++iter)
+		*iter = ParsedProgram->PoolStaticString(*iter);
+
+	return VM::OperationPtr(new VM::Operations::ForkDependentFuture(ParsedProgram->PoolStaticString(varname), type, futurenames, waitforany));
+}
+
+//
+// Bind the value on top of the stack to a new future
+//
+// The future's name is expected beneath the value on the stack; any thread
+// pool name must already have been popped. The operations generated for the
+// value are moved out of the current block and into the future. Returns
+// false if the parameters are unsuitable, after reporting the error.
+//
+bool ParserState::BindFutureExpression(bool threadpool, std::wstring& varname, VM::EpochVariableTypeID& type)
+{
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_OPERATION)
+	{
+		ReportFatalError("Futures must be bound to an operation, not just a constant");
+
+		TheStack.pop_back();
+		TheStack.pop_back();
+
+		return false;
+	}
+
+	VM::OperationPtr theop(TheStack.back().OperationPointer);
+	TheStack.pop_back();
+
+
+	if(TheStack.back().Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError("Futures must be attached to a variable name");
+		TheStack.pop_back();
+		return false;
+	}
+
+	varname = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(theop.get());
+	if(pushop)
+	{
+		VM::OperationPtr finalop(pushop->GetNestedOperation());
+		pushop->UnlinkOperation();
+		theop.release();		// TODO - is this really supposed to be here??
 
 		// TODO - why do we do all this convoluted crap when we could just EraseOperation(theop.get()) ??
 		Blocks.back().TheBlock->EraseOperation(finalop.get());
@@ -230,10 +657,10 @@ VM::OperationPtr ParserState::CreateOperation_Future()
 				Blocks.back().TheBlock->RemoveTailOperations(1);
 		}
 
-		VM::EpochVariableTypeID type = finalop->GetType(*CurrentScope);
+		type = finalop->GetType(*CurrentScope);
 		CurrentScope->AddFuture(ParsedProgram->PoolStaticString(varname), VM::OperationPtr(finalop.release()));
 
-		return VM::OperationPtr(new VM::Operations::ForkFuture(ParsedProgram->PoolStaticString(varname), type, threadpool));
+		return true;
 	}
 
 	Blocks.back().TheBlock->EraseOperation(theop.get());
@@ -249,9 +676,514 @@ VM::OperationPtr ParserState::CreateOperation_Future()
 			Blocks.back().TheBlock->RemoveTailOperations(1);
 	}
 
-	VM::EpochVariableTypeID type = theop->GetType(*CurrentScope);
+	type = theop->GetType(*CurrentScope);
 	CurrentScope->AddFuture(ParsedProgram->PoolStaticString(varname), VM::OperationPtr(theop.release()));
 
-	return VM::OperationPtr(new VM::Operations::ForkFuture(ParsedProgram->PoolStaticString(varname), type, threadpool));
+	return true;
 }
 
+
+//
+// Create an operation that runs several independent expressions at once
+//
+// The first parameter names a tuple variable, which receives the result
+// of each expression in its members, in order. The operations generated
+// for each expression are moved out of the current block and into their
+// own branch of the new operation; the final operation of each branch is
+// taken out of its push wrapper, so that it hands its value back to the
+// parallel invoke instead of leaving it on the stack.
+//
+VM::OperationPtr ParserState::CreateOperation_ParallelInvoke()
+{
+	size_t numparams = PassedParameterCount.top();
+	if(numparams < 2)
+	{
+		ReportFatalError("parallelinvoke() requires a tuple variable name followed by one or more expressions");
+
+		for(size_t i = numparams; i > 0; --i)
+			TheStack.pop_back();
+
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	size_t numbranches = numparams - 1;
+	const StackEntry& tupleentry = *(TheStack.end() - numparams);
+
+	if(tupleentry.Type != StackEntry::STACKENTRYTYPE_IDENTIFIER || CurrentScope->GetVariableType(tupleentry.StringValue) != VM::EpochVariableType_Tuple)
+	{
+		ReportFatalError("First parameter to parallelinvoke() must be a tuple variable");
+
+		for(size_t i = numparams; i > 0; --i)
+			TheStack.pop_back();
+
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring tuplename = tupleentry.StringValue;
+	const VM::TupleType& tupletype = CurrentScope->GetTupleType(CurrentScope->GetVariableTupleTypeID(tuplename));
+	const std::vector<std::wstring>& members = tupletype.GetMemberOrder();
+
+	if(members.size() != numbranches)
+	{
+		ReportFatalError("The tuple passed to parallelinvoke() must have exactly one member for each expression");
+
+		for(size_t i = numparams; i > 0; --i)
+			TheStack.pop_back();
+
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	for(size_t i = 0; i < numbranches; ++i)
+	{
+		const StackEntry& entry = *(TheStack.end() - numbranches + i);
+		if(entry.Type != StackEntry::STACKENTRYTYPE_OPERATION)
+		{
+			ReportFatalError("Each parameter to parallelinvoke() after the first must be a function call or other expression, not a constant");
+
+			for(size_t j = numparams; j > 0; --j)
+				TheStack.pop_back();
+
+			return VM::OperationPtr(new VM::Operations::NoOp);
+		}
+
+		if(entry.OperationPointer->GetType(*CurrentScope) != tupletype.GetMemberType(members[i]))
+		{
+			ReportFatalError("Type of expression passed to parallelinvoke() does not match the corresponding tuple member");
+
+			for(size_t j = numparams; j > 0; --j)
+				TheStack.pop_back();
+
+			return VM::OperationPtr(new VM::Operations::NoOp);
+		}
+	}
+
+	for(size_t i = numparams; i > 0; --i)
+		TheStack.pop_back();
+
+	std::vector<size_t> branchindices;
+	Blocks.back().TheBlock->IndexTailOps(numbranches, *CurrentScope, branchindices);
+
+	std::vector<VM::Operation*>& allops = Blocks.back().TheBlock->GetAllOperations();
+	VM::Operations::ParallelInvoke::BranchList branches(numbranches);
+	for(size_t i = 0; i < numbranches; ++i)
+	{
+		size_t first = branchindices[numbranches - i - 1];
+		size_t last = (i + 1 < numbranches) ? branchindices[numbranches - i - 2] : allops.size();
+		branches[i].assign(allops.begin() + first, allops.begin() + last);
+
+		VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(branches[i].back());
+		if(pushop)
+		{
+			branches[i].back() = pushop->GetNestedOperation();
+			pushop->UnlinkOperation();
+			delete pushop;
+		}
+	}
+
+	allops.erase(allops.begin() + branchindices[numbranches - 1], allops.end());
+
+	return VM::OperationPtr(new VM::Operations::ParallelInvoke(ParsedProgram->PoolStaticString(tuplename), branches));
+}
+
+
+//
+// Create an operation to construct a new channel
+//
+VM::OperationPtr ParserState::CreateOperation_Channel()
+{
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError("channel() function expects an element type and a capacity");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID capacitytype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID elementtype = GetChannelElementType(TheStack.back().StringValue);
+	TheStack.pop_back();
+
+	if(elementtype == VM::EpochVariableType_Error)
+	{
+		ReportFatalError("Channels can only carry integer, integer16, real, or boolean values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(capacitytype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("Capacity of a channel must be an integer");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::CreateChannel(elementtype));
+}
+
+//
+// Create an operation to send a value over a channel
+//
+// The element type of the channel is taken from the type of the value.
+//
+VM::OperationPtr ParserState::CreateOperation_ChannelSend()
+{
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError("channelsend() function expects a channel handle and a value");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID elementtype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID handletype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	if(handletype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("First parameter to channelsend() must be a channel handle");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(!IsValidChannelElementType(elementtype))
+	{
+		ReportFatalError("Channels can only carry integer, integer16, real, or boolean values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::SendChannel(elementtype));
+}
+
+//
+// Create an operation to receive a value from a channel
+//
+VM::OperationPtr ParserState::CreateOperation_ChannelReceive()
+{
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError("channelreceive() function expects an element type and a channel handle");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID handletype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID elementtype = GetChannelElementType(TheStack.back().StringValue);
+	TheStack.pop_back();
+
+	if(elementtype == VM::EpochVariableType_Error)
+	{
+		ReportFatalError("Channels can only carry integer, integer16, real, or boolean values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(handletype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("Second parameter to channelreceive() must be a channel handle");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::ReceiveChannel(elementtype));
+}
+
+
+//
+// Create an operation that sets up a generator
+//
+// The single parameter must be a call to a user-defined function, which
+// becomes the body of the generator. The operations generated for the
+// call are moved out of the current block and into the new operation;
+// the call's parameters are evaluated when the generator is created,
+// but the call itself is only made once the first value is requested.
+// The values produced by the generator are of the function's return type.
+//
+VM::OperationPtr ParserState::CreateOperation_Generator()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("generator() function expects a single function call");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry entry = TheStack.back();
+	TheStack.pop_back();
+
+	VM::Operations::Invoke* invokeop = NULL;
+	if(entry.Type == StackEntry::STACKENTRYTYPE_OPERATION)
+	{
+		invokeop = dynamic_cast<VM::Operations::Invoke*>(entry.OperationPointer);
+		if(!invokeop && entry.OperationPointer->GetNestedOperation())
+			invokeop = dynamic_cast<VM::Operations::Invoke*>(entry.OperationPointer->GetNestedOperation());
+	}
+
+	if(!invokeop || !dynamic_cast<VM::Function*>(invokeop->GetFunction()))
+	{
+		ReportFatalError("generator() must be passed a call to a user-defined function");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID elementtype = invokeop->GetType(*CurrentScope);
+	if(!IsValidReplyType(elementtype))
+	{
+		ReportFatalError("Generators can only produce integer, integer16, real, boolean, or string values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::vector<size_t> bodyindices;
+	Blocks.back().TheBlock->IndexTailOps(1, *CurrentScope, bodyindices);
+
+	std::vector<VM::Operation*>& allops = Blocks.back().TheBlock->GetAllOperations();
+	VM::Operations::CreateGenerator::Branch body(allops.begin() + bodyindices[0], allops.end());
+	allops.erase(allops.begin() + bodyindices[0], allops.end());
+
+	VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(body.back());
+	if(pushop)
+	{
+		body.back() = pushop->GetNestedOperation();
+		pushop->UnlinkOperation();
+		delete pushop;
+	}
+
+	return VM::OperationPtr(new VM::Operations::CreateGenerator(elementtype, body));
+}
+
+//
+// Create an operation that hands a value from a generator body to its consumer
+//
+// Whether the value matches the element type of the generator can only
+// be checked at runtime, since any function may be used as a generator.
+//
+VM::OperationPtr ParserState::CreateOperation_Yield()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("yield() function expects a single value");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID valuetype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	if(!IsValidReplyType(valuetype))
+	{
+		ReportFatalError("Generators can only produce integer, integer16, real, boolean, or string values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::YieldValue(valuetype));
+}
+
+//
+// Create an operation to determine if a generator has more values
+//
+VM::OperationPtr ParserState::CreateOperation_HasNext()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("hasnext() function expects a generator handle");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID handletype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	if(handletype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("Parameter to hasnext() must be a generator handle");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::GeneratorHasNext);
+}
+
+//
+// Create an operation to retrieve the next value from a generator
+//
+VM::OperationPtr ParserState::CreateOperation_NextValue()
+{
+	if(PassedParameterCount.top() != 2)
+	{
+		ReportFatalError("nextvalue() function expects an element type and a generator handle");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID handletype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID elementtype = GetReplyType(TheStack.back().StringValue);
+	TheStack.pop_back();
+
+	if(elementtype == VM::EpochVariableType_Error)
+	{
+		ReportFatalError("Generators can only produce integer, integer16, real, boolean, or string values");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(handletype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError("Second parameter to nextvalue() must be a generator handle");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::GeneratorNextValue(elementtype));
+}
+
+
+//
+// Create an operation for atomically updating an integer variable or array element
+//
+// The first parameter names the variable; for integer arrays, the index
+// of the element to update comes next. The remaining parameters are the
+// operands of the update, which are always integers.
+//
+VM::OperationPtr ParserState::CreateOperation_Atomic(const std::wstring& operationname)
+{
+	VM::Operations::AtomicOpType optype;
+	if(operationname == Keywords::AtomicAdd)
+		optype = VM::Operations::Atomic_Add;
+	else if(operationname == Keywords::AtomicMin)
+		optype = VM::Operations::Atomic_Min;
+	else if(operationname == Keywords::AtomicMax)
+		optype = VM::Operations::Atomic_Max;
+	else if(operationname == Keywords::CompareExchange)
+		optype = VM::Operations::Atomic_CompareExchange;
+	else
+		throw VM::InternalFailureException("Unrecognized atomic update function");
+
+	std::string functionname = narrow(operationname);
+
+	size_t numoperands = (optype == VM::Operations::Atomic_CompareExchange) ? 2 : 1;
+	size_t paramcount = PassedParameterCount.top();
+
+	if(paramcount < numoperands + 1 || paramcount > numoperands + 2)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError((functionname + "() function expects a variable, an optional array index, and " + (numoperands > 1 ? "2 integer operands" : "an integer operand")).c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	bool operandsvalid = true;
+	for(size_t i = 1; i < paramcount; ++i)
+	{
+		if(TheStack.back().DetermineEffectiveType(*CurrentScope) != VM::EpochVariableType_Integer)
+			operandsvalid = false;
+		TheStack.pop_back();
+	}
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	if(!operandsvalid)
+	{
+		ReportFatalError(("Parameters to " + functionname + "() function must be integers").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(identifier.Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError(("First parameter to " + functionname + "() function must be a variable identifier").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(CurrentScope->GetScopeOwningVariable(identifier.StringValue) == NULL)
+	{
+		ReportFatalError("Variable not found");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(CurrentScope->IsConstant(identifier.StringValue))
+	{
+		ReportFatalError("Cannot atomically update a constant");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	const std::wstring& varname = ParsedProgram->PoolStaticString(identifier.StringValue);
+	VM::EpochVariableTypeID vartype = CurrentScope->GetVariableType(identifier.StringValue);
+
+	if(paramcount == numoperands + 2)
+	{
+		if(vartype != VM::EpochVariableType_Array || CurrentScope->GetArrayType(identifier.StringValue) != VM::EpochVariableType_Integer)
+		{
+			ReportFatalError(("First parameter to " + functionname + "() function must be an integer array when an index is given").c_str());
+			return VM::OperationPtr(new VM::Operations::NoOp);
+		}
+
+		return VM::OperationPtr(new VM::Operations::AtomicUpdateArray(varname, optype));
+	}
+
+	if(vartype != VM::EpochVariableType_Integer)
+	{
+		ReportFatalError(("First parameter to " + functionname + "() function must be an integer variable").c_str());
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::AtomicUpdate(varname, optype));
+}
+
+
+//
+// Create an operation for cancelling the computation of a future
+//
+VM::OperationPtr ParserState::CreateOperation_Cancel()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("cancel() function expects the name of a future");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	std::wstring futurename = TheStack.back().StringValue;
+	TheStack.pop_back();
+
+	if(!CurrentScope->HasFuture(futurename))
+	{
+		ReportFatalError("Parameter to cancel() must be the name of a future");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::CancelFuture(ParsedProgram->PoolStaticString(futurename)));
+}
+
+//
+// Create an operation for discarding the work queued in a thread pool
+//
+VM::OperationPtr ParserState::CreateOperation_CancelPool()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("cancelpool() function expects the name of a thread pool");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	VM::EpochVariableTypeID pooltype = TheStack.back().DetermineEffectiveType(*CurrentScope);
+	TheStack.pop_back();
+
+	if(pooltype != VM::EpochVariableType_String)
+	{
+		ReportFatalError("Parameter to cancelpool() must be a string");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::CancelPoolWork);
+}
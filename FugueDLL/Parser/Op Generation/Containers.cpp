@@ -14,6 +14,8 @@
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
 #include "Virtual Machine/Operations/StackOps.h"
 #include "Virtual Machine/Operations/UtilityOps.h"
 
@@ -49,6 +51,15 @@ VM::OperationPtr ParserState::CreateOperation_ConsArray()
 	if(complained)
 		return VM::OperationPtr(new VM::Operations::NoOp);
 
+	// Array storage holds fixed-size scalar elements only; a collection of
+	// records is expressed as one array per member instead, which also keeps
+	// loops over a single member walking contiguous memory
+	if(elementtype == VM::EpochVariableType_Structure || elementtype == VM::EpochVariableType_Tuple)
+	{
+		ReportFatalError("Arrays of structures and tuples are not supported; store each member in an array of its own instead");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
 	TempArrayType = elementtype;
 
 	if(paramcount)
@@ -177,3 +188,381 @@ VM::OperationPtr ParserState::CreateOperation_WriteArray()
 
 	return VM::OperationPtr(new VM::Operations::WriteArray(ParsedProgram->PoolStaticString(identifier.StringValue)));
 }
+
+//
+// Create an operation for appending a value to the end of an array
+//
+VM::OperationPtr ParserState::CreateOperation_AppendArray()
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 2)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError("appendarray() function expects 2 parameters");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry value = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	if(identifier.Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError("First parameter to appendarray() function must be a variable identifier");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(CurrentScope->GetScopeOwningVariable(identifier.StringValue) == NULL)
+	{
+		ReportFatalError("Variable not found");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(CurrentScope->GetVariableType(identifier.StringValue) != VM::EpochVariableType_Array)
+	{
+		ReportFatalError("First parameter to appendarray() function must be an array variable");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(value.DetermineEffectiveType(*CurrentScope) != CurrentScope->GetArrayType(identifier.StringValue))
+	{
+		ReportFatalError("Cannot append this value to the given array - type mismatch");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::AppendArray(ParsedProgram->PoolStaticString(identifier.StringValue)));
+}
+
+
+//
+// Validate the array identifier passed to one of the sorting and
+// searching functions, and retrieve the element type of the array
+//
+bool ParserState::ValidateSortableArrayIdentifier(const StackEntry& identifier, const char* functionname, VM::EpochVariableTypeID& elementtype)
+{
+	if(identifier.Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError((std::string("First parameter to ") + functionname + "() function must be a variable identifier").c_str());
+		return false;
+	}
+
+	if(CurrentScope->GetScopeOwningVariable(identifier.StringValue) == NULL)
+	{
+		ReportFatalError("Variable not found");
+		return false;
+	}
+
+	if(CurrentScope->GetVariableType(identifier.StringValue) != VM::EpochVariableType_Array)
+	{
+		ReportFatalError((std::string("First parameter to ") + functionname + "() function must be an array variable").c_str());
+		return false;
+	}
+
+	elementtype = CurrentScope->GetArrayType(identifier.StringValue);
+	switch(elementtype)
+	{
+	case VM::EpochVariableType_Integer:
+	case VM::EpochVariableType_Integer16:
+	case VM::EpochVariableType_Real:
+	case VM::EpochVariableType_String:
+		return true;
+	}
+
+	ReportFatalError((std::string(functionname) + "() function only supports arrays of integers, 16-bit integers, reals, and strings").c_str());
+	return false;
+}
+
+//
+// Helper for validating the array functions which accept only an array;
+// returns the pooled name of the array, or NULL if the call is invalid
+//
+const std::wstring* ParserState::ValidateWholeArrayAccess(const char* functionname)
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 1)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError((std::string(functionname) + "() function expects 1 parameter").c_str());
+		return NULL;
+	}
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID elementtype;
+	if(!ValidateSortableArrayIdentifier(identifier, functionname, elementtype))
+		return NULL;
+
+	return &ParsedProgram->PoolStaticString(identifier.StringValue);
+}
+
+//
+// Create an operation for sorting an array in place
+//
+VM::OperationPtr ParserState::CreateOperation_SortArray()
+{
+	const std::wstring* arrayname = ValidateWholeArrayAccess("sortarray");
+	if(!arrayname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::SortArray(*arrayname));
+}
+
+//
+// Create an operation for finding a value in a sorted array
+//
+VM::OperationPtr ParserState::CreateOperation_SearchArray()
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 2)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError("searcharray() function expects 2 parameters");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry value = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID elementtype;
+	if(!ValidateSortableArrayIdentifier(identifier, "searcharray", elementtype))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	if(value.DetermineEffectiveType(*CurrentScope) != elementtype)
+	{
+		ReportFatalError("Cannot search for this value in the given array - type mismatch");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::SearchArray(ParsedProgram->PoolStaticString(identifier.StringValue)));
+}
+
+//
+// Create an operation for finding the index of the smallest element of an array
+//
+VM::OperationPtr ParserState::CreateOperation_MinIndex()
+{
+	const std::wstring* arrayname = ValidateWholeArrayAccess("minindex");
+	if(!arrayname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::ArrayMinIndex(*arrayname));
+}
+
+//
+// Create an operation for finding the index of the largest element of an array
+//
+VM::OperationPtr ParserState::CreateOperation_MaxIndex()
+{
+	const std::wstring* arrayname = ValidateWholeArrayAccess("maxindex");
+	if(!arrayname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::ArrayMaxIndex(*arrayname));
+}
+
+
+//
+// Validate the map identifier passed to one of the hash map functions,
+// and retrieve the key and value types of the map if it is valid
+//
+bool ParserState::ValidateHashMapIdentifier(const StackEntry& identifier, const char* functionname, VM::EpochVariableTypeID& keytype, VM::EpochVariableTypeID& valuetype)
+{
+	if(identifier.Type != StackEntry::STACKENTRYTYPE_IDENTIFIER)
+	{
+		ReportFatalError((std::string("First parameter to ") + functionname + "() function must be a variable identifier").c_str());
+		return false;
+	}
+
+	if(CurrentScope->GetScopeOwningVariable(identifier.StringValue) == NULL)
+	{
+		ReportFatalError("Variable not found");
+		return false;
+	}
+
+	if(CurrentScope->GetVariableType(identifier.StringValue) != VM::EpochVariableType_HashMap)
+	{
+		ReportFatalError((std::string("First parameter to ") + functionname + "() function must be a hash map variable").c_str());
+		return false;
+	}
+
+	std::map<std::wstring, std::pair<VM::EpochVariableTypeID, VM::EpochVariableTypeID> >::const_iterator iter = HashMapTypes.find(identifier.StringValue);
+	if(iter == HashMapTypes.end())
+		throw VM::InternalFailureException("Hash map variable was defined without recording its key and value types");
+
+	keytype = iter->second.first;
+	valuetype = iter->second.second;
+	return true;
+}
+
+//
+// Create an operation for inserting or replacing a value in a hash map
+//
+VM::OperationPtr ParserState::CreateOperation_MapInsert()
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 3)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError("mapinsert() function expects 3 parameters");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry value = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry key = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID keytype, valuetype;
+	if(!ValidateHashMapIdentifier(identifier, "mapinsert", keytype, valuetype))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	if(key.DetermineEffectiveType(*CurrentScope) != keytype)
+	{
+		ReportFatalError("Cannot use this key with the given hash map - type mismatch");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(value.DetermineEffectiveType(*CurrentScope) != valuetype)
+	{
+		ReportFatalError("Cannot store this value in the given hash map - type mismatch");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::HashMapInsert(ParsedProgram->PoolStaticString(identifier.StringValue)));
+}
+
+//
+// Helper for validating the hash map functions which accept a single key;
+// returns the pooled name of the map, or NULL if the call is invalid
+//
+const std::wstring* ParserState::ValidateHashMapKeyedAccess(const char* functionname, VM::EpochVariableTypeID& valuetype)
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 2)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError((std::string(functionname) + "() function expects 2 parameters").c_str());
+		return NULL;
+	}
+
+	StackEntry key = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID keytype;
+	if(!ValidateHashMapIdentifier(identifier, functionname, keytype, valuetype))
+		return NULL;
+
+	if(key.DetermineEffectiveType(*CurrentScope) != keytype)
+	{
+		ReportFatalError("Cannot use this key with the given hash map - type mismatch");
+		return NULL;
+	}
+
+	return &ParsedProgram->PoolStaticString(identifier.StringValue);
+}
+
+//
+// Create an operation for retrieving a value from a hash map
+//
+VM::OperationPtr ParserState::CreateOperation_MapLookup()
+{
+	VM::EpochVariableTypeID valuetype;
+	const std::wstring* mapname = ValidateHashMapKeyedAccess("maplookup", valuetype);
+	if(!mapname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::HashMapLookup(*mapname, valuetype));
+}
+
+//
+// Create an operation for checking if a key is present in a hash map
+//
+VM::OperationPtr ParserState::CreateOperation_MapContains()
+{
+	VM::EpochVariableTypeID valuetype;
+	const std::wstring* mapname = ValidateHashMapKeyedAccess("mapcontains", valuetype);
+	if(!mapname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::HashMapContains(*mapname));
+}
+
+//
+// Create an operation for removing a key from a hash map
+//
+VM::OperationPtr ParserState::CreateOperation_MapErase()
+{
+	VM::EpochVariableTypeID valuetype;
+	const std::wstring* mapname = ValidateHashMapKeyedAccess("maperase", valuetype);
+	if(!mapname)
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::HashMapErase(*mapname));
+}
+
+//
+// Create an operation for retrieving the keys of a hash map as an array
+//
+VM::OperationPtr ParserState::CreateOperation_MapKeys()
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 1)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError("mapkeys() function expects 1 parameter");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry identifier = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID keytype, valuetype;
+	if(!ValidateHashMapIdentifier(identifier, "mapkeys", keytype, valuetype))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	TempArrayType = keytype;
+	return VM::OperationPtr(new VM::Operations::HashMapKeys(ParsedProgram->PoolStaticString(identifier.StringValue), keytype));
+}
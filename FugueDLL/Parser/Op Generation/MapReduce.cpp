@@ -13,6 +13,7 @@
 
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
 #include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
 #include "Virtual Machine/Operations/Operators/Arithmetic.h"
 #include "Virtual Machine/Operations/Variables/StringOps.h"
 #include "Virtual Machine/Operations/Flow/Invoke.h"
@@ -25,6 +26,11 @@
 
 #include "Virtual Machine/VMExceptions.h"
 
+#include "Language Extensions/ExtensionCatalog.h"
+#include "Language Extensions/FunctionPointerTypes.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace Parser;
 
@@ -32,11 +38,37 @@ using namespace VM;
 using namespace VM::Operations;
 
 
+namespace
+{
+
+	//
+	// Give any loaded language extensions the chance to generate
+	// code for running a map or reduce on a device such as a GPU
+	//
+	void OfferArrayOperationToExtensions(Extensions::ArrayOperationType operation, const std::wstring& functionname, EpochVariableTypeID elementtype, EpochVariableTypeID resulttype)
+	{
+		if(!Config::DeviceMapReduceThreshold)
+			return;
+
+		Extensions::ArrayOperationInfo info;
+		info.Operation = operation;
+		info.FunctionName = functionname.c_str();
+		info.ElementType = elementtype;
+		info.ResultType = resulttype;
+
+		Extensions::OfferArrayOperation(info);
+	}
+
+}
+
+
 //
 // Create an operation that invokes the map function.
 //
 // Map applies a given unary function to each entry in the container,
 // and returns a container containing the results of the operation.
+// The entries may also be drawn from a generator, passed directly as
+// the first parameter, in which case they are never stored in memory.
 //
 VM::OperationPtr ParserState::CreateOperation_Map()
 {
@@ -53,11 +85,14 @@ VM::OperationPtr ParserState::CreateOperation_Map()
 	StackEntry p1 = TheStack.back();
 	TheStack.pop_back();
 
+	VM::Operations::CreateGenerator* generatorop = NULL;
+
 	if(p1.Type == StackEntry::STACKENTRYTYPE_OPERATION)
 	{
-		if(!dynamic_cast<VM::Operations::ConsArray*>(p1.OperationPointer) && p1.OperationPointer->GetType(*CurrentScope) != VM::EpochVariableType_Array)
+		generatorop = dynamic_cast<VM::Operations::CreateGenerator*>(p1.OperationPointer);
+		if(!generatorop && !dynamic_cast<VM::Operations::ConsArray*>(p1.OperationPointer) && p1.OperationPointer->GetType(*CurrentScope) != VM::EpochVariableType_Array)
 		{
-			ReportFatalError("First parameter to map() must be an array");
+			ReportFatalError("First parameter to map() must be an array or a generator");
 			return VM::OperationPtr(new VM::Operations::NoOp);
 		}
 	}
@@ -81,6 +116,8 @@ VM::OperationPtr ParserState::CreateOperation_Map()
 		VM::Operations::ConsArray* consop = dynamic_cast<VM::Operations::ConsArray*>(p1.OperationPointer);
 		if(consop)
 			elementtype = consop->GetElementType();
+		else if(generatorop)
+			elementtype = generatorop->GetElementType();
 	}
 
 	if(p2.StringValue == Keywords::DebugWrite)
@@ -149,9 +186,11 @@ VM::OperationPtr ParserState::CreateOperation_Map()
 		}
 
 		op.reset(new VM::Operations::Invoke(func, false));
+		if(!generatorop)
+			OfferArrayOperationToExtensions(Extensions::ArrayOperation_Map, p2.StringValue, elementtype, op->GetType(*CurrentScope));
 	}
 
-	return VM::OperationPtr(new VM::Operations::MapOperation(op));
+	return VM::OperationPtr(new VM::Operations::MapOperation(op, generatorop != NULL));
 }
 
 
@@ -162,7 +201,7 @@ VM::OperationPtr ParserState::CreateOperation_Map()
 // function. The function is applied to each value in the container,
 // and the running "result" variable. The result is a single
 // value representing the result at the end of the reduction
-// operation.
+// operation. As with map, the entries may also come from a generator.
 //
 VM::OperationPtr ParserState::CreateOperation_Reduce()
 {
@@ -179,12 +218,15 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 	StackEntry p1 = TheStack.back();
 	TheStack.pop_back();
 
+	VM::Operations::CreateGenerator* generatorop = NULL;
+
 	if(p1.Type == StackEntry::STACKENTRYTYPE_OPERATION)
 	{
 		VM::Operations::ConsArray* consop = dynamic_cast<VM::Operations::ConsArray*>(p1.OperationPointer);
-		if(!consop && p1.OperationPointer->GetType(*CurrentScope) != VM::EpochVariableType_Array)
+		generatorop = dynamic_cast<VM::Operations::CreateGenerator*>(p1.OperationPointer);
+		if(!consop && !generatorop && p1.OperationPointer->GetType(*CurrentScope) != VM::EpochVariableType_Array)
 		{
-			ReportFatalError("First parameter to reduce() must be an array");
+			ReportFatalError("First parameter to reduce() must be an array or a generator");
 			return VM::OperationPtr(new VM::Operations::NoOp);
 		}
 	}
@@ -198,6 +240,9 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 
 	VM::EpochVariableTypeID elementtype;
 
+	// An array produced directly by a map can be reduced without building it
+	bool fusemap = false;
+
 	if(p1.Type == StackEntry::STACKENTRYTYPE_IDENTIFIER)
 	{
 		elementtype = ArrayTypes[p1.StringValue];
@@ -208,15 +253,27 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 		VM::Operations::ConsArray* consop = dynamic_cast<VM::Operations::ConsArray*>(p1.OperationPointer);
 		if(consop)
 			elementtype = consop->GetElementType();
+		else if(generatorop)
+			elementtype = generatorop->GetElementType();
+
+		VM::Operations::MapOperation* mapop = dynamic_cast<VM::Operations::MapOperation*>(p1.OperationPointer);
+		if(mapop && mapop->GetNestedOperation())
+		{
+			elementtype = mapop->GetNestedOperation()->GetType(*CurrentScope);
+
+			VM::Block* block = Blocks.back().TheBlock;
+			if(block->GetNumOperations() && block->GetTailOperation()->GetNestedOperation() == mapop)
+				fusemap = VM::Operations::MapReduceOperation::CanFuse(block->GetTailOperation());
+		}
 	}
 
 	if(p2.StringValue == Keywords::Add)
 	{
 		switch(elementtype)
 		{
-		case VM::EpochVariableType_Integer:		op.reset(new VM::Operations::SumIntegers(false, false));			break;
-		case VM::EpochVariableType_Integer16:	op.reset(new VM::Operations::SumInteger16s(false, false));			break;
-		case VM::EpochVariableType_Real:		op.reset(new VM::Operations::SumReals(false, false));				break;
+		case VM::EpochVariableType_Integer:		op.reset(VM::Operations::SumIntegers::Create(false, false));			break;
+		case VM::EpochVariableType_Integer16:	op.reset(VM::Operations::SumInteger16s::Create(false, false));			break;
+		case VM::EpochVariableType_Real:		op.reset(VM::Operations::SumReals::Create(false, false));				break;
 		default:
 			ReportFatalError("Cannot add() parameters of this type");
 			return VM::OperationPtr(new VM::Operations::NoOp);			
@@ -226,9 +283,9 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 	{
 		switch(elementtype)
 		{
-		case VM::EpochVariableType_Integer:		op.reset(new VM::Operations::SubtractIntegers(false, false));		break;
-		case VM::EpochVariableType_Integer16:	op.reset(new VM::Operations::SubtractInteger16s(false, false));		break;
-		case VM::EpochVariableType_Real:		op.reset(new VM::Operations::SubtractReals(false, false));			break;
+		case VM::EpochVariableType_Integer:		op.reset(VM::Operations::SubtractIntegers::Create(false, false));		break;
+		case VM::EpochVariableType_Integer16:	op.reset(VM::Operations::SubtractInteger16s::Create(false, false));		break;
+		case VM::EpochVariableType_Real:		op.reset(VM::Operations::SubtractReals::Create(false, false));			break;
 		default:
 			ReportFatalError("Cannot subtract() parameters of this type");
 			return VM::OperationPtr(new VM::Operations::NoOp);			
@@ -238,9 +295,9 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 	{
 		switch(elementtype)
 		{
-		case VM::EpochVariableType_Integer:		op.reset(new VM::Operations::MultiplyIntegers(false, false));		break;
-		case VM::EpochVariableType_Integer16:	op.reset(new VM::Operations::MultiplyInteger16s(false, false));		break;
-		case VM::EpochVariableType_Real:		op.reset(new VM::Operations::MultiplyReals(false, false));			break;
+		case VM::EpochVariableType_Integer:		op.reset(VM::Operations::MultiplyIntegers::Create(false, false));		break;
+		case VM::EpochVariableType_Integer16:	op.reset(VM::Operations::MultiplyInteger16s::Create(false, false));		break;
+		case VM::EpochVariableType_Real:		op.reset(VM::Operations::MultiplyReals::Create(false, false));			break;
 		default:
 			ReportFatalError("Cannot multiply() parameters of this type");
 			return VM::OperationPtr(new VM::Operations::NoOp);			
@@ -250,9 +307,9 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 	{
 		switch(elementtype)
 		{
-		case VM::EpochVariableType_Integer:		op.reset(new VM::Operations::DivideIntegers(false, false));			break;
-		case VM::EpochVariableType_Integer16:	op.reset(new VM::Operations::DivideInteger16s(false, false));		break;
-		case VM::EpochVariableType_Real:		op.reset(new VM::Operations::DivideReals(false, false));			break;
+		case VM::EpochVariableType_Integer:		op.reset(VM::Operations::DivideIntegers::Create(false, false));			break;
+		case VM::EpochVariableType_Integer16:	op.reset(VM::Operations::DivideInteger16s::Create(false, false));		break;
+		case VM::EpochVariableType_Real:		op.reset(VM::Operations::DivideReals::Create(false, false));			break;
 		default:
 			ReportFatalError("Cannot divide() parameters of this type");
 			return VM::OperationPtr(new VM::Operations::NoOp);			
@@ -297,7 +354,15 @@ VM::OperationPtr ParserState::CreateOperation_Reduce()
 		op.reset(new VM::Operations::Invoke(func, false));
 	}
 
-	return VM::OperationPtr(new VM::Operations::ReduceOperation(op));
+	// Only associative operators can be split up into a reduction tree
+	if(!generatorop && elementtype == VM::EpochVariableType_Integer && (p2.StringValue == Keywords::Add || p2.StringValue == Keywords::Multiply))
+		OfferArrayOperationToExtensions(Extensions::ArrayOperation_Reduce, p2.StringValue, elementtype, elementtype);
+
+	VM::OperationPtr reduceop(new VM::Operations::ReduceOperation(op, generatorop != NULL));
+	if(fusemap)
+		return VM::OperationPtr(new VM::Operations::MapReduceOperation(Blocks.back().TheBlock->PopTailOperation(), reduceop));
+
+	return reduceop;
 }
 
 
@@ -74,8 +74,18 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 		return CreateOperation_Multiply();
 	else if(operationname == Keywords::Divide)
 		return CreateOperation_Divide();
+	else if(operationname == Keywords::ArrayAdd || operationname == Keywords::ArraySubtract || operationname == Keywords::ArrayMultiply || operationname == Keywords::ArrayDivide)
+		return CreateOperation_ArrayArithmetic(operationname);
 	else if(operationname == Keywords::Concat)
 		return CreateOperation_Concat();
+	else if(operationname == Keywords::Find)
+		return CreateOperation_Find();
+	else if(operationname == Keywords::StartsWith)
+		return CreateOperation_StartsWith();
+	else if(operationname == Keywords::Compare)
+		return CreateOperation_Compare();
+	else if(operationname == Keywords::Split)
+		return CreateOperation_Split();
 	else if(operationname == Keywords::Equal)
 		return CreateOperation_Equal();
 	else if(operationname == Keywords::NotEqual)
@@ -110,6 +120,8 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 		return CreateOperation_Return();
 	else if(operationname == Keywords::SizeOf)
 		return CreateOperation_SizeOf();
+	else if(operationname == Keywords::Move)
+		return CreateOperation_Move();
 	else if(operationname == Keywords::Length)
 		return CreateOperation_Length();
 	else if(operationname == Keywords::Member)
@@ -128,8 +140,20 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 		return CreateOperation_Reduce();
 	else if(operationname == Keywords::Message)
 		return CreateOperation_Message();
+	else if(operationname == Keywords::Broadcast)
+		return CreateOperation_Broadcast();
+	else if(operationname == Keywords::SendAfter)
+		return CreateOperation_DelayedMessage(false);
+	else if(operationname == Keywords::SendEvery)
+		return CreateOperation_DelayedMessage(true);
+	else if(operationname == Keywords::Request)
+		return CreateOperation_Request();
+	else if(operationname == Keywords::Reply)
+		return CreateOperation_Reply();
 	else if(operationname == Keywords::AcceptMessage)
 		return CreateOperation_AcceptMessage();
+	else if(operationname == Keywords::AcceptMessageTimeout)
+		return CreateOperation_AcceptMessageTimeout();
 	else if(operationname == Keywords::Caller)
 	{
 		ReportFatalError("This function can only be used when sending messages");
@@ -147,12 +171,58 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 	}
 	else if(operationname == Keywords::Future)
 		return CreateOperation_Future();
+	else if(operationname == Keywords::WhenAll)
+		return CreateOperation_DependentFuture(false);
+	else if(operationname == Keywords::WhenAny)
+		return CreateOperation_DependentFuture(true);
+	else if(operationname == Keywords::ParallelInvoke)
+		return CreateOperation_ParallelInvoke();
+	else if(operationname == Keywords::Channel)
+		return CreateOperation_Channel();
+	else if(operationname == Keywords::ChannelSend)
+		return CreateOperation_ChannelSend();
+	else if(operationname == Keywords::ChannelReceive)
+		return CreateOperation_ChannelReceive();
+	else if(operationname == Keywords::Generator)
+		return CreateOperation_Generator();
+	else if(operationname == Keywords::Yield)
+		return CreateOperation_Yield();
+	else if(operationname == Keywords::HasNext)
+		return CreateOperation_HasNext();
+	else if(operationname == Keywords::NextValue)
+		return CreateOperation_NextValue();
+	else if(operationname == Keywords::AtomicAdd || operationname == Keywords::AtomicMin || operationname == Keywords::AtomicMax || operationname == Keywords::CompareExchange)
+		return CreateOperation_Atomic(operationname);
+	else if(operationname == Keywords::Cancel)
+		return CreateOperation_Cancel();
+	else if(operationname == Keywords::CancelPool)
+		return CreateOperation_CancelPool();
 	else if(operationname == Keywords::Array)
 		return CreateOperation_ConsArray();
 	else if(operationname == Keywords::ReadArray)
 		return CreateOperation_ReadArray();
 	else if(operationname == Keywords::WriteArray)
 		return CreateOperation_WriteArray();
+	else if(operationname == Keywords::AppendArray)
+		return CreateOperation_AppendArray();
+	else if(operationname == Keywords::SortArray)
+		return CreateOperation_SortArray();
+	else if(operationname == Keywords::SearchArray)
+		return CreateOperation_SearchArray();
+	else if(operationname == Keywords::MinIndex)
+		return CreateOperation_MinIndex();
+	else if(operationname == Keywords::MaxIndex)
+		return CreateOperation_MaxIndex();
+	else if(operationname == Keywords::MapInsert)
+		return CreateOperation_MapInsert();
+	else if(operationname == Keywords::MapLookup)
+		return CreateOperation_MapLookup();
+	else if(operationname == Keywords::MapContains)
+		return CreateOperation_MapContains();
+	else if(operationname == Keywords::MapErase)
+		return CreateOperation_MapErase();
+	else if(operationname == Keywords::MapKeys)
+		return CreateOperation_MapKeys();
 	else
 	{
 		if(CurrentScope->HasTupleType(operationname))
@@ -172,11 +242,16 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 					throw SyntaxException("Incorrect number of parameters");
 			}
 
+			std::vector<size_t> memberopindices;
+			Blocks.back().TheBlock->IndexTailOps(members.size(), *CurrentScope, memberopindices);
+
 			for(size_t i = 0; i < members.size(); ++i)
 			{
+				size_t opindex = memberopindices[members.size() - i - 1];
+
 				if(t.GetMemberType(members[i]) == VM::EpochVariableType_Integer16)
 				{
-					VM::Operation* op = Blocks.back().TheBlock->GetOperationFromEnd(members.size() - i, *CurrentScope);
+					VM::Operation* op = Blocks.back().TheBlock->GetOperation(opindex);
 					VM::Operations::PushIntegerLiteral* pushop = dynamic_cast<VM::Operations::PushIntegerLiteral*>(op);
 
 					if(pushop)
@@ -187,12 +262,12 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 						stream << litval;
 						if(!(stream >> lit16val))
 							throw SyntaxException("Overflow converting integer to integer16");
-						Blocks.back().TheBlock->ReplaceOperationFromEnd(members.size() - i, VM::OperationPtr(new VM::Operations::PushInteger16Literal(lit16val)), *CurrentScope);
+						Blocks.back().TheBlock->ReplaceOperation(opindex, VM::OperationPtr(new VM::Operations::PushInteger16Literal(lit16val)));
 					}
 				}
 				else if(t.GetMemberType(members[i]) == VM::EpochVariableType_Function)
 				{
-					VM::Operation* op = Blocks.back().TheBlock->GetOperationFromEnd(members.size() - i, *CurrentScope);
+					VM::Operation* op = Blocks.back().TheBlock->GetOperation(opindex);
 					VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(op);
 
 					if(pushop)
@@ -204,7 +279,7 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 							if(!CurrentScope->GetFunctionSignature(t.GetMemberTypeHintString(members[i])).DoesFunctionMatchSignature(CurrentScope->GetFunction(getvalop->GetAssociatedIdentifier()), *CurrentScope))
 								throw SyntaxException("Function does not match the required function signature");
 
-							Blocks.back().TheBlock->ReplaceOperationFromEnd(members.size() - i, VM::OperationPtr(new VM::Operations::BindFunctionReference(getvalop->GetAssociatedIdentifier())), *CurrentScope);
+							Blocks.back().TheBlock->ReplaceOperation(opindex, VM::OperationPtr(new VM::Operations::BindFunctionReference(getvalop->GetAssociatedIdentifier())));
 						}
 						else
 							throw ParserFailureException("Failure while trying to pass a function reference");
@@ -302,11 +377,16 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 					throw SyntaxException("Incorrect number of parameters");
 			}
 
+			std::vector<size_t> memberopindices;
+			Blocks.back().TheBlock->IndexTailOps(members.size(), *CurrentScope, memberopindices);
+
 			for(size_t i = 0; i < members.size(); ++i)
 			{
+				size_t opindex = memberopindices[members.size() - i - 1];
+
 				if(t.GetMemberType(members[i]) == VM::EpochVariableType_Integer16)
 				{
-					VM::Operation* op = Blocks.back().TheBlock->GetOperationFromEnd(members.size() - i, *CurrentScope);
+					VM::Operation* op = Blocks.back().TheBlock->GetOperation(opindex);
 					VM::Operations::PushIntegerLiteral* pushop = dynamic_cast<VM::Operations::PushIntegerLiteral*>(op);
 
 					if(pushop)
@@ -317,12 +397,12 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 						stream << litval;
 						if(!(stream >> lit16val))
 							throw SyntaxException("Overflow converting integer to integer16");
-						Blocks.back().TheBlock->ReplaceOperationFromEnd(members.size() - i, VM::OperationPtr(new VM::Operations::PushInteger16Literal(lit16val)), *CurrentScope);
+						Blocks.back().TheBlock->ReplaceOperation(opindex, VM::OperationPtr(new VM::Operations::PushInteger16Literal(lit16val)));
 					}
 				}
 				else if(t.GetMemberType(members[i]) == VM::EpochVariableType_Function)
 				{
-					VM::Operation* op = Blocks.back().TheBlock->GetOperationFromEnd(members.size() - i, *CurrentScope);
+					VM::Operation* op = Blocks.back().TheBlock->GetOperation(opindex);
 					VM::Operations::PushOperation* pushop = dynamic_cast<VM::Operations::PushOperation*>(op);
 
 					if(pushop)
@@ -334,7 +414,7 @@ VM::OperationPtr ParserState::CreateOperation(const std::wstring& operationname)
 							if(!CurrentScope->GetFunctionSignature(t.GetMemberTypeHintString(members[i])).DoesFunctionMatchSignature(CurrentScope->GetFunction(getvalop->GetAssociatedIdentifier()), *CurrentScope))
 								throw SyntaxException("Function does not match the required function signature");
 
-							Blocks.back().TheBlock->ReplaceOperationFromEnd(members.size() - i, VM::OperationPtr(new VM::Operations::BindFunctionReference(getvalop->GetAssociatedIdentifier())), *CurrentScope);
+							Blocks.back().TheBlock->ReplaceOperation(opindex, VM::OperationPtr(new VM::Operations::BindFunctionReference(getvalop->GetAssociatedIdentifier())));
 						}
 						else
 							throw ParserFailureException("Failure while trying to pass a function reference");
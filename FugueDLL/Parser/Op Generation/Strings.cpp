@@ -12,6 +12,7 @@
 
 #include "Virtual Machine/Operations/Variables/StringOps.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
 #include "Virtual Machine/Operations/UtilityOps.h"
 
 #include "Virtual Machine/Core Entities/Program.h"
@@ -112,6 +113,11 @@ VM::OperationPtr ParserState::CreateOperation_Length()
 			TheStack.pop_back();
 			return VM::OperationPtr(new VM::Operations::ArrayLength(ParsedProgram->PoolStaticString(variable.StringValue)));
 		}
+		else if(CurrentScope->GetVariableType(variable.StringValue) == VM::EpochVariableType_HashMap)
+		{
+			TheStack.pop_back();
+			return VM::OperationPtr(new VM::Operations::HashMapSize(ParsedProgram->PoolStaticString(variable.StringValue)));
+		}
 
 		ReportFatalError("Function parameter must be a string");
 		TheStack.pop_back();
@@ -122,3 +128,84 @@ VM::OperationPtr ParserState::CreateOperation_Length()
 	return VM::OperationPtr(new VM::Operations::Length(ParsedProgram->PoolStaticString(variable.StringValue)));
 }
 
+
+//
+// Pop the two parameters of a string search or comparison function,
+// ensuring that both are single strings; returns false and reports
+// an error if the parameters are not suitable.
+//
+bool ParserState::ValidateStringPairParameters(const char* functionname)
+{
+	size_t paramcount = PassedParameterCount.top();
+	if(paramcount != 2)
+	{
+		while(paramcount > 0)
+		{
+			TheStack.pop_back();
+			--paramcount;
+		}
+
+		ReportFatalError((std::string(functionname) + "() function expects 2 parameters").c_str());
+		return false;
+	}
+
+	StackEntry second = TheStack.back();
+	TheStack.pop_back();
+
+	StackEntry first = TheStack.back();
+	TheStack.pop_back();
+
+	bool firstisstring = !first.IsArray() && first.DetermineEffectiveType(*CurrentScope) == VM::EpochVariableType_String;
+	bool secondisstring = !second.IsArray() && second.DetermineEffectiveType(*CurrentScope) == VM::EpochVariableType_String;
+	if(!firstisstring || !secondisstring)
+	{
+		ReportFatalError((std::string(functionname) + "() function expects 2 strings").c_str());
+		return false;
+	}
+
+	return true;
+}
+
+//
+// Create an operation to locate one string within another
+//
+VM::OperationPtr ParserState::CreateOperation_Find()
+{
+	if(!ValidateStringPairParameters("find"))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::FindSubstring);
+}
+
+//
+// Create an operation to test if a string begins with a given prefix
+//
+VM::OperationPtr ParserState::CreateOperation_StartsWith()
+{
+	if(!ValidateStringPairParameters("startswith"))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::StartsWith);
+}
+
+//
+// Create an operation to determine the ordering of two strings
+//
+VM::OperationPtr ParserState::CreateOperation_Compare()
+{
+	if(!ValidateStringPairParameters("compare"))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::CompareStrings);
+}
+
+//
+// Create an operation to split a string into an array of pieces
+//
+VM::OperationPtr ParserState::CreateOperation_Split()
+{
+	if(!ValidateStringPairParameters("split"))
+		return VM::OperationPtr(new VM::Operations::NoOp);
+
+	return VM::OperationPtr(new VM::Operations::SplitString);
+}
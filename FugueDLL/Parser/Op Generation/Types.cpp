@@ -165,6 +165,7 @@ VM::OperationPtr ParserState::CreateOperation_Cast()
 		case VM::EpochVariableType_Address:
 		case VM::EpochVariableType_Array:
 		case VM::EpochVariableType_TaskHandle:
+		case VM::EpochVariableType_HashMap:
 			ReportFatalError("This data type cannot be converted into a string");
 			return VM::OperationPtr(new VM::Operations::NoOp);
 		default:
@@ -173,4 +174,4 @@ VM::OperationPtr ParserState::CreateOperation_Cast()
 	}
 
 	throw VM::NotImplementedException("Conversion between these types is not available");
-}
\ No newline at end of file
+}
\ No newline at end of file
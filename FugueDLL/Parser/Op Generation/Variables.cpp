@@ -185,3 +185,35 @@ VM::OperationPtr ParserState::CreateOperation_SizeOf()
 	return VM::OperationPtr(new VM::Operations::SizeOf(ParsedProgram->PoolStaticString(variable.StringValue)));
 }
 
+//
+// Create an operation that hands over the contents of an array or buffer
+//
+VM::OperationPtr ParserState::CreateOperation_Move()
+{
+	if(PassedParameterCount.top() != 1)
+	{
+		ReportFatalError("move() function expects 1 parameter");
+		for(size_t i = PassedParameterCount.top(); i > 0; --i)
+			TheStack.pop_back();
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	StackEntry variable = TheStack.back();
+	TheStack.pop_back();
+
+	VM::EpochVariableTypeID type = CurrentScope->GetVariableType(variable.StringValue);
+	if(type != VM::EpochVariableType_Array && type != VM::EpochVariableType_Buffer)
+	{
+		ReportFatalError("Only arrays and buffers can be moved");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	if(CurrentScope->IsConstant(variable.StringValue))
+	{
+		ReportFatalError("Cannot move the contents of a constant");
+		return VM::OperationPtr(new VM::Operations::NoOp);
+	}
+
+	return VM::OperationPtr(new VM::Operations::MoveVariable(ParsedProgram->PoolStaticString(variable.StringValue)));
+}
+
@@ -105,4 +105,26 @@ struct RegisterEndOfParallelFor : public ParseFunctorBase
 	}
 };
 
+//
+// Register a reduction clause of a parallelfor() loop, such as sum(total)
+//
+struct RegisterParallelForReduction : public ParseFunctorBase
+{
+	RegisterParallelForReduction(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename IteratorType>
+	void operator () (IteratorType begin, IteratorType end) const
+	{
+		Trace(L"RegisterParallelForReduction", std::wstring(begin, end));
+
+		State.SetParsePosition(begin);
+		std::wstring clause(begin, end);
+		std::wstring::size_type openparens = clause.find(L'(');
+		std::wstring::size_type closeparens = clause.rfind(L')');
+		State.RegisterParallelForReduction(StripWhitespace(clause.substr(0, openparens)), StripWhitespace(clause.substr(openparens + 1, closeparens - openparens - 1)));
+	}
+};
+
 
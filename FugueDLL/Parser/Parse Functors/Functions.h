@@ -32,6 +32,25 @@ struct RegisterFunction : public ParseFunctorBase
 	}
 };
 
+//
+// Inform the parse analyzer that a function definition has been
+// completely parsed, passing along the full text of the definition.
+//
+struct RecordFunctionSource : public ParseFunctorBase
+{
+	RecordFunctionSource(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename IteratorType>
+	void operator () (IteratorType begin, IteratorType end) const
+	{
+		Trace(L"RecordFunctionSource");
+
+		State.RecordFunctionSource(begin, end);
+	}
+};
+
 //
 // Inform the parse analyzer that a function body is upcoming.
 // This variant is used during the preparse phase.
@@ -203,6 +203,30 @@ struct RegisterUpcomingArrayVariable : public ParseFunctorBase
 	}
 };
 
+//
+// Inform the parse analyzer that the following variable is of the hash map container type.
+//
+struct RegisterUpcomingHashMapVariable : public ParseFunctorBase
+{
+	RegisterUpcomingHashMapVariable(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename ParamType>
+	void operator () (ParamType) const
+	{
+		Trace(L"RegisterUpcomingHashMapVariable");
+		State.RegisterUpcomingVariable(VM::EpochVariableType_HashMap);
+	}
+
+	template <typename IteratorType>
+	void operator () (IteratorType begin, IteratorType end) const
+	{
+		Trace(L"RegisterUpcomingHashMapVariable");
+		State.RegisterUpcomingVariable(VM::EpochVariableType_HashMap);
+	}
+};
+
 //
 // Inform the parse analyzer of a defined variable's identifier.
 //
@@ -260,6 +284,42 @@ struct RegisterArrayVariable : public ParseFunctorBase
 	}
 };
 
+//
+// Inform the parse analyzer that a hash map variable has been defined
+//
+struct RegisterHashMapVariable : public ParseFunctorBase
+{
+	RegisterHashMapVariable(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename ParamType>
+	void operator () (ParamType) const
+	{
+		Trace(L"RegisterHashMapVariable");
+
+		State.RegisterHashMapVariable();
+	}
+};
+
+//
+// Inform the parse analyzer that a file-backed array variable has been defined
+//
+struct RegisterMappedArrayVariable : public ParseFunctorBase
+{
+	RegisterMappedArrayVariable(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename ParamType>
+	void operator () (ParamType) const
+	{
+		Trace(L"RegisterMappedArrayVariable");
+
+		State.RegisterMappedArrayVariable();
+	}
+};
+
 //
 // Inform the parse analyzer that the next variable definition should be a constant
 //
@@ -300,3 +360,43 @@ struct RegisterArrayType : public ParseFunctorBase
 	}
 };
 
+//
+// Store the key type of a hash map for later retrieval and type validation
+//
+struct RegisterHashMapKeyType : public ParseFunctorBase
+{
+	RegisterHashMapKeyType(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename IteratorType>
+	void operator () (IteratorType begin, IteratorType end) const
+	{
+		std::wstring str(begin, end);
+		Trace(L"RegisterHashMapKeyType", str);
+
+		State.SetParsePosition(begin);
+		State.RegisterHashMapKeyType(str);
+	}
+};
+
+//
+// Store the value type of a hash map for later retrieval and type validation
+//
+struct RegisterHashMapValueType : public ParseFunctorBase
+{
+	RegisterHashMapValueType(Parser::ParserState& state)
+		: ParseFunctorBase(state)
+	{ }
+
+	template <typename IteratorType>
+	void operator () (IteratorType begin, IteratorType end) const
+	{
+		std::wstring str(begin, end);
+		Trace(L"RegisterHashMapValueType", str);
+
+		State.SetParsePosition(begin);
+		State.RegisterHashMapValueType(str);
+	}
+};
+
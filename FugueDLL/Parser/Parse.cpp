@@ -12,6 +12,7 @@
 #include "Parser/Parser State Machine/ParserState.h"
 
 #include "User Interface/Output.h"
+#include "User Interface/TraceLog.h"
 
 #include "Utility/Files/Files.h"
 
@@ -24,15 +25,20 @@ using namespace Parser;
 //
 // Load a file into memory, then send it to the parser
 //
+// Any parser traces still held in the trace log are written out once
+// parsing finishes, whether or not it succeeded. The debug table is
+// then sorted, since no further operations will be recorded in it.
+//
 bool Parser::ParseFile(const std::string& filename, ParserState& state, std::vector<Byte>& memory)
 {
 	Files::Load(filename.c_str(), memory);
 
 	state.SetCodeBuffer(&memory[0]);
-	
-	if(!ParseMemoryPass1(state, memory, filename))
-		return false;
-	
-	return ParseMemoryPass2(state, memory, filename);
+	state.IndexSourceLines(memory, filename);
+
+	bool success = ParseMemoryPass1(state, memory, filename) && ParseMemoryPass2(state, memory, filename);
+	TraceLog::Flush();
+	state.DebugInfo.Finalize();
+	return success;
 }
 
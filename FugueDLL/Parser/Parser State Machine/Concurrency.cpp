@@ -182,13 +182,8 @@ void ParserState::EndResponseMap()
 	std::wstring mapname = TheStack.back().StringValue;
 	TheStack.pop_back();
 
-#ifdef _DEBUG
-	{
-		std::wostringstream stream;
-		stream << "Created response map " << responses.get() << " in scope " << CurrentScope;
-		Trace(stream.str().c_str());
-	}
-#endif
+	if(TraceLog::IsEnabled(TraceLog::Category_Parser))
+		TraceLog::Entry(L"Parser trace: ") << L"Created response map " << responses.get() << L" in scope " << CurrentScope;
 
 	CurrentScope->AddResponseMap(mapname, responses.release());
 
@@ -220,6 +220,14 @@ void ParserState::EnterBlock()
 	{
 		scope->AddVariable(ControlVarName, ControlVarType);
 
+		// Each reduction variable gets a private copy in the loop body's scope
+		if(entry.Type == BlockEntry::BLOCKENTRYTYPE_PARALLELFOR && !ParallelForReductions.empty())
+		{
+			const ParallelForReductionList& reductions = ParallelForReductions.top();
+			for(ParallelForReductionList::const_iterator iter = reductions.begin(); iter != reductions.end(); ++iter)
+				scope->AddVariable(iter->VariableName, iter->VariableType);
+		}
+
 		TraceScopeCreation(scope.get(), NULL);
 		scope->ParentScope = CurrentScope;
 	}
@@ -564,11 +572,23 @@ void ParserState::ExitBlock()
 			else
 			{
 				success = true;
-				AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::ParallelFor(body.release(), ParsedProgram->PoolStaticString(TheStack.back().StringValue), true, 0)));
+				std::auto_ptr<VM::Operations::ParallelFor> op(new VM::Operations::ParallelFor(body.release(), ParsedProgram->PoolStaticString(TheStack.back().StringValue), true, 0));
+
+				if(!ParallelForReductions.empty())
+				{
+					const ParallelForReductionList& reductions = ParallelForReductions.top();
+					for(ParallelForReductionList::const_iterator iter = reductions.begin(); iter != reductions.end(); ++iter)
+						op->AddReduction(static_cast<VM::Operations::ParallelFor::ReductionOperator>(iter->Operator), iter->VariableName);
+				}
+
+				AddOperationToCurrentBlock(VM::OperationPtr(op.release()));
 			}
 
 			TheStack.pop_back();
 
+			if(!ParallelForReductions.empty())
+				ParallelForReductions.pop();
+
 			// If we didn't manage to attach the code block to a parallelfor instruction,
 			// we need to ensure that we reset the current scope before exiting the switch
 			// case, so that the auto_ptr doesn't release the block prior to us getting
@@ -781,6 +801,62 @@ void ParserState::RegisterEndOfParallelFor()
 	ControlVarName = (TheStack.rbegin() + 3)->StringValue;
 	ControlVarType = VM::EpochVariableType_Integer;
 
+	for(ParallelForReductionList::const_iterator iter = PendingReductions.begin(); iter != PendingReductions.end(); ++iter)
+	{
+		if(iter->VariableName == ControlVarName)
+			ReportFatalError("The loop counter of a parallelfor() cannot also be a reduction variable");
+
+		for(ParallelForReductionList::const_iterator otheriter = PendingReductions.begin(); otheriter != iter; ++otheriter)
+		{
+			if(otheriter->VariableName == iter->VariableName)
+				ReportFatalError("A variable can only appear in one reduction clause of a parallelfor()");
+		}
+	}
+
+	ParallelForReductions.push(PendingReductions);
+	PendingReductions.clear();
+
 	PopParameterCount();
 }
 
+//
+// Register a reduction clause attached to a parallelfor() loop
+//
+// The operator names are not reserved words; they are only recognized
+// in this position, so they remain available for use as identifiers.
+//
+void ParserState::RegisterParallelForReduction(const std::wstring& operatorname, const std::wstring& varname)
+{
+	ParallelForReduction reduction;
+	reduction.VariableName = varname;
+
+	if(operatorname == Keywords::ReduceSum)
+		reduction.Operator = VM::Operations::ParallelFor::Reduction_Sum;
+	else if(operatorname == Keywords::ReduceProduct)
+		reduction.Operator = VM::Operations::ParallelFor::Reduction_Product;
+	else if(operatorname == Keywords::ReduceMin)
+		reduction.Operator = VM::Operations::ParallelFor::Reduction_Min;
+	else if(operatorname == Keywords::ReduceMax)
+		reduction.Operator = VM::Operations::ParallelFor::Reduction_Max;
+	else
+	{
+		ReportFatalError("Unknown parallelfor() reduction; expected sum, product, min, or max");
+		return;
+	}
+
+	if(!CurrentScope->HasVariable(varname))
+	{
+		ReportFatalError("Reduction variable of a parallelfor() has not been defined");
+		return;
+	}
+
+	reduction.VariableType = CurrentScope->GetVariableType(varname);
+	if(reduction.VariableType != VM::EpochVariableType_Integer && reduction.VariableType != VM::EpochVariableType_Real)
+	{
+		ReportFatalError("Reduction variables of a parallelfor() must be integers or reals");
+		return;
+	}
+
+	PendingReductions.push_back(reduction);
+}
+
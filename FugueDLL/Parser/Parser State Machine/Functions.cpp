@@ -19,6 +19,8 @@
 
 #include "Virtual Machine/VMExceptions.h"
 
+#include "Utility/Hashing.h"
+
 
 using namespace Parser;
 
@@ -56,6 +58,23 @@ void ParserState::RegisterUpcomingFunctionPP(const std::wstring& functionname)
 }
 
 
+//
+// Record a fingerprint of the source text of a completed function definition.
+// The validator uses this to skip over functions which have not changed since
+// they last passed validation; see ValidationCache.h for details.
+//
+void ParserState::RecordFunctionSource(ParsePosIter begin, ParsePosIter end)
+{
+	VM::ScopeDescription& globalscope = ParsedProgram->GetGlobalScope();
+	if(!globalscope.HasFunction(FunctionName))
+		return;
+
+	VM::Function* func = dynamic_cast<VM::Function*>(globalscope.GetFunction(FunctionName));
+	if(func)
+		func->SetSourceFingerprint(Hashing::HashBytes64(Hashing::FNV64OffsetBasis, begin, end - begin));
+}
+
+
 //
 // Register a named parameter belonging to the current function.
 //
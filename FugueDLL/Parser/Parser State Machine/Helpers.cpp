@@ -15,11 +15,14 @@
 #include "Virtual Machine/Core Entities/Block.h"
 
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
 
 #include "User Interface/Output.h"
 
 #include "Utility/Strings.h"
 
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace Parser;
 
@@ -44,7 +47,12 @@ VM::EpochVariableTypeID ParserState::StackEntry::DetermineEffectiveType(const VM
 		return scope.GetVariableType(StringValue);
 	case STACKENTRYTYPE_OPERATION:
 		if(OperationPointer->GetType(scope) == VM::EpochVariableType_Array)
+		{
+			const VM::Operations::ElementwiseArithmetic* elementwiseop = dynamic_cast<VM::Operations::ElementwiseArithmetic*>(OperationPointer);
+			if(elementwiseop)
+				return elementwiseop->GetElementType();
 			return dynamic_cast<VM::Operations::ConsArray*>(OperationPointer)->GetElementType();
+		}
 		return OperationPointer->GetType(scope);
 	default:
 		throw ParserFailureException("Invalid parse stack entry");
@@ -66,6 +74,33 @@ bool ParserState::StackEntry::IsArray() const
 	return false;
 }
 
+//
+// Determine if a parse stack entry refers to an array value, and
+// retrieve the type of its elements; for scalar entries, the type
+// of the value itself is retrieved instead. Unlike IsArray(), this
+// also recognizes array variables and computed arrays.
+//
+bool ParserState::GetArrayOperandElementType(const StackEntry& entry, VM::EpochVariableTypeID& elementtype) const
+{
+	if(entry.Type == StackEntry::STACKENTRYTYPE_IDENTIFIER && CurrentScope->GetVariableType(entry.StringValue) == VM::EpochVariableType_Array)
+	{
+		elementtype = CurrentScope->GetArrayType(entry.StringValue);
+		return true;
+	}
+
+	if(entry.Type == StackEntry::STACKENTRYTYPE_OPERATION && entry.OperationPointer->GetType(*CurrentScope) == VM::EpochVariableType_Array)
+	{
+		if(dynamic_cast<VM::Operations::ConsArray*>(entry.OperationPointer) || dynamic_cast<VM::Operations::ElementwiseArithmetic*>(entry.OperationPointer))
+			elementtype = entry.DetermineEffectiveType(*CurrentScope);
+		else
+			elementtype = VM::EpochVariableType_Error;
+		return true;
+	}
+
+	elementtype = entry.DetermineEffectiveType(*CurrentScope);
+	return false;
+}
+
 
 //
 // Output the given line of source code, and display an
@@ -127,17 +162,51 @@ void ParserState::SetParsePosition(const ParsePosIter& pos)
 	ParsePosition = pos;
 }
 
+//
+// Build the table used to map parse positions back to file locations
+//
+void ParserState::IndexSourceLines(const std::vector<Byte>& memblock, const std::string& sourcename)
+{
+	SourceLines.Index(&memblock[0], &memblock[0] + memblock.size() - 1, sourcename);
+}
+
+//
+// Retrieve the file location of an arbitrary parse position
+//
+FileLocationInfo ParserState::GetSourceLocation(ParsePosIter pos) const
+{
+	return SourceLines.Locate(pos, Config::TabWidth);
+}
+
+//
+// Retrieve the parse position at the start of the line following the given position
+//
+ParsePosIter ParserState::GetEndOfSourceLine(ParsePosIter pos) const
+{
+	return SourceLines.GetEndOfLine(pos);
+}
+
 //
 // Retrieve the current file location of the parser
 //
 FileLocationInfo ParserState::GetFileLocationInfo() const
 {
-	FileLocationInfo fileinfo;
-	fileinfo.FileName = widen(ParsePosition.get_position().file);
-	fileinfo.Line = ParsePosition.get_position().line;
-	fileinfo.Column = ParsePosition.get_position().column;
+	return GetSourceLocation(ParsePosition);
+}
+
+//
+// Retrieve the name of the function whose code is currently being parsed
+//
+// Operations added while no block is open belong to the initializers of
+// the current function's return values. Code outside of any function,
+// such as global initializers, yields an empty name.
+//
+std::wstring ParserState::GetEnclosingFunctionName() const
+{
+	if(Blocks.empty() || Blocks.front().Type == BlockEntry::BLOCKENTRYTYPE_FUNCTION_NOCREATE)
+		return FunctionName;
 
-	return fileinfo;
+	return std::wstring();
 }
 
 
@@ -164,7 +233,7 @@ void ParserState::PushSavedIdentifier(SavedStringIndex slotindex)
 //
 void ParserState::AddOperationDeferred(VM::OperationPtr op)
 {
-	DebugInfo.TrackInstruction(op.get(), GetFileLocationInfo());
+	DebugInfo.TrackInstruction(op.get(), GetFileLocationInfo(), GetEnclosingFunctionName());
 	DeferredOperations.push_back(op.release());
 }
 
@@ -214,7 +283,7 @@ void ParserState::PushCachedOperations()
 //
 void ParserState::AddOperationToCurrentBlock(VM::OperationPtr op)
 {
-	DebugInfo.TrackInstruction(op.get(), GetFileLocationInfo());
+	DebugInfo.TrackInstruction(op.get(), GetFileLocationInfo(), GetEnclosingFunctionName());
 	if(!Blocks.empty())
 		Blocks.back().TheBlock->AddOperation(op);
 	else
@@ -739,9 +739,9 @@ void ParserState::RegisterOpAssignment()
 	{
 		switch(type)
 		{
-		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SumIntegers(false, false), *CurrentScope));			break;
-		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SumInteger16s(false, false), *CurrentScope));			break;
-		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SumReals(false, false), *CurrentScope));				break;
+		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SumIntegers::Create(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SumInteger16s::Create(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SumReals::Create(false, false), *CurrentScope));				break;
 		default:								throw ParserFailureException("Invalid type for this operation");
 		}
 	}
@@ -749,9 +749,9 @@ void ParserState::RegisterOpAssignment()
 	{
 		switch(type)
 		{
-		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SubtractIntegers(false, false), *CurrentScope));		break;
-		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SubtractInteger16s(false, false), *CurrentScope));		break;
-		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::SubtractReals(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SubtractIntegers::Create(false, false), *CurrentScope));		break;
+		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SubtractInteger16s::Create(false, false), *CurrentScope));		break;
+		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::SubtractReals::Create(false, false), *CurrentScope));			break;
 		default:								throw ParserFailureException("Invalid type for this operation");
 		}
 	}
@@ -759,9 +759,9 @@ void ParserState::RegisterOpAssignment()
 	{
 		switch(type)
 		{
-		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::MultiplyIntegers(false, false), *CurrentScope));		break;
-		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::MultiplyInteger16s(false, false), *CurrentScope));		break;
-		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::MultiplyReals(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::MultiplyIntegers::Create(false, false), *CurrentScope));		break;
+		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::MultiplyInteger16s::Create(false, false), *CurrentScope));		break;
+		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::MultiplyReals::Create(false, false), *CurrentScope));			break;
 		default:								throw ParserFailureException("Invalid type for this operation");
 		}
 	}
@@ -769,9 +769,9 @@ void ParserState::RegisterOpAssignment()
 	{
 		switch(type)
 		{
-		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::DivideIntegers(false, false), *CurrentScope));			break;
-		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::DivideInteger16s(false, false), *CurrentScope));		break;
-		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(new VM::Operations::DivideReals(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Integer:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::DivideIntegers::Create(false, false), *CurrentScope));			break;
+		case VM::EpochVariableType_Integer16:	arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::DivideInteger16s::Create(false, false), *CurrentScope));		break;
+		case VM::EpochVariableType_Real:		arithmeticop.reset(new VM::Operations::PushOperation(VM::Operations::DivideReals::Create(false, false), *CurrentScope));			break;
 		default:								throw ParserFailureException("Invalid type for this operation");
 		}
 	}
@@ -847,9 +847,9 @@ void ParserState::PreincrementVariable()
 	VM::OperationPtr innerop(NULL);
 	switch(type)
 	{
-	case VM::EpochVariableType_Integer:		innerop.reset(new VM::Operations::SumIntegers(false, false));		break;
-	case VM::EpochVariableType_Integer16:	innerop.reset(new VM::Operations::SumInteger16s(false, false));		break;
-	case VM::EpochVariableType_Real:		innerop.reset(new VM::Operations::SumReals(false, false));			break;
+	case VM::EpochVariableType_Integer:		innerop.reset(VM::Operations::SumIntegers::Create(false, false));		break;
+	case VM::EpochVariableType_Integer16:	innerop.reset(VM::Operations::SumInteger16s::Create(false, false));		break;
+	case VM::EpochVariableType_Real:		innerop.reset(VM::Operations::SumReals::Create(false, false));			break;
 	default:								throw ParserFailureException("Invalid variable type for this operator");
 	}
 	
@@ -885,9 +885,9 @@ void ParserState::PredecrementVariable()
 	VM::OperationPtr innerop(NULL);
 	switch(type)
 	{
-	case VM::EpochVariableType_Integer:		innerop.reset(new VM::Operations::SubtractIntegers(false, false));		break;
-	case VM::EpochVariableType_Integer16:	innerop.reset(new VM::Operations::SubtractInteger16s(false, false));	break;
-	case VM::EpochVariableType_Real:		innerop.reset(new VM::Operations::SubtractReals(false, false));			break;
+	case VM::EpochVariableType_Integer:		innerop.reset(VM::Operations::SubtractIntegers::Create(false, false));		break;
+	case VM::EpochVariableType_Integer16:	innerop.reset(VM::Operations::SubtractInteger16s::Create(false, false));	break;
+	case VM::EpochVariableType_Real:		innerop.reset(VM::Operations::SubtractReals::Create(false, false));			break;
 	default:								throw ParserFailureException("Invalid variable type for this operator");
 	}
 
@@ -923,9 +923,9 @@ void ParserState::PostincrementVariable()
 	VM::OperationPtr innerop(NULL);
 	switch(type)
 	{
-	case VM::EpochVariableType_Integer:		innerop.reset(new VM::Operations::SumIntegers(false, false));		break;
-	case VM::EpochVariableType_Integer16:	innerop.reset(new VM::Operations::SumInteger16s(false, false));		break;
-	case VM::EpochVariableType_Real:		innerop.reset(new VM::Operations::SumReals(false, false));			break;
+	case VM::EpochVariableType_Integer:		innerop.reset(VM::Operations::SumIntegers::Create(false, false));		break;
+	case VM::EpochVariableType_Integer16:	innerop.reset(VM::Operations::SumInteger16s::Create(false, false));		break;
+	case VM::EpochVariableType_Real:		innerop.reset(VM::Operations::SumReals::Create(false, false));			break;
 	default:								throw ParserFailureException("Invalid variable type for this operator");
 	}
 
@@ -961,9 +961,9 @@ void ParserState::PostdecrementVariable()
 	VM::OperationPtr innerop(NULL);
 	switch(type)
 	{
-	case VM::EpochVariableType_Integer:		innerop.reset(new VM::Operations::SubtractIntegers(false, false));		break;
-	case VM::EpochVariableType_Integer16:	innerop.reset(new VM::Operations::SubtractInteger16s(false, false));	break;
-	case VM::EpochVariableType_Real:		innerop.reset(new VM::Operations::SubtractReals(false, false));			break;
+	case VM::EpochVariableType_Integer:		innerop.reset(VM::Operations::SubtractIntegers::Create(false, false));		break;
+	case VM::EpochVariableType_Integer16:	innerop.reset(VM::Operations::SubtractInteger16s::Create(false, false));	break;
+	case VM::EpochVariableType_Real:		innerop.reset(VM::Operations::SubtractReals::Create(false, false));			break;
 	default:								throw ParserFailureException("Invalid variable type for this operator");
 	}
 
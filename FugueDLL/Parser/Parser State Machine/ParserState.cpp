@@ -28,6 +28,7 @@ using namespace Parser;
 ParserState::ParserState()
 	: ParsedProgram(new VM::Program),
 	  CodeBuffer(NULL),
+	  ParsePosition(NULL),
 	  ParseFailed(false),
 	  FunctionReturns(NULL),
 	  CreatedTupleType(NULL),
@@ -51,7 +52,6 @@ ParserState::ParserState()
 //
 ParserState::~ParserState()
 {
-	delete ParsedProgram;
 	delete FunctionReturns;
 	delete CreatedTupleType;
 	delete CreatedStructureType;
@@ -87,5 +87,8 @@ ParserState::~ParserState()
 
 	for(std::map<std::wstring, VM::Block*>::iterator iter = FunctionReturnInitializationBlocks.begin(); iter != FunctionReturnInitializationBlocks.end(); ++iter)
 		delete iter->second;
+
+	// Leftover code objects live in the program's code arena, so the program must go last
+	delete ParsedProgram;
 }
 
@@ -13,6 +13,7 @@
 #include "Virtual Machine/Core Entities/Types/FunctionSignature.h"
 
 #include "Parser/Debug Info Tables/DebugTable.h"
+#include "Parser/Debug Info Tables/SourceLineTable.h"
 
 #include <boost/spirit/include/classic.hpp>
 
@@ -35,7 +36,7 @@ namespace Parser
 {
 
 	// Handy type shortcuts
-	typedef boost::spirit::classic::position_iterator<const char*> ParsePosIter;
+	typedef const Byte* ParsePosIter;
 
 	//
 	// Various slots for storing identifiers in the parser state machine
@@ -67,6 +68,7 @@ namespace Parser
 	public:
 		void RegisterUpcomingFunction(const std::wstring& functionname);
 		void RegisterUpcomingFunctionPP(const std::wstring& functionname);
+		void RecordFunctionSource(ParsePosIter begin, ParsePosIter end);
 
 	// Function parameters
 	public:
@@ -155,6 +157,13 @@ namespace Parser
 	public:
 		void RegisterArrayVariable();
 		void RegisterArrayType(const std::wstring& type);
+		void RegisterMappedArrayVariable();
+
+	// Hash maps
+	public:
+		void RegisterHashMapKeyType(const std::wstring& type);
+		void RegisterHashMapValueType(const std::wstring& type);
+		void RegisterHashMapVariable();
 
 	// Tuples
 	public:
@@ -181,6 +190,7 @@ namespace Parser
 
 		void RegisterEndOfWhileLoopConditional();
 		void RegisterEndOfParallelFor();
+		void RegisterParallelForReduction(const std::wstring& operatorname, const std::wstring& varname);
 
 		void EnterBlock();
 		void EnterBlockPP();
@@ -311,6 +321,8 @@ namespace Parser
 		void SetCodeBuffer(Byte* buffer)
 		{ CodeBuffer = buffer; }
 
+		void IndexSourceLines(const std::vector<Byte>& memblock, const std::string& sourcename);
+
 		void DumpCodeLine(unsigned line, unsigned column, unsigned tabwidth) const;
 
 	// Parse position tracking, used for outputting hints when errors occur
@@ -320,6 +332,9 @@ namespace Parser
 		const ParsePosIter& GetParsePosition() const
 		{ return ParsePosition; }
 
+		FileLocationInfo GetSourceLocation(ParsePosIter pos) const;
+		ParsePosIter GetEndOfSourceLine(ParsePosIter pos) const;
+
 	// Error reporting
 	public:
 		void ReportFatalError(const char* what);
@@ -452,14 +467,24 @@ namespace Parser
 		ReturnPointerType* ParseBitwiseOp(bool firstisarray, bool secondisarray);
 
 		FileLocationInfo GetFileLocationInfo() const;
+		std::wstring GetEnclosingFunctionName() const;
 
 		size_t ValidateStructInit(const std::vector<std::wstring>& members, const std::wstring& structtypename, std::vector<VM::Operation*>& ops, size_t maxop, bool& initbyfunctioncall);
 		size_t ValidateTupleInit(const std::vector<std::wstring>& members, const std::wstring& tupletypename, std::vector<VM::Operation*>& ops, size_t maxop);
+
+		bool ValidateHashMapIdentifier(const StackEntry& identifier, const char* functionname, VM::EpochVariableTypeID& keytype, VM::EpochVariableTypeID& valuetype);
+		const std::wstring* ValidateHashMapKeyedAccess(const char* functionname, VM::EpochVariableTypeID& valuetype);
+		bool ValidateSortableArrayIdentifier(const StackEntry& identifier, const char* functionname, VM::EpochVariableTypeID& elementtype);
+		const std::wstring* ValidateWholeArrayAccess(const char* functionname);
+		bool ValidateStringPairParameters(const char* functionname);
+		bool GetArrayOperandElementType(const StackEntry& entry, VM::EpochVariableTypeID& elementtype) const;
 		void ReverseOps(VM::Block* block, size_t numops);
 		void ReverseOpsAsGroups(VM::Block* block, size_t numops);
 
 		void AddOperationToCurrentBlock(VM::OperationPtr op);
 
+		void ValidatePayloadOwnership(const StackEntry& entry, VM::EpochVariableTypeID type, bool multipledeliveries);
+
 		void RegisterInfixFunction(const std::wstring& functionname);
 
 	// Internal helpers for builtin functions
@@ -469,6 +494,7 @@ namespace Parser
 		VM::OperationPtr CreateOperation_Subtract();
 		VM::OperationPtr CreateOperation_Multiply();
 		VM::OperationPtr CreateOperation_Divide();
+		VM::OperationPtr CreateOperation_ArrayArithmetic(const std::wstring& operationname);
 
 		// Bitwise and Logical Operators
 		VM::OperationPtr CreateOperation_Or();
@@ -486,13 +512,41 @@ namespace Parser
 
 		// Concurrency
 		VM::OperationPtr CreateOperation_Message();
+		VM::OperationPtr CreateOperation_Broadcast();
+		VM::OperationPtr CreateOperation_DelayedMessage(bool periodic);
+		VM::OperationPtr CreateOperation_Request();
+		VM::OperationPtr CreateOperation_Reply();
 		VM::OperationPtr CreateOperation_AcceptMessage();
+		VM::OperationPtr CreateOperation_AcceptMessageTimeout();
 		VM::OperationPtr CreateOperation_Future();
+		VM::OperationPtr CreateOperation_DependentFuture(bool waitforany);
+		bool BindFutureExpression(bool threadpool, std::wstring& varname, VM::EpochVariableTypeID& type);
+		VM::OperationPtr CreateOperation_ParallelInvoke();
+		VM::OperationPtr CreateOperation_Channel();
+		VM::OperationPtr CreateOperation_ChannelSend();
+		VM::OperationPtr CreateOperation_ChannelReceive();
+		VM::OperationPtr CreateOperation_Generator();
+		VM::OperationPtr CreateOperation_Yield();
+		VM::OperationPtr CreateOperation_HasNext();
+		VM::OperationPtr CreateOperation_NextValue();
+		VM::OperationPtr CreateOperation_Atomic(const std::wstring& operationname);
+		VM::OperationPtr CreateOperation_Cancel();
+		VM::OperationPtr CreateOperation_CancelPool();
 
 		// Containers
 		VM::OperationPtr CreateOperation_ConsArray();
 		VM::OperationPtr CreateOperation_ReadArray();
 		VM::OperationPtr CreateOperation_WriteArray();
+		VM::OperationPtr CreateOperation_AppendArray();
+		VM::OperationPtr CreateOperation_SortArray();
+		VM::OperationPtr CreateOperation_SearchArray();
+		VM::OperationPtr CreateOperation_MinIndex();
+		VM::OperationPtr CreateOperation_MaxIndex();
+		VM::OperationPtr CreateOperation_MapInsert();
+		VM::OperationPtr CreateOperation_MapLookup();
+		VM::OperationPtr CreateOperation_MapContains();
+		VM::OperationPtr CreateOperation_MapErase();
+		VM::OperationPtr CreateOperation_MapKeys();
 
 		// Debugging
 		VM::OperationPtr CreateOperation_DebugWrite();
@@ -510,6 +564,10 @@ namespace Parser
 		// Strings
 		VM::OperationPtr CreateOperation_Concat();
 		VM::OperationPtr CreateOperation_Length();
+		VM::OperationPtr CreateOperation_Find();
+		VM::OperationPtr CreateOperation_StartsWith();
+		VM::OperationPtr CreateOperation_Compare();
+		VM::OperationPtr CreateOperation_Split();
 		
 		// Structures
 		VM::OperationPtr CreateOperation_ReadStructure();
@@ -526,6 +584,7 @@ namespace Parser
 		// Variables
 		VM::OperationPtr CreateOperation_Assign();
 		VM::OperationPtr CreateOperation_SizeOf();
+		VM::OperationPtr CreateOperation_Move();
 		
 
 	// Internal state tracking
@@ -570,6 +629,7 @@ namespace Parser
 		std::wstring UpcomingNestedMemberType;
 
 		Byte* CodeBuffer;
+		SourceLineTable SourceLines;
 
 		ParsePosIter ParsePosition;
 
@@ -604,6 +664,10 @@ namespace Parser
 		std::map<std::wstring, VM::EpochVariableTypeID> ArrayTypes;
 		VM::EpochVariableTypeID TempArrayType;
 
+		std::map<std::wstring, std::pair<VM::EpochVariableTypeID, VM::EpochVariableTypeID> > HashMapTypes;
+		VM::EpochVariableTypeID TempHashMapKeyType;
+		VM::EpochVariableTypeID TempHashMapValueType;
+
 		std::list<std::wstring> MemberAccesses;
 
 		struct TypeAnnotationOp
@@ -624,6 +688,16 @@ namespace Parser
 		std::wstring ControlVarName;
 		VM::EpochVariableTypeID ControlVarType;
 
+		struct ParallelForReduction
+		{
+			unsigned Operator;
+			std::wstring VariableName;
+			VM::EpochVariableTypeID VariableType;
+		};
+		typedef std::vector<ParallelForReduction> ParallelForReductionList;
+		ParallelForReductionList PendingReductions;
+		std::stack<ParallelForReductionList> ParallelForReductions;
+
 		std::stack<std::wstring> ExtensionControlKeywords;
 
 	// Public tracking
@@ -17,6 +17,8 @@
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
 
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
 #include "Virtual Machine/Operations/Variables/VariableOps.h"
 #include "Virtual Machine/Operations/Flow/Invoke.h"
 #include "Virtual Machine/Operations/StackOps.h"
@@ -183,6 +185,9 @@ void ParserState::RegisterArrayVariable()
 		{
 			invokeop = dynamic_cast<VM::Operations::Invoke*>(pushop->GetNestedOperation());
 
+			VM::Operations::HashMapKeys* keysop = dynamic_cast<VM::Operations::HashMapKeys*>(pushop->GetNestedOperation());
+			VM::Operations::ElementwiseArithmetic* elementwiseop = dynamic_cast<VM::Operations::ElementwiseArithmetic*>(pushop->GetNestedOperation());
+
 			if(invokeop)
 			{
 				TempArrayType = invokeop->GetFunction()->GetTypeHint(*CurrentScope);
@@ -193,6 +198,16 @@ void ParserState::RegisterArrayVariable()
 				AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::PushOperation(new VM::Operations::ConsArrayIndirect(TempArrayType, invokeop), *CurrentScope)));
 				AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
 			}
+			else if(keysop)
+			{
+				TempArrayType = keysop->GetKeyType();
+				AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
+			}
+			else if(elementwiseop)
+			{
+				TempArrayType = elementwiseop->GetElementType();
+				AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
+			}
 			else
 				throw VM::InternalFailureException("Unsure what to do with array constructor");
 		}
@@ -257,3 +272,98 @@ void ParserState::RegisterArrayType(const std::wstring& type)
 		throw VM::NotImplementedException("Cannot construct an array of this type");
 }
 
+//
+// Register the construction of a named array variable backed by a file
+//
+void ParserState::RegisterMappedArrayVariable()
+{
+	const std::wstring& varname = ParsedProgram->PoolStaticString(VariableNameStack.top());
+
+	if(Blocks.back().TheBlock->GetTailOperation()->GetType(*CurrentScope) != VM::EpochVariableType_String)
+		ReportFatalError("maparray() expects the name of the file to map as a string");
+	else if(TempArrayType == VM::EpochVariableType_String)
+		ReportFatalError("maparray() can only map arrays of integer, integer16, real, or boolean elements");
+	else
+	{
+		CurrentScope->AddVariable(varname, VM::EpochVariableType_Array);
+
+		AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::PushOperation(new VM::Operations::ConsMappedArray(TempArrayType), *CurrentScope)));
+		AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
+
+		ArrayTypes[varname] = TempArrayType;
+		CurrentScope->SetArrayType(varname, TempArrayType);
+
+		if(IsDefiningConstant)
+			CurrentScope->SetConstant(varname);
+	}
+
+	TheStack.pop_back();
+
+	VariableTypeStack.pop();
+	VariableNameStack.pop();
+	PopParameterCount();
+	IsDefiningConstant = false;
+}
+
+
+//
+// Register the construction of a named hash map variable
+//
+void ParserState::RegisterHashMapVariable()
+{
+	const std::wstring& varname = ParsedProgram->PoolStaticString(VariableNameStack.top());
+
+	CurrentScope->AddVariable(varname, VM::EpochVariableType_HashMap);
+
+	AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::PushOperation(new VM::Operations::ConsHashMap(TempHashMapKeyType, TempHashMapValueType), *CurrentScope)));
+	AddOperationToCurrentBlock(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
+
+	HashMapTypes[varname] = std::make_pair(TempHashMapKeyType, TempHashMapValueType);
+
+	if(IsDefiningConstant)
+		CurrentScope->SetConstant(varname);
+
+	VariableTypeStack.pop();
+	VariableNameStack.pop();
+	PopParameterCount();
+	IsDefiningConstant = false;
+}
+
+//
+// Register the key type of a hash map; only integers and strings can be used as keys
+//
+void ParserState::RegisterHashMapKeyType(const std::wstring& type)
+{
+	if(type == Keywords::Integer)
+		TempHashMapKeyType = VM::EpochVariableType_Integer;
+	else if(type == Keywords::String)
+		TempHashMapKeyType = VM::EpochVariableType_String;
+	else
+	{
+		ReportFatalError("Hash map keys must be integers or strings");
+		TempHashMapKeyType = VM::EpochVariableType_Integer;
+	}
+}
+
+//
+// Register the value type of a hash map
+//
+void ParserState::RegisterHashMapValueType(const std::wstring& type)
+{
+	if(type == Keywords::Integer)
+		TempHashMapValueType = VM::EpochVariableType_Integer;
+	else if(type == Keywords::Integer16)
+		TempHashMapValueType = VM::EpochVariableType_Integer16;
+	else if(type == Keywords::Real)
+		TempHashMapValueType = VM::EpochVariableType_Real;
+	else if(type == Keywords::Boolean)
+		TempHashMapValueType = VM::EpochVariableType_Boolean;
+	else if(type == Keywords::String)
+		TempHashMapValueType = VM::EpochVariableType_String;
+	else
+	{
+		ReportFatalError("Hash map values must be integers, reals, booleans, or strings");
+		TempHashMapValueType = VM::EpochVariableType_Integer;
+	}
+}
+
@@ -9,6 +9,8 @@
 
 #include "User Interface/Output.h"
 
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace Parser;
 using namespace boost::spirit::classic;
@@ -24,16 +26,19 @@ namespace boost
 
 bool Parser::ParseMemoryPass1(ParserState& state, const std::vector<Byte>& memblock, const std::string& sourcename)
 {
-	position_iterator<const Byte*> start(&memblock[0], &memblock[0] + memblock.size() - 1, sourcename);
-    position_iterator<const Byte*> end;
+	const Byte* start = &memblock[0];
+	const Byte* end = &memblock[0] + memblock.size() - 1;
 
-	EpochGrammarPreProcess ppgrammar(state);
+	EpochGrammarPreProcess ppgrammar(state, Config::SkimFunctionBodies);
     SkipGrammar skip;
 
-	parse_info<position_iterator<const Byte*> > result;
+	parse_info<const Byte*> result;
 
 	UI::OutputStream out;
-	out << L"Parsing: first pass..." << std::endl;
+	if(Config::SkimFunctionBodies)
+		out << L"Parsing: first pass (declarations only)..." << std::endl;
+	else
+		out << L"Parsing: first pass..." << std::endl;
 
 	try
 	{
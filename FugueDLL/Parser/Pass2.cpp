@@ -9,6 +9,8 @@
 
 #include "User Interface/Output.h"
 
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace Parser;
 using namespace boost::spirit::classic;
@@ -25,13 +27,13 @@ namespace boost
 
 bool Parser::ParseMemoryPass2(ParserState& state, const std::vector<Byte>& memblock, const std::string& sourcename)
 {
-	position_iterator<const Byte*> start(&memblock[0], &memblock[0] + memblock.size() - 1, sourcename);
-    position_iterator<const Byte*> end;
+	const Byte* start = &memblock[0];
+	const Byte* end = &memblock[0] + memblock.size() - 1;
 
 	EpochGrammar grammar(state);
 	SkipGrammar skip;
 
-	parse_info<position_iterator<const Byte*> > result;
+	parse_info<const Byte*> result;
 
 	UI::OutputStream out;
 	out << L"Parsing: second pass..." << std::endl;
@@ -46,6 +48,14 @@ bool Parser::ParseMemoryPass2(ParserState& state, const std::vector<Byte>& membl
 		return false;
 	}
 
+	// When the first pass skims function bodies, it cannot catch syntax
+	// errors inside them, so at least point out where the parse stopped
+	if(!result.full && !state.ParseFailed && Config::SkimFunctionBodies)
+	{
+		state.SetParsePosition(result.stop);
+		state.ReportFatalError("Syntax error - unable to parse the code at this location");
+	}
+
     return result.full && !state.ParseFailed;
 }
 
@@ -7,42 +7,10 @@
 
 #include "pch.h"
 #include "Parser/Tracing.h"
-#include "User Interface/Output.h"
-#include "Configuration/RuntimeOptions.h"
 
 
 //
-// Display a trace of what the parser is currently doing
-//
-void Parser::Trace(const wchar_t* traceinfo)
-{
-#ifdef _DEBUG
-	if(Config::TraceParserExecution)
-	{
-		UI::OutputStream out;
-		out << UI::lightgreen << L"Parser trace: ";
-		out << UI::resetcolor << traceinfo << std::endl;
-	}
-#endif
-}
-
-//
-// Display a trace of what the parser is currently doing, including the associated code fragment
-//
-void Parser::Trace(const wchar_t* traceinfo, const std::wstring& identifier)
-{
-#ifdef _DEBUG
-	if(Config::TraceParserExecution)
-	{
-		UI::OutputStream out;
-		out << UI::lightgreen << L"Parser trace: ";
-		out << UI::resetcolor << traceinfo << L" [" << identifier << L"]" << std::endl;
-	}
-#endif
-}
-
-//
-// Display a trace of a newly created lexical scope descriptor.
+// Record a trace of a newly created lexical scope descriptor.
 //
 // This is primarily useful for debugging issues with scope resolution
 // and bindings in the parser. Note that not all code in the parser
@@ -52,17 +20,12 @@ void Parser::Trace(const wchar_t* traceinfo, const std::wstring& identifier)
 //
 void Parser::TraceScopeCreation(const VM::ScopeDescription* newscope, const VM::ScopeDescription* displacedscope)
 {
-#ifdef _DEBUG
-	if(Config::TraceParserExecution)
-	{
-		UI::OutputStream out;
-		out << UI::lightgreen << L"Scope created: ";
-		out << UI::resetcolor << newscope;
+	if(!TraceLog::IsEnabled(TraceLog::Category_Scopes))
+		return;
 
-		if(displacedscope)
-			out << L" (displacing scope " << displacedscope << L")";
+	TraceLog::Entry entry(L"Scope created: ");
+	entry << newscope;
 
-		out << std::endl;
-	}
-#endif
-}
\ No newline at end of file
+	if(displacedscope)
+		entry << L" (displacing scope " << displacedscope << L")";
+}
\ No newline at end of file
@@ -4,10 +4,17 @@
 //
 // Utility code for tracing the execution of the parser
 //
+// Traces go to the diagnostic trace log, and are available in all builds;
+// the checks are inlined so that disabled traces cost next to nothing.
+//
 
 #pragma once
 
 
+// Dependencies
+#include "User Interface/TraceLog.h"
+
+
 // Forward declarations
 namespace VM
 {
@@ -17,9 +24,26 @@ namespace VM
 
 namespace Parser
 {
-	void Trace(const wchar_t* traceinfo);
-	void Trace(const wchar_t* traceinfo, const std::wstring& identifier);
+
+	//
+	// Record what the parser is currently doing
+	//
+	inline void Trace(const wchar_t* traceinfo)
+	{
+		if(TraceLog::IsEnabled(TraceLog::Category_Parser))
+			TraceLog::Write(L"Parser trace: ", traceinfo);
+	}
+
+	//
+	// Record what the parser is currently doing, including the associated code fragment
+	//
+	inline void Trace(const wchar_t* traceinfo, const std::wstring& identifier)
+	{
+		if(TraceLog::IsEnabled(TraceLog::Category_Parser))
+			TraceLog::Write(L"Parser trace: ", traceinfo, identifier);
+	}
 
 	void TraceScopeCreation(const VM::ScopeDescription* newscope, const VM::ScopeDescription* displacedscope);
+
 }
 
@@ -35,10 +35,9 @@ namespace VM
 		class ExecuteBlock;
 		class ExitIfChain;
 		class ForkTask;
+		class FusedOperation;
 		class If;
-		class MapOperation;
 		class NoOp;
-		class ReduceOperation;
 		class Return;
 		class WhileLoop;
 		class WhileLoopConditional;
@@ -47,10 +46,17 @@ namespace VM
 
 
 // We need headers for all operations which are non-trivial to serialize
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
 #include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
 #include "Virtual Machine/Operations/Concurrency/Tasks.h"
 #include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
 #include "Virtual Machine/Operations/Flow/FlowControl.h"
 #include "Virtual Machine/Operations/Flow/Invoke.h"
 #include "Virtual Machine/Operations/Operators/Arithmetic.h"
@@ -153,24 +159,28 @@ namespace VM
 
 // Serialization for operations that consist of just an instruction
 SERIALIZE_TOKENONLY(VM::Operations::Break, Serialization::Break)
+SERIALIZE_TOKENONLY(VM::Operations::CompareStrings, Serialization::CompareStrings)
 SERIALIZE_TOKENONLY(VM::Operations::CreateThreadPool, Serialization::ThreadPool)
+SERIALIZE_TOKENONLY(VM::Operations::CancelPoolWork, Serialization::CancelPoolWork)
 SERIALIZE_TOKENONLY(VM::Operations::DebugCrashVM, Serialization::DebugCrashVM)
 SERIALIZE_TOKENONLY(VM::Operations::DebugReadStaticString, Serialization::DebugRead)
 SERIALIZE_TOKENONLY(VM::Operations::DebugWriteStringExpression, Serialization::DebugWrite)
 SERIALIZE_TOKENONLY(VM::Operations::DoWhileLoop, Serialization::DoWhile)
 SERIALIZE_TOKENONLY(VM::Operations::ExitIfChain, Serialization::ExitIfChain)
+SERIALIZE_TOKENONLY(VM::Operations::FindSubstring, Serialization::FindString)
 SERIALIZE_TOKENONLY(VM::Operations::ForkTask, Serialization::ForkTask)
 SERIALIZE_TOKENONLY(VM::Operations::ForkThread, Serialization::ForkThread)
 SERIALIZE_TOKENONLY(VM::Operations::GetMessageSender, Serialization::GetMessageSender)
+SERIALIZE_TOKENONLY(VM::Operations::GeneratorHasNext, Serialization::GeneratorHasNext)
 SERIALIZE_TOKENONLY(VM::Operations::GetTaskCaller, Serialization::GetTaskCaller)
 SERIALIZE_TOKENONLY(VM::Operations::If, Serialization::If)
 SERIALIZE_TOKENONLY(VM::Operations::LogicalNot, Serialization::LogicalNot)
 SERIALIZE_TOKENONLY(VM::Operations::LogicalXor, Serialization::LogicalXor)
-SERIALIZE_TOKENONLY(VM::Operations::MapOperation, Serialization::Map)
 SERIALIZE_TOKENONLY(VM::Operations::Negate, Serialization::Negate)
 SERIALIZE_TOKENONLY(VM::Operations::NoOp, Serialization::NoOp)
-SERIALIZE_TOKENONLY(VM::Operations::ReduceOperation, Serialization::Reduce)
 SERIALIZE_TOKENONLY(VM::Operations::Return, Serialization::Return)
+SERIALIZE_TOKENONLY(VM::Operations::SplitString, Serialization::SplitString)
+SERIALIZE_TOKENONLY(VM::Operations::StartsWith, Serialization::StringStartsWith)
 SERIALIZE_TOKENONLY(VM::Operations::WhileLoop, Serialization::While)
 SERIALIZE_TOKENONLY(VM::Operations::WhileLoopConditional, Serialization::WhileCondition)
 
@@ -200,7 +210,9 @@ SERIALIZE_TYPECAST_TOSTRING(VM::Operations::TypeCastBufferToString, Serializatio
 
 
 // Operations that do not need a trailing newline
-SERIALIZE_TOKEN_NOLINEBREAK(VM::Operations::PushOperation, Serialization::PushOperation)
+template <> const std::wstring& Serialization::GetToken<VM::Operations::PushOperation>() { return Serialization::PushOperation; }
+template <> void Serialization::SerializeNode<VM::Operations::PushOperation>(const VM::Operations::PushOperation& op, SerializationTraverser& traverser)
+{ traverser.WritePushOp(op); }
 
 
 // Operations that do not need to record their address
@@ -215,6 +227,7 @@ SERIALIZE_TOKENWITHTYPE(VM::Operations::BitwiseXor, Serialization::BitwiseXor)
 
 // Operations with payloads that must be serialized
 SERIALIZE_WITHPAYLOAD(VM::Operations::AcceptMessageFromResponseMap, Serialization::AcceptMessageFromMap)
+SERIALIZE_WITHPAYLOAD(VM::Operations::AcceptMessageWithTimeout, Serialization::AcceptMessageWithTimeout)
 SERIALIZE_WITHPAYLOAD(VM::Operations::AssignValue, Serialization::AssignValue)
 SERIALIZE_WITHPAYLOAD(VM::Operations::BindFunctionReference, Serialization::BindFunctionReference)
 SERIALIZE_WITHPAYLOAD(VM::Operations::BindReference, Serialization::BindReference)
@@ -231,6 +244,7 @@ SERIALIZE_WITHPAYLOAD(VM::Operations::IsLesser, Serialization::IsLesser)
 SERIALIZE_WITHPAYLOAD(VM::Operations::IsLesserOrEqual, Serialization::IsLesserEqual)
 SERIALIZE_WITHPAYLOAD(VM::Operations::IsNotEqual, Serialization::IsNotEqual)
 SERIALIZE_WITHPAYLOAD(VM::Operations::Length, Serialization::Length)
+SERIALIZE_WITHPAYLOAD(VM::Operations::MoveVariable, Serialization::MoveValue)
 SERIALIZE_WITHPAYLOAD(VM::Operations::PushBooleanLiteral, Serialization::PushBooleanLiteral)
 SERIALIZE_WITHPAYLOAD(VM::Operations::PushIntegerLiteral, Serialization::PushIntegerLiteral)
 SERIALIZE_WITHPAYLOAD(VM::Operations::PushInteger16Literal, Serialization::PushInteger16Literal)
@@ -240,7 +254,16 @@ SERIALIZE_WITHPAYLOAD(VM::Operations::RealConstant, Serialization::RealConstant)
 SERIALIZE_WITHPAYLOAD(VM::Operations::SizeOf, Serialization::SizeOf)
 SERIALIZE_WITHPAYLOAD(VM::Operations::ReadArray, Serialization::ReadArray)
 SERIALIZE_WITHPAYLOAD(VM::Operations::WriteArray, Serialization::WriteArray)
+SERIALIZE_WITHPAYLOAD(VM::Operations::AppendArray, Serialization::AppendArray)
 SERIALIZE_WITHPAYLOAD(VM::Operations::ArrayLength, Serialization::ArrayLength)
+SERIALIZE_WITHPAYLOAD(VM::Operations::SortArray, Serialization::SortArray)
+SERIALIZE_WITHPAYLOAD(VM::Operations::SearchArray, Serialization::SearchArray)
+SERIALIZE_WITHPAYLOAD(VM::Operations::ArrayMinIndex, Serialization::ArrayMinIndex)
+SERIALIZE_WITHPAYLOAD(VM::Operations::ArrayMaxIndex, Serialization::ArrayMaxIndex)
+SERIALIZE_WITHPAYLOAD(VM::Operations::HashMapInsert, Serialization::HashMapInsert)
+SERIALIZE_WITHPAYLOAD(VM::Operations::HashMapContains, Serialization::HashMapContains)
+SERIALIZE_WITHPAYLOAD(VM::Operations::HashMapErase, Serialization::HashMapErase)
+SERIALIZE_WITHPAYLOAD(VM::Operations::HashMapSize, Serialization::HashMapSize)
 
 
 // Operations with compound payloads
@@ -284,14 +307,58 @@ template <> void Serialization::SerializeNode<Marshalling::CallDLL>(const Marsha
 template <> const std::wstring& Serialization::GetToken<VM::Function>() { throw Exception("Function wrapper object is not serialized directly"); }
 template <> void Serialization::SerializeNode<VM::Function>(const VM::Function& func, SerializationTraverser& traverser) { throw Exception("Function wrapper object is not serialized directly"); }
 
+template <> const std::wstring& Serialization::GetToken<VM::Operations::FusedOperation>() { throw Exception("Fused operations are generated by the optimizer and cannot be serialized"); }
+template <> void Serialization::SerializeNode<VM::Operations::FusedOperation>(const VM::Operations::FusedOperation& op, SerializationTraverser& traverser) { throw Exception("Fused operations are generated by the optimizer and cannot be serialized"); }
+
+// Maps and reduces over generators are written with distinct tokens so the loader knows where their elements come from
+template <> const std::wstring& Serialization::GetToken<VM::Operations::MapOperation>() { return Serialization::Map; }
+template <> void Serialization::SerializeNode<VM::Operations::MapOperation>(const VM::Operations::MapOperation& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, op.IsFromGenerator() ? Serialization::MapGenerator : GetToken<VM::Operations::MapOperation>(), true); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ReduceOperation>() { return Serialization::Reduce; }
+template <> void Serialization::SerializeNode<VM::Operations::ReduceOperation>(const VM::Operations::ReduceOperation& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, op.IsFromGenerator() ? Serialization::ReduceGenerator : GetToken<VM::Operations::ReduceOperation>(), true); }
+
+// Fused map-reduce operations serialize their original map and reduce operations instead (see MapReduceOperation)
+template <> const std::wstring& Serialization::GetToken<VM::Operations::MapReduceOperation>() { return Serialization::Reduce; }
+template <> void Serialization::SerializeNode<VM::Operations::MapReduceOperation>(const VM::Operations::MapReduceOperation& op, SerializationTraverser& traverser) { throw Exception("Fused map-reduce operations are not serialized directly"); }
+
 template <> const std::wstring& Serialization::GetToken<VM::Operations::ForkFuture>() { return Serialization::ForkFuture; }
 template <> void Serialization::SerializeNode<VM::Operations::ForkFuture>(const VM::Operations::ForkFuture& op, SerializationTraverser& traverser)
 { traverser.WriteForkFuture(&op, GetToken<VM::Operations::ForkFuture>(), op.GetVarName(), op.GetType(), op.UsesThreadPool()); }
 
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ForkDependentFuture>() { return Serialization::ForkDependentFuture; }
+template <> void Serialization::SerializeNode<VM::Operations::ForkDependentFuture>(const VM::Operations::ForkDependentFuture& op, SerializationTraverser& traverser)
+{ traverser.WriteForkDependentFuture(&op, GetToken<VM::Operations::ForkDependentFuture>(), op.GetVarName(), op.GetType(), op.WaitsForAny(), op.GetFutureNames()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::CancelFuture>() { return Serialization::CancelFuture; }
+template <> void Serialization::SerializeNode<VM::Operations::CancelFuture>(const VM::Operations::CancelFuture& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::CancelFuture>(), op.GetFutureName()); }
+
 template <> const std::wstring& Serialization::GetToken<VM::Operations::SendTaskMessage>() { return Serialization::SendTaskMessage; }
 template <> void Serialization::SerializeNode<VM::Operations::SendTaskMessage>(const VM::Operations::SendTaskMessage& op, SerializationTraverser& traverser)
 { traverser.WriteSendMessage(&op, GetToken<VM::Operations::SendTaskMessage>(), op.DoesUseTaskID(), op.GetMessageName(), op.GetPayloadTypes()); }
 
+template <> const std::wstring& Serialization::GetToken<VM::Operations::DelayedSendTaskMessage>() { return Serialization::DelayedSendTaskMessage; }
+template <> void Serialization::SerializeNode<VM::Operations::DelayedSendTaskMessage>(const VM::Operations::DelayedSendTaskMessage& op, SerializationTraverser& traverser)
+{ traverser.WriteDelayedSendMessage(&op, GetToken<VM::Operations::DelayedSendTaskMessage>(), op.DoesUseTaskID(), op.IsPeriodic(), op.GetMessageName(), op.GetPayloadTypes()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::BroadcastTaskMessage>() { return Serialization::BroadcastTaskMessage; }
+template <> void Serialization::SerializeNode<VM::Operations::BroadcastTaskMessage>(const VM::Operations::BroadcastTaskMessage& op, SerializationTraverser& traverser)
+{ traverser.WriteBroadcastMessage(&op, GetToken<VM::Operations::BroadcastTaskMessage>(), op.GetMessageName(), op.GetPayloadTypes()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::SendTaskRequest>() { return Serialization::SendTaskRequest; }
+template <> void Serialization::SerializeNode<VM::Operations::SendTaskRequest>(const VM::Operations::SendTaskRequest& op, SerializationTraverser& traverser)
+{ traverser.WriteSendRequest(&op, GetToken<VM::Operations::SendTaskRequest>(), op.GetFutureName(), op.GetMessageName(), op.GetPayloadTypes()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ReplyToRequest>() { return Serialization::ReplyToRequest; }
+template <> void Serialization::SerializeNode<VM::Operations::ReplyToRequest>(const VM::Operations::ReplyToRequest& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::ReplyToRequest>(), op.GetReplyType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::PendingReply>() { return Serialization::PendingReply; }
+template <> void Serialization::SerializeNode<VM::Operations::PendingReply>(const VM::Operations::PendingReply& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::PendingReply>(), op.GetReplyType()); }
+
 template <> const std::wstring& Serialization::GetToken<VM::Operations::AcceptMessage>() { return Serialization::AcceptMessage; }
 template <> void Serialization::SerializeNode<VM::Operations::AcceptMessage>(const VM::Operations::AcceptMessage& op, SerializationTraverser& traverser)
 { traverser.WriteAcceptMessage(&op, GetToken<VM::Operations::AcceptMessage>(), op.GetMessageName(), op.GetPayloadTypes()); }
@@ -318,8 +385,64 @@ template <> void Serialization::SerializeNode<Extensions::HandoffControlOperatio
 
 template <> const std::wstring& Serialization::GetToken<VM::Operations::ParallelFor>() { return Serialization::ParallelFor; }
 template <> void Serialization::SerializeNode<VM::Operations::ParallelFor>(const VM::Operations::ParallelFor& op, SerializationTraverser& traverser)
-{ traverser.WriteOp(&op, GetToken<VM::Operations::ParallelFor>(), op.GetAssociatedIdentifier()); }
+{ traverser.WriteParallelFor(op, GetToken<VM::Operations::ParallelFor>()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ParallelInvoke>() { return Serialization::ParallelInvoke; }
+template <> void Serialization::SerializeNode<VM::Operations::ParallelInvoke>(const VM::Operations::ParallelInvoke& op, SerializationTraverser& traverser)
+{ traverser.WriteParallelInvoke(op, GetToken<VM::Operations::ParallelInvoke>()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::CreateGenerator>() { return Serialization::CreateGenerator; }
+template <> void Serialization::SerializeNode<VM::Operations::CreateGenerator>(const VM::Operations::CreateGenerator& op, SerializationTraverser& traverser)
+{ traverser.WriteCompoundOp(&op, GetToken<VM::Operations::CreateGenerator>(), op.GetElementType(), op.GetBody().size()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::YieldValue>() { return Serialization::YieldValue; }
+template <> void Serialization::SerializeNode<VM::Operations::YieldValue>(const VM::Operations::YieldValue& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::YieldValue>(), op.GetValueType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::GeneratorNextValue>() { return Serialization::GeneratorNextValue; }
+template <> void Serialization::SerializeNode<VM::Operations::GeneratorNextValue>(const VM::Operations::GeneratorNextValue& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::GeneratorNextValue>(), op.GetElementType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::AtomicUpdate>() { return Serialization::AtomicUpdate; }
+template <> void Serialization::SerializeNode<VM::Operations::AtomicUpdate>(const VM::Operations::AtomicUpdate& op, SerializationTraverser& traverser)
+{ traverser.WriteAtomicOp(&op, GetToken<VM::Operations::AtomicUpdate>(), op.GetAssociatedIdentifier(), op.GetOperationType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::AtomicUpdateArray>() { return Serialization::AtomicUpdateArray; }
+template <> void Serialization::SerializeNode<VM::Operations::AtomicUpdateArray>(const VM::Operations::AtomicUpdateArray& op, SerializationTraverser& traverser)
+{ traverser.WriteAtomicOp(&op, GetToken<VM::Operations::AtomicUpdateArray>(), op.GetAssociatedIdentifier(), op.GetOperationType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ConsMappedArray>() { return Serialization::ConsMappedArray; }
+template <> void Serialization::SerializeNode<VM::Operations::ConsMappedArray>(const VM::Operations::ConsMappedArray& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::ConsMappedArray>(), op.GetElementType()); }
 
 template <> const std::wstring& Serialization::GetToken<VM::Operations::ConsArrayIndirect>() { return Serialization::ConsArrayIndirect; }
 template <> void Serialization::SerializeNode<VM::Operations::ConsArrayIndirect>(const VM::Operations::ConsArrayIndirect& op, SerializationTraverser& traverser)
 { traverser.WriteOp(&op, GetToken<VM::Operations::ConsArrayIndirect>(), op.GetElementType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::CreateChannel>() { return Serialization::CreateChannel; }
+template <> void Serialization::SerializeNode<VM::Operations::CreateChannel>(const VM::Operations::CreateChannel& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::CreateChannel>(), op.GetElementType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::SendChannel>() { return Serialization::SendChannel; }
+template <> void Serialization::SerializeNode<VM::Operations::SendChannel>(const VM::Operations::SendChannel& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::SendChannel>(), op.GetElementType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ReceiveChannel>() { return Serialization::ReceiveChannel; }
+template <> void Serialization::SerializeNode<VM::Operations::ReceiveChannel>(const VM::Operations::ReceiveChannel& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::ReceiveChannel>(), op.GetElementType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ElementwiseArithmetic>() { return Serialization::ElementwiseArithmetic; }
+template <> void Serialization::SerializeNode<VM::Operations::ElementwiseArithmetic>(const VM::Operations::ElementwiseArithmetic& op, SerializationTraverser& traverser)
+{ traverser.WriteElementwiseArithmeticOp(&op, GetToken<VM::Operations::ElementwiseArithmetic>(), op.GetOperatorType(), op.GetElementType(), op.IsFirstArray(), op.IsSecondArray()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::ConsHashMap>() { return Serialization::ConsHashMap; }
+template <> void Serialization::SerializeNode<VM::Operations::ConsHashMap>(const VM::Operations::ConsHashMap& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::ConsHashMap>(), op.GetKeyType(), op.GetValueType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::HashMapLookup>() { return Serialization::HashMapLookup; }
+template <> void Serialization::SerializeNode<VM::Operations::HashMapLookup>(const VM::Operations::HashMapLookup& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::HashMapLookup>(), op.GetAssociatedIdentifier(), op.GetValueType()); }
+
+template <> const std::wstring& Serialization::GetToken<VM::Operations::HashMapKeys>() { return Serialization::HashMapKeys; }
+template <> void Serialization::SerializeNode<VM::Operations::HashMapKeys>(const VM::Operations::HashMapKeys& op, SerializationTraverser& traverser)
+{ traverser.WriteOp(&op, GetToken<VM::Operations::HashMapKeys>(), op.GetAssociatedIdentifier(), op.GetKeyType()); }
@@ -13,27 +13,61 @@
 #include "Virtual Machine/Core Entities/Program.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 #include "Virtual Machine/Core Entities/Concurrency/Future.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/StackOps.h"
 #include "Virtual Machine/SelfAware.h"
 
 #include "Marshalling/ExternalDLL.h"
 
+#include "Bytecode/Bytecode.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include "Utility/Files/BufferedWriter.h"
+
 #include "Language Extensions/ExtensionCatalog.h"
 
 
 using namespace Serialization;
 
 
+//
+// Construct a serializer which writes to the given file
+//
+// The file stream is given a large buffer before it is opened, so that
+// the many small writes made during serialization are batched into a
+// few large writes to the file.
+//
 SerializationTraverser::SerializationTraverser(const std::string& filename)
-	: OutputStream(filename.c_str(), std::ios_base::out | std::ios_base::trunc),
+	: StreamBuffer(Files::OutputBufferSize),
+	  OwnedStream(new std::wofstream),
+	  OutputStream(*OwnedStream),
 	  CurrentProgram(NULL),
 	  CurrentScope(NULL),
 	  TabDepth(0),
 	  IgnoreTabPads(false)
 {
+	std::wofstream* filestream = static_cast<std::wofstream*>(OwnedStream.get());
+	filestream->rdbuf()->pubsetbuf(&StreamBuffer[0], static_cast<std::streamsize>(StreamBuffer.size()));
+	filestream->open(filename.c_str(), std::ios_base::out | std::ios_base::trunc);
+
 	if(!OutputStream)
 		throw FileException("Failed to write to output file: " + filename);
 }
 
+//
+// Construct a serializer which writes to an existing stream
+//
+SerializationTraverser::SerializationTraverser(std::wostream& stream)
+	: OutputStream(stream),
+	  CurrentProgram(NULL),
+	  CurrentScope(NULL),
+	  TabDepth(0),
+	  IgnoreTabPads(false)
+{
+}
+
 
 void SerializationTraverser::SetProgram(VM::Program& program)
 {
@@ -41,7 +75,13 @@ void SerializationTraverser::SetProgram(VM::Program& program)
 
 	UINT_PTR flags = 0;
 	if(CurrentProgram->GetUsesConsole())
-		flags = 1;
+		flags |= Bytecode::Flags::UsesConsole;
+	if(Config::CompactBytecode)
+		flags |= Bytecode::Flags::CompactNumbers;
+	if(CurrentProgram->IsPreoptimized())
+		flags |= Bytecode::Flags::Preoptimized;
+	if(CurrentProgram->IsValidated())
+		flags |= Bytecode::Flags::Validated;
 
 	OutputStream << reinterpret_cast<void*>(flags) << L"\n";
 
@@ -226,7 +266,7 @@ void SerializationTraverser::TraverseScope(VM::ScopeDescription& scope)
 	{
 		PadTabs();
 		OutputStream << iter->first << L"\n";
-		dynamic_cast<VM::SelfAwareBase*>(iter->second->GetNestedOperation())->Traverse(*this);
+		iter->second->GetNestedOperation()->Traverse(*this);
 	}
 
 	PadTabs();
@@ -422,6 +462,12 @@ void SerializationTraverser::WriteOp(const void* opptr, const std::wstring& toke
 	OutputStream << opptr << L" " << token << L" " << type << L"\n";
 }
 
+void SerializationTraverser::WriteOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID type1, VM::EpochVariableTypeID type2)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" " << type1 << L" " << type2 << L"\n";
+}
+
 void SerializationTraverser::WriteOp(const std::wstring& token)
 {
 	PadTabs();
@@ -434,6 +480,12 @@ void SerializationTraverser::WriteOp(const void* opptr, const std::wstring& toke
 	OutputStream << opptr << L" " << token << L" " << param << L"\n";
 }
 
+void SerializationTraverser::WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param, VM::EpochVariableTypeID type)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" " << param << L" " << type << L"\n";
+}
+
 void SerializationTraverser::WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param1, const std::wstring& param2)
 {
 	PadTabs();
@@ -512,6 +564,20 @@ void SerializationTraverser::WriteArithmeticOp(const void* opptr, const std::wst
 	OutputStream << numparams << L"\n";
 }
 
+void SerializationTraverser::WriteElementwiseArithmeticOp(const void* opptr, const std::wstring& token, unsigned optype, VM::EpochVariableTypeID elementtype, bool isfirstarray, bool issecondarray)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" " << optype << L" " << elementtype << L" ";
+	OutputStream << (isfirstarray ? Serialization::True : Serialization::False) << L" ";
+	OutputStream << (issecondarray ? Serialization::True : Serialization::False) << L"\n";
+}
+
+void SerializationTraverser::WriteAtomicOp(const void* opptr, const std::wstring& token, const std::wstring& varname, unsigned optype)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" " << varname << L" " << optype << L"\n";
+}
+
 void SerializationTraverser::WriteForkFuture(const void* opptr, const std::wstring& token, const std::wstring& varname, VM::EpochVariableTypeID type, bool usesthreadpool)
 {
 	PadTabs();
@@ -520,6 +586,23 @@ void SerializationTraverser::WriteForkFuture(const void* opptr, const std::wstri
 	OutputStream << (usesthreadpool ? Serialization::True : Serialization::False) << L"\n";
 }
 
+void SerializationTraverser::WriteForkDependentFuture(const void* opptr, const std::wstring& token, const std::wstring& varname, VM::EpochVariableTypeID type, bool waitforany, const std::vector<std::wstring>& dependencies)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" ";
+	OutputStream << varname << L" " << type << L" ";
+	OutputStream << (waitforany ? Serialization::True : Serialization::False) << L" ";
+	OutputStream << dependencies.size() << L"\n";
+
+	++TabDepth;
+	for(std::vector<std::wstring>::const_iterator iter = dependencies.begin(); iter != dependencies.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << *iter << L"\n";
+	}
+	--TabDepth;
+}
+
 void SerializationTraverser::WriteSendMessage(const void* opptr, const std::wstring& token, bool usestaskid, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes)
 {
 	PadTabs();
@@ -536,6 +619,53 @@ void SerializationTraverser::WriteSendMessage(const void* opptr, const std::wstr
 	--TabDepth;
 }
 
+void SerializationTraverser::WriteDelayedSendMessage(const void* opptr, const std::wstring& token, bool usestaskid, bool periodic, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" ";
+	OutputStream << (usestaskid ? Serialization::True : Serialization::False) << L" ";
+	OutputStream << (periodic ? Serialization::True : Serialization::False) << L" ";
+	OutputStream << messagename << L" " << payloadtypes.size() << L"\n";
+
+	++TabDepth;
+	for(std::list<VM::EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << *iter << L"\n";
+	}
+	--TabDepth;
+}
+
+void SerializationTraverser::WriteBroadcastMessage(const void* opptr, const std::wstring& token, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" ";
+	OutputStream << messagename << L" " << payloadtypes.size() << L"\n";
+
+	++TabDepth;
+	for(std::list<VM::EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << *iter << L"\n";
+	}
+	--TabDepth;
+}
+
+void SerializationTraverser::WriteSendRequest(const void* opptr, const std::wstring& token, const std::wstring& futurename, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes)
+{
+	PadTabs();
+	OutputStream << opptr << L" " << token << L" ";
+	OutputStream << futurename << L" " << messagename << L" " << payloadtypes.size() << L"\n";
+
+	++TabDepth;
+	for(std::list<VM::EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << *iter << L"\n";
+	}
+	--TabDepth;
+}
+
 void SerializationTraverser::WriteAcceptMessage(const void* opptr, const std::wstring& token, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes)
 {
 	PadTabs();
@@ -556,6 +686,58 @@ void SerializationTraverser::WriteAcceptMessage(const void* opptr, const std::ws
 	--TabDepth;
 }
 
+//
+// Write a push operation; the nested operation follows on the same line
+//
+// Validated programs record the type being pushed, so that the loader
+// can hand it to the operation rather than the operation working it out
+// from the scope every time it executes.
+//
+void SerializationTraverser::WritePushOp(const VM::Operations::PushOperation& op)
+{
+	if(!CurrentProgram->IsValidated())
+	{
+		WriteOp(&op, PushOperation, false);
+		return;
+	}
+
+	PadTabs();
+	OutputStream << &op << L" " << TypedPushOperation << L" " << op.GetResolvedType(*CurrentScope) << L" ";
+	IgnoreTabPads = true;
+}
+
+void SerializationTraverser::WriteParallelFor(const VM::Operations::ParallelFor& op, const std::wstring& token)
+{
+	const std::vector<VM::Operations::ParallelFor::Reduction>& reductions = op.GetReductions();
+
+	PadTabs();
+	OutputStream << &op << L" " << token << L" " << op.GetAssociatedIdentifier() << L" " << reductions.size() << L"\n";
+
+	++TabDepth;
+	for(std::vector<VM::Operations::ParallelFor::Reduction>::const_iterator iter = reductions.begin(); iter != reductions.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << iter->Operator << L" " << iter->VariableName << L"\n";
+	}
+	--TabDepth;
+}
+
+void SerializationTraverser::WriteParallelInvoke(const VM::Operations::ParallelInvoke& op, const std::wstring& token)
+{
+	const VM::Operations::ParallelInvoke::BranchList& branches = op.GetBranches();
+
+	PadTabs();
+	OutputStream << &op << L" " << token << L" " << op.GetAssociatedIdentifier() << L" " << branches.size() << L"\n";
+
+	++TabDepth;
+	for(VM::Operations::ParallelInvoke::BranchList::const_iterator iter = branches.begin(); iter != branches.end(); ++iter)
+	{
+		PadTabs();
+		OutputStream << iter->size() << L"\n";
+	}
+	--TabDepth;
+}
+
 
 void SerializationTraverser::WriteConsArray(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID elementtype, size_t numelements)
 {
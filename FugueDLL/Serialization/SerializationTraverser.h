@@ -20,6 +20,8 @@ namespace VM
 	class TupleType;
 	class ResponseMap;
 	class ResponseMapEntry;
+
+	namespace Operations { class ParallelFor; class ParallelInvoke; class PushOperation; }
 }
 
 namespace Marshalling { class CallDLL; }
@@ -61,6 +63,7 @@ namespace Serialization
 	// Construction
 	public:
 		SerializationTraverser(const std::string& filename);
+		explicit SerializationTraverser(std::wostream& stream);
 
 	// Traversal interface
 	public:
@@ -103,8 +106,10 @@ namespace Serialization
 		void WriteOp(const void* opptr, const std::wstring& token, const void* secondptr);
 		void WriteOp(const void* opptr, const std::wstring& token, bool newline);
 		void WriteOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID type);
+		void WriteOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID type1, VM::EpochVariableTypeID type2);
 		void WriteOp(const std::wstring& token);
 		void WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param);
+		void WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param, VM::EpochVariableTypeID type);
 		void WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param1, const std::wstring& param2);
 		void WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param1, const std::wstring& param2, HandleType handle);
 		void WriteOp(const void* opptr, const std::wstring& token, const std::wstring& param1, const std::wstring& param2, VM::EpochVariableTypeID param3, VM::EpochVariableTypeID param4);
@@ -115,9 +120,18 @@ namespace Serialization
 		void WriteCastOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID originaltype, VM::EpochVariableTypeID destinationtype);
 		void WriteCastOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID originaltype);
 		void WriteArithmeticOp(const void* opptr, const std::wstring& token, bool isfirstarray, bool issecondarray, size_t numparams);
+		void WriteElementwiseArithmeticOp(const void* opptr, const std::wstring& token, unsigned optype, VM::EpochVariableTypeID elementtype, bool isfirstarray, bool issecondarray);
+		void WriteAtomicOp(const void* opptr, const std::wstring& token, const std::wstring& varname, unsigned optype);
 		void WriteForkFuture(const void* opptr, const std::wstring& token, const std::wstring& varname, VM::EpochVariableTypeID type, bool usesthreadpool);
+		void WriteForkDependentFuture(const void* opptr, const std::wstring& token, const std::wstring& varname, VM::EpochVariableTypeID type, bool waitforany, const std::vector<std::wstring>& dependencies);
 		void WriteSendMessage(const void* opptr, const std::wstring& token, bool usestaskid, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes);
+		void WriteDelayedSendMessage(const void* opptr, const std::wstring& token, bool usestaskid, bool periodic, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes);
+		void WriteBroadcastMessage(const void* opptr, const std::wstring& token, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes);
+		void WriteSendRequest(const void* opptr, const std::wstring& token, const std::wstring& futurename, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes);
 		void WriteAcceptMessage(const void* opptr, const std::wstring& token, const std::wstring& messagename, const std::list<VM::EpochVariableTypeID>& payloadtypes);
+		void WriteParallelFor(const VM::Operations::ParallelFor& op, const std::wstring& token);
+		void WriteParallelInvoke(const VM::Operations::ParallelInvoke& op, const std::wstring& token);
+		void WritePushOp(const VM::Operations::PushOperation& op);
 		void WriteConsArray(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID elementtype, size_t numelements);
 		void WriteCompoundOp(const void* opptr, const std::wstring& token, size_t numops);
 		void WriteCompoundOp(const void* opptr, const std::wstring& token, VM::EpochVariableTypeID type, size_t numops);
@@ -141,7 +155,9 @@ namespace Serialization
 
 	// Internal tracking
 	private:
-		std::wofstream OutputStream;
+		std::vector<wchar_t> StreamBuffer;
+		std::auto_ptr<std::wostream> OwnedStream;
+		std::wostream& OutputStream;
 
 		VM::Program* CurrentProgram;
 		VM::ScopeDescription* CurrentScope;
@@ -33,14 +33,34 @@ const wchar_t* Keywords::Member = L"member";
 
 const wchar_t* Keywords::ReadArray = L"readarray";
 const wchar_t* Keywords::WriteArray = L"writearray";
+const wchar_t* Keywords::AppendArray = L"appendarray";
+const wchar_t* Keywords::SortArray = L"sortarray";
+const wchar_t* Keywords::SearchArray = L"searcharray";
+const wchar_t* Keywords::MinIndex = L"minindex";
+const wchar_t* Keywords::MaxIndex = L"maxindex";
+
+const wchar_t* Keywords::MapInsert = L"mapinsert";
+const wchar_t* Keywords::MapLookup = L"maplookup";
+const wchar_t* Keywords::MapContains = L"mapcontains";
+const wchar_t* Keywords::MapErase = L"maperase";
+const wchar_t* Keywords::MapKeys = L"mapkeys";
 
 const wchar_t* Keywords::Add = L"add";
 const wchar_t* Keywords::Subtract = L"subtract";
 const wchar_t* Keywords::Multiply = L"multiply";
 const wchar_t* Keywords::Divide = L"divide";
 
+const wchar_t* Keywords::ArrayAdd = L"arrayadd";
+const wchar_t* Keywords::ArraySubtract = L"arraysubtract";
+const wchar_t* Keywords::ArrayMultiply = L"arraymultiply";
+const wchar_t* Keywords::ArrayDivide = L"arraydivide";
+
 const wchar_t* Keywords::Concat = L"concat";
 const wchar_t* Keywords::Length = L"length";
+const wchar_t* Keywords::Find = L"find";
+const wchar_t* Keywords::StartsWith = L"startswith";
+const wchar_t* Keywords::Compare = L"compare";
+const wchar_t* Keywords::Split = L"split";
 
 const wchar_t* Keywords::Equal = L"equal";
 const wchar_t* Keywords::NotEqual = L"notequal";
@@ -58,6 +78,7 @@ const wchar_t* Keywords::Reduce= L"reduce";
 const wchar_t* Keywords::Cast = L"cast";
 
 const wchar_t* Keywords::SizeOf = L"sizeof";
+const wchar_t* Keywords::Move = L"move";
 
 const wchar_t* Keywords::Or = L"or";
 const wchar_t* Keywords::And = L"and";
@@ -65,7 +86,13 @@ const wchar_t* Keywords::Xor = L"xor";
 const wchar_t* Keywords::Not = L"not";
 
 const wchar_t* Keywords::Message = L"message";
+const wchar_t* Keywords::Broadcast = L"broadcast";
+const wchar_t* Keywords::SendAfter = L"sendafter";
+const wchar_t* Keywords::SendEvery = L"sendevery";
+const wchar_t* Keywords::Request = L"request";
+const wchar_t* Keywords::Reply = L"reply";
 const wchar_t* Keywords::AcceptMessage = L"acceptmsg";
+const wchar_t* Keywords::AcceptMessageTimeout = L"acceptmsgtimeout";
 const wchar_t* Keywords::ResponseMap = L"responsemap";
 const wchar_t* Keywords::Caller = L"caller";
 const wchar_t* Keywords::Sender = L"sender";
@@ -80,6 +107,8 @@ const wchar_t* Keywords::Tuple = L"tuple";
 const wchar_t* Keywords::Structure = L"structure";
 const wchar_t* Keywords::Array = L"array";
 const wchar_t* Keywords::Buffer = L"buffer";
+const wchar_t* Keywords::HashMap = L"hashmap";
+const wchar_t* Keywords::MapArray = L"maparray";
 
 const wchar_t* Keywords::Reference = L"ref";
 const wchar_t* Keywords::Constant = L"constant";
@@ -95,8 +124,28 @@ const wchar_t* Keywords::Task = L"task";
 const wchar_t* Keywords::Thread = L"thread";
 const wchar_t* Keywords::ThreadPool = L"threadpool";
 const wchar_t* Keywords::Future = L"future";
+const wchar_t* Keywords::WhenAll = L"whenall";
+const wchar_t* Keywords::WhenAny = L"whenany";
+const wchar_t* Keywords::Channel = L"channel";
+const wchar_t* Keywords::ChannelSend = L"channelsend";
+const wchar_t* Keywords::ChannelReceive = L"channelreceive";
+const wchar_t* Keywords::Generator = L"generator";
+const wchar_t* Keywords::Yield = L"yield";
+const wchar_t* Keywords::HasNext = L"hasnext";
+const wchar_t* Keywords::NextValue = L"nextvalue";
+const wchar_t* Keywords::AtomicAdd = L"atomicadd";
+const wchar_t* Keywords::AtomicMin = L"atomicmin";
+const wchar_t* Keywords::AtomicMax = L"atomicmax";
+const wchar_t* Keywords::CompareExchange = L"compareexchange";
+const wchar_t* Keywords::Cancel = L"cancel";
+const wchar_t* Keywords::CancelPool = L"cancelpool";
 
 const wchar_t* Keywords::ParallelFor = L"parallelfor";
+const wchar_t* Keywords::ParallelInvoke = L"parallelinvoke";
+const wchar_t* Keywords::ReduceSum = L"sum";
+const wchar_t* Keywords::ReduceProduct = L"product";
+const wchar_t* Keywords::ReduceMin = L"min";
+const wchar_t* Keywords::ReduceMax = L"max";
 
 const wchar_t* Keywords::True = L"true";
 const wchar_t* Keywords::False = L"false";
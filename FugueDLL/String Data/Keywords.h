@@ -34,14 +34,34 @@ namespace Keywords
 	
 	extern const wchar_t* ReadArray;
 	extern const wchar_t* WriteArray;
+	extern const wchar_t* AppendArray;
+	extern const wchar_t* SortArray;
+	extern const wchar_t* SearchArray;
+	extern const wchar_t* MinIndex;
+	extern const wchar_t* MaxIndex;
+
+	extern const wchar_t* MapInsert;
+	extern const wchar_t* MapLookup;
+	extern const wchar_t* MapContains;
+	extern const wchar_t* MapErase;
+	extern const wchar_t* MapKeys;
 
 	extern const wchar_t* Add;
 	extern const wchar_t* Subtract;
 	extern const wchar_t* Multiply;
 	extern const wchar_t* Divide;
 
+	extern const wchar_t* ArrayAdd;
+	extern const wchar_t* ArraySubtract;
+	extern const wchar_t* ArrayMultiply;
+	extern const wchar_t* ArrayDivide;
+
 	extern const wchar_t* Concat;
 	extern const wchar_t* Length;
+	extern const wchar_t* Find;
+	extern const wchar_t* StartsWith;
+	extern const wchar_t* Compare;
+	extern const wchar_t* Split;
 
 	extern const wchar_t* Equal;
 	extern const wchar_t* NotEqual;
@@ -59,6 +79,7 @@ namespace Keywords
 	extern const wchar_t* Cast;
 
 	extern const wchar_t* SizeOf;
+	extern const wchar_t* Move;
 
 	extern const wchar_t* Or;
 	extern const wchar_t* And;
@@ -66,7 +87,13 @@ namespace Keywords
 	extern const wchar_t* Not;
 
 	extern const wchar_t* Message;
+	extern const wchar_t* Broadcast;
+	extern const wchar_t* SendAfter;
+	extern const wchar_t* SendEvery;
+	extern const wchar_t* Request;
+	extern const wchar_t* Reply;
 	extern const wchar_t* AcceptMessage;
+	extern const wchar_t* AcceptMessageTimeout;
 	extern const wchar_t* ResponseMap;
 	extern const wchar_t* Caller;
 	extern const wchar_t* Sender;
@@ -81,6 +108,8 @@ namespace Keywords
 	extern const wchar_t* Structure;
 	extern const wchar_t* Array;
 	extern const wchar_t* Buffer;
+	extern const wchar_t* HashMap;
+	extern const wchar_t* MapArray;
 
 	extern const wchar_t* Reference;
 	extern const wchar_t* Constant;
@@ -96,8 +125,28 @@ namespace Keywords
 	extern const wchar_t* Thread;
 	extern const wchar_t* ThreadPool;
 	extern const wchar_t* Future;
+	extern const wchar_t* WhenAll;
+	extern const wchar_t* WhenAny;
+	extern const wchar_t* Channel;
+	extern const wchar_t* ChannelSend;
+	extern const wchar_t* ChannelReceive;
+	extern const wchar_t* Generator;
+	extern const wchar_t* Yield;
+	extern const wchar_t* HasNext;
+	extern const wchar_t* NextValue;
+	extern const wchar_t* AtomicAdd;
+	extern const wchar_t* AtomicMin;
+	extern const wchar_t* AtomicMax;
+	extern const wchar_t* CompareExchange;
+	extern const wchar_t* Cancel;
+	extern const wchar_t* CancelPool;
 
 	extern const wchar_t* ParallelFor;
+	extern const wchar_t* ParallelInvoke;
+	extern const wchar_t* ReduceSum;
+	extern const wchar_t* ReduceProduct;
+	extern const wchar_t* ReduceMin;
+	extern const wchar_t* ReduceMax;
 
 	extern const wchar_t* True;
 	extern const wchar_t* False;
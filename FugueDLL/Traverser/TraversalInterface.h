@@ -105,9 +105,22 @@ namespace Traverser
 	};
 
 	
+	//
+	// Descriptor of a single member of a structure or tuple variable
+	//
+	struct CompositeMember
+	{
+		std::wstring Identifier;
+		VM::EpochVariableTypeID Type;
+	};
+
 	//
 	// Simple POD descriptor of a variable in a lexical scope
 	//
+	// Structure and tuple variables also list their members, in layout order.
+	// Members are addressed by traversal payloads and by the marshalling
+	// callbacks using qualified identifiers of the form "variable.member".
+	//
 	struct ScopeContents
 	{
 		ScopeContents()
@@ -122,6 +135,7 @@ namespace Traverser
 		VM::EpochVariableTypeID ContainedType;
 		size_t ContainedSize;
 		bool ContainedSizeKnown;
+		std::vector<CompositeMember> Members;
 	};
 
 }
@@ -7,10 +7,16 @@
 
 #include "pch.h"
 
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
 #include "Virtual Machine/Operations/Concurrency/FutureOps.h"
 #include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
 #include "Virtual Machine/Operations/Concurrency/Tasks.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
 #include "Virtual Machine/Operations/Containers/MapReduce.h"
 #include "Virtual Machine/Operations/Flow/FlowControl.h"
 #include "Virtual Machine/Operations/Flow/Invoke.h"
@@ -24,6 +30,7 @@
 #include "Virtual Machine/Operations/Variables/TupleOps.h"
 #include "Virtual Machine/Operations/Variables/VariableOps.h"
 #include "Virtual Machine/Operations/Debugging.h"
+#include "Virtual Machine/Operations/FusedOps.h"
 #include "Virtual Machine/Operations/StackOps.h"
 #include "Virtual Machine/Operations/UtilityOps.h"
 #include "Virtual Machine/Operations/Typedefs.h"
@@ -31,6 +38,8 @@
 #include "Marshalling/ExternalDLL.h"
 
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Program.h"
 
 #include "Virtual Machine/Types Management/RuntimeCasts.h"
@@ -91,6 +100,41 @@ void TaskSafetyWrapper::OpMustNotAccessGlobalState(ValidationTraverser& traverse
 }
 
 
+//
+// Determine if the given function could safely be run within a task
+//
+// The function is validated in isolation, exactly as if its body had
+// appeared inside a task block. Note that as with task validation in
+// general, the bodies of any functions it invokes are not examined.
+//
+bool Validator::IsTaskSafe(VM::Program& program, VM::Function& function)
+{
+	ValidationTraverser traverser;
+	traverser.SetProgram(program);
+
+	traverser.EnterTask();
+	static_cast<VM::SelfAwareBase&>(function).Traverse(traverser);
+	traverser.ExitTask();
+
+	return traverser.IsValid();
+}
+
+//
+// Determine if the given code block could safely be run within a task
+//
+bool Validator::IsTaskSafe(VM::Program& program, VM::Block& block)
+{
+	ValidationTraverser traverser;
+	traverser.SetProgram(program);
+
+	traverser.EnterTask();
+	block.Traverse(traverser);
+	traverser.ExitTask();
+
+	return traverser.IsValid();
+}
+
+
 #define VALIDATOR_TEMPLATE(operationname) \
 	template <> void Validator::TaskSafetyCheck<operationname>(const operationname& op, ValidationTraverser& traverser)
 
@@ -109,6 +153,7 @@ void TaskSafetyWrapper::OpMustNotAccessGlobalState(ValidationTraverser& traverse
 // Operations which are always valid
 VALIDATE_ALWAYS_VALID(VM::Operations::AcceptMessage)
 VALIDATE_ALWAYS_VALID(VM::Operations::AcceptMessageFromResponseMap)
+VALIDATE_ALWAYS_VALID(VM::Operations::AcceptMessageWithTimeout)
 VALIDATE_ALWAYS_VALID(VM::Operations::AssignStructureIndirect)
 VALIDATE_ALWAYS_VALID(VM::Operations::BitwiseAnd)
 VALIDATE_ALWAYS_VALID(VM::Operations::BitwiseNot)
@@ -116,10 +161,16 @@ VALIDATE_ALWAYS_VALID(VM::Operations::BitwiseOr)
 VALIDATE_ALWAYS_VALID(VM::Operations::BitwiseXor)
 VALIDATE_ALWAYS_VALID(VM::Operations::BooleanConstant)
 VALIDATE_ALWAYS_VALID(VM::Operations::Break)
+VALIDATE_ALWAYS_VALID(VM::Operations::BroadcastTaskMessage)
+VALIDATE_ALWAYS_VALID(VM::Operations::CompareStrings)
 VALIDATE_ALWAYS_VALID(VM::Operations::Concatenate)
 VALIDATE_ALWAYS_VALID(VM::Operations::ConsArray)
+VALIDATE_ALWAYS_VALID(VM::Operations::CreateChannel)
+VALIDATE_ALWAYS_VALID(VM::Operations::CreateGenerator)
 VALIDATE_ALWAYS_VALID(VM::Operations::CreateThreadPool)
+VALIDATE_ALWAYS_VALID(VM::Operations::CancelPoolWork)
 VALIDATE_ALWAYS_VALID(VM::Operations::DebugCrashVM)
+VALIDATE_ALWAYS_VALID(VM::Operations::DelayedSendTaskMessage)
 VALIDATE_ALWAYS_VALID(VM::Operations::DivideInteger16s)
 VALIDATE_ALWAYS_VALID(VM::Operations::DivideIntegers)
 VALIDATE_ALWAYS_VALID(VM::Operations::DivideReals)
@@ -128,9 +179,13 @@ VALIDATE_ALWAYS_VALID(VM::Operations::ElseIf)
 VALIDATE_ALWAYS_VALID(VM::Operations::ElseIfWrapper)
 VALIDATE_ALWAYS_VALID(VM::Operations::ExecuteBlock)
 VALIDATE_ALWAYS_VALID(VM::Operations::ExitIfChain)
+VALIDATE_ALWAYS_VALID(VM::Operations::FindSubstring)
 VALIDATE_ALWAYS_VALID(VM::Operations::ForkFuture)
+VALIDATE_ALWAYS_VALID(VM::Operations::ForkDependentFuture)
+VALIDATE_ALWAYS_VALID(VM::Operations::CancelFuture)
 VALIDATE_ALWAYS_VALID(VM::Operations::ForkTask)
 VALIDATE_ALWAYS_VALID(VM::Operations::ForkThread)
+VALIDATE_ALWAYS_VALID(VM::Operations::FusedOperation)
 VALIDATE_ALWAYS_VALID(VM::Operations::GetMessageSender)
 VALIDATE_ALWAYS_VALID(VM::Operations::GetTaskCaller)
 VALIDATE_ALWAYS_VALID(VM::Operations::If)
@@ -149,11 +204,14 @@ VALIDATE_ALWAYS_VALID(VM::Operations::LogicalNot)
 VALIDATE_ALWAYS_VALID(VM::Operations::LogicalOr)
 VALIDATE_ALWAYS_VALID(VM::Operations::LogicalXor)
 VALIDATE_ALWAYS_VALID(VM::Operations::MapOperation)
+VALIDATE_ALWAYS_VALID(VM::Operations::MapReduceOperation)
 VALIDATE_ALWAYS_VALID(VM::Operations::MultiplyInteger16s)
 VALIDATE_ALWAYS_VALID(VM::Operations::MultiplyIntegers)
 VALIDATE_ALWAYS_VALID(VM::Operations::MultiplyReals)
 VALIDATE_ALWAYS_VALID(VM::Operations::Negate)
+VALIDATE_ALWAYS_VALID(VM::Operations::ElementwiseArithmetic)
 VALIDATE_ALWAYS_VALID(VM::Operations::NoOp)
+VALIDATE_ALWAYS_VALID(VM::Operations::PendingReply)
 VALIDATE_ALWAYS_VALID(VM::Operations::PushBooleanLiteral)
 VALIDATE_ALWAYS_VALID(VM::Operations::PushInteger16Literal)
 VALIDATE_ALWAYS_VALID(VM::Operations::PushIntegerLiteral)
@@ -162,9 +220,21 @@ VALIDATE_ALWAYS_VALID(VM::Operations::PushRealLiteral)
 VALIDATE_ALWAYS_VALID(VM::Operations::PushStringLiteral)
 VALIDATE_ALWAYS_VALID(VM::Operations::RealConstant)
 VALIDATE_ALWAYS_VALID(VM::Operations::ReadStructureIndirect)
+VALIDATE_ALWAYS_VALID(VM::Operations::ReceiveChannel)
+VALIDATE_ALWAYS_VALID(VM::Operations::SplitString)
+VALIDATE_ALWAYS_VALID(VM::Operations::StartsWith)
+VALIDATE_ALWAYS_VALID(VM::Operations::YieldValue)
+VALIDATE_ALWAYS_VALID(VM::Operations::GeneratorHasNext)
+VALIDATE_ALWAYS_VALID(VM::Operations::GeneratorNextValue)
+VALIDATE_ALWAYS_VALID(VM::Operations::ConsHashMap)
+VALIDATE_ALWAYS_VALID(VM::Operations::AtomicUpdate)
+VALIDATE_ALWAYS_VALID(VM::Operations::AtomicUpdateArray)
 VALIDATE_ALWAYS_VALID(VM::Operations::ReduceOperation)
+VALIDATE_ALWAYS_VALID(VM::Operations::ReplyToRequest)
 VALIDATE_ALWAYS_VALID(VM::Operations::Return)
+VALIDATE_ALWAYS_VALID(VM::Operations::SendChannel)
 VALIDATE_ALWAYS_VALID(VM::Operations::SendTaskMessage)
+VALIDATE_ALWAYS_VALID(VM::Operations::SendTaskRequest)
 VALIDATE_ALWAYS_VALID(VM::Operations::SubtractInteger16s)
 VALIDATE_ALWAYS_VALID(VM::Operations::SubtractIntegers)
 VALIDATE_ALWAYS_VALID(VM::Operations::SubtractReals)
@@ -176,6 +246,7 @@ VALIDATE_ALWAYS_VALID(VM::Operations::TypeCastBufferToString)
 VALIDATE_ALWAYS_VALID(VM::Operations::WhileLoop)
 VALIDATE_ALWAYS_VALID(VM::Operations::WhileLoopConditional)
 VALIDATE_ALWAYS_VALID(VM::Operations::ConsArrayIndirect)
+VALIDATE_ALWAYS_VALID(VM::Operations::ConsMappedArray)
 
 VALIDATE_ALWAYS_VALID(VM::Operations::TypeCastStringToInteger)
 VALIDATE_ALWAYS_VALID(VM::Operations::TypeCastRealToInteger)
@@ -216,13 +287,26 @@ VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::BindStructMemberReference)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::GetVariableValue)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::InitializeValue)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::Length)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::MoveVariable)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ReadStructure)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ReadTuple)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::SizeOf)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ReadArray)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::WriteArray)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::AppendArray)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::SortArray)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::SearchArray)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ArrayMinIndex)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ArrayMaxIndex)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapInsert)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapLookup)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapContains)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapErase)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapKeys)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::HashMapSize)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ArrayLength)
 VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ParallelFor)
+VALIDATE_ONLY_CONST_GLOBALS(VM::Operations::ParallelInvoke)
 
 
 // Additional validation traversal logic
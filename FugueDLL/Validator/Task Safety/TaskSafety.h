@@ -9,7 +9,13 @@
 
 
 // Forward declarations
-namespace VM { class Operation; }
+namespace VM
+{
+	class Operation;
+	class Program;
+	class Function;
+	class Block;
+}
 
 
 namespace Validator
@@ -28,6 +34,15 @@ namespace Validator
 	void TaskSafetyCheck(const OperationClass& op, ValidationTraverser& traverser);
 
 
+	//
+	// Determine if the given function could safely be run within a
+	// task, i.e. concurrently with other code. This is used by the VM
+	// when deciding whether work can be spread across worker threads.
+	//
+	bool IsTaskSafe(VM::Program& program, VM::Function& function);
+	bool IsTaskSafe(VM::Program& program, VM::Block& block);
+
+
 	//
 	// This class provides a handy way to pass "friend" access over to
 	// the validation logic from the traverser code. All the functions
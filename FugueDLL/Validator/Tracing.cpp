@@ -1,31 +1,18 @@
 #include "pch.h"
 #include "Validator/Tracing.h"
-#include "User Interface/Output.h"
-#include "Configuration/RuntimeOptions.h"
+#include "User Interface/TraceLog.h"
 
 
 void Validator::TraceScopeEntry(const VM::ScopeDescription& scope)
 {
-#ifdef _DEBUG
-	if(Config::TraceValidatorExecution)
-	{
-		UI::OutputStream out;
-		out << UI::lightgreen << L"Validator trace: ";
-		out << UI::resetcolor << L"Begin processing scope " << (&scope) << std::endl;
-	}
-#endif
+	if(TraceLog::IsEnabled(TraceLog::Category_Validator))
+		TraceLog::Entry(L"Validator trace: ") << L"Begin processing scope " << (&scope);
 }
 
 
 void Validator::TraceScopeExit(const VM::ScopeDescription& scope)
 {
-#ifdef _DEBUG
-	if(Config::TraceValidatorExecution)
-	{
-		UI::OutputStream out;
-		out << UI::lightgreen << L"Validator trace: ";
-		out << UI::resetcolor << L"Finished processing scope " << (&scope) << std::endl;
-	}
-#endif
+	if(TraceLog::IsEnabled(TraceLog::Category_Validator))
+		TraceLog::Entry(L"Validator trace: ") << L"Finished processing scope " << (&scope);
 }
 
@@ -0,0 +1,84 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Cache of functions which are known to have passed validation
+//
+
+#include "pch.h"
+
+#include "Validator/ValidationCache.h"
+
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+
+using namespace Validator;
+
+
+namespace
+{
+
+	//
+	// Fingerprints recorded for a function when it last passed validation
+	//
+	struct CacheEntry
+	{
+		Hashing::Hash64 SourceFingerprint;
+		Hashing::Hash64 ContextFingerprint;
+	};
+
+	typedef std::map<std::wstring, CacheEntry> CacheMap;
+
+	Threads::CriticalSection CacheCritSec;
+	CacheMap ValidFunctions;
+
+}
+
+
+//
+// Compute a fingerprint of the parts of the global scope which affect validation
+//
+// Task safety checks depend on whether a variable is global, and if so
+// whether it is constant; the fingerprint therefore covers the name and
+// constness of each global variable.
+//
+Hashing::Hash64 ValidationCache::ComputeContextFingerprint(const VM::ScopeDescription& globalscope)
+{
+	std::wstring context;
+	const std::vector<std::wstring>& members = globalscope.GetMemberOrder();
+	for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
+	{
+		context += *iter;
+		context += globalscope.IsConstant(*iter) ? L'\x01' : L'\x02';
+	}
+
+	return Hashing::HashString64(Hashing::FNV64OffsetBasis, context);
+}
+
+//
+// Determine if the given function has already passed validation in its current form
+//
+bool ValidationCache::IsKnownValid(const std::wstring& functionname, Hashing::Hash64 sourcefingerprint, Hashing::Hash64 contextfingerprint)
+{
+	Threads::CriticalSection::Auto mutex(CacheCritSec);
+
+	CacheMap::const_iterator iter = ValidFunctions.find(functionname);
+	if(iter == ValidFunctions.end())
+		return false;
+
+	return (iter->second.SourceFingerprint == sourcefingerprint && iter->second.ContextFingerprint == contextfingerprint);
+}
+
+//
+// Remember that the given function passed validation
+//
+void ValidationCache::RecordValid(const std::wstring& functionname, Hashing::Hash64 sourcefingerprint, Hashing::Hash64 contextfingerprint)
+{
+	Threads::CriticalSection::Auto mutex(CacheCritSec);
+
+	CacheEntry& entry = ValidFunctions[functionname];
+	entry.SourceFingerprint = sourcefingerprint;
+	entry.ContextFingerprint = contextfingerprint;
+}
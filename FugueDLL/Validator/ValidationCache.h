@@ -0,0 +1,45 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Cache of functions which are known to have passed validation
+//
+// Each function parsed from source carries a fingerprint of its text.
+// Once a function validates without errors, its fingerprint is stored
+// here along with a fingerprint of the global scope it was checked
+// against. If the same function turns up again unchanged, in a program
+// whose globals are also unchanged, its body does not need to be walked
+// a second time.
+//
+// Note that validating a function never examines the bodies of the
+// functions it calls, so a change to a callee does not affect the
+// validity of its callers; only the function's own text and the global
+// variables it could access are relevant.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Hashing.h"
+
+
+// Forward declarations
+namespace VM
+{
+	class ScopeDescription;
+}
+
+
+namespace Validator
+{
+
+	namespace ValidationCache
+	{
+		Hashing::Hash64 ComputeContextFingerprint(const VM::ScopeDescription& globalscope);
+
+		bool IsKnownValid(const std::wstring& functionname, Hashing::Hash64 sourcefingerprint, Hashing::Hash64 contextfingerprint);
+		void RecordValid(const std::wstring& functionname, Hashing::Hash64 sourcefingerprint, Hashing::Hash64 contextfingerprint);
+	}
+
+}
@@ -12,15 +12,104 @@
 
 #include "Validator/Validator.h"
 #include "Validator/Tracing.h"
+#include "Validator/ValidationCache.h"
 
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 #include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/VMExceptions.h"
 
+#include "Utility/Threading/ThreadPool.h"
+#include "Utility/Threading/Synchronization.h"
+
+#include "User Interface/TraceLog.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace Validator;
 
 
+namespace
+{
+
+	//
+	// Shared tracking for validating the functions of a scope in parallel
+	//
+	// Each function is validated by its own traverser, so that workers do
+	// not share any state beyond the index of the next function to check.
+	// Keeping one traverser per function also lets the results be merged
+	// in the original order, so errors are reported exactly as they are
+	// by a sequential validation.
+	//
+	struct ParallelValidationJob
+	{
+		ParallelValidationJob(const std::vector<VM::SelfAwareBase*>& functions, unsigned numworkitems)
+			: Functions(functions),
+			  Fragments(functions.size()),
+			  NextFunction(0),
+			  PendingWorkItems(numworkitems),
+			  Failed(false)
+		{ }
+
+		void RecordFailure(const std::string& message)
+		{
+			Threads::CriticalSection::Auto mutex(FailureCritSec);
+			if(!Failed)
+			{
+				Failed = true;
+				FailureMessage = message;
+			}
+		}
+
+		const std::vector<VM::SelfAwareBase*>& Functions;
+		std::vector<ValidationTraverser> Fragments;
+
+		volatile LONG NextFunction;
+		Threads::CountdownLatch PendingWorkItems;
+
+		Threads::CriticalSection FailureCritSec;
+		bool Failed;
+		std::string FailureMessage;
+	};
+
+	//
+	// Work item which validates functions until none remain
+	//
+	class ParallelValidationWorkItem : public Threads::PoolWorkItem
+	{
+	public:
+		explicit ParallelValidationWorkItem(ParallelValidationJob& job)
+			: Job(job)
+		{ }
+
+		virtual void PerformWork()
+		{
+			try
+			{
+				size_t index;
+				while((index = static_cast<size_t>(::InterlockedIncrement(&Job.NextFunction) - 1)) < Job.Functions.size())
+					Job.Functions[index]->Traverse(Job.Fragments[index]);
+			}
+			catch(const std::exception& e)
+			{
+				Job.RecordFailure(e.what());
+			}
+			catch(...)
+			{
+				Job.RecordFailure("Unexpected error while validating a function");
+			}
+
+			Job.PendingWorkItems.CountDown();
+		}
+
+	private:
+		ParallelValidationJob& Job;
+	};
+
+}
+
+
 //
 // Construct and initialize a validation traverser
 //
@@ -28,7 +117,9 @@ ValidationTraverser::ValidationTraverser()
 	: Valid(true),
 	  TaskDepthCounter(0),
 	  CurrentProgram(NULL),
-	  CurrentScope(NULL)
+	  CurrentScope(NULL),
+	  ValidatingIncrementally(false),
+	  ContextFingerprint(0)
 {
 }
 
@@ -104,13 +195,41 @@ void ValidationTraverser::TraverseScope(VM::ScopeDescription& scope)
 		const VM::ScopeDescription& TheScope;
 	} helper(scope);
 
-	for(VM::ScopeDescription::FunctionMap::iterator iter = scope.Functions.begin(); iter != scope.Functions.end(); ++iter)
+	// Only the functions of the global scope are validated incrementally;
+	// nested functions are checked along with the body which contains them
+	bool outerincremental = ValidatingIncrementally;
+	Hashing::Hash64 outercontext = ContextFingerprint;
+
+	ValidatingIncrementally = (Config::IncrementalValidation && CurrentProgram && TaskDepthCounter == 0 && &scope == &CurrentProgram->GetGlobalScope());
+	if(ValidatingIncrementally)
+		ContextFingerprint = ValidationCache::ComputeContextFingerprint(scope);
+
+	std::vector<const std::wstring*> names;
+	std::vector<VM::SelfAwareBase*> functions;
+	CollectFunctionsToValidate(scope, names, functions);
+
+	if(ShouldValidateFunctionsInParallel(functions.size()))
+		TraverseFunctionsInParallel(scope, names, functions);
+	else
 	{
-		VM::SelfAwareBase* func = dynamic_cast<VM::SelfAwareBase*>(iter->second);
-		if(func)
-			func->Traverse(*this);
+		for(size_t i = 0; i < functions.size(); ++i)
+		{
+			bool wasvalid = Valid;
+			size_t numerrors = ErrorList.size();
+
+			Valid = true;
+			functions[i]->Traverse(*this);
+
+			if(Valid && ErrorList.size() == numerrors)
+				RecordValidFunction(*names[i], functions[i]);
+
+			Valid = (Valid && wasvalid);
+		}
 	}
 
+	ValidatingIncrementally = outerincremental;
+	ContextFingerprint = outercontext;
+
 	for(VM::ScopeDescription::ResponseMapList::const_iterator iter = scope.ResponseMaps.begin(); iter != scope.ResponseMaps.end(); ++iter)
 	{
 		VM::ResponseMap* themap = iter->second;
@@ -123,6 +242,126 @@ void ValidationTraverser::TraverseScope(VM::ScopeDescription& scope)
 }
 
 
+//
+// Gather the functions of a scope which must be validated
+//
+// When validating incrementally, functions which are known to have passed
+// validation in their current form are left out; see ValidationCache.h.
+//
+void ValidationTraverser::CollectFunctionsToValidate(VM::ScopeDescription& scope, std::vector<const std::wstring*>& names, std::vector<VM::SelfAwareBase*>& functions)
+{
+	for(VM::ScopeDescription::FunctionMap::iterator iter = scope.Functions.begin(); iter != scope.Functions.end(); ++iter)
+	{
+		VM::SelfAwareBase* func = dynamic_cast<VM::SelfAwareBase*>(iter->second);
+		if(!func)
+			continue;
+
+		if(ValidatingIncrementally)
+		{
+			const VM::Function* userfunc = dynamic_cast<const VM::Function*>(iter->second);
+			if(userfunc && userfunc->HasSourceFingerprint() && ValidationCache::IsKnownValid(iter->first, userfunc->GetSourceFingerprint(), ContextFingerprint))
+				continue;
+		}
+
+		names.push_back(&iter->first);
+		functions.push_back(func);
+	}
+}
+
+//
+// Remember that a function passed validation, so it can be skipped next time
+//
+void ValidationTraverser::RecordValidFunction(const std::wstring& name, VM::SelfAwareBase* function)
+{
+	if(!ValidatingIncrementally)
+		return;
+
+	const VM::Function* userfunc = dynamic_cast<const VM::Function*>(function);
+	if(userfunc && userfunc->HasSourceFingerprint())
+		ValidationCache::RecordValid(name, userfunc->GetSourceFingerprint(), ContextFingerprint);
+}
+
+
+//
+// Determine if the functions of a scope are numerous enough to validate in parallel
+//
+bool ValidationTraverser::ShouldValidateFunctionsInParallel(size_t numfunctions) const
+{
+	if(!Config::ParallelValidationThreshold || !CurrentProgram || TaskDepthCounter > 0)
+		return false;
+
+	// Trace output from several workers would not follow the order of the scopes
+	if(TraceLog::IsEnabled(TraceLog::Category_Validator))
+		return false;
+
+	return (numfunctions >= Config::ParallelValidationThreshold);
+}
+
+//
+// Validate each function of a scope on the shared worker pool
+//
+// Function bodies do not depend on each other for validation, so each
+// is checked by a separate traverser; the results are then merged back
+// into this traverser in the same order a sequential pass would visit
+// the functions.
+//
+void ValidationTraverser::TraverseFunctionsInParallel(VM::ScopeDescription& scope, const std::vector<const std::wstring*>& names, const std::vector<VM::SelfAwareBase*>& functions)
+{
+	if(functions.empty())
+		return;
+
+	Threads::ThreadPool& pool = CurrentProgram->GetSharedThreadPool();
+	unsigned numworkitems = std::min(pool.GetNumThreads(), static_cast<unsigned>(functions.size()));
+
+	ParallelValidationJob job(functions, numworkitems);
+	for(std::vector<ValidationTraverser>::iterator iter = job.Fragments.begin(); iter != job.Fragments.end(); ++iter)
+	{
+		iter->SetProgram(*CurrentProgram);
+		iter->CurrentScope = &scope;
+		iter->RecordTraversedScope(scope);
+	}
+
+	for(unsigned i = 0; i < numworkitems; ++i)
+		pool.AddWorkItem(new ParallelValidationWorkItem(job), Threads::WorkPriority_Batch);
+
+	// Help out with the validation while waiting for it to finish
+	while(!job.PendingWorkItems.IsReleased())
+	{
+		if(!pool.RunPendingWorkItem())
+			job.PendingWorkItems.Wait();
+	}
+
+	if(job.Failed)
+		throw VM::ExecutionException(job.FailureMessage);
+
+	for(size_t i = 0; i < job.Fragments.size(); ++i)
+	{
+		const ValidationTraverser& fragment = job.Fragments[i];
+		if(fragment.Valid && fragment.ErrorList.empty())
+			RecordValidFunction(*names[i], functions[i]);
+
+		MergeFragment(fragment);
+	}
+
+	CurrentScope = &scope;
+}
+
+//
+// Fold the results of a separately validated fragment into this traverser
+//
+void ValidationTraverser::MergeFragment(const ValidationTraverser& fragment)
+{
+	if(!fragment.Valid)
+		Valid = false;
+
+	ErrorList.insert(ErrorList.end(), fragment.ErrorList.begin(), fragment.ErrorList.end());
+
+	SeenBlocks.insert(fragment.SeenBlocks.begin(), fragment.SeenBlocks.end());
+	SeenScopes.insert(fragment.SeenScopes.begin(), fragment.SeenScopes.end());
+	SeenOps.insert(fragment.SeenOps.begin(), fragment.SeenOps.end());
+}
+
+
 //
 // Register that we have entered an asynchronous task block
 //
@@ -17,11 +17,13 @@ namespace VM
 	class Program;
 	class ScopeDescription;
 	class Block;
+	class SelfAwareBase;
 }
 
 
 // Dependencies
 #include "Validator/Task Safety/TaskSafety.h"
+#include "Utility/Hashing.h"
 
 
 namespace Validator
@@ -115,6 +117,13 @@ namespace Validator
 	private:
 		void TraverseScope(VM::ScopeDescription& scope);
 
+		void CollectFunctionsToValidate(VM::ScopeDescription& scope, std::vector<const std::wstring*>& names, std::vector<VM::SelfAwareBase*>& functions);
+		void RecordValidFunction(const std::wstring& name, VM::SelfAwareBase* function);
+
+		bool ShouldValidateFunctionsInParallel(size_t numfunctions) const;
+		void TraverseFunctionsInParallel(VM::ScopeDescription& scope, const std::vector<const std::wstring*>& names, const std::vector<VM::SelfAwareBase*>& functions);
+		void MergeFragment(const ValidationTraverser& fragment);
+
 	// Internal tracking
 	private:
 		bool Valid;
@@ -124,6 +133,9 @@ namespace Validator
 		VM::Program* CurrentProgram;
 		VM::ScopeDescription* CurrentScope;
 
+		bool ValidatingIncrementally;
+		Hashing::Hash64 ContextFingerprint;
+
 		std::list<ValidationError> ErrorList;
 
 		std::set<const VM::Block*> SeenBlocks;
@@ -8,13 +8,20 @@
 #include "pch.h"
 
 #include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/InstructionStream.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 #include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Concurrency/CancellationToken.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
+#include "Virtual Machine/VMExceptions.h"
 
 #include "Virtual Machine/Operations/Flow/Invoke.h"
 #include "Virtual Machine/Operations/StackOps.h"
 
+#include "Utility/Threading/Lockless.h"
+
 
 using namespace VM;
 
@@ -27,8 +34,12 @@ Block::~Block()
 	for(std::vector<Operation*>::iterator iter = Operations.begin(); iter != Operations.end(); ++iter)
 		delete *iter;
 
+	DiscardCachedScope();
+
 	if(DeleteScopes)
 		delete BoundScope;
+
+	delete Instructions;
 }
 
 
@@ -39,8 +50,14 @@ Block::~Block()
 // when appropriate. This is done to allow functions and control structures
 // to retrieve a conditional value from the stack prior to cleanup.
 //
+// Entering a block is the point at which cancelled work stops; see
+// CancellationToken.h for details.
+//
 void Block::ExecuteBlock(ExecutionContext& context, HeapStorage* heapstorage, bool enterscopes, unsigned skipinstructions)
 {
+	if(context.Cancellation && context.Cancellation->IsCancelled())
+		throw TaskCancelledException();
+
 	if(enterscopes)
 	{
 		if(heapstorage)
@@ -49,19 +66,91 @@ void Block::ExecuteBlock(ExecutionContext& context, HeapStorage* heapstorage, bo
 			context.Scope.Enter(context.Stack);
 	}
 
-	std::vector<Operation*>::iterator iter = Operations.begin();
-	std::advance(iter, skipinstructions);
-	while(iter != Operations.end())
+	if(Instructions)
+		Instructions->Execute(context, skipinstructions);
+	else
 	{
+		// Each operation reports its flow control result through the same
+		// context. Execution stops as soon as any operation reports a result
+		// other than normal flow, so the result never needs to be reset.
 		FlowControlResult bodyflowresult = FLOWCONTROL_NORMAL;
-		(*iter)->ExecuteFast(ExecutionContext(context.RunningProgram, context.Scope, context.Stack, bodyflowresult));
-		if(bodyflowresult != FLOWCONTROL_NORMAL)
+		ExecutionContext bodycontext(context, bodyflowresult);
+		Profiler::OperationTracker profiling(context.Profile);
+
+		std::vector<Operation*>::iterator iter = Operations.begin();
+		std::advance(iter, skipinstructions);
+		while(iter != Operations.end())
 		{
-			context.FlowResult = bodyflowresult;
-			break;
+			profiling.SetOperation(*iter);
+			if(Instrumentation::IsActive())
+				Instrumentation::ExecuteOperation(**iter, bodycontext);
+			else
+				(*iter)->ExecuteFast(bodycontext);
+			if(bodyflowresult != FLOWCONTROL_NORMAL)
+			{
+				context.FlowResult = bodyflowresult;
+				break;
+			}
+			++iter;
 		}
-		++iter;
 	}
+
+	// The end of a block is a safe point for garbage collection; the
+	// block's own variables are still on the stack (or in the heap
+	// storage) at this point, so they are treated as roots.
+	if(GarbageCollector::IsCollectionDue())
+		GarbageCollector::CollectAtSafePoint(context.Stack);
+}
+
+//
+// Execute the block as the body of a control structure
+//
+// The block's scope is entered as a child of the current scope, and
+// released again once the block has finished.
+//
+void Block::ExecuteNestedBlock(ExecutionContext& context)
+{
+	ScopeLease lease(*this, context.Scope);
+	ExecuteBlock(ExecutionContext(context, lease.GetScope()), NULL);
+	lease.GetScope().Exit(context.Stack);
+}
+
+
+//
+// Take the block's kept activated scope for the duration of an entry
+//
+// If the scope is already in use (by another thread, or by a recursive
+// function call further up the call stack) a fresh scope is built instead.
+// When the entry is over the scope is handed back, unless another one was
+// handed back in the meantime, in which case the extra scope is simply
+// released.
+//
+Block::ScopeLease::ScopeLease(Block& block, ActivatedScope& parent)
+	: TheBlock(block)
+{
+	TheScope = reinterpret_cast<ActivatedScope*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&block.CachedScope), NULL));
+	if(TheScope)
+		TheScope->ParentScope = &parent;
+	else
+		TheScope = new ActivatedScope(*block.BoundScope, &parent);
+}
+
+Block::ScopeLease::~ScopeLease()
+{
+	if(!Atomic::CompareAndSwapPointer(&TheBlock.CachedScope, static_cast<ActivatedScope*>(NULL), TheScope))
+		delete TheScope;
+}
+
+//
+// Release the activated scope kept for entries into the block, if any
+//
+// This must be done whenever the block is bound to a different scope,
+// since the kept activation refers to the old scope's layout.
+//
+void Block::DiscardCachedScope()
+{
+	delete CachedScope;
+	CachedScope = NULL;
 }
 
 
@@ -70,6 +159,7 @@ void Block::ExecuteBlock(ExecutionContext& context, HeapStorage* heapstorage, bo
 //
 void Block::AddOperation(OperationPtr op)
 {
+	DiscardInstructionStream();
 	Operations.push_back(op.release());
 }
 
@@ -79,6 +169,7 @@ void Block::AddOperation(OperationPtr op)
 //
 void Block::InsertHeadOperation(OperationPtr op)
 {
+	DiscardInstructionStream();
 	Operations.insert(Operations.begin(), op.release());
 }
 
@@ -93,6 +184,7 @@ void Block::InsertHeadOperation(OperationPtr op)
 //
 void Block::RemoveTailOperations(size_t numops)
 {
+	DiscardInstructionStream();
 	for(size_t i = 0; i < numops; ++i)
 	{
 		delete Operations.back();
@@ -105,6 +197,7 @@ void Block::RemoveTailOperations(size_t numops)
 //
 void Block::RemoveOperationFromEnd(size_t numops, const VM::ScopeDescription& scope)
 {
+	DiscardInstructionStream();
 	if(numops > Operations.size())
 		throw InternalFailureException("Cannot remove operation from code block - not that many operations are there");
 
@@ -122,42 +215,29 @@ void Block::RemoveOperationFromEnd(size_t numops, const VM::ScopeDescription& sc
 //
 void Block::ShiftUpTailOperation(size_t offset)
 {
+	DiscardInstructionStream();
 	if(!offset)
 		return;
 
 	if(Operations.size() <= offset)
 		throw InternalFailureException("Cannot shift up tail operation - not enough operations exist");
 
-	// TODO - check this and other nearby functions for exception safety
-	Operation* op = *Operations.rbegin();
-
-	for(size_t i = Operations.size() - 1; i >= Operations.size() - offset; --i)
-		Operations[i] = Operations[i - 1];
-
-	Operations[Operations.size() - offset - 1] = op;
+	std::rotate(Operations.end() - offset - 1, Operations.end() - 1, Operations.end());
 }
 
 void Block::ShiftUpTailOperationGroup(size_t offset, const VM::ScopeDescription& scope)
 {
+	DiscardInstructionStream();
 	if(!offset)
 		return;
 
-	if(Operations.size() <= offset)
-		throw InternalFailureException("Cannot shift up tail operation - not enough operations exist");
-
 	size_t numopsingroup = Operations.size() - CountTailOps(1, scope);
+	if(Operations.size() < offset + numopsingroup)
+		throw InternalFailureException("Cannot shift up tail operation - not enough operations exist");
 
-	std::reverse(Operations.rbegin(), Operations.rbegin() + numopsingroup);
-
-	for(size_t groupindex = 0; groupindex < numopsingroup; ++groupindex)
-	{
-		Operation* op = *Operations.rbegin();
-
-		for(size_t i = Operations.size() - 1; i >= Operations.size() - offset - numopsingroup + groupindex; --i)
-			Operations[i] = Operations[i - 1];
-
-		Operations[Operations.size() - offset - numopsingroup + groupindex] = op;
-	}
+	// Moving the whole group at once keeps this linear in the number of
+	// operations involved, rather than shifting one operation at a time
+	std::rotate(Operations.end() - numopsingroup - offset, Operations.end() - numopsingroup, Operations.end());
 }
 
 
@@ -179,6 +259,7 @@ Operation* Block::GetOperationFromEnd(size_t numops, const VM::ScopeDescription&
 //
 void Block::ReplaceOperationFromEnd(size_t numops, OperationPtr op, const VM::ScopeDescription& scope)
 {
+	DiscardInstructionStream();
 	if(numops > Operations.size())
 		throw InternalFailureException("Cannot replace operation in block - not that many oeprations are there");
 
@@ -188,6 +269,22 @@ void Block::ReplaceOperationFromEnd(size_t numops, OperationPtr op, const VM::Sc
 	Operations[index] = op.release();
 }
 
+//
+// Replace the operation at the given index with a new operation
+//
+// Indices may be obtained from IndexTailOps(); this avoids rescanning
+// the block when several operations near the end need to be replaced.
+//
+void Block::ReplaceOperation(size_t index, OperationPtr op)
+{
+	DiscardInstructionStream();
+	if(index >= Operations.size())
+		throw InternalFailureException("Cannot replace operation in block - index out of range");
+
+	delete Operations[index];
+	Operations[index] = op.release();
+}
+
 //
 // Reverse the n last operations in the block
 //
@@ -198,6 +295,7 @@ void Block::ReplaceOperationFromEnd(size_t numops, OperationPtr op, const VM::Sc
 //
 void Block::ReverseTailOperations(size_t numops, const ScopeDescription& scope)
 {
+	DiscardInstructionStream();
 	if(numops > Operations.size())
 		throw InternalFailureException("Cannot reverse operations in block - not that many operations are there");
 
@@ -257,6 +355,7 @@ void Block::ReverseTailOperations(size_t numops, const ScopeDescription& scope)
 //
 void Block::EraseOperation(Operation* op)
 {
+	DiscardInstructionStream();
 	for(std::vector<Operation*>::iterator iter = Operations.begin(); iter != Operations.end(); )
 	{
 		if(*iter == op)
@@ -306,3 +405,61 @@ size_t Block::CountTailOps(size_t numops, const ScopeDescription& scope) const
 
 	return i;
 }
+
+//
+// Locate the first instruction of each of the given number of
+// trailing operations, treating function calls as a unit as per
+// CountTailOps(). On return, indices[n] holds the same value as
+// CountTailOps(n + 1) would; computing all of them in a single pass
+// avoids rescanning the tail of the block once per operation.
+//
+void Block::IndexTailOps(size_t numops, const ScopeDescription& scope, std::vector<size_t>& indices) const
+{
+	indices.clear();
+	indices.reserve(numops);
+
+	size_t i = Operations.size();
+	while(indices.size() < numops)
+	{
+		if(i == 0)
+			throw Exception("Not enough operations! Something is borked in the parser.");
+
+		--i;
+
+		size_t delta = Operations[i]->GetNumParameters(scope);
+		while(delta > 0)
+		{
+			delta += Operations[--i]->GetNumParameters(scope);
+			--delta;
+		}
+
+		indices.push_back(i);
+	}
+}
+
+
+//
+// Lower the block's operations into a linear instruction stream,
+// which will be used in place of the operation list for execution
+//
+// The stream refers to the block's operations and their resolved
+// variable slots, so any later changes to the operation list will
+// discard the stream and revert to executing the operations directly.
+//
+void Block::GenerateInstructionStream()
+{
+	DiscardInstructionStream();
+
+	if(BoundScope)
+		Instructions = new InstructionStream(Operations, *BoundScope);
+}
+
+//
+// Release the block's instruction stream, if any
+//
+void Block::DiscardInstructionStream()
+{
+	delete Instructions;
+	Instructions = NULL;
+}
+
@@ -21,6 +21,7 @@ namespace VM
 	// Forward declarations
 	class ScopeDescription;
 	class ActivatedScope;
+	class InstructionStream;
 
 	//
 	// Block of sequentially executed operations
@@ -31,11 +32,20 @@ namespace VM
 	public:
 		Block(bool deletescopes = true)
 			: DeleteScopes(deletescopes),
-			  BoundScope(NULL)
+			  BoundScope(NULL),
+			  Instructions(NULL),
+			  CachedScope(NULL)
 		{ }
 
 		virtual ~Block();
 
+	// Memory management
+	public:
+		// Blocks live in the code arena of their program; see RuntimeContext
+		static void* operator new(size_t size);
+		static void operator delete(void* ptr)
+		{ }
+
 	// Execution interface
 	public:
 		virtual void ExecuteBlock(ExecutionContext& context, HeapStorage* heapstorage, bool enterscopes = true, unsigned skipinstructions = 0);
@@ -53,6 +63,7 @@ namespace VM
 
 		OperationPtr PopTailOperation()
 		{
+			DiscardInstructionStream();
 			OperationPtr ret(Operations.back());
 			Operations.pop_back();
 			return ret;
@@ -63,6 +74,11 @@ namespace VM
 
 		Operation* GetOperationFromEnd(size_t numopsfromend, const ScopeDescription& scope);
 
+		Operation* GetOperation(size_t index)
+		{ return Operations[index]; }
+
+		void ReplaceOperation(size_t index, OperationPtr op);
+
 		size_t GetNumOperations() const
 		{ return Operations.size(); }
 
@@ -72,12 +88,20 @@ namespace VM
 		{ return Operations; }
 
 		std::vector<Operation*>& GetAllOperations()
-		{ return Operations; }
+		{ DiscardInstructionStream(); return Operations; }
+
+	// Linear instruction stream interface
+	public:
+		void GenerateInstructionStream();
+		void DiscardInstructionStream();
+
+		bool HasInstructionStream() const
+		{ return (Instructions != NULL); }
 
 	// Lexical scoping interface
 	public:
 		void BindToScope(ScopeDescription* scope)
-		{ BoundScope = scope; }
+		{ DiscardCachedScope(); BoundScope = scope; }
 
 		const ScopeDescription* GetBoundScope() const
 		{ return BoundScope; }
@@ -88,6 +112,29 @@ namespace VM
 		void DoNotDeleteScope()
 		{ DeleteScopes = false; }
 
+	// Activation of nested blocks
+	//
+	// Control structures activate the scope of their body block each time
+	// the body is entered. Rather than building a fresh activated scope
+	// each time, the block keeps one around between entries, which is then
+	// only rebound to the stack (and to its current parent scope).
+	public:
+		class ScopeLease
+		{
+		public:
+			ScopeLease(Block& block, ActivatedScope& parent);
+			~ScopeLease();
+
+			ActivatedScope& GetScope()
+			{ return *TheScope; }
+
+		private:
+			Block& TheBlock;
+			ActivatedScope* TheScope;
+		};
+
+		void ExecuteNestedBlock(ExecutionContext& context);
+
 	// Traversal interface
 	public:
 		template <class TraverserT>
@@ -104,11 +151,7 @@ namespace VM
 					if(BoundScope)
 						traverser.SetCurrentScope(BoundScope);
 
-					SelfAwareBase* op = dynamic_cast<SelfAwareBase*>(*iter);
-					if(op)
-						op->Traverse(traverser);
-					else
-						throw NotImplementedException("An operation class is not derived from SelfAware");
+					(*iter)->Traverse(traverser);
 				}
 				traverser.ExitBlock(*this);
 			}
@@ -128,12 +171,17 @@ namespace VM
 	// Additional helpers
 	public:
 		size_t CountTailOps(size_t numops, const ScopeDescription& scope) const;
+		void IndexTailOps(size_t numops, const ScopeDescription& scope, std::vector<size_t>& indices) const;
 
 	// Internal storage
 	private:
 		std::vector<Operation*> Operations;
 		ScopeDescription* BoundScope;
 		bool DeleteScopes;
+		InstructionStream* Instructions;
+		ActivatedScope* volatile CachedScope;
+
+		void DiscardCachedScope();
 	};
 }
 
@@ -0,0 +1,69 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Tokens for cooperatively cancelling asynchronous work
+//
+// Work which can be cancelled (the computation of a future, or the chunks
+// of a parallel for loop) runs with a token in its execution context.
+// Cancelling a token does not interrupt anything by itself; instead, the
+// token is checked each time a block of code is entered, and work which
+// finds its token cancelled unwinds by throwing TaskCancelledException.
+// The code which started the work catches the exception and releases
+// the work's stack and scopes straight away.
+//
+// A token may be chained to the token of the code which started it, so
+// that cancelling a future also stops any parallel loops run by the code
+// computing that future.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	class CancellationToken
+	{
+	// Construction
+	public:
+		CancellationToken()
+			: Cancelled(0),
+			  Parent(NULL)
+		{ }
+
+	// Cancellation interface
+	public:
+		void Cancel()
+		{ ::InterlockedExchange(&Cancelled, 1); }
+
+		bool IsCancelled() const
+		{
+			for(const CancellationToken* token = this; token; token = token->Parent)
+			{
+				if(token->Cancelled)
+					return true;
+			}
+
+			return false;
+		}
+
+		//
+		// Prepare the token for a new piece of work
+		//
+		// Must not be called while any work is still checking the token.
+		//
+		void Reset(const CancellationToken* parent)
+		{
+			Parent = parent;
+			::InterlockedExchange(&Cancelled, 0);
+		}
+
+	// Internal tracking
+	private:
+		volatile LONG Cancelled;
+		const CancellationToken* Parent;
+	};
+
+}
+
@@ -0,0 +1,190 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Typed single-producer/single-consumer channels between tasks
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/Channel.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Threading/Lockless.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+	// Largest number of slots a single channel may have
+	const Integer32 MaxChannelCapacity = 1 << 24;
+
+	// Number of times a waiting thread checks the channel before yielding
+	const unsigned SpinCount = 256;
+
+
+	//
+	// Wait for the other side of a channel to make progress
+	//
+	void WaitForChannel(unsigned& attempts)
+	{
+		if(++attempts < SpinCount)
+			YieldProcessor();
+		else
+			::SwitchToThread();
+	}
+}
+
+
+//
+// Construct a channel with room for at least the given number of values
+//
+// The capacity is rounded up to a power of two, so that ring positions can
+// be wrapped with a mask.
+//
+Channel::Channel(EpochVariableTypeID elementtype, size_t capacity)
+	: ElementType(elementtype),
+	  SlotSize(TypeInfo::GetStorageSize(elementtype)),
+	  Tail(0),
+	  CachedHead(0),
+	  Producer(0),
+	  Head(0),
+	  CachedTail(0),
+	  Consumer(0)
+{
+	size_t numslots = 1;
+	while(numslots < capacity)
+		numslots <<= 1;
+
+	Mask = static_cast<LONG>(numslots - 1);
+	Slots = new Byte[numslots * SlotSize];
+}
+
+//
+// Clean up the channel's storage; any values still in transit are lost
+//
+Channel::~Channel()
+{
+	delete [] Slots;
+}
+
+
+//
+// Copy a value into the channel, waiting for room if the channel is full
+//
+void Channel::Send(const void* value)
+{
+	ClaimEndpoint(Producer);
+
+	LONG tail = Tail;
+	if(tail - CachedHead > Mask)
+	{
+		unsigned attempts = 0;
+		while(tail - (CachedHead = Atomic::LoadAcquire(&Head)) > Mask)
+			WaitForChannel(attempts);
+	}
+
+	memcpy(Slots + (tail & Mask) * SlotSize, value, SlotSize);
+	Atomic::StoreRelease(&Tail, tail + 1);
+}
+
+//
+// Copy a value out of the channel, waiting for one to arrive if the channel is empty
+//
+void Channel::Receive(void* value)
+{
+	ClaimEndpoint(Consumer);
+
+	LONG head = Head;
+	if(head == CachedTail)
+	{
+		unsigned attempts = 0;
+		while(head == (CachedTail = Atomic::LoadAcquire(&Tail)))
+			WaitForChannel(attempts);
+	}
+
+	memcpy(value, Slots + (head & Mask) * SlotSize, SlotSize);
+	Atomic::StoreRelease(&Head, head + 1);
+}
+
+
+//
+// Ensure that only one thread ever uses a given end of a channel
+//
+// The first thread to use the end claims it; after that, checking the
+// claim is a plain read.
+//
+void Channel::ClaimEndpoint(volatile LONG& owner)
+{
+	LONG threadid = static_cast<LONG>(::GetCurrentThreadId());
+	if(owner == threadid)
+		return;
+
+	if(Atomic::CompareExchange(&owner, 0, threadid) != 0)
+		throw ExecutionException("Channels may only be used by one sending and one receiving thread");
+}
+
+
+
+//
+// Construct an empty channel table
+//
+ChannelTable::ChannelTable()
+	: NumChannels(0)
+{
+	for(LONG i = 0; i < MaxChannels; ++i)
+		Channels[i] = NULL;
+}
+
+//
+// Destroy all channels created by the program
+//
+ChannelTable::~ChannelTable()
+{
+	for(LONG i = 0; i < MaxChannels; ++i)
+		delete Channels[i];
+}
+
+
+//
+// Create a new channel and return its handle
+//
+// Handles start at 1, so that a zero-initialized handle never refers to
+// a channel.
+//
+Integer32 ChannelTable::CreateChannel(EpochVariableTypeID elementtype, Integer32 capacity)
+{
+	if(capacity <= 0 || capacity > MaxChannelCapacity)
+		throw ExecutionException("Invalid channel capacity");
+
+	std::auto_ptr<Channel> channel(new Channel(elementtype, static_cast<size_t>(capacity)));
+
+	LONG index = ::InterlockedIncrement(&NumChannels) - 1;
+	if(index >= MaxChannels)
+	{
+		::InterlockedDecrement(&NumChannels);
+		throw ExecutionException("Too many channels have been created");
+	}
+
+	Atomic::StoreRelease(&Channels[index], channel.release());
+	return static_cast<Integer32>(index + 1);
+}
+
+//
+// Look up the channel with the given handle
+//
+Channel& ChannelTable::GetChannel(Integer32 handle) const
+{
+	Channel* channel = NULL;
+	if(handle > 0 && handle <= MaxChannels)
+		channel = Atomic::LoadAcquire(&Channels[handle - 1]);
+
+	if(!channel)
+		throw ExecutionException("Invalid channel handle");
+
+	return *channel;
+}
+
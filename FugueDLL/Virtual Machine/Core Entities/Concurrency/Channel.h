@@ -0,0 +1,124 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Typed single-producer/single-consumer channels between tasks
+//
+// A channel is a bounded ring buffer of fixed-size slots, each holding a
+// single value of the channel's element type. Values are copied straight
+// from the sender's stack into a slot, and from the slot onto the
+// receiver's stack, so sending neither allocates memory nor touches any
+// shared structure other than the two ring indices.
+//
+// Exactly one thread may send on a channel, and exactly one thread may
+// receive from it; the first thread to use each end claims it for good,
+// and any other thread which tries to use the same end is rejected. This
+// is what allows the ring to get by without any locking: the producer is
+// the only writer of the tail index, and the consumer the only writer of
+// the head index. Each side keeps a private copy of the other's index,
+// so that it only needs to look at the shared one when the ring appears
+// to be full (or empty).
+//
+// Sending on a full channel, or receiving from an empty one, waits for the
+// other side to catch up; the waiting thread spins briefly, then yields
+// its time slice until the channel is ready.
+//
+// Channels are identified by integer handles, which are only meaningful
+// within the program that created them; see ChannelTable.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Types/EpochTypeIDs.h"
+
+
+namespace VM
+{
+
+	class Channel
+	{
+	// Construction and destruction
+	public:
+		Channel(EpochVariableTypeID elementtype, size_t capacity);
+		~Channel();
+
+	// Transfer interface
+	public:
+		void Send(const void* value);
+		void Receive(void* value);
+
+	// Additional queries
+	public:
+		EpochVariableTypeID GetElementType() const
+		{ return ElementType; }
+
+		size_t GetSlotSize() const
+		{ return SlotSize; }
+
+	// Internal helpers
+	private:
+		static void ClaimEndpoint(volatile LONG& owner);
+
+	// Fixed properties, shared by both sides
+	private:
+		EpochVariableTypeID ElementType;
+		size_t SlotSize;
+		LONG Mask;
+		Byte* Slots;
+
+	// Producer side; kept on a cache line of its own
+	private:
+		__declspec(align(64)) volatile LONG Tail;
+		LONG CachedHead;
+		volatile LONG Producer;
+
+	// Consumer side; kept on a cache line of its own
+	private:
+		__declspec(align(64)) volatile LONG Head;
+		LONG CachedTail;
+		volatile LONG Consumer;
+
+	// Non-copyable
+	private:
+		Channel(const Channel&);
+		Channel& operator = (const Channel&);
+	};
+
+
+	//
+	// Table of the channels created by a program
+	//
+	// Handles simply index the table, so looking up a channel on each
+	// send or receive is a bounds check and a load. Channels live until
+	// the table itself is destroyed, along with the rest of the program's
+	// runtime context.
+	//
+	class ChannelTable
+	{
+	// Construction and destruction
+	public:
+		ChannelTable();
+		~ChannelTable();
+
+	// Channel management
+	public:
+		Integer32 CreateChannel(EpochVariableTypeID elementtype, Integer32 capacity);
+		Channel& GetChannel(Integer32 handle) const;
+
+	// Internal tracking
+	private:
+		static const LONG MaxChannels = 1024;
+
+		Channel* volatile Channels[MaxChannels];
+		volatile LONG NumChannels;
+
+	// Non-copyable
+	private:
+		ChannelTable(const ChannelTable&);
+		ChannelTable& operator = (const ChannelTable&);
+	};
+
+}
+
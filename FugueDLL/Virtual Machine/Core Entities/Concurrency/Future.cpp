@@ -9,32 +9,52 @@
 
 #include "Virtual Machine/Core Entities/Concurrency/Future.h"
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/VMExceptions.h"
 
 #include "Utility/Memory/Stack.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Tracing.h"
 
 
 using namespace VM;
 
 
+//
+// Marker which replaces the list of pending continuations once a
+// future has completed; it is never dereferenced as a real entry
+//
+Future::ContinuationNode Future::CompletedSentinel = { NULL, NULL };
+
+
 //
 // Construct and initialize a future wrapper
 //
 Future::Future(VM::OperationPtr op)
 	: Op(op),
-	  Result(NULL)
+	  Result(NULL),
+	  Completion(1),
+	  Continuations(NULL)
 {
-	std::wostringstream id;
-	id << L"Epoch Future " << this;
-
-	CompletionEventHandle = ::CreateEvent(NULL, FALSE, FALSE, id.str().c_str());
 }
 
 //
 // Destruct and clean up a future wrapper
 //
+// Continuations still pending on a future which never completed are
+// discarded along with their list entries; they are never invoked.
+//
 Future::~Future()
 {
-	::CloseHandle(CompletionEventHandle);
+	ContinuationNode* node = Continuations;
+	if(node == &CompletedSentinel)
+		return;
+
+	while(node)
+	{
+		ContinuationNode* next = node->Next;
+		delete node;
+		node = next;
+	}
 }
 
 
@@ -43,8 +63,38 @@ Future::~Future()
 //
 RValuePtr Future::GetValue() const
 {
-	::WaitForSingleObject(CompletionEventHandle, INFINITE);
-	return RValuePtr(Result->Clone());
+	return RValuePtr(ReadValue().Clone());
+}
+
+//
+// Access a future's value in place, blocking on the completion of the calculation if necessary
+//
+// This avoids copying the result for callers which only need to read
+// it; the reference remains valid for as long as the future exists.
+//
+const RValue& Future::ReadValue() const
+{
+	WaitForCompletion();
+	if(!Result.get())
+		throw ExecutionException("Cannot read the value of a future whose computation was cancelled");
+
+	return *Result;
+}
+
+//
+// Block until the future's value has been computed
+//
+// Only waits which actually block are timed (and traced), so that the
+// telemetry reflects time lost to futures which were read too early.
+//
+void Future::WaitForCompletion() const
+{
+	if(Completion.IsReleased())
+		return;
+
+	Threads::Telemetry::WaitTimer timer(Threads::Telemetry::Wait_Future);
+	Threads::Tracing::Span span("Future wait");
+	Completion.Wait();
 }
 
 //
@@ -62,5 +112,67 @@ EpochVariableTypeID Future::GetType(const ScopeDescription& scope) const
 void Future::SetResult(RValuePtr value)
 {
 	Result.reset(value.release());
-	::SetEvent(CompletionEventHandle);
+	Complete();
+}
+
+//
+// Mark the future as completed without a value, because its computation
+// was cancelled; waiting threads and continuations are released as usual
+//
+void Future::SetCancelled()
+{
+	Complete();
+}
+
+//
+// Release any threads waiting on the future, and run its continuations
+//
+// The list of pending continuations is sealed by exchanging in the
+// completion sentinel; any registration which loses the race against
+// the exchange sees the sentinel and runs its continuation itself.
+// Entries were pushed onto the head of the list, so they are invoked
+// in reverse order of registration.
+//
+void Future::Complete()
+{
+	Completion.CountDown();
+
+	ContinuationNode* node = reinterpret_cast<ContinuationNode*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&Continuations), &CompletedSentinel));
+	while(node)
+	{
+		ContinuationNode* next = node->Next;
+		FutureContinuation* continuation = node->Continuation;
+		delete node;
+		continuation->OnFutureComplete(*this);
+		node = next;
+	}
+}
+
+//
+// Register code to be run once the future's value is available
+//
+// Registration is an interlocked push onto the list of pending
+// continuations. If the future has already completed, the list has
+// been replaced by the completion sentinel, and the continuation is
+// invoked immediately on the calling thread instead.
+//
+void Future::AddContinuation(FutureContinuation* continuation)
+{
+	ContinuationNode* node = new ContinuationNode;
+	node->Continuation = continuation;
+
+	while(true)
+	{
+		ContinuationNode* head = Continuations;
+		if(head == &CompletedSentinel)
+		{
+			delete node;
+			continuation->OnFutureComplete(*this);
+			return;
+		}
+
+		node->Next = head;
+		if(::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&Continuations), node, head) == head)
+			return;
+	}
 }
@@ -11,6 +11,8 @@
 // Dependencies
 #include "Utility/Types/EpochTypeIDs.h"
 #include "Virtual Machine/Core Entities/RValue.h"
+#include "Virtual Machine/Core Entities/Concurrency/CancellationToken.h"
+#include "Utility/Threading/Synchronization.h"
 
 
 class StackSpace;
@@ -24,6 +26,23 @@ namespace VM
 	class ScopeDescription;
 
 	typedef std::auto_ptr<VM::Operation> OperationPtr;
+	class Future;
+
+
+	//
+	// Interface for code which should run once a future has completed
+	//
+	// Each continuation is invoked exactly once, on whichever thread
+	// completes the future (or on the registering thread, if the future
+	// has already completed). Continuations are responsible for releasing
+	// themselves once they have been invoked, since a single continuation
+	// may be shared between several futures.
+	//
+	struct FutureContinuation
+	{
+		virtual ~FutureContinuation() { }
+		virtual void OnFutureComplete(Future& future) = 0;
+	};
 
 
 	//
@@ -34,6 +53,15 @@ namespace VM
 	// read the value before it is finished computing results in the
 	// calling thread blocking until the value is ready.
 	//
+	// Completion is tracked by a countdown latch, so reading a future
+	// which has already finished costs a single check of the latch;
+	// no kernel objects are involved unless a reader has to block.
+	//
+	// A future may be cancelled, which stops its computation the next
+	// time the computation enters a block. A cancelled future still
+	// completes, so that nothing waits on it forever, but it has no
+	// value; reading it is an error.
+	//
 	class Future
 	{
 	// Construction
@@ -45,21 +73,57 @@ namespace VM
 	public:
 		EpochVariableTypeID GetType(const VM::ScopeDescription& scope) const;
 		RValuePtr GetValue() const;
+		const RValue& ReadValue() const;
+
+		bool IsComplete() const
+		{ return Completion.IsReleased(); }
 
 	// Value storage
 	public:
 		void SetResult(RValuePtr value);
 
+	// Cancellation
+	public:
+		void Cancel()
+		{ Cancellation.Cancel(); }
+
+		const CancellationToken& GetCancellationToken() const
+		{ return Cancellation; }
+
+		void SetCancelled();
+
+	// Continuations
+	public:
+		void AddContinuation(FutureContinuation* continuation);
+
 	// Operation retrieval
 	public:
 		virtual Operation* GetNestedOperation() const
 		{ return Op.get(); }
 
+	// Internal helpers
+	private:
+		void WaitForCompletion() const;
+		void Complete();
+
+	// Internal helper structures
+	private:
+		struct ContinuationNode
+		{
+			FutureContinuation* Continuation;
+			ContinuationNode* Next;
+		};
+
+		static ContinuationNode CompletedSentinel;
+
 	// Internal tracking
 	private:
 		OperationPtr Op;
 		RValuePtr Result;
-		HANDLE CompletionEventHandle;
+		mutable Threads::CountdownLatch Completion;
+		CancellationToken Cancellation;
+
+		ContinuationNode* volatile Continuations;
 	};
 
 }
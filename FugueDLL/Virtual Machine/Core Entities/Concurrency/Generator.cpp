@@ -0,0 +1,328 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Generators for lazily producing sequences of values
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/Generator.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/ExecutionContext.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Memory/Stack.h"
+#include "Utility/Threading/Lockless.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	//
+	// Thrown through the body of a generator which is being discarded
+	// before it has finished, so that its frames are unwound properly
+	//
+	struct AbandonedMarker
+	{
+	};
+
+
+	//
+	// RAII wrapper which keeps a consumer's stack alive while it waits
+	// for a generator body to produce a value
+	//
+	// Any collection which takes place inside the body only scans the
+	// generator's own stack as the executing stack, so the consumer's
+	// stack must be registered as an additional root in the meantime.
+	//
+	struct SuspendedConsumer
+	{
+		explicit SuspendedConsumer(const StackSpace& stack)
+			: Stack(stack)
+		{ GarbageCollector::RegisterSuspendedStack(Stack); }
+
+		~SuspendedConsumer()
+		{ GarbageCollector::UnregisterSuspendedStack(Stack); }
+
+		const StackSpace& Stack;
+	};
+
+
+	//
+	// RAII wrapper which claims a generator for the calling consumer
+	//
+	struct ExclusiveUse
+	{
+		explicit ExclusiveUse(volatile LONG& inuse)
+			: InUse(inuse)
+		{
+			if(::InterlockedCompareExchange(&InUse, 1, 0) != 0)
+				throw ExecutionException("A generator cannot be used by more than one task at a time");
+		}
+
+		~ExclusiveUse()
+		{ ::InterlockedExchange(&InUse, 0); }
+
+		volatile LONG& InUse;
+	};
+
+}
+
+
+//
+// Construct a generator; the body does not start running until
+// the first value is requested
+//
+// The caller is responsible for pushing the parameters of the body
+// onto the generator's stack before the generator is used.
+//
+Generator::Generator(Program& program, Operation* body, EpochVariableTypeID elementtype, DWORD taskorigin)
+	: RunningProgram(program),
+	  Body(body),
+	  ElementType(elementtype),
+	  TaskOrigin(taskorigin),
+	  Stack(new StackSpace),
+	  Routine(&Generator::BodyEntryPoint, this, Config::GeneratorStackSize),
+	  Started(false),
+	  Abandoned(false),
+	  PendingValue(NULL),
+	  Failed(false),
+	  InUse(0)
+{
+	GarbageCollector::RegisterSuspendedStack(*Stack);
+}
+
+//
+// Destruct and clean up a generator
+//
+// A body which is still suspended part way through is resumed one last
+// time, and unwinds without producing any further values.
+//
+Generator::~Generator()
+{
+	if(Started && !Routine.IsFinished())
+	{
+		Abandoned = true;
+		try
+		{
+			Routine.Resume();
+		}
+		catch(...)
+		{
+			// Nothing useful can be done this late
+		}
+	}
+
+	delete PendingValue;
+	ReleaseStack();
+}
+
+
+//
+// Determine if the generator has another value to hand out,
+// running the body until it produces one if necessary
+//
+bool Generator::HasNext(const StackSpace& consumerstack)
+{
+	ExclusiveUse claim(InUse);
+
+	if(!PendingValue && !Routine.IsFinished())
+		Advance(consumerstack);
+
+	return (PendingValue != NULL);
+}
+
+//
+// Retrieve the next value of the sequence; the caller takes
+// ownership of the returned r-value
+//
+RValue* Generator::Next(const StackSpace& consumerstack)
+{
+	ExclusiveUse claim(InUse);
+
+	if(!PendingValue && !Routine.IsFinished())
+		Advance(consumerstack);
+
+	if(!PendingValue)
+		throw ExecutionException("No more values are available from this generator");
+
+	RValue* ret = PendingValue;
+	PendingValue = NULL;
+	return ret;
+}
+
+//
+// Hand a value over to the consumer from within the body, and
+// suspend the body until the consumer asks for the next value
+//
+// The generator takes ownership of the value.
+//
+void Generator::YieldValue(RValue* value)
+{
+	if(value->GetType() != ElementType)
+	{
+		delete value;
+		throw ExecutionException("Value yielded does not match the element type of the generator");
+	}
+
+	PendingValue = value;
+	Routine.Suspend();
+
+	if(Abandoned)
+		throw AbandonedMarker();
+}
+
+//
+// Retrieve the generator whose body is running on the calling thread, if any
+//
+Generator* Generator::GetCurrent()
+{
+	Threads::Coroutine* routine = Threads::Coroutine::GetCurrent();
+	if(!routine)
+		return NULL;
+
+	return reinterpret_cast<Generator*>(routine->GetParam());
+}
+
+
+//
+// Run the body until it yields a value or finishes
+//
+// Failures within the body end the sequence, and are passed on to the
+// consumer which was waiting for the value.
+//
+void Generator::Advance(const StackSpace& consumerstack)
+{
+	{
+		SuspendedConsumer consumer(consumerstack);
+		Started = true;
+		Routine.Resume();
+	}
+
+	if(Routine.IsFinished())
+		ReleaseStack();
+
+	if(Failed)
+	{
+		Failed = false;
+		throw ExecutionException(FailureMessage);
+	}
+}
+
+//
+// Release the generator's stack once the body can no longer use it
+//
+void Generator::ReleaseStack()
+{
+	if(!Stack.get())
+		return;
+
+	GarbageCollector::UnregisterSuspendedStack(*Stack);
+	Stack.reset();
+}
+
+//
+// Entry point of the body's coroutine
+//
+// The body is invoked on the generator's stack, within an empty scope,
+// in the same way that a future runs its operation. No exceptions may
+// escape from here, since there is nothing on the coroutine's stack to
+// catch them; failures are recorded for the consumer instead.
+//
+void Generator::BodyEntryPoint(void* param)
+{
+	Generator* self = reinterpret_cast<Generator*>(param);
+
+	try
+	{
+		FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+		ScopeDescription descriptor;
+		ActivatedScope scope(descriptor);
+		scope.TaskOrigin = self->TaskOrigin;
+		scope.Enter(*self->Stack);
+		ExecutionContext context(self->RunningProgram, scope, *self->Stack, flowresult);
+		self->Body->ExecuteAndStoreRValue(context);
+		scope.Exit(*self->Stack);
+	}
+	catch(AbandonedMarker&)
+	{
+		// The generator is being discarded; nothing more to do
+	}
+	catch(std::exception& ex)
+	{
+		self->Failed = true;
+		self->FailureMessage = ex.what();
+	}
+	catch(...)
+	{
+		self->Failed = true;
+		self->FailureMessage = "Unknown failure within the body of a generator";
+	}
+}
+
+
+
+//
+// Construct an empty generator table
+//
+GeneratorTable::GeneratorTable()
+	: NumGenerators(0)
+{
+	for(LONG i = 0; i < MaxGenerators; ++i)
+		Generators[i] = NULL;
+}
+
+//
+// Destroy all generators created by the program
+//
+GeneratorTable::~GeneratorTable()
+{
+	for(LONG i = 0; i < MaxGenerators; ++i)
+		delete Generators[i];
+}
+
+
+//
+// Take ownership of a new generator and return its handle
+//
+// As with channels, handles start at 1, so that a zero-initialized
+// handle never refers to a generator.
+//
+Integer32 GeneratorTable::AddGenerator(std::auto_ptr<Generator>& generator)
+{
+	LONG index = ::InterlockedIncrement(&NumGenerators) - 1;
+	if(index >= MaxGenerators)
+	{
+		::InterlockedDecrement(&NumGenerators);
+		throw ExecutionException("Too many generators have been created");
+	}
+
+	Atomic::StoreRelease(&Generators[index], generator.release());
+	return static_cast<Integer32>(index + 1);
+}
+
+//
+// Look up the generator with the given handle
+//
+Generator& GeneratorTable::GetGenerator(Integer32 handle) const
+{
+	Generator* generator = NULL;
+	if(handle > 0 && handle <= MaxGenerators)
+		generator = Atomic::LoadAcquire(&Generators[handle - 1]);
+
+	if(!generator)
+		throw ExecutionException("Invalid generator handle");
+
+	return *generator;
+}
+
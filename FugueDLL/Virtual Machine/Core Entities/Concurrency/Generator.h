@@ -0,0 +1,144 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Generators for lazily producing sequences of values
+//
+// A generator runs a function call as a coroutine, on a native stack of
+// its own and with a VM stack of its own. Each time the consumer asks for
+// a value, the call is resumed until it yields the next one, and is then
+// suspended again with its frames intact. Only one value is ever held by
+// the generator at a time, so arbitrarily long (or unbounded) sequences
+// can be consumed in constant memory.
+//
+// The parameters of the call are evaluated eagerly, in the scope of the
+// code which creates the generator, and placed on the generator's stack;
+// the body of the function does not start running until the first value
+// is requested. Values must be of the generator's element type, which is
+// the return type of the function; whatever the function returns once it
+// finishes is discarded, and marks the end of the sequence.
+//
+// The body runs on the thread of whichever consumer resumed it, so a
+// generator may be handed from one task to another, but must not be used
+// by two tasks at once. Bodies should not wait for messages, since the
+// consumer's task is blocked for as long as the body runs.
+//
+// Generators are identified by integer handles, much like channels; see
+// GeneratorTable.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Types/EpochTypeIDs.h"
+#include "Utility/Threading/Coroutines.h"
+
+
+// Forward declarations
+class StackSpace;
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Operation;
+	class Program;
+	class RValue;
+
+
+	class Generator
+	{
+	// Construction and destruction
+	public:
+		Generator(Program& program, Operation* body, EpochVariableTypeID elementtype, DWORD taskorigin);
+		~Generator();
+
+	// Consumer interface
+	public:
+		bool HasNext(const StackSpace& consumerstack);
+		RValue* Next(const StackSpace& consumerstack);
+
+	// Body interface
+	public:
+		void YieldValue(RValue* value);
+
+		static Generator* GetCurrent();
+
+	// Additional queries
+	public:
+		EpochVariableTypeID GetElementType() const
+		{ return ElementType; }
+
+		StackSpace& GetStack()
+		{ return *Stack; }
+
+	// Internal helpers
+	private:
+		void Advance(const StackSpace& consumerstack);
+		void ReleaseStack();
+
+		static void BodyEntryPoint(void* param);
+
+	// Internal tracking
+	private:
+		Program& RunningProgram;
+		Operation* Body;
+		EpochVariableTypeID ElementType;
+		DWORD TaskOrigin;
+
+		std::auto_ptr<StackSpace> Stack;
+		Threads::Coroutine Routine;
+		bool Started;
+		bool Abandoned;
+
+		RValue* PendingValue;
+
+		bool Failed;
+		std::string FailureMessage;
+
+		volatile LONG InUse;
+
+	// Non-copyable
+	private:
+		Generator(const Generator&);
+		Generator& operator = (const Generator&);
+	};
+
+
+	//
+	// Table of the generators created by a program
+	//
+	// Like channels, generators are looked up by indexing the table, and
+	// live until the table itself is destroyed. Generators which run to
+	// completion release their stacks straight away, however, so finished
+	// generators cost very little to keep around.
+	//
+	class GeneratorTable
+	{
+	// Construction and destruction
+	public:
+		GeneratorTable();
+		~GeneratorTable();
+
+	// Generator management
+	public:
+		Integer32 AddGenerator(std::auto_ptr<Generator>& generator);
+		Generator& GetGenerator(Integer32 handle) const;
+
+	// Internal tracking
+	private:
+		static const LONG MaxGenerators = 4096;
+
+		Generator* volatile Generators[MaxGenerators];
+		volatile LONG NumGenerators;
+
+	// Non-copyable
+	private:
+		GeneratorTable(const GeneratorTable&);
+		GeneratorTable& operator = (const GeneratorTable&);
+	};
+
+}
+
@@ -0,0 +1,51 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Interning of message signatures for fast matching of task messages
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/MessageSignatures.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	typedef std::pair<std::wstring, std::list<EpochVariableTypeID> > Signature;
+
+	//
+	// Table of all signatures seen so far
+	//
+	// Signatures are only interned while programs are parsed or loaded,
+	// so the lock is never touched while messages are being passed.
+	//
+	Threads::CriticalSection SignatureCriticalSection;
+	std::map<Signature, MessageSignatureID> SignatureIDs;
+
+}
+
+
+//
+// Retrieve the ID of the given message signature, allocating a new ID if needed
+//
+MessageSignatureID MessageSignatures::Intern(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
+{
+	Threads::CriticalSection::Auto mutex(SignatureCriticalSection);
+
+	Signature signature(messagename, payloadtypes);
+	std::map<Signature, MessageSignatureID>::const_iterator iter = SignatureIDs.find(signature);
+	if(iter != SignatureIDs.end())
+		return iter->second;
+
+	MessageSignatureID id = SignatureIDs.size();
+	SignatureIDs.insert(std::make_pair(signature, id));
+	return id;
+}
+
@@ -0,0 +1,34 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Interning of message signatures for fast matching of task messages
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Types/IDTypes.h"
+#include "Utility/Types/EpochTypeIDs.h"
+
+
+namespace VM
+{
+
+	//
+	// A message signature is the combination of a message name and the
+	// types of its payload values. Each distinct signature is assigned a
+	// small integer ID the first time it is seen, so that senders and
+	// receivers can match messages with a single integer comparison.
+	//
+	// IDs are allocated densely starting from zero, which allows them to
+	// be used directly as indices into dispatch tables.
+	//
+	namespace MessageSignatures
+	{
+		MessageSignatureID Intern(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes);
+	}
+
+}
+
@@ -0,0 +1,662 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Transport carrying task messages between VM processes on different machines
+//
+// Every frame starts with a fixed header giving the frame type and the
+// lengths of the task name and body which follow it. Announcement frames
+// have no body; the body of a message frame is the encoded message, as
+// produced by RemoteTaskTable::Send.
+//
+// The node directory is a text file listing one node per line, in the
+// form host:port; blank lines and lines starting with # are ignored.
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/NetworkTransport.h"
+
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Strings.h"
+
+#include "User Interface/Output.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include <fstream>
+
+
+using namespace VM;
+
+
+namespace
+{
+	//
+	// Types of frame passed over node links
+	//
+	enum FrameType
+	{
+		Frame_Announce = 1,				// The sending node runs the named task
+		Frame_Message = 2				// Message for the named task
+	};
+
+	struct FrameHeader
+	{
+		UInteger32 Type;
+		UInteger32 NameLength;
+		UInteger32 BodyLength;
+	};
+
+	// Limits on incoming frames; links sending anything larger are dropped
+	const UInteger32 MaxFrameNameLength = 4096;
+	const UInteger32 MaxFrameBodyLength = 16 * 1024 * 1024;
+
+	// Timings of the network thread, in milliseconds
+	const DWORD PollInterval = 100;
+	const DWORD ConnectTimeout = 100;
+	const DWORD ReconnectInterval = 1000;
+
+	// Amount of data taken from a socket with each receive
+	const size_t ReceiveChunkSize = 64 * 1024;
+
+
+	//
+	// Helper for appending raw data to a frame
+	//
+	void Append(std::vector<Byte>& frame, const void* data, size_t size)
+	{
+		const Byte* bytes = reinterpret_cast<const Byte*>(data);
+		frame.insert(frame.end(), bytes, bytes + size);
+	}
+
+	//
+	// Open a link to the given address, giving up if it cannot be reached quickly
+	//
+	// Returns INVALID_SOCKET if the connection fails. The returned socket is
+	// left in blocking mode.
+	//
+	SOCKET ConnectWithTimeout(const sockaddr_in& address)
+	{
+		SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if(s == INVALID_SOCKET)
+			return INVALID_SOCKET;
+
+		u_long nonblocking = 1;
+		::ioctlsocket(s, FIONBIO, &nonblocking);
+
+		if(::connect(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR)
+		{
+			if(::WSAGetLastError() != WSAEWOULDBLOCK)
+			{
+				::closesocket(s);
+				return INVALID_SOCKET;
+			}
+
+			fd_set writable;
+			fd_set failed;
+			FD_ZERO(&writable);
+			FD_ZERO(&failed);
+			FD_SET(s, &writable);
+			FD_SET(s, &failed);
+
+			timeval timeout;
+			timeout.tv_sec = 0;
+			timeout.tv_usec = ConnectTimeout * 1000;
+
+			if(::select(0, NULL, &writable, &failed, &timeout) != 1 || !FD_ISSET(s, &writable))
+			{
+				::closesocket(s);
+				return INVALID_SOCKET;
+			}
+		}
+
+		nonblocking = 0;
+		::ioctlsocket(s, FIONBIO, &nonblocking);
+		return s;
+	}
+
+	//
+	// Turn off output coalescing on a link; frames are batched by the transport itself
+	//
+	void DisableNagle(SOCKET s)
+	{
+		BOOL nodelay = TRUE;
+		::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+	}
+
+	//
+	// Print a warning about a problem with a link to another node
+	//
+	void WarnAboutLink(const std::wstring& message)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"WARNING - " << message << std::endl << UI::resetcolor;
+	}
+}
+
+
+//
+// Construct the transport, start listening for links, and start the network thread
+//
+NetworkTransport::NetworkTransport(RemoteTaskTable& owner, Program* program)
+	: Owner(owner),
+	  NetworkProgram(program),
+	  ListenSocket(INVALID_SOCKET),
+	  NetworkThread(NULL),
+	  StopRequested(0)
+{
+	WSADATA wsadata;
+	if(::WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+		throw Threads::ThreadException("Failed to initialize networking for messages between nodes");
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(static_cast<u_short>(Config::NodePort));
+
+	ListenSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(ListenSocket == INVALID_SOCKET
+	   || ::bind(ListenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR
+	   || ::listen(ListenSocket, SOMAXCONN) == SOCKET_ERROR)
+	{
+		if(ListenSocket != INVALID_SOCKET)
+			::closesocket(ListenSocket);
+		::WSACleanup();
+		throw Threads::ThreadException("Failed to listen for messages from other nodes on the configured port");
+	}
+
+	ReadDirectory();
+
+	NetworkThread = ::CreateThread(NULL, 0, NetworkThreadProc, this, 0, NULL);
+	if(!NetworkThread)
+	{
+		for(std::vector<NodeLink*>::iterator iter = Links.begin(); iter != Links.end(); ++iter)
+			delete *iter;
+		::closesocket(ListenSocket);
+		::WSACleanup();
+		throw Threads::ThreadException("Failed to start the thread relaying messages between nodes");
+	}
+}
+
+//
+// Stop the network thread, and close all links
+//
+// Frames which have not been written yet are discarded.
+//
+NetworkTransport::~NetworkTransport()
+{
+	::InterlockedExchange(&StopRequested, 1);
+	::WaitForSingleObject(NetworkThread, INFINITE);
+	::CloseHandle(NetworkThread);
+
+	for(std::vector<NodeLink*>::iterator iter = Links.begin(); iter != Links.end(); ++iter)
+	{
+		if((*iter)->Socket != INVALID_SOCKET)
+			::closesocket((*iter)->Socket);
+		delete *iter;
+	}
+
+	::closesocket(ListenSocket);
+	::WSACleanup();
+}
+
+
+//
+// Announce a task to all connected nodes
+//
+// The announcements are written out by the network thread.
+//
+void NetworkTransport::ExportTask(const std::wstring& taskname)
+{
+	Threads::CriticalSection::Auto lock(CritSec);
+
+	if(!ExportedTasks.insert(taskname).second)
+		return;
+
+	for(std::vector<NodeLink*>::iterator iter = Links.begin(); iter != Links.end(); ++iter)
+	{
+		if((*iter)->Socket != INVALID_SOCKET && !(*iter)->Dead)
+			QueueFrame(**iter, Frame_Announce, taskname, NULL);
+	}
+}
+
+//
+// Send an encoded message to a task announced by another node
+//
+// Returns false if no node has announced a task with the given name. The
+// contents of the message are taken over by the transport.
+//
+bool NetworkTransport::Post(const std::wstring& taskname, std::vector<Byte>& message)
+{
+	Threads::CriticalSection::Auto lock(CritSec);
+
+	TaskLinkMap::iterator iter = TaskLinks.find(taskname);
+	if(iter == TaskLinks.end())
+		return false;
+
+	QueueFrame(*iter->second, Frame_Message, taskname, &message);
+	FlushLink(*iter->second);
+	return true;
+}
+
+
+//
+// Add a frame to the queue of a link
+//
+// The body, if any, is swapped into the frame rather than copied. Must be
+// called with the critical section held.
+//
+void NetworkTransport::QueueFrame(NodeLink& link, UInteger32 type, const std::wstring& taskname, std::vector<Byte>* body)
+{
+	FrameHeader header;
+	header.Type = type;
+	header.NameLength = static_cast<UInteger32>(taskname.length());
+	header.BodyLength = body ? static_cast<UInteger32>(body->size()) : 0;
+
+	link.PendingFrames.push_back(OutgoingFrame());
+	OutgoingFrame& frame = link.PendingFrames.back();
+	Append(frame.Header, &header, sizeof(header));
+	Append(frame.Header, taskname.data(), taskname.length() * sizeof(wchar_t));
+	if(body)
+		frame.Body.swap(*body);
+}
+
+//
+// Queue announcements of every exported task on a newly established link
+//
+// Must be called with the critical section held.
+//
+void NetworkTransport::QueueAnnouncements(NodeLink& link)
+{
+	for(std::set<std::wstring>::const_iterator iter = ExportedTasks.begin(); iter != ExportedTasks.end(); ++iter)
+		QueueFrame(link, Frame_Announce, *iter, NULL);
+}
+
+//
+// Write out the frames queued on a link
+//
+// If another thread is already writing to the link, it picks up the new
+// frames once its current batch is written, and this call returns right
+// away. Otherwise, frames are written in batches until the queue is empty;
+// the critical section is released while each batch is being written, so
+// other senders can keep queueing frames in the meantime.
+//
+// Must be called with the critical section held exactly once, since it
+// must be fully released around each write.
+//
+void NetworkTransport::FlushLink(NodeLink& link)
+{
+	if(link.Flushing)
+		return;
+
+	link.Flushing = true;
+
+	std::vector<OutgoingFrame> batch;
+	std::vector<WSABUF> buffers;
+	while(!link.PendingFrames.empty() && !link.Dead && link.Socket != INVALID_SOCKET)
+	{
+		size_t batchsize = std::min<size_t>(link.PendingFrames.size(), std::max<unsigned>(Config::NetworkBatchSize, 1));
+		batch.resize(batchsize);
+		buffers.clear();
+		for(size_t i = 0; i < batchsize; ++i)
+		{
+			batch[i].Header.swap(link.PendingFrames.front().Header);
+			batch[i].Body.swap(link.PendingFrames.front().Body);
+			link.PendingFrames.pop_front();
+
+			WSABUF buffer;
+			buffer.buf = &batch[i].Header[0];
+			buffer.len = static_cast<u_long>(batch[i].Header.size());
+			buffers.push_back(buffer);
+
+			if(!batch[i].Body.empty())
+			{
+				buffer.buf = &batch[i].Body[0];
+				buffer.len = static_cast<u_long>(batch[i].Body.size());
+				buffers.push_back(buffer);
+			}
+		}
+
+		SOCKET s = link.Socket;
+		DWORD bytessent;
+
+		CritSec.Exit();
+		int result = ::WSASend(s, &buffers[0], static_cast<DWORD>(buffers.size()), &bytessent, 0, NULL, NULL);
+		CritSec.Enter();
+
+		batch.clear();
+
+		if(result == SOCKET_ERROR)
+		{
+			WarnAboutLink(L"lost the link to another node; pending messages were discarded");
+			RetireLink(link);
+		}
+	}
+
+	link.Flushing = false;
+}
+
+//
+// Stop using a link which has failed
+//
+// Tasks announced over the link become unreachable until they are
+// announced again. Only the network thread closes sockets, once nobody
+// is writing to them; see CollectDeadLinks. Must be called with the
+// critical section held.
+//
+void NetworkTransport::RetireLink(NodeLink& link)
+{
+	link.Dead = true;
+	link.PendingFrames.clear();
+
+	for(TaskLinkMap::iterator iter = TaskLinks.begin(); iter != TaskLinks.end(); )
+	{
+		if(iter->second == &link)
+			TaskLinks.erase(iter++);
+		else
+			++iter;
+	}
+}
+
+//
+// Close the sockets of retired links
+//
+// Links to directory nodes are kept, so they can be reconnected later;
+// links accepted from other nodes are freed. Must be called with the
+// critical section held, on the network thread.
+//
+void NetworkTransport::CollectDeadLinks()
+{
+	for(size_t i = 0; i < Links.size(); )
+	{
+		NodeLink* link = Links[i];
+		if(!link->Dead || link->Flushing)
+		{
+			++i;
+			continue;
+		}
+
+		if(link->Socket != INVALID_SOCKET)
+		{
+			::closesocket(link->Socket);
+			link->Socket = INVALID_SOCKET;
+		}
+
+		if(link->FromDirectory)
+		{
+			link->Dead = false;
+			link->ReceiveBuffer.clear();
+			++i;
+		}
+		else
+		{
+			delete link;
+			Links.erase(Links.begin() + i);
+		}
+	}
+}
+
+
+//
+// Load the list of nodes to connect to
+//
+// Nodes which cannot be resolved are reported and skipped. If no
+// directory is configured, this node only accepts links from others.
+//
+void NetworkTransport::ReadDirectory()
+{
+	if(Config::NodeDirectory.empty())
+		return;
+
+	std::wifstream infile(Config::NodeDirectory.c_str());
+	if(!infile)
+	{
+		WarnAboutLink(L"could not open the node directory \"" + Config::NodeDirectory + L"\"");
+		return;
+	}
+
+	std::wstring line;
+	while(std::getline(infile, line))
+	{
+		line = StripWhitespace(line);
+		if(line.empty() || line[0] == L'#')
+			continue;
+
+		size_t colonpos = line.rfind(L':');
+		unsigned port = 0;
+		if(colonpos != std::wstring::npos)
+		{
+			std::wistringstream portstream(line.substr(colonpos + 1));
+			portstream >> port;
+		}
+
+		if(!port || port > 0xffff)
+		{
+			WarnAboutLink(L"ignored malformed node directory entry \"" + line + L"\"");
+			continue;
+		}
+
+		std::string host = narrow(line.substr(0, colonpos));
+		unsigned long hostaddress = ::inet_addr(host.c_str());
+		if(hostaddress == INADDR_NONE)
+		{
+			const hostent* hostinfo = ::gethostbyname(host.c_str());
+			if(!hostinfo || hostinfo->h_addrtype != AF_INET)
+			{
+				WarnAboutLink(L"could not resolve the node \"" + line + L"\"");
+				continue;
+			}
+			memcpy(&hostaddress, hostinfo->h_addr_list[0], sizeof(hostaddress));
+		}
+
+		std::auto_ptr<NodeLink> link(new NodeLink);
+		link->Socket = INVALID_SOCKET;
+		memset(&link->Address, 0, sizeof(link->Address));
+		link->Address.sin_family = AF_INET;
+		link->Address.sin_addr.s_addr = hostaddress;
+		link->Address.sin_port = htons(static_cast<u_short>(port));
+		link->FromDirectory = true;
+		link->Flushing = false;
+		link->Dead = false;
+		Links.push_back(link.release());
+	}
+}
+
+
+//
+// Entry point of the network thread
+//
+DWORD __stdcall NetworkTransport::NetworkThreadProc(void* param)
+{
+	reinterpret_cast<NetworkTransport*>(param)->RunNetwork();
+	return 0;
+}
+
+//
+// Service all links until the transport is destroyed
+//
+// Only this thread adds or removes links, so it can walk the list of
+// links without holding the critical section, as long as it does not
+// touch any state which senders use.
+//
+void NetworkTransport::RunNetwork()
+{
+	Threads::ProgramBinding binding(NetworkProgram);
+
+	DWORD lastconnect = ::GetTickCount() - ReconnectInterval;
+	while(!StopRequested)
+	{
+		if(::GetTickCount() - lastconnect >= ReconnectInterval)
+		{
+			ConnectToDirectoryNodes();
+			lastconnect = ::GetTickCount();
+		}
+
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(ListenSocket, &readable);
+
+		{
+			Threads::CriticalSection::Auto lock(CritSec);
+
+			CollectDeadLinks();
+
+			for(size_t i = 0; i < Links.size(); ++i)
+			{
+				NodeLink& link = *Links[i];
+				if(link.Socket == INVALID_SOCKET || link.Dead)
+					continue;
+
+				if(!link.PendingFrames.empty())
+					FlushLink(link);
+
+				if(!link.Dead)
+					FD_SET(link.Socket, &readable);
+			}
+		}
+
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = PollInterval * 1000;
+
+		if(::select(0, &readable, NULL, NULL, &timeout) <= 0)
+			continue;
+
+		if(FD_ISSET(ListenSocket, &readable))
+			AcceptLink();
+
+		for(size_t i = 0; i < Links.size(); ++i)
+		{
+			NodeLink& link = *Links[i];
+			if(link.Socket == INVALID_SOCKET || !FD_ISSET(link.Socket, &readable))
+				continue;
+
+			if(!ReceiveFrames(link))
+			{
+				Threads::CriticalSection::Auto lock(CritSec);
+				RetireLink(link);
+			}
+		}
+	}
+}
+
+//
+// Try to open links to directory nodes which are not connected
+//
+void NetworkTransport::ConnectToDirectoryNodes()
+{
+	for(size_t i = 0; i < Links.size(); ++i)
+	{
+		NodeLink& link = *Links[i];
+		if(!link.FromDirectory || link.Socket != INVALID_SOCKET)
+			continue;
+
+		SOCKET s = ConnectWithTimeout(link.Address);
+		if(s == INVALID_SOCKET)
+			continue;
+
+		DisableNagle(s);
+
+		Threads::CriticalSection::Auto lock(CritSec);
+		link.Socket = s;
+		QueueAnnouncements(link);
+	}
+}
+
+//
+// Accept a link opened by another node
+//
+// Links beyond what a single wait can cover are refused.
+//
+void NetworkTransport::AcceptLink()
+{
+	SOCKET s = ::accept(ListenSocket, NULL, NULL);
+	if(s == INVALID_SOCKET)
+		return;
+
+	if(Links.size() >= FD_SETSIZE - 1)
+	{
+		::closesocket(s);
+		WarnAboutLink(L"refused a link from another node; too many nodes are connected");
+		return;
+	}
+
+	DisableNagle(s);
+
+	std::auto_ptr<NodeLink> link(new NodeLink);
+	link->Socket = s;
+	memset(&link->Address, 0, sizeof(link->Address));
+	link->FromDirectory = false;
+	link->Flushing = false;
+	link->Dead = false;
+
+	Threads::CriticalSection::Auto lock(CritSec);
+	QueueAnnouncements(*link);
+	Links.push_back(link.release());
+}
+
+//
+// Read whatever data is waiting on a link, and handle all complete frames
+//
+// Returns false if the link was closed by the other side, failed, or sent
+// a malformed frame.
+//
+bool NetworkTransport::ReceiveFrames(NodeLink& link)
+{
+	size_t previoussize = link.ReceiveBuffer.size();
+	link.ReceiveBuffer.resize(previoussize + ReceiveChunkSize);
+
+	int received = ::recv(link.Socket, &link.ReceiveBuffer[previoussize], static_cast<int>(ReceiveChunkSize), 0);
+	if(received <= 0)
+		return false;
+
+	link.ReceiveBuffer.resize(previoussize + received);
+
+	size_t position = 0;
+	std::vector<Byte> body;
+	while(link.ReceiveBuffer.size() - position >= sizeof(FrameHeader))
+	{
+		FrameHeader header;
+		memcpy(&header, &link.ReceiveBuffer[position], sizeof(header));
+		if(header.NameLength > MaxFrameNameLength || header.BodyLength > MaxFrameBodyLength)
+		{
+			WarnAboutLink(L"dropped a link to another node after receiving a malformed frame");
+			return false;
+		}
+
+		size_t framesize = sizeof(header) + header.NameLength * sizeof(wchar_t) + header.BodyLength;
+		if(link.ReceiveBuffer.size() - position < framesize)
+			break;
+
+		const Byte* name = &link.ReceiveBuffer[position + sizeof(header)];
+		std::wstring taskname(reinterpret_cast<const wchar_t*>(name), header.NameLength);
+		const Byte* bodystart = name + header.NameLength * sizeof(wchar_t);
+		position += framesize;
+
+		if(header.Type == Frame_Announce)
+		{
+			Threads::CriticalSection::Auto lock(CritSec);
+			if(!link.Dead)
+				TaskLinks[taskname] = &link;
+		}
+		else if(header.Type == Frame_Message)
+		{
+			body.assign(bodystart, bodystart + header.BodyLength);
+			try
+			{
+				Owner.DeliverMessage(taskname, body);
+			}
+			catch(const std::exception& e)
+			{
+				WarnAboutLink(L"discarded a message from another node: " + widen(e.what()));
+			}
+		}
+	}
+
+	link.ReceiveBuffer.erase(link.ReceiveBuffer.begin(), link.ReceiveBuffer.begin() + position);
+	return true;
+}
+
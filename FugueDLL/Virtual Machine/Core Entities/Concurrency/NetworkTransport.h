@@ -0,0 +1,105 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Transport carrying task messages between VM processes on different machines
+//
+// Each VM listens for links from other nodes on Config::NodePort, and
+// connects to every node listed in the node directory (Config::NodeDirectory).
+// Links carry frames in both directions, regardless of which side opened
+// them. Whenever a task is exported, its name is announced over every
+// link; each node keeps track of which link announced each task name, and
+// sends messages for that task over the same link. Tasks exported before a
+// link comes up are announced as soon as the link is established.
+//
+// Messages are pipelined: senders never wait for any acknowledgement,
+// and frames queued while another thread is already writing to the link
+// are picked up by that thread and written together with its own. Each
+// write hands the headers and encoded messages of a whole batch of frames
+// to the socket at once as a scatter/gather list, so the message bytes are
+// never copied into an intermediate buffer.
+//
+// A single network thread per program accepts links, receives frames,
+// retries connections to directory nodes which are not reachable, and
+// closes links which fail. Incoming messages are handed back to the owning
+// RemoteTaskTable for delivery on this thread.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
+
+#include <winsock2.h>
+
+
+namespace VM
+{
+
+	class NetworkTransport : public TaskTransport
+	{
+	// Construction and destruction
+	public:
+		NetworkTransport(RemoteTaskTable& owner, Program* program);
+		virtual ~NetworkTransport();
+
+	// Transport interface
+	public:
+		virtual void ExportTask(const std::wstring& taskname);
+		virtual bool Post(const std::wstring& taskname, std::vector<Byte>& message);
+
+	// Internal tracking structures
+	private:
+		struct OutgoingFrame
+		{
+			std::vector<Byte> Header;
+			std::vector<Byte> Body;
+		};
+
+		struct NodeLink
+		{
+			SOCKET Socket;
+			sockaddr_in Address;		// Only meaningful for links to directory nodes
+			bool FromDirectory;
+			bool Flushing;
+			bool Dead;
+			std::deque<OutgoingFrame> PendingFrames;
+			std::vector<Byte> ReceiveBuffer;
+		};
+
+		typedef std::map<std::wstring, NodeLink*> TaskLinkMap;
+
+	// Internal helpers
+	private:
+		static DWORD __stdcall NetworkThreadProc(void* param);
+		void RunNetwork();
+
+		void ReadDirectory();
+		void ConnectToDirectoryNodes();
+		void AcceptLink();
+		bool ReceiveFrames(NodeLink& link);
+
+		void QueueFrame(NodeLink& link, UInteger32 type, const std::wstring& taskname, std::vector<Byte>* body);
+		void QueueAnnouncements(NodeLink& link);
+		void FlushLink(NodeLink& link);
+		void RetireLink(NodeLink& link);
+		void CollectDeadLinks();
+
+	// Internal tracking
+	private:
+		RemoteTaskTable& Owner;
+		Program* NetworkProgram;
+
+		Threads::CriticalSection CritSec;
+		std::vector<NodeLink*> Links;
+		std::set<std::wstring> ExportedTasks;
+		TaskLinkMap TaskLinks;
+
+		SOCKET ListenSocket;
+		HANDLE NetworkThread;
+		volatile LONG StopRequested;
+	};
+
+}
+
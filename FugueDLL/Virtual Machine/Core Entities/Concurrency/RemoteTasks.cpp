@@ -0,0 +1,259 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Message passing between tasks running in different VM processes
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
+#include "Virtual Machine/Core Entities/Concurrency/SharedMemoryTransport.h"
+#include "Virtual Machine/Core Entities/Concurrency/NetworkTransport.h"
+#include "Virtual Machine/Core Entities/Concurrency/MessageSignatures.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Memory/Heap.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+	//
+	// Helpers for appending raw data to an encoded message
+	//
+	void Append(std::vector<Byte>& message, const void* data, size_t size)
+	{
+		const Byte* bytes = reinterpret_cast<const Byte*>(data);
+		message.insert(message.end(), bytes, bytes + size);
+	}
+
+	void AppendString(std::vector<Byte>& message, const std::wstring& str)
+	{
+		UInteger32 length = static_cast<UInteger32>(str.length());
+		Append(message, &length, sizeof(length));
+		Append(message, str.data(), str.length() * sizeof(wchar_t));
+	}
+
+
+	//
+	// Helper for reading the fields of an encoded message with bounds checking
+	//
+	class MessageReader
+	{
+	public:
+		explicit MessageReader(const std::vector<Byte>& message)
+			: Message(message),
+			  Position(0)
+		{ }
+
+		void Read(void* data, size_t size)
+		{
+			if(Message.size() - Position < size)
+				throw Threads::ThreadException("Received a truncated message from another process");
+
+			memcpy(data, &Message[Position], size);
+			Position += size;
+		}
+
+		UInteger32 ReadInteger()
+		{
+			UInteger32 value;
+			Read(&value, sizeof(value));
+			return value;
+		}
+
+		std::wstring ReadString()
+		{
+			UInteger32 length = ReadInteger();
+			if((Message.size() - Position) / sizeof(wchar_t) < length)
+				throw Threads::ThreadException("Received a truncated message from another process");
+
+			std::wstring str(reinterpret_cast<const wchar_t*>(&Message[Position]), length);
+			Position += length * sizeof(wchar_t);
+			return str;
+		}
+
+	private:
+		const std::vector<Byte>& Message;
+		size_t Position;
+	};
+
+
+	//
+	// Payload types which can be passed between processes
+	//
+	bool IsRemotableType(EpochVariableTypeID type)
+	{
+		switch(type)
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+		case EpochVariableType_String:
+			return true;
+		}
+
+		return false;
+	}
+}
+
+
+//
+// Construct and initialize the table; no transports are started yet
+//
+RemoteTaskTable::RemoteTaskTable()
+	: TransportsStarted(false)
+{
+}
+
+//
+// Shut down all transports
+//
+// This runs as the owning program is destroyed, before its pools go away,
+// so no transport delivers messages into a dead program.
+//
+RemoteTaskTable::~RemoteTaskTable()
+{
+	for(std::vector<TaskTransport*>::iterator iter = Transports.begin(); iter != Transports.end(); ++iter)
+		delete *iter;
+}
+
+
+//
+// Determine if any transport for remote messaging is configured
+//
+bool RemoteTaskTable::IsEnabled()
+{
+	return (Config::ShareTaskMailboxes || Config::NodePort != 0);
+}
+
+//
+// Start up the configured transports, the first time they are needed
+//
+// Transports are listed in order of preference; shared mailboxes come
+// first, since they are far cheaper than network links.
+//
+void RemoteTaskTable::StartTransports(Program* program)
+{
+	Threads::CriticalSection::Auto lock(CritSec);
+
+	if(TransportsStarted)
+		return;
+
+	if(Config::ShareTaskMailboxes)
+		Transports.push_back(new SharedMemoryTransport(*this, program));
+
+	if(Config::NodePort != 0)
+		Transports.push_back(new NetworkTransport(*this, program));
+
+	TransportsStarted = true;
+}
+
+
+//
+// Make a task reachable by name from other processes
+//
+void RemoteTaskTable::ExportTask(const std::wstring& taskname, Program* program)
+{
+	StartTransports(program);
+
+	for(std::vector<TaskTransport*>::iterator iter = Transports.begin(); iter != Transports.end(); ++iter)
+		(*iter)->ExportTask(taskname);
+}
+
+
+//
+// Send a message to a task exported by another process
+//
+// Returns false if none of the transports know of a task with the given
+// name. The payload must have been packed according to the given types.
+//
+bool RemoteTaskTable::Send(Program* program, const std::wstring& taskname, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes, const HeapStorage& payload)
+{
+	StartTransports(program);
+
+	std::vector<Byte> message;
+	AppendString(message, messagename);
+
+	UInteger32 numtypes = static_cast<UInteger32>(payloadtypes.size());
+	Append(message, &numtypes, sizeof(numtypes));
+	for(std::list<EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		if(!IsRemotableType(*iter))
+			throw NotImplementedException("Only scalar and string values can be passed to tasks in other processes");
+
+		UInteger32 type = static_cast<UInteger32>(*iter);
+		Append(message, &type, sizeof(type));
+	}
+
+	const Byte* storageptr = reinterpret_cast<const Byte*>(payload.GetStartOfStorage());
+	for(std::list<EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		if(*iter == EpochVariableType_String)
+			AppendString(message, StringVariable::GetByHandle(*reinterpret_cast<const StringVariable::BaseStorage*>(storageptr)));
+		else
+			Append(message, storageptr, TypeInfo::GetStorageSize(*iter));
+
+		storageptr += TypeInfo::GetStorageSize(*iter);
+	}
+
+	for(std::vector<TaskTransport*>::iterator iter = Transports.begin(); iter != Transports.end(); ++iter)
+	{
+		if((*iter)->Post(taskname, message))
+			return true;
+	}
+
+	return false;
+}
+
+//
+// Decode a message received by a transport, and pass it on to the local task
+//
+// This must be called on a thread bound to the receiving program. Strings
+// in the payload are added to the pools of the program; the receiver frees
+// them along with the rest of the payload as usual.
+//
+void RemoteTaskTable::DeliverMessage(const std::wstring& taskname, const std::vector<Byte>& message)
+{
+	MessageReader reader(message);
+
+	std::wstring messagename = reader.ReadString();
+
+	std::list<EpochVariableTypeID> payloadtypes;
+	size_t payloadsize = 0;
+	UInteger32 numtypes = reader.ReadInteger();
+	for(UInteger32 i = 0; i < numtypes; ++i)
+	{
+		EpochVariableTypeID type = static_cast<EpochVariableTypeID>(reader.ReadInteger());
+		if(!IsRemotableType(type))
+			throw Threads::ThreadException("Received a message with an unsupported payload type");
+
+		payloadtypes.push_back(type);
+		payloadsize += TypeInfo::GetStorageSize(type);
+	}
+
+	std::auto_ptr<HeapStorage> heapblock(HeapStorage::AcquirePooled(payloadsize));
+	Byte* storageptr = reinterpret_cast<Byte*>(heapblock->GetStartOfStorage());
+	for(std::list<EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+	{
+		if(*iter == EpochVariableType_String)
+			*reinterpret_cast<StringVariable::BaseStorage*>(storageptr) = StringVariable::PoolStringLiteral(reader.ReadString());
+		else
+			reader.Read(storageptr, TypeInfo::GetStorageSize(*iter));
+
+		storageptr += TypeInfo::GetStorageSize(*iter);
+	}
+
+	Threads::SendEvent(taskname, MessageSignatures::Intern(messagename, payloadtypes), heapblock.release());
+}
+
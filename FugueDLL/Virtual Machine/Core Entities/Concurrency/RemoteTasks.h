@@ -0,0 +1,111 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Message passing between tasks running in different VM processes
+//
+// Task names are normally only meaningful within the program which forked
+// the task. When remote messaging is enabled, each task forked by name is
+// also exported through one or more transports, which make the task
+// reachable from other VM processes. A message sent to a task name which
+// is not known within the program is offered to each transport in turn,
+// until one of them knows where the task lives. The following transports
+// are available:
+//
+//  - Shared mailboxes (Config::ShareTaskMailboxes) reach other processes
+//    on the same machine; see SharedMemoryTransport.h.
+//  - Network links (Config::NodePort) reach processes on other machines
+//    listed in the node directory; see NetworkTransport.h.
+//
+// Messages crossing processes cannot carry pointers or pool handles, so
+// they are encoded into a flat byte form before being handed to a
+// transport. The message name and payload types are written out in full,
+// followed by the payload values; scalars are copied as-is, and strings
+// are written out character by character. Arrays and other pooled data are
+// not supported.
+//
+// Transports deliver incoming messages on threads of their own, which are
+// bound to the receiving program. Each message is decoded, its payload is
+// rebuilt against the pools of the program, and it is passed on to the
+// task's ordinary mailbox. Remote messages therefore appear to come from
+// the transport's thread; tasks which need to answer a remote sender
+// should do so by name rather than through sender().
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Types/EpochTypeIDs.h"
+
+
+// Forward declarations
+class HeapStorage;
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Program;
+
+
+	//
+	// Interface for the mechanisms which carry messages out of the process
+	//
+	class TaskTransport
+	{
+	// Destruction
+	public:
+		virtual ~TaskTransport()
+		{ }
+
+	// Transport interface
+	public:
+		virtual void ExportTask(const std::wstring& taskname) = 0;
+		virtual bool Post(const std::wstring& taskname, std::vector<Byte>& message) = 0;
+	};
+
+
+	//
+	// Remote messaging state of a single program
+	//
+	class RemoteTaskTable
+	{
+	// Construction and destruction
+	public:
+		RemoteTaskTable();
+		~RemoteTaskTable();
+
+	// Configuration
+	public:
+		static bool IsEnabled();
+
+	// Task export
+	public:
+		void ExportTask(const std::wstring& taskname, Program* program);
+
+	// Message passing
+	public:
+		bool Send(Program* program, const std::wstring& taskname, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes, const HeapStorage& payload);
+		void DeliverMessage(const std::wstring& taskname, const std::vector<Byte>& message);
+
+	// Internal helpers
+	private:
+		void StartTransports(Program* program);
+
+	// Internal tracking
+	private:
+		Threads::CriticalSection CritSec;
+		std::vector<TaskTransport*> Transports;
+		bool TransportsStarted;
+
+	// Non-copyable
+	private:
+		RemoteTaskTable(const RemoteTaskTable&);
+		RemoteTaskTable& operator = (const RemoteTaskTable&);
+	};
+
+}
+
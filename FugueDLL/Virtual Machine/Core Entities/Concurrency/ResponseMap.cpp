@@ -8,23 +8,64 @@
 #include "pch.h"
 
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
+#include "Virtual Machine/Core Entities/Concurrency/MessageSignatures.h"
 
 #include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+
+#include "Utility/Threading/Lockless.h"
 
 
 using namespace VM;
 
 
+//
+// Construct and initialize a response map entry wrapper
+//
+ResponseMapEntry::ResponseMapEntry(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes, VM::Block* responseblock, VM::ScopeDescription* helperscope)
+	: MessageName(messagename),
+	  PayloadTypes(payloadtypes),
+	  Signature(MessageSignatures::Intern(messagename, payloadtypes)),
+	  ResponseBlock(responseblock),
+	  HelperScope(helperscope),
+	  CachedParameterScope(NULL)
+{ }
+
 //
 // Destruct and clean up a response map entry wrapper
 //
 ResponseMapEntry::~ResponseMapEntry()
 {
+	delete CachedParameterScope;
 	delete HelperScope;
 	delete ResponseBlock;
 }
 
+
+//
+// Take the entry's kept parameter scope for the duration of a dispatch
+//
+// As with Block::ScopeLease, a fresh scope is built if the kept one is
+// already in use, e.g. by a handler which accepts further messages.
+//
+ResponseMapEntry::ParameterScopeLease::ParameterScopeLease(const ResponseMapEntry& entry, ActivatedScope& parent)
+	: TheEntry(entry)
+{
+	TheScope = reinterpret_cast<ActivatedScope*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&entry.CachedParameterScope), NULL));
+	if(!TheScope)
+		TheScope = new ActivatedScope(*entry.ResponseBlock->GetBoundScope()->ParentScope);
+
+	TheScope->ParentScope = &parent;
+}
+
+ResponseMapEntry::ParameterScopeLease::~ParameterScopeLease()
+{
+	if(!Atomic::CompareAndSwapPointer(&TheEntry.CachedParameterScope, static_cast<ActivatedScope*>(NULL), TheScope))
+		delete TheScope;
+}
+
+
 //
 // Destruct and clean up a response map wrapper
 //
@@ -37,7 +78,21 @@ ResponseMap::~ResponseMap()
 //
 // Add a response map entry to the response map
 //
+// Entries are also indexed by message signature, so that dispatching
+// an incoming message is a single table lookup. If several entries
+// share a signature, the first one added takes precedence.
+//
 void ResponseMap::AddEntry(ResponseMapEntry* entry)
 {
 	ResponseEntries.push_back(entry);
+
+	MessageSignatureID signature = entry->GetSignature();
+	if(signature >= EntriesBySignature.size())
+		EntriesBySignature.resize(signature + 1, NULL);
+
+	if(!EntriesBySignature[signature])
+	{
+		EntriesBySignature[signature] = entry;
+		Signatures.push_back(signature);
+	}
 }
@@ -10,6 +10,7 @@
 
 // Dependencies
 #include "Utility/Types/EpochTypeIDs.h"
+#include "Utility/Types/IDTypes.h"
 #include "Virtual Machine/Core Entities/Operation.h"
 
 
@@ -17,18 +18,14 @@ namespace VM
 {
 	// Forward declarations
 	class Block;
+	class ActivatedScope;
 
 
 	class ResponseMapEntry
 	{
 	// Construction and destruction
 	public:
-		ResponseMapEntry(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes, VM::Block* responseblock, VM::ScopeDescription* helperscope)
-			: MessageName(messagename),
-			  PayloadTypes(payloadtypes),
-			  ResponseBlock(responseblock),
-			  HelperScope(helperscope)
-		{ }
+		ResponseMapEntry(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes, VM::Block* responseblock, VM::ScopeDescription* helperscope);
 
 		~ResponseMapEntry();
 
@@ -40,18 +37,44 @@ namespace VM
 		const std::list<EpochVariableTypeID>& GetPayloadTypes() const
 		{ return PayloadTypes; }
 
+		MessageSignatureID GetSignature() const
+		{ return Signature; }
+
 		VM::Block* GetResponseBlock() const
 		{ return ResponseBlock; }
 
 		VM::ScopeDescription* GetHelperScope() const
 		{ return HelperScope; }
 
+	// Activation of the response handler's parameters
+	//
+	// Long-lived server tasks accept the same messages over and over, so
+	// the entry keeps the activated parameter scope around between
+	// dispatches, in the same way that blocks keep their own activated
+	// scopes (see Block::ScopeLease).
+	public:
+		class ParameterScopeLease
+		{
+		public:
+			ParameterScopeLease(const ResponseMapEntry& entry, ActivatedScope& parent);
+			~ParameterScopeLease();
+
+			ActivatedScope& GetScope()
+			{ return *TheScope; }
+
+		private:
+			const ResponseMapEntry& TheEntry;
+			ActivatedScope* TheScope;
+		};
+
 	// Internal tracking
 	private:
 		const std::wstring& MessageName;
 		std::list<EpochVariableTypeID> PayloadTypes;
+		MessageSignatureID Signature;
 		VM::Block* ResponseBlock;
 		VM::ScopeDescription* HelperScope;
+		mutable ActivatedScope* volatile CachedParameterScope;
 	};
 
 	class ResponseMap
@@ -67,9 +90,30 @@ namespace VM
 		const std::vector<ResponseMapEntry*>& GetEntries() const
 		{ return ResponseEntries; }
 
+	// Dispatch interface
+	public:
+		//
+		// Retrieve the entry which responds to messages with the given
+		// signature, or NULL if the map does not handle the message
+		//
+		const ResponseMapEntry* FindEntry(MessageSignatureID signature) const
+		{
+			if(signature >= EntriesBySignature.size())
+				return NULL;
+			return EntriesBySignature[signature];
+		}
+
+		//
+		// Retrieve the distinct signatures of all messages handled by the map
+		//
+		const std::vector<MessageSignatureID>& GetSignatures() const
+		{ return Signatures; }
+
 	// Internal tracking
 	private:
 		std::vector<ResponseMapEntry*> ResponseEntries;
+		std::vector<ResponseMapEntry*> EntriesBySignature;
+		std::vector<MessageSignatureID> Signatures;
 	};
 
 }
@@ -0,0 +1,194 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Transport carrying task messages between processes on the same machine
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Concurrency/SharedMemoryTransport.h"
+
+#include "Utility/Threading/SharedMailbox.h"
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+#include "User Interface/Output.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+	// Number of handles the bridge waits on besides the mailbox events
+	const size_t NumBridgeControlHandles = 2;
+}
+
+
+//
+// Construct and initialize the transport
+//
+// The bridge thread is not started until the first task is exported.
+//
+SharedMemoryTransport::SharedMemoryTransport(RemoteTaskTable& owner, Program* program)
+	: Owner(owner),
+	  BridgeProgram(program),
+	  BridgeThread(NULL),
+	  StopEvent(NULL),
+	  RefreshEvent(NULL)
+{
+}
+
+//
+// Stop the bridge thread, and release all shared mailboxes
+//
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+	if(BridgeThread)
+	{
+		::SetEvent(StopEvent);
+		::WaitForSingleObject(BridgeThread, INFINITE);
+		::CloseHandle(BridgeThread);
+		::CloseHandle(StopEvent);
+		::CloseHandle(RefreshEvent);
+	}
+
+	for(MailboxMap::iterator iter = ExportedMailboxes.begin(); iter != ExportedMailboxes.end(); ++iter)
+		delete iter->second;
+
+	for(MailboxMap::iterator iter = RemoteMailboxes.begin(); iter != RemoteMailboxes.end(); ++iter)
+		delete iter->second;
+}
+
+
+//
+// Create a shared mailbox for a task, so other processes can reach it
+//
+// A task which is forked again under the same name keeps its existing
+// mailbox.
+//
+void SharedMemoryTransport::ExportTask(const std::wstring& taskname)
+{
+	Threads::CriticalSection::Auto lock(CritSec);
+
+	if(ExportedMailboxes.find(taskname) != ExportedMailboxes.end())
+		return;
+
+	if(ExportedMailboxes.size() >= MAXIMUM_WAIT_OBJECTS - NumBridgeControlHandles)
+		throw Threads::ThreadException("Too many tasks in this program share their mailboxes with other processes");
+
+	ExportedMailboxes[taskname] = Threads::SharedMailbox::Create(taskname, Config::NumMessageSlots, Config::SharedMessageSize);
+
+	if(!BridgeThread)
+	{
+		StopEvent = ::CreateEvent(NULL, true, false, NULL);
+		RefreshEvent = ::CreateEvent(NULL, false, false, NULL);
+		BridgeThread = ::CreateThread(NULL, 0, BridgeThreadProc, this, 0, NULL);
+		if(!BridgeThread)
+			throw Threads::ThreadException("Failed to start the thread relaying messages from other processes");
+	}
+	else
+		::SetEvent(RefreshEvent);
+}
+
+//
+// Post an encoded message to a task exported by another process
+//
+// Returns false if no process shares a mailbox under the given task name.
+//
+bool SharedMemoryTransport::Post(const std::wstring& taskname, std::vector<Byte>& message)
+{
+	Threads::SharedMailbox* mailbox = OpenRemoteMailbox(taskname);
+	if(!mailbox)
+		return false;
+
+	if(!mailbox->Post(&message[0], message.size()))
+		throw Threads::ThreadException("The mailbox of the task in the other process is full");
+
+	return true;
+}
+
+//
+// Look up the shared mailbox of a task in another process
+//
+// Mailboxes are kept open once found, so only the first message sent to
+// each remote task pays for opening the mapping.
+//
+Threads::SharedMailbox* SharedMemoryTransport::OpenRemoteMailbox(const std::wstring& taskname)
+{
+	Threads::CriticalSection::Auto lock(CritSec);
+
+	MailboxMap::const_iterator iter = RemoteMailboxes.find(taskname);
+	if(iter != RemoteMailboxes.end())
+		return iter->second;
+
+	Threads::SharedMailbox* mailbox = Threads::SharedMailbox::Open(taskname);
+	if(mailbox)
+		RemoteMailboxes[taskname] = mailbox;
+
+	return mailbox;
+}
+
+
+//
+// Entry point of the bridge thread
+//
+DWORD __stdcall SharedMemoryTransport::BridgeThreadProc(void* param)
+{
+	reinterpret_cast<SharedMemoryTransport*>(param)->RunBridge();
+	return 0;
+}
+
+//
+// Relay messages from the exported mailboxes until the transport is destroyed
+//
+// The bridge drains every exported mailbox each time it wakes up, so a
+// wakeup which covers several posted messages loses none of them. The
+// wait list is rebuilt whenever another task is exported.
+//
+void SharedMemoryTransport::RunBridge()
+{
+	Threads::ProgramBinding binding(BridgeProgram);
+
+	std::vector<std::pair<std::wstring, Threads::SharedMailbox*> > mailboxes;
+	std::vector<HANDLE> handles;
+	std::vector<Byte> message;
+
+	while(true)
+	{
+		{
+			Threads::CriticalSection::Auto lock(CritSec);
+			mailboxes.assign(ExportedMailboxes.begin(), ExportedMailboxes.end());
+		}
+
+		handles.clear();
+		handles.push_back(StopEvent);
+		handles.push_back(RefreshEvent);
+		for(size_t i = 0; i < mailboxes.size(); ++i)
+			handles.push_back(mailboxes[i].second->GetMessageEvent());
+
+		for(size_t i = 0; i < mailboxes.size(); ++i)
+		{
+			while(mailboxes[i].second->Take(message))
+			{
+				try
+				{
+					Owner.DeliverMessage(mailboxes[i].first, message);
+				}
+				catch(const std::exception& e)
+				{
+					UI::OutputStream output;
+					output << UI::lightred << L"WARNING - discarded a message from another process: ";
+					output << e.what() << std::endl << UI::resetcolor;
+				}
+			}
+		}
+
+		if(::WaitForMultipleObjects(static_cast<DWORD>(handles.size()), &handles[0], false, INFINITE) == WAIT_OBJECT_0)
+			return;
+	}
+}
+
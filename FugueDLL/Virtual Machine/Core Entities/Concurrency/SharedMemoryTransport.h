@@ -0,0 +1,68 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Transport carrying task messages between processes on the same machine
+//
+// Each exported task gets a shared mailbox under its own name (see
+// SharedMailbox.h), which other VM processes on the machine open in order
+// to post messages to the task. A single bridge thread per program waits
+// on the shared mailboxes of all of the program's exported tasks, and
+// hands each incoming message back to the owning RemoteTaskTable for
+// delivery.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
+
+
+// Forward declarations
+namespace Threads
+{
+	class SharedMailbox;
+}
+
+
+namespace VM
+{
+
+	class SharedMemoryTransport : public TaskTransport
+	{
+	// Construction and destruction
+	public:
+		SharedMemoryTransport(RemoteTaskTable& owner, Program* program);
+		virtual ~SharedMemoryTransport();
+
+	// Transport interface
+	public:
+		virtual void ExportTask(const std::wstring& taskname);
+		virtual bool Post(const std::wstring& taskname, std::vector<Byte>& message);
+
+	// Internal helpers
+	private:
+		static DWORD __stdcall BridgeThreadProc(void* param);
+		void RunBridge();
+
+		Threads::SharedMailbox* OpenRemoteMailbox(const std::wstring& taskname);
+
+	// Internal tracking
+	private:
+		typedef std::map<std::wstring, Threads::SharedMailbox*> MailboxMap;
+
+		RemoteTaskTable& Owner;
+		Program* BridgeProgram;
+
+		Threads::CriticalSection CritSec;
+		MailboxMap ExportedMailboxes;
+		MailboxMap RemoteMailboxes;
+
+		HANDLE BridgeThread;
+		HANDLE StopEvent;
+		HANDLE RefreshEvent;
+	};
+
+}
+
@@ -9,9 +9,23 @@
 
 #include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Types/CompositeType.h"
+#include "Virtual Machine/Core Entities/Types/Tuple.h"
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/JIT/NativeCompiler.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
 
 #include "Virtual Machine/SelfAware.inl"
 
+#include "Utility/Memory/Stack.h"
+#include "Utility/Threading/Lockless.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 
@@ -23,7 +37,16 @@ Function::Function(Program& program, Block* codeblock, ScopeDescription* params,
 	: CodeBlock(codeblock),
 	  Params(params),
 	  Returns(returns),
-	  RunningProgram(&program)
+	  RunningProgram(&program),
+	  Placement(ReturnPlacement_Unknown),
+	  ReturnTupleTypeID(0),
+	  InlineCalls(false),
+	  CachedActivation(NULL),
+	  NativeState(NativeCode_Interpreted),
+	  Hotness(0),
+	  NativeCode(NULL),
+	  HasFingerprint(false),
+	  SourceFingerprint(0)
 {
 }
 
@@ -32,6 +55,8 @@ Function::Function(Program& program, Block* codeblock, ScopeDescription* params,
 //
 Function::~Function()
 {
+	delete CachedActivation;
+	delete NativeCode;
 	delete CodeBlock;
 	delete Params;
 	delete Returns;
@@ -42,30 +67,363 @@ Function::~Function()
 //
 RValuePtr Function::Invoke(ExecutionContext& context)
 {
-	std::auto_ptr<ActivatedScope> paramclone(new ActivatedScope(*Params));
-	std::auto_ptr<ActivatedScope> returnclone(new ActivatedScope(*Returns));
+	if(DeferredSource)
+		LoadDeferredCodeBlock();
 
-	paramclone->BindToStack(context.Stack);
-	returnclone->Enter(context.Stack);
+	if(InlineCalls)
+	{
+		ActivationLease lease(*this);
+		return InvokeInActivation(context, lease.GetActivation());
+	}
 
-	std::auto_ptr<ActivatedScope> codescope(new ActivatedScope(*CodeBlock->GetBoundScope()));
-	codescope->TaskOrigin = context.Scope.TaskOrigin;
-	codescope->LastMessageOrigin = context.Scope.LastMessageOrigin;
-	codescope->ParentScope = &context.Scope;
-	codescope->PushNewGhostSet();
-	paramclone->GhostIntoScope(*codescope);
-	returnclone->GhostIntoScope(*codescope);
+	Activation activation(*this);
+	return InvokeInActivation(context, activation);
+}
 
-	CodeBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *codescope, context.Stack, context.FlowResult), NULL);
-	RValuePtr ret(returnclone->GetEffectiveTuple());
-	codescope->Exit(context.Stack);
-	
-	returnclone->Exit(context.Stack);
-	paramclone->Exit(context.Stack);
-	codescope->PopGhostSet();
+//
+// Helper for running the function's code within the given activation
+//
+RValuePtr Function::InvokeInActivation(ExecutionContext& context, Activation& activation)
+{
+	EnterActivation(context, activation);
+
+	ExecuteBody(context, activation);
+	RValuePtr ret(activation.ReturnScope.GetEffectiveTuple());
+
+	ExitActivation(context, activation);
 	return ret;
 }
 
+//
+// Invoke the function and push its return value onto the stack
+//
+// The caller's stack serves as the destination slot for the return value;
+// once the body has run, the return value is moved straight out of the
+// return variables and into the space it will occupy after the function's
+// frames have been released. This avoids building an r-value for the
+// result (and one more per member for tuples) only to have the caller
+// push it back onto the stack, which matters most when the function is
+// called repeatedly, e.g. by map(), or its result is assigned directly
+// into a variable.
+//
+// Values which cannot be moved this way (such as unassigned strings) are
+// passed back through the usual r-value path. Returns false without doing
+// anything if the function's return type can never be placed directly.
+//
+bool Function::InvokeAndPushResult(ExecutionContext& context)
+{
+	if(Placement == ReturnPlacement_Unknown)
+		DetermineReturnPlacement();
+
+	if(Placement == ReturnPlacement_Unsupported)
+		return false;
+
+	if(DeferredSource)
+		LoadDeferredCodeBlock();
+
+	if(InlineCalls)
+	{
+		ActivationLease lease(*this);
+		InvokeAndPushResultInActivation(context, lease.GetActivation());
+	}
+	else
+	{
+		Activation activation(*this);
+		InvokeAndPushResultInActivation(context, activation);
+	}
+
+	return true;
+}
+
+//
+// Helper for running the function's code within the given activation,
+// and then pushing its return value onto the stack
+//
+void Function::InvokeAndPushResultInActivation(ExecutionContext& context, Activation& activation)
+{
+	Byte* callertop = reinterpret_cast<Byte*>(context.Stack.GetCurrentTopOfStack());
+
+	EnterActivation(context, activation);
+
+	ExecuteBody(context, activation);
+
+	// The return value is first gathered into a block on top of the stack,
+	// and then moved down to its final location. The frames are dead at
+	// this point, and popping them only touches the space below the final
+	// location, so the value survives the exits intact.
+	RValuePtr ret;
+	size_t resultsize = PushReturnValue(activation.ReturnScope, context.Stack);
+	if(resultsize)
+		memmove(callertop + activation.ParamScope.GetStackUsage() - resultsize, context.Stack.GetCurrentTopOfStack(), resultsize);
+	else
+		ret = activation.ReturnScope.GetEffectiveTuple();
+
+	ExitActivation(context, activation);
+
+	if(!resultsize)
+		Operations::PushOperation::DoPush(GetType(context.Scope.GetOriginalDescription()), ret.get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+}
+
+//
+// Helper for running the function's body within an entered activation
+//
+// The body reports its flow control results through its own context, so
+// that a return from the function does not also end the caller's block.
+//
+// Each time the body ends by making a tail call to the function itself,
+// the new parameters are already in place in the parameter frame (see
+// BeginTailCall), and the body is simply run again.
+//
+// If the function has been compiled to native code, the body is run that
+// way instead, unless the native code hands the call back.
+//
+void Function::ExecuteBody(ExecutionContext& context, Activation& activation)
+{
+	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+	ExecutionContext bodycontext(context, activation.CodeScope, flowresult);
+	Profiler::FrameTracker profiling(context.Profile, *this);
+
+	if(ExecuteNativeBody(activation))
+		return;
+
+	CodeBlock->ExecuteBlock(bodycontext, NULL);
+	while(activation.CodeScope.TailCallPending)
+	{
+		activation.CodeScope.TailCallPending = false;
+		activation.CodeScope.Exit(context.Stack);
+
+		flowresult = FLOWCONTROL_NORMAL;
+		CodeBlock->ExecuteBlock(bodycontext, NULL);
+	}
+}
+
+//
+// Run the function's body as native code, if possible
+//
+// Until the function has been compiled, each call counts towards its
+// hotness, as does each iteration of the loops in its body. The first
+// call to find the function hot enough compiles it; if compilation is
+// not possible, the function is left to the interpreter from then on.
+//
+// Returns false if the body must be run by the interpreter. Native code
+// does not touch the activation unless it completes successfully, so the
+// interpreter can always run the call from the start.
+//
+bool Function::ExecuteNativeBody(Activation& activation)
+{
+	LONG state = Atomic::LoadAcquire(&NativeState);
+	if(state == NativeCode_Compiled)
+		return NativeCode->Execute(activation.ParamScope, activation.ReturnScope);
+
+	if(state != NativeCode_Interpreted || !Config::UseJITCompiler || Instrumentation::IsActive())
+		return false;
+
+	LONG hotness = ::InterlockedIncrement(&Hotness);
+	if(hotness == 1)
+		JIT::AttachHotnessCounter(*CodeBlock, &Hotness);
+
+	if(static_cast<unsigned>(hotness) < Config::JITThreshold)
+		return false;
+
+	if(::InterlockedCompareExchange(&NativeState, NativeCode_Compiling, NativeCode_Interpreted) != NativeCode_Interpreted)
+		return false;
+
+	// Running out of executable memory only means the function
+	// cannot be compiled; it can still be run as usual
+	try
+	{
+		NativeCode = JIT::CompileFunction(*CodeBlock, *Params, *Returns);
+	}
+	catch(MemoryException&)
+	{
+		NativeCode = NULL;
+	}
+
+	::InterlockedExchange(&NativeState, NativeCode ? NativeCode_Compiled : NativeCode_Unsupported);
+	if(!NativeCode)
+		return false;
+
+	return NativeCode->Execute(activation.ParamScope, activation.ReturnScope);
+}
+
+//
+// Use the given native code for the function's body from now on
+//
+// The function takes ownership of the code. Returns false, leaving the
+// code to the caller, if the function already has native code or has
+// been found not to support it.
+//
+bool Function::BindNativeCode(JIT::NativeFunction* code)
+{
+	if(NativeState != NativeCode_Interpreted)
+		return false;
+
+	NativeCode = code;
+	::InterlockedExchange(&NativeState, NativeCode_Compiled);
+	return true;
+}
+
+//
+// Release the function's native code, if any
+//
+// This must be done whenever the function's code block is replaced,
+// since the native code was compiled from the old block.
+//
+void Function::DiscardNativeCode()
+{
+	delete NativeCode;
+	NativeCode = NULL;
+	NativeState = NativeCode_Interpreted;
+	Hotness = 0;
+}
+
+
+//
+// Hand a tail call to the function over to its running invocation
+//
+// This is used by calls the optimizer has identified as self-recursive
+// tail calls. The parameters for the call have been pushed onto the stack
+// in the same layout as the parameter frame, so they are copied over the
+// current parameters, and the running body is told to return and start
+// over. Returns false (leaving the stack untouched) if the call is not
+// being made directly from the function's own body, in which case the
+// call should be performed as usual.
+//
+bool Function::BeginTailCall(ExecutionContext& context)
+{
+	ActivatedScope* paramframe = context.Scope.GetLinkedParamFrame();
+	if(!paramframe || &paramframe->GetOriginalDescription() != Params || !paramframe->GetParameterStorage())
+		return false;
+
+	size_t paramsize = paramframe->GetStackUsage();
+	memmove(paramframe->GetParameterStorage(), context.Stack.GetCurrentTopOfStack(), paramsize);
+	context.Stack.Pop(paramsize);
+
+	context.Scope.TailCallPending = true;
+	context.FlowResult = FLOWCONTROL_RETURN;
+	return true;
+}
+
+//
+// Determine how the function's return value can be placed onto the stack
+//
+// Single return values of any plain type (including structures and tuples
+// which can be block copied) are copied as-is. Multiple return values form
+// a tuple, which is assembled member by member; this is limited to members
+// which are plain values or string handles.
+//
+void Function::DetermineReturnPlacement()
+{
+	const std::vector<std::wstring>& members = Returns->GetMemberOrder();
+
+	ReturnPlacement placement = ReturnPlacement_Unsupported;
+	if(members.size() == 1)
+	{
+		switch(Returns->GetVariableType(members.front()))
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+		case EpochVariableType_String:
+		case EpochVariableType_Structure:
+		case EpochVariableType_Tuple:
+			placement = ReturnPlacement_Single;
+			break;
+		}
+	}
+	else if(members.size() > 1)
+	{
+		ReturnTupleTypeID = TupleTrackerClass::LookForMatchingTupleType(*Returns);
+		if(ReturnTupleTypeID != TupleTrackerClass::InvalidID)
+		{
+			placement = ReturnPlacement_Tuple;
+			for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
+			{
+				switch(Returns->GetVariableType(*iter))
+				{
+				case EpochVariableType_Integer:
+				case EpochVariableType_Integer16:
+				case EpochVariableType_Real:
+				case EpochVariableType_Boolean:
+				case EpochVariableType_String:
+					break;
+
+				default:
+					placement = ReturnPlacement_Unsupported;
+					break;
+				}
+			}
+		}
+	}
+
+	Placement = placement;
+}
+
+//
+// Push a copy of the function's return value onto the stack
+//
+// Returns the number of bytes pushed, or 0 (with nothing pushed) if the
+// value cannot be copied directly. The return variables are about to be
+// released, so any handles they hold are simply moved rather than shared.
+//
+size_t Function::PushReturnValue(ActivatedScope& returnclone, StackSpace& stack) const
+{
+	const std::vector<std::wstring>& members = Returns->GetMemberOrder();
+
+	if(Placement == ReturnPlacement_Single)
+	{
+		const Variable& var = returnclone.GetVariableRef(members.front());
+
+		size_t size;
+		if(var.GetType() == EpochVariableType_Structure || var.GetType() == EpochVariableType_Tuple)
+		{
+			IDType id = *reinterpret_cast<const IDType*>(var.GetStorage());
+			if(!id)
+				return 0;
+
+			const CompositeType& type = CompositeType::GetCompositeType(var.GetType(), id);
+			if(!type.CanCopyAsBlock(var.GetStorage()))
+				return 0;
+
+			size = type.GetTotalSize();
+		}
+		else
+		{
+			if(var.GetType() == EpochVariableType_String && !StringVariable(var.GetStorage()).GetHandleValue())
+				return 0;
+
+			size = TypeInfo::GetStorageSize(var.GetType());
+		}
+
+		stack.Push(size);
+		memcpy(stack.GetCurrentTopOfStack(), var.GetStorage(), size);
+		return size;
+	}
+
+	for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
+	{
+		const Variable& var = returnclone.GetVariableRef(*iter);
+		if(var.GetType() == EpochVariableType_String && !StringVariable(var.GetStorage()).GetHandleValue())
+			return 0;
+	}
+
+	const CompositeType& tupletype = CompositeType::GetCompositeType(EpochVariableType_Tuple, ReturnTupleTypeID);
+	stack.Push(tupletype.GetTotalSize());
+
+	Byte* block = reinterpret_cast<Byte*>(stack.GetCurrentTopOfStack());
+	*reinterpret_cast<IDType*>(block) = ReturnTupleTypeID;
+
+	const std::vector<std::wstring>& tuplemembers = tupletype.GetMemberOrder();
+	for(std::vector<std::wstring>::const_iterator iter = tuplemembers.begin(); iter != tuplemembers.end(); ++iter)
+	{
+		const Variable& var = returnclone.GetVariableRef(*iter);
+		memcpy(block + tupletype.GetMemberOffset(*iter), var.GetStorage(), TypeInfo::GetStorageSize(var.GetType()));
+	}
+
+	return tupletype.GetTotalSize();
+}
+
 //
 // Invoke the function and execute its code
 //
@@ -75,29 +433,122 @@ RValuePtr Function::Invoke(ExecutionContext& context)
 //
 RValuePtr Function::InvokeWithExternalParams(ExecutionContext& context, void* externalstack)
 {
-	std::auto_ptr<ActivatedScope> paramclone(new ActivatedScope(*Params));
-	std::auto_ptr<ActivatedScope> returnclone(new ActivatedScope(*Returns));
+	// Parameters live on the external caller's stack, which is not
+	// visible to the garbage collector, so collection is held off for
+	// the lifetime of the call.
+	GarbageCollector::Deferral deferral;
+
+	if(DeferredSource)
+		LoadDeferredCodeBlock();
+
+	ActivatedScope paramclone(*Params);
+	ActivatedScope returnclone(*Returns);
+
+	paramclone.BindToMachineStack(externalstack);
+	returnclone.Enter(context.Stack);
 
-	paramclone->BindToMachineStack(externalstack);
-	returnclone->Enter(context.Stack);
+	ActivatedScope codescope(*CodeBlock->GetBoundScope(), &context.Scope);
+	codescope.LinkFunctionFrames(paramclone, returnclone);
 
-	std::auto_ptr<ActivatedScope> codescope(new ActivatedScope(*CodeBlock->GetBoundScope()));
-	codescope->ParentScope = &context.Scope;
-	codescope->PushNewGhostSet();
-	paramclone->GhostIntoScope(*codescope);
-	returnclone->GhostIntoScope(*codescope);
+	Profiler::FrameTracker profiling(context.Profile, *this);
 
 	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
-	CodeBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *codescope, context.Stack, flowresult), NULL);
-	RValuePtr ret(returnclone->GetEffectiveTuple());
-	codescope->Exit(context.Stack);
+	CodeBlock->ExecuteBlock(ExecutionContext(context, codescope, flowresult), NULL);
+	RValuePtr ret(returnclone.GetEffectiveTuple());
+	codescope.Exit(context.Stack);
 	
-	returnclone->Exit(context.Stack);
-	paramclone->ExitFromMachineStack();
-	codescope->PopGhostSet();
+	returnclone.Exit(context.Stack);
+	paramclone.ExitFromMachineStack();
 	return ret;
 }
 
+//
+// Bind an activation's scopes to the stack, ready to run the function's code
+//
+void Function::EnterActivation(ExecutionContext& context, Activation& activation)
+{
+	activation.ParamScope.BindToStack(context.Stack);
+	activation.ReturnScope.Enter(context.Stack);
+
+	activation.CodeScope.ParentScope = &context.Scope;
+	activation.CodeScope.TaskOrigin = context.Scope.TaskOrigin;
+	activation.CodeScope.LastMessageOrigin = context.Scope.LastMessageOrigin;
+}
+
+//
+// Release the stack space used by an activation's scopes
+//
+void Function::ExitActivation(ExecutionContext& context, Activation& activation)
+{
+	activation.CodeScope.Exit(context.Stack);
+	activation.ReturnScope.Exit(context.Stack);
+	activation.ParamScope.Exit(context.Stack);
+}
+
+//
+// Release the activation kept for inline calls, if any
+//
+// This must be done whenever the function's code block is replaced, since
+// the kept activation refers to the old block's scope.
+//
+void Function::DiscardCachedActivation()
+{
+	delete CachedActivation;
+	CachedActivation = NULL;
+}
+
+
+//
+// Construct a set of activated scopes for a call to the given function
+//
+Function::Activation::Activation(Function& function)
+	: ParamScope(*function.Params),
+	  ReturnScope(*function.Returns),
+	  CodeScope(*function.CodeBlock->GetBoundScope())
+{
+	CodeScope.LinkFunctionFrames(ParamScope, ReturnScope);
+}
+
+//
+// Take the function's kept activation for the duration of an inline call
+//
+// If the activation is already in use (by another thread, or further up
+// the call stack) a fresh activation is built instead. When the call is
+// over the activation is handed back, unless another one was handed back
+// in the meantime, in which case the extra activation is simply released.
+//
+Function::ActivationLease::ActivationLease(Function& function)
+	: TheFunction(function)
+{
+	TheActivation = reinterpret_cast<Activation*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&function.CachedActivation), NULL));
+	if(!TheActivation)
+		TheActivation = new Activation(function);
+}
+
+Function::ActivationLease::~ActivationLease()
+{
+	if(!Atomic::CompareAndSwapPointer(&TheFunction.CachedActivation, static_cast<Activation*>(NULL), TheActivation))
+		delete TheActivation;
+}
+
+
+//
+// Decode the function's code block, if its loading was deferred
+//
+// Loading happens at most once, the first time the code is needed;
+// concurrent callers wait for the first one to finish.
+//
+void Function::LoadDeferredCodeBlock()
+{
+	Threads::CriticalSection::Auto mutex(DeferredLoadCriticalSection);
+	if(!DeferredSource)
+		return;
+
+	DeferredSource->LoadDeferredCodeBlock(*this);
+	DeferredSource = NULL;
+}
+
+
 //
 // Retrieve the function's return type
 //
@@ -130,12 +581,24 @@ void Function::TraverseHelper(TraverserT& traverser)
 
 void Function::Traverse(Validator::ValidationTraverser& traverser)
 {
+	LoadDeferredCodeBlock();
 	TraverseHelper(traverser);
 }
 
 void Function::Traverse(Serialization::SerializationTraverser& traverser)
+{
+	LoadDeferredCodeBlock();
+	TraverseHelper(traverser);
+}
+
+//
+// Deferred code is optimized separately when it is loaded,
+// so the optimizer does not force it to be loaded here
+//
+void Function::Traverse(Optimizer::OptimizationTraverser& traverser)
 {
 	TraverseHelper(traverser);
+	traverser.ExitFunction(*this);
 }
 
 
@@ -11,6 +11,8 @@
 #include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/SelfAware.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Hashing.h"
 
 
 // Forward declarations
@@ -22,6 +24,11 @@ namespace VM
 	// Forward declarations
 	class ScopeDescription;
 
+	namespace JIT
+	{
+		class NativeFunction;
+	}
+
 	//
 	// Base class for all callable functions
 	//
@@ -39,6 +46,36 @@ namespace VM
 		virtual ScopeDescription& GetParams() = 0;
 		virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const = 0;
 		virtual EpochVariableTypeID GetTypeHint(const ScopeDescription& scope) const = 0;
+
+		//
+		// Invoke the function and write its result directly onto the stack
+		//
+		// As with Operation::ExecuteAndPushScalar, this returns false
+		// without doing anything if the result cannot be pushed this way.
+		//
+		virtual bool InvokeAndPushResult(ExecutionContext& context)
+		{ return false; }
+	};
+
+	// Forward declarations
+	class Function;
+
+	//
+	// Interface for objects which can supply a function's code block on demand
+	//
+	// Implementations must call SetCodeBlock on the function once its
+	// code has been produced.
+	//
+	class DeferredCodeSource
+	{
+	// Destruction
+	public:
+		virtual ~DeferredCodeSource()
+		{ }
+
+	// Loading interface
+	public:
+		virtual void LoadDeferredCodeBlock(Function& function) = 0;
 	};
 
 	//
@@ -55,6 +92,7 @@ namespace VM
 	public:
 		virtual RValuePtr Invoke(ExecutionContext& context);
 		virtual RValuePtr InvokeWithExternalParams(ExecutionContext& context, void* externalstack);
+		virtual bool InvokeAndPushResult(ExecutionContext& context);
 
 		virtual ScopeDescription& GetParams()
 		{ return *Params; }
@@ -74,11 +112,55 @@ namespace VM
 		{ return *Returns; }
 			
 		void SetCodeBlock(Block* block)
-		{ delete CodeBlock; CodeBlock = block; }
+		{ DiscardCachedActivation(); DiscardNativeCode(); delete CodeBlock; CodeBlock = block; }
 
 		const Block* GetCodeBlock() const
 		{ return CodeBlock; }
 
+	// Deferred loading of the function's code
+	public:
+		void SetDeferredCodeSource(DeferredCodeSource* source)
+		{ DeferredSource = source; }
+
+		void LoadDeferredCodeBlock();
+
+		bool HasDeferredCode() const
+		{ return (DeferredSource != NULL); }
+
+	// Source fingerprint
+	//
+	// Functions parsed from source carry a hash of their definition's
+	// text, so that the validator can recognize a function which has
+	// not changed since it last passed validation.
+	public:
+		void SetSourceFingerprint(Hashing::Hash64 fingerprint)
+		{ SourceFingerprint = fingerprint; HasFingerprint = true; }
+
+		bool HasSourceFingerprint() const
+		{ return HasFingerprint; }
+
+		Hashing::Hash64 GetSourceFingerprint() const
+		{ return SourceFingerprint; }
+
+	// Inline calls
+	//
+	// Functions which are called inline keep a set of activated scopes
+	// around between calls, instead of building a new set for each call;
+	// see the function inlining pass in the optimizer for details.
+	public:
+		void EnableInlineCalls()
+		{ InlineCalls = true; }
+
+		bool IsCalledInline() const
+		{ return InlineCalls; }
+
+	// Tail calls
+	//
+	// Calls which the function makes to itself in tail position reuse the
+	// running invocation's frames; see the tail call pass in the optimizer.
+	public:
+		bool BeginTailCall(ExecutionContext& context);
+
 	// Traversal
 	public:
 		template <typename TraverserT>
@@ -86,18 +168,101 @@ namespace VM
 
 		virtual void Traverse(Validator::ValidationTraverser& traverser);
 		virtual void Traverse(Serialization::SerializationTraverser& traverser);
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 	// Access to linked program
 	public:
 		Program& GetRunningProgram()
 		{ return *RunningProgram; }
 
+	// Activation of the function's scopes
+	protected:
+		struct Activation
+		{
+			explicit Activation(Function& function);
+
+			ActivatedScope ParamScope;
+			ActivatedScope ReturnScope;
+			ActivatedScope CodeScope;
+		};
+
+		class ActivationLease
+		{
+		public:
+			explicit ActivationLease(Function& function);
+			~ActivationLease();
+
+			Activation& GetActivation()
+			{ return *TheActivation; }
+
+		private:
+			Function& TheFunction;
+			Activation* TheActivation;
+		};
+
+		void EnterActivation(ExecutionContext& context, Activation& activation);
+		void ExitActivation(ExecutionContext& context, Activation& activation);
+		void DiscardCachedActivation();
+
+		RValuePtr InvokeInActivation(ExecutionContext& context, Activation& activation);
+		void InvokeAndPushResultInActivation(ExecutionContext& context, Activation& activation);
+		void ExecuteBody(ExecutionContext& context, Activation& activation);
+
+	// Native code
+	//
+	// Functions which become hot are compiled into native code, if
+	// possible; see NativeCompiler.h for details. Code compiled ahead
+	// of time can also be bound to the function before it first runs.
+	public:
+		bool BindNativeCode(JIT::NativeFunction* code);
+
+	protected:
+		bool ExecuteNativeBody(Activation& activation);
+		void DiscardNativeCode();
+
+	// Internal helpers
+	protected:
+		void DetermineReturnPlacement();
+		size_t PushReturnValue(ActivatedScope& returnclone, StackSpace& stack) const;
+
 	// Internal tracking
 	protected:
 		Block* CodeBlock;
 		ScopeDescription* Params;
 		ScopeDescription* Returns;
 		Program* RunningProgram;
+
+		enum ReturnPlacement
+		{
+			ReturnPlacement_Unknown,
+			ReturnPlacement_Unsupported,
+			ReturnPlacement_Single,
+			ReturnPlacement_Tuple
+		};
+
+		ReturnPlacement Placement;
+		IDType ReturnTupleTypeID;
+
+		bool InlineCalls;
+		Activation* volatile CachedActivation;
+
+		Threads::CriticalSection DeferredLoadCriticalSection;
+		DeferredCodeSource* volatile DeferredSource;
+
+		enum NativeCodeState
+		{
+			NativeCode_Interpreted,
+			NativeCode_Compiling,
+			NativeCode_Compiled,
+			NativeCode_Unsupported
+		};
+
+		volatile LONG NativeState;
+		volatile LONG Hotness;
+		JIT::NativeFunction* NativeCode;
+
+		bool HasFingerprint;
+		Hashing::Hash64 SourceFingerprint;
 	};
 
 }
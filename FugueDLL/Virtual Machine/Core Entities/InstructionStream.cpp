@@ -0,0 +1,273 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Linear instruction stream representation of a code block
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/InstructionStream.h"
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
+
+#include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Memory/Stack.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Push the value of a scalar variable onto the stack
+	//
+	template <class VarType>
+	void PushVariable(const Instruction& instruction, ExecutionContext& context)
+	{
+		typename VarType::BaseStorage value = context.Scope.GetVariableRef<VarType>(*instruction.Operand.Var.Slot, *instruction.Operand.Var.Name).GetValue();
+		context.Stack.Push(VarType::GetStorageSize());
+		VarType(context.Stack.GetCurrentTopOfStack()).SetValue(value);
+	}
+
+	//
+	// Pop the top of the stack into a scalar variable
+	//
+	template <class VarType>
+	void AssignVariable(const Instruction& instruction, ExecutionContext& context)
+	{
+		VarType temp(context.Stack.GetCurrentTopOfStack());
+		context.Scope.GetVariableRef<VarType>(*instruction.Operand.Var.Slot, *instruction.Operand.Var.Name).SetValue(temp.GetValue());
+		context.Stack.Pop(VarType::GetStorageSize());
+	}
+
+	//
+	// Combine the two scalar values on top of the stack
+	//
+	// The result is written over the first operand, which leaves the
+	// stack in the same state as popping both operands and pushing the
+	// result, without the redundant stack pointer adjustments.
+	//
+	template <ArithmeticOpType OpType, class VarType>
+	void ApplyArithmetic(StackSpace& stack)
+	{
+		VarType twovar(stack.GetCurrentTopOfStack());
+		VarType onevar(stack.GetOffsetIntoStack(VarType::GetStorageSize()));
+
+		switch(OpType)
+		{
+		case Arithmetic_Add:		onevar.SetValue(onevar.GetValue() + twovar.GetValue());		break;
+		case Arithmetic_Subtract:	onevar.SetValue(onevar.GetValue() - twovar.GetValue());		break;
+		case Arithmetic_Multiply:	onevar.SetValue(onevar.GetValue() * twovar.GetValue());		break;
+		case Arithmetic_Divide:		onevar.SetValue(onevar.GetValue() / twovar.GetValue());		break;
+		}
+
+		stack.Pop(VarType::GetStorageSize());
+	}
+
+	//
+	// Determine if an arithmetic operation works on two plain scalars
+	//
+	template <class OperationClass>
+	bool IsScalarArithmetic(const Operation* op)
+	{
+		const OperationClass* arithmeticop = dynamic_cast<const OperationClass*>(op);
+		if(!arithmeticop)
+			return false;
+
+		return (arithmeticop->GetNumParameters() == 2 && !arithmeticop->IsFirstArray() && !arithmeticop->IsSecondArray());
+	}
+
+}
+
+
+//
+// Construct an instruction stream from the operations of a code block
+//
+// The given scope should be the scope bound to the block, so that
+// variable types can be looked up for the operations being encoded.
+//
+InstructionStream::InstructionStream(const std::vector<Operation*>& operations, const ScopeDescription& scope)
+{
+	Instructions.reserve(operations.size());
+	for(std::vector<Operation*>::const_iterator iter = operations.begin(); iter != operations.end(); ++iter)
+		Instructions.push_back(Encode(*iter, scope));
+}
+
+
+//
+// Select the most specific encoding available for the given operation
+//
+Instruction InstructionStream::Encode(Operation* op, const ScopeDescription& scope)
+{
+	Instruction instruction;
+	instruction.Opcode = Instruction_Execute;
+	instruction.Op = op;
+
+	if(const PushIntegerLiteral* push = dynamic_cast<const PushIntegerLiteral*>(op))
+	{
+		instruction.Opcode = Instruction_PushInteger;
+		instruction.Operand.IntegerValue = push->GetValue();
+	}
+	else if(const PushInteger16Literal* push = dynamic_cast<const PushInteger16Literal*>(op))
+	{
+		instruction.Opcode = Instruction_PushInteger16;
+		instruction.Operand.Integer16Value = push->GetValue();
+	}
+	else if(const PushRealLiteral* push = dynamic_cast<const PushRealLiteral*>(op))
+	{
+		instruction.Opcode = Instruction_PushReal;
+		instruction.Operand.RealValue = push->GetValue();
+	}
+	else if(const PushBooleanLiteral* push = dynamic_cast<const PushBooleanLiteral*>(op))
+	{
+		instruction.Opcode = Instruction_PushBoolean;
+		instruction.Operand.BooleanValue = push->GetValue();
+	}
+	else if(const AssignValue* assign = dynamic_cast<const AssignValue*>(op))
+	{
+		if(!assign->GetVariableSlot().IsResolved())
+			return instruction;
+
+		switch(scope.GetVariableType(assign->GetAssociatedIdentifier()))
+		{
+		case EpochVariableType_Integer:		instruction.Opcode = Instruction_AssignInteger;		break;
+		case EpochVariableType_Integer16:	instruction.Opcode = Instruction_AssignInteger16;	break;
+		case EpochVariableType_Real:		instruction.Opcode = Instruction_AssignReal;		break;
+		case EpochVariableType_Boolean:		instruction.Opcode = Instruction_AssignBoolean;		break;
+		default:							return instruction;
+		}
+
+		instruction.Operand.Var.Slot = &assign->GetVariableSlot();
+		instruction.Operand.Var.Name = &assign->GetAssociatedIdentifier();
+	}
+	else if(dynamic_cast<const PushOperation*>(op))
+	{
+		const Operation* nested = op->GetNestedOperation();
+
+		if(const GetVariableValue* getvalue = dynamic_cast<const GetVariableValue*>(nested))
+		{
+			if(!getvalue->GetVariableSlot().IsResolved())
+				return instruction;
+
+			switch(getvalue->GetType(scope))
+			{
+			case EpochVariableType_Integer:		instruction.Opcode = Instruction_PushIntegerVariable;		break;
+			case EpochVariableType_Integer16:	instruction.Opcode = Instruction_PushInteger16Variable;		break;
+			case EpochVariableType_Real:		instruction.Opcode = Instruction_PushRealVariable;			break;
+			case EpochVariableType_Boolean:		instruction.Opcode = Instruction_PushBooleanVariable;		break;
+			default:							return instruction;
+			}
+
+			instruction.Operand.Var.Slot = &getvalue->GetVariableSlot();
+			instruction.Operand.Var.Name = &getvalue->GetAssociatedIdentifier();
+		}
+		else if(IsScalarArithmetic<SumIntegers>(nested))
+			instruction.Opcode = Instruction_AddIntegers;
+		else if(IsScalarArithmetic<SubtractIntegers>(nested))
+			instruction.Opcode = Instruction_SubtractIntegers;
+		else if(IsScalarArithmetic<MultiplyIntegers>(nested))
+			instruction.Opcode = Instruction_MultiplyIntegers;
+		else if(IsScalarArithmetic<DivideIntegers>(nested))
+			instruction.Opcode = Instruction_DivideIntegers;
+		else if(IsScalarArithmetic<SumReals>(nested))
+			instruction.Opcode = Instruction_AddReals;
+		else if(IsScalarArithmetic<SubtractReals>(nested))
+			instruction.Opcode = Instruction_SubtractReals;
+		else if(IsScalarArithmetic<MultiplyReals>(nested))
+			instruction.Opcode = Instruction_MultiplyReals;
+		else if(IsScalarArithmetic<DivideReals>(nested))
+			instruction.Opcode = Instruction_DivideReals;
+	}
+
+	return instruction;
+}
+
+
+//
+// Execute the instructions in the stream, starting from the given index
+//
+// This mirrors the logic of Block::ExecuteBlock, including the handling
+// of flow control results; note that only generic instructions can alter
+// the flow of execution, so the other instructions skip the check.
+//
+void InstructionStream::Execute(ExecutionContext& context, size_t skipinstructions) const
+{
+	StackSpace& stack = context.Stack;
+
+	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+	ExecutionContext opcontext(context, flowresult);
+	Profiler::OperationTracker profiling(context.Profile);
+
+	const size_t numinstructions = Instructions.size();
+	for(size_t i = skipinstructions; i < numinstructions; ++i)
+	{
+		const Instruction& instruction = Instructions[i];
+		switch(instruction.Opcode)
+		{
+		case Instruction_Execute:
+			profiling.SetOperation(instruction.Op);
+			if(Instrumentation::IsActive())
+				Instrumentation::ExecuteOperation(*instruction.Op, opcontext);
+			else
+				instruction.Op->ExecuteFast(opcontext);
+			if(flowresult != FLOWCONTROL_NORMAL)
+			{
+				context.FlowResult = flowresult;
+				return;
+			}
+			break;
+
+		case Instruction_PushInteger:
+			stack.Push(IntegerVariable::GetStorageSize());
+			IntegerVariable(stack.GetCurrentTopOfStack()).SetValue(instruction.Operand.IntegerValue);
+			break;
+		case Instruction_PushInteger16:
+			stack.Push(Integer16Variable::GetStorageSize());
+			Integer16Variable(stack.GetCurrentTopOfStack()).SetValue(instruction.Operand.Integer16Value);
+			break;
+		case Instruction_PushReal:
+			stack.Push(RealVariable::GetStorageSize());
+			RealVariable(stack.GetCurrentTopOfStack()).SetValue(instruction.Operand.RealValue);
+			break;
+		case Instruction_PushBoolean:
+			stack.Push(BooleanVariable::GetStorageSize());
+			BooleanVariable(stack.GetCurrentTopOfStack()).SetValue(instruction.Operand.BooleanValue);
+			break;
+
+		case Instruction_PushIntegerVariable:		PushVariable<IntegerVariable>(instruction, context);		break;
+		case Instruction_PushInteger16Variable:		PushVariable<Integer16Variable>(instruction, context);		break;
+		case Instruction_PushRealVariable:			PushVariable<RealVariable>(instruction, context);			break;
+		case Instruction_PushBooleanVariable:		PushVariable<BooleanVariable>(instruction, context);		break;
+
+		case Instruction_AssignInteger:				AssignVariable<IntegerVariable>(instruction, context);		break;
+		case Instruction_AssignInteger16:			AssignVariable<Integer16Variable>(instruction, context);	break;
+		case Instruction_AssignReal:				AssignVariable<RealVariable>(instruction, context);			break;
+		case Instruction_AssignBoolean:				AssignVariable<BooleanVariable>(instruction, context);		break;
+
+		case Instruction_AddIntegers:				ApplyArithmetic<Arithmetic_Add, IntegerVariable>(stack);		break;
+		case Instruction_SubtractIntegers:			ApplyArithmetic<Arithmetic_Subtract, IntegerVariable>(stack);	break;
+		case Instruction_MultiplyIntegers:			ApplyArithmetic<Arithmetic_Multiply, IntegerVariable>(stack);	break;
+		case Instruction_DivideIntegers:			ApplyArithmetic<Arithmetic_Divide, IntegerVariable>(stack);		break;
+
+		case Instruction_AddReals:					ApplyArithmetic<Arithmetic_Add, RealVariable>(stack);			break;
+		case Instruction_SubtractReals:				ApplyArithmetic<Arithmetic_Subtract, RealVariable>(stack);		break;
+		case Instruction_MultiplyReals:				ApplyArithmetic<Arithmetic_Multiply, RealVariable>(stack);		break;
+		case Instruction_DivideReals:				ApplyArithmetic<Arithmetic_Divide, RealVariable>(stack);		break;
+
+		default:
+			throw InternalFailureException("Unrecognized instruction in instruction stream");
+		}
+	}
+}
+
@@ -0,0 +1,127 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Linear instruction stream representation of a code block
+//
+// Executing a block normally means walking its list of operation
+// objects and dispatching a virtual call to each one. The operations
+// are allocated individually, so the walk touches memory scattered
+// all over the heap, and even trivial operations like pushing a
+// literal pay for the virtual dispatch and r-value construction.
+//
+// An instruction stream is an alternative, flattened encoding of the
+// same block: a contiguous array of fixed-width instructions, one per
+// operation, executed by a single switch-based dispatch loop. Common
+// simple operations (literal pushes, scalar variable reads/writes, and
+// scalar arithmetic) are encoded directly with their operands inline;
+// everything else is encoded as a generic instruction that defers to
+// the original operation object. Since there is exactly one instruction
+// per operation, the stream can be started at any operation index.
+//
+// Streams are generated ahead of execution by the optimizer when the
+// instruction stream engine is enabled in the runtime options.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/ExecutionContext.h"
+
+
+// Forward declarations
+class StackSpace;
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Operation;
+	class ScopeDescription;
+	struct VariableSlot;
+
+
+	//
+	// Operation codes understood by the instruction stream interpreter
+	//
+	enum InstructionOpcode
+	{
+		Instruction_Execute,				// Defer to the original operation object
+
+		Instruction_PushInteger,
+		Instruction_PushInteger16,
+		Instruction_PushReal,
+		Instruction_PushBoolean,
+
+		Instruction_PushIntegerVariable,
+		Instruction_PushInteger16Variable,
+		Instruction_PushRealVariable,
+		Instruction_PushBooleanVariable,
+
+		Instruction_AssignInteger,
+		Instruction_AssignInteger16,
+		Instruction_AssignReal,
+		Instruction_AssignBoolean,
+
+		Instruction_AddIntegers,
+		Instruction_SubtractIntegers,
+		Instruction_MultiplyIntegers,
+		Instruction_DivideIntegers,
+
+		Instruction_AddReals,
+		Instruction_SubtractReals,
+		Instruction_MultiplyReals,
+		Instruction_DivideReals
+	};
+
+
+	//
+	// Fixed-width encoding of a single instruction
+	//
+	struct Instruction
+	{
+		InstructionOpcode Opcode;
+		Operation* Op;
+
+		union
+		{
+			Integer32 IntegerValue;
+			Integer16 Integer16Value;
+			Real RealValue;
+			bool BooleanValue;
+
+			struct
+			{
+				const VariableSlot* Slot;
+				const std::wstring* Name;
+			} Var;
+		} Operand;
+	};
+
+
+	//
+	// Flattened, directly executable form of a code block
+	//
+	class InstructionStream
+	{
+	// Construction
+	public:
+		InstructionStream(const std::vector<Operation*>& operations, const ScopeDescription& scope);
+
+	// Execution interface
+	public:
+		void Execute(ExecutionContext& context, size_t skipinstructions) const;
+
+	// Internal helpers
+	private:
+		static Instruction Encode(Operation* op, const ScopeDescription& scope);
+
+	// Internal tracking
+	private:
+		std::vector<Instruction> Instructions;
+	};
+
+}
+
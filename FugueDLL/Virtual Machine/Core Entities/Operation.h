@@ -11,6 +11,13 @@
 // an RValuePtr for the return value. Avoiding excessive uses of r-values helps maintain
 // better performance, especially in inner loops etc.
 //
+// Operations which produce simple scalar values (integers, reals, booleans) may also
+// implement ExecuteAndPushScalar, which writes the result directly onto the stack; this
+// lets PushOperation skip the r-value entirely, so that scalar expression evaluation
+// does not need to allocate any memory. Strings may use the same mechanism to push a
+// pooled string handle, avoiding a copy of the string's contents. Composite values
+// still travel via RValuePtr.
+//
 
 #pragma once
 
@@ -38,12 +45,25 @@ namespace VM
 	//
 	// Base interface for all language operations
 	//
-	class Operation
+	class Operation : public virtual SelfAwareBase
 	{
-	// Destruction
+	// Construction and destruction
 	public:
+		Operation()
+			: TypeInfoResolved(false),
+			  ResolvedType(EpochVariableType_Error),
+			  ResolvedNumParameters(0)
+		{ }
+
 		virtual ~Operation() { }
 
+	// Memory management
+	public:
+		// Operations live in the code arena of their program; see RuntimeContext
+		static void* operator new(size_t size);
+		static void operator delete(void* ptr)
+		{ }
+
 	// Execution and type-retrieval interface
 	public:
 		virtual void ExecuteFast(ExecutionContext& context) = 0;
@@ -51,12 +71,63 @@ namespace VM
 		virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const = 0;
 		virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const = 0;
 
+		//
+		// Execute the operation and push its result directly onto the stack
+		//
+		// Returns false, without executing anything, if the operation cannot
+		// produce its result in this fashion; in that case the caller should
+		// fall back on ExecuteAndStoreRValue.
+		//
+		virtual bool ExecuteAndPushScalar(ExecutionContext& context)
+		{ return false; }
+
+	// Cached type information
+	//
+	// Types and parameter counts are worked out on demand, often by looking
+	// up variables through the chain of scopes, and they may change while a
+	// program is still being parsed. Once the code is final the optimizer
+	// records them here (see OptimizationTraverser), and later queries made
+	// through these accessors are answered without recomputation.
+	public:
+		EpochVariableTypeID GetResolvedType(const ScopeDescription& scope) const
+		{ return TypeInfoResolved ? ResolvedType : GetType(scope); }
+
+		size_t GetResolvedNumParameters(const ScopeDescription& scope) const
+		{ return TypeInfoResolved ? ResolvedNumParameters : GetNumParameters(scope); }
+
+		void ResolveTypeInfo(const ScopeDescription& scope)
+		{
+			ResolvedType = GetType(scope);
+			ResolvedNumParameters = GetNumParameters(scope);
+			TypeInfoResolved = true;
+		}
+
+	// Node type checks
+	public:
+		//
+		// Determine if the operation is of exactly the given type
+		//
+		// This is a simple comparison of type tags, and is much cheaper than
+		// a dynamic_cast; note however that it does not match subclasses.
+		//
+		template <class NodeType>
+		bool IsNode() const
+		{ return GetNodeTypeTag() == SelfAware<NodeType>::GetStaticNodeTypeTag(); }
+
+		template <class NodeType>
+		const NodeType* AsNode() const
+		{ return IsNode<NodeType>() ? static_cast<const NodeType*>(this) : NULL; }
+
+		template <class NodeType>
+		NodeType* AsNode()
+		{ return IsNode<NodeType>() ? static_cast<NodeType*>(this) : NULL; }
+
 	// Traversal interface
 	public:
 		template <class TraverserT>
 		void TraverseExternal(TraverserT& traverser) const
 		{
-			traverser.TraverseNode(dynamic_cast<const SelfAwareBase*>(this)->GetToken(), GetNodeTraversalPayload(traverser.GetCurrentScope()));
+			traverser.TraverseNode(GetToken(), GetNodeTraversalPayload(traverser.GetCurrentScope()));
 			Operation* nested = GetNestedOperation();
 			if(nested)
 				nested->TraverseExternal(traverser);
@@ -68,7 +139,7 @@ namespace VM
 		virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
 		{
 			Traverser::Payload payload;
-			payload.ParameterCount = GetNumParameters(*scope);
+			payload.ParameterCount = GetResolvedNumParameters(*scope);
 			return payload;
 		}
 
@@ -81,6 +152,12 @@ namespace VM
 		{
 			return NULL;
 		}
+
+	// Internal tracking
+	private:
+		bool TypeInfoResolved;
+		EpochVariableTypeID ResolvedType;
+		size_t ResolvedNumParameters;
 	};
 
 	typedef std::auto_ptr<Operation> OperationPtr;
@@ -13,14 +13,27 @@
 #include "Virtual Machine/Core Entities/Types/Tuple.h"
 #include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 
+#include "Virtual Machine/Operations/Operators/Bitwise.h"
+#include "Virtual Machine/Operations/Operators/Comparison.h"
+#include "Virtual Machine/Operations/Operators/Logical.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+#include "Virtual Machine/Operations/StackOps.h"
+
+#include "Virtual Machine/JIT/NativeCompiler.h"
+
 #include "Language Extensions/ExtensionCatalog.h"
 
 #include "Marshalling/Callback.h"
+#include "Marshalling/DLLPool.h"
 
 #include "Utility/Strings.h"
 #include "Utility/Memory/Heap.h"
 
 #include "Utility/Threading/Threads.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Synchronization.h"
+
+#include "User Interface/BufferedOutput.h"
 
 #include <stdio.h>
 #include <fcntl.h>
@@ -34,29 +47,83 @@ using namespace VM;
 unsigned Program::ProgramInstances = 0;
 
 
+namespace
+{
+
+	// Programs may be created and destroyed on several threads at once
+	Threads::CriticalSection ProgramInstancesCriticalSection;
+
+
+	//
+	// Determine if an operation only computes and stores values, without
+	// any effects that a snapshot of the global storage could not capture
+	//
+	// Arithmetic on literals has already been folded by the optimizer by
+	// the time a program is executed, so arithmetic operations are not
+	// checked for here.
+	//
+	bool IsSnapshotSafe(const Operation* op)
+	{
+		if(const Operations::PushOperation* push = dynamic_cast<const Operations::PushOperation*>(op))
+			return IsSnapshotSafe(push->GetNestedOperation());
+
+		return (dynamic_cast<const Operations::PushIntegerLiteral*>(op)
+			 || dynamic_cast<const Operations::PushInteger16Literal*>(op)
+			 || dynamic_cast<const Operations::PushRealLiteral*>(op)
+			 || dynamic_cast<const Operations::PushBooleanLiteral*>(op)
+			 || dynamic_cast<const Operations::InitializeValue*>(op)
+			 || dynamic_cast<const Operations::IntegerConstant*>(op)
+			 || dynamic_cast<const Operations::Integer16Constant*>(op)
+			 || dynamic_cast<const Operations::RealConstant*>(op)
+			 || dynamic_cast<const Operations::BooleanConstant*>(op)
+			 || dynamic_cast<const Operations::GetVariableValue*>(op)
+			 || dynamic_cast<const Operations::Comparator*>(op)
+			 || dynamic_cast<const Operations::BitwiseOr*>(op)
+			 || dynamic_cast<const Operations::BitwiseAnd*>(op)
+			 || dynamic_cast<const Operations::BitwiseXor*>(op)
+			 || dynamic_cast<const Operations::BitwiseNot*>(op)
+			 || dynamic_cast<const Operations::LogicalOr*>(op)
+			 || dynamic_cast<const Operations::LogicalAnd*>(op)
+			 || dynamic_cast<const Operations::LogicalXor*>(op)
+			 || dynamic_cast<const Operations::LogicalNot*>(op));
+	}
+
+}
+
+
 //
 // Construct a program and initialize it
 //
+// Any number of programs may exist at once; each has its own pooled data
+// and threads (see RuntimeContext). The type registries, marshalling
+// callbacks, native code, and extensions are still shared by the whole
+// process, so they are only reset while no other program exists.
+//
+// The program is bound to the constructing thread, so that data pooled
+// while the program is loaded ends up in the program's own pools.
+//
 Program::Program() :
 	GlobalInitBlock(NULL),
 	GlobalStorageSpace(NULL),
 	ActivatedGlobalScope(NULL),
-	FlagsUsesConsole(false)
+	CaptureSnapshot(false),
+	RestoreSnapshot(false),
+	FlagsUsesConsole(false),
+	FlagsPreoptimized(false),
+	FlagsValidated(false)
 {
-	// TODO - remove single-program-per-process gibberish
-
-	// This is kind of lame and inelegant; there shouldn't be a limit on the program
-	// instances active because everything should be able to run independently.
-	// Eventually it would be nice to refactor/adjust things to eliminate the one
-	// instance requirement.
-	if(ProgramInstances > 0)
-		throw Exception("Cannot instantiate multiple programs in the same process!");
-
-	++ProgramInstances;
-	TupleTrackerClass::ResetSharedData();
-	StructureTrackerClass::ResetSharedData();
-	Marshalling::Clean();
-	StringVariable::EmptyPool();
+	{
+		Threads::CriticalSection::Auto mutex(ProgramInstancesCriticalSection);
+		if(ProgramInstances++ == 0)
+		{
+			TupleTrackerClass::ResetSharedData();
+			StructureTrackerClass::ResetSharedData();
+			Marshalling::Clean();
+			JIT::CleanNativeCode();
+		}
+	}
+
+	Threads::BindProgramToThisThread(this);
 }
 
 //
@@ -64,12 +131,19 @@ Program::Program() :
 //
 Program::~Program()
 {
+	GlobalScope.SetSingleActivation(NULL);
 	delete ActivatedGlobalScope;
 	delete GlobalInitBlock;
 	delete GlobalStorageSpace;
-	--ProgramInstances;
 
-	Extensions::Reset();
+	// Don't leave the destroying thread bound to a dead program
+	const Threads::ThreadInfo* info = reinterpret_cast<const Threads::ThreadInfo*>(::TlsGetValue(Threads::GetTLSIndex()));
+	if(info && info->RunningProgram == this)
+		Threads::BindProgramToThisThread(NULL);
+
+	Threads::CriticalSection::Auto mutex(ProgramInstancesCriticalSection);
+	if(--ProgramInstances == 0)
+		Extensions::Reset();
 }
 
 
@@ -78,21 +152,65 @@ Program::~Program()
 //
 RValuePtr Program::Execute()
 {
+	Threads::ProgramBinding binding(this);
+	TypesManager::ProgramTypeChecks typechecks(FlagsValidated);
+	Marshalling::DLLPool::PreloadSession preload(Marshalling::TheDLLPool);
+
 	delete ActivatedGlobalScope;
 	ActivatedGlobalScope = new ActivatedScope(GlobalScope);
+	GlobalScope.SetSingleActivation(ActivatedGlobalScope);
 
 	if(GlobalInitBlock)
 	{
 		delete GlobalStorageSpace;
 		GlobalStorageSpace = new HeapStorage;
-		FlowControlResult ignored = FLOWCONTROL_NORMAL;
-		GlobalInitBlock->ExecuteBlock(ExecutionContext(*this, *ActivatedGlobalScope, Stack, ignored), GlobalStorageSpace);
+
+		bool restored = false;
+		if(RestoreSnapshot)
+		{
+			ActivatedGlobalScope->Enter(*GlobalStorageSpace);
+			if(GlobalStorageSpace->GetSize() == GlobalStorageSnapshot.size())
+			{
+				if(!GlobalStorageSnapshot.empty())
+					memcpy(GlobalStorageSpace->GetStartOfStorage(), &GlobalStorageSnapshot[0], GlobalStorageSnapshot.size());
+				restored = true;
+			}
+			else
+			{
+				// The snapshot does not fit this program; the init block enters
+				// the global scope itself, so start over with fresh storage
+				delete ActivatedGlobalScope;
+				ActivatedGlobalScope = new ActivatedScope(GlobalScope);
+				GlobalScope.SetSingleActivation(ActivatedGlobalScope);
+
+				delete GlobalStorageSpace;
+				GlobalStorageSpace = new HeapStorage;
+			}
+		}
+
+		if(!restored)
+		{
+			FlowControlResult ignored = FLOWCONTROL_NORMAL;
+			GlobalInitBlock->ExecuteBlock(ExecutionContext(*this, *ActivatedGlobalScope, Stack, ignored), GlobalStorageSpace);
+
+			if(CaptureSnapshot)
+			{
+				const Byte* storage = reinterpret_cast<const Byte*>(GlobalStorageSpace->GetStartOfStorage());
+				GlobalStorageSnapshot.assign(storage, storage + GlobalStorageSpace->GetSize());
+			}
+		}
 	}
 
-	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
-	RValuePtr ret(GlobalScope.GetFunction(L"entrypoint")->Invoke(ExecutionContext(*this, *ActivatedGlobalScope, Stack, flowresult)));
+	RValuePtr ret;
+	{
+		UI::BufferedOutput::Session bufferedoutput;
+		Threads::Telemetry::DumpSession telemetry;
+
+		FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+		ret.reset(GlobalScope.GetFunction(L"entrypoint")->Invoke(ExecutionContext(*this, *ActivatedGlobalScope, Stack, flowresult)).release());
 
-	Threads::WaitForThreadsToFinish();
+		Threads::WaitForThreadsToFinish(this);
+	}
 
 	size_t allocatedstack = Stack.GetAllocatedStack();
 	if(allocatedstack != 0)
@@ -101,6 +219,62 @@ RValuePtr Program::Execute()
 	return ret;
 }
 
+//
+// Determine if the state produced by the global init block can be captured as raw bytes
+//
+// This is only possible if every global variable is a plain scalar, so
+// that the global storage holds no handles or pointers, and the global
+// init block does nothing but compute and store values. Running such a
+// block has no effects outside of the global storage, which means that
+// restoring a snapshot of the storage is indistinguishable from running
+// the block again.
+//
+bool Program::CanSnapshotGlobalStorage() const
+{
+	if(!GlobalInitBlock)
+		return false;
+
+	for(unsigned i = 0; i < GlobalScope.GetNumMembers(); ++i)
+	{
+		if(GlobalScope.IsReference(i) || GlobalScope.IsFunctionSignature(i))
+			return false;
+
+		switch(GlobalScope.GetVariableType(i))
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	const std::vector<Operation*>& ops = GlobalInitBlock->GetAllOperations();
+	for(std::vector<Operation*>::const_iterator iter = ops.begin(); iter != ops.end(); ++iter)
+	{
+		if(!IsSnapshotSafe(*iter))
+			return false;
+	}
+
+	return true;
+}
+
+//
+// Use the given snapshot in place of running the global init block
+//
+// If the snapshot does not match the layout of the global storage, it
+// is ignored and the global init block runs as usual.
+//
+void Program::RestoreGlobalStorageSnapshot(const std::vector<Byte>& snapshot)
+{
+	GlobalStorageSnapshot = snapshot;
+	RestoreSnapshot = true;
+}
+
+
 //
 // Pool a static string value in a central location
 //
@@ -153,7 +327,15 @@ void Program::CreateThreadPool(const std::wstring& poolname, unsigned numthreads
 }
 
 //
-// Add a work item to a worker thread pool's work queue
+// Add an anonymous work item to a worker thread pool's work queue
+//
+void Program::AddPoolWorkItem(const std::wstring& poolname, std::auto_ptr<Threads::PoolWorkItem> workitem)
+{
+	ThreadPools.GetNamedPool(poolname).AddWorkItem(workitem.release());
+}
+
+//
+// Add a named work item to a worker thread pool's work queue
 //
 void Program::AddPoolWorkItem(const std::wstring& poolname, const std::wstring& threadname, std::auto_ptr<Threads::PoolWorkItem> workitem)
 {
@@ -165,3 +347,19 @@ bool Program::HasThreadPool(const std::wstring& poolname) const
 	return ThreadPools.HasNamedPool(poolname);
 }
 
+//
+// Discard any work items still waiting in a worker thread pool's queue
+//
+unsigned Program::CancelPoolWorkItems(const std::wstring& poolname)
+{
+	return ThreadPools.GetNamedPool(poolname).CancelPendingWorkItems();
+}
+
+//
+// Retrieve the worker thread pool shared by all parallel loops in the program
+//
+Threads::ThreadPool& Program::GetSharedThreadPool()
+{
+	return ThreadPools.GetSharedPool(this);
+}
+
@@ -11,6 +11,7 @@
 // Dependencies
 #include "Utility/Memory/Stack.h"
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
 #include "Virtual Machine/Thread Pooling/PoolTracker.h"
 #include "Language Extensions/ExtensionCatalog.h"
 
@@ -36,6 +37,12 @@ namespace VM
 		void SetUsesConsole()								{ FlagsUsesConsole = true; }
 		bool GetUsesConsole() const							{ return FlagsUsesConsole; }
 
+		void SetPreoptimized()								{ FlagsPreoptimized = true; }
+		bool IsPreoptimized() const							{ return FlagsPreoptimized; }
+
+		void SetValidated()									{ FlagsValidated = true; }
+		bool IsValidated() const							{ return FlagsValidated; }
+
 	// Global scope access
 	public:
 		ScopeDescription& GetGlobalScope()					{ return GlobalScope; }
@@ -52,15 +59,31 @@ namespace VM
 	public:
 		StackSpace& GetStack()					{ return Stack; }
 
+	// Runtime context access
+	public:
+		RuntimeContext& GetRuntime()			{ return Runtime; }
+
 	// Execution interface
 	public:
 		RValuePtr Execute();
 
+	// Snapshots of the global storage after global initialization
+	public:
+		bool CanSnapshotGlobalStorage() const;
+		void RestoreGlobalStorageSnapshot(const std::vector<Byte>& snapshot);
+
+		void CaptureGlobalStorageSnapshot()				{ CaptureSnapshot = true; }
+		const std::vector<Byte>& GetGlobalStorageSnapshot() const
+		{ return GlobalStorageSnapshot; }
+
 	// Thread pool management interface
 	public:
 		void CreateThreadPool(const std::wstring& poolname, unsigned numthreads);
+		void AddPoolWorkItem(const std::wstring& poolname, std::auto_ptr<Threads::PoolWorkItem> workitem);
 		void AddPoolWorkItem(const std::wstring& poolname, const std::wstring& threadname, std::auto_ptr<Threads::PoolWorkItem> workitem);
 		bool HasThreadPool(const std::wstring& poolname) const;
+		unsigned CancelPoolWorkItems(const std::wstring& poolname);
+		Threads::ThreadPool& GetSharedThreadPool();
 
 	// Traversal interface
 	public:
@@ -80,6 +103,7 @@ namespace VM
 
 	// Internal tracking
 	private:
+		RuntimeContext Runtime;				// Must be destroyed last, since variables refer into its pools
 		std::set<std::wstring> StaticStringPool;
 		ScopeDescription GlobalScope;
 		ActivatedScope* ActivatedGlobalScope;
@@ -88,7 +112,13 @@ namespace VM
 		HeapStorage* GlobalStorageSpace;
 		ThreadPoolTracker ThreadPools;
 
+		std::vector<Byte> GlobalStorageSnapshot;
+		bool CaptureSnapshot;
+		bool RestoreSnapshot;
+
 		bool FlagsUsesConsole;
+		bool FlagsPreoptimized;
+		bool FlagsValidated;
 
 	// Shared internal tracking
 	private:
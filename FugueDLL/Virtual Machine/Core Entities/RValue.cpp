@@ -336,12 +336,17 @@ ArrayRValue::ArrayRValue(HandleType datahandle, bool copyelements)
 	: RValue(EpochVariableType_Array),
 	  StoredHandle(datahandle)
 {
-	const VM::ArrayVariable::PoolType::PoolEntry& entry = VM::ArrayVariable::Pool.Get(StoredHandle);
+	GarbageCollector::PinArray(StoredHandle);
+
+	const VM::ArrayVariable::PoolType::PoolEntry& entry = VM::ArrayVariable::GetPool().Get(StoredHandle);
 	ElementType = entry.Type;
 	if(copyelements)
-		CopyElements(entry.Buffer, entry.Size / TypeInfo::GetStorageSize(ElementType));
-	else
-		Elements.resize(entry.Size / TypeInfo::GetStorageSize(ElementType));
+	{
+		if(entry.Mapped)
+			CopyMappedElements(*entry.Mapped);
+		else
+			CopyElements(entry.Buffer, entry.Size / TypeInfo::GetStorageSize(ElementType));
+	}
 }
 
 ArrayRValue::ArrayRValue(const LibraryArrayReturnInfo& arrayinfo)
@@ -362,9 +367,23 @@ void ArrayRValue::CopyElements(const void* originalstorage, size_t numelements)
 	}
 }
 
+//
+// Copy the elements of a file-backed array, one window at a time
+//
+void ArrayRValue::CopyMappedElements(MappedArrayStorage& mapped)
+{
+	size_t numelements = mapped.GetNumElements();
+	for(size_t first = 0; first < numelements; )
+	{
+		MappedArrayStorage::Window window(mapped, first);
+		CopyElements(window.GetStorage(), window.GetNumElements());
+		first += window.GetNumElements();
+	}
+}
+
 void ArrayRValue::StoreIntoNewBuffer()
 {
-	StoredHandle = ArrayVariable::AllocateNewHandle(ElementType, Elements.size());
+	SetHandle(ArrayVariable::AllocateNewHandle(ElementType, Elements.size()));
 	void* storage = ArrayVariable::GetArrayStorage(StoredHandle);
 	for(size_t i = 0; i < Elements.size(); ++i)
 	{
@@ -411,6 +430,7 @@ void ArrayRValue::Clean()
 		delete *iter;
 
 	Elements.clear();
+	GarbageCollector::UnpinArray(StoredHandle);
 	StoredHandle = 0;
 }
 
@@ -423,6 +443,20 @@ void ArrayRValue::CopyFrom(const ArrayRValue& rhs)
 		Elements.push_back((*iter)->Clone());
 }
 
+//
+// Retrieve the number of elements in the array
+//
+// Arrays constructed from a handle without copying their elements
+// refer directly to the pooled data, so the count comes from there.
+//
+size_t ArrayRValue::GetElementCount() const
+{
+	if(Elements.empty() && StoredHandle)
+		return ArrayVariable::PoolType::GetNumElements(ArrayVariable::GetPool().Get(StoredHandle));
+
+	return Elements.size();
+}
+
 //
 // Append an element to the array
 //
@@ -474,6 +508,7 @@ BufferRValue::~BufferRValue()
 //
 void BufferRValue::Clean()
 {
+	GarbageCollector::UnpinBuffer(BufferHandle);
 	BufferHandle = 0;
 }
 
@@ -484,6 +519,7 @@ void BufferRValue::Clean()
 //
 void BufferRValue::CopyFrom(const BufferRValue& rhs)
 {
+	GarbageCollector::PinBuffer(rhs.BufferHandle);
 	BufferHandle = rhs.BufferHandle;
 }
 
@@ -500,9 +536,53 @@ bool BufferRValue::VirtualComparator(const RValue& rhs) const
 	if(BufferHandle == rhsvalue.BufferHandle)
 		return true;
 
-	if(BufferVariable::Pool.Get(BufferHandle).Size != BufferVariable::Pool.Get(rhsvalue.BufferHandle).Size)
+	if(BufferVariable::GetPool().Get(BufferHandle).Size != BufferVariable::GetPool().Get(rhsvalue.BufferHandle).Size)
+		return false;
+
+	return (memcmp(BufferVariable::GetPool().Get(BufferHandle).Buffer, BufferVariable::GetPool().Get(rhsvalue.BufferHandle).Buffer, BufferVariable::GetPool().Get(BufferHandle).Size) == 0);
+}
+
+
+
+//-------------------------------------------------------------------------------
+// Hash maps
+//-------------------------------------------------------------------------------
+
+//
+// Destruct and clean up the hash map r-value
+//
+HashMapRValue::~HashMapRValue()
+{
+	Clean();
+}
+
+//
+// Release the handle to the associated map (this will allow the garbage collector to free the map)
+//
+void HashMapRValue::Clean()
+{
+	GarbageCollector::UnpinHashMap(MapHandle);
+	MapHandle = 0;
+}
+
+//
+// Copy from another map. As with buffers, only the handle is
+// copied, so the r-value sees all future changes to the map.
+//
+void HashMapRValue::CopyFrom(const HashMapRValue& rhs)
+{
+	GarbageCollector::PinHashMap(rhs.MapHandle);
+	MapHandle = rhs.MapHandle;
+}
+
+//
+// Determine if two maps are equal; maps are only equal to themselves
+//
+bool HashMapRValue::VirtualComparator(const RValue& rhs) const
+{
+	if(rhs.GetType() != EpochVariableType_HashMap)
 		return false;
 
-	return (memcmp(BufferVariable::Pool.Get(BufferHandle).Buffer, BufferVariable::Pool.Get(rhsvalue.BufferHandle).Buffer, BufferVariable::Pool.Get(BufferHandle).Size) == 0);
+	return (MapHandle == rhs.CastTo<HashMapRValue>().MapHandle);
 }
 
@@ -13,6 +13,9 @@
 #include "Virtual Machine/Core Entities/Types/Structure.h"
 #include "Virtual Machine/Types Management/Typecasts.h"
 #include "Virtual Machine/VMExceptions.h"
+#include "Utility/Memory/ThreadLocalAllocator.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
 
 // Forward declarations
 struct LibraryArrayReturnInfo;
@@ -24,6 +27,7 @@ namespace VM
 	class ScopeDescription;
 	class ActivatedScope;
 	class FunctionBase;
+	class MappedArrayStorage;
 
 	//
 	// Base class for all r-value types
@@ -39,6 +43,17 @@ namespace VM
 		virtual ~RValue()
 		{ }
 
+	// Memory management
+	public:
+		static void* operator new(size_t size)
+		{
+			Instrumentation::CountRValueAllocation();
+			return ThreadLocalArena::Allocate(size);
+		}
+
+		static void operator delete(void* ptr)
+		{ ThreadLocalArena::Free(ptr); }
+
 	// Type interface
 	public:
 		EpochVariableTypeID GetType() const
@@ -58,8 +73,7 @@ namespace VM
 				return (Type == rhs.Type);
 			}
 
-			if(Type != rhs.Type)
-				throw ExecutionException("Cannot compare variables of differing types; conversion required");
+			TypesManager::TypeChecks::Verify(rhs.Type, Type, "Cannot compare variables of differing types; conversion required");
 
 			return VirtualComparator(rhs);
 		}
@@ -308,7 +322,7 @@ namespace VM
 			: RValue(EpochVariableType_Array),
 			  ElementType(rhs.ElementType),
 			  StoredHandle(rhs.StoredHandle)
-		{ CopyFrom(rhs); }
+		{ GarbageCollector::PinArray(StoredHandle); CopyFrom(rhs); }
 
 		~ArrayRValue();
 
@@ -316,8 +330,7 @@ namespace VM
 	public:
 		void AddElement(RValue* element);
 
-		size_t GetElementCount() const
-		{ return Elements.size(); }
+		size_t GetElementCount() const;
 
 		EpochVariableTypeID GetElementType() const
 		{ return ElementType; }
@@ -334,7 +347,11 @@ namespace VM
 		{ return StoredHandle; }
 
 		void SetHandle(HandleType handle)
-		{ StoredHandle = handle; }
+		{
+			GarbageCollector::PinArray(handle);
+			GarbageCollector::UnpinArray(StoredHandle);
+			StoredHandle = handle;
+		}
 
 		void StoreIntoNewBuffer();
 
@@ -357,6 +374,7 @@ namespace VM
 		void CopyFrom(const ArrayRValue& rhs);
 
 		void CopyElements(const void* storage, size_t numelements);
+		void CopyMappedElements(MappedArrayStorage& mapped);
 
 	// Helper for comparison interface
 	public:
@@ -380,7 +398,7 @@ namespace VM
 		explicit BufferRValue(HandleType bufferhandle)
 			: RValue(EpochVariableType_Buffer),
 			  BufferHandle(bufferhandle)
-		{ }
+		{ GarbageCollector::PinBuffer(BufferHandle); }
 
 		BufferRValue(const BufferRValue& rhs)
 			: RValue(EpochVariableType_Buffer),
@@ -426,6 +444,63 @@ namespace VM
 		HandleType BufferHandle;
 	};
 
+
+	//
+	// Special derived type for hash map rvalues
+	//
+	class HashMapRValue : public RValue
+	{
+	// Construction and destruction
+	public:
+		explicit HashMapRValue(HandleType maphandle)
+			: RValue(EpochVariableType_HashMap),
+			  MapHandle(maphandle)
+		{ GarbageCollector::PinHashMap(MapHandle); }
+
+		HashMapRValue(const HashMapRValue& rhs)
+			: RValue(EpochVariableType_HashMap),
+			  MapHandle(0)
+		{ CopyFrom(rhs); }
+
+		~HashMapRValue();
+
+	// R-value interface
+	public:
+		static EpochVariableTypeID GetType()
+		{ return EpochVariableType_HashMap; }
+
+	// Copy interface
+	public:
+		virtual RValue* Clone() const
+		{
+			HashMapRValue *copy = new HashMapRValue(*this);
+			return copy;
+		}
+
+		HashMapRValue& operator = (const HashMapRValue& rhs)
+		{
+			if(this != &rhs) { Clean(); CopyFrom(rhs); }
+			return *this;
+		}
+
+	protected:
+		void Clean();
+		void CopyFrom(const HashMapRValue& rhs);
+
+	// Handle retrieval interface
+	public:
+		HandleType GetOriginHandle() const
+		{ return MapHandle; }
+
+	// Helper for comparison interface
+	public:
+		virtual bool VirtualComparator(const RValue& rhs) const;
+
+	// Internal tracking
+	protected:
+		HandleType MapHandle;
+	};
+
 	
 	// Handy type shortcuts
 	typedef BoundRValue<Integer32, EpochVariableType_Null> NullRValue;
@@ -0,0 +1,59 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Storage belonging to a single running program
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Block.h"
+
+#include "Utility/Threading/Threads.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+	// Storage used by threads which are not running any program
+	RuntimeContext ProcessContext;
+}
+
+
+//
+// Retrieve the context of the program bound to the calling thread
+//
+RuntimeContext& RuntimeContext::GetCurrent()
+{
+	const Threads::ThreadInfo* info = reinterpret_cast<const Threads::ThreadInfo*>(::TlsGetValue(Threads::GetTLSIndex()));
+	if(info && info->RunningProgram)
+		return info->RunningProgram->GetRuntime();
+
+	return ProcessContext;
+}
+
+
+//
+// Place code objects in the arena of the program bound to the calling thread
+//
+// Code is built while the program under construction is bound (see the
+// constructor of Program), and any code generated during execution
+// belongs to the running program, so this is always the owning program.
+// Code objects are not freed individually; see the comments at the top
+// of RuntimeContext.h.
+//
+void* Operation::operator new(size_t size)
+{
+	return RuntimeContext::GetCurrent().CodeArena.Allocate(size);
+}
+
+void* Block::operator new(size_t size)
+{
+	return RuntimeContext::GetCurrent().CodeArena.Allocate(size);
+}
+
@@ -0,0 +1,92 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Storage belonging to a single running program
+//
+// Each program owns the pools which hold its string, array, buffer, and
+// hash map data, so that several independent programs can run side by
+// side in the same process without ever sharing pooled data. Handles are
+// resolved against the pools of whichever program is bound to the calling
+// thread; see Threads::BindProgramToThisThread. The context of the
+// program being executed can also be reached from the execution context,
+// as context.RunningProgram.GetRuntime().
+//
+// The operations and blocks making up a program's code are placed in an
+// arena owned by the context, in the order they are created by the parser
+// or loader. Code which runs in sequence therefore sits together in
+// memory, and the code objects of a program need not be freed one by one;
+// their memory goes away with the arena, once their destructors have run.
+//
+// Channels created by the program's tasks are also tracked here, so that
+// channel handles are only ever resolved within the program which created
+// them; see Channel.h. Tasks which share their mailboxes with other
+// processes are tracked here as well; see RemoteTasks.h.
+//
+// Generators are tracked here too; see Generator.h. They are declared
+// last, so that they are destroyed first: discarding a generator which
+// has not finished unwinds its body, which may still refer to pooled
+// data and to code in the arena.
+//
+// When a program is destroyed, its pools are released along with it,
+// without affecting the data of any other program. Threads which are not
+// running any program fall back on a context shared by the whole process.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
+#include "Virtual Machine/Core Entities/Concurrency/Channel.h"
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
+#include "Virtual Machine/Core Entities/Concurrency/Generator.h"
+
+#include "Utility/Memory/Arena.h"
+
+
+namespace VM
+{
+
+	class RuntimeContext
+	{
+	// Construction
+	public:
+		RuntimeContext()
+		{ }
+
+	// Pooled data
+	public:
+		StringVariable::PoolType StringPool;
+		ArrayVariable::PoolType ArrayPool;
+		BufferVariable::PoolType BufferPool;
+		HashMapVariable::PoolType HashMapPool;
+
+	// Code storage
+	public:
+		MemoryArena CodeArena;
+
+	// Inter-task communication
+	public:
+		ChannelTable Channels;
+		RemoteTaskTable RemoteTasks;
+
+	// Lazily evaluated sequences; must be destroyed first
+	public:
+		GeneratorTable Generators;
+
+	// Context lookup
+	public:
+		static RuntimeContext& GetCurrent();
+
+	// Non-copyable
+	private:
+		RuntimeContext(const RuntimeContext&);
+		RuntimeContext& operator = (const RuntimeContext&);
+	};
+
+}
+
@@ -20,12 +20,18 @@
 #include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
 
 #include "Virtual Machine/Types Management/TypeInfo.h"
 
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
+
 #include "Utility/Strings.h"
 
 #include "Utility/Memory/Heap.h"
+#include "Utility/Memory/Alignment.h"
+
+#include "Configuration/RuntimeOptions.h"
 
 
 using namespace VM;
@@ -44,11 +50,18 @@ ActivatedScope::ActivatedScope(ScopeDescription& scope)
 	  ParentScope(NULL),
 	  TaskOrigin(0),
 	  LastMessageOrigin(0),
-
-	  Variables(scope.Variables),
-	  References(scope.References),
-	  Futures(scope.Futures)
-{ }
+	  PendingReply(NULL),
+	  ParamFrame(NULL),
+	  ReturnFrame(NULL),
+	  ParameterStorage(NULL),
+	  TailCallPending(false),
+	  LoopInvariantStorage(NULL),
+	  StackUsage(0),
+	  StackUsageDepth(0)
+{
+	CopyFrameLayout();
+	MemoryAccounting::CountAllocation(MemoryAccounting::Category_Scopes, sizeof(ActivatedScope));
+}
 
 //
 // Construct and initialize an activated scope with a given parent scope, based on a scope description template
@@ -58,17 +71,26 @@ ActivatedScope::ActivatedScope(ScopeDescription& scope, ActivatedScope* parent)
 	  ParentScope(parent),
 	  TaskOrigin(0),
 	  LastMessageOrigin(0),
-
-	  Variables(scope.Variables),
-	  References(scope.References),
-	  Futures(scope.Futures)
-{ }
+	  PendingReply(NULL),
+	  ParamFrame(NULL),
+	  ReturnFrame(NULL),
+	  ParameterStorage(NULL),
+	  TailCallPending(false),
+	  LoopInvariantStorage(NULL),
+	  StackUsage(0),
+	  StackUsageDepth(0)
+{
+	CopyFrameLayout();
+	MemoryAccounting::CountAllocation(MemoryAccounting::Category_Scopes, sizeof(ActivatedScope));
+}
 
 //
 // Destruct and clean up an activated scope
 //
 ActivatedScope::~ActivatedScope()
 {
+	MemoryAccounting::CountRelease(MemoryAccounting::Category_Scopes, sizeof(ActivatedScope));
+
 	// Poison data members just in case someone tries to use this scope once it has been deleted
 	ParentScope = reinterpret_cast<ActivatedScope*>(static_cast<UINT_PTR>(0xbaadf00d));
 }
@@ -81,62 +103,34 @@ ActivatedScope::~ActivatedScope()
 //
 // Enter a lexical scope, reserving space for each variable on the stack.
 //
+// The entire frame is reserved in one step, using the layout computed
+// by the scope description; each variable is then bound to its offset
+// within the frame. With aligned layouts, the frame itself is placed on
+// an aligned address, so that the padding within it has an effect.
+//
 void ActivatedScope::Enter(StackSpace& stack)
 {
-	StackUsage.push(0);
+	if(OriginalScope.Layout->HintsMissing)
+		throw Exception("Invalid type hint");
 
-	for(std::vector<std::wstring>::const_iterator iter = OriginalScope.MemberOrder.begin(); iter != OriginalScope.MemberOrder.end(); ++iter)
+	if(!OriginalScope.Layout->Stackable)
+		throw NotImplementedException("Cannot reserve stack space for this variable type");
+
+	size_t framesize = OriginalScope.Layout->StorageSize;
+	if(Config::AlignedLayout)
 	{
-		VariableMap::iterator variter = Variables.find(*iter);
-		if(variter == Variables.end())
-			continue;
+		Byte* frametop = reinterpret_cast<Byte*>(stack.GetCurrentTopOfStack()) - framesize;
+		framesize += reinterpret_cast<size_t>(frametop) % Alignment::MaxNaturalAlignment;
+	}
 
-		Variable& var = variter->second;
-		switch(var.GetType())
-		{
-		case EpochVariableType_Null:
-			StackUsage.top() += var.CastTo<NullVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Integer:
-			StackUsage.top() += var.CastTo<IntegerVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Integer16:
-			StackUsage.top() += var.CastTo<Integer16Variable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Real:
-			StackUsage.top() += var.CastTo<RealVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Boolean:
-			StackUsage.top() += var.CastTo<BooleanVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_String:
-			StackUsage.top() += var.CastTo<StringVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Tuple:
-			{
-				ScopeDescription::TupleTypeIDMap::const_iterator ttiter = OriginalScope.TupleTypeHints.find(*iter);
-				if(ttiter == OriginalScope.TupleTypeHints.end())
-					throw Exception("Invalid type hint");
-				StackUsage.top() += var.CastTo<TupleVariable>().BindToStack(stack, GetTupleType(ttiter->second));
-			}
-			break;
-		case EpochVariableType_Structure:
-			{
-				ScopeDescription::StructureTypeIDMap::const_iterator stiter = OriginalScope.StructureTypeHints.find(*iter);
-				if(stiter == OriginalScope.StructureTypeHints.end())
-					throw Exception("Invalid type hint");
-				StackUsage.top() += var.CastTo<StructureVariable>().BindToStack(stack, GetStructureType(stiter->second));
-			}
-			break;
-		case EpochVariableType_Buffer:
-			StackUsage.top() += var.CastTo<BufferVariable>().BindToStack(stack);
-			break;
-		case EpochVariableType_Array:
-			StackUsage.top() += var.CastTo<ArrayVariable>().BindToStack(stack);
-			break;
-		default:
-			throw NotImplementedException("Cannot reserve stack space for this variable type");
-		}
+	stack.Push(framesize);
+	PushStackUsage(framesize);
+
+	Byte* frame = reinterpret_cast<Byte*>(stack.GetCurrentTopOfStack());
+	for(std::vector<ScopeDescription::FrameSlot>::const_iterator iter = OriginalScope.Layout->Slots.begin(); iter != OriginalScope.Layout->Slots.end(); ++iter)
+	{
+		if(iter->VariableIndex != ScopeDescription::NoFrameIndex)
+			FrameVariables[iter->VariableIndex].BindToStorage(frame + iter->StackOffset);
 	}
 }
 
@@ -145,70 +139,16 @@ void ActivatedScope::Enter(StackSpace& stack)
 //
 void ActivatedScope::Enter(HeapStorage& heapstorage)
 {
-	size_t requiredstorage = 0;
+	if(OriginalScope.Layout->HintsMissing)
+		throw Exception("Invalid type hint");
 
-	for(std::vector<std::wstring>::const_iterator iter = OriginalScope.MemberOrder.begin(); iter != OriginalScope.MemberOrder.end(); ++iter)
-	{
-		VariableMap::iterator variter = Variables.find(*iter);
-		if(variter == Variables.end())
-			continue;
+	heapstorage.Allocate(OriginalScope.Layout->StorageSize);
 
-		Variable& var = variter->second;
-		switch(var.GetType())
-		{
-		case EpochVariableType_Tuple:
-			{
-				ScopeDescription::TupleTypeIDMap::const_iterator ttiter = OriginalScope.TupleTypeHints.find(*iter);
-				if(ttiter == OriginalScope.TupleTypeHints.end())
-					throw Exception("Invalid type hint");
-				requiredstorage += GetTupleType(ttiter->second).GetTotalSize();
-			}
-			break;
-		case EpochVariableType_Structure:
-			{
-				ScopeDescription::StructureTypeIDMap::const_iterator stiter = OriginalScope.StructureTypeHints.find(*iter);
-				if(stiter == OriginalScope.StructureTypeHints.end())
-					throw Exception("Invalid type hint");
-				requiredstorage += GetStructureType(stiter->second).GetTotalSize();
-			}
-			break;
-		default:
-			requiredstorage += TypeInfo::GetStorageSize(var.GetType());
-			break;
-		}
-	}
-
-	heapstorage.Allocate(requiredstorage);
 	Byte* storage = reinterpret_cast<Byte*>(heapstorage.GetStartOfStorage());
-	for(std::vector<std::wstring>::const_iterator iter = OriginalScope.MemberOrder.begin(); iter != OriginalScope.MemberOrder.end(); ++iter)
+	for(std::vector<ScopeDescription::FrameSlot>::const_iterator iter = OriginalScope.Layout->Slots.begin(); iter != OriginalScope.Layout->Slots.end(); ++iter)
 	{
-		VariableMap::iterator variter = Variables.find(*iter);
-		if(variter == Variables.end())
-			continue;
-
-		Variable& var = variter->second;
-		var.BindToStorage(storage);
-		switch(var.GetType())
-		{
-			{
-				ScopeDescription::TupleTypeIDMap::const_iterator ttiter = OriginalScope.TupleTypeHints.find(*iter);
-				if(ttiter == OriginalScope.TupleTypeHints.end())
-					throw Exception("Invalid type hint");
-				storage += GetTupleType(ttiter->second).GetTotalSize();
-			}
-			break;
-		case EpochVariableType_Structure:
-			{
-				ScopeDescription::StructureTypeIDMap::const_iterator stiter = OriginalScope.StructureTypeHints.find(*iter);
-				if(stiter == OriginalScope.StructureTypeHints.end())
-					throw Exception("Invalid type hint");
-				storage += GetStructureType(stiter->second).GetTotalSize();
-			}
-			break;
-		default:
-			storage += TypeInfo::GetStorageSize(var.GetType());
-			break;
-		}
+		if(iter->VariableIndex != ScopeDescription::NoFrameIndex)
+			FrameVariables[iter->VariableIndex].BindToStorage(storage + iter->HeapOffset);
 	}
 }
 
@@ -217,11 +157,7 @@ void ActivatedScope::Enter(HeapStorage& heapstorage)
 //
 void ActivatedScope::Exit(StackSpace& stack)
 {
-	if(StackUsage.empty())
-		throw InternalFailureException("Exited scope too many times!");
-
-	stack.Pop(StackUsage.top());
-	StackUsage.pop();
+	stack.Pop(PopStackUsage());
 }
 
 //
@@ -229,7 +165,7 @@ void ActivatedScope::Exit(StackSpace& stack)
 //
 void ActivatedScope::ExitFromMachineStack()
 {
-	StackUsage.pop();
+	PopStackUsage();
 }
 
 //
@@ -240,45 +176,53 @@ void ActivatedScope::ExitFromMachineStack()
 //
 void ActivatedScope::BindToStack(StackSpace& stack)
 {
-	StackUsage.push(0);
+	ParameterStorage = reinterpret_cast<Byte*>(stack.GetCurrentTopOfStack());
+
+	if(OriginalScope.Layout->BindingValid)
+	{
+		BindToParameters(reinterpret_cast<Byte*>(stack.GetCurrentTopOfStack()), false);
+		return;
+	}
+
+	PushStackUsage(0);
 
 	for(std::vector<std::wstring>::const_iterator iter = OriginalScope.MemberOrder.begin(); iter != OriginalScope.MemberOrder.end(); ++iter)
 	{
-		if(IsReference(*iter))
+		const ScopeDescription::FrameSlot& slot = OriginalScope.Layout->Slots[iter - OriginalScope.MemberOrder.begin()];
+		if(slot.ReferenceIndex != ScopeDescription::NoFrameIndex)
 		{
-			ReferenceBinding binding(stack.GetOffsetIntoStack(StackUsage.top()));
-			StackUsage.top() += ReferenceBinding::GetStorageSize();
+			ReferenceBinding binding(stack.GetOffsetIntoStack(StackUsage));
+			StackUsage += ReferenceBinding::GetStorageSize();
 
-			References.find(*iter)->second.second = binding.GetValue();
+			FrameReferences[slot.ReferenceIndex].second = binding.GetValue();
 		}
 		else if(IsFunctionSignature(*iter))
 		{
-			FunctionBinding binding(stack.GetOffsetIntoStack(StackUsage.top()));
-			StackUsage.top() += FunctionBinding::GetStorageSize();
+			FunctionBinding binding(stack.GetOffsetIntoStack(StackUsage));
+			StackUsage += FunctionBinding::GetStorageSize();
 
 			AddFunction(*iter, binding.GetValue());
 		}
 		else
 		{
-			VariableMap::iterator variter = Variables.find(*iter);
-			if(variter == Variables.end())
+			if(slot.VariableIndex == ScopeDescription::NoFrameIndex)
 				throw InternalFailureException("Incomplete variable bindings in scope; not sure how to proceed");
 
-			Variable& var = variter->second;
-			var.BindToStorage(stack.GetOffsetIntoStack(StackUsage.top()));
+			Variable& var = FrameVariables[slot.VariableIndex];
+			var.BindToStorage(stack.GetOffsetIntoStack(StackUsage));
 			switch(var.GetType())
 			{
 			case EpochVariableType_Tuple:
-				StackUsage.top() += GetTupleType(var.CastTo<TupleVariable>().GetValue()).GetTotalSize();
+				StackUsage += GetTupleType(var.CastTo<TupleVariable>().GetValue()).GetTotalSize();
 				break;
 			case EpochVariableType_Structure:
-				StackUsage.top() += GetStructureType(var.CastTo<StructureVariable>().GetValue()).GetTotalSize();
+				StackUsage += GetStructureType(var.CastTo<StructureVariable>().GetValue()).GetTotalSize();
 				break;
 			case EpochVariableType_Array:
-				StackUsage.top() += var.CastTo<ArrayVariable>().GetStorageSize();
+				StackUsage += var.CastTo<ArrayVariable>().GetStorageSize();
 				break;
 			default:
-				StackUsage.top() += TypeInfo::GetStorageSize(var.GetType());
+				StackUsage += TypeInfo::GetStorageSize(var.GetType());
 				break;
 			}
 		}
@@ -292,44 +236,52 @@ void ActivatedScope::BindToStack(StackSpace& stack)
 //
 void ActivatedScope::BindToMachineStack(void* rawstack)
 {
-	StackUsage.push(0);
+	ParameterStorage = NULL;
+
+	if(OriginalScope.Layout->BindingValid)
+	{
+		BindToParameters(reinterpret_cast<Byte*>(rawstack), true);
+		return;
+	}
+
+	PushStackUsage(0);
 
 	UByte* topofstack = reinterpret_cast<UByte*>(rawstack);
 
 	for(std::vector<std::wstring>::const_reverse_iterator iter = OriginalScope.MemberOrder.rbegin(); iter != OriginalScope.MemberOrder.rend(); ++iter)
 	{
-		if(IsReference(*iter))
+		const ScopeDescription::FrameSlot& slot = OriginalScope.Layout->Slots[OriginalScope.MemberOrder.rend() - iter - 1];
+		if(slot.ReferenceIndex != ScopeDescription::NoFrameIndex)
 		{
-			ReferenceBinding binding(topofstack + StackUsage.top());
-			StackUsage.top() += ReferenceBinding::GetStorageSize();
+			ReferenceBinding binding(topofstack + StackUsage);
+			StackUsage += ReferenceBinding::GetStorageSize();
 
-			References.find(*iter)->second.second = binding.GetValue();
+			FrameReferences[slot.ReferenceIndex].second = binding.GetValue();
 		}
 		else if(IsFunctionSignature(*iter))
 		{
-			FunctionBinding binding(topofstack + StackUsage.top());
-			StackUsage.top() += FunctionBinding::GetStorageSize();
+			FunctionBinding binding(topofstack + StackUsage);
+			StackUsage += FunctionBinding::GetStorageSize();
 
 			AddFunction(*iter, binding.GetValue());
 		}
 		else
 		{
-			VariableMap::iterator variter = Variables.find(*iter);
-			if(variter == Variables.end())
+			if(slot.VariableIndex == ScopeDescription::NoFrameIndex)
 				throw InternalFailureException("Incomplete variable bindings in scope; not sure how to proceed");
 
-			Variable& var = variter->second;
-			var.BindToStorage(topofstack + StackUsage.top());
+			Variable& var = FrameVariables[slot.VariableIndex];
+			var.BindToStorage(topofstack + StackUsage);
 			switch(var.GetType())
 			{
 			case EpochVariableType_Tuple:
-				StackUsage.top() += GetTupleType(var.CastTo<TupleVariable>().GetValue()).GetTotalSize();
+				StackUsage += GetTupleType(var.CastTo<TupleVariable>().GetValue()).GetTotalSize();
 				break;
 			case EpochVariableType_Structure:
-				StackUsage.top() += GetStructureType(var.CastTo<StructureVariable>().GetValue()).GetTotalSize();
+				StackUsage += GetStructureType(var.CastTo<StructureVariable>().GetValue()).GetTotalSize();
 				break;
 			default:
-				StackUsage.top() += TypeInfo::GetStorageSize(var.GetType());
+				StackUsage += TypeInfo::GetStorageSize(var.GetType());
 				break;
 			}
 		}
@@ -346,6 +298,11 @@ RValuePtr ActivatedScope::PopVariableOffStack(const std::wstring& name, StackSpa
 	return PopVariableOffStack(name, LookupVariable(name), stack, ignorestorage);
 }
 
+RValuePtr ActivatedScope::PopVariableOffStack(const VariableSlot& slot, const std::wstring& name, StackSpace& stack, bool ignorestorage)
+{
+	return PopVariableOffStack(name, LookupVariable(slot, name), stack, ignorestorage);
+}
+
 RValuePtr ActivatedScope::PopVariableOffStack(const std::wstring& name, Variable& var, StackSpace& stack, bool ignorestorage)
 {
 	switch(var.GetType())
@@ -563,6 +520,14 @@ RValuePtr ActivatedScope::PopVariableOffStack(const std::wstring& name, Variable
 			stack.Pop(ArrayVariable::GetBaseStorageSize());
 			return ret;
 		}
+	case EpochVariableType_HashMap:
+		{
+			HashMapVariable temp(stack.GetCurrentTopOfStack());
+			RValuePtr ret(temp.GetAsRValue());
+			var.CastTo<HashMapVariable>().SetHandleValue(temp.GetHandleValue());
+			stack.Pop(HashMapVariable::GetStorageSize());
+			return ret;
+		}
 	default:
 		throw NotImplementedException("Cannot pop variable of this type off the stack");
 	}
@@ -570,56 +535,43 @@ RValuePtr ActivatedScope::PopVariableOffStack(const std::wstring& name, Variable
 
 
 //-------------------------------------------------------------------------------
-// Ghosts
+// Function frames
 //-------------------------------------------------------------------------------
 
 //
-// Add linkage binding variables in the "other" scope to actual stored
-// variables in this scope. The other scope will recognize the ghosted
-// variables as valid, and defer to this scope to retrieve information
-// about those variables.
+// Link the given parameter and return value scopes to this scope, so
+// that the variables stored in them are visible from within this scope.
 //
-// This strategy is used to handle function parameter and return value
-// scopes. Since the two scopes are separate from the function body's
-// outermost lexical scope, there needs to be a way to register their
-// contents with the function's lexical scope so that the code within
-// the function can access the parameter/return variables. Ghosting is
-// our current solution for this issue.
+// This is used for the outermost lexical scope of a function's body.
+// The parameter and return value scopes are separate from the function
+// body's scope, so there needs to be a way for the code in the function
+// to access the parameter/return variables. This scope simply holds on
+// to the two scopes directly, and defers to them for any names which
+// belong to them; unlike a set of per-name links, this does not require
+// building any lookup structures each time the function is called.
 //
-void ActivatedScope::GhostIntoScope(ActivatedScope& other) const
+void ActivatedScope::LinkFunctionFrames(ActivatedScope& params, ActivatedScope& returns)
 {
-	if(other.Ghosts.empty())
-		throw InternalFailureException("Must PushNewGhostSet() before calling GhostIntoScope()");
-
-	for(VariableMap::const_iterator iter = Variables.begin(); iter != Variables.end(); ++iter)
-		other.Ghosts.back()[iter->first] = const_cast<ActivatedScope*>(this);
-
-	for(VariableRefMap::const_iterator iter = References.begin(); iter != References.end(); ++iter)
-		other.Ghosts.back()[iter->first] = const_cast<ActivatedScope*>(this);
-
-	for(FunctionMap::const_iterator iter = Functions.begin(); iter != Functions.end(); ++iter)
-		other.Ghosts.back()[iter->first] = const_cast<ActivatedScope*>(this);
+	ParamFrame = &params;
+	ReturnFrame = &returns;
 }
 
 //
-// Track a new set of ghosts for the current scope. We need to allow
-// multiple layers of "current" ghosts in order to properly handle
-// recursion and other re-entrant behaviours.
+// Find the linked function frame (if any) which holds the given name
 //
-void ActivatedScope::PushNewGhostSet()
+ActivatedScope* ActivatedScope::FindLinkedFrame(const std::wstring& name) const
 {
-	Ghosts.push_back(GhostVariableMap());
-}
+	if(!ParamFrame)
+		return NULL;
 
-//
-// Note that a set of ghost links is no longer in use, and restore
-// the ghost set (if any) that was active previously.
-//
-void ActivatedScope::PopGhostSet()
-{
-	Ghosts.pop_back();
-}
+	if(ReturnFrame->OriginalScope.Layout->FindMember(name) != ScopeDescription::NoFrameIndex)
+		return ReturnFrame;
+
+	if(ParamFrame->OriginalScope.Layout->FindMember(name) != ScopeDescription::NoFrameIndex)
+		return ParamFrame;
 
+	return NULL;
+}
 
 
 //-------------------------------------------------------------------------------
@@ -631,20 +583,37 @@ void ActivatedScope::PopGhostSet()
 //
 RValuePtr ActivatedScope::GetVariableValue(const std::wstring& name) const
 {
-	FutureMap::const_iterator futiter = Futures.find(name);
-	if(futiter != Futures.end())
-		return RValuePtr(futiter->second->GetValue());
+	const Future* future = FindLocalFuture(name);
+	if(future)
+		return future->GetValue();
 
-	const Variable& var = LookupVariable(name);
+	return GetVariableValue(LookupVariable(name));
+}
+
+//
+// Retrieve the value of the variable in the given precomputed slot as an r-value
+//
+RValuePtr ActivatedScope::GetVariableValue(const VariableSlot& slot, const std::wstring& name) const
+{
+	if(!slot.IsResolved())
+		return GetVariableValue(name);
 
+	return GetVariableValue(LookupVariable(slot, name));
+}
+
+//
+// Wrap the contents of a variable in an r-value
+//
+RValuePtr ActivatedScope::GetVariableValue(const Variable& var) const
+{
 	switch(var.GetType())
 	{
 	case EpochVariableType_Null:		return RValuePtr(new NullRValue());
-	case EpochVariableType_Integer:		return GetVariableRef<IntegerVariable>(name).GetAsRValue();
-	case EpochVariableType_Integer16:	return GetVariableRef<Integer16Variable>(name).GetAsRValue();
-	case EpochVariableType_Real:		return GetVariableRef<RealVariable>(name).GetAsRValue();
-	case EpochVariableType_Boolean:		return GetVariableRef<BooleanVariable>(name).GetAsRValue();
-	case EpochVariableType_String:		return GetVariableRef<StringVariable>(name).GetAsRValue();
+	case EpochVariableType_Integer:		return var.CastTo<IntegerVariable>().GetAsRValue();
+	case EpochVariableType_Integer16:	return var.CastTo<Integer16Variable>().GetAsRValue();
+	case EpochVariableType_Real:		return var.CastTo<RealVariable>().GetAsRValue();
+	case EpochVariableType_Boolean:		return var.CastTo<BooleanVariable>().GetAsRValue();
+	case EpochVariableType_String:		return var.CastTo<StringVariable>().GetAsRValue();
 	case EpochVariableType_Tuple:
 		{
 			const TupleVariable& vartuple = var.CastTo<TupleVariable>();
@@ -669,8 +638,9 @@ RValuePtr ActivatedScope::GetVariableValue(const std::wstring& name) const
 
 			return retptr;
 		}
-	case EpochVariableType_Buffer:		return GetVariableRef<BufferVariable>(name).GetAsRValue();
-	case EpochVariableType_Array:		return GetVariableRef<ArrayVariable>(name).GetAsRValue();
+	case EpochVariableType_Buffer:		return var.CastTo<BufferVariable>().GetAsRValue();
+	case EpochVariableType_Array:		return var.CastTo<ArrayVariable>().GetAsRValue();
+	case EpochVariableType_HashMap:		return var.CastTo<HashMapVariable>().GetAsRValue();
 	}
 
 	throw NotImplementedException("Cannot retrieve variable value - unrecognized type");
@@ -724,6 +694,10 @@ RValuePtr ActivatedScope::SetVariableValue(const std::wstring& name, RValuePtr v
 		var.CastTo<ArrayVariable>().SetValue(value->CastTo<ArrayRValue>().GetHandle());
 		break;
 
+	case EpochVariableType_HashMap:
+		var.CastTo<HashMapVariable>().SetHandleValue(value->CastTo<HashMapRValue>().GetOriginHandle());
+		break;
+
 	default:
 		throw NotImplementedException("Cannot set variable value for this type");
 		break;
@@ -861,8 +835,8 @@ const FunctionSignature& ActivatedScope::GetFunctionSignature(unsigned memberind
 //
 Future* ActivatedScope::GetFuture(const std::wstring& name)
 {
-	FutureMap::iterator iter = Futures.find(name);
-	if(iter == Futures.end())
+	ScopeDescription::FutureMap::iterator iter = OriginalScope.Futures.find(name);
+	if(iter == OriginalScope.Futures.end())
 	{
 		if(ParentScope)
 			return ParentScope->GetFuture(name);
@@ -873,6 +847,18 @@ Future* ActivatedScope::GetFuture(const std::wstring& name)
 	return iter->second;
 }
 
+//
+// Retrieve a future declared directly in this scope, or NULL if there is none
+//
+const Future* ActivatedScope::FindLocalFuture(const std::wstring& name) const
+{
+	ScopeDescription::FutureMap::const_iterator iter = OriginalScope.Futures.find(name);
+	if(iter == OriginalScope.Futures.end())
+		return NULL;
+
+	return iter->second;
+}
+
 
 
 //-------------------------------------------------------------------------------
@@ -902,12 +888,9 @@ FunctionBase* ActivatedScope::GetFunction(const std::wstring& name) const
 	if(iter != Functions.end())
 		return iter->second;
 
-	if(!Ghosts.empty())
-	{
-		GhostVariableMap::const_iterator ghostiter = Ghosts.back().find(name);
-		if(ghostiter != Ghosts.back().end())
-			return ghostiter->second->GetFunction(name);
-	}
+	ActivatedScope* frame = FindLinkedFrame(name);
+	if(frame)
+		return frame->GetFunction(name);
 
 	if(ParentScope)
 		return ParentScope->GetFunction(name);
@@ -915,6 +898,51 @@ FunctionBase* ActivatedScope::GetFunction(const std::wstring& name) const
 	return OriginalScope.GetFunction(name);
 }
 
+//
+// Retrieve a runtime-bound function, given the scope which supplied
+// the binding the last time the same lookup was performed
+//
+// Runtime bindings are only ever created from the function signature
+// members of a scope's description, so the same lookup tends to find
+// its binding in the same scope every time. The cached scope is only
+// trusted if all scopes between here and there have no bindings and
+// no linked function frames, which guarantees that the result matches a
+// full lookup; otherwise the full lookup is done and the cache updated.
+//
+FunctionBase* ActivatedScope::GetFunction(const std::wstring& name, const ScopeDescription*& bindingscope) const
+{
+	const ScopeDescription* cachedscope = bindingscope;
+	if(cachedscope)
+	{
+		for(const ActivatedScope* scope = this; scope; scope = scope->ParentScope)
+		{
+			if(&scope->OriginalScope == cachedscope)
+			{
+				FunctionMap::const_iterator iter = scope->Functions.find(name);
+				if(iter != scope->Functions.end())
+					return iter->second;
+				break;
+			}
+
+			if(!scope->Functions.empty() || scope->HasLinkedFrames())
+				break;
+		}
+	}
+
+	for(const ActivatedScope* scope = this; scope && !scope->HasLinkedFrames(); scope = scope->ParentScope)
+	{
+		FunctionMap::const_iterator iter = scope->Functions.find(name);
+		if(iter != scope->Functions.end())
+		{
+			bindingscope = &scope->OriginalScope;
+			return iter->second;
+		}
+	}
+
+	bindingscope = NULL;
+	return GetFunction(name);
+}
+
 
 
 //-------------------------------------------------------------------------------
@@ -927,11 +955,11 @@ FunctionBase* ActivatedScope::GetFunction(const std::wstring& name) const
 //
 RValuePtr ActivatedScope::GetEffectiveTuple() const
 {
-	if(Variables.empty())
+	if(FrameVariables.empty())
 		return RValuePtr(new NullRValue());
 
-	if(Variables.size() == 1)
-		return GetVariableValue(Variables.begin()->first);
+	if(FrameVariables.size() == 1)
+		return GetVariableValue(FrameVariables.front());
 
 	IDType id = TupleTrackerClass::InvalidID;
 	
@@ -962,23 +990,26 @@ RValuePtr ActivatedScope::GetEffectiveTuple() const
 //
 Variable& ActivatedScope::LookupVariable(const std::wstring& name) const
 {
-	VariableMap::const_iterator iter = Variables.find(name);
-	if(iter != Variables.end())
-		return const_cast<Variable&>(iter->second);
+	const ScopeDescription::FrameSlot* slot = NULL;
 
-	if(!Ghosts.empty())
+	size_t memberindex = OriginalScope.Layout->FindMember(name);
+	if(memberindex != ScopeDescription::NoFrameIndex)
 	{
-		GhostVariableMap::const_iterator ghostiter = Ghosts.back().find(name);
-		if(ghostiter != Ghosts.back().end())
-			return ghostiter->second->LookupVariable(name);
+		slot = &OriginalScope.Layout->Slots[memberindex];
+		if(slot->VariableIndex != ScopeDescription::NoFrameIndex)
+			return const_cast<Variable&>(FrameVariables[slot->VariableIndex]);
 	}
 
-	VariableRefMap::const_iterator refiter = References.find(name);
-	if(refiter != References.end())
+	ActivatedScope* frame = FindLinkedFrame(name);
+	if(frame)
+		return frame->LookupVariable(name);
+
+	if(slot && slot->ReferenceIndex != ScopeDescription::NoFrameIndex)
 	{
-		if(!refiter->second.second)
+		const VariableRefDescriptor& reference = FrameReferences[slot->ReferenceIndex];
+		if(!reference.second)
 			throw ExecutionException("Cannot access unbound reference");
-		return *refiter->second.second;
+		return *reference.second;
 	}
 
 	if(ParentScope)
@@ -987,29 +1018,168 @@ Variable& ActivatedScope::LookupVariable(const std::wstring& name) const
 	throw MissingVariableException("Failed to find the given variable");
 }
 
+//
+// Look up a variable using a slot precomputed from the scope descriptions
+//
+// Rather than searching for the name in each scope along the chain, we
+// only need to locate the activation of the scope that owns the slot; a
+// pointer comparison per scope is far cheaper than the string lookups.
+// Linked function frames are checked as well, since function parameters
+// and return values are owned by scopes which are not part of the parent
+// chain. If no owning activation can be found (for instance because the
+// program was modified after slot resolution) we revert to a by-name
+// lookup, which will also produce a suitable error if needed.
+//
+Variable& ActivatedScope::LookupVariable(const VariableSlot& slot, const std::wstring& name) const
+{
+	if(slot.IsResolved())
+	{
+		// Globals are reached directly; tasks may only read constant
+		// globals, so this needs no synchronization of its own
+		const ActivatedScope* single = slot.OwnerScope->GetSingleActivation();
+		if(single)
+			return single->LookupSlotMember(slot.MemberIndex, name);
+
+		for(const ActivatedScope* scope = this; scope; scope = scope->ParentScope)
+		{
+			if(&scope->OriginalScope == slot.OwnerScope)
+				return scope->LookupSlotMember(slot.MemberIndex, name);
+
+			if(scope->ParamFrame)
+			{
+				if(&scope->ReturnFrame->OriginalScope == slot.OwnerScope)
+					return scope->ReturnFrame->LookupSlotMember(slot.MemberIndex, name);
+
+				if(&scope->ParamFrame->OriginalScope == slot.OwnerScope)
+					return scope->ParamFrame->LookupSlotMember(slot.MemberIndex, name);
+			}
+		}
+	}
+
+	return LookupVariable(name);
+}
+
+//
+// Retrieve the variable (or referenced variable) bound to the given member slot
+//
+Variable& ActivatedScope::LookupSlotMember(size_t memberindex, const std::wstring& name) const
+{
+	if(memberindex < OriginalScope.Layout->Slots.size())
+	{
+		const ScopeDescription::FrameSlot& slot = OriginalScope.Layout->Slots[memberindex];
+		if(slot.VariableIndex != ScopeDescription::NoFrameIndex)
+			return const_cast<Variable&>(FrameVariables[slot.VariableIndex]);
+
+		if(slot.ReferenceIndex != ScopeDescription::NoFrameIndex)
+		{
+			const VariableRefDescriptor& reference = FrameReferences[slot.ReferenceIndex];
+			if(!reference.second)
+				throw ExecutionException("Cannot access unbound reference");
+			return *reference.second;
+		}
+	}
+
+	return LookupVariable(name);
+}
+
+//
+// Take a private copy of the variable wrappers laid out by the scope description
+//
+// The layout is normally prepared by the optimizer before the program
+// starts executing; scopes that were created or modified later on are
+// prepared here on first activation instead.
+//
+void ActivatedScope::CopyFrameLayout()
+{
+	if(!OriginalScope.FrameLayoutValid)
+		OriginalScope.PrepareFrameLayout();
+
+	FrameVariables = OriginalScope.Layout->Variables;
+	FrameReferences = OriginalScope.Layout->References;
+}
+
+//
+// Bind the scope's members to a block of passed parameters
+//
+// This uses the binding layout precomputed by the scope description, so
+// no lookups or type queries are needed per member. Parameters passed
+// on the VM stack have the first member at the lowest address, while
+// parameters passed on the machine stack are laid out in reverse.
+//
+void ActivatedScope::BindToParameters(Byte* parameters, bool reverseorder)
+{
+	PushStackUsage(0);
+
+	const size_t nummembers = OriginalScope.Layout->Slots.size();
+	for(size_t i = 0; i < nummembers; ++i)
+	{
+		size_t memberindex = reverseorder ? (nummembers - i - 1) : i;
+		const ScopeDescription::FrameSlot& slot = OriginalScope.Layout->Slots[memberindex];
+		Byte* storage = parameters + StackUsage;
+
+		if(slot.ReferenceIndex != ScopeDescription::NoFrameIndex)
+			FrameReferences[slot.ReferenceIndex].second = ReferenceBinding(storage).GetValue();
+		else if(slot.IsFunctionBinding)
+			AddFunction(OriginalScope.MemberOrder[memberindex], FunctionBinding(storage).GetValue());
+		else
+			FrameVariables[slot.VariableIndex].BindToStorage(storage);
+
+		StackUsage += slot.BindingSize;
+	}
+}
+
+//
+// Track the amount of stack space used by a new entry into the scope
+//
+void ActivatedScope::PushStackUsage(size_t usage)
+{
+	if(StackUsageDepth)
+		NestedStackUsage.push_back(StackUsage);
+
+	StackUsage = usage;
+	++StackUsageDepth;
+}
+
+//
+// Retrieve and discard the stack space used by the innermost entry into the scope
+//
+size_t ActivatedScope::PopStackUsage()
+{
+	if(!StackUsageDepth)
+		throw InternalFailureException("Exited scope too many times!");
+
+	size_t usage = StackUsage;
+	if(--StackUsageDepth)
+	{
+		StackUsage = NestedStackUsage.back();
+		NestedStackUsage.pop_back();
+	}
+	else
+		StackUsage = 0;
+
+	return usage;
+}
+
 //
 // Ensure that we cannot duplicate identifiers within scopes, or introduce shadowing identifiers
 //
 void ActivatedScope::CheckForDuplicateIdentifier(const std::wstring& name) const
 {
-	if(Variables.find(name) != Variables.end())
+	if(OriginalScope.Variables.find(name) != OriginalScope.Variables.end())
 		throw DuplicateIdentifierException("The name \"" + narrow(name) + "\" is already in use as a variable identifier");
 
-	if(References.find(name) != References.end())
+	if(OriginalScope.References.find(name) != OriginalScope.References.end())
 		throw DuplicateIdentifierException("The name \"" + narrow(name) + "\" is already in use as a variable reference identifier");
 
-	if(Futures.find(name) != Futures.end())
+	if(OriginalScope.Futures.find(name) != OriginalScope.Futures.end())
 		throw DuplicateIdentifierException("The name \"" + narrow(name) + "\" is already in use as a future identifier");
 
 	if(Functions.find(name) != Functions.end())
 		throw DuplicateIdentifierException("The name \"" + narrow(name) + "\" is already in use as a function identifier");
 
-	for(std::deque<GhostVariableMap>::const_iterator iter = Ghosts.begin(); iter != Ghosts.end(); ++iter)
-	{
-		GhostVariableMap::const_iterator ghostiter = iter->find(name);
-		if(ghostiter != iter->end())
-			ghostiter->second->CheckForDuplicateIdentifier(name);
-	}
+	ActivatedScope* frame = FindLinkedFrame(name);
+	if(frame)
+		frame->CheckForDuplicateIdentifier(name);
 
 	if(ParentScope)
 		ParentScope->CheckForDuplicateIdentifier(name);
@@ -1050,4 +1220,26 @@ unsigned ActivatedScope::FindLastMessageOrigin() const
 	return 0;
 }
 
+//
+// Claim the future awaiting a reply to the request being handled;
+// if no request is awaiting a reply, returns NULL.
+//
+// The claim is cleared from the scope which held it, so each request
+// can be replied to at most once.
+//
+Future* ActivatedScope::TakePendingReply()
+{
+	if(PendingReply)
+	{
+		Future* ret = PendingReply;
+		PendingReply = NULL;
+		return ret;
+	}
+
+	if(ParentScope)
+		return ParentScope->TakePendingReply();
+
+	return NULL;
+}
+
 
@@ -14,10 +14,18 @@
 // be "entered" multiple times but representing different instances
 // of the variables/etc. each time.
 //
+// Activation is kept as cheap as possible, since it happens for every
+// function call and nested code block. The scope description provides
+// a precomputed frame layout; the activated scope only copies the flat
+// list of variable wrappers, and reserves the whole frame with a single
+// stack push when entered.
+//
 
 #pragma once
 
 #include "Virtual Machine/Core Entities/RValue.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 
 // Forward declarations
@@ -49,6 +57,14 @@ namespace VM
 		ActivatedScope(const ActivatedScope& rhs);
 		ActivatedScope& operator = (const ActivatedScope& rhs);
 
+	// Memory management
+	public:
+		static void* operator new(size_t size)
+		{ return ThreadLocalArena::Allocate(size); }
+
+		static void operator delete(void* ptr)
+		{ ThreadLocalArena::Free(ptr); }
+
 	// Stack interaction interface
 	public:
 		void Enter(StackSpace& stack);
@@ -61,16 +77,19 @@ namespace VM
 
 		RValuePtr PopVariableOffStack(const std::wstring& name, StackSpace& stack, bool ignorestorage);
 		RValuePtr PopVariableOffStack(const std::wstring& name, Variable& var, StackSpace& stack, bool ignorestorage);
+		RValuePtr PopVariableOffStack(const VariableSlot& slot, const std::wstring& name, StackSpace& stack, bool ignorestorage);
 
-	// Ghost-references for parameter and return value scopes (see function documentation for more details)
+	// Links to parameter and return value scopes (see function documentation for more details)
 	public:
-		void GhostIntoScope(ActivatedScope& other) const;
-		void PushNewGhostSet();
-		void PopGhostSet();
+		void LinkFunctionFrames(ActivatedScope& params, ActivatedScope& returns);
+
+		bool HasLinkedFrames() const
+		{ return (ParamFrame != NULL); }
 
 	// Variable getters and setters
 	public:
 		RValuePtr GetVariableValue(const std::wstring& name) const;
+		RValuePtr GetVariableValue(const VariableSlot& slot, const std::wstring& name) const;
 		RValuePtr SetVariableValue(const std::wstring& name, RValuePtr value);
 
 	// Type information retrieval
@@ -89,6 +108,13 @@ namespace VM
 		template <class VarClass>
 		VarClass& GetVariableRef(const std::wstring& name)							{ return LookupVariable(name).CastTo<VarClass>(); }
 
+	// Access to variables via slots precomputed at load time
+	public:
+		Variable& GetVariableRef(const VariableSlot& slot, const std::wstring& name)	{ return LookupVariable(slot, name); }
+
+		template <class VarClass>
+		VarClass& GetVariableRef(const VariableSlot& slot, const std::wstring& name)	{ return LookupVariable(slot, name).CastTo<VarClass>(); }
+
 	// Tuples
 	public:
 		bool HasTupleType(const std::wstring& name);
@@ -124,6 +150,7 @@ namespace VM
 	// Futures
 	public:
 		Future* GetFuture(const std::wstring& name);
+		const Future* FindLocalFuture(const std::wstring& name) const;
 
 	// References
 	public:
@@ -134,15 +161,31 @@ namespace VM
 	public:
 		void AddFunction(const std::wstring& name, FunctionBase* func);
 		FunctionBase* GetFunction(const std::wstring& name) const;
+		FunctionBase* GetFunction(const std::wstring& name, const ScopeDescription*& bindingscope) const;
 
 	// Helpers for multiple return values
 	public:
 		RValuePtr GetEffectiveTuple() const;
 
+	// Stack usage queries
+	public:
+		size_t GetStackUsage() const
+		{ return StackUsage; }
+
 	// Internal helpers
 	private:
 		Variable& LookupVariable(const std::wstring& name) const;
+		Variable& LookupVariable(const VariableSlot& slot, const std::wstring& name) const;
+		Variable& LookupSlotMember(size_t memberindex, const std::wstring& name) const;
 		void CheckForDuplicateIdentifier(const std::wstring& name) const;
+		ActivatedScope* FindLinkedFrame(const std::wstring& name) const;
+
+		RValuePtr GetVariableValue(const Variable& var) const;
+		void CopyFrameLayout();
+		void BindToParameters(Byte* parameters, bool reverseorder);
+
+		void PushStackUsage(size_t usage);
+		size_t PopStackUsage();
 
 	// Public information on the origins of this scope
 	public:
@@ -154,35 +197,49 @@ namespace VM
 	public:
 		TaskHandle TaskOrigin;
 		TaskHandle LastMessageOrigin;
+		Future* PendingReply;
 
 		TaskHandle FindTaskOrigin() const;
 		TaskHandle FindLastMessageOrigin() const;
+		Future* TakePendingReply();
+
+	// Tail call support
+	public:
+		ActivatedScope* GetLinkedParamFrame() const
+		{ return ParamFrame; }
+
+		Byte* GetParameterStorage() const
+		{ return ParameterStorage; }
+
+		bool TailCallPending;
+
+	// Loop invariant support
+	public:
+		Byte* LoopInvariantStorage;
 
 	// Internal tracking
 	private:
 		ScopeDescription& OriginalScope;
 
-		typedef std::pair<std::wstring, ActivatedScope*> GhostVariableMapEntry;
-		typedef std::map<std::wstring, ActivatedScope*> GhostVariableMap;
-		std::deque<GhostVariableMap> Ghosts;
+		ActivatedScope* ParamFrame;
+		ActivatedScope* ReturnFrame;
 
-		typedef std::pair<std::wstring, Variable> VariableMapEntry;
-		typedef std::map<std::wstring, Variable> VariableMap;
-		VariableMap Variables;
+		Byte* ParameterStorage;
 
-		typedef std::pair<EpochVariableTypeID, Variable*> VariableRefDescriptor;
-		typedef std::pair<std::wstring, VariableRefDescriptor> VariableRefMapEntry;
-		typedef std::map<std::wstring, VariableRefDescriptor> VariableRefMap;
-		VariableRefMap References;
+		std::vector<Variable> FrameVariables;
 
-		typedef std::map<std::wstring, Future*> FutureMap;
-		FutureMap Futures;
+		typedef std::pair<EpochVariableTypeID, Variable*> VariableRefDescriptor;
+		std::vector<VariableRefDescriptor> FrameReferences;
 
 		typedef std::pair<std::wstring, FunctionBase*> FunctionMapEntry;
 		typedef std::map<std::wstring, FunctionBase*> FunctionMap;
 		FunctionMap Functions;
 
-		std::stack<size_t> StackUsage;
+		// The usage of the innermost entry is kept inline, since scopes
+		// are almost never entered more than once at the same time
+		size_t StackUsage;
+		unsigned StackUsageDepth;
+		std::vector<size_t> NestedStackUsage;
 	};
 
 }
@@ -18,6 +18,7 @@
 #include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
 #include "Virtual Machine/Core Entities/Concurrency/Future.h"
 
@@ -31,12 +32,125 @@
 
 #include "Utility/Memory/Stack.h"
 #include "Utility/Memory/Heap.h"
+#include "Utility/Memory/Alignment.h"
 #include "Utility/Strings.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Configuration/RuntimeOptions.h"
 
 
 using namespace VM;
 
 
+namespace
+{
+
+	//
+	// Ordering of member indices by the names of the members
+	//
+	struct MemberNameOrdering
+	{
+		explicit MemberNameOrdering(const std::vector<std::wstring>& names)
+			: Names(names)
+		{ }
+
+		bool operator () (size_t lhs, size_t rhs) const
+		{ return Names[lhs] < Names[rhs]; }
+
+		const std::vector<std::wstring>& Names;
+	};
+
+	//
+	// Pad a frame offset so that a member of the given size is naturally aligned, if aligned layouts are in use
+	//
+	size_t AlignFrameOffset(size_t offset, size_t size)
+	{
+		if(!Config::AlignedLayout || !size)
+			return offset;
+
+		return Alignment::AlignUp(offset, Alignment::GetNaturalAlignment(size));
+	}
+
+}
+
+
+//
+// Process-wide pool of distinct frame layouts
+//
+// Layouts are keyed by a description of their complete contents, and
+// are reference counted by the scopes which share them.
+//
+struct ScopeDescription::FrameLayoutPool
+{
+	typedef std::map<std::wstring, FrameLayout*> LayoutMap;
+
+	~FrameLayoutPool()
+	{
+		for(LayoutMap::iterator iter = Layouts.begin(); iter != Layouts.end(); ++iter)
+			delete iter->second;
+	}
+
+	FrameLayout* Intern(std::auto_ptr<FrameLayout> layout)
+	{
+		std::wstring key = DescribeLayout(*layout);
+
+		Threads::CriticalSection::Auto mutex(CritSec);
+
+		LayoutMap::iterator iter = Layouts.find(key);
+		if(iter == Layouts.end())
+			iter = Layouts.insert(LayoutMap::value_type(key, layout.release())).first;
+
+		++iter->second->RefCount;
+		return iter->second;
+	}
+
+	void Release(FrameLayout* layout)
+	{
+		std::wstring key = DescribeLayout(*layout);
+
+		Threads::CriticalSection::Auto mutex(CritSec);
+
+		if(--layout->RefCount == 0)
+		{
+			Layouts.erase(key);
+			delete layout;
+		}
+	}
+
+	static std::wstring DescribeLayout(const FrameLayout& layout)
+	{
+		std::wostringstream description;
+		description << layout.Stackable << layout.HintsMissing << layout.BindingValid << L' ' << layout.StorageSize;
+
+		for(size_t i = 0; i < layout.Slots.size(); ++i)
+		{
+			const FrameSlot& slot = layout.Slots[i];
+			description << L'\x1f' << layout.MemberNames[i] << L'\x1f'
+						<< slot.VariableIndex << L' ' << slot.ReferenceIndex << L' '
+						<< slot.StackOffset << L' ' << slot.HeapOffset << L' '
+						<< slot.BindingSize << L' ' << slot.IsFunctionBinding;
+
+			if(slot.VariableIndex != NoFrameIndex)
+			{
+				const Variable& var = layout.Variables[slot.VariableIndex];
+				description << L' ' << var.GetType() << L' ' << var.GetStorage();
+			}
+			else if(slot.ReferenceIndex != NoFrameIndex)
+			{
+				const VariableRefDescriptor& reference = layout.References[slot.ReferenceIndex];
+				description << L' ' << reference.first << L' ' << reference.second;
+			}
+		}
+
+		return description.str();
+	}
+
+	Threads::CriticalSection CritSec;
+	LayoutMap Layouts;
+};
+
+ScopeDescription::FrameLayoutPool ScopeDescription::TheFrameLayoutPool;
+
+
 //-------------------------------------------------------------------------------
 // Construction and destruction
 //-------------------------------------------------------------------------------
@@ -45,7 +159,10 @@ using namespace VM;
 // Construct and initialize a lexical scope template
 //
 ScopeDescription::ScopeDescription()
-	: ParentScope(NULL)
+	: ParentScope(NULL),
+	  FrameLayoutValid(false),
+	  Layout(NULL),
+	  SingleActivation(NULL)
 {
 }
 
@@ -69,7 +186,13 @@ ScopeDescription::~ScopeDescription()
 		delete iter->second;
 
 	for(FutureMap::iterator iter = Futures.begin(); iter != Futures.end(); ++iter)
-		delete iter->second;
+	{
+		if(SharedFutures.find(iter->first) == SharedFutures.end())
+			delete iter->second;
+	}
+
+	if(Layout)
+		TheFrameLayoutPool.Release(Layout);
 }
 
 
@@ -85,6 +208,7 @@ void ScopeDescription::AddVariable(const std::wstring& name, EpochVariableTypeID
 	CheckForDuplicateIdentifier(name);
 
 	MemberOrder.push_back(name);
+	FrameLayoutValid = false;
 
 	switch(type)
 	{
@@ -112,6 +236,9 @@ void ScopeDescription::AddVariable(const std::wstring& name, EpochVariableTypeID
 	case EpochVariableType_Array:
 		Variables.insert(VariableMapEntry(name, ArrayVariable(NULL)));
 		break;
+	case EpochVariableType_HashMap:
+		Variables.insert(VariableMapEntry(name, HashMapVariable(NULL)));
+		break;
 	default:
 		throw NotImplementedException("Cannot add variable to scope - type not recognized");
 	}
@@ -125,6 +252,7 @@ void ScopeDescription::AddTupleVariable(const std::wstring& tupletypename, const
 	CheckForDuplicateIdentifier(name);
 
 	MemberOrder.push_back(name);
+	FrameLayoutValid = false;
 	Variables.insert(VariableMapEntry(name, TupleVariable(NULL)));
 	TupleTypeHints.insert(TupleTypeIDMapEntry(name, GetTupleTypeID(tupletypename)));
 }
@@ -137,6 +265,7 @@ void ScopeDescription::AddStructureVariable(const std::wstring& structuretypenam
 	CheckForDuplicateIdentifier(name);
 
 	MemberOrder.push_back(name);
+	FrameLayoutValid = false;
 	Variables.insert(VariableMapEntry(name, StructureVariable(NULL)));
 	StructureTypeHints.insert(StructureTypeIDMapEntry(name, GetStructureTypeID(structuretypename)));
 }
@@ -146,6 +275,7 @@ void ScopeDescription::AddStructureVariable(IDType structuretypeid, const std::w
 	CheckForDuplicateIdentifier(name);
 
 	MemberOrder.push_back(name);
+	FrameLayoutValid = false;
 	Variables.insert(VariableMapEntry(name, StructureVariable(NULL)));
 	StructureTypeHints.insert(StructureTypeIDMapEntry(name, structuretypeid));
 }
@@ -163,6 +293,7 @@ void ScopeDescription::AddReference(EpochVariableTypeID type, const std::wstring
 	CheckForDuplicateIdentifier(name);
 
 	MemberOrder.push_back(name);
+	FrameLayoutValid = false;
 	References.insert(VariableRefMapEntry(name, VariableRefDescriptor(type, NULL)));
 }
 
@@ -188,6 +319,7 @@ void ScopeDescription::AddFunctionSignature(const std::wstring& name, const Func
 	{
 		CheckForDuplicateIdentifier(name);
 		MemberOrder.push_back(name);
+		FrameLayoutValid = false;
 	}
 	FunctionSignatures.insert(FunctionSignatureMapEntry(name, signature));
 }
@@ -251,6 +383,20 @@ void ScopeDescription::AddFuture(const std::wstring& name, VM::OperationPtr boun
 	Futures.insert(std::make_pair(name, new Future(boundop)));
 }
 
+//
+// Make a future owned by another scope readable by name from this scope
+//
+// The future is not released along with this scope; its owner must
+// outlive any code which reads it through this scope.
+//
+void ScopeDescription::ShareFuture(const std::wstring& name, Future* future)
+{
+	CheckForDuplicateIdentifier(name);
+
+	Futures.insert(std::make_pair(name, future));
+	SharedFutures.insert(name);
+}
+
 
 //-------------------------------------------------------------------------------
 // Generic variable information retrieval
@@ -328,6 +474,43 @@ const ScopeDescription* ScopeDescription::GetScopeOwningVariable(const std::wstr
 	return NULL;
 }
 
+//
+// Determine the owning scope and member index of the given variable,
+// so that activated scopes can access it without repeating the search.
+// References are resolved as well, since their binding lives in a slot
+// of the owning scope; futures are not, since they are not variables.
+// If the name cannot be resolved statically, an unresolved slot is
+// returned and callers should fall back on looking up the name.
+//
+VariableSlot ScopeDescription::ResolveVariableSlot(const std::wstring& name) const
+{
+	if(Variables.find(name) != Variables.end() || References.find(name) != References.end())
+	{
+		for(size_t i = 0; i < MemberOrder.size(); ++i)
+		{
+			if(MemberOrder[i] == name)
+				return VariableSlot(this, i);
+		}
+
+		return VariableSlot();
+	}
+
+	if(Futures.find(name) != Futures.end())
+		return VariableSlot();
+
+	if(!Ghosts.empty())
+	{
+		GhostVariableMap::const_iterator iter = Ghosts.back().find(name);
+		if(iter != Ghosts.back().end())
+			return iter->second->ResolveVariableSlot(name);
+	}
+
+	if(ParentScope)
+		return ParentScope->ResolveVariableSlot(name);
+
+	return VariableSlot();
+}
+
 
 //-------------------------------------------------------------------------------
 // Ghost references
@@ -629,6 +812,7 @@ IDType ScopeDescription::GetVariableTupleTypeID(const std::wstring& varname) con
 void ScopeDescription::SetVariableTupleTypeID(const std::wstring& name, IDType id)
 {
 	TupleTypeHints.insert(TupleTypeIDMapEntry(name, id));
+	FrameLayoutValid = false;
 }
 
 
@@ -733,6 +917,7 @@ IDType ScopeDescription::GetVariableStructureTypeID(const std::wstring& varname)
 void ScopeDescription::SetVariableStructureTypeID(const std::wstring& name, IDType id)
 {
 	StructureTypeHints.insert(StructureTypeIDMapEntry(name, id));
+	FrameLayoutValid = false;
 }
 
 
@@ -772,6 +957,184 @@ const VM::ResponseMap& ScopeDescription::GetResponseMap(const std::wstring& name
 }
 
 
+//-------------------------------------------------------------------------------
+// Frame layout
+//-------------------------------------------------------------------------------
+
+//
+// Precompute the storage layout used when activating this scope
+//
+// Each activation needs its own copy of the variable wrappers, so that
+// recursive and re-entrant code can bind the same lexical scope to
+// different storage. Rather than copying the name-keyed maps on every
+// activation, we flatten the variables and references into vectors in
+// member order, and record where each variable lives within a single
+// contiguous frame. Activating the scope then costs one vector copy and
+// one stack reservation, regardless of the number of members.
+//
+// Stack offsets reproduce the layout obtained by pushing each variable
+// individually (the stack grows downwards, so the first member ends up
+// at the highest address), while heap offsets lay members out in order.
+// When aligned layouts are enabled, both are padded so that each member
+// is naturally aligned relative to the start of the frame.
+//
+// The layout is computed once the program has been loaded, and again
+// if the scope is modified afterwards; it is not safe to call this
+// while the scope is being activated from other threads.
+//
+void ScopeDescription::PrepareFrameLayout()
+{
+	std::auto_ptr<FrameLayout> layout(new FrameLayout);
+
+	layout->Slots.reserve(MemberOrder.size());
+	std::vector<size_t> sizes;
+	sizes.reserve(MemberOrder.size());
+
+	for(std::vector<std::wstring>::const_iterator iter = MemberOrder.begin(); iter != MemberOrder.end(); ++iter)
+	{
+		FrameSlot slot;
+		slot.VariableIndex = NoFrameIndex;
+		slot.ReferenceIndex = NoFrameIndex;
+		slot.StackOffset = 0;
+		slot.HeapOffset = 0;
+		slot.BindingSize = 0;
+		slot.IsFunctionBinding = false;
+
+		size_t size = 0;
+
+		VariableMap::const_iterator variter = Variables.find(*iter);
+		if(variter != Variables.end())
+		{
+			slot.VariableIndex = layout->Variables.size();
+			layout->Variables.push_back(variter->second);
+
+			switch(variter->second.GetType())
+			{
+			case EpochVariableType_Tuple:
+				{
+					TupleTypeIDMap::const_iterator ttiter = TupleTypeHints.find(*iter);
+					if(ttiter == TupleTypeHints.end())
+						layout->HintsMissing = true;
+					else
+						size = GetTupleType(ttiter->second).GetTotalSize();
+				}
+				break;
+			case EpochVariableType_Structure:
+				{
+					StructureTypeIDMap::const_iterator stiter = StructureTypeHints.find(*iter);
+					if(stiter == StructureTypeHints.end())
+						layout->HintsMissing = true;
+					else
+						size = GetStructureType(stiter->second).GetTotalSize();
+				}
+				break;
+			case EpochVariableType_Null:
+			case EpochVariableType_Integer:
+			case EpochVariableType_Integer16:
+			case EpochVariableType_Real:
+			case EpochVariableType_Boolean:
+			case EpochVariableType_String:
+			case EpochVariableType_Buffer:
+			case EpochVariableType_Array:
+			case EpochVariableType_HashMap:
+				size = TypeInfo::GetStorageSize(variter->second.GetType());
+				break;
+			default:
+				// Heap storage can accommodate this variable, but stack frames cannot
+				size = TypeInfo::GetStorageSize(variter->second.GetType());
+				layout->Stackable = false;
+				break;
+			}
+		}
+		else
+		{
+			VariableRefMap::const_iterator refiter = References.find(*iter);
+			if(refiter != References.end())
+			{
+				slot.ReferenceIndex = layout->References.size();
+				layout->References.push_back(refiter->second);
+			}
+		}
+
+		// Members bound to passed parameters are classified in the same
+		// order as ActivatedScope::BindToStack checks them
+		if(slot.ReferenceIndex != NoFrameIndex)
+			slot.BindingSize = ReferenceBinding::GetStorageSize();
+		else if(IsFunctionSignature(*iter))
+		{
+			slot.IsFunctionBinding = true;
+			slot.BindingSize = FunctionBinding::GetStorageSize();
+		}
+		else if(slot.VariableIndex != NoFrameIndex && size)
+			slot.BindingSize = size;
+		else
+			layout->BindingValid = false;
+
+		layout->Slots.push_back(slot);
+		sizes.push_back(size);
+	}
+
+	size_t heapsize = 0;
+	for(size_t i = 0; i < layout->Slots.size(); ++i)
+	{
+		heapsize = AlignFrameOffset(heapsize, sizes[i]);
+		layout->Slots[i].HeapOffset = heapsize;
+		heapsize += sizes[i];
+	}
+
+	size_t stacksize = 0;
+	for(size_t i = layout->Slots.size(); i-- > 0; )
+	{
+		stacksize = AlignFrameOffset(stacksize, sizes[i]);
+		layout->Slots[i].StackOffset = stacksize;
+		stacksize += sizes[i];
+	}
+
+	layout->StorageSize = std::max(heapsize, stacksize);
+	if(Config::AlignedLayout)
+		layout->StorageSize = Alignment::AlignUp(layout->StorageSize, Alignment::MaxNaturalAlignment);
+
+	// Members are looked up by name with a binary search; the sort is stable so
+	// that a name which appears more than once resolves to its first occurrence
+	layout->MemberNames = MemberOrder;
+	layout->MembersByName.reserve(MemberOrder.size());
+	for(size_t i = 0; i < MemberOrder.size(); ++i)
+		layout->MembersByName.push_back(i);
+	std::stable_sort(layout->MembersByName.begin(), layout->MembersByName.end(), MemberNameOrdering(layout->MemberNames));
+
+	FrameLayout* interned = TheFrameLayoutPool.Intern(layout);
+	if(Layout)
+		TheFrameLayoutPool.Release(Layout);
+	Layout = interned;
+
+	FrameLayoutValid = true;
+}
+
+//
+// Find the index of the member with the given name, if any
+//
+size_t ScopeDescription::FrameLayout::FindMember(const std::wstring& name) const
+{
+	size_t low = 0;
+	size_t high = MembersByName.size();
+	while(low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		if(MemberNames[MembersByName[mid]] < name)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if(low < MembersByName.size() && MemberNames[MembersByName[low]] == name)
+		return MembersByName[low];
+
+	return NoFrameIndex;
+}
+
+
+
+
 //-------------------------------------------------------------------------------
 // Internal helpers
 //-------------------------------------------------------------------------------
@@ -867,3 +1230,4 @@ EpochVariableTypeID ScopeDescription::GetArrayType(const std::wstring& name) con
 
 	return iter->second;
 }
+
@@ -14,6 +14,7 @@
 #include "Virtual Machine/Core Entities/Types/FunctionSignature.h"
 #include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 #include "Virtual Machine/Types Management/Typecasts.h"
 
@@ -23,6 +24,7 @@ class StackSpace;
 class HeapStorage;
 namespace Validator { class ValidationTraverser; }
 namespace Serialization { class SerializationTraverser; }
+namespace Optimizer { class OptimizationTraverser; }
 
 
 namespace VM
@@ -30,6 +32,7 @@ namespace VM
 
 	// Forward declarations
 	class FunctionBase;
+	class ActivatedScope;
 	class Operation;
 	class Block;
 	class ResponseMap;
@@ -49,6 +52,7 @@ namespace VM
 		friend class ActivatedScope;
 		friend class Serialization::SerializationTraverser;
 		friend class Validator::ValidationTraverser;
+		friend class Optimizer::OptimizationTraverser;
 
 	// Construction and destruction
 	public:
@@ -85,6 +89,18 @@ namespace VM
 	// Futures interface
 	public:
 		void AddFuture(const std::wstring& name, VM::OperationPtr boundop);
+		void ShareFuture(const std::wstring& name, Future* future);
+
+		bool HasFuture(const std::wstring& name) const
+		{
+			if(Futures.find(name) != Futures.end())
+				return true;
+
+			if(ParentScope)
+				return ParentScope->HasFuture(name);
+
+			return false;
+		}
 
 	// Generic variable information retrieval
 	public:
@@ -119,6 +135,7 @@ namespace VM
 		bool IsConstant(const std::wstring& name) const;
 
 		const ScopeDescription* GetScopeOwningVariable(const std::wstring& name) const;
+		VariableSlot ResolveVariableSlot(const std::wstring& name) const;
 
 		EpochVariableTypeID GetTypeHint(unsigned index) const
 		{ return EpochVariableType_Error; }
@@ -222,6 +239,24 @@ namespace VM
 		VM::EpochVariableTypeID GetArrayType(unsigned index) const
 		{ return GetArrayType(MemberOrder[index]); }
 
+	// Frame layout
+	public:
+		void PrepareFrameLayout();
+
+	// Single activation
+	//
+	// The global scope is activated exactly once for each run of a program,
+	// and every task and function shares that activation. The program binds
+	// the activation to the scope description here, so that variables owned
+	// by the global scope can be found directly from their slots instead of
+	// by walking the chain of activated scopes, which grows with call depth.
+	public:
+		void SetSingleActivation(ActivatedScope* activation)
+		{ SingleActivation = activation; }
+
+		ActivatedScope* GetSingleActivation() const
+		{ return SingleActivation; }
+
 	// Traversal interface
 	public:
 		template <class TraverserT>
@@ -262,6 +297,7 @@ namespace VM
 
 		typedef std::map<std::wstring, Future*> FutureMap;
 		FutureMap Futures;
+		std::set<std::wstring> SharedFutures;
 
 		typedef std::pair<std::wstring, FunctionBase*> FunctionMapEntry;
 		typedef std::map<std::wstring, FunctionBase*> FunctionMap;
@@ -291,6 +327,64 @@ namespace VM
 		ResponseMapList ResponseMaps;
 
 		std::map<std::wstring, VM::EpochVariableTypeID> ArrayTypes;
+
+	// Precomputed frame layout, shared by all activations of the scope
+	//
+	// Layouts never change once computed, and a great many scopes end up
+	// with identical ones; most loop bodies and helper blocks hold either
+	// no members at all or the same handful of counters. Layouts are thus
+	// interned in a process-wide pool, so that identical scopes share one
+	// copy. Each layout keeps its own compact array of member names, which
+	// is searched by name instead of building a map per scope.
+	private:
+		static const size_t NoFrameIndex = static_cast<size_t>(-1);
+
+		struct FrameSlot
+		{
+			size_t VariableIndex;
+			size_t ReferenceIndex;
+			size_t StackOffset;
+			size_t HeapOffset;
+
+			// Layout of the member when bound to passed parameters
+			size_t BindingSize;
+			bool IsFunctionBinding;
+		};
+
+		struct FrameLayout
+		{
+			FrameLayout()
+				: Stackable(true),
+				  HintsMissing(false),
+				  BindingValid(true),
+				  StorageSize(0),
+				  RefCount(0)
+			{ }
+
+			size_t FindMember(const std::wstring& name) const;
+
+			std::vector<FrameSlot> Slots;
+			std::vector<Variable> Variables;
+			std::vector<VariableRefDescriptor> References;
+
+			std::vector<std::wstring> MemberNames;
+			std::vector<size_t> MembersByName;
+
+			bool Stackable;
+			bool HintsMissing;
+			bool BindingValid;
+			size_t StorageSize;
+
+			unsigned RefCount;
+		};
+
+		struct FrameLayoutPool;
+		static FrameLayoutPool TheFrameLayoutPool;
+
+		bool FrameLayoutValid;
+		FrameLayout* Layout;
+
+		ActivatedScope* SingleActivation;
 	};
 
 }
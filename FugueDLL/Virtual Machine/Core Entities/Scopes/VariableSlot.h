@@ -0,0 +1,57 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Precomputed location of a variable within the lexical scope tree
+//
+// Resolving a variable by name requires a series of map lookups and
+// string comparisons, potentially across several scopes in the chain
+// of parents and ghosts. Since the scope which owns a given variable
+// is fixed once the program is loaded, operations which access the
+// variable can resolve the name once ahead of time and then use the
+// owning scope and member index directly during execution. The slot
+// refers to the scope description rather than an activated scope so
+// that it remains valid across recursion and other re-entrant calls.
+//
+// Slots owned by the global scope skip the search for an activation
+// entirely, since the global scope only ever has the one activation
+// made by the program; see ScopeDescription::GetSingleActivation.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class ScopeDescription;
+
+
+	struct VariableSlot
+	{
+	// Construction
+	public:
+		VariableSlot()
+			: OwnerScope(NULL),
+			  MemberIndex(0)
+		{ }
+
+		VariableSlot(const ScopeDescription* owner, size_t index)
+			: OwnerScope(owner),
+			  MemberIndex(index)
+		{ }
+
+	// Queries
+	public:
+		bool IsResolved() const
+		{ return (OwnerScope != NULL); }
+
+	// Slot location
+	public:
+		const ScopeDescription* OwnerScope;
+		size_t MemberIndex;
+	};
+
+}
+
@@ -9,8 +9,15 @@
 
 #include "Virtual Machine/Core Entities/Types/CompositeType.h"
 #include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Types/Structure.h"
+#include "Virtual Machine/Core Entities/Types/Tuple.h"
 #include "Virtual Machine/Types Management/TypeInfo.h"
 
+#include "Utility/Memory/Alignment.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 
@@ -23,8 +30,9 @@ void CompositeType::AddMember(const std::wstring& name, VM::EpochVariableTypeID
 	MemberInfo info;
 	info.Type = type;
 	info.Offset = 0;
+	info.Size = TypeInfo::GetStorageSize(type);
 	info.TypeHint = 0;
-	StorageSize += TypeInfo::GetStorageSize(type);
+	StorageSize += info.Size;
 
 	MemberInfoMap.insert(std::make_pair(name, info));
 	MemberOrder.push_back(name);
@@ -35,8 +43,9 @@ void CompositeType::AddMember(const std::wstring& name, const StructureType& typ
 	MemberInfo info;
 	info.Type = EpochVariableType_Structure;
 	info.Offset = 0;
+	info.Size = type.GetTotalSize();
 	info.TypeHint = typehint;
-	StorageSize += type.GetTotalSize();
+	StorageSize += info.Size;
 
 	MemberInfoMap.insert(std::make_pair(name, info));
 	MemberOrder.push_back(name);
@@ -47,8 +56,9 @@ void CompositeType::AddMember(const std::wstring& name, const TupleType& type, I
 	MemberInfo info;
 	info.Type = EpochVariableType_Tuple;
 	info.Offset = 0;
+	info.Size = type.GetTotalSize();
 	info.TypeHint = typehint;
-	StorageSize += type.GetTotalSize();
+	StorageSize += info.Size;
 
 	MemberInfoMap.insert(std::make_pair(name, info));
 	MemberOrder.push_back(name);
@@ -59,9 +69,10 @@ void CompositeType::AddFunctionMember(const std::wstring& name, const std::wstri
 	MemberInfo info;
 	info.Type = EpochVariableType_Function;
 	info.Offset = 0;
+	info.Size = FunctionBinding::GetStorageSize();
 	info.TypeHint = 0;
 	info.StringHint = hint;
-	StorageSize += FunctionBinding::GetStorageSize();
+	StorageSize += info.Size;
 
 	MemberInfoMap.insert(std::make_pair(name, info));
 	MemberOrder.push_back(name);
@@ -80,6 +91,18 @@ EpochVariableTypeID CompositeType::GetMemberType(const std::wstring& name) const
 	return iter->second.Type;
 }
 
+//
+// Retrieve the number of bytes occupied by a given member, excluding any padding
+//
+size_t CompositeType::GetMemberSize(const std::wstring& name) const
+{
+	std::map<std::wstring, MemberInfo>::const_iterator iter = MemberInfoMap.find(name);
+	if(iter == MemberInfoMap.end())
+		throw ExecutionException("The requested identifier does not match any members of the composite type");
+
+	return iter->second.Size;
+}
+
 //
 // Retrieve the type hint of a given member
 // WARNING: this does not check for validity!
@@ -123,4 +146,128 @@ size_t CompositeType::GetMemberOffset(const std::wstring& name) const
 	return iter->second.Offset;
 }
 
+//
+// Resolve the location and type of the given member ahead of time
+//
+// The ID is that of this type, as registered with the owning tracker;
+// it is recorded so that the slot can be validated at execution time.
+//
+MemberSlot CompositeType::ResolveMemberSlot(const std::wstring& name, IDType ownertypeid) const
+{
+	return MemberSlot(ownertypeid, GetMemberOffset(name), GetMemberType(name));
+}
+
+
+//
+// Place a member at the first suitable offset at or after the given
+// offset, and return the offset immediately following the member
+//
+// Members are packed tightly by default; when aligned layouts are
+// enabled, each member is padded to its natural alignment instead.
+//
+size_t CompositeType::PlaceMember(MemberInfo& info, size_t offset, size_t size)
+{
+	if(Config::AlignedLayout)
+		offset = Alignment::AlignUp(offset, Alignment::GetNaturalAlignment(size));
+
+	info.Offset = offset;
+	info.Size = size;
+	return offset + size;
+}
+
+//
+// Pad the end of a layout so that the members of consecutive values all remain aligned
+//
+size_t CompositeType::PadEndOfLayout(size_t offset)
+{
+	if(Config::AlignedLayout)
+		return Alignment::AlignUp(offset, Alignment::MaxNaturalAlignment);
+
+	return offset;
+}
+
+
+//
+// Determine if a value of this type can be copied with a single block copy
+//
+// Values of composite types are laid out identically in variable storage
+// and on the stack, so whole values can be passed around without building
+// an r-value for each member. This is permitted as long as every member is
+// a plain value or a handle which can safely be shared; unassigned strings
+// are left for the r-value path to deal with.
+//
+bool CompositeType::CanCopyAsBlock(const void* storage) const
+{
+	const Byte* bytes = reinterpret_cast<const Byte*>(storage);
+	for(std::vector<std::wstring>::const_iterator iter = MemberOrder.begin(); iter != MemberOrder.end(); ++iter)
+	{
+		const MemberInfo& info = MemberInfoMap.find(*iter)->second;
+		const void* memberstorage = bytes + info.Offset;
+
+		switch(info.Type)
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+		case EpochVariableType_Function:
+		case EpochVariableType_Address:
+			break;
+
+		case EpochVariableType_String:
+			if(!StringVariable(const_cast<void*>(memberstorage)).GetHandleValue())
+				return false;
+			break;
+
+		case EpochVariableType_Structure:
+		case EpochVariableType_Tuple:
+			{
+				IDType id = *reinterpret_cast<const IDType*>(memberstorage);
+				if(!id || !GetCompositeType(info.Type, id).CanCopyAsBlock(memberstorage))
+					return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// Mark all pooled handles held by a value of this type as shared
+//
+// This must be done whenever the value is block copied, since the copy
+// and the original then hold the same handles.
+//
+void CompositeType::ShareHandles(const void* storage) const
+{
+	const Byte* bytes = reinterpret_cast<const Byte*>(storage);
+	for(std::vector<std::wstring>::const_iterator iter = MemberOrder.begin(); iter != MemberOrder.end(); ++iter)
+	{
+		const MemberInfo& info = MemberInfoMap.find(*iter)->second;
+		const void* memberstorage = bytes + info.Offset;
+
+		if(info.Type == EpochVariableType_String)
+			StringVariable::ShareHandle(StringVariable(const_cast<void*>(memberstorage)).GetHandleValue());
+		else if(info.Type == EpochVariableType_Structure || info.Type == EpochVariableType_Tuple)
+			GetCompositeType(info.Type, *reinterpret_cast<const IDType*>(memberstorage)).ShareHandles(memberstorage);
+	}
+}
+
+//
+// Locate the definition of the given structure or tuple type
+//
+const CompositeType& CompositeType::GetCompositeType(EpochVariableTypeID type, IDType id)
+{
+	if(type == EpochVariableType_Structure)
+		return StructureTrackerClass::GetOwnerOfStructureType(id)->GetStructureType(id);
+	else if(type == EpochVariableType_Tuple)
+		return TupleTrackerClass::GetOwnerOfTupleType(id)->GetTupleType(id);
+
+	throw InternalFailureException("Type is not a composite type");
+}
+
 
@@ -29,6 +29,49 @@ namespace VM
 	class TupleType;
 	class FunctionSignature;
 
+
+	//
+	// Precomputed location of a member within a composite type
+	//
+	// Looking up a member by name requires a map search in the type's
+	// member table. Operations which always access the same member can
+	// resolve the name once ahead of time, and use the offset and type
+	// directly during execution. The slot records which composite type
+	// it was resolved against, so that it can be validated cheaply
+	// against the type annotation stored with the variable itself.
+	//
+	struct MemberSlot
+	{
+	// Construction
+	public:
+		MemberSlot()
+			: OwnerTypeID(0),
+			  Offset(0),
+			  Type(EpochVariableType_Error)
+		{ }
+
+		MemberSlot(IDType ownertypeid, size_t offset, EpochVariableTypeID type)
+			: OwnerTypeID(ownertypeid),
+			  Offset(offset),
+			  Type(type)
+		{ }
+
+	// Queries
+	public:
+		bool IsResolved() const
+		{ return (OwnerTypeID != 0); }
+
+		bool IsResolvedFor(IDType ownertypeid) const
+		{ return (OwnerTypeID != 0 && OwnerTypeID == ownertypeid); }
+
+	// Slot location
+	public:
+		IDType OwnerTypeID;
+		size_t Offset;
+		EpochVariableTypeID Type;
+	};
+
+
 	//
 	// Base class for a composite type definition
 	//
@@ -53,6 +96,7 @@ namespace VM
 	// Member query interface
 	public:
 		EpochVariableTypeID GetMemberType(const std::wstring& name) const;
+		size_t GetMemberSize(const std::wstring& name) const;
 		IDType GetMemberTypeHint(const std::wstring& name) const;
 		const std::wstring& GetMemberTypeHintString(const std::wstring& name) const;
 
@@ -67,15 +111,25 @@ namespace VM
 		virtual void ComputeOffsets(const ScopeDescription& scope) = 0;
 		size_t GetMemberOffset(const std::wstring& name) const;
 
+		MemberSlot ResolveMemberSlot(const std::wstring& name, IDType ownertypeid) const;
+
 		virtual size_t GetMemberStorageSize() const = 0;
 		virtual size_t GetTotalSize() const = 0;
 
+	// Helpers for copying entire values between storage regions
+	public:
+		bool CanCopyAsBlock(const void* storage) const;
+		void ShareHandles(const void* storage) const;
+
+		static const CompositeType& GetCompositeType(EpochVariableTypeID type, IDType id);
+
 	// Internal tracking
 	protected:
 		struct MemberInfo
 		{
 			EpochVariableTypeID Type;
 			size_t Offset;
+			size_t Size;
 			IDType TypeHint;
 			std::wstring StringHint;
 		};
@@ -83,6 +137,11 @@ namespace VM
 		std::map<std::wstring, MemberInfo> MemberInfoMap;
 		std::vector<std::wstring> MemberOrder;
 		size_t StorageSize;
+
+	// Layout helpers for derived types
+	protected:
+		static size_t PlaceMember(MemberInfo& info, size_t offset, size_t size);
+		static size_t PadEndOfLayout(size_t offset);
 	
 	// Helper access to serializer
 	public:
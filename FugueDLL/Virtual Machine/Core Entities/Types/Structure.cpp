@@ -36,7 +36,6 @@ std::map<IDType, StructureTrackerClass*> StructureTrackerClass::OwnerMap;
 void StructureType::ComputeOffsets(const ScopeDescription& scope)
 {
 	size_t offset = sizeof(size_t);		// Skip the type annotation
-	StorageSize = 0;
 	for(std::vector<std::wstring>::const_iterator iter = MemberOrder.begin(); iter != MemberOrder.end(); ++iter)
 	{
 		size_t storagesize;
@@ -53,41 +52,10 @@ void StructureType::ComputeOffsets(const ScopeDescription& scope)
 			break;
 		}
 
-		// TODO - more intelligent packing/padding code
-		/*
-		// PLATFORM DEPENDENT CODE - PAD TO 32 BITS
-		if(storagesize > 4)			// Tail-padding for blobs larger than 32 bits
-		{
-			MemberInfoMap[*iter].Offset = offset;
-			offset += storagesize;
-			StorageSize += storagesize;
-			while(offset % 4 != 0)
-			{
-				++offset;
-				++StorageSize;
-			}
-		}
-		else if(storagesize < 4)	// Head-padding for blobs less than 32 bits
-		{
-			size_t pad = 4 - storagesize;
-			offset += pad;
-			MemberInfoMap[*iter].Offset = offset;
-			offset += storagesize;
-			StorageSize += 4;
-		}
-		else
-		{
-			MemberInfoMap[*iter].Offset = offset;
-			offset += storagesize;
-			StorageSize += 4;
-		}
-		// END PLATFORM DEPENDENCY
-		*/
-
-		MemberInfoMap[*iter].Offset = offset;
-		offset += storagesize;
-		StorageSize += storagesize;
+		offset = PlaceMember(MemberInfoMap[*iter], offset, storagesize);
 	}
+
+	StorageSize = PadEndOfLayout(offset) - sizeof(size_t);
 }
 
 
@@ -262,10 +230,29 @@ size_t StructureVariable::BindToStack(StackSpace& stack, const StructureType& ty
 //
 RValuePtr StructureVariable::ReadMember(const std::wstring& member) const
 {
-	StructureTrackerClass* tracker = StructureTrackerClass::GetOwnerOfStructureType(GetValue());
-	void* storage = reinterpret_cast<Byte*>(Storage) + tracker->GetStructureType(GetValue()).GetMemberOffset(member);
+	const StructureType& type = StructureTrackerClass::GetOwnerOfStructureType(GetValue())->GetStructureType(GetValue());
+	return ReadMemberAt(type.GetMemberOffset(member), type.GetMemberType(member));
+}
+
+//
+// Read a member from a structure, using a slot precomputed at load time if possible
+//
+RValuePtr StructureVariable::ReadMember(const MemberSlot& slot, const std::wstring& member) const
+{
+	if(slot.IsResolvedFor(GetValue()))
+		return ReadMemberAt(slot.Offset, slot.Type);
 
-	switch(tracker->GetStructureType(GetValue()).GetMemberType(member))
+	return ReadMember(member);
+}
+
+//
+// Read the member of the given type stored at the given offset
+//
+RValuePtr StructureVariable::ReadMemberAt(size_t offset, EpochVariableTypeID membertype) const
+{
+	void* storage = reinterpret_cast<Byte*>(Storage) + offset;
+
+	switch(membertype)
 	{
 	case EpochVariableType_Integer:
 		{
@@ -320,10 +307,27 @@ RValuePtr StructureVariable::ReadMember(const std::wstring& member) const
 //
 void StructureVariable::WriteMember(const std::wstring& member, RValuePtr value, bool ignorestorage)
 {
-	StructureTrackerClass* tracker = StructureTrackerClass::GetOwnerOfStructureType(GetValue());
-	void* storage = reinterpret_cast<Byte*>(Storage) + tracker->GetStructureType(GetValue()).GetMemberOffset(member);
+	const StructureType& type = StructureTrackerClass::GetOwnerOfStructureType(GetValue())->GetStructureType(GetValue());
+	WriteMemberAt(type.GetMemberOffset(member), type.GetMemberType(member), value, ignorestorage);
+}
 
-	EpochVariableTypeID membertype = tracker->GetStructureType(GetValue()).GetMemberType(member);
+//
+// Assign a structure member, using a slot precomputed at load time if possible
+//
+void StructureVariable::WriteMember(const MemberSlot& slot, const std::wstring& member, RValuePtr value, bool ignorestorage)
+{
+	if(slot.IsResolvedFor(GetValue()))
+		WriteMemberAt(slot.Offset, slot.Type, value, ignorestorage);
+	else
+		WriteMember(member, value, ignorestorage);
+}
+
+//
+// Assign the member of the given type stored at the given offset
+//
+void StructureVariable::WriteMemberAt(size_t offset, EpochVariableTypeID membertype, RValuePtr value, bool ignorestorage)
+{
+	void* storage = reinterpret_cast<Byte*>(Storage) + offset;
 
 	if(value->GetType() != membertype)
 		throw ExecutionException("Type mismatch - cannot assign structure member value");
@@ -37,10 +37,9 @@ void TupleType::ComputeOffsets(const ScopeDescription& scope)
 {
 	size_t offset = sizeof(size_t);		// Skip the type annotation
 	for(std::vector<std::wstring>::const_iterator iter = MemberOrder.begin(); iter != MemberOrder.end(); ++iter)
-	{
-		MemberInfoMap[*iter].Offset = offset;
-		offset += TypeInfo::GetStorageSize(MemberInfoMap[*iter].Type);
-	}
+		offset = PlaceMember(MemberInfoMap[*iter], offset, TypeInfo::GetStorageSize(MemberInfoMap[*iter].Type));
+
+	StorageSize = PadEndOfLayout(offset) - sizeof(size_t);
 }
 
 
@@ -1,17 +1,91 @@
 #include "pch.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
 #include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Utility/Threading/Synchronization.h"
 
 using namespace VM;
 
+
+namespace
+{
+	// Serializes copy-on-write for arrays which several threads may write at once
+	Threads::CriticalSection ConcurrentWriteCritSec;
+}
+
+
 size_t ArrayVariable::GetNumElements() const
 {
-	return (Pool.Get(GetValue()).Size / TypeInfo::GetStorageSize(GetElementType()));
+	return PoolType::GetNumElements(GetPool().Get(GetValue()));
+}
+
+//
+// Retrieve the storage, element type, and number of elements of
+// the array all at once, with only a single lookup into the pool
+//
+// File-backed arrays have no storage to hand back, so they cannot be
+// accessed this way; the caller must use the overload below instead.
+//
+void* ArrayVariable::GetArrayInfo(VM::EpochVariableTypeID& elementtype, size_t& numelements) const
+{
+	MappedArrayStorage* mapped;
+	void* storage = GetArrayInfo(elementtype, numelements, mapped);
+	if(mapped)
+		throw ExecutionException("This operation is not supported on file-backed arrays");
+
+	return storage;
+}
+
+//
+// Retrieve the storage, element type, and number of elements of the
+// array, along with its file-backed storage; the storage is NULL and
+// the mapped storage is valid for arrays which are backed by a file
+//
+void* ArrayVariable::GetArrayInfo(VM::EpochVariableTypeID& elementtype, size_t& numelements, MappedArrayStorage*& mapped) const
+{
+	const PoolType::PoolEntry& entry = GetPool().Get(GetValue());
+	elementtype = entry.Type;
+	numelements = PoolType::GetNumElements(entry);
+	mapped = entry.Mapped;
+	return entry.Buffer;
+}
+
+
+//
+// Retrieve storage for writing, where other threads may be writing to
+// the same array variable at the same time
+//
+// Atomic operations let several workers update one array in place. If
+// the array is still shared when they start, only the first of them
+// may give the variable its private copy; the others must then write
+// to that same copy rather than making copies of their own.
+//
+void* ArrayVariable::GetConcurrentWritableStorage()
+{
+	if(GetPool().IsShared(GetValue()))
+	{
+		Threads::CriticalSection::Auto mutex(ConcurrentWriteCritSec);
+		if(GetPool().IsShared(GetValue()))
+			SetValue(GetPool().Duplicate(GetValue()));
+	}
+
+	return GetArrayStorage(GetValue());
 }
 
 
 ArrayVariable::BaseStorage ArrayVariable::AllocateNewHandle(VM::EpochVariableTypeID elementtype, size_t numentries)
 {
-	return Pool.Add(NULL, TypeInfo::GetStorageSize(elementtype) * numentries, elementtype);
+	return GetPool().Add(NULL, TypeInfo::GetStorageSize(elementtype) * numentries, elementtype);
+}
+
+
+//
+// Determine the number of elements held by a pooled array
+//
+size_t ArrayVariable::PoolType::GetNumElements(const PoolEntry& entry)
+{
+	if(entry.Mapped)
+		return entry.Mapped->GetNumElements();
+
+	return entry.Size / TypeInfo::GetStorageSize(entry.Type);
 }
 
@@ -10,6 +10,10 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/HandlePool.h"
+#include "Virtual Machine/Core Entities/Variables/MappedArrayStorage.h"
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
+#include "Utility/Memory/Alignment.h"
 
 
 namespace VM
@@ -28,6 +32,14 @@ namespace VM
 	public:
 		friend class ArrayRValue;
 
+	// Friend access for reclaiming unused data
+	public:
+		friend class GarbageCollector;
+
+	// Friend access for holding the pool of each program
+	public:
+		friend class RuntimeContext;
+
 	// Construction
 	public:
 		ArrayVariable(void* storage)
@@ -51,6 +63,7 @@ namespace VM
 
 		RValuePtr GetAsRValue() const
 		{
+			ShareHandle(GetValue());
 			return RValuePtr(new ArrayRValue(GetValue(), false));
 		}
 
@@ -63,11 +76,14 @@ namespace VM
 
 		VM::EpochVariableTypeID GetElementType() const
 		{
-			return Pool.Get(GetValue()).Type;
+			return GetPool().Get(GetValue()).Type;
 		}
 
 		size_t GetNumElements() const;
 
+		void* GetArrayInfo(VM::EpochVariableTypeID& elementtype, size_t& numelements) const;
+		void* GetArrayInfo(VM::EpochVariableTypeID& elementtype, size_t& numelements, MappedArrayStorage*& mapped) const;
+
 
 	// Shared storage size/type retrieval
 	public:
@@ -87,7 +103,74 @@ namespace VM
 
 		static void* GetArrayStorage(BaseStorage id)
 		{
-			return Pool.Get(id).Buffer;
+			const PoolType::PoolEntry& entry = GetPool().Get(id);
+			if(entry.Mapped)
+				throw ExecutionException("This operation is not supported on file-backed arrays");
+
+			return entry.Buffer;
+		}
+
+	// File-backed arrays
+	//
+	// Arrays may be backed by a file rather than by memory; see the notes
+	// in MappedArrayStorage.h. Such arrays have no buffer of their own, so
+	// operations which require one refuse to work on them, and operations
+	// which support them check for mapped storage first. File-backed arrays
+	// have reference semantics, since duplicating them on write would mean
+	// copying the file; all holders of the handle see the same elements.
+	public:
+		static BaseStorage AllocateMappedHandle(const std::wstring& filename, VM::EpochVariableTypeID elementtype)
+		{
+			return GetPool().AddMapped(new MappedArrayStorage(filename, elementtype));
+		}
+
+		static MappedArrayStorage* GetMappedStorage(BaseStorage id)
+		{
+			return GetPool().Get(id).Mapped;
+		}
+
+		bool IsFileBacked() const
+		{
+			return (GetMappedStorage(GetValue()) != NULL);
+		}
+
+	// Copy-on-write support
+	//
+	// Array handles are copied freely when arrays are passed around, so
+	// any handle which is copied out of its variable is marked as shared.
+	// Writes to a shared array must go through GetWritableStorage, which
+	// gives the variable a private copy of the data first. The garbage
+	// collector clears the shared flag of arrays which turn out to have
+	// only one remaining holder, so that subsequent writes are in-place.
+	public:
+		static void ShareHandle(BaseStorage id)
+		{
+			GetPool().MarkShared(id);
+		}
+
+		void* GetWritableStorage()
+		{
+			if(GetPool().IsShared(GetValue()))
+				SetValue(GetPool().Duplicate(GetValue()));
+
+			return GetArrayStorage(GetValue());
+		}
+
+		void* GetConcurrentWritableStorage();
+
+	// Incremental construction
+	//
+	// Arrays reserve spare capacity as they grow, so appending elements
+	// one at a time costs amortized constant time per element. Returns
+	// the storage of the new element; if no data is provided, the new
+	// element is zero-filled so that it can be written to afterwards.
+	public:
+		void* Append(const void* elementdata, size_t elementsize)
+		{
+			if(GetPool().IsShared(GetValue()))
+				SetValue(GetPool().Duplicate(GetValue()));
+
+			return GetPool().Append(GetValue(), reinterpret_cast<const Byte*>(elementdata), elementsize);
 		}
 
 	// Internal helper class for pooling array data
@@ -95,73 +178,194 @@ namespace VM
 
 		class PoolType
 		{
+			friend class ArrayVariable;
 			friend class ArrayRValue;
 
 		protected:
 			struct PoolEntry
 			{
-				Byte* Buffer;
+				Byte* Buffer;			// Always aligned to Alignment::ArrayBufferAlignment
 				size_t Size;
+				size_t Capacity;
 				VM::EpochVariableTypeID Type;
+				bool Shared;
+				MappedArrayStorage* Mapped;	// NULL for arrays stored in memory
 			};
 
 		public:
-			PoolType()
-				: CurID(0)
-			{ }
-
 			~PoolType()
 			{
-				for(std::map<HandleType, PoolEntry>::const_iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete [] iter->second.Buffer;
+				Clear();
 			}
 
 			HandleType Add(const Byte* existingbuffer, size_t size, VM::EpochVariableTypeID type)
 			{
-				++CurID;
 				PoolEntry entry;
-				entry.Buffer = new Byte[size];
+				entry.Buffer = Alignment::AllocateAligned(size, Alignment::ArrayBufferAlignment);
 				entry.Size = size;
+				entry.Capacity = size;
 				entry.Type = type;
+				entry.Shared = false;
+				entry.Mapped = NULL;
 				if(existingbuffer)
 					memcpy(entry.Buffer, existingbuffer, size);
-				ThePool.insert(std::make_pair(CurID, entry));
-				return CurID;
+
+				HandleType id = ThePool.Allocate(entry);
+				MemoryAccounting::CountAllocation(MemoryAccounting::Category_Arrays, size);
+				return id;
+			}
+			HandleType AddMapped(MappedArrayStorage* storage)
+			{
+				PoolEntry entry;
+				entry.Buffer = NULL;
+				entry.Size = 0;
+				entry.Capacity = 0;
+				entry.Type = storage->GetElementType();
+				entry.Shared = false;
+				entry.Mapped = storage;
+
+				return ThePool.Allocate(entry);
+			}
+			HandleType Duplicate(HandleType id)
+			{
+				const PoolEntry& original = Get(id);
+				return Add(original.Buffer, original.Size, original.Type);
 			}
 			void Set(HandleType id, const Byte* existingbuffer, size_t size)
 			{
-				if(ThePool.find(id) == ThePool.end())
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
 					throw InternalFailureException("Cannot set mutable array entry - ID not allocated");
-
-				delete [] ThePool[id].Buffer;
-				ThePool[id].Buffer = new Byte[size];
-				ThePool[id].Size = size;
-				if(existingbuffer)
-					memcpy(ThePool[id].Buffer, existingbuffer, size);
+				if(entry->Mapped)
+					throw ExecutionException("Cannot resize a file-backed array");
+
+				if(size > entry->Capacity)
+				{
+					size_t newcapacity = GetGrownCapacity(entry->Capacity, size);
+					MemoryAccounting::CountResize(MemoryAccounting::Category_Arrays, entry->Capacity, newcapacity);
+
+					Byte* newbuffer = Alignment::AllocateAligned(newcapacity, Alignment::ArrayBufferAlignment);
+					if(existingbuffer)
+						memcpy(newbuffer, existingbuffer, size);
+
+					Alignment::FreeAligned(entry->Buffer);
+					entry->Buffer = newbuffer;
+					entry->Capacity = newcapacity;
+				}
+				else if(existingbuffer)
+					memmove(entry->Buffer, existingbuffer, size);
+
+				entry->Size = size;
+			}
+			Byte* Append(HandleType id, const Byte* elementdata, size_t elementsize)
+			{
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+					throw InternalFailureException("Cannot append to array - ID not allocated");
+				if(entry->Mapped)
+					throw ExecutionException("Cannot append to a file-backed array");
+
+				size_t required = entry->Size + elementsize;
+				if(required > entry->Capacity)
+				{
+					size_t newcapacity = GetGrownCapacity(entry->Capacity, required);
+					MemoryAccounting::CountResize(MemoryAccounting::Category_Arrays, entry->Capacity, newcapacity);
+
+					Byte* newbuffer = Alignment::AllocateAligned(newcapacity, Alignment::ArrayBufferAlignment);
+					memcpy(newbuffer, entry->Buffer, entry->Size);
+					Alignment::FreeAligned(entry->Buffer);
+					entry->Buffer = newbuffer;
+					entry->Capacity = newcapacity;
+				}
+
+				Byte* element = entry->Buffer + entry->Size;
+				if(elementdata)
+					memcpy(element, elementdata, elementsize);
+				else
+					memset(element, 0, elementsize);
+
+				entry->Size = required;
+				return element;
 			}
 			const PoolEntry& Get(HandleType id) const
 			{
-				std::map<HandleType, PoolEntry>::const_iterator iter = ThePool.find(id);
-				if(iter == ThePool.end())
+				const PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+				{
+					// Arrays are left unassigned when their contents are moved away
+					if(!id)
+						throw ExecutionException("Cannot use an array whose contents have been moved");
+
 					throw InternalFailureException("Invalid pooled array ID!");
+				}
 
-				return iter->second;
+				return *entry;
+			}
+
+			static size_t GetNumElements(const PoolEntry& entry);
+
+			void MarkShared(HandleType id)
+			{
+				PoolEntry* entry = ThePool.Find(id);
+				if(entry && !entry->Mapped)
+					entry->Shared = true;
+			}
+			bool IsShared(HandleType id) const
+			{
+				return Get(id).Shared;
 			}
 
 			void Clear()
 			{
-				for(std::map<HandleType, PoolEntry>::iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete [] iter->second.Buffer;
-				ThePool.clear();
-				CurID = 0;
+				ThePool.Clear(ReleaseEntry);
 			}
 
+			//
+			// Garbage collection support; only valid while
+			// no other threads are able to access the pool
+			//
+			bool Contains(HandleType id) const
+			{ return ThePool.ContainsUnsynchronized(id); }
+
+			size_t GetNumAddedSinceCollection() const
+			{ return ThePool.GetNumAddedSinceCollection(); }
+
+			size_t Sweep(const std::set<HandleType>& reachable)
+			{ return ThePool.SweepUnsynchronized(reachable, ReleaseEntry); }
+
+			void ClearShared(HandleType id)
+			{ ThePool.Find(id)->Shared = false; }
+
+		protected:
+			static void ReleaseEntry(PoolEntry& entry)
+			{
+				MemoryAccounting::CountRelease(MemoryAccounting::Category_Arrays, entry.Capacity);
+				Alignment::FreeAligned(entry.Buffer);
+				delete entry.Mapped;
+			}
+
+			//
+			// Grow storage geometrically so that repeated appends do
+			// not need to reallocate and copy the array every time
+			//
+			static size_t GetGrownCapacity(size_t currentcapacity, size_t required)
+			{
+				size_t newcapacity = currentcapacity * 2;
+				if(newcapacity < MinimumGrownCapacity)
+					newcapacity = MinimumGrownCapacity;
+				if(newcapacity < required)
+					newcapacity = required;
+				return newcapacity;
+			}
+
+			static const size_t MinimumGrownCapacity = 64;
+
 		protected:
-			HandleType CurID;
-			std::map<HandleType, PoolEntry> ThePool;
+			ShardedHandlePool<PoolEntry> ThePool;
 		};
 
-		static PoolType Pool;
+		// Each program has a pool of its own; see RuntimeContext
+		static PoolType& GetPool();
 	};
 
 }
@@ -10,6 +10,8 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/HandlePool.h"
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
 
 
 namespace VM
@@ -28,6 +30,14 @@ namespace VM
 	public:
 		friend class BufferRValue;
 
+	// Friend access for reclaiming unused data
+	public:
+		friend class GarbageCollector;
+
+	// Friend access for holding the pool of each program
+	public:
+		friend class RuntimeContext;
+
 	// Construction
 	public:
 		BufferVariable(void* storage)
@@ -41,16 +51,16 @@ namespace VM
 		{
 			HandleType id = *reinterpret_cast<HandleType*>(Storage);
 			if(!id)
-				throw InternalFailureException("Cannot retrieve value of unassigned buffer");
-			return Pool.Get(id).Buffer;
+				throw ExecutionException("Cannot retrieve value of unassigned buffer; were its contents moved?");
+			return GetPool().Get(id).Buffer;
 		}
 
 		size_t GetSize() const
 		{
 			HandleType id = *reinterpret_cast<HandleType*>(Storage);
 			if(!id)
-				throw InternalFailureException("Cannot retrieve size of unassigned buffer");
-			return Pool.Get(id).Size;
+				throw ExecutionException("Cannot retrieve size of unassigned buffer; were its contents moved?");
+			return GetPool().Get(id).Size;
 		}
 
 		RValuePtr GetAsRValue() const
@@ -60,17 +70,17 @@ namespace VM
 		{
 			if(ignorestorage)
 			{
-				HandleType id = Pool.Add(existingbuffer, newsize);
+				HandleType id = GetPool().Add(existingbuffer, newsize);
 				*reinterpret_cast<HandleType*>(Storage) = id;
 			}
 			else
 			{
 				HandleType id = *reinterpret_cast<HandleType*>(Storage);
 				if(id)
-					Pool.Set(id, existingbuffer, newsize);
+					GetPool().Set(id, existingbuffer, newsize);
 				else
 				{
-					id = Pool.Add(existingbuffer, newsize);
+					id = GetPool().Add(existingbuffer, newsize);
 					*reinterpret_cast<HandleType*>(Storage) = id;
 				}
 			}
@@ -116,61 +126,77 @@ namespace VM
 			};
 
 		public:
-			PoolType()
-				: CurID(0)
-			{ }
-
 			~PoolType()
 			{
-				for(std::map<HandleType, PoolEntry>::const_iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete [] iter->second.Buffer;
+				Clear();
 			}
 
 			HandleType Add(const Byte* existingbuffer, size_t size)
 			{
-				++CurID;
 				PoolEntry entry;
 				entry.Buffer = new Byte[size];
 				entry.Size = size;
 				if(existingbuffer)
 					memcpy(entry.Buffer, existingbuffer, size);
-				ThePool.insert(std::make_pair(CurID, entry));
-				return CurID;
+
+				HandleType id = ThePool.Allocate(entry);
+				MemoryAccounting::CountAllocation(MemoryAccounting::Category_Buffers, size);
+				return id;
 			}
 			void Set(HandleType id, const Byte* existingbuffer, size_t size)
 			{
-				if(ThePool.find(id) == ThePool.end())
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
 					throw InternalFailureException("Cannot set mutable buffer entry - ID not allocated");
 
-				delete [] ThePool[id].Buffer;
-				ThePool[id].Buffer = new Byte[size];
-				ThePool[id].Size = size;
+				MemoryAccounting::CountResize(MemoryAccounting::Category_Buffers, entry->Size, size);
+
+				delete [] entry->Buffer;
+				entry->Buffer = new Byte[size];
+				entry->Size = size;
 				if(existingbuffer)
-					memcpy(ThePool[id].Buffer, existingbuffer, size);
+					memcpy(entry->Buffer, existingbuffer, size);
 			}
 			const PoolEntry& Get(HandleType id) const
 			{
-				std::map<HandleType, PoolEntry>::const_iterator iter = ThePool.find(id);
-				if(iter == ThePool.end())
+				const PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
 					throw InternalFailureException("Invalid pooled buffer ID!");
 
-				return iter->second;
+				return *entry;
 			}
 
 			void Clear()
 			{
-				for(std::map<HandleType, PoolEntry>::iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete [] iter->second.Buffer;
-				ThePool.clear();
-				CurID = 0;
+				ThePool.Clear(ReleaseEntry);
+			}
+
+			//
+			// Garbage collection support; only valid while
+			// no other threads are able to access the pool
+			//
+			bool Contains(HandleType id) const
+			{ return ThePool.ContainsUnsynchronized(id); }
+
+			size_t GetNumAddedSinceCollection() const
+			{ return ThePool.GetNumAddedSinceCollection(); }
+
+			size_t Sweep(const std::set<HandleType>& reachable)
+			{ return ThePool.SweepUnsynchronized(reachable, ReleaseEntry); }
+
+		protected:
+			static void ReleaseEntry(PoolEntry& entry)
+			{
+				MemoryAccounting::CountRelease(MemoryAccounting::Category_Buffers, entry.Size);
+				delete [] entry.Buffer;
 			}
 
 		protected:
-			HandleType CurID;
-			std::map<HandleType, PoolEntry> ThePool;
+			ShardedHandlePool<PoolEntry> ThePool;
 		};
 
-		static PoolType Pool;
+		// Each program has a pool of its own; see RuntimeContext
+		static PoolType& GetPool();
 	};
 
 }
@@ -0,0 +1,388 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Generic storage for pooled data which is referred to by handle
+//
+// Entries are kept in a dense array of slots, and a handle encodes the
+// index of its slot along with a generation counter. Each time a slot
+// is released its generation is advanced, so handles which refer to a
+// previous occupant of the slot no longer match and are rejected; this
+// allows stale handles to be detected without any searching. Released
+// slots are kept on a free list and reused by subsequent allocations.
+//
+// Generation zero is never issued, which guarantees that the null
+// handle (0) cannot ever refer to a valid entry.
+//
+// Slots are stored in a deque rather than a vector, so that references
+// to entries remain valid while other entries are added to the pool.
+//
+// The pool does not take care of any resources owned by the entries;
+// wrappers are responsible for releasing an entry's contents prior to
+// freeing its slot.
+//
+// Pools which are shared between threads should use ShardedHandlePool,
+// which splits the entries across several independently locked pools.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/VMExceptions.h"
+#include "Utility/Threading/Synchronization.h"
+
+
+namespace VM
+{
+
+	//
+	// Single pool of handle slots
+	//
+	// The given number of high bits are left clear in all handles issued
+	// by the pool, so that the handles can be extended by a wrapper.
+	//
+	template <class EntryType, unsigned ReservedBits = 0>
+	class HandlePool
+	{
+	// Handle encoding
+	private:
+		static const unsigned IndexBits = ((sizeof(HandleType) >= 8) ? 32 : 22) - ReservedBits;
+		static const HandleType IndexMask = (static_cast<HandleType>(1) << IndexBits) - 1;
+		static const HandleType GenerationMask = ~static_cast<HandleType>(0) >> (IndexBits + ReservedBits);
+
+		static size_t GetIndex(HandleType handle)
+		{ return static_cast<size_t>(handle & IndexMask); }
+
+		static HandleType GetGeneration(HandleType handle)
+		{ return handle >> IndexBits; }
+
+		static HandleType MakeHandle(size_t index, HandleType generation)
+		{ return (generation << IndexBits) | static_cast<HandleType>(index); }
+
+	// Construction
+	public:
+		HandlePool()
+			: NumLiveEntries(0)
+		{ }
+
+	// Entry management
+	public:
+		//
+		// Store an entry in the pool, and return its handle
+		//
+		HandleType Allocate(const EntryType& entry)
+		{
+			size_t index;
+			if(FreeSlots.empty())
+			{
+				index = Slots.size();
+				if(index > IndexMask)
+					throw InternalFailureException("Handle pool is full - too many live entries");
+
+				Slot slot;
+				slot.Generation = 1;
+				slot.Live = false;
+				Slots.push_back(slot);
+			}
+			else
+			{
+				index = FreeSlots.back();
+				FreeSlots.pop_back();
+			}
+
+			Slot& slot = Slots[index];
+			slot.Entry = entry;
+			slot.Live = true;
+			++NumLiveEntries;
+			return MakeHandle(index, slot.Generation);
+		}
+
+		//
+		// Release the slot held by the given entry; the handle (and
+		// any copies of it) become invalid immediately.
+		//
+		void Free(HandleType handle)
+		{
+			if(!Contains(handle))
+				throw InternalFailureException("Cannot free pooled entry - invalid or stale handle");
+
+			size_t index = GetIndex(handle);
+			Slot& slot = Slots[index];
+			EntryType empty = EntryType();
+			std::swap(slot.Entry, empty);
+			slot.Live = false;
+			slot.Generation = (slot.Generation + 1) & GenerationMask;
+			if(!slot.Generation)
+				slot.Generation = 1;
+
+			FreeSlots.push_back(index);
+			--NumLiveEntries;
+		}
+
+		//
+		// Release all entries; all outstanding handles become invalid
+		//
+		// Generations are deliberately retained, so that handles issued
+		// before the pool was cleared cannot alias new entries.
+		//
+		void Clear()
+		{
+			for(size_t i = 0; i < Slots.size(); ++i)
+			{
+				if(Slots[i].Live)
+					Free(MakeHandle(i, Slots[i].Generation));
+			}
+		}
+
+	// Entry access
+	public:
+		bool Contains(HandleType handle) const
+		{
+			size_t index = GetIndex(handle);
+			if(index >= Slots.size())
+				return false;
+
+			const Slot& slot = Slots[index];
+			return (slot.Live && slot.Generation == GetGeneration(handle));
+		}
+
+		//
+		// Retrieve the entry for the given handle, or NULL if the
+		// handle is not valid (or no longer valid) for this pool
+		//
+		EntryType* Find(HandleType handle)
+		{
+			if(!Contains(handle))
+				return NULL;
+			return &Slots[GetIndex(handle)].Entry;
+		}
+
+		const EntryType* Find(HandleType handle) const
+		{
+			if(!Contains(handle))
+				return NULL;
+			return &Slots[GetIndex(handle)].Entry;
+		}
+
+	// Iteration over live entries
+	public:
+		size_t GetNumSlots() const
+		{ return Slots.size(); }
+
+		size_t GetNumLiveEntries() const
+		{ return NumLiveEntries; }
+
+		//
+		// Retrieve the handle of the entry occupying the given slot,
+		// or 0 if the slot is currently unoccupied
+		//
+		HandleType GetHandleForSlot(size_t index) const
+		{
+			const Slot& slot = Slots[index];
+			if(!slot.Live)
+				return 0;
+			return MakeHandle(index, slot.Generation);
+		}
+
+	// Internal tracking
+	private:
+		struct Slot
+		{
+			EntryType Entry;
+			HandleType Generation;
+			bool Live;
+		};
+
+		std::deque<Slot> Slots;
+		std::vector<size_t> FreeSlots;
+		size_t NumLiveEntries;
+	};
+
+
+	//
+	// Thread safe pool of handle slots
+	//
+	// Entries are spread across a fixed set of shards, each of which is
+	// a separate pool protected by its own lock. Threads allocate from
+	// the shard selected by their thread ID, so threads working with
+	// their own data rarely contend for the same lock. The shard index
+	// is stored in the low bits of each handle, which means any thread
+	// can resolve any handle; handles passed between tasks in messages
+	// remain valid regardless of which thread allocated them, and even
+	// after that thread has exited.
+	//
+	// Entries returned by Find remain valid after the shard lock has
+	// been released, since slots never move once allocated (see above).
+	// Concurrent modification of the same entry from multiple threads is
+	// not synchronized, just as with any other variable shared between
+	// threads.
+	//
+	template <class EntryType>
+	class ShardedHandlePool
+	{
+	// Handle encoding
+	private:
+		static const unsigned ShardBits = 4;
+		static const size_t NumShards = static_cast<size_t>(1) << ShardBits;
+		static const HandleType ShardMask = NumShards - 1;
+
+		typedef HandlePool<EntryType, ShardBits> ShardPoolType;
+
+		static size_t GetShardIndexForThisThread()
+		{
+			// Windows thread IDs are always multiples of 4
+			return static_cast<size_t>(::GetCurrentThreadId() >> 2) & ShardMask;
+		}
+
+	// Entry management
+	public:
+		HandleType Allocate(const EntryType& entry)
+		{
+			size_t shardindex = GetShardIndexForThisThread();
+			Shard& shard = Shards[shardindex];
+
+			Threads::CriticalSection::Auto mutex(shard.Lock);
+			++shard.AddedSinceCollection;
+			return (shard.Pool.Allocate(entry) << ShardBits) | static_cast<HandleType>(shardindex);
+		}
+
+		EntryType* Find(HandleType handle)
+		{
+			Shard& shard = Shards[handle & ShardMask];
+			Threads::CriticalSection::Auto mutex(shard.Lock);
+			return shard.Pool.Find(handle >> ShardBits);
+		}
+
+		const EntryType* Find(HandleType handle) const
+		{
+			const Shard& shard = Shards[handle & ShardMask];
+			Threads::CriticalSection::Auto mutex(shard.Lock);
+			return shard.Pool.Find(handle >> ShardBits);
+		}
+
+	// Garbage collection support
+	//
+	// These functions do not lock the individual shards, and must only
+	// be used while no other threads are able to access the pool.
+	public:
+		bool ContainsUnsynchronized(HandleType handle) const
+		{
+			return Shards[handle & ShardMask].Pool.Contains(handle >> ShardBits);
+		}
+
+		size_t GetNumAddedSinceCollection() const
+		{
+			size_t total = 0;
+			for(size_t i = 0; i < NumShards; ++i)
+				total += Shards[i].AddedSinceCollection;
+			return total;
+		}
+
+		//
+		// Free all entries which are not in the given reachable set,
+		// invoking the given functor on each entry before it is freed.
+		// Entries for which the retain functor returns true are kept
+		// regardless of reachability. Returns the number of entries
+		// freed.
+		//
+		template <class ReleaseFunctorType>
+		size_t SweepUnsynchronized(const std::set<HandleType>& reachable, ReleaseFunctorType release)
+		{
+			return SweepUnsynchronized(reachable, release, NeverRetain);
+		}
+
+		template <class ReleaseFunctorType, class RetainFunctorType>
+		size_t SweepUnsynchronized(const std::set<HandleType>& reachable, ReleaseFunctorType release, RetainFunctorType retain)
+		{
+			size_t numfreed = 0;
+			for(size_t shardindex = 0; shardindex < NumShards; ++shardindex)
+			{
+				Shard& shard = Shards[shardindex];
+				for(size_t i = 0; i < shard.Pool.GetNumSlots(); ++i)
+				{
+					HandleType localhandle = shard.Pool.GetHandleForSlot(i);
+					if(!localhandle)
+						continue;
+
+					HandleType handle = (localhandle << ShardBits) | static_cast<HandleType>(shardindex);
+					if(reachable.find(handle) == reachable.end() && !retain(*shard.Pool.Find(localhandle)))
+					{
+						release(*shard.Pool.Find(localhandle));
+						shard.Pool.Free(localhandle);
+						++numfreed;
+					}
+				}
+
+				shard.AddedSinceCollection = 0;
+			}
+
+			return numfreed;
+		}
+
+		//
+		// Invoke the given functor on each live entry; only valid
+		// while no other threads are able to access the pool
+		//
+		template <class FunctorType>
+		void ForEachUnsynchronized(FunctorType functor)
+		{
+			for(size_t shardindex = 0; shardindex < NumShards; ++shardindex)
+			{
+				Shard& shard = Shards[shardindex];
+				for(size_t i = 0; i < shard.Pool.GetNumSlots(); ++i)
+				{
+					HandleType localhandle = shard.Pool.GetHandleForSlot(i);
+					if(localhandle)
+						functor(*shard.Pool.Find(localhandle));
+				}
+			}
+		}
+
+		//
+		// Free all entries, invoking the given functor on each entry
+		// before it is freed.
+		//
+		template <class ReleaseFunctorType>
+		void Clear(ReleaseFunctorType release)
+		{
+			for(size_t shardindex = 0; shardindex < NumShards; ++shardindex)
+			{
+				Shard& shard = Shards[shardindex];
+				Threads::CriticalSection::Auto mutex(shard.Lock);
+
+				for(size_t i = 0; i < shard.Pool.GetNumSlots(); ++i)
+				{
+					HandleType localhandle = shard.Pool.GetHandleForSlot(i);
+					if(localhandle)
+						release(*shard.Pool.Find(localhandle));
+				}
+
+				shard.Pool.Clear();
+				shard.AddedSinceCollection = 0;
+			}
+		}
+
+	// Internal helpers
+	private:
+		static bool NeverRetain(const EntryType&)
+		{ return false; }
+
+	// Internal tracking
+	private:
+		struct Shard
+		{
+			Shard()
+				: AddedSinceCollection(0)
+			{ }
+
+			mutable Threads::CriticalSection Lock;
+			ShardPoolType Pool;
+			size_t AddedSinceCollection;
+		};
+
+		Shard Shards[NumShards];
+	};
+
+}
+
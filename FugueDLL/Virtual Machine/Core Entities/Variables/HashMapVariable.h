@@ -0,0 +1,281 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Interface for storing hash map containers on the freestore
+//
+// Hash maps associate keys of a single type (integer or string) with
+// values of a single scalar type. Keys and values are held by content,
+// so the contents of a map never refer to other pooled data; only the
+// map itself is tracked by the garbage collector. Like buffers, maps
+// have reference semantics: assigning a map variable shares the same
+// underlying container rather than copying it.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/HandlePool.h"
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
+#include "Utility/Hashing.h"
+
+#include <hash_map>
+
+
+namespace VM
+{
+
+	//
+	// Key of a hash map entry
+	//
+	// Only the member matching the key type of the map is used; the
+	// other member is always left at its default value.
+	//
+	struct HashMapKey
+	{
+		HashMapKey()
+			: IntegerValue(0)
+		{ }
+
+		explicit HashMapKey(Integer32 value)
+			: IntegerValue(value)
+		{ }
+
+		explicit HashMapKey(const std::wstring& value)
+			: IntegerValue(0),
+			  StringValue(value)
+		{ }
+
+		bool operator < (const HashMapKey& rhs) const
+		{
+			if(IntegerValue != rhs.IntegerValue)
+				return IntegerValue < rhs.IntegerValue;
+			return StringValue < rhs.StringValue;
+		}
+
+		Integer32 IntegerValue;
+		std::wstring StringValue;
+	};
+
+	//
+	// Hash function for map keys; found by the standard library through argument-dependent lookup
+	//
+	inline size_t hash_value(const HashMapKey& key)
+	{
+		return Hashing::HashString32(Hashing::FNV32OffsetBasis, key.StringValue) ^ static_cast<size_t>(key.IntegerValue);
+	}
+
+
+	//
+	// Wrapper for hash map containers
+	//
+	class HashMapVariable : public Variable
+	{
+	// Handy type shortcuts
+	public:
+		typedef HandleType BaseStorage;
+		typedef stdext::hash_map<HashMapKey, RValue*> EntryMap;
+
+	// Friend access for sharing handles with rvalues
+	public:
+		friend class HashMapRValue;
+
+	// Friend access for reclaiming unused data
+	public:
+		friend class GarbageCollector;
+
+	// Friend access for holding the pool of each program
+	public:
+		friend class RuntimeContext;
+
+	// Construction
+	public:
+		HashMapVariable(void* storage)
+			: Variable(EpochVariableType_HashMap, storage)
+		{
+		}
+
+	// Variable interface
+	public:
+		RValuePtr GetAsRValue() const
+		{ return RValuePtr(new HashMapRValue(GetHandleValue())); }
+
+		size_t BindToStack(StackSpace& stack)
+		{
+			stack.Push(GetStorageSize());
+			Storage = stack.GetCurrentTopOfStack();
+			return GetStorageSize();
+		}
+
+	// Container interface
+	public:
+		EpochVariableTypeID GetKeyType() const
+		{ return GetPool().Get(GetAssignedHandle()).KeyType; }
+
+		EpochVariableTypeID GetValueType() const
+		{ return GetPool().Get(GetAssignedHandle()).ValueType; }
+
+		const EntryMap& GetEntries() const
+		{ return *GetPool().Get(GetAssignedHandle()).Entries; }
+
+		void Insert(const HashMapKey& key, RValuePtr value)
+		{ GetPool().Insert(GetAssignedHandle(), key, value); }
+
+		RValuePtr Lookup(const HashMapKey& key) const
+		{
+			const EntryMap& entries = GetEntries();
+			EntryMap::const_iterator iter = entries.find(key);
+			if(iter == entries.end())
+				throw ExecutionException("Key not found in hash map");
+			return RValuePtr(iter->second->Clone());
+		}
+
+		bool Contains(const HashMapKey& key) const
+		{ return (GetEntries().find(key) != GetEntries().end()); }
+
+		bool Erase(const HashMapKey& key)
+		{ return GetPool().Erase(GetAssignedHandle(), key); }
+
+	// Direct handle manipulation - use sparingly!
+	public:
+		BaseStorage GetHandleValue() const
+		{ return *reinterpret_cast<HandleType*>(Storage); }
+
+		void SetHandleValue(BaseStorage newval)
+		{ *reinterpret_cast<HandleType*>(Storage) = newval; }
+
+		static BaseStorage AllocateNewHandle(EpochVariableTypeID keytype, EpochVariableTypeID valuetype)
+		{ return GetPool().Add(keytype, valuetype); }
+
+	// Shared storage size/type retrieval
+	public:
+		static size_t GetStorageSize()
+		{ return sizeof(HandleType); }
+
+		static size_t GetBaseStorageSize()
+		{ return GetStorageSize(); }
+
+		static EpochVariableTypeID GetStaticType()
+		{ return EpochVariableType_HashMap; }
+
+	// Internal helpers
+	protected:
+		HandleType GetAssignedHandle() const
+		{
+			HandleType id = GetHandleValue();
+			if(!id)
+				throw InternalFailureException("Cannot access contents of unassigned hash map");
+			return id;
+		}
+
+	// Internal helper class for pooling hash map data
+	protected:
+
+		class PoolType
+		{
+		protected:
+			struct PoolEntry
+			{
+				EpochVariableTypeID KeyType;
+				EpochVariableTypeID ValueType;
+				EntryMap* Entries;
+			};
+
+			// Approximate storage used by each entry, for memory accounting purposes
+			static const size_t EntryFootprint = sizeof(HashMapKey) + sizeof(RValue*);
+
+		public:
+			~PoolType()
+			{
+				Clear();
+			}
+
+			HandleType Add(EpochVariableTypeID keytype, EpochVariableTypeID valuetype)
+			{
+				PoolEntry entry;
+				entry.KeyType = keytype;
+				entry.ValueType = valuetype;
+				entry.Entries = new EntryMap;
+
+				HandleType id = ThePool.Allocate(entry);
+				MemoryAccounting::CountAllocation(MemoryAccounting::Category_HashMaps, sizeof(EntryMap));
+				return id;
+			}
+			void Insert(HandleType id, const HashMapKey& key, RValuePtr value)
+			{
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+					throw InternalFailureException("Cannot insert into hash map - ID not allocated");
+
+				std::pair<EntryMap::iterator, bool> result = entry->Entries->insert(std::make_pair(key, static_cast<RValue*>(NULL)));
+				if(result.second)
+					MemoryAccounting::CountResize(MemoryAccounting::Category_HashMaps, 0, EntryFootprint);
+				else
+					delete result.first->second;
+
+				result.first->second = value.release();
+			}
+			bool Erase(HandleType id, const HashMapKey& key)
+			{
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+					throw InternalFailureException("Cannot erase from hash map - ID not allocated");
+
+				EntryMap::iterator iter = entry->Entries->find(key);
+				if(iter == entry->Entries->end())
+					return false;
+
+				delete iter->second;
+				entry->Entries->erase(iter);
+				MemoryAccounting::CountResize(MemoryAccounting::Category_HashMaps, EntryFootprint, 0);
+				return true;
+			}
+			const PoolEntry& Get(HandleType id) const
+			{
+				const PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+					throw InternalFailureException("Invalid pooled hash map ID!");
+
+				return *entry;
+			}
+
+			void Clear()
+			{
+				ThePool.Clear(ReleaseEntry);
+			}
+
+			//
+			// Garbage collection support; only valid while
+			// no other threads are able to access the pool
+			//
+			bool Contains(HandleType id) const
+			{ return ThePool.ContainsUnsynchronized(id); }
+
+			size_t GetNumAddedSinceCollection() const
+			{ return ThePool.GetNumAddedSinceCollection(); }
+
+			size_t Sweep(const std::set<HandleType>& reachable)
+			{ return ThePool.SweepUnsynchronized(reachable, ReleaseEntry); }
+
+		protected:
+			static void ReleaseEntry(PoolEntry& entry)
+			{
+				MemoryAccounting::CountRelease(MemoryAccounting::Category_HashMaps, sizeof(EntryMap) + entry.Entries->size() * EntryFootprint);
+
+				for(EntryMap::iterator iter = entry.Entries->begin(); iter != entry.Entries->end(); ++iter)
+					delete iter->second;
+				delete entry.Entries;
+			}
+
+		protected:
+			ShardedHandlePool<PoolEntry> ThePool;
+		};
+
+		// Each program has a pool of its own; see RuntimeContext
+		static PoolType& GetPool();
+	};
+
+}
+
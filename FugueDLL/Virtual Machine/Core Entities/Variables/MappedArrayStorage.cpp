@@ -0,0 +1,392 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// File-backed storage for arrays which are too large to hold in memory
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Core Entities/Variables/MappedArrayStorage.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include "Utility/Strings.h"
+
+#include <limits>
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	// Marker for slots and windows which do not refer to anything
+	const size_t NoWindow = static_cast<size_t>(-1);
+
+	//
+	// Work handed to a system worker thread for faulting in a window ahead of use
+	//
+	struct PrefetchRequest
+	{
+		MappedArrayStorage* Owner;
+		size_t Slot;
+		const Byte* View;
+		size_t Size;
+		size_t PageSize;
+	};
+
+}
+
+
+//
+// Open a file for access as an array of the given element type
+//
+// Files which cannot be opened for writing are opened read-only, in
+// which case any attempt to write to the array is a runtime error.
+//
+MappedArrayStorage::MappedArrayStorage(const std::wstring& filename, EpochVariableTypeID elementtype)
+	: FileHandle(INVALID_HANDLE_VALUE),
+	  MappingHandle(NULL),
+	  ReadOnly(false),
+	  ElementType(elementtype),
+	  ElementSize(TypeInfo::GetStorageSize(elementtype)),
+	  NumElements(0),
+	  ElementsPerWindow(0),
+	  PageSize(0),
+	  UseCounter(0),
+	  LastWindowIndex(NoWindow),
+	  PendingPrefetches(0)
+{
+	switch(elementtype)
+	{
+	case EpochVariableType_Integer:
+	case EpochVariableType_Integer16:
+	case EpochVariableType_Real:
+	case EpochVariableType_Boolean:
+		break;
+
+	default:
+		throw ExecutionException("File-backed arrays may only hold integer, integer16, real, or boolean elements");
+	}
+
+	FileHandle = ::CreateFile(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(FileHandle == INVALID_HANDLE_VALUE)
+	{
+		ReadOnly = true;
+		FileHandle = ::CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(FileHandle == INVALID_HANDLE_VALUE)
+			throw ExecutionException("Failed to open file for file-backed array: " + narrow(filename));
+	}
+
+	LARGE_INTEGER filesize;
+	if(!::GetFileSizeEx(FileHandle, &filesize))
+	{
+		Close();
+		throw ExecutionException("Failed to determine the size of file for file-backed array: " + narrow(filename));
+	}
+
+	if(filesize.QuadPart % ElementSize)
+	{
+		Close();
+		throw ExecutionException("File does not hold a whole number of array elements: " + narrow(filename));
+	}
+
+	// Elements are indexed with 32-bit integers
+	if(static_cast<ULONGLONG>(filesize.QuadPart) / ElementSize > static_cast<ULONGLONG>(std::numeric_limits<Integer32>::max()))
+	{
+		Close();
+		throw ExecutionException("File holds too many elements to be used as an array: " + narrow(filename));
+	}
+
+	NumElements = static_cast<size_t>(filesize.QuadPart / ElementSize);
+
+	// Windows must start on a multiple of the allocation granularity, so
+	// each window holds a whole multiple of that many elements
+	SYSTEM_INFO sysinfo;
+	::GetSystemInfo(&sysinfo);
+	PageSize = sysinfo.dwPageSize;
+
+	size_t granularity = sysinfo.dwAllocationGranularity;
+	size_t multiple = Config::MappedArrayWindowSize / (granularity * ElementSize);
+	if(!multiple)
+		multiple = 1;
+	ElementsPerWindow = multiple * granularity;
+
+	// Empty files cannot be mapped, but there is nothing to access anyways
+	if(!NumElements)
+		return;
+
+	MappingHandle = ::CreateFileMapping(FileHandle, NULL, ReadOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
+	if(!MappingHandle)
+	{
+		Close();
+		throw ExecutionException("Failed to map file for file-backed array: " + narrow(filename));
+	}
+}
+
+//
+// Unmap all windows and release the file
+//
+MappedArrayStorage::~MappedArrayStorage()
+{
+	// Wait for any outstanding read-ahead to let go of its window
+	while(PendingPrefetches)
+		::Sleep(0);
+
+	Close();
+}
+
+void MappedArrayStorage::Close()
+{
+	for(std::vector<MappedView>::iterator iter = Views.begin(); iter != Views.end(); ++iter)
+	{
+		if(iter->View)
+			::UnmapViewOfFile(iter->View);
+	}
+	Views.clear();
+
+	if(MappingHandle)
+		::CloseHandle(MappingHandle);
+	if(FileHandle != INVALID_HANDLE_VALUE)
+		::CloseHandle(FileHandle);
+
+	MappingHandle = NULL;
+	FileHandle = INVALID_HANDLE_VALUE;
+}
+
+
+//
+// Copy a single element out of the file
+//
+void MappedArrayStorage::ReadElement(size_t index, void* target)
+{
+	Threads::CriticalSection::Auto mutex(CritSec);
+
+	size_t slot = AcquireView(index / ElementsPerWindow);
+	memcpy(target, Views[slot].View + (index % ElementsPerWindow) * ElementSize, ElementSize);
+	ReleaseView(slot);
+}
+
+//
+// Copy a single element into the file
+//
+void MappedArrayStorage::WriteElement(size_t index, const void* source)
+{
+	if(ReadOnly)
+		throw ExecutionException("Cannot write to a file-backed array whose file is read-only");
+
+	Threads::CriticalSection::Auto mutex(CritSec);
+
+	size_t slot = AcquireView(index / ElementsPerWindow);
+	memcpy(Views[slot].View + (index % ElementsPerWindow) * ElementSize, source, ElementSize);
+	ReleaseView(slot);
+}
+
+
+//
+// Pin the window containing the given element for direct access
+//
+MappedArrayStorage::Window::Window(MappedArrayStorage& owner, size_t firstelement)
+	: Owner(owner),
+	  Slot(NoWindow),
+	  Storage(NULL),
+	  NumElements(0)
+{
+	if(firstelement >= Owner.NumElements)
+		throw InternalFailureException("Cannot map window of file-backed array - element index out of range");
+
+	Threads::CriticalSection::Auto mutex(Owner.CritSec);
+
+	Slot = Owner.AcquireView(firstelement / Owner.ElementsPerWindow);
+
+	size_t offset = firstelement % Owner.ElementsPerWindow;
+	Storage = Owner.Views[Slot].View + offset * Owner.ElementSize;
+	NumElements = Owner.Views[Slot].NumElements - offset;
+}
+
+MappedArrayStorage::Window::~Window()
+{
+	Threads::CriticalSection::Auto mutex(Owner.CritSec);
+	Owner.ReleaseView(Slot);
+}
+
+
+//
+// Pin the view of the given window, mapping it if necessary, and
+// return its slot; the caller must hold the critical section
+//
+// Moving from one window to the next is taken as a sign that the
+// array is being walked in order, which triggers read-ahead of the
+// window after that.
+//
+size_t MappedArrayStorage::AcquireView(size_t windowindex)
+{
+	size_t slot = FindView(windowindex);
+	if(slot == NoWindow)
+		slot = MapView(windowindex);
+
+	MappedView& view = Views[slot];
+	++view.PinCount;
+	view.LastUsed = ++UseCounter;
+
+	if(windowindex != LastWindowIndex)
+	{
+		if(LastWindowIndex != NoWindow && windowindex == LastWindowIndex + 1)
+			PrefetchWindow(windowindex + 1);
+
+		LastWindowIndex = windowindex;
+	}
+
+	return slot;
+}
+
+//
+// Unpin a view; the caller must hold the critical section
+//
+void MappedArrayStorage::ReleaseView(size_t slot)
+{
+	--Views[slot].PinCount;
+}
+
+//
+// Locate the slot which currently maps the given window, if any
+//
+size_t MappedArrayStorage::FindView(size_t windowindex) const
+{
+	for(size_t i = 0; i < Views.size(); ++i)
+	{
+		if(Views[i].View && Views[i].WindowIndex == windowindex)
+			return i;
+	}
+
+	return NoWindow;
+}
+
+//
+// Map the given window into a free slot, and return the slot
+//
+// The least recently used view which is not pinned is recycled once
+// the configured number of views are mapped; if every view is pinned,
+// another slot is added instead. The caller must hold the critical
+// section.
+//
+size_t MappedArrayStorage::MapView(size_t windowindex)
+{
+	static const size_t MaxCachedViews = 4;
+
+	size_t slot = NoWindow;
+	for(size_t i = 0; i < Views.size(); ++i)
+	{
+		if(Views[i].PinCount)
+			continue;
+
+		if(!Views[i].View)
+		{
+			slot = i;
+			break;
+		}
+
+		if(slot == NoWindow || Views[i].LastUsed < Views[slot].LastUsed)
+			slot = i;
+	}
+
+	if(slot == NoWindow || (Views[slot].View && Views.size() < MaxCachedViews))
+	{
+		MappedView newview;
+		newview.WindowIndex = NoWindow;
+		newview.View = NULL;
+		newview.NumElements = 0;
+		newview.PinCount = 0;
+		newview.LastUsed = 0;
+
+		Views.push_back(newview);
+		slot = Views.size() - 1;
+	}
+
+	MappedView& view = Views[slot];
+	if(view.View)
+	{
+		::UnmapViewOfFile(view.View);
+		view.View = NULL;
+	}
+
+	size_t firstelement = windowindex * ElementsPerWindow;
+	view.NumElements = std::min(ElementsPerWindow, NumElements - firstelement);
+
+	ULONGLONG offset = static_cast<ULONGLONG>(firstelement) * ElementSize;
+	view.View = reinterpret_cast<Byte*>(::MapViewOfFile(MappingHandle, ReadOnly ? FILE_MAP_READ : FILE_MAP_WRITE, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xffffffff), view.NumElements * ElementSize));
+	if(!view.View)
+		throw ExecutionException("Failed to map window of file-backed array; the process may be out of address space");
+
+	view.WindowIndex = windowindex;
+	return slot;
+}
+
+//
+// Map the given window ahead of use, and fault its pages in on a
+// system worker thread; the caller must hold the critical section
+//
+// Read-ahead is purely a hint, so failing to map or queue it is not
+// an error. The view stays pinned until its pages have been touched.
+//
+void MappedArrayStorage::PrefetchWindow(size_t windowindex)
+{
+	if(windowindex * ElementsPerWindow >= NumElements || FindView(windowindex) != NoWindow)
+		return;
+
+	size_t slot;
+	try
+	{
+		slot = MapView(windowindex);
+	}
+	catch(const ExecutionException&)
+	{
+		return;
+	}
+
+	MappedView& view = Views[slot];
+	view.LastUsed = ++UseCounter;
+
+	PrefetchRequest* request = new PrefetchRequest;
+	request->Owner = this;
+	request->Slot = slot;
+	request->View = view.View;
+	request->Size = view.NumElements * ElementSize;
+	request->PageSize = PageSize;
+
+	++view.PinCount;
+	::InterlockedIncrement(&PendingPrefetches);
+
+	if(!::QueueUserWorkItem(PrefetchThreadProc, request, WT_EXECUTEDEFAULT))
+	{
+		--view.PinCount;
+		::InterlockedDecrement(&PendingPrefetches);
+		delete request;
+	}
+}
+
+//
+// Touch each page of a prefetched window so that the system reads it in
+//
+DWORD WINAPI MappedArrayStorage::PrefetchThreadProc(void* param)
+{
+	PrefetchRequest* request = reinterpret_cast<PrefetchRequest*>(param);
+
+	volatile Byte sink = 0;
+	for(size_t offset = 0; offset < request->Size; offset += request->PageSize)
+		sink = request->View[offset];
+
+	MappedArrayStorage* owner = request->Owner;
+	{
+		Threads::CriticalSection::Auto mutex(owner->CritSec);
+		owner->ReleaseView(request->Slot);
+	}
+
+	delete request;
+	::InterlockedDecrement(&owner->PendingPrefetches);
+	return 0;
+}
@@ -0,0 +1,141 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// File-backed storage for arrays which are too large to hold in memory
+//
+// The file is treated as a flat run of scalar elements of a single type,
+// in native byte order. Rather than mapping the entire file at once, a
+// handful of fixed-size windows are mapped on demand and recycled in
+// least recently used order, so arbitrarily large files can be accessed
+// with a bounded amount of address space. Writes go straight into the
+// mapped view and reach the file when the view is unmapped.
+//
+// When accesses move from one window into the next, the array is assumed
+// to be walked sequentially; the window after that is mapped ahead of
+// time, and its pages are faulted in on a system worker thread so that
+// the disk reads overlap with processing of the current window.
+//
+// All access to the window table is serialized, so file-backed arrays may
+// be read and written from several tasks at once.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Types/EpochTypeIDs.h"
+#include "Utility/Threading/Synchronization.h"
+
+
+namespace VM
+{
+
+	class MappedArrayStorage
+	{
+	// Construction and destruction
+	public:
+		MappedArrayStorage(const std::wstring& filename, EpochVariableTypeID elementtype);
+		~MappedArrayStorage();
+
+	// Queries
+	public:
+		EpochVariableTypeID GetElementType() const
+		{ return ElementType; }
+
+		size_t GetElementSize() const
+		{ return ElementSize; }
+
+		size_t GetNumElements() const
+		{ return NumElements; }
+
+	// Element access
+	public:
+		void ReadElement(size_t index, void* target);
+		void WriteElement(size_t index, const void* source);
+
+	// Bulk access
+	public:
+
+		//
+		// Direct access to the elements of the window containing a given
+		// element, from that element to the end of the window; the window
+		// stays mapped for the lifetime of this object
+		//
+		class Window
+		{
+		// Construction and destruction
+		public:
+			Window(MappedArrayStorage& owner, size_t firstelement);
+			~Window();
+
+		// Access
+		public:
+			void* GetStorage() const
+			{ return Storage; }
+
+			size_t GetNumElements() const
+			{ return NumElements; }
+
+		// Internal tracking
+		private:
+			MappedArrayStorage& Owner;
+			size_t Slot;
+			void* Storage;
+			size_t NumElements;
+
+		// Non-copyable
+		private:
+			Window(const Window&);
+			Window& operator = (const Window&);
+		};
+
+	// Internal helpers
+	private:
+		size_t AcquireView(size_t windowindex);
+		void ReleaseView(size_t slot);
+		size_t MapView(size_t windowindex);
+		void PrefetchWindow(size_t windowindex);
+
+		size_t FindView(size_t windowindex) const;
+
+		static DWORD WINAPI PrefetchThreadProc(void* param);
+
+		void Close();
+
+	// Internal tracking
+	private:
+		struct MappedView
+		{
+			size_t WindowIndex;
+			Byte* View;
+			size_t NumElements;
+			unsigned PinCount;
+			UInteger32 LastUsed;
+		};
+
+		HANDLE FileHandle;
+		HANDLE MappingHandle;
+		bool ReadOnly;
+
+		EpochVariableTypeID ElementType;
+		size_t ElementSize;
+		size_t NumElements;
+		size_t ElementsPerWindow;
+		size_t PageSize;
+
+		std::vector<MappedView> Views;
+		UInteger32 UseCounter;
+		size_t LastWindowIndex;
+
+		volatile LONG PendingPrefetches;
+
+		Threads::CriticalSection CritSec;
+
+	// Non-copyable
+	private:
+		MappedArrayStorage(const MappedArrayStorage&);
+		MappedArrayStorage& operator = (const MappedArrayStorage&);
+	};
+
+}
@@ -9,6 +9,8 @@
 
 
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/HandlePool.h"
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
 
 
 namespace VM
@@ -24,6 +26,14 @@ namespace VM
 	public:
 		typedef HandleType BaseStorage;
 
+	// Friend access for reclaiming unused strings
+	public:
+		friend class GarbageCollector;
+
+	// Friend access for holding the pool of each program
+	public:
+		friend class RuntimeContext;
+
 	// Construction
 	public:
 		StringVariable(void* storage)
@@ -44,7 +54,7 @@ namespace VM
 			HandleType id = *reinterpret_cast<HandleType*>(Storage);
 			if(!id)
 				throw InternalFailureException("Cannot retrieve value of unassigned string");
-			return Pool.Get(id);
+			return GetPool().Get(id);
 		}
 
 		RValuePtr GetAsRValue() const
@@ -54,17 +64,20 @@ namespace VM
 		{
 			if(ignorestorage)
 			{
-				HandleType id = Pool.Add(newvalue);
+				HandleType id = GetPool().Add(newvalue);
 				*reinterpret_cast<HandleType*>(Storage) = id;
 			}
 			else
 			{
+				// Interned and shared strings may be referred to from many
+				// places, so they are never modified in place; instead, the
+				// variable receives a fresh copy of its own.
 				HandleType id = *reinterpret_cast<HandleType*>(Storage);
-				if(id)
-					Pool.Set(id, newvalue);
+				if(id && !GetPool().IsImmutable(id))
+					GetPool().Set(id, newvalue);
 				else
 				{
-					id = Pool.Add(newvalue);
+					id = GetPool().Add(newvalue);
 					*reinterpret_cast<HandleType*>(Storage) = id;
 				}
 			}
@@ -101,17 +114,27 @@ namespace VM
 	public:
 		static HandleType PoolStringLiteral(const std::wstring& value)
 		{
-			return Pool.Add(value);
+			return GetPool().Add(value);
 		}
 
-		static const std::wstring& GetByHandle(HandleType handle)
+		static HandleType InternStringLiteral(const std::wstring& value)
+		{
+			return GetPool().Intern(value);
+		}
+
+		static HandleType PoolConcatenation(HandleType prefix, const std::wstring& suffix)
+		{
+			return GetPool().AddConcatenation(prefix, suffix);
+		}
+
+		static void ShareHandle(HandleType handle)
 		{
-			return Pool.Get(handle);
+			GetPool().Freeze(handle);
 		}
 
-		static void EmptyPool()
+		static const std::wstring& GetByHandle(HandleType handle)
 		{
-			Pool.Clear();
+			return GetPool().Get(handle);
 		}
 
 	// Internal helper class for pooling strings
@@ -124,56 +147,325 @@ namespace VM
 		// into the pool. The garbage collector takes care of freeing string data which is
 		// no longer in use.
 		//
+		// String literals are interned: each distinct literal value is stored in the pool
+		// exactly once, and every push of the literal shares the same handle. Interned
+		// entries are immutable and are never collected.
+		//
+		// Concatenations produce rope entries, which refer to the handle of their prefix
+		// and store only the appended suffix; the full value is assembled the first time it
+		// is read, and cached in place. This keeps loops which repeatedly append to the same
+		// string linear rather than quadratic, as long as the string is not read in between.
+		// An entry used as a prefix (or otherwise shared between several variables) is made
+		// immutable, so that the meaning of the ropes referring to it is preserved.
+		//
+		// When compact storage is enabled (see Config::CompactStrings), entries which survive
+		// a garbage collection are stored with one byte per character, provided that every
+		// character fits in Latin-1. The rest of the VM only ever deals in wide strings, so
+		// the wide form of a compacted entry is rebuilt when the entry is next read, and is
+		// discarded again by the following collection. Collections only happen at the end of
+		// a block, once no operation is still holding on to the value of a string. Interned
+		// entries are left alone, since literals are read often and the table of interned
+		// values holds a wide copy of each of them regardless.
+		//
+		// Each entry is accounted by the number of bytes its characters occupy; see
+		// MemoryAccounting. The accounted size is kept in the entry, so that releasing the
+		// entry reverses the accounting exactly, regardless of how the entry was flattened
+		// or compacted in between.
+		//
 		class PoolType
 		{
-		public:
-			PoolType()
-				: CurID(0)
-			{ }
+		protected:
+			struct PoolEntry
+			{
+				std::wstring Value;
+				std::string CompactValue;
+				volatile HandleType Prefix;
+				volatile bool Compact;
+				bool Interned;
+				bool Immutable;
+				size_t AccountedBytes;
+			};
 
+		public:
 			~PoolType()
 			{
-				for(std::map<HandleType, std::wstring*>::const_iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete iter->second;
+				Clear();
 			}
 
 			HandleType Add(const std::wstring& value)
 			{
-				++CurID;
-				ThePool.insert(std::make_pair(CurID, new std::wstring(value)));
-				return CurID;
+				PoolEntry entry;
+				entry.Value = value;
+				entry.Prefix = 0;
+				entry.Compact = false;
+				entry.Interned = false;
+				entry.Immutable = false;
+				return AllocateEntry(entry);
+			}
+			HandleType AddConcatenation(HandleType prefix, const std::wstring& suffix)
+			{
+				PoolEntry* prefixentry = ThePool.Find(prefix);
+				if(!prefixentry)
+					throw InternalFailureException("Invalid pooled string ID!");
+
+				// Short strings are cheaper to copy than to chain
+				if(!prefixentry->Prefix && GetLength(*prefixentry) + suffix.length() <= MinimumRopeLength)
+					return Add(Get(prefix) + suffix);
+
+				prefixentry->Immutable = true;
+
+				PoolEntry entry;
+				entry.Value = suffix;
+				entry.Prefix = prefix;
+				entry.Compact = false;
+				entry.Interned = false;
+				entry.Immutable = false;
+				return AllocateEntry(entry);
+			}
+			HandleType Intern(const std::wstring& value)
+			{
+				Threads::CriticalSection::Auto mutex(InternCriticalSection);
+
+				std::map<std::wstring, HandleType>::const_iterator iter = InternedHandles.find(value);
+				if(iter != InternedHandles.end())
+					return iter->second;
+
+				PoolEntry entry;
+				entry.Value = value;
+				entry.Prefix = 0;
+				entry.Compact = false;
+				entry.Interned = true;
+				entry.Immutable = true;
+				HandleType id = AllocateEntry(entry);
+				InternedHandles.insert(std::make_pair(value, id));
+				return id;
 			}
 			void Set(HandleType id, const std::wstring& value)
 			{
-				if(ThePool.find(id) == ThePool.end())
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
 					throw InternalFailureException("Cannot set mutable string entry - ID not allocated");
 
-				delete ThePool[id];
-				ThePool[id] = new std::wstring(value);
+				if(entry->Immutable)
+					throw InternalFailureException("Cannot set mutable string entry - entry is shared");
+
+				Threads::CriticalSection::Auto mutex(RopeCriticalSection);
+				entry->Value = value;
+				std::string().swap(entry->CompactValue);
+				entry->Compact = false;
+				entry->Prefix = 0;
+				UpdateAccountedBytes(*entry);
 			}
 			const std::wstring& Get(HandleType id) const
 			{
-				std::map<HandleType, std::wstring*>::const_iterator iter = ThePool.find(id);
-				if(iter == ThePool.end())
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
+					throw InternalFailureException("Invalid pooled string ID!");
+
+				if(entry->Prefix)
+					Flatten(*entry);
+				else if(entry->Compact)
+					Expand(*entry);
+
+				return entry->Value;
+			}
+			void Freeze(HandleType id)
+			{
+				PoolEntry* entry = ThePool.Find(id);
+				if(!entry)
 					throw InternalFailureException("Invalid pooled string ID!");
 
-				return *(iter->second);
+				entry->Immutable = true;
+			}
+			bool IsImmutable(HandleType id) const
+			{
+				const PoolEntry* entry = ThePool.Find(id);
+				return (entry && entry->Immutable);
 			}
 
 			void Clear()
 			{
-				for(std::map<HandleType, std::wstring*>::iterator iter = ThePool.begin(); iter != ThePool.end(); ++iter)
-					delete iter->second;
-				ThePool.clear();
-				CurID = 0;
+				Threads::CriticalSection::Auto mutex(InternCriticalSection);
+				ThePool.Clear(ReleaseEntry);
+				InternedHandles.clear();
+			}
+
+			//
+			// Garbage collection support; only valid while
+			// no other threads are able to access the pool
+			//
+			bool Contains(HandleType id) const
+			{ return ThePool.ContainsUnsynchronized(id); }
+
+			HandleType GetPrefix(HandleType id) const
+			{ return ThePool.Find(id)->Prefix; }
+
+			size_t GetNumAddedSinceCollection() const
+			{ return ThePool.GetNumAddedSinceCollection(); }
+
+			size_t Sweep(const std::set<HandleType>& reachable)
+			{
+				size_t numfreed = ThePool.SweepUnsynchronized(reachable, ReleaseEntry, IsEntryInterned);
+				if(IsCompactionEnabled())
+					ThePool.ForEachUnsynchronized(CompactEntry);
+				return numfreed;
 			}
 
 		protected:
-			HandleType CurID;
-			std::map<HandleType, std::wstring*> ThePool;
+			//
+			// Store an entry in the pool, accounting for its contents
+			//
+			HandleType AllocateEntry(PoolEntry& entry)
+			{
+				entry.AccountedBytes = GetFootprint(entry);
+				HandleType id = ThePool.Allocate(entry);
+				MemoryAccounting::CountAllocation(MemoryAccounting::Category_Strings, entry.AccountedBytes);
+				return id;
+			}
+
+			//
+			// Adjust the accounting of an entry whose contents have changed
+			//
+			static void UpdateAccountedBytes(PoolEntry& entry)
+			{
+				size_t newbytes = GetFootprint(entry);
+				MemoryAccounting::CountResize(MemoryAccounting::Category_Strings, entry.AccountedBytes, newbytes);
+				entry.AccountedBytes = newbytes;
+			}
+
+			static size_t GetFootprint(const PoolEntry& entry)
+			{
+				if(entry.Compact)
+					return entry.CompactValue.length();
+				return entry.Value.length() * sizeof(wchar_t);
+			}
+
+			static size_t GetLength(const PoolEntry& entry)
+			{
+				if(entry.Compact)
+					return entry.CompactValue.length();
+				return entry.Value.length();
+			}
+
+			//
+			// Append the characters held by an entry (excluding any prefix) to a wide string
+			//
+			static void AppendCharacters(const PoolEntry& entry, std::wstring& out)
+			{
+				if(!entry.Compact)
+				{
+					out.append(entry.Value);
+					return;
+				}
+
+				for(std::string::const_iterator iter = entry.CompactValue.begin(); iter != entry.CompactValue.end(); ++iter)
+					out.push_back(static_cast<wchar_t>(static_cast<unsigned char>(*iter)));
+			}
+
+			//
+			// Rebuild the wide form of a compacted entry, so that it can be handed out
+			//
+			void Expand(PoolEntry& entry) const
+			{
+				Threads::CriticalSection::Auto mutex(RopeCriticalSection);
+				if(!entry.Compact)
+					return;
+
+				std::wstring expanded;
+				expanded.reserve(entry.CompactValue.length());
+				AppendCharacters(entry, expanded);
+
+				entry.Value.swap(expanded);
+				std::string().swap(entry.CompactValue);
+				entry.Compact = false;
+				UpdateAccountedBytes(entry);
+			}
+
+			//
+			// Store an entry with one byte per character, if all of its characters fit
+			//
+			// Strings short enough to live inside the string object itself gain
+			// nothing from compaction, so they are skipped.
+			//
+			static void CompactEntry(PoolEntry& entry)
+			{
+				if(entry.Compact || entry.Interned || entry.Value.length() < MinimumCompactLength)
+					return;
+
+				for(std::wstring::const_iterator iter = entry.Value.begin(); iter != entry.Value.end(); ++iter)
+				{
+					if(static_cast<unsigned>(*iter) > 0xff)
+						return;
+				}
+
+				std::string compacted;
+				compacted.reserve(entry.Value.length());
+				for(std::wstring::const_iterator iter = entry.Value.begin(); iter != entry.Value.end(); ++iter)
+					compacted.push_back(static_cast<char>(*iter));
+
+				entry.CompactValue.swap(compacted);
+				std::wstring().swap(entry.Value);
+				entry.Compact = true;
+				UpdateAccountedBytes(entry);
+			}
+
+			static bool IsCompactionEnabled();
+
+			//
+			// Assemble the full value of a rope entry, and cache it in the entry
+			//
+			void Flatten(PoolEntry& entry) const
+			{
+				Threads::CriticalSection::Auto mutex(RopeCriticalSection);
+				if(!entry.Prefix)
+					return;
+
+				std::vector<const PoolEntry*> pieces;
+				pieces.push_back(&entry);
+				size_t totallength = GetLength(entry);
+
+				for(HandleType prefix = entry.Prefix; prefix; )
+				{
+					const PoolEntry* prefixentry = ThePool.Find(prefix);
+					if(!prefixentry)
+						throw InternalFailureException("Invalid pooled string ID in concatenated string!");
+
+					pieces.push_back(prefixentry);
+					totallength += GetLength(*prefixentry);
+					prefix = prefixentry->Prefix;
+				}
+
+				std::wstring flattened;
+				flattened.reserve(totallength);
+				for(std::vector<const PoolEntry*>::const_reverse_iterator iter = pieces.rbegin(); iter != pieces.rend(); ++iter)
+					AppendCharacters(**iter, flattened);
+
+				entry.Value.swap(flattened);
+				std::string().swap(entry.CompactValue);
+				entry.Compact = false;
+				entry.Prefix = 0;
+				UpdateAccountedBytes(entry);
+			}
+
+			static void ReleaseEntry(PoolEntry& entry)
+			{ MemoryAccounting::CountRelease(MemoryAccounting::Category_Strings, entry.AccountedBytes); }
+
+			static bool IsEntryInterned(const PoolEntry& entry)
+			{ return entry.Interned; }
+
+		protected:
+			static const size_t MinimumRopeLength = 64;
+			static const size_t MinimumCompactLength = 8;
+
+			mutable ShardedHandlePool<PoolEntry> ThePool;
+
+			Threads::CriticalSection InternCriticalSection;
+			mutable Threads::CriticalSection RopeCriticalSection;
+			std::map<std::wstring, HandleType> InternedHandles;
 		};
 
-		static PoolType Pool;
+		// Each program has a pool of its own; see RuntimeContext
+		static PoolType& GetPool();
 	};
 
 
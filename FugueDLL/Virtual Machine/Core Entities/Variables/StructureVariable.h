@@ -9,6 +9,7 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Types/CompositeType.h"
 
 
 namespace VM
@@ -53,6 +54,12 @@ namespace VM
 		RValuePtr ReadMember(const std::wstring& member) const;
 
 		void WriteMember(const std::wstring& member, RValuePtr value, bool ignorestorage);
+
+	// Structure interface via members precomputed at load time
+	public:
+		RValuePtr ReadMember(const MemberSlot& slot, const std::wstring& member) const;
+
+		void WriteMember(const MemberSlot& slot, const std::wstring& member, RValuePtr value, bool ignorestorage);
 		
 		template<class TypeData>
 		void WriteMember(const std::wstring& member, void* value, bool ignorestorage)
@@ -69,6 +76,11 @@ namespace VM
 
 		static EpochVariableTypeID GetStaticType()
 		{ return EpochVariableType_Structure; }
+
+	// Internal helpers
+	private:
+		RValuePtr ReadMemberAt(size_t offset, EpochVariableTypeID membertype) const;
+		void WriteMemberAt(size_t offset, EpochVariableTypeID membertype, RValuePtr value, bool ignorestorage);
 	};
 
 }
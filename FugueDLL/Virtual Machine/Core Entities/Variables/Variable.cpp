@@ -10,15 +10,40 @@
 #include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
-
-
-// Shared pool of string data; see class definition for details
-VM::StringVariable::PoolType VM::StringVariable::Pool;
-
-// Shared pool of buffers; compare with string pooling system
-VM::BufferVariable::PoolType VM::BufferVariable::Pool;
-
-// Shared pool of arrays
-VM::ArrayVariable::PoolType VM::ArrayVariable::Pool;
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+// Pool of string data; see class definition for details
+VM::StringVariable::PoolType& VM::StringVariable::GetPool()
+{
+	return RuntimeContext::GetCurrent().StringPool;
+}
+
+// Compact storage of strings is a runtime option; see the notes on the string pool
+bool VM::StringVariable::PoolType::IsCompactionEnabled()
+{
+	return Config::CompactStrings;
+}
+
+// Pool of buffers; compare with string pooling system
+VM::BufferVariable::PoolType& VM::BufferVariable::GetPool()
+{
+	return RuntimeContext::GetCurrent().BufferPool;
+}
+
+// Pool of arrays
+VM::ArrayVariable::PoolType& VM::ArrayVariable::GetPool()
+{
+	return RuntimeContext::GetCurrent().ArrayPool;
+}
+
+// Pool of hash maps
+VM::HashMapVariable::PoolType& VM::HashMapVariable::GetPool()
+{
+	return RuntimeContext::GetCurrent().HashMapPool;
+}
 
 
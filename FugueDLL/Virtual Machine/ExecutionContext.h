@@ -8,6 +8,10 @@
 #pragma once
 
 
+// Dependencies
+#include "Virtual Machine/Profiling/Profiler.h"
+
+
 // Forward declarations
 class StackSpace;
 
@@ -18,6 +22,7 @@ namespace VM
 	// Forward declarations
 	class ActivatedScope;
 	class Program;
+	class CancellationToken;
 
 
 	enum FlowControlResult
@@ -29,6 +34,19 @@ namespace VM
 	};
 
 
+	//
+	// Execution state passed to each operation
+	//
+	// Contexts are cheap to build, but they are still built at every
+	// nesting level, so code which executes many operations in a row
+	// should construct a single context up front and reuse it, rather
+	// than recreating one per operation. The helper constructors below
+	// derive a context for nested execution from the enclosing one.
+	//
+	// Nested contexts inherit the cancellation token of their parent, if
+	// any; code which starts cancellable work sets the token on the root
+	// context of that work. See CancellationToken.h.
+	//
 	struct ExecutionContext
 	{
 	// Construction
@@ -37,7 +55,36 @@ namespace VM
 			: Scope(scope),
 			  Stack(stack),
 			  FlowResult(flowresult),
-			  RunningProgram(program)
+			  RunningProgram(program),
+			  Profile(Profiler::GetRecordForThisThread()),
+			  Cancellation(NULL)
+		{ }
+
+		ExecutionContext(const ExecutionContext& parent, ActivatedScope& scope)
+			: Scope(scope),
+			  Stack(parent.Stack),
+			  FlowResult(parent.FlowResult),
+			  RunningProgram(parent.RunningProgram),
+			  Profile(parent.Profile),
+			  Cancellation(parent.Cancellation)
+		{ }
+
+		ExecutionContext(const ExecutionContext& parent, FlowControlResult& flowresult)
+			: Scope(parent.Scope),
+			  Stack(parent.Stack),
+			  FlowResult(flowresult),
+			  RunningProgram(parent.RunningProgram),
+			  Profile(parent.Profile),
+			  Cancellation(parent.Cancellation)
+		{ }
+
+		ExecutionContext(const ExecutionContext& parent, ActivatedScope& scope, FlowControlResult& flowresult)
+			: Scope(scope),
+			  Stack(parent.Stack),
+			  FlowResult(flowresult),
+			  RunningProgram(parent.RunningProgram),
+			  Profile(parent.Profile),
+			  Cancellation(parent.Cancellation)
 		{ }
 
 	// Data members
@@ -46,6 +93,8 @@ namespace VM
 		StackSpace& Stack;
 		FlowControlResult& FlowResult;
 		Program& RunningProgram;
+		ProfileRecord* Profile;
+		const CancellationToken* Cancellation;
 	};
 
 }
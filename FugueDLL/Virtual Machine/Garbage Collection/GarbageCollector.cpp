@@ -0,0 +1,356 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Garbage collection for pooled string, array, buffer, and hash map data
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
+
+#include "Utility/Memory/Stack.h"
+#include "Utility/Memory/Heap.h"
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/Synchronization.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	//
+	// Tracking for handles pinned by r-values
+	//
+	Threads::CriticalSection PinCriticalSection;
+	std::map<HandleType, unsigned> PinnedArrays;
+	std::map<HandleType, unsigned> PinnedBuffers;
+	std::map<HandleType, unsigned> PinnedHashMaps;
+
+	// Stacks which are scanned in addition to the executing stack
+	std::multiset<const StackSpace*> SuspendedStacks;
+
+	// Number of active collection deferrals
+	volatile LONG DeferralCount = 0;
+
+	// Statistics
+	size_t NumCollections = 0;
+	size_t NumEntriesReclaimed = 0;
+
+
+	//
+	// Helpers for adjusting pin counts
+	//
+	void Pin(std::map<HandleType, unsigned>& pins, HandleType handle)
+	{
+		if(!handle)
+			return;
+
+		Threads::CriticalSection::Auto mutex(PinCriticalSection);
+		++pins[handle];
+	}
+
+	void Unpin(std::map<HandleType, unsigned>& pins, HandleType handle)
+	{
+		if(!handle)
+			return;
+
+		Threads::CriticalSection::Auto mutex(PinCriticalSection);
+		std::map<HandleType, unsigned>::iterator iter = pins.find(handle);
+		if(iter != pins.end() && --iter->second == 0)
+			pins.erase(iter);
+	}
+
+	//
+	// Determine if an array with the given element type may contain handles
+	//
+	bool ElementsMayContainHandles(EpochVariableTypeID elementtype)
+	{
+		switch(elementtype)
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+			return false;
+		}
+
+		return true;
+	}
+
+}
+
+
+//
+// Working state of the marking phase
+//
+struct GarbageCollector::MarkState
+{
+	std::set<HandleType> ReachableStrings;
+	std::set<HandleType> ReachableArrays;
+	std::set<HandleType> ReachableBuffers;
+	std::set<HandleType> ReachableHashMaps;
+
+	std::map<HandleType, size_t> ArrayReferenceCounts;
+
+	std::vector<HandleType> ArraysToScan;
+};
+
+
+//
+// Determine if enough pooled data has been allocated to warrant a collection
+//
+bool GarbageCollector::IsCollectionDue()
+{
+	if(!Config::GarbageCollectionThreshold)
+		return false;
+
+	size_t allocations = StringVariable::GetPool().GetNumAddedSinceCollection()
+					   + ArrayVariable::GetPool().GetNumAddedSinceCollection()
+					   + BufferVariable::GetPool().GetNumAddedSinceCollection()
+					   + HashMapVariable::GetPool().GetNumAddedSinceCollection();
+
+	return (allocations >= Config::GarbageCollectionThreshold);
+}
+
+//
+// Perform a collection, if it is currently safe to do so
+//
+// If collection is not possible (due to other threads running, or
+// an active deferral) the request is simply ignored; the collection
+// will be attempted again at the next safe point.
+//
+void GarbageCollector::CollectAtSafePoint(const StackSpace& stack)
+{
+	if(DeferralCount > 0)
+		return;
+
+	if(Threads::GetNumRunningThreads(Threads::GetInfoForThisThread().RunningProgram) > 1)
+		return;
+
+	Collect(stack);
+}
+
+
+//
+// Mark all pooled data reachable from the roots, and release the rest
+//
+void GarbageCollector::Collect(const StackSpace& stack)
+{
+	MarkState state;
+
+	MarkRegion(stack.GetCurrentTopOfStack(), stack.GetAllocatedStack(), state);
+
+	HeapStorage::RegionList heapregions = HeapStorage::GetLiveStorageRegions();
+	for(HeapStorage::RegionList::const_iterator iter = heapregions.begin(); iter != heapregions.end(); ++iter)
+		MarkRegion(iter->first, iter->second, state);
+
+	{
+		Threads::CriticalSection::Auto mutex(PinCriticalSection);
+
+		for(std::map<HandleType, unsigned>::const_iterator iter = PinnedArrays.begin(); iter != PinnedArrays.end(); ++iter)
+		{
+			if(state.ReachableArrays.insert(iter->first).second)
+				state.ArraysToScan.push_back(iter->first);
+
+			// Pinned arrays are held by r-values, which may hand out further
+			// copies of the handle at any time, so they always remain shared
+			state.ArrayReferenceCounts[iter->first] += 2;
+		}
+
+		for(std::map<HandleType, unsigned>::const_iterator iter = PinnedBuffers.begin(); iter != PinnedBuffers.end(); ++iter)
+			state.ReachableBuffers.insert(iter->first);
+
+		for(std::map<HandleType, unsigned>::const_iterator iter = PinnedHashMaps.begin(); iter != PinnedHashMaps.end(); ++iter)
+			state.ReachableHashMaps.insert(iter->first);
+
+		for(std::multiset<const StackSpace*>::const_iterator iter = SuspendedStacks.begin(); iter != SuspendedStacks.end(); ++iter)
+		{
+			if(*iter != &stack)
+				MarkRegion((*iter)->GetCurrentTopOfStack(), (*iter)->GetAllocatedStack(), state);
+		}
+	}
+
+	while(!state.ArraysToScan.empty())
+	{
+		HandleType handle = state.ArraysToScan.back();
+		state.ArraysToScan.pop_back();
+
+		if(!ArrayVariable::GetPool().Contains(handle))
+			continue;
+
+		if(ElementsMayContainHandles(ArrayVariable::GetPool().Get(handle).Type))
+			MarkRegion(ArrayVariable::GetPool().Get(handle).Buffer, ArrayVariable::GetPool().Get(handle).Size, state);
+	}
+
+	// Arrays with at most one holder can safely be written in place again
+	for(std::set<HandleType>::const_iterator iter = state.ReachableArrays.begin(); iter != state.ReachableArrays.end(); ++iter)
+	{
+		if(ArrayVariable::GetPool().Contains(*iter) && state.ArrayReferenceCounts[*iter] <= 1)
+			ArrayVariable::GetPool().ClearShared(*iter);
+	}
+
+	NumEntriesReclaimed += StringVariable::GetPool().Sweep(state.ReachableStrings);
+	NumEntriesReclaimed += ArrayVariable::GetPool().Sweep(state.ReachableArrays);
+	NumEntriesReclaimed += BufferVariable::GetPool().Sweep(state.ReachableBuffers);
+	NumEntriesReclaimed += HashMapVariable::GetPool().Sweep(state.ReachableHashMaps);
+	++NumCollections;
+}
+
+//
+// Conservatively mark any handles found in the given region of memory
+//
+// Variables of varying sizes are packed together on the stack without
+// any padding, so handles are not guaranteed to be aligned; every byte
+// offset in the region is therefore considered.
+//
+void GarbageCollector::MarkRegion(const void* start, size_t numbytes, MarkState& state)
+{
+	if(numbytes < sizeof(HandleType))
+		return;
+
+	const Byte* bytes = static_cast<const Byte*>(start);
+	for(size_t offset = 0; offset <= numbytes - sizeof(HandleType); ++offset)
+	{
+		HandleType candidate;
+		memcpy(&candidate, bytes + offset, sizeof(HandleType));
+
+		// Concatenated strings also keep their prefixes alive
+		if(StringVariable::GetPool().Contains(candidate))
+		{
+			for(HandleType handle = candidate; handle && state.ReachableStrings.insert(handle).second; )
+				handle = StringVariable::GetPool().GetPrefix(handle);
+		}
+
+		if(BufferVariable::GetPool().Contains(candidate))
+			state.ReachableBuffers.insert(candidate);
+
+		// Map contents are held by value, so maps need no further scanning
+		if(HashMapVariable::GetPool().Contains(candidate))
+			state.ReachableHashMaps.insert(candidate);
+
+		if(ArrayVariable::GetPool().Contains(candidate))
+		{
+			++state.ArrayReferenceCounts[candidate];
+			if(state.ReachableArrays.insert(candidate).second)
+				state.ArraysToScan.push_back(candidate);
+		}
+	}
+}
+
+
+//
+// Pin an array handle, preventing the array from being collected
+//
+void GarbageCollector::PinArray(HandleType handle)
+{
+	Pin(PinnedArrays, handle);
+}
+
+//
+// Release a pin on an array handle
+//
+void GarbageCollector::UnpinArray(HandleType handle)
+{
+	Unpin(PinnedArrays, handle);
+}
+
+//
+// Pin a buffer handle, preventing the buffer from being collected
+//
+void GarbageCollector::PinBuffer(HandleType handle)
+{
+	Pin(PinnedBuffers, handle);
+}
+
+//
+// Release a pin on a buffer handle
+//
+void GarbageCollector::UnpinBuffer(HandleType handle)
+{
+	Unpin(PinnedBuffers, handle);
+}
+
+//
+// Pin a hash map handle, preventing the map from being collected
+//
+void GarbageCollector::PinHashMap(HandleType handle)
+{
+	Pin(PinnedHashMaps, handle);
+}
+
+//
+// Release a pin on a hash map handle
+//
+void GarbageCollector::UnpinHashMap(HandleType handle)
+{
+	Unpin(PinnedHashMaps, handle);
+}
+
+
+//
+// Register a stack whose contents must be treated as roots, even
+// while the stack is not the one being executed
+//
+// Registrations nest; each must be matched by an unregistration.
+//
+void GarbageCollector::RegisterSuspendedStack(const StackSpace& stack)
+{
+	Threads::CriticalSection::Auto mutex(PinCriticalSection);
+	SuspendedStacks.insert(&stack);
+}
+
+//
+// Release a registration of an additional root stack
+//
+void GarbageCollector::UnregisterSuspendedStack(const StackSpace& stack)
+{
+	Threads::CriticalSection::Auto mutex(PinCriticalSection);
+	std::multiset<const StackSpace*>::iterator iter = SuspendedStacks.find(&stack);
+	if(iter != SuspendedStacks.end())
+		SuspendedStacks.erase(iter);
+}
+
+
+//
+// Retrieve the number of collections performed so far
+//
+size_t GarbageCollector::GetNumCollections()
+{
+	return NumCollections;
+}
+
+//
+// Retrieve the total number of pool entries released by collections so far
+//
+size_t GarbageCollector::GetNumEntriesReclaimed()
+{
+	return NumEntriesReclaimed;
+}
+
+
+//
+// Begin deferring collection
+//
+GarbageCollector::Deferral::Deferral()
+{
+	::InterlockedIncrement(&DeferralCount);
+}
+
+//
+// Stop deferring collection
+//
+GarbageCollector::Deferral::~Deferral()
+{
+	::InterlockedDecrement(&DeferralCount);
+}
+
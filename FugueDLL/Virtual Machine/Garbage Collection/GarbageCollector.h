@@ -0,0 +1,93 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Garbage collection for pooled string, array, buffer, and hash map data
+//
+// String, array, buffer, and hash map variables hold handles into the pools of
+// their program (see RuntimeContext) rather than the data itself, and
+// handles are copied freely around the stack and heap storage without
+// any form of ownership tracking.
+// The collector therefore uses a conservative mark and sweep scheme:
+// any word in the root data which looks like a live handle is treated
+// as one, and pool entries not reachable from the roots are released.
+//
+// The roots consist of the executing stack, all live heap storage
+// blocks (global variables, message payloads, etc.), and handles that
+// are pinned by r-values which currently refer to pooled data. Arrays
+// found during marking are scanned in turn, since they may contain
+// handles of their own.
+//
+// Collection only ever happens at safe points, between the execution
+// of code blocks, and only while no other threads of the same program
+// are running, since the stacks of other threads cannot be scanned
+// reliably. Operations which hold on to pooled data across the
+// execution of nested code (without keeping a handle on the stack)
+// must defer collection for the duration; see GarbageCollector::Deferral.
+//
+// Stacks which are not currently executing, but still hold live data,
+// can be registered as additional roots. This is how the suspended
+// frames of generators (and the stacks of their consumers, while a
+// generator body runs) are kept alive.
+//
+
+#pragma once
+
+
+// Forward declarations
+class StackSpace;
+
+
+namespace VM
+{
+
+	class GarbageCollector
+	{
+	// Collection interface
+	public:
+		static bool IsCollectionDue();
+		static void CollectAtSafePoint(const StackSpace& stack);
+
+	// Pinning of handles held outside of root data
+	public:
+		static void PinArray(HandleType handle);
+		static void UnpinArray(HandleType handle);
+
+		static void PinBuffer(HandleType handle);
+		static void UnpinBuffer(HandleType handle);
+
+		static void PinHashMap(HandleType handle);
+		static void UnpinHashMap(HandleType handle);
+
+	// Additional stacks scanned as roots
+	public:
+		static void RegisterSuspendedStack(const StackSpace& stack);
+		static void UnregisterSuspendedStack(const StackSpace& stack);
+
+	// Statistics
+	public:
+		static size_t GetNumCollections();
+		static size_t GetNumEntriesReclaimed();
+
+	// Collection deferral
+	public:
+		//
+		// RAII wrapper which prevents any collection from taking place
+		// while the wrapper is alive. The wrapper may be nested freely.
+		//
+		struct Deferral
+		{
+			Deferral();
+			~Deferral();
+		};
+
+	// Internal helpers
+	private:
+		struct MarkState;
+
+		static void Collect(const StackSpace& stack);
+		static void MarkRegion(const void* start, size_t numbytes, MarkState& state);
+	};
+
+}
+
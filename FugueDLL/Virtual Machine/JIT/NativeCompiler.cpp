@@ -0,0 +1,975 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Compilation of hot functions into native machine code
+//
+// WARNING - generated code is platform-specific!
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/JIT/NativeCompiler.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/Comparison.h"
+#include "Virtual Machine/Operations/Variables/VariableOps.h"
+#include "Virtual Machine/Operations/StackOps.h"
+
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Utility/Threading/Synchronization.h"
+
+
+using namespace VM;
+using namespace VM::JIT;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+
+	//
+	// Track the executable memory reserved for compiled code
+	//
+	struct CodeSpaceRecord
+	{
+		UByte* StartOfSpace;
+		UByte* NextAvailableByte;
+		size_t Size;
+	};
+
+	std::vector<CodeSpaceRecord> CodeSpaceList;
+
+	Threads::CriticalSection CodeSpaceCriticalSection;
+
+	const size_t CodeSpaceSize = 65536;
+
+
+	//
+	// Reserve executable memory for compiled code of the given size
+	//
+	// Code which does not fit in the usual amount of space is given
+	// a reservation of its own.
+	//
+	UByte* GetCodeSpace(size_t numbytes)
+	{
+		Threads::CriticalSection::Auto mutex(CodeSpaceCriticalSection);
+
+		if(!CodeSpaceList.empty())
+		{
+			CodeSpaceRecord& rec = CodeSpaceList.back();
+			if(rec.NextAvailableByte + numbytes <= rec.StartOfSpace + rec.Size)
+			{
+				UByte* ret = rec.NextAvailableByte;
+				rec.NextAvailableByte += numbytes;
+				return ret;
+			}
+		}
+
+		CodeSpaceRecord rec;
+		rec.Size = std::max(numbytes, CodeSpaceSize);
+		rec.StartOfSpace = reinterpret_cast<UByte*>(::VirtualAlloc(NULL, rec.Size, MEM_COMMIT, PAGE_EXECUTE_READWRITE));
+		if(!rec.StartOfSpace)
+			throw MemoryException("Failed to allocate space for native code");
+
+		rec.NextAvailableByte = rec.StartOfSpace + numbytes;
+		CodeSpaceList.push_back(rec);
+		return rec.StartOfSpace;
+	}
+
+
+	//
+	// Condition codes, as encoded in the conditional jump and set instructions
+	//
+	enum ConditionCode
+	{
+		Condition_Equal				= 0x04,
+		Condition_NotEqual			= 0x05,
+		Condition_Less				= 0x0C,
+		Condition_GreaterOrEqual	= 0x0D,
+		Condition_LessOrEqual		= 0x0E,
+		Condition_Greater			= 0x0F
+	};
+
+	const size_t UnplacedLabel = static_cast<size_t>(-1);
+
+
+	//
+	// Helper for emitting machine code, with support for forward jumps
+	//
+	// Code is assembled in a scratch buffer, and only copied into executable
+	// memory once it is complete. All jumps use 32-bit displacements, which
+	// are filled in once the code is copied to its final location.
+	//
+	class CodeWriter
+	{
+	public:
+		typedef size_t Label;
+
+	public:
+		void Emit(UByte byte)
+		{ Code.push_back(byte); }
+
+		void Emit32(UInteger32 value)
+		{
+			Emit(static_cast<UByte>(value & 0xFF));
+			Emit(static_cast<UByte>((value >> 8) & 0xFF));
+			Emit(static_cast<UByte>((value >> 16) & 0xFF));
+			Emit(static_cast<UByte>((value >> 24) & 0xFF));
+		}
+
+		Label CreateLabel()
+		{
+			LabelPositions.push_back(UnplacedLabel);
+			return LabelPositions.size() - 1;
+		}
+
+		void PlaceLabel(Label label)
+		{ LabelPositions[label] = Code.size(); }
+
+		void EmitJump(Label target)
+		{
+			Emit(0xE9);
+			EmitJumpTarget(target);
+		}
+
+		void EmitConditionalJump(ConditionCode condition, Label target)
+		{
+			Emit(0x0F);	Emit(static_cast<UByte>(0x80 | condition));
+			EmitJumpTarget(target);
+		}
+
+		size_t GetSize() const
+		{ return Code.size(); }
+
+		void CopyTo(UByte* destination) const
+		{
+			memcpy(destination, &Code[0], Code.size());
+
+			for(std::vector<std::pair<size_t, Label> >::const_iterator iter = Fixups.begin(); iter != Fixups.end(); ++iter)
+			{
+				size_t target = LabelPositions[iter->second];
+				if(target == UnplacedLabel)
+					throw InternalFailureException("Native code contains a jump to a location which was never placed");
+
+				Integer32 displacement = static_cast<Integer32>(target) - static_cast<Integer32>(iter->first + sizeof(Integer32));
+				memcpy(destination + iter->first, &displacement, sizeof(Integer32));
+			}
+		}
+
+	private:
+		void EmitJumpTarget(Label target)
+		{
+			Fixups.push_back(std::make_pair(Code.size(), target));
+			Emit32(0);
+		}
+
+	private:
+		std::vector<UByte> Code;
+		std::vector<size_t> LabelPositions;
+		std::vector<std::pair<size_t, Label> > Fixups;
+	};
+
+
+	//
+	// Check if an operation is scalar arithmetic of the given kind
+	//
+	template <class OperationClass>
+	bool IsScalarArithmetic(const Operation* op)
+	{
+		const OperationClass* arithmeticop = dynamic_cast<const OperationClass*>(op);
+		if(!arithmeticop)
+			return false;
+
+		return (arithmeticop->GetNumParameters() == 2 && !arithmeticop->IsFirstArray() && !arithmeticop->IsSecondArray());
+	}
+
+
+	//
+	// Compiler for the body of a single function
+	//
+	// The operand stack is kept on the machine stack, one 32-bit entry per
+	// value, while EBX holds the address of the array of variable values.
+	// The types of the values on the operand stack are tracked during
+	// compilation, so that each operation can check it is given the
+	// operands it expects; anything unexpected abandons the compilation.
+	//
+	// The operand stack must be empty at the start and end of each block,
+	// and wherever control leaves a loop or conditional, so that all paths
+	// to any given point in the code agree on the layout of the stack.
+	//
+	class FunctionCompiler
+	{
+	// Construction
+	public:
+		FunctionCompiler(const ScopeDescription& params, const ScopeDescription& returns)
+			: Params(params),
+			  Returns(returns)
+		{ }
+
+	// Compilation interface
+	public:
+		bool Compile(const Block& codeblock, std::vector<UByte>& code);
+
+		const std::vector<NativeSlot>& GetSlots() const
+		{ return Slots; }
+
+	// Internal helpers
+	private:
+		bool CompileBlock(const Block& block);
+		bool CompileOperation(Operation* op);
+		bool CompilePushedOperation(const Operation* op);
+		bool CompileLiteral(const Operation* op);
+		bool CompileStore(const VariableSlot& slot, const std::wstring& name);
+		bool CompileArithmetic(ArithmeticOpType optype);
+		bool CompileComparison(const Comparator& op);
+		bool CompileIf(If& op);
+		bool CompileElseIf(ElseIf& op);
+		bool CompileWhileLoop(WhileLoop& op);
+
+		void CompileConditionTest();
+		bool PopOperand(EpochVariableTypeID type);
+
+		bool FindSlot(const VariableSlot& slot, const std::wstring& name, size_t& index);
+
+		UInteger32 GetSlotOffset(size_t index) const
+		{ return static_cast<UInteger32>(index * sizeof(Integer32)); }
+
+		CodeWriter::Label GetBreakTarget() const;
+		CodeWriter::Label GetExitTarget() const;
+
+	// Internal tracking
+	private:
+		const ScopeDescription& Params;
+		const ScopeDescription& Returns;
+
+		std::set<const ScopeDescription*> LocalScopes;
+		std::vector<NativeSlot> Slots;
+
+		std::vector<EpochVariableTypeID> Operands;
+
+		CodeWriter Writer;
+		CodeWriter::Label ReturnLabel;
+		CodeWriter::Label BailLabel;
+
+		// Loops and conditionals enclosing the code being compiled
+		struct Construct
+		{
+			bool IsLoop;
+			CodeWriter::Label Exit;
+		};
+
+		std::vector<Construct> Constructs;
+	};
+
+
+	//
+	// Compile the body of a function
+	//
+	// The finished code, with all jumps filled in, is placed in the given
+	// buffer; since every jump is relative, the code may then be copied
+	// to any location. Returns false if the body uses anything which
+	// cannot be compiled.
+	//
+	bool FunctionCompiler::Compile(const Block& codeblock, std::vector<UByte>& code)
+	{
+		ReturnLabel = Writer.CreateLabel();
+		BailLabel = Writer.CreateLabel();
+		CodeWriter::Label exitlabel = Writer.CreateLabel();
+
+		// push ebp
+		Writer.Emit(0x55);
+
+		// mov ebp, esp
+		Writer.Emit(0x8B);	Writer.Emit(0xEC);
+
+		// push ebx
+		Writer.Emit(0x53);
+
+		// mov ebx, [ebp + 8]
+		Writer.Emit(0x8B);	Writer.Emit(0x5D);	Writer.Emit(0x08);
+
+		if(!CompileBlock(codeblock))
+			return false;
+
+		// mov eax, 1
+		Writer.PlaceLabel(ReturnLabel);
+		Writer.Emit(0xB8);	Writer.Emit32(1);
+
+		// lea esp, [ebp - 4]
+		Writer.PlaceLabel(exitlabel);
+		Writer.Emit(0x8D);	Writer.Emit(0x65);	Writer.Emit(0xFC);
+
+		// pop ebx
+		Writer.Emit(0x5B);
+
+		// pop ebp
+		Writer.Emit(0x5D);
+
+		// ret
+		Writer.Emit(0xC3);
+
+		// xor eax, eax
+		Writer.PlaceLabel(BailLabel);
+		Writer.Emit(0x33);	Writer.Emit(0xC0);
+
+		// jmp exit
+		Writer.EmitJump(exitlabel);
+
+		code.resize(Writer.GetSize());
+		Writer.CopyTo(&code[0]);
+		return true;
+	}
+
+	//
+	// Compile the operations of a block
+	//
+	// The variables of the block's own scope are private to the compiled code.
+	//
+	bool FunctionCompiler::CompileBlock(const Block& block)
+	{
+		if(!Operands.empty())
+			return false;
+
+		if(block.GetBoundScope())
+			LocalScopes.insert(block.GetBoundScope());
+
+		const std::vector<Operation*>& ops = block.GetAllOperations();
+		for(std::vector<Operation*>::const_iterator iter = ops.begin(); iter != ops.end(); ++iter)
+		{
+			if(!CompileOperation(*iter))
+				return false;
+		}
+
+		return Operands.empty();
+	}
+
+	//
+	// Compile a single operation of a block
+	//
+	bool FunctionCompiler::CompileOperation(Operation* op)
+	{
+		if(dynamic_cast<const PushOperation*>(op))
+			return CompilePushedOperation(op->GetNestedOperation());
+
+		if(const AssignValue* assign = dynamic_cast<const AssignValue*>(op))
+			return CompileStore(assign->GetVariableSlot(), assign->GetAssociatedIdentifier());
+
+		if(const InitializeValue* init = dynamic_cast<const InitializeValue*>(op))
+			return CompileStore(init->GetVariableSlot(), init->GetAssociatedIdentifier());
+
+		if(If* ifop = dynamic_cast<If*>(op))
+			return CompileIf(*ifop);
+
+		if(ElseIf* elseifop = dynamic_cast<ElseIf*>(op))
+			return CompileElseIf(*elseifop);
+
+		if(WhileLoop* loop = dynamic_cast<WhileLoop*>(op))
+			return CompileWhileLoop(*loop);
+
+		if(ExecuteBlock* blockop = dynamic_cast<ExecuteBlock*>(op))
+			return (!blockop->GetBody() || CompileBlock(*blockop->GetBody()));
+
+		if(dynamic_cast<const WhileLoopConditional*>(op))
+		{
+			// Leave the loop if the condition is false
+			if(!PopOperand(EpochVariableType_Boolean) || !Operands.empty())
+				return false;
+
+			CompileConditionTest();
+			Writer.EmitConditionalJump(Condition_Equal, GetBreakTarget());
+			return true;
+		}
+
+		if(dynamic_cast<const Break*>(op))
+		{
+			if(!Operands.empty())
+				return false;
+
+			Writer.EmitJump(GetBreakTarget());
+			return true;
+		}
+
+		if(dynamic_cast<const ExitIfChain*>(op))
+		{
+			if(!Operands.empty())
+				return false;
+
+			Writer.EmitJump(GetExitTarget());
+			return true;
+		}
+
+		if(dynamic_cast<const Return*>(op))
+		{
+			Writer.EmitJump(ReturnLabel);
+			return true;
+		}
+
+		return CompileLiteral(op);
+	}
+
+	//
+	// Compile an operation whose result is pushed onto the stack
+	//
+	bool FunctionCompiler::CompilePushedOperation(const Operation* op)
+	{
+		if(const GetVariableValue* getvalue = dynamic_cast<const GetVariableValue*>(op))
+		{
+			size_t index;
+			if(!FindSlot(getvalue->GetVariableSlot(), getvalue->GetAssociatedIdentifier(), index))
+				return false;
+
+			// push dword ptr [ebx + offset]
+			Writer.Emit(0xFF);	Writer.Emit(0xB3);	Writer.Emit32(GetSlotOffset(index));
+			Operands.push_back(Slots[index].Type);
+			return true;
+		}
+
+		if(IsScalarArithmetic<SumIntegers>(op))
+			return CompileArithmetic(Arithmetic_Add);
+		if(IsScalarArithmetic<SubtractIntegers>(op))
+			return CompileArithmetic(Arithmetic_Subtract);
+		if(IsScalarArithmetic<MultiplyIntegers>(op))
+			return CompileArithmetic(Arithmetic_Multiply);
+		if(IsScalarArithmetic<DivideIntegers>(op))
+			return CompileArithmetic(Arithmetic_Divide);
+
+		if(const Comparator* comparison = dynamic_cast<const Comparator*>(op))
+			return CompileComparison(*comparison);
+
+		return CompileLiteral(op);
+	}
+
+	//
+	// Compile a literal push
+	//
+	bool FunctionCompiler::CompileLiteral(const Operation* op)
+	{
+		if(const PushIntegerLiteral* literal = dynamic_cast<const PushIntegerLiteral*>(op))
+		{
+			// push imm32
+			Writer.Emit(0x68);	Writer.Emit32(static_cast<UInteger32>(literal->GetValue()));
+			Operands.push_back(EpochVariableType_Integer);
+			return true;
+		}
+
+		if(const PushBooleanLiteral* literal = dynamic_cast<const PushBooleanLiteral*>(op))
+		{
+			// push imm32
+			Writer.Emit(0x68);	Writer.Emit32(literal->GetValue() ? 1 : 0);
+			Operands.push_back(EpochVariableType_Boolean);
+			return true;
+		}
+
+		return false;
+	}
+
+	//
+	// Compile a write of the value on top of the stack into a variable
+	//
+	bool FunctionCompiler::CompileStore(const VariableSlot& slot, const std::wstring& name)
+	{
+		size_t index;
+		if(!FindSlot(slot, name, index) || !PopOperand(Slots[index].Type))
+			return false;
+
+		// pop eax
+		Writer.Emit(0x58);
+
+		// mov [ebx + offset], eax
+		Writer.Emit(0x89);	Writer.Emit(0x83);	Writer.Emit32(GetSlotOffset(index));
+		return true;
+	}
+
+	//
+	// Compile scalar integer arithmetic on the top two values of the stack
+	//
+	// Division by zero, and the single overflowing division, are handed
+	// back to the interpreter so that they are reported in the usual way.
+	//
+	bool FunctionCompiler::CompileArithmetic(ArithmeticOpType optype)
+	{
+		if(!PopOperand(EpochVariableType_Integer) || !PopOperand(EpochVariableType_Integer))
+			return false;
+
+		// pop ecx
+		Writer.Emit(0x59);
+
+		// pop eax
+		Writer.Emit(0x58);
+
+		switch(optype)
+		{
+		case Arithmetic_Add:
+			// add eax, ecx
+			Writer.Emit(0x03);	Writer.Emit(0xC1);
+			break;
+
+		case Arithmetic_Subtract:
+			// sub eax, ecx
+			Writer.Emit(0x2B);	Writer.Emit(0xC1);
+			break;
+
+		case Arithmetic_Multiply:
+			// imul eax, ecx
+			Writer.Emit(0x0F);	Writer.Emit(0xAF);	Writer.Emit(0xC1);
+			break;
+
+		case Arithmetic_Divide:
+			{
+				CodeWriter::Label dividelabel = Writer.CreateLabel();
+
+				// test ecx, ecx
+				Writer.Emit(0x85);	Writer.Emit(0xC9);
+
+				// jz bail
+				Writer.EmitConditionalJump(Condition_Equal, BailLabel);
+
+				// cmp ecx, -1
+				Writer.Emit(0x83);	Writer.Emit(0xF9);	Writer.Emit(0xFF);
+
+				// jne divide
+				Writer.EmitConditionalJump(Condition_NotEqual, dividelabel);
+
+				// cmp eax, 0x80000000
+				Writer.Emit(0x3D);	Writer.Emit32(0x80000000);
+
+				// je bail
+				Writer.EmitConditionalJump(Condition_Equal, BailLabel);
+
+				// cdq
+				Writer.PlaceLabel(dividelabel);
+				Writer.Emit(0x99);
+
+				// idiv ecx
+				Writer.Emit(0xF7);	Writer.Emit(0xF9);
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		// push eax
+		Writer.Emit(0x50);
+		Operands.push_back(EpochVariableType_Integer);
+		return true;
+	}
+
+	//
+	// Compile a comparison of the top two values of the stack
+	//
+	bool FunctionCompiler::CompileComparison(const Comparator& op)
+	{
+		ConditionCode condition;
+		bool isordering = true;
+
+		if(dynamic_cast<const IsEqual*>(&op))
+		{
+			condition = Condition_Equal;
+			isordering = false;
+		}
+		else if(dynamic_cast<const IsNotEqual*>(&op))
+		{
+			condition = Condition_NotEqual;
+			isordering = false;
+		}
+		else if(dynamic_cast<const IsGreater*>(&op))
+			condition = Condition_Greater;
+		else if(dynamic_cast<const IsGreaterOrEqual*>(&op))
+			condition = Condition_GreaterOrEqual;
+		else if(dynamic_cast<const IsLesser*>(&op))
+			condition = Condition_Less;
+		else if(dynamic_cast<const IsLesserOrEqual*>(&op))
+			condition = Condition_LessOrEqual;
+		else
+			return false;
+
+		// Booleans are always held as exactly 0 or 1, so they can be tested for equality directly
+		EpochVariableTypeID type = op.GetOperandType();
+		if(type != EpochVariableType_Integer && (type != EpochVariableType_Boolean || isordering))
+			return false;
+
+		if(!PopOperand(type) || !PopOperand(type))
+			return false;
+
+		// pop ecx
+		Writer.Emit(0x59);
+
+		// pop eax
+		Writer.Emit(0x58);
+
+		// cmp eax, ecx
+		Writer.Emit(0x3B);	Writer.Emit(0xC1);
+
+		// setcc al
+		Writer.Emit(0x0F);	Writer.Emit(static_cast<UByte>(0x90 | condition));	Writer.Emit(0xC0);
+
+		// movzx eax, al
+		Writer.Emit(0x0F);	Writer.Emit(0xB6);	Writer.Emit(0xC0);
+
+		// push eax
+		Writer.Emit(0x50);
+		Operands.push_back(EpochVariableType_Boolean);
+		return true;
+	}
+
+	//
+	// Compile an if/elseif/else chain
+	//
+	// Any elseif clauses which run end with an exit from the chain,
+	// which skips the remaining clauses and the else block.
+	//
+	bool FunctionCompiler::CompileIf(If& op)
+	{
+		if(!PopOperand(EpochVariableType_Boolean) || !Operands.empty())
+			return false;
+
+		CodeWriter::Label falselabel = Writer.CreateLabel();
+		CodeWriter::Label endlabel = Writer.CreateLabel();
+
+		CompileConditionTest();
+		Writer.EmitConditionalJump(Condition_Equal, falselabel);
+
+		Construct construct = { false, endlabel };
+		Constructs.push_back(construct);
+
+		if(op.GetTrueBlock() && !CompileBlock(*op.GetTrueBlock()))
+			return false;
+
+		Writer.EmitJump(endlabel);
+		Writer.PlaceLabel(falselabel);
+
+		if(op.GetElseIfBlock() && op.GetElseIfBlock()->GetBlock() && !CompileBlock(*op.GetElseIfBlock()->GetBlock()))
+			return false;
+
+		if(op.GetFalseBlock() && !CompileBlock(*op.GetFalseBlock()))
+			return false;
+
+		Constructs.pop_back();
+		Writer.PlaceLabel(endlabel);
+		return true;
+	}
+
+	//
+	// Compile a single elseif clause
+	//
+	bool FunctionCompiler::CompileElseIf(ElseIf& op)
+	{
+		if(!PopOperand(EpochVariableType_Boolean) || !Operands.empty())
+			return false;
+
+		CodeWriter::Label skiplabel = Writer.CreateLabel();
+
+		CompileConditionTest();
+		Writer.EmitConditionalJump(Condition_Equal, skiplabel);
+
+		if(op.GetBlock() && !CompileBlock(*op.GetBlock()))
+			return false;
+
+		Writer.PlaceLabel(skiplabel);
+		return true;
+	}
+
+	//
+	// Compile a while loop
+	//
+	// The loop's condition is checked by a conditional operation within
+	// the body itself. Loops with hoisted invariants keep those values on
+	// the VM stack, which compiled code has no access to.
+	//
+	bool FunctionCompiler::CompileWhileLoop(WhileLoop& op)
+	{
+		if(op.HasHoistedOperations() || !op.GetBody() || !Operands.empty())
+			return false;
+
+		CodeWriter::Label toplabel = Writer.CreateLabel();
+		CodeWriter::Label exitlabel = Writer.CreateLabel();
+
+		Writer.PlaceLabel(toplabel);
+
+		Construct construct = { true, exitlabel };
+		Constructs.push_back(construct);
+
+		if(!CompileBlock(*op.GetBody()))
+			return false;
+
+		Constructs.pop_back();
+
+		Writer.EmitJump(toplabel);
+		Writer.PlaceLabel(exitlabel);
+		return true;
+	}
+
+	//
+	// Pop a boolean off the stack and test it, ready for a conditional jump
+	//
+	void FunctionCompiler::CompileConditionTest()
+	{
+		// pop eax
+		Writer.Emit(0x58);
+
+		// test eax, eax
+		Writer.Emit(0x85);	Writer.Emit(0xC0);
+	}
+
+	//
+	// Check that the value on top of the stack has the given type, and remove it
+	//
+	bool FunctionCompiler::PopOperand(EpochVariableTypeID type)
+	{
+		if(Operands.empty() || Operands.back() != type)
+			return false;
+
+		Operands.pop_back();
+		return true;
+	}
+
+	//
+	// Map a variable onto its entry in the array of values
+	//
+	// Only integer and boolean variables belonging to the function itself
+	// can be used; references, globals, and the variables of enclosing
+	// scopes are left to the interpreter.
+	//
+	bool FunctionCompiler::FindSlot(const VariableSlot& slot, const std::wstring& name, size_t& index)
+	{
+		if(!slot.IsResolved())
+			return false;
+
+		for(index = 0; index < Slots.size(); ++index)
+		{
+			if(Slots[index].Slot.OwnerScope == slot.OwnerScope && Slots[index].Slot.MemberIndex == slot.MemberIndex)
+				return true;
+		}
+
+		NativeSlot newslot;
+		newslot.Slot = slot;
+		newslot.Name = name;
+
+		if(slot.OwnerScope == &Params)
+			newslot.Source = NativeSlot_Parameter;
+		else if(slot.OwnerScope == &Returns)
+			newslot.Source = NativeSlot_Return;
+		else if(LocalScopes.find(slot.OwnerScope) != LocalScopes.end())
+			newslot.Source = NativeSlot_Local;
+		else
+			return false;
+
+		unsigned memberindex = static_cast<unsigned>(slot.MemberIndex);
+		if(slot.OwnerScope->IsReference(memberindex))
+			return false;
+
+		newslot.Type = slot.OwnerScope->GetVariableType(memberindex);
+		if(newslot.Type != EpochVariableType_Integer && newslot.Type != EpochVariableType_Boolean)
+			return false;
+
+		if(Slots.size() >= MaxNativeSlots)
+			return false;
+
+		Slots.push_back(newslot);
+		index = Slots.size() - 1;
+		return true;
+	}
+
+	//
+	// Determine where control goes when leaving the innermost loop
+	//
+	// Outside of any loop, this leaves the function.
+	//
+	CodeWriter::Label FunctionCompiler::GetBreakTarget() const
+	{
+		for(std::vector<Construct>::const_reverse_iterator iter = Constructs.rbegin(); iter != Constructs.rend(); ++iter)
+		{
+			if(iter->IsLoop)
+				return iter->Exit;
+		}
+
+		return ReturnLabel;
+	}
+
+	//
+	// Determine where control goes when leaving the innermost loop or conditional
+	//
+	CodeWriter::Label FunctionCompiler::GetExitTarget() const
+	{
+		if(Constructs.empty())
+			return ReturnLabel;
+
+		return Constructs.back().Exit;
+	}
+
+
+	//
+	// Helpers for moving values between variables and compiled code
+	//
+	Integer32 ReadValue(Variable& var, EpochVariableTypeID type)
+	{
+		if(type == EpochVariableType_Boolean)
+			return BooleanVariable(var.GetStorage()).GetValue() ? 1 : 0;
+
+		return IntegerVariable(var.GetStorage()).GetValue();
+	}
+
+	void WriteValue(Variable& var, EpochVariableTypeID type, Integer32 value)
+	{
+		if(type == EpochVariableType_Boolean)
+			BooleanVariable(var.GetStorage()).SetValue(value != 0);
+		else
+			IntegerVariable(var.GetStorage()).SetValue(value);
+	}
+
+
+	//
+	// Attach a hotness counter to the while loops in a block
+	//
+	void AttachCounterToLoops(const Block& block, volatile LONG* counter)
+	{
+		const std::vector<Operation*>& ops = block.GetAllOperations();
+		for(std::vector<Operation*>::const_iterator iter = ops.begin(); iter != ops.end(); ++iter)
+		{
+			if(WhileLoop* loop = dynamic_cast<WhileLoop*>(*iter))
+			{
+				loop->AttachHotnessCounter(counter);
+				if(loop->GetBody())
+					AttachCounterToLoops(*loop->GetBody(), counter);
+			}
+			else if(If* ifop = dynamic_cast<If*>(*iter))
+			{
+				if(ifop->GetTrueBlock())
+					AttachCounterToLoops(*ifop->GetTrueBlock(), counter);
+				if(ifop->GetElseIfBlock() && ifop->GetElseIfBlock()->GetBlock())
+					AttachCounterToLoops(*ifop->GetElseIfBlock()->GetBlock(), counter);
+				if(ifop->GetFalseBlock())
+					AttachCounterToLoops(*ifop->GetFalseBlock(), counter);
+			}
+			else if(ElseIf* elseifop = dynamic_cast<ElseIf*>(*iter))
+			{
+				if(elseifop->GetBlock())
+					AttachCounterToLoops(*elseifop->GetBlock(), counter);
+			}
+			else if(ExecuteBlock* blockop = dynamic_cast<ExecuteBlock*>(*iter))
+			{
+				if(blockop->GetBody())
+					AttachCounterToLoops(*blockop->GetBody(), counter);
+			}
+		}
+	}
+
+}
+
+
+//
+// Construct a wrapper for compiled code
+//
+NativeFunction::NativeFunction(NativeEntryPoint entrypoint, const std::vector<NativeSlot>& slots)
+	: EntryPoint(entrypoint),
+	  Slots(slots)
+{
+}
+
+//
+// Run the compiled code for a call whose scopes have been entered
+//
+// Returns false, leaving the return values untouched, if the call
+// must be run by the interpreter instead.
+//
+bool NativeFunction::Execute(ActivatedScope& params, ActivatedScope& returns) const
+{
+	Integer32 values[MaxNativeSlots];
+
+	const size_t numslots = Slots.size();
+	for(size_t i = 0; i < numslots; ++i)
+	{
+		const NativeSlot& slot = Slots[i];
+		switch(slot.Source)
+		{
+		case NativeSlot_Parameter:	values[i] = ReadValue(params.GetVariableRef(slot.Slot, slot.Name), slot.Type);		break;
+		case NativeSlot_Return:		values[i] = ReadValue(returns.GetVariableRef(slot.Slot, slot.Name), slot.Type);	break;
+		default:					values[i] = 0;																		break;
+		}
+	}
+
+	if(!EntryPoint(values))
+		return false;
+
+	for(size_t i = 0; i < numslots; ++i)
+	{
+		const NativeSlot& slot = Slots[i];
+		if(slot.Source == NativeSlot_Return)
+			WriteValue(returns.GetVariableRef(slot.Slot, slot.Name), slot.Type, values[i]);
+	}
+
+	return true;
+}
+
+
+//
+// Compile the body of a function into native code
+//
+// Returns NULL if the function cannot be compiled, in which
+// case it should continue to be run by the interpreter.
+//
+NativeFunction* JIT::CompileFunction(const Block& codeblock, const ScopeDescription& params, const ScopeDescription& returns)
+{
+	FunctionCompiler compiler(params, returns);
+
+	std::vector<UByte> code;
+	if(!compiler.Compile(codeblock, code))
+		return NULL;
+
+	UByte* space = GetCodeSpace(code.size());
+	memcpy(space, &code[0], code.size());
+	::FlushInstructionCache(::GetCurrentProcess(), space, code.size());
+
+	return new NativeFunction(reinterpret_cast<NativeEntryPoint>(space), compiler.GetSlots());
+}
+
+//
+// Compile the body of a function into native code held in a buffer
+//
+// The code is not made executable; this is used to compile functions
+// ahead of time, for embedding in an executable. Returns false if the
+// function cannot be compiled.
+//
+bool JIT::CompileFunctionCode(const Block& codeblock, const ScopeDescription& params, const ScopeDescription& returns, std::vector<UByte>& code, std::vector<NativeSlot>& slots)
+{
+	FunctionCompiler compiler(params, returns);
+	if(!compiler.Compile(codeblock, code))
+		return false;
+
+	slots = compiler.GetSlots();
+	return true;
+}
+
+//
+// Count the iterations of the while loops in a function's body towards its hotness
+//
+void JIT::AttachHotnessCounter(const Block& codeblock, volatile LONG* counter)
+{
+	AttachCounterToLoops(codeblock, counter);
+}
+
+//
+// Release all executable memory used by compiled code
+//
+// This should only be done when no compiled functions remain.
+//
+void JIT::CleanNativeCode()
+{
+	Threads::CriticalSection::Auto mutex(CodeSpaceCriticalSection);
+
+	for(std::vector<CodeSpaceRecord>::iterator iter = CodeSpaceList.begin(); iter != CodeSpaceList.end(); ++iter)
+		::VirtualFree(iter->StartOfSpace, 0, MEM_RELEASE);
+
+	CodeSpaceList.clear();
+}
+
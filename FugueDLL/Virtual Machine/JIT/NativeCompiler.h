@@ -0,0 +1,113 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Compilation of hot functions into native machine code
+//
+// WARNING - generated code is platform-specific!
+//
+// Functions start out running in the interpreter. Each call to a function,
+// and each iteration of a while loop in its body, counts towards the
+// function's hotness; once the count passes the configured threshold, the
+// function's body is compiled into x86 code which performs the same work
+// without any operation dispatch or VM stack traffic.
+//
+// Only a restricted class of functions can be compiled: those whose code
+// consists entirely of integer and boolean scalar work on the function's
+// own parameters, return values, and locals, using literals, variable
+// reads and writes, integer arithmetic and comparisons, if/elseif/else
+// chains, and while loops. Any other operation (function calls, arrays,
+// structures, strings, reals, and so on) leaves the function running in
+// the interpreter for good.
+//
+// Compiled code works on a private copy of the variables, and only writes
+// the return values back once it has finished. This allows it to hand
+// control back to the interpreter at any point, simply by having the
+// interpreter run the whole call over; this is done when the code meets a
+// condition it does not handle itself, such as a division by zero.
+//
+// The same compiler is used ahead of time by EXEGen; see NativeImages.h.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+#include "Utility/Types/EpochTypeIDs.h"
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Block;
+	class ScopeDescription;
+	class ActivatedScope;
+
+
+	namespace JIT
+	{
+
+		//
+		// Signature of the entry point of compiled code
+		//
+		// The code is given an array holding the value of each variable it
+		// uses, and returns zero if the interpreter must run the call instead.
+		//
+		typedef Integer32 (__cdecl *NativeEntryPoint)(Integer32* values);
+
+		// Largest number of variables compiled code may use
+		const size_t MaxNativeSlots = 64;
+
+
+		//
+		// Description of a variable used by compiled code
+		//
+		enum NativeSlotSource
+		{
+			NativeSlot_Parameter,				// Read from the parameters on entry
+			NativeSlot_Return,					// Read on entry, and written back on success
+			NativeSlot_Local					// Private to the compiled code
+		};
+
+		struct NativeSlot
+		{
+			VariableSlot Slot;
+			std::wstring Name;
+			EpochVariableTypeID Type;
+			NativeSlotSource Source;
+		};
+
+
+		//
+		// Compiled form of a function's body
+		//
+		class NativeFunction
+		{
+		// Construction
+		public:
+			NativeFunction(NativeEntryPoint entrypoint, const std::vector<NativeSlot>& slots);
+
+		// Execution
+		public:
+			bool Execute(ActivatedScope& params, ActivatedScope& returns) const;
+
+		// Internal tracking
+		private:
+			NativeEntryPoint EntryPoint;
+			std::vector<NativeSlot> Slots;
+		};
+
+
+		// Compilation interface
+		NativeFunction* CompileFunction(const Block& codeblock, const ScopeDescription& params, const ScopeDescription& returns);
+		bool CompileFunctionCode(const Block& codeblock, const ScopeDescription& params, const ScopeDescription& returns, std::vector<UByte>& code, std::vector<NativeSlot>& slots);
+		void AttachHotnessCounter(const Block& codeblock, volatile LONG* counter);
+
+		void CleanNativeCode();
+
+	}
+
+}
+
@@ -0,0 +1,345 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Native code images for functions compiled ahead of time
+//
+// WARNING - generated code is platform-specific!
+//
+// An image consists of a fixed header, followed by a record for each
+// compiled function, followed by the code of the functions. Each record
+// holds the function's position in the optimizer's traversal order, the
+// location of its code within the image, and a description of each of
+// the variables used by the code. Code is aligned within the image, and
+// the image is placed at the start of a section, so the alignment holds
+// once the executable is loaded.
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/JIT/NativeImages.h"
+#include "Virtual Machine/JIT/NativeCompiler.h"
+
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+
+#include "Bytecode/StartupImages.h"
+
+
+using namespace VM;
+using namespace VM::JIT;
+
+
+namespace
+{
+	const char ImageCookie[] = "EpochNTV";
+	const UInteger32 ImageVersion = 1;
+
+	// Name of the executable section holding the image; see EXEGen's NativeCode section manager
+	const char NativeSectionName[] = ".native";
+
+	const size_t CodeAlignment = 16;
+
+
+	//
+	// Fixed header at the start of each image
+	//
+	struct ImageHeader
+	{
+		char Cookie[sizeof(ImageCookie) - 1];
+		UInteger32 Version;
+		UInteger32 BytecodeSize;
+		UInteger32 BytecodeHash;
+		UInteger32 NumFunctions;
+	};
+
+	//
+	// Record describing a single compiled function
+	//
+	// The record is followed by the given number of slot records.
+	//
+	struct FunctionRecord
+	{
+		UInteger32 FunctionIndex;
+		UInteger32 CodeOffset;
+		UInteger32 CodeSize;
+		UInteger32 NumSlots;
+	};
+
+	//
+	// Record describing a variable used by compiled code
+	//
+	// The record is followed by the variable's name, without a terminator.
+	//
+	struct SlotRecord
+	{
+		UInteger32 Source;
+		UInteger32 Type;
+		UInteger32 NameLength;
+	};
+
+
+	//
+	// Helpers for appending raw data to an image
+	//
+	void Append(std::vector<UByte>& image, const void* data, size_t size)
+	{
+		const UByte* bytes = reinterpret_cast<const UByte*>(data);
+		image.insert(image.end(), bytes, bytes + size);
+	}
+
+	template <class RecordType>
+	void Append(std::vector<UByte>& image, const RecordType& record)
+	{
+		Append(image, &record, sizeof(record));
+	}
+
+
+	//
+	// Helper for reading records from an image with bounds checking
+	//
+	class ImageReader
+	{
+	public:
+		ImageReader(const void* image, size_t size)
+			: Image(reinterpret_cast<const UByte*>(image)),
+			  Size(size),
+			  Position(0)
+		{ }
+
+		template <class RecordType>
+		bool Read(RecordType& record)
+		{
+			if(Size - Position < sizeof(record))
+				return false;
+
+			memcpy(&record, Image + Position, sizeof(record));
+			Position += sizeof(record);
+			return true;
+		}
+
+		bool ReadName(UInteger32 length, std::wstring& name)
+		{
+			if((Size - Position) / sizeof(wchar_t) < length)
+				return false;
+
+			name.assign(reinterpret_cast<const wchar_t*>(Image + Position), length);
+			Position += length * sizeof(wchar_t);
+			return true;
+		}
+
+		bool ContainsRange(UInteger32 offset, UInteger32 size) const
+		{ return (offset <= Size && size <= Size - offset); }
+
+	private:
+		const UByte* Image;
+		size_t Size;
+		size_t Position;
+	};
+
+
+	//
+	// Tie a variable used by precompiled code to the function's scopes
+	//
+	// Returns false if the function no longer has a matching variable.
+	//
+	bool ResolveSlot(Function& function, NativeSlot& slot)
+	{
+		if(slot.Type != EpochVariableType_Integer && slot.Type != EpochVariableType_Boolean)
+			return false;
+
+		if(slot.Source == NativeSlot_Local)
+		{
+			slot.Slot = VariableSlot();
+			return true;
+		}
+
+		ScopeDescription* scope;
+		if(slot.Source == NativeSlot_Parameter)
+			scope = &function.GetParams();
+		else if(slot.Source == NativeSlot_Return)
+			scope = &function.GetReturns();
+		else
+			return false;
+
+		slot.Slot = scope->ResolveVariableSlot(slot.Name);
+		if(slot.Slot.OwnerScope != scope)
+			return false;
+
+		unsigned memberindex = static_cast<unsigned>(slot.Slot.MemberIndex);
+		return (!scope->IsReference(memberindex) && scope->GetVariableType(memberindex) == slot.Type);
+	}
+}
+
+
+//
+// Compile the given functions ahead of time, and gather their code into an image
+//
+// Functions whose code is deferred, or which cannot be compiled, are left
+// out of the image. If no function can be compiled, the image is empty.
+//
+void NativeImages::Build(const std::vector<Function*>& functions, const void* bytecode, size_t bytecodesize, std::vector<UByte>& image)
+{
+	image.clear();
+
+	ImageHeader header;
+	memcpy(header.Cookie, ImageCookie, sizeof(header.Cookie));
+	header.Version = ImageVersion;
+	header.BytecodeSize = static_cast<UInteger32>(bytecodesize);
+	header.BytecodeHash = StartupImages::HashBinary(bytecode, bytecodesize);
+	header.NumFunctions = 0;
+
+	std::vector<UByte> records;
+	std::vector<UByte> code;
+	std::vector<size_t> recordoffsets;
+
+	for(size_t i = 0; i < functions.size(); ++i)
+	{
+		Function& function = *functions[i];
+		if(!function.GetCodeBlock() || function.HasDeferredCode())
+			continue;
+
+		std::vector<UByte> functioncode;
+		std::vector<NativeSlot> slots;
+		if(!JIT::CompileFunctionCode(*function.GetCodeBlock(), function.GetParams(), function.GetReturns(), functioncode, slots))
+			continue;
+
+		code.resize((code.size() + CodeAlignment - 1) / CodeAlignment * CodeAlignment, 0xCC);
+
+		FunctionRecord record;
+		record.FunctionIndex = static_cast<UInteger32>(i);
+		record.CodeOffset = static_cast<UInteger32>(code.size());
+		record.CodeSize = static_cast<UInteger32>(functioncode.size());
+		record.NumSlots = static_cast<UInteger32>(slots.size());
+
+		recordoffsets.push_back(records.size());
+		Append(records, record);
+
+		for(std::vector<NativeSlot>::const_iterator iter = slots.begin(); iter != slots.end(); ++iter)
+		{
+			SlotRecord slotrecord;
+			slotrecord.Source = static_cast<UInteger32>(iter->Source);
+			slotrecord.Type = static_cast<UInteger32>(iter->Type);
+			slotrecord.NameLength = static_cast<UInteger32>(iter->Name.length());
+			Append(records, slotrecord);
+			Append(records, iter->Name.data(), iter->Name.length() * sizeof(wchar_t));
+		}
+
+		Append(code, &functioncode[0], functioncode.size());
+		++header.NumFunctions;
+	}
+
+	if(!header.NumFunctions)
+		return;
+
+	// Code offsets are relative to the start of the code; rebase them onto the start of the image
+	size_t codestart = (sizeof(ImageHeader) + records.size() + CodeAlignment - 1) / CodeAlignment * CodeAlignment;
+	for(std::vector<size_t>::const_iterator iter = recordoffsets.begin(); iter != recordoffsets.end(); ++iter)
+	{
+		FunctionRecord* record = reinterpret_cast<FunctionRecord*>(&records[*iter]);
+		record->CodeOffset += static_cast<UInteger32>(codestart);
+	}
+
+	Append(image, header);
+	Append(image, &records[0], records.size());
+	image.resize(codestart, 0);
+	Append(image, &code[0], code.size());
+}
+
+//
+// Bind the precompiled code in an image to the functions of a loaded program
+//
+// The image must be held in executable memory, and remain there for as
+// long as the functions exist; the code is run in place. The functions
+// must be listed in the order the optimizer visited them. Nothing is
+// bound if the image was built from different bytecode. Returns the
+// number of functions which were given precompiled code.
+//
+size_t NativeImages::Bind(const void* image, size_t imagesize, const std::vector<Function*>& functions, const void* bytecode)
+{
+	ImageReader reader(image, imagesize);
+
+	ImageHeader header;
+	if(!reader.Read(header) || memcmp(header.Cookie, ImageCookie, sizeof(header.Cookie)) != 0 || header.Version != ImageVersion)
+		return 0;
+
+	if(StartupImages::HashBinary(bytecode, header.BytecodeSize) != header.BytecodeHash)
+		return 0;
+
+	size_t bound = 0;
+	for(UInteger32 i = 0; i < header.NumFunctions; ++i)
+	{
+		FunctionRecord record;
+		if(!reader.Read(record) || !reader.ContainsRange(record.CodeOffset, record.CodeSize) || record.NumSlots > MaxNativeSlots)
+			break;
+
+		std::vector<NativeSlot> slots(record.NumSlots);
+		for(UInteger32 j = 0; j < record.NumSlots; ++j)
+		{
+			SlotRecord slotrecord;
+			if(!reader.Read(slotrecord) || !reader.ReadName(slotrecord.NameLength, slots[j].Name))
+				return bound;
+
+			slots[j].Source = static_cast<NativeSlotSource>(slotrecord.Source);
+			slots[j].Type = static_cast<EpochVariableTypeID>(slotrecord.Type);
+		}
+
+		if(record.FunctionIndex >= functions.size())
+			continue;
+
+		Function& function = *functions[record.FunctionIndex];
+		if(!function.GetCodeBlock() || function.HasDeferredCode())
+			continue;
+
+		bool valid = true;
+		for(std::vector<NativeSlot>::iterator iter = slots.begin(); valid && iter != slots.end(); ++iter)
+			valid = ResolveSlot(function, *iter);
+
+		if(!valid)
+			continue;
+
+		const UByte* code = reinterpret_cast<const UByte*>(image) + record.CodeOffset;
+		NativeFunction* native = new NativeFunction(reinterpret_cast<NativeEntryPoint>(const_cast<UByte*>(code)), slots);
+		if(function.BindNativeCode(native))
+			++bound;
+		else
+			delete native;
+	}
+
+	return bound;
+}
+
+
+//
+// Locate the native code image embedded in the host executable, if any
+//
+// Returns NULL if the executable which started the process does not
+// carry an image.
+//
+const void* NativeImages::FindInHostExecutable(size_t& imagesize)
+{
+	const UByte* base = reinterpret_cast<const UByte*>(::GetModuleHandle(NULL));
+	if(!base)
+		return NULL;
+
+	const IMAGE_DOS_HEADER* dosheader = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+	if(dosheader->e_magic != IMAGE_DOS_SIGNATURE)
+		return NULL;
+
+	const IMAGE_NT_HEADERS* ntheaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosheader->e_lfanew);
+	if(ntheaders->Signature != IMAGE_NT_SIGNATURE)
+		return NULL;
+
+	const IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(ntheaders);
+	for(WORD i = 0; i < ntheaders->FileHeader.NumberOfSections; ++i, ++section)
+	{
+		if(strncmp(reinterpret_cast<const char*>(section->Name), NativeSectionName, IMAGE_SIZEOF_SHORT_NAME) == 0)
+		{
+			imagesize = section->Misc.VirtualSize;
+			return base + section->VirtualAddress;
+		}
+	}
+
+	return NULL;
+}
+
@@ -0,0 +1,52 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Native code images for functions compiled ahead of time
+//
+// WARNING - generated code is platform-specific!
+//
+// When EXEGen builds an executable, it can have the functions of the
+// program compiled into native code up front, using the same compiler as
+// the JIT (see NativeCompiler.h). The compiled code for every function
+// which can be compiled is gathered into an image, which EXEGen places in
+// an executable section of its own, named ".native", alongside the
+// section holding the bytecode.
+//
+// When the executable runs, the program is loaded from the bytecode as
+// usual, and the image is then bound to the loaded functions. Functions
+// with precompiled code run it directly from the executable's section,
+// from their very first call; all other functions stay in the interpreter.
+//
+// Functions are identified by the order in which the optimizer visits
+// them, which is fixed for any given bytecode; the image records a hash
+// of the bytecode it was built from, and is ignored if the bytecode does
+// not match. The variables used by each function are recorded by name,
+// and are looked up again when the image is bound.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Function;
+
+
+	namespace JIT
+	{
+		namespace NativeImages
+		{
+
+			void Build(const std::vector<Function*>& functions, const void* bytecode, size_t bytecodesize, std::vector<UByte>& image);
+			size_t Bind(const void* image, size_t imagesize, const std::vector<Function*>& functions, const void* bytecode);
+
+			const void* FindInHostExecutable(size_t& imagesize);
+
+		}
+	}
+
+}
+
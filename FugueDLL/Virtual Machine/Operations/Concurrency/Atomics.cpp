@@ -0,0 +1,189 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Atomic update operations for integers shared between tasks
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+
+#include "Virtual Machine/Routines.inl"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Virtual Machine/SelfAware.inl"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Pop the operands of an atomic update off the stack
+	//
+	// Compare-exchange takes the comparand as its operand, and the
+	// replacement value (which sits on top of it) as the desired value.
+	//
+	void PopOperands(StackSpace& stack, AtomicOpType optype, Integer32& operand, Integer32& desired)
+	{
+		desired = 0;
+		if(optype == Atomic_CompareExchange)
+		{
+			desired = IntegerVariable(stack.GetCurrentTopOfStack()).GetValue();
+			stack.Pop(IntegerVariable::GetStorageSize());
+		}
+
+		operand = IntegerVariable(stack.GetCurrentTopOfStack()).GetValue();
+		stack.Pop(IntegerVariable::GetStorageSize());
+	}
+
+	//
+	// Replace the target with the operand for as long as the given
+	// ordering holds, retrying if another thread gets in first
+	//
+	template <class OrderingT>
+	Integer32 InterlockedReplaceIf(volatile LONG* target, Integer32 operand, OrderingT ordering)
+	{
+		LONG current = *target;
+		while(ordering(operand, current))
+		{
+			LONG previous = ::InterlockedCompareExchange(target, operand, current);
+			if(previous == current)
+				break;
+
+			current = previous;
+		}
+
+		return current;
+	}
+
+	//
+	// Apply an atomic update to the given integer, and return its previous value
+	//
+	Integer32 ApplyAtomicUpdate(AtomicOpType optype, void* storage, Integer32 operand, Integer32 desired)
+	{
+		volatile LONG* target = reinterpret_cast<volatile LONG*>(storage);
+
+		switch(optype)
+		{
+		case Atomic_Add:				return ::InterlockedExchangeAdd(target, operand);
+		case Atomic_Min:				return InterlockedReplaceIf(target, operand, std::less<LONG>());
+		case Atomic_Max:				return InterlockedReplaceIf(target, operand, std::greater<LONG>());
+		case Atomic_CompareExchange:	return ::InterlockedCompareExchange(target, desired, operand);
+		}
+
+		throw InternalFailureException("Unrecognized atomic operation");
+	}
+
+	//
+	// Build a traversal payload naming the variable updated by an operation
+	//
+	Traverser::Payload GetTargetPayload(const std::wstring& varname, size_t numparams)
+	{
+		Traverser::Payload payload;
+		payload.SetValue(varname.c_str());
+		payload.IsIdentifier = true;
+		payload.ParameterCount = numparams;
+		return payload;
+	}
+
+}
+
+
+//
+// Atomically update an integer variable, leaving its previous value on the stack
+//
+Integer32 AtomicUpdate::Execute(ExecutionContext& context)
+{
+	Integer32 operand, desired;
+	PopOperands(context.Stack, OpType, operand, desired);
+
+	IntegerVariable& var = context.Scope.GetVariableRef<IntegerVariable>(Slot, VarName);
+	return ApplyAtomicUpdate(OpType, var.GetStorage(), operand, desired);
+}
+
+bool AtomicUpdate::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	Integer32 previous = Execute(context);
+	context.Stack.Push(IntegerVariable::GetStorageSize());
+	IntegerVariable(context.Stack.GetCurrentTopOfStack()).SetValue(previous);
+	return true;
+}
+
+void AtomicUpdate::ExecuteFast(ExecutionContext& context)
+{
+	Execute(context);
+}
+
+RValuePtr AtomicUpdate::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(Execute(context)));
+}
+
+Traverser::Payload AtomicUpdate::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetTargetPayload(VarName, GetNumParameters(*scope));
+}
+
+
+//
+// Atomically update an element of an integer array, leaving its previous value on the stack
+//
+// The update is made directly in the array's pooled storage, so that
+// every worker sharing the array variable sees it; see the notes on
+// ArrayVariable::GetConcurrentWritableStorage.
+//
+Integer32 AtomicUpdateArray::Execute(ExecutionContext& context)
+{
+	Integer32 operand, desired;
+	PopOperands(context.Stack, OpType, operand, desired);
+
+	Integer32 index = IntegerVariable(context.Stack.GetCurrentTopOfStack()).GetValue();
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID elementtype;
+	size_t numelements;
+	arrayvar.GetArrayInfo(elementtype, numelements);
+
+	if(elementtype != EpochVariableType_Integer)
+		throw ExecutionException("Atomic operations are only supported on integer arrays");
+
+	if(index < 0 || index >= static_cast<Integer32>(numelements))
+		throw ExecutionException("Invalid array index");
+
+	Integer32* elements = reinterpret_cast<Integer32*>(arrayvar.GetConcurrentWritableStorage());
+	return ApplyAtomicUpdate(OpType, elements + index, operand, desired);
+}
+
+bool AtomicUpdateArray::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	Integer32 previous = Execute(context);
+	context.Stack.Push(IntegerVariable::GetStorageSize());
+	IntegerVariable(context.Stack.GetCurrentTopOfStack()).SetValue(previous);
+	return true;
+}
+
+void AtomicUpdateArray::ExecuteFast(ExecutionContext& context)
+{
+	Execute(context);
+}
+
+RValuePtr AtomicUpdateArray::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(Execute(context)));
+}
+
+Traverser::Payload AtomicUpdateArray::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetTargetPayload(ArrayName, GetNumParameters(*scope));
+}
+
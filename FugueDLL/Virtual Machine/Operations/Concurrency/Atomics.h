@@ -0,0 +1,156 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Atomic update operations for integers shared between tasks
+//
+// These operations let parallel for bodies and tasks update shared
+// counters and arrays of integers directly, rather than routing each
+// update through a message. Each operation reads, combines, and writes
+// its target as one indivisible step using the CPU's interlocked
+// instructions, and evaluates to the value the target held beforehand.
+// Since no update can be lost or torn, the validator permits these
+// operations to touch global variables from within tasks.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		//
+		// Atomic updates available
+		//
+		enum AtomicOpType
+		{
+			Atomic_Add,					// Add the operand to the target
+			Atomic_Min,					// Replace the target with the operand, if the operand is smaller
+			Atomic_Max,					// Replace the target with the operand, if the operand is larger
+			Atomic_CompareExchange		// Replace the target with the second operand, if the target equals the first
+		};
+
+
+		//
+		// Operation for atomically updating an integer variable
+		//
+		// Expects the operand on the stack; compare-exchange expects the
+		// comparand, and the replacement value above it.
+		//
+		class AtomicUpdate : public Operation, public SelfAware<AtomicUpdate>
+		{
+		// Construction
+		public:
+			AtomicUpdate(const std::wstring& varname, AtomicOpType optype)
+				: VarName(varname),
+				  OpType(optype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return (OpType == Atomic_CompareExchange) ? 2 : 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return VarName; }
+
+			AtomicOpType GetOperationType() const
+			{ return OpType; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal helpers
+		private:
+			Integer32 Execute(ExecutionContext& context);
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			AtomicOpType OpType;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for atomically updating an element of an integer array
+		//
+		// Expects the index of the element on the stack, followed by the
+		// operands as for AtomicUpdate.
+		//
+		class AtomicUpdateArray : public Operation, public SelfAware<AtomicUpdateArray>
+		{
+		// Construction
+		public:
+			AtomicUpdateArray(const std::wstring& arrayname, AtomicOpType optype)
+				: ArrayName(arrayname),
+				  OpType(optype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return (OpType == Atomic_CompareExchange) ? 3 : 2; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+			AtomicOpType GetOperationType() const
+			{ return OpType; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal helpers
+		private:
+			Integer32 Execute(ExecutionContext& context);
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			AtomicOpType OpType;
+			VariableSlot Slot;
+		};
+
+	}
+}
+
@@ -0,0 +1,119 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operations for passing values between tasks over channels
+//
+// Values travel between the stack of the sending task and the stack of
+// the receiving task as raw storage, so no r-values are created along the
+// way unless the caller asks for one.
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
+#include "Virtual Machine/Core Entities/Concurrency/Channel.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+
+#include "Virtual Machine/Routines.inl"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Virtual Machine/SelfAware.inl"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+	//
+	// Look up the channel whose handle is held at the given offset into the stack
+	//
+	Channel& GetChannelFromStack(ExecutionContext& context, size_t offset)
+	{
+		IntegerVariable handle(context.Stack.GetOffsetIntoStack(offset));
+		return context.RunningProgram.GetRuntime().Channels.GetChannel(handle.GetValue());
+	}
+}
+
+
+//
+// Create a channel, leaving its handle in place of the capacity on the stack
+//
+bool CreateChannel::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	IntegerVariable capacity(context.Stack.GetCurrentTopOfStack());
+	capacity.SetValue(context.RunningProgram.GetRuntime().Channels.CreateChannel(ElementType, capacity.GetValue()));
+	return true;
+}
+
+void CreateChannel::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndPushScalar(context);
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+}
+
+RValuePtr CreateChannel::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteAndPushScalar(context);
+	IntegerVariable handle(context.Stack.GetCurrentTopOfStack());
+	Integer32 ret = handle.GetValue();
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+	return RValuePtr(new IntegerRValue(ret));
+}
+
+
+//
+// Send the value on top of the stack over the channel beneath it
+//
+void SendChannel::ExecuteFast(ExecutionContext& context)
+{
+	size_t valuesize = TypeInfo::GetStorageSize(ElementType);
+	Channel& channel = GetChannelFromStack(context, valuesize);
+	if(channel.GetElementType() != ElementType)
+		throw ExecutionException("Value sent over a channel does not match the channel's element type");
+
+	channel.Send(context.Stack.GetCurrentTopOfStack());
+	context.Stack.Pop(valuesize + IntegerVariable::GetStorageSize());
+}
+
+RValuePtr SendChannel::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Receive a value from the channel on top of the stack, and push it in place of the handle
+//
+bool ReceiveChannel::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	Channel& channel = GetChannelFromStack(context, 0);
+	if(channel.GetElementType() != ElementType)
+		throw ExecutionException("Value received from a channel does not match the channel's element type");
+
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+	context.Stack.Push(TypeInfo::GetStorageSize(ElementType));
+	channel.Receive(context.Stack.GetCurrentTopOfStack());
+	return true;
+}
+
+void ReceiveChannel::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndPushScalar(context);
+	context.Stack.Pop(TypeInfo::GetStorageSize(ElementType));
+}
+
+RValuePtr ReceiveChannel::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteAndPushScalar(context);
+	RValuePtr ret(GetRValuePtrFromStorage(ElementType, context.Stack.GetCurrentTopOfStack()));
+	context.Stack.Pop(TypeInfo::GetStorageSize(ElementType));
+	return ret;
+}
+
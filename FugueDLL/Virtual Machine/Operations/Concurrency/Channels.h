@@ -0,0 +1,129 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operations for passing values between tasks over channels
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		//
+		// Operation for creating a new channel
+		//
+		// Expects the capacity of the channel on the stack, and produces
+		// the integer handle of the new channel.
+		//
+		class CreateChannel : public Operation, public SelfAware<CreateChannel>
+		{
+		// Construction
+		public:
+			explicit CreateChannel(EpochVariableTypeID elementtype)
+				: ElementType(elementtype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+		};
+
+		//
+		// Operation for sending a value over a channel
+		//
+		// Expects the channel handle on the stack, followed by the value to
+		// send; waits until the channel has room for the value.
+		//
+		class SendChannel : public Operation, public SelfAware<SendChannel>
+		{
+		// Construction
+		public:
+			explicit SendChannel(EpochVariableTypeID elementtype)
+				: ElementType(elementtype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+		};
+
+		//
+		// Operation for receiving a value from a channel
+		//
+		// Expects the channel handle on the stack, and produces the next
+		// value sent over the channel; waits until a value is available.
+		//
+		class ReceiveChannel : public Operation, public SelfAware<ReceiveChannel>
+		{
+		// Construction
+		public:
+			explicit ReceiveChannel(EpochVariableTypeID elementtype)
+				: ElementType(elementtype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return ElementType; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+		};
+
+	}
+}
+
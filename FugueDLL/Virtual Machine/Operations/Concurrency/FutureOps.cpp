@@ -19,6 +19,8 @@
 
 #include "Virtual Machine/Thread Pooling/WorkItems.h"
 
+#include "Virtual Machine/VMExceptions.h"
+
 #include "Utility/Threading/Threads.h"
 
 
@@ -30,6 +32,91 @@ using namespace VM::Operations;
 DWORD __stdcall ExecuteEpochFutureTask(void* info);
 
 
+namespace
+{
+
+	//
+	// Continuation which queues a work item on a thread pool
+	//
+	class PoolWorkItemContinuation : public FutureContinuation
+	{
+	public:
+		PoolWorkItemContinuation(std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname)
+			: WorkItem(workitem),
+			  RunningProgram(program),
+			  PoolName(poolname)
+		{ }
+
+		virtual void OnFutureComplete(Future& future)
+		{
+			RunningProgram.AddPoolWorkItem(PoolName, WorkItem);
+			delete this;
+		}
+
+	private:
+		std::auto_ptr<Threads::PoolWorkItem> WorkItem;
+		Program& RunningProgram;
+		std::wstring PoolName;
+	};
+
+	//
+	// Continuation which passes control on once all of a set of futures have completed
+	//
+	class WhenAllContinuation : public FutureContinuation
+	{
+	public:
+		WhenAllContinuation(size_t numfutures, FutureContinuation* next)
+			: NumOutstanding(static_cast<LONG>(numfutures)),
+			  Next(next)
+		{ }
+
+		virtual void OnFutureComplete(Future& future)
+		{
+			if(::InterlockedDecrement(&NumOutstanding) != 0)
+				return;
+
+			Next->OnFutureComplete(future);
+			delete this;
+		}
+
+	private:
+		volatile LONG NumOutstanding;
+		FutureContinuation* Next;
+	};
+
+	//
+	// Continuation which passes control on as soon as any of a set of futures completes
+	//
+	// The continuation remains registered with the other futures, so it
+	// can only be released once every one of them has completed as well.
+	//
+	class WhenAnyContinuation : public FutureContinuation
+	{
+	public:
+		WhenAnyContinuation(size_t numfutures, FutureContinuation* next)
+			: NumOutstanding(static_cast<LONG>(numfutures)),
+			  Fired(0),
+			  Next(next)
+		{ }
+
+		virtual void OnFutureComplete(Future& future)
+		{
+			if(::InterlockedCompareExchange(&Fired, 1, 0) == 0)
+				Next->OnFutureComplete(future);
+
+			if(::InterlockedDecrement(&NumOutstanding) == 0)
+				delete this;
+		}
+
+	private:
+		volatile LONG NumOutstanding;
+		volatile LONG Fired;
+		FutureContinuation* Next;
+	};
+
+}
+
+
 //
 // Fork a task that computes a future, and start execution of code in the new context
 //
@@ -46,7 +133,7 @@ void ForkFuture::ExecuteFast(ExecutionContext& context)
 		context.Stack.Pop(temp.GetStorageSize());
 
 		std::auto_ptr<Threads::PoolWorkItem> workitem(new FutureWorkItem(*future, context));
-		context.RunningProgram.AddPoolWorkItem(poolname, id.str(), workitem);
+		context.RunningProgram.AddPoolWorkItem(poolname, workitem);
 		return;
 	}
 
@@ -60,6 +147,96 @@ RValuePtr ForkFuture::ExecuteAndStoreRValue(ExecutionContext& context)
 }
 
 
+//
+// Fork the computation of a future once the futures it depends on have completed
+//
+void ForkDependentFuture::ExecuteFast(ExecutionContext& context)
+{
+	Future* future = context.Scope.GetFuture(VarName);
+
+	VM::StringVariable temp(context.Stack.GetCurrentTopOfStack());
+	std::wstring poolname = temp.GetValue();
+	context.Stack.Pop(temp.GetStorageSize());
+
+	std::vector<Future*> futures;
+	FutureWorkItem::InputList inputs;
+	for(std::vector<std::wstring>::const_iterator iter = FutureNames.begin(); iter != FutureNames.end(); ++iter)
+	{
+		Future* input = context.Scope.GetFuture(*iter);
+		futures.push_back(input);
+		inputs.push_back(std::make_pair(*iter, input));
+	}
+
+	std::auto_ptr<Threads::PoolWorkItem> workitem(new FutureWorkItem(*future, inputs, context));
+
+	if(futures.size() == 1)
+		ScheduleWhenComplete(*futures.front(), workitem, context.RunningProgram, poolname);
+	else if(WaitForAny)
+		ScheduleWhenAny(futures, workitem, context.RunningProgram, poolname);
+	else
+		ScheduleWhenAll(futures, workitem, context.RunningProgram, poolname);
+}
+
+RValuePtr ForkDependentFuture::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Request that the computation of a future stop
+//
+void CancelFuture::ExecuteFast(ExecutionContext& context)
+{
+	context.Scope.GetFuture(FutureName)->Cancel();
+}
+
+RValuePtr CancelFuture::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Queue a work item on the given pool once the future has completed
+//
+void VM::Operations::ScheduleWhenComplete(Future& future, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname)
+{
+	future.AddContinuation(new PoolWorkItemContinuation(workitem, program, poolname));
+}
+
+//
+// Queue a work item on the given pool once all of the futures have completed
+//
+void VM::Operations::ScheduleWhenAll(const std::vector<Future*>& futures, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname)
+{
+	if(futures.empty())
+	{
+		program.AddPoolWorkItem(poolname, workitem);
+		return;
+	}
+
+	WhenAllContinuation* continuation = new WhenAllContinuation(futures.size(), new PoolWorkItemContinuation(workitem, program, poolname));
+	for(std::vector<Future*>::const_iterator iter = futures.begin(); iter != futures.end(); ++iter)
+		(*iter)->AddContinuation(continuation);
+}
+
+//
+// Queue a work item on the given pool as soon as any of the futures has completed
+//
+void VM::Operations::ScheduleWhenAny(const std::vector<Future*>& futures, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname)
+{
+	if(futures.empty())
+		throw ExecutionException("Cannot wait for any one of an empty set of futures");
+
+	WhenAnyContinuation* continuation = new WhenAnyContinuation(futures.size(), new PoolWorkItemContinuation(workitem, program, poolname));
+	for(std::vector<Future*>::const_iterator iter = futures.begin(); iter != futures.end(); ++iter)
+		(*iter)->AddContinuation(continuation);
+}
+
+
 //
 // Entry point stub for executing implicit tasks assigned to futures
 //
@@ -71,6 +248,7 @@ DWORD __stdcall ExecuteEpochFutureTask(void* info)
 
 		Threads::ThreadInfo* threadinfo = reinterpret_cast<Threads::ThreadInfo*>(info);
 		Operation* op = threadinfo->OpPointer;
+		Future* future = threadinfo->BoundFuture;
 
 		StackSpace stack;
 
@@ -79,14 +257,22 @@ DWORD __stdcall ExecuteEpochFutureTask(void* info)
 		std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*descriptor));
 		newscope->TaskOrigin = threadinfo->TaskOrigin;
 		newscope->Enter(stack);
-		RValuePtr ret(op->ExecuteAndStoreRValue(ExecutionContext(*threadinfo->RunningProgram, *newscope, stack, flowresult))->Clone());
+
+		ExecutionContext context(*threadinfo->RunningProgram, *newscope, stack, flowresult);
+		context.Cancellation = &future->GetCancellationToken();
+
+		RValuePtr ret(op->ExecuteAndStoreRValue(context)->Clone());
 		newscope->Exit(stack);
 
-		threadinfo->BoundFuture->SetResult(ret);
+		future->SetResult(ret);
 
 		if(stack.GetAllocatedStack() != 0)
 			throw InternalFailureException("A stack space leak was detected when exiting an Epoch task.");
 	}
+	catch(TaskCancelledException&)
+	{
+		reinterpret_cast<Threads::ThreadInfo*>(info)->BoundFuture->SetCancelled();
+	}
 	catch(std::exception& ex)
 	{
 		::MessageBoxA(0, ex.what(), Strings::WindowTitle, MB_ICONERROR);
@@ -12,12 +12,34 @@
 #include "Virtual Machine/Core Entities/Operation.h"
 
 
+// Forward declarations
+namespace Threads { struct PoolWorkItem; }
+
+
 namespace VM
 {
 
+	// Forward declarations
+	class Future;
+	class Program;
+
+
 	namespace Operations
 	{
 
+		//
+		// Helpers for scheduling work on a thread pool once futures complete
+		//
+		// Rather than occupying a pool thread while it blocks on a future,
+		// dependent work is held back and only queued on the named pool once
+		// the futures it relies on have their values available. Work items
+		// given to these helpers are owned by the scheduler from then on.
+		//
+		void ScheduleWhenComplete(Future& future, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname);
+		void ScheduleWhenAll(const std::vector<Future*>& futures, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname);
+		void ScheduleWhenAny(const std::vector<Future*>& futures, std::auto_ptr<Threads::PoolWorkItem> workitem, Program& program, const std::wstring& poolname);
+
+
 		//
 		// Operation for forking a task that computes a future
 		//
@@ -55,6 +77,89 @@ namespace VM
 			bool UseThreadPool;
 		};
 
+
+		//
+		// Operation for forking a future whose computation depends on other futures
+		//
+		// The computation is held back until all of the named futures have
+		// completed (or any one of them, if WaitForAny is set), and is then
+		// queued on a thread pool. The expression can read each of the named
+		// futures; reading one which has not completed yet blocks as usual.
+		//
+		class ForkDependentFuture : public Operation, public SelfAware<ForkDependentFuture>
+		{
+		// Construction
+		public:
+			ForkDependentFuture(const std::wstring& varname, EpochVariableTypeID type, const std::vector<std::wstring>& futurenames, bool waitforany)
+				: Type(type),
+				  VarName(varname),
+				  FutureNames(futurenames),
+				  WaitForAny(waitforany)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return Type; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetType() const							{ return Type; }
+			const std::wstring& GetVarName() const						{ return VarName; }
+			const std::vector<std::wstring>& GetFutureNames() const		{ return FutureNames; }
+			bool WaitsForAny() const									{ return WaitForAny; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID Type;
+			const std::wstring& VarName;
+			std::vector<std::wstring> FutureNames;
+			bool WaitForAny;
+		};
+
+
+		//
+		// Operation for cancelling the computation of a future
+		//
+		// The computation stops the next time it enters a block; if it has
+		// not yet started, it never runs at all. Cancelling a future which
+		// has already completed has no effect.
+		//
+		class CancelFuture : public Operation, public SelfAware<CancelFuture>
+		{
+		// Construction
+		public:
+			CancelFuture(const std::wstring& futurename)
+				: FutureName(futurename)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetFutureName() const
+			{ return FutureName; }
+
+		// Internal tracking
+		private:
+			const std::wstring& FutureName;
+		};
+
 	}
 
 }
@@ -0,0 +1,168 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operations for creating and consuming generators
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Core Entities/Concurrency/Generator.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+
+#include "Virtual Machine/Routines.inl"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Virtual Machine/SelfAware.inl"
+
+#include "Validator/Validator.h"
+
+#include "Serialization/SerializationTraverser.h"
+
+#include "Optimizer/Optimizer.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+	//
+	// Look up the generator whose handle is on top of the stack, and pop the handle
+	//
+	Generator& PopGenerator(ExecutionContext& context)
+	{
+		IntegerVariable handle(context.Stack.GetCurrentTopOfStack());
+		Generator& generator = context.RunningProgram.GetRuntime().Generators.GetGenerator(handle.GetValue());
+		context.Stack.Pop(IntegerVariable::GetStorageSize());
+		return generator;
+	}
+}
+
+
+//
+// Construct and initialize a generator creation operation
+//
+// The operation takes ownership of the operations in the body.
+//
+CreateGenerator::CreateGenerator(EpochVariableTypeID elementtype, const Branch& body)
+	: ElementType(elementtype),
+	  Body(body)
+{
+}
+
+//
+// Destruct and clean up a generator creation operation
+//
+CreateGenerator::~CreateGenerator()
+{
+	for(Branch::iterator iter = Body.begin(); iter != Body.end(); ++iter)
+		delete *iter;
+}
+
+//
+// Create the generator, evaluating the parameters of its function call
+//
+// Parameters are evaluated in the caller's scope, but are pushed onto
+// the generator's stack, where the function call will find them once
+// the body starts running.
+//
+RValuePtr CreateGenerator::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	std::auto_ptr<Generator> generator(new Generator(context.RunningProgram, Body.back(), ElementType, context.Scope.TaskOrigin));
+
+	ExecutionContext paramcontext(context.RunningProgram, context.Scope, generator->GetStack(), context.FlowResult);
+	for(size_t i = 0; i + 1 < Body.size(); ++i)
+		Body[i]->ExecuteFast(paramcontext);
+
+	return RValuePtr(new IntegerRValue(context.RunningProgram.GetRuntime().Generators.AddGenerator(generator)));
+}
+
+void CreateGenerator::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+template <typename TraverserT>
+void CreateGenerator::TraverseHelper(TraverserT& traverser)
+{
+	traverser.TraverseNode(*this);
+	for(Branch::iterator iter = Body.begin(); iter != Body.end(); ++iter)
+		(*iter)->Traverse(traverser);
+}
+
+void CreateGenerator::Traverse(Validator::ValidationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void CreateGenerator::Traverse(Serialization::SerializationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void CreateGenerator::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+
+//
+// Hand the value on top of the stack to the consumer of the current generator
+//
+void YieldValue::ExecuteFast(ExecutionContext& context)
+{
+	Generator* generator = Generator::GetCurrent();
+	if(!generator)
+		throw ExecutionException("yield() can only be used within the body of a generator");
+
+	RValuePtr value(GetRValuePtrFromStorage(ValueType, context.Stack.GetCurrentTopOfStack()));
+	context.Stack.Pop(TypeInfo::GetStorageSize(ValueType));
+	generator->YieldValue(value.release());
+}
+
+RValuePtr YieldValue::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Determine if the generator on top of the stack has another value
+//
+void GeneratorHasNext::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr GeneratorHasNext::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	Generator& generator = PopGenerator(context);
+	return RValuePtr(new BooleanRValue(generator.HasNext(context.Stack)));
+}
+
+
+//
+// Retrieve the next value from the generator on top of the stack
+//
+void GeneratorNextValue::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr GeneratorNextValue::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	Generator& generator = PopGenerator(context);
+	if(generator.GetElementType() != ElementType)
+		throw ExecutionException("Value requested from a generator does not match the generator's element type");
+
+	return RValuePtr(generator.Next(context.Stack));
+}
+
@@ -0,0 +1,167 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operations for creating and consuming generators
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		//
+		// Operation for creating a new generator
+		//
+		// The operation holds the code which evaluates the generator's
+		// function call; the leading operations push the parameters of the
+		// call, and the final operation invokes the function. Parameters are
+		// pushed straight onto the stack of the new generator, while the
+		// call itself is left for the generator to run as its body. The
+		// result is the integer handle of the new generator.
+		//
+		class CreateGenerator : public Operation, public SelfAware<CreateGenerator>
+		{
+		// Handy type shortcuts
+		public:
+			typedef std::vector<Operation*> Branch;
+
+		// Construction and destruction
+		public:
+			CreateGenerator(EpochVariableTypeID elementtype, const Branch& body);
+			virtual ~CreateGenerator();
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+			const Branch& GetBody() const
+			{ return Body; }
+
+		// Traversal interface
+		protected:
+			template <typename TraverserT>
+			void TraverseHelper(TraverserT& traverser);
+
+			virtual void Traverse(Validator::ValidationTraverser& traverser);
+			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+			Branch Body;
+		};
+
+		//
+		// Operation for handing a value from a generator body to its consumer
+		//
+		// Expects the value on the stack; the body is suspended until the
+		// consumer asks for the next value.
+		//
+		class YieldValue : public Operation, public SelfAware<YieldValue>
+		{
+		// Construction
+		public:
+			explicit YieldValue(EpochVariableTypeID valuetype)
+				: ValueType(valuetype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetValueType() const
+			{ return ValueType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ValueType;
+		};
+
+		//
+		// Operation for determining if a generator has more values
+		//
+		// Expects the generator handle on the stack. The generator's body
+		// is run until it yields a value, if one is not already waiting.
+		//
+		class GeneratorHasNext : public Operation, public SelfAware<GeneratorHasNext>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+		};
+
+		//
+		// Operation for retrieving the next value from a generator
+		//
+		// Expects the generator handle on the stack; asking for a value
+		// after the sequence has ended is a runtime error.
+		//
+		class GeneratorNextValue : public Operation, public SelfAware<GeneratorNextValue>
+		{
+		// Construction
+		public:
+			explicit GeneratorNextValue(EpochVariableTypeID elementtype)
+				: ElementType(elementtype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return ElementType; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+		};
+
+	}
+}
+
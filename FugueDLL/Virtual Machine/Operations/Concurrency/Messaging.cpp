@@ -14,7 +14,11 @@
 #include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
+#include "Virtual Machine/Core Entities/Concurrency/MessageSignatures.h"
+#include "Virtual Machine/Core Entities/Concurrency/Future.h"
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
 #include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Program.h"
 #include "Virtual Machine/SelfAware.inl"
 
 #include "Virtual Machine/Routines.inl"
@@ -23,6 +27,8 @@
 
 #include "Utility/Threading/Threads.h"
 
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 using namespace VM::Operations;
@@ -31,13 +37,34 @@ using namespace VM::Operations;
 // Prototypes
 namespace
 {
-	void Dispatch(const std::vector<ResponseMapEntry*>& mapentries, ExecutionContext& context, HandleType taskorigin);
+	size_t GetPayloadSize(const std::list<EpochVariableTypeID>& payloadtypes);
+	HeapStorage* PackPayload(ExecutionContext& context, const std::list<EpochVariableTypeID>& payloadtypes, size_t payloadsize);
+	bool Dispatch(const ResponseMap& responses, ExecutionContext& context, HandleType taskorigin, DWORD timeoutms);
 }
 
 
+//
+// Construct and initialize a message sending operation
+//
+// The message signature and payload size are computed up front, so that
+// sending the message at runtime only needs to copy the payload values.
+//
+SendTaskMessage::SendTaskMessage(bool usestaskid, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
+	: MessageName(messagename),
+	  PayloadTypes(payloadtypes),
+	  Signature(MessageSignatures::Intern(messagename, payloadtypes)),
+	  PayloadSize(GetPayloadSize(payloadtypes)),
+	  UsesTaskID(usestaskid)
+{
+}
+
 //
 // Send a message to another task
 //
+// When remote messaging is enabled, a task name which is not known within
+// this program is looked up among the tasks exported by other processes;
+// see RemoteTasks.h. Local delivery never goes through any transport.
+//
 void SendTaskMessage::ExecuteFast(ExecutionContext& context)
 {
 	std::wstring targetname;
@@ -54,88 +81,205 @@ void SendTaskMessage::ExecuteFast(ExecutionContext& context)
 		TaskHandleVariable threadidvar(context.Stack.GetCurrentTopOfStack());
 		threadid = threadidvar.GetValue();
 		context.Stack.Pop(TaskHandleVariable::GetStorageSize());
-		targetname = Threads::GetThreadNameGivenID(threadid);
 	}
 
-	std::auto_ptr<HeapStorage> heapblock(new HeapStorage);
-	size_t neededstorage = 0;
-	for(std::list<EpochVariableTypeID>::const_iterator iter = PayloadTypes.begin(); iter != PayloadTypes.end(); ++iter)
-	{
-		if(*iter == EpochVariableType_Array)
-			neededstorage += sizeof(HandleType);
-		else
-			neededstorage += TypeInfo::GetStorageSize(*iter);
-	}
+	// The receiving task hands the block back to the pool once the message is processed
+	HeapStorage* heapblock = PackPayload(context, PayloadTypes, PayloadSize);
 
-	heapblock->Allocate(neededstorage);
-	void* storageptr = heapblock->GetStartOfStorage();
-	for(std::list<EpochVariableTypeID>::const_iterator iter = PayloadTypes.begin(); iter != PayloadTypes.end(); ++iter)
+	if(UsesTaskID && RemoteTaskTable::IsEnabled() && !Threads::IsTaskRegistered(targetname))
 	{
-		switch(*iter)
+		if(context.RunningProgram.GetRuntime().RemoteTasks.Send(&context.RunningProgram, targetname, MessageName, PayloadTypes, *heapblock))
 		{
-		case EpochVariableType_Integer:
-			{
-				IntegerVariable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<IntegerVariable::BaseStorage*>(storageptr) = var.GetValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + IntegerVariable::GetStorageSize();
-				context.Stack.Pop(IntegerVariable::GetStorageSize());
-			}
-			break;
+			HeapStorage::ReleasePooled(heapblock);
+			return;
+		}
+	}
 
-		case EpochVariableType_Integer16:
-			{
-				Integer16Variable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<Integer16Variable::BaseStorage*>(storageptr) = var.GetValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + Integer16Variable::GetStorageSize();
-				context.Stack.Pop(Integer16Variable::GetStorageSize());
-			}
-			break;
+	if(UsesTaskID)
+		Threads::SendEvent(targetname, Signature, heapblock);
+	else
+		Threads::SendEvent(threadid, Signature, heapblock);
+}
 
-		case EpochVariableType_Real:
-			{
-				RealVariable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<RealVariable::BaseStorage*>(storageptr) = var.GetValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + RealVariable::GetStorageSize();
-				context.Stack.Pop(RealVariable::GetStorageSize());
-			}
-			break;
+RValuePtr SendTaskMessage::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
 
-		case EpochVariableType_Boolean:
-			{
-				BooleanVariable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<BooleanVariable::BaseStorage*>(storageptr) = var.GetValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + BooleanVariable::GetStorageSize();
-				context.Stack.Pop(BooleanVariable::GetStorageSize());
-			}
-			break;
 
-		case EpochVariableType_String:
-			{
-				StringVariable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<StringVariable::BaseStorage*>(storageptr) = var.GetHandleValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + StringVariable::GetStorageSize();
-				context.Stack.Pop(StringVariable::GetStorageSize());
-			}
-			break;
+//
+// Construct and initialize a broadcast message operation
+//
+BroadcastTaskMessage::BroadcastTaskMessage(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
+	: MessageName(messagename),
+	  PayloadTypes(payloadtypes),
+	  Signature(MessageSignatures::Intern(messagename, payloadtypes)),
+	  PayloadSize(GetPayloadSize(payloadtypes))
+{
+}
 
-		case EpochVariableType_Array:
-			{
-				ArrayVariable var(context.Stack.GetCurrentTopOfStack());
-				*reinterpret_cast<ArrayVariable::BaseStorage*>(storageptr) = var.GetValue();
-				storageptr = reinterpret_cast<Byte*>(storageptr) + ArrayVariable::GetBaseStorageSize();
-				context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
-			}
-			break;
+//
+// Send a message to every task in a group
+//
+// The payload is packed once, and the same block is shared by all of the
+// receiving tasks; see Threads::BroadcastEvent.
+//
+void BroadcastTaskMessage::ExecuteFast(ExecutionContext& context)
+{
+	StringVariable temp(context.Stack.GetCurrentTopOfStack());
+	std::wstring groupname = temp.GetValue();
+	context.Stack.Pop(temp.GetStorageSize());
 
-		default:
-			throw NotImplementedException("Cannot pass this data type in a message payload");
-		}
+	HeapStorage* heapblock = PackPayload(context, PayloadTypes, PayloadSize);
+	Threads::BroadcastEvent(groupname, Signature, heapblock);
+}
+
+RValuePtr BroadcastTaskMessage::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Construct and initialize a delayed message sending operation
+//
+DelayedSendTaskMessage::DelayedSendTaskMessage(bool usestaskid, bool periodic, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
+	: MessageName(messagename),
+	  PayloadTypes(payloadtypes),
+	  Signature(MessageSignatures::Intern(messagename, payloadtypes)),
+	  PayloadSize(GetPayloadSize(payloadtypes)),
+	  UsesTaskID(usestaskid),
+	  Periodic(periodic)
+{
+}
+
+//
+// Hand a message to the timer service, to be sent to another task once the delay passes
+//
+// The target is on top of the stack, followed by the payload, with the
+// delay (or period) beneath them both. Delayed messages only ever go to
+// tasks of this program; they are not relayed to remote tasks.
+//
+void DelayedSendTaskMessage::ExecuteFast(ExecutionContext& context)
+{
+	std::wstring targetname;
+	TaskHandle threadid = 0;
+
+	if(UsesTaskID)
+	{
+		StringVariable temp(context.Stack.GetCurrentTopOfStack());
+		targetname = temp.GetValue();
+		context.Stack.Pop(temp.GetStorageSize());
+	}
+	else
+	{
+		TaskHandleVariable threadidvar(context.Stack.GetCurrentTopOfStack());
+		threadid = threadidvar.GetValue();
+		context.Stack.Pop(TaskHandleVariable::GetStorageSize());
+	}
+
+	HeapStorage* heapblock = PackPayload(context, PayloadTypes, PayloadSize);
+
+	IntegerVariable delayvar(context.Stack.GetCurrentTopOfStack());
+	Integer32 delay = delayvar.GetValue();
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+
+	if(delay < 0 || (Periodic && delay == 0))
+	{
+		HeapStorage::ReleasePooled(heapblock);
+		throw ExecutionException(Periodic ? "The period of a repeating message must be a positive number of milliseconds" : "Cannot send a message with a negative delay");
 	}
 
-	Threads::SendEvent(targetname, MessageName, PayloadTypes, heapblock.release());
+	DWORD periodms = Periodic ? static_cast<DWORD>(delay) : 0;
+
+	if(UsesTaskID)
+		Threads::SendDelayedEvent(targetname, Signature, heapblock, static_cast<DWORD>(delay), periodms);
+	else
+		Threads::SendDelayedEvent(threadid, Signature, heapblock, static_cast<DWORD>(delay), periodms);
 }
 
-RValuePtr SendTaskMessage::ExecuteAndStoreRValue(ExecutionContext& context)
+RValuePtr DelayedSendTaskMessage::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Construct and initialize a request sending operation
+//
+SendTaskRequest::SendTaskRequest(const std::wstring& futurename, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
+	: FutureName(futurename),
+	  MessageName(messagename),
+	  PayloadTypes(payloadtypes),
+	  Signature(MessageSignatures::Intern(messagename, payloadtypes)),
+	  PayloadSize(GetPayloadSize(payloadtypes))
+{
+}
+
+//
+// Send a request to another task, to be answered through a future
+//
+// Futures are single-use, so a future which already holds a reply
+// cannot be used for another request.
+//
+void SendTaskRequest::ExecuteFast(ExecutionContext& context)
+{
+	StringVariable temp(context.Stack.GetCurrentTopOfStack());
+	std::wstring targetname = temp.GetValue();
+	context.Stack.Pop(temp.GetStorageSize());
+
+	Future* future = context.Scope.GetFuture(FutureName);
+	if(future->IsComplete())
+		throw ExecutionException("This future already holds the reply to an earlier request");
+
+	HeapStorage* heapblock = PackPayload(context, PayloadTypes, PayloadSize);
+	Threads::SendRequest(targetname, Signature, heapblock, future);
+}
+
+RValuePtr SendTaskRequest::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Answer the request being handled, by storing the reply in the requesting task's future
+//
+void ReplyToRequest::ExecuteFast(ExecutionContext& context)
+{
+	RValuePtr value(GetRValuePtrFromStorage(Type, context.Stack.GetCurrentTopOfStack()));
+	context.Stack.Pop(TypeInfo::GetStorageSize(Type));
+
+	Future* future = context.Scope.TakePendingReply();
+	if(!future)
+		throw ExecutionException("There is no request awaiting a reply; was the request already answered?");
+
+	if(future->GetType(context.Scope.GetOriginalDescription()) != Type)
+		throw ExecutionException("Reply does not match the type expected by the requesting task");
+
+	future->SetResult(value);
+}
+
+RValuePtr ReplyToRequest::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
+//
+// Placeholders for replies are never executed directly
+//
+void PendingReply::ExecuteFast(ExecutionContext& context)
+{
+	throw InternalFailureException("Attempted to compute the value of a future which is filled in by a reply");
+}
+
+RValuePtr PendingReply::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	ExecuteFast(context);
 	return RValuePtr(new NullRValue);
@@ -153,6 +297,9 @@ AcceptMessage::AcceptMessage(const std::wstring& messagename, Block* theblock, S
 		payloadtypes.push_back(helperscope->GetVariableType(*iter));
 
 	ResponseEntry = new ResponseMapEntry(messagename, payloadtypes, theblock, helperscope);
+
+	Responses = new ResponseMap;
+	Responses->AddEntry(ResponseEntry);
 }
 
 
@@ -161,21 +308,18 @@ AcceptMessage::AcceptMessage(const std::wstring& messagename, Block* theblock, S
 //
 AcceptMessage::~AcceptMessage()
 {
-	delete ResponseEntry;
+	delete Responses;
 }
 
 //
 // Accept an incoming message from another task, matching a specific signature
 //
-// Note that this blocks until a matching message is received. Also note that
-// while this operation is active, any non-recognized messages will be ignored.
+// Note that this blocks until a matching message is received. Any other
+// messages remain queued for later acceptance operations.
 //
 void AcceptMessage::ExecuteFast(ExecutionContext& context)
 {
-	std::vector<ResponseMapEntry*> vec;
-	vec.push_back(ResponseEntry);
-
-	Dispatch(vec, context, context.Scope.TaskOrigin);
+	Dispatch(*Responses, context, context.Scope.TaskOrigin, INFINITE);
 }
 
 RValuePtr AcceptMessage::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -202,6 +346,11 @@ void AcceptMessage::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void AcceptMessage::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 const std::wstring& AcceptMessage::GetMessageName() const
 {
 	return ResponseEntry->GetMessageName();
@@ -217,15 +366,12 @@ const std::list<VM::EpochVariableTypeID>& AcceptMessage::GetPayloadTypes() const
 // Wait for a message that matches one of several patterns in a response map.
 //
 // Note that this operation blocks until a matching message is located.
-// Also note that while this operation is active, non-matched messages
-// will be ignored entirely.
+// Any other messages remain queued for later acceptance operations.
 //
 void AcceptMessageFromResponseMap::ExecuteFast(ExecutionContext& context)
 {
 	const ResponseMap& themap = context.Scope.GetOriginalDescription().GetResponseMap(MapName);
-	const std::vector<ResponseMapEntry*>& mapentries = themap.GetEntries();
-
-	Dispatch(mapentries, context, context.Scope.TaskOrigin);
+	Dispatch(themap, context, context.Scope.TaskOrigin, INFINITE);
 }
 
 RValuePtr AcceptMessageFromResponseMap::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -254,6 +400,62 @@ void AcceptMessageFromResponseMap::Traverse(Serialization::SerializationTraverse
 	TraverseHelper(traverser);
 }
 
+void AcceptMessageFromResponseMap::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+
+//
+// Wait for a message that matches one of several patterns in a response map,
+// for no longer than the number of milliseconds on top of the stack
+//
+// Messages which arrive after the timeout are left queued, just as with
+// any other message which is not accepted.
+//
+void AcceptMessageWithTimeout::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr AcceptMessageWithTimeout::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	IntegerVariable timeoutvar(context.Stack.GetCurrentTopOfStack());
+	Integer32 timeout = timeoutvar.GetValue();
+	context.Stack.Pop(IntegerVariable::GetStorageSize());
+
+	if(timeout < 0)
+		throw ExecutionException("Cannot wait for a message for a negative amount of time");
+
+	const ResponseMap& themap = context.Scope.GetOriginalDescription().GetResponseMap(MapName);
+	return RValuePtr(new BooleanRValue(Dispatch(themap, context, context.Scope.TaskOrigin, static_cast<DWORD>(timeout))));
+}
+
+template <typename TraverserT>
+void AcceptMessageWithTimeout::TraverseHelper(TraverserT& traverser)
+{
+	traverser.TraverseNode(*this);
+
+	const std::vector<ResponseMapEntry*>& mapentries = traverser.GetCurrentScope()->GetResponseMap(MapName).GetEntries();
+	for(std::vector<ResponseMapEntry*>::const_iterator iter = mapentries.begin(); iter != mapentries.end(); ++iter)
+		(*iter)->GetResponseBlock()->Traverse(traverser);
+}
+
+void AcceptMessageWithTimeout::Traverse(Validator::ValidationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void AcceptMessageWithTimeout::Traverse(Serialization::SerializationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void AcceptMessageWithTimeout::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 //
 // Retrieve the ID of the task which forked this task
 //
@@ -288,111 +490,149 @@ namespace
 {
 
 	//
-	// Wait for an incoming message from another task, and then act on it as needed
-	//
-	// This function blocks until a message is matched and accepted. Any messages which
-	// are not matched are discarded immediately.
+	// Determine how much storage the payload of a message with the given types requires
 	//
-	void Dispatch(const std::vector<ResponseMapEntry*>& mapentries, ExecutionContext& context, HandleType taskorigin)
+	size_t GetPayloadSize(const std::list<EpochVariableTypeID>& payloadtypes)
 	{
-		while(true)
+		size_t payloadsize = 0;
+		for(std::list<EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
 		{
-			// We use an artificial scope here to ensure that the auto_ptr destructs on time
-			{
-				std::auto_ptr<Threads::MessageInfo> msginfo(Threads::WaitForEvent());
-				if(!msginfo.get())
-					continue;
+			if(*iter == EpochVariableType_Array)
+				payloadsize += sizeof(HandleType);
+			else
+				payloadsize += TypeInfo::GetStorageSize(*iter);
+		}
 
-				bool messagerecognized = false;
-				Block* messageblock = NULL;
+		return payloadsize;
+	}
 
-				for(std::vector<ResponseMapEntry*>::const_iterator iter = mapentries.begin(); iter != mapentries.end(); ++iter)
+	//
+	// Move the payload values of a message off the stack and into a pooled storage block
+	//
+	// Only handles are copied for arrays and buffers. Arrays pushed in the
+	// usual way have already been marked as shared, so neither task can see
+	// the other's writes; arrays and buffers handed over with move() belong
+	// to the receiver alone, which can then use them without any copying.
+	// The parser ensures that buffers are always moved, since they have no
+	// copy-on-write protection of their own.
+	//
+	HeapStorage* PackPayload(ExecutionContext& context, const std::list<EpochVariableTypeID>& payloadtypes, size_t payloadsize)
+	{
+		std::auto_ptr<HeapStorage> heapblock(HeapStorage::AcquirePooled(payloadsize));
+		void* storageptr = heapblock->GetStartOfStorage();
+		for(std::list<EpochVariableTypeID>::const_iterator iter = payloadtypes.begin(); iter != payloadtypes.end(); ++iter)
+		{
+			switch(*iter)
+			{
+			case EpochVariableType_Integer:
 				{
-					const ResponseMapEntry& mapentry = **iter;
-
-					if(msginfo->MessageName != mapentry.GetMessageName())
-						continue;
-
-					bool ignore = false;
-
-					const std::list<EpochVariableTypeID>& payloadtypes = mapentry.GetPayloadTypes();
-
-					if(payloadtypes.size() != msginfo->PayloadTypes.size())
-						continue;
-
-					std::list<EpochVariableTypeID>::const_iterator msginfoiter = msginfo->PayloadTypes.begin();
-					for(std::list<EpochVariableTypeID>::const_iterator payloaditer = payloadtypes.begin(); payloaditer != payloadtypes.end(); ++payloaditer)
-					{
-						if(*payloaditer != *msginfoiter)
-						{
-							ignore = true;
-							break;
-						}
-
-						++msginfoiter;
-					}
-
-					if(ignore)
-						continue;
-
-					messagerecognized = true;
-					messageblock = mapentry.GetResponseBlock();
-					break;
+					IntegerVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<IntegerVariable::BaseStorage*>(storageptr) = var.GetValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + IntegerVariable::GetStorageSize();
+					context.Stack.Pop(IntegerVariable::GetStorageSize());
 				}
+				break;
 
-				if(!messagerecognized)
-					continue;
-
-				void* heapptr = msginfo->StorageBlock->GetStartOfStorage();
-				for(std::list<EpochVariableTypeID>::const_iterator storageiter = msginfo->PayloadTypes.begin(); storageiter != msginfo->PayloadTypes.end(); ++storageiter)
+			case EpochVariableType_Integer16:
 				{
-					switch(*storageiter)
-					{
-					case EpochVariableType_Integer:
-						PushValueOntoStack<TypeInfo::IntegerT>(context.Stack, *reinterpret_cast<IntegerVariable::BaseStorage*>(heapptr));
-						break;
-
-					case EpochVariableType_Integer16:
-						PushValueOntoStack<TypeInfo::Integer16T>(context.Stack, *reinterpret_cast<Integer16Variable::BaseStorage*>(heapptr));
-						break;
-
-					case EpochVariableType_Real:
-						PushValueOntoStack<TypeInfo::RealT>(context.Stack, *reinterpret_cast<RealVariable::BaseStorage*>(heapptr));
-						break;
-
-					case EpochVariableType_Boolean:
-						PushValueOntoStack<TypeInfo::BooleanT>(context.Stack, *reinterpret_cast<BooleanVariable::BaseStorage*>(heapptr));
-						break;
-
-					case EpochVariableType_String:
-						PushValueOntoStack<TypeInfo::StringT>(context.Stack, *reinterpret_cast<StringVariable::BaseStorage*>(heapptr));
-						break;
-
-					case EpochVariableType_Array:
-						PushValueOntoStack<TypeInfo::ArrayT>(context.Stack, *reinterpret_cast<ArrayVariable::BaseStorage*>(heapptr));
-						break;
+					Integer16Variable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<Integer16Variable::BaseStorage*>(storageptr) = var.GetValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + Integer16Variable::GetStorageSize();
+					context.Stack.Pop(Integer16Variable::GetStorageSize());
+				}
+				break;
 
-					default:
-						throw NotImplementedException("Cannot process message payload of this type");
-					}
+			case EpochVariableType_Real:
+				{
+					RealVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<RealVariable::BaseStorage*>(storageptr) = var.GetValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + RealVariable::GetStorageSize();
+					context.Stack.Pop(RealVariable::GetStorageSize());
+				}
+				break;
 
-					heapptr = reinterpret_cast<Byte*>(heapptr) + TypeInfo::GetStorageSize(*storageiter);
+			case EpochVariableType_Boolean:
+				{
+					BooleanVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<BooleanVariable::BaseStorage*>(storageptr) = var.GetValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + BooleanVariable::GetStorageSize();
+					context.Stack.Pop(BooleanVariable::GetStorageSize());
 				}
+				break;
 
-				std::auto_ptr<ActivatedScope> newparamscope(new ActivatedScope(*messageblock->GetBoundScope()->ParentScope));
-				newparamscope->ParentScope = &context.Scope;
-				newparamscope->BindToStack(context.Stack);
+			case EpochVariableType_String:
+				{
+					StringVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<StringVariable::BaseStorage*>(storageptr) = var.GetHandleValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + StringVariable::GetStorageSize();
+					context.Stack.Pop(StringVariable::GetStorageSize());
+				}
+				break;
 
-				std::auto_ptr<ActivatedScope> newcodescope(new ActivatedScope(*messageblock->GetBoundScope()));
-				newcodescope->ParentScope = newparamscope.get();
-				newcodescope->LastMessageOrigin = msginfo->Origin;
-				newcodescope->TaskOrigin = taskorigin;
-				messageblock->ExecuteBlock(ExecutionContext(context.RunningProgram, *newcodescope, context.Stack, context.FlowResult), NULL);
+			case EpochVariableType_Array:
+				{
+					ArrayVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<ArrayVariable::BaseStorage*>(storageptr) = var.GetValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + ArrayVariable::GetBaseStorageSize();
+					context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
+				}
+				break;
 
-				newparamscope->Exit(context.Stack);
+			case EpochVariableType_Buffer:
+				{
+					BufferVariable var(context.Stack.GetCurrentTopOfStack());
+					*reinterpret_cast<BufferVariable::BaseStorage*>(storageptr) = var.GetHandleValue();
+					storageptr = reinterpret_cast<Byte*>(storageptr) + BufferVariable::GetStorageSize();
+					context.Stack.Pop(BufferVariable::GetStorageSize());
+				}
 				break;
+
+			default:
+				throw NotImplementedException("Cannot pass this data type in a message payload");
 			}
 		}
+
+		return heapblock.release();
+	}
+
+	//
+	// Wait for an incoming message from another task, and then act on it as needed
+	//
+	// This function blocks until a message is matched and accepted, or the timeout
+	// passes, in which case false is returned. Only messages with signatures handled by
+	// the response map are retrieved from the mailbox; any other messages are kept
+	// waiting there until a receive which handles them comes along.
+	//
+	bool Dispatch(const ResponseMap& responses, ExecutionContext& context, HandleType taskorigin, DWORD timeoutms)
+	{
+		std::auto_ptr<Threads::MessageInfo> msginfo(Threads::WaitForEvent(responses.GetSignatures(), timeoutms));
+		if(!msginfo.get())
+			return false;
+
+		// Only matching messages are ever handed back, so a miss here is a bug
+		const ResponseMapEntry* mapentry = responses.FindEntry(msginfo->Signature);
+		if(!mapentry)
+			throw InternalFailureException("Received a message which the response map cannot handle");
+
+		Block* messageblock = mapentry->GetResponseBlock();
+
+		// The payload was packed in the same order that pushing it back onto
+		// the stack would produce, so the parameter scope is bound directly
+		// to the message's storage block instead; the block stays alive until
+		// the handler has finished with it.
+		ResponseMapEntry::ParameterScopeLease paramlease(*mapentry, context.Scope);
+		paramlease.GetScope().BindToMachineStack(msginfo->StorageBlock->GetStartOfStorage());
+
+		Block::ScopeLease codelease(*messageblock, paramlease.GetScope());
+		ActivatedScope& codescope = codelease.GetScope();
+		codescope.LastMessageOrigin = msginfo->Origin;
+		codescope.PendingReply = msginfo->ReplySlot;
+		codescope.TaskOrigin = taskorigin;
+		messageblock->ExecuteBlock(ExecutionContext(context, codescope), NULL);
+		codescope.Exit(context.Stack);
+
+		paramlease.GetScope().ExitFromMachineStack();
+		return true;
 	}
 
 }
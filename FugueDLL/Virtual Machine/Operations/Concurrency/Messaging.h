@@ -17,6 +17,7 @@ namespace VM
 
 	// Forward declarations
 	class Block;
+	class ResponseMap;
 	class ResponseMapEntry;
 
 
@@ -30,11 +31,7 @@ namespace VM
 		{
 		// Construction
 		public:
-			SendTaskMessage(bool usestaskid, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes)
-				: MessageName(messagename),
-				  PayloadTypes(payloadtypes),
-				  UsesTaskID(usestaskid)
-			{ }
+			SendTaskMessage(bool usestaskid, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes);
 
 		// Operation interface
 		public:
@@ -57,9 +54,193 @@ namespace VM
 		private:
 			const std::wstring& MessageName;
 			std::list<EpochVariableTypeID> PayloadTypes;
+			MessageSignatureID Signature;
+			size_t PayloadSize;
 			bool UsesTaskID;
 		};
 
+		//
+		// Operation for sending a single message to every task in a group
+		//
+		class BroadcastTaskMessage : public Operation, public SelfAware<BroadcastTaskMessage>
+		{
+		// Construction
+		public:
+			BroadcastTaskMessage(const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes);
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetMessageName() const							{ return MessageName; }
+			const std::list<EpochVariableTypeID>& GetPayloadTypes() const		{ return PayloadTypes; }
+
+		// Internal tracking
+		private:
+			const std::wstring& MessageName;
+			std::list<EpochVariableTypeID> PayloadTypes;
+			MessageSignatureID Signature;
+			size_t PayloadSize;
+		};
+
+		//
+		// Operation for sending a message to another task after a delay
+		//
+		// Periodic messages are sent again at the same interval for as long
+		// as the receiving task keeps running. Delivery is carried out by the
+		// timer service, so the sender does not wait for the delay to pass.
+		//
+		class DelayedSendTaskMessage : public Operation, public SelfAware<DelayedSendTaskMessage>
+		{
+		// Construction
+		public:
+			DelayedSendTaskMessage(bool usestaskid, bool periodic, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes);
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 3; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetMessageName() const							{ return MessageName; }
+			const std::list<EpochVariableTypeID>& GetPayloadTypes() const		{ return PayloadTypes; }
+			bool DoesUseTaskID() const											{ return UsesTaskID; }
+			bool IsPeriodic() const												{ return Periodic; }
+
+		// Internal tracking
+		private:
+			const std::wstring& MessageName;
+			std::list<EpochVariableTypeID> PayloadTypes;
+			MessageSignatureID Signature;
+			size_t PayloadSize;
+			bool UsesTaskID;
+			bool Periodic;
+		};
+
+
+		//
+		// Operation for sending a request to another task
+		//
+		// The request carries the named future along with the message; the
+		// receiving task answers by filling the future in directly (see the
+		// ReplyToRequest operation below), so the sender carries on running
+		// and only waits if it reads the future before the reply is in.
+		//
+		class SendTaskRequest : public Operation, public SelfAware<SendTaskRequest>
+		{
+		// Construction
+		public:
+			SendTaskRequest(const std::wstring& futurename, const std::wstring& messagename, const std::list<EpochVariableTypeID>& payloadtypes);
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetFutureName() const							{ return FutureName; }
+			const std::wstring& GetMessageName() const							{ return MessageName; }
+			const std::list<EpochVariableTypeID>& GetPayloadTypes() const		{ return PayloadTypes; }
+
+		// Internal tracking
+		private:
+			const std::wstring& FutureName;
+			const std::wstring& MessageName;
+			std::list<EpochVariableTypeID> PayloadTypes;
+			MessageSignatureID Signature;
+			size_t PayloadSize;
+		};
+
+		//
+		// Operation for answering the request currently being handled
+		//
+		class ReplyToRequest : public Operation, public SelfAware<ReplyToRequest>
+		{
+		// Construction
+		public:
+			explicit ReplyToRequest(EpochVariableTypeID type)
+				: Type(type)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetReplyType() const
+			{ return Type; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID Type;
+		};
+
+		//
+		// Placeholder bound to futures which are filled in by replies to requests
+		//
+		// The placeholder only records the type of the expected reply; it
+		// is never executed, since the value comes from the responding task.
+		//
+		class PendingReply : public Operation, public SelfAware<PendingReply>
+		{
+		// Construction
+		public:
+			explicit PendingReply(EpochVariableTypeID type)
+				: Type(type)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return Type; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Additional queries
+		public:
+			EpochVariableTypeID GetReplyType() const
+			{ return Type; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID Type;
+		};
+
 
 		//
 		// Operation for accepting a single incoming message
@@ -94,9 +275,11 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
+			VM::ResponseMap* Responses;
 			VM::ResponseMapEntry* ResponseEntry;
 		};
 
@@ -130,6 +313,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
 			{
@@ -145,6 +329,54 @@ namespace VM
 			const std::wstring& MapName;
 		};
 
+		//
+		// Operation for accepting a message from a response map, giving up after a timeout
+		//
+		// The result indicates whether or not a message was accepted before
+		// the given number of milliseconds passed.
+		//
+		class AcceptMessageWithTimeout : public Operation, public SelfAware<AcceptMessageWithTimeout>
+		{
+		// Construction
+		public:
+			AcceptMessageWithTimeout(const std::wstring& mapname)
+				: MapName(mapname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Traversal interface
+		protected:
+			template <typename TraverserT>
+			void TraverseHelper(TraverserT& traverser);
+
+			virtual void Traverse(Validator::ValidationTraverser& traverser);
+			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
+
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+			{
+				Traverser::Payload payload;
+				payload.SetValue(MapName.c_str());
+				payload.IsIdentifier = true;
+				payload.ParameterCount = GetNumParameters(*scope);
+				return payload;
+			}
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+		};
+
 
 		//
 		// Operation for looking up which task forked the current task
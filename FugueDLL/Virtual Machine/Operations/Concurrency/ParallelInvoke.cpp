@@ -0,0 +1,185 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operation for running several independent calls side by side
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Types/Tuple.h"
+#include "Virtual Machine/Core Entities/Variables/TupleVariable.h"
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/Thread Pooling/WorkItems.h"
+#include "Virtual Machine/SelfAware.inl"
+
+#include "Validator/Validator.h"
+
+#include "Serialization/SerializationTraverser.h"
+
+#include "Optimizer/Optimizer.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+//
+// Construct and initialize a parallel invoke operation
+//
+// The operation takes ownership of the operations in each branch.
+//
+ParallelInvoke::ParallelInvoke(const std::wstring& tuplename, const BranchList& branches)
+	: TupleName(tuplename),
+	  Branches(branches),
+	  ParallelSafety(ParallelSafety_Unknown)
+{
+}
+
+//
+// Destruct and clean up a parallel invoke operation
+//
+ParallelInvoke::~ParallelInvoke()
+{
+	for(BranchList::iterator iter = Branches.begin(); iter != Branches.end(); ++iter)
+	{
+		for(Branch::iterator opiter = iter->begin(); opiter != iter->end(); ++opiter)
+			delete *opiter;
+	}
+}
+
+//
+// Run each branch and store the results into the target tuple
+//
+// Branches which cannot safely run within a task are instead run one
+// after another on the calling thread, in order.
+//
+void ParallelInvoke::ExecuteFast(ExecutionContext& context)
+{
+	// Results are held outside of any variable until every branch
+	// has finished, so collection must be held off until then.
+	GarbageCollector::Deferral deferral;
+
+	const ScopeDescription& description = context.Scope.GetOriginalDescription();
+	const std::vector<std::wstring>& members = description.GetTupleType(description.GetVariableTupleTypeID(TupleName)).GetMemberOrder();
+	TupleVariable& tuple = context.Scope.GetVariableRef<TupleVariable>(TupleName);
+
+	if(Branches.size() <= 1 || !CanRunInParallel(context.RunningProgram))
+	{
+		for(size_t i = 0; i < Branches.size(); ++i)
+			tuple.WriteMember(members[i], ExecuteBranch(context, i), false);
+		return;
+	}
+
+	ParallelArrayJob job(context, EpochVariableType_Error, NULL, Branches.size(), static_cast<unsigned>(Branches.size()));
+
+	Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+	for(size_t i = 1; i < Branches.size(); ++i)
+		pool.AddWorkItem(new ParallelInvokeWorkItem(*this, job, i));
+
+	// The other branches refer to the job, so a failure here must
+	// still wait for all of them before being passed on
+	try
+	{
+		job.Results[0] = ExecuteBranch(context, 0).release();
+	}
+	catch(std::exception& ex)
+	{
+		job.RecordFailure(ex.what());
+	}
+
+	job.CompleteChunk();
+	job.WaitForChunks();
+
+	for(size_t i = 0; i < Branches.size(); ++i)
+	{
+		RValuePtr result(job.Results[i]);
+		job.Results[i] = NULL;
+		tuple.WriteMember(members[i], result, false);
+	}
+}
+
+RValuePtr ParallelInvoke::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+//
+// Evaluate a single branch, and return its result
+//
+// The leading operations of the branch push the parameters for its
+// final operation, which produces the result.
+//
+RValuePtr ParallelInvoke::ExecuteBranch(ExecutionContext& context, size_t index)
+{
+	const Branch& branch = Branches[index];
+	for(size_t i = 0; i + 1 < branch.size(); ++i)
+		branch[i]->ExecuteFast(context);
+
+	return branch.back()->ExecuteAndStoreRValue(context);
+}
+
+//
+// Determine if the branches can be run at the same time
+//
+// As with parallel maps, each branch must be a call to a user-defined
+// function which passes the validator's task safety checks. The result
+// is cached since the checks involve full traversals of the functions.
+//
+bool ParallelInvoke::CanRunInParallel(Program& program)
+{
+	if(ParallelSafety == ParallelSafety_Unknown)
+	{
+		ParallelSafety = ParallelSafety_Safe;
+		for(BranchList::const_iterator iter = Branches.begin(); iter != Branches.end(); ++iter)
+		{
+			Invoke* invokeop = dynamic_cast<Invoke*>(iter->back());
+			Function* function = invokeop ? dynamic_cast<Function*>(invokeop->GetFunction()) : NULL;
+
+			if(!function || !Validator::IsTaskSafe(program, *function))
+			{
+				ParallelSafety = ParallelSafety_Unsafe;
+				break;
+			}
+		}
+	}
+
+	return (ParallelSafety == ParallelSafety_Safe);
+}
+
+
+template <typename TraverserT>
+void ParallelInvoke::TraverseHelper(TraverserT& traverser)
+{
+	traverser.TraverseNode(*this);
+	for(BranchList::iterator iter = Branches.begin(); iter != Branches.end(); ++iter)
+	{
+		for(Branch::iterator opiter = iter->begin(); opiter != iter->end(); ++opiter)
+			(*opiter)->Traverse(traverser);
+	}
+}
+
+void ParallelInvoke::Traverse(Validator::ValidationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void ParallelInvoke::Traverse(Serialization::SerializationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+void ParallelInvoke::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
@@ -0,0 +1,97 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Operation for running several independent calls side by side
+//
+// Each branch of a parallel invoke is the sequence of operations which
+// evaluates one expression; its final operation produces the value of
+// the branch, and the operations before it push that operation's
+// parameters. The branches are handed to the shared worker pool, with
+// the calling thread running the first branch itself and then helping
+// with whatever else is pending until every branch has finished. The
+// results are stored, in order, into the members of a tuple variable.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Program;
+
+
+	namespace Operations
+	{
+
+		class ParallelInvoke : public Operation, public SelfAware<ParallelInvoke>
+		{
+		// Handy type shortcuts
+		public:
+			typedef std::vector<Operation*> Branch;
+			typedef std::vector<Branch> BranchList;
+
+		// Construction and destruction
+		public:
+			ParallelInvoke(const std::wstring& tuplename, const BranchList& branches);
+			virtual ~ParallelInvoke();
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Branch execution
+		public:
+			RValuePtr ExecuteBranch(ExecutionContext& context, size_t index);
+
+			bool CanRunInParallel(Program& program);
+
+		// Queries
+		public:
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return TupleName; }
+
+			const BranchList& GetBranches() const
+			{ return Branches; }
+
+		// Traversal interface
+		protected:
+			template <typename TraverserT>
+			void TraverseHelper(TraverserT& traverser);
+
+			virtual void Traverse(Validator::ValidationTraverser& traverser);
+			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
+
+		// Internal tracking
+		private:
+			const std::wstring& TupleName;
+			BranchList Branches;
+
+			enum ParallelSafetyState
+			{
+				ParallelSafety_Unknown,
+				ParallelSafety_Safe,
+				ParallelSafety_Unsafe
+			};
+
+			ParallelSafetyState ParallelSafety;
+		};
+
+	}
+
+}
+
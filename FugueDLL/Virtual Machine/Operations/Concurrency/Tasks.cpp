@@ -10,6 +10,7 @@
 #include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
+#include "Virtual Machine/Core Entities/Concurrency/RemoteTasks.h"
 #include "Virtual Machine/Core Entities/Program.h"
 
 #include "Virtual Machine/Operations/Concurrency/Tasks.h"
@@ -31,6 +32,10 @@
 
 #include "Serialization/SerializationTraverser.h"
 
+#include "Optimizer/Optimizer.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 using namespace VM::Operations;
@@ -51,12 +56,25 @@ ForkTask::~ForkTask()
 //
 // Fork a task and start execution in the new context
 //
+// When green tasks are enabled, the task is run by the shared worker
+// pool instead of getting a thread of its own. When remote messaging is
+// enabled, the task is exported under its name before it starts, so that
+// other processes can send messages to it; the task itself always runs
+// in this process.
+//
 void ForkTask::ExecuteFast(ExecutionContext& context)
 {
 	StringVariable temp(context.Stack.GetCurrentTopOfStack());
 	std::wstring taskname = temp.GetValue();
 	context.Stack.Pop(temp.GetStorageSize());
-	Threads::Create(taskname, ExecuteEpochTask, CodeBlock, &context.RunningProgram);
+
+	if(RemoteTaskTable::IsEnabled())
+		context.RunningProgram.GetRuntime().RemoteTasks.ExportTask(taskname, &context.RunningProgram);
+
+	if(Config::UseGreenTasks)
+		Threads::CreateGreenTask(taskname, ExecuteEpochTask, CodeBlock, &context.RunningProgram, context.RunningProgram.GetSharedThreadPool());
+	else
+		Threads::Create(taskname, ExecuteEpochTask, CodeBlock, &context.RunningProgram);
 }
 
 RValuePtr ForkTask::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -85,6 +103,11 @@ void ForkTask::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void ForkTask::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 //
 // Destruct and clean up a thread forking operation
@@ -143,6 +166,11 @@ void ForkThread::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void ForkThread::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 void CreateThreadPool::ExecuteFast(ExecutionContext& context)
 {
@@ -171,6 +199,29 @@ RValuePtr CreateThreadPool::ExecuteAndStoreRValue(ExecutionContext& context)
 }
 
 
+//
+// Discard the work items still waiting in a thread pool
+//
+void CancelPoolWork::ExecuteFast(ExecutionContext& context)
+{
+	std::wstring poolname;
+
+	{
+		StringVariable temp(context.Stack.GetCurrentTopOfStack());
+		poolname = temp.GetValue();
+		context.Stack.Pop(temp.GetStorageSize());
+	}
+
+	context.RunningProgram.CancelPoolWorkItems(poolname);
+}
+
+RValuePtr CancelPoolWork::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+
 //
 // Entry point stub for forked Epoch task threads
 //
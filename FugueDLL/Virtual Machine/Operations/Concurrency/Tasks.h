@@ -53,6 +53,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -91,6 +92,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -116,6 +118,26 @@ namespace VM
 			{ return 2; }
 		};
 
+
+		//
+		// Operation for discarding the work still queued in a pool of worker threads
+		//
+		// Work items which are already running are not affected.
+		//
+		class CancelPoolWork : public Operation, public SelfAware<CancelPoolWork>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+		};
+
 	}
 
 }
@@ -0,0 +1,391 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Native sorting and searching operations for arrays
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/Thread Pooling/WorkItems.h"
+#include "Virtual Machine/SelfAware.inl"
+#include "Virtual Machine/Routines.inl"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Ordering of string array elements, which are stored as handles
+	//
+	struct StringHandleLess
+	{
+		bool operator () (HandleType lhs, HandleType rhs) const
+		{ return StringVariable::GetByHandle(lhs) < StringVariable::GetByHandle(rhs); }
+	};
+
+	//
+	// String element paired with its contents, so that sorting does
+	// not have to look up the contents of each string repeatedly
+	//
+	struct StringSortKey
+	{
+		const std::wstring* Value;
+		HandleType Handle;
+	};
+
+	struct StringSortKeyLess
+	{
+		bool operator () (const StringSortKey& lhs, const StringSortKey& rhs) const
+		{ return *lhs.Value < *rhs.Value; }
+	};
+
+
+	//
+	// Sorter for a contiguous buffer of elements of a single type
+	//
+	template <typename T, typename LessT>
+	class BufferSorter : public ArraySorter
+	{
+	public:
+		BufferSorter(T* elements)
+			: Elements(elements)
+		{ }
+
+		virtual void SortRun(size_t first, size_t last)
+		{ std::sort(Elements + first, Elements + last, LessT()); }
+
+		virtual void MergeRuns(size_t first, size_t middle, size_t last)
+		{ std::inplace_merge(Elements + first, Elements + middle, Elements + last, LessT()); }
+
+	private:
+		T* Elements;
+	};
+
+
+	//
+	// Determine if an array is large enough to be worth sorting in parallel
+	//
+	bool ShouldSplitSort(size_t count)
+	{
+		if(!Config::ParallelSortThreshold)
+			return false;
+
+		return (count >= Config::ParallelSortThreshold);
+	}
+
+	//
+	// Sort a buffer of elements, splitting the work across the shared
+	// worker pool if the buffer is large enough
+	//
+	// The buffer is divided into one run per pool thread, and each run is
+	// sorted independently. Runs are then merged in pairs; each round of
+	// merging halves the number of runs, with an odd run left over being
+	// carried into the next round untouched.
+	//
+	template <typename T, typename LessT>
+	void SortElements(ExecutionContext& context, EpochVariableTypeID elementtype, T* elements, size_t count)
+	{
+		BufferSorter<T, LessT> sorter(elements);
+
+		Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+		size_t numruns = pool.GetNumThreads();
+		if(numruns > count)
+			numruns = count;
+
+		if(!ShouldSplitSort(count) || numruns < 2)
+		{
+			sorter.SortRun(0, count);
+			return;
+		}
+
+		std::vector<size_t> bounds;
+		for(size_t i = 0; i <= numruns; ++i)
+			bounds.push_back((count * i) / numruns);
+
+		{
+			ParallelArrayJob job(context, elementtype, elements, 0, static_cast<unsigned>(numruns));
+			for(size_t i = 0; i < numruns; ++i)
+				pool.AddWorkItem(new SortRunWorkItem(sorter, job, bounds[i], bounds[i + 1]), Threads::WorkPriority_Batch);
+			job.WaitForChunks();
+		}
+
+		while(bounds.size() > 2)
+		{
+			std::vector<size_t> mergedbounds;
+
+			ParallelArrayJob job(context, elementtype, elements, 0, static_cast<unsigned>((bounds.size() - 1) / 2));
+			for(size_t i = 0; i + 2 < bounds.size(); i += 2)
+			{
+				pool.AddWorkItem(new MergeRunsWorkItem(sorter, job, bounds[i], bounds[i + 1], bounds[i + 2]), Threads::WorkPriority_Batch);
+				mergedbounds.push_back(bounds[i]);
+			}
+
+			if(bounds.size() % 2 == 0)
+				mergedbounds.push_back(bounds[bounds.size() - 2]);
+			mergedbounds.push_back(bounds.back());
+
+			job.WaitForChunks();
+			bounds.swap(mergedbounds);
+		}
+	}
+
+	//
+	// Sort a buffer of string handles
+	//
+	// The contents of each string are looked up once, up front; the
+	// handles are then written back out in sorted order.
+	//
+	void SortStrings(ExecutionContext& context, HandleType* handles, size_t count)
+	{
+		std::vector<StringSortKey> keys(count);
+		for(size_t i = 0; i < count; ++i)
+		{
+			keys[i].Value = &StringVariable::GetByHandle(handles[i]);
+			keys[i].Handle = handles[i];
+		}
+
+		SortElements<StringSortKey, StringSortKeyLess>(context, EpochVariableType_String, &keys[0], count);
+
+		for(size_t i = 0; i < count; ++i)
+			handles[i] = keys[i].Handle;
+	}
+
+
+	//
+	// Find a value in a sorted buffer of elements; returns -1 if not present
+	//
+	template <typename T, typename LessT>
+	Integer32 SearchElements(const T* elements, size_t count, T value)
+	{
+		LessT less;
+		const T* found = std::lower_bound(elements, elements + count, value, less);
+		if(found == elements + count || less(value, *found))
+			return -1;
+
+		return static_cast<Integer32>(found - elements);
+	}
+
+	//
+	// Find the index of the first smallest (or largest) element of a buffer
+	//
+	template <typename T, typename LessT>
+	Integer32 FindExtremeElement(const T* elements, size_t count, bool findlargest)
+	{
+		LessT less;
+		size_t best = 0;
+		for(size_t i = 1; i < count; ++i)
+		{
+			if(findlargest ? less(elements[best], elements[i]) : less(elements[i], elements[best]))
+				best = i;
+		}
+
+		return static_cast<Integer32>(best);
+	}
+
+	//
+	// Shared logic for finding the smallest or largest element of an array
+	//
+	Integer32 FindExtremeIndex(const ArrayVariable& arrayvar, bool findlargest)
+	{
+		EpochVariableTypeID elementtype;
+		size_t count;
+		const void* storage = arrayvar.GetArrayInfo(elementtype, count);
+
+		if(!count)
+			throw ExecutionException(findlargest ? "Cannot find the largest element of an empty array" : "Cannot find the smallest element of an empty array");
+
+		switch(elementtype)
+		{
+		case EpochVariableType_Integer:
+			return FindExtremeElement<Integer32, std::less<Integer32> >(reinterpret_cast<const Integer32*>(storage), count, findlargest);
+
+		case EpochVariableType_Integer16:
+			return FindExtremeElement<Integer16, std::less<Integer16> >(reinterpret_cast<const Integer16*>(storage), count, findlargest);
+
+		case EpochVariableType_Real:
+			return FindExtremeElement<Real, std::less<Real> >(reinterpret_cast<const Real*>(storage), count, findlargest);
+
+		case EpochVariableType_String:
+			return FindExtremeElement<HandleType, StringHandleLess>(reinterpret_cast<const HandleType*>(storage), count, findlargest);
+		}
+
+		throw NotImplementedException("Cannot search arrays of this type, support not implemented");
+	}
+
+	//
+	// Build a traversal payload naming the array accessed by an operation
+	//
+	Traverser::Payload GetArrayPayload(const std::wstring& arrayname, size_t numparams)
+	{
+		Traverser::Payload payload;
+		payload.SetValue(arrayname.c_str());
+		payload.IsIdentifier = true;
+		payload.ParameterCount = numparams;
+		return payload;
+	}
+
+}
+
+
+//
+// Sort the elements of the array in place
+//
+// Sorting counts as a write, so an array which is shared with other
+// holders is given a private copy first.
+//
+void SortArray::ExecuteFast(ExecutionContext& context)
+{
+	// Elements are moved around in the array's pooled storage while
+	// the sort runs, so collection must be held off until done
+	GarbageCollector::Deferral deferral;
+
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID elementtype;
+	size_t count;
+	arrayvar.GetArrayInfo(elementtype, count);
+	if(count < 2)
+		return;
+
+	void* storage = arrayvar.GetWritableStorage();
+
+	switch(elementtype)
+	{
+	case EpochVariableType_Integer:
+		SortElements<Integer32, std::less<Integer32> >(context, elementtype, reinterpret_cast<Integer32*>(storage), count);
+		break;
+
+	case EpochVariableType_Integer16:
+		SortElements<Integer16, std::less<Integer16> >(context, elementtype, reinterpret_cast<Integer16*>(storage), count);
+		break;
+
+	case EpochVariableType_Real:
+		SortElements<Real, std::less<Real> >(context, elementtype, reinterpret_cast<Real*>(storage), count);
+		break;
+
+	case EpochVariableType_String:
+		SortStrings(context, reinterpret_cast<HandleType*>(storage), count);
+		break;
+
+	default:
+		throw NotImplementedException("Cannot sort arrays of this type, support not implemented");
+	}
+}
+
+RValuePtr SortArray::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue());
+}
+
+Traverser::Payload SortArray::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetArrayPayload(ArrayName, GetNumParameters(*scope));
+}
+
+
+//
+// Pop a value off the stack and look for it in the array
+//
+void SearchArray::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr SearchArray::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	const ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID elementtype;
+	size_t count;
+	const void* storage = arrayvar.GetArrayInfo(elementtype, count);
+
+	Integer32 index;
+	switch(elementtype)
+	{
+	case EpochVariableType_Integer:
+		index = SearchElements<Integer32, std::less<Integer32> >(reinterpret_cast<const Integer32*>(storage), count, IntegerVariable(context.Stack.GetCurrentTopOfStack()).GetValue());
+		context.Stack.Pop(IntegerVariable::GetStorageSize());
+		break;
+
+	case EpochVariableType_Integer16:
+		index = SearchElements<Integer16, std::less<Integer16> >(reinterpret_cast<const Integer16*>(storage), count, Integer16Variable(context.Stack.GetCurrentTopOfStack()).GetValue());
+		context.Stack.Pop(Integer16Variable::GetStorageSize());
+		break;
+
+	case EpochVariableType_Real:
+		index = SearchElements<Real, std::less<Real> >(reinterpret_cast<const Real*>(storage), count, RealVariable(context.Stack.GetCurrentTopOfStack()).GetValue());
+		context.Stack.Pop(RealVariable::GetStorageSize());
+		break;
+
+	case EpochVariableType_String:
+		index = SearchElements<HandleType, StringHandleLess>(reinterpret_cast<const HandleType*>(storage), count, StringVariable(context.Stack.GetCurrentTopOfStack()).GetHandleValue());
+		context.Stack.Pop(StringVariable::GetStorageSize());
+		break;
+
+	default:
+		throw NotImplementedException("Cannot search arrays of this type, support not implemented");
+	}
+
+	return RValuePtr(new IntegerRValue(index));
+}
+
+Traverser::Payload SearchArray::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetArrayPayload(ArrayName, GetNumParameters(*scope));
+}
+
+
+//
+// Find the index of the smallest element of the array
+//
+void ArrayMinIndex::ExecuteFast(ExecutionContext& context)
+{
+	// Nothing to do.
+}
+
+RValuePtr ArrayMinIndex::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(FindExtremeIndex(context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName), false)));
+}
+
+Traverser::Payload ArrayMinIndex::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetArrayPayload(ArrayName, GetNumParameters(*scope));
+}
+
+
+//
+// Find the index of the largest element of the array
+//
+void ArrayMaxIndex::ExecuteFast(ExecutionContext& context)
+{
+	// Nothing to do.
+}
+
+RValuePtr ArrayMaxIndex::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(FindExtremeIndex(context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName), true)));
+}
+
+Traverser::Payload ArrayMaxIndex::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetArrayPayload(ArrayName, GetNumParameters(*scope));
+}
+
@@ -0,0 +1,234 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Native sorting and searching operations for arrays
+//
+// These operations work directly on the pooled storage of an array,
+// rather than going through readarray() and writearray() one element
+// at a time. Arrays of integers, 16-bit integers, reals, and strings
+// are supported; strings are ordered by a plain comparison of their
+// characters.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+
+
+namespace VM
+{
+
+	namespace Operations
+	{
+
+		//
+		// Interface for sorting the elements of an array in pieces
+		//
+		// Large arrays are sorted as independent runs on the shared worker
+		// pool; neighbouring runs are then merged pairwise, again on the
+		// pool, until a single sorted run remains.
+		//
+		class ArraySorter
+		{
+		public:
+			virtual ~ArraySorter()
+			{ }
+
+			virtual void SortRun(size_t first, size_t last) = 0;
+			virtual void MergeRuns(size_t first, size_t middle, size_t last) = 0;
+		};
+
+
+		//
+		// Operation for sorting an array into ascending order, in place
+		//
+		class SortArray : public Operation, public SelfAware<SortArray>
+		{
+		// Construction
+		public:
+			SortArray(const std::wstring& arrayname)
+				: ArrayName(arrayname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for finding a value in a sorted array
+		//
+		// The result is the index of a matching element, or -1 if the
+		// value is not present. The array must already be in ascending
+		// order (see SortArray); otherwise the result is meaningless.
+		//
+		class SearchArray : public Operation, public SelfAware<SearchArray>
+		{
+		// Construction
+		public:
+			SearchArray(const std::wstring& arrayname)
+				: ArrayName(arrayname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for finding the index of the smallest element of an array
+		//
+		// If several elements share the smallest value, the first of
+		// them is chosen.
+		//
+		class ArrayMinIndex : public Operation, public SelfAware<ArrayMinIndex>
+		{
+		// Construction
+		public:
+			ArrayMinIndex(const std::wstring& arrayname)
+				: ArrayName(arrayname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for finding the index of the largest element of an array
+		//
+		// If several elements share the largest value, the first of
+		// them is chosen.
+		//
+		class ArrayMaxIndex : public Operation, public SelfAware<ArrayMaxIndex>
+		{
+		// Construction
+		public:
+			ArrayMaxIndex(const std::wstring& arrayname)
+				: ArrayName(arrayname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			VariableSlot Slot;
+		};
+
+	}
+
+}
+
@@ -22,6 +22,75 @@ using namespace VM;
 using namespace VM::Operations;
 
 
+namespace
+{
+
+	//
+	// Retrieve an array index from the top of the stack and validate it
+	//
+	Integer32 PopArrayIndex(StackSpace& stack, size_t numelements)
+	{
+		IntegerVariable::BaseStorage index = IntegerVariable(stack.GetCurrentTopOfStack()).GetValue();
+		stack.Pop(IntegerVariable::GetStorageSize());
+
+		if(index < 0 || index >= static_cast<Integer32>(numelements))
+			throw ExecutionException("Invalid array index");
+
+		return index;
+	}
+
+	//
+	// Copy a scalar array element directly onto the stack
+	//
+	template <class VarType>
+	void PushArrayElement(StackSpace& stack, Byte* storage, Integer32 index)
+	{
+		typename VarType::BaseStorage value = VarType(storage + VarType::GetStorageSize() * index).GetValue();
+		stack.Push(VarType::GetStorageSize());
+		VarType(stack.GetCurrentTopOfStack()).SetValue(value);
+	}
+
+	//
+	// Pop a scalar value off the stack directly into an array element
+	//
+	template <class VarType>
+	void WriteArrayElement(StackSpace& stack, ArrayVariable& arrayvar, size_t numelements)
+	{
+		typename VarType::BaseStorage value = VarType(stack.GetCurrentTopOfStack()).GetValue();
+		stack.Pop(VarType::GetStorageSize());
+
+		Integer32 index = PopArrayIndex(stack, numelements);
+
+		Byte* storage = reinterpret_cast<Byte*>(arrayvar.GetWritableStorage());
+		VarType(storage + VarType::GetStorageSize() * index).SetValue(value);
+	}
+
+	//
+	// Copy an element of a file-backed array directly onto the stack
+	//
+	void PushMappedArrayElement(StackSpace& stack, MappedArrayStorage& mapped, Integer32 index)
+	{
+		stack.Push(mapped.GetElementSize());
+		mapped.ReadElement(index, stack.GetCurrentTopOfStack());
+	}
+
+	//
+	// Pop a value off the stack directly into an element of a file-backed array
+	//
+	void WriteMappedArrayElement(StackSpace& stack, MappedArrayStorage& mapped)
+	{
+		// File-backed arrays only hold scalars, which fit in a real's storage
+		RealVariable::BaseStorage value;
+		memcpy(&value, stack.GetCurrentTopOfStack(), mapped.GetElementSize());
+		stack.Pop(mapped.GetElementSize());
+
+		Integer32 index = PopArrayIndex(stack, mapped.GetNumElements());
+		mapped.WriteElement(index, &value);
+	}
+
+}
+
+
 //
 // Construct an array of the given element type with the given number of entries
 //
@@ -208,7 +277,7 @@ void ConsArrayIndirect::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	if(TheOp)
-		dynamic_cast<SelfAwareBase*>(TheOp)->Traverse(traverser);
+		TheOp->Traverse(traverser);
 }
 
 void ConsArrayIndirect::Traverse(Validator::ValidationTraverser& traverser)
@@ -221,6 +290,29 @@ void ConsArrayIndirect::Traverse(Serialization::SerializationTraverser& traverse
 	TraverseHelper(traverser);
 }
 
+void ConsArrayIndirect::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+
+
+//
+// Open the file named on top of the stack as a file-backed array
+//
+void ConsMappedArray::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr ConsMappedArray::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	std::wstring filename = StringVariable(context.Stack.GetCurrentTopOfStack()).GetValue();
+	context.Stack.Pop(StringVariable::GetStorageSize());
+
+	return RValuePtr(new ArrayRValue(ArrayVariable::AllocateMappedHandle(filename, ElementType), false));
+}
+
 
 
 //
@@ -238,17 +330,22 @@ void ReadArray::ExecuteFast(ExecutionContext& context)
 
 RValuePtr ReadArray::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	IntegerVariable indexvar(context.Stack.GetCurrentTopOfStack());
-	IntegerVariable::BaseStorage index = indexvar.GetValue();
-	context.Stack.Pop(IntegerVariable::GetStorageSize());
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
 
-	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(ArrayName);
+	EpochVariableTypeID entrytype;
+	size_t numelements;
+	MappedArrayStorage* mapped;
+	void* storage = arrayvar.GetArrayInfo(entrytype, numelements, mapped);
 
-	void* storage = ArrayVariable::GetArrayStorage(arrayvar.GetValue());
-	EpochVariableTypeID entrytype = arrayvar.GetElementType();
+	Integer32 index = PopArrayIndex(context.Stack, numelements);
 
-	if(index < 0 || index >= static_cast<Integer32>(arrayvar.GetNumElements()))
-		throw ExecutionException("Invalid array index");
+	// File-backed arrays only hold scalars, which fit in a real's storage
+	if(mapped)
+	{
+		RealVariable::BaseStorage element;
+		mapped->ReadElement(index, &element);
+		return GetRValuePtrFromStorage(entrytype, &element);
+	}
 
 	size_t stride = TypeInfo::GetStorageSize(entrytype);
 	void* target = reinterpret_cast<char*>(storage) + (stride * index);
@@ -256,6 +353,35 @@ RValuePtr ReadArray::ExecuteAndStoreRValue(ExecutionContext& context)
 	return GetRValuePtrFromStorage(entrytype, target);
 }
 
+//
+// Push scalar array elements directly, without going through an r-value
+//
+bool ReadArray::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID entrytype;
+	size_t numelements;
+	MappedArrayStorage* mapped;
+	Byte* storage = reinterpret_cast<Byte*>(arrayvar.GetArrayInfo(entrytype, numelements, mapped));
+
+	if(mapped)
+	{
+		PushMappedArrayElement(context.Stack, *mapped, PopArrayIndex(context.Stack, numelements));
+		return true;
+	}
+
+	switch(entrytype)
+	{
+	case EpochVariableType_Integer:		PushArrayElement<IntegerVariable>(context.Stack, storage, PopArrayIndex(context.Stack, numelements));		return true;
+	case EpochVariableType_Integer16:	PushArrayElement<Integer16Variable>(context.Stack, storage, PopArrayIndex(context.Stack, numelements));	return true;
+	case EpochVariableType_Real:		PushArrayElement<RealVariable>(context.Stack, storage, PopArrayIndex(context.Stack, numelements));		return true;
+	case EpochVariableType_Boolean:		PushArrayElement<BooleanVariable>(context.Stack, storage, PopArrayIndex(context.Stack, numelements));		return true;
+	}
+
+	return false;
+}
+
 EpochVariableTypeID ReadArray::GetType(const ScopeDescription& scope) const
 {
 	return scope.GetArrayType(ArrayName);
@@ -278,15 +404,31 @@ WriteArray::WriteArray(const std::wstring& arrayname)
 
 void WriteArray::ExecuteFast(ExecutionContext& context)
 {
-	RValuePtr writevalue(NULL);
-	EpochVariableTypeID entrytype = context.Scope.GetVariableRef<ArrayVariable>(ArrayName).GetElementType();
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID entrytype;
+	size_t numelements;
+	MappedArrayStorage* mapped;
+	arrayvar.GetArrayInfo(entrytype, numelements, mapped);
 
+	if(mapped)
+	{
+		WriteMappedArrayElement(context.Stack, *mapped);
+		return;
+	}
+
+	// Scalar elements are written straight from the stack
+	switch(entrytype)
+	{
+	case EpochVariableType_Integer:		WriteArrayElement<IntegerVariable>(context.Stack, arrayvar, numelements);		return;
+	case EpochVariableType_Integer16:	WriteArrayElement<Integer16Variable>(context.Stack, arrayvar, numelements);	return;
+	case EpochVariableType_Real:		WriteArrayElement<RealVariable>(context.Stack, arrayvar, numelements);			return;
+	case EpochVariableType_Boolean:		WriteArrayElement<BooleanVariable>(context.Stack, arrayvar, numelements);		return;
+	}
+
+	RValuePtr writevalue(NULL);
 	switch(entrytype)
 	{
-	case EpochVariableType_Integer:		writevalue = IntegerVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
-	case EpochVariableType_Integer16:	writevalue = Integer16Variable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
-	case EpochVariableType_Real:		writevalue = RealVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();			break;
-	case EpochVariableType_Boolean:		writevalue = BooleanVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
 	case EpochVariableType_String:		writevalue = StringVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
 	case EpochVariableType_Function:	writevalue = FunctionBinding(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
 	case EpochVariableType_Address:		writevalue = AddressVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
@@ -298,15 +440,9 @@ void WriteArray::ExecuteFast(ExecutionContext& context)
 
 	context.Stack.Pop(TypeInfo::GetStorageSize(entrytype));
 
-	IntegerVariable indexvar(context.Stack.GetCurrentTopOfStack());
-	IntegerVariable::BaseStorage index = indexvar.GetValue();
-	context.Stack.Pop(IntegerVariable::GetStorageSize());
-
-	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(ArrayName);
-	void* storage = ArrayVariable::GetArrayStorage(arrayvar.GetValue());
+	Integer32 index = PopArrayIndex(context.Stack, numelements);
 
-	if(index < 0 || index >= static_cast<Integer32>(arrayvar.GetNumElements()))
-		throw ExecutionException("Invalid array index");
+	void* storage = arrayvar.GetWritableStorage();
 
 	size_t stride = TypeInfo::GetStorageSize(entrytype);
 	void* target = reinterpret_cast<char*>(storage) + (stride * index);
@@ -330,6 +466,61 @@ Traverser::Payload WriteArray::GetNodeTraversalPayload(const VM::ScopeDescriptio
 }
 
 
+//
+// Append the value on top of the stack to the end of an array
+//
+void AppendArray::ExecuteFast(ExecutionContext& context)
+{
+	ArrayVariable& arrayvar = context.Scope.GetVariableRef<ArrayVariable>(Slot, ArrayName);
+
+	EpochVariableTypeID entrytype = arrayvar.GetElementType();
+	size_t stride = TypeInfo::GetStorageSize(entrytype);
+
+	// Scalar elements are copied straight from the stack
+	switch(entrytype)
+	{
+	case EpochVariableType_Integer:
+	case EpochVariableType_Integer16:
+	case EpochVariableType_Real:
+	case EpochVariableType_Boolean:
+		arrayvar.Append(context.Stack.GetCurrentTopOfStack(), stride);
+		context.Stack.Pop(stride);
+		return;
+	}
+
+	RValuePtr appendvalue(NULL);
+	switch(entrytype)
+	{
+	case EpochVariableType_String:		appendvalue = StringVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
+	case EpochVariableType_Function:	appendvalue = FunctionBinding(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
+	case EpochVariableType_Address:		appendvalue = AddressVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
+	case EpochVariableType_Buffer:		appendvalue = BufferVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();		break;
+	case EpochVariableType_TaskHandle:	appendvalue = TaskHandleVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();	break;
+	default:
+		throw NotImplementedException("Cannot append array member of this type, support not implemented");
+	}
+
+	context.Stack.Pop(stride);
+
+	WriteRValueToStorage(appendvalue, arrayvar.Append(NULL, stride));
+}
+
+RValuePtr AppendArray::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue());
+}
+
+Traverser::Payload AppendArray::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload payload;
+	payload.SetValue(ArrayName.c_str());
+	payload.IsIdentifier = true;
+	payload.ParameterCount = GetNumParameters(*scope);
+	return payload;
+}
+
+
 void ArrayLength::ExecuteFast(ExecutionContext& context)
 {
 	// Nothing to do.
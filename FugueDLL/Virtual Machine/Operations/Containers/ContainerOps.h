@@ -10,6 +10,7 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 
 namespace VM
@@ -94,6 +95,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Queries
 		public:
@@ -107,6 +109,43 @@ namespace VM
 		};
 
 
+		//
+		// Operation for opening a file as an array of scalar elements
+		//
+		// The name of the file is taken from the stack. The elements are
+		// never loaded in full, so the file may be larger than memory; see
+		// MappedArrayStorage.h for details.
+		//
+		class ConsMappedArray : public Operation, public SelfAware<ConsMappedArray>
+		{
+		// Construction
+		public:
+			ConsMappedArray(EpochVariableTypeID elementtype)
+				: ElementType(elementtype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Array; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Queries
+		public:
+			EpochVariableTypeID GetElementType() const
+			{ return ElementType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID ElementType;
+		};
+
+
 		//
 		// Operation for retrieving a value from an array
 		//
@@ -120,6 +159,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const;
 
@@ -129,6 +169,14 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return ArrayName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -136,6 +184,7 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& ArrayName;
+			VariableSlot Slot;
 		};
 
 
@@ -162,6 +211,58 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return ArrayName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& ArrayName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for appending a value to the end of an array
+		//
+		class AppendArray : public Operation, public SelfAware<AppendArray>
+		{
+		// Construction
+		public:
+			AppendArray(const std::wstring& arrayname)
+				: ArrayName(arrayname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return VM::EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return ArrayName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -169,6 +270,7 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& ArrayName;
+			VariableSlot Slot;
 		};
 
 
@@ -0,0 +1,234 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Virtual machine operations for working with hash map containers
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/SelfAware.inl"
+#include "Virtual Machine/Routines.inl"
+#include "Virtual Machine/VMExceptions.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Retrieve a hash map key from the top of the stack
+	//
+	HashMapKey PopHashMapKey(StackSpace& stack, EpochVariableTypeID keytype)
+	{
+		switch(keytype)
+		{
+		case EpochVariableType_Integer:
+			{
+				HashMapKey key(IntegerVariable(stack.GetCurrentTopOfStack()).GetValue());
+				stack.Pop(IntegerVariable::GetStorageSize());
+				return key;
+			}
+
+		case EpochVariableType_String:
+			{
+				HashMapKey key(StringVariable(stack.GetCurrentTopOfStack()).GetValue());
+				stack.Pop(StringVariable::GetStorageSize());
+				return key;
+			}
+		}
+
+		throw NotImplementedException("Hash map keys of this type are not supported");
+	}
+
+	//
+	// Build a traversal payload naming the map accessed by an operation
+	//
+	Traverser::Payload GetMapPayload(const std::wstring& mapname, size_t numparams)
+	{
+		Traverser::Payload payload;
+		payload.SetValue(mapname.c_str());
+		payload.IsIdentifier = true;
+		payload.ParameterCount = numparams;
+		return payload;
+	}
+
+}
+
+
+//
+// Allocate a new, empty map and hand it back as an r-value
+//
+void ConsHashMap::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr ConsHashMap::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new HashMapRValue(HashMapVariable::AllocateNewHandle(KeyType, ValueType)));
+}
+
+
+//
+// Pop a key and value off the stack and store them in the map;
+// the value is on top of the stack, with the key beneath it
+//
+void HashMapInsert::ExecuteFast(ExecutionContext& context)
+{
+	HashMapVariable& mapvar = context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName);
+
+	EpochVariableTypeID valuetype = mapvar.GetValueType();
+	RValuePtr value(GetRValuePtrFromStorage(valuetype, context.Stack.GetCurrentTopOfStack()));
+	context.Stack.Pop(TypeInfo::GetStorageSize(valuetype));
+
+	HashMapKey key = PopHashMapKey(context.Stack, mapvar.GetKeyType());
+	mapvar.Insert(key, value);
+}
+
+RValuePtr HashMapInsert::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue());
+}
+
+Traverser::Payload HashMapInsert::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetMapPayload(MapName, GetNumParameters(*scope));
+}
+
+
+//
+// Retrieve the value stored under the key on top of the stack;
+// looking up a key which is not present is a runtime error
+//
+void HashMapLookup::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr HashMapLookup::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	const HashMapVariable& mapvar = context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName);
+	return mapvar.Lookup(PopHashMapKey(context.Stack, mapvar.GetKeyType()));
+}
+
+
+//
+// Determine if the key on top of the stack is present in the map
+//
+void HashMapContains::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr HashMapContains::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	const HashMapVariable& mapvar = context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName);
+	return RValuePtr(new BooleanRValue(mapvar.Contains(PopHashMapKey(context.Stack, mapvar.GetKeyType()))));
+}
+
+Traverser::Payload HashMapContains::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetMapPayload(MapName, GetNumParameters(*scope));
+}
+
+
+//
+// Remove the key on top of the stack from the map, if present
+//
+void HashMapErase::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+RValuePtr HashMapErase::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	HashMapVariable& mapvar = context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName);
+	return RValuePtr(new BooleanRValue(mapvar.Erase(PopHashMapKey(context.Stack, mapvar.GetKeyType()))));
+}
+
+Traverser::Payload HashMapErase::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetMapPayload(MapName, GetNumParameters(*scope));
+}
+
+
+//
+// Copy the keys of the map into a new array
+//
+void HashMapKeys::ExecuteFast(ExecutionContext& context)
+{
+	// Nothing to do.
+}
+
+RValuePtr HashMapKeys::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	const HashMapVariable& mapvar = context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName);
+	const HashMapVariable::EntryMap& entries = mapvar.GetEntries();
+
+	HandleType arraydatahandle = ArrayVariable::AllocateNewHandle(KeyType, entries.size());
+	Byte* storage = reinterpret_cast<Byte*>(ArrayVariable::GetArrayStorage(arraydatahandle));
+
+	std::auto_ptr<ArrayRValue> ret(new ArrayRValue(arraydatahandle, false));
+
+	for(HashMapVariable::EntryMap::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+	{
+		switch(KeyType)
+		{
+		case EpochVariableType_Integer:
+			{
+				IntegerVariable var(storage);
+				var.SetValue(iter->first.IntegerValue);
+				ret->AddElement(var.GetAsRValue().release());
+			}
+			break;
+
+		case EpochVariableType_String:
+			{
+				StringVariable var(storage);
+				var.SetValue(iter->first.StringValue, true);
+				ret->AddElement(var.GetAsRValue().release());
+			}
+			break;
+
+		default:
+			throw NotImplementedException("Hash map keys of this type are not supported");
+		}
+
+		storage += TypeInfo::GetStorageSize(KeyType);
+	}
+
+	return RValuePtr(ret.release());
+}
+
+
+//
+// Retrieve the number of entries in the map
+//
+void HashMapSize::ExecuteFast(ExecutionContext& context)
+{
+	// Nothing to do.
+}
+
+RValuePtr HashMapSize::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	Integer32 size = static_cast<Integer32>(context.Scope.GetVariableRef<HashMapVariable>(Slot, MapName).GetEntries().size());
+	return RValuePtr(new IntegerRValue(size));
+}
+
+Traverser::Payload HashMapSize::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	return GetMapPayload(MapName, 1);
+}
+
@@ -0,0 +1,333 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Virtual machine operations for working with hash map containers
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+
+
+namespace VM
+{
+
+	namespace Operations
+	{
+
+		//
+		// Operation for constructing a new, empty hash map
+		//
+		class ConsHashMap : public Operation, public SelfAware<ConsHashMap>
+		{
+		// Construction
+		public:
+			ConsHashMap(EpochVariableTypeID keytype, EpochVariableTypeID valuetype)
+				: KeyType(keytype),
+				  ValueType(valuetype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_HashMap; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Queries
+		public:
+			EpochVariableTypeID GetKeyType() const
+			{ return KeyType; }
+
+			EpochVariableTypeID GetValueType() const
+			{ return ValueType; }
+
+		// Internal tracking
+		private:
+			EpochVariableTypeID KeyType;
+			EpochVariableTypeID ValueType;
+		};
+
+
+		//
+		// Operation for inserting or replacing a value in a hash map
+		//
+		class HashMapInsert : public Operation, public SelfAware<HashMapInsert>
+		{
+		// Construction
+		public:
+			HashMapInsert(const std::wstring& mapname)
+				: MapName(mapname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for retrieving the value stored under a key
+		//
+		class HashMapLookup : public Operation, public SelfAware<HashMapLookup>
+		{
+		// Construction
+		public:
+			HashMapLookup(const std::wstring& mapname, EpochVariableTypeID valuetype)
+				: MapName(mapname),
+				  ValueType(valuetype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return ValueType; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+			EpochVariableTypeID GetValueType() const
+			{ return ValueType; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			EpochVariableTypeID ValueType;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for determining if a key is present in a hash map
+		//
+		class HashMapContains : public Operation, public SelfAware<HashMapContains>
+		{
+		// Construction
+		public:
+			HashMapContains(const std::wstring& mapname)
+				: MapName(mapname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for removing a key from a hash map
+		//
+		// The result indicates whether or not the key was present.
+		//
+		class HashMapErase : public Operation, public SelfAware<HashMapErase>
+		{
+		// Construction
+		public:
+			HashMapErase(const std::wstring& mapname)
+				: MapName(mapname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for retrieving the keys of a hash map as an array
+		//
+		// This is the means of iterating over a map; the order of the
+		// keys is unspecified.
+		//
+		class HashMapKeys : public Operation, public SelfAware<HashMapKeys>
+		{
+		// Construction
+		public:
+			HashMapKeys(const std::wstring& mapname, EpochVariableTypeID keytype)
+				: MapName(mapname),
+				  KeyType(keytype)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Array; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+			EpochVariableTypeID GetKeyType() const
+			{ return KeyType; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			EpochVariableTypeID KeyType;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for retrieving the number of entries in a hash map
+		//
+		class HashMapSize : public Operation, public SelfAware<HashMapSize>
+		{
+		// Construction
+		public:
+			HashMapSize(const std::wstring& mapname)
+				: MapName(mapname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return MapName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& MapName;
+			VariableSlot Slot;
+		};
+
+	}
+
+}
+
@@ -10,21 +10,197 @@
 #include "Virtual Machine/Operations/Containers/MapReduce.h"
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
 #include "Virtual Machine/Operations/StackOps.h"
+#include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/VectorReductions.h"
+#include "Virtual Machine/Operations/Variables/StringOps.h"
 #include "Virtual Machine/Types Management/TypeInfo.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/RuntimeContext.h"
+#include "Virtual Machine/Core Entities/Concurrency/Generator.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
+#include "Virtual Machine/Thread Pooling/WorkItems.h"
 #include "Virtual Machine/Routines.inl"
 
 #include "Validator/Validator.h"
 
 #include "Serialization/SerializationTraverser.h"
 
+#include "Optimizer/Optimizer.h"
+
 #include "Parser/Debug Info Tables/DebugTable.h"
 
+#include "Language Extensions/ExtensionCatalog.h"
+#include "Language Extensions/FunctionPointerTypes.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 using namespace VM::Operations;
 
 
+namespace
+{
+
+	//
+	// Determine if an array is large enough to be worth splitting up
+	//
+	bool ShouldSplitArray(size_t count)
+	{
+		if(!Config::ParallelMapReduceThreshold)
+			return false;
+
+		return (count >= Config::ParallelMapReduceThreshold);
+	}
+
+	//
+	// Determine if an array is large enough to be worth handing to a device
+	//
+	bool ShouldOffloadArray(size_t count)
+	{
+		if(!Config::DeviceMapReduceThreshold)
+			return false;
+
+		return (count >= Config::DeviceMapReduceThreshold);
+	}
+
+	//
+	// Determine if values of the given type can be mapped without r-values
+	//
+	bool IsUnboxedType(EpochVariableTypeID type)
+	{
+		switch(type)
+		{
+		case EpochVariableType_Integer:
+		case EpochVariableType_Integer16:
+		case EpochVariableType_Real:
+		case EpochVariableType_Boolean:
+			return true;
+		}
+
+		return false;
+	}
+
+	//
+	// Determine how many chunks to divide an array into
+	//
+	unsigned GetNumChunks(Threads::ThreadPool& pool, size_t count)
+	{
+		size_t numchunks = pool.GetNumThreads();
+		if(numchunks > count)
+			numchunks = count;
+
+		return static_cast<unsigned>(numchunks);
+	}
+
+	//
+	// Determine if an operation is the given built-in operator, applied to a pair of scalars
+	//
+	template <class OperatorType>
+	bool IsScalarOperator(Operation* op)
+	{
+		OperatorType* arithmeticop = dynamic_cast<OperatorType*>(op);
+		return arithmeticop && !arithmeticop->IsFirstArray() && !arithmeticop->IsSecondArray();
+	}
+
+	//
+	// Look up the generator whose handle is on top of the stack, and pop the handle
+	//
+	Generator& PopGenerator(ExecutionContext& context)
+	{
+		IntegerVariable handle(context.Stack.GetCurrentTopOfStack());
+		Generator& generator = context.RunningProgram.GetRuntime().Generators.GetGenerator(handle.GetValue());
+		context.Stack.Pop(IntegerVariable::GetStorageSize());
+		return generator;
+	}
+
+}
+
+
+//
+// Construct and initialize tracking for a split map or reduce
+//
+ParallelArrayJob::ParallelArrayJob(ExecutionContext& context, EpochVariableTypeID elementtype, void* storage, size_t numresults, unsigned numchunks)
+	: RunningProgram(context.RunningProgram),
+	  CallerScope(context.Scope),
+	  ElementType(elementtype),
+	  Storage(storage),
+	  ResultType(EpochVariableType_Error),
+	  ResultStorage(NULL),
+	  Results(numresults, NULL),
+	  PendingChunks(numchunks),
+	  Failed(false)
+{
+}
+
+//
+// Destruct and clean up tracking for a split map or reduce
+//
+// Any results which have not been claimed by the caller (notably after
+// a failure) are released here.
+//
+ParallelArrayJob::~ParallelArrayJob()
+{
+	for(std::vector<RValue*>::iterator iter = Results.begin(); iter != Results.end(); ++iter)
+		delete *iter;
+}
+
+//
+// Retrieve the storage of the array element at the given index
+//
+void* ParallelArrayJob::GetElementStorage(size_t index) const
+{
+	return reinterpret_cast<char*>(Storage) + index * TypeInfo::GetStorageSize(ElementType);
+}
+
+//
+// Record that a chunk failed to complete
+//
+// Only the first failure is kept; it is reported to the caller once
+// all of the chunks have finished.
+//
+void ParallelArrayJob::RecordFailure(const std::string& message)
+{
+	Threads::CriticalSection::Auto mutex(FailureCritSec);
+	if(!Failed)
+	{
+		Failed = true;
+		FailureMessage = message;
+	}
+}
+
+//
+// Record that a chunk has finished, successfully or otherwise
+//
+void ParallelArrayJob::CompleteChunk()
+{
+	PendingChunks.CountDown();
+}
+
+//
+// Wait for all chunks of the job to finish
+//
+// The calling thread helps out with pending pool work while it waits,
+// much like a parallel loop. If any chunk failed, the failure is raised
+// on the calling thread.
+//
+void ParallelArrayJob::WaitForChunks()
+{
+	Threads::ThreadPool& pool = RunningProgram.GetSharedThreadPool();
+	while(!PendingChunks.IsReleased())
+	{
+		if(!pool.RunPendingWorkItem())
+			PendingChunks.Wait();
+	}
+
+	if(Failed)
+		throw ExecutionException(FailureMessage);
+}
+
+
 //
 // Destruct and clean up a map operation
 //
@@ -36,27 +212,83 @@ MapOperation::~MapOperation()
 //
 // Map a unary function onto an array of values, and return the result
 //
+// Large arrays are split into chunks, which are mapped in parallel by
+// the shared worker pool, provided that the mapped function is safe to
+// run within a task. Results are always stored in element order.
+//
 RValuePtr MapOperation::ExecuteAndStoreRValue(ExecutionContext& context)
 {
+	if(FromGenerator)
+		return MapGeneratedElements(context);
+
+	// The array storage is walked directly while the mapped function runs,
+	// and the array handle is no longer on the stack, so collection must be
+	// held off until the map is complete.
+	GarbageCollector::Deferral deferral;
+
 	ArrayVariable arrayvar(context.Stack.GetCurrentTopOfStack());
+	MappedArrayStorage* mapped = ArrayVariable::GetMappedStorage(arrayvar.GetValue());
+	if(mapped)
+	{
+		context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
+		return MapFileBackedElements(context, *mapped);
+	}
+
 	EpochVariableTypeID type = arrayvar.GetElementType();
 	size_t count = arrayvar.GetNumElements();
 	void* storage = ArrayVariable::GetArrayStorage(arrayvar.GetValue());
 	context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
 
-	RValuePtr result(new ArrayRValue(type));
+	// When both the elements and the mapped results are plain scalars, the
+	// results are written straight into the storage of the new array
+	EpochVariableTypeID resulttype = TheOp->GetType(context.Scope.GetOriginalDescription());
+	if(IsUnboxedType(type) && IsUnboxedType(resulttype))
+	{
+		HandleType resulthandle = ArrayVariable::AllocateNewHandle(resulttype, count);
+		RValuePtr result(new ArrayRValue(resulthandle, false));
+		MapUnboxedStorage(context, type, storage, count, resulttype, ArrayVariable::GetArrayStorage(resulthandle));
+		return result;
+	}
+
+	unsigned numchunks = 1;
+	if(ShouldSplitArray(count) && CanRunInParallel(context.RunningProgram))
+		numchunks = GetNumChunks(context.RunningProgram.GetSharedThreadPool(), count);
+
+	RValuePtr result(new ArrayRValue(resulttype));
 	ArrayRValue* resultptr = dynamic_cast<ArrayRValue*>(result.get());
 
-	for(size_t i = 0; i < count; ++i)
+	if(numchunks <= 1)
 	{
-		PushOperation::DoPush(type, GetRValuePtrFromStorage(type, storage).get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
-		storage = reinterpret_cast<char*>(storage) + TypeInfo::GetStorageSize(type);
+		for(size_t i = 0; i < count; ++i)
+		{
+			PushOperation::DoPush(type, GetRValuePtrFromStorage(type, storage).get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+			storage = reinterpret_cast<char*>(storage) + TypeInfo::GetStorageSize(type);
 
-		RValuePtr ret(TheOp->ExecuteAndStoreRValue(context));
-		
-		EpochVariableTypeID rettype = ret->GetType();
-		if(rettype != EpochVariableType_Null)
-			resultptr->AddElement(ret.release());
+			RValuePtr ret(TheOp->ExecuteAndStoreRValue(context));
+			
+			EpochVariableTypeID rettype = ret->GetType();
+			if(rettype != EpochVariableType_Null)
+				resultptr->AddElement(ret.release());
+		}
+	}
+	else
+	{
+		ParallelArrayJob job(context, type, storage, count, numchunks);
+
+		Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+		for(unsigned i = 0; i < numchunks; ++i)
+			pool.AddWorkItem(new MapWorkItem(*this, job, (count * i) / numchunks, (count * (i + 1)) / numchunks), Threads::WorkPriority_Batch);
+
+		job.WaitForChunks();
+
+		for(std::vector<RValue*>::iterator iter = job.Results.begin(); iter != job.Results.end(); ++iter)
+		{
+			RValuePtr ret(*iter);
+			*iter = NULL;
+
+			if(ret->GetType() != EpochVariableType_Null)
+				resultptr->AddElement(ret.release());
+		}
 	}
 
 	resultptr->StoreIntoNewBuffer();
@@ -69,13 +301,253 @@ void MapOperation::ExecuteFast(ExecutionContext& context)
 	ExecuteAndStoreRValue(context);
 }
 
+//
+// Map a run of scalar elements, writing the scalar results directly
+// into the given storage
+//
+// Large enough runs are handed to a device, or split into chunks which
+// are mapped in parallel by the shared worker pool; see above.
+//
+void MapOperation::MapUnboxedStorage(ExecutionContext& context, EpochVariableTypeID type, void* storage, size_t count, EpochVariableTypeID resulttype, void* resultstorage)
+{
+	if(MapOnDevice(context, type, storage, count, resulttype, resultstorage))
+		return;
+
+	unsigned numchunks = 1;
+	if(ShouldSplitArray(count) && CanRunInParallel(context.RunningProgram))
+		numchunks = GetNumChunks(context.RunningProgram.GetSharedThreadPool(), count);
+
+	if(numchunks <= 1)
+	{
+		MapUnboxedElements(context, type, storage, resulttype, resultstorage, 0, count);
+		return;
+	}
+
+	ParallelArrayJob job(context, type, storage, 0, numchunks);
+	job.ResultType = resulttype;
+	job.ResultStorage = resultstorage;
+
+	Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+	for(unsigned i = 0; i < numchunks; ++i)
+		pool.AddWorkItem(new MapWorkItem(*this, job, (count * i) / numchunks, (count * (i + 1)) / numchunks), Threads::WorkPriority_Batch);
+
+	job.WaitForChunks();
+}
+
+//
+// Map the function onto each element of a file-backed array
+//
+// The file is walked one window at a time, so that only a bounded part
+// of it is mapped at once; each window is mapped just as an in-memory
+// array would be. Note that the mapped results are held in memory, so
+// mapping an array which is larger than memory will exhaust it; reduce
+// such arrays directly, or with a fused map and reduce, instead.
+//
+RValuePtr MapOperation::MapFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped)
+{
+	EpochVariableTypeID type = mapped.GetElementType();
+	size_t count = mapped.GetNumElements();
+	size_t elementsize = mapped.GetElementSize();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+
+	EpochVariableTypeID resulttype = TheOp->GetType(typescope);
+	if(IsUnboxedType(resulttype))
+	{
+		HandleType resulthandle = ArrayVariable::AllocateNewHandle(resulttype, count);
+		RValuePtr result(new ArrayRValue(resulthandle, false));
+		char* resultstorage = reinterpret_cast<char*>(ArrayVariable::GetArrayStorage(resulthandle));
+		size_t resultsize = TypeInfo::GetStorageSize(resulttype);
+
+		for(size_t first = 0; first < count; )
+		{
+			MappedArrayStorage::Window window(mapped, first);
+			MapUnboxedStorage(context, type, window.GetStorage(), window.GetNumElements(), resulttype, resultstorage + first * resultsize);
+			first += window.GetNumElements();
+		}
+
+		return result;
+	}
+
+	RValuePtr result(new ArrayRValue(resulttype));
+	ArrayRValue* resultptr = dynamic_cast<ArrayRValue*>(result.get());
+
+	for(size_t first = 0; first < count; )
+	{
+		MappedArrayStorage::Window window(mapped, first);
+		const char* element = reinterpret_cast<const char*>(window.GetStorage());
+
+		for(size_t i = 0; i < window.GetNumElements(); ++i)
+		{
+			context.Stack.Push(elementsize);
+			memcpy(context.Stack.GetCurrentTopOfStack(), element, elementsize);
+			element += elementsize;
+
+			RValuePtr ret(TheOp->ExecuteAndStoreRValue(context));
+			if(ret->GetType() != EpochVariableType_Null)
+				resultptr->AddElement(ret.release());
+		}
+
+		first += window.GetNumElements();
+	}
+
+	resultptr->StoreIntoNewBuffer();
+
+	return result;
+}
+
+//
+// Map the function onto each value produced by a generator, in order
+//
+// Each value is handed to the mapped function as soon as it is produced,
+// and then released. Elements are passed around as r-values which hold
+// their contents directly, so collection is free to run meanwhile, both
+// here and within the generator's body.
+//
+RValuePtr MapOperation::MapGeneratedElements(ExecutionContext& context)
+{
+	Generator& generator = PopGenerator(context);
+	EpochVariableTypeID type = generator.GetElementType();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+
+	RValuePtr result(new ArrayRValue(TheOp->GetType(typescope)));
+	ArrayRValue* resultptr = dynamic_cast<ArrayRValue*>(result.get());
+
+	while(generator.HasNext(context.Stack))
+	{
+		RValuePtr element(generator.Next(context.Stack));
+		PushOperation::DoPush(type, element.get(), typescope, context.Stack, false, false);
+
+		RValuePtr ret(TheOp->ExecuteAndStoreRValue(context));
+		if(ret->GetType() != EpochVariableType_Null)
+			resultptr->AddElement(ret.release());
+	}
+
+	resultptr->StoreIntoNewBuffer();
+
+	return result;
+}
+
+//
+// Apply the mapped function to the given range of array elements
+// on behalf of a parallel map
+//
+// Results are stored either directly into the job's result storage,
+// or in the job's result list at the index of the element that
+// produced them. The type scope is used for looking up the layouts
+// of structure and tuple elements; it is passed in separately since
+// the context's scope belongs to the worker.
+//
+void MapOperation::MapElements(ExecutionContext& context, const ScopeDescription& typescope, ParallelArrayJob& job, size_t first, size_t last)
+{
+	EpochVariableTypeID type = job.ElementType;
+
+	if(job.ResultStorage)
+	{
+		MapUnboxedElements(context, type, job.Storage, job.ResultType, job.ResultStorage, first, last);
+		return;
+	}
+
+	for(size_t i = first; i < last; ++i)
+	{
+		PushOperation::DoPush(type, GetRValuePtrFromStorage(type, job.GetElementStorage(i)).get(), typescope, context.Stack, false, false);
+		job.Results[i] = TheOp->ExecuteAndStoreRValue(context).release();
+	}
+}
+
+//
+// Apply the mapped function to a range of scalar elements, writing the
+// scalar results directly into the given storage
+//
+// Elements are copied straight from the array onto the stack, and the
+// result is taken straight off the stack, so no r-values are involved
+// as long as the mapped function can push its result directly.
+//
+void MapOperation::MapUnboxedElements(ExecutionContext& context, EpochVariableTypeID type, void* storage, EpochVariableTypeID resulttype, void* resultstorage, size_t first, size_t last)
+{
+	size_t elementsize = TypeInfo::GetStorageSize(type);
+	size_t resultsize = TypeInfo::GetStorageSize(resulttype);
+
+	const char* element = reinterpret_cast<const char*>(storage) + first * elementsize;
+	char* result = reinterpret_cast<char*>(resultstorage) + first * resultsize;
+
+	for(size_t i = first; i < last; ++i)
+	{
+		context.Stack.Push(elementsize);
+		memcpy(context.Stack.GetCurrentTopOfStack(), element, elementsize);
+
+		if(!TheOp->ExecuteAndPushScalar(context))
+		{
+			RValuePtr ret(TheOp->ExecuteAndStoreRValue(context));
+			PushOperation::DoPush(resulttype, ret.get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+		}
+
+		memcpy(result, context.Stack.GetCurrentTopOfStack(), resultsize);
+		context.Stack.Pop(resultsize);
+
+		element += elementsize;
+		result += resultsize;
+	}
+}
+
+//
+// Hand a map of scalar elements over to a language extension, if one can run it
+//
+// Large enough arrays are offered to any extension which compiled device
+// code for the mapped function, such as the CUDA extension. Returns false
+// if the map must be done by the VM instead; the results are untouched.
+//
+bool MapOperation::MapOnDevice(ExecutionContext& context, EpochVariableTypeID type, const void* storage, size_t count, EpochVariableTypeID resulttype, void* resultstorage)
+{
+	if(!ShouldOffloadArray(count))
+		return false;
+
+	Invoke* invokeop = dynamic_cast<Invoke*>(TheOp);
+	if(!invokeop)
+		return false;
+
+	const std::wstring& functionname = context.Scope.GetOriginalDescription().GetFunctionName(invokeop->GetFunction());
+
+	Extensions::ArrayOperationInfo info;
+	info.Operation = Extensions::ArrayOperation_Map;
+	info.FunctionName = functionname.c_str();
+	info.ElementType = type;
+	info.ResultType = resulttype;
+
+	return Extensions::ExecuteArrayOperation(info, storage, count, resultstorage);
+}
+
+//
+// Determine if the mapped function can be applied to several elements at once
+//
+// Only user-defined functions which pass the validator's task safety
+// checks are mapped in parallel; debug output and the like must always
+// occur in order. The result is cached since the check involves a full
+// traversal of the function. Concurrent first executions may both run
+// the check, but will always arrive at the same answer.
+//
+bool MapOperation::CanRunInParallel(Program& program)
+{
+	if(ParallelSafety == ParallelSafety_Unknown)
+	{
+		Invoke* invokeop = dynamic_cast<Invoke*>(TheOp);
+		Function* function = invokeop ? dynamic_cast<Function*>(invokeop->GetFunction()) : NULL;
+
+		if(function && Validator::IsTaskSafe(program, *function))
+			ParallelSafety = ParallelSafety_Safe;
+		else
+			ParallelSafety = ParallelSafety_Unsafe;
+	}
+
+	return (ParallelSafety == ParallelSafety_Safe);
+}
+
 
 template <typename TraverserT>
 void MapOperation::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	if(TheOp)
-		dynamic_cast<SelfAwareBase*>(TheOp)->Traverse(traverser);
+		TheOp->Traverse(traverser);
 }
 
 void MapOperation::Traverse(Validator::ValidationTraverser& traverser)
@@ -88,6 +560,11 @@ void MapOperation::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void MapOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 //
 // Destruct and clean up a reduce operation
 //
@@ -100,40 +577,333 @@ ReduceOperation::~ReduceOperation()
 // Apply a binary function to each element in an array, keeping a running
 // accumulator value as we go along. The final accumulator value is returned.
 //
+// Large arrays reduced with an associative built-in operator are split
+// into chunks, each of which is reduced by the shared worker pool; the
+// partial results are then combined in order on the calling thread,
+// forming a two level reduction tree. Since the operator is associative
+// the result is the same as reducing the elements one at a time.
+//
 RValuePtr ReduceOperation::ExecuteAndStoreRValue(ExecutionContext& context)
 {
+	if(FromGenerator)
+		return ReduceGeneratedElements(context);
+
+	// See MapOperation::ExecuteAndStoreRValue
+	GarbageCollector::Deferral deferral;
+
 	ArrayVariable arrayvar(context.Stack.GetCurrentTopOfStack());
+	MappedArrayStorage* mapped = ArrayVariable::GetMappedStorage(arrayvar.GetValue());
+	if(mapped)
+	{
+		context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
+		return ReduceFileBackedElements(context, *mapped);
+	}
+
 	EpochVariableTypeID type = arrayvar.GetElementType();
 	size_t count = arrayvar.GetNumElements();
 	void* storage = ArrayVariable::GetArrayStorage(arrayvar.GetValue());
 	context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
 
-	size_t elementstoragesize = TypeInfo::GetStorageSize(type);
+	if(!count)
+		throw ExecutionException("Cannot reduce() an empty array");
+
+	return ReduceStorage(context, context.Scope.GetOriginalDescription(), type, storage, count);
+}
+
+void ReduceOperation::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+//
+// Reduce the given (non-empty) run of array elements, handing it to a
+// device or splitting it between the shared worker pool if possible
+//
+RValuePtr ReduceOperation::ReduceStorage(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count)
+{
+	RValuePtr deviceresult(NULL);
+	if(ReduceOnDevice(type, storage, count, deviceresult))
+		return deviceresult;
+
+	unsigned numchunks = 1;
+	if(ShouldSplitArray(count) && CanRunInParallel())
+		numchunks = GetNumChunks(context.RunningProgram.GetSharedThreadPool(), count);
+
+	if(numchunks <= 1)
+		return ReduceElements(context, typescope, type, storage, count);
+
+	ParallelArrayJob job(context, type, storage, numchunks, numchunks);
+
+	Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+	for(unsigned i = 0; i < numchunks; ++i)
+		pool.AddWorkItem(new ReduceWorkItem(*this, job, i, (count * i) / numchunks, (count * (i + 1)) / numchunks), Threads::WorkPriority_Batch);
+
+	job.WaitForChunks();
+
+	RValuePtr ret(job.Results[0]);
+	job.Results[0] = NULL;
+
+	for(unsigned i = 1; i < numchunks; ++i)
+		ret = ApplyOperator(context, typescope, type, ret.get(), job.Results[i]);
+
+	return ret;
+}
+
+//
+// Reduce the elements of a file-backed array, one window at a time
+//
+// When the operator is associative, each window is reduced on its own,
+// in parallel where possible, and folded into the running result.
+// Otherwise the accumulator is simply carried from one window into
+// the next.
+//
+RValuePtr ReduceOperation::ReduceFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped)
+{
+	EpochVariableTypeID type = mapped.GetElementType();
+	size_t count = mapped.GetNumElements();
+	size_t elementsize = mapped.GetElementSize();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+
+	if(!count)
+		throw ExecutionException("Cannot reduce() an empty array");
+
+	bool associative = CanRunInParallel();
+
 	RValuePtr ret(NULL);
+	for(size_t first = 0; first < count; )
+	{
+		MappedArrayStorage::Window window(mapped, first);
+		first += window.GetNumElements();
 
-	--count;
-	ret.reset(GetRValuePtrFromStorage(type, storage).release());
-	PushOperation::DoPush(type, ret.get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+		if(associative)
+		{
+			RValuePtr partial(ReduceStorage(context, typescope, type, window.GetStorage(), window.GetNumElements()));
+			if(ret.get())
+				ret = ApplyOperator(context, typescope, type, ret.get(), partial.get());
+			else
+				ret = partial;
 
-	for(size_t i = 0; i < count; ++i)
+			continue;
+		}
+
+		const char* element = reinterpret_cast<const char*>(window.GetStorage());
+		for(size_t i = 0; i < window.GetNumElements(); ++i)
+		{
+			RValuePtr value(GetRValuePtrFromStorage(type, element));
+			element += elementsize;
+
+			if(ret.get())
+				ret = ApplyOperator(context, typescope, type, ret.get(), value.get());
+			else
+				ret = value;
+		}
+	}
+
+	return ret;
+}
+
+//
+// Combine each value produced by a generator into the accumulator, in order
+//
+// Only the accumulator and the current value are alive at any given time;
+// see MapOperation::MapGeneratedElements.
+//
+RValuePtr ReduceOperation::ReduceGeneratedElements(ExecutionContext& context)
+{
+	Generator& generator = PopGenerator(context);
+	EpochVariableTypeID type = generator.GetElementType();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+
+	if(!generator.HasNext(context.Stack))
+		throw ExecutionException("Cannot reduce() an empty sequence");
+
+	RValuePtr ret(generator.Next(context.Stack));
+	while(generator.HasNext(context.Stack))
 	{
-		storage = reinterpret_cast<char*>(storage) + elementstoragesize;
-		ret.reset(GetRValuePtrFromStorage(type, storage).release());
-		PushOperation::DoPush(type, ret.get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+		RValuePtr element(generator.Next(context.Stack));
+		ret = ApplyOperator(context, typescope, type, ret.get(), element.get());
+	}
 
-		RValuePtr intermediate(TheOp->ExecuteAndStoreRValue(context));
-		ret.reset(intermediate->Clone());
-		PushOperation::DoPush(type, ret.get(), context.Scope.GetOriginalDescription(), context.Stack, false, false);
+	return ret;
+}
+
+//
+// Reduce the given (non-empty) run of array elements to a single value
+//
+// Built-in arithmetic is handed to the vectorized kernels, and other
+// operators on scalar elements are fed straight from the array; only
+// the remaining cases construct an r-value for each element. See
+// MapOperation::MapElements for details on the type scope.
+//
+RValuePtr ReduceOperation::ReduceElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count)
+{
+	RValuePtr kernelresult(NULL);
+	if(ReduceWithKernel(type, storage, count, kernelresult))
+		return kernelresult;
+
+	if(IsUnboxedType(type) && TheOp->GetType(typescope) == type)
+		return ReduceUnboxedElements(context, typescope, type, storage, count);
+
+	size_t elementstoragesize = TypeInfo::GetStorageSize(type);
+
+	RValuePtr ret(GetRValuePtrFromStorage(type, storage));
+	for(size_t i = 1; i < count; ++i)
+	{
+		storage = reinterpret_cast<char*>(storage) + elementstoragesize;
+		RValuePtr element(GetRValuePtrFromStorage(type, storage));
+		ret = ApplyOperator(context, typescope, type, ret.get(), element.get());
 	}
 
-	context.Stack.Pop(elementstoragesize);
+	return ret;
+}
 
+//
+// Reduce a run of scalar elements, keeping the accumulator on the stack
+//
+// The accumulator is pushed once, and each element is copied straight
+// from the array onto the stack above it. The operator leaves its result
+// in place of its two parameters, so the result becomes the accumulator
+// for the next element without any r-values being involved, as long as
+// the operator can push its result directly. The operator must produce
+// values of the element type for this to work.
+//
+RValuePtr ReduceOperation::ReduceUnboxedElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count)
+{
+	size_t elementsize = TypeInfo::GetStorageSize(type);
+	const char* element = reinterpret_cast<const char*>(storage);
+
+	context.Stack.Push(elementsize);
+	memcpy(context.Stack.GetCurrentTopOfStack(), element, elementsize);
+
+	for(size_t i = 1; i < count; ++i)
+	{
+		element += elementsize;
+
+		context.Stack.Push(elementsize);
+		memcpy(context.Stack.GetCurrentTopOfStack(), element, elementsize);
+
+		if(!TheOp->ExecuteAndPushScalar(context))
+		{
+			RValuePtr intermediate(TheOp->ExecuteAndStoreRValue(context));
+			PushOperation::DoPush(type, intermediate.get(), typescope, context.Stack, false, false);
+		}
+	}
+
+	RValuePtr ret(GetRValuePtrFromStorage(type, context.Stack.GetCurrentTopOfStack()));
+	context.Stack.Pop(elementsize);
 	return ret;
 }
 
-void ReduceOperation::ExecuteFast(ExecutionContext& context)
+//
+// Reduce a run of numeric elements with one of the vectorized kernels, if possible
+//
+// Built-in addition and multiplication need not go through the operator
+// at all; the kernels read the elements straight out of the array. Note
+// that the kernels combine real values in a different order than the
+// operator would, just as the array forms of the operators do; see
+// VectorReductions.h. Returns false if the operator must be applied.
+//
+bool ReduceOperation::ReduceWithKernel(EpochVariableTypeID type, const void* storage, size_t count, RValuePtr& result) const
 {
-	ExecuteAndStoreRValue(context);
+	switch(type)
+	{
+	case EpochVariableType_Integer:
+		{
+			const Integer32* elements = reinterpret_cast<const Integer32*>(storage);
+			if(IsScalarOperator<SumIntegers>(TheOp))
+				result.reset(new IntegerRValue(SumArrayElements(elements, count)));
+			else if(IsScalarOperator<MultiplyIntegers>(TheOp))
+				result.reset(new IntegerRValue(MultiplyArrayElements(elements, count)));
+		}
+		break;
+
+	case EpochVariableType_Integer16:
+		{
+			const Integer16* elements = reinterpret_cast<const Integer16*>(storage);
+			if(IsScalarOperator<SumInteger16s>(TheOp))
+				result.reset(new Integer16RValue(SumArrayElements(elements, count)));
+			else if(IsScalarOperator<MultiplyInteger16s>(TheOp))
+				result.reset(new Integer16RValue(MultiplyArrayElements(elements, count)));
+		}
+		break;
+
+	case EpochVariableType_Real:
+		{
+			const Real* elements = reinterpret_cast<const Real*>(storage);
+			if(IsScalarOperator<SumReals>(TheOp))
+				result.reset(new RealRValue(SumArrayElements(elements, count)));
+			else if(IsScalarOperator<MultiplyReals>(TheOp))
+				result.reset(new RealRValue(MultiplyArrayElements(elements, count)));
+		}
+		break;
+	}
+
+	return (result.get() != NULL);
+}
+
+//
+// Combine the running accumulator with another value
+//
+RValuePtr ReduceOperation::ApplyOperator(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, RValue* accumulator, RValue* value)
+{
+	PushOperation::DoPush(type, accumulator, typescope, context.Stack, false, false);
+	PushOperation::DoPush(type, value, typescope, context.Stack, false, false);
+
+	RValuePtr intermediate(TheOp->ExecuteAndStoreRValue(context));
+	return RValuePtr(intermediate->Clone());
+}
+
+//
+// Hand a reduction over to a language extension, if one can run it
+//
+// Devices reduce arrays with a parallel reduction tree, so just as with
+// splitting the reduction into chunks, only associative operators can be
+// handed off; of those, only integer addition and multiplication can be
+// described to an extension. Returns false if the VM must do the work.
+//
+bool ReduceOperation::ReduceOnDevice(EpochVariableTypeID type, const void* storage, size_t count, RValuePtr& result) const
+{
+	if(type != EpochVariableType_Integer || !ShouldOffloadArray(count))
+		return false;
+
+	const wchar_t* operatorname;
+	if(dynamic_cast<SumIntegers*>(TheOp))
+		operatorname = Keywords::Add;
+	else if(dynamic_cast<MultiplyIntegers*>(TheOp))
+		operatorname = Keywords::Multiply;
+	else
+		return false;
+
+	Extensions::ArrayOperationInfo info;
+	info.Operation = Extensions::ArrayOperation_Reduce;
+	info.FunctionName = operatorname;
+	info.ElementType = type;
+	info.ResultType = type;
+
+	Integer32 value;
+	if(!Extensions::ExecuteArrayOperation(info, storage, count, &value))
+		return false;
+
+	result.reset(new IntegerRValue(value));
+	return true;
+}
+
+//
+// Determine if the reduction can be split into independent chunks
+//
+// This requires the operator to be associative. There is no way to know
+// this for user-defined functions, so only the built-in operators which
+// are known to be associative qualify. Note that real arithmetic is not
+// associative in floating point, and splitting the reduction would make
+// the result depend on the number of worker threads.
+//
+bool ReduceOperation::CanRunInParallel() const
+{
+	return dynamic_cast<SumIntegers*>(TheOp)
+		|| dynamic_cast<SumInteger16s*>(TheOp)
+		|| dynamic_cast<MultiplyIntegers*>(TheOp)
+		|| dynamic_cast<MultiplyInteger16s*>(TheOp)
+		|| dynamic_cast<Concatenate*>(TheOp);
 }
 
 template <typename TraverserT>
@@ -141,7 +911,7 @@ void ReduceOperation::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	if(TheOp)
-		dynamic_cast<SelfAwareBase*>(TheOp)->Traverse(traverser);
+		TheOp->Traverse(traverser);
 }
 
 void ReduceOperation::Traverse(Validator::ValidationTraverser& traverser)
@@ -153,3 +923,312 @@ void ReduceOperation::Traverse(Serialization::SerializationTraverser& traverser)
 {
 	TraverseHelper(traverser);
 }
+
+void ReduceOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+
+//
+// Construct and initialize a fused map-reduce operation
+//
+// The map is passed in along with the push operation that wraps it,
+// since that is the form in which the map was originally generated.
+//
+MapReduceOperation::MapReduceOperation(OperationPtr mappush, OperationPtr reduceop)
+	: MapPush(NULL),
+	  Map(NULL),
+	  Reduce(NULL)
+{
+	if(!CanFuse(mappush.get()) || !dynamic_cast<ReduceOperation*>(reduceop.get()))
+		throw InternalFailureException("Cannot fuse these operations into a single map-reduce operation");
+
+	MapPush = mappush.release();
+	Map = dynamic_cast<MapOperation*>(MapPush->GetNestedOperation());
+	Reduce = dynamic_cast<ReduceOperation*>(reduceop.release());
+}
+
+//
+// Destruct and clean up a fused map-reduce operation
+//
+MapReduceOperation::~MapReduceOperation()
+{
+	delete MapPush;
+	delete Reduce;
+}
+
+//
+// Determine if a reduce of the array produced by the given operation can be fused
+//
+bool MapReduceOperation::CanFuse(const Operation* arrayop)
+{
+	if(!dynamic_cast<const PushOperation*>(arrayop))
+		return false;
+
+	const MapOperation* mapop = dynamic_cast<const MapOperation*>(arrayop->GetNestedOperation());
+	return (mapop && mapop->GetNestedOperation());
+}
+
+//
+// Map each element of an array and reduce the results, returning the
+// final accumulator value
+//
+// Parallel execution follows the rules of both the map and the reduce;
+// the array is only split when the mapped function is safe to run in a
+// task and the reduction operator is associative. Each chunk then keeps
+// its own accumulator, and the partial results are combined in order on
+// the calling thread.
+//
+RValuePtr MapReduceOperation::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	if(Map->IsFromGenerator())
+		return MapReduceGeneratedElements(context);
+
+	// See MapOperation::ExecuteAndStoreRValue
+	GarbageCollector::Deferral deferral;
+
+	ArrayVariable arrayvar(context.Stack.GetCurrentTopOfStack());
+	MappedArrayStorage* mapped = ArrayVariable::GetMappedStorage(arrayvar.GetValue());
+	if(mapped)
+	{
+		context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
+		return MapReduceFileBackedElements(context, *mapped);
+	}
+
+	EpochVariableTypeID type = arrayvar.GetElementType();
+	size_t count = arrayvar.GetNumElements();
+	void* storage = ArrayVariable::GetArrayStorage(arrayvar.GetValue());
+	context.Stack.Pop(ArrayVariable::GetBaseStorageSize());
+
+	RValuePtr ret(MapReduceStorage(context, context.Scope.GetOriginalDescription(), type, storage, count));
+	if(!ret.get())
+		throw ExecutionException("Cannot reduce() an empty array");
+
+	return ret;
+}
+
+void MapReduceOperation::ExecuteFast(ExecutionContext& context)
+{
+	ExecuteAndStoreRValue(context);
+}
+
+//
+// Map and reduce the given run of array elements, handing the work to a
+// device or splitting it between the shared worker pool where possible
+//
+// If there are no mapped values at all, a null pointer is returned.
+//
+RValuePtr MapReduceOperation::MapReduceStorage(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count)
+{
+	// A map which can run on a device is done there in full; the mapped
+	// array is then reduced on the device as well, if possible
+	EpochVariableTypeID mappedtype = Map->GetNestedOperation()->GetType(typescope);
+	if(count && ShouldOffloadArray(count) && IsUnboxedType(type) && IsUnboxedType(mappedtype))
+	{
+		std::vector<char> mapped(count * TypeInfo::GetStorageSize(mappedtype));
+		if(Map->MapOnDevice(context, type, storage, count, mappedtype, &mapped[0]))
+		{
+			RValuePtr ret(NULL);
+			if(!Reduce->ReduceOnDevice(mappedtype, &mapped[0], count, ret))
+				ret = Reduce->ReduceElements(context, typescope, mappedtype, &mapped[0], count);
+
+			return ret;
+		}
+	}
+
+	unsigned numchunks = 1;
+	if(ShouldSplitArray(count) && Reduce->CanRunInParallel() && Map->CanRunInParallel(context.RunningProgram))
+		numchunks = GetNumChunks(context.RunningProgram.GetSharedThreadPool(), count);
+
+	RValuePtr ret(NULL);
+	if(numchunks <= 1)
+		ret = MapReduceElements(context, typescope, type, storage, count);
+	else
+	{
+		ParallelArrayJob job(context, type, storage, numchunks, numchunks);
+
+		Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+		for(unsigned i = 0; i < numchunks; ++i)
+			pool.AddWorkItem(new MapReduceWorkItem(*this, job, i, (count * i) / numchunks, (count * (i + 1)) / numchunks), Threads::WorkPriority_Batch);
+
+		job.WaitForChunks();
+
+		// Chunks in which every element mapped to nothing have no result
+		for(unsigned i = 0; i < numchunks; ++i)
+		{
+			if(!job.Results[i])
+				continue;
+
+			if(ret.get())
+				ret = Reduce->ApplyOperator(context, typescope, ret->GetType(), ret.get(), job.Results[i]);
+			else
+			{
+				ret.reset(job.Results[i]);
+				job.Results[i] = NULL;
+			}
+		}
+	}
+
+	return ret;
+}
+
+//
+// Map and reduce the elements of a file-backed array, one window at a time
+//
+// Neither the mapped array nor the file as a whole is ever held in memory,
+// so this is the preferred way to process arrays larger than memory. As
+// with a plain reduce, windows are processed independently only when the
+// reduction operator is associative; see ReduceFileBackedElements.
+//
+RValuePtr MapReduceOperation::MapReduceFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped)
+{
+	EpochVariableTypeID type = mapped.GetElementType();
+	size_t count = mapped.GetNumElements();
+	size_t elementsize = mapped.GetElementSize();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+	Operation* mapfunction = Map->GetNestedOperation();
+
+	bool associative = Reduce->CanRunInParallel();
+
+	RValuePtr ret(NULL);
+	for(size_t first = 0; first < count; )
+	{
+		MappedArrayStorage::Window window(mapped, first);
+		first += window.GetNumElements();
+
+		if(associative)
+		{
+			RValuePtr partial(MapReduceStorage(context, typescope, type, window.GetStorage(), window.GetNumElements()));
+			if(!partial.get())
+				continue;
+
+			if(ret.get())
+				ret = Reduce->ApplyOperator(context, typescope, partial->GetType(), ret.get(), partial.get());
+			else
+				ret = partial;
+
+			continue;
+		}
+
+		const char* element = reinterpret_cast<const char*>(window.GetStorage());
+		for(size_t i = 0; i < window.GetNumElements(); ++i)
+		{
+			context.Stack.Push(elementsize);
+			memcpy(context.Stack.GetCurrentTopOfStack(), element, elementsize);
+			element += elementsize;
+
+			RValuePtr mappedvalue(mapfunction->ExecuteAndStoreRValue(context));
+			if(mappedvalue->GetType() == EpochVariableType_Null)
+				continue;
+
+			if(ret.get())
+				ret = Reduce->ApplyOperator(context, typescope, mappedvalue->GetType(), ret.get(), mappedvalue.get());
+			else
+				ret = mappedvalue;
+		}
+	}
+
+	if(!ret.get())
+		throw ExecutionException("Cannot reduce() an empty array");
+
+	return ret;
+}
+
+//
+// Map each value produced by a generator, reducing the results as we go
+//
+// Neither the generated sequence nor the mapped sequence is ever built,
+// so the whole pipeline runs in constant memory regardless of the length
+// of the sequence; see MapOperation::MapGeneratedElements.
+//
+RValuePtr MapReduceOperation::MapReduceGeneratedElements(ExecutionContext& context)
+{
+	Generator& generator = PopGenerator(context);
+	EpochVariableTypeID type = generator.GetElementType();
+	const ScopeDescription& typescope = context.Scope.GetOriginalDescription();
+	Operation* mapfunction = Map->GetNestedOperation();
+
+	RValuePtr ret(NULL);
+	while(generator.HasNext(context.Stack))
+	{
+		RValuePtr element(generator.Next(context.Stack));
+		PushOperation::DoPush(type, element.get(), typescope, context.Stack, false, false);
+
+		RValuePtr mapped(mapfunction->ExecuteAndStoreRValue(context));
+		if(mapped->GetType() == EpochVariableType_Null)
+			continue;
+
+		if(ret.get())
+			ret = Reduce->ApplyOperator(context, typescope, mapped->GetType(), ret.get(), mapped.get());
+		else
+			ret = mapped;
+	}
+
+	if(!ret.get())
+		throw ExecutionException("Cannot reduce() an empty sequence");
+
+	return ret;
+}
+
+//
+// Map the given run of array elements, reducing the results as we go
+//
+// Elements for which the mapped function returns nothing are skipped,
+// just as they would be left out of the mapped array. If there are no
+// mapped values at all, a null pointer is returned.
+//
+// See MapOperation::MapElements for details on the type scope.
+//
+RValuePtr MapReduceOperation::MapReduceElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count)
+{
+	Operation* mapfunction = Map->GetNestedOperation();
+	size_t elementstoragesize = TypeInfo::GetStorageSize(type);
+
+	RValuePtr ret(NULL);
+	for(size_t i = 0; i < count; ++i)
+	{
+		PushOperation::DoPush(type, GetRValuePtrFromStorage(type, storage).get(), typescope, context.Stack, false, false);
+		storage = reinterpret_cast<char*>(storage) + elementstoragesize;
+
+		RValuePtr mapped(mapfunction->ExecuteAndStoreRValue(context));
+		if(mapped->GetType() == EpochVariableType_Null)
+			continue;
+
+		if(ret.get())
+			ret = Reduce->ApplyOperator(context, typescope, mapped->GetType(), ret.get(), mapped.get());
+		else
+			ret = mapped;
+	}
+
+	return ret;
+}
+
+template <typename TraverserT>
+void MapReduceOperation::TraverseHelper(TraverserT& traverser)
+{
+	traverser.TraverseNode(*this);
+	static_cast<SelfAwareBase*>(MapPush)->Traverse(traverser);
+	static_cast<SelfAwareBase*>(Reduce)->Traverse(traverser);
+}
+
+void MapReduceOperation::Traverse(Validator::ValidationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+//
+// Fused operations are serialized as the original map and reduce, so
+// that the fusion is invisible in the generated code; the loader will
+// fuse the operations again when the program is loaded.
+//
+void MapReduceOperation::Traverse(Serialization::SerializationTraverser& traverser)
+{
+	static_cast<SelfAwareBase*>(MapPush)->Traverse(traverser);
+	static_cast<SelfAwareBase*>(Reduce)->Traverse(traverser);
+}
+
+void MapReduceOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
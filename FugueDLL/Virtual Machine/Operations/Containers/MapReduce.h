@@ -9,20 +9,91 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Utility/Threading/Synchronization.h"
 
 
 namespace VM
 {
 
+	// Forward declarations
+	class ActivatedScope;
+	class Program;
+	class MappedArrayStorage;
+
 	namespace Operations
 	{
 
+		//
+		// Shared tracking for a map or reduce which has been split into
+		// chunks and handed out to the shared worker pool
+		//
+		// Each chunk of a map writes one result per element, and each
+		// chunk of a reduce writes one result for the whole chunk; since
+		// no two chunks write the same result slot, the results need no
+		// further synchronization. Parallel invokes use the same tracking
+		// with one chunk (and one result) per branch, and no array.
+		//
+		struct ParallelArrayJob
+		{
+		// Construction and destruction
+		public:
+			ParallelArrayJob(ExecutionContext& context, EpochVariableTypeID elementtype, void* storage, size_t numresults, unsigned numchunks);
+			~ParallelArrayJob();
+
+		// Make jobs uncopyable
+		private:
+			ParallelArrayJob(const ParallelArrayJob& other);
+			ParallelArrayJob& operator=(const ParallelArrayJob& other);
+
+		// Chunk interface
+		public:
+			void* GetElementStorage(size_t index) const;
+
+			void RecordFailure(const std::string& message);
+			void CompleteChunk();
+
+			void WaitForChunks();
+
+		// Shared state
+		public:
+			Program& RunningProgram;
+			ActivatedScope& CallerScope;
+
+			EpochVariableTypeID ElementType;
+			void* Storage;
+
+			// Maps of scalar elements to scalar results write into the new array directly
+			EpochVariableTypeID ResultType;
+			void* ResultStorage;
+
+			std::vector<RValue*> Results;
+
+		// Internal tracking
+		private:
+			Threads::CountdownLatch PendingChunks;
+
+			Threads::CriticalSection FailureCritSec;
+			bool Failed;
+			std::string FailureMessage;
+		};
+
+
+		//
+		// Operation for mapping a function onto an array
+		//
+		// The elements may instead be drawn from a generator, in which case
+		// the generator's handle is expected on the stack in place of the
+		// array. Generated elements are mapped one at a time, as they are
+		// produced, so they are never all held in memory at once.
+		//
 		class MapOperation : public Operation, public SelfAware<MapOperation>
 		{
 		// Construction and destruction
 		public:
-			explicit MapOperation(OperationPtr op)
-				: TheOp(op.release())
+			MapOperation(OperationPtr op, bool fromgenerator)
+				: TheOp(op.release()),
+				  FromGenerator(fromgenerator),
+				  ParallelSafety(ParallelSafety_Unknown)
 			{ }
 
 			virtual ~MapOperation();
@@ -40,6 +111,23 @@ namespace VM
 
 			virtual Operation* GetNestedOperation() const
 			{ return TheOp; }
+
+			bool IsFromGenerator() const
+			{ return FromGenerator; }
+
+		// Element processing
+		public:
+			void MapElements(ExecutionContext& context, const ScopeDescription& typescope, ParallelArrayJob& job, size_t first, size_t last);
+			bool MapOnDevice(ExecutionContext& context, EpochVariableTypeID type, const void* storage, size_t count, EpochVariableTypeID resulttype, void* resultstorage);
+
+			bool CanRunInParallel(Program& program);
+
+		// Internal helpers
+		private:
+			void MapUnboxedElements(ExecutionContext& context, EpochVariableTypeID type, void* storage, EpochVariableTypeID resulttype, void* resultstorage, size_t first, size_t last);
+			void MapUnboxedStorage(ExecutionContext& context, EpochVariableTypeID type, void* storage, size_t count, EpochVariableTypeID resulttype, void* resultstorage);
+			RValuePtr MapGeneratedElements(ExecutionContext& context);
+			RValuePtr MapFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped);
 			
 		// Traversal interface
 		protected:
@@ -48,19 +136,37 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		protected:
 			Operation* TheOp;
+			bool FromGenerator;
+
+			enum ParallelSafetyState
+			{
+				ParallelSafety_Unknown,
+				ParallelSafety_Safe,
+				ParallelSafety_Unsafe
+			};
+
+			ParallelSafetyState ParallelSafety;
 		};
 
 
+		//
+		// Operation for reducing an array to a single value
+		//
+		// As with maps, the elements may instead be drawn from a generator,
+		// and are then combined one at a time, as they are produced.
+		//
 		class ReduceOperation : public Operation, public SelfAware<ReduceOperation>
 		{
 		// Construction and destruction
 		public:
-			explicit ReduceOperation(OperationPtr op)
-				: TheOp(op.release())
+			ReduceOperation(OperationPtr op, bool fromgenerator)
+				: TheOp(op.release()),
+				  FromGenerator(fromgenerator)
 			{ }
 
 			virtual ~ReduceOperation();
@@ -79,6 +185,25 @@ namespace VM
 			virtual Operation* GetNestedOperation() const
 			{ return TheOp; }
 
+			bool IsFromGenerator() const
+			{ return FromGenerator; }
+
+		// Element processing
+		public:
+			RValuePtr ReduceElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count);
+			RValuePtr ApplyOperator(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, RValue* accumulator, RValue* value);
+			bool ReduceOnDevice(EpochVariableTypeID type, const void* storage, size_t count, RValuePtr& result) const;
+
+			bool CanRunInParallel() const;
+
+		// Internal helpers
+		private:
+			RValuePtr ReduceStorage(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count);
+			RValuePtr ReduceUnboxedElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count);
+			bool ReduceWithKernel(EpochVariableTypeID type, const void* storage, size_t count, RValuePtr& result) const;
+			RValuePtr ReduceGeneratedElements(ExecutionContext& context);
+			RValuePtr ReduceFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped);
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -86,10 +211,75 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		protected:
 			Operation* TheOp;
+			bool FromGenerator;
+		};
+
+
+		//
+		// Reduce the results of a map, without building the mapped array
+		//
+		// The parser and bytecode loader substitute this operation for a
+		// reduce of an array which comes straight from a map. Each element
+		// is mapped and immediately combined into the accumulator, so only
+		// one mapped value is alive at any given time. When the map draws
+		// its elements from a generator, the whole pipeline therefore runs
+		// in constant memory.
+		//
+		// The original operations are retained, both to do the actual work
+		// of mapping and reducing, and so that the program can still be
+		// serialized in its original form.
+		//
+		class MapReduceOperation : public Operation, public SelfAware<MapReduceOperation>
+		{
+		// Construction and destruction
+		public:
+			MapReduceOperation(OperationPtr mappush, OperationPtr reduceop);
+			virtual ~MapReduceOperation();
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return Reduce->GetType(scope); }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 1; }
+
+		// Fusion support
+		public:
+			static bool CanFuse(const Operation* arrayop);
+
+		// Element processing
+		public:
+			RValuePtr MapReduceElements(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count);
+
+		// Internal helpers
+		private:
+			RValuePtr MapReduceStorage(ExecutionContext& context, const ScopeDescription& typescope, EpochVariableTypeID type, void* storage, size_t count);
+			RValuePtr MapReduceGeneratedElements(ExecutionContext& context);
+			RValuePtr MapReduceFileBackedElements(ExecutionContext& context, MappedArrayStorage& mapped);
+
+		// Traversal interface
+		protected:
+			template <typename TraverserT>
+			void TraverseHelper(TraverserT& traverser);
+
+			virtual void Traverse(Validator::ValidationTraverser& traverser);
+			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
+
+		// Internal tracking
+		protected:
+			Operation* MapPush;
+			MapOperation* Map;
+			ReduceOperation* Reduce;
 		};
 
 	}
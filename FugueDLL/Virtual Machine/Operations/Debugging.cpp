@@ -11,7 +11,7 @@
 #include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 #include "Virtual Machine/Types Management/Typecasts.h"
 
-#include "User Interface/Output.h"
+#include "User Interface/BufferedOutput.h"
 #include "User Interface/Input.h"
 
 
@@ -25,13 +25,9 @@ using namespace VM::Operations;
 //
 void DebugWriteStringExpression::ExecuteFast(ExecutionContext& context)
 {
-	UI::OutputStream output;
-
-	output << UI::lightblue << L"DEBUG: " << UI::resetcolor;
-	
 	{
 		StringVariable value(context.Stack.GetCurrentTopOfStack());
-		output << value.GetValue() << std::endl;
+		UI::BufferedOutput::WriteDebugMessage(value.GetValue());
 	}
 	context.Stack.Pop(StringVariable::GetStorageSize());
 }
@@ -20,6 +20,11 @@
 
 #include "Virtual Machine/Thread Pooling/WorkItems.h"
 
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Tracing.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 
 using namespace VM;
 using namespace VM::Operations;
@@ -44,10 +49,7 @@ RValuePtr ExecuteBlock::ExecuteAndStoreRValue(ExecutionContext& context)
 
 void ExecuteBlock::ExecuteFast(ExecutionContext& context)
 {
-	std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*Body->GetBoundScope()));
-	newscope->ParentScope = &context.Scope;
-	Body->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, context.FlowResult), NULL);
-	newscope->Exit(context.Stack);
+	Body->ExecuteNestedBlock(context);
 }
 
 template <typename TraverserT>
@@ -69,6 +71,11 @@ void ExecuteBlock::Traverse(Serialization::SerializationTraverser& traverser)
 		Body->Traverse(traverser);
 }
 
+void ExecuteBlock::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 //
 // Construct and initialize an if-conditional wrapper operation.
@@ -109,10 +116,7 @@ void If::ExecuteFast(ExecutionContext& context)
 	{
 		if(TrueBlock)
 		{
-			std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*TrueBlock->GetBoundScope()));
-			newscope->ParentScope = &context.Scope;
-			TrueBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, context.FlowResult), NULL);
-			newscope->Exit(context.Stack);
+			TrueBlock->ExecuteNestedBlock(context);
 		}
 	}
 	else
@@ -122,10 +126,7 @@ void If::ExecuteFast(ExecutionContext& context)
 
 		if(context.FlowResult == FLOWCONTROL_NORMAL && FalseBlock)
 		{
-			std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*FalseBlock->GetBoundScope()));
-			newscope->ParentScope = &context.Scope;
-			FalseBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, context.FlowResult), NULL);
-			newscope->Exit(context.Stack);
+			FalseBlock->ExecuteNestedBlock(context);
 		}
 	}
 
@@ -184,6 +185,11 @@ void If::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void If::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 //
 // Construct and initialize an elseif wrapper block
 //
@@ -210,10 +216,7 @@ ElseIfWrapper::~ElseIfWrapper()
 //
 void ElseIfWrapper::ExecuteFast(ExecutionContext& context)
 {
-	std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*WrapperBlock->GetBoundScope()));
-	newscope->ParentScope = &context.Scope;
-	WrapperBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, context.FlowResult), NULL);
-	newscope->Exit(context.Stack);
+	WrapperBlock->ExecuteNestedBlock(context);
 }
 
 RValuePtr ElseIfWrapper::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -240,6 +243,11 @@ void ElseIfWrapper::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void ElseIfWrapper::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 //
 // Construct and initialize the elseif clause
@@ -268,10 +276,7 @@ void ElseIf::ExecuteFast(ExecutionContext& context)
 
 	if(result)
 	{
-		std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*TheBlock->GetBoundScope()));
-		newscope->ParentScope = &context.Scope;
-		TheBlock->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, context.FlowResult), NULL);
-		newscope->Exit(context.Stack);
+		TheBlock->ExecuteNestedBlock(context);
 	}
 }
 
@@ -299,6 +304,11 @@ void ElseIf::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void ElseIf::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 //
 // Construct and initialize the loop wrapper operation
 //
@@ -322,15 +332,18 @@ DoWhileLoop::~DoWhileLoop()
 void DoWhileLoop::ExecuteFast(ExecutionContext& context)
 {
 	bool result;
-	std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*Body->GetBoundScope()));
-	newscope->ParentScope = &context.Scope;
+	Block::ScopeLease lease(*Body, context.Scope);
+	ActivatedScope& newscope = lease.GetScope();
 
-	newscope->Enter(context.Stack);
+	newscope.Enter(context.Stack);
+
+	FlowControlResult loopflowresult = FLOWCONTROL_NORMAL;
+	ExecutionContext loopcontext(context, newscope, loopflowresult);
 
 	do
 	{
-		FlowControlResult loopflowresult = FLOWCONTROL_NORMAL;
-		Body->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, loopflowresult), NULL, false);
+		loopflowresult = FLOWCONTROL_NORMAL;
+		Body->ExecuteBlock(loopcontext, NULL, false);
 
 		BooleanVariable condresult(context.Stack.GetCurrentTopOfStack());
 		result = condresult.GetValue();
@@ -345,7 +358,7 @@ void DoWhileLoop::ExecuteFast(ExecutionContext& context)
 		}
 	} while(result);
 
-	newscope->Exit(context.Stack);
+	newscope.Exit(context.Stack);
 }
 
 RValuePtr DoWhileLoop::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -372,12 +385,19 @@ void DoWhileLoop::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void DoWhileLoop::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 //
 // Construct and initialize the loop wrapper operation
 //
 WhileLoop::WhileLoop(Block* body)
-	: Body(body)
+	: Body(body),
+	  HoistedStorageSize(0),
+	  HotnessCounter(NULL)
 {
 }
 
@@ -386,6 +406,9 @@ WhileLoop::WhileLoop(Block* body)
 //
 WhileLoop::~WhileLoop()
 {
+	for(std::vector<Operation*>::iterator iter = HoistedOps.begin(); iter != HoistedOps.end(); ++iter)
+		delete *iter;
+
 	delete Body;
 }
 
@@ -393,25 +416,57 @@ WhileLoop::~WhileLoop()
 // Execute the contents of the while loop's body, contingent
 // upon the associated condition expression.
 //
+// Any values hoisted out of the body by the optimizer are computed once
+// up front, and kept on the stack just beneath the body's frame for the
+// duration of the loop.
+//
+// If the loop belongs to a function which may be compiled to native code,
+// the number of iterations is added to the function's hotness once the
+// loop finishes.
+//
 void WhileLoop::ExecuteFast(ExecutionContext& context)
 {
+	for(std::vector<Operation*>::const_iterator iter = HoistedOps.begin(); iter != HoistedOps.end(); ++iter)
+		(*iter)->ExecuteFast(context);
+
 	FlowControlResult loopflowresult = FLOWCONTROL_NORMAL;
-	std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*Body->GetBoundScope()));
-	newscope->ParentScope = &context.Scope;
+	Block::ScopeLease lease(*Body, context.Scope);
+	ActivatedScope& newscope = lease.GetScope();
 
-	newscope->Enter(context.Stack);
+	newscope.LoopInvariantStorage = reinterpret_cast<Byte*>(context.Stack.GetCurrentTopOfStack());
+	newscope.Enter(context.Stack);
 
+	ExecutionContext loopcontext(context, newscope, loopflowresult);
+	LONG iterations = 0;
 	do
 	{
-		Body->ExecuteBlock(ExecutionContext(context.RunningProgram, *newscope, context.Stack, loopflowresult), NULL, false);
+		Body->ExecuteBlock(loopcontext, NULL, false);
+		++iterations;
 	} while(loopflowresult == FLOWCONTROL_NORMAL);
 
-	newscope->Exit(context.Stack);
+	newscope.Exit(context.Stack);
+	context.Stack.Pop(HoistedStorageSize);
+
+	if(HotnessCounter)
+		::InterlockedExchangeAdd(HotnessCounter, iterations);
 
 	if(loopflowresult == FLOWCONTROL_RETURN)
 		context.FlowResult = loopflowresult;
 }
 
+//
+// Attach operations which are to be run once before the loop starts
+//
+// Each operation pushes one value; the values can then be read by the
+// loop body from the storage of the body's activated scope. The loop
+// takes ownership of the operations.
+//
+void WhileLoop::SetHoistedOperations(const std::vector<Operation*>& ops, size_t storagesize)
+{
+	HoistedOps.insert(HoistedOps.end(), ops.begin(), ops.end());
+	HoistedStorageSize += storagesize;
+}
+
 RValuePtr WhileLoop::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	ExecuteFast(context);
@@ -437,6 +492,11 @@ void WhileLoop::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void WhileLoop::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 //
 // Check the while loop's condition, and break if it is false
@@ -508,9 +568,13 @@ ParallelFor::ParallelFor(Block* body, const std::wstring& countervarname, bool r
 	: Body(body),
 	  CounterVariableName(countervarname),
 	  ReleaseBody(releasebody),
+	  Scheduling(ParallelForSchedule_Static),
+	  NextIteration(0),
+	  EndIteration(0),
+	  GrainSize(1),
+	  NumChunks(1),
 	  SkipInstructions(skipinstructions)
 {
-	WaitCounterDecEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
 }
 
 
@@ -518,7 +582,6 @@ ParallelFor::~ParallelFor()
 {
 	if(ReleaseBody)
 		delete Body;
-	::CloseHandle(WaitCounterDecEvent);
 }
 
 RValuePtr ParallelFor::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -552,43 +615,83 @@ void ParallelFor::ExecuteFast(ExecutionContext& context)
 		context.Stack.Pop(IntegerVariable::GetBaseStorageSize());
 	}
 
-	if(upperbound < lowerbound)
+	if(upperbound <= lowerbound)
 		return;
 
+	// All parallel loops share a single pool of worker threads; the
+	// requested thread count only determines how the loop is divided
+	Threads::ThreadPool& pool = context.RunningProgram.GetSharedThreadPool();
+
 	size_t span = upperbound - lowerbound;
-	size_t workchunksize = span / threadcount;
-	size_t partialchunksize = span % threadcount;
+	size_t numchunks = (threadcount > 0) ? static_cast<size_t>(threadcount) : pool.GetNumThreads();
+	if(numchunks > span)
+		numchunks = span;
 
-	std::wostringstream stream;
-	stream << L"__internal_threadpool_parallelfor_" << this;
-	std::wstring threadpoolname = stream.str();
-	if(!context.RunningProgram.HasThreadPool(threadpoolname))
-		context.RunningProgram.CreateThreadPool(threadpoolname, threadcount);
+	Scheduling = Config::ParallelForScheduling;
+	if(Scheduling > ParallelForSchedule_Guided)
+		Scheduling = ParallelForSchedule_Static;
 
-	unsigned waitcounter = threadcount;
+	GrainSize = static_cast<LONG>(std::max(Config::ParallelForGrainSize, 1u));
+	NumChunks = static_cast<LONG>(numchunks);
+	EndIteration = static_cast<LONG>(upperbound);
+	::InterlockedExchange(&NextIteration, static_cast<LONG>(lowerbound));
 
-	size_t allocatedchunkspace = 0;
-	while(allocatedchunkspace < span)
+	if(!Reductions.empty())
 	{
-		size_t chunklowerbound = allocatedchunkspace;
+		const ScopeDescription& bodyscope = *Body->GetBoundScope();
+		for(std::vector<Reduction>::iterator iter = Reductions.begin(); iter != Reductions.end(); ++iter)
+			iter->VariableType = bodyscope.GetVariableType(iter->VariableName);
 
-		if(span - allocatedchunkspace <= (workchunksize + partialchunksize))
-			allocatedchunkspace = span;
-		else
-			allocatedchunkspace += workchunksize;
+		PartialResults.clear();
+		PartialResults.resize(numchunks);
+	}
+
+	PendingChunks.Reset(static_cast<unsigned>(numchunks));
 
-		size_t chunkupperbound = allocatedchunkspace;
+	// Cancelling whatever is running this loop also cancels the loop itself
+	Cancellation.Reset(context.Cancellation);
 
-		std::wostringstream stream;
-		stream << L"__internal_thread_parallelfor_" << chunklowerbound << L"_" << chunkupperbound;
-		std::auto_ptr<Threads::PoolWorkItem> workitem(new ParallelForWorkItem(*this, &context.Scope, *Body, context.RunningProgram, chunklowerbound, chunkupperbound, CounterVariableName, SkipInstructions));
-		context.RunningProgram.AddPoolWorkItem(threadpoolname, stream.str(), workitem);
+	for(size_t i = 0; i < numchunks; ++i)
+	{
+		// With dynamic scheduling, work items claim their iterations as they go
+		size_t chunklowerbound = 0;
+		size_t chunkupperbound = 0;
+
+		if(Scheduling == ParallelForSchedule_Static)
+		{
+			chunklowerbound = lowerbound + (span * i) / numchunks;
+			chunkupperbound = lowerbound + (span * (i + 1)) / numchunks;
+		}
+
+		pool.AddWorkItem(new ParallelForWorkItem(*this, &context.Scope, *Body, context.RunningProgram, i, chunklowerbound, chunkupperbound, CounterVariableName, SkipInstructions), Threads::WorkPriority_Batch);
 	}
 
-	while(waitcounter > 0)
+	// Help out with the loop while waiting for it to finish
 	{
-		::WaitForSingleObject(WaitCounterDecEvent, INFINITE);
-		--waitcounter;
+		Threads::Telemetry::WaitTimer jointimer(Threads::Telemetry::Wait_ParallelForJoin);
+		Threads::Tracing::Span joinspan("Parallel loop join", numchunks);
+		while(!PendingChunks.IsReleased())
+		{
+			if(!pool.RunPendingWorkItem())
+				PendingChunks.Wait();
+		}
+	}
+
+	// Fold each chunk's private accumulators into the reduction variables;
+	// chunks are always combined in the same order, so that real-valued
+	// results do not depend on which work items happened to finish first.
+	// If the loop was cancelled, the results cover only some of the
+	// iterations, and should not be relied upon.
+	if(!Reductions.empty())
+	{
+		ReductionValueList results;
+		LoadReductionValues(context.Scope, results);
+
+		for(std::vector<ReductionValueList>::const_iterator iter = PartialResults.begin(); iter != PartialResults.end(); ++iter)
+			CombineReductionValues(results, *iter);
+
+		StoreReductionValues(context.Scope, results);
+		PartialResults.clear();
 	}
 }
 
@@ -612,7 +715,197 @@ void ParallelFor::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void ParallelFor::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
+//
+// Take the next range of loop iterations to be executed
+//
+// This is used by work items when dynamic or guided scheduling is in
+// effect. Dynamic scheduling hands out ranges of the grain size; guided
+// scheduling hands out a share of the remaining iterations proportional
+// to the number of work items, but never less than the grain size.
+// Returns false once all iterations have been claimed, or if the loop
+// has been cancelled.
+//
+bool ParallelFor::ClaimIterations(size_t& lowerbound, size_t& upperbound)
+{
+	if(Cancellation.IsCancelled())
+		return false;
+
+	if(Scheduling == ParallelForSchedule_Dynamic)
+	{
+		LONG first = ::InterlockedExchangeAdd(&NextIteration, GrainSize);
+		if(first >= EndIteration)
+			return false;
+
+		lowerbound = static_cast<size_t>(first);
+		upperbound = static_cast<size_t>(std::min(first + GrainSize, EndIteration));
+		return true;
+	}
+
+	while(true)
+	{
+		LONG first = NextIteration;
+		if(first >= EndIteration)
+			return false;
+
+		LONG count = std::max((EndIteration - first) / (2 * NumChunks), GrainSize);
+		LONG last = std::min(first + count, EndIteration);
+		if(::InterlockedCompareExchange(&NextIteration, last, first) == first)
+		{
+			lowerbound = static_cast<size_t>(first);
+			upperbound = static_cast<size_t>(last);
+			return true;
+		}
+	}
+}
+
 void ParallelFor::DecrementWaitCounter()
 {
-	::SetEvent(WaitCounterDecEvent);
+	PendingChunks.CountDown();
+}
+
+
+//
+// Register a variable which is reduced across all iterations of the loop
+//
+// The variable must be an integer or real variable visible to the loop;
+// the loop body sees a private copy of it, which is folded back into
+// the original once the loop has finished.
+//
+void ParallelFor::AddReduction(ReductionOperator op, const std::wstring& varname)
+{
+	if(op > Reduction_Max)
+		throw ExecutionException("Invalid reduction operator in parallelfor()");
+
+	Reduction reduction;
+	reduction.Operator = op;
+	reduction.VariableName = varname;
+	reduction.VariableType = EpochVariableType_Error;
+	Reductions.push_back(reduction);
+}
+
+//
+// Set each accumulator to the identity value of its reduction operator
+//
+void ParallelFor::InitializeReductionValues(ReductionValueList& values) const
+{
+	values.resize(Reductions.size());
+	for(size_t i = 0; i < Reductions.size(); ++i)
+	{
+		switch(Reductions[i].Operator)
+		{
+		case Reduction_Sum:
+			values[i].IntegerValue = 0;
+			values[i].RealValue = 0.0f;
+			break;
+
+		case Reduction_Product:
+			values[i].IntegerValue = 1;
+			values[i].RealValue = 1.0f;
+			break;
+
+		case Reduction_Min:
+			values[i].IntegerValue = std::numeric_limits<Integer32>::max();
+			values[i].RealValue = std::numeric_limits<Real>::max();
+			break;
+
+		case Reduction_Max:
+			values[i].IntegerValue = std::numeric_limits<Integer32>::min();
+			values[i].RealValue = -std::numeric_limits<Real>::max();
+			break;
+		}
+	}
+}
+
+//
+// Write accumulators into the reduction variables visible from the given scope
+//
+void ParallelFor::StoreReductionValues(ActivatedScope& scope, const ReductionValueList& values) const
+{
+	for(size_t i = 0; i < Reductions.size(); ++i)
+	{
+		if(Reductions[i].VariableType == EpochVariableType_Real)
+			scope.SetVariableValue(Reductions[i].VariableName, RValuePtr(new RealRValue(values[i].RealValue)));
+		else
+			scope.SetVariableValue(Reductions[i].VariableName, RValuePtr(new IntegerRValue(values[i].IntegerValue)));
+	}
+}
+
+//
+// Read the reduction variables visible from the given scope back into accumulators
+//
+void ParallelFor::LoadReductionValues(const ActivatedScope& scope, ReductionValueList& values) const
+{
+	values.resize(Reductions.size());
+	for(size_t i = 0; i < Reductions.size(); ++i)
+	{
+		RValuePtr value = scope.GetVariableValue(Reductions[i].VariableName);
+		if(Reductions[i].VariableType == EpochVariableType_Real)
+			values[i].RealValue = value->CastTo<RealRValue>().GetValue();
+		else
+			values[i].IntegerValue = value->CastTo<IntegerRValue>().GetValue();
+	}
+}
+
+//
+// Record the private accumulators of a finished chunk of the loop
+//
+// Each chunk has its own slot, so no locking is needed; the slots are
+// only read once every chunk has signalled completion.
+//
+void ParallelFor::SubmitPartialResults(size_t chunkindex, const ReductionValueList& values)
+{
+	if(chunkindex < PartialResults.size())
+		PartialResults[chunkindex] = values;
+}
+
+//
+// Fold one set of accumulators into another
+//
+void ParallelFor::CombineReductionValues(ReductionValueList& accumulated, const ReductionValueList& values) const
+{
+	if(values.size() != Reductions.size())
+		return;
+
+	for(size_t i = 0; i < Reductions.size(); ++i)
+	{
+		ReductionValue& target = accumulated[i];
+		const ReductionValue& source = values[i];
+		bool isreal = (Reductions[i].VariableType == EpochVariableType_Real);
+
+		switch(Reductions[i].Operator)
+		{
+		case Reduction_Sum:
+			if(isreal)
+				target.RealValue += source.RealValue;
+			else
+				target.IntegerValue += source.IntegerValue;
+			break;
+
+		case Reduction_Product:
+			if(isreal)
+				target.RealValue *= source.RealValue;
+			else
+				target.IntegerValue *= source.IntegerValue;
+			break;
+
+		case Reduction_Min:
+			if(isreal)
+				target.RealValue = std::min(target.RealValue, source.RealValue);
+			else
+				target.IntegerValue = std::min(target.IntegerValue, source.IntegerValue);
+			break;
+
+		case Reduction_Max:
+			if(isreal)
+				target.RealValue = std::max(target.RealValue, source.RealValue);
+			else
+				target.IntegerValue = std::max(target.IntegerValue, source.IntegerValue);
+			break;
+		}
+	}
 }
@@ -9,12 +9,15 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Concurrency/CancellationToken.h"
+#include "Utility/Threading/Synchronization.h"
 
 
 namespace VM
 {
 	// Forward declarations
 	class Block;
+	class ActivatedScope;
 
 	namespace Operations
 	{
@@ -51,6 +54,9 @@ namespace VM
 			Block* Detach()
 			{ Block* ret = Body; Body = NULL; return ret; }
 
+			Block* GetBody() const
+			{ return Body; }
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -58,6 +64,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -92,6 +99,12 @@ namespace VM
 			ElseIfWrapper* GetElseIfBlock()
 			{ return ElseIfBlocks; }
 
+			Block* GetTrueBlock()
+			{ return TrueBlock; }
+
+			Block* GetFalseBlock()
+			{ return FalseBlock; }
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -99,6 +112,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -143,6 +157,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -170,6 +185,11 @@ namespace VM
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
 			{ return 1; }
 
+		// Clause access
+		public:
+			Block* GetBlock()
+			{ return TheBlock; }
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -177,6 +197,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal tracking
 		private:
@@ -214,6 +235,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 			virtual Block* GetAttachedCodeBlock() const
 			{
@@ -257,15 +279,38 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 			virtual Block* GetAttachedCodeBlock() const
 			{
 				return Body;
 			}
 
+		// Additional accessors
+		public:
+			Block* GetBody() const
+			{ return Body; }
+
+		// Loop invariant hoisting
+		public:
+			void SetHoistedOperations(const std::vector<Operation*>& ops, size_t storagesize);
+
+			bool HasHoistedOperations() const
+			{ return !HoistedOps.empty(); }
+
+		// Hotness tracking for native code compilation
+		public:
+			void AttachHotnessCounter(volatile LONG* counter)
+			{ HotnessCounter = counter; }
+
 		// Internal tracking
 		private:
 			Block* Body;
+
+			std::vector<Operation*> HoistedOps;
+			size_t HoistedStorageSize;
+
+			volatile LONG* HotnessCounter;
 		};
 
 		//
@@ -373,6 +418,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Additional accessors
 		public:
@@ -383,6 +429,76 @@ namespace VM
 		public:
 			void DecrementWaitCounter();
 
+		// Cancellation
+		public:
+			void Cancel()
+			{ Cancellation.Cancel(); }
+
+			bool IsCancelled() const
+			{ return Cancellation.IsCancelled(); }
+
+			const CancellationToken& GetCancellationToken() const
+			{ return Cancellation; }
+
+		// Iteration scheduling
+		public:
+			bool ClaimIterations(size_t& lowerbound, size_t& upperbound);
+
+			bool HasDynamicScheduling() const
+			{ return (Scheduling != ParallelForSchedule_Static); }
+
+			enum ScheduleMode
+			{
+				ParallelForSchedule_Static = 0,
+				ParallelForSchedule_Dynamic = 1,
+				ParallelForSchedule_Guided = 2
+			};
+
+		// Reduction variables
+		public:
+			enum ReductionOperator
+			{
+				Reduction_Sum = 0,
+				Reduction_Product = 1,
+				Reduction_Min = 2,
+				Reduction_Max = 3
+			};
+
+			struct Reduction
+			{
+				ReductionOperator Operator;
+				std::wstring VariableName;
+				EpochVariableTypeID VariableType;
+			};
+
+			//
+			// Private accumulator for a single reduction variable
+			//
+			// Only the member matching the variable's type is used.
+			//
+			struct ReductionValue
+			{
+				Integer32 IntegerValue;
+				Real RealValue;
+			};
+
+			typedef std::vector<ReductionValue> ReductionValueList;
+
+			void AddReduction(ReductionOperator op, const std::wstring& varname);
+
+			const std::vector<Reduction>& GetReductions() const
+			{ return Reductions; }
+
+			void InitializeReductionValues(ReductionValueList& values) const;
+			void StoreReductionValues(ActivatedScope& scope, const ReductionValueList& values) const;
+			void LoadReductionValues(const ActivatedScope& scope, ReductionValueList& values) const;
+
+			void SubmitPartialResults(size_t chunkindex, const ReductionValueList& values);
+
+		// Internal helpers
+		protected:
+			void CombineReductionValues(ReductionValueList& accumulated, const ReductionValueList& values) const;
+
 		// Internal tracking
 		protected:
 			Block* Body;
@@ -390,9 +506,19 @@ namespace VM
 
 			bool ReleaseBody;
 
-			HANDLE WaitCounterDecEvent;
+			Threads::CountdownLatch PendingChunks;
+			CancellationToken Cancellation;
+
+			unsigned Scheduling;
+			volatile LONG NextIteration;
+			LONG EndIteration;
+			LONG GrainSize;
+			LONG NumChunks;
 
 			unsigned SkipInstructions;
+
+			std::vector<Reduction> Reductions;
+			std::vector<ReductionValueList> PartialResults;
 		};
 	}
 }
@@ -23,7 +23,8 @@ using namespace VM::Operations;
 //
 Invoke::Invoke(FunctionBase* function, bool cleanupfunction)
 	: Function(function),
-	  CleanUpFunction(cleanupfunction)
+	  CleanUpFunction(cleanupfunction),
+	  TailCallFunction(NULL)
 {
 }
 
@@ -40,6 +41,11 @@ Invoke::~Invoke()
 //
 // Invoke the bound Epoch function
 //
+// Calls in tail position of the function's own body are handed back to
+// the running invocation of the function, which restarts its body with
+// the new parameters instead of nesting another call; see the tail call
+// pass in the optimizer for details.
+//
 RValuePtr Invoke::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	return Function->Invoke(context);
@@ -47,9 +53,20 @@ RValuePtr Invoke::ExecuteAndStoreRValue(ExecutionContext& context)
 
 void Invoke::ExecuteFast(ExecutionContext& context)
 {
+	if(TailCallFunction && TailCallFunction->BeginTailCall(context))
+		return;
+
 	Function->Invoke(context);
 }
 
+bool Invoke::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	if(TailCallFunction && TailCallFunction->BeginTailCall(context))
+		return true;
+
+	return Function->InvokeAndPushResult(context);
+}
+
 //
 // Retrieve the function's return type
 //
@@ -84,6 +101,11 @@ void Invoke::Traverse(Serialization::SerializationTraverser& traverser)
 	traverser.TraverseNode(*this);
 }
 
+void Invoke::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 Traverser::Payload Invoke::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
 {
 	Traverser::Payload payload;
@@ -98,12 +120,23 @@ Traverser::Payload Invoke::GetNodeTraversalPayload(const VM::ScopeDescription* s
 //
 RValuePtr InvokeIndirect::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	return context.Scope.GetFunction(FunctionName)->Invoke(context);
+	return LookupFunction(context)->Invoke(context);
 }
 
 void InvokeIndirect::ExecuteFast(ExecutionContext& context)
 {
-	context.Scope.GetFunction(FunctionName)->Invoke(context);
+	LookupFunction(context)->Invoke(context);
+}
+
+//
+// Find the function currently bound to the invoked name
+//
+FunctionBase* InvokeIndirect::LookupFunction(ExecutionContext& context)
+{
+	const ScopeDescription* bindingscope = BindingScope;
+	FunctionBase* function = context.Scope.GetFunction(FunctionName, bindingscope);
+	BindingScope = bindingscope;
+	return function;
 }
 
 //
@@ -150,3 +183,8 @@ void InvokeIndirect::Traverse(Serialization::SerializationTraverser& traverser)
 	traverser.TraverseNode(*this);
 }
 
+void InvokeIndirect::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
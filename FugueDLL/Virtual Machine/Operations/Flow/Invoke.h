@@ -17,6 +17,7 @@ namespace VM
 
 	// Forward declarations
 	class FunctionBase;
+	class Function;
 
 
 	namespace Operations
@@ -36,6 +37,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const;
 
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const;
@@ -45,6 +47,14 @@ namespace VM
 			FunctionBase* GetFunction() const
 			{ return Function; }
 
+		// Tail calls
+		public:
+			void MarkAsTailCall(VM::Function* function)
+			{ TailCallFunction = function; }
+
+			bool IsTailCall() const
+			{ return (TailCallFunction != NULL); }
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -52,6 +62,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -60,6 +71,7 @@ namespace VM
 		private:
 			FunctionBase* Function;
 			bool CleanUpFunction;
+			VM::Function* TailCallFunction;
 		};
 
 
@@ -72,7 +84,8 @@ namespace VM
 		// Construction
 		public:
 			InvokeIndirect(const std::wstring& functionname)
-				: FunctionName(functionname)
+				: FunctionName(functionname),
+				  BindingScope(NULL)
 			{ }
 
 		// Operation interface
@@ -88,6 +101,10 @@ namespace VM
 			const std::wstring& GetFunctionName() const
 			{ return FunctionName; }
 
+		// Internal helpers
+		private:
+			FunctionBase* LookupFunction(ExecutionContext& context);
+
 		// Traversal interface
 		protected:
 			template <typename TraverserT>
@@ -95,6 +112,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
 			{
@@ -108,6 +126,11 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& FunctionName;
+
+			// Scope which supplied the function binding on the last call;
+			// this is only a hint, and is validated on every lookup, so it
+			// is safe for threads sharing the operation to overwrite it
+			const ScopeDescription* volatile BindingScope;
 		};
 
 	}
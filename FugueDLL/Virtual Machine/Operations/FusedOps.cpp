@@ -0,0 +1,136 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Implementation of fused operations which are not templated
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/FusedOps.h"
+
+#include "Virtual Machine/Core Entities/Block.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Largest ratio of table entries to clauses for which
+	// a switch still uses a directly indexed table
+	//
+	const size_t MaxDenseTableRatio = 2;
+
+
+	//
+	// Ordering and matching of switch clauses by their literal values
+	//
+	bool CaseValueLess(const FusedIntegerSwitch::Case& lhs, const FusedIntegerSwitch::Case& rhs)
+	{
+		return (lhs.Value < rhs.Value);
+	}
+
+	bool CaseValueEqual(const FusedIntegerSwitch::Case& lhs, const FusedIntegerSwitch::Case& rhs)
+	{
+		return (lhs.Value == rhs.Value);
+	}
+
+}
+
+
+//
+// Construct and initialize an integer switch operation
+//
+// The clauses must be given in their original order, so that the first
+// of several clauses sharing the same literal is the one which is kept.
+//
+FusedIntegerSwitch::FusedIntegerSwitch(const std::wstring& varname, const VariableSlot& slot, const std::vector<Case>& cases, Block* defaultbody, const std::vector<Operation*>& originalops)
+	: VarName(varname),
+	  Slot(slot),
+	  Cases(cases),
+	  MinimumValue(0),
+	  DefaultBody(defaultbody),
+	  OriginalOps(originalops)
+{
+	std::stable_sort(Cases.begin(), Cases.end(), CaseValueLess);
+	Cases.erase(std::unique(Cases.begin(), Cases.end(), CaseValueEqual), Cases.end());
+
+	if(Cases.empty())
+		return;
+
+	MinimumValue = Cases.front().Value;
+	UInteger32 span = static_cast<UInteger32>(Cases.back().Value) - static_cast<UInteger32>(MinimumValue);
+	if(span / MaxDenseTableRatio >= Cases.size())
+		return;
+
+	DenseTable.resize(span + 1, NULL);
+	for(std::vector<Case>::const_iterator iter = Cases.begin(); iter != Cases.end(); ++iter)
+		DenseTable[static_cast<UInteger32>(iter->Value) - static_cast<UInteger32>(MinimumValue)] = &(*iter);
+}
+
+//
+// Destruct and clean up an integer switch operation
+//
+FusedIntegerSwitch::~FusedIntegerSwitch()
+{
+	for(std::vector<Operation*>::iterator iter = OriginalOps.begin(); iter != OriginalOps.end(); ++iter)
+		delete *iter;
+}
+
+
+//
+// Execute the block selected by the value of the switch variable
+//
+// Elseif clauses signal the end of the chain when they finish, exactly
+// as they would have without the switch; that signal is absorbed here in
+// place of the original if operation.
+//
+void FusedIntegerSwitch::ExecuteFast(ExecutionContext& context)
+{
+	const Case* selected = FindCase(context.Scope.GetVariableRef<IntegerVariable>(Slot, VarName).GetValue());
+
+	Block* body = selected ? selected->Body : DefaultBody;
+	if(body)
+		body->ExecuteNestedBlock(context);
+
+	if(context.FlowResult == FLOWCONTROL_EXITELSEIFWRAPPER)
+		context.FlowResult = FLOWCONTROL_NORMAL;
+}
+
+RValuePtr FusedIntegerSwitch::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return RValuePtr(new NullRValue);
+}
+
+//
+// Locate the clause for the given value, if there is one
+//
+const FusedIntegerSwitch::Case* FusedIntegerSwitch::FindCase(Integer32 value) const
+{
+	if(!DenseTable.empty())
+	{
+		// Values below the minimum wrap around to large offsets, so
+		// a single comparison rejects values on either side of the table
+		UInteger32 offset = static_cast<UInteger32>(value) - static_cast<UInteger32>(MinimumValue);
+		if(offset >= DenseTable.size())
+			return NULL;
+
+		return DenseTable[offset];
+	}
+
+	Case key;
+	key.Value = value;
+	key.Body = NULL;
+
+	std::vector<Case>::const_iterator iter = std::lower_bound(Cases.begin(), Cases.end(), key, CaseValueLess);
+	if(iter == Cases.end() || iter->Value != value)
+		return NULL;
+
+	return &(*iter);
+}
@@ -0,0 +1,272 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Fused operations, each of which replaces a short, commonly occurring
+// sequence of simpler operations. These are generated by the optimizer
+// only; the parser and bytecode loader never produce them directly.
+//
+// Each fused operation does the work of the original sequence without
+// the intermediate stack traffic and virtual calls. For example, the
+// statement "x = x + 1" normally becomes four operations: push the
+// value of x, push the literal, add the two values on the stack, and
+// pop the result into x. The fused form reads x, adds the literal, and
+// writes the result back into x directly.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+
+
+namespace VM
+{
+
+	// Forward declarations
+	class Block;
+
+
+	namespace Operations
+	{
+
+		//
+		// Comparisons available to fused operations
+		//
+		enum FusedComparisonType
+		{
+			FusedComparison_Equal,
+			FusedComparison_NotEqual,
+			FusedComparison_Greater,
+			FusedComparison_GreaterOrEqual,
+			FusedComparison_Lesser,
+			FusedComparison_LesserOrEqual
+		};
+
+
+		//
+		// Base class for all fused operations
+		//
+		// All fused operations share this single traversal identity, so
+		// the traversal subsystems only need to handle one class. Fused
+		// operations are never serialized; the optimizer does not run on
+		// programs which are destined for serialization.
+		//
+		class FusedOperation : public Operation, public SelfAware<FusedOperation>
+		{
+		// Operation interface (partial)
+		public:
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+		};
+
+
+		//
+		// Apply an arithmetic operator to a variable and a literal,
+		// and push the result onto the stack
+		//
+		template<ArithmeticOpType OpType, class VarType>
+		class FusedVariableLiteralArithmetic : public FusedOperation
+		{
+		// Construction
+		public:
+			FusedVariableLiteralArithmetic(const std::wstring& varname, const VariableSlot& slot, typename VarType::BaseStorage literalvalue)
+				: VarName(varname),
+				  Slot(slot),
+				  LiteralValue(literalvalue)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return VarType::GetStaticType(); }
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			VariableSlot Slot;
+			typename VarType::BaseStorage LiteralValue;
+		};
+
+
+		//
+		// Apply an arithmetic operator to a variable and a literal,
+		// and store the result into a variable (possibly the same one)
+		//
+		template<ArithmeticOpType OpType, class VarType>
+		class FusedVariableLiteralArithmeticAssign : public FusedOperation
+		{
+		// Construction
+		public:
+			FusedVariableLiteralArithmeticAssign(const std::wstring& varname, const VariableSlot& slot, typename VarType::BaseStorage literalvalue, const std::wstring& targetname, const VariableSlot& targetslot)
+				: VarName(varname),
+				  Slot(slot),
+				  LiteralValue(literalvalue),
+				  TargetName(targetname),
+				  TargetSlot(targetslot)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return VarType::GetStaticType(); }
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			VariableSlot Slot;
+			typename VarType::BaseStorage LiteralValue;
+
+			const std::wstring& TargetName;
+			VariableSlot TargetSlot;
+		};
+
+
+		//
+		// Compare a variable with a literal, and push the
+		// boolean result onto the stack
+		//
+		template<FusedComparisonType ComparisonType, class VarType>
+		class FusedVariableLiteralComparison : public FusedOperation
+		{
+		// Construction
+		public:
+			FusedVariableLiteralComparison(const std::wstring& varname, const VariableSlot& slot, typename VarType::BaseStorage literalvalue)
+				: VarName(varname),
+				  Slot(slot),
+				  LiteralValue(literalvalue)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return VarName; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+			typename VarType::BaseStorage GetLiteralValue() const
+			{ return LiteralValue; }
+
+		// Internal helpers
+		private:
+			bool Compare(ExecutionContext& context);
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			VariableSlot Slot;
+			typename VarType::BaseStorage LiteralValue;
+		};
+
+
+		//
+		// Select a block to execute based on the value of an integer variable
+		//
+		// This replaces an if/elseif/else chain in which every condition
+		// compares the same integer variable against a different literal.
+		// Instead of testing the conditions in turn, the variable is read
+		// once and the matching block is found directly: through a table
+		// indexed by the value when the literals are packed closely enough,
+		// or by binary search over the sorted literals otherwise.
+		//
+		// The original operations are kept by the switch, since they still
+		// own the blocks of code for each clause.
+		//
+		class FusedIntegerSwitch : public FusedOperation
+		{
+		// Clause information
+		public:
+			struct Case
+			{
+				Integer32 Value;
+				Block* Body;
+			};
+
+		// Construction and destruction
+		public:
+			FusedIntegerSwitch(const std::wstring& varname, const VariableSlot& slot, const std::vector<Case>& cases, Block* defaultbody, const std::vector<Operation*>& originalops);
+			virtual ~FusedIntegerSwitch();
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Null; }
+
+		// Internal helpers
+		private:
+			const Case* FindCase(Integer32 value) const;
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			VariableSlot Slot;
+
+			std::vector<Case> Cases;
+			std::vector<const Case*> DenseTable;
+			Integer32 MinimumValue;
+			Block* DefaultBody;
+
+			std::vector<Operation*> OriginalOps;
+		};
+
+
+		//
+		// Push a value which was computed before the enclosing loop started
+		//
+		// The optimizer moves computations whose results cannot change
+		// between iterations out of while loop bodies. The results are kept
+		// on the stack beneath the body's frame, and this operation copies
+		// the appropriate result back onto the stack in place of the
+		// original computation.
+		//
+		template<class VarType>
+		class FusedPushLoopInvariant : public FusedOperation
+		{
+		// Construction
+		public:
+			explicit FusedPushLoopInvariant(size_t offset)
+				: Offset(offset)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return VarType::GetStaticType(); }
+
+		// Internal tracking
+		private:
+			size_t Offset;
+		};
+
+	}
+
+}
+
+
+#include "FusedOps.inl"
+
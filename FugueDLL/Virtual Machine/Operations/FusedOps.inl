@@ -0,0 +1,104 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Implementation of fused operations
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/FusedOps.h"
+#include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+
+
+//
+// Push the result of an arithmetic operation between a variable and a literal
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType>
+void VM::Operations::FusedVariableLiteralArithmetic<OpType, VarType>::ExecuteFast(ExecutionContext& context)
+{
+	typename VarType::BaseStorage value = ApplyArithmeticOperator<OpType>(context.Scope.GetVariableRef<VarType>(Slot, VarName).GetValue(), LiteralValue);
+	context.Stack.Push(VarType::GetStorageSize());
+	VarType(context.Stack.GetCurrentTopOfStack()).SetValue(value);
+}
+
+template<VM::Operations::ArithmeticOpType OpType, class VarType>
+VM::RValuePtr VM::Operations::FusedVariableLiteralArithmetic<OpType, VarType>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return VarType(context.Stack.GetCurrentTopOfStack()).GetAsRValue();
+}
+
+
+//
+// Store the result of an arithmetic operation between a variable and a literal
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType>
+void VM::Operations::FusedVariableLiteralArithmeticAssign<OpType, VarType>::ExecuteFast(ExecutionContext& context)
+{
+	typename VarType::BaseStorage value = ApplyArithmeticOperator<OpType>(context.Scope.GetVariableRef<VarType>(Slot, VarName).GetValue(), LiteralValue);
+	context.Scope.GetVariableRef<VarType>(TargetSlot, TargetName).SetValue(value);
+}
+
+template<VM::Operations::ArithmeticOpType OpType, class VarType>
+VM::RValuePtr VM::Operations::FusedVariableLiteralArithmeticAssign<OpType, VarType>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return context.Scope.GetVariableRef<VarType>(TargetSlot, TargetName).GetAsRValue();
+}
+
+
+//
+// Compare a variable with a literal
+//
+template<VM::Operations::FusedComparisonType ComparisonType, class VarType>
+bool VM::Operations::FusedVariableLiteralComparison<ComparisonType, VarType>::Compare(ExecutionContext& context)
+{
+	typename VarType::BaseStorage value = context.Scope.GetVariableRef<VarType>(Slot, VarName).GetValue();
+
+	switch(ComparisonType)
+	{
+	case FusedComparison_Equal:				return (value == LiteralValue);
+	case FusedComparison_NotEqual:			return (value != LiteralValue);
+	case FusedComparison_Greater:			return (value > LiteralValue);
+	case FusedComparison_GreaterOrEqual:	return (value >= LiteralValue);
+	case FusedComparison_Lesser:			return (value < LiteralValue);
+	case FusedComparison_LesserOrEqual:		return (value <= LiteralValue);
+	}
+
+	throw InternalFailureException("Unrecognized comparison in fused operation");
+}
+
+template<VM::Operations::FusedComparisonType ComparisonType, class VarType>
+void VM::Operations::FusedVariableLiteralComparison<ComparisonType, VarType>::ExecuteFast(ExecutionContext& context)
+{
+	bool result = Compare(context);
+	context.Stack.Push(BooleanVariable::GetStorageSize());
+	BooleanVariable(context.Stack.GetCurrentTopOfStack()).SetValue(result);
+}
+
+template<VM::Operations::FusedComparisonType ComparisonType, class VarType>
+VM::RValuePtr VM::Operations::FusedVariableLiteralComparison<ComparisonType, VarType>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return BooleanVariable(context.Stack.GetCurrentTopOfStack()).GetAsRValue();
+}
+
+
+//
+// Copy a precomputed loop invariant value onto the stack
+//
+template<class VarType>
+void VM::Operations::FusedPushLoopInvariant<VarType>::ExecuteFast(ExecutionContext& context)
+{
+	context.Stack.Push(VarType::GetStorageSize());
+	memcpy(context.Stack.GetCurrentTopOfStack(), context.Scope.LoopInvariantStorage + Offset, VarType::GetStorageSize());
+}
+
+template<class VarType>
+VM::RValuePtr VM::Operations::FusedPushLoopInvariant<VarType>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	ExecuteFast(context);
+	return VarType(context.Stack.GetCurrentTopOfStack()).GetAsRValue();
+}
+
@@ -8,6 +8,10 @@
 #include "pch.h"
 
 #include "Virtual Machine/Operations/Operators/Arithmetic.h"
+#include "Virtual Machine/Operations/Operators/VectorArithmetic.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
+#include "Virtual Machine/Garbage Collection/GarbageCollector.h"
 #include "Virtual Machine/Routines.inl"
 
 
@@ -56,3 +60,163 @@ RValuePtr Negate::ExecuteAndStoreRValue(ExecutionContext& context)
 	}
 }
 
+//
+// Execute a negation operation, placing the result directly on the stack
+//
+// Negation leaves the stack size unchanged, so we simply overwrite
+// the operand with the result in place.
+//
+bool Negate::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	switch(Type)
+	{
+	case VM::EpochVariableType_Integer:
+		{
+			IntegerVariable var(context.Stack.GetCurrentTopOfStack());
+			var.SetValue(-var.GetValue());
+			return true;
+		}
+
+	case VM::EpochVariableType_Integer16:
+		{
+			Integer16Variable var(context.Stack.GetCurrentTopOfStack());
+			var.SetValue(-var.GetValue());
+			return true;
+		}
+
+	case VM::EpochVariableType_Real:
+		{
+			RealVariable var(context.Stack.GetCurrentTopOfStack());
+			var.SetValue(-var.GetValue());
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+namespace
+{
+
+	//
+	// Operand of an element-wise arithmetic operation
+	//
+	// Scalar operands are copied out of the stack, so that they remain
+	// valid after the stack space is released; array operands refer
+	// directly to the pooled array storage.
+	//
+	struct ElementwiseOperand
+	{
+		union
+		{
+			Integer32 IntegerValue;
+			Integer16 Integer16Value;
+			Real RealValue;
+		} Scalar;
+
+		const void* ArrayElements;
+		size_t Count;
+		bool IsScalar;
+
+		template <typename ElementType>
+		const ElementType* GetElements() const
+		{ return reinterpret_cast<const ElementType*>(IsScalar ? &Scalar : ArrayElements); }
+	};
+
+	//
+	// Retrieve an element-wise arithmetic operand from the top of the stack
+	//
+	ElementwiseOperand PopElementwiseOperand(StackSpace& stack, EpochVariableTypeID elementtype, bool isarray)
+	{
+		ElementwiseOperand operand;
+
+		if(isarray)
+		{
+			ArrayVariable arrayvar(stack.GetCurrentTopOfStack());
+			if(arrayvar.GetElementType() != elementtype)
+				throw ExecutionException("Type mismatch");
+
+			operand.Count = arrayvar.GetNumElements();
+			operand.ArrayElements = operand.Count ? ArrayVariable::GetArrayStorage(arrayvar.GetValue()) : NULL;
+			operand.IsScalar = false;
+			stack.Pop(arrayvar.GetStorageSize());
+		}
+		else
+		{
+			size_t size = TypeInfo::GetStorageSize(elementtype);
+			memcpy(&operand.Scalar, stack.GetCurrentTopOfStack(), size);
+			stack.Pop(size);
+
+			operand.ArrayElements = NULL;
+			operand.Count = 1;
+			operand.IsScalar = true;
+		}
+
+		return operand;
+	}
+
+	//
+	// Run the vector kernel matching the element type of the operands
+	//
+	template <typename ElementType>
+	void ApplyElementwiseOperands(ArithmeticOpType optype, const ElementwiseOperand& one, const ElementwiseOperand& two, void* result, size_t count)
+	{
+		ApplyElementwiseArithmetic(optype, one.GetElements<ElementType>(), one.IsScalar, two.GetElements<ElementType>(), two.IsScalar, reinterpret_cast<ElementType*>(result), count);
+	}
+
+}
+
+
+//
+// Execute an element-wise arithmetic operation
+//
+void ElementwiseArithmetic::ExecuteFast(ExecutionContext& context)
+{
+	// Nothing to do here; the result is only meaningful as an r-value, and
+	// evaluating the operands has no effect on program state.
+}
+
+RValuePtr ElementwiseArithmetic::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	// The operand arrays are read directly after their handles have been
+	// popped off the stack, so collection must be held off until done
+	GarbageCollector::Deferral deferral;
+
+	// The second operand is on top of the stack
+	ElementwiseOperand two = PopElementwiseOperand(context.Stack, ElementType, SecondIsArray);
+	ElementwiseOperand one = PopElementwiseOperand(context.Stack, ElementType, FirstIsArray);
+
+	if(FirstIsArray && SecondIsArray && one.Count != two.Count)
+		throw ExecutionException("Arrays passed to element-wise arithmetic must have the same number of elements");
+
+	size_t count = FirstIsArray ? one.Count : two.Count;
+
+	HandleType resulthandle = ArrayVariable::AllocateNewHandle(ElementType, count);
+	RValuePtr result(new ArrayRValue(resulthandle, false));
+	if(!count)
+		return result;
+
+	void* storage = ArrayVariable::GetArrayStorage(resulthandle);
+
+	switch(ElementType)
+	{
+	case EpochVariableType_Integer:
+		ApplyElementwiseOperands<Integer32>(OpType, one, two, storage, count);
+		break;
+
+	case EpochVariableType_Integer16:
+		ApplyElementwiseOperands<Integer16>(OpType, one, two, storage, count);
+		break;
+
+	case EpochVariableType_Real:
+		ApplyElementwiseOperands<Real>(OpType, one, two, storage, count);
+		break;
+
+	default:
+		throw ExecutionException("Element-wise arithmetic is not supported on arrays of this type");
+	}
+
+	return result;
+}
+
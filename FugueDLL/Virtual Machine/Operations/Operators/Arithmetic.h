@@ -34,6 +34,35 @@ namespace VM
 			Arithmetic_Divide
 		};
 
+		//
+		// Possible combinations of parameters to an arithmetic operation
+		//
+		enum ArithmeticOperandShape
+		{
+			ArithmeticShape_Array,				// Single array, reduced to one value
+			ArithmeticShape_Scalars,			// Two scalar values
+			ArithmeticShape_ArrayScalar,		// Array followed by a scalar
+			ArithmeticShape_ScalarArray,		// Scalar followed by an array
+			ArithmeticShape_ArrayArray			// Two arrays
+		};
+
+		//
+		// Apply an arithmetic operator to a pair of values
+		//
+		template<ArithmeticOpType OpType, typename ValueType>
+		ValueType ApplyArithmeticOperator(ValueType one, ValueType two)
+		{
+			switch(OpType)
+			{
+			case Arithmetic_Add:		return one + two;
+			case Arithmetic_Subtract:	return one - two;
+			case Arithmetic_Multiply:	return one * two;
+			case Arithmetic_Divide:		return one / two;
+			}
+
+			throw InternalFailureException("Unrecognized arithmetic operation");
+		}
+
 		//
 		// Base arithmetic operation
 		//
@@ -54,10 +83,21 @@ namespace VM
 				  NumParams(2)
 			{ }
 
+			static ArithmeticOp* Create();
+			static ArithmeticOp* Create(bool firstisarray, bool secondisarray);
+
+		protected:
+			ArithmeticOp(bool firstisarray, bool secondisarray, unsigned numparams)
+				: FirstIsArray(firstisarray),
+				  SecondIsArray(secondisarray),
+				  NumParams(numparams)
+			{ }
+
 		// Operation interface
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return VarType::GetStaticType(); }
@@ -73,8 +113,14 @@ namespace VM
 
 		// Internal helpers
 		protected:
+			typename VarType::BaseStorage Evaluate(StackSpace& stack) const;
 			typename VarType::BaseStorage OperateOnArray(StackSpace& stack) const;
 
+			template <ArithmeticOperandShape Shape>
+			typename VarType::BaseStorage EvaluateShape(StackSpace& stack) const;
+
+			static ArithmeticOperandShape GetOperandShape(bool firstisarray, bool secondisarray, unsigned numparams);
+
 		// Internal tracking
 		protected:
 			bool FirstIsArray;
@@ -82,6 +128,31 @@ namespace VM
 			unsigned NumParams;
 		};
 
+		//
+		// Arithmetic operation specialized for a particular operand shape
+		//
+		// Instances should be obtained via ArithmeticOp::Create rather than
+		// created directly. Since the specialized operation derives from the
+		// generic one, the rest of the VM (validation, serialization, etc.)
+		// does not need to know about the specializations at all.
+		//
+		template<ArithmeticOpType OpType, class VarType, class RValueType, ArithmeticOperandShape Shape>
+		class SpecializedArithmeticOp : public ArithmeticOp<OpType, VarType, RValueType>
+		{
+		// Construction
+		public:
+			SpecializedArithmeticOp()
+				: ArithmeticOp<OpType, VarType, RValueType>(Shape == ArithmeticShape_Array || Shape == ArithmeticShape_ArrayScalar || Shape == ArithmeticShape_ArrayArray,
+															Shape == ArithmeticShape_ScalarArray || Shape == ArithmeticShape_ArrayArray,
+															(Shape == ArithmeticShape_Array) ? 1 : 2)
+			{ }
+
+		// Operation interface
+		public:
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+		};
+
 
 		class Negate : public Operation, public SelfAware<Negate>
 		{
@@ -95,6 +166,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return Type; }
@@ -102,12 +174,64 @@ namespace VM
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
 			{ return 1; }
 
+		// Additional queries
+		public:
+			VM::EpochVariableTypeID GetOperandType() const
+			{ return Type; }
+
 		// Internal tracking
 		private:
 			VM::EpochVariableTypeID Type;
 		};
 
 
+		//
+		// Element-wise arithmetic on arrays
+		//
+		// Unlike the standard arithmetic operations, which reduce arrays
+		// to a single value, this operation produces a new array holding
+		// the result of applying the operator to each pair of elements.
+		// One of the operands may be a scalar, in which case it is paired
+		// with every element of the other operand.
+		//
+		class ElementwiseArithmetic : public Operation, public SelfAware<ElementwiseArithmetic>
+		{
+		// Construction
+		public:
+			ElementwiseArithmetic(ArithmeticOpType optype, EpochVariableTypeID elementtype, bool firstisarray, bool secondisarray)
+				: OpType(optype),
+				  ElementType(elementtype),
+				  FirstIsArray(firstisarray),
+				  SecondIsArray(secondisarray)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Array; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Additional queries
+		public:
+			ArithmeticOpType GetOperatorType() const	{ return OpType; }
+			EpochVariableTypeID GetElementType() const	{ return ElementType; }
+			bool IsFirstArray() const					{ return FirstIsArray; }
+			bool IsSecondArray() const					{ return SecondIsArray; }
+
+		// Internal tracking
+		private:
+			ArithmeticOpType OpType;
+			EpochVariableTypeID ElementType;
+			bool FirstIsArray;
+			bool SecondIsArray;
+		};
+
+
 		//
 		// Handy type shortcuts
 		//
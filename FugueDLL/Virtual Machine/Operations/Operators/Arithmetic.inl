@@ -11,79 +11,113 @@
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Types Management/Typecasts.h"
+#include "Virtual Machine/Operations/Operators/VectorReductions.h"
 
 
+//
+// Determine the operand shape of an arithmetic operation
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+VM::Operations::ArithmeticOperandShape VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::GetOperandShape(bool firstisarray, bool secondisarray, unsigned numparams)
+{
+	if(numparams == 1)
+		return ArithmeticShape_Array;
+	else if(numparams != 2)
+		throw ExecutionException("Invalid set of parameters");
+
+	if(firstisarray && secondisarray)
+		return ArithmeticShape_ArrayArray;
+	else if(firstisarray)
+		return ArithmeticShape_ArrayScalar;
+	else if(secondisarray)
+		return ArithmeticShape_ScalarArray;
+
+	return ArithmeticShape_Scalars;
+}
+
 //
 // Perform the selected arithmetic operation
 //
+// This generic version has to examine the operand shape each time it
+// is executed; operations created via the Create() factories use the
+// specialized implementations instead.
+//
 template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
-VM::RValuePtr VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::ExecuteAndStoreRValue(ExecutionContext& context)
+typename VarType::BaseStorage VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::Evaluate(StackSpace& stack) const
+{
+	switch(GetOperandShape(FirstIsArray, SecondIsArray, NumParams))
+	{
+	case ArithmeticShape_Array:			return EvaluateShape<ArithmeticShape_Array>(stack);
+	case ArithmeticShape_Scalars:		return EvaluateShape<ArithmeticShape_Scalars>(stack);
+	case ArithmeticShape_ArrayScalar:	return EvaluateShape<ArithmeticShape_ArrayScalar>(stack);
+	case ArithmeticShape_ScalarArray:	return EvaluateShape<ArithmeticShape_ScalarArray>(stack);
+	case ArithmeticShape_ArrayArray:	return EvaluateShape<ArithmeticShape_ArrayArray>(stack);
+	}
+
+	throw ExecutionException("Invalid set of parameters");
+}
+
+//
+// Perform the selected arithmetic operation on operands of a known shape
+//
+// Both the operation and the shape are compile-time constants, so each
+// instantiation of this function reduces to a single straight-line path.
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+template<VM::Operations::ArithmeticOperandShape Shape>
+typename VarType::BaseStorage VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::EvaluateShape(StackSpace& stack) const
 {
-	VarType::BaseStorage ret = 0;
+	typename VarType::BaseStorage ret = 0;
 
-	if(NumParams == 1)
-		ret = OperateOnArray(context.Stack);
-	else if(NumParams == 2)
+	if(Shape == ArithmeticShape_Array)
+		ret = OperateOnArray(stack);
+	else if(Shape == ArithmeticShape_ArrayScalar)
+	{
+		VarType var(stack.GetCurrentTopOfStack());
+		typename VarType::BaseStorage variableval = var.GetValue();
+		stack.Pop(VarType::GetStorageSize());
+		ret = ApplyArithmeticOperator<OpType>(OperateOnArray(stack), variableval);
+	}
+	else if(Shape == ArithmeticShape_ScalarArray)
+	{
+		ret = OperateOnArray(stack);
+		VarType var(stack.GetCurrentTopOfStack());
+		ret = ApplyArithmeticOperator<OpType>(var.GetValue(), ret);
+		stack.Pop(VarType::GetStorageSize());
+	}
+	else if(Shape == ArithmeticShape_ArrayArray)
 	{
-		if(FirstIsArray && !SecondIsArray)
-		{
-			VarType var(context.Stack.GetCurrentTopOfStack());
-			VarType::BaseStorage variableval = var.GetValue();
-			context.Stack.Pop(VarType::GetStorageSize());
-			switch(OpType)
-			{
-			case Arithmetic_Add:		ret = OperateOnArray(context.Stack) + variableval;		break;
-			case Arithmetic_Subtract:	ret = OperateOnArray(context.Stack) - variableval;		break;
-			case Arithmetic_Multiply:	ret = OperateOnArray(context.Stack) * variableval;		break;
-			case Arithmetic_Divide:		ret = OperateOnArray(context.Stack) / variableval;		break;
-			default: throw InternalFailureException("Unrecognized arithmetic operation");
-			}
-		}
-		else if(!FirstIsArray && SecondIsArray)
-		{
-			ret = OperateOnArray(context.Stack);
-			VarType var(context.Stack.GetCurrentTopOfStack());
-			switch(OpType)
-			{
-			case Arithmetic_Add:		ret = var.GetValue() + ret;		break;
-			case Arithmetic_Subtract:	ret = var.GetValue() - ret;		break;
-			case Arithmetic_Multiply:	ret = var.GetValue() * ret;		break;
-			case Arithmetic_Divide:		ret = var.GetValue() / ret;		break;
-			default: throw InternalFailureException("Unrecognized arithmetic operation");
-			}
-			context.Stack.Pop(VarType::GetStorageSize());
-		}
-		else if(FirstIsArray && SecondIsArray)
-		{
-			ret = OperateOnArray(context.Stack);
-			switch(OpType)
-			{
-			case Arithmetic_Add:		ret = OperateOnArray(context.Stack) + ret;		break;
-			case Arithmetic_Subtract:	ret = OperateOnArray(context.Stack) - ret;		break;
-			case Arithmetic_Multiply:	ret = OperateOnArray(context.Stack) * ret;		break;
-			case Arithmetic_Divide:		ret = OperateOnArray(context.Stack) / ret;		break;
-			default: throw InternalFailureException("Unrecognized arithmetic operation");
-			}
-		}
-		else
-		{
-			VarType twovar(context.Stack.GetCurrentTopOfStack());
-			VarType onevar(context.Stack.GetOffsetIntoStack(VarType::GetStorageSize()));
-			switch(OpType)
-			{
-			case Arithmetic_Add:		ret = onevar.GetValue() + twovar.GetValue();		break;
-			case Arithmetic_Subtract:	ret = onevar.GetValue() - twovar.GetValue();		break;
-			case Arithmetic_Multiply:	ret = onevar.GetValue() * twovar.GetValue();		break;
-			case Arithmetic_Divide:		ret = onevar.GetValue() / twovar.GetValue();		break;
-			default: throw InternalFailureException("Unrecognized arithmetic operation");
-			}
-			context.Stack.Pop(VarType::GetStorageSize() * 2);
-		}
+		ret = OperateOnArray(stack);
+		ret = ApplyArithmeticOperator<OpType>(OperateOnArray(stack), ret);
 	}
 	else
-		throw ExecutionException("Invalid set of parameters");
+	{
+		VarType twovar(stack.GetCurrentTopOfStack());
+		VarType onevar(stack.GetOffsetIntoStack(VarType::GetStorageSize()));
+		ret = ApplyArithmeticOperator<OpType>(onevar.GetValue(), twovar.GetValue());
+		stack.Pop(VarType::GetStorageSize() * 2);
+	}
 
-	return RValuePtr(new RValueType(ret));
+	return ret;
+}
+
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+VM::RValuePtr VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new RValueType(Evaluate(context.Stack)));
+}
+
+//
+// Perform the selected arithmetic operation, placing the
+// result directly on the stack instead of in an r-value
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+bool VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	typename VarType::BaseStorage ret = Evaluate(context.Stack);
+	context.Stack.Push(VarType::GetStorageSize());
+	VarType(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+	return true;
 }
 
 template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
@@ -100,7 +134,7 @@ void VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::ExecuteFast(Exec
 template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
 typename VarType::BaseStorage VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::OperateOnArray(StackSpace& stack) const
 {
-	VarType::BaseStorage ret = 0;
+	typename VarType::BaseStorage ret = 0;
 	if(OpType == Arithmetic_Multiply || OpType == Arithmetic_Divide)
 		ret = 1;
 
@@ -113,19 +147,83 @@ typename VarType::BaseStorage VM::Operations::ArithmeticOp<OpType, VarType, RVal
 	if(type != VarType::GetStaticType())
 		throw ExecutionException("Type mismatch");
 
-	for(size_t i = 0; i < count; ++i)
+	const typename VarType::BaseStorage* elements = reinterpret_cast<const typename VarType::BaseStorage*>(storage);
+
+	if(OpType == Arithmetic_Add)
+		ret = SumArrayElements(elements, count);
+	else if(OpType == Arithmetic_Multiply)
+		ret = MultiplyArrayElements(elements, count);
+	else if(count > 0)
+		throw NotImplementedException("Arithmetic operation not implemented for array mode");
+
+	return ret;
+}
+
+
+//
+// Factories for creating arithmetic operations
+//
+// These select the specialized implementation matching the given
+// operand shape, so that the shape checks are done once when the
+// operation is built rather than every time it is executed.
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+VM::Operations::ArithmeticOp<OpType, VarType, RValueType>* VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::Create()
+{
+	return new SpecializedArithmeticOp<OpType, VarType, RValueType, ArithmeticShape_Array>;
+}
+
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType>
+VM::Operations::ArithmeticOp<OpType, VarType, RValueType>* VM::Operations::ArithmeticOp<OpType, VarType, RValueType>::Create(bool firstisarray, bool secondisarray)
+{
+	switch(GetOperandShape(firstisarray, secondisarray, 2))
 	{
-		VarType var(storage);
-		if(OpType == Arithmetic_Add)
-			ret = var.GetValue() + ret;
-		else if(OpType == Arithmetic_Multiply)
-			ret = var.GetValue() * ret;
-		else
-			throw NotImplementedException("Arithmetic operation not implemented for array mode");
-
-		storage = reinterpret_cast<char*>(storage) + VarType::GetBaseStorageSize();
+	case ArithmeticShape_Scalars:		return new SpecializedArithmeticOp<OpType, VarType, RValueType, ArithmeticShape_Scalars>;
+	case ArithmeticShape_ArrayScalar:	return new SpecializedArithmeticOp<OpType, VarType, RValueType, ArithmeticShape_ArrayScalar>;
+	case ArithmeticShape_ScalarArray:	return new SpecializedArithmeticOp<OpType, VarType, RValueType, ArithmeticShape_ScalarArray>;
+	case ArithmeticShape_ArrayArray:	return new SpecializedArithmeticOp<OpType, VarType, RValueType, ArithmeticShape_ArrayArray>;
 	}
 
-	return ret;
+	throw InternalFailureException("Unrecognized arithmetic operand shape");
+}
+
+
+//
+// Execute a specialized arithmetic operation
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType, VM::Operations::ArithmeticOperandShape Shape>
+VM::RValuePtr VM::Operations::SpecializedArithmeticOp<OpType, VarType, RValueType, Shape>::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new RValueType(this->template EvaluateShape<Shape>(context.Stack)));
+}
+
+//
+// Execute a specialized arithmetic operation, placing the result
+// directly on the stack
+//
+// When both operands are scalars, the result is written over the first
+// operand; this leaves the stack in the same state as popping both
+// operands and pushing the result.
+//
+template<VM::Operations::ArithmeticOpType OpType, class VarType, class RValueType, VM::Operations::ArithmeticOperandShape Shape>
+bool VM::Operations::SpecializedArithmeticOp<OpType, VarType, RValueType, Shape>::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	StackSpace& stack = context.Stack;
+
+	if(Shape == ArithmeticShape_Scalars)
+	{
+		VarType twovar(stack.GetCurrentTopOfStack());
+		VarType onevar(stack.GetOffsetIntoStack(VarType::GetStorageSize()));
+		onevar.SetValue(ApplyArithmeticOperator<OpType>(onevar.GetValue(), twovar.GetValue()));
+		stack.Pop(VarType::GetStorageSize());
+	}
+	else
+	{
+		typename VarType::BaseStorage ret = this->template EvaluateShape<Shape>(stack);
+		stack.Push(VarType::GetStorageSize());
+		VarType(stack.GetCurrentTopOfStack()).SetValue(ret);
+	}
+
+	return true;
 }
 
@@ -16,6 +16,8 @@
 
 #include "Serialization/SerializationTraverser.h"
 
+#include "Optimizer/Optimizer.h"
+
 
 
 using namespace VM;
@@ -63,7 +65,7 @@ void BitwiseOr::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	for(std::list<Operation*>::const_iterator iter = SubOps.begin(); iter != SubOps.end(); ++iter)
-		dynamic_cast<SelfAwareBase*>(*iter)->Traverse(traverser);
+		(*iter)->Traverse(traverser);
 }
 
 void BitwiseOr::Traverse(Validator::ValidationTraverser& traverser)
@@ -76,6 +78,11 @@ void BitwiseOr::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void BitwiseOr::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 BitwiseAnd::BitwiseAnd(EpochVariableTypeID type)
 	: Type(type)
@@ -124,7 +131,7 @@ void BitwiseAnd::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	for(std::list<Operation*>::const_iterator iter = SubOps.begin(); iter != SubOps.end(); ++iter)
-		dynamic_cast<SelfAwareBase*>(*iter)->Traverse(traverser);
+		(*iter)->Traverse(traverser);
 }
 
 void BitwiseAnd::Traverse(Validator::ValidationTraverser& traverser)
@@ -137,6 +144,11 @@ void BitwiseAnd::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void BitwiseAnd::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 BitwiseXor::BitwiseXor(EpochVariableTypeID type)
 	: Type(type)
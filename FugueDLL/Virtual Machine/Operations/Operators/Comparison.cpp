@@ -27,11 +27,34 @@ Traverser::Payload Comparator::GetNodeTraversalPayload(const VM::ScopeDescriptio
 	return payload;
 }
 
+//
+// Common execution logic for all comparators; derived classes
+// simply provide the comparison itself, so that the result can
+// be placed directly on the stack without an r-value if desired.
+//
+void Comparator::ExecuteFast(ExecutionContext& context)
+{
+	Compare(context);
+}
+
+RValuePtr Comparator::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new BooleanRValue(Compare(context)));
+}
+
+bool Comparator::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	bool ret = Compare(context);
+	context.Stack.Push(BooleanVariable::GetStorageSize());
+	BooleanVariable(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+	return true;
+}
+
 
 //
 // Test if two values are equal
 //
-RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsEqual::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -44,7 +67,7 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() == val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -52,7 +75,7 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() == val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Boolean:
 		{
@@ -60,7 +83,7 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			BooleanVariable val1(context.Stack.GetOffsetIntoStack(BooleanVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() == val2.GetValue());
 			context.Stack.Pop(BooleanVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_String:
 		{
@@ -68,7 +91,7 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			StringVariable val1(context.Stack.GetOffsetIntoStack(StringVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() == val2.GetValue());
 			context.Stack.Pop(StringVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Tuple:
 		{
@@ -97,7 +120,7 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			size_t storage1 = val1.GetStorageSize();
 			size_t storage2 = val2.GetStorageSize();
 			context.Stack.Pop(storage1 + storage2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 
 	default:
@@ -105,15 +128,10 @@ RValuePtr IsEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 	}
 }
 
-void IsEqual::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
-
 //
 // Test if two values are not equal
 //
-RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsNotEqual::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -126,7 +144,7 @@ RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() != val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -134,7 +152,7 @@ RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() != val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Boolean:
 		{
@@ -142,7 +160,7 @@ RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			BooleanVariable val1(context.Stack.GetOffsetIntoStack(BooleanVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() != val2.GetValue());
 			context.Stack.Pop(BooleanVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_String:
 		{
@@ -150,7 +168,7 @@ RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			StringVariable val1(context.Stack.GetOffsetIntoStack(StringVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() != val2.GetValue());
 			context.Stack.Pop(StringVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Tuple:
 		{
@@ -179,22 +197,17 @@ RValuePtr IsNotEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			size_t storage1 = val1.GetStorageSize();
 			size_t storage2 = val2.GetStorageSize();
 			context.Stack.Pop(storage1 + storage2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	default:
 		throw NotImplementedException("Cannot test these values for inequality");
 	}
 }
 
-void IsNotEqual::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
-
 //
 // Test if one value is greater than another
 //
-RValuePtr IsGreater::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsGreater::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -207,7 +220,7 @@ RValuePtr IsGreater::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() > val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -215,23 +228,18 @@ RValuePtr IsGreater::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() > val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	default:
 		throw ExecutionException("Invalid types for greater() parameters");
 	}
 }
 
-void IsGreater::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
-
 
 //
 // Test if one value is greater than or equal to another
 //
-RValuePtr IsGreaterOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsGreaterOrEqual::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -244,7 +252,7 @@ RValuePtr IsGreaterOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() >= val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -252,23 +260,18 @@ RValuePtr IsGreaterOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() >= val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	default:
 		throw ExecutionException("Invalid types for greaterequal() parameters");
 	}
 }
 
-void IsGreaterOrEqual::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
-
 
 //
 // Test if one value is less than another
 //
-RValuePtr IsLesser::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsLesser::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -281,7 +284,7 @@ RValuePtr IsLesser::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() < val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -289,22 +292,17 @@ RValuePtr IsLesser::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() < val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	default:
 		throw ExecutionException("Invalid types for less() parameters");
 	}
 }
 
-void IsLesser::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
-
 //
 // Test if one value is less than or equal to another
 //
-RValuePtr IsLesserOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
+bool IsLesserOrEqual::Compare(ExecutionContext& context)
 {
 	switch(Type)
 	{
@@ -317,7 +315,7 @@ RValuePtr IsLesserOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			IntegerVariable val1(context.Stack.GetOffsetIntoStack(IntegerVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() <= val2.GetValue());
 			context.Stack.Pop(IntegerVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	case EpochVariableType_Real:
 		{
@@ -325,14 +323,10 @@ RValuePtr IsLesserOrEqual::ExecuteAndStoreRValue(ExecutionContext& context)
 			RealVariable val1(context.Stack.GetOffsetIntoStack(RealVariable::GetStorageSize()));
 			bool ret = (val1.GetValue() <= val2.GetValue());
 			context.Stack.Pop(RealVariable::GetStorageSize() * 2);
-			return RValuePtr(new BooleanRValue(ret));
+			return ret;
 		}
 	default:
 		throw ExecutionException("Invalid types for lessequal() parameters");
 	}
 }
 
-void IsLesserOrEqual::ExecuteFast(ExecutionContext& context)
-{
-	ExecuteAndStoreRValue(context);
-}
@@ -10,6 +10,8 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 
 
 namespace VM
@@ -34,8 +36,9 @@ namespace VM
 
 		// Operation interface (partial)
 		public:
-			virtual void ExecuteFast(ExecutionContext& context) = 0;
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context) = 0;
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return EpochVariableType_Boolean; }
@@ -43,10 +46,19 @@ namespace VM
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
 			{ return 2; }
 
+		// Additional queries
+		public:
+			EpochVariableTypeID GetOperandType() const
+			{ return Type; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
 
+		// Comparison interface
+		protected:
+			virtual bool Compare(ExecutionContext& context) = 0;
+
 		// Internal tracking
 		protected:
 			EpochVariableTypeID Type;
@@ -63,10 +75,9 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
-		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
 		};
 
 		//
@@ -80,10 +91,9 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
-		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
 		};
 
 		//
@@ -97,10 +107,9 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
-		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
 		};
 
 		//
@@ -114,10 +123,9 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
-		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
 		};
 
 		//
@@ -131,10 +139,9 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
-		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
 		};
 
 
@@ -149,11 +156,144 @@ namespace VM
 				: Comparator(type)
 			{ }
 
-		// Comparator/operation interface
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context);
+		};
+
+
+		//
+		// Apply the test performed by a given comparison operation to a pair of values
+		//
+		template <class ComparisonClass>
+		struct ComparisonPredicate;
+
+		template <> struct ComparisonPredicate<IsEqual>
+		{
+			static const bool IsOrdering = false;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one == two; }
+		};
+
+		template <> struct ComparisonPredicate<IsNotEqual>
+		{
+			static const bool IsOrdering = false;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one != two; }
+		};
+
+		template <> struct ComparisonPredicate<IsGreater>
+		{
+			static const bool IsOrdering = true;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one > two; }
+		};
+
+		template <> struct ComparisonPredicate<IsGreaterOrEqual>
+		{
+			static const bool IsOrdering = true;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one >= two; }
+		};
+
+		template <> struct ComparisonPredicate<IsLesser>
+		{
+			static const bool IsOrdering = true;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one < two; }
+		};
+
+		template <> struct ComparisonPredicate<IsLesserOrEqual>
+		{
+			static const bool IsOrdering = true;
+			template <typename ValueType> static bool Apply(const ValueType& one, const ValueType& two)	{ return one <= two; }
+		};
+
+
+		//
+		// Comparison operation specialized for a single operand type
+		//
+		// The general comparison operations select the type of their
+		// operands each time they are executed. This version knows its
+		// operand type statically, and reads both operands directly off
+		// the stack, so that the result can be pushed as a raw boolean
+		// with no further dispatching. It derives from the general form
+		// of the comparison so that it is treated identically in all
+		// other respects (serialization, fusion, and so on).
+		//
+		template <class ComparisonClass, class VarType>
+		class TypedComparison : public ComparisonClass
+		{
+		// Construction
+		public:
+			TypedComparison()
+				: ComparisonClass(VarType::GetStaticType())
+			{ }
+
+		// Operation interface
 		public:
-			virtual void ExecuteFast(ExecutionContext& context);
-			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual void ExecuteFast(ExecutionContext& context)
+			{
+				CompareOperands(context);
+			}
+
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context)
+			{
+				return RValuePtr(new BooleanRValue(CompareOperands(context)));
+			}
+
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context)
+			{
+				bool ret = CompareOperands(context);
+				context.Stack.Push(BooleanVariable::GetStorageSize());
+				BooleanVariable(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+				return true;
+			}
+
+		// Comparator interface
+		protected:
+			virtual bool Compare(ExecutionContext& context)
+			{
+				return CompareOperands(context);
+			}
+
+		// Internal helpers
+		private:
+			bool CompareOperands(ExecutionContext& context)
+			{
+				VarType val2(context.Stack.GetCurrentTopOfStack());
+				VarType val1(context.Stack.GetOffsetIntoStack(VarType::GetStorageSize()));
+				bool ret = ComparisonPredicate<ComparisonClass>::Apply(val1.GetValue(), val2.GetValue());
+				context.Stack.Pop(VarType::GetStorageSize() * 2);
+				return ret;
+			}
 		};
+
+
+		//
+		// Create a comparison operation for the given operand type
+		//
+		// Types with a statically typed implementation get one; all
+		// others fall back on the general comparison, which takes care
+		// of reporting invalid operand types.
+		//
+		template <class ComparisonClass>
+		Operation* CreateComparison(EpochVariableTypeID type)
+		{
+			switch(type)
+			{
+			case EpochVariableType_Integer:		return new TypedComparison<ComparisonClass, IntegerVariable>;
+			case EpochVariableType_Integer16:	return new TypedComparison<ComparisonClass, Integer16Variable>;
+			case EpochVariableType_Real:		return new TypedComparison<ComparisonClass, RealVariable>;
+
+			case EpochVariableType_Boolean:
+				if(!ComparisonPredicate<ComparisonClass>::IsOrdering)
+					return new TypedComparison<ComparisonClass, BooleanVariable>;
+				break;
+
+			case EpochVariableType_String:
+				if(!ComparisonPredicate<ComparisonClass>::IsOrdering)
+					return new TypedComparison<ComparisonClass, StringVariable>;
+				break;
+			}
+
+			return new ComparisonClass(type);
+		}
 	}
 
 }
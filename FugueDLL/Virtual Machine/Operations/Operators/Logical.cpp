@@ -16,6 +16,8 @@
 
 #include "Serialization/SerializationTraverser.h"
 
+#include "Optimizer/Optimizer.h"
+
 
 using namespace VM;
 using namespace VM::Operations;
@@ -48,7 +50,7 @@ void LogicalOr::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	for(std::list<Operation*>::const_iterator iter = SubOps.begin(); iter != SubOps.end(); ++iter)
-		dynamic_cast<SelfAwareBase*>(*iter)->Traverse(traverser);
+		(*iter)->Traverse(traverser);
 }
 
 void LogicalOr::Traverse(Validator::ValidationTraverser& traverser)
@@ -61,6 +63,11 @@ void LogicalOr::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void LogicalOr::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 RValuePtr LogicalAnd::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	bool ret = true;
@@ -88,7 +95,7 @@ void LogicalAnd::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	for(std::list<Operation*>::const_iterator iter = SubOps.begin(); iter != SubOps.end(); ++iter)
-		dynamic_cast<SelfAwareBase*>(*iter)->Traverse(traverser);
+		(*iter)->Traverse(traverser);
 }
 
 void LogicalAnd::Traverse(Validator::ValidationTraverser& traverser)
@@ -101,6 +108,11 @@ void LogicalAnd::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void LogicalAnd::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 
 
 RValuePtr LogicalXor::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -120,6 +132,18 @@ void LogicalXor::ExecuteFast(ExecutionContext& context)
 	context.Stack.Pop(BooleanVariable::GetStorageSize() * 2);
 }
 
+bool LogicalXor::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	BooleanVariable two(context.Stack.GetCurrentTopOfStack());
+	BooleanVariable one(context.Stack.GetOffsetIntoStack(BooleanVariable::GetStorageSize()));
+	bool oneval = one.GetValue();
+	bool twoval = two.GetValue();
+	context.Stack.Pop(BooleanVariable::GetStorageSize());
+
+	BooleanVariable(context.Stack.GetCurrentTopOfStack()).SetValue((oneval || twoval) && (!(oneval && twoval)));
+	return true;
+}
+
 
 RValuePtr LogicalNot::ExecuteAndStoreRValue(ExecutionContext& context)
 {
@@ -136,3 +160,10 @@ void LogicalNot::ExecuteFast(ExecutionContext& context)
 	context.Stack.Pop(BooleanVariable::GetStorageSize());
 }
 
+bool LogicalNot::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	BooleanVariable param(context.Stack.GetCurrentTopOfStack());
+	param.SetValue(!param.GetValue());
+	return true;
+}
+
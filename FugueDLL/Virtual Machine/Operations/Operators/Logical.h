@@ -43,6 +43,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 		};
 
 		//
@@ -68,6 +69,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 		};
 
 		//
@@ -79,6 +81,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return EpochVariableType_Boolean; }
@@ -96,6 +99,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return EpochVariableType_Boolean; }
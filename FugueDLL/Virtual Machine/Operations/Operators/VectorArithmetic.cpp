@@ -0,0 +1,214 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for element-wise arithmetic on arrays
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Operators/VectorArithmetic.h"
+
+#include "Utility/Threading/MachineInfo.h"
+
+#include <emmintrin.h>
+#include <smmintrin.h>
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Wrappers describing the vector registers and instructions
+	// used for each supported element type
+	//
+	struct RealKernel
+	{
+		typedef Real ElementType;
+		typedef __m128 RegisterType;
+		static const size_t LaneCount = 4;
+
+		static bool IsAvailable(ArithmeticOpType optype)
+		{ return Threads::CPUSupportsSSE2(); }
+
+		static RegisterType Load(const Real* elements)					{ return _mm_loadu_ps(elements); }
+		static RegisterType Broadcast(Real value)						{ return _mm_set1_ps(value); }
+		static void Store(Real* elements, RegisterType values)			{ _mm_storeu_ps(elements, values); }
+
+		template <ArithmeticOpType OpType>
+		static RegisterType Apply(RegisterType one, RegisterType two)
+		{
+			switch(OpType)
+			{
+			case Arithmetic_Add:		return _mm_add_ps(one, two);
+			case Arithmetic_Subtract:	return _mm_sub_ps(one, two);
+			case Arithmetic_Multiply:	return _mm_mul_ps(one, two);
+			case Arithmetic_Divide:		return _mm_div_ps(one, two);
+			}
+
+			throw InternalFailureException("Unrecognized arithmetic operation");
+		}
+	};
+
+	//
+	// Packed 32-bit multiplication which keeps the low half of each
+	// product is only available starting with SSE4.1.
+	//
+	struct IntegerKernel
+	{
+		typedef Integer32 ElementType;
+		typedef __m128i RegisterType;
+		static const size_t LaneCount = 4;
+
+		static bool IsAvailable(ArithmeticOpType optype)
+		{
+			if(optype == Arithmetic_Divide)
+				return false;
+			if(optype == Arithmetic_Multiply)
+				return Threads::CPUSupportsSSE41();
+			return Threads::CPUSupportsSSE2();
+		}
+
+		static RegisterType Load(const Integer32* elements)				{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements)); }
+		static RegisterType Broadcast(Integer32 value)					{ return _mm_set1_epi32(value); }
+		static void Store(Integer32* elements, RegisterType values)		{ _mm_storeu_si128(reinterpret_cast<__m128i*>(elements), values); }
+
+		template <ArithmeticOpType OpType>
+		static RegisterType Apply(RegisterType one, RegisterType two)
+		{
+			switch(OpType)
+			{
+			case Arithmetic_Add:		return _mm_add_epi32(one, two);
+			case Arithmetic_Subtract:	return _mm_sub_epi32(one, two);
+			case Arithmetic_Multiply:	return _mm_mullo_epi32(one, two);
+			}
+
+			throw InternalFailureException("Arithmetic operation has no vector implementation");
+		}
+	};
+
+	struct Integer16Kernel
+	{
+		typedef Integer16 ElementType;
+		typedef __m128i RegisterType;
+		static const size_t LaneCount = 8;
+
+		static bool IsAvailable(ArithmeticOpType optype)
+		{ return (optype != Arithmetic_Divide) && Threads::CPUSupportsSSE2(); }
+
+		static RegisterType Load(const Integer16* elements)				{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements)); }
+		static RegisterType Broadcast(Integer16 value)					{ return _mm_set1_epi16(value); }
+		static void Store(Integer16* elements, RegisterType values)		{ _mm_storeu_si128(reinterpret_cast<__m128i*>(elements), values); }
+
+		template <ArithmeticOpType OpType>
+		static RegisterType Apply(RegisterType one, RegisterType two)
+		{
+			switch(OpType)
+			{
+			case Arithmetic_Add:		return _mm_add_epi16(one, two);
+			case Arithmetic_Subtract:	return _mm_sub_epi16(one, two);
+			case Arithmetic_Multiply:	return _mm_mullo_epi16(one, two);
+			}
+
+			throw InternalFailureException("Arithmetic operation has no vector implementation");
+		}
+	};
+
+
+	//
+	// Apply an operator to every element of the operands
+	//
+	// The operator and the operand shape are compile-time constants, so
+	// the inner loops contain no branches. Leftover elements which do not
+	// fill a complete vector register (and everything, when the CPU lacks
+	// the required instructions) are handled by the scalar loop.
+	//
+	template <class KernelType, ArithmeticOpType OpType, bool OneIsScalar, bool TwoIsScalar>
+	void ApplyKernel(const typename KernelType::ElementType* one, const typename KernelType::ElementType* two, typename KernelType::ElementType* result, size_t count)
+	{
+		typedef typename KernelType::ElementType ElementType;
+		typedef typename KernelType::RegisterType RegisterType;
+
+		size_t i = 0;
+
+		if(KernelType::IsAvailable(OpType))
+		{
+			RegisterType broadcastone = KernelType::Broadcast(OneIsScalar ? *one : 0);
+			RegisterType broadcasttwo = KernelType::Broadcast(TwoIsScalar ? *two : 0);
+
+			for(; i + KernelType::LaneCount <= count; i += KernelType::LaneCount)
+			{
+				RegisterType valuesone = OneIsScalar ? broadcastone : KernelType::Load(one + i);
+				RegisterType valuestwo = TwoIsScalar ? broadcasttwo : KernelType::Load(two + i);
+				KernelType::Store(result + i, KernelType::template Apply<OpType>(valuesone, valuestwo));
+			}
+		}
+
+		for(; i < count; ++i)
+			result[i] = ApplyArithmeticOperator<OpType, ElementType>(OneIsScalar ? *one : one[i], TwoIsScalar ? *two : two[i]);
+	}
+
+	//
+	// Select the kernel instantiation for the given operand shape
+	//
+	template <class KernelType, ArithmeticOpType OpType>
+	void DispatchShape(const typename KernelType::ElementType* one, bool onescalar, const typename KernelType::ElementType* two, bool twoscalar, typename KernelType::ElementType* result, size_t count)
+	{
+		if(onescalar && twoscalar)
+			throw InternalFailureException("Element-wise arithmetic requires at least one array operand");
+		else if(onescalar)
+			ApplyKernel<KernelType, OpType, true, false>(one, two, result, count);
+		else if(twoscalar)
+			ApplyKernel<KernelType, OpType, false, true>(one, two, result, count);
+		else
+			ApplyKernel<KernelType, OpType, false, false>(one, two, result, count);
+	}
+
+	//
+	// Select the kernel instantiation for the given operator
+	//
+	template <class KernelType>
+	void DispatchOperator(ArithmeticOpType optype, const typename KernelType::ElementType* one, bool onescalar, const typename KernelType::ElementType* two, bool twoscalar, typename KernelType::ElementType* result, size_t count)
+	{
+		switch(optype)
+		{
+		case Arithmetic_Add:		DispatchShape<KernelType, Arithmetic_Add>(one, onescalar, two, twoscalar, result, count);			return;
+		case Arithmetic_Subtract:	DispatchShape<KernelType, Arithmetic_Subtract>(one, onescalar, two, twoscalar, result, count);		return;
+		case Arithmetic_Multiply:	DispatchShape<KernelType, Arithmetic_Multiply>(one, onescalar, two, twoscalar, result, count);		return;
+		case Arithmetic_Divide:		DispatchShape<KernelType, Arithmetic_Divide>(one, onescalar, two, twoscalar, result, count);		return;
+		}
+
+		throw InternalFailureException("Unrecognized arithmetic operation");
+	}
+
+}
+
+
+//
+// Element-wise arithmetic on integer arrays
+//
+void VM::Operations::ApplyElementwiseArithmetic(ArithmeticOpType optype, const Integer32* one, bool onescalar, const Integer32* two, bool twoscalar, Integer32* result, size_t count)
+{
+	DispatchOperator<IntegerKernel>(optype, one, onescalar, two, twoscalar, result, count);
+}
+
+//
+// Element-wise arithmetic on 16-bit integer arrays
+//
+void VM::Operations::ApplyElementwiseArithmetic(ArithmeticOpType optype, const Integer16* one, bool onescalar, const Integer16* two, bool twoscalar, Integer16* result, size_t count)
+{
+	DispatchOperator<Integer16Kernel>(optype, one, onescalar, two, twoscalar, result, count);
+}
+
+//
+// Element-wise arithmetic on real arrays
+//
+void VM::Operations::ApplyElementwiseArithmetic(ArithmeticOpType optype, const Real* one, bool onescalar, const Real* two, bool twoscalar, Real* result, size_t count)
+{
+	DispatchOperator<RealKernel>(optype, one, onescalar, two, twoscalar, result, count);
+}
+
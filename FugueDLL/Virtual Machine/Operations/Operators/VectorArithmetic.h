@@ -0,0 +1,33 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for element-wise arithmetic on arrays
+//
+// Each operand is either an array of values or, if the corresponding
+// flag is set, a single value which is applied to every element of
+// the other operand. The result array must hold as many elements as
+// the array operand(s). SSE instructions are used where the host CPU
+// supports them; integer division is always done with scalar code,
+// since there is no packed integer division instruction.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Operations/Operators/Arithmetic.h"
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		void ApplyElementwiseArithmetic(ArithmeticOpType optype, const Integer32* one, bool onescalar, const Integer32* two, bool twoscalar, Integer32* result, size_t count);
+		void ApplyElementwiseArithmetic(ArithmeticOpType optype, const Integer16* one, bool onescalar, const Integer16* two, bool twoscalar, Integer16* result, size_t count);
+		void ApplyElementwiseArithmetic(ArithmeticOpType optype, const Real* one, bool onescalar, const Real* two, bool twoscalar, Real* result, size_t count);
+
+	}
+}
+
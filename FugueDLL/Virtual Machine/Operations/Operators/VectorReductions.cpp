@@ -0,0 +1,211 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for reducing arrays of numeric values
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Operators/VectorReductions.h"
+
+#include "Utility/Threading/MachineInfo.h"
+
+#include <emmintrin.h>
+#include <smmintrin.h>
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	//
+	// Scalar fallbacks, used when the CPU lacks the required
+	// instruction set, and for any leftover elements that do
+	// not fill a complete vector register
+	//
+	template <typename T>
+	T ScalarSum(const T* elements, size_t count, T initial)
+	{
+		T ret = initial;
+		for(size_t i = 0; i < count; ++i)
+			ret = elements[i] + ret;
+		return ret;
+	}
+
+	template <typename T>
+	T ScalarProduct(const T* elements, size_t count, T initial)
+	{
+		T ret = initial;
+		for(size_t i = 0; i < count; ++i)
+			ret = elements[i] * ret;
+		return ret;
+	}
+
+
+	//
+	// Helpers for collapsing a vector register into a single value
+	//
+	Integer32 HorizontalSum(__m128i values)
+	{
+		values = _mm_add_epi32(values, _mm_shuffle_epi32(values, _MM_SHUFFLE(1, 0, 3, 2)));
+		values = _mm_add_epi32(values, _mm_shuffle_epi32(values, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(values);
+	}
+
+	Real HorizontalSum(__m128 values)
+	{
+		values = _mm_add_ps(values, _mm_movehl_ps(values, values));
+		values = _mm_add_ss(values, _mm_shuffle_ps(values, values, _MM_SHUFFLE(1, 1, 1, 1)));
+		return _mm_cvtss_f32(values);
+	}
+
+	Real HorizontalProduct(__m128 values)
+	{
+		values = _mm_mul_ps(values, _mm_movehl_ps(values, values));
+		values = _mm_mul_ss(values, _mm_shuffle_ps(values, values, _MM_SHUFFLE(1, 1, 1, 1)));
+		return _mm_cvtss_f32(values);
+	}
+
+	template <typename T, size_t LaneCount>
+	void ExtractLanes(__m128i values, T (&lanes)[LaneCount])
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), values);
+	}
+
+}
+
+
+//
+// Sum the elements of an integer array
+//
+Integer32 VM::Operations::SumArrayElements(const Integer32* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE2())
+		return ScalarSum<Integer32>(elements, count, 0);
+
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_add_epi32(acc0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i)));
+		acc1 = _mm_add_epi32(acc1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i + 4)));
+	}
+
+	return ScalarSum<Integer32>(elements + i, count - i, HorizontalSum(_mm_add_epi32(acc0, acc1)));
+}
+
+//
+// Sum the elements of a 16-bit integer array
+//
+Integer16 VM::Operations::SumArrayElements(const Integer16* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE2())
+		return ScalarSum<Integer16>(elements, count, 0);
+
+	__m128i acc = _mm_setzero_si128();
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+		acc = _mm_add_epi16(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i)));
+
+	Integer16 lanes[8];
+	ExtractLanes(acc, lanes);
+	Integer16 ret = ScalarSum<Integer16>(lanes, 8, 0);
+
+	return ScalarSum<Integer16>(elements + i, count - i, ret);
+}
+
+//
+// Sum the elements of a real array
+//
+Real VM::Operations::SumArrayElements(const Real* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE2())
+		return ScalarSum<Real>(elements, count, 0.0f);
+
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_loadu_ps(elements + i));
+		acc1 = _mm_add_ps(acc1, _mm_loadu_ps(elements + i + 4));
+	}
+
+	return ScalarSum<Real>(elements + i, count - i, HorizontalSum(_mm_add_ps(acc0, acc1)));
+}
+
+
+//
+// Multiply together the elements of an integer array
+//
+// Packed 32-bit multiplication which keeps the low half of each
+// product is only available starting with SSE4.1.
+//
+Integer32 VM::Operations::MultiplyArrayElements(const Integer32* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE41())
+		return ScalarProduct<Integer32>(elements, count, 1);
+
+	__m128i acc = _mm_set1_epi32(1);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+		acc = _mm_mullo_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i)));
+
+	Integer32 lanes[4];
+	ExtractLanes(acc, lanes);
+	Integer32 ret = ScalarProduct<Integer32>(lanes, 4, 1);
+
+	return ScalarProduct<Integer32>(elements + i, count - i, ret);
+}
+
+//
+// Multiply together the elements of a 16-bit integer array
+//
+Integer16 VM::Operations::MultiplyArrayElements(const Integer16* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE2())
+		return ScalarProduct<Integer16>(elements, count, 1);
+
+	__m128i acc = _mm_set1_epi16(1);
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+		acc = _mm_mullo_epi16(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + i)));
+
+	Integer16 lanes[8];
+	ExtractLanes(acc, lanes);
+	Integer16 ret = ScalarProduct<Integer16>(lanes, 8, 1);
+
+	return ScalarProduct<Integer16>(elements + i, count - i, ret);
+}
+
+//
+// Multiply together the elements of a real array
+//
+Real VM::Operations::MultiplyArrayElements(const Real* elements, size_t count)
+{
+	if(!Threads::CPUSupportsSSE2())
+		return ScalarProduct<Real>(elements, count, 1.0f);
+
+	__m128 acc0 = _mm_set1_ps(1.0f);
+	__m128 acc1 = _mm_set1_ps(1.0f);
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		acc0 = _mm_mul_ps(acc0, _mm_loadu_ps(elements + i));
+		acc1 = _mm_mul_ps(acc1, _mm_loadu_ps(elements + i + 4));
+	}
+
+	return ScalarProduct<Real>(elements + i, count - i, HorizontalProduct(_mm_mul_ps(acc0, acc1)));
+}
+
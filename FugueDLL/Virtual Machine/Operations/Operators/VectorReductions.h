@@ -0,0 +1,33 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for reducing arrays of numeric values
+//
+// These routines use SSE instructions to process several array
+// elements at once when the host CPU supports it, and fall back
+// on plain scalar loops otherwise. Note that reductions of real
+// values are performed in a different order than a simple loop
+// would use, so the results may differ in the last few bits due
+// to rounding.
+//
+
+#pragma once
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		Integer32 SumArrayElements(const Integer32* elements, size_t count);
+		Integer16 SumArrayElements(const Integer16* elements, size_t count);
+		Real SumArrayElements(const Real* elements, size_t count);
+
+		Integer32 MultiplyArrayElements(const Integer32* elements, size_t count);
+		Integer16 MultiplyArrayElements(const Integer16* elements, size_t count);
+		Real MultiplyArrayElements(const Real* elements, size_t count);
+
+	}
+}
+
@@ -18,6 +18,7 @@
 #include "Virtual Machine/VMExceptions.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
 #include "Virtual Machine/Operations/Flow/Invoke.h"
+#include "Virtual Machine/Profiling/Instrumentation.h"
 #include "Virtual Machine/SelfAware.inl"
 
 #include "Parser/Debug Info Tables/DebugTable.h"
@@ -27,6 +28,26 @@ using namespace VM;
 using namespace VM::Operations;
 
 
+namespace
+{
+
+	//
+	// Push any padding needed so that the top of the stack lies at the given address
+	//
+	// Composite values are pushed one member at a time; when members are laid
+	// out with padding between them, the padding is pushed along with them so
+	// that the value on the stack matches the layout of the composite type.
+	//
+	void PadStackTo(StackSpace& stack, const Byte* address)
+	{
+		size_t padding = reinterpret_cast<const Byte*>(stack.GetCurrentTopOfStack()) - address;
+		if(padding)
+			stack.Push(padding);
+	}
+
+}
+
+
 //
 // Push an integer value onto the stack
 //
@@ -73,12 +94,24 @@ Traverser::Payload PushInteger16Literal::GetNodeTraversalPayload(const VM::Scope
 }
 
 
+//
+// Construct the operation and intern its literal value
+//
+// Since the interned copy of the string is shared and never collected,
+// executing the operation does not need to touch the string pool at all.
+//
+PushStringLiteral::PushStringLiteral(const std::wstring& value)
+	: LiteralValue(value),
+	  LiteralHandle(StringVariable::InternStringLiteral(value))
+{
+}
+
 //
 // Push a string value onto the stack
 //
 void PushStringLiteral::ExecuteFast(ExecutionContext& context)
 {
-	PushValueOntoStack<TypeInfo::StringT>(context.Stack, StringVariable::PoolStringLiteral(LiteralValue));
+	PushValueOntoStack<TypeInfo::StringT>(context.Stack, LiteralHandle);
 }
 
 RValuePtr PushStringLiteral::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -146,7 +179,8 @@ Traverser::Payload PushBooleanLiteral::GetNodeTraversalPayload(const VM::ScopeDe
 PushOperation::PushOperation(VM::Operation* op, const ScopeDescription& scope)
 	: TheOp(op),
 	  IsConsArray(false),
-	  IsConsFromFunction(false)
+	  IsConsFromFunction(false),
+	  KnownType(EpochVariableType_Error)
 {
 	if(dynamic_cast<VM::Operations::ConsArray*>(TheOp) != NULL)
 		IsConsArray = true;
@@ -156,6 +190,25 @@ PushOperation::PushOperation(VM::Operation* op, const ScopeDescription& scope)
 		IsConsFromFunction = true;
 }
 
+//
+// Construct a push operation whose type has already been established
+//
+// This is used when loading validated binaries, which record the
+// type of each push; the type is trusted without being checked.
+//
+PushOperation::PushOperation(VM::Operation* op, EpochVariableTypeID knowntype)
+	: TheOp(op),
+	  IsConsArray(false),
+	  IsConsFromFunction(false),
+	  KnownType(knowntype)
+{
+	if(dynamic_cast<VM::Operations::ConsArray*>(TheOp) != NULL)
+		IsConsArray = true;
+
+	if(KnownType == EpochVariableType_Array && dynamic_cast<VM::Operations::Invoke*>(TheOp) != NULL)
+		IsConsFromFunction = true;
+}
+
 //
 // Destruct and clean up an operation that pushes the result
 // of another operation onto the stack
@@ -171,14 +224,33 @@ PushOperation::~PushOperation()
 RValuePtr PushOperation::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	RValuePtr opresult(TheOp->ExecuteAndStoreRValue(context));
-	DoPush(TheOp->GetType(context.Scope.GetOriginalDescription()), opresult.get(), context.Scope.GetOriginalDescription(), context.Stack, IsConsArray, IsConsFromFunction);
+
+	EpochVariableTypeID type = KnownType;
+	if(type == EpochVariableType_Error)
+		type = TheOp->GetResolvedType(context.Scope.GetOriginalDescription());
+
+	DoPush(type, opresult.get(), context.Scope.GetOriginalDescription(), context.Stack, IsConsArray, IsConsFromFunction);
 
 	return opresult;
 }
 
+//
+// Evaluate an operation and place its value on the stack,
+// discarding the r-value. Scalar results are pushed directly
+// by the nested operation where possible.
+//
 void PushOperation::ExecuteFast(ExecutionContext& context)
 {
-	ExecuteAndStoreRValue(context);
+	if(Instrumentation::IsActive())
+	{
+		Instrumentation::Measurement measure(*TheOp);
+		if(!TheOp->ExecuteAndPushScalar(context))
+			ExecuteAndStoreRValue(context);
+		return;
+	}
+
+	if(!TheOp->ExecuteAndPushScalar(context))
+		ExecuteAndStoreRValue(context);
 }
 
 //
@@ -218,10 +290,16 @@ void PushOperation::DoPush(EpochVariableTypeID type, RValue* value, const ScopeD
 			IDType tupletypeid = tuple.GetTupleTypeID();
 			const TupleType& tupletype = scope.GetTupleType(tupletypeid);
 
+			const Byte* start = reinterpret_cast<const Byte*>(stack.GetCurrentTopOfStack()) - tupletype.GetTotalSize();
+
 			std::vector<std::wstring> members = tupletype.GetMemberOrder();
 			for(std::vector<std::wstring>::const_reverse_iterator iter = members.rbegin(); iter != members.rend(); ++iter)
+			{
+				PadStackTo(stack, start + tupletype.GetMemberOffset(*iter) + tupletype.GetMemberSize(*iter));
 				DoPush(tupletype.GetMemberType(*iter), tuple.GetValue(*iter).get(), scope, stack, false, false);
+			}
 
+			PadStackTo(stack, start + sizeof(IDType));
 			PushValueOntoStack<TypeInfo::TupleT>(stack, tupletypeid);
 		}
 		break;
@@ -232,10 +310,16 @@ void PushOperation::DoPush(EpochVariableTypeID type, RValue* value, const ScopeD
 			IDType structuretypeid = structure.GetStructureTypeID();
 			const StructureType& structuretype = scope.GetStructureType(structuretypeid);
 
+			const Byte* start = reinterpret_cast<const Byte*>(stack.GetCurrentTopOfStack()) - structuretype.GetTotalSize();
+
 			std::vector<std::wstring> members = structuretype.GetMemberOrder();
 			for(std::vector<std::wstring>::const_reverse_iterator iter = members.rbegin(); iter != members.rend(); ++iter)
+			{
+				PadStackTo(stack, start + structuretype.GetMemberOffset(*iter) + structuretype.GetMemberSize(*iter));
 				DoPush(structuretype.GetMemberType(*iter), structure.GetValue(*iter).get(), scope, stack, false, false);
+			}
 
+			PadStackTo(stack, start + sizeof(IDType));
 			PushValueOntoStack<TypeInfo::StructureT>(stack, structuretypeid);
 		}
 		break;
@@ -262,6 +346,11 @@ void PushOperation::DoPush(EpochVariableTypeID type, RValue* value, const ScopeD
 		*reinterpret_cast<HandleType*>(stack.GetCurrentTopOfStack()) = value->CastTo<BufferRValue>().GetOriginHandle();
 		break;
 
+	case EpochVariableType_HashMap:
+		stack.Push(sizeof(HandleType));
+		*reinterpret_cast<HandleType*>(stack.GetCurrentTopOfStack()) = value->CastTo<HashMapRValue>().GetOriginHandle();
+		break;
+
 	default:
 		throw NotImplementedException("Cannot pass value of this type on the stack");
 	}
@@ -272,7 +361,7 @@ void PushOperation::TraverseHelper(TraverserT& traverser)
 {
 	traverser.TraverseNode(*this);
 	if(TheOp)
-		dynamic_cast<SelfAwareBase*>(TheOp)->Traverse(traverser);
+		TheOp->Traverse(traverser);
 }
 
 void PushOperation::Traverse(Validator::ValidationTraverser& traverser)
@@ -285,12 +374,17 @@ void PushOperation::Traverse(Serialization::SerializationTraverser& traverser)
 	TraverseHelper(traverser);
 }
 
+void PushOperation::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraverseHelper(traverser);
+}
+
 //
 // Push a reference binding onto the stack
 //
 void BindReference::ExecuteFast(ExecutionContext& context)
 {
-	PushValueOntoStack<TypeInfo::ReferenceBindingT>(context.Stack, &context.Scope.GetVariableRef(VarName));
+	PushValueOntoStack<TypeInfo::ReferenceBindingT>(context.Stack, &context.Scope.GetVariableRef(Slot, VarName));
 }
 
 RValuePtr BindReference::ExecuteAndStoreRValue(ExecutionContext& context)
@@ -9,6 +9,7 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 
 namespace VM
@@ -93,9 +94,7 @@ namespace VM
 		{
 		// Construction
 		public:
-			PushStringLiteral(const std::wstring& value) :
-				LiteralValue(value)
-			{ }
+			PushStringLiteral(const std::wstring& value);
 
 		// Operation interface
 		public:
@@ -115,6 +114,7 @@ namespace VM
 		// Internal tracking
 		private:
 			std::wstring LiteralValue;
+			HandleType LiteralHandle;
 		};
 
 		//
@@ -139,6 +139,11 @@ namespace VM
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
 			{ return 0; }
 
+		// Additional queries
+		public:
+			Real GetValue() const
+			{ return LiteralValue; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -192,6 +197,7 @@ namespace VM
 		// Construction and destruction
 		public:
 			PushOperation(Operation* op, const ScopeDescription& scope);
+			PushOperation(Operation* op, EpochVariableTypeID knowntype);
 			virtual ~PushOperation();
 
 		// Operation interface
@@ -200,10 +206,10 @@ namespace VM
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
 
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
-			{ return TheOp->GetType(scope); }
+			{ return TheOp->GetResolvedType(scope); }
 
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
-			{ return (TheOp ? TheOp->GetNumParameters(scope) : 0); }
+			{ return (TheOp ? TheOp->GetResolvedNumParameters(scope) : 0); }
 
 		// Additional queries
 		public:
@@ -220,6 +226,7 @@ namespace VM
 
 			virtual void Traverse(Validator::ValidationTraverser& traverser);
 			virtual void Traverse(Serialization::SerializationTraverser& traverser);
+			virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		// Internal helpers
 		public:
@@ -230,6 +237,10 @@ namespace VM
 			Operation* TheOp;
 			bool IsConsArray;
 			bool IsConsFromFunction;
+
+			// Type of the pushed value as recorded in validated binaries;
+			// EpochVariableType_Error if it must be looked up on each push
+			EpochVariableTypeID KnownType;
 		};
 
 
@@ -256,6 +267,14 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return VarName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -263,6 +282,7 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
+			VariableSlot Slot;
 		};
 
 
@@ -8,8 +8,11 @@
 #include "pch.h"
 
 #include "Virtual Machine/Operations/Variables/StringOps.h"
+#include "Virtual Machine/Operations/Variables/StringSearch.h"
 #include "Virtual Machine/Core Entities/Variables/Variable.h"
 #include "Virtual Machine/Core Entities/Variables/StringVariable.h"
+#include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Types Management/TypeInfo.h"
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
 #include "Virtual Machine/Core Entities/Program.h"
 
@@ -18,6 +21,28 @@ using namespace VM;
 using namespace VM::Operations;
 
 
+namespace
+{
+
+	//
+	// Retrieve the two string parameters of an operation from the stack;
+	// the second parameter is on top of the stack, with the first beneath it
+	//
+	// The returned strings refer directly to the contents of the string
+	// pool, and remain valid after the parameters are popped.
+	//
+	void PopStringParameters(StackSpace& stack, const std::wstring*& one, const std::wstring*& two)
+	{
+		StringVariable twovar(stack.GetCurrentTopOfStack());
+		StringVariable onevar(stack.GetOffsetIntoStack(StringVariable::GetStorageSize()));
+		one = &onevar.GetValue();
+		two = &twovar.GetValue();
+		stack.Pop(StringVariable::GetStorageSize() * 2);
+	}
+
+}
+
+
 //
 // Concatenate two strings and return the result
 //
@@ -32,27 +57,31 @@ RValuePtr Concatenate::ExecuteAndStoreRValue(ExecutionContext& context)
 		if(FirstIsArray && !SecondIsArray)
 		{
 			StringVariable var(context.Stack.GetCurrentTopOfStack());
-			std::wstring variableval = var.GetValue();
+			const std::wstring& variableval = var.GetValue();
 			context.Stack.Pop(StringVariable::GetStorageSize());
-			ret = OperateOnArray(context.Stack) + variableval;
+			ret = OperateOnArray(context.Stack);
+			ret += variableval;
 		}
 		else if(!FirstIsArray && SecondIsArray)
 		{
 			ret = OperateOnArray(context.Stack);
 			StringVariable var(context.Stack.GetCurrentTopOfStack());
-			ret = var.GetValue() + ret;
+			ret.insert(0, var.GetValue());
 			context.Stack.Pop(StringVariable::GetStorageSize());
 		}
 		else if(FirstIsArray && SecondIsArray)
 		{
 			ret = OperateOnArray(context.Stack);
-			ret = OperateOnArray(context.Stack) + ret;
+			ret.insert(0, OperateOnArray(context.Stack));
 		}
 		else
 		{
 			StringVariable twovar(context.Stack.GetCurrentTopOfStack());
 			StringVariable onevar(context.Stack.GetOffsetIntoStack(StringVariable::GetStorageSize()));
-			ret = onevar.GetValue() + twovar.GetValue();
+			const std::wstring& one = onevar.GetValue();
+			const std::wstring& two = twovar.GetValue();
+			ret.reserve(one.length() + two.length());
+			ret.append(one).append(two);
 			context.Stack.Pop(StringVariable::GetStorageSize() * 2);
 		}
 	}
@@ -67,6 +96,31 @@ void Concatenate::ExecuteFast(ExecutionContext& context)
 	ExecuteAndStoreRValue(context);
 }
 
+//
+// Concatenate two strings, and push the handle of the result
+//
+// The result is stored in the string pool as a concatenation entry,
+// which refers to the first string rather than copying it; see the
+// string pool for details. Array concatenations and unassigned strings
+// fall back on the general r-value path.
+//
+bool Concatenate::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	if(NumParams != 2 || FirstIsArray || SecondIsArray)
+		return false;
+
+	StringVariable twovar(context.Stack.GetCurrentTopOfStack());
+	StringVariable onevar(context.Stack.GetOffsetIntoStack(StringVariable::GetStorageSize()));
+	if(!onevar.GetHandleValue() || !twovar.GetHandleValue())
+		return false;
+
+	HandleType result = StringVariable::PoolConcatenation(onevar.GetHandleValue(), twovar.GetValue());
+
+	context.Stack.Pop(StringVariable::GetStorageSize());
+	StringVariable(context.Stack.GetCurrentTopOfStack()).SetHandleValue(result);
+	return true;
+}
+
 //
 // Concatenate all members of an array
 //
@@ -83,6 +137,12 @@ std::wstring Concatenate::OperateOnArray(StackSpace& stack) const
 	if(type != EpochVariableType_String)
 		throw ExecutionException("concat() function expects an array of strings");
 
+	// Measure the result first, so that it only needs to be allocated once
+	size_t totallength = 0;
+	for(Integer32 i = 0; i < count; ++i)
+		totallength += StringVariable(stack.GetOffsetIntoStack(static_cast<size_t>(i) * StringVariable::GetStorageSize())).GetValue().length();
+	ret.reserve(totallength);
+
 	for(Integer32 i = 0; i < count; ++i)
 	{
 		StringVariable var(stack.GetCurrentTopOfStack());
@@ -110,3 +170,158 @@ void Length::ExecuteFast(ExecutionContext& context)
 	// Nothing to do.
 }
 
+
+//
+// Locate the second string within the first
+//
+Integer32 FindSubstring::Search(ExecutionContext& context)
+{
+	const std::wstring* haystack;
+	const std::wstring* needle;
+	PopStringParameters(context.Stack, haystack, needle);
+
+	size_t index = SearchStringData(haystack->c_str(), haystack->length(), needle->c_str(), needle->length(), 0);
+	if(index == std::wstring::npos)
+		return -1;
+
+	return static_cast<Integer32>(index);
+}
+
+void FindSubstring::ExecuteFast(ExecutionContext& context)
+{
+	Search(context);
+}
+
+RValuePtr FindSubstring::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(Search(context)));
+}
+
+bool FindSubstring::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	Integer32 ret = Search(context);
+	context.Stack.Push(IntegerVariable::GetStorageSize());
+	IntegerVariable(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+	return true;
+}
+
+
+//
+// Determine if the first string begins with the second
+//
+bool StartsWith::Test(ExecutionContext& context)
+{
+	const std::wstring* str;
+	const std::wstring* prefix;
+	PopStringParameters(context.Stack, str, prefix);
+
+	if(prefix->length() > str->length())
+		return false;
+
+	return FindFirstMismatch(str->c_str(), prefix->c_str(), prefix->length()) == prefix->length();
+}
+
+void StartsWith::ExecuteFast(ExecutionContext& context)
+{
+	Test(context);
+}
+
+RValuePtr StartsWith::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new BooleanRValue(Test(context)));
+}
+
+bool StartsWith::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	bool ret = Test(context);
+	context.Stack.Push(BooleanVariable::GetStorageSize());
+	BooleanVariable(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+	return true;
+}
+
+
+//
+// Determine the relative ordering of two strings
+//
+Integer32 CompareStrings::Compare(ExecutionContext& context)
+{
+	const std::wstring* one;
+	const std::wstring* two;
+	PopStringParameters(context.Stack, one, two);
+
+	return CompareStringData(one->c_str(), one->length(), two->c_str(), two->length());
+}
+
+void CompareStrings::ExecuteFast(ExecutionContext& context)
+{
+	Compare(context);
+}
+
+RValuePtr CompareStrings::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	return RValuePtr(new IntegerRValue(Compare(context)));
+}
+
+bool CompareStrings::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	Integer32 ret = Compare(context);
+	context.Stack.Push(IntegerVariable::GetStorageSize());
+	IntegerVariable(context.Stack.GetCurrentTopOfStack()).SetValue(ret);
+	return true;
+}
+
+
+//
+// Split the first string at each occurrence of the second
+//
+// Adjacent separators produce empty pieces, so joining the
+// resulting array with the separator always reproduces the
+// original string.
+//
+void SplitString::ExecuteFast(ExecutionContext& context)
+{
+	context.Stack.Pop(StringVariable::GetStorageSize() * 2);
+}
+
+RValuePtr SplitString::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	const std::wstring* str;
+	const std::wstring* separator;
+	PopStringParameters(context.Stack, str, separator);
+
+	if(separator->empty())
+		throw ExecutionException("split() cannot be used with an empty separator");
+
+	std::vector<size_t> piecestarts;
+	std::vector<size_t> piecelengths;
+
+	size_t start = 0;
+	while(true)
+	{
+		size_t index = SearchStringData(str->c_str(), str->length(), separator->c_str(), separator->length(), start);
+		if(index == std::wstring::npos)
+			break;
+
+		piecestarts.push_back(start);
+		piecelengths.push_back(index - start);
+		start = index + separator->length();
+	}
+	piecestarts.push_back(start);
+	piecelengths.push_back(str->length() - start);
+
+	HandleType arraydatahandle = ArrayVariable::AllocateNewHandle(EpochVariableType_String, piecestarts.size());
+	Byte* storage = reinterpret_cast<Byte*>(ArrayVariable::GetArrayStorage(arraydatahandle));
+
+	std::auto_ptr<ArrayRValue> ret(new ArrayRValue(arraydatahandle, false));
+
+	for(size_t i = 0; i < piecestarts.size(); ++i)
+	{
+		StringVariable var(storage);
+		var.SetValue(str->substr(piecestarts[i], piecelengths[i]), true);
+		ret->AddElement(var.GetAsRValue().release());
+		storage += TypeInfo::GetStorageSize(EpochVariableType_String);
+	}
+
+	return RValuePtr(ret.release());
+}
+
@@ -40,6 +40,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 			
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
 			{ return EpochVariableType_String; }
@@ -112,6 +113,100 @@ namespace VM
 		};
 
 
+		//
+		// Operation for locating the first occurrence of one string within another
+		//
+		// The result is the zero-based index of the match, or -1 if the
+		// second string does not occur in the first.
+		//
+		class FindSubstring : public Operation, public SelfAware<FindSubstring>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Internal helpers
+		private:
+			Integer32 Search(ExecutionContext& context);
+		};
+
+
+		//
+		// Operation for testing whether a string begins with a given prefix
+		//
+		class StartsWith : public Operation, public SelfAware<StartsWith>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Boolean; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Internal helpers
+		private:
+			bool Test(ExecutionContext& context);
+		};
+
+
+		//
+		// Operation for ordering two strings
+		//
+		// The result is negative if the first string sorts before the
+		// second, zero if they are identical, and positive otherwise.
+		//
+		class CompareStrings : public Operation, public SelfAware<CompareStrings>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Integer; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+
+		// Internal helpers
+		private:
+			Integer32 Compare(ExecutionContext& context);
+		};
+
+
+		//
+		// Operation for splitting a string into an array of the pieces
+		// found between occurrences of a separator string
+		//
+		class SplitString : public Operation, public SelfAware<SplitString>
+		{
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const
+			{ return EpochVariableType_Array; }
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 2; }
+		};
+
+
 	}
 
 }
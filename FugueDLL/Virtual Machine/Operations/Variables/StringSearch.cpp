@@ -0,0 +1,217 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for searching and comparing string data
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Operations/Variables/StringSearch.h"
+
+#include "Utility/Threading/MachineInfo.h"
+
+#include <intrin.h>
+#include <emmintrin.h>
+#include <nmmintrin.h>
+
+
+using namespace VM;
+using namespace VM::Operations;
+
+
+namespace
+{
+
+	// Number of 16-bit characters held in a single vector register
+	const size_t CharactersPerRegister = 8;
+
+	// Mask returned by _mm_movemask_epi8 when all characters compared equal
+	const int AllCharactersEqual = 0xffff;
+
+	//
+	// Load a register's worth of characters from possibly unaligned storage
+	//
+	__m128i LoadCharacters(const wchar_t* characters)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(characters));
+	}
+
+	//
+	// Determine if the given number of characters are identical
+	//
+	bool CharactersMatch(const wchar_t* one, const wchar_t* two, size_t count)
+	{
+		return FindFirstMismatch(one, two, count) == count;
+	}
+
+
+	//
+	// Scalar search, used when the CPU lacks the required
+	// instruction set, and for any leftover characters that
+	// do not fill a complete vector register
+	//
+	size_t ScalarSearch(const wchar_t* haystack, size_t haystacklength, const wchar_t* needle, size_t needlelength, size_t start)
+	{
+		for(size_t i = start; i + needlelength <= haystacklength; ++i)
+		{
+			if(haystack[i] == needle[0] && CharactersMatch(haystack + i, needle, needlelength))
+				return i;
+		}
+
+		return std::wstring::npos;
+	}
+
+	//
+	// Search using the SSE4.2 string comparison instructions
+	//
+	// PCMPESTRI in "equal ordered" mode locates the first position in
+	// a block of haystack characters where the first few characters of
+	// the needle begin, including a partial match which runs off the
+	// end of the block. Each reported candidate is then checked against
+	// the full needle; if the block contains no candidate at all, the
+	// whole block is skipped.
+	//
+	size_t SSE42Search(const wchar_t* haystack, size_t haystacklength, const wchar_t* needle, size_t needlelength, size_t start)
+	{
+		const int SearchMode = _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ORDERED | _SIDD_LEAST_SIGNIFICANT;
+
+		wchar_t prefix[CharactersPerRegister] = { 0 };
+		int prefixlength = static_cast<int>(std::min(needlelength, CharactersPerRegister));
+		std::copy(needle, needle + prefixlength, prefix);
+		__m128i prefixchars = LoadCharacters(prefix);
+
+		size_t laststart = haystacklength - needlelength;
+
+		size_t i = start;
+		while(i + CharactersPerRegister <= haystacklength)
+		{
+			int index = _mm_cmpestri(prefixchars, prefixlength, LoadCharacters(haystack + i), static_cast<int>(CharactersPerRegister), SearchMode);
+			if(index == static_cast<int>(CharactersPerRegister))
+			{
+				i += CharactersPerRegister;
+				continue;
+			}
+
+			size_t candidate = i + index;
+			if(candidate > laststart)
+				return std::wstring::npos;
+
+			if(CharactersMatch(haystack + candidate, needle, needlelength))
+				return candidate;
+
+			i = candidate + 1;
+		}
+
+		return ScalarSearch(haystack, haystacklength, needle, needlelength, i);
+	}
+
+	//
+	// Search using SSE2 comparisons
+	//
+	// Candidate positions are found by comparing a block of characters
+	// against both the first and last characters of the needle; only
+	// positions where both agree need to be checked in full.
+	//
+	size_t SSE2Search(const wchar_t* haystack, size_t haystacklength, const wchar_t* needle, size_t needlelength, size_t start)
+	{
+		__m128i firstchar = _mm_set1_epi16(static_cast<short>(needle[0]));
+		__m128i lastchar = _mm_set1_epi16(static_cast<short>(needle[needlelength - 1]));
+
+		size_t i = start;
+		for(; i + needlelength - 1 + CharactersPerRegister <= haystacklength; i += CharactersPerRegister)
+		{
+			__m128i firstmatches = _mm_cmpeq_epi16(firstchar, LoadCharacters(haystack + i));
+			__m128i lastmatches = _mm_cmpeq_epi16(lastchar, LoadCharacters(haystack + i + needlelength - 1));
+			unsigned long mask = static_cast<unsigned long>(_mm_movemask_epi8(_mm_and_si128(firstmatches, lastmatches)));
+
+			unsigned long bit;
+			while(_BitScanForward(&bit, mask))
+			{
+				size_t candidate = i + bit / 2;
+				if(CharactersMatch(haystack + candidate, needle, needlelength))
+					return candidate;
+
+				// Each character occupies two bits of the mask
+				mask &= ~(3ul << bit);
+			}
+		}
+
+		return ScalarSearch(haystack, haystacklength, needle, needlelength, i);
+	}
+
+}
+
+
+//
+// Find the index of the first character which differs between two strings
+//
+// If the given number of characters are all identical, the count is returned.
+//
+size_t VM::Operations::FindFirstMismatch(const wchar_t* one, const wchar_t* two, size_t count)
+{
+	size_t i = 0;
+
+	if(Threads::CPUSupportsSSE2())
+	{
+		for(; i + CharactersPerRegister <= count; i += CharactersPerRegister)
+		{
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(LoadCharacters(one + i), LoadCharacters(two + i)));
+			if(mask != AllCharactersEqual)
+			{
+				unsigned long bit;
+				_BitScanForward(&bit, static_cast<unsigned long>(~mask & AllCharactersEqual));
+				return i + bit / 2;
+			}
+		}
+	}
+
+	for(; i < count; ++i)
+	{
+		if(one[i] != two[i])
+			return i;
+	}
+
+	return count;
+}
+
+//
+// Compare two strings, returning a negative value if the first
+// string sorts before the second, zero if they are identical,
+// and a positive value if the first string sorts after the second
+//
+int VM::Operations::CompareStringData(const wchar_t* one, size_t onelength, const wchar_t* two, size_t twolength)
+{
+	size_t common = std::min(onelength, twolength);
+	size_t mismatch = FindFirstMismatch(one, two, common);
+	if(mismatch < common)
+		return (one[mismatch] < two[mismatch]) ? -1 : 1;
+
+	if(onelength == twolength)
+		return 0;
+
+	return (onelength < twolength) ? -1 : 1;
+}
+
+//
+// Find the first occurrence of a substring at or after the given position
+//
+// Returns std::wstring::npos if the substring does not occur. An empty
+// substring is considered to occur at the starting position.
+//
+size_t VM::Operations::SearchStringData(const wchar_t* haystack, size_t haystacklength, const wchar_t* needle, size_t needlelength, size_t start)
+{
+	if(start > haystacklength || needlelength > haystacklength - start)
+		return std::wstring::npos;
+
+	if(needlelength == 0)
+		return start;
+
+	if(Threads::CPUSupportsSSE42())
+		return SSE42Search(haystack, haystacklength, needle, needlelength, start);
+
+	if(Threads::CPUSupportsSSE2())
+		return SSE2Search(haystack, haystacklength, needle, needlelength, start);
+
+	return ScalarSearch(haystack, haystacklength, needle, needlelength, start);
+}
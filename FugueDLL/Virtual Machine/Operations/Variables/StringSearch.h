@@ -0,0 +1,30 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Vectorized kernels for searching and comparing string data
+//
+// These routines work directly on the characters held in the string
+// pool. Where the host CPU supports it, SSE4.2 string instructions
+// are used to search for substrings, and SSE2 is used to compare up
+// to eight characters at once; otherwise plain scalar loops are used.
+// Comparisons are ordinal, i.e. strings are ordered by the numeric
+// values of their characters, matching std::wstring::compare.
+//
+
+#pragma once
+
+
+namespace VM
+{
+	namespace Operations
+	{
+
+		size_t FindFirstMismatch(const wchar_t* one, const wchar_t* two, size_t count);
+
+		int CompareStringData(const wchar_t* one, size_t onelength, const wchar_t* two, size_t twolength);
+
+		size_t SearchStringData(const wchar_t* haystack, size_t haystacklength, const wchar_t* needle, size_t needlelength, size_t start);
+
+	}
+}
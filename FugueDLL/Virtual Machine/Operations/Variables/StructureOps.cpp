@@ -27,7 +27,8 @@ using namespace VM::Operations;
 //
 ReadStructure::ReadStructure(const std::wstring& varname, const std::wstring& membername)
 	: VarName(varname),
-	  MemberName(membername)
+	  MemberName(membername),
+	  QualifiedName(varname + L"." + membername)
 {
 }
 
@@ -36,7 +37,7 @@ ReadStructure::ReadStructure(const std::wstring& varname, const std::wstring& me
 //
 RValuePtr ReadStructure::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	return context.Scope.GetVariableRef<StructureVariable>(VarName).ReadMember(MemberName);
+	return context.Scope.GetVariableRef<StructureVariable>(Slot, VarName).ReadMember(Member, MemberName);
 }
 
 void ReadStructure::ExecuteFast(ExecutionContext& context)
@@ -52,6 +53,15 @@ EpochVariableTypeID ReadStructure::GetType(const ScopeDescription& scope) const
 	return scope.GetStructureType(scope.GetVariableStructureTypeID(VarName)).GetMemberType(MemberName);
 }
 
+Traverser::Payload ReadStructure::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload ret;
+	ret.SetValue(QualifiedName.c_str());
+	ret.IsIdentifier = true;
+	ret.ParameterCount = GetNumParameters(*scope);
+	return ret;
+}
+
 //
 // Construct and initialize the structure read operation
 //
@@ -67,7 +77,7 @@ ReadStructureIndirect::ReadStructureIndirect(const std::wstring& membername, Ope
 RValuePtr ReadStructureIndirect::ExecuteAndStoreRValue(ExecutionContext& context)
 {
 	StructureVariable thestruct(context.Stack.GetCurrentTopOfStack());
-	RValuePtr ret(thestruct.ReadMember(MemberName));
+	RValuePtr ret(thestruct.ReadMember(Member, MemberName));
 	context.Stack.Pop(thestruct.GetStorageSize());
 	return ret;
 }
@@ -125,7 +135,8 @@ IDType ReadStructureIndirect::WalkInstructionsForTypeHint(const ScopeDescription
 //
 AssignStructure::AssignStructure(const std::wstring& varname, const std::wstring& membername)
 	: VarName(varname),
-	  MemberName(membername)
+	  MemberName(membername),
+	  QualifiedName(varname + L"." + membername)
 {
 }
 
@@ -134,41 +145,42 @@ AssignStructure::AssignStructure(const std::wstring& varname, const std::wstring
 //
 RValuePtr AssignStructure::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	StructureVariable& structure = context.Scope.GetVariableRef<StructureVariable>(VarName);
-	switch(GetType(context.Scope.GetOriginalDescription()))
+	StructureVariable& structure = context.Scope.GetVariableRef<StructureVariable>(Slot, VarName);
+	EpochVariableTypeID membertype = Member.IsResolvedFor(structure.GetValue()) ? Member.Type : GetType(context.Scope.GetOriginalDescription());
+	switch(membertype)
 	{
 	case EpochVariableType_Integer:
 		{
 			IntegerVariable var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(IntegerVariable::GetStorageSize());
 		}
 		break;
 	case EpochVariableType_Integer16:
 		{
 			Integer16Variable var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(Integer16Variable::GetStorageSize());
 		}
 		break;
 	case EpochVariableType_Real:
 		{
 			RealVariable var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(RealVariable::GetStorageSize());
 		}
 		break;
 	case EpochVariableType_Boolean:
 		{
 			BooleanVariable var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(BooleanVariable::GetStorageSize());
 		}
 		break;
 	case EpochVariableType_String:
 		{
 			StringVariable var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(StringVariable::GetStorageSize());
 		}
 		break;
@@ -185,14 +197,14 @@ RValuePtr AssignStructure::ExecuteAndStoreRValue(ExecutionContext& context)
 			for(std::vector<std::wstring>::const_iterator iter = members.begin(); iter != members.end(); ++iter)
 				rvptr->AddMember(*iter, RValuePtr(var.ReadMember(*iter)->Clone()));
 
-			structure.WriteMember(MemberName, RValuePtr(rvptr), false);
+			structure.WriteMember(Member, MemberName, RValuePtr(rvptr), false);
 			context.Stack.Pop(substructuretype.GetTotalSize());
 		}
 		break;
 	case EpochVariableType_Function:
 		{
 			FunctionBinding var(context.Stack.GetCurrentTopOfStack());
-			structure.WriteMember(MemberName, var.GetAsRValue(), false);
+			structure.WriteMember(Member, MemberName, var.GetAsRValue(), false);
 			context.Stack.Pop(FunctionBinding::GetStorageSize());
 		}
 		break;
@@ -200,7 +212,7 @@ RValuePtr AssignStructure::ExecuteAndStoreRValue(ExecutionContext& context)
 		throw NotImplementedException("Cannot assign structure member value");
 	}
 
-	return structure.ReadMember(MemberName);
+	return structure.ReadMember(Member, MemberName);
 }
 
 void AssignStructure::ExecuteFast(ExecutionContext& context)
@@ -216,6 +228,15 @@ EpochVariableTypeID AssignStructure::GetType(const ScopeDescription& scope) cons
 	return scope.GetStructureType(scope.GetVariableStructureTypeID(VarName)).GetMemberType(MemberName);
 }
 
+Traverser::Payload AssignStructure::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload ret;
+	ret.SetValue(QualifiedName.c_str());
+	ret.IsIdentifier = true;
+	ret.ParameterCount = GetNumParameters(*scope);
+	return ret;
+}
+
 //
 // Construct and initialize the structure write operation
 //
@@ -355,7 +376,15 @@ RValuePtr BindStructMemberReference::ExecuteAndStoreRValue(ExecutionContext& con
 	}
 	else
 	{
-		Byte* address = reinterpret_cast<Byte*>(context.Scope.GetVariableRef(*VarName).GetStorage()) + context.Scope.GetStructureType(context.Scope.GetVariableStructureTypeID(*VarName)).GetMemberOffset(MemberName);
+		StructureVariable& structure = context.Scope.GetVariableRef<StructureVariable>(Slot, *VarName);
+
+		size_t offset;
+		if(Member.IsResolvedFor(structure.GetValue()))
+			offset = Member.Offset;
+		else
+			offset = context.Scope.GetStructureType(context.Scope.GetVariableStructureTypeID(*VarName)).GetMemberOffset(MemberName);
+
+		Byte* address = reinterpret_cast<Byte*>(structure.GetStorage()) + offset;
 		return RValuePtr(new AddressRValue(address));
 	}
 }
@@ -11,6 +11,7 @@
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
 #include "Virtual Machine/Core Entities/Types/Structure.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 
 namespace VM
@@ -48,10 +49,28 @@ namespace VM
 			const std::wstring& GetMemberName() const
 			{ return MemberName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+			void SetMemberSlot(const MemberSlot& slot)
+			{ Member = slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
 			const std::wstring& MemberName;
+			const std::wstring QualifiedName;
+			VariableSlot Slot;
+			MemberSlot Member;
 		};
 
 		//
@@ -80,10 +99,19 @@ namespace VM
 			const std::wstring& GetMemberName() const
 			{ return MemberName; }
 
+			Operation* GetPriorOperation() const
+			{ return PriorOp; }
+
+		// Slot resolution
+		public:
+			void SetMemberSlot(const MemberSlot& slot)
+			{ Member = slot; }
+
 		// Internal tracking
 		private:
 			const std::wstring& MemberName;
 			VM::Operation* PriorOp;
+			MemberSlot Member;
 		};
 
 		//
@@ -112,10 +140,28 @@ namespace VM
 			const std::wstring& GetMemberName() const
 			{ return MemberName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+			void SetMemberSlot(const MemberSlot& slot)
+			{ Member = slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
 			const std::wstring& MemberName;
+			const std::wstring QualifiedName;
+			VariableSlot Slot;
+			MemberSlot Member;
 		};
 
 		//
@@ -179,11 +225,24 @@ namespace VM
 			bool IsChained() const
 			{ return Chained; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+			void SetMemberSlot(const MemberSlot& slot)
+			{ Member = slot; }
+
 		// Internal tracking
 		private:
 			const std::wstring* VarName;
 			const std::wstring& MemberName;
 			bool Chained;
+			VariableSlot Slot;
+			MemberSlot Member;
 		};
 
 	}
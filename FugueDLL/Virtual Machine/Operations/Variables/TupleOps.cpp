@@ -29,7 +29,8 @@ using namespace VM::Operations;
 //
 ReadTuple::ReadTuple(const std::wstring& varname, const std::wstring& membername)
 	: VarName(varname),
-	  MemberName(membername)
+	  MemberName(membername),
+	  QualifiedName(varname + L"." + membername)
 {
 }
 
@@ -54,12 +55,22 @@ EpochVariableTypeID ReadTuple::GetType(const ScopeDescription& scope) const
 	return scope.GetTupleType(scope.GetVariableTupleTypeID(VarName)).GetMemberType(MemberName);
 }
 
+Traverser::Payload ReadTuple::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload ret;
+	ret.SetValue(QualifiedName.c_str());
+	ret.IsIdentifier = true;
+	ret.ParameterCount = GetNumParameters(*scope);
+	return ret;
+}
+
 //
 // Construct and initialize the tuple write operation
 //
 AssignTuple::AssignTuple(const std::wstring& varname, const std::wstring& membername)
 	: VarName(varname),
-	  MemberName(membername)
+	  MemberName(membername),
+	  QualifiedName(varname + L"." + membername)
 {
 }
 
@@ -118,3 +129,12 @@ EpochVariableTypeID AssignTuple::GetType(const ScopeDescription& scope) const
 {
 	return scope.GetTupleType(scope.GetVariableTupleTypeID(VarName)).GetMemberType(MemberName);
 }
+
+Traverser::Payload AssignTuple::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload ret;
+	ret.SetValue(QualifiedName.c_str());
+	ret.IsIdentifier = true;
+	ret.ParameterCount = GetNumParameters(*scope);
+	return ret;
+}
@@ -42,10 +42,15 @@ namespace VM
 			const std::wstring& GetMemberName() const
 			{ return MemberName; }
 
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
 			const std::wstring& MemberName;
+			const std::wstring QualifiedName;
 		};
 
 		//
@@ -71,10 +76,15 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const		{ return VarName; }
 			const std::wstring& GetMemberName() const				{ return MemberName; }
 
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
 			const std::wstring& MemberName;
+			const std::wstring QualifiedName;
 		};
 
 	}
@@ -10,11 +10,15 @@
 #include "Virtual Machine/Operations/Variables/VariableOps.h"
 
 #include "Virtual Machine/Core Entities/Scopes/ActivatedScope.h"
+#include "Virtual Machine/Core Entities/Concurrency/Future.h"
 #include "Virtual Machine/Core Entities/Function.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
+#include "Virtual Machine/Core Entities/Variables/StringVariable.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Types/CompositeType.h"
 #include "Virtual Machine/Core Entities/Program.h"
 #include "Virtual Machine/SelfAware.inl"
+#include "Virtual Machine/VMExceptions.h"
 
 #include "Virtual Machine/Types Management/TypeInfo.h"
 #include "Virtual Machine/Types Management/Typecasts.h"
@@ -37,12 +41,51 @@ AssignValue::AssignValue(const std::wstring& varname)
 //
 RValuePtr AssignValue::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	return context.Scope.PopVariableOffStack(VarName, context.Stack, false);
+	return context.Scope.PopVariableOffStack(Slot, VarName, context.Stack, false);
 }
 
 void AssignValue::ExecuteFast(ExecutionContext& context)
 {
-	context.Scope.PopVariableOffStack(VarName, context.Stack, false);
+	// Strings are assigned by simply rebinding the variable to the handle
+	// on the stack; producing the r-value would mean copying the string
+	// and, for concatenated strings, assembling the full value.
+	Variable& var = context.Scope.GetVariableRef(Slot, VarName);
+	if(var.GetType() == EpochVariableType_String)
+	{
+		StringVariable temp(context.Stack.GetCurrentTopOfStack());
+		var.CastTo<StringVariable>().SetHandleValue(temp.GetHandleValue());
+		context.Stack.Pop(StringVariable::GetStorageSize());
+		return;
+	}
+
+	// Structures and tuples are laid out on the stack exactly as they are
+	// in storage, so the whole value can be moved into place in one copy.
+	// As with strings, any handles held by the value are simply rebound.
+	if(var.GetType() == EpochVariableType_Structure || var.GetType() == EpochVariableType_Tuple)
+	{
+		IDType id = *reinterpret_cast<IDType*>(context.Stack.GetCurrentTopOfStack());
+		size_t size = CompositeType::GetCompositeType(var.GetType(), id).GetTotalSize();
+		memcpy(var.GetStorage(), context.Stack.GetCurrentTopOfStack(), size);
+		context.Stack.Pop(size);
+		return;
+	}
+
+	// Plain values are likewise copied straight into the variable
+	switch(var.GetType())
+	{
+	case EpochVariableType_Integer:
+	case EpochVariableType_Integer16:
+	case EpochVariableType_Real:
+	case EpochVariableType_Boolean:
+		{
+			size_t size = TypeInfo::GetStorageSize(var.GetType());
+			memcpy(var.GetStorage(), context.Stack.GetCurrentTopOfStack(), size);
+			context.Stack.Pop(size);
+		}
+		return;
+	}
+
+	context.Scope.PopVariableOffStack(Slot, VarName, context.Stack, false);
 }
 
 
@@ -90,26 +133,28 @@ InitializeValue::InitializeValue(const std::wstring& varname)
 //
 RValuePtr InitializeValue::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	if(context.Scope.GetVariableType(VarName) == EpochVariableType_Buffer)
+	Variable& target = context.Scope.GetVariableRef(Slot, VarName);
+
+	if(target.GetType() == EpochVariableType_Buffer)
 	{
 		IntegerVariable var(context.Stack.GetCurrentTopOfStack());
 		size_t buffersize = var.GetValue();
 		context.Stack.Pop(IntegerVariable::GetStorageSize());
 
-		context.Scope.GetVariableRef(VarName).CastTo<BufferVariable>().SetValue(NULL, buffersize, true);
-		return context.Scope.GetVariableValue(VarName);
+		target.CastTo<BufferVariable>().SetValue(NULL, buffersize, true);
+		return context.Scope.GetVariableValue(Slot, VarName);
 	}
-	else if(context.Scope.GetVariableType(VarName) == EpochVariableType_Array)
+	else if(target.GetType() == EpochVariableType_Array)
 	{
 		IntegerVariable var(context.Stack.GetCurrentTopOfStack());
 		HandleType handle = var.GetValue();
 		context.Stack.Pop(IntegerVariable::GetStorageSize());
 
-		context.Scope.GetVariableRef(VarName).CastTo<ArrayVariable>().SetValue(handle);
-		return context.Scope.GetVariableValue(VarName);
+		target.CastTo<ArrayVariable>().SetValue(handle);
+		return context.Scope.GetVariableValue(Slot, VarName);
 	}
 	else
-		return context.Scope.PopVariableOffStack(VarName, context.Stack, true);
+		return context.Scope.PopVariableOffStack(VarName, target, context.Stack, true);
 }
 
 void InitializeValue::ExecuteFast(ExecutionContext& context)
@@ -161,7 +206,7 @@ GetVariableValue::GetVariableValue(const std::wstring& varname)
 //
 RValuePtr GetVariableValue::ExecuteAndStoreRValue(ExecutionContext& context)
 {
-	return context.Scope.GetVariableValue(VarName);
+	return context.Scope.GetVariableValue(Slot, VarName);
 }
 
 void GetVariableValue::ExecuteFast(ExecutionContext& context)
@@ -169,6 +214,142 @@ void GetVariableValue::ExecuteFast(ExecutionContext& context)
 	// Nothing to do.
 }
 
+//
+// Copy a scalar variable's value straight onto the stack
+//
+// Structures and tuples are also copied directly, as a single block,
+// rather than being read into an r-value member by member.
+//
+// Futures have no variable storage of their own, so their results are
+// read from the future itself instead.
+//
+bool GetVariableValue::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	if(!Slot.IsResolved())
+	{
+		const Future* future = context.Scope.FindLocalFuture(VarName);
+		if(future)
+			return PushFutureResult(*future, context.Stack);
+	}
+
+	const Variable& var = context.Scope.GetVariableRef(Slot, VarName);
+	switch(var.GetType())
+	{
+	case EpochVariableType_Integer:		PushScalar<IntegerVariable>(var, context.Stack);		return true;
+	case EpochVariableType_Integer16:	PushScalar<Integer16Variable>(var, context.Stack);		return true;
+	case EpochVariableType_Real:		PushScalar<RealVariable>(var, context.Stack);			return true;
+	case EpochVariableType_Boolean:		PushScalar<BooleanVariable>(var, context.Stack);		return true;
+	case EpochVariableType_String:		return PushStringHandle(var, context.Stack);
+	case EpochVariableType_Array:		PushArrayHandle(var, context.Stack);					return true;
+	case EpochVariableType_Structure:
+	case EpochVariableType_Tuple:		return PushComposite(var, context.Stack);
+	}
+
+	return false;
+}
+
+template <class VarType>
+void GetVariableValue::PushScalar(const Variable& var, StackSpace& stack)
+{
+	typename VarType::BaseStorage value = VarType(var.GetStorage()).GetValue();
+	stack.Push(VarType::GetStorageSize());
+	VarType(stack.GetCurrentTopOfStack()).SetValue(value);
+}
+
+//
+// Push a string variable's handle onto the stack
+//
+// The pooled string is shared rather than copied; sharing makes the
+// pooled entry immutable, so later changes to the value will be made
+// on a fresh copy instead of affecting the other holders of the handle.
+// Unassigned strings are left for the r-value path to report.
+//
+bool GetVariableValue::PushStringHandle(const Variable& var, StackSpace& stack)
+{
+	StringVariable::BaseStorage handle = StringVariable(var.GetStorage()).GetHandleValue();
+	if(!handle)
+		return false;
+
+	StringVariable::ShareHandle(handle);
+	stack.Push(StringVariable::GetStorageSize());
+	StringVariable(stack.GetCurrentTopOfStack()).SetHandleValue(handle);
+	return true;
+}
+
+//
+// Push an array variable's handle onto the stack
+//
+// As with strings, the array data is shared rather than copied, and
+// will be copied only if one of the holders later writes to it.
+//
+void GetVariableValue::PushArrayHandle(const Variable& var, StackSpace& stack)
+{
+	ArrayVariable::BaseStorage handle = ArrayVariable(var.GetStorage()).GetValue();
+
+	ArrayVariable::ShareHandle(handle);
+	stack.Push(ArrayVariable::GetBaseStorageSize());
+	ArrayVariable(stack.GetCurrentTopOfStack()).SetValue(handle);
+}
+
+//
+// Push a copy of a structure or tuple variable onto the stack
+//
+// Handles held by the value's members are shared with the copy, just as
+// for standalone string and array variables. Values which cannot safely
+// be block copied are left for the r-value path.
+//
+bool GetVariableValue::PushComposite(const Variable& var, StackSpace& stack)
+{
+	IDType id = *reinterpret_cast<const IDType*>(var.GetStorage());
+	if(!id)
+		return false;
+
+	const CompositeType& type = CompositeType::GetCompositeType(var.GetType(), id);
+	if(!type.CanCopyAsBlock(var.GetStorage()))
+		return false;
+
+	type.ShareHandles(var.GetStorage());
+	stack.Push(type.GetTotalSize());
+	memcpy(stack.GetCurrentTopOfStack(), var.GetStorage(), type.GetTotalSize());
+	return true;
+}
+
+//
+// Push the result of a future straight onto the stack
+//
+// Scalar results are read in place, which saves cloning the result
+// for every read of a future that has already completed. Other types
+// are left for the r-value path, which takes care of copying them.
+//
+bool GetVariableValue::PushFutureResult(const Future& future, StackSpace& stack)
+{
+	const RValue& result = future.ReadValue();
+	switch(result.GetType())
+	{
+	case EpochVariableType_Integer:
+		stack.Push(IntegerVariable::GetStorageSize());
+		IntegerVariable(stack.GetCurrentTopOfStack()).SetValue(result.CastTo<IntegerRValue>().GetValue());
+		return true;
+
+	case EpochVariableType_Integer16:
+		stack.Push(Integer16Variable::GetStorageSize());
+		Integer16Variable(stack.GetCurrentTopOfStack()).SetValue(result.CastTo<Integer16RValue>().GetValue());
+		return true;
+
+	case EpochVariableType_Real:
+		stack.Push(RealVariable::GetStorageSize());
+		RealVariable(stack.GetCurrentTopOfStack()).SetValue(result.CastTo<RealRValue>().GetValue());
+		return true;
+
+	case EpochVariableType_Boolean:
+		stack.Push(BooleanVariable::GetStorageSize());
+		BooleanVariable(stack.GetCurrentTopOfStack()).SetValue(result.CastTo<BooleanRValue>().GetValue());
+		return true;
+	}
+
+	return false;
+}
+
 //
 // Get the type of the retrieved variable
 //
@@ -187,6 +368,92 @@ Traverser::Payload GetVariableValue::GetNodeTraversalPayload(const VM::ScopeDesc
 }
 
 
+//
+// Hand the contents of the variable over to the stack without sharing them
+//
+bool MoveVariable::ExecuteAndPushScalar(ExecutionContext& context)
+{
+	EpochVariableTypeID type;
+	HandleType handle = TakeHandle(context, type);
+
+	context.Stack.Push(sizeof(HandleType));
+	*reinterpret_cast<HandleType*>(context.Stack.GetCurrentTopOfStack()) = handle;
+	return true;
+}
+
+RValuePtr MoveVariable::ExecuteAndStoreRValue(ExecutionContext& context)
+{
+	EpochVariableTypeID type;
+	HandleType handle = TakeHandle(context, type);
+
+	if(type == EpochVariableType_Array)
+		return RValuePtr(new ArrayRValue(handle, false));
+
+	return RValuePtr(new BufferRValue(handle));
+}
+
+//
+// Moving a value without using it simply discards it; the
+// garbage collector will reclaim the data at some point
+//
+void MoveVariable::ExecuteFast(ExecutionContext& context)
+{
+	EpochVariableTypeID type;
+	TakeHandle(context, type);
+}
+
+EpochVariableTypeID MoveVariable::GetType(const ScopeDescription& scope) const
+{
+	return scope.GetVariableType(VarName);
+}
+
+Traverser::Payload MoveVariable::GetNodeTraversalPayload(const VM::ScopeDescription* scope) const
+{
+	Traverser::Payload ret;
+	ret.SetValue(VarName.c_str());
+	ret.IsIdentifier = true;
+	ret.ParameterCount = GetNumParameters(*scope);
+	return ret;
+}
+
+//
+// Detach the handle held by the variable, leaving the variable unassigned
+//
+HandleType MoveVariable::TakeHandle(ExecutionContext& context, EpochVariableTypeID& type)
+{
+	Variable& var = context.Scope.GetVariableRef(Slot, VarName);
+	type = var.GetType();
+
+	HandleType handle;
+	switch(type)
+	{
+	case EpochVariableType_Array:
+		{
+			ArrayVariable& arrayvar = var.CastTo<ArrayVariable>();
+			handle = arrayvar.GetValue();
+			arrayvar.SetValue(0);
+		}
+		break;
+
+	case EpochVariableType_Buffer:
+		{
+			BufferVariable& buffervar = var.CastTo<BufferVariable>();
+			handle = buffervar.GetHandleValue();
+			buffervar.SetHandleValue(0);
+		}
+		break;
+
+	default:
+		throw ExecutionException("Only arrays and buffers can be moved");
+	}
+
+	if(!handle)
+		throw ExecutionException("Cannot move a variable whose contents have already been moved");
+
+	return handle;
+}
+
+
 //
 // Retrieve a variable's storage size
 //
@@ -214,4 +481,4 @@ Traverser::Payload SizeOf::GetNodeTraversalPayload(const VM::ScopeDescription* s
 	payload.IsIdentifier = true;
 	payload.ParameterCount = GetNumParameters(*scope);
 	return payload;
-}
\ No newline at end of file
+}
\ No newline at end of file
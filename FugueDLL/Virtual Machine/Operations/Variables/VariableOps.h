@@ -9,6 +9,7 @@
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/Core Entities/Scopes/VariableSlot.h"
 
 
 namespace VM
@@ -17,6 +18,8 @@ namespace VM
 	// Forward declarations
 	class ScopeDescription;
 	class FunctionBase;
+	class Variable;
+	class Future;
 
 	namespace Operations
 	{
@@ -43,6 +46,14 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return VarName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -50,6 +61,7 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
+			VariableSlot Slot;
 		};
 
 		//
@@ -75,6 +87,14 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return VarName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
@@ -82,6 +102,7 @@ namespace VM
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
+			VariableSlot Slot;
 		};
 
 		//
@@ -97,6 +118,7 @@ namespace VM
 		public:
 			virtual void ExecuteFast(ExecutionContext& context);
 			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
 			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const;
 
 			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
@@ -107,13 +129,87 @@ namespace VM
 			const std::wstring& GetAssociatedIdentifier() const
 			{ return VarName; }
 
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
 		// Traversal
 		public:
 			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
 			
+		// Internal helpers
+		private:
+			template <class VarType>
+			static void PushScalar(const Variable& var, StackSpace& stack);
+
+			static bool PushStringHandle(const Variable& var, StackSpace& stack);
+			static void PushArrayHandle(const Variable& var, StackSpace& stack);
+			static bool PushComposite(const Variable& var, StackSpace& stack);
+			static bool PushFutureResult(const Future& future, StackSpace& stack);
+
+		// Internal tracking
+		private:
+			const std::wstring& VarName;
+			VariableSlot Slot;
+		};
+
+
+		//
+		// Operation for handing over the contents of an array or buffer variable
+		//
+		// The handle is pushed without being marked as shared, and the
+		// variable is left unassigned, so that the new holder (typically
+		// the receiver of a message) owns the data outright and can write
+		// to it in place without copying. Any later use of the original
+		// variable is an error.
+		//
+		class MoveVariable : public Operation, public SelfAware<MoveVariable>
+		{
+		// Construction
+		public:
+			MoveVariable(const std::wstring& varname)
+				: VarName(varname)
+			{ }
+
+		// Operation interface
+		public:
+			virtual void ExecuteFast(ExecutionContext& context);
+			virtual RValuePtr ExecuteAndStoreRValue(ExecutionContext& context);
+			virtual bool ExecuteAndPushScalar(ExecutionContext& context);
+			virtual EpochVariableTypeID GetType(const ScopeDescription& scope) const;
+
+			virtual size_t GetNumParameters(const VM::ScopeDescription& scope) const
+			{ return 0; }
+
+		// Additional queries
+		public:
+			const std::wstring& GetAssociatedIdentifier() const
+			{ return VarName; }
+
+		// Slot resolution
+		public:
+			void SetVariableSlot(const VariableSlot& slot)
+			{ Slot = slot; }
+
+			const VariableSlot& GetVariableSlot() const
+			{ return Slot; }
+
+		// Traversal
+		public:
+			virtual Traverser::Payload GetNodeTraversalPayload(const VM::ScopeDescription* scope) const;
+
+		// Internal helpers
+		private:
+			HandleType TakeHandle(ExecutionContext& context, EpochVariableTypeID& type);
+
 		// Internal tracking
 		private:
 			const std::wstring& VarName;
+			VariableSlot Slot;
 		};
 
 
@@ -194,6 +290,9 @@ namespace VM
 			static EpochVariableTypeID GetTypeStatic()
 			{ return EpochVariableType_Integer; }
 
+			Integer32 GetValue() const
+			{ return Value; }
+
 		// Internal tracking
 		private:
 			Integer32 Value;
@@ -241,6 +340,9 @@ namespace VM
 			static EpochVariableTypeID GetTypeStatic()
 			{ return EpochVariableType_Integer16; }
 
+			Integer16 GetValue() const
+			{ return Value; }
+
 		// Internal tracking
 		private:
 			Integer16 Value;
@@ -288,6 +390,9 @@ namespace VM
 			static EpochVariableTypeID GetTypeStatic()
 			{ return EpochVariableType_Real; }
 
+			Real GetValue() const
+			{ return Value; }
+
 		// Internal tracking
 		private:
 			Real Value;
@@ -335,6 +440,9 @@ namespace VM
 			static EpochVariableTypeID GetTypeStatic()
 			{ return EpochVariableType_Boolean; }
 
+			bool GetValue() const
+			{ return Value; }
+
 		// Internal tracking
 		private:
 			bool Value;
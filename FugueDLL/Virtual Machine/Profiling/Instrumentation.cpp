@@ -0,0 +1,459 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Instrumented execution mode for measuring individual operations
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Profiling/Instrumentation.h"
+#include "Virtual Machine/Core Entities/Operation.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Parser/Debug Info Tables/DebugTable.h"
+
+#include "User Interface/Output.h"
+
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Strings.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include <iomanip>
+#include <typeinfo>
+#include <intrin.h>
+
+#pragma intrinsic(__rdtsc)
+#pragma intrinsic(__readpmc)
+
+
+using namespace VM;
+
+
+bool Instrumentation::Active = false;
+bool Instrumentation::HardwareCountersActive = false;
+
+
+namespace
+{
+
+	//
+	// Measurements collected for a single operation (or group of operations)
+	//
+	struct OperationCounters
+	{
+		OperationCounters()
+			: Calls(0),
+			  TotalCycles(0),
+			  SelfCycles(0),
+			  RValueAllocations(0)
+		{
+			std::fill(SelfEvents, SelfEvents + Instrumentation::NumHardwareCounters, 0);
+		}
+
+		void Merge(const OperationCounters& other)
+		{
+			Calls += other.Calls;
+			TotalCycles += other.TotalCycles;
+			SelfCycles += other.SelfCycles;
+			RValueAllocations += other.RValueAllocations;
+
+			for(size_t i = 0; i < Instrumentation::NumHardwareCounters; ++i)
+				SelfEvents[i] += other.SelfEvents[i];
+		}
+
+		unsigned __int64 Calls;
+		unsigned __int64 TotalCycles;
+		unsigned __int64 SelfCycles;
+		unsigned __int64 RValueAllocations;
+		unsigned __int64 SelfEvents[Instrumentation::NumHardwareCounters];
+	};
+
+	typedef std::map<const Operation*, OperationCounters> OperationCounterMap;
+
+}
+
+
+//
+// Counters collected by a single thread
+//
+struct Instrumentation::ThreadCounters
+{
+	ThreadCounters()
+		: NestedCycles(0),
+		  RValueAllocations(0)
+	{
+		std::fill(NestedEvents, NestedEvents + NumHardwareCounters, 0);
+	}
+
+	OperationCounterMap Operations;
+
+	// Cycles and hardware events spent in measured operations nested within the current one
+	unsigned __int64 NestedCycles;
+	unsigned __int64 NestedEvents[NumHardwareCounters];
+
+	// Running total of r-values allocated by this thread
+	unsigned __int64 RValueAllocations;
+};
+
+
+namespace
+{
+
+	//
+	// Tracking for the active instrumentation session
+	//
+	DWORD CountersTLSIndex = TLS_OUT_OF_INDEXES;
+
+	Threads::CriticalSection CountersCriticalSection;
+	std::vector<Instrumentation::ThreadCounters*> AllCounters;
+
+
+	//
+	// Hardware performance counters, numbered as for the RDPMC instruction
+	//
+	// Bit 30 selects the fixed counters, the first of which counts retired
+	// instructions on processors which provide them.
+	//
+	const unsigned FixedCounterInstructionsRetired = (1 << 30);
+
+	unsigned HardwareCounterIndices[Instrumentation::NumHardwareCounters];
+	bool HardwareCounterAvailable[Instrumentation::NumHardwareCounters];
+
+	const char* HardwareCounterNames[Instrumentation::NumHardwareCounters] =
+	{
+		"Instructions",
+		"Cache misses",
+		"Branch misses"
+	};
+
+	//
+	// Determine if the given counter can be read from user mode
+	//
+	// Reading a counter which the OS has not made available raises an
+	// exception rather than returning an error, so it is trapped here.
+	// This must stay in a function of its own, since SEH cannot be used
+	// in functions which need to destroy objects while unwinding.
+	//
+	bool ProbeHardwareCounter(unsigned index)
+	{
+		__try
+		{
+			__readpmc(index);
+			return true;
+		}
+		__except(EXCEPTION_EXECUTE_HANDLER)
+		{
+			return false;
+		}
+	}
+
+	//
+	// Read all available hardware counters; unavailable counters read as zero
+	//
+	void ReadHardwareCounters(unsigned __int64* values)
+	{
+		for(size_t i = 0; i < Instrumentation::NumHardwareCounters; ++i)
+			values[i] = HardwareCounterAvailable[i] ? __readpmc(HardwareCounterIndices[i]) : 0;
+	}
+
+
+	//
+	// Retrieve the counters for the calling thread, creating them on demand
+	//
+	Instrumentation::ThreadCounters& GetCountersForThisThread()
+	{
+		Instrumentation::ThreadCounters* counters = reinterpret_cast<Instrumentation::ThreadCounters*>(::TlsGetValue(CountersTLSIndex));
+		if(!counters)
+		{
+			counters = new Instrumentation::ThreadCounters;
+			::TlsSetValue(CountersTLSIndex, counters);
+
+			Threads::CriticalSection::Auto mutex(CountersCriticalSection);
+			AllCounters.push_back(counters);
+		}
+
+		return *counters;
+	}
+
+	//
+	// Obtain a readable name for the type of the given operation
+	//
+	std::string GetOperationTypeName(const Operation& op)
+	{
+		std::string name(typeid(op).name());
+
+		if(name.compare(0, 6, "class ") == 0)
+			name.erase(0, 6);
+		else if(name.compare(0, 7, "struct ") == 0)
+			name.erase(0, 7);
+
+		return name;
+	}
+
+	//
+	// Write out one section of the report, ordered by descending total cycles
+	//
+	void WriteSection(std::ostream& outfile, const std::string& heading, const std::map<std::string, OperationCounters>& rows, bool hardwarecounters)
+	{
+		std::vector<std::pair<unsigned __int64, std::string> > order;
+		for(std::map<std::string, OperationCounters>::const_iterator iter = rows.begin(); iter != rows.end(); ++iter)
+			order.push_back(std::make_pair(iter->second.TotalCycles, iter->first));
+
+		std::sort(order.begin(), order.end());
+		std::reverse(order.begin(), order.end());
+
+		outfile << std::left << std::setw(60) << heading
+				<< std::right << std::setw(14) << "Calls"
+				<< std::setw(20) << "Total cycles"
+				<< std::setw(20) << "Self cycles"
+				<< std::setw(14) << "R-values";
+
+		for(size_t i = 0; hardwarecounters && i < Instrumentation::NumHardwareCounters; ++i)
+		{
+			if(HardwareCounterAvailable[i])
+				outfile << std::setw(20) << HardwareCounterNames[i];
+		}
+
+		outfile << "\n";
+
+		for(std::vector<std::pair<unsigned __int64, std::string> >::const_iterator iter = order.begin(); iter != order.end(); ++iter)
+		{
+			const OperationCounters& counters = rows.find(iter->second)->second;
+			outfile << std::left << std::setw(60) << iter->second
+					<< std::right << std::setw(14) << counters.Calls
+					<< std::setw(20) << counters.TotalCycles
+					<< std::setw(20) << counters.SelfCycles
+					<< std::setw(14) << counters.RValueAllocations;
+
+			for(size_t i = 0; hardwarecounters && i < Instrumentation::NumHardwareCounters; ++i)
+			{
+				if(HardwareCounterAvailable[i])
+					outfile << std::setw(20) << counters.SelfEvents[i];
+			}
+
+			outfile << "\n";
+		}
+
+		outfile << "\n";
+	}
+
+}
+
+
+//
+// Execute an operation, measuring its cost
+//
+void Instrumentation::ExecuteOperation(Operation& op, ExecutionContext& context)
+{
+	Measurement measure(op);
+	op.ExecuteFast(context);
+}
+
+//
+// Count an r-value allocation made by the calling thread
+//
+void Instrumentation::RecordRValueAllocation()
+{
+	++GetCountersForThisThread().RValueAllocations;
+}
+
+
+//
+// Begin measuring an operation
+//
+// The nested cycle and event counts belong to the enclosing measurement,
+// so they are set aside until this measurement is complete.
+//
+Instrumentation::Measurement::Measurement(const Operation& op)
+	: Op(op),
+	  Counters(GetCountersForThisThread())
+{
+	SavedNestedCycles = Counters.NestedCycles;
+	Counters.NestedCycles = 0;
+	StartAllocations = Counters.RValueAllocations;
+
+	if(HardwareCountersActive)
+	{
+		for(size_t i = 0; i < NumHardwareCounters; ++i)
+		{
+			SavedNestedEvents[i] = Counters.NestedEvents[i];
+			Counters.NestedEvents[i] = 0;
+		}
+
+		ReadHardwareCounters(StartEvents);
+	}
+
+	StartCycles = __rdtsc();
+}
+
+//
+// Finish measuring an operation, and record the results
+//
+// A counter which appears to run backwards (because it wrapped, or the
+// thread moved to another processor) contributes nothing to the results.
+//
+Instrumentation::Measurement::~Measurement()
+{
+	unsigned __int64 elapsed = __rdtsc() - StartCycles;
+
+	unsigned __int64 events[NumHardwareCounters];
+	if(HardwareCountersActive)
+		ReadHardwareCounters(events);
+
+	OperationCounters& counters = Counters.Operations[&Op];
+	++counters.Calls;
+	counters.TotalCycles += elapsed;
+	counters.SelfCycles += (elapsed > Counters.NestedCycles) ? elapsed - Counters.NestedCycles : 0;
+	counters.RValueAllocations += Counters.RValueAllocations - StartAllocations;
+
+	Counters.NestedCycles = SavedNestedCycles + elapsed;
+
+	if(HardwareCountersActive)
+	{
+		for(size_t i = 0; i < NumHardwareCounters; ++i)
+		{
+			unsigned __int64 delta = (events[i] > StartEvents[i]) ? events[i] - StartEvents[i] : 0;
+			counters.SelfEvents[i] += (delta > Counters.NestedEvents[i]) ? delta - Counters.NestedEvents[i] : 0;
+			Counters.NestedEvents[i] = SavedNestedEvents[i] + delta;
+		}
+	}
+}
+
+
+//
+// Determine which hardware counters can be read, and start reading them
+//
+void Instrumentation::EnableHardwareCounters()
+{
+	HardwareCounterIndices[Counter_InstructionsRetired] = FixedCounterInstructionsRetired;
+	HardwareCounterIndices[Counter_CacheMisses] = Config::CacheMissCounterIndex;
+	HardwareCounterIndices[Counter_BranchMispredictions] = Config::BranchMissCounterIndex;
+
+	HardwareCountersActive = false;
+	for(size_t i = 0; i < NumHardwareCounters; ++i)
+	{
+		HardwareCounterAvailable[i] = ProbeHardwareCounter(HardwareCounterIndices[i]);
+		if(HardwareCounterAvailable[i])
+			HardwareCountersActive = true;
+	}
+
+	if(!HardwareCountersActive)
+	{
+		UI::OutputStream output;
+		output << UI::lightred << L"Instrumentation: hardware performance counters cannot be read from user mode on this machine" << UI::resetcolor << std::endl;
+	}
+}
+
+
+//
+// Begin an instrumentation session, if instrumentation is enabled
+//
+Instrumentation::Session::Session(const DebugTable* debuginfo, const std::string& reportfilename)
+	: WasEnabled(Config::InstrumentOperations),
+	  DebugInfo(debuginfo),
+	  ReportFileName(reportfilename)
+{
+	if(!WasEnabled)
+		return;
+
+	if(Active)
+		throw InternalFailureException("Cannot start an instrumentation session while another session is already running");
+
+	CountersTLSIndex = ::TlsAlloc();
+	if(CountersTLSIndex == TLS_OUT_OF_INDEXES)
+		throw InternalFailureException("Failed to allocate thread-local storage for instrumentation");
+
+	if(Config::InstrumentHardwareCounters)
+		EnableHardwareCounters();
+
+	Active = true;
+}
+
+//
+// End the instrumentation session, and write out the report
+//
+Instrumentation::Session::~Session()
+{
+	if(!WasEnabled)
+		return;
+
+	Active = false;
+
+	WriteReportFile(ReportFileName, *this);
+
+	{
+		Threads::CriticalSection::Auto mutex(CountersCriticalSection);
+		for(std::vector<ThreadCounters*>::iterator iter = AllCounters.begin(); iter != AllCounters.end(); ++iter)
+			delete *iter;
+		AllCounters.clear();
+	}
+
+	::TlsFree(CountersTLSIndex);
+	CountersTLSIndex = TLS_OUT_OF_INDEXES;
+
+	HardwareCountersActive = false;
+}
+
+//
+// Fill in the report file for the session
+//
+void Instrumentation::Session::WriteContents(std::ostream& outfile)
+{
+	WriteReport(outfile, DebugInfo, ReportFileName);
+}
+
+
+//
+// Merge the counters from all threads, and write out the report
+//
+// The first section groups measurements by operation type; the second
+// and third group them by the Epoch function and source location of each
+// operation, where known. Operations without debug information (such as
+// those created by the optimizer) appear only in the first section.
+//
+void Instrumentation::WriteReport(std::ostream& outfile, const DebugTable* debuginfo, const std::string& reportfilename)
+{
+	OperationCounterMap merged;
+	{
+		Threads::CriticalSection::Auto mutex(CountersCriticalSection);
+		for(std::vector<ThreadCounters*>::const_iterator iter = AllCounters.begin(); iter != AllCounters.end(); ++iter)
+		{
+			for(OperationCounterMap::const_iterator opiter = (*iter)->Operations.begin(); opiter != (*iter)->Operations.end(); ++opiter)
+				merged[opiter->first].Merge(opiter->second);
+		}
+	}
+
+	std::map<std::string, OperationCounters> bytype;
+	std::map<std::string, OperationCounters> byfunction;
+	std::map<std::string, OperationCounters> bylocation;
+	for(OperationCounterMap::const_iterator iter = merged.begin(); iter != merged.end(); ++iter)
+	{
+		std::string opname = GetOperationTypeName(*iter->first);
+		bytype[opname].Merge(iter->second);
+
+		std::wstring functionname;
+		if(debuginfo && debuginfo->FindInstructionFunction(iter->first, functionname))
+			byfunction[functionname.empty() ? std::string("(global code)") : narrow(functionname)].Merge(iter->second);
+
+		FileLocationInfo location;
+		if(debuginfo && debuginfo->FindInstructionLocation(iter->first, location))
+		{
+			std::ostringstream key;
+			key << narrow(location.FileName) << ":" << location.Line << " " << opname;
+			bylocation[key.str()].Merge(iter->second);
+		}
+	}
+
+	WriteSection(outfile, "Operation type", bytype, HardwareCountersActive);
+	if(debuginfo)
+	{
+		WriteSection(outfile, "Epoch function", byfunction, HardwareCountersActive);
+		WriteSection(outfile, "Source location", bylocation, HardwareCountersActive);
+	}
+
+	UI::OutputStream output;
+	output << L"Instrumentation: " << merged.size() << L" operations written to " << widen(reportfilename) << std::endl;
+}
+
@@ -0,0 +1,157 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Instrumented execution mode for measuring individual operations
+//
+// Where the sampling profiler gives a statistical picture of where time
+// is spent, instrumentation measures every operation exactly. When it is
+// enabled, each statement-level operation executed by a block, and each
+// operation evaluated by a push, is timed with the processor's cycle
+// counter. The number of calls, the cycles spent, and the number of
+// r-values allocated are collected per operation; once the program exits,
+// the counts are merged by operation type and by source location, and
+// written out as a table.
+//
+// Operations invoked directly by other operations (such as the operands
+// of an arithmetic operation which are not pushed separately) are not
+// measured on their own; their cost is included in the innermost
+// measured operation. Self cycles exclude time spent in nested measured
+// operations, whereas total cycles include it; for recursive calls, the
+// total cycles of an operation which is nested within itself are counted
+// once per level of nesting.
+//
+// Counters are kept per thread, so measuring does not require any locks.
+// When instrumentation is disabled, all that remains is a single test of
+// a global flag per operation and per r-value allocation.
+//
+// Cycle counts alone do not say why an operation is slow, so measurements
+// may also read the processor's hardware performance counters: retired
+// instructions, cache misses, and mispredicted branches. Their self counts
+// are collected in the same way as the self cycles. User mode code cannot
+// select the events which the counters count, so the OS (or a driver) is
+// expected to have programmed them; retired instructions are read from
+// the fixed counter which exists for the purpose, and the configuration
+// names the general purpose counters holding the other two events. Each
+// counter is probed when the session starts, and any which cannot be read
+// from user mode are left out. Note that the counters belong to the
+// processor rather than the thread, so their counts include anything else
+// which ran on the same processor during a measurement.
+//
+// Besides operation type and source location, the report also groups the
+// measurements by the Epoch function containing each operation, as
+// recorded in the debug information.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Profiling/ReportFile.h"
+
+
+// Forward declarations
+class DebugTable;
+
+namespace VM
+{
+	class Operation;
+	struct ExecutionContext;
+}
+
+
+namespace VM
+{
+
+	class Instrumentation
+	{
+	// Instrumentation state
+	public:
+		static bool IsActive()
+		{ return Active; }
+
+	// Measurement interface
+	public:
+		// Per-thread storage for counters; see Instrumentation.cpp
+		struct ThreadCounters;
+
+		// Hardware performance counters read during measurements
+		enum HardwareCounter
+		{
+			Counter_InstructionsRetired,
+			Counter_CacheMisses,
+			Counter_BranchMispredictions,
+			NumHardwareCounters
+		};
+
+		//
+		// Execute the given operation, measuring its cost
+		//
+		static void ExecuteOperation(Operation& op, ExecutionContext& context);
+
+		//
+		// Count an r-value allocation against the operations being measured
+		//
+		static void CountRValueAllocation()
+		{
+			if(Active)
+				RecordRValueAllocation();
+		}
+
+		//
+		// RAII wrapper which measures the cost of an operation, from
+		// construction of the wrapper until its destruction
+		//
+		class Measurement
+		{
+		public:
+			explicit Measurement(const Operation& op);
+			~Measurement();
+
+		private:
+			const Operation& Op;
+			ThreadCounters& Counters;
+			unsigned __int64 SavedNestedCycles;
+			unsigned __int64 StartAllocations;
+			unsigned __int64 StartCycles;
+			unsigned __int64 SavedNestedEvents[NumHardwareCounters];
+			unsigned __int64 StartEvents[NumHardwareCounters];
+		};
+
+	// Instrumentation sessions
+	public:
+		//
+		// RAII wrapper which instruments all code executed while the
+		// wrapper is alive, if instrumentation is turned on in the
+		// configuration. The report is written when the wrapper is
+		// destroyed. Source locations are only reported if debug
+		// information is provided.
+		//
+		struct Session : public ReportWriter
+		{
+			Session(const DebugTable* debuginfo, const std::string& reportfilename);
+			~Session();
+
+		private:
+			virtual void WriteContents(std::ostream& outfile);
+
+		private:
+			bool WasEnabled;
+			const DebugTable* DebugInfo;
+			std::string ReportFileName;
+		};
+
+	// Internal helpers
+	private:
+		static void RecordRValueAllocation();
+		static void EnableHardwareCounters();
+		static void WriteReport(std::ostream& outfile, const DebugTable* debuginfo, const std::string& reportfilename);
+
+	// Internal tracking
+	private:
+		static bool Active;
+		static bool HardwareCountersActive;
+	};
+
+}
+
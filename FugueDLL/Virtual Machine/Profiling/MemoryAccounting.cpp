@@ -0,0 +1,267 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Accounting of the memory held by the virtual machine
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Profiling/MemoryAccounting.h"
+#include "Virtual Machine/Profiling/Profiler.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Parser/Debug Info Tables/DebugTable.h"
+
+#include "User Interface/Output.h"
+
+#include "Utility/Memory/Heap.h"
+#include "Utility/Memory/Stack.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Strings.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include <iomanip>
+
+
+using namespace VM;
+
+
+bool MemoryAccounting::TrackingSites = false;
+
+
+namespace
+{
+
+	// Accounts for each category; see MemoryAccount for why these are not constructed
+	MemoryAccount Accounts[MemoryAccounting::NumCategories];
+
+	const char* CategoryNames[MemoryAccounting::NumCategories] = { "Strings", "Arrays", "Buffers", "Hash maps", "Scopes" };
+
+
+	//
+	// Allocations attributed to a single site
+	//
+	struct SiteCounters
+	{
+		SiteCounters()
+			: Allocations(0),
+			  Bytes(0)
+		{ }
+
+		unsigned __int64 Allocations;
+		unsigned __int64 Bytes;
+	};
+
+	typedef std::pair<const Operation*, MemoryAccounting::Category> SiteKey;
+
+	Threads::CriticalSection SiteCriticalSection;
+	std::map<SiteKey, SiteCounters> Sites;
+
+
+	//
+	// Write one row of the summary section of the report
+	//
+	void WriteAccount(std::ostream& outfile, const std::string& name, const MemoryAccount::Statistics& stats)
+	{
+		outfile << std::left << std::setw(20) << name
+				<< std::right << std::setw(18) << stats.LiveAllocations
+				<< std::setw(18) << stats.LiveBytes
+				<< std::setw(18) << stats.PeakBytes
+				<< std::setw(20) << stats.TotalAllocations << "\n";
+	}
+
+}
+
+
+//
+// Account for a new allocation in the given category
+//
+void MemoryAccounting::CountAllocation(Category category, size_t numbytes)
+{
+	Accounts[category].Allocated(numbytes);
+	if(TrackingSites)
+		RecordSite(category, numbytes);
+}
+
+//
+// Account for the release of an allocation in the given category
+//
+void MemoryAccounting::CountRelease(Category category, size_t numbytes)
+{
+	Accounts[category].Released(numbytes);
+}
+
+//
+// Account for an allocation in the given category changing its size
+//
+// Growth is attributed to the running site just like a new allocation,
+// since that is where the additional memory was requested.
+//
+void MemoryAccounting::CountResize(Category category, size_t oldbytes, size_t newbytes)
+{
+	Accounts[category].Resized(oldbytes, newbytes);
+	if(TrackingSites && newbytes > oldbytes)
+		RecordSite(category, newbytes - oldbytes);
+}
+
+
+//
+// Gather the current state of all accounts
+//
+MemoryAccounting::Snapshot MemoryAccounting::GetSnapshot()
+{
+	Snapshot snapshot;
+	snapshot.Strings = Accounts[Category_Strings].GetStatistics();
+	snapshot.Arrays = Accounts[Category_Arrays].GetStatistics();
+	snapshot.Buffers = Accounts[Category_Buffers].GetStatistics();
+	snapshot.HashMaps = Accounts[Category_HashMaps].GetStatistics();
+	snapshot.Scopes = Accounts[Category_Scopes].GetStatistics();
+	snapshot.HeapStorage = HeapStorage::GetMemoryStatistics();
+
+	StackSpace::MemoryStatistics stacks = StackSpace::GetMemoryStatistics();
+	snapshot.Stacks = stacks.Committed;
+	snapshot.DeepestStack = stacks.DeepestStack;
+
+	return snapshot;
+}
+
+
+//
+// Attribute an allocation to the operation the calling thread is running
+//
+void MemoryAccounting::RecordSite(Category category, size_t numbytes)
+{
+	ProfileRecord* record = Profiler::GetRecordForThisThread();
+	const Operation* op = record ? static_cast<const Operation*>(record->CurrentOperation) : NULL;
+
+	Threads::CriticalSection::Auto mutex(SiteCriticalSection);
+	SiteCounters& counters = Sites[SiteKey(op, category)];
+	++counters.Allocations;
+	counters.Bytes += numbytes;
+}
+
+
+//
+// Begin tracking allocation sites, if the memory report is enabled
+//
+MemoryAccounting::Session::Session(const DebugTable* debuginfo, const std::string& reportfilename)
+	: WasEnabled(Config::MemoryReport),
+	  DebugInfo(debuginfo),
+	  ReportFileName(reportfilename)
+{
+	if(!WasEnabled)
+		return;
+
+	if(TrackingSites)
+		throw InternalFailureException("Cannot start a memory report session while another session is already running");
+
+	Profiler::BeginRecording();
+
+	{
+		Threads::CriticalSection::Auto mutex(SiteCriticalSection);
+		Sites.clear();
+	}
+
+	TrackingSites = true;
+}
+
+//
+// Stop tracking allocation sites, and write out the report
+//
+MemoryAccounting::Session::~Session()
+{
+	if(!WasEnabled)
+		return;
+
+	TrackingSites = false;
+
+	WriteReportFile(ReportFileName, *this);
+
+	{
+		Threads::CriticalSection::Auto mutex(SiteCriticalSection);
+		Sites.clear();
+	}
+
+	Profiler::EndRecording();
+}
+
+//
+// Fill in the report file for the session
+//
+void MemoryAccounting::Session::WriteContents(std::ostream& outfile)
+{
+	WriteReport(outfile, DebugInfo, ReportFileName);
+}
+
+
+//
+// Write out the final snapshot, followed by the allocations made at each site
+//
+// Sites are merged by source location, and ordered by descending number
+// of bytes allocated. Allocations made outside of any statement (such as
+// those made while loading the program) or by operations without a known
+// source location are grouped together.
+//
+void MemoryAccounting::WriteReport(std::ostream& outfile, const DebugTable* debuginfo, const std::string& reportfilename)
+{
+	std::map<std::string, SiteCounters> bylocation;
+	{
+		Threads::CriticalSection::Auto mutex(SiteCriticalSection);
+		for(std::map<SiteKey, SiteCounters>::const_iterator iter = Sites.begin(); iter != Sites.end(); ++iter)
+		{
+			std::ostringstream key;
+
+			FileLocationInfo location;
+			if(debuginfo && iter->first.first && debuginfo->FindInstructionLocation(iter->first.first, location))
+				key << narrow(location.FileName) << ":" << location.Line;
+			else
+				key << "<unknown location>";
+			key << " " << CategoryNames[iter->first.second];
+
+			SiteCounters& counters = bylocation[key.str()];
+			counters.Allocations += iter->second.Allocations;
+			counters.Bytes += iter->second.Bytes;
+		}
+	}
+
+	Snapshot snapshot = GetSnapshot();
+
+	outfile << std::left << std::setw(20) << "Account"
+			<< std::right << std::setw(18) << "Live allocations"
+			<< std::setw(18) << "Live bytes"
+			<< std::setw(18) << "Peak bytes"
+			<< std::setw(20) << "Total allocations" << "\n";
+	WriteAccount(outfile, "Strings", snapshot.Strings);
+	WriteAccount(outfile, "Arrays", snapshot.Arrays);
+	WriteAccount(outfile, "Buffers", snapshot.Buffers);
+	WriteAccount(outfile, "Hash maps", snapshot.HashMaps);
+	WriteAccount(outfile, "Scopes", snapshot.Scopes);
+	WriteAccount(outfile, "Heap storage", snapshot.HeapStorage);
+	WriteAccount(outfile, "Stacks", snapshot.Stacks);
+	outfile << "Deepest stack: " << snapshot.DeepestStack << " bytes committed\n\n";
+
+	std::vector<std::pair<unsigned __int64, std::string> > order;
+	for(std::map<std::string, SiteCounters>::const_iterator iter = bylocation.begin(); iter != bylocation.end(); ++iter)
+		order.push_back(std::make_pair(iter->second.Bytes, iter->first));
+
+	std::sort(order.begin(), order.end());
+	std::reverse(order.begin(), order.end());
+
+	outfile << std::left << std::setw(60) << "Allocation site"
+			<< std::right << std::setw(18) << "Allocations"
+			<< std::setw(20) << "Bytes" << "\n";
+
+	for(std::vector<std::pair<unsigned __int64, std::string> >::const_iterator iter = order.begin(); iter != order.end(); ++iter)
+	{
+		const SiteCounters& counters = bylocation.find(iter->second)->second;
+		outfile << std::left << std::setw(60) << iter->second
+				<< std::right << std::setw(18) << counters.Allocations
+				<< std::setw(20) << counters.Bytes << "\n";
+	}
+
+	UI::OutputStream output;
+	output << L"Memory report: " << bylocation.size() << L" allocation sites written to " << widen(reportfilename) << std::endl;
+}
+
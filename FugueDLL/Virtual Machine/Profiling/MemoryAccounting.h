@@ -0,0 +1,115 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Accounting of the memory held by the virtual machine
+//
+// Pooled strings, arrays, and buffers, as well as activated scopes, are
+// accounted as they are allocated and released; together with the heap
+// storage blocks and stacks (which keep their own accounts) this gives a
+// live breakdown of which part of the VM is holding memory, available at
+// any time through GetSnapshot. The bytes accounted for each pooled entry
+// are its payload; the pool's own bookkeeping is not included.
+//
+// When the memory report is turned on in the configuration, allocations
+// of the VM's own accounts are additionally attributed to the statement
+// level operation which was running at the time, via the profiler's
+// per-thread records. Once the program exits, a report is written with
+// the final snapshot and the allocations made at each source location.
+// Site tracking takes a lock per allocation, so it is only meant for
+// diagnosing memory growth, not for production runs.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Memory/Accounting.h"
+#include "Virtual Machine/Profiling/ReportFile.h"
+
+
+// Forward declarations
+class DebugTable;
+
+
+namespace VM
+{
+
+	class MemoryAccounting
+	{
+	// Accounts kept by the VM
+	public:
+		enum Category
+		{
+			Category_Strings,
+			Category_Arrays,
+			Category_Buffers,
+			Category_HashMaps,
+			Category_Scopes,
+
+			NumCategories
+		};
+
+	// Accounting interface
+	public:
+		static void CountAllocation(Category category, size_t numbytes);
+		static void CountRelease(Category category, size_t numbytes);
+		static void CountResize(Category category, size_t oldbytes, size_t newbytes);
+
+	// Snapshots
+	public:
+		//
+		// Breakdown of the memory held by each part of the VM
+		//
+		// This structure is handed out by the VM DLL as is, so any
+		// changes to its layout must be made with care.
+		//
+		struct Snapshot
+		{
+			MemoryAccount::Statistics Strings;
+			MemoryAccount::Statistics Arrays;
+			MemoryAccount::Statistics Buffers;
+			MemoryAccount::Statistics HashMaps;
+			MemoryAccount::Statistics Scopes;
+			MemoryAccount::Statistics HeapStorage;
+			MemoryAccount::Statistics Stacks;
+			size_t DeepestStack;
+		};
+
+		static Snapshot GetSnapshot();
+
+	// Reporting sessions
+	public:
+		//
+		// RAII wrapper which tracks allocation sites for all code executed
+		// while the wrapper is alive, if the memory report is turned on in
+		// the configuration. The report is written when the wrapper is
+		// destroyed. Source locations are only reported if debug
+		// information is provided.
+		//
+		struct Session : public ReportWriter
+		{
+			Session(const DebugTable* debuginfo, const std::string& reportfilename);
+			~Session();
+
+		private:
+			virtual void WriteContents(std::ostream& outfile);
+
+		private:
+			bool WasEnabled;
+			const DebugTable* DebugInfo;
+			std::string ReportFileName;
+		};
+
+	// Internal helpers
+	private:
+		static void RecordSite(Category category, size_t numbytes);
+		static void WriteReport(std::ostream& outfile, const DebugTable* debuginfo, const std::string& reportfilename);
+
+	// Internal tracking
+	private:
+		static bool TrackingSites;
+	};
+
+}
+
@@ -0,0 +1,619 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Microbenchmarks for the threading and memory primitives of the VM
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Profiling/PrimitiveBenchmarks.h"
+#include "Virtual Machine/Core Entities/Variables/HandlePool.h"
+
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/ThreadPool.h"
+#include "Utility/Threading/Mailbox.h"
+#include "Utility/Threading/Lockless.h"
+#include "Utility/Threading/MachineInfo.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+#include "Utility/Memory/ThreadLocalAllocator.h"
+#include "Utility/Memory/Stack.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	//
+	// Amount of work done by each benchmark
+	//
+	// These are chosen so that each measurement takes in the region of a
+	// tenth of a second on current hardware, which is long enough to hide
+	// the cost of starting the benchmark threads.
+	//
+	const unsigned MessagesPerProducer = 250000;
+	const unsigned MessageBatchSize = 64;
+	const unsigned CASOperationsPerThread = 1000000;
+	const unsigned PoolLatencySamples = 10000;
+	const unsigned PoolWarmupSamples = 100;
+	const unsigned PoolThroughputItems = 200000;
+	const unsigned AllocationsPerThread = 1 << 20;
+	const unsigned AllocationBatchSize = 64;
+	const unsigned StackFrames = 1 << 18;
+	const unsigned StackValuesPerFrame = 16;
+	const unsigned StacksPerThread = 10000;
+	const unsigned HandleOperationsPerThread = 1 << 19;
+	const unsigned HandleBatchSize = 64;
+
+	// Block sizes requested by the allocator benchmarks, spanning all of the arena size classes
+	const size_t BlockSizes[] = { 16, 24, 48, 96, 200, 400 };
+	const size_t NumBlockSizes = sizeof(BlockSizes) / sizeof(BlockSizes[0]);
+
+
+	//
+	// Body of a benchmark, run on each thread of a benchmark group
+	//
+	typedef void (*BenchmarkBodyPtr)(unsigned threadindex, unsigned numthreads, void* context);
+
+	//
+	// Set of threads which run a benchmark body together
+	//
+	// Each thread waits until all of the threads are ready, so that they
+	// are released at the same moment; the measured time runs from their
+	// release until the last of them has finished the body.
+	//
+	struct BenchmarkGroup
+	{
+		BenchmarkBodyPtr Body;
+		void* Context;
+		unsigned NumThreads;
+
+		volatile LONG NumReady;
+		HANDLE ReadyEvent;
+		HANDLE StartEvent;
+
+		volatile LONG Failed;
+		std::string FailureMessage;
+	};
+
+	struct BenchmarkThread
+	{
+		BenchmarkGroup* Group;
+		unsigned Index;
+		Threads::ThreadInfo Info;
+		unsigned __int64 FinishTimestamp;
+	};
+
+
+	//
+	// Remember the first failure seen by any thread of a group
+	//
+	void RecordFailure(BenchmarkGroup& group, const std::string& message)
+	{
+		if(Atomic::CompareAndSwap(&group.Failed, 0, 1))
+			group.FailureMessage = message;
+	}
+
+	//
+	// Entry point of each thread in a benchmark group
+	//
+	// The thread joins the threading system just as a thread pool worker
+	// does, so that it has a local heap and arena of its own. Since it is
+	// not a task, the threading system leaves its heap alone on the way
+	// out; the heap is therefore released here.
+	//
+	DWORD __stdcall BenchmarkThreadProc(void* param)
+	{
+		BenchmarkThread& thread = *reinterpret_cast<BenchmarkThread*>(param);
+		BenchmarkGroup& group = *thread.Group;
+
+		Threads::Enter(&thread.Info);
+
+		if(::InterlockedIncrement(&group.NumReady) == static_cast<LONG>(group.NumThreads))
+			::SetEvent(group.ReadyEvent);
+
+		::WaitForSingleObject(group.StartEvent, INFINITE);
+
+		if(!group.Failed)
+		{
+			try
+			{
+				group.Body(thread.Index, group.NumThreads, group.Context);
+			}
+			catch(const std::exception& e)
+			{
+				RecordFailure(group, e.what());
+			}
+			catch(...)
+			{
+				RecordFailure(group, "Unknown exception in benchmark thread");
+			}
+		}
+
+		thread.FinishTimestamp = Threads::Telemetry::GetTimestamp();
+
+		Threads::Exit();
+		::HeapDestroy(thread.Info.LocalHeapHandle);
+		return 0;
+	}
+
+	//
+	// Run a benchmark body on the given number of threads at once,
+	// returning the wall-clock time taken in milliseconds
+	//
+	double RunOnThreads(unsigned numthreads, BenchmarkBodyPtr body, void* context)
+	{
+		BenchmarkGroup group;
+		group.Body = body;
+		group.Context = context;
+		group.NumThreads = numthreads;
+		group.NumReady = 0;
+		group.Failed = 0;
+		group.ReadyEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+		group.StartEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		std::vector<BenchmarkThread> threads(numthreads);
+		std::vector<HANDLE> handles;
+
+		if(group.ReadyEvent && group.StartEvent)
+		{
+			for(unsigned i = 0; i < numthreads; ++i)
+			{
+				BenchmarkThread& thread = threads[i];
+				thread.Group = &group;
+				thread.Index = i;
+				thread.FinishTimestamp = 0;
+
+				thread.Info.CodeBlock = NULL;
+				thread.Info.BoundFuture = NULL;
+				thread.Info.RunningProgram = NULL;
+				thread.Info.HandleToSelf = 0;
+				thread.Info.TaskOrigin = 0;
+				thread.Info.LocalHeapHandle = NULL;
+				thread.Info.MessageEvent = NULL;
+				thread.Info.WaitingForMessage = 0;
+				thread.Info.Mailbox = NULL;
+				thread.Info.GreenTask = NULL;
+
+				HANDLE handle = ::CreateThread(NULL, 0, BenchmarkThreadProc, &thread, 0, NULL);
+				if(!handle)
+				{
+					RecordFailure(group, "Failed to create benchmark thread");
+					break;
+				}
+
+				handles.push_back(handle);
+			}
+		}
+		else
+			RecordFailure(group, "Failed to create synchronization events for benchmark threads");
+
+		// Threads which did start are released even after a failure, so that they can exit
+		if(!group.Failed)
+			::WaitForSingleObject(group.ReadyEvent, INFINITE);
+
+		unsigned __int64 start = Threads::Telemetry::GetTimestamp();
+		if(group.StartEvent)
+			::SetEvent(group.StartEvent);
+
+		unsigned __int64 finish = start;
+		for(size_t i = 0; i < handles.size(); ++i)
+		{
+			::WaitForSingleObject(handles[i], INFINITE);
+			::CloseHandle(handles[i]);
+			finish = std::max(finish, threads[i].FinishTimestamp);
+		}
+
+		if(group.ReadyEvent)
+			::CloseHandle(group.ReadyEvent);
+		if(group.StartEvent)
+			::CloseHandle(group.StartEvent);
+
+		if(group.Failed)
+			throw Threads::ThreadException(group.FailureMessage);
+
+		return Threads::Telemetry::TicksToMilliseconds(finish - start);
+	}
+
+
+	//
+	// Message passed through the mailbox benchmark
+	//
+	// Messages are allocated up front so that the benchmark measures the
+	// mailbox itself rather than the allocator.
+	//
+	struct BenchmarkMessage
+	{
+		unsigned Sequence;
+	};
+
+	struct MailboxContext
+	{
+		LocklessMailbox<BenchmarkMessage>* Mailbox;
+		BenchmarkMessage* Messages;
+	};
+
+	//
+	// Pass messages from every thread but the first to the first thread,
+	// which drains them in batches just as a task does
+	//
+	void MailboxBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		MailboxContext& mailbox = *reinterpret_cast<MailboxContext*>(context);
+
+		if(threadindex == 0)
+		{
+			BenchmarkMessage* batch[MessageBatchSize];
+			unsigned total = (numthreads - 1) * MessagesPerProducer;
+			for(unsigned received = 0; received < total; )
+			{
+				unsigned count = mailbox.Mailbox->GetMessages(batch, MessageBatchSize);
+				if(!count)
+					::SwitchToThread();
+
+				received += count;
+			}
+		}
+		else
+		{
+			BenchmarkMessage* messages = mailbox.Messages + (threadindex - 1) * MessagesPerProducer;
+			for(unsigned i = 0; i < MessagesPerProducer; ++i)
+				mailbox.Mailbox->AddMessage(&messages[i]);
+		}
+	}
+
+
+	//
+	// Increment a single shared counter with a CAS loop from every thread
+	//
+	void CompareAndSwapBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		volatile LONG* counter = reinterpret_cast<volatile LONG*>(context);
+
+		for(unsigned i = 0; i < CASOperationsPerThread; ++i)
+		{
+			LONG current;
+			do
+			{
+				current = Atomic::LoadAcquire(counter);
+			} while(!Atomic::CompareAndSwap(counter, current, current + 1));
+		}
+	}
+
+
+	//
+	// Allocate and free batches of small objects from the thread's arena
+	//
+	void ArenaBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		void* blocks[AllocationBatchSize];
+		for(unsigned i = 0; i < AllocationsPerThread; i += AllocationBatchSize)
+		{
+			for(unsigned j = 0; j < AllocationBatchSize; ++j)
+				blocks[j] = ThreadLocalArena::Allocate(BlockSizes[(i + j) % NumBlockSizes]);
+
+			for(unsigned j = 0; j < AllocationBatchSize; ++j)
+				ThreadLocalArena::Free(blocks[j]);
+		}
+	}
+
+	//
+	// Allocate and free batches of small objects from the thread's local heap
+	//
+	void LocalHeapBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		ThreadLocalAllocator<Byte> allocator;
+
+		Byte* blocks[AllocationBatchSize];
+		for(unsigned i = 0; i < AllocationsPerThread; i += AllocationBatchSize)
+		{
+			for(unsigned j = 0; j < AllocationBatchSize; ++j)
+				blocks[j] = allocator.allocate(BlockSizes[(i + j) % NumBlockSizes]);
+
+			for(unsigned j = 0; j < AllocationBatchSize; ++j)
+				allocator.deallocate(blocks[j], BlockSizes[(i + j) % NumBlockSizes]);
+		}
+	}
+
+
+	//
+	// Push and pop frames of values on a single stack, writing each value as it is pushed
+	//
+	void StackPushPopBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		StackSpace stack;
+
+		for(unsigned i = 0; i < StackFrames; ++i)
+		{
+			for(unsigned j = 0; j < StackValuesPerFrame; ++j)
+			{
+				stack.Push(sizeof(Integer32));
+				*reinterpret_cast<Integer32*>(stack.GetCurrentTopOfStack()) = static_cast<Integer32>(i + j);
+			}
+
+			for(unsigned j = 0; j < StackValuesPerFrame; ++j)
+				stack.Pop(sizeof(Integer32));
+		}
+	}
+
+	//
+	// Create and destroy stacks, as every task and function call with a stack of its own does
+	//
+	void StackCreateBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		for(unsigned i = 0; i < StacksPerThread; ++i)
+		{
+			StackSpace stack;
+			stack.Push(sizeof(Integer32));
+			*reinterpret_cast<Integer32*>(stack.GetCurrentTopOfStack()) = static_cast<Integer32>(i);
+			stack.Pop(sizeof(Integer32));
+		}
+	}
+
+
+	//
+	// Add, look up, and free batches of entries in a single handle pool
+	//
+	void HandlePoolBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		HandlePool<unsigned> pool;
+
+		HandleType handles[HandleBatchSize];
+		for(unsigned i = 0; i < HandleOperationsPerThread; i += HandleBatchSize)
+		{
+			for(unsigned j = 0; j < HandleBatchSize; ++j)
+				handles[j] = pool.Allocate(i + j);
+
+			for(unsigned j = 0; j < HandleBatchSize; ++j)
+			{
+				if(*pool.Find(handles[j]) != i + j)
+					throw InternalFailureException("Handle pool returned the wrong entry");
+			}
+
+			for(unsigned j = 0; j < HandleBatchSize; ++j)
+				pool.Free(handles[j]);
+		}
+	}
+
+	//
+	// Add and look up entries in a sharded pool shared by all threads
+	//
+	void ShardedHandlePoolBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		ShardedHandlePool<unsigned>& pool = *reinterpret_cast<ShardedHandlePool<unsigned>*>(context);
+
+		HandleType handles[HandleBatchSize];
+		for(unsigned i = 0; i < HandleOperationsPerThread; i += HandleBatchSize)
+		{
+			for(unsigned j = 0; j < HandleBatchSize; ++j)
+				handles[j] = pool.Allocate(i + j);
+
+			for(unsigned j = 0; j < HandleBatchSize; ++j)
+			{
+				if(*pool.Find(handles[j]) != i + j)
+					throw InternalFailureException("Sharded handle pool returned the wrong entry");
+			}
+		}
+	}
+
+	void ReleaseNothing(unsigned& entry)
+	{
+	}
+
+
+	//
+	// Track the completion of work items fed to a pool by the benchmarks
+	//
+	struct PoolCompletion
+	{
+		volatile LONG Remaining;
+		unsigned __int64 LatencyTicks;
+		HANDLE DoneEvent;
+	};
+
+	//
+	// Work item which measures how long it waited to be claimed
+	//
+	// Only one of these is in flight at a time, and the submitting thread
+	// waits for the done event, so the latency total needs no interlocked
+	// updates.
+	//
+	struct LatencyWorkItem : public Threads::PoolWorkItem
+	{
+		explicit LatencyWorkItem(PoolCompletion& completion)
+			: Completion(completion),
+			  SubmitTimestamp(Threads::Telemetry::GetTimestamp())
+		{ }
+
+		virtual void PerformWork()
+		{
+			Completion.LatencyTicks += Threads::Telemetry::GetTimestamp() - SubmitTimestamp;
+			if(::InterlockedDecrement(&Completion.Remaining) == 0)
+				::SetEvent(Completion.DoneEvent);
+		}
+
+		PoolCompletion& Completion;
+		unsigned __int64 SubmitTimestamp;
+	};
+
+	//
+	// Work item which does nothing but signal its completion
+	//
+	struct EmptyWorkItem : public Threads::PoolWorkItem
+	{
+		explicit EmptyWorkItem(PoolCompletion& completion)
+			: Completion(completion)
+		{ }
+
+		virtual void PerformWork()
+		{
+			if(::InterlockedDecrement(&Completion.Remaining) == 0)
+				::SetEvent(Completion.DoneEvent);
+		}
+
+		PoolCompletion& Completion;
+	};
+
+	//
+	// Submit work items to a pool one at a time, waiting for each to be
+	// run, and return the total time they spent waiting to be claimed
+	//
+	// Workers go idle between items, so this measures the full path from
+	// submitting an item to a worker waking up and claiming it.
+	//
+	unsigned __int64 MeasurePoolLatency(Threads::ThreadPool& pool, PoolCompletion& completion, unsigned numsamples)
+	{
+		completion.LatencyTicks = 0;
+		for(unsigned i = 0; i < numsamples; ++i)
+		{
+			completion.Remaining = 1;
+			pool.AddWorkItem(new LatencyWorkItem(completion));
+			::WaitForSingleObject(completion.DoneEvent, INFINITE);
+		}
+
+		return completion.LatencyTicks;
+	}
+
+	//
+	// Submit a burst of empty work items to a pool, and return the time
+	// taken until all of them have been run
+	//
+	unsigned __int64 MeasurePoolThroughput(Threads::ThreadPool& pool, PoolCompletion& completion)
+	{
+		completion.Remaining = PoolThroughputItems;
+
+		unsigned __int64 start = Threads::Telemetry::GetTimestamp();
+		for(unsigned i = 0; i < PoolThroughputItems; ++i)
+			pool.AddWorkItem(new EmptyWorkItem(completion));
+
+		::WaitForSingleObject(completion.DoneEvent, INFINITE);
+		return Threads::Telemetry::GetTimestamp() - start;
+	}
+
+
+	//
+	// Parameters of a complete benchmarking session
+	//
+	struct SessionContext
+	{
+		unsigned MaxThreads;
+		PrimitiveBenchmarks::ResultCallbackPtr Callback;
+		void* UserData;
+	};
+
+	//
+	// Run every benchmark in turn, passing the results on to the callback
+	//
+	// This runs on a benchmark thread of its own, since creating a thread
+	// pool requires the creating thread to be known to the VM.
+	//
+	void SessionBody(unsigned threadindex, unsigned numthreads, void* context)
+	{
+		SessionContext& session = *reinterpret_cast<SessionContext*>(context);
+
+		{
+			std::vector<BenchmarkMessage> messages(session.MaxThreads * MessagesPerProducer);
+			for(unsigned producers = 1; producers <= session.MaxThreads; ++producers)
+			{
+				LocklessMailbox<BenchmarkMessage> mailbox(MailboxOverflow_BlockSender);
+				MailboxContext mailboxcontext = { &mailbox, &messages[0] };
+				double ms = RunOnThreads(producers + 1, MailboxBody, &mailboxcontext);
+				session.Callback(L"mailbox.throughput", producers, static_cast<unsigned __int64>(producers) * MessagesPerProducer, ms, session.UserData);
+			}
+		}
+
+		for(unsigned threads = 1; threads <= session.MaxThreads; ++threads)
+		{
+			volatile LONG counter = 0;
+			double ms = RunOnThreads(threads, CompareAndSwapBody, const_cast<LONG*>(&counter));
+			session.Callback(L"cas.contended", threads, static_cast<unsigned __int64>(threads) * CASOperationsPerThread, ms, session.UserData);
+		}
+
+		{
+			PoolCompletion completion;
+			completion.DoneEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+			if(!completion.DoneEvent)
+				throw Threads::ThreadException("Failed to create synchronization event for thread pool benchmark");
+
+			try
+			{
+				for(unsigned workers = 1; workers <= session.MaxThreads; ++workers)
+				{
+					Threads::ThreadPool pool(workers, NULL);
+					MeasurePoolLatency(pool, completion, PoolWarmupSamples);
+
+					unsigned __int64 latency = MeasurePoolLatency(pool, completion, PoolLatencySamples);
+					session.Callback(L"threadpool.claimlatency", workers, PoolLatencySamples, Threads::Telemetry::TicksToMilliseconds(latency), session.UserData);
+
+					unsigned __int64 elapsed = MeasurePoolThroughput(pool, completion);
+					session.Callback(L"threadpool.throughput", workers, PoolThroughputItems, Threads::Telemetry::TicksToMilliseconds(elapsed), session.UserData);
+				}
+			}
+			catch(...)
+			{
+				::CloseHandle(completion.DoneEvent);
+				throw;
+			}
+
+			::CloseHandle(completion.DoneEvent);
+		}
+
+		for(unsigned threads = 1; threads <= session.MaxThreads; ++threads)
+		{
+			double ms = RunOnThreads(threads, ArenaBody, NULL);
+			session.Callback(L"arena.allocfree", threads, static_cast<unsigned __int64>(threads) * AllocationsPerThread * 2, ms, session.UserData);
+		}
+
+		for(unsigned threads = 1; threads <= session.MaxThreads; ++threads)
+		{
+			double ms = RunOnThreads(threads, LocalHeapBody, NULL);
+			session.Callback(L"localheap.allocfree", threads, static_cast<unsigned __int64>(threads) * AllocationsPerThread * 2, ms, session.UserData);
+		}
+
+		{
+			double ms = RunOnThreads(1, StackPushPopBody, NULL);
+			session.Callback(L"stack.pushpop", 1, static_cast<unsigned __int64>(StackFrames) * StackValuesPerFrame * 2, ms, session.UserData);
+		}
+
+		for(unsigned threads = 1; threads <= session.MaxThreads; ++threads)
+		{
+			double ms = RunOnThreads(threads, StackCreateBody, NULL);
+			session.Callback(L"stack.createdestroy", threads, static_cast<unsigned __int64>(threads) * StacksPerThread, ms, session.UserData);
+		}
+
+		{
+			double ms = RunOnThreads(1, HandlePoolBody, NULL);
+			session.Callback(L"handlepool.addgetfree", 1, static_cast<unsigned __int64>(HandleOperationsPerThread) * 3, ms, session.UserData);
+		}
+
+		for(unsigned threads = 1; threads <= session.MaxThreads; ++threads)
+		{
+			std::auto_ptr<ShardedHandlePool<unsigned> > pool(new ShardedHandlePool<unsigned>);
+			double ms = RunOnThreads(threads, ShardedHandlePoolBody, pool.get());
+			pool->Clear(ReleaseNothing);
+			session.Callback(L"shardedhandlepool.addget", threads, static_cast<unsigned __int64>(threads) * HandleOperationsPerThread * 2, ms, session.UserData);
+		}
+	}
+
+}
+
+
+//
+// Run the complete set of primitive benchmarks
+//
+// Benchmarks of shared structures are run with each thread count from
+// one up to the given maximum; zero means one thread per processor.
+//
+void PrimitiveBenchmarks::RunAll(unsigned maxthreads, ResultCallbackPtr callback, void* userdata)
+{
+	SessionContext session;
+	session.MaxThreads = maxthreads ? maxthreads : Threads::GetCPUCount();
+	session.Callback = callback;
+	session.UserData = userdata;
+
+	RunOnThreads(1, SessionBody, &session);
+}
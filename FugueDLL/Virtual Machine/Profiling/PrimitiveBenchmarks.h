@@ -0,0 +1,38 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Microbenchmarks for the threading and memory primitives of the VM
+//
+// The mailboxes, thread pools, arena and heap allocators, stacks, and
+// handle pools are exercised directly, without any Epoch program being
+// loaded, so that changes to them can be measured in isolation. Each
+// benchmark reports the number of operations it performed along with
+// the wall-clock time they took. Benchmarks of shared structures are
+// repeated for every thread count from one up to the given maximum.
+//
+// The thread pool latency benchmark is the one exception: it reports
+// the total time its work items spent between being submitted and being
+// claimed by a worker, so that the time per operation is the mean
+// latency rather than an inverse rate.
+//
+// All benchmarks run on threads of their own which are set up in the
+// same way as thread pool workers, so the caller need not be known to
+// the VM's threading system.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	namespace PrimitiveBenchmarks
+	{
+		// Callback which receives the result of each benchmark as it completes
+		typedef void (__stdcall *ResultCallbackPtr)(const wchar_t* name, unsigned numthreads, unsigned __int64 numoperations, double milliseconds, void* userdata);
+
+		void RunAll(unsigned maxthreads, ResultCallbackPtr callback, void* userdata);
+	}
+
+}
@@ -0,0 +1,306 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Sampling profiler for Epoch programs
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Profiling/Profiler.h"
+#include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Virtual Machine/Core Entities/Scopes/ScopeDescription.h"
+#include "Virtual Machine/VMExceptions.h"
+
+#include "Parser/Debug Info Tables/DebugTable.h"
+
+#include "User Interface/Output.h"
+
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Strings.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	//
+	// Snapshot of a thread's call stack, as taken by the sampling thread
+	//
+	struct SampledStack
+	{
+		DWORD ThreadID;
+		std::vector<const Function*> Frames;
+		const Operation* CurrentOperation;
+
+		bool operator < (const SampledStack& rhs) const
+		{
+			if(ThreadID != rhs.ThreadID)
+				return ThreadID < rhs.ThreadID;
+			if(Frames != rhs.Frames)
+				return Frames < rhs.Frames;
+			return CurrentOperation < rhs.CurrentOperation;
+		}
+	};
+
+
+	//
+	// Tracking for the active profiling session
+	//
+	// Records are also handed out while some other facility needs to
+	// know what each thread is running (see BeginRecording), so they
+	// outlive the session itself where necessary.
+	//
+	volatile bool SessionActive = false;
+	volatile LONG RecordingCount = 0;
+	DWORD RecordTLSIndex = TLS_OUT_OF_INDEXES;
+
+	Threads::CriticalSection RecordCriticalSection;
+	std::vector<ProfileRecord*> Records;
+
+	HANDLE SamplingThread = NULL;
+	HANDLE StopEvent = NULL;
+
+	// Sample counts; only accessed by the sampling thread while the session is running
+	std::map<SampledStack, size_t> Samples;
+	size_t NumSamples = 0;
+
+
+	//
+	// Look up the name of a function for display in the report
+	//
+	std::string GetFunctionName(const Program& program, const Function* function)
+	{
+		try
+		{
+			return narrow(program.GetGlobalScope().GetFunctionName(function));
+		}
+		catch(const ExecutionException&)
+		{
+			return "<anonymous function>";
+		}
+	}
+
+}
+
+
+//
+// Retrieve the profiling record for the calling thread
+//
+ProfileRecord* Profiler::GetRecordForThisThread()
+{
+	if(RecordingCount <= 0)
+		return NULL;
+
+	ProfileRecord* record = reinterpret_cast<ProfileRecord*>(::TlsGetValue(RecordTLSIndex));
+	if(!record)
+	{
+		record = new ProfileRecord;
+		record->CurrentOperation = NULL;
+		record->Depth = 0;
+		record->ThreadID = ::GetCurrentThreadId();
+		::TlsSetValue(RecordTLSIndex, record);
+
+		Threads::CriticalSection::Auto mutex(RecordCriticalSection);
+		Records.push_back(record);
+	}
+
+	return record;
+}
+
+
+//
+// Begin a profiling session, if profiling is enabled
+//
+Profiler::Session::Session(const Program& program, const DebugTable& debuginfo, const std::string& reportfilename)
+	: Active(Config::ProfilerSampleInterval != 0),
+	  TheProgram(program),
+	  DebugInfo(debuginfo),
+	  ReportFileName(reportfilename)
+{
+	if(!Active)
+		return;
+
+	if(SessionActive)
+		throw InternalFailureException("Cannot start a profiling session while another session is already running");
+
+	BeginRecording();
+
+	Samples.clear();
+	NumSamples = 0;
+
+	StopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	SessionActive = true;
+
+	SamplingThread = ::CreateThread(NULL, 0, SamplingThreadProc, NULL, 0, NULL);
+	if(!SamplingThread)
+	{
+		SessionActive = false;
+		::CloseHandle(StopEvent);
+		EndRecording();
+		throw InternalFailureException("Failed to start the profiler's sampling thread");
+	}
+}
+
+//
+// End the profiling session, and write out the report
+//
+Profiler::Session::~Session()
+{
+	if(!Active)
+		return;
+
+	SessionActive = false;
+	::SetEvent(StopEvent);
+	::WaitForSingleObject(SamplingThread, INFINITE);
+	::CloseHandle(SamplingThread);
+	::CloseHandle(StopEvent);
+	SamplingThread = NULL;
+	StopEvent = NULL;
+
+	WriteReportFile(ReportFileName, *this);
+
+	EndRecording();
+	Samples.clear();
+}
+
+//
+// Fill in the report file for the session
+//
+void Profiler::Session::WriteContents(std::ostream& outfile)
+{
+	WriteReport(outfile, TheProgram, DebugInfo, ReportFileName);
+}
+
+
+//
+// Start handing out records to threads which run Epoch code
+//
+// Calls may be nested; records remain available until the matching
+// number of calls to EndRecording have been made. Both calls must be
+// made from the thread which runs the program, while no other threads
+// are executing Epoch code.
+//
+void Profiler::BeginRecording()
+{
+	if(RecordingCount++ > 0)
+		return;
+
+	RecordTLSIndex = ::TlsAlloc();
+	if(RecordTLSIndex == TLS_OUT_OF_INDEXES)
+	{
+		RecordingCount = 0;
+		throw InternalFailureException("Failed to allocate thread-local storage for the profiler");
+	}
+}
+
+//
+// Stop handing out records, and free all records once nobody needs them
+//
+void Profiler::EndRecording()
+{
+	if(--RecordingCount > 0)
+		return;
+
+	{
+		Threads::CriticalSection::Auto mutex(RecordCriticalSection);
+		for(std::vector<ProfileRecord*>::iterator iter = Records.begin(); iter != Records.end(); ++iter)
+			delete *iter;
+		Records.clear();
+	}
+
+	::TlsFree(RecordTLSIndex);
+	RecordTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+
+//
+// Entry point for the thread which periodically samples all records
+//
+DWORD __stdcall Profiler::SamplingThreadProc(void* param)
+{
+	while(::WaitForSingleObject(StopEvent, Config::ProfilerSampleInterval) == WAIT_TIMEOUT)
+		TakeSamples();
+
+	return 0;
+}
+
+//
+// Record a snapshot of what each thread is currently executing
+//
+// Threads which are not currently running any Epoch code are skipped.
+//
+void Profiler::TakeSamples()
+{
+	Threads::CriticalSection::Auto mutex(RecordCriticalSection);
+
+	for(std::vector<ProfileRecord*>::const_iterator iter = Records.begin(); iter != Records.end(); ++iter)
+	{
+		const ProfileRecord& record = **iter;
+
+		LONG depth = record.Depth;
+		const Operation* op = record.CurrentOperation;
+		if(depth <= 0 && !op)
+			continue;
+
+		SampledStack stack;
+		stack.ThreadID = record.ThreadID;
+		stack.CurrentOperation = op;
+
+		LONG numframes = (depth < ProfileRecord::MaxFrames) ? depth : ProfileRecord::MaxFrames;
+		for(LONG i = 0; i < numframes; ++i)
+		{
+			const Function* frame = record.Frames[i];
+			stack.Frames.push_back(frame);
+		}
+
+		++Samples[stack];
+		++NumSamples;
+	}
+}
+
+//
+// Write out the samples as collapsed stacks
+//
+// Each line holds one distinct stack, with frames separated by semicolons
+// and followed by the number of times the stack was sampled. The root of
+// each stack is the thread, followed by the Epoch functions being called,
+// and finally the source location of the operation being executed, if it
+// is recorded in the debug information. Operations which were created by
+// the optimizer have no source location, so their time is attributed to
+// the function containing them.
+//
+void Profiler::WriteReport(std::ostream& outfile, const Program& program, const DebugTable& debuginfo, const std::string& reportfilename)
+{
+	std::map<const Function*, std::string> functionnames;
+
+	for(std::map<SampledStack, size_t>::const_iterator iter = Samples.begin(); iter != Samples.end(); ++iter)
+	{
+		const SampledStack& stack = iter->first;
+		outfile << "thread " << stack.ThreadID;
+
+		for(std::vector<const Function*>::const_iterator frameiter = stack.Frames.begin(); frameiter != stack.Frames.end(); ++frameiter)
+		{
+			std::map<const Function*, std::string>::iterator nameiter = functionnames.find(*frameiter);
+			if(nameiter == functionnames.end())
+				nameiter = functionnames.insert(std::make_pair(*frameiter, GetFunctionName(program, *frameiter))).first;
+
+			outfile << ";" << nameiter->second;
+		}
+
+		FileLocationInfo location;
+		if(stack.CurrentOperation && debuginfo.FindInstructionLocation(stack.CurrentOperation, location))
+			outfile << ";" << narrow(location.FileName) << ":" << location.Line;
+
+		outfile << " " << iter->second << "\n";
+	}
+
+	UI::OutputStream output;
+	output << L"Profiler: " << NumSamples << L" samples written to " << widen(reportfilename) << std::endl;
+}
+
@@ -0,0 +1,175 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Sampling profiler for Epoch programs
+//
+// Native profilers only ever see the VM's own dispatch loops, which says
+// nothing about where the time is going in the Epoch program itself. When
+// profiling is enabled, each thread which executes Epoch code keeps a
+// record of the Epoch function calls it is nested in and the operation it
+// is currently running. A separate sampling thread wakes up at a fixed
+// interval and takes a snapshot of every record. Once the program exits,
+// the samples are resolved to function names and source locations via
+// the parser's debug information, and written out as a list of collapsed
+// stacks, which can be fed directly to the common flame graph tools.
+//
+// Records are written only by their owning threads, and read by the
+// sampling thread without any synchronization; a sample may therefore
+// occasionally see a call stack which is in the middle of changing.
+// This is harmless for statistical purposes, and keeps the overhead of
+// profiling down to a store or two per operation and function call.
+// When profiling is disabled, all that remains is a single test of the
+// context's record pointer per operation and per call.
+//
+// Green tasks are attributed to the thread they were started on.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Virtual Machine/Profiling/ReportFile.h"
+
+
+// Forward declarations
+class DebugTable;
+
+namespace VM
+{
+	class Operation;
+	class Function;
+	class Program;
+}
+
+
+namespace VM
+{
+
+	//
+	// Record of what a single thread is currently executing
+	//
+	struct ProfileRecord
+	{
+		static const LONG MaxFrames = 128;
+
+		const Operation* volatile CurrentOperation;
+		const Function* volatile Frames[MaxFrames];
+		volatile LONG Depth;
+		DWORD ThreadID;
+	};
+
+
+	class Profiler
+	{
+	// Record access
+	public:
+		//
+		// Retrieve the record for the calling thread, or NULL if no
+		// profiling session (or other recording) is active. Records
+		// are created on demand.
+		//
+		static ProfileRecord* GetRecordForThisThread();
+
+		//
+		// Make records available outside of a profiling session, for
+		// facilities which need to know what each thread is running
+		//
+		static void BeginRecording();
+		static void EndRecording();
+
+	// Profiling sessions
+	public:
+		//
+		// RAII wrapper which profiles the given program for as long as the
+		// wrapper is alive, if profiling is turned on in the configuration.
+		// The report is written when the wrapper is destroyed.
+		//
+		struct Session : public ReportWriter
+		{
+			Session(const Program& program, const DebugTable& debuginfo, const std::string& reportfilename);
+			~Session();
+
+		private:
+			virtual void WriteContents(std::ostream& outfile);
+
+		private:
+			bool Active;
+			const Program& TheProgram;
+			const DebugTable& DebugInfo;
+			std::string ReportFileName;
+		};
+
+	// Tracking helpers
+	public:
+		//
+		// RAII wrapper which tracks the operations run by a block of code
+		//
+		// The previously running operation is restored once the block is
+		// done, since that operation (which ran the block) is still going.
+		//
+		class OperationTracker
+		{
+		public:
+			explicit OperationTracker(ProfileRecord* record)
+				: Record(record),
+				  SavedOperation(record ? record->CurrentOperation : NULL)
+			{ }
+
+			~OperationTracker()
+			{
+				if(Record)
+					Record->CurrentOperation = SavedOperation;
+			}
+
+			void SetOperation(const Operation* op)
+			{
+				if(Record)
+					Record->CurrentOperation = op;
+			}
+
+		private:
+			ProfileRecord* Record;
+			const Operation* SavedOperation;
+		};
+
+		//
+		// RAII wrapper which tracks a call to an Epoch function
+		//
+		// Calls nested more deeply than the record can hold are counted,
+		// but the functions themselves are not recorded.
+		//
+		class FrameTracker
+		{
+		public:
+			FrameTracker(ProfileRecord* record, const Function& function)
+				: Record(record)
+			{
+				if(Record)
+				{
+					LONG depth = Record->Depth;
+					if(depth < ProfileRecord::MaxFrames)
+						Record->Frames[depth] = &function;
+					Record->Depth = depth + 1;
+				}
+			}
+
+			~FrameTracker()
+			{
+				if(Record)
+					Record->Depth = Record->Depth - 1;
+			}
+
+		private:
+			ProfileRecord* Record;
+		};
+
+	// Internal helpers
+	private:
+		static DWORD __stdcall SamplingThreadProc(void* param);
+		static void TakeSamples();
+		static void WriteReport(std::ostream& outfile, const Program& program, const DebugTable& debuginfo, const std::string& reportfilename);
+	};
+
+}
+
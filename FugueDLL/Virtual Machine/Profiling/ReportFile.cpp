@@ -0,0 +1,38 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Shared handling of the report files written by the profilers
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Profiling/ReportFile.h"
+
+#include <fstream>
+
+
+//
+// Open the given report file, and have the writer fill it in
+//
+// Reports are written from the destructors of the profiling sessions, so
+// this may be running while the program's own exception is unwinding the
+// stack; nothing is allowed to escape. The file is skipped silently if it
+// cannot be opened.
+//
+void VM::WriteReportFile(const std::string& filename, ReportWriter& writer)
+{
+	try
+	{
+		std::ofstream outfile(filename.c_str(), std::ios::trunc);
+		if(!outfile)
+			return;
+
+		writer.WriteContents(outfile);
+	}
+	catch(...)
+	{
+		// Failing to write the report should not mask the program's own results
+	}
+}
+
@@ -0,0 +1,35 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Shared handling of the report files written by the profilers
+//
+// The profiler, instrumentation, and memory report sessions all write
+// their reports as the session ends; each session provides the contents
+// by implementing ReportWriter, and WriteReportFile takes care of opening
+// the file and dealing with any failure along the way.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	//
+	// Interface for generating the contents of a report file
+	//
+	class ReportWriter
+	{
+	public:
+		virtual ~ReportWriter()
+		{ }
+
+		virtual void WriteContents(std::ostream& outfile) = 0;
+	};
+
+
+	void WriteReportFile(const std::string& filename, ReportWriter& writer);
+
+}
+
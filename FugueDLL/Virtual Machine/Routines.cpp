@@ -30,6 +30,7 @@ RValuePtr VM::GetRValuePtrFromStorage(VM::EpochVariableTypeID vartype, const voi
 	case EpochVariableType_Address:		return AddressVariable(storage).GetAsRValue();
 	case EpochVariableType_Buffer:		return BufferVariable(storage).GetAsRValue();
 	case EpochVariableType_TaskHandle:	return TaskHandleVariable(storage).GetAsRValue();
+	case EpochVariableType_HashMap:		return HashMapVariable(storage).GetAsRValue();
 	}
 
 	throw NotImplementedException("Cannot directly convert from untyped storage to this type; implementation is probably just missing");
@@ -1,14 +1,33 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Base interface for nodes of the code tree which know how to traverse themselves
+//
+// Operations derive from SelfAwareBase (virtually) as well as from their
+// SelfAware wrapper, so that traversal of an operation is a plain virtual
+// call on the operation itself, rather than a cross-cast from Operation to
+// SelfAwareBase. Each node type also carries a tag which uniquely identifies
+// it, so that code which needs to find a particular type of node can check
+// for it directly; see Operation::IsNode.
+//
+
 #pragma once
 
 
 // Forward declarations
 namespace Validator { class ValidationTraverser; }
 namespace Serialization { class SerializationTraverser; }
+namespace Optimizer { class OptimizationTraverser; }
 
 
 namespace VM
 {
 
+	// Tag identifying the concrete type of a node
+	typedef const void* NodeTypeTag;
+
+
 	class SelfAwareBase
 	{
 	public:
@@ -17,18 +36,30 @@ namespace VM
 
 		virtual void Traverse(Validator::ValidationTraverser& traverser) = 0;
 		virtual void Traverse(Serialization::SerializationTraverser& traverser) = 0;
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser) = 0;
 
 		virtual const std::wstring& GetToken() const = 0;
+		virtual NodeTypeTag GetNodeTypeTag() const = 0;
 	};
 
 	template <class SelfType>
-	class SelfAware : public SelfAwareBase
+	class SelfAware : public virtual SelfAwareBase
 	{
 	public:
 		virtual void Traverse(Validator::ValidationTraverser& traverser);
 		virtual void Traverse(Serialization::SerializationTraverser& traverser);
+		virtual void Traverse(Optimizer::OptimizationTraverser& traverser);
 
 		virtual const std::wstring& GetToken() const;
+
+		virtual NodeTypeTag GetNodeTypeTag() const
+		{ return GetStaticNodeTypeTag(); }
+
+		static NodeTypeTag GetStaticNodeTypeTag()
+		{
+			static const char tag = 0;
+			return &tag;
+		}
 	};
 
 }
@@ -12,6 +12,7 @@
 #include "Virtual Machine/SelfAware.h"
 #include "Validator/Validator.h"
 #include "Serialization/SerializationTraverser.h"
+#include "Optimizer/Optimizer.h"
 
 
 //
@@ -60,6 +61,15 @@ void VM::SelfAware<SelfType>::Traverse(Serialization::SerializationTraverser& tr
 	TraversalHelper<Serialization::SerializationTraverser, SelfType>(traverser, *static_cast<SelfType*>(this));
 }
 
+//
+// Dispatch a traversal call for the optimization traverser
+//
+template <class SelfType>
+void VM::SelfAware<SelfType>::Traverse(Optimizer::OptimizationTraverser& traverser)
+{
+	TraversalHelper<Optimizer::OptimizationTraverser, SelfType>(traverser, *static_cast<SelfType*>(this));
+}
+
 
 //
 // Retrieve the token associated with a given node type
@@ -11,18 +11,65 @@
 #include "Virtual Machine/VMExceptions.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Threading/MachineInfo.h"
+#include "Utility/Threading/Telemetry.h"
+
+#include "Configuration/RuntimeOptions.h"
+#include "Configuration/AutoTuning.h"
 
 
 using namespace VM;
 
 
+namespace
+{
+
+	//
+	// Determine how worker threads should be placed on processors, based on the runtime options
+	//
+	Threads::WorkerPlacement GetConfiguredWorkerPlacement()
+	{
+		if(Config::PoolWorkerPlacement == 1)
+			return Threads::WorkerPlacement_NodeLocal;
+		else if(Config::PoolWorkerPlacement == 2)
+			return Threads::WorkerPlacement_PinToProcessor;
+
+		return Threads::WorkerPlacement_Unrestricted;
+	}
+
+}
+
+
+//
+// Construct and initialize the thread pool tracker
+//
+ThreadPoolTracker::ThreadPoolTracker()
+	: SharedPool(NULL)
+{
+}
+
 //
 // Destruct the thread pool tracker and all associated thread pool objects
 //
+// The shared pool's record of how long work waited in its queues is
+// handed to the auto-tuning logic, to size the next program's pool.
+//
 ThreadPoolTracker::~ThreadPoolTracker()
 {
 	for(NamedThreadPoolMap::iterator iter = NamedThreadPools.begin(); iter != NamedThreadPools.end(); ++iter)
 		delete iter->second;
+
+	if(SharedPool && Config::AutoTuneRuntime)
+	{
+		Threads::ThreadPool::Statistics stats = SharedPool->GetStatistics();
+		if(stats.NumClaimed)
+		{
+			double averagelatency = Threads::Telemetry::TicksToMilliseconds(stats.ClaimLatencyTicks) / static_cast<double>(stats.NumClaimed);
+			Config::AutoTuning::RecordSharedPoolUsage(stats.NumWorkers, averagelatency, Threads::GetCPUCount());
+		}
+	}
+
+	delete SharedPool;
 }
 
 
@@ -34,7 +81,7 @@ void ThreadPoolTracker::CreateNamedPool(const std::wstring& poolname, unsigned n
 	if(NamedThreadPools.find(poolname) != NamedThreadPools.end())
 		throw ExecutionException("A thread pool by the name of \"" + narrow(poolname) + "\" already exists, cannot create another pool by this name");
 
-	NamedThreadPools[poolname] = new Threads::ThreadPool(numthreads, runningprogram);
+	NamedThreadPools[poolname] = new Threads::ThreadPool(numthreads, runningprogram, GetConfiguredWorkerPlacement());
 }
 
 
@@ -55,3 +102,29 @@ bool ThreadPoolTracker::HasNamedPool(const std::wstring& poolname) const
 {
 	return (NamedThreadPools.find(poolname) != NamedThreadPools.end());
 }
+
+
+//
+// Retrieve the pool shared by all internal parallel work in the program
+//
+// The pool is created the first time it is requested, with one worker
+// thread per CPU unless configured otherwise, and lives until the program
+// is torn down. Up to the configured number of its workers are reserved
+// for normal priority work, always leaving at least one worker available
+// for batch work.
+//
+Threads::ThreadPool& ThreadPoolTracker::GetSharedPool(VM::Program* runningprogram)
+{
+	if(!SharedPool)
+	{
+		Threads::CriticalSection::Auto mutex(SharedPoolCritSec);
+		if(!SharedPool)
+		{
+			unsigned numthreads = Config::SharedPoolThreads ? Config::SharedPoolThreads : std::max(Threads::GetCPUCount(), 1u);
+			unsigned numreserved = std::min(Config::ReservedPoolWorkers, numthreads - 1);
+			SharedPool = new Threads::ThreadPool(numthreads, runningprogram, GetConfiguredWorkerPlacement(), numreserved);
+		}
+	}
+
+	return *SharedPool;
+}
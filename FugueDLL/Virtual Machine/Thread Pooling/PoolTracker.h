@@ -21,8 +21,9 @@ namespace VM
 
 	class ThreadPoolTracker
 	{
-	// Destruction
+	// Construction and destruction
 	public:
+		ThreadPoolTracker();
 		~ThreadPoolTracker();
 
 	// Pool management
@@ -31,10 +32,15 @@ namespace VM
 		Threads::ThreadPool& GetNamedPool(const std::wstring& poolname);
 		bool HasNamedPool(const std::wstring& poolname) const;
 
+		Threads::ThreadPool& GetSharedPool(VM::Program* runningprogram);
+
 	// Internal tracking
 	private:
 		typedef std::map<std::wstring, Threads::ThreadPool*> NamedThreadPoolMap;
 		NamedThreadPoolMap NamedThreadPools;
+
+		Threads::ThreadPool* volatile SharedPool;
+		Threads::CriticalSection SharedPoolCritSec;
 	};
 
 }
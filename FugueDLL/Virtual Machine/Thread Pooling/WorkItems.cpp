@@ -13,16 +13,64 @@
 #include "Virtual Machine/Core Entities/Block.h"
 #include "Virtual Machine/Core Entities/Program.h"
 #include "Virtual Machine/Core Entities/Concurrency/Future.h"
+#include "Virtual Machine/VMExceptions.h"
 
 #include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Operations/Containers/MapReduce.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
 
 #include "Utility/Memory/Stack.h"
 #include "Utility/Threading/Threads.h"
+#include "Utility/Threading/Tracing.h"
 
 
 using namespace VM;
 
 
+namespace
+{
+
+	//
+	// Execution environment for one chunk of a split map or reduce,
+	// or for one branch of a parallel invoke
+	//
+	// Each chunk gets a stack and scope of its own; the scope is parented
+	// to the caller's, so the applied functions see the same variables as
+	// they would if the array were processed on the calling thread.
+	//
+	struct ArrayChunkEnvironment
+	{
+		explicit ArrayChunkEnvironment(VM::Operations::ParallelArrayJob& job)
+			: ChunkScope(Descriptor, &job.CallerScope),
+			  FlowResult(FLOWCONTROL_NORMAL),
+			  Context(job.RunningProgram, ChunkScope, Stack, FlowResult),
+			  TypeScope(job.CallerScope.GetOriginalDescription())
+		{
+			ChunkScope.TaskOrigin = job.CallerScope.TaskOrigin;
+			ChunkScope.LastMessageOrigin = job.CallerScope.LastMessageOrigin;
+			ChunkScope.Enter(Stack);
+		}
+
+		void Exit()
+		{
+			ChunkScope.Exit(Stack);
+
+			if(Stack.GetAllocatedStack() != 0)
+				throw InternalFailureException("A stack space leak was detected when completing a pooled map or reduce work item.");
+		}
+
+		StackSpace Stack;
+		ScopeDescription Descriptor;
+		ActivatedScope ChunkScope;
+		FlowControlResult FlowResult;
+		ExecutionContext Context;
+		const ScopeDescription& TypeScope;
+	};
+
+}
+
+
 ForkThreadWorkItem::ForkThreadWorkItem(Block& codeblock, ExecutionContext& context)
 	: TheBlock(codeblock),
 	  RunningProgram(context.RunningProgram)
@@ -50,17 +98,60 @@ FutureWorkItem::FutureWorkItem(Future& thefuture, ExecutionContext& context)
 {
 }
 
+//
+// Prepare to compute a future whose expression reads other futures
+//
+// Each input future is made readable by name from the scope in which
+// the expression runs.
+//
+FutureWorkItem::FutureWorkItem(Future& thefuture, const InputList& inputs, ExecutionContext& context)
+	: TheFuture(thefuture),
+	  Inputs(inputs)
+{
+}
+
 
+//
+// Compute the value of the future
+//
+// A future which was cancelled before its work item ran is completed
+// without doing any work at all. One which is cancelled while running
+// unwinds at the next block it enters; its stack and scopes are released
+// as soon as the exception reaches this point.
+//
 void FutureWorkItem::PerformWork()
 {
+	if(TheFuture.GetCancellationToken().IsCancelled())
+	{
+		TheFuture.SetCancelled();
+		return;
+	}
+
 	StackSpace stack;
 
 	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
 	std::auto_ptr<ScopeDescription> descriptor(new ScopeDescription);
+	for(InputList::const_iterator iter = Inputs.begin(); iter != Inputs.end(); ++iter)
+		descriptor->ShareFuture(iter->first, iter->second);
+
 	std::auto_ptr<ActivatedScope> newscope(new ActivatedScope(*descriptor));
 	newscope->TaskOrigin = Threads::GetInfoForThisThread().TaskOrigin;
 	newscope->Enter(stack);
-	RValuePtr ret(TheFuture.GetNestedOperation()->ExecuteAndStoreRValue(ExecutionContext(*Threads::GetInfoForThisThread().RunningProgram, *newscope, stack, flowresult))->Clone());
+
+	ExecutionContext context(*Threads::GetInfoForThisThread().RunningProgram, *newscope, stack, flowresult);
+	context.Cancellation = &TheFuture.GetCancellationToken();
+
+	RValuePtr ret;
+	try
+	{
+		ret.reset(TheFuture.GetNestedOperation()->ExecuteAndStoreRValue(context)->Clone());
+	}
+	catch(TaskCancelledException&)
+	{
+		TheFuture.SetCancelled();
+		return;
+	}
+
 	newscope->Exit(stack);
 
 	TheFuture.SetResult(ret);
@@ -69,12 +160,19 @@ void FutureWorkItem::PerformWork()
 		throw InternalFailureException("A stack space leak was detected when exiting an Epoch task.");
 }
 
+void FutureWorkItem::Cancel()
+{
+	TheFuture.Cancel();
+	TheFuture.SetCancelled();
+}
+
 
 
-ParallelForWorkItem::ParallelForWorkItem(VM::Operations::ParallelFor& pforop, VM::ActivatedScope* parentscope, Block& codeblock, Program& runningprogram, size_t lowerbound, size_t upperbound, const std::wstring& countervarname, unsigned skipinstructions)
+ParallelForWorkItem::ParallelForWorkItem(VM::Operations::ParallelFor& pforop, VM::ActivatedScope* parentscope, Block& codeblock, Program& runningprogram, size_t chunkindex, size_t lowerbound, size_t upperbound, const std::wstring& countervarname, unsigned skipinstructions)
 	: ParallelForOp(pforop),
 	  TheBlock(codeblock),
 	  RunningProgram(runningprogram),
+	  ChunkIndex(chunkindex),
 	  LowerBound(lowerbound),
 	  UpperBound(upperbound),
 	  CounterVarName(countervarname),
@@ -83,34 +181,276 @@ ParallelForWorkItem::ParallelForWorkItem(VM::Operations::ParallelFor& pforop, VM
 {
 }
 
+//
+// Execute this work item's share of the loop
+//
+// The body's scope is entered once for all of the iterations run by the
+// work item, rather than once per iteration. Entering a scope only binds
+// its variables to the stack; the body's own instructions initialize its
+// locals each time through, so the frame can safely be kept in between.
+// The counter is written directly into its bound variable, and reduction
+// variables simply keep their values from one iteration to the next, so
+// an iteration costs no name lookups or allocations of its own.
+//
+// If the loop is cancelled, the work item stops at the next iteration
+// or block boundary. A work item which is interrupted partway through an
+// iteration does not contribute to any reductions.
+//
 void ParallelForWorkItem::PerformWork()
 {
-	StackSpace stack;
+	if(ParallelForOp.IsCancelled())
+	{
+		ParallelForOp.DecrementWaitCounter();
+		return;
+	}
 
-	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+	StackSpace stack;
 
 	std::auto_ptr<ActivatedScope> codescope(new ActivatedScope(*TheBlock.GetBoundScope()));
 	codescope->TaskOrigin = Threads::GetInfoForThisThread().TaskOrigin;
 	codescope->LastMessageOrigin = 0;
 	codescope->ParentScope = ParentScope;
 
-	for(size_t counter = LowerBound; counter < UpperBound; ++counter)
-	{
-		codescope->Enter(stack);
-		codescope->SetVariableValue(CounterVarName, RValuePtr(new IntegerRValue(static_cast<Integer32>(counter))));
-		TheBlock.ExecuteBlock(ExecutionContext(RunningProgram, *codescope, stack, flowresult), NULL, false, SkipInstructions);
-		codescope->Exit(stack);
+	ParallelForOp.InitializeReductionValues(Accumulators);
+
+	codescope->Enter(stack);
+	IntegerVariable& counter = codescope->GetVariableRef<IntegerVariable>(CounterVarName);
+
+	if(!Accumulators.empty())
+		ParallelForOp.StoreReductionValues(*codescope, Accumulators);
 
-		if(flowresult != FLOWCONTROL_NORMAL)
+	FlowControlResult flowresult = FLOWCONTROL_NORMAL;
+	ExecutionContext context(RunningProgram, *codescope, stack, flowresult);
+	context.Cancellation = &ParallelForOp.GetCancellationToken();
+
+	try
+	{
+		if(ParallelForOp.HasDynamicScheduling())
 		{
-			flowresult = FLOWCONTROL_NORMAL;
-			break;
+			size_t lowerbound, upperbound;
+			while(ParallelForOp.ClaimIterations(lowerbound, upperbound))
+			{
+				if(!ExecuteIterations(context, counter, lowerbound, upperbound))
+					break;
+			}
 		}
+		else
+			ExecuteIterations(context, counter, LowerBound, UpperBound);
+	}
+	catch(TaskCancelledException&)
+	{
+		ParallelForOp.DecrementWaitCounter();
+		return;
 	}
 
+	if(!Accumulators.empty())
+	{
+		ParallelForOp.LoadReductionValues(*codescope, Accumulators);
+		ParallelForOp.SubmitPartialResults(ChunkIndex, Accumulators);
+	}
+
+	codescope->Exit(stack);
+
 	ParallelForOp.DecrementWaitCounter();
 
 	if(stack.GetAllocatedStack() != 0)
 		throw InternalFailureException("A stack space leak was detected when completing a ParallelForWorkItem pooled work item.");
 }
 
+//
+// Execute the loop body for the given range of iterations
+//
+// Returns false if the body signalled an early exit from the loop, or
+// if the loop has been cancelled. Breaking out of the body cancels the
+// whole loop, so that the other work items stop claiming iterations.
+// The body's scope must already have been entered; see PerformWork.
+// Reduction variables hold this work item's private accumulators
+// throughout, and whatever the body leaves in them carries over to
+// the next iteration.
+//
+bool ParallelForWorkItem::ExecuteIterations(ExecutionContext& context, IntegerVariable& counter, size_t lowerbound, size_t upperbound)
+{
+	Threads::Tracing::Span span("Parallel loop chunk", upperbound - lowerbound);
+
+	for(size_t i = lowerbound; i < upperbound; ++i)
+	{
+		if(ParallelForOp.IsCancelled())
+			return false;
+
+		counter.SetValue(static_cast<Integer32>(i));
+
+		TheBlock.ExecuteBlock(context, NULL, false, SkipInstructions);
+
+		if(context.FlowResult != FLOWCONTROL_NORMAL)
+		{
+			if(context.FlowResult == FLOWCONTROL_BREAK)
+				ParallelForOp.Cancel();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ParallelForWorkItem::Cancel()
+{
+	ParallelForOp.DecrementWaitCounter();
+}
+
+
+
+MapWorkItem::MapWorkItem(VM::Operations::MapOperation& mapop, VM::Operations::ParallelArrayJob& job, size_t first, size_t last)
+	: MapOp(mapop),
+	  Job(job),
+	  First(first),
+	  Last(last)
+{
+}
+
+void MapWorkItem::PerformWork()
+{
+	try
+	{
+		ArrayChunkEnvironment environment(Job);
+		MapOp.MapElements(environment.Context, environment.TypeScope, Job, First, Last);
+		environment.Exit();
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
+
+
+ReduceWorkItem::ReduceWorkItem(VM::Operations::ReduceOperation& reduceop, VM::Operations::ParallelArrayJob& job, size_t chunkindex, size_t first, size_t last)
+	: ReduceOp(reduceop),
+	  Job(job),
+	  ChunkIndex(chunkindex),
+	  First(first),
+	  Last(last)
+{
+}
+
+void ReduceWorkItem::PerformWork()
+{
+	try
+	{
+		ArrayChunkEnvironment environment(Job);
+		RValuePtr result(ReduceOp.ReduceElements(environment.Context, environment.TypeScope, Job.ElementType, Job.GetElementStorage(First), Last - First));
+		Job.Results[ChunkIndex] = result.release();
+		environment.Exit();
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
+
+
+MapReduceWorkItem::MapReduceWorkItem(VM::Operations::MapReduceOperation& mapreduceop, VM::Operations::ParallelArrayJob& job, size_t chunkindex, size_t first, size_t last)
+	: MapReduceOp(mapreduceop),
+	  Job(job),
+	  ChunkIndex(chunkindex),
+	  First(first),
+	  Last(last)
+{
+}
+
+void MapReduceWorkItem::PerformWork()
+{
+	try
+	{
+		ArrayChunkEnvironment environment(Job);
+		RValuePtr result(MapReduceOp.MapReduceElements(environment.Context, environment.TypeScope, Job.ElementType, Job.GetElementStorage(First), Last - First));
+		Job.Results[ChunkIndex] = result.release();
+		environment.Exit();
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
+
+
+ParallelInvokeWorkItem::ParallelInvokeWorkItem(VM::Operations::ParallelInvoke& invokeop, VM::Operations::ParallelArrayJob& job, size_t branchindex)
+	: InvokeOp(invokeop),
+	  Job(job),
+	  BranchIndex(branchindex)
+{
+}
+
+void ParallelInvokeWorkItem::PerformWork()
+{
+	try
+	{
+		ArrayChunkEnvironment environment(Job);
+		RValuePtr result(InvokeOp.ExecuteBranch(environment.Context, BranchIndex));
+		Job.Results[BranchIndex] = result.release();
+		environment.Exit();
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
+
+
+SortRunWorkItem::SortRunWorkItem(VM::Operations::ArraySorter& sorter, VM::Operations::ParallelArrayJob& job, size_t first, size_t last)
+	: Sorter(sorter),
+	  Job(job),
+	  First(first),
+	  Last(last)
+{
+}
+
+void SortRunWorkItem::PerformWork()
+{
+	try
+	{
+		Sorter.SortRun(First, Last);
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
+
+
+MergeRunsWorkItem::MergeRunsWorkItem(VM::Operations::ArraySorter& sorter, VM::Operations::ParallelArrayJob& job, size_t first, size_t middle, size_t last)
+	: Sorter(sorter),
+	  Job(job),
+	  First(first),
+	  Middle(middle),
+	  Last(last)
+{
+}
+
+void MergeRunsWorkItem::PerformWork()
+{
+	try
+	{
+		Sorter.MergeRuns(First, Middle, Last);
+	}
+	catch(std::exception& ex)
+	{
+		Job.RecordFailure(ex.what());
+	}
+
+	Job.CompleteChunk();
+}
+
@@ -10,6 +10,12 @@
 
 // Dependencies
 #include "Utility/Threading/ThreadPool.h"
+#include "Virtual Machine/Operations/Flow/FlowControl.h"
+#include "Virtual Machine/Core Entities/Variables/Variable.h"
+
+
+// Forward declarations
+class StackSpace;
 
 
 namespace VM
@@ -22,7 +28,14 @@ namespace VM
 	class Program;
 
 	namespace Operations
-	{ class ParallelFor; }
+	{
+		class MapOperation;
+		class ReduceOperation;
+		class MapReduceOperation;
+		class ParallelInvoke;
+		class ArraySorter;
+		struct ParallelArrayJob;
+	}
 
 
 	struct ForkThreadWorkItem : public Threads::PoolWorkItem
@@ -44,17 +57,24 @@ namespace VM
 
 	struct FutureWorkItem : public Threads::PoolWorkItem
 	{
+	// Helper types
+	public:
+		typedef std::vector<std::pair<std::wstring, Future*> > InputList;
+
 	// Construction
 	public:
 		FutureWorkItem(Future& thefuture, ExecutionContext& context);
+		FutureWorkItem(Future& thefuture, const InputList& inputs, ExecutionContext& context);
 
 	// Work item interface
 	public:
 		virtual void PerformWork();
+		virtual void Cancel();
 
 	// Internal tracking
 	protected:
 		Future& TheFuture;
+		InputList Inputs;
 	};
 
 
@@ -62,11 +82,16 @@ namespace VM
 	{
 	// Construction
 	public:
-		ParallelForWorkItem(VM::Operations::ParallelFor& pforop, VM::ActivatedScope* parentscope, Block& codeblock, Program& runningprogram, size_t lowerbound, size_t upperbound, const std::wstring& countervarname, unsigned skipinstructions);
+		ParallelForWorkItem(VM::Operations::ParallelFor& pforop, VM::ActivatedScope* parentscope, Block& codeblock, Program& runningprogram, size_t chunkindex, size_t lowerbound, size_t upperbound, const std::wstring& countervarname, unsigned skipinstructions);
 
 	// Work item interface
 	public:
 		virtual void PerformWork();
+		virtual void Cancel();
+
+	// Internal helpers
+	protected:
+		bool ExecuteIterations(ExecutionContext& context, IntegerVariable& counter, size_t lowerbound, size_t upperbound);
 
 	// Internal tracking
 	protected:
@@ -76,14 +101,139 @@ namespace VM
 		Block& TheBlock;
 		Program& RunningProgram;
 
+		size_t ChunkIndex;
 		size_t LowerBound;
 		size_t UpperBound;
 
 		const std::wstring& CounterVarName;
 
+		VM::Operations::ParallelFor::ReductionValueList Accumulators;
+
 		unsigned SkipInstructions;
 	};
 
+
+	struct MapWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		MapWorkItem(VM::Operations::MapOperation& mapop, VM::Operations::ParallelArrayJob& job, size_t first, size_t last);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::MapOperation& MapOp;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t First;
+		size_t Last;
+	};
+
+
+	struct ReduceWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		ReduceWorkItem(VM::Operations::ReduceOperation& reduceop, VM::Operations::ParallelArrayJob& job, size_t chunkindex, size_t first, size_t last);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::ReduceOperation& ReduceOp;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t ChunkIndex;
+		size_t First;
+		size_t Last;
+	};
+
+
+	struct MapReduceWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		MapReduceWorkItem(VM::Operations::MapReduceOperation& mapreduceop, VM::Operations::ParallelArrayJob& job, size_t chunkindex, size_t first, size_t last);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::MapReduceOperation& MapReduceOp;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t ChunkIndex;
+		size_t First;
+		size_t Last;
+	};
+
+
+	struct ParallelInvokeWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		ParallelInvokeWorkItem(VM::Operations::ParallelInvoke& invokeop, VM::Operations::ParallelArrayJob& job, size_t branchindex);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::ParallelInvoke& InvokeOp;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t BranchIndex;
+	};
+
+
+	struct SortRunWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		SortRunWorkItem(VM::Operations::ArraySorter& sorter, VM::Operations::ParallelArrayJob& job, size_t first, size_t last);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::ArraySorter& Sorter;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t First;
+		size_t Last;
+	};
+
+
+	struct MergeRunsWorkItem : public Threads::PoolWorkItem
+	{
+	// Construction
+	public:
+		MergeRunsWorkItem(VM::Operations::ArraySorter& sorter, VM::Operations::ParallelArrayJob& job, size_t first, size_t middle, size_t last);
+
+	// Work item interface
+	public:
+		virtual void PerformWork();
+
+	// Internal tracking
+	protected:
+		VM::Operations::ArraySorter& Sorter;
+		VM::Operations::ParallelArrayJob& Job;
+
+		size_t First;
+		size_t Middle;
+		size_t Last;
+	};
+
 }
 
 
@@ -0,0 +1,243 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Conversions between values of different types, used by the typecast operations
+//
+
+#include "pch.h"
+
+#include "Virtual Machine/Types Management/Conversions.h"
+
+#include <cfloat>
+#include <cerrno>
+
+
+using namespace VM;
+
+
+namespace
+{
+
+	//
+	// Wrapper for the classic "C" locale used for formatting and parsing reals
+	//
+	// The locale is created once when the DLL is loaded rather than on each
+	// conversion, since creating a locale is considerably more expensive
+	// than the conversions themselves.
+	//
+	class ClassicLocale
+	{
+	public:
+		ClassicLocale()
+			: Locale(::_create_locale(LC_NUMERIC, "C"))
+		{ }
+
+		~ClassicLocale()
+		{
+			if(Locale)
+				::_free_locale(Locale);
+		}
+
+		_locale_t Get() const
+		{ return Locale; }
+
+	private:
+		_locale_t Locale;
+	};
+
+	ClassicLocale NumericLocale;
+
+
+	bool IsDigit(wchar_t c)
+	{
+		return c >= L'0' && c <= L'9';
+	}
+
+	//
+	// Skip the white space at the start of a string, as the stream extractors do
+	//
+	size_t SkipLeadingSpace(const std::wstring& text)
+	{
+		size_t pos = 0;
+		while(pos < text.length() && ::iswspace(text[pos]))
+			++pos;
+		return pos;
+	}
+
+	//
+	// Parse an optionally signed decimal integer, and check that it fits in the given range
+	//
+	bool ParseIntegerInRange(const std::wstring& text, __int64 minvalue, __int64 maxvalue, __int64& out)
+	{
+		size_t pos = SkipLeadingSpace(text);
+
+		bool negative = false;
+		if(pos < text.length() && (text[pos] == L'-' || text[pos] == L'+'))
+		{
+			negative = (text[pos] == L'-');
+			++pos;
+		}
+
+		if(pos >= text.length() || !IsDigit(text[pos]))
+			return false;
+
+		// Magnitudes beyond this are out of range for any of our integer types
+		const __int64 limit = -minvalue;
+
+		__int64 magnitude = 0;
+		for( ; pos < text.length() && IsDigit(text[pos]); ++pos)
+		{
+			magnitude = magnitude * 10 + (text[pos] - L'0');
+			if(magnitude > limit)
+				return false;
+		}
+
+		__int64 value = negative ? -magnitude : magnitude;
+		if(value < minvalue || value > maxvalue)
+			return false;
+
+		out = value;
+		return true;
+	}
+
+	//
+	// Find the extent of a decimal real number, in the forms accepted by the stream extractors
+	//
+	// Returns false if the text does not start with a number.
+	//
+	bool ScanReal(const std::wstring& text, size_t& begin, size_t& end)
+	{
+		size_t pos = SkipLeadingSpace(text);
+		begin = pos;
+
+		if(pos < text.length() && (text[pos] == L'-' || text[pos] == L'+'))
+			++pos;
+
+		bool hasdigits = false;
+		for( ; pos < text.length() && IsDigit(text[pos]); ++pos)
+			hasdigits = true;
+
+		if(pos < text.length() && text[pos] == L'.')
+		{
+			for(++pos; pos < text.length() && IsDigit(text[pos]); ++pos)
+				hasdigits = true;
+		}
+
+		if(!hasdigits)
+			return false;
+
+		// The exponent only counts if it has at least one digit
+		if(pos < text.length() && (text[pos] == L'e' || text[pos] == L'E'))
+		{
+			size_t exponentpos = pos + 1;
+			if(exponentpos < text.length() && (text[exponentpos] == L'-' || text[exponentpos] == L'+'))
+				++exponentpos;
+
+			if(exponentpos < text.length() && IsDigit(text[exponentpos]))
+			{
+				pos = exponentpos;
+				while(pos < text.length() && IsDigit(text[pos]))
+					++pos;
+			}
+		}
+
+		end = pos;
+		return true;
+	}
+
+}
+
+
+//
+// Format an integer in decimal
+//
+std::wstring TypesManager::FormatInteger(Integer32 value)
+{
+	wchar_t buffer[16];
+	wchar_t* const bufferend = buffer + (sizeof(buffer) / sizeof(wchar_t));
+	wchar_t* pos = bufferend;
+
+	// Work with the unsigned magnitude so that the most negative value is handled correctly
+	unsigned magnitude = (value < 0) ? (0u - static_cast<unsigned>(value)) : static_cast<unsigned>(value);
+	do
+	{
+		*--pos = static_cast<wchar_t>(L'0' + (magnitude % 10));
+		magnitude /= 10;
+	} while(magnitude);
+
+	if(value < 0)
+		*--pos = L'-';
+
+	return std::wstring(pos, bufferend);
+}
+
+//
+// Format a real with six significant digits, matching the default stream output
+//
+std::wstring TypesManager::FormatReal(Real value)
+{
+	wchar_t buffer[64];
+	int length = ::_snwprintf_l(buffer, sizeof(buffer) / sizeof(wchar_t), L"%g", NumericLocale.Get(), static_cast<double>(value));
+	if(length < 0)
+	{
+		std::wstringstream convert;
+		convert << value;
+		return convert.str();
+	}
+
+	return std::wstring(buffer, static_cast<size_t>(length));
+}
+
+
+//
+// Parse a 32-bit integer
+//
+bool TypesManager::ParseInteger(const std::wstring& text, Integer32& out)
+{
+	__int64 value;
+	if(!ParseIntegerInRange(text, INT_MIN, INT_MAX, value))
+		return false;
+
+	out = static_cast<Integer32>(value);
+	return true;
+}
+
+//
+// Parse a 16-bit integer
+//
+bool TypesManager::ParseInteger(const std::wstring& text, Integer16& out)
+{
+	__int64 value;
+	if(!ParseIntegerInRange(text, SHRT_MIN, SHRT_MAX, value))
+		return false;
+
+	out = static_cast<Integer16>(value);
+	return true;
+}
+
+//
+// Parse a real; values too large to be represented are rejected
+//
+bool TypesManager::ParseReal(const std::wstring& text, Real& out)
+{
+	size_t begin, end;
+	if(!ScanReal(text, begin, end))
+		return false;
+
+	// Only the scanned portion is handed to the CRT, so that it cannot
+	// accept forms (such as hexadecimal) which the streams would not
+	std::wstring number(text, begin, end - begin);
+
+	errno = 0;
+	double value = ::_wcstod_l(number.c_str(), NULL, NumericLocale.Get());
+	if(errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL))
+		return false;
+
+	if(value > FLT_MAX || value < -FLT_MAX)
+		return false;
+
+	out = static_cast<Real>(value);
+	return true;
+}
+
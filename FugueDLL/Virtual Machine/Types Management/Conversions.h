@@ -0,0 +1,97 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Conversions between values of different types, used by the typecast operations
+//
+// The general case converts by writing the value to a string stream and
+// reading it back as the destination type. Building a stream for each
+// cast adds up quickly when casts are done in loops, so the common casts
+// between numbers and strings (and between integer sizes) are handled by
+// dedicated routines instead. These follow the same rules as the streams:
+// leading white space is skipped, parsing stops at the first character
+// which cannot continue the number, and values out of the destination's
+// range are rejected. Formatting and parsing always use the classic "C"
+// conventions, regardless of the current locale.
+//
+
+#pragma once
+
+
+namespace VM
+{
+
+	namespace TypesManager
+	{
+
+		// Dedicated conversion routines
+		std::wstring FormatInteger(Integer32 value);
+		std::wstring FormatReal(Real value);
+
+		bool ParseInteger(const std::wstring& text, Integer32& out);
+		bool ParseInteger(const std::wstring& text, Integer16& out);
+		bool ParseReal(const std::wstring& text, Real& out);
+
+
+		//
+		// Convert a value using the general stream-based method
+		// Returns false if the value could not be converted
+		//
+		template <typename OriginT, typename DestinationT>
+		inline bool ConvertValue(const OriginT& value, DestinationT& out)
+		{
+			std::wstringstream convert;
+			convert << value;
+			return !!(convert >> out);
+		}
+
+
+		//
+		// Conversions with dedicated implementations
+		//
+		inline bool ConvertValue(const std::wstring& value, Integer32& out)
+		{ return ParseInteger(value, out); }
+
+		inline bool ConvertValue(const std::wstring& value, Integer16& out)
+		{ return ParseInteger(value, out); }
+
+		inline bool ConvertValue(const std::wstring& value, Real& out)
+		{ return ParseReal(value, out); }
+
+		inline bool ConvertValue(const Integer32& value, std::wstring& out)
+		{
+			out = FormatInteger(value);
+			return true;
+		}
+
+		inline bool ConvertValue(const Integer16& value, std::wstring& out)
+		{
+			out = FormatInteger(value);
+			return true;
+		}
+
+		inline bool ConvertValue(const Real& value, std::wstring& out)
+		{
+			out = FormatReal(value);
+			return true;
+		}
+
+		inline bool ConvertValue(const Integer16& value, Integer32& out)
+		{
+			out = value;
+			return true;
+		}
+
+		inline bool ConvertValue(const Integer32& value, Integer16& out)
+		{
+			if(value < SHRT_MIN || value > SHRT_MAX)
+				return false;
+
+			out = static_cast<Integer16>(value);
+			return true;
+		}
+
+	}
+
+}
+
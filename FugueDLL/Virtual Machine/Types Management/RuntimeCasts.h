@@ -11,6 +11,8 @@
 #include "Virtual Machine/Core Entities/Operation.h"
 #include "Virtual Machine/Core Entities/Variables/BufferVariable.h"
 
+#include "Virtual Machine/Types Management/Conversions.h"
+
 #include "Utility/Strings.h"
 
 
@@ -36,9 +38,7 @@ namespace VM
 				OriginVarTypeInfo::VariableType var(context.Stack.GetCurrentTopOfStack());
 				DestinationVarTypeInfo::VariableType::BaseStorage retval;
 
-				std::wstringstream convert;
-				convert << var.GetValue();
-				if(!(convert >> retval))
+				if(!TypesManager::ConvertValue(var.GetValue(), retval))
 					throw ExecutionException("Failed to cast value; possible causes are overflow or malformed data");
 
 				context.Stack.Pop(var.GetStorageSize());
@@ -82,9 +82,7 @@ namespace VM
 				OriginVarTypeInfo::VariableType var(context.Stack.GetCurrentTopOfStack());
 				std::wstring retval;
 
-				std::wstringstream convert;
-				convert << var.GetValue();
-				if(!(convert >> retval))
+				if(!TypesManager::ConvertValue(var.GetValue(), retval))
 					throw ExecutionException("Failed to cast value; possible causes are overflow or malformed data");
 
 				context.Stack.Pop(var.GetStorageSize());
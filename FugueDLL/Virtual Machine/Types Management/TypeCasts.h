@@ -11,6 +11,10 @@
 #pragma once
 
 
+// Dependencies
+#include "Virtual Machine/Types Management/TypeChecking.h"
+
+
 namespace VM
 {
 
@@ -27,8 +31,7 @@ namespace VM
 		template<class VariableClass>
 		VariableClass& CastVariable(Variable& var)
 		{
-			if(var.GetType() != VariableClass::GetStaticType())
-				throw ExecutionException("Invalid variable cast attempted!");
+			TypeChecks::Verify(var.GetType(), VariableClass::GetStaticType(), "Invalid variable cast attempted!");
 
 			return *(reinterpret_cast<VariableClass*>(&var));
 		}
@@ -36,8 +39,7 @@ namespace VM
 		template<class VariableClass>
 		const VariableClass& CastVariable(const Variable& var)
 		{
-			if(var.GetType() != VariableClass::GetStaticType())
-				throw ExecutionException("Invalid variable cast attempted!");
+			TypeChecks::Verify(var.GetType(), VariableClass::GetStaticType(), "Invalid variable cast attempted!");
 
 			return *(reinterpret_cast<const VariableClass*>(&var));
 		}
@@ -49,19 +51,15 @@ namespace VM
 		template<class RValueClass>
 		const RValueClass& CastRValue(const RValue& rval)
 		{
-			if(rval.GetType() != RValueClass::GetType())
-				throw ExecutionException("Invalid rvalue cast attempted!");
-
-			return dynamic_cast<const RValueClass&>(rval);
+			TypeChecks::Verify(rval.GetType(), RValueClass::GetType(), "Invalid rvalue cast attempted!");
+			return TypeChecks::Downcast<const RValueClass>(rval);
 		}
 
 		template<class RValueClass>
 		RValueClass& CastRValue(RValue& rval)
 		{
-			if(rval.GetType() != RValueClass::GetType())
-				throw ExecutionException("Invalid rvalue cast attempted!");
-
-			return dynamic_cast<RValueClass&>(rval);
+			TypeChecks::Verify(rval.GetType(), RValueClass::GetType(), "Invalid rvalue cast attempted!");
+			return TypeChecks::Downcast<RValueClass>(rval);
 		}
 
 	}
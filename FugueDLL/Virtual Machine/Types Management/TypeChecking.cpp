@@ -0,0 +1,35 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Policy controlling runtime verification of types during execution
+//
+
+#include "pch.h"
+#include "Virtual Machine/Types Management/TypeChecking.h"
+
+using namespace VM;
+using namespace VM::TypesManager;
+
+
+volatile LONG ProgramTypeChecks::NumUnvalidatedPrograms = 0;
+
+
+//
+// Note the start of a program's execution
+//
+ProgramTypeChecks::ProgramTypeChecks(bool validated)
+	: Validated(validated)
+{
+	if(!Validated)
+		::InterlockedIncrement(&NumUnvalidatedPrograms);
+}
+
+//
+// Note the end of a program's execution
+//
+ProgramTypeChecks::~ProgramTypeChecks()
+{
+	if(!Validated)
+		::InterlockedDecrement(&NumUnvalidatedPrograms);
+}
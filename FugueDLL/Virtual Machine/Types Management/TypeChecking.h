@@ -0,0 +1,128 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Policy controlling runtime verification of types during execution
+//
+// Programs compiled from source, and binaries which carry a validation
+// record, have been through the validator before they run; the types
+// passed to casts and comparisons in such a program have already been
+// proven consistent, so checking them again at runtime is redundant.
+// Other binaries (hand-assembled code, or images written before the
+// validation record existed) have never been validated, and must keep
+// every check.
+//
+// In unchecked builds (FUGUE_UNCHECKED_EXECUTION, which the release
+// configurations define) the checks are therefore skipped only while no
+// unvalidated program is executing; see ProgramTypeChecks. Checked builds
+// always verify types, as a safety net while developing the VM itself.
+//
+// Note that the validator does not track the element types of arrays;
+// checks on array elements must not go through this policy.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Types/EpochTypeIDs.h"
+#include "Virtual Machine/VMExceptions.h"
+
+
+namespace VM
+{
+
+	namespace TypesManager
+	{
+
+		//
+		// Type verification policy; specialized below for each execution mode
+		//
+		template <bool Checked>
+		struct TypeCheckPolicy;
+
+		//
+		// Checked mode: mismatched types raise an execution exception
+		//
+		template <>
+		struct TypeCheckPolicy<true>
+		{
+			static void Verify(EpochVariableTypeID actual, EpochVariableTypeID expected, const char* message)
+			{
+				if(actual != expected)
+					throw ExecutionException(message);
+			}
+
+			template <class TargetClass, class SourceClass>
+			static TargetClass& Downcast(SourceClass& source)
+			{ return dynamic_cast<TargetClass&>(source); }
+		};
+
+		//
+		// Unchecked mode: types are trusted to be correct, and verification compiles away
+		//
+		template <>
+		struct TypeCheckPolicy<false>
+		{
+			static void Verify(EpochVariableTypeID, EpochVariableTypeID, const char*)
+			{ }
+
+			template <class TargetClass, class SourceClass>
+			static TargetClass& Downcast(SourceClass& source)
+			{ return static_cast<TargetClass&>(source); }
+		};
+
+
+		//
+		// Tracks the programs which are executing without having been validated
+		//
+		// Construct one of these for the duration of each program's execution.
+		//
+		class ProgramTypeChecks
+		{
+		// Construction and destruction
+		public:
+			explicit ProgramTypeChecks(bool validated);
+			~ProgramTypeChecks();
+
+		// Queries
+		public:
+			static bool AreRequired()
+			{ return (NumUnvalidatedPrograms != 0); }
+
+		// Internal tracking
+		private:
+			bool Validated;
+			static volatile LONG NumUnvalidatedPrograms;
+		};
+
+
+#ifdef FUGUE_UNCHECKED_EXECUTION
+
+		//
+		// Unchecked builds: verify types only while an unvalidated program is running
+		//
+		struct TypeChecks
+		{
+			static void Verify(EpochVariableTypeID actual, EpochVariableTypeID expected, const char* message)
+			{
+				if(ProgramTypeChecks::AreRequired())
+					TypeCheckPolicy<true>::Verify(actual, expected, message);
+			}
+
+			template <class TargetClass, class SourceClass>
+			static TargetClass& Downcast(SourceClass& source)
+			{
+				if(ProgramTypeChecks::AreRequired())
+					return TypeCheckPolicy<true>::Downcast<TargetClass>(source);
+				return TypeCheckPolicy<false>::Downcast<TargetClass>(source);
+			}
+		};
+
+#else
+		typedef TypeCheckPolicy<true> TypeChecks;
+#endif
+
+	}
+
+}
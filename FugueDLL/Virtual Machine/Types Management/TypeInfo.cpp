@@ -29,6 +29,7 @@ size_t TypeInfo::GetStorageSize(EpochVariableTypeID type)
 	case EpochVariableType_Buffer:		return BufferVariable::GetStorageSize();
 	case EpochVariableType_TaskHandle:	return TaskHandleVariable::GetStorageSize();
 	case EpochVariableType_Array:		return ArrayVariable::GetBaseStorageSize();
+	case EpochVariableType_HashMap:		return HashMapVariable::GetStorageSize();
 
 	case EpochVariableType_Tuple:
 	case EpochVariableType_Structure:
@@ -62,6 +63,7 @@ bool TypeInfo::IsNumeric(VM::EpochVariableTypeID type)
 	case EpochVariableType_Address:
 	case EpochVariableType_Buffer:
 	case EpochVariableType_TaskHandle:
+	case EpochVariableType_HashMap:
 	case EpochVariableType_Tuple:
 	case EpochVariableType_Structure:
 		return false;
@@ -14,6 +14,7 @@
 #include "Virtual Machine/Core Entities/Variables/TupleVariable.h"
 #include "Virtual Machine/Core Entities/Variables/StructureVariable.h"
 #include "Virtual Machine/Core Entities/Variables/ArrayVariable.h"
+#include "Virtual Machine/Core Entities/Variables/HashMapVariable.h"
 
 
 namespace TypeInfo
@@ -44,6 +45,7 @@ namespace TypeInfo
 	DECLARE_TYPE(StructureT, StructureVariable, StructureRValue)
 	DECLARE_TYPE(BufferT, BufferVariable, BufferRValue)
 	DECLARE_TYPE(ArrayT, ArrayVariable, ArrayRValue)
+	DECLARE_TYPE(HashMapT, HashMapVariable, HashMapRValue)
 
 
 #undef DECLARE_TYPE
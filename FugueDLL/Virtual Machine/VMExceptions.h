@@ -123,6 +123,26 @@ namespace VM
 		}
 	};
 
+	//
+	// This exception is thrown when a block is entered by work which has been cancelled; see
+	// CancellationToken.h. It is always caught by the code which started the cancelled work,
+	// so it should never be reported as an error.
+	//
+	class TaskCancelledException : public Exception
+	{
+	// Construction
+	public:
+		TaskCancelledException() : Exception("Execution was cancelled") { }
+
+	// Helpers for making error reporting more friendly
+	public:
+		virtual const char* GetErrorPrologue() const
+		{
+			return "Cancelled work was not stopped cleanly by the code which started it. "
+				"Please report this error and provide any relevant code.";
+		}
+	};
+
 }
 
 
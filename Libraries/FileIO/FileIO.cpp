@@ -0,0 +1,706 @@
+//
+// The Epoch Language Project
+// Auxiliary Libraries
+//
+// Library for efficiently reading large data files
+//
+// Three ways of reading are offered, each suited to a different access
+// pattern:
+//
+//  - Memory mapped files, for random access to a whole file. Reads are
+//    served straight from the mapped view, without any read system calls.
+//
+//  - Overlapped reads, for fetching a block of a file into a buffer while
+//    the program gets on with other work. The read itself is carried out
+//    by the OS; waiting for it can be wrapped in a future, as in
+//    future(bytesread, waitread(request)).
+//
+//  - Streams, for reading a file from start to end in fixed size chunks.
+//    The next chunk is always being read in the background while the
+//    program works on the current one, so sequential processing is
+//    rarely held up waiting on the disk. Chunks can be taken as raw bytes
+//    or as arrays of integers or reals, ready to hand to array operations.
+//
+// Files, mappings, reads, and streams are all identified by integer
+// handles; 0 is never a valid handle. A handle must not be closed while
+// another task is still using it, and the buffer given to an overlapped
+// read must stay alive until the read has been waited on.
+//
+// Functions are registered as externals residing in this DLL, so that
+// their parameters are passed in the order listed, just as with any other
+// external function.
+//
+
+#include "stdlib.h"
+#include "windows.h"
+#include <vector>
+#include <map>
+
+#include "Utility/Types/IDTypes.h"
+#include "Utility/Types/IntegerTypes.h"
+#include "Utility/Types/RealTypes.h"
+
+#include "Marshalling/LibraryImporting.h"
+
+
+namespace
+{
+
+	//
+	// Base for all objects which are handed to programs as handles
+	//
+	class Resource
+	{
+	public:
+		virtual ~Resource()
+		{ }
+	};
+
+	//
+	// A file mapped into memory in its entirety
+	//
+	class MappedFile : public Resource
+	{
+	public:
+		MappedFile()
+			: File(INVALID_HANDLE_VALUE), Mapping(NULL), View(NULL), Size(0)
+		{ }
+
+		virtual ~MappedFile()
+		{
+			if(View)
+				::UnmapViewOfFile(View);
+			if(Mapping)
+				::CloseHandle(Mapping);
+			if(File != INVALID_HANDLE_VALUE)
+				::CloseHandle(File);
+		}
+
+	public:
+		HANDLE File;
+		HANDLE Mapping;
+		const char* View;
+		size_t Size;
+	};
+
+	//
+	// A file opened for overlapped reads
+	//
+	class OverlappedFile : public Resource
+	{
+	public:
+		OverlappedFile()
+			: File(INVALID_HANDLE_VALUE)
+		{ }
+
+		virtual ~OverlappedFile()
+		{
+			if(File != INVALID_HANDLE_VALUE)
+				::CloseHandle(File);
+		}
+
+	public:
+		HANDLE File;
+	};
+
+	//
+	// An overlapped read which has been started but not yet waited on
+	//
+	// Reads which cannot be started are still given a handle, so that the
+	// failure is reported through waitread like any other.
+	//
+	class PendingRead : public Resource
+	{
+	public:
+		PendingRead()
+			: File(INVALID_HANDLE_VALUE), Started(false)
+		{
+			::ZeroMemory(&Overlapped, sizeof(Overlapped));
+		}
+
+		virtual ~PendingRead()
+		{
+			if(Overlapped.hEvent)
+				::CloseHandle(Overlapped.hEvent);
+		}
+
+	public:
+		HANDLE File;
+		OVERLAPPED Overlapped;
+		bool Started;
+	};
+
+	//
+	// A file read sequentially in chunks, with the next chunk read ahead
+	//
+	// There are two chunk buffers: one holds the chunk most recently handed
+	// to the program, while the next chunk is read into the other.
+	//
+	class Stream : public Resource
+	{
+	public:
+		Stream()
+			: File(INVALID_HANDLE_VALUE), ChunkSize(0), NextOffset(0), ReadBuffer(0), ReadPending(false)
+		{
+			::ZeroMemory(&Overlapped, sizeof(Overlapped));
+		}
+
+		virtual ~Stream()
+		{
+			if(ReadPending)
+			{
+				DWORD ignored;
+				::CancelIo(File);
+				::GetOverlappedResult(File, &Overlapped, &ignored, TRUE);
+			}
+
+			if(Overlapped.hEvent)
+				::CloseHandle(Overlapped.hEvent);
+			if(File != INVALID_HANDLE_VALUE)
+				::CloseHandle(File);
+		}
+
+	public:
+		HANDLE File;
+		size_t ChunkSize;
+		unsigned __int64 NextOffset;
+		std::vector<char> Chunks[2];
+		unsigned ReadBuffer;
+		OVERLAPPED Overlapped;
+		bool ReadPending;
+	};
+
+
+	//
+	// Table of live handles
+	//
+	CRITICAL_SECTION ResourceCriticalSection;
+	std::map<Integer32, Resource*> Resources;
+	Integer32 NextHandle = 1;
+
+	RequestMarshalBufferPtr RequestMarshalBuffer = NULL;
+
+
+	Integer32 AddResource(Resource* resource)
+	{
+		::EnterCriticalSection(&ResourceCriticalSection);
+		Integer32 handle = NextHandle++;
+		Resources[handle] = resource;
+		::LeaveCriticalSection(&ResourceCriticalSection);
+		return handle;
+	}
+
+	template <typename ResourceT>
+	ResourceT* GetResource(Integer32 handle)
+	{
+		::EnterCriticalSection(&ResourceCriticalSection);
+		std::map<Integer32, Resource*>::const_iterator iter = Resources.find(handle);
+		Resource* resource = (iter == Resources.end()) ? NULL : iter->second;
+		::LeaveCriticalSection(&ResourceCriticalSection);
+		return dynamic_cast<ResourceT*>(resource);
+	}
+
+	template <typename ResourceT>
+	ResourceT* RemoveResource(Integer32 handle)
+	{
+		ResourceT* ret = NULL;
+
+		::EnterCriticalSection(&ResourceCriticalSection);
+		std::map<Integer32, Resource*>::iterator iter = Resources.find(handle);
+		if(iter != Resources.end())
+		{
+			ret = dynamic_cast<ResourceT*>(iter->second);
+			if(ret)
+				Resources.erase(iter);
+		}
+		::LeaveCriticalSection(&ResourceCriticalSection);
+
+		return ret;
+	}
+
+	void ReleaseAllResources()
+	{
+		for(std::map<Integer32, Resource*>::iterator iter = Resources.begin(); iter != Resources.end(); ++iter)
+			delete iter->second;
+
+		Resources.clear();
+	}
+
+
+	//
+	// Allocate an array to return to the VM, with room for the given number of elements
+	//
+	void* AllocateReturnArray(VM::EpochVariableTypeID type, size_t elementsize, size_t count, void*& elements)
+	{
+		char* buffer = reinterpret_cast<char*>(RequestMarshalBuffer(sizeof(LibraryArrayReturnInfo) + elementsize * count));
+		LibraryArrayReturnInfo* info = reinterpret_cast<LibraryArrayReturnInfo*>(buffer);
+		info->TypeHint = type;
+		info->ElementCount = count;
+		elements = buffer + sizeof(LibraryArrayReturnInfo);
+		return buffer;
+	}
+
+	//
+	// Return the given bytes as an array of 32-bit elements; trailing partial elements are dropped
+	//
+	void* ReturnPackedElements(VM::EpochVariableTypeID type, const char* data, size_t numbytes)
+	{
+		size_t count = numbytes / 4;
+
+		void* elements;
+		void* ret = AllocateReturnArray(type, 4, count, elements);
+		if(count)
+			::CopyMemory(elements, data, count * 4);
+		return ret;
+	}
+
+	//
+	// Clamp a read of a mapped file to the mapped range
+	//
+	size_t ClampMappedRead(const MappedFile& file, Integer32 offset, Integer32 count)
+	{
+		if(offset < 0 || count <= 0 || static_cast<size_t>(offset) >= file.Size)
+			return 0;
+
+		size_t available = file.Size - static_cast<size_t>(offset);
+		return (static_cast<size_t>(count) < available) ? static_cast<size_t>(count) : available;
+	}
+
+
+	//
+	// Start reading the next chunk of a stream into the spare buffer
+	//
+	void StartStreamRead(Stream& stream)
+	{
+		stream.Overlapped.Offset = static_cast<DWORD>(stream.NextOffset & 0xFFFFFFFF);
+		stream.Overlapped.OffsetHigh = static_cast<DWORD>(stream.NextOffset >> 32);
+		::ResetEvent(stream.Overlapped.hEvent);
+
+		std::vector<char>& buffer = stream.Chunks[stream.ReadBuffer];
+		if(::ReadFile(stream.File, &buffer[0], static_cast<DWORD>(stream.ChunkSize), NULL, &stream.Overlapped) || ::GetLastError() == ERROR_IO_PENDING)
+			stream.ReadPending = true;
+	}
+
+	//
+	// Wait for the chunk being read ahead, and start reading the one after it
+	//
+	// Returns the completed chunk, which remains valid until the next call.
+	// At the end of the file, or if the read fails, no bytes are returned.
+	//
+	const char* TakeStreamChunk(Stream& stream, size_t& numbytes)
+	{
+		numbytes = 0;
+		if(!stream.ReadPending)
+			return NULL;
+
+		DWORD bytesread = 0;
+		BOOL succeeded = ::GetOverlappedResult(stream.File, &stream.Overlapped, &bytesread, TRUE);
+		stream.ReadPending = false;
+
+		if(!succeeded || bytesread == 0)
+			return NULL;
+
+		const char* chunk = &stream.Chunks[stream.ReadBuffer][0];
+		numbytes = bytesread;
+
+		stream.NextOffset += bytesread;
+		stream.ReadBuffer = 1 - stream.ReadBuffer;
+		StartStreamRead(stream);
+
+		return chunk;
+	}
+
+}
+
+
+//
+// Main entry/exit point for the DLL - initialization and cleanup should be done here
+//
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD reason, LPVOID reserved)
+{
+	if(reason == DLL_PROCESS_ATTACH)
+		::InitializeCriticalSection(&ResourceCriticalSection);
+	else if(reason == DLL_PROCESS_DETACH)
+	{
+		ReleaseAllResources();
+		::DeleteCriticalSection(&ResourceCriticalSection);
+	}
+
+    return TRUE;
+}
+
+
+//
+// Callback that is invoked when a program starts running which loads this library.
+// Our goal here is to register all of the functions in the library with the Epoch
+// virtual machine, so that we can call the library from the program.
+//
+void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
+{
+	RequestMarshalBuffer = registration.RequestMarshalBuffer;
+
+	const wchar_t* thisdll = L"FileIO.dll";
+
+	// Memory mapped files
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"filename", VM::EpochVariableType_String));
+		registration.RegisterExternal(L"mapfile", "MapFile", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"mapping", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"mappedsize", "GetMappedSize", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+		registration.RegisterExternal(L"unmapfile", "UnmapFile", thisdll, &params[0], params.size(), VM::EpochVariableType_Null, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"mapping", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"offset", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"count", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"buffer", VM::EpochVariableType_Buffer));
+		registration.RegisterExternal(L"readmapped", "ReadMapped", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"mapping", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"offset", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"count", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"readmappedintegers", "ReadMappedIntegers", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+		registration.RegisterExternal(L"readmappedreals", "ReadMappedReals", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+	}
+
+	// Overlapped reads
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"filename", VM::EpochVariableType_String));
+		registration.RegisterExternal(L"openfile", "OpenOverlappedFile", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"file", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"filesize", "GetOverlappedFileSize", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+		registration.RegisterExternal(L"closefile", "CloseOverlappedFile", thisdll, &params[0], params.size(), VM::EpochVariableType_Null, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"file", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"offset", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"count", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"buffer", VM::EpochVariableType_Buffer));
+		registration.RegisterExternal(L"beginread", "BeginRead", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"request", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"isreadcomplete", "IsReadComplete", thisdll, &params[0], params.size(), VM::EpochVariableType_Boolean, bindrecord);
+		registration.RegisterExternal(L"waitread", "WaitRead", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	// Streams
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"filename", VM::EpochVariableType_String));
+		params.push_back(ParamData(L"chunksize", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"openstream", "OpenStream", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"stream", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"buffer", VM::EpochVariableType_Buffer));
+		registration.RegisterExternal(L"nextchunk", "ReadNextChunk", thisdll, &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"stream", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"nextintegers", "ReadNextIntegers", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+		registration.RegisterExternal(L"nextreals", "ReadNextReals", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+		registration.RegisterExternal(L"closestream", "CloseStream", thisdll, &params[0], params.size(), VM::EpochVariableType_Null, bindrecord);
+	}
+}
+
+
+
+//-------------------------------------------------------------------------------
+// Routines exported by the DLL
+//-------------------------------------------------------------------------------
+
+//
+// Map an entire file into memory for reading; returns 0 on failure
+//
+// Empty files cannot be mapped, and so cannot be opened this way.
+//
+Integer32 __stdcall MapFile(const wchar_t* filename)
+{
+	MappedFile* file = new MappedFile;
+
+	file->File = ::CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if(file->File != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if(::GetFileSizeEx(file->File, &size) && size.QuadPart > 0 && size.QuadPart <= 0x7FFFFFFF)
+		{
+			file->Size = static_cast<size_t>(size.QuadPart);
+			file->Mapping = ::CreateFileMapping(file->File, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(file->Mapping)
+				file->View = reinterpret_cast<const char*>(::MapViewOfFile(file->Mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+
+	if(!file->View)
+	{
+		delete file;
+		return 0;
+	}
+
+	return AddResource(file);
+}
+
+Integer32 __stdcall GetMappedSize(Integer32 mapping)
+{
+	MappedFile* file = GetResource<MappedFile>(mapping);
+	return file ? static_cast<Integer32>(file->Size) : 0;
+}
+
+void __stdcall UnmapFile(Integer32 mapping)
+{
+	delete RemoveResource<MappedFile>(mapping);
+}
+
+//
+// Copy bytes from a mapped file into a buffer; returns the number of bytes copied
+//
+Integer32 __stdcall ReadMapped(Integer32 mapping, Integer32 offset, Integer32 count, void* buffer)
+{
+	MappedFile* file = GetResource<MappedFile>(mapping);
+	if(!file || !buffer)
+		return 0;
+
+	size_t numbytes = ClampMappedRead(*file, offset, count);
+	if(numbytes)
+		::CopyMemory(buffer, file->View + offset, numbytes);
+
+	return static_cast<Integer32>(numbytes);
+}
+
+//
+// Read packed 32-bit integers from a mapped file; the count is in elements
+//
+void* __stdcall ReadMappedIntegers(Integer32 mapping, Integer32 offset, Integer32 count)
+{
+	MappedFile* file = GetResource<MappedFile>(mapping);
+	if(!file || count < 0 || count > 0x1FFFFFFF)
+		return ReturnPackedElements(VM::EpochVariableType_Integer, NULL, 0);
+
+	size_t numbytes = ClampMappedRead(*file, offset, count * 4);
+	return ReturnPackedElements(VM::EpochVariableType_Integer, file->View + offset, numbytes);
+}
+
+//
+// Read packed 32-bit reals from a mapped file; the count is in elements
+//
+void* __stdcall ReadMappedReals(Integer32 mapping, Integer32 offset, Integer32 count)
+{
+	MappedFile* file = GetResource<MappedFile>(mapping);
+	if(!file || count < 0 || count > 0x1FFFFFFF)
+		return ReturnPackedElements(VM::EpochVariableType_Real, NULL, 0);
+
+	size_t numbytes = ClampMappedRead(*file, offset, count * 4);
+	return ReturnPackedElements(VM::EpochVariableType_Real, file->View + offset, numbytes);
+}
+
+
+//
+// Open a file for overlapped reads; returns 0 on failure
+//
+Integer32 __stdcall OpenOverlappedFile(const wchar_t* filename)
+{
+	HANDLE handle = ::CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+	if(handle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	OverlappedFile* file = new OverlappedFile;
+	file->File = handle;
+	return AddResource(file);
+}
+
+Integer32 __stdcall GetOverlappedFileSize(Integer32 filehandle)
+{
+	OverlappedFile* file = GetResource<OverlappedFile>(filehandle);
+	if(!file)
+		return 0;
+
+	LARGE_INTEGER size;
+	if(!::GetFileSizeEx(file->File, &size) || size.QuadPart > 0x7FFFFFFF)
+		return 0;
+
+	return static_cast<Integer32>(size.QuadPart);
+}
+
+void __stdcall CloseOverlappedFile(Integer32 filehandle)
+{
+	delete RemoveResource<OverlappedFile>(filehandle);
+}
+
+//
+// Start reading part of a file into a buffer, without waiting for the read to finish
+//
+// Returns a request handle, which must be passed to waitread to find out
+// how many bytes were read, and to release the request. Returns 0 if the
+// file handle is not valid.
+//
+Integer32 __stdcall BeginRead(Integer32 filehandle, Integer32 offset, Integer32 count, void* buffer)
+{
+	OverlappedFile* file = GetResource<OverlappedFile>(filehandle);
+	if(!file)
+		return 0;
+
+	PendingRead* read = new PendingRead;
+	read->File = file->File;
+	read->Overlapped.Offset = static_cast<DWORD>(offset);
+	read->Overlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if(read->Overlapped.hEvent && buffer && offset >= 0 && count > 0)
+	{
+		if(::ReadFile(file->File, buffer, static_cast<DWORD>(count), NULL, &read->Overlapped) || ::GetLastError() == ERROR_IO_PENDING)
+			read->Started = true;
+	}
+
+	return AddResource(read);
+}
+
+//
+// Check if an overlapped read has finished, without waiting for it
+//
+BOOL __stdcall IsReadComplete(Integer32 request)
+{
+	PendingRead* read = GetResource<PendingRead>(request);
+	if(!read || !read->Started)
+		return TRUE;
+
+	return HasOverlappedIoCompleted(&read->Overlapped) ? TRUE : FALSE;
+}
+
+//
+// Wait for an overlapped read to finish, and release the request
+//
+// Returns the number of bytes read, which is 0 at the end of the file,
+// or -1 if the read failed.
+//
+Integer32 __stdcall WaitRead(Integer32 request)
+{
+	PendingRead* read = RemoveResource<PendingRead>(request);
+	if(!read)
+		return -1;
+
+	Integer32 ret = -1;
+	if(read->Started)
+	{
+		DWORD bytesread = 0;
+		if(::GetOverlappedResult(read->File, &read->Overlapped, &bytesread, TRUE))
+			ret = static_cast<Integer32>(bytesread);
+		else if(::GetLastError() == ERROR_HANDLE_EOF)
+			ret = 0;
+	}
+
+	delete read;
+	return ret;
+}
+
+
+//
+// Open a file for sequential reading in chunks of the given size; returns 0 on failure
+//
+// Chunk sizes are rounded down to a multiple of 4 bytes, so that chunks
+// always hold whole integers or reals. Reading of the first chunk starts
+// immediately.
+//
+Integer32 __stdcall OpenStream(const wchar_t* filename, Integer32 chunksize)
+{
+	if(chunksize < 4)
+		return 0;
+
+	HANDLE handle = ::CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(handle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	Stream* stream = new Stream;
+	stream->File = handle;
+	stream->ChunkSize = static_cast<size_t>(chunksize) & ~static_cast<size_t>(3);
+	stream->Chunks[0].resize(stream->ChunkSize);
+	stream->Chunks[1].resize(stream->ChunkSize);
+	stream->Overlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!stream->Overlapped.hEvent)
+	{
+		delete stream;
+		return 0;
+	}
+
+	StartStreamRead(*stream);
+	return AddResource(stream);
+}
+
+//
+// Copy the next chunk of a stream into a buffer, which must hold at least a chunk
+//
+// Returns the number of bytes copied, which is 0 at the end of the stream.
+//
+Integer32 __stdcall ReadNextChunk(Integer32 streamhandle, void* buffer)
+{
+	Stream* stream = GetResource<Stream>(streamhandle);
+	if(!stream || !buffer)
+		return 0;
+
+	size_t numbytes;
+	const char* chunk = TakeStreamChunk(*stream, numbytes);
+	if(numbytes)
+		::CopyMemory(buffer, chunk, numbytes);
+
+	return static_cast<Integer32>(numbytes);
+}
+
+//
+// Retrieve the next chunk of a stream as an array of integers
+//
+// The array is empty at the end of the stream.
+//
+void* __stdcall ReadNextIntegers(Integer32 streamhandle)
+{
+	Stream* stream = GetResource<Stream>(streamhandle);
+	if(!stream)
+		return ReturnPackedElements(VM::EpochVariableType_Integer, NULL, 0);
+
+	size_t numbytes;
+	const char* chunk = TakeStreamChunk(*stream, numbytes);
+	return ReturnPackedElements(VM::EpochVariableType_Integer, chunk, numbytes);
+}
+
+//
+// Retrieve the next chunk of a stream as an array of reals
+//
+// The array is empty at the end of the stream.
+//
+void* __stdcall ReadNextReals(Integer32 streamhandle)
+{
+	Stream* stream = GetResource<Stream>(streamhandle);
+	if(!stream)
+		return ReturnPackedElements(VM::EpochVariableType_Real, NULL, 0);
+
+	size_t numbytes;
+	const char* chunk = TakeStreamChunk(*stream, numbytes);
+	return ReturnPackedElements(VM::EpochVariableType_Real, chunk, numbytes);
+}
+
+void __stdcall CloseStream(Integer32 streamhandle)
+{
+	delete RemoveResource<Stream>(streamhandle);
+}
+
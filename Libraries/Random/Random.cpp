@@ -4,11 +4,24 @@
 //
 // Library for working with random numbers
 //
+// Numbers are produced by the xoshiro128** generator. Each thread has
+// generator state of its own, so that tasks running in parallel never
+// contend with one another for random numbers, and each thread's state
+// is seeded differently so that parallel tasks see distinct sequences.
+// The generator is not suitable for cryptographic purposes.
+//
+// Besides the basic random() function, whole arrays of random integers
+// or reals can be produced in a single call, which avoids the overhead
+// of calling into the library once per number. Where the CPU supports
+// SSE2, arrays are filled by running four generators side by side.
+//
 
 #include "stdlib.h"
 #include "windows.h"
 #include <vector>
 
+#include <emmintrin.h>
+
 #include "Utility/Types/IDTypes.h"
 #include "Utility/Types/IntegerTypes.h"
 #include "Utility/Types/RealTypes.h"
@@ -16,6 +29,264 @@
 #include "Marshalling/LibraryImporting.h"
 
 
+namespace
+{
+
+	// Number of generators run side by side when filling arrays
+	const size_t LaneCount = 4;
+
+	// Scale factor for turning the top 24 bits of a random number into a real in [0, 1)
+	const Real RealScale = 1.0f / 16777216.0f;
+
+	//
+	// Generator state belonging to a single thread
+	//
+	// The scalar state is used for individual numbers and for any
+	// elements left over when filling an array. The lane states are
+	// held one word at a time across all lanes, so that each word can
+	// be loaded straight into a vector register.
+	//
+	struct GeneratorState
+	{
+		UInteger32 Scalar[4];
+		UInteger32 Lanes[4][LaneCount];
+	};
+
+	DWORD StateTLSIndex = TLS_OUT_OF_INDEXES;
+	volatile LONG SeedCounter = 0;
+	bool UseSSE2 = false;
+
+	RequestMarshalBufferPtr RequestMarshalBuffer = NULL;
+
+
+	//
+	// Scramble a seed value; used to spread seeds across the generator state
+	//
+	UInteger32 MixSeed(UInteger32& seed)
+	{
+		UInteger32 z = (seed += 0x9e3779b9);
+		z = (z ^ (z >> 16)) * 0x85ebca6b;
+		z = (z ^ (z >> 13)) * 0xc2b2ae35;
+		return z ^ (z >> 16);
+	}
+
+	//
+	// Fill a generator state with fresh seed values
+	//
+	// The seed mixes the time, the thread ID, and a counter which is
+	// bumped for every thread, so that threads started in the same
+	// instant still receive different sequences. Each word of a state
+	// is mixed from a different input, and the mixing is reversible, so
+	// at most one word can be zero; xoshiro cannot escape a state which
+	// is entirely zero.
+	//
+	void SeedState(GeneratorState& state)
+	{
+		UInteger32 seed = static_cast<UInteger32>(::GetTickCount()) ^ (static_cast<UInteger32>(::GetCurrentThreadId()) * 0x9e3779b9);
+		seed += static_cast<UInteger32>(::InterlockedIncrement(&SeedCounter)) * 0x6c8e9cf5;
+
+		for(size_t i = 0; i < 4; ++i)
+			state.Scalar[i] = MixSeed(seed);
+
+		for(size_t lane = 0; lane < LaneCount; ++lane)
+		{
+			for(size_t i = 0; i < 4; ++i)
+				state.Lanes[i][lane] = MixSeed(seed);
+		}
+	}
+
+	//
+	// Retrieve the calling thread's generator state, creating it if necessary
+	//
+	GeneratorState& GetStateForThisThread()
+	{
+		GeneratorState* state = reinterpret_cast<GeneratorState*>(::TlsGetValue(StateTLSIndex));
+		if(!state)
+		{
+			state = new GeneratorState;
+			SeedState(*state);
+			::TlsSetValue(StateTLSIndex, state);
+		}
+
+		return *state;
+	}
+
+	//
+	// Release the calling thread's generator state, if it has one
+	//
+	void ReleaseStateForThisThread()
+	{
+		if(StateTLSIndex == TLS_OUT_OF_INDEXES)
+			return;
+
+		delete reinterpret_cast<GeneratorState*>(::TlsGetValue(StateTLSIndex));
+		::TlsSetValue(StateTLSIndex, NULL);
+	}
+
+
+	//
+	// Advance a single generator and return its next output
+	//
+	inline UInteger32 RotateLeft(UInteger32 value, int bits)
+	{
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	UInteger32 NextNumber(UInteger32 (&s)[4])
+	{
+		UInteger32 ret = RotateLeft(s[1] * 5, 7) * 9;
+		UInteger32 t = s[1] << 9;
+
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = RotateLeft(s[3], 11);
+
+		return ret;
+	}
+
+	//
+	// Map a random number onto the range [0, maximum)
+	//
+	// Taking the high half of the product avoids the division needed
+	// by the modulus operator.
+	//
+	inline Integer32 ScaleToRange(UInteger32 value, Integer32 maximum)
+	{
+		if(maximum <= 0)
+			return 0;
+
+		return static_cast<Integer32>((static_cast<unsigned __int64>(value) * static_cast<UInteger32>(maximum)) >> 32);
+	}
+
+	inline Real ScaleToReal(UInteger32 value)
+	{
+		return static_cast<Real>(value >> 8) * RealScale;
+	}
+
+
+	//
+	// Vector equivalents of the above, operating on all lanes at once
+	//
+	inline __m128i RotateLeft(__m128i value, int bits)
+	{
+		return _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - bits));
+	}
+
+	__m128i NextNumbers(__m128i (&s)[4])
+	{
+		// Multiplication by 5 and 9 as shift-and-add, since SSE2 lacks a packed 32-bit multiply
+		__m128i scaled = _mm_add_epi32(_mm_slli_epi32(s[1], 2), s[1]);
+		__m128i rotated = RotateLeft(scaled, 7);
+		__m128i ret = _mm_add_epi32(_mm_slli_epi32(rotated, 3), rotated);
+		__m128i t = _mm_slli_epi32(s[1], 9);
+
+		s[2] = _mm_xor_si128(s[2], s[0]);
+		s[3] = _mm_xor_si128(s[3], s[1]);
+		s[1] = _mm_xor_si128(s[1], s[2]);
+		s[0] = _mm_xor_si128(s[0], s[3]);
+		s[2] = _mm_xor_si128(s[2], t);
+		s[3] = RotateLeft(s[3], 11);
+
+		return ret;
+	}
+
+	__m128i ScaleToRange(__m128i values, __m128i maximum)
+	{
+		// Multiply the even and odd lanes separately, keeping the high half of each product
+		__m128i even = _mm_mul_epu32(values, maximum);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(values, 32), maximum);
+		even = _mm_srli_epi64(even, 32);
+		odd = _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0));
+		return _mm_or_si128(even, odd);
+	}
+
+	__m128 ScaleToReal(__m128i values)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(values, 8)), _mm_set1_ps(RealScale));
+	}
+
+	void LoadLanes(const GeneratorState& state, __m128i (&s)[4])
+	{
+		for(size_t i = 0; i < 4; ++i)
+			s[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.Lanes[i]));
+	}
+
+	void StoreLanes(GeneratorState& state, const __m128i (&s)[4])
+	{
+		for(size_t i = 0; i < 4; ++i)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state.Lanes[i]), s[i]);
+	}
+
+
+	//
+	// Fill a block of memory with random integers in [0, maximum)
+	//
+	void FillIntegers(Integer32* elements, size_t count, Integer32 maximum)
+	{
+		GeneratorState& state = GetStateForThisThread();
+
+		size_t i = 0;
+		if(UseSSE2 && maximum > 0)
+		{
+			__m128i s[4];
+			LoadLanes(state, s);
+
+			__m128i max = _mm_set1_epi32(maximum);
+			for(; i + LaneCount <= count; i += LaneCount)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(elements + i), ScaleToRange(NextNumbers(s), max));
+
+			StoreLanes(state, s);
+		}
+
+		for(; i < count; ++i)
+			elements[i] = ScaleToRange(NextNumber(state.Scalar), maximum);
+	}
+
+	//
+	// Fill a block of memory with random reals in [0, 1)
+	//
+	void FillReals(Real* elements, size_t count)
+	{
+		GeneratorState& state = GetStateForThisThread();
+
+		size_t i = 0;
+		if(UseSSE2)
+		{
+			__m128i s[4];
+			LoadLanes(state, s);
+
+			for(; i + LaneCount <= count; i += LaneCount)
+				_mm_storeu_ps(elements + i, ScaleToReal(NextNumbers(s)));
+
+			StoreLanes(state, s);
+		}
+
+		for(; i < count; ++i)
+			elements[i] = ScaleToReal(NextNumber(state.Scalar));
+	}
+
+
+	//
+	// Allocate an array to return to the VM, with room for the given number of elements
+	//
+	void* AllocateReturnArray(VM::EpochVariableTypeID type, size_t elementsize, Integer32 count, void*& elements)
+	{
+		size_t numelements = (count > 0) ? static_cast<size_t>(count) : 0;
+
+		char* buffer = reinterpret_cast<char*>(RequestMarshalBuffer(sizeof(LibraryArrayReturnInfo) + elementsize * numelements));
+		LibraryArrayReturnInfo* info = reinterpret_cast<LibraryArrayReturnInfo*>(buffer);
+		info->TypeHint = type;
+		info->ElementCount = numelements;
+		elements = buffer + sizeof(LibraryArrayReturnInfo);
+		return buffer;
+	}
+
+}
+
+
 //
 // Main entry/exit point for the DLL - initialization and cleanup should be done here
 //
@@ -23,8 +294,19 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD reason, LPVOID reserved)
 {
 	if(reason == DLL_PROCESS_ATTACH)
 	{
-		// Initialize random number system
-		srand(::GetTickCount());
+		StateTLSIndex = ::TlsAlloc();
+		if(StateTLSIndex == TLS_OUT_OF_INDEXES)
+			return FALSE;
+
+		UseSSE2 = (::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != FALSE);
+	}
+	else if(reason == DLL_THREAD_DETACH)
+		ReleaseStateForThisThread();
+	else if(reason == DLL_PROCESS_DETACH)
+	{
+		ReleaseStateForThisThread();
+		::TlsFree(StateTLSIndex);
+		StateTLSIndex = TLS_OUT_OF_INDEXES;
 	}
 
     return TRUE;
@@ -38,9 +320,28 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD reason, LPVOID reserved)
 //
 void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
 {
-	std::vector<ParamData> params;
-	params.push_back(ParamData(L"maximum", VM::EpochVariableType_Integer));
-	registration.RegisterFunction(L"random", "GetRandomNumber", &params[0], params.size(), VM::EpochVariableType_Integer, VM::EpochVariableType_Error, bindrecord);
+	RequestMarshalBuffer = registration.RequestMarshalBuffer;
+
+	const wchar_t* thisdll = L"Random.dll";
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"maximum", VM::EpochVariableType_Integer));
+		registration.RegisterFunction(L"random", "GetRandomNumber", &params[0], params.size(), VM::EpochVariableType_Integer, VM::EpochVariableType_Error, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"count", VM::EpochVariableType_Integer));
+		params.push_back(ParamData(L"maximum", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"randomintegers", "GetRandomIntegers", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+	}
+
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"count", VM::EpochVariableType_Integer));
+		registration.RegisterExternal(L"randomreals", "GetRandomReals", thisdll, &params[0], params.size(), VM::EpochVariableType_Array, bindrecord);
+	}
 }
 
 
@@ -50,10 +351,34 @@ void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
 //-------------------------------------------------------------------------------
 
 //
-// Simple standard C library random number generator
+// Retrieve a random integer in the range [0, maximum)
 //
 Integer32 __stdcall GetRandomNumber(Integer32 maximum)
 {
-	return static_cast<Integer32>(static_cast<Real>(rand()) / static_cast<Real>(RAND_MAX) * static_cast<Real>(maximum));
+	return ScaleToRange(NextNumber(GetStateForThisThread().Scalar), maximum);
+}
+
+//
+// Retrieve an array of random integers, each in the range [0, maximum)
+//
+void* __stdcall GetRandomIntegers(Integer32 count, Integer32 maximum)
+{
+	void* elements;
+	void* ret = AllocateReturnArray(VM::EpochVariableType_Integer, sizeof(Integer32), count, elements);
+	if(count > 0)
+		FillIntegers(reinterpret_cast<Integer32*>(elements), static_cast<size_t>(count), maximum);
+	return ret;
+}
+
+//
+// Retrieve an array of random reals, each in the range [0, 1)
+//
+void* __stdcall GetRandomReals(Integer32 count)
+{
+	void* elements;
+	void* ret = AllocateReturnArray(VM::EpochVariableType_Real, sizeof(Real), count, elements);
+	if(count > 0)
+		FillReals(reinterpret_cast<Real*>(elements), static_cast<size_t>(count));
+	return ret;
 }
 
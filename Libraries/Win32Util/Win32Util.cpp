@@ -4,6 +4,17 @@
 //
 // Library for general commonly used Win32 functionality
 //
+// Programs which own windows can wait for window messages and Epoch
+// task messages at the same time, using waitmessages, instead of
+// polling between GetMessage and acceptmsg. For the common case,
+// pumpmessages dispatches window messages until a task message is
+// waiting, so a GUI task's main loop can be written as:
+//
+//   while(pumpmessages(INFINITE) == MESSAGEWAIT_TASKMESSAGE)
+//   {
+//       acceptmsg(...)
+//   }
+//
 
 #include "stdlib.h"
 #include "windows.h"
@@ -14,6 +25,17 @@
 #include "Marshalling/LibraryImporting.h"
 
 
+namespace
+{
+
+	// Returned by pumpmessages once WM_QUIT has been retrieved
+	const Integer32 MessageLoopQuit = 3;
+
+	WaitForTaskOrWindowMessagePtr WaitForTaskOrWindowMessage = NULL;
+
+}
+
+
 //
 // Main entry/exit point for the DLL - initialization and cleanup should be done here
 //
@@ -30,6 +52,8 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD reason, LPVOID reserved)
 //
 void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
 {
+	WaitForTaskOrWindowMessage = registration.WaitForTaskOrWindowMessage;
+
 	// Constants
 #define REGCONSTANT_INTEGER(strname, value)	{ DWORD v = value; registration.RegisterConstant(strname, VM::EpochVariableType_Integer, &v, bindrecord); }
 
@@ -49,6 +73,14 @@ void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
 	REGCONSTANT_INTEGER(L"WM_DESTROY", WM_DESTROY);
 	REGCONSTANT_INTEGER(L"WM_COMMAND", WM_COMMAND);
 
+	REGCONSTANT_INTEGER(L"INFINITE", INFINITE);
+
+	REGCONSTANT_INTEGER(L"MESSAGEWAIT_TIMEDOUT", LibraryWait_TimedOut);
+	REGCONSTANT_INTEGER(L"MESSAGEWAIT_TASKMESSAGE", LibraryWait_TaskMessage);
+	REGCONSTANT_INTEGER(L"MESSAGEWAIT_WINDOWMESSAGE", LibraryWait_WindowMessage);
+	REGCONSTANT_INTEGER(L"MESSAGEWAIT_UNSUPPORTED", LibraryWait_Unsupported);
+	REGCONSTANT_INTEGER(L"MESSAGEWAIT_QUIT", MessageLoopQuit);
+
 #undef REGCONSTANT_INTEGER
 
 	// Function signatures
@@ -140,6 +172,21 @@ void __stdcall LinkToEpochVM(RegistrationTable registration, void* bindrecord)
 		registration.RegisterFunction(L"loword", "GetLowWord", &params[0], params.size(), VM::EpochVariableType_Integer, VM::EpochVariableType_Error, bindrecord);
 	}
 
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"timeout", VM::EpochVariableType_Integer));
+		registration.RegisterFunction(L"waitmessages", "WaitForMessages", &params[0], params.size(), VM::EpochVariableType_Integer, VM::EpochVariableType_Error, bindrecord);
+		registration.RegisterFunction(L"pumpmessages", "PumpMessages", &params[0], params.size(), VM::EpochVariableType_Integer, VM::EpochVariableType_Error, bindrecord);
+	}
+
+	// Batch functions implemented in this library
+	{
+		std::vector<ParamData> params;
+		params.push_back(ParamData(L"values", VM::EpochVariableType_Integer));
+		registration.RegisterBatchFunction(L"hiwords", "GetHighWords", &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+		registration.RegisterBatchFunction(L"lowords", "GetLowWords", &params[0], params.size(), VM::EpochVariableType_Integer, bindrecord);
+	}
+
 	// Functions implemented in other libraries
 	{
 		std::vector<ParamData> params;
@@ -266,3 +313,68 @@ Integer32 __stdcall GetLowWord(Integer32 value)
 {
 	return LOWORD(value);
 }
+
+void __stdcall GetHighWords(const void* const* arguments, void* results, size_t count)
+{
+	const Integer32* values = reinterpret_cast<const Integer32*>(arguments[0]);
+	Integer32* words = reinterpret_cast<Integer32*>(results);
+	for(size_t i = 0; i < count; ++i)
+		words[i] = HIWORD(values[i]);
+}
+
+void __stdcall GetLowWords(const void* const* arguments, void* results, size_t count)
+{
+	const Integer32* values = reinterpret_cast<const Integer32*>(arguments[0]);
+	Integer32* words = reinterpret_cast<Integer32*>(results);
+	for(size_t i = 0; i < count; ++i)
+		words[i] = LOWORD(values[i]);
+}
+
+//
+// Wait until either a window message or an Epoch task message arrives
+//
+// Returns one of the MESSAGEWAIT_ constants; neither kind of message
+// is removed, so the program retrieves it as usual afterwards.
+//
+Integer32 __stdcall WaitForMessages(Integer32 timeout)
+{
+	return WaitForTaskOrWindowMessage(static_cast<UInteger32>(timeout));
+}
+
+//
+// Dispatch window messages until an Epoch task message is waiting
+//
+// Returns MESSAGEWAIT_TASKMESSAGE when the program should accept a
+// task message, MESSAGEWAIT_QUIT once WM_QUIT has been retrieved, or
+// MESSAGEWAIT_TIMEDOUT if the timeout expires first. The timeout
+// covers the whole call, including time spent dispatching.
+//
+Integer32 __stdcall PumpMessages(Integer32 timeout)
+{
+	DWORD timeoutms = static_cast<DWORD>(timeout);
+	DWORD starttime = ::GetTickCount();
+
+	while(true)
+	{
+		MSG msg;
+		while(::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			if(msg.message == WM_QUIT)
+				return MessageLoopQuit;
+
+			::TranslateMessage(&msg);
+			::DispatchMessage(&msg);
+		}
+
+		DWORD remaining = INFINITE;
+		if(timeoutms != INFINITE)
+		{
+			DWORD elapsed = ::GetTickCount() - starttime;
+			remaining = (elapsed >= timeoutms) ? 0 : timeoutms - elapsed;
+		}
+
+		Integer32 result = WaitForTaskOrWindowMessage(remaining);
+		if(result != LibraryWait_WindowMessage)
+			return result;
+	}
+}
@@ -11,120 +11,186 @@ namespace Bytecode
 {
 	extern const char* HeaderCookie;
 
-	extern const unsigned char NullFlag;
-	extern const unsigned char NoOp;
-	extern const unsigned char ParentScope;
-	extern const unsigned char Variables;
-	extern const unsigned char Ghosts;
-	extern const unsigned char Functions;
-	extern const unsigned char CallDLL;
-	extern const unsigned char Reference;
-	extern const unsigned char StructureHints;
-	extern const unsigned char BeginBlock;
-	extern const unsigned char EndBlock;
-	extern const unsigned char Invoke;
-	extern const unsigned char PushOperation;
-	extern const unsigned char PushIntegerLiteral;
-	extern const unsigned char PushStringLiteral;
-	extern const unsigned char AssignValue;
-	extern const unsigned char GetValue;
-	extern const unsigned char BindFunctionReference;
-	extern const unsigned char SizeOf;
-	extern const unsigned char IsNotEqual;
-	extern const unsigned char If;
-	extern const unsigned char While;
-	extern const unsigned char BindReference;
-	extern const unsigned char WhileCondition;
-	extern const unsigned char Scope;
-	extern const unsigned char GhostRecord;
-	extern const unsigned char IsEqual;
-	extern const unsigned char ElseIfWrapper;
-	extern const unsigned char ElseIf;
-	extern const unsigned char ExitIfChain;
-	extern const unsigned char Members;
-	extern const unsigned char StaticStrings;
-	extern const unsigned char StringVars;
-	extern const unsigned char TupleStaticData;
-	extern const unsigned char IDCounter;
-	extern const unsigned char StructureStaticData;
-	extern const unsigned char TupleTypes;
-	extern const unsigned char TupleHints;
-	extern const unsigned char StructureTypes;
-	extern const unsigned char StructureTypeMap;
-	extern const unsigned char TupleTypeMap;
-	extern const unsigned char EndScope;
-	extern const unsigned char TypeCast;
-	extern const unsigned char DebugWrite;
-	extern const unsigned char PushRealLiteral;
-	extern const unsigned char DoWhile;
-	extern const unsigned char DivideReals;
-	extern const unsigned char AddReals;
-	extern const unsigned char SubReals;
-	extern const unsigned char IsLesser;
-	extern const unsigned char PushBooleanLiteral;
-	extern const unsigned char AddIntegers;
-	extern const unsigned char SubtractIntegers;
-	extern const unsigned char IsGreater;
-	extern const unsigned char DebugRead;
-	extern const unsigned char TypeCastToString;
-	extern const unsigned char ReadTuple;
-	extern const unsigned char WriteTuple;
-	extern const unsigned char ReadStructure;
-	extern const unsigned char WriteStructure;
-	extern const unsigned char GlobalBlock;
-	extern const unsigned char Init;
-	extern const unsigned char PushInteger16Literal;
-	extern const unsigned char DivideIntegers;
-	extern const unsigned char Concat;
-	extern const unsigned char IsGreaterEqual;
-	extern const unsigned char IsLesserEqual;
-	extern const unsigned char DivideInteger16s;
-	extern const unsigned char BitwiseOr;
-	extern const unsigned char BitwiseAnd;
-	extern const unsigned char BitwiseXor;
-	extern const unsigned char BitwiseNot;
-	extern const unsigned char LogicalOr;
-	extern const unsigned char LogicalAnd;
-	extern const unsigned char LogicalXor;
-	extern const unsigned char LogicalNot;
-	extern const unsigned char InvokeIndirect;
-	extern const unsigned char Break;
-	extern const unsigned char Return;
-	extern const unsigned char BooleanLiteral;
-	extern const unsigned char Futures;
-	extern const unsigned char ReadStructureIndirect;
-	extern const unsigned char BindStruct;
-	extern const unsigned char WriteStructureIndirect;
-	extern const unsigned char Constants;
-	extern const unsigned char FunctionSignatureList;
-	extern const unsigned char FunctionSignatureBegin;
-	extern const unsigned char FunctionSignatureEnd;
-	extern const unsigned char ForkTask;
-	extern const unsigned char ResponseMaps;
-	extern const unsigned char AcceptMessage;
-	extern const unsigned char MultiplyIntegers;
-	extern const unsigned char GetMessageSender;
-	extern const unsigned char GetTaskCaller;
-	extern const unsigned char SendTaskMessage;
-	extern const unsigned char AcceptMessageFromMap;
-	extern const unsigned char DebugCrashVM;
-	extern const unsigned char Future;
-	extern const unsigned char Map;
-	extern const unsigned char Reduce;
-	extern const unsigned char IntegerLiteral;
-	extern const unsigned char ThreadPool;
-	extern const unsigned char ForkThread;
-	extern const unsigned char Handoff;
-	extern const unsigned char ExtensionData;
-	extern const unsigned char ReadArray;
-	extern const unsigned char WriteArray;
-	extern const unsigned char ConsArrayIndirect;
-	extern const unsigned char ArrayLength;
-	extern const unsigned char ParallelFor;
-	extern const unsigned char HandoffControl;
-	extern const unsigned char ArrayHints;
-	extern const unsigned char ConsArray;
-	extern const unsigned char Length;
+	//
+	// Option flags stored in the header of each binary
+	//
+	namespace Flags
+	{
+		// The program requires a console window
+		const unsigned UsesConsole			= 0x01;
+
+		// Every integer after the flags themselves is stored as a
+		// little-endian base-128 varint instead of four fixed bytes
+		const unsigned CompactNumbers		= 0x02;
+
+		// Constant expressions were folded when the binary was built,
+		// so the loader does not need to look for them again
+		const unsigned Preoptimized			= 0x04;
+
+		// The program passed static validation when the binary was built,
+		// and the binary records the type of each value pushed on the stack
+		const unsigned Validated			= 0x08;
+	}
+
+	//
+	// Instruction values are compile-time constants, so that they can be
+	// used in switch statements and to index decoding tables directly
+	//
+	const unsigned char NullFlag					= 0x00;
+	const unsigned char ParentScope					= 0x01;
+	const unsigned char ThreadPool					= 0x02;
+	const unsigned char Variables					= 0x03;
+	const unsigned char Ghosts						= 0x04;
+	const unsigned char Functions					= 0x05;
+	const unsigned char CallDLL						= 0x06;
+	const unsigned char Reference					= 0x07;
+	const unsigned char StructureHints				= 0x08;
+	const unsigned char BeginBlock					= 0x09;
+	const unsigned char EndBlock					= 0x0a;
+	const unsigned char Invoke						= 0x0b;
+	const unsigned char PushOperation				= 0x0c;
+	const unsigned char PushIntegerLiteral			= 0x0d;
+	const unsigned char PushStringLiteral			= 0x0e;
+	const unsigned char AssignValue					= 0x0f;
+	const unsigned char GetValue					= 0x10;
+	const unsigned char BindFunctionReference		= 0x11;
+	const unsigned char SizeOf						= 0x12;
+	const unsigned char IsNotEqual					= 0x13;
+	const unsigned char If							= 0x14;
+	const unsigned char While						= 0x15;
+	const unsigned char BindReference				= 0x16;
+	const unsigned char WhileCondition				= 0x17;
+	const unsigned char NoOp						= 0x18;
+	const unsigned char Scope						= 0x19;
+	const unsigned char GhostRecord					= 0x1a;
+	const unsigned char IsEqual						= 0x1b;
+	const unsigned char ElseIfWrapper				= 0x1c;
+	const unsigned char ElseIf						= 0x1d;
+	const unsigned char ExitIfChain					= 0x1e;
+	const unsigned char Members						= 0x1f;
+	const unsigned char StaticStrings				= 0x20;
+	const unsigned char StringVars					= 0x21;
+	const unsigned char TupleStaticData				= 0x22;
+	const unsigned char IDCounter					= 0x23;
+	const unsigned char StructureStaticData			= 0x24;
+	const unsigned char TupleTypes					= 0x25;
+	const unsigned char TupleHints					= 0x26;
+	const unsigned char StructureTypes				= 0x27;
+	const unsigned char StructureTypeMap			= 0x28;
+	const unsigned char TupleTypeMap				= 0x29;
+	const unsigned char EndScope					= 0x2a;
+	const unsigned char TypeCast					= 0x2b;
+	const unsigned char DebugWrite					= 0x2c;
+	const unsigned char PushRealLiteral				= 0x2d;
+	const unsigned char DoWhile						= 0x2e;
+	const unsigned char DivideReals					= 0x2f;
+	const unsigned char AddReals					= 0x30;
+	const unsigned char SubReals					= 0x31;
+	const unsigned char IsLesser					= 0x32;
+	const unsigned char PushBooleanLiteral			= 0x33;
+	const unsigned char AddIntegers					= 0x34;
+	const unsigned char SubtractIntegers			= 0x35;
+	const unsigned char IsGreater					= 0x36;
+	const unsigned char DebugRead					= 0x37;
+	const unsigned char TypeCastToString			= 0x38;
+	const unsigned char ReadTuple					= 0x39;
+	const unsigned char WriteTuple					= 0x3a;
+	const unsigned char ReadStructure				= 0x3b;
+	const unsigned char WriteStructure				= 0x3c;
+	const unsigned char GlobalBlock					= 0x3d;
+	const unsigned char Init						= 0x3e;
+	const unsigned char PushInteger16Literal		= 0x3f;
+	const unsigned char DivideIntegers				= 0x40;
+	const unsigned char Concat						= 0x41;
+	const unsigned char IsGreaterEqual				= 0x42;
+	const unsigned char IsLesserEqual				= 0x43;
+	const unsigned char DivideInteger16s			= 0x44;
+	const unsigned char BitwiseOr					= 0x45;
+	const unsigned char BitwiseAnd					= 0x46;
+	const unsigned char BitwiseXor					= 0x47;
+	const unsigned char BitwiseNot					= 0x48;
+	const unsigned char LogicalOr					= 0x49;
+	const unsigned char LogicalAnd					= 0x4a;
+	const unsigned char LogicalXor					= 0x4b;
+	const unsigned char LogicalNot					= 0x4c;
+	const unsigned char InvokeIndirect				= 0x4d;
+	const unsigned char Break						= 0x4e;
+	const unsigned char Return						= 0x4f;
+	const unsigned char BooleanLiteral				= 0x50;
+	const unsigned char Futures						= 0x51;
+	const unsigned char ReadStructureIndirect		= 0x52;
+	const unsigned char BindStruct					= 0x53;
+	const unsigned char WriteStructureIndirect		= 0x54;
+	const unsigned char Constants					= 0x55;
+	const unsigned char FunctionSignatureList		= 0x56;
+	const unsigned char FunctionSignatureBegin		= 0x57;
+	const unsigned char FunctionSignatureEnd		= 0x58;
+	const unsigned char ForkTask					= 0x59;
+	const unsigned char ResponseMaps				= 0x5a;
+	const unsigned char AcceptMessage				= 0x5b;
+	const unsigned char MultiplyIntegers			= 0x5c;
+	const unsigned char GetMessageSender			= 0x5d;
+	const unsigned char GetTaskCaller				= 0x5e;
+	const unsigned char SendTaskMessage				= 0x5f;
+	const unsigned char AcceptMessageFromMap		= 0x60;
+	const unsigned char DebugCrashVM				= 0x61;
+	const unsigned char Future						= 0x62;
+	const unsigned char Map							= 0x63;
+	const unsigned char Reduce						= 0x64;
+	const unsigned char IntegerLiteral				= 0x65;
+	const unsigned char ForkThread					= 0x66;
+	const unsigned char Handoff						= 0x67;
+	const unsigned char ExtensionData				= 0x68;
+	const unsigned char ReadArray					= 0x69;
+	const unsigned char WriteArray					= 0x6a;
+	const unsigned char ConsArrayIndirect			= 0x6b;
+	const unsigned char ArrayLength					= 0x6c;
+	const unsigned char ParallelFor					= 0x6d;
+	const unsigned char HandoffControl				= 0x6e;
+	const unsigned char ArrayHints					= 0x6f;
+	const unsigned char ConsArray					= 0x70;
+	const unsigned char Length						= 0x71;
+	const unsigned char Channel						= 0x72;
+	const unsigned char ChannelSend					= 0x73;
+	const unsigned char ChannelReceive				= 0x74;
+	const unsigned char BroadcastTaskMessage		= 0x75;
+	const unsigned char SendTaskRequest				= 0x76;
+	const unsigned char ReplyToRequest				= 0x77;
+	const unsigned char PendingReply				= 0x78;
+	const unsigned char ConsHashMap					= 0x79;
+	const unsigned char HashMapInsert				= 0x7a;
+	const unsigned char HashMapLookup				= 0x7b;
+	const unsigned char HashMapContains				= 0x7c;
+	const unsigned char HashMapErase				= 0x7d;
+	const unsigned char HashMapKeys					= 0x7e;
+	const unsigned char HashMapSize					= 0x7f;
+	const unsigned char AppendArray					= 0x80;
+	const unsigned char ElementwiseArithmetic		= 0x81;
+	const unsigned char TypedPushOperation			= 0x82;
+	const unsigned char DelayedSendTaskMessage		= 0x83;
+	const unsigned char AcceptMessageWithTimeout	= 0x84;
+	const unsigned char ParallelInvoke				= 0x85;
+	const unsigned char CreateGenerator				= 0x86;
+	const unsigned char YieldValue					= 0x87;
+	const unsigned char GeneratorHasNext			= 0x88;
+	const unsigned char GeneratorNextValue			= 0x89;
+	const unsigned char MapGenerator				= 0x8a;
+	const unsigned char ReduceGenerator				= 0x8b;
+	const unsigned char SortArray					= 0x8c;
+	const unsigned char SearchArray					= 0x8d;
+	const unsigned char ArrayMinIndex				= 0x8e;
+	const unsigned char ArrayMaxIndex				= 0x8f;
+	const unsigned char ConsMappedArray				= 0x90;
+	const unsigned char MoveValue					= 0x91;
+	const unsigned char FindString					= 0x92;
+	const unsigned char StringStartsWith			= 0x93;
+	const unsigned char CompareStrings				= 0x94;
+	const unsigned char SplitString					= 0x95;
+	const unsigned char AtomicUpdate				= 0x96;
+	const unsigned char AtomicUpdateArray			= 0x97;
+	const unsigned char CancelFuture				= 0x98;
+	const unsigned char CancelPoolWork				= 0x99;
+	const unsigned char DependentFuture				= 0x9a;
 }
 
 
@@ -0,0 +1,270 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Compression of bytecode embedded in generated executables
+//
+// Compressed bytecode begins with a small header giving the sizes of the
+// original and compressed data, followed by a single block in the LZ4
+// format: a series of sequences, each consisting of a run of literal
+// bytes followed by a back-reference to earlier output. The format is
+// chosen for decompression speed rather than ratio, since it is paid
+// on every program startup; decoding needs no tables at all, and runs
+// in a single pass straight into the buffer the loader reads from.
+//
+// The compressor is a simple greedy matcher with a single-entry hash
+// table, which is fast and does reasonably well on bytecode; since it
+// only ever runs in EXEGen, its speed is of little concern anyway.
+//
+
+#include "pch.h"
+
+#include "Bytecode/Compression.h"
+#include "Bytecode/BytecodeExceptions.h"
+
+
+namespace
+{
+
+	const char CompressionCookie[] = "EpochLZ";
+
+	//
+	// Fixed header at the start of compressed bytecode
+	//
+	struct CompressedHeader
+	{
+		char Cookie[sizeof(CompressionCookie) - 1];
+		UInteger32 OriginalSize;
+		UInteger32 CompressedSize;
+	};
+
+	// Parameters of the LZ4 block format
+	const size_t MinimumMatch = 4;
+	const size_t MaximumOffset = 0xffff;
+	const size_t LastLiterals = 5;			// The final bytes of a block are always literals
+	const size_t MatchFindLimit = 12;		// The last match must start at least this far from the end
+	const unsigned RunMask = 15;
+
+	const unsigned HashBits = 16;
+
+
+	inline UInteger32 ReadUInteger32(const UByte* data)
+	{
+		UInteger32 ret;
+		memcpy(&ret, data, sizeof(ret));
+		return ret;
+	}
+
+	inline UInteger32 HashSequence(UInteger32 sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HashBits);
+	}
+
+
+	//
+	// Append the extra bytes for a run length which does not fit in its token nibble
+	//
+	void WriteRunLength(std::vector<Byte>& output, size_t length)
+	{
+		length -= RunMask;
+		while(length >= 255)
+		{
+			output.push_back(static_cast<Byte>(255));
+			length -= 255;
+		}
+		output.push_back(static_cast<Byte>(length));
+	}
+
+	//
+	// Append a sequence of literals, followed by a match unless this is the final sequence
+	//
+	void WriteSequence(std::vector<Byte>& output, const UByte* literals, size_t numliterals, size_t offset, size_t matchlength)
+	{
+		unsigned literalnibble = (numliterals < RunMask) ? static_cast<unsigned>(numliterals) : RunMask;
+		unsigned matchnibble = 0;
+		if(matchlength)
+			matchnibble = (matchlength - MinimumMatch < RunMask) ? static_cast<unsigned>(matchlength - MinimumMatch) : RunMask;
+
+		output.push_back(static_cast<Byte>((literalnibble << 4) | matchnibble));
+		if(literalnibble == RunMask)
+			WriteRunLength(output, numliterals);
+
+		output.insert(output.end(), literals, literals + numliterals);
+
+		if(!matchlength)
+			return;
+
+		output.push_back(static_cast<Byte>(offset & 0xff));
+		output.push_back(static_cast<Byte>(offset >> 8));
+		if(matchnibble == RunMask)
+			WriteRunLength(output, matchlength - MinimumMatch);
+	}
+
+	//
+	// Read the extra bytes of a run length, checking against the end of the input
+	//
+	size_t ReadRunLength(const UByte*& input, const UByte* inputend)
+	{
+		size_t length = 0;
+		UByte next;
+		do
+		{
+			if(input >= inputend)
+				throw InvalidBytecodeException("Compressed bytecode is truncated");
+
+			next = *input++;
+			length += next;
+		} while(next == 255);
+
+		return length;
+	}
+
+}
+
+
+//
+// Determine if the given buffer holds compressed bytecode
+//
+bool BytecodeCompression::IsCompressed(const void* buffer)
+{
+	return memcmp(buffer, CompressionCookie, sizeof(CompressionCookie) - 1) == 0;
+}
+
+//
+// Compress the given bytecode
+//
+// Returns false, leaving the output empty, if compression would not
+// make the data any smaller; the bytecode should be stored as-is.
+//
+bool BytecodeCompression::Compress(const void* data, size_t size, std::vector<Byte>& compressed)
+{
+	const UByte* input = reinterpret_cast<const UByte*>(data);
+
+	compressed.clear();
+	compressed.reserve(sizeof(CompressedHeader) + size + size / 255 + 16);
+	compressed.resize(sizeof(CompressedHeader));
+
+	size_t anchor = 0;
+	if(size > MatchFindLimit)
+	{
+		std::vector<size_t> hashtable(1 << HashBits, 0);
+		size_t matchlimit = size - LastLiterals;
+		size_t scanlimit = size - MatchFindLimit;
+
+		size_t position = 1;
+		while(position < scanlimit)
+		{
+			UInteger32 sequence = ReadUInteger32(input + position);
+			UInteger32 hash = HashSequence(sequence);
+			size_t candidate = hashtable[hash];
+			hashtable[hash] = position;
+
+			if(position - candidate > MaximumOffset || ReadUInteger32(input + candidate) != sequence)
+			{
+				++position;
+				continue;
+			}
+
+			size_t matchlength = MinimumMatch;
+			while(position + matchlength < matchlimit && input[candidate + matchlength] == input[position + matchlength])
+				++matchlength;
+
+			WriteSequence(compressed, input + anchor, position - anchor, position - candidate, matchlength);
+
+			position += matchlength;
+			anchor = position;
+		}
+	}
+
+	WriteSequence(compressed, input + anchor, size - anchor, 0, 0);
+
+	if(compressed.size() >= size)
+	{
+		compressed.clear();
+		return false;
+	}
+
+	CompressedHeader header;
+	memcpy(header.Cookie, CompressionCookie, sizeof(header.Cookie));
+	header.OriginalSize = static_cast<UInteger32>(size);
+	header.CompressedSize = static_cast<UInteger32>(compressed.size() - sizeof(CompressedHeader));
+	memcpy(&compressed[0], &header, sizeof(header));
+
+	return true;
+}
+
+//
+// Decompress bytecode produced by Compress
+//
+// The output is allocated once, at its final size, and filled in a
+// single pass. Every length and offset is checked, so that a damaged
+// executable is reported as such rather than overrunning memory.
+//
+void BytecodeCompression::Decompress(const void* buffer, std::vector<Byte>& decompressed)
+{
+	if(!IsCompressed(buffer))
+		throw InvalidBytecodeException("Buffer does not contain compressed bytecode");
+
+	CompressedHeader header;
+	memcpy(&header, buffer, sizeof(header));
+
+	decompressed.resize(header.OriginalSize);
+	if(!header.OriginalSize)
+		return;
+
+	const UByte* input = reinterpret_cast<const UByte*>(buffer) + sizeof(CompressedHeader);
+	const UByte* inputend = input + header.CompressedSize;
+
+	UByte* outputbegin = reinterpret_cast<UByte*>(&decompressed[0]);
+	UByte* output = outputbegin;
+	UByte* outputend = outputbegin + header.OriginalSize;
+
+	while(input < inputend)
+	{
+		unsigned token = *input++;
+
+		size_t numliterals = token >> 4;
+		if(numliterals == RunMask)
+			numliterals += ReadRunLength(input, inputend);
+
+		if(numliterals > static_cast<size_t>(inputend - input) || numliterals > static_cast<size_t>(outputend - output))
+			throw InvalidBytecodeException("Compressed bytecode is corrupted; literal run is out of bounds");
+
+		memcpy(output, input, numliterals);
+		input += numliterals;
+		output += numliterals;
+
+		// The final sequence carries literals only
+		if(input == inputend)
+			break;
+
+		if(inputend - input < 2)
+			throw InvalidBytecodeException("Compressed bytecode is truncated");
+
+		size_t offset = input[0] | (static_cast<size_t>(input[1]) << 8);
+		input += 2;
+
+		size_t matchlength = (token & RunMask) + MinimumMatch;
+		if((token & RunMask) == RunMask)
+			matchlength += ReadRunLength(input, inputend);
+
+		if(offset == 0 || offset > static_cast<size_t>(output - outputbegin) || matchlength > static_cast<size_t>(outputend - output))
+			throw InvalidBytecodeException("Compressed bytecode is corrupted; match is out of bounds");
+
+		// Matches may overlap the bytes they produce, repeating a short pattern
+		const UByte* match = output - offset;
+		if(offset >= matchlength)
+		{
+			memcpy(output, match, matchlength);
+			output += matchlength;
+		}
+		else
+		{
+			for(size_t i = 0; i < matchlength; ++i)
+				*output++ = *match++;
+		}
+	}
+
+	if(output != outputend)
+		throw InvalidBytecodeException("Compressed bytecode is corrupted; decompressed size does not match");
+}
@@ -0,0 +1,17 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Compression of bytecode embedded in generated executables
+//
+
+#pragma once
+
+
+namespace BytecodeCompression
+{
+	bool IsCompressed(const void* buffer);
+
+	bool Compress(const void* data, size_t size, std::vector<Byte>& compressed);
+	void Decompress(const void* buffer, std::vector<Byte>& decompressed);
+}
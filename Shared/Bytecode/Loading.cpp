@@ -33,7 +33,10 @@
 #include "Virtual Machine/Operations/Operators/Logical.h"
 #include "Virtual Machine/Operations/Variables/StringOps.h"
 #include "Virtual Machine/Operations/Containers/ContainerOps.h"
+#include "Virtual Machine/Operations/Containers/ArrayAlgorithms.h"
+#include "Virtual Machine/Operations/Containers/HashMapOps.h"
 #include "Virtual Machine/Operations/Concurrency/FutureOps.h"
+#include "Virtual Machine/Operations/Concurrency/Channels.h"
 #include "Virtual Machine/Operations/Containers/MapReduce.h"
 
 #include "Virtual Machine/Types Management/RuntimeCasts.h"
@@ -41,6 +44,9 @@
 
 #include "Virtual Machine/Operations/Concurrency/Tasks.h"
 #include "Virtual Machine/Operations/Concurrency/Messaging.h"
+#include "Virtual Machine/Operations/Concurrency/ParallelInvoke.h"
+#include "Virtual Machine/Operations/Concurrency/Generators.h"
+#include "Virtual Machine/Operations/Concurrency/Atomics.h"
 #include "Virtual Machine/Core Entities/Concurrency/ResponseMap.h"
 
 #include "Virtual Machine/SelfAware.inl"
@@ -50,6 +56,10 @@
 
 #include "Language Extensions/Handoff.h"
 
+#include "Optimizer/Optimizer.h"
+
+#include "Configuration/RuntimeOptions.h"
+
 #include "Utility/Strings.h"
 
 #include <iomanip>
@@ -68,7 +78,9 @@ FileLoader::FileLoader(const void* buffer, VM::Program& runningprogram)
 	: Buffer(reinterpret_cast<const UByte*>(buffer)),
 	  Offset(0),
 	  LoadingProgram(&runningprogram),
-	  IsPrepass(true)
+	  IsPrepass(true),
+	  CompactNumbers(false),
+	  DeferFunctionBodies(Config::DeferFunctionLoading)
 {
 	try
 	{
@@ -94,6 +106,40 @@ FileLoader::FileLoader(const void* buffer, VM::Program& runningprogram)
 	}
 }
 
+//
+// Decode the body of a function whose loading was deferred
+//
+// The body is located using the offsets recorded during the prepass, and
+// is decoded exactly as it would have been during the main pass. Since
+// the program-wide optimization pass has already run by the time this
+// happens, the new code block is optimized on its own before use.
+//
+// Nested functions within the body are themselves deferred again.
+//
+void FileLoader::LoadDeferredCodeBlock(VM::Function& function)
+{
+	Threads::CriticalSection::Auto mutex(DeferredLoadCriticalSection);
+
+	std::map<const VM::Function*, ptrdiff_t>::iterator iter = DeferredFunctionBodies.find(&function);
+	if(iter == DeferredFunctionBodies.end())
+		throw InvalidBytecodeException("Cannot load function body - function was not deferred by this loader");
+
+	Offset = iter->second;
+	DeferredFunctionBodies.erase(iter);
+
+	VM::ScopeDescription* localscope = LoadScope(false);
+	std::auto_ptr<VM::Block> codeblock(LoadCodeBlock());
+	codeblock->BindToScope(UnregisterScopeToDelete(localscope));
+
+	VM::Block* block = codeblock.release();
+	function.SetCodeBlock(block);
+
+	Optimizer::OptimizationTraverser optimizer;
+	optimizer.SetProgram(*LoadingProgram);
+	block->Traverse(optimizer);
+	optimizer.ExitFunction(function);
+}
+
 //
 // Destruct and clean up the loader
 //
@@ -129,9 +175,18 @@ void FileLoader::CheckCookie()
 //
 void FileLoader::CheckFlags()
 {
+	// The flags themselves are always stored in the fixed width form
+	CompactNumbers = false;
+
 	Integer32 flags = ReadNumber();
-	if(flags)
+	if(flags & Bytecode::Flags::UsesConsole)
 		LoadingProgram->SetUsesConsole();
+	if(flags & Bytecode::Flags::Preoptimized)
+		LoadingProgram->SetPreoptimized();
+	if(flags & Bytecode::Flags::Validated)
+		LoadingProgram->SetValidated();
+
+	CompactNumbers = ((flags & Bytecode::Flags::CompactNumbers) != 0);
 }
 
 //
@@ -148,8 +203,29 @@ void FileLoader::ExpectInstruction(unsigned char instruction)
 //
 // Read a 32-bit number from the buffer
 //
+// In compact binaries, each byte of a number holds seven bits of the
+// value, least significant first; the high bit is set on every byte
+// except the last. Small IDs and counts therefore take a single byte.
+//
 Integer32 FileLoader::ReadNumber()
 {
+	if(CompactNumbers)
+	{
+		UInteger32 value = 0;
+		for(unsigned shift = 0; ; shift += 7)
+		{
+			if(shift > 28)
+				throw InvalidBytecodeException("Compact number in binary is longer than 32 bits; ensure the binary is not corrupted");
+
+			UByte byte = Buffer[Offset++];
+			value |= static_cast<UInteger32>(byte & 0x7f) << shift;
+			if(!(byte & 0x80))
+				break;
+		}
+
+		return static_cast<Integer32>(value);
+	}
+
 	const UByte* p = Buffer + Offset;
 	Integer32 value = *reinterpret_cast<const Integer32*>(p);
 	Offset += sizeof(Integer32);
@@ -183,35 +259,60 @@ bool FileLoader::ReadFlag()
 //
 std::string FileLoader::ReadNullTerminatedString()
 {
-	std::string ret;
-	const UByte* p = Buffer + Offset;
-	const Byte* pchar = reinterpret_cast<const Byte*>(p);
-	while(*pchar)
+	const Byte* pchar = reinterpret_cast<const Byte*>(Buffer + Offset);
+	size_t len = strlen(pchar);
+	Offset += len + 1;
+	return std::string(pchar, len);
+}
+
+//
+// Read a string of a known length
+//
+std::string FileLoader::ReadStringByLength(Integer32 len)
+{
+	const Byte* pchar = reinterpret_cast<const Byte*>(Buffer + Offset);
+	Offset += len;
+	return std::string(pchar, len);
+}
+
+//
+// Read a null-terminated string, and widen it into the program's static string pool
+//
+// The loader visits the whole buffer twice (once for the prepass), and
+// widening is by far the most expensive part of reading a string. Each
+// pooled string is therefore remembered by its position in the buffer,
+// so that the second pass can simply step over the raw characters.
+//
+const std::wstring& FileLoader::ReadPooledString()
+{
+	ptrdiff_t location = Offset;
+	std::map<ptrdiff_t, const std::wstring*>::const_iterator iter = PooledStringLocations.find(location);
+	if(iter != PooledStringLocations.end())
 	{
-		ret.push_back(*pchar);
-		++pchar;
-		++Offset;
+		Offset += strlen(reinterpret_cast<const Byte*>(Buffer + Offset)) + 1;
+		return *iter->second;
 	}
 
-	++Offset;
+	const std::wstring& ret = WidenAndCache(ReadNullTerminatedString());
+	PooledStringLocations[location] = &ret;
 	return ret;
 }
 
 //
-// Read a string of a known length
+// Read a string of a known length, and widen it into the program's static string pool
 //
-std::string FileLoader::ReadStringByLength(Integer32 len)
+const std::wstring& FileLoader::ReadPooledString(Integer32 len)
 {
-	std::string ret;
-	const UByte* p = Buffer + Offset;
-	const Byte* pchar = reinterpret_cast<const Byte*>(p);
-	for(Integer32 i = 0; i < len; ++i)
+	ptrdiff_t location = Offset;
+	std::map<ptrdiff_t, const std::wstring*>::const_iterator iter = PooledStringLocations.find(location);
+	if(iter != PooledStringLocations.end())
 	{
-		ret.push_back(*pchar);
-		++pchar;
-		++Offset;
+		Offset += len;
+		return *iter->second;
 	}
 
+	const std::wstring& ret = WidenAndCache(ReadStringByLength(len));
+	PooledStringLocations[location] = &ret;
 	return ret;
 }
 
@@ -260,29 +361,29 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	for(Integer32 i = 0; i < numvars; ++i)
 	{
 		bool isreference = ReadFlag();
-		std::string varname = ReadNullTerminatedString();
+		const std::wstring& varname = ReadPooledString();
 		Integer32 vartype = ReadNumber();
 
 		if(!IsPrepass)
 		{
 			if(isreference)
-				ScopeIDMap[scopeid]->AddReference(static_cast<VM::EpochVariableTypeID>(vartype), WidenAndCache(varname));
+				ScopeIDMap[scopeid]->AddReference(static_cast<VM::EpochVariableTypeID>(vartype), varname);
 			else
 			{
 				if(vartype == VM::EpochVariableType_Tuple)
 				{
-					ScopeIDMap[scopeid]->Variables.insert(VM::ScopeDescription::VariableMapEntry(WidenAndCache(varname), VM::TupleVariable(NULL)));
-					ScopeIDMap[scopeid]->MemberOrder.push_back(WidenAndCache(varname));
+					ScopeIDMap[scopeid]->Variables.insert(VM::ScopeDescription::VariableMapEntry(varname, VM::TupleVariable(NULL)));
+					ScopeIDMap[scopeid]->MemberOrder.push_back(varname);
 				}
 				else if(vartype == VM::EpochVariableType_Structure)
 				{
-					ScopeIDMap[scopeid]->Variables.insert(VM::ScopeDescription::VariableMapEntry(WidenAndCache(varname), VM::StructureVariable(NULL)));
-					ScopeIDMap[scopeid]->MemberOrder.push_back(WidenAndCache(varname));
+					ScopeIDMap[scopeid]->Variables.insert(VM::ScopeDescription::VariableMapEntry(varname, VM::StructureVariable(NULL)));
+					ScopeIDMap[scopeid]->MemberOrder.push_back(varname);
 				}
 				else if(vartype == VM::EpochVariableType_Function)
-					ScopeIDMap[scopeid]->MemberOrder.push_back(WidenAndCache(varname));
+					ScopeIDMap[scopeid]->MemberOrder.push_back(varname);
 				else
-					ScopeIDMap[scopeid]->AddVariable(WidenAndCache(varname), static_cast<VM::EpochVariableTypeID>(vartype));
+					ScopeIDMap[scopeid]->AddVariable(varname, static_cast<VM::EpochVariableTypeID>(vartype));
 			}
 		}
 	}
@@ -299,11 +400,11 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 		Integer32 numrecs = ReadNumber();
 		for(Integer32 j = 0; j < numrecs; ++j)
 		{
-			std::string varname = ReadNullTerminatedString();
+			const std::wstring& varname = ReadPooledString();
 			ScopeID ownerid = ReadNumber();
 
 			if(!IsPrepass)
-				ScopeIDMap[scopeid]->Ghosts.back().insert(VM::ScopeDescription::GhostVariableMapEntry(WidenAndCache(varname), ScopeIDMap.find(ownerid)->second));
+				ScopeIDMap[scopeid]->Ghosts.back().insert(VM::ScopeDescription::GhostVariableMapEntry(varname, ScopeIDMap.find(ownerid)->second));
 		}
 	}
 
@@ -311,7 +412,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	Integer32 numfuncs = ReadNumber();
 	for(Integer32 i = 0; i < numfuncs; ++i)
 	{
-		std::string funcname = ReadNullTerminatedString();
+		const std::wstring& funcname = ReadPooledString();
 		Integer32 funcid = ReadNumber();
 		ReadNumber();
 
@@ -319,8 +420,8 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 		if(nextop == Bytecode::CallDLL)
 		{
 			ReadInstruction();
-			std::string dllname = ReadNullTerminatedString();
-			std::string dllfuncname = ReadNullTerminatedString();
+			const std::wstring& dllname = ReadPooledString();
+			const std::wstring& dllfuncname = ReadPooledString();
 			Integer32 returntype = ReadNumber();
 			Integer32 returntypehint = ReadNumber();
 
@@ -328,9 +429,9 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 			if(IsPrepass)
 			{
 				UnregisterScopeToDelete(params);
-				std::auto_ptr<VM::FunctionBase> callop(new Marshalling::CallDLL(WidenAndCache(dllname), WidenAndCache(dllfuncname), params, static_cast<VM::EpochVariableTypeID>(returntype), static_cast<VM::EpochVariableTypeID>(returntypehint)));
+				std::auto_ptr<VM::FunctionBase> callop(new Marshalling::CallDLL(dllname, dllfuncname, params, static_cast<VM::EpochVariableTypeID>(returntype), static_cast<VM::EpochVariableTypeID>(returntypehint)));
 				FunctionIDMap[funcid] = callop.get();
-				ScopeIDMap[scopeid]->AddFunction(WidenAndCache(funcname), callop);
+				ScopeIDMap[scopeid]->AddFunction(funcname, callop);
 			}
 		}
 		else
@@ -338,15 +439,33 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 			VM::ScopeDescription* params = LoadScope(false);
 			VM::ScopeDescription* returns = LoadScope(false);
 			ExpectInstruction(Bytecode::BeginBlock);
+
+			// Skip over the body using the location recorded by the prepass
+			if(!IsPrepass && DeferFunctionBodies)
+			{
+				const FunctionBodyLocation& location = FunctionBodies[funcid];
+				VM::Function* func = dynamic_cast<VM::Function*>(FunctionIDMap[funcid]);
+				DeferredFunctionBodies[func] = location.Begin;
+				func->SetDeferredCodeSource(this);
+				Offset = location.End;
+				continue;
+			}
+
+			ptrdiff_t bodybegin = Offset;
 			VM::ScopeDescription* localscope = LoadScope(false);
 			VM::Block* codeblock = LoadCodeBlock();
 			if(IsPrepass)
 			{
 				std::auto_ptr<VM::FunctionBase> func(new VM::Function(*LoadingProgram, NULL, params, returns));
 				FunctionIDMap[funcid] = func.get();
-				ScopeIDMap[scopeid]->AddFunction(WidenAndCache(funcname), func);
+				ScopeIDMap[scopeid]->AddFunction(funcname, func);
 				UnregisterScopeToDelete(params);
 				UnregisterScopeToDelete(returns);
+
+				FunctionBodyLocation location;
+				location.Begin = bodybegin;
+				location.End = Offset;
+				FunctionBodies[funcid] = location;
 			}
 			else
 			{
@@ -360,33 +479,33 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	Integer32 numfuncsignatures = ReadNumber();
 	for(Integer32 i = 0; i < numfuncsignatures; ++i)
 	{
-		std::string signaturename = ReadNullTerminatedString();
+		const std::wstring& signaturename = ReadPooledString();
 		ExpectInstruction(Bytecode::FunctionSignatureBegin);
 		VM::FunctionSignature signature = LoadFunctionSignature();
 		if(!IsPrepass)
-			ScopeIDMap[scopeid]->AddFunctionSignature(WidenAndCache(signaturename), signature, false);
+			ScopeIDMap[scopeid]->AddFunctionSignature(signaturename, signature, false);
 	}
 
 	ExpectInstruction(Bytecode::TupleTypes);
 	Integer32 numtupletypes = ReadNumber();
 	for(Integer32 i = 0; i < numtupletypes; ++i)
 	{
-		std::string varname = ReadNullTerminatedString();
+		const std::wstring& varname = ReadPooledString();
 		TupleTypeID id = ReadNumber();
 
 		if(!IsPrepass)
-			ScopeIDMap[scopeid]->TupleTypes.insert(VM::ScopeDescription::TupleTypeIDMapEntry(WidenAndCache(varname), id));
+			ScopeIDMap[scopeid]->TupleTypes.insert(VM::ScopeDescription::TupleTypeIDMapEntry(varname, id));
 	}
 
 	ExpectInstruction(Bytecode::TupleHints);
 	Integer32 numtuplehints = ReadNumber();
 	for(Integer32 i = 0; i < numtuplehints; ++i)
 	{
-		std::string varname = ReadNullTerminatedString();
+		const std::wstring& varname = ReadPooledString();
 		TupleTypeID hint = ReadNumber();
 		
 		if(!IsPrepass)
-			ScopeIDMap[scopeid]->TupleTypeHints.insert(VM::ScopeDescription::TupleTypeIDMapEntry(WidenAndCache(varname), hint));
+			ScopeIDMap[scopeid]->TupleTypeHints.insert(VM::ScopeDescription::TupleTypeIDMapEntry(varname, hint));
 	}
 
 	ExpectInstruction(Bytecode::TupleTypeMap);
@@ -403,12 +522,12 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 		Integer32 nummembers = ReadNumber();
 		for(Integer32 j = 0; j < nummembers; ++j)
 		{
-			std::string membername = ReadNullTerminatedString();
+			const std::wstring& membername = ReadPooledString();
 			Integer32 type = ReadNumber();
 			Integer32 offset = ReadNumber();
 
 			if(!IsPrepass)
-				tupletype->AddMember(WidenAndCache(membername), static_cast<VM::EpochVariableTypeID>(type));
+				tupletype->AddMember(membername, static_cast<VM::EpochVariableTypeID>(type));
 		}
 
 		if(!IsPrepass)
@@ -423,22 +542,22 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	Integer32 numstructtypes = ReadNumber();
 	for(Integer32 i = 0; i < numstructtypes; ++i)
 	{
-		std::string varname = ReadNullTerminatedString();
+		const std::wstring& varname = ReadPooledString();
 		StructureTypeID id = ReadNumber();
 
 		if(!IsPrepass)
-			ScopeIDMap[scopeid]->StructureTypes.insert(VM::ScopeDescription::StructureTypeIDMapEntry(WidenAndCache(varname), id));
+			ScopeIDMap[scopeid]->StructureTypes.insert(VM::ScopeDescription::StructureTypeIDMapEntry(varname, id));
 	}
 
 	ExpectInstruction(Bytecode::StructureHints);
 	Integer32 numstructhints = ReadNumber();
 	for(Integer32 i = 0; i < numstructhints; ++i)
 	{
-		std::string varname = ReadNullTerminatedString();
+		const std::wstring& varname = ReadPooledString();
 		StructureTypeID hint = ReadNumber();
 
 		if(!IsPrepass)
-			ScopeIDMap[scopeid]->StructureTypeHints.insert(VM::ScopeDescription::StructureTypeIDMapEntry(WidenAndCache(varname), hint));
+			ScopeIDMap[scopeid]->StructureTypeHints.insert(VM::ScopeDescription::StructureTypeIDMapEntry(varname, hint));
 	}
 
 	ExpectInstruction(Bytecode::StructureTypeMap);
@@ -455,7 +574,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 		Integer32 nummembers = ReadNumber();
 		for(Integer32 j = 0; j < nummembers; ++j)
 		{
-			std::string membername = ReadNullTerminatedString();
+			const std::wstring& membername = ReadPooledString();
 			Integer32 type = ReadNumber();
 			Integer32 offset = ReadNumber();
 			StructureTypeID hint = 0;
@@ -466,11 +585,11 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 			if(!IsPrepass)
 			{
 				if(type == VM::EpochVariableType_Structure)
-					structtype->AddMember(WidenAndCache(membername), VM::StructureTrackerClass::GetOwnerOfStructureType(hint)->GetStructureType(hint), hint);
+					structtype->AddMember(membername, VM::StructureTrackerClass::GetOwnerOfStructureType(hint)->GetStructureType(hint), hint);
 				else if(type == VM::EpochVariableType_Tuple)
-					structtype->AddMember(WidenAndCache(membername), VM::TupleTrackerClass::GetOwnerOfTupleType(hint)->GetTupleType(hint), hint);
+					structtype->AddMember(membername, VM::TupleTrackerClass::GetOwnerOfTupleType(hint)->GetTupleType(hint), hint);
 				else
-					structtype->AddMember(WidenAndCache(membername), static_cast<VM::EpochVariableTypeID>(type));
+					structtype->AddMember(membername, static_cast<VM::EpochVariableTypeID>(type));
 			}
 		}
 
@@ -486,7 +605,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 
 	UINT_PTR numconstants = ReadNumber();
 	for(UINT_PTR i = 0; i < numconstants; ++i)
-		ScopeIDMap[scopeid]->SetConstant(WidenAndCache(ReadNullTerminatedString()));
+		ScopeIDMap[scopeid]->SetConstant(ReadPooledString());
 
 
 	ExpectInstruction(Bytecode::ResponseMaps);
@@ -494,12 +613,12 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	UINT_PTR numresponsemaps = ReadNumber();
 	for(UINT_PTR i = 0; i < numresponsemaps; ++i)
 	{
-		std::wstring mapname = WidenAndCache(ReadNullTerminatedString());
+		std::wstring mapname = ReadPooledString();
 		UINT_PTR nummapentries = ReadNumber();
 		std::auto_ptr<VM::ResponseMap> themap(new VM::ResponseMap);
 		for(UINT_PTR j = 0; j < nummapentries; ++j)
 		{
-			std::string messagename = ReadNullTerminatedString();
+			const std::wstring& messagename = ReadPooledString();
 			UINT_PTR nummessageparams = ReadNumber();
 			std::list<VM::EpochVariableTypeID> paramtypes;
 			for(UINT_PTR k = 0; k < nummessageparams; ++k)
@@ -516,7 +635,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 			if(!IsPrepass)
 			{
 				responseblock->BindToScope(UnregisterScopeToDelete(responsescope));
-				std::auto_ptr<VM::ResponseMapEntry> mapentry(new VM::ResponseMapEntry(WidenAndCache(messagename), paramtypes, responseblock.release(), UnregisterScopeToDelete(auxscope)));
+				std::auto_ptr<VM::ResponseMapEntry> mapentry(new VM::ResponseMapEntry(messagename, paramtypes, responseblock.release(), UnregisterScopeToDelete(auxscope)));
 				themap->AddEntry(mapentry.release());
 			}
 		}
@@ -530,7 +649,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	UINT_PTR numfutures = ReadNumber();
 	for(UINT_PTR i = 0; i < numfutures; ++i)
 	{
-		const std::wstring& futurename = WidenAndCache(ReadNullTerminatedString());
+		const std::wstring& futurename = ReadPooledString();
 		ReadNumber();
 
 		std::auto_ptr<VM::Block> tempblock(new VM::Block);
@@ -544,7 +663,7 @@ VM::ScopeDescription* FileLoader::LoadScope(bool linktoglobal)
 	UINT_PTR numarrayhints = ReadNumber();
 	for(UINT_PTR i = 0; i < numarrayhints; ++i)
 	{
-		const std::wstring& arrayname = WidenAndCache(ReadNullTerminatedString());
+		const std::wstring& arrayname = ReadPooledString();
 		UINT_PTR hint = ReadNumber();
 
 		if(!IsPrepass)
@@ -647,813 +766,1411 @@ VM::Block* FileLoader::LoadCodeBlock()
 //
 // Turn the bytecode into a VM op
 //
+// Each instruction is handled by its own decoder function; the decoder
+// is found by indexing a table with the instruction byte, so the cost of
+// decoding does not depend on which instruction is being loaded.
+//
 void FileLoader::GenerateOpFromByteCode(unsigned char instruction, VM::Block* newblock)
 {
-	// TODO - consider factoring this up into a series of private member functions
-
-	if(instruction == Bytecode::PushOperation)
-	{
-		unsigned char op = ReadInstruction();
-		GenerateOpFromByteCode(op, newblock);
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushOperation(newblock->PopTailOperation().release(), *newblock->GetBoundScope())));
-	}
-	else if(instruction == Bytecode::Invoke)
-	{
-		FunctionID funcid = ReadNumber();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::Invoke(FunctionIDMap.find(funcid)->second, false)));
-	}
-	else if(instruction == Bytecode::DebugWrite)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::DebugWriteStringExpression));
-	}
-	else if(instruction == Bytecode::PushRealLiteral)
-	{
-		Real value = ReadFloat();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushRealLiteral(value)));
-	}
-	else if(instruction == Bytecode::DivideReals)
-	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
-		if(!IsPrepass)
-		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::DivideReals));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::DivideReals(firstisarray, secondisarray)));
-		}
-	}
-	else if(instruction == Bytecode::PushIntegerLiteral)
-	{
-		Integer32 value = ReadNumber();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushIntegerLiteral(value)));
-	}
-	else if(instruction == Bytecode::IsEqual)
-	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsEqual(type)));
-	}
-	else if(instruction == Bytecode::IsNotEqual)
-	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsNotEqual(type)));
-	}
-	else if(instruction == Bytecode::IsLesser)
+	InstructionDecoder decoder = DecoderTable.Decoders[instruction];
+	if(!decoder)
 	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsLesser(type)));
+		std::ostringstream stream;
+		stream << "Read an opcode from the binary, but it doesn't match any known opcode. Aborting program execution!\n";
+		stream << "Opcode value: 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(instruction) << " Offset: 0x" << std::setw(8) << (Offset - 1);
+		throw InvalidBytecodeException(stream.str());
 	}
-	else if(instruction == Bytecode::IsGreater)
+
+	(this->*decoder)(newblock);
+}
+
+
+//
+// Set up the table of instruction decoders
+//
+// Instructions which may not appear within a code block have no decoder,
+// and are reported as invalid if encountered.
+//
+FileLoader::InstructionDecoderTable::InstructionDecoderTable()
+{
+	for(unsigned i = 0; i < NumInstructionValues; ++i)
+		Decoders[i] = NULL;
+
+	Decoders[Bytecode::PushOperation] = &FileLoader::DecodePushOperation;
+	Decoders[Bytecode::Invoke] = &FileLoader::DecodeInvoke;
+	Decoders[Bytecode::DebugWrite] = &FileLoader::DecodeDebugWrite;
+	Decoders[Bytecode::PushRealLiteral] = &FileLoader::DecodePushRealLiteral;
+	Decoders[Bytecode::DivideReals] = &FileLoader::DecodeDivideReals;
+	Decoders[Bytecode::PushIntegerLiteral] = &FileLoader::DecodePushIntegerLiteral;
+	Decoders[Bytecode::IsEqual] = &FileLoader::DecodeIsEqual;
+	Decoders[Bytecode::IsNotEqual] = &FileLoader::DecodeIsNotEqual;
+	Decoders[Bytecode::IsLesser] = &FileLoader::DecodeIsLesser;
+	Decoders[Bytecode::IsGreater] = &FileLoader::DecodeIsGreater;
+	Decoders[Bytecode::AssignValue] = &FileLoader::DecodeAssignValue;
+	Decoders[Bytecode::DoWhile] = &FileLoader::DecodeDoWhile;
+	Decoders[Bytecode::GetValue] = &FileLoader::DecodeGetValue;
+	Decoders[Bytecode::If] = &FileLoader::DecodeIf;
+	Decoders[Bytecode::AddReals] = &FileLoader::DecodeAddReals;
+	Decoders[Bytecode::SubReals] = &FileLoader::DecodeSubReals;
+	Decoders[Bytecode::PushBooleanLiteral] = &FileLoader::DecodePushBooleanLiteral;
+	Decoders[Bytecode::PushStringLiteral] = &FileLoader::DecodePushStringLiteral;
+	Decoders[Bytecode::AddIntegers] = &FileLoader::DecodeAddIntegers;
+	Decoders[Bytecode::SubtractIntegers] = &FileLoader::DecodeSubtractIntegers;
+	Decoders[Bytecode::DebugRead] = &FileLoader::DecodeDebugRead;
+	Decoders[Bytecode::ElseIf] = &FileLoader::DecodeElseIf;
+	Decoders[Bytecode::ExitIfChain] = &FileLoader::DecodeExitIfChain;
+	Decoders[Bytecode::ReadTuple] = &FileLoader::DecodeReadTuple;
+	Decoders[Bytecode::WriteTuple] = &FileLoader::DecodeWriteTuple;
+	Decoders[Bytecode::ReadStructure] = &FileLoader::DecodeReadStructure;
+	Decoders[Bytecode::WriteStructure] = &FileLoader::DecodeWriteStructure;
+	Decoders[Bytecode::Init] = &FileLoader::DecodeInit;
+	Decoders[Bytecode::BindFunctionReference] = &FileLoader::DecodeBindFunctionReference;
+	Decoders[Bytecode::SizeOf] = &FileLoader::DecodeSizeOf;
+	Decoders[Bytecode::While] = &FileLoader::DecodeWhile;
+	Decoders[Bytecode::BindReference] = &FileLoader::DecodeBindReference;
+	Decoders[Bytecode::WhileCondition] = &FileLoader::DecodeWhileCondition;
+	Decoders[Bytecode::Break] = &FileLoader::DecodeBreak;
+	Decoders[Bytecode::Return] = &FileLoader::DecodeReturn;
+	Decoders[Bytecode::BitwiseAnd] = &FileLoader::DecodeBitwiseAnd;
+	Decoders[Bytecode::BitwiseOr] = &FileLoader::DecodeBitwiseOr;
+	Decoders[Bytecode::BitwiseXor] = &FileLoader::DecodeBitwiseXor;
+	Decoders[Bytecode::BitwiseNot] = &FileLoader::DecodeBitwiseNot;
+	Decoders[Bytecode::LogicalAnd] = &FileLoader::DecodeLogicalAnd;
+	Decoders[Bytecode::LogicalOr] = &FileLoader::DecodeLogicalOr;
+	Decoders[Bytecode::LogicalXor] = &FileLoader::DecodeLogicalXor;
+	Decoders[Bytecode::LogicalNot] = &FileLoader::DecodeLogicalNot;
+	Decoders[Bytecode::Concat] = &FileLoader::DecodeConcat;
+	Decoders[Bytecode::IsGreaterEqual] = &FileLoader::DecodeIsGreaterEqual;
+	Decoders[Bytecode::PushInteger16Literal] = &FileLoader::DecodePushInteger16Literal;
+	Decoders[Bytecode::InvokeIndirect] = &FileLoader::DecodeInvokeIndirect;
+	Decoders[Bytecode::BooleanLiteral] = &FileLoader::DecodeBooleanLiteral;
+	Decoders[Bytecode::BeginBlock] = &FileLoader::DecodeBeginBlock;
+	Decoders[Bytecode::ReadStructureIndirect] = &FileLoader::DecodeReadStructureIndirect;
+	Decoders[Bytecode::BindStruct] = &FileLoader::DecodeBindStruct;
+	Decoders[Bytecode::WriteStructureIndirect] = &FileLoader::DecodeWriteStructureIndirect;
+	Decoders[Bytecode::ForkTask] = &FileLoader::DecodeForkTask;
+	Decoders[Bytecode::AcceptMessage] = &FileLoader::DecodeAcceptMessage;
+	Decoders[Bytecode::MultiplyIntegers] = &FileLoader::DecodeMultiplyIntegers;
+	Decoders[Bytecode::GetMessageSender] = &FileLoader::DecodeGetMessageSender;
+	Decoders[Bytecode::GetTaskCaller] = &FileLoader::DecodeGetTaskCaller;
+	Decoders[Bytecode::SendTaskMessage] = &FileLoader::DecodeSendTaskMessage;
+	Decoders[Bytecode::BroadcastTaskMessage] = &FileLoader::DecodeBroadcastTaskMessage;
+	Decoders[Bytecode::SendTaskRequest] = &FileLoader::DecodeSendTaskRequest;
+	Decoders[Bytecode::ReplyToRequest] = &FileLoader::DecodeReplyToRequest;
+	Decoders[Bytecode::PendingReply] = &FileLoader::DecodePendingReply;
+	Decoders[Bytecode::AcceptMessageFromMap] = &FileLoader::DecodeAcceptMessageFromMap;
+	Decoders[Bytecode::TypeCastToString] = &FileLoader::DecodeTypeCastToString;
+	Decoders[Bytecode::DivideIntegers] = &FileLoader::DecodeDivideIntegers;
+	Decoders[Bytecode::TypeCast] = &FileLoader::DecodeTypeCast;
+	Decoders[Bytecode::Future] = &FileLoader::DecodeFuture;
+	Decoders[Bytecode::Map] = &FileLoader::DecodeMap;
+	Decoders[Bytecode::Reduce] = &FileLoader::DecodeReduce;
+	Decoders[Bytecode::IsLesserEqual] = &FileLoader::DecodeIsLesserEqual;
+	Decoders[Bytecode::IntegerLiteral] = &FileLoader::DecodeIntegerLiteral;
+	Decoders[Bytecode::ThreadPool] = &FileLoader::DecodeThreadPool;
+	Decoders[Bytecode::ForkThread] = &FileLoader::DecodeForkThread;
+	Decoders[Bytecode::Handoff] = &FileLoader::DecodeHandoff;
+	Decoders[Bytecode::HandoffControl] = &FileLoader::DecodeHandoffControl;
+	Decoders[Bytecode::ParallelFor] = &FileLoader::DecodeParallelFor;
+	Decoders[Bytecode::ReadArray] = &FileLoader::DecodeReadArray;
+	Decoders[Bytecode::WriteArray] = &FileLoader::DecodeWriteArray;
+	Decoders[Bytecode::AppendArray] = &FileLoader::DecodeAppendArray;
+	Decoders[Bytecode::ArrayLength] = &FileLoader::DecodeArrayLength;
+	Decoders[Bytecode::SortArray] = &FileLoader::DecodeSortArray;
+	Decoders[Bytecode::SearchArray] = &FileLoader::DecodeSearchArray;
+	Decoders[Bytecode::ArrayMinIndex] = &FileLoader::DecodeArrayMinIndex;
+	Decoders[Bytecode::ArrayMaxIndex] = &FileLoader::DecodeArrayMaxIndex;
+	Decoders[Bytecode::ConsArrayIndirect] = &FileLoader::DecodeConsArrayIndirect;
+	Decoders[Bytecode::ConsMappedArray] = &FileLoader::DecodeConsMappedArray;
+	Decoders[Bytecode::MoveValue] = &FileLoader::DecodeMoveValue;
+	Decoders[Bytecode::FindString] = &FileLoader::DecodeFindString;
+	Decoders[Bytecode::StringStartsWith] = &FileLoader::DecodeStringStartsWith;
+	Decoders[Bytecode::CompareStrings] = &FileLoader::DecodeCompareStrings;
+	Decoders[Bytecode::SplitString] = &FileLoader::DecodeSplitString;
+	Decoders[Bytecode::Channel] = &FileLoader::DecodeChannel;
+	Decoders[Bytecode::ChannelSend] = &FileLoader::DecodeChannelSend;
+	Decoders[Bytecode::ChannelReceive] = &FileLoader::DecodeChannelReceive;
+	Decoders[Bytecode::ConsHashMap] = &FileLoader::DecodeConsHashMap;
+	Decoders[Bytecode::HashMapInsert] = &FileLoader::DecodeHashMapInsert;
+	Decoders[Bytecode::HashMapLookup] = &FileLoader::DecodeHashMapLookup;
+	Decoders[Bytecode::HashMapContains] = &FileLoader::DecodeHashMapContains;
+	Decoders[Bytecode::HashMapErase] = &FileLoader::DecodeHashMapErase;
+	Decoders[Bytecode::HashMapKeys] = &FileLoader::DecodeHashMapKeys;
+	Decoders[Bytecode::HashMapSize] = &FileLoader::DecodeHashMapSize;
+	Decoders[Bytecode::ElementwiseArithmetic] = &FileLoader::DecodeElementwiseArithmetic;
+	Decoders[Bytecode::TypedPushOperation] = &FileLoader::DecodeTypedPushOperation;
+	Decoders[Bytecode::DelayedSendTaskMessage] = &FileLoader::DecodeDelayedSendTaskMessage;
+	Decoders[Bytecode::AcceptMessageWithTimeout] = &FileLoader::DecodeAcceptMessageWithTimeout;
+	Decoders[Bytecode::ParallelInvoke] = &FileLoader::DecodeParallelInvoke;
+	Decoders[Bytecode::CreateGenerator] = &FileLoader::DecodeCreateGenerator;
+	Decoders[Bytecode::YieldValue] = &FileLoader::DecodeYieldValue;
+	Decoders[Bytecode::GeneratorHasNext] = &FileLoader::DecodeGeneratorHasNext;
+	Decoders[Bytecode::GeneratorNextValue] = &FileLoader::DecodeGeneratorNextValue;
+	Decoders[Bytecode::MapGenerator] = &FileLoader::DecodeMapGenerator;
+	Decoders[Bytecode::ReduceGenerator] = &FileLoader::DecodeReduceGenerator;
+	Decoders[Bytecode::AtomicUpdate] = &FileLoader::DecodeAtomicUpdate;
+	Decoders[Bytecode::AtomicUpdateArray] = &FileLoader::DecodeAtomicUpdateArray;
+	Decoders[Bytecode::CancelFuture] = &FileLoader::DecodeCancelFuture;
+	Decoders[Bytecode::CancelPoolWork] = &FileLoader::DecodeCancelPoolWork;
+	Decoders[Bytecode::DependentFuture] = &FileLoader::DecodeDependentFuture;
+}
+
+const FileLoader::InstructionDecoderTable FileLoader::DecoderTable;
+
+
+//
+// Decoders for each instruction which may appear within a code block
+//
+// The instruction byte itself has already been consumed; each decoder
+// reads the instruction's operands, and (outside of the prepass) adds
+// the corresponding operation to the given block.
+//
+void FileLoader::DecodePushOperation(VM::Block* newblock)
+{
+	unsigned char op = ReadInstruction();
+	GenerateOpFromByteCode(op, newblock);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushOperation(newblock->PopTailOperation().release(), *newblock->GetBoundScope())));
+}
+
+void FileLoader::DecodeTypedPushOperation(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+
+	unsigned char op = ReadInstruction();
+	GenerateOpFromByteCode(op, newblock);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushOperation(newblock->PopTailOperation().release(), type)));
+}
+
+void FileLoader::DecodeInvoke(VM::Block* newblock)
+{
+	FunctionID funcid = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::Invoke(FunctionIDMap.find(funcid)->second, false)));
+}
+
+void FileLoader::DecodeDebugWrite(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::DebugWriteStringExpression));
+}
+
+void FileLoader::DecodePushRealLiteral(VM::Block* newblock)
+{
+	Real value = ReadFloat();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushRealLiteral(value)));
+}
+
+void FileLoader::DecodeDivideReals(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsGreater(type)));
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::DivideReals::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::DivideReals::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::AssignValue)
+}
+
+void FileLoader::DecodePushIntegerLiteral(VM::Block* newblock)
+{
+	Integer32 value = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushIntegerLiteral(value)));
+}
+
+void FileLoader::DecodeIsEqual(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsEqual>(type)));
+}
+
+void FileLoader::DecodeIsNotEqual(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsNotEqual>(type)));
+}
+
+void FileLoader::DecodeIsLesser(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsLesser>(type)));
+}
+
+void FileLoader::DecodeIsGreater(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsGreater>(type)));
+}
+
+void FileLoader::DecodeAssignValue(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignValue(varname)));
+}
+
+void FileLoader::DecodeDoWhile(VM::Block* newblock)
+{
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> theblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		std::string varname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignValue(WidenAndCache(varname))));
+		theblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::DoWhileLoop(theblock.release())));
 	}
-	else if(instruction == Bytecode::DoWhile)
+}
+
+void FileLoader::DecodeGetValue(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetVariableValue(varname)));
+}
+
+void FileLoader::DecodeMoveValue(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::MoveVariable(varname)));
+}
+
+void FileLoader::DecodeIf(VM::Block* newblock)
+{
+	std::auto_ptr<VM::Block> trueblock(NULL);
+	std::auto_ptr<VM::Block> falseblock(NULL);
+
+	unsigned char nextop = ReadInstruction();
+	if(nextop == Bytecode::BeginBlock)
 	{
-		ExpectInstruction(Bytecode::BeginBlock);
 		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> theblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			theblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::DoWhileLoop(theblock.release())));
-		}
-	}
-	else if(instruction == Bytecode::GetValue)
-	{
-		std::string varname = ReadNullTerminatedString();
+		trueblock.reset(LoadCodeBlock());
 		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetVariableValue(WidenAndCache(varname))));
+			trueblock->BindToScope(UnregisterScopeToDelete(scope));
 	}
-	else if(instruction == Bytecode::If)
-	{
-		std::auto_ptr<VM::Block> trueblock(NULL);
-		std::auto_ptr<VM::Block> falseblock(NULL);
-
-		unsigned char nextop = ReadInstruction();
-		if(nextop == Bytecode::BeginBlock)
-		{
-			VM::ScopeDescription* scope = LoadScope(false);
-			trueblock.reset(LoadCodeBlock());
-			if(!IsPrepass)
-				trueblock->BindToScope(UnregisterScopeToDelete(scope));
-		}
 
-		std::auto_ptr<VM::Operations::If> ifop(NULL);
-		if(!IsPrepass)
-			ifop.reset(new VM::Operations::If(trueblock.release(), NULL));
+	std::auto_ptr<VM::Operations::If> ifop(NULL);
+	if(!IsPrepass)
+		ifop.reset(new VM::Operations::If(trueblock.release(), NULL));
 
-		nextop = ReadInstruction();
-		if(nextop == Bytecode::ElseIfWrapper)
+	nextop = ReadInstruction();
+	if(nextop == Bytecode::ElseIfWrapper)
+	{
+		do
 		{
-			do
-			{
+			nextop = ReadInstruction();
+			if(nextop == Bytecode::ElseIf)
 				nextop = ReadInstruction();
-				if(nextop == Bytecode::ElseIf)
-					nextop = ReadInstruction();
-
-				if(nextop == Bytecode::BeginBlock)
-				{
-					VM::ScopeDescription* scope = LoadScope(false);
-					std::auto_ptr<VM::Block> elseifwrapblock(LoadCodeBlock());
-					if(!IsPrepass)
-					{
-						elseifwrapblock->BindToScope(UnregisterScopeToDelete(scope));
-						ifop->SetElseIfBlock(new VM::Operations::ElseIfWrapper(elseifwrapblock.release()));
-					}				
-				}
-				else
-					throw InvalidBytecodeException("Elseifwrap instruction loaded, but no elseif blocks found! This is probably a compiler bug.");
-			} while(PeekInstruction() == Bytecode::ElseIf);
-		}
 
-		nextop = ReadInstruction();
-		if(nextop == Bytecode::BeginBlock)
-		{
-			VM::ScopeDescription* scope = LoadScope(false);
-			falseblock.reset(LoadCodeBlock());
-			if(!IsPrepass)
+			if(nextop == Bytecode::BeginBlock)
 			{
-				falseblock->BindToScope(UnregisterScopeToDelete(scope));
-				ifop->SetFalseBlock(falseblock.release());
+				VM::ScopeDescription* scope = LoadScope(false);
+				std::auto_ptr<VM::Block> elseifwrapblock(LoadCodeBlock());
+				if(!IsPrepass)
+				{
+					elseifwrapblock->BindToScope(UnregisterScopeToDelete(scope));
+					ifop->SetElseIfBlock(new VM::Operations::ElseIfWrapper(elseifwrapblock.release()));
+				}				
 			}
-		}
-
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(ifop.release()));
-	}
-	else if(instruction == Bytecode::AddReals)
-	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
-		if(!IsPrepass)
-		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SumReals));
 			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SumReals(firstisarray, secondisarray)));
-		}
+				throw InvalidBytecodeException("Elseifwrap instruction loaded, but no elseif blocks found! This is probably a compiler bug.");
+		} while(PeekInstruction() == Bytecode::ElseIf);
 	}
-	else if(instruction == Bytecode::SubReals)
+
+	nextop = ReadInstruction();
+	if(nextop == Bytecode::BeginBlock)
 	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
+		VM::ScopeDescription* scope = LoadScope(false);
+		falseblock.reset(LoadCodeBlock());
 		if(!IsPrepass)
 		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SubtractReals));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SubtractReals(firstisarray, secondisarray)));
+			falseblock->BindToScope(UnregisterScopeToDelete(scope));
+			ifop->SetFalseBlock(falseblock.release());
 		}
 	}
-	else if(instruction == Bytecode::PushBooleanLiteral)
-	{
-		bool value = ReadFlag();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushBooleanLiteral(value)));
-	}
-	else if(instruction == Bytecode::PushStringLiteral)
+
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(ifop.release()));
+}
+
+void FileLoader::DecodeAddReals(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		Integer32 len = ReadNumber();
-		std::string str = ReadStringByLength(len);
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushStringLiteral(WidenAndCache(str))));
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SumReals::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SumReals::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::AddIntegers)
+}
+
+void FileLoader::DecodeSubReals(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
-		if(!IsPrepass)
-		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SumIntegers));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SumIntegers(firstisarray, secondisarray)));
-		}
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SubtractReals::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SubtractReals::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::SubtractIntegers)
+}
+
+void FileLoader::DecodePushBooleanLiteral(VM::Block* newblock)
+{
+	bool value = ReadFlag();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushBooleanLiteral(value)));
+}
+
+void FileLoader::DecodePushStringLiteral(VM::Block* newblock)
+{
+	Integer32 len = ReadNumber();
+	const std::wstring& str = ReadPooledString(len);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushStringLiteral(str)));
+}
+
+void FileLoader::DecodeAddIntegers(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
-		if(!IsPrepass)
-		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SubtractIntegers));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::SubtractIntegers(firstisarray, secondisarray)));
-		}
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SumIntegers::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SumIntegers::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::DebugRead)
+}
+
+void FileLoader::DecodeSubtractIntegers(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::DebugReadStaticString));
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SubtractIntegers::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::SubtractIntegers::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::ElseIf)
-	{
-		if(ReadInstruction() != Bytecode::BeginBlock)
-			throw InvalidBytecodeException("Corruption near Elseif instruction (expected to begin a block here)");
+}
 
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> block(LoadCodeBlock());
+void FileLoader::DecodeDebugRead(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::DebugReadStaticString));
+}
 
-		if(!IsPrepass)
-		{
-			block->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ElseIf(block.release())));
-		}
-	}
-	else if(instruction == Bytecode::ExitIfChain)
+void FileLoader::DecodeElseIf(VM::Block* newblock)
+{
+	if(ReadInstruction() != Bytecode::BeginBlock)
+		throw InvalidBytecodeException("Corruption near Elseif instruction (expected to begin a block here)");
+
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> block(LoadCodeBlock());
+
+	if(!IsPrepass)
 	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ExitIfChain));
+		block->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ElseIf(block.release())));
 	}
-	else if(instruction == Bytecode::ReadTuple)
-	{
-		std::string varname = ReadNullTerminatedString();
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadTuple(WidenAndCache(varname), WidenAndCache(membername))));
-	}
-	else if(instruction == Bytecode::WriteTuple)
-	{
-		std::string varname = ReadNullTerminatedString();
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignTuple(WidenAndCache(varname), WidenAndCache(membername))));
-	}
-	else if(instruction == Bytecode::ReadStructure)
-	{
-		std::string varname = ReadNullTerminatedString();
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadStructure(WidenAndCache(varname), WidenAndCache(membername))));
-	}
-	else if(instruction == Bytecode::WriteStructure)
-	{
-		std::string varname = ReadNullTerminatedString();
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignStructure(WidenAndCache(varname), WidenAndCache(membername))));
-	}
-	else if(instruction == Bytecode::Init)
-	{
-		std::string varname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::InitializeValue(WidenAndCache(varname))));
-	}
-	else if(instruction == Bytecode::BindFunctionReference)
-	{
-		std::string funcname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindFunctionReference(WidenAndCache(funcname))));
-	}
-	else if(instruction == Bytecode::SizeOf)
-	{
-		std::string varname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::SizeOf(WidenAndCache(varname))));
-	}
-	else if(instruction == Bytecode::While)
-	{
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> loopblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			loopblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::WhileLoop(loopblock.release())));
-		}
-	}
-	else if(instruction == Bytecode::BindReference)
-	{
-		std::string varname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindReference(WidenAndCache(varname))));
-	}
-	else if(instruction == Bytecode::WhileCondition)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::WhileLoopConditional));
-	}
-	else if(instruction == Bytecode::Break)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::Break));
-	}
-	else if(instruction == Bytecode::Return)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::Return));
-	}
-	else if(instruction == Bytecode::BitwiseAnd)
-	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+}
 
-		std::auto_ptr<VM::Operations::BitwiseAnd> op(NULL);
-		if(!IsPrepass)
-			op.reset(new VM::Operations::BitwiseAnd(type));
+void FileLoader::DecodeExitIfChain(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ExitIfChain));
+}
 
-		UInteger32 testcount = ReadNumber();
-		for(UInteger32 i = 0; i < testcount; ++i)
-		{
-			std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
-			GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+void FileLoader::DecodeReadTuple(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadTuple(varname, membername)));
+}
 
-			if(!IsPrepass)
-				op->AddOperation(tempblock->PopTailOperation().release());
-		}
+void FileLoader::DecodeWriteTuple(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignTuple(varname, membername)));
+}
 
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(op.release()));
-	}
-	else if(instruction == Bytecode::BitwiseOr)
-	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+void FileLoader::DecodeReadStructure(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadStructure(varname, membername)));
+}
 
-		std::auto_ptr<VM::Operations::BitwiseOr> op(NULL);
-		if(!IsPrepass)
-			op.reset(new VM::Operations::BitwiseOr(type));
+void FileLoader::DecodeWriteStructure(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignStructure(varname, membername)));
+}
 
-		UInteger32 testcount = ReadNumber();
-		for(UInteger32 i = 0; i < testcount; ++i)
-		{
-			std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
-			GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+void FileLoader::DecodeInit(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::InitializeValue(varname)));
+}
 
-			if(!IsPrepass)
-				op->AddOperation(tempblock->PopTailOperation().release());
-		}
+void FileLoader::DecodeBindFunctionReference(VM::Block* newblock)
+{
+	const std::wstring& funcname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindFunctionReference(funcname)));
+}
 
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(op.release()));
+void FileLoader::DecodeSizeOf(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SizeOf(varname)));
+}
+
+void FileLoader::DecodeWhile(VM::Block* newblock)
+{
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> loopblock(LoadCodeBlock());
+	if(!IsPrepass)
+	{
+		loopblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::WhileLoop(loopblock.release())));
 	}
-	else if(instruction == Bytecode::BitwiseXor)
+}
+
+void FileLoader::DecodeBindReference(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindReference(varname)));
+}
+
+void FileLoader::DecodeWhileCondition(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::WhileLoopConditional));
+}
+
+void FileLoader::DecodeBreak(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::Break));
+}
+
+void FileLoader::DecodeReturn(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::Return));
+}
+
+void FileLoader::DecodeBitwiseAnd(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+
+	std::auto_ptr<VM::Operations::BitwiseAnd> op(NULL);
+	if(!IsPrepass)
+		op.reset(new VM::Operations::BitwiseAnd(type));
+
+	UInteger32 testcount = ReadNumber();
+	for(UInteger32 i = 0; i < testcount; ++i)
 	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+		std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
+		GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
 
 		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BitwiseXor(type)));
+			op->AddOperation(tempblock->PopTailOperation().release());
 	}
-	else if(instruction == Bytecode::BitwiseNot)
+
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(op.release()));
+}
+
+void FileLoader::DecodeBitwiseOr(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+
+	std::auto_ptr<VM::Operations::BitwiseOr> op(NULL);
+	if(!IsPrepass)
+		op.reset(new VM::Operations::BitwiseOr(type));
+
+	UInteger32 testcount = ReadNumber();
+	for(UInteger32 i = 0; i < testcount; ++i)
 	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+		std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
+		GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
 
 		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BitwiseNot(type)));
+			op->AddOperation(tempblock->PopTailOperation().release());
 	}
-	else if(instruction == Bytecode::LogicalAnd)
-	{
-		std::auto_ptr<VM::Operations::LogicalAnd> op(NULL);
-		if(!IsPrepass)
-			op.reset(new VM::Operations::LogicalAnd);
 
-		UInteger32 testcount = ReadNumber();
-		for(UInteger32 i = 0; i < testcount; ++i)
-		{
-			std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
-			GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(op.release()));
+}
 
-			if(!IsPrepass)
-				op->AddOperation(tempblock->PopTailOperation().release());
-		}
+void FileLoader::DecodeBitwiseXor(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
 
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(op.release()));
-	}
-	else if(instruction == Bytecode::LogicalOr)
-	{
-		std::auto_ptr<VM::Operations::LogicalOr> op;
-		if(!IsPrepass)
-			op.reset(new VM::Operations::LogicalOr);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BitwiseXor(type)));
+}
 
-		UInteger32 testcount = ReadNumber();
-		for(UInteger32 i = 0; i < testcount; ++i)
-		{
-			std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
-			GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+void FileLoader::DecodeBitwiseNot(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
 
-			if(!IsPrepass)
-				op->AddOperation(tempblock->PopTailOperation().release());
-		}
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BitwiseNot(type)));
+}
 
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(op.release()));
-	}
-	else if(instruction == Bytecode::LogicalXor)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::LogicalXor));
-	}
-	else if(instruction == Bytecode::LogicalNot)
+void FileLoader::DecodeLogicalAnd(VM::Block* newblock)
+{
+	std::auto_ptr<VM::Operations::LogicalAnd> op(NULL);
+	if(!IsPrepass)
+		op.reset(new VM::Operations::LogicalAnd);
+
+	UInteger32 testcount = ReadNumber();
+	for(UInteger32 i = 0; i < testcount; ++i)
 	{
+		std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
+		GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+
 		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::LogicalNot));
+			op->AddOperation(tempblock->PopTailOperation().release());
 	}
-	else if(instruction == Bytecode::Concat)
+
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(op.release()));
+}
+
+void FileLoader::DecodeLogicalOr(VM::Block* newblock)
+{
+	std::auto_ptr<VM::Operations::LogicalOr> op;
+	if(!IsPrepass)
+		op.reset(new VM::Operations::LogicalOr);
+
+	UInteger32 testcount = ReadNumber();
+	for(UInteger32 i = 0; i < testcount; ++i)
 	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
+		std::auto_ptr<VM::Block> tempblock(new VM::Block(false));
+		GenerateOpFromByteCode(ReadInstruction(), tempblock.get());
+
 		if(!IsPrepass)
-		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::Concatenate));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::Concatenate(firstisarray, secondisarray)));
-		}
+			op->AddOperation(tempblock->PopTailOperation().release());
 	}
-	else if(instruction == Bytecode::IsGreaterEqual)
+
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(op.release()));
+}
+
+void FileLoader::DecodeLogicalXor(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::LogicalXor));
+}
+
+void FileLoader::DecodeLogicalNot(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::LogicalNot));
+}
+
+void FileLoader::DecodeConcat(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsGreaterOrEqual(type)));
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::Concatenate));
+		else
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::Concatenate(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::PushInteger16Literal)
+}
+
+void FileLoader::DecodeFindString(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::FindSubstring));
+}
+
+void FileLoader::DecodeStringStartsWith(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::StartsWith));
+}
+
+void FileLoader::DecodeCompareStrings(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CompareStrings));
+}
+
+void FileLoader::DecodeSplitString(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SplitString));
+}
+
+void FileLoader::DecodeIsGreaterEqual(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsGreaterOrEqual>(type)));
+}
+
+void FileLoader::DecodePushInteger16Literal(VM::Block* newblock)
+{
+	Integer16 value = static_cast<Integer16>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushInteger16Literal(value)));
+}
+
+void FileLoader::DecodeInvokeIndirect(VM::Block* newblock)
+{
+	const std::wstring& funcname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::InvokeIndirect(funcname)));
+}
+
+void FileLoader::DecodeBooleanLiteral(VM::Block* newblock)
+{
+	bool flag = ReadFlag();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BooleanConstant(flag)));
+}
+
+void FileLoader::DecodeBeginBlock(VM::Block* newblock)
+{
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> theblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		Integer16 value = static_cast<Integer16>(ReadNumber());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::PushInteger16Literal(value)));
+		theblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ExecuteBlock(theblock.release())));
 	}
-	else if(instruction == Bytecode::InvokeIndirect)
+}
+
+void FileLoader::DecodeReadStructureIndirect(VM::Block* newblock)
+{
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadStructureIndirect(membername, newblock->GetTailOperation())));
+}
+
+void FileLoader::DecodeBindStruct(VM::Block* newblock)
+{
+	std::wstring membername, varname;
+
+	bool chained = ReadFlag();
+	if(!chained)
+		varname = ReadPooledString();
+
+	membername = ReadPooledString();
+
+	if(!IsPrepass)
 	{
-		std::string funcname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::InvokeIndirect(WidenAndCache(funcname))));
+		if(chained)
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindStructMemberReference(membername)));
+		else
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindStructMemberReference(varname, membername)));
 	}
-	else if(instruction == Bytecode::BooleanLiteral)
+}
+
+void FileLoader::DecodeWriteStructureIndirect(VM::Block* newblock)
+{
+	const std::wstring& membername = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignStructureIndirect(membername)));
+}
+
+void FileLoader::DecodeForkTask(VM::Block* newblock)
+{
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		bool flag = ReadFlag();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::BooleanConstant(flag)));
+		scope->ParentScope = &LoadingProgram->GetGlobalScope();
+		taskblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkTask(taskblock.release())));
 	}
-	else if(instruction == Bytecode::BeginBlock)
+}
+
+void FileLoader::DecodeAcceptMessage(VM::Block* newblock)
+{
+	const std::wstring& messagename = ReadPooledString();
+
+	UINT_PTR numparams = ReadNumber();
+	std::vector<VM::EpochVariableTypeID> paramtypes;
+	for(UINT_PTR i = 0; i < numparams; ++i)
+		paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* responsescope = LoadScope(false);
+	std::auto_ptr<VM::Block> responseblock(LoadCodeBlock());
+	VM::ScopeDescription* auxscope = LoadScope(false);
+	if(!IsPrepass)
 	{
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> theblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			theblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ExecuteBlock(theblock.release())));
-		}
+		responseblock->BindToScope(UnregisterScopeToDelete(responsescope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AcceptMessage(messagename, responseblock.release(), UnregisterScopeToDelete(auxscope))));
 	}
-	else if(instruction == Bytecode::ReadStructureIndirect)
+}
+
+void FileLoader::DecodeMultiplyIntegers(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	UInteger32 paramcount = ReadNumber();
+	if(!IsPrepass)
 	{
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadStructureIndirect(WidenAndCache(membername), newblock->GetTailOperation())));
+		if(paramcount == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::MultiplyIntegers::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::MultiplyIntegers::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::BindStruct)
-	{
-		std::string membername, varname;
+}
 
-		bool chained = ReadFlag();
-		if(!chained)
-			varname = ReadNullTerminatedString();
+void FileLoader::DecodeGetMessageSender(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetMessageSender));
+}
 
-		membername = ReadNullTerminatedString();
+void FileLoader::DecodeGetTaskCaller(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetTaskCaller));
+}
 
-		if(!IsPrepass)
-		{
-			if(chained)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindStructMemberReference(WidenAndCache(membername))));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::BindStructMemberReference(WidenAndCache(varname), WidenAndCache(membername))));
-		}
-	}
-	else if(instruction == Bytecode::WriteStructureIndirect)
-	{
-		std::string membername = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AssignStructureIndirect(WidenAndCache(membername))));
-	}
-	else if(instruction == Bytecode::ForkTask)
-	{
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			scope->ParentScope = &LoadingProgram->GetGlobalScope();
-			taskblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkTask(taskblock.release())));
-		}
-	}
-	else if(instruction == Bytecode::AcceptMessage)
-	{
-		std::string messagename = ReadNullTerminatedString();
+void FileLoader::DecodeSendTaskMessage(VM::Block* newblock)
+{
+	std::string targettaskname;
+	bool targettaskbyname = ReadFlag();
+	const std::wstring& messagename = ReadPooledString();
+	UINT_PTR numparams = ReadNumber();
+	std::list<VM::EpochVariableTypeID> paramtypes;
+	for(UINT_PTR i = 0; i < numparams; ++i)
+		paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SendTaskMessage(targettaskbyname, messagename, paramtypes)));
+}
 
-		UINT_PTR numparams = ReadNumber();
-		std::vector<VM::EpochVariableTypeID> paramtypes;
-		for(UINT_PTR i = 0; i < numparams; ++i)
-			paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+void FileLoader::DecodeBroadcastTaskMessage(VM::Block* newblock)
+{
+	const std::wstring& messagename = ReadPooledString();
+	UINT_PTR numparams = ReadNumber();
+	std::list<VM::EpochVariableTypeID> paramtypes;
+	for(UINT_PTR i = 0; i < numparams; ++i)
+		paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::BroadcastTaskMessage(messagename, paramtypes)));
+}
 
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* responsescope = LoadScope(false);
-		std::auto_ptr<VM::Block> responseblock(LoadCodeBlock());
-		VM::ScopeDescription* auxscope = LoadScope(false);
-		if(!IsPrepass)
-		{
-			responseblock->BindToScope(UnregisterScopeToDelete(responsescope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AcceptMessage(WidenAndCache(messagename), responseblock.release(), UnregisterScopeToDelete(auxscope))));
-		}
-	}
-	else if(instruction == Bytecode::MultiplyIntegers)
+void FileLoader::DecodeSendTaskRequest(VM::Block* newblock)
+{
+	const std::wstring& futurename = ReadPooledString();
+	const std::wstring& messagename = ReadPooledString();
+	UINT_PTR numparams = ReadNumber();
+	std::list<VM::EpochVariableTypeID> paramtypes;
+	for(UINT_PTR i = 0; i < numparams; ++i)
+		paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SendTaskRequest(futurename, messagename, paramtypes)));
+}
+
+void FileLoader::DecodeReplyToRequest(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReplyToRequest(type)));
+}
+
+void FileLoader::DecodePendingReply(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID type = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::PendingReply(type)));
+}
+
+void FileLoader::DecodeAcceptMessageFromMap(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AcceptMessageFromResponseMap(mapname)));
+}
+
+void FileLoader::DecodeDelayedSendTaskMessage(VM::Block* newblock)
+{
+	bool targettaskbyname = ReadFlag();
+	bool periodic = ReadFlag();
+	const std::wstring& messagename = ReadPooledString();
+	UINT_PTR numparams = ReadNumber();
+	std::list<VM::EpochVariableTypeID> paramtypes;
+	for(UINT_PTR i = 0; i < numparams; ++i)
+		paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::DelayedSendTaskMessage(targettaskbyname, periodic, messagename, paramtypes)));
+}
+
+void FileLoader::DecodeAcceptMessageWithTimeout(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AcceptMessageWithTimeout(mapname)));
+}
+
+void FileLoader::DecodeTypeCastToString(VM::Block* newblock)
+{
+	Integer32 originaltype = ReadNumber();
+	if(!IsPrepass)
 	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		UInteger32 paramcount = ReadNumber();
-		if(!IsPrepass)
+		switch(originaltype)
 		{
-			if(paramcount == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::MultiplyIntegers));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::MultiplyIntegers(firstisarray, secondisarray)));
+		case VM::EpochVariableType_Real:
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::RealT>));
+			break;
+		case VM::EpochVariableType_Integer:
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::IntegerT>));
+			break;
+		case VM::EpochVariableType_Integer16:
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::Integer16T>));
+			break;
+		case VM::EpochVariableType_Boolean:
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastBooleanToString()));
+			break;
+		case VM::EpochVariableType_Buffer:
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastBufferToString()));
+			break;
+		default:
+			throw Exception("Cannot cast the given variable type to string; is one or more of your libraries out of date?");
 		}
 	}
-	else if(instruction == Bytecode::GetMessageSender)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetMessageSender));
-	}
-	else if(instruction == Bytecode::GetTaskCaller)
-	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::GetTaskCaller));
-	}
-	else if(instruction == Bytecode::SendTaskMessage)
-	{
-		std::string targettaskname;
-		bool targettaskbyname = ReadFlag();
-		std::string messagename = ReadNullTerminatedString();
-		UINT_PTR numparams = ReadNumber();
-		std::list<VM::EpochVariableTypeID> paramtypes;
-		for(UINT_PTR i = 0; i < numparams; ++i)
-			paramtypes.push_back(static_cast<VM::EpochVariableTypeID>(ReadNumber()));
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::SendTaskMessage(targettaskbyname, WidenAndCache(messagename), paramtypes)));
-	}
-	else if(instruction == Bytecode::AcceptMessageFromMap)
+}
+
+void FileLoader::DecodeDivideIntegers(VM::Block* newblock)
+{
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	Integer32 numparams = ReadNumber();
+	if(!IsPrepass)
 	{
-		std::string mapname = ReadNullTerminatedString();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::AcceptMessageFromResponseMap(WidenAndCache(mapname))));
+		if(numparams == 1)
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::DivideIntegers::Create()));
+		else
+			newblock->AddOperation(VM::OperationPtr(VM::Operations::DivideIntegers::Create(firstisarray, secondisarray)));
 	}
-	else if(instruction == Bytecode::TypeCastToString)
+}
+
+void FileLoader::DecodeTypeCast(VM::Block* newblock)
+{
+	Integer32 origintype = ReadNumber();
+	Integer32 desttype = ReadNumber();
+	if(!IsPrepass)
 	{
-		Integer32 originaltype = ReadNumber();
-		if(!IsPrepass)
+		if(desttype == VM::EpochVariableType_Integer)
 		{
-			switch(originaltype)
+			switch(origintype)
 			{
-			case VM::EpochVariableType_Real:
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::RealT>));
+			case VM::EpochVariableType_String:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::IntegerT>));
 				break;
-			case VM::EpochVariableType_Integer:
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::IntegerT>));
+			case VM::EpochVariableType_Real:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::RealT, TypeInfo::IntegerT>));
 				break;
 			case VM::EpochVariableType_Integer16:
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastToString<TypeInfo::Integer16T>));
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::Integer16T, TypeInfo::IntegerT>));
 				break;
 			case VM::EpochVariableType_Boolean:
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastBooleanToString()));
-				break;
-			case VM::EpochVariableType_Buffer:
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCastBufferToString()));
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::IntegerT>));
 				break;
 			default:
-				throw Exception("Cannot cast the given variable type to string; is one or more of your libraries out of date?");
+				throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
 			}
 		}
-	}
-	else if(instruction == Bytecode::DivideIntegers)
-	{
-		bool firstisarray = ReadFlag();
-		bool secondisarray = ReadFlag();
-		Integer32 numparams = ReadNumber();
-		if(!IsPrepass)
+		else if(desttype == VM::EpochVariableType_Integer16)
 		{
-			if(numparams == 1)
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::DivideIntegers));
-			else
-				newblock->AddOperation(VM::OperationPtr(new VM::Operations::DivideIntegers(firstisarray, secondisarray)));
-		}
-	}
-	else if(instruction == Bytecode::TypeCast)
-	{
-		Integer32 origintype = ReadNumber();
-		Integer32 desttype = ReadNumber();
-		if(!IsPrepass)
-		{
-			if(desttype == VM::EpochVariableType_Integer)
-			{
-				switch(origintype)
-				{
-				case VM::EpochVariableType_String:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::IntegerT>));
-					break;
-				case VM::EpochVariableType_Real:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::RealT, TypeInfo::IntegerT>));
-					break;
-				case VM::EpochVariableType_Integer16:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::Integer16T, TypeInfo::IntegerT>));
-					break;
-				case VM::EpochVariableType_Boolean:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::IntegerT>));
-					break;
-				default:
-					throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
-				}
-			}
-			else if(desttype == VM::EpochVariableType_Integer16)
+			switch(origintype)
 			{
-				switch(origintype)
-				{
-				case VM::EpochVariableType_String:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::Integer16T>));
-					break;
-				case VM::EpochVariableType_Real:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::RealT, TypeInfo::Integer16T>));
-					break;
-				case VM::EpochVariableType_Integer:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::IntegerT, TypeInfo::Integer16T>));
-					break;
-				case VM::EpochVariableType_Boolean:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::Integer16T>));
-					break;
-				default:
-					throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
-				}
+			case VM::EpochVariableType_String:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::Integer16T>));
+				break;
+			case VM::EpochVariableType_Real:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::RealT, TypeInfo::Integer16T>));
+				break;
+			case VM::EpochVariableType_Integer:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::IntegerT, TypeInfo::Integer16T>));
+				break;
+			case VM::EpochVariableType_Boolean:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::Integer16T>));
+				break;
+			default:
+				throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
 			}
-			else if(desttype == VM::EpochVariableType_Real)
+		}
+		else if(desttype == VM::EpochVariableType_Real)
+		{
+			switch(origintype)
 			{
-				switch(origintype)
-				{
-				case VM::EpochVariableType_String:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::RealT>));
-					break;
-				case VM::EpochVariableType_Integer:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::IntegerT, TypeInfo::RealT>));
-					break;
-				case VM::EpochVariableType_Integer16:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::Integer16T, TypeInfo::RealT>));
-					break;
-				case VM::EpochVariableType_Boolean:
-					newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::RealT>));
-					break;
-				default:
-					throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
-				}
-			}
-			else
+			case VM::EpochVariableType_String:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::StringT, TypeInfo::RealT>));
+				break;
+			case VM::EpochVariableType_Integer:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::IntegerT, TypeInfo::RealT>));
+				break;
+			case VM::EpochVariableType_Integer16:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::Integer16T, TypeInfo::RealT>));
+				break;
+			case VM::EpochVariableType_Boolean:
+				newblock->AddOperation(VM::OperationPtr(new VM::Operations::TypeCast<TypeInfo::BooleanT, TypeInfo::RealT>));
+				break;
+			default:
 				throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
+			}
 		}
+		else
+			throw Exception("Invalid parameters supplied to typecast operation; ensure all libraries are up to date and the binary is not corrupted");
 	}
-	else if(instruction == Bytecode::Future)
-	{
-		const std::wstring& futurename = WidenAndCache(ReadNullTerminatedString());
-		Integer32 type = ReadNumber();
-		bool usethreadpool = ReadFlag();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkFuture(futurename, static_cast<VM::EpochVariableTypeID>(type), usethreadpool)));
-	}
-	else if(instruction == Bytecode::Map)
-	{
-		VM::Block* tempblock = new VM::Block;
-		GenerateOpFromByteCode(ReadInstruction(), tempblock);
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::MapOperation(tempblock->PopTailOperation())));
-		delete tempblock;
-	}
-	else if(instruction == Bytecode::Reduce)
-	{
-		VM::Block* tempblock = new VM::Block;
-		GenerateOpFromByteCode(ReadInstruction(), tempblock);
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReduceOperation(tempblock->PopTailOperation())));
-		delete tempblock;
-	}
-	else if(instruction == Bytecode::IsLesserEqual)
+}
+
+void FileLoader::DecodeFuture(VM::Block* newblock)
+{
+	const std::wstring& futurename = ReadPooledString();
+	Integer32 type = ReadNumber();
+	bool usethreadpool = ReadFlag();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkFuture(futurename, static_cast<VM::EpochVariableTypeID>(type), usethreadpool)));
+}
+
+void FileLoader::DecodeMap(VM::Block* newblock)
+{
+	DecodeMapOperation(newblock, false);
+}
+
+void FileLoader::DecodeReduce(VM::Block* newblock)
+{
+	DecodeReduceOperation(newblock, false);
+}
+
+void FileLoader::DecodeMapGenerator(VM::Block* newblock)
+{
+	DecodeMapOperation(newblock, true);
+}
+
+void FileLoader::DecodeReduceGenerator(VM::Block* newblock)
+{
+	DecodeReduceOperation(newblock, true);
+}
+
+//
+// Maps and reduces over generators differ from those over arrays only in
+// where their elements come from; both forms are decoded the same way.
+//
+void FileLoader::DecodeMapOperation(VM::Block* newblock, bool fromgenerator)
+{
+	VM::Block* tempblock = new VM::Block;
+	GenerateOpFromByteCode(ReadInstruction(), tempblock);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::MapOperation(tempblock->PopTailOperation(), fromgenerator)));
+	delete tempblock;
+}
+
+void FileLoader::DecodeReduceOperation(VM::Block* newblock, bool fromgenerator)
+{
+	VM::Block* tempblock = new VM::Block;
+	GenerateOpFromByteCode(ReadInstruction(), tempblock);
+	if(!IsPrepass)
 	{
-		Integer32 type = ReadNumber();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IsLesserOrEqual(static_cast<VM::EpochVariableTypeID>(type))));
+		VM::OperationPtr reduceop(new VM::Operations::ReduceOperation(tempblock->PopTailOperation(), fromgenerator));
+
+		// Reduce the results of a map directly, as the parser does
+		if(newblock->GetNumOperations() && VM::Operations::MapReduceOperation::CanFuse(newblock->GetTailOperation()))
+			newblock->AddOperation(VM::OperationPtr(new VM::Operations::MapReduceOperation(newblock->PopTailOperation(), reduceop)));
+		else
+			newblock->AddOperation(reduceop);
 	}
-	else if(instruction == Bytecode::IntegerLiteral)
+	delete tempblock;
+}
+
+void FileLoader::DecodeIsLesserEqual(VM::Block* newblock)
+{
+	Integer32 type = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(VM::Operations::CreateComparison<VM::Operations::IsLesserOrEqual>(static_cast<VM::EpochVariableTypeID>(type))));
+}
+
+void FileLoader::DecodeIntegerLiteral(VM::Block* newblock)
+{
+	Integer32 value = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::IntegerConstant(value)));
+}
+
+void FileLoader::DecodeThreadPool(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CreateThreadPool()));
+}
+
+void FileLoader::DecodeForkThread(VM::Block* newblock)
+{
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		Integer32 value = ReadNumber();
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::IntegerConstant(value)));
+		scope->ParentScope = &LoadingProgram->GetGlobalScope();
+		taskblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkThread(taskblock.release())));
 	}
-	else if(instruction == Bytecode::ThreadPool)
+}
+
+void FileLoader::DecodeHandoff(VM::Block* newblock)
+{
+	const std::wstring& libraryname = ReadPooledString();
+	HandleType codehandle = ReadNumber();
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::CreateThreadPool()));
+		taskblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new Extensions::HandoffOperation(libraryname, taskblock, codehandle)));
 	}
-	else if(instruction == Bytecode::ForkThread)
+}
+
+void FileLoader::DecodeHandoffControl(VM::Block* newblock)
+{
+	const std::wstring& libraryname = ReadPooledString();
+	const std::wstring& countervarname = ReadPooledString();
+	HandleType codehandle = ReadNumber();
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> controlblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			scope->ParentScope = &LoadingProgram->GetGlobalScope();
-			taskblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkThread(taskblock.release())));
-		}
+		controlblock->BindToScope(UnregisterScopeToDelete(scope));
+		newblock->AddOperation(VM::OperationPtr(new Extensions::HandoffControlOperation(libraryname, controlblock.release(), countervarname, *scope, codehandle)));
 	}
-	else if(instruction == Bytecode::Handoff)
+}
+
+void FileLoader::DecodeParallelFor(VM::Block* newblock)
+{
+	const std::wstring& countervarname = ReadPooledString();
+
+	UINT_PTR numreductions = ReadNumber();
+	std::vector<std::pair<VM::Operations::ParallelFor::ReductionOperator, std::wstring> > reductions;
+	for(UINT_PTR i = 0; i < numreductions; ++i)
 	{
-		const std::wstring& libraryname = WidenAndCache(ReadNullTerminatedString());
-		HandleType codehandle = ReadNumber();
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> taskblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			taskblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new Extensions::HandoffOperation(libraryname, taskblock, codehandle)));
-		}
+		VM::Operations::ParallelFor::ReductionOperator op = static_cast<VM::Operations::ParallelFor::ReductionOperator>(ReadNumber());
+		reductions.push_back(std::make_pair(op, ReadPooledString()));
 	}
-	else if(instruction == Bytecode::HandoffControl)
+
+	ExpectInstruction(Bytecode::BeginBlock);
+	VM::ScopeDescription* scope = LoadScope(false);
+	std::auto_ptr<VM::Block> controlblock(LoadCodeBlock());
+	if(!IsPrepass)
 	{
-		const std::wstring& libraryname = WidenAndCache(ReadNullTerminatedString());
-		const std::wstring& countervarname = WidenAndCache(ReadNullTerminatedString());
-		HandleType codehandle = ReadNumber();
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> controlblock(LoadCodeBlock());
-		if(!IsPrepass)
-		{
-			controlblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new Extensions::HandoffControlOperation(libraryname, controlblock.release(), countervarname, *scope, codehandle)));
-		}
+		controlblock->BindToScope(UnregisterScopeToDelete(scope));
+		std::auto_ptr<VM::Operations::ParallelFor> op(new VM::Operations::ParallelFor(controlblock.release(), countervarname, true, 0));
+		for(std::vector<std::pair<VM::Operations::ParallelFor::ReductionOperator, std::wstring> >::const_iterator iter = reductions.begin(); iter != reductions.end(); ++iter)
+			op->AddReduction(iter->first, iter->second);
+		newblock->AddOperation(VM::OperationPtr(op.release()));
 	}
-	else if(instruction == Bytecode::ParallelFor)
+}
+
+void FileLoader::DecodeParallelInvoke(VM::Block* newblock)
+{
+	const std::wstring& tuplename = ReadPooledString();
+
+	UINT_PTR numbranches = ReadNumber();
+	std::vector<UINT_PTR> branchsizes;
+	for(UINT_PTR i = 0; i < numbranches; ++i)
+		branchsizes.push_back(ReadNumber());
+
+	// The operations of each branch follow in order
+	VM::Block* tempblock = new VM::Block;
+	VM::Operations::ParallelInvoke::BranchList branches(numbranches);
+	for(UINT_PTR i = 0; i < numbranches; ++i)
 	{
-		const std::wstring& countervarname = WidenAndCache(ReadNullTerminatedString());
-		ExpectInstruction(Bytecode::BeginBlock);
-		VM::ScopeDescription* scope = LoadScope(false);
-		std::auto_ptr<VM::Block> controlblock(LoadCodeBlock());
-		if(!IsPrepass)
+		for(UINT_PTR j = 0; j < branchsizes[i]; ++j)
 		{
-			controlblock->BindToScope(UnregisterScopeToDelete(scope));
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ParallelFor(controlblock.release(), countervarname, true, 0)));
+			GenerateOpFromByteCode(ReadInstruction(), tempblock);
+			if(!IsPrepass)
+				branches[i].push_back(tempblock->PopTailOperation().release());
 		}
 	}
-	else if(instruction == Bytecode::ReadArray)
-	{
-		const std::wstring& arrayname = WidenAndCache(ReadNullTerminatedString());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadArray(arrayname)));
-	}
-	else if(instruction == Bytecode::WriteArray)
-	{
-		const std::wstring& arrayname = WidenAndCache(ReadNullTerminatedString());
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::WriteArray(arrayname)));
-	}
-	else if(instruction == Bytecode::ArrayLength)
+	delete tempblock;
+
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ParallelInvoke(tuplename, branches)));
+}
+
+void FileLoader::DecodeCreateGenerator(VM::Block* newblock)
+{
+	Integer32 elementtype = ReadNumber();
+	UINT_PTR numops = ReadNumber();
+
+	// The operations of the generator's function call follow in order
+	VM::Block* tempblock = new VM::Block;
+	VM::Operations::CreateGenerator::Branch body;
+	for(UINT_PTR i = 0; i < numops; ++i)
 	{
-		const std::wstring& arrayname = WidenAndCache(ReadNullTerminatedString());
+		GenerateOpFromByteCode(ReadInstruction(), tempblock);
 		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ArrayLength(arrayname)));
+			body.push_back(tempblock->PopTailOperation().release());
 	}
-	else if(instruction == Bytecode::ConsArrayIndirect)
-	{
-		VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	delete tempblock;
 
-		unsigned char op = ReadInstruction();
-		GenerateOpFromByteCode(op, newblock);
-		if(!IsPrepass)
-			newblock->AddOperation(VM::OperationPtr(new VM::Operations::ConsArrayIndirect(elementtype, newblock->PopTailOperation().release())));
-	}
-	else
-	{
-		std::ostringstream stream;
-		stream << "Read an opcode from the binary, but it doesn't match any known opcode. Aborting program execution!\n";
-		stream << "Opcode value: 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(instruction) << " Offset: 0x" << std::setw(8) << (Offset - 1);
-		throw InvalidBytecodeException(stream.str());
-	}
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CreateGenerator(static_cast<VM::EpochVariableTypeID>(elementtype), body)));
+}
+
+void FileLoader::DecodeYieldValue(VM::Block* newblock)
+{
+	Integer32 valuetype = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::YieldValue(static_cast<VM::EpochVariableTypeID>(valuetype))));
+}
+
+void FileLoader::DecodeGeneratorHasNext(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::GeneratorHasNext));
+}
+
+void FileLoader::DecodeGeneratorNextValue(VM::Block* newblock)
+{
+	Integer32 elementtype = ReadNumber();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::GeneratorNextValue(static_cast<VM::EpochVariableTypeID>(elementtype))));
+}
+
+void FileLoader::DecodeAtomicUpdate(VM::Block* newblock)
+{
+	const std::wstring& varname = ReadPooledString();
+	VM::Operations::AtomicOpType optype = static_cast<VM::Operations::AtomicOpType>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AtomicUpdate(varname, optype)));
+}
+
+void FileLoader::DecodeAtomicUpdateArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	VM::Operations::AtomicOpType optype = static_cast<VM::Operations::AtomicOpType>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AtomicUpdateArray(arrayname, optype)));
+}
+
+void FileLoader::DecodeCancelFuture(VM::Block* newblock)
+{
+	const std::wstring& futurename = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CancelFuture(futurename)));
+}
+
+void FileLoader::DecodeDependentFuture(VM::Block* newblock)
+{
+	const std::wstring& futurename = ReadPooledString();
+	Integer32 type = ReadNumber();
+	bool waitforany = ReadFlag();
+	UINT_PTR numdependencies = ReadNumber();
+	std::vector<std::wstring> dependencies;
+	for(UINT_PTR i = 0; i < numdependencies; ++i)
+		dependencies.push_back(ReadPooledString());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ForkDependentFuture(futurename, static_cast<VM::EpochVariableTypeID>(type), dependencies, waitforany)));
+}
+
+void FileLoader::DecodeCancelPoolWork(VM::Block* newblock)
+{
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CancelPoolWork()));
+}
+
+void FileLoader::DecodeReadArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReadArray(arrayname)));
+}
+
+void FileLoader::DecodeWriteArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::WriteArray(arrayname)));
+}
+
+void FileLoader::DecodeAppendArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::AppendArray(arrayname)));
+}
+
+void FileLoader::DecodeArrayLength(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ArrayLength(arrayname)));
+}
+
+void FileLoader::DecodeSortArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SortArray(arrayname)));
+}
+
+void FileLoader::DecodeSearchArray(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SearchArray(arrayname)));
+}
+
+void FileLoader::DecodeArrayMinIndex(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ArrayMinIndex(arrayname)));
+}
+
+void FileLoader::DecodeArrayMaxIndex(VM::Block* newblock)
+{
+	const std::wstring& arrayname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ArrayMaxIndex(arrayname)));
+}
+
+void FileLoader::DecodeConsMappedArray(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ConsMappedArray(elementtype)));
+}
+
+void FileLoader::DecodeConsArrayIndirect(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+
+	unsigned char op = ReadInstruction();
+	GenerateOpFromByteCode(op, newblock);
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ConsArrayIndirect(elementtype, newblock->PopTailOperation().release())));
+}
+
+void FileLoader::DecodeChannel(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::CreateChannel(elementtype)));
+}
+
+void FileLoader::DecodeChannelSend(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::SendChannel(elementtype)));
+}
+
+void FileLoader::DecodeChannelReceive(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ReceiveChannel(elementtype)));
+}
+
+void FileLoader::DecodeConsHashMap(VM::Block* newblock)
+{
+	VM::EpochVariableTypeID keytype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	VM::EpochVariableTypeID valuetype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ConsHashMap(keytype, valuetype)));
+}
+
+void FileLoader::DecodeHashMapInsert(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapInsert(mapname)));
+}
+
+void FileLoader::DecodeHashMapLookup(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	VM::EpochVariableTypeID valuetype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapLookup(mapname, valuetype)));
+}
+
+void FileLoader::DecodeHashMapContains(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapContains(mapname)));
+}
+
+void FileLoader::DecodeHashMapErase(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapErase(mapname)));
+}
+
+void FileLoader::DecodeHashMapKeys(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	VM::EpochVariableTypeID keytype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapKeys(mapname, keytype)));
+}
+
+void FileLoader::DecodeHashMapSize(VM::Block* newblock)
+{
+	const std::wstring& mapname = ReadPooledString();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::HashMapSize(mapname)));
+}
+
+void FileLoader::DecodeElementwiseArithmetic(VM::Block* newblock)
+{
+	VM::Operations::ArithmeticOpType optype = static_cast<VM::Operations::ArithmeticOpType>(ReadNumber());
+	VM::EpochVariableTypeID elementtype = static_cast<VM::EpochVariableTypeID>(ReadNumber());
+	bool firstisarray = ReadFlag();
+	bool secondisarray = ReadFlag();
+	if(!IsPrepass)
+		newblock->AddOperation(VM::OperationPtr(new VM::Operations::ElementwiseArithmetic(optype, elementtype, firstisarray, secondisarray)));
 }
 
 //
@@ -1507,7 +2224,7 @@ void FileLoader::CheckExtensions()
 	unsigned numextensions = ReadNumber();
 	for(unsigned i = 0; i < numextensions; ++i)
 	{
-		const std::wstring& extensionname = WidenAndCache(ReadNullTerminatedString());
+		const std::wstring& extensionname = ReadPooledString();
 		if(IsPrepass)
 		{
 			Extensions::RegisterExtensionLibrary(extensionname, *LoadingProgram, false);
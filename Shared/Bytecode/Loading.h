@@ -19,9 +19,19 @@ class FileLoader;
 
 // Dependencies
 #include "Virtual Machine/Core Entities/Types/FunctionSignature.h"
+#include "Virtual Machine/Core Entities/Function.h"
+#include "Utility/Threading/Synchronization.h"
 
 
-class FileLoader
+//
+// Loader for converting a binary program into VM objects
+//
+// When deferred function loading is enabled, the loader must outlive
+// the program's execution, since function bodies are only decoded from
+// the buffer when they are first invoked; the buffer itself must also
+// remain valid throughout.
+//
+class FileLoader : public VM::DeferredCodeSource
 {
 // Construction and destruction
 public:
@@ -33,6 +43,10 @@ public:
 	VM::Program* GetProgram()
 	{ return LoadingProgram; }
 
+// Deferred function loading
+public:
+	virtual void LoadDeferredCodeBlock(VM::Function& function);
+
 // Internal helpers for cleanup
 private:
 	void Clean();
@@ -48,6 +62,141 @@ private:
 private:
 	void GenerateOpFromByteCode(unsigned char instruction, VM::Block* newblock);
 
+// Internal helpers for decoding individual instructions
+private:
+	typedef void (FileLoader::*InstructionDecoder)(VM::Block* newblock);
+
+	static const unsigned NumInstructionValues = 256;
+
+	struct InstructionDecoderTable
+	{
+		InstructionDecoderTable();
+		InstructionDecoder Decoders[NumInstructionValues];
+	};
+
+	static const InstructionDecoderTable DecoderTable;
+
+	void DecodePushOperation(VM::Block* newblock);
+	void DecodeTypedPushOperation(VM::Block* newblock);
+	void DecodeInvoke(VM::Block* newblock);
+	void DecodeDebugWrite(VM::Block* newblock);
+	void DecodePushRealLiteral(VM::Block* newblock);
+	void DecodeDivideReals(VM::Block* newblock);
+	void DecodePushIntegerLiteral(VM::Block* newblock);
+	void DecodeIsEqual(VM::Block* newblock);
+	void DecodeIsNotEqual(VM::Block* newblock);
+	void DecodeIsLesser(VM::Block* newblock);
+	void DecodeIsGreater(VM::Block* newblock);
+	void DecodeAssignValue(VM::Block* newblock);
+	void DecodeDoWhile(VM::Block* newblock);
+	void DecodeGetValue(VM::Block* newblock);
+	void DecodeMoveValue(VM::Block* newblock);
+	void DecodeIf(VM::Block* newblock);
+	void DecodeAddReals(VM::Block* newblock);
+	void DecodeSubReals(VM::Block* newblock);
+	void DecodePushBooleanLiteral(VM::Block* newblock);
+	void DecodePushStringLiteral(VM::Block* newblock);
+	void DecodeAddIntegers(VM::Block* newblock);
+	void DecodeSubtractIntegers(VM::Block* newblock);
+	void DecodeDebugRead(VM::Block* newblock);
+	void DecodeElseIf(VM::Block* newblock);
+	void DecodeExitIfChain(VM::Block* newblock);
+	void DecodeReadTuple(VM::Block* newblock);
+	void DecodeWriteTuple(VM::Block* newblock);
+	void DecodeReadStructure(VM::Block* newblock);
+	void DecodeWriteStructure(VM::Block* newblock);
+	void DecodeInit(VM::Block* newblock);
+	void DecodeBindFunctionReference(VM::Block* newblock);
+	void DecodeSizeOf(VM::Block* newblock);
+	void DecodeWhile(VM::Block* newblock);
+	void DecodeBindReference(VM::Block* newblock);
+	void DecodeWhileCondition(VM::Block* newblock);
+	void DecodeBreak(VM::Block* newblock);
+	void DecodeReturn(VM::Block* newblock);
+	void DecodeBitwiseAnd(VM::Block* newblock);
+	void DecodeBitwiseOr(VM::Block* newblock);
+	void DecodeBitwiseXor(VM::Block* newblock);
+	void DecodeBitwiseNot(VM::Block* newblock);
+	void DecodeLogicalAnd(VM::Block* newblock);
+	void DecodeLogicalOr(VM::Block* newblock);
+	void DecodeLogicalXor(VM::Block* newblock);
+	void DecodeLogicalNot(VM::Block* newblock);
+	void DecodeConcat(VM::Block* newblock);
+	void DecodeFindString(VM::Block* newblock);
+	void DecodeStringStartsWith(VM::Block* newblock);
+	void DecodeCompareStrings(VM::Block* newblock);
+	void DecodeSplitString(VM::Block* newblock);
+	void DecodeIsGreaterEqual(VM::Block* newblock);
+	void DecodePushInteger16Literal(VM::Block* newblock);
+	void DecodeInvokeIndirect(VM::Block* newblock);
+	void DecodeBooleanLiteral(VM::Block* newblock);
+	void DecodeBeginBlock(VM::Block* newblock);
+	void DecodeReadStructureIndirect(VM::Block* newblock);
+	void DecodeBindStruct(VM::Block* newblock);
+	void DecodeWriteStructureIndirect(VM::Block* newblock);
+	void DecodeForkTask(VM::Block* newblock);
+	void DecodeAcceptMessage(VM::Block* newblock);
+	void DecodeMultiplyIntegers(VM::Block* newblock);
+	void DecodeGetMessageSender(VM::Block* newblock);
+	void DecodeGetTaskCaller(VM::Block* newblock);
+	void DecodeSendTaskMessage(VM::Block* newblock);
+	void DecodeBroadcastTaskMessage(VM::Block* newblock);
+	void DecodeSendTaskRequest(VM::Block* newblock);
+	void DecodeReplyToRequest(VM::Block* newblock);
+	void DecodePendingReply(VM::Block* newblock);
+	void DecodeAcceptMessageFromMap(VM::Block* newblock);
+	void DecodeDelayedSendTaskMessage(VM::Block* newblock);
+	void DecodeAcceptMessageWithTimeout(VM::Block* newblock);
+	void DecodeTypeCastToString(VM::Block* newblock);
+	void DecodeDivideIntegers(VM::Block* newblock);
+	void DecodeTypeCast(VM::Block* newblock);
+	void DecodeFuture(VM::Block* newblock);
+	void DecodeMap(VM::Block* newblock);
+	void DecodeReduce(VM::Block* newblock);
+	void DecodeMapGenerator(VM::Block* newblock);
+	void DecodeReduceGenerator(VM::Block* newblock);
+	void DecodeIsLesserEqual(VM::Block* newblock);
+	void DecodeIntegerLiteral(VM::Block* newblock);
+	void DecodeThreadPool(VM::Block* newblock);
+	void DecodeForkThread(VM::Block* newblock);
+	void DecodeHandoff(VM::Block* newblock);
+	void DecodeHandoffControl(VM::Block* newblock);
+	void DecodeParallelFor(VM::Block* newblock);
+	void DecodeParallelInvoke(VM::Block* newblock);
+	void DecodeCreateGenerator(VM::Block* newblock);
+	void DecodeYieldValue(VM::Block* newblock);
+	void DecodeGeneratorHasNext(VM::Block* newblock);
+	void DecodeGeneratorNextValue(VM::Block* newblock);
+	void DecodeAtomicUpdate(VM::Block* newblock);
+	void DecodeAtomicUpdateArray(VM::Block* newblock);
+	void DecodeCancelFuture(VM::Block* newblock);
+	void DecodeDependentFuture(VM::Block* newblock);
+	void DecodeCancelPoolWork(VM::Block* newblock);
+	void DecodeReadArray(VM::Block* newblock);
+	void DecodeWriteArray(VM::Block* newblock);
+	void DecodeAppendArray(VM::Block* newblock);
+	void DecodeArrayLength(VM::Block* newblock);
+	void DecodeSortArray(VM::Block* newblock);
+	void DecodeSearchArray(VM::Block* newblock);
+	void DecodeArrayMinIndex(VM::Block* newblock);
+	void DecodeArrayMaxIndex(VM::Block* newblock);
+	void DecodeConsArrayIndirect(VM::Block* newblock);
+	void DecodeConsMappedArray(VM::Block* newblock);
+	void DecodeChannel(VM::Block* newblock);
+	void DecodeChannelSend(VM::Block* newblock);
+	void DecodeChannelReceive(VM::Block* newblock);
+	void DecodeConsHashMap(VM::Block* newblock);
+	void DecodeHashMapInsert(VM::Block* newblock);
+	void DecodeHashMapLookup(VM::Block* newblock);
+	void DecodeHashMapContains(VM::Block* newblock);
+	void DecodeHashMapErase(VM::Block* newblock);
+	void DecodeHashMapKeys(VM::Block* newblock);
+	void DecodeHashMapSize(VM::Block* newblock);
+	void DecodeElementwiseArithmetic(VM::Block* newblock);
+
+	void DecodeMapOperation(VM::Block* newblock, bool fromgenerator);
+	void DecodeReduceOperation(VM::Block* newblock, bool fromgenerator);
+
 // Internal helpers for reading data chunks
 private:
 	Integer32 ReadNumber();
@@ -55,6 +204,8 @@ private:
 	bool ReadFlag();
 	std::string ReadNullTerminatedString();
 	std::string ReadStringByLength(Integer32 len);
+	const std::wstring& ReadPooledString();
+	const std::wstring& ReadPooledString(Integer32 len);
 	unsigned char ReadInstruction();
 	unsigned char PeekInstruction();
 
@@ -75,10 +226,24 @@ private:
 	ptrdiff_t Offset;
 	VM::Program* LoadingProgram;
 	bool IsPrepass;
+	bool CompactNumbers;
 
 	std::map<ScopeID, VM::ScopeDescription*> ScopeIDMap;
 	std::map<FunctionID, VM::FunctionBase*> FunctionIDMap;
 
 	std::set<VM::ScopeDescription*> DeleteScopes;
+
+	std::map<ptrdiff_t, const std::wstring*> PooledStringLocations;
+
+	struct FunctionBodyLocation
+	{
+		ptrdiff_t Begin;
+		ptrdiff_t End;
+	};
+
+	bool DeferFunctionBodies;
+	std::map<FunctionID, FunctionBodyLocation> FunctionBodies;
+	std::map<const VM::Function*, ptrdiff_t> DeferredFunctionBodies;
+	Threads::CriticalSection DeferredLoadCriticalSection;
 };
 
@@ -9,22 +9,142 @@
 
 #include "Bytecode/Services.h"
 #include "Bytecode/Loading.h"
+#include "Bytecode/StartupImages.h"
+#include "Bytecode/Compression.h"
+#include "Bytecode/BytecodeExceptions.h"
 
 #include "Virtual Machine/Core Entities/Program.h"
+#include "Virtual Machine/JIT/NativeImages.h"
+
+#include "Optimizer/Optimizer.h"
 
 #include "User Interface/Output.h"
 
 #include "Utility/Files/Files.h"
 
+#include "Configuration/RuntimeOptions.h"
+
+
+namespace
+{
+
+	//
+	// Startup image which accompanies a binary being executed
+	//
+	struct StartupImage
+	{
+		std::string FileName;
+		UInteger32 BinaryHash;
+	};
+
+	//
+	// Apply a startup image to a loaded program, if the program can use one
+	//
+	// Returns true if an image should be written once the program has
+	// completed its global initialization.
+	//
+	bool PrepareStartupImage(VM::Program& program, const StartupImage& image)
+	{
+		if(!program.CanSnapshotGlobalStorage())
+			return false;
+
+		std::vector<Byte> snapshot;
+		if(StartupImages::Load(image.FileName, image.BinaryHash, snapshot))
+		{
+			program.RestoreGlobalStorageSnapshot(snapshot);
+			return false;
+		}
+
+		program.CaptureGlobalStorageSnapshot();
+		return true;
+	}
+
+	//
+	// Load and execute a binary program, optionally using a startup image
+	//
+	// Compressed bytecode is expanded before loading; the expanded copy
+	// must outlive the program, since function bodies may be loaded from
+	// the buffer lazily while the program is running.
+	//
+	bool ExecuteProgram(const void* buffer, const StartupImage* image)
+	{
+		std::vector<Byte> decompressed;
+		std::auto_ptr<VM::Program> program(new VM::Program);
+		std::auto_ptr<FileLoader> loader(NULL);
+
+		try
+		{
+			if(BytecodeCompression::IsCompressed(buffer))
+			{
+				BytecodeCompression::Decompress(buffer, decompressed);
+				if(decompressed.empty())
+					throw InvalidBytecodeException("Compressed bytecode is empty");
+				buffer = &decompressed[0];
+			}
+
+			loader.reset(new FileLoader(buffer, *program.get()));
+			BinaryServices::PrepareLoadedProgram(*loader, buffer);
+
+			bool saveimage = (image && PrepareStartupImage(*loader->GetProgram(), *image));
+
+			loader->GetProgram()->Execute();
+
+			if(saveimage)
+				StartupImages::Save(image->FileName, image->BinaryHash, loader->GetProgram()->GetGlobalStorageSnapshot());
+		}
+		catch(const std::exception& e)
+		{
+			UI::OutputStream output;
+			output << UI::lightred << L"ERROR: " << UI::resetcolor;
+			output << e.what() << std::endl;
+			::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
+			return false;
+		}
+		catch(...)
+		{
+			UI::OutputStream output;
+			output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
+			::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
+			return false;
+		}
+
+		return true;
+	}
+
+}
+
 
 //
 // Load a binary file into memory and execute it
 //
+// By default the file is mapped into memory and the loader reads the
+// bytecode in place, which avoids copying the entire file up front.
+//
 bool BinaryServices::ExecuteFile(const char* filename)
 {
+	StartupImage image;
+	image.FileName = StartupImages::GetImageFileName(filename);
+
+	if(Config::MemoryMapBinaries)
+	{
+		Files::MappedFile mapping(filename);
+		if(!mapping.GetSize())
+			throw FileException("Input file is empty");
+
+		if(!Config::UseStartupImages)
+			return ExecuteMemoryBuffer(mapping.GetData());
+
+		image.BinaryHash = StartupImages::HashBinary(mapping.GetData(), mapping.GetSize());
+		return ExecuteProgram(mapping.GetData(), &image);
+	}
+
 	std::vector<Byte> memory;
 	Files::Load(filename, memory);
-	return ExecuteMemoryBuffer(&memory[0]);
+	if(!Config::UseStartupImages)
+		return ExecuteMemoryBuffer(&memory[0]);
+
+	image.BinaryHash = StartupImages::HashBinary(&memory[0], memory.size());
+	return ExecuteProgram(&memory[0], &image);
 }
 
 //
@@ -32,30 +152,37 @@ bool BinaryServices::ExecuteFile(const char* filename)
 //
 bool BinaryServices::ExecuteMemoryBuffer(const void* buffer)
 {
-	std::auto_ptr<VM::Program> program(new VM::Program);
-	std::auto_ptr<FileLoader> loader(NULL);
+	return ExecuteProgram(buffer, NULL);
+}
 
-	try
-	{
-		loader.reset(new FileLoader(buffer, *program.get()));
-		loader->GetProgram()->Execute();
-	}
-	catch(const std::exception& e)
+
+//
+// Optimize a program freshly loaded from the given bytecode, so that it is ready to run
+//
+// Any precompiled code carried by the host executable is bound to the
+// program's functions at this point.
+//
+void BinaryServices::PrepareLoadedProgram(FileLoader& loader, const void* buffer)
+{
+	Optimizer::OptimizationTraverser optimizer;
+	loader.GetProgram()->Traverse(optimizer);
+
+	// Bytecode carries no debug information, so findings can't be given a location
+	const std::list<Optimizer::ParallelizationReport>& reports = optimizer.GetParallelizationReports();
+	if(!reports.empty())
 	{
 		UI::OutputStream output;
-		output << UI::lightred << L"ERROR: " << UI::resetcolor;
-		output << e.what() << std::endl;
-		::MessageBoxA(0, e.what(), Strings::WindowTitle, MB_ICONERROR);
-		return false;
+		for(std::list<Optimizer::ParallelizationReport>::const_iterator iter = reports.begin(); iter != reports.end(); ++iter)
+			output << L"Auto-parallelization: " << iter->Description << std::endl;
 	}
-	catch(...)
+
+	// Executables built by EXEGen may carry precompiled code for the program
+	if(Config::UseNativeImages)
 	{
-		UI::OutputStream output;
-		output << UI::lightred << L"ERROR: UNKNOWN EXCEPTION" << UI::resetcolor << std::endl;
-		::MessageBoxA(0, "Unknown error", Strings::WindowTitle, MB_ICONERROR);
-		return false;
+		size_t nativeimagesize = 0;
+		const void* nativeimage = VM::JIT::NativeImages::FindInHostExecutable(nativeimagesize);
+		if(nativeimage)
+			VM::JIT::NativeImages::Bind(nativeimage, nativeimagesize, optimizer.GetOptimizedFunctions(), buffer);
 	}
-
-	return true;
 }
 
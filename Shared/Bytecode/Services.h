@@ -8,9 +8,15 @@
 #pragma once
 
 
+// Forward declarations
+class FileLoader;
+
+
 namespace BinaryServices
 {
 	bool ExecuteFile(const char* filename);
 	bool ExecuteMemoryBuffer(const void* buffer);
+
+	void PrepareLoadedProgram(FileLoader& loader, const void* buffer);
 }
 
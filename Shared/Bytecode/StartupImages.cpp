@@ -0,0 +1,122 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Startup images which capture a program's state after global initialization
+//
+// An image is only valid for the exact binary it was produced from; the
+// binary's size and hash are stored in the image and checked on load,
+// so rebuilding the binary automatically invalidates any old image.
+// Likewise, images record whether they were produced with aligned
+// layouts, since the layout of global storage differs between modes.
+//
+
+#include "pch.h"
+
+#include "Bytecode/StartupImages.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include "Utility/Hashing.h"
+
+#include <fstream>
+
+
+namespace
+{
+	const char ImageCookie[] = "EpochIMG";
+	const UInteger32 ImageVersion = 2;
+
+	//
+	// Fixed header at the start of each image file
+	//
+	struct ImageHeader
+	{
+		char Cookie[sizeof(ImageCookie) - 1];
+		UInteger32 Version;
+		UInteger32 BinaryHash;
+		UInteger32 StorageSize;
+		UInteger32 AlignedLayout;
+	};
+}
+
+
+//
+// Compute a hash of the given binary, used to tie images to their binaries
+//
+// This is the 32-bit FNV-1a hash; it is cheap enough to compute on every
+// run and is more than adequate for detecting a changed binary.
+//
+UInteger32 StartupImages::HashBinary(const void* buffer, size_t size)
+{
+	return Hashing::HashBytes32(Hashing::FNV32OffsetBasis, buffer, size) ^ static_cast<UInteger32>(size);
+}
+
+//
+// Determine the name of the image file which accompanies the given binary
+//
+std::string StartupImages::GetImageFileName(const char* binaryfilename)
+{
+	return std::string(binaryfilename) + ".epi";
+}
+
+
+//
+// Load the global storage snapshot held in an image file
+//
+// Returns false if there is no image, or if the image does not belong
+// to the given binary.
+//
+bool StartupImages::Load(const std::string& filename, UInteger32 binaryhash, std::vector<Byte>& globalstorage)
+{
+	std::ifstream infile(filename.c_str(), std::ios::binary);
+	if(!infile)
+		return false;
+
+	ImageHeader header;
+	infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if(!infile)
+		return false;
+
+	if(memcmp(header.Cookie, ImageCookie, sizeof(header.Cookie)) != 0 || header.Version != ImageVersion || header.BinaryHash != binaryhash)
+		return false;
+
+	if(header.AlignedLayout != static_cast<UInteger32>(Config::AlignedLayout))
+		return false;
+
+	globalstorage.resize(header.StorageSize);
+	if(header.StorageSize)
+	{
+		infile.read(reinterpret_cast<char*>(&globalstorage[0]), static_cast<std::streamsize>(header.StorageSize));
+		if(!infile)
+			return false;
+	}
+
+	return true;
+}
+
+//
+// Write an image file holding the given global storage snapshot
+//
+// Images only serve to speed up later runs, so failing to write one
+// (for instance because the binary lives in a read-only location) is
+// not treated as an error.
+//
+void StartupImages::Save(const std::string& filename, UInteger32 binaryhash, const std::vector<Byte>& globalstorage)
+{
+	std::ofstream outfile(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if(!outfile)
+		return;
+
+	ImageHeader header;
+	memcpy(header.Cookie, ImageCookie, sizeof(header.Cookie));
+	header.Version = ImageVersion;
+	header.BinaryHash = binaryhash;
+	header.StorageSize = static_cast<UInteger32>(globalstorage.size());
+	header.AlignedLayout = static_cast<UInteger32>(Config::AlignedLayout);
+
+	outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if(!globalstorage.empty())
+		outfile.write(reinterpret_cast<const char*>(&globalstorage[0]), static_cast<std::streamsize>(globalstorage.size()));
+}
+
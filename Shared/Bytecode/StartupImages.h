@@ -0,0 +1,20 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Startup images which capture a program's state after global initialization
+//
+
+#pragma once
+
+
+namespace StartupImages
+{
+	UInteger32 HashBinary(const void* buffer, size_t size);
+
+	std::string GetImageFileName(const char* binaryfilename);
+
+	bool Load(const std::string& filename, UInteger32 binaryhash, std::vector<Byte>& globalstorage);
+	void Save(const std::string& filename, UInteger32 binaryhash, const std::vector<Byte>& globalstorage);
+}
+
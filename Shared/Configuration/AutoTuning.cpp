@@ -0,0 +1,106 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Automatic tuning of runtime options based on observed resource usage
+//
+
+#include "pch.h"
+
+#include "Configuration/AutoTuning.h"
+#include "Configuration/RuntimeOptions.h"
+
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/Synchronization.h"
+
+
+namespace
+{
+
+	// Upper bounds on the values chosen by the tuning logic
+	const size_t MaxTunedStackSize = 64 * 1024 * 1024;
+	const unsigned MaxTunedMessageSlots = 65536;
+	const unsigned MaxPoolThreadsPerProcessor = 4;
+
+	// Average claim latencies, in milliseconds, which cause the shared pool to be resized
+	const double GrowPoolLatency = 2.0;
+	const double ShrinkPoolLatency = 0.1;
+
+	Threads::CriticalSection TuningCritSec;
+
+
+	//
+	// Change a runtime option, keeping the value within the option's limits
+	//
+	// Adjustments go through the same path as explicit changes, so the
+	// tuning logic can never pick a value the option does not accept.
+	//
+	void AdjustOption(const wchar_t* name, size_t value)
+	{
+		unsigned minimum, maximum;
+		if(!Config::GetRuntimeOptionLimits(name, minimum, maximum))
+			return;
+
+		value = std::min(std::max(value, static_cast<size_t>(minimum)), static_cast<size_t>(maximum));
+		Config::SetRuntimeOption(name, static_cast<unsigned>(value));
+	}
+
+}
+
+
+//
+// Take note of the deepest point reached by a stack which is being released
+//
+// This is called for every stack, so the common case of a stack which
+// stayed well within the default size is checked before taking the lock.
+//
+void Config::AutoTuning::RecordStackUsage(size_t peakbytes)
+{
+	if(!Config::AutoTuneRuntime || peakbytes * 2 <= Config::StackSize)
+		return;
+
+	Threads::CriticalSection::Auto mutex(TuningCritSec);
+
+	size_t newsize = std::max<size_t>(Config::StackSize, 1);
+	while(peakbytes * 2 > newsize && newsize < MaxTunedStackSize)
+		newsize *= 2;
+
+	AdjustOption(L"stacksize", std::min(newsize, MaxTunedStackSize));
+}
+
+//
+// Take note of the usage of a mailbox whose task has ended
+//
+void Config::AutoTuning::RecordMailboxUsage(const MailboxStatistics& stats)
+{
+	if(!Config::AutoTuneRuntime)
+		return;
+
+	if(stats.HighWaterMark < stats.Capacity && !stats.NumDropped && !stats.NumRejected)
+		return;
+
+	Threads::CriticalSection::Auto mutex(TuningCritSec);
+
+	if(Config::NumMessageSlots <= stats.Capacity && stats.Capacity < MaxTunedMessageSlots)
+		AdjustOption(L"messageslots", std::min(stats.Capacity * 2, MaxTunedMessageSlots));
+}
+
+//
+// Take note of how well a program's shared pool kept up with its work
+//
+void Config::AutoTuning::RecordSharedPoolUsage(unsigned numworkers, double averageclaimlatencyms, unsigned numprocessors)
+{
+	if(!Config::AutoTuneRuntime)
+		return;
+
+	numprocessors = std::max(numprocessors, 1u);
+	unsigned maxworkers = numprocessors * MaxPoolThreadsPerProcessor;
+
+	Threads::CriticalSection::Auto mutex(TuningCritSec);
+
+	if(averageclaimlatencyms > GrowPoolLatency && numworkers < maxworkers)
+		AdjustOption(L"sharedpoolthreads", std::min(numworkers + std::max(numprocessors / 2, 1u), maxworkers));
+	else if(averageclaimlatencyms < ShrinkPoolLatency && numworkers > numprocessors)
+		AdjustOption(L"sharedpoolthreads", numworkers - 1);
+}
+
@@ -0,0 +1,48 @@
+//
+// The Epoch Language Project
+// FUGUE Virtual Machine
+//
+// Automatic tuning of runtime options based on observed resource usage
+//
+// When Config::AutoTuneRuntime is set, the VM keeps an eye on a few
+// resources whose ideal sizes depend heavily on the workload, and adjusts
+// the corresponding options so that resources created later fit better:
+//
+//  - Stacks: the committed size of a stack when it is released is its
+//    high-water mark. Whenever a stack gets within half of the default
+//    stack size, the default is doubled, so that deep recursion in one
+//    task gives later tasks more headroom.
+//
+//  - Mailboxes: if a task's mailbox filled up at any point during its
+//    lifetime, the number of message slots is doubled. Mailboxes kept by
+//    parked task threads are enlarged when handed to their next task.
+//
+//  - The shared worker pool: when a program's shared pool is torn down,
+//    the average time work items waited to be claimed is used to size the
+//    shared pool of the next program. Long waits add workers (which helps
+//    when work items block on one another); very short waits with more
+//    workers than processors remove them again.
+//
+// All of the adjustments are bounded, and the values set through the
+// config file or Config::SetRuntimeOption act as the starting point.
+//
+
+#pragma once
+
+
+// Forward declarations
+struct MailboxStatistics;
+
+
+namespace Config
+{
+
+	namespace AutoTuning
+	{
+		void RecordStackUsage(size_t peakbytes);
+		void RecordMailboxUsage(const MailboxStatistics& stats);
+		void RecordSharedPoolUsage(unsigned numworkers, double averageclaimlatencyms, unsigned numprocessors);
+	}
+
+}
+
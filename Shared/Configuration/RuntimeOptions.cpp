@@ -14,28 +14,425 @@
 
 
 // Flag controlling whether or not we output trace data when parsing code
-// Note that this is ignored in release builds of the VM, which never trace
+// Tracing is available in all builds, but is only on by default in debug builds
+#ifdef _DEBUG
 bool Config::TraceParserExecution = true;
+#else
+bool Config::TraceParserExecution = false;
+#endif
 
 // Flag controlling whether or not we output trace data when validating code
-// Note that this is ignored in release builds of the VM, which never trace
+// Tracing is available in all builds, but is only on by default in debug builds
+#ifdef _DEBUG
 bool Config::TraceValidatorExecution = true;
+#else
+bool Config::TraceValidatorExecution = false;
+#endif
+
+// Flag controlling whether or not each operation's calls, cycles, and r-value
+// allocations are measured while running programs from source; the results are
+// written alongside the source file when the program exits
+bool Config::InstrumentOperations = false;
+
+// Flag controlling whether instrumented runs also read the processor's hardware
+// performance counters; see Virtual Machine/Profiling/Instrumentation.h
+bool Config::InstrumentHardwareCounters = false;
+
+// Performance counters (numbered as for the RDPMC instruction) which the OS or
+// a driver has programmed to count cache misses and mispredicted branches
+unsigned Config::CacheMissCounterIndex = 0;
+unsigned Config::BranchMissCounterIndex = 1;
+
+
+// Flag controlling whether the first parse pass skips over the contents of
+// function bodies, and only records the declarations needed by the second
+// pass; this makes parsing faster, but syntax errors inside of function
+// bodies are reported with less detail
+bool Config::SkimFunctionBodies = false;
 
 
 // Space reserved for the execution stack, in bytes (default is 1MB)
 // Each forked task will get this amount of stack space as well
+// Only the portion of the stack actually in use is committed to memory
 size_t Config::StackSize = (1024 * 1024);
 
+// Number of string, array, and buffer allocations which may be made
+// before the garbage collector runs to reclaim unused data; setting
+// this to zero disables garbage collection entirely
+unsigned Config::GarbageCollectionThreshold = 4096;
+
+// Flag controlling whether structures, tuples, and stack frames pad their
+// members to natural alignment, rather than packing them tightly; aligned
+// layouts use a little more memory but avoid misaligned loads and stores
+bool Config::AlignedLayout = false;
+
+// Approximate amount of a file-backed array which is mapped into memory at
+// a time, in bytes (default is 16MB); each window is rounded to a multiple
+// of the system's allocation granularity, and a few windows are kept mapped
+// at once, so this bounds the address space used by each such array
+size_t Config::MappedArrayWindowSize = (16 * 1024 * 1024);
+
+// Flag controlling whether strings which survive a garbage collection are
+// stored with one byte per character (when every character fits in Latin-1)
+// rather than two; the wide form is rebuilt on demand when the string is read
+bool Config::CompactStrings = false;
+
+
+// Flag controlling whether the optimizer precomputes expressions over
+// constant values and removes operations which have no effect
+bool Config::FoldConstants = true;
+
+// Flag controlling whether the optimizer replaces common sequences
+// of simple operations with equivalent fused operations
+bool Config::FuseOperations = true;
+
+// Flag controlling whether the optimizer replaces if/elseif chains over
+// integer equality tests with switches; this relies on operation fusion
+bool Config::BuildJumpTables = true;
+
+// Flag controlling whether the optimizer hands consecutive extension control
+// blocks over the same literal range (such as cudafor loops) to the extension
+// together, so that they can share their transfers to and from the device
+bool Config::FuseHandoffs = true;
+
+// Flag controlling whether code blocks are lowered into linear instruction
+// streams before execution, instead of dispatching over the operation tree
+bool Config::UseInstructionStreams = false;
+
+// Flag controlling whether hot functions are compiled to native code, and
+// the hotness (calls plus while loop iterations) a function must reach first
+bool Config::UseJITCompiler = false;
+unsigned Config::JITThreshold = 1000;
+
+// Flag controlling whether the optimizer switches small, simple functions
+// over to inline calls, which reuse the function's activated scopes
+bool Config::InlineFunctions = true;
+
+// Flag controlling whether the optimizer moves values which cannot change
+// between iterations of a while loop out of the loop's body
+bool Config::HoistLoopInvariants = true;
+
+// Flag controlling whether the optimizer looks for loops and map calls
+// which pass the task safety checks, and reports what it finds; map
+// calls which pass are committed to parallel execution during loading
+bool Config::AutoParallelize = false;
+
+// Interval in milliseconds between samples taken by the built-in profiler
+// when running programs from source; 0 disables profiling entirely
+unsigned Config::ProfilerSampleInterval = 0;
+
+// Flag controlling whether allocations are attributed to the source
+// locations which made them when running programs from source, and a
+// report of the memory held by the VM is written once the program exits
+bool Config::MemoryReport = false;
+
 
 // Number of pre-allocated message slots in the inter-thread mailboxes
 unsigned Config::NumMessageSlots = 64;
 
+// Behavior when a message is sent to a task whose mailbox is full
+//  0 - block: the sender waits until the receiver frees up a slot; green
+//      tasks park until then, and tasks sending to themselves fail instead
+//  1 - drop oldest: the oldest pending message is discarded
+//  2 - fail: the send fails with an error
+unsigned Config::MailboxOverflowMode = 2;
+
+// Flag controlling whether tasks can receive messages from other VM
+// processes on the same machine; when set, each task forked by name gets
+// a mailbox in named shared memory, and messages sent to task names that
+// are not known locally are looked up among the shared mailboxes
+bool Config::ShareTaskMailboxes = false;
+
+// Largest size in bytes of an encoded message passed through a shared
+// mailbox, including its name and payload; larger messages are rejected
+unsigned Config::SharedMessageSize = 1024;
+
+// TCP port on which this VM accepts links from other nodes for passing
+// messages between tasks on different machines; 0 disables networking
+unsigned Config::NodePort = 0;
+
+// Path of a text file listing the other nodes to link up with, one node
+// per line in the form host:port; only used when NodePort is set
+std::wstring Config::NodeDirectory;
+
+// Largest number of messages written to a node link in a single batch
+unsigned Config::NetworkBatchSize = 64;
+
+// Interval in milliseconds between dumps of the concurrency statistics
+// (mailbox, thread pool, and wait timings) to the console while programs
+// run; 0 disables the dumps. The statistics are gathered regardless, and
+// can also be queried through the VM DLL.
+unsigned Config::TelemetryDumpInterval = 0;
+
+// Flag controlling whether task, work item, message, and wait events are
+// traced while programs run; the trace is written alongside the program
+// file in the Chrome trace event format once the program exits
+bool Config::TraceEvents = false;
+
+// Number of events kept by the tracing ring buffer; once it fills up,
+// the oldest events are overwritten
+unsigned Config::TraceBufferSize = 65536;
+
+// Flag controlling whether debug messages written by programs are buffered
+// per thread and written to the console in batches by a background thread,
+// rather than being written immediately by the thread which produced them
+bool Config::BufferDebugOutput = false;
+
+// Maximum interval in milliseconds between writes of buffered debug messages
+unsigned Config::DebugOutputFlushInterval = 50;
+
+// Flag controlling whether forked tasks run as green tasks, which share
+// the worker threads of the shared pool, instead of each task getting a
+// dedicated OS thread
+bool Config::UseGreenTasks = false;
+
+// Amount of native stack space reserved for each green task
+size_t Config::GreenTaskStackSize = (256 * 1024);
+
+// Amount of native stack space reserved for the body of each generator
+size_t Config::GeneratorStackSize = (256 * 1024);
+
+// Maximum number of idle OS threads kept parked after their tasks end,
+// ready to run newly forked tasks; zero disables the cache
+unsigned Config::TaskThreadCacheSize = 16;
+
+
+// Scheduling mode used to hand out the iterations of parallel loops
+//  0 - static: each work item gets a fixed, equally sized range up front
+//  1 - dynamic: work items repeatedly take ranges of the grain size
+//  2 - guided: as dynamic, but ranges start large and shrink towards the
+//      grain size as the loop nears completion
+unsigned Config::ParallelForScheduling = 2;
+
+// Minimum number of iterations taken at a time by a parallel loop work
+// item when using dynamic or guided scheduling
+unsigned Config::ParallelForGrainSize = 1;
+
+// Minimum number of array elements for map and reduce operations to be
+// split across the shared worker pool; smaller arrays (and all arrays,
+// when set to 0) are processed sequentially on the calling thread
+unsigned Config::ParallelMapReduceThreshold = 1024;
+
+// Minimum number of array elements for map and reduce operations to be
+// handed to a language extension which can run them on a device such as
+// a GPU; below this size, transferring the array to the device costs more
+// than it saves. Setting this to zero keeps all map and reduce operations
+// on the CPU.
+unsigned Config::DeviceMapReduceThreshold = 65536;
+
+// Minimum number of array elements for sortarray() to sort pieces of the
+// array in parallel on the shared worker pool before merging them; smaller
+// arrays (and all arrays, when set to 0) are sorted on the calling thread
+unsigned Config::ParallelSortThreshold = 16384;
+
+// Minimum number of functions a scope must contain for the validator to
+// check them in parallel on the shared worker pool; setting this to zero
+// (the default) always validates sequentially
+unsigned Config::ParallelValidationThreshold = 0;
+
+// Skip validating functions whose source text (and the set of global variables
+// they might touch) is unchanged since they last passed validation within this
+// process; this mostly benefits hosts which compile the same program repeatedly
+bool Config::IncrementalValidation = true;
+
+// Placement of thread pool worker threads on the machine's processors
+//  0 - unrestricted: workers may run on any processor
+//  1 - node local: each worker stays on the processors of one NUMA
+//      node, so that its stack and heap are allocated from that node
+//  2 - pinned: each worker is tied to a single processor
+unsigned Config::PoolWorkerPlacement = 0;
+
+// Number of worker threads in the shared pool which only run tasks and other
+// normal priority work, and never pick up chunks of batch work such as parallel
+// for loops; this bounds the latency of tasks while batch work is running. At
+// least one worker is always left free for batch work.
+unsigned Config::ReservedPoolWorkers = 0;
+
+// Number of worker threads in the shared pool; 0 (the default) creates one
+// worker per processor. The shared pool is created when a program first
+// needs it, so changing this affects programs started afterwards.
+unsigned Config::SharedPoolThreads = 0;
+
+// Flag controlling whether the VM adjusts the stack size, message slot count,
+// and shared pool size by itself, based on how programs actually use them;
+// see AutoTuning.h. Values which are set explicitly act as the starting point.
+bool Config::AutoTuneRuntime = false;
+
+
+// Flag controlling whether /execsource keeps a compiled binary of each
+// source file it runs, and reuses it while the file remains unchanged
+bool Config::CacheParsedSources = false;
+
+// Flag controlling whether binaries are executed directly from a read-only
+// mapping of the file, rather than first being copied into memory
+bool Config::MemoryMapBinaries = true;
+
+// Flag controlling whether the bodies of functions in binaries are only
+// decoded the first time each function is invoked; functions which are
+// never called then cost nothing beyond the initial scan of the file
+bool Config::DeferFunctionLoading = false;
+
+// Flag controlling whether generated binaries store integers in a compact
+// variable-length form, which makes typical binaries considerably smaller
+bool Config::CompactBytecode = false;
+
+// Flag controlling whether project builds write each source file's
+// assembly code to the intermediates directory; otherwise the code is
+// passed straight from the compiler to the assembler in memory
+bool Config::KeepAssemblyListings = false;
+
+// Flag controlling whether executed binaries keep a startup image next
+// to the binary file, holding the global variables as they stand after
+// global initialization; later runs restore the image instead of running
+// the initialization code again. Only programs whose globals are plain
+// scalars set up by simple expressions can use an image.
+bool Config::UseStartupImages = false;
+
+// Flag controlling whether constant expressions are folded when a binary
+// is compiled, rather than each time the binary is loaded. Binaries built
+// this way are marked so that the loader skips the folding pass.
+bool Config::PreoptimizeBinaries = false;
+
+// Flag controlling whether EXEGen updates an existing executable in place,
+// writing only the bytes which differ from the previous build; rebuilds
+// which only change the Epoch bytecode then touch little more than the
+// bytecode section and the headers describing its size
+bool Config::IncrementalLinking = false;
+
+// Flag controlling whether EXEGen compiles the functions of a program into
+// native code ahead of time, embedding the code in the executable; only
+// functions the JIT compiler could handle are compiled this way
+bool Config::EmbedNativeCode = false;
+
+// Flag controlling whether EXEGen compresses the bytecode it embeds in an
+// executable; this shrinks the file at the cost of expanding the code
+// into memory each time the program starts
+bool Config::CompressEmbeddedBytecode = false;
+
+// Flag controlling whether EXEGen keeps the resource section it compiles
+// for an executable, and reuses it while the resource scripts and the
+// files they refer to remain unchanged
+bool Config::CacheCompiledResources = true;
+
+// Flag controlling whether executables use the native code embedded in
+// them by EXEGen, rather than interpreting every function
+bool Config::UseNativeImages = true;
+
+// Flag controlling whether language extensions are prepared for execution
+// on a background thread as soon as the program starts; otherwise each
+// extension is prepared when the program first runs code which uses it
+bool Config::WarmUpExtensions = false;
+
+// Flag controlling whether the external DLLs called by a program are loaded
+// on background threads as soon as the program starts, rather than each one
+// being loaded in the middle of execution by the first call into it
+bool Config::PreloadDLLs = true;
+
 
 // Default width of a tab (in spaces)
 unsigned Config::TabWidth = 4;
 
 
 
+namespace
+{
+
+	//
+	// Options which may be changed while programs are running
+	//
+	// Each of these is only read when the resource it governs is created
+	// (a stack, a mailbox, a pool, and so on), so a change affects only
+	// resources created from then on. Options are addressed by the same
+	// names used in the config file, and each accepts values within the
+	// given inclusive range only.
+	//
+	struct AdjustableOption
+	{
+		const wchar_t* Name;
+		unsigned* UnsignedValue;
+		size_t* SizeValue;
+		bool* BooleanValue;
+		unsigned MinValue;
+		unsigned MaxValue;
+	};
+
+	// Limits shared by several options
+	const unsigned MinStackSize = 64 * 1024;
+	const unsigned MaxStackSize = 256 * 1024 * 1024;
+	const unsigned MaxMessageSlots = 1024 * 1024;
+	const unsigned MaxPoolThreads = 1024;
+	const unsigned Unlimited = std::numeric_limits<unsigned>::max();
+
+	const AdjustableOption AdjustableOptions[] =
+	{
+		{ L"stacksize", NULL, &Config::StackSize, NULL, MinStackSize, MaxStackSize },
+		{ L"greentaskstacksize", NULL, &Config::GreenTaskStackSize, NULL, MinStackSize, MaxStackSize },
+		{ L"generatorstacksize", NULL, &Config::GeneratorStackSize, NULL, MinStackSize, MaxStackSize },
+		{ L"gcthreshold", &Config::GarbageCollectionThreshold, NULL, NULL, 0, Unlimited },
+		{ L"messageslots", &Config::NumMessageSlots, NULL, NULL, 1, MaxMessageSlots },
+		{ L"taskthreadcache", &Config::TaskThreadCacheSize, NULL, NULL, 0, MaxPoolThreads },
+		{ L"parallelforgrainsize", &Config::ParallelForGrainSize, NULL, NULL, 1, Unlimited },
+		{ L"parallelmapreducethreshold", &Config::ParallelMapReduceThreshold, NULL, NULL, 0, Unlimited },
+		{ L"parallelsortthreshold", &Config::ParallelSortThreshold, NULL, NULL, 0, Unlimited },
+		{ L"sharedpoolthreads", &Config::SharedPoolThreads, NULL, NULL, 0, MaxPoolThreads },
+		{ L"reservedpoolworkers", &Config::ReservedPoolWorkers, NULL, NULL, 0, MaxPoolThreads },
+		{ L"autotune", NULL, NULL, &Config::AutoTuneRuntime, 0, 1 }
+	};
+
+	const size_t NumAdjustableOptions = sizeof(AdjustableOptions) / sizeof(AdjustableOptions[0]);
+
+	const AdjustableOption* FindAdjustableOption(const std::wstring& name)
+	{
+		for(size_t i = 0; i < NumAdjustableOptions; ++i)
+		{
+			if(name == AdjustableOptions[i].Name)
+				return &AdjustableOptions[i];
+		}
+
+		return NULL;
+	}
+
+	//
+	// Store a value in an adjustable option, without checking its range
+	//
+	void StoreOption(const AdjustableOption& option, unsigned value)
+	{
+		if(option.UnsignedValue)
+			*option.UnsignedValue = value;
+		else if(option.SizeValue)
+			*option.SizeValue = value;
+		else
+			*option.BooleanValue = (value != 0);
+	}
+
+	//
+	// Retrieve the value of an adjustable option
+	//
+	unsigned LoadOption(const AdjustableOption& option)
+	{
+		if(option.UnsignedValue)
+			return *option.UnsignedValue;
+		else if(option.SizeValue)
+			return static_cast<unsigned>(std::min<size_t>(*option.SizeValue, Unlimited));
+
+		return (*option.BooleanValue ? 1 : 0);
+	}
+
+	//
+	// Pull any adjustable options which were set out of range back within their limits
+	//
+	void ClampAdjustableOptions()
+	{
+		for(size_t i = 0; i < NumAdjustableOptions; ++i)
+		{
+			unsigned value = LoadOption(AdjustableOptions[i]);
+			StoreOption(AdjustableOptions[i], std::min(std::max(value, AdjustableOptions[i].MinValue), AdjustableOptions[i].MaxValue));
+		}
+	}
+
+}
+
+
 //
 // Load the configuration options from an external config file
 // If any particular option is not present in the config file,
@@ -47,11 +444,130 @@ void Config::LoadFromConfigFile()
 	
 	config.ReadConfig(L"traceparser", Config::TraceParserExecution);
 	config.ReadConfig(L"tracevalidator", Config::TraceValidatorExecution);
+	config.ReadConfig(L"instrumentops", Config::InstrumentOperations);
+	config.ReadConfig(L"instrumentpmu", Config::InstrumentHardwareCounters);
+	config.ReadConfig(L"pmucachemisscounter", Config::CacheMissCounterIndex);
+	config.ReadConfig(L"pmubranchmisscounter", Config::BranchMissCounterIndex);
+
+	config.ReadConfig(L"skimfunctionbodies", Config::SkimFunctionBodies);
 
 	config.ReadConfig(L"stacksize", Config::StackSize);
+	config.ReadConfig(L"gcthreshold", Config::GarbageCollectionThreshold);
+	config.ReadConfig(L"alignedlayout", Config::AlignedLayout);
+	config.ReadConfig(L"mappedarraywindow", Config::MappedArrayWindowSize);
+	config.ReadConfig(L"compactstrings", Config::CompactStrings);
+
+	config.ReadConfig(L"foldconstants", Config::FoldConstants);
+	config.ReadConfig(L"fuseoperations", Config::FuseOperations);
+	config.ReadConfig(L"buildjumptables", Config::BuildJumpTables);
+	config.ReadConfig(L"fusehandoffs", Config::FuseHandoffs);
+	config.ReadConfig(L"instructionstreams", Config::UseInstructionStreams);
+	config.ReadConfig(L"jitcompiler", Config::UseJITCompiler);
+	config.ReadConfig(L"jitthreshold", Config::JITThreshold);
+	config.ReadConfig(L"inlinefunctions", Config::InlineFunctions);
+	config.ReadConfig(L"hoistloopinvariants", Config::HoistLoopInvariants);
+	config.ReadConfig(L"autoparallelize", Config::AutoParallelize);
+
+	config.ReadConfig(L"profileinterval", Config::ProfilerSampleInterval);
+	config.ReadConfig(L"memoryreport", Config::MemoryReport);
 
 	config.ReadConfig(L"messageslots", Config::NumMessageSlots);
+	config.ReadConfig(L"mailboxoverflow", Config::MailboxOverflowMode);
+	config.ReadConfig(L"sharetaskmailboxes", Config::ShareTaskMailboxes);
+	config.ReadConfig(L"sharedmessagesize", Config::SharedMessageSize);
+	config.ReadConfig(L"nodeport", Config::NodePort);
+	Config::NodeDirectory = config.ReadConfig<std::wstring>(L"nodedirectory");
+	config.ReadConfig(L"networkbatchsize", Config::NetworkBatchSize);
+	config.ReadConfig(L"telemetryinterval", Config::TelemetryDumpInterval);
+	config.ReadConfig(L"traceevents", Config::TraceEvents);
+	config.ReadConfig(L"tracebuffersize", Config::TraceBufferSize);
+	config.ReadConfig(L"bufferdebugoutput", Config::BufferDebugOutput);
+	config.ReadConfig(L"debugoutputflushinterval", Config::DebugOutputFlushInterval);
+
+	config.ReadConfig(L"greentasks", Config::UseGreenTasks);
+	config.ReadConfig(L"greentaskstacksize", Config::GreenTaskStackSize);
+	config.ReadConfig(L"generatorstacksize", Config::GeneratorStackSize);
+	config.ReadConfig(L"taskthreadcache", Config::TaskThreadCacheSize);
+
+	config.ReadConfig(L"parallelforscheduling", Config::ParallelForScheduling);
+	config.ReadConfig(L"parallelforgrainsize", Config::ParallelForGrainSize);
+	config.ReadConfig(L"parallelmapreducethreshold", Config::ParallelMapReduceThreshold);
+	config.ReadConfig(L"devicemapreducethreshold", Config::DeviceMapReduceThreshold);
+	config.ReadConfig(L"parallelsortthreshold", Config::ParallelSortThreshold);
+	config.ReadConfig(L"parallelvalidationthreshold", Config::ParallelValidationThreshold);
+	config.ReadConfig(L"incrementalvalidation", Config::IncrementalValidation);
+
+	config.ReadConfig(L"poolworkerplacement", Config::PoolWorkerPlacement);
+	config.ReadConfig(L"reservedpoolworkers", Config::ReservedPoolWorkers);
+	config.ReadConfig(L"sharedpoolthreads", Config::SharedPoolThreads);
+	config.ReadConfig(L"autotune", Config::AutoTuneRuntime);
+
+	config.ReadConfig(L"parsecache", Config::CacheParsedSources);
+	config.ReadConfig(L"mapbinaries", Config::MemoryMapBinaries);
+	config.ReadConfig(L"deferfunctionloading", Config::DeferFunctionLoading);
+	config.ReadConfig(L"compactbytecode", Config::CompactBytecode);
+	config.ReadConfig(L"keepassembly", Config::KeepAssemblyListings);
+	config.ReadConfig(L"startupimages", Config::UseStartupImages);
+	config.ReadConfig(L"preoptimizebinaries", Config::PreoptimizeBinaries);
+	config.ReadConfig(L"incrementallink", Config::IncrementalLinking);
+	config.ReadConfig(L"embednativecode", Config::EmbedNativeCode);
+	config.ReadConfig(L"compressbytecode", Config::CompressEmbeddedBytecode);
+	config.ReadConfig(L"resourcecache", Config::CacheCompiledResources);
+	config.ReadConfig(L"nativeimages", Config::UseNativeImages);
+	config.ReadConfig(L"warmupextensions", Config::WarmUpExtensions);
+	config.ReadConfig(L"preloaddlls", Config::PreloadDLLs);
 
 	config.ReadConfig(L"tabwidth", Config::TabWidth);
+
+	ClampAdjustableOptions();
+}
+
+
+//
+// Change one of the options which may be adjusted at runtime
+//
+// Returns false, leaving the option unchanged, if the option does not
+// exist or the value lies outside of the range the option accepts.
+//
+bool Config::SetRuntimeOption(const std::wstring& name, unsigned value)
+{
+	const AdjustableOption* option = FindAdjustableOption(name);
+	if(!option)
+		return false;
+
+	if(value < option->MinValue || value > option->MaxValue)
+		return false;
+
+	StoreOption(*option, value);
+	return true;
+}
+
+//
+// Retrieve the current value of one of the options which may be adjusted at runtime
+//
+// This reflects any adjustments made by the auto-tuning logic.
+//
+bool Config::GetRuntimeOption(const std::wstring& name, unsigned& value)
+{
+	const AdjustableOption* option = FindAdjustableOption(name);
+	if(!option)
+		return false;
+
+	value = LoadOption(*option);
+	return true;
+}
+
+//
+// Retrieve the range of values accepted by one of the options which may be adjusted at runtime
+//
+bool Config::GetRuntimeOptionLimits(const std::wstring& name, unsigned& minimum, unsigned& maximum)
+{
+	const AdjustableOption* option = FindAdjustableOption(name);
+	if(!option)
+		return false;
+
+	minimum = option->MinValue;
+	maximum = option->MaxValue;
+	return true;
 }
 
@@ -17,13 +17,87 @@ namespace Config
 
 	void LoadFromConfigFile();
 
+	bool SetRuntimeOption(const std::wstring& name, unsigned value);
+	bool GetRuntimeOption(const std::wstring& name, unsigned& value);
+	bool GetRuntimeOptionLimits(const std::wstring& name, unsigned& minimum, unsigned& maximum);
+
 
 	extern bool TraceParserExecution;
 	extern bool TraceValidatorExecution;
+	extern bool InstrumentOperations;
+	extern bool InstrumentHardwareCounters;
+	extern unsigned CacheMissCounterIndex;
+	extern unsigned BranchMissCounterIndex;
+
+	extern bool SkimFunctionBodies;
 
 	extern size_t StackSize;
+	extern unsigned GarbageCollectionThreshold;
+	extern bool AlignedLayout;
+	extern size_t MappedArrayWindowSize;
+	extern bool CompactStrings;
+
+	extern bool FoldConstants;
+	extern bool FuseOperations;
+	extern bool BuildJumpTables;
+	extern bool FuseHandoffs;
+	extern bool UseInstructionStreams;
+	extern bool UseJITCompiler;
+	extern unsigned JITThreshold;
+	extern bool InlineFunctions;
+	extern bool HoistLoopInvariants;
+	extern bool AutoParallelize;
+
+	extern unsigned ProfilerSampleInterval;
+	extern bool MemoryReport;
 
 	extern unsigned NumMessageSlots;
+	extern unsigned MailboxOverflowMode;
+	extern bool ShareTaskMailboxes;
+	extern unsigned SharedMessageSize;
+	extern unsigned NodePort;
+	extern std::wstring NodeDirectory;
+	extern unsigned NetworkBatchSize;
+	extern unsigned TelemetryDumpInterval;
+	extern bool TraceEvents;
+	extern unsigned TraceBufferSize;
+	extern bool BufferDebugOutput;
+	extern unsigned DebugOutputFlushInterval;
+
+	extern bool UseGreenTasks;
+	extern size_t GreenTaskStackSize;
+	extern size_t GeneratorStackSize;
+	extern unsigned TaskThreadCacheSize;
+
+	extern unsigned ParallelForScheduling;
+	extern unsigned ParallelForGrainSize;
+
+	extern unsigned ParallelMapReduceThreshold;
+	extern unsigned DeviceMapReduceThreshold;
+	extern unsigned ParallelSortThreshold;
+	extern unsigned ParallelValidationThreshold;
+	extern bool IncrementalValidation;
+
+	extern unsigned PoolWorkerPlacement;
+	extern unsigned ReservedPoolWorkers;
+	extern unsigned SharedPoolThreads;
+	extern bool AutoTuneRuntime;
+
+	extern bool CacheParsedSources;
+	extern bool MemoryMapBinaries;
+	extern bool DeferFunctionLoading;
+	extern bool CompactBytecode;
+	extern bool KeepAssemblyListings;
+	extern bool UseStartupImages;
+	extern bool PreoptimizeBinaries;
+	extern bool IncrementalLinking;
+	extern bool EmbedNativeCode;
+	extern bool CompressEmbeddedBytecode;
+	extern bool CacheCompiledResources;
+	extern bool UseNativeImages;
+
+	extern bool WarmUpExtensions;
+	extern bool PreloadDLLs;
 
 	extern unsigned TabWidth;
 
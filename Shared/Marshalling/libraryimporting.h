@@ -33,8 +33,10 @@ typedef void (__stdcall *RegisterConstantFuncPtr)(const wchar_t* name, VM::Epoch
 typedef IDType (__stdcall *RegisterStructureFuncPtr)(const wchar_t* name, const ParamData* params, size_t numparams, void* bindrecord);
 typedef void (__stdcall *RegisterExternalFuncPtr)(const wchar_t* name, const char* internalname, const wchar_t* dllname, const ParamData* params, size_t numparams, VM::EpochVariableTypeID returntype, void* bindrecord);
 typedef void (__stdcall *RegisterSignatureFuncPtr)(const wchar_t* name, const ParamData* params, size_t numparams, VM::EpochVariableTypeID returntype, void* bindrecord);
+typedef void (__stdcall *RegisterBatchFunctionFuncPtr)(const wchar_t* name, const char* internalname, const ParamData* params, size_t numparams, VM::EpochVariableTypeID returntype, void* bindrecord);
 
 typedef void* (__stdcall *RequestMarshalBufferPtr)(size_t numbytes);
+typedef Integer32 (__stdcall *WaitForTaskOrWindowMessagePtr)(UInteger32 timeoutms);
 
 
 //
@@ -49,8 +51,29 @@ struct RegistrationTable
 	RegisterStructureFuncPtr RegisterStructure;
 	RegisterExternalFuncPtr RegisterExternal;
 	RegisterSignatureFuncPtr RegisterSignature;
+	RegisterBatchFunctionFuncPtr RegisterBatchFunction;
 
 	RequestMarshalBufferPtr RequestMarshalBuffer;
+
+	WaitForTaskOrWindowMessagePtr WaitForTaskOrWindowMessage;
+};
+
+
+//
+// Results of WaitForTaskOrWindowMessage
+//
+// The wait suspends the calling task until either an Epoch message
+// arrives in its mailbox, or a window message arrives in the thread's
+// Win32 message queue, or the timeout (in milliseconds, or INFINITE)
+// expires. Neither kind of message is removed from its queue. Green
+// tasks cannot wait for window messages, and fail immediately.
+//
+enum LibraryWaitResult
+{
+	LibraryWait_TimedOut = 0,
+	LibraryWait_TaskMessage = 1,
+	LibraryWait_WindowMessage = 2,
+	LibraryWait_Unsupported = -1
 };
 
 
@@ -64,3 +87,23 @@ struct LibraryArrayReturnInfo
 	size_t ElementCount;
 };
 
+
+//
+// Signature of library routines registered with RegisterBatchFunction
+//
+// A batch function performs the same operation on many sets of inputs
+// in a single call, which avoids paying the marshalling overhead for
+// each individual set. On the Epoch side, each parameter is an array
+// of the type given in the registration, and the function returns an
+// array of the registered return type (or nothing, for null returns).
+// All argument arrays must have the same number of elements.
+//
+// The library routine receives one pointer per parameter, in order of
+// registration, each referring to the packed elements of an argument
+// array, along with the element count. Results are written to a buffer
+// which is provided by the VM, and is NULL for null return types.
+//
+// Only integer, integer16, real, and boolean elements are supported.
+//
+typedef void (__stdcall *LibraryBatchFuncPtr)(const void* const* arguments, void* results, size_t count);
+
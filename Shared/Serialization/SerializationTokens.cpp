@@ -45,6 +45,7 @@ std::wstring Serialization::PushRealLiteral(L"PUSH_REAL");
 std::wstring Serialization::PushStringLiteral(L"PUSH_STR");
 std::wstring Serialization::PushBooleanLiteral(L"PUSH_BOOL");
 std::wstring Serialization::PushOperation(L"PUSH");
+std::wstring Serialization::TypedPushOperation(L"PUSHTYPED");
 std::wstring Serialization::BindReference(L"BINDREF");
 std::wstring Serialization::BindFunctionReference(L"BINDFUNC");
 
@@ -61,6 +62,7 @@ std::wstring Serialization::Return(L"RET");
 std::wstring Serialization::AssignValue(L"WRITE");
 std::wstring Serialization::InitializeValue(L"INIT");
 std::wstring Serialization::GetValue(L"READ");
+std::wstring Serialization::MoveValue(L"MOVE");
 std::wstring Serialization::SizeOf(L"SIZEOF");
 std::wstring Serialization::Length(L"LENGTH");
 std::wstring Serialization::IntegerConstant(L"INT");
@@ -81,13 +83,35 @@ std::wstring Serialization::ConsArray(L"CONSARRAY");
 std::wstring Serialization::ConsArrayIndirect(L"CONSARRAYINDIRECT");
 std::wstring Serialization::ReadArray(L"READARRAY");
 std::wstring Serialization::WriteArray(L"WRITEARRAY");
+std::wstring Serialization::AppendArray(L"APPENDARRAY");
 std::wstring Serialization::ArrayLength(L"ARRAYLENGTH");
+std::wstring Serialization::SortArray(L"SORTARRAY");
+std::wstring Serialization::SearchArray(L"SEARCHARRAY");
+std::wstring Serialization::ArrayMinIndex(L"ARRAYMININDEX");
+std::wstring Serialization::ArrayMaxIndex(L"ARRAYMAXINDEX");
+std::wstring Serialization::ConsMappedArray(L"CONSMAPPEDARRAY");
 std::wstring Serialization::Map(L"MAP");
 std::wstring Serialization::Reduce(L"REDUCE");
+std::wstring Serialization::MapGenerator(L"MAPGENERATOR");
+std::wstring Serialization::ReduceGenerator(L"REDUCEGENERATOR");
+
+std::wstring Serialization::ConsHashMap(L"CONSHASHMAP");
+std::wstring Serialization::HashMapInsert(L"HASHMAPINSERT");
+std::wstring Serialization::HashMapLookup(L"HASHMAPLOOKUP");
+std::wstring Serialization::HashMapContains(L"HASHMAPCONTAINS");
+std::wstring Serialization::HashMapErase(L"HASHMAPERASE");
+std::wstring Serialization::HashMapKeys(L"HASHMAPKEYS");
+std::wstring Serialization::HashMapSize(L"HASHMAPSIZE");
 
 std::wstring Serialization::AcceptMessage(L"ACCEPTMSG");
 std::wstring Serialization::AcceptMessageFromMap(L"ACCEPTMSGMAP");
 std::wstring Serialization::SendTaskMessage(L"SENDMSG");
+std::wstring Serialization::DelayedSendTaskMessage(L"SENDMSGDELAYED");
+std::wstring Serialization::AcceptMessageWithTimeout(L"ACCEPTMSGTIMEOUT");
+std::wstring Serialization::BroadcastTaskMessage(L"BROADCASTMSG");
+std::wstring Serialization::SendTaskRequest(L"SENDREQUEST");
+std::wstring Serialization::ReplyToRequest(L"REPLY");
+std::wstring Serialization::PendingReply(L"PENDINGREPLY");
 std::wstring Serialization::GetTaskCaller(L"GETCALLER");
 std::wstring Serialization::GetMessageSender(L"GETSENDER");
 
@@ -104,6 +128,7 @@ std::wstring Serialization::DivideIntegers(L"DIV_INT");
 std::wstring Serialization::DivideInteger16s(L"DIV_INT16");
 std::wstring Serialization::DivideReals(L"DIV_REAL");
 std::wstring Serialization::Negate(L"NEG");
+std::wstring Serialization::ElementwiseArithmetic(L"ELEMENTWISE");
 
 std::wstring Serialization::IsEqual(L"EQ");
 std::wstring Serialization::IsNotEqual(L"NEQ");
@@ -123,16 +148,37 @@ std::wstring Serialization::LogicalXor(L"LXOR");
 std::wstring Serialization::LogicalNot(L"LNOT");
 
 std::wstring Serialization::Concat(L"CONCAT");
+std::wstring Serialization::FindString(L"FIND");
+std::wstring Serialization::StringStartsWith(L"STARTSWITH");
+std::wstring Serialization::CompareStrings(L"STRCMP");
+std::wstring Serialization::SplitString(L"SPLIT");
 
 std::wstring Serialization::TypeCast(L"CAST");
 std::wstring Serialization::TypeCastToString(L"CASTSTR");
 
 std::wstring Serialization::ForkTask(L"FORK");
 std::wstring Serialization::ForkFuture(L"FUTURE");
+std::wstring Serialization::ForkDependentFuture(L"DEPFUTURE");
 std::wstring Serialization::ForkThread(L"FORKTHREAD");
 std::wstring Serialization::ThreadPool(L"THREADPOOL");
 
+std::wstring Serialization::CreateChannel(L"CHANNEL");
+std::wstring Serialization::SendChannel(L"CHANNELSEND");
+std::wstring Serialization::ReceiveChannel(L"CHANNELRECV");
+
 std::wstring Serialization::ParallelFor(L"PFOR");
+std::wstring Serialization::ParallelInvoke(L"PARALLELINVOKE");
+
+std::wstring Serialization::CreateGenerator(L"GENERATOR");
+std::wstring Serialization::YieldValue(L"YIELD");
+std::wstring Serialization::GeneratorHasNext(L"GENHASNEXT");
+std::wstring Serialization::GeneratorNextValue(L"GENNEXT");
+
+std::wstring Serialization::AtomicUpdate(L"ATOMIC");
+std::wstring Serialization::AtomicUpdateArray(L"ATOMICARRAY");
+
+std::wstring Serialization::CancelFuture(L"CANCELFUTURE");
+std::wstring Serialization::CancelPoolWork(L"CANCELPOOL");
 
 std::wstring Serialization::DebugWrite(L"DEBUG_WRITE");
 std::wstring Serialization::DebugRead(L"DEBUG_READ");
@@ -46,6 +46,7 @@ namespace Serialization
 	extern std::wstring PushStringLiteral;
 	extern std::wstring PushBooleanLiteral;
 	extern std::wstring PushOperation;
+	extern std::wstring TypedPushOperation;
 	extern std::wstring BindReference;
 	extern std::wstring BindFunctionReference;
 
@@ -64,6 +65,7 @@ namespace Serialization
 	extern std::wstring AssignValue;
 	extern std::wstring InitializeValue;
 	extern std::wstring GetValue;
+	extern std::wstring MoveValue;
 	extern std::wstring SizeOf;
 	extern std::wstring Length;
 	extern std::wstring IntegerConstant;
@@ -87,14 +89,37 @@ namespace Serialization
 	extern std::wstring ConsArrayIndirect;
 	extern std::wstring ReadArray;
 	extern std::wstring WriteArray;
+	extern std::wstring AppendArray;
 	extern std::wstring ArrayLength;
+	extern std::wstring SortArray;
+	extern std::wstring SearchArray;
+	extern std::wstring ArrayMinIndex;
+	extern std::wstring ArrayMaxIndex;
+	extern std::wstring ConsMappedArray;
 	extern std::wstring Map;
 	extern std::wstring Reduce;
+	extern std::wstring MapGenerator;
+	extern std::wstring ReduceGenerator;
+
+	// Hash maps
+	extern std::wstring ConsHashMap;
+	extern std::wstring HashMapInsert;
+	extern std::wstring HashMapLookup;
+	extern std::wstring HashMapContains;
+	extern std::wstring HashMapErase;
+	extern std::wstring HashMapKeys;
+	extern std::wstring HashMapSize;
 
 	// Message passing
 	extern std::wstring AcceptMessage;
 	extern std::wstring AcceptMessageFromMap;
 	extern std::wstring SendTaskMessage;
+	extern std::wstring DelayedSendTaskMessage;
+	extern std::wstring AcceptMessageWithTimeout;
+	extern std::wstring BroadcastTaskMessage;
+	extern std::wstring SendTaskRequest;
+	extern std::wstring ReplyToRequest;
+	extern std::wstring PendingReply;
 	extern std::wstring GetTaskCaller;
 	extern std::wstring GetMessageSender;
 
@@ -112,6 +137,7 @@ namespace Serialization
 	extern std::wstring DivideInteger16s;
 	extern std::wstring DivideReals;
 	extern std::wstring Negate;
+	extern std::wstring ElementwiseArithmetic;
 
 	// Built-in comparison operations
 	extern std::wstring IsEqual;
@@ -135,6 +161,10 @@ namespace Serialization
 
 	// String operations
 	extern std::wstring Concat;
+	extern std::wstring FindString;
+	extern std::wstring StringStartsWith;
+	extern std::wstring CompareStrings;
+	extern std::wstring SplitString;
 
 	// Built in conversion/type-cast operations
 	extern std::wstring TypeCast;
@@ -143,11 +173,32 @@ namespace Serialization
 	// Asynchronous tasks
 	extern std::wstring ForkTask;
 	extern std::wstring ForkFuture;
+	extern std::wstring ForkDependentFuture;
 	extern std::wstring ForkThread;
 	extern std::wstring ThreadPool;
 
+	// Channels between tasks
+	extern std::wstring CreateChannel;
+	extern std::wstring SendChannel;
+	extern std::wstring ReceiveChannel;
+
 	// Additional parallelism features
 	extern std::wstring ParallelFor;
+	extern std::wstring ParallelInvoke;
+
+	// Generators
+	extern std::wstring CreateGenerator;
+	extern std::wstring YieldValue;
+	extern std::wstring GeneratorHasNext;
+	extern std::wstring GeneratorNextValue;
+
+	// Atomic operations
+	extern std::wstring AtomicUpdate;
+	extern std::wstring AtomicUpdateArray;
+
+	// Cancellation operations
+	extern std::wstring CancelFuture;
+	extern std::wstring CancelPoolWork;
 
 	// Debug operations
 	extern std::wstring DebugWrite;
@@ -0,0 +1,253 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Buffered output of debug messages written by running programs
+//
+
+#include "pch.h"
+
+#include "User Interface/BufferedOutput.h"
+#include "User Interface/Output.h"
+
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace UI;
+
+
+volatile LONG BufferedOutput::SessionActive = 0;
+volatile LONG BufferedOutput::PendingLines = 0;
+
+
+namespace
+{
+
+	// Number of lines a thread may buffer before the writer is woken early
+	const size_t WakeWriterThreshold = 64;
+
+	// Prefix shown ahead of each debug message
+	const wchar_t DebugPrefix[] = L"DEBUG: ";
+
+	//
+	// Lines buffered by a single thread
+	//
+	// The lock is only ever contended by the writer, which holds it just
+	// long enough to take the buffered lines. Once created, a buffer stays
+	// in the list until the session ends, even if its thread exits.
+	//
+	struct ThreadBuffer
+	{
+		Threads::CriticalSection Lock;
+		std::vector<std::wstring> Lines;
+		ThreadBuffer* Next;
+	};
+
+	DWORD BufferTLSIndex = TLS_OUT_OF_INDEXES;
+	ThreadBuffer* volatile Buffers = NULL;
+
+	HANDLE WriterThread = NULL;
+	HANDLE WakeWriterEvent = NULL;
+	HANDLE StopWriterEvent = NULL;
+
+	// Serializes writing the buffers out, between the writer and explicit flushes
+	Threads::CriticalSection FlushCriticalSection;
+
+
+	//
+	// Retrieve the calling thread's buffer, creating it if necessary
+	//
+	ThreadBuffer& GetBufferForThisThread()
+	{
+		ThreadBuffer* buffer = reinterpret_cast<ThreadBuffer*>(::TlsGetValue(BufferTLSIndex));
+		if(!buffer)
+		{
+			buffer = new ThreadBuffer;
+			buffer->Lines.reserve(WakeWriterThreshold);
+
+			do
+			{
+				buffer->Next = Buffers;
+			} while(!Atomic::CompareAndSwapPointer(&Buffers, buffer->Next, buffer));
+
+			::TlsSetValue(BufferTLSIndex, buffer);
+		}
+
+		return *buffer;
+	}
+
+	//
+	// Write out the lines buffered by all threads
+	//
+	// Each thread's lines are taken in a single batch, and written out
+	// under a single acquisition of the console lock.
+	//
+	void WriteBuffers()
+	{
+		Threads::CriticalSection::Auto flushmutex(FlushCriticalSection);
+
+		std::vector<std::wstring> batch;
+		for(ThreadBuffer* buffer = Buffers; buffer; buffer = buffer->Next)
+		{
+			{
+				Threads::CriticalSection::Auto mutex(buffer->Lock);
+				batch.swap(buffer->Lines);
+			}
+
+			if(batch.empty())
+				continue;
+
+			OutputPrefixedLines(OutputColor_LightBlue, DebugPrefix, batch);
+			::InterlockedExchangeAdd(&BufferedOutput::PendingLines, -static_cast<LONG>(batch.size()));
+			batch.clear();
+		}
+	}
+
+}
+
+
+//
+// Write a debug message to the console, or buffer it if a session is running
+//
+void BufferedOutput::WriteDebugMessage(const std::wstring& message)
+{
+	if(!IsEnabled())
+	{
+		OutputStream output;
+		output << lightblue << DebugPrefix << resetcolor;
+		output << message << std::endl;
+		return;
+	}
+
+	ThreadBuffer& buffer = GetBufferForThisThread();
+
+	size_t numlines;
+	{
+		Threads::CriticalSection::Auto mutex(buffer.Lock);
+		buffer.Lines.push_back(message);
+		numlines = buffer.Lines.size();
+		::InterlockedIncrement(&PendingLines);
+	}
+
+	if(numlines == WakeWriterThreshold)
+		::SetEvent(WakeWriterEvent);
+}
+
+//
+// Write out all buffered lines immediately
+//
+void BufferedOutput::Flush()
+{
+	if(BufferTLSIndex == TLS_OUT_OF_INDEXES)
+		return;
+
+	WriteBuffers();
+}
+
+
+//
+// Start buffering debug messages, if buffering is enabled
+//
+BufferedOutput::Session::Session()
+	: Active(Config::BufferDebugOutput)
+{
+	if(!Active)
+		return;
+
+	if(WriterThread)
+		throw Threads::ThreadException("Cannot start buffering debug output while another buffering session is already running");
+
+	BufferTLSIndex = ::TlsAlloc();
+	if(BufferTLSIndex == TLS_OUT_OF_INDEXES)
+		throw Threads::ThreadException("Failed to allocate thread-local storage for buffered debug output");
+
+	WakeWriterEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	StopWriterEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(WakeWriterEvent && StopWriterEvent)
+		WriterThread = ::CreateThread(NULL, 0, WriterThreadProc, NULL, 0, NULL);
+
+	if(!WriterThread)
+	{
+		if(WakeWriterEvent)
+			::CloseHandle(WakeWriterEvent);
+		if(StopWriterEvent)
+			::CloseHandle(StopWriterEvent);
+		WakeWriterEvent = StopWriterEvent = NULL;
+
+		::TlsFree(BufferTLSIndex);
+		BufferTLSIndex = TLS_OUT_OF_INDEXES;
+		throw Threads::ThreadException("Failed to start the debug output writer thread");
+	}
+
+	::InterlockedExchange(&SessionActive, 1);
+}
+
+//
+// Stop buffering, write out any remaining lines, and release all buffers
+//
+BufferedOutput::Session::~Session()
+{
+	if(!Active)
+		return;
+
+	::InterlockedExchange(&SessionActive, 0);
+
+	::SetEvent(StopWriterEvent);
+	::WaitForSingleObject(WriterThread, INFINITE);
+	::CloseHandle(WriterThread);
+	::CloseHandle(WakeWriterEvent);
+	::CloseHandle(StopWriterEvent);
+	WriterThread = WakeWriterEvent = StopWriterEvent = NULL;
+
+	try
+	{
+		WriteBuffers();
+	}
+	catch(...)
+	{
+		// Failing to write the output should not mask the program's own results
+	}
+
+	ThreadBuffer* buffer = Buffers;
+	Buffers = NULL;
+	while(buffer)
+	{
+		ThreadBuffer* next = buffer->Next;
+		delete buffer;
+		buffer = next;
+	}
+
+	PendingLines = 0;
+
+	::TlsFree(BufferTLSIndex);
+	BufferTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+//
+// Entry point for the thread which writes out buffered lines
+//
+// The writer runs whenever a thread has buffered a batch of lines, and
+// otherwise at the configured interval, so that lines from threads which
+// only log occasionally still appear promptly.
+//
+DWORD __stdcall BufferedOutput::Session::WriterThreadProc(void* param)
+{
+	HANDLE events[2] = { StopWriterEvent, WakeWriterEvent };
+	while(::WaitForMultipleObjects(2, events, FALSE, Config::DebugOutputFlushInterval) != WAIT_OBJECT_0)
+	{
+		try
+		{
+			WriteBuffers();
+		}
+		catch(...)
+		{
+			// A failed write loses only that batch; keep serving the other threads
+		}
+	}
+
+	return 0;
+}
+
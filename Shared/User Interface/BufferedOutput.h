@@ -0,0 +1,82 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Buffered output of debug messages written by running programs
+//
+// Writing a debug message to the console normally means taking the console
+// lock, switching colors, and writing the text, all on the thread which
+// produced the message. Programs which log heavily spend much of their time
+// waiting on the console, and tasks which log at the same time queue up
+// behind each other for it.
+//
+// While a buffering session is active, each thread instead appends its
+// messages to a line buffer of its own, and a background writer thread
+// periodically takes the buffered lines and writes them to the console in
+// batches. Lines from any one thread always appear in order. Any other
+// console output first writes out every pending line, so that the output
+// of a thread never overtakes the debug messages it wrote earlier; when
+// the session ends, all remaining lines are written out as well.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Threading/Lockless.h"
+
+
+namespace UI
+{
+	namespace BufferedOutput
+	{
+
+		// Set while a session is running; use IsEnabled to check this
+		extern volatile LONG SessionActive;
+
+		// Number of buffered lines not yet written to the console
+		extern volatile LONG PendingLines;
+
+		//
+		// Check if debug messages are currently being buffered
+		//
+		inline bool IsEnabled()
+		{
+			return Atomic::LoadAcquire(&SessionActive) != 0;
+		}
+
+		//
+		// Check if any buffered lines are waiting to be written
+		//
+		inline bool HasPendingLines()
+		{
+			return Atomic::LoadAcquire(&PendingLines) != 0;
+		}
+
+
+		// Output of debug messages
+		void WriteDebugMessage(const std::wstring& message);
+		void Flush();
+
+
+		//
+		// RAII helper for buffering debug messages while a program runs,
+		// if Config::BufferDebugOutput is set. Sessions must not end until
+		// all of the program's tasks have finished.
+		//
+		class Session
+		{
+		public:
+			Session();
+			~Session();
+
+		private:
+			static DWORD __stdcall WriterThreadProc(void* param);
+
+		private:
+			bool Active;
+		};
+
+	}
+}
+
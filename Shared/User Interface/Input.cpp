@@ -7,6 +7,7 @@
 
 #include "pch.h"
 #include "User Interface/Input.h"
+#include "User Interface/BufferedOutput.h"
 
 #include <iostream>
 
@@ -18,6 +19,9 @@ using namespace UI;
 //
 std::wstring Input::BlockingRead()
 {
+	// Make sure any prompt written through the debug output is visible
+	BufferedOutput::Flush();
+
 	std::wstring result;
 	std::getline(std::wcin, result);
 	return result;
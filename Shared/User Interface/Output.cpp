@@ -8,6 +8,7 @@
 #include "pch.h"
 
 #include "User Interface/Output.h"
+#include "User Interface/BufferedOutput.h"
 
 #include "Utility/Threading/Threads.h"
 #include "Utility/Threading/Synchronization.h"
@@ -21,17 +22,51 @@ using namespace UI;
 Threads::CriticalSection ConsoleCriticalSection;
 
 
+namespace
+{
+
+	//
+	// Map an output color to the corresponding console attribute bits
+	//
+	WORD GetColorBits(OutputColor color)
+	{
+		switch(color)
+		{
+		case OutputColor_Red:			return FOREGROUND_RED;
+		case OutputColor_Green:			return FOREGROUND_GREEN;
+		case OutputColor_Blue:			return FOREGROUND_BLUE;
+		case OutputColor_LightRed:		return FOREGROUND_RED | FOREGROUND_INTENSITY;
+		case OutputColor_LightGreen:	return FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+		case OutputColor_LightBlue:		return FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+		case OutputColor_White:
+		default:
+			return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+		}
+	}
+
+}
+
+
 //
 // Display text messages
 //
+// Buffered debug messages are written out first, so that they are not
+// overtaken by output which was produced after them.
+//
 void UI::OutputMessage(const wchar_t* message)
 {
+	if(BufferedOutput::HasPendingLines())
+		BufferedOutput::Flush();
+
 	Threads::CriticalSection::Auto mutex(ConsoleCriticalSection);
 	WriteConsole(::GetStdHandle(STD_OUTPUT_HANDLE), message, static_cast<DWORD>(wcslen(message)), NULL, NULL);
 }
 
 void UI::OutputMessage(const std::wstring& message)
 {
+	if(BufferedOutput::HasPendingLines())
+		BufferedOutput::Flush();
+
 	Threads::CriticalSection::Auto mutex(ConsoleCriticalSection);
 	WriteConsole(::GetStdHandle(STD_OUTPUT_HANDLE), message.c_str(), static_cast<DWORD>(message.length()), NULL, NULL);
 }
@@ -41,20 +76,10 @@ void UI::OutputMessage(const std::wstring& message)
 //
 void UI::SetOutputColor(OutputColor color)
 {
-	WORD bits;
+	if(BufferedOutput::HasPendingLines())
+		BufferedOutput::Flush();
 
-	switch(color)
-	{
-	case OutputColor_Red:			bits = FOREGROUND_RED;							break;
-	case OutputColor_Green:			bits = FOREGROUND_GREEN;						break;
-	case OutputColor_Blue:			bits = FOREGROUND_BLUE;							break;
-	case OutputColor_LightRed:		bits = FOREGROUND_RED | FOREGROUND_INTENSITY;	break;
-	case OutputColor_LightGreen:	bits = FOREGROUND_GREEN | FOREGROUND_INTENSITY;	break;
-	case OutputColor_LightBlue:		bits = FOREGROUND_BLUE | FOREGROUND_INTENSITY;	break;
-	case OutputColor_White:
-	default:
-		bits = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-	}
+	WORD bits = GetColorBits(color);
 
 	{
 		Threads::CriticalSection::Auto mutex(ConsoleCriticalSection);
@@ -62,3 +87,27 @@ void UI::SetOutputColor(OutputColor color)
 	}
 }
 
+//
+// Display a series of lines, each preceded by a prefix in the given color
+//
+// The console is locked once for the whole series, rather than once per
+// line; the text color is left as the default afterwards.
+//
+void UI::OutputPrefixedLines(OutputColor prefixcolor, const wchar_t* prefix, const std::vector<std::wstring>& lines)
+{
+	HANDLE console = ::GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD prefixlength = static_cast<DWORD>(wcslen(prefix));
+	WORD prefixbits = GetColorBits(prefixcolor);
+	WORD textbits = GetColorBits(OutputColor_White);
+
+	Threads::CriticalSection::Auto mutex(ConsoleCriticalSection);
+	for(std::vector<std::wstring>::const_iterator iter = lines.begin(); iter != lines.end(); ++iter)
+	{
+		::SetConsoleTextAttribute(console, prefixbits);
+		WriteConsole(console, prefix, prefixlength, NULL, NULL);
+		::SetConsoleTextAttribute(console, textbits);
+		WriteConsole(console, iter->c_str(), static_cast<DWORD>(iter->length()), NULL, NULL);
+		WriteConsole(console, L"\n", 1, NULL, NULL);
+	}
+}
+
@@ -33,6 +33,9 @@ namespace UI
 
 	// Color control functions
 	void SetOutputColor(OutputColor color);
+
+	// Batched output of lines which each carry a colored prefix
+	void OutputPrefixedLines(OutputColor prefixcolor, const wchar_t* prefix, const std::vector<std::wstring>& lines);
 }
 
 // Template class implementations
@@ -0,0 +1,184 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Diagnostic trace log, available in all builds
+//
+
+#include "pch.h"
+
+#include "User Interface/TraceLog.h"
+#include "User Interface/Output.h"
+
+#include "Utility/Threading/Lockless.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+unsigned TraceLog::EnabledCategories = 0;
+
+
+namespace
+{
+
+	// Number of characters a thread may buffer before it writes them out
+	const size_t BufferFlushThreshold = 16 * 1024;
+
+	//
+	// Trace entries buffered by a single thread
+	//
+	// Buffers are only ever written by the thread which owns them. Once
+	// created, a buffer stays in the list until the log is shut down,
+	// even if its thread exits, so that no entries are lost.
+	//
+	struct ThreadBuffer
+	{
+		std::wstring Text;
+		ThreadBuffer* Next;
+	};
+
+	DWORD BufferTLSIndex = TLS_OUT_OF_INDEXES;
+	ThreadBuffer* volatile Buffers = NULL;
+
+
+	//
+	// Retrieve the calling thread's buffer, creating it if necessary
+	//
+	ThreadBuffer& GetBufferForThisThread()
+	{
+		ThreadBuffer* buffer = reinterpret_cast<ThreadBuffer*>(::TlsGetValue(BufferTLSIndex));
+		if(!buffer)
+		{
+			buffer = new ThreadBuffer;
+			buffer->Text.reserve(BufferFlushThreshold);
+
+			do
+			{
+				buffer->Next = Buffers;
+			} while(!Atomic::CompareAndSwapPointer(&Buffers, buffer->Next, buffer));
+
+			::TlsSetValue(BufferTLSIndex, buffer);
+		}
+
+		return *buffer;
+	}
+
+	//
+	// Write out a buffer's contents
+	//
+	void FlushBuffer(ThreadBuffer& buffer)
+	{
+		if(buffer.Text.empty())
+			return;
+
+		UI::OutputMessage(buffer.Text);
+		buffer.Text.clear();
+	}
+
+	//
+	// Write out the calling thread's buffer if it has filled up
+	//
+	void CheckBufferThreshold(ThreadBuffer& buffer)
+	{
+		if(buffer.Text.length() >= BufferFlushThreshold)
+			FlushBuffer(buffer);
+	}
+
+}
+
+
+//
+// Enable the categories selected in the configuration
+//
+void TraceLog::Init()
+{
+	BufferTLSIndex = ::TlsAlloc();
+	if(BufferTLSIndex == TLS_OUT_OF_INDEXES)
+		throw Threads::ThreadException("Failed to allocate thread-local storage for the trace log");
+
+	unsigned categories = 0;
+	if(Config::TraceParserExecution)
+		categories |= Category_Parser | Category_Scopes;
+	if(Config::TraceValidatorExecution)
+		categories |= Category_Validator;
+
+	EnabledCategories = categories;
+}
+
+//
+// Write out any remaining entries, and release all buffers
+//
+void TraceLog::Shutdown()
+{
+	EnabledCategories = 0;
+	Flush();
+
+	ThreadBuffer* buffer = Buffers;
+	Buffers = NULL;
+	while(buffer)
+	{
+		ThreadBuffer* next = buffer->Next;
+		delete buffer;
+		buffer = next;
+	}
+
+	if(BufferTLSIndex != TLS_OUT_OF_INDEXES)
+	{
+		::TlsFree(BufferTLSIndex);
+		BufferTLSIndex = TLS_OUT_OF_INDEXES;
+	}
+}
+
+
+//
+// Append an entry to the calling thread's buffer
+//
+void TraceLog::Write(const wchar_t* prefix, const wchar_t* text)
+{
+	ThreadBuffer& buffer = GetBufferForThisThread();
+	buffer.Text += prefix;
+	buffer.Text += text;
+	buffer.Text += L"\n";
+	CheckBufferThreshold(buffer);
+}
+
+//
+// Append an entry with an associated code fragment to the calling thread's buffer
+//
+void TraceLog::Write(const wchar_t* prefix, const wchar_t* text, const std::wstring& detail)
+{
+	ThreadBuffer& buffer = GetBufferForThisThread();
+	buffer.Text += prefix;
+	buffer.Text += text;
+	buffer.Text += L" [";
+	buffer.Text += detail;
+	buffer.Text += L"]\n";
+	CheckBufferThreshold(buffer);
+}
+
+//
+// Write out the entries buffered by all threads
+//
+// Buffers are read without synchronizing against their owners, so this
+// must only be called while no other thread is writing trace entries;
+// for instance once parsing and validation have completed.
+//
+void TraceLog::Flush()
+{
+	for(ThreadBuffer* buffer = Buffers; buffer; buffer = buffer->Next)
+		FlushBuffer(*buffer);
+}
+
+
+//
+// Write out a composed entry
+//
+TraceLog::Entry::~Entry()
+{
+	ThreadBuffer& buffer = GetBufferForThisThread();
+	buffer.Text += Stream.str();
+	buffer.Text += L"\n";
+	CheckBufferThreshold(buffer);
+}
+
@@ -0,0 +1,82 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Diagnostic trace log, available in all builds
+//
+// Trace entries are grouped into categories, each of which is enabled by
+// a bit in a single mask; callers check the category before building any
+// entries, so disabled tracing costs one test and branch per trace point.
+//
+// Entries are not written to the console as they are made. Instead, each
+// thread appends its entries to a buffer of its own, without taking any
+// locks; a buffer is only written out once it fills up, or when the log
+// is flushed. Entries from any one thread therefore always appear in order,
+// but entries from different threads appear in blocks rather than being
+// interleaved line by line.
+//
+
+#pragma once
+
+
+namespace TraceLog
+{
+
+	//
+	// Categories of trace entries
+	//
+	enum Category
+	{
+		Category_Parser		= 0x01,		// Parser actions (Config::TraceParserExecution)
+		Category_Scopes		= 0x02,		// Creation of scope descriptors by the parser (likewise)
+		Category_Validator	= 0x04		// Validator scope processing (Config::TraceValidatorExecution)
+	};
+
+	// Mask of enabled categories; set up by Init
+	extern unsigned EnabledCategories;
+
+	//
+	// Check if entries of the given category should be written
+	//
+	inline bool IsEnabled(Category category)
+	{
+		return (EnabledCategories & category) != 0;
+	}
+
+
+	// Setup and teardown
+	void Init();
+	void Shutdown();
+
+	// Writing entries
+	void Write(const wchar_t* prefix, const wchar_t* text);
+	void Write(const wchar_t* prefix, const wchar_t* text, const std::wstring& detail);
+	void Flush();
+
+
+	//
+	// Helper for composing an entry out of several values
+	//
+	// The entry is written when the helper goes out of scope.
+	//
+	class Entry
+	{
+	public:
+		explicit Entry(const wchar_t* prefix)
+		{ Stream << prefix; }
+
+		~Entry();
+
+		template <typename T>
+		Entry& operator << (const T& value)
+		{
+			Stream << value;
+			return *this;
+		}
+
+	private:
+		std::wostringstream Stream;
+	};
+
+}
+
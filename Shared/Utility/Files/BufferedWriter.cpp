@@ -0,0 +1,115 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Buffered writer for producing binary files
+//
+
+#include "pch.h"
+
+#include "Utility/Files/BufferedWriter.h"
+#include "Utility/Exception.h"
+
+
+using namespace Files;
+
+
+//
+// Create (or truncate) the given file for writing
+//
+BufferedWriter::BufferedWriter(const char* filename, size_t buffersize)
+	: FileHandle(INVALID_HANDLE_VALUE),
+	  MemoryTarget(NULL),
+	  Buffer(buffersize ? buffersize : 1),
+	  Used(0)
+{
+	FileHandle = ::CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(FileHandle == INVALID_HANDLE_VALUE)
+		throw FileException(std::string("Failed to open output file: ") + filename);
+}
+
+//
+// Prepare to append output to the given block of memory
+//
+BufferedWriter::BufferedWriter(std::vector<unsigned char>& memory, size_t buffersize)
+	: FileHandle(INVALID_HANDLE_VALUE),
+	  MemoryTarget(&memory),
+	  Buffer(buffersize ? buffersize : 1),
+	  Used(0)
+{
+}
+
+//
+// Write out any remaining data and close the file
+//
+// Errors cannot be reported from here; callers which need to know that
+// all of the data reached the file should call Flush explicitly first.
+//
+BufferedWriter::~BufferedWriter()
+{
+	try
+	{
+		Flush();
+	}
+	catch(...)
+	{
+	}
+
+	if(FileHandle != INVALID_HANDLE_VALUE)
+		::CloseHandle(FileHandle);
+}
+
+//
+// Append a block of data to the file
+//
+// Blocks which are larger than the buffer bypass it entirely.
+//
+void BufferedWriter::Write(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	if(size > Buffer.size() - Used)
+	{
+		Flush();
+
+		if(size >= Buffer.size())
+		{
+			WriteThrough(bytes, size);
+			return;
+		}
+	}
+
+	memcpy(&Buffer[Used], bytes, size);
+	Used += size;
+}
+
+//
+// Hand all buffered data to the operating system
+//
+void BufferedWriter::Flush()
+{
+	if(!Used)
+		return;
+
+	size_t size = Used;
+	Used = 0;
+
+	WriteThrough(&Buffer[0], size);
+}
+
+//
+// Pass a block of data directly to the output file or memory
+//
+void BufferedWriter::WriteThrough(const unsigned char* data, size_t size)
+{
+	if(MemoryTarget)
+	{
+		MemoryTarget->insert(MemoryTarget->end(), data, data + size);
+		return;
+	}
+
+	DWORD written = 0;
+	if(!::WriteFile(FileHandle, data, static_cast<DWORD>(size), &written, NULL) || written != size)
+		throw FileException("Failed to write to output file");
+}
+
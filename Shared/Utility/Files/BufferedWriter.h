@@ -0,0 +1,66 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Buffered writer for producing binary files
+//
+
+#pragma once
+
+
+namespace Files
+{
+
+	// Size of the buffers used when writing large files
+	const size_t OutputBufferSize = 256 * 1024;
+
+
+	//
+	// Simple binary file writer which accumulates output in memory
+	//
+	// Data is only handed to the operating system once the buffer
+	// fills up (or the writer is flushed or destroyed), so producing a
+	// file one byte at a time costs little more than a memory copy.
+	// A writer can also target a block of memory instead of a file, so
+	// that the same code can produce output in either place.
+	//
+	class BufferedWriter
+	{
+	// Construction and destruction
+	public:
+		explicit BufferedWriter(const char* filename, size_t buffersize = OutputBufferSize);
+		explicit BufferedWriter(std::vector<unsigned char>& memory, size_t buffersize = OutputBufferSize);
+		~BufferedWriter();
+
+	// Output interface
+	public:
+		void WriteByte(unsigned char value)
+		{
+			if(Used == Buffer.size())
+				Flush();
+			Buffer[Used++] = value;
+		}
+
+		void Write(const void* data, size_t size);
+
+		void Flush();
+
+	// Internal helpers
+	private:
+		void WriteThrough(const unsigned char* data, size_t size);
+
+	// Internal tracking
+	private:
+		HANDLE FileHandle;
+		std::vector<unsigned char>* MemoryTarget;
+		std::vector<unsigned char> Buffer;
+		size_t Used;
+
+	// Non-copyable
+	private:
+		BufferedWriter(const BufferedWriter&);
+		BufferedWriter& operator = (const BufferedWriter&);
+	};
+
+}
+
@@ -24,14 +24,14 @@ void Files::Load(const char* filename, std::vector<Byte>& memory)
     if(!infile)
 		throw FileException("Failed to load input file");
 
-	infile.unsetf(std::ios::skipws);
-
-	// Reserve memory for loading the file
+	// Read the whole file in one go, followed by a null terminator
 	size_t size = GetFileSize(filename);
-	memory.reserve(size + 10);	// Just some paranoia-padding
+	memory.resize(size + 1);
+
+	if(size && !infile.read(&memory[0], static_cast<std::streamsize>(size)))
+		throw FileException("Failed to read input file");
 
-    std::copy(std::istream_iterator<Byte>(infile), std::istream_iterator<Byte>(), std::back_inserter(memory));
-	memory.push_back(NULL);
+	memory[size] = 0;
 }
 
 
@@ -43,3 +43,63 @@ size_t Files::GetFileSize(const char* filename)
 	return static_cast<size_t>(size);
 }
 
+
+//
+// Map a file's contents into memory for reading
+//
+Files::MappedFile::MappedFile(const char* filename)
+	: FileHandle(INVALID_HANDLE_VALUE),
+	  MappingHandle(NULL),
+	  View(NULL),
+	  Size(0)
+{
+	FileHandle = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(FileHandle == INVALID_HANDLE_VALUE)
+		throw FileException("Failed to load input file");
+
+	LARGE_INTEGER filesize;
+	if(!::GetFileSizeEx(FileHandle, &filesize) || static_cast<ULONGLONG>(filesize.QuadPart) >= std::numeric_limits<size_t>::max())
+	{
+		Close();
+		throw FileException("File too large to read into memory!");
+	}
+
+	Size = static_cast<size_t>(filesize.QuadPart);
+
+	// Empty files cannot be mapped; leave the view empty instead
+	if(!Size)
+		return;
+
+	MappingHandle = ::CreateFileMapping(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(MappingHandle)
+		View = ::MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+	if(!View)
+	{
+		Close();
+		throw FileException("Failed to map input file into memory");
+	}
+}
+
+//
+// Release the mapping and the underlying file
+//
+Files::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+void Files::MappedFile::Close()
+{
+	if(View)
+		::UnmapViewOfFile(View);
+	if(MappingHandle)
+		::CloseHandle(MappingHandle);
+	if(FileHandle != INVALID_HANDLE_VALUE)
+		::CloseHandle(FileHandle);
+
+	View = NULL;
+	MappingHandle = NULL;
+	FileHandle = INVALID_HANDLE_VALUE;
+}
+
@@ -11,5 +11,45 @@ namespace Files
 {
 	void Load(const char* filename, std::vector<Byte>& memory);
 	size_t GetFileSize(const char* filename);
+
+
+	//
+	// Read-only view of a file's contents, mapped directly into memory
+	//
+	// The contents are paged in on demand by the operating system, and
+	// are never copied; the view remains valid for the lifetime of the
+	// mapping object.
+	//
+	class MappedFile
+	{
+	// Construction and destruction
+	public:
+		explicit MappedFile(const char* filename);
+		~MappedFile();
+
+	// Data access
+	public:
+		const void* GetData() const
+		{ return View; }
+
+		size_t GetSize() const
+		{ return Size; }
+
+	// Internal helpers
+	private:
+		void Close();
+
+	// Internal tracking
+	private:
+		HANDLE FileHandle;
+		HANDLE MappingHandle;
+		const void* View;
+		size_t Size;
+
+	// Non-copyable
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator = (const MappedFile&);
+	};
 }
 
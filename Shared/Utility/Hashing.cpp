@@ -0,0 +1,61 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Common library functions for computing FNV-1a hashes
+//
+
+#include "pch.h"
+#include "Utility/Hashing.h"
+
+#include <fstream>
+
+
+//
+// Hash the contents of the given file into an existing hash value
+//
+// Returns false if the file could not be read.
+//
+bool Hashing::HashFileContents64(Hash64& hash, const std::wstring& filename)
+{
+	std::ifstream infile(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!infile)
+		return false;
+
+	std::vector<char> buffer(64 * 1024);
+	while(infile)
+	{
+		infile.read(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+		hash = HashBytes64(hash, &buffer[0], static_cast<size_t>(infile.gcount()));
+	}
+
+	return true;
+}
+
+//
+// Hash the last modification time of the given file into an existing hash value
+//
+// Files which cannot be found leave the hash unchanged.
+//
+Hashing::Hash64 Hashing::HashFileTimeStamp64(Hash64 hash, const std::wstring& filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!::GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &attributes))
+		return hash;
+
+	return HashBytes64(hash, &attributes.ftLastWriteTime, sizeof(attributes.ftLastWriteTime));
+}
+
+//
+// Hash the last modification time of a loaded module into an existing hash value
+//
+// Passing NULL hashes the time stamp of the running executable.
+//
+Hashing::Hash64 Hashing::HashModuleTimeStamp64(Hash64 hash, HMODULE module)
+{
+	std::vector<wchar_t> path(MAX_PATH + 1, 0);
+	if(!::GetModuleFileName(module, &path[0], MAX_PATH))
+		return hash;
+
+	return HashFileTimeStamp64(hash, &path[0]);
+}
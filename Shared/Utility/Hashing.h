@@ -0,0 +1,74 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Common library functions for computing FNV-1a hashes
+//
+// The 32-bit hash is used wherever a hash lives only in memory or in a
+// small record, such as lookup tables and startup images. The 64-bit hash
+// is used by the various on-disk caches, whose keys must be unlikely to
+// collide across a great many cached files. Each function hashes into an
+// existing value, so several pieces of data can be combined into one key;
+// start from the matching offset basis.
+//
+
+#pragma once
+
+
+namespace Hashing
+{
+
+	typedef UInteger32 Hash32;
+	typedef unsigned __int64 Hash64;
+
+	const Hash32 FNV32OffsetBasis = 2166136261u;
+	const Hash32 FNV32Prime = 16777619u;
+
+	const Hash64 FNV64OffsetBasis = 14695981039346656037ULL;
+	const Hash64 FNV64Prime = 1099511628211ULL;
+
+
+	//
+	// Hash the given bytes into an existing hash value
+	//
+	inline Hash32 HashBytes32(Hash32 hash, const void* data, size_t numbytes)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		for(size_t i = 0; i < numbytes; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FNV32Prime;
+		}
+		return hash;
+	}
+
+	inline Hash64 HashBytes64(Hash64 hash, const void* data, size_t numbytes)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		for(size_t i = 0; i < numbytes; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FNV64Prime;
+		}
+		return hash;
+	}
+
+	//
+	// Hash the characters of the given string into an existing hash value
+	//
+	inline Hash32 HashString32(Hash32 hash, const std::wstring& str)
+	{
+		return HashBytes32(hash, str.c_str(), str.length() * sizeof(wchar_t));
+	}
+
+	inline Hash64 HashString64(Hash64 hash, const std::wstring& str)
+	{
+		return HashBytes64(hash, str.c_str(), str.length() * sizeof(wchar_t));
+	}
+
+
+	bool HashFileContents64(Hash64& hash, const std::wstring& filename);
+	Hash64 HashFileTimeStamp64(Hash64 hash, const std::wstring& filename);
+	Hash64 HashModuleTimeStamp64(Hash64 hash, HMODULE module);
+
+}
@@ -0,0 +1,76 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Live accounting of the memory held by a kind of allocation
+//
+// Each account tracks the number of allocations and bytes currently
+// live, the highest number of bytes ever live at once, and the total
+// number of allocations made. All updates are interlocked, so accounts
+// may be shared freely between threads; reading the statistics gives a
+// snapshot which may be slightly out of date if other threads are busy
+// allocating at the time.
+//
+// Accounts deliberately have no constructor. All accounts are expected
+// to have static storage duration, and are therefore zeroed before any
+// code runs; this keeps allocations made during static initialization
+// from being counted against an account which is later reset.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Threading/Lockless.h"
+
+
+struct MemoryAccount
+{
+// Statistics
+public:
+	struct Statistics
+	{
+		size_t LiveAllocations;
+		size_t LiveBytes;
+		size_t PeakBytes;
+		size_t TotalAllocations;
+	};
+
+	Statistics GetStatistics() const
+	{
+		Statistics stats;
+		stats.LiveAllocations = static_cast<size_t>(Atomic::LoadAcquire(&LiveAllocations));
+		stats.LiveBytes = static_cast<size_t>(Atomic::LoadAcquire(&LiveBytes));
+		stats.PeakBytes = static_cast<size_t>(Atomic::LoadAcquire(&PeakBytes));
+		stats.TotalAllocations = static_cast<size_t>(Atomic::LoadAcquire(&TotalAllocations));
+		return stats;
+	}
+
+// Accounting interface
+public:
+	void Allocated(size_t numbytes)
+	{
+		Atomic::Add(&LiveAllocations, 1);
+		Atomic::Add(&TotalAllocations, 1);
+		Atomic::UpdateMaximum(&PeakBytes, Atomic::Add(&LiveBytes, static_cast<LONG_PTR>(numbytes)));
+	}
+
+	void Released(size_t numbytes)
+	{
+		Atomic::Add(&LiveAllocations, -1);
+		Atomic::Add(&LiveBytes, -static_cast<LONG_PTR>(numbytes));
+	}
+
+	void Resized(size_t oldbytes, size_t newbytes)
+	{
+		Atomic::UpdateMaximum(&PeakBytes, Atomic::Add(&LiveBytes, static_cast<LONG_PTR>(newbytes) - static_cast<LONG_PTR>(oldbytes)));
+	}
+
+// Internal tracking
+private:
+	volatile LONG_PTR LiveAllocations;
+	volatile LONG_PTR LiveBytes;
+	volatile LONG_PTR PeakBytes;
+	volatile LONG_PTR TotalAllocations;
+};
+
@@ -0,0 +1,69 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Helpers for laying out and allocating data at natural alignment
+//
+// A value is naturally aligned when its address is a multiple of its
+// own size (up to the largest scalar the VM handles). Misaligned loads
+// and stores are slower on most hardware, and prevent the compiler from
+// using aligned vector instructions on runs of elements.
+//
+
+#pragma once
+
+
+// Dependencies
+#include <malloc.h>
+
+
+namespace Alignment
+{
+
+	// Largest alignment required by any scalar value held by the VM
+	const size_t MaxNaturalAlignment = 8;
+
+	// Alignment of pooled array buffers; suitable for 128- and 256-bit vector loads
+	const size_t ArrayBufferAlignment = 32;
+
+
+	//
+	// Determine the natural alignment of a value with the given storage size
+	//
+	// Composite values are larger than any scalar, and are aligned to the
+	// largest natural alignment that evenly divides their size.
+	//
+	inline size_t GetNaturalAlignment(size_t size)
+	{
+		size_t alignment = 1;
+		while(alignment < MaxNaturalAlignment && size % (alignment * 2) == 0)
+			alignment *= 2;
+		return alignment;
+	}
+
+	//
+	// Round an offset up to the next multiple of the given alignment
+	//
+	inline size_t AlignUp(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+
+	//
+	// Allocate and free blocks at a given alignment
+	//
+	inline Byte* AllocateAligned(size_t numbytes, size_t alignment)
+	{
+		void* memory = ::_aligned_malloc(numbytes ? numbytes : 1, alignment);
+		if(!memory)
+			throw MemoryException("Failed to allocate aligned memory block!");
+		return reinterpret_cast<Byte*>(memory);
+	}
+
+	inline void FreeAligned(Byte* memory)
+	{
+		::_aligned_free(memory);
+	}
+
+}
@@ -0,0 +1,80 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Arena for objects which all share a single lifetime
+//
+
+#include "pch.h"
+#include "Utility/Memory/Arena.h"
+
+
+namespace
+{
+	const size_t ChunkSize = 64 * 1024;
+	const size_t LargeAllocationSize = ChunkSize / 4;
+	const size_t AllocationAlignment = 16;
+}
+
+
+//
+// Construct an empty arena; no memory is reserved until it is needed
+//
+MemoryArena::MemoryArena()
+	: NextFree(NULL),
+	  ChunkEnd(NULL),
+	  ReservedBytes(0)
+{
+}
+
+//
+// Release all memory handed out by the arena
+//
+MemoryArena::~MemoryArena()
+{
+	for(std::vector<Byte*>::iterator iter = Chunks.begin(); iter != Chunks.end(); ++iter)
+		::VirtualFree(*iter, 0, MEM_RELEASE);
+}
+
+
+//
+// Hand out a block of memory of the given size
+//
+// Blocks are aligned suitably for any type. Large requests are given a
+// chunk of their own, so that they don't waste the rest of the current
+// chunk.
+//
+void* MemoryArena::Allocate(size_t size)
+{
+	size = (size + AllocationAlignment - 1) & ~(AllocationAlignment - 1);
+
+	Threads::CriticalSection::Auto mutex(ArenaCriticalSection);
+
+	if(size > LargeAllocationSize)
+		return ReserveChunk(size);
+
+	if(static_cast<size_t>(ChunkEnd - NextFree) < size)
+	{
+		NextFree = ReserveChunk(ChunkSize);
+		ChunkEnd = NextFree + ChunkSize;
+	}
+
+	void* ret = NextFree;
+	NextFree += size;
+	return ret;
+}
+
+//
+// Reserve a fresh chunk of memory, which is released along with the arena
+//
+Byte* MemoryArena::ReserveChunk(size_t size)
+{
+	Byte* chunk = reinterpret_cast<Byte*>(::VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if(!chunk)
+		throw std::bad_alloc();
+
+	Chunks.push_back(chunk);
+	ReservedBytes += size;
+	return chunk;
+}
+
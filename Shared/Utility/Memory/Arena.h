@@ -0,0 +1,55 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Arena for objects which all share a single lifetime
+//
+// An arena hands out memory by bumping a pointer through large chunks,
+// so consecutive allocations sit next to each other in memory. Objects
+// are never freed individually; all of the memory is released at once
+// when the arena itself is destroyed. Destructors of objects placed in
+// the arena are the responsibility of the caller.
+//
+// Allocation is serialized, so an arena may be shared between threads.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Threading/Synchronization.h"
+
+
+class MemoryArena
+{
+// Construction and destruction
+public:
+	MemoryArena();
+	~MemoryArena();
+
+// Allocation interface
+public:
+	void* Allocate(size_t size);
+
+	size_t GetReservedBytes() const
+	{ return ReservedBytes; }
+
+// Internal helpers
+private:
+	Byte* ReserveChunk(size_t size);
+
+// Internal tracking
+private:
+	std::vector<Byte*> Chunks;
+	Byte* NextFree;
+	Byte* ChunkEnd;
+	size_t ReservedBytes;
+
+	Threads::CriticalSection ArenaCriticalSection;
+
+// Non-copyable
+private:
+	MemoryArena(const MemoryArena&);
+	MemoryArena& operator = (const MemoryArena&);
+};
+
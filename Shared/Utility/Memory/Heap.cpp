@@ -8,14 +8,69 @@
 #include "pch.h"
 #include "Utility/Memory/Heap.h"
 
+#include "Utility/Threading/Synchronization.h"
+
+
+namespace
+{
+	// Tracking for all storage wrappers in existence, so that the
+	// garbage collector can treat their contents as root data
+	Threads::CriticalSection LiveStorageCriticalSection;
+	std::set<const HeapStorage*> LiveStorage;
+
+	MemoryAccount StorageAccount;
+
+
+	//
+	// Pools of recycled storage blocks, one per size class
+	//
+	// Pooled blocks are typically allocated by one thread and released
+	// by another (e.g. message payloads), so the pools are lock-free
+	// lists which any thread may push to or pop from. Blocks in a pool
+	// remain registered as live storage, which saves the registration
+	// work on each reuse; their contents are cleared on release so the
+	// garbage collector does not find stale handles in idle blocks.
+	//
+	// Statically zeroed list headers are valid empty lists.
+	//
+	const size_t MinPooledSize = 16;
+	const size_t NumPoolSizeClasses = 5;			// 16 through 256 bytes
+	const USHORT MaxPooledPerSizeClass = 256;
+
+	SLIST_HEADER StoragePools[NumPoolSizeClasses];
+
+
+	//
+	// Determine which pool services blocks of the given size
+	// Returns false if the size is too large to be pooled
+	//
+	bool GetPoolSizeClass(size_t numbytes, size_t& sizeclass)
+	{
+		for(sizeclass = 0; sizeclass < NumPoolSizeClasses; ++sizeclass)
+		{
+			if(numbytes <= (MinPooledSize << sizeclass))
+				return true;
+		}
+
+		return false;
+	}
+}
 
 
 //
 // Construct and initialize the heap storage wrapper
 //
 HeapStorage::HeapStorage()
-	: AllocatedSpace(NULL)
+	: AllocatedSpace(NULL),
+	  AllocatedSize(0),
+	  NumHolders(1)
 {
+	{
+		Threads::CriticalSection::Auto mutex(LiveStorageCriticalSection);
+		LiveStorage.insert(this);
+	}
+
+	StorageAccount.Allocated(0);
 }
 
 //
@@ -23,7 +78,13 @@ HeapStorage::HeapStorage()
 //
 HeapStorage::~HeapStorage()
 {
-	delete [] AllocatedSpace;
+	{
+		Threads::CriticalSection::Auto mutex(LiveStorageCriticalSection);
+		LiveStorage.erase(this);
+	}
+
+	StorageAccount.Released(AllocatedSize);
+	ThreadLocalArena::Free(AllocatedSpace);
 }
 
 //
@@ -32,7 +93,127 @@ HeapStorage::~HeapStorage()
 //
 void HeapStorage::Allocate(size_t numbytes)
 {
-	delete [] AllocatedSpace;
-	AllocatedSpace = new Byte[numbytes];
+	ThreadLocalArena::Free(AllocatedSpace);
+	StorageAccount.Resized(AllocatedSize, 0);
+	AllocatedSpace = NULL;
+	AllocatedSize = 0;
+
+	AllocatedSpace = static_cast<Byte*>(ThreadLocalArena::Allocate(numbytes));
+	AllocatedSize = numbytes;
+	StorageAccount.Resized(0, numbytes);
+}
+
+
+//
+// Obtain a storage block of at least the given size, reusing a pooled block if possible
+//
+// Blocks obtained this way should be handed back via ReleasePooled; note
+// that the block may be larger than requested, and that its contents
+// are always zeroed.
+//
+HeapStorage* HeapStorage::AcquirePooled(size_t numbytes)
+{
+	size_t sizeclass;
+	if(!GetPoolSizeClass(numbytes, sizeclass))
+	{
+		std::auto_ptr<HeapStorage> storage(new HeapStorage);
+		storage->Allocate(numbytes);
+		return storage.release();
+	}
+
+	PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&StoragePools[sizeclass]);
+	if(entry)
+		return reinterpret_cast<HeapStorage*>(entry);
+
+	std::auto_ptr<HeapStorage> storage(new HeapStorage);
+	storage->Allocate(MinPooledSize << sizeclass);
+	memset(storage->AllocatedSpace, 0, storage->AllocatedSize);
+	return storage.release();
+}
+
+//
+// Return a storage block to the pools for later reuse
+//
+// Blocks which do not fit a size class, or whose pool is already full,
+// are simply freed. This may be called from any thread.
+//
+// A block shared among several holders (see ShareAmong) is only recycled
+// once the last of them has released it. A holder which still sees more
+// than one holder must drop a reference; a holder which sees only itself
+// is necessarily the last, since the count never goes back up.
+//
+void HeapStorage::ReleasePooled(HeapStorage* storage)
+{
+	if(!storage)
+		return;
+
+	if(storage->NumHolders > 1 && ::InterlockedDecrement(&storage->NumHolders) > 0)
+		return;
+
+	storage->NumHolders = 1;
+
+	size_t sizeclass;
+	if(GetPoolSizeClass(storage->AllocatedSize, sizeclass) && storage->AllocatedSize == (MinPooledSize << sizeclass))
+	{
+		if(::QueryDepthSList(&StoragePools[sizeclass]) < MaxPooledPerSizeClass)
+		{
+			memset(storage->AllocatedSpace, 0, storage->AllocatedSize);
+			::InterlockedPushEntrySList(&StoragePools[sizeclass], &storage->PoolEntry);
+			return;
+		}
+	}
+
+	delete storage;
+}
+
+//
+// Hand the block to the given number of holders at once
+//
+// Each holder must eventually pass the block to ReleasePooled, and none
+// of them may change its contents; this is used to give every receiver
+// of a broadcast message the same payload. Must be called before the
+// block is handed to any of the holders.
+//
+void HeapStorage::ShareAmong(LONG numholders)
+{
+	NumHolders = numholders;
+}
+
+//
+// Free all blocks currently held in the pools
+//
+void HeapStorage::FreeAllPooled()
+{
+	for(size_t sizeclass = 0; sizeclass < NumPoolSizeClasses; ++sizeclass)
+	{
+		while(PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&StoragePools[sizeclass]))
+			delete reinterpret_cast<HeapStorage*>(entry);
+	}
+}
+
+
+//
+// Retrieve the number and total size of storage blocks in existence
+//
+MemoryAccount::Statistics HeapStorage::GetMemoryStatistics()
+{
+	return StorageAccount.GetStatistics();
+}
+
+//
+// Retrieve the location and size of each allocated storage block
+//
+HeapStorage::RegionList HeapStorage::GetLiveStorageRegions()
+{
+	RegionList regions;
+
+	Threads::CriticalSection::Auto mutex(LiveStorageCriticalSection);
+	for(std::set<const HeapStorage*>::const_iterator iter = LiveStorage.begin(); iter != LiveStorage.end(); ++iter)
+	{
+		if((*iter)->AllocatedSpace)
+			regions.push_back(std::make_pair(static_cast<const void*>((*iter)->AllocatedSpace), (*iter)->AllocatedSize));
+	}
+
+	return regions;
 }
 
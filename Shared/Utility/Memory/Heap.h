@@ -8,6 +8,11 @@
 #pragma once
 
 
+// Dependencies
+#include "Utility/Memory/ThreadLocalAllocator.h"
+#include "Utility/Memory/Accounting.h"
+
+
 class HeapStorage
 {
 // Construction and destruction
@@ -15,6 +20,14 @@ public:
 	HeapStorage();
 	~HeapStorage();
 
+// Object allocation
+public:
+	static void* operator new(size_t size)
+	{ return ThreadLocalArena::Allocate(size); }
+
+	static void operator delete(void* ptr)
+	{ ThreadLocalArena::Free(ptr); }
+
 // Memory management interface
 public:
 	void Allocate(size_t numbytes);
@@ -22,8 +35,33 @@ public:
 	void* GetStartOfStorage() const
 	{ return AllocatedSpace; }
 
+	size_t GetSize() const
+	{ return AllocatedSize; }
+
+// Pooled storage for short-lived blocks
+public:
+	static HeapStorage* AcquirePooled(size_t numbytes);
+	static void ReleasePooled(HeapStorage* storage);
+	static void FreeAllPooled();
+
+// Sharing of a single block between several holders
+public:
+	void ShareAmong(LONG numholders);
+
+// Enumeration of all storage blocks currently in existence
+public:
+	typedef std::vector<std::pair<const void*, size_t> > RegionList;
+	static RegionList GetLiveStorageRegions();
+
+// Memory accounting for all storage blocks, including pooled blocks
+public:
+	static MemoryAccount::Statistics GetMemoryStatistics();
+
 // Internal tracking
 private:
+	SLIST_ENTRY PoolEntry;			// Must be first, for the storage pools
 	Byte* AllocatedSpace;
+	size_t AllocatedSize;
+	volatile LONG NumHolders;
 };
 
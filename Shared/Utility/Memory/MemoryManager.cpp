@@ -40,7 +40,11 @@ HeapManager::~HeapManager()
 // Construct a wrapper for managing unaligned memory blocks.
 //
 UnalignedMemoryAllocator::UnalignedMemoryAllocator(size_t initialblocksize)
+	: BlockSize(initialblocksize)
 {
+	for(size_t i = 0; i < NumSizeClasses; ++i)
+		FreeLists[i] = NULL;
+
 	AllocateBlock(initialblocksize);
 }
 
@@ -67,34 +71,139 @@ void UnalignedMemoryAllocator::AllocateBlock(size_t numbytes)
 	if(!memory)
 		throw MemoryException("Failed to allocate heap memory!");
 
-	AllocBlocks.push_back(AllocBlock(memory, numbytes));
+	AllocBlocks.push_back(AllocBlock(memory, numpages * TheGlobalHeap.GetPageSize()));
 }
 
 //
-// Commit a block of memory. This will use existing memory chunks if possible,
-// or allocate new pages as necessary.
+// Commit a block of memory. This will reuse freed memory of the same size
+// class if possible, then existing memory chunks, and finally allocate new
+// pages as necessary.
 //
 void* UnalignedMemoryAllocator::CommitMemory(size_t numbytes)
 {
-	for(std::vector<AllocBlock>::iterator iter = AllocBlocks.begin(); iter != AllocBlocks.end(); ++iter)
+	size_t chunksize = numbytes + sizeof(AllocHeader);
+	size_t sizeclass = GetSizeClass(chunksize);
+
+	if(sizeclass != NoSizeClass)
 	{
-		AllocBlock& block = *iter;
-		if(block.FreeOffset + numbytes <= block.NumBytes)
-			return block.Commit(numbytes);
+		chunksize = SmallestClassSize << sizeclass;
+
+		FreeChunk* chunk = FreeLists[sizeclass];
+		if(chunk)
+		{
+			FreeLists[sizeclass] = chunk->Next;
+			++AllocBlocks[chunk->Header.BlockIndex].LiveAllocations;
+			return &chunk->Header + 1;
+		}
 	}
 
-	AllocateBlock(numbytes);
-	return AllocBlocks.rbegin()->Commit(numbytes);
+	return CommitChunk(chunksize);
 }
 
 
 //
-// Release a block of memory. This marks a region of memory as freed; memory
-// which is freed can be consolidated during the garbage collection phase,
-// and then be reused for new allocations.
+// Release a block of memory so that it can be reused by later allocations.
 //
 void UnalignedMemoryAllocator::FreeMemory(void* address)
 {
-	// TODO - implement memory release mechanism and garbage collection
+	if(!address)
+		return;
+
+	FreeChunk* chunk = reinterpret_cast<FreeChunk*>(reinterpret_cast<AllocHeader*>(address) - 1);
+	size_t blockindex = chunk->Header.BlockIndex;
+	AllocBlock& block = AllocBlocks[blockindex];
+
+	if(!block.LiveAllocations)
+		throw MemoryException("Freed memory which was not allocated from this allocator!");
+
+	// Recycle the entire block once nothing in it remains in use
+	if(--block.LiveAllocations == 0)
+	{
+		ReleaseFreeChunksInBlock(blockindex);
+		block.FreeOffset = 0;
+		return;
+	}
+
+	// Coalesce the chunk with the unused space at the end of the block, if it is adjacent
+	if(block.IsLastCommitted(chunk, chunk->Header.ChunkSize))
+	{
+		block.FreeOffset -= chunk->Header.ChunkSize;
+		return;
+	}
+
+	// Large allocations start out in a block of their own, but smaller chunks
+	// may later be carved from the space after them; such an allocation is
+	// reclaimed along with the rest of the block once the block empties
+	size_t sizeclass = GetSizeClass(chunk->Header.ChunkSize);
+	if(sizeclass == NoSizeClass)
+		return;
+
+	chunk->Next = FreeLists[sizeclass];
+	FreeLists[sizeclass] = chunk;
+}
+
+
+//
+// Determine which size class serves chunks of the given size (including the header)
+//
+size_t UnalignedMemoryAllocator::GetSizeClass(size_t chunksize)
+{
+	size_t classsize = SmallestClassSize;
+	for(size_t sizeclass = 0; sizeclass < NumSizeClasses; ++sizeclass)
+	{
+		if(chunksize <= classsize)
+			return sizeclass;
+		classsize <<= 1;
+	}
+
+	return NoSizeClass;
+}
+
+//
+// Carve a fresh chunk out of the allocated blocks, allocating a new block if none has room
+//
+// Chunks too large for any size class are placed in an empty block of
+// their own, so that freeing them always allows the block to be recycled.
+//
+void* UnalignedMemoryAllocator::CommitChunk(size_t chunksize)
+{
+	bool large = (GetSizeClass(chunksize) == NoSizeClass);
+
+	size_t blockindex = 0;
+	for(; blockindex < AllocBlocks.size(); ++blockindex)
+	{
+		const AllocBlock& block = AllocBlocks[blockindex];
+		if(large && block.LiveAllocations)
+			continue;
+
+		if(block.FreeOffset + chunksize <= block.NumBytes)
+			break;
+	}
+
+	if(blockindex == AllocBlocks.size())
+		AllocateBlock(large ? chunksize : std::max(chunksize, BlockSize));
+
+	AllocHeader* header = reinterpret_cast<AllocHeader*>(AllocBlocks[blockindex].Commit(chunksize));
+	header->BlockIndex = static_cast<UInteger32>(blockindex);
+	header->ChunkSize = static_cast<UInteger32>(chunksize);
+	return header + 1;
+}
+
+//
+// Remove all free list entries which lie within the given block, ahead of recycling the block
+//
+void UnalignedMemoryAllocator::ReleaseFreeChunksInBlock(size_t blockindex)
+{
+	for(size_t sizeclass = 0; sizeclass < NumSizeClasses; ++sizeclass)
+	{
+		FreeChunk** link = &FreeLists[sizeclass];
+		while(*link)
+		{
+			if((*link)->Header.BlockIndex == blockindex)
+				*link = (*link)->Next;
+			else
+				link = &(*link)->Next;
+		}
+	}
 }
 
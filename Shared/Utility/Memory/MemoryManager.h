@@ -58,8 +58,20 @@ public:
 //
 // This memory allocator is the simplest and has the least overhead, both in
 // terms of allocation/deallocation complexity, and in terms of extra memory
-// padding. All memory is packed as tightly as possible on the heap without
-// regards for alignment.
+// padding. Memory is carved out of large blocks on the heap without regards
+// for alignment beyond that of the blocks themselves.
+//
+// Small allocations are rounded up to one of a set of power-of-two size
+// classes; freed allocations are kept on a free list for their class and
+// handed out again by later requests of the same class. Freeing the most
+// recent allocation in a block returns its space to the block directly,
+// and once every allocation in a block has been freed, the whole block
+// is recycled for use by allocations of any size. Allocations too large
+// for any size class are given a block of their own, which is likewise
+// recycled once the allocation is freed.
+//
+// The allocator is not internally synchronized; each instance should be
+// used from a single thread at a time.
 //
 class UnalignedMemoryAllocator : public MemoryAllocator
 {
@@ -83,12 +95,13 @@ protected:
 		void* Storage;
 		size_t NumBytes;
 		size_t FreeOffset;
+		size_t LiveAllocations;
 
 		//
 		// Initialize the block tracking structure
 		//
 		AllocBlock(void* storage, size_t numbytes)
-			: Storage(storage), NumBytes(numbytes), FreeOffset(0)
+			: Storage(storage), NumBytes(numbytes), FreeOffset(0), LiveAllocations(0)
 		{ }
 
 		//
@@ -106,12 +119,50 @@ protected:
 			if(FreeOffset > NumBytes)
 				throw MemoryException("Overcommitted an unaligned allocation block!");
 
+			++LiveAllocations;
 			return ptr;
 		}
+
+		//
+		// Determine if the given chunk is the last one committed from this block
+		//
+		bool IsLastCommitted(const void* chunk, size_t chunksize) const
+		{ return (reinterpret_cast<const Byte*>(chunk) + chunksize == reinterpret_cast<const Byte*>(Storage) + FreeOffset); }
+	};
+
+	//
+	// Header stored immediately ahead of each committed allocation
+	//
+	struct AllocHeader
+	{
+		UInteger32 BlockIndex;
+		UInteger32 ChunkSize;			// Including the header
 	};
 
+	//
+	// Layout of a freed allocation waiting on a free list; the
+	// header is left intact so that the chunk can be reused as-is
+	//
+	struct FreeChunk
+	{
+		AllocHeader Header;
+		FreeChunk* Next;
+	};
+
+	static const size_t NumSizeClasses = 9;
+	static const size_t SmallestClassSize = 16;
+	static const size_t NoSizeClass = ~static_cast<size_t>(0);
+
+// Internal helpers
+protected:
+	static size_t GetSizeClass(size_t chunksize);
+
+	void* CommitChunk(size_t chunksize);
+	void ReleaseFreeChunksInBlock(size_t blockindex);
+
 // Internal storage
 protected:
 	std::vector<AllocBlock> AllocBlocks;
+	FreeChunk* FreeLists[NumSizeClasses];
+	size_t BlockSize;
 };
-
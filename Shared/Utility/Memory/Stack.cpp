@@ -12,14 +12,141 @@
 // and cleanly decouples the stack from any client code, and
 // allows any form of data to be stored without code overhead.
 //
+// The full size of each stack is reserved as address space when
+// the stack is created, but memory is only committed one segment
+// at a time, as pushes reach past the committed region. A stack
+// which never gets deep therefore only costs a single segment of
+// real memory, regardless of the configured stack size. Since the
+// reservation is contiguous, addresses of values on the stack stay
+// valid as the stack grows. The lowest segment of the reservation
+// is never committed, and serves as a guard region: any stray
+// access beyond the end of the stack faults immediately instead
+// of corrupting unrelated memory.
+//
+// Threads which run many short-lived work items (such as thread
+// pool workers) keep a small cache of released stacks, so that a
+// new stack can reuse an existing reservation and its committed
+// top segment instead of going back to the OS each time.
+//
 
 
 #include "pch.h"
 
 #include "Utility/Memory/Stack.h"
-#include "Utility/Memory/MemoryManager.h"
 
 #include "Configuration/RuntimeOptions.h"
+#include "Configuration/AutoTuning.h"
+
+
+namespace
+{
+
+	// Stack memory is committed in segments of this size
+	const size_t SegmentSize = 64 * 1024;
+
+	// Number of released stacks each thread keeps for reuse
+	const size_t MaxCachedStacksPerThread = 4;
+
+
+	//
+	// Tracking for released stack reservations
+	//
+	struct CachedStack
+	{
+		void* Allocation;
+		size_t ReservedBytes;
+	};
+
+	typedef std::vector<CachedStack> StackCache;
+
+	DWORD StackCacheTLSIndex = TLS_OUT_OF_INDEXES;
+
+
+	//
+	// Accounting of committed stack memory
+	//
+	MemoryAccount StackAccount;
+	volatile LONG_PTR DeepestStack = 0;
+
+
+	//
+	// Retrieve the stack cache owned by the current thread, if any
+	//
+	StackCache* GetStackCacheForThisThread()
+	{
+		if(StackCacheTLSIndex == TLS_OUT_OF_INDEXES)
+			return NULL;
+
+		return static_cast<StackCache*>(::TlsGetValue(StackCacheTLSIndex));
+	}
+
+	//
+	// Round the given size up to a whole number of segments
+	//
+	size_t RoundUpToSegment(size_t numbytes)
+	{
+		return ((numbytes + SegmentSize - 1) / SegmentSize) * SegmentSize;
+	}
+
+}
+
+
+//
+// Initialize the stack caching logic
+//
+void StackSpace::Init()
+{
+	StackCacheTLSIndex = ::TlsAlloc();
+}
+
+//
+// Shut down the stack caching logic
+//
+void StackSpace::Shutdown()
+{
+	if(StackCacheTLSIndex != TLS_OUT_OF_INDEXES)
+		::TlsFree(StackCacheTLSIndex);
+
+	StackCacheTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+//
+// Provide the current thread with a cache of released stacks
+//
+void StackSpace::AttachCacheToThisThread()
+{
+	if(StackCacheTLSIndex == TLS_OUT_OF_INDEXES || GetStackCacheForThisThread())
+		return;
+
+	::TlsSetValue(StackCacheTLSIndex, new StackCache);
+}
+
+//
+// Release all stacks cached by the current thread
+//
+void StackSpace::DetachCacheFromThisThread()
+{
+	std::auto_ptr<StackCache> cache(GetStackCacheForThisThread());
+	if(!cache.get())
+		return;
+
+	::TlsSetValue(StackCacheTLSIndex, NULL);
+
+	for(StackCache::const_iterator iter = cache->begin(); iter != cache->end(); ++iter)
+		::VirtualFree(iter->Allocation, 0, MEM_RELEASE);
+}
+
+
+//
+// Retrieve the total committed memory of all stacks, and the largest committed size of any one stack
+//
+StackSpace::MemoryStatistics StackSpace::GetMemoryStatistics()
+{
+	MemoryStatistics stats;
+	stats.Committed = StackAccount.GetStatistics();
+	stats.DeepestStack = static_cast<size_t>(Atomic::LoadAcquire(&DeepestStack));
+	return stats;
+}
 
 
 //
@@ -27,15 +154,11 @@
 //
 
 //
-// Construct a stack and allocate the default amount of space.
+// Construct a stack and reserve the default amount of space.
 //
 StackSpace::StackSpace()
 {
-	StackAllocation = ::HeapAlloc(TheGlobalHeap.GetHeap(), 0, Config::StackSize);
-	CurrentStackPointer = EndOfStackAllocation = reinterpret_cast<Byte*>(StackAllocation) + Config::StackSize;
-#ifdef _DEBUG
-	memset(StackAllocation, 0xee, Config::StackSize);
-#endif
+	Reserve(Config::StackSize);
 }
 
 //
@@ -43,38 +166,141 @@ StackSpace::StackSpace()
 //
 StackSpace::StackSpace(size_t numbytes)
 {
-	StackAllocation = ::HeapAlloc(TheGlobalHeap.GetHeap(), 0, numbytes);
-	CurrentStackPointer = EndOfStackAllocation = reinterpret_cast<Byte*>(StackAllocation) + numbytes;
+	Reserve(numbytes);
+}
+
+//
+// Return the stack's memory to the thread's cache, or release it.
+//
+// Cached stacks keep only their topmost segment committed, so that
+// a deep recursion does not pin a large amount of memory for reuse.
+//
+StackSpace::~StackSpace()
+{
+	StackAccount.Released(GetCommittedStack());
+
+	if(Config::AutoTuneRuntime)
+		Config::AutoTuning::RecordStackUsage(GetCommittedStack());
+
+	StackCache* cache = GetStackCacheForThisThread();
+	if(cache && cache->size() < MaxCachedStacksPerThread)
+	{
+		Byte* retained = reinterpret_cast<Byte*>(EndOfStackAllocation) - SegmentSize;
+		if(CommittedLimit < retained)
+			::VirtualFree(CommittedLimit, retained - reinterpret_cast<Byte*>(CommittedLimit), MEM_DECOMMIT);
+
+		CachedStack cached;
+		cached.Allocation = StackAllocation;
+		cached.ReservedBytes = ReservedBytes;
+		cache->push_back(cached);
+		return;
+	}
+
+	::VirtualFree(StackAllocation, 0, MEM_RELEASE);
+}
+
+//
+// Set up the stack's address space, reusing a cached reservation if possible.
+//
+// The reservation includes an extra guard segment below the usable
+// space, which is never committed. The topmost segment is committed
+// straight away, since practically every stack will need it.
+//
+void StackSpace::Reserve(size_t numbytes)
+{
+	ReservedBytes = RoundUpToSegment(numbytes) + SegmentSize;
+	if(ReservedBytes < SegmentSize * 2)
+		ReservedBytes = SegmentSize * 2;
+
+	StackAllocation = NULL;
+
+	StackCache* cache = GetStackCacheForThisThread();
+	if(cache)
+	{
+		for(StackCache::iterator iter = cache->begin(); iter != cache->end(); ++iter)
+		{
+			if(iter->ReservedBytes == ReservedBytes)
+			{
+				StackAllocation = iter->Allocation;
+				cache->erase(iter);
+				break;
+			}
+		}
+	}
+
+	bool reused = (StackAllocation != NULL);
+	if(!reused)
+	{
+		StackAllocation = ::VirtualAlloc(NULL, ReservedBytes, MEM_RESERVE, PAGE_NOACCESS);
+		if(!StackAllocation)
+			throw MemoryException("Failed to reserve stack space");
+	}
+
+	StackLimit = reinterpret_cast<Byte*>(StackAllocation) + SegmentSize;
+	CurrentStackPointer = CommittedLimit = EndOfStackAllocation = reinterpret_cast<Byte*>(StackAllocation) + ReservedBytes;
+
+	StackAccount.Allocated(0);
+
+	if(reused)
+	{
+		CommittedLimit = reinterpret_cast<Byte*>(EndOfStackAllocation) - SegmentSize;
+		StackAccount.Resized(0, SegmentSize);
 #ifdef _DEBUG
-	memset(StackAllocation, 0xee, numbytes);
+		memset(CommittedLimit, 0xee, SegmentSize);
 #endif
+	}
+	else if(!CommitSpaceFor(reinterpret_cast<Byte*>(EndOfStackAllocation) - 1))
+	{
+		StackAccount.Released(0);
+		::VirtualFree(StackAllocation, 0, MEM_RELEASE);
+		throw MemoryException("Failed to commit stack space");
+	}
 }
 
 //
-// Clean up the stack's memory.
+// Commit enough additional segments to make the given stack pointer valid.
 //
-StackSpace::~StackSpace()
+// Returns false if the stack cannot grow that far.
+//
+bool StackSpace::CommitSpaceFor(void* newstackpointer)
 {
-	::HeapFree(TheGlobalHeap.GetHeap(), 0, StackAllocation);
+	if(newstackpointer <= StackLimit)
+		return false;
+
+	size_t numbytes = RoundUpToSegment(reinterpret_cast<Byte*>(CommittedLimit) - reinterpret_cast<Byte*>(newstackpointer));
+	Byte* newlimit = reinterpret_cast<Byte*>(CommittedLimit) - numbytes;
+
+	if(!::VirtualAlloc(newlimit, numbytes, MEM_COMMIT, PAGE_READWRITE))
+		return false;
+
+#ifdef _DEBUG
+	memset(newlimit, 0xee, numbytes);
+#endif
+
+	CommittedLimit = newlimit;
+
+	StackAccount.Resized(0, numbytes);
+	Atomic::UpdateMaximum(&DeepestStack, static_cast<LONG_PTR>(GetCommittedStack()));
+	return true;
 }
 
 //
-// Push a given number of bytes onto the stack.
+// Grow the committed region of the stack to cover a push which
+// has reached past it, failing if the stack is exhausted.
 //
-void StackSpace::Push(size_t numbytes)
+void StackSpace::Grow(void* newstackpointer)
 {
-	CurrentStackPointer = reinterpret_cast<Byte*>(CurrentStackPointer) - numbytes;
-	if(CurrentStackPointer <= StackAllocation)
+	if(!CommitSpaceFor(newstackpointer))
 	{
-		CurrentStackPointer = StackAllocation;
+		CurrentStackPointer = StackLimit;
 		throw MemoryException("Out of stack space");
 	}
 }
 
 //
-// Pop a given number of bytes off the stack.
+// Pop a given number of bytes off the stack, checking for excess pops.
 //
-void StackSpace::Pop(size_t numbytes)
+void StackSpace::CheckedPop(size_t numbytes)
 {
 #ifdef _DEBUG
 	memset(CurrentStackPointer, 0xcc, numbytes);
@@ -95,4 +321,4 @@ void StackSpace::Pop(size_t numbytes)
 
 //
 // END platform-dependent assumptions
-//
\ No newline at end of file
+//
\ No newline at end of file
@@ -5,10 +5,17 @@
 // Definition of the basic push-down, downward-growing stack
 // used during execution of code within the virtual machine.
 //
+// Stack memory is reserved up front but only committed as it is
+// actually used; see Stack.cpp for details.
+//
 
 #pragma once
 
 
+// Dependencies
+#include "Utility/Memory/Accounting.h"
+
+
 //
 // Basic implementation of a downward-growing stack
 //
@@ -21,10 +28,41 @@ public:
 
 	~StackSpace();
 
+// Per-thread caching of released stacks
+public:
+	static void Init();
+	static void Shutdown();
+
+	static void AttachCacheToThisThread();
+	static void DetachCacheFromThisThread();
+
 // Stack manipulation
+//
+// These are called for practically every value the VM handles, so
+// they are kept inline. Pushing only needs to check the committed
+// region of the stack, with growth handled out of line; popping is
+// only checked in debug builds, since an excess pop is always a bug
+// in the VM itself rather than in the program being executed.
 public:
-	void Push(size_t numbytes);
-	void Pop(size_t numbytes);
+	void Push(size_t numbytes)
+	{
+		// WARNING - this code makes a platform-dependent assumption that char is 1 byte
+		void* newstackpointer = reinterpret_cast<Byte*>(CurrentStackPointer) - numbytes;
+		if(newstackpointer < CommittedLimit)
+			Grow(newstackpointer);
+
+		CurrentStackPointer = newstackpointer;
+	}
+
+	void Pop(size_t numbytes)
+	{
+#ifdef _DEBUG
+		CheckedPop(numbytes);
+#else
+		// WARNING - this code makes a platform-dependent assumption that char is 1 byte
+		CurrentStackPointer = reinterpret_cast<Byte*>(CurrentStackPointer) + numbytes;
+#endif
+	}
 
 // Stack address retrieval
 public:
@@ -39,11 +77,38 @@ public:
 public:
 	size_t GetAllocatedStack() const
 	{ return reinterpret_cast<Byte*>(EndOfStackAllocation) - reinterpret_cast<Byte*>(CurrentStackPointer); }
+
+	size_t GetCommittedStack() const
+	{ return reinterpret_cast<Byte*>(EndOfStackAllocation) - reinterpret_cast<Byte*>(CommittedLimit); }
 	// END platform-dependent assumptions
 
+// Memory accounting for all stacks
+//
+// Stack memory is accounted as it is committed, so the peak committed
+// size of the deepest stack is its high-water mark, to within a segment.
+public:
+	struct MemoryStatistics
+	{
+		MemoryAccount::Statistics Committed;
+		size_t DeepestStack;
+	};
+
+	static MemoryStatistics GetMemoryStatistics();
+
+// Internal helpers
+private:
+	void Reserve(size_t numbytes);
+	bool CommitSpaceFor(void* newstackpointer);
+
+	void Grow(void* newstackpointer);
+	void CheckedPop(size_t numbytes);
+
 // Internal tracking
 private:
 	void* StackAllocation;
+	size_t ReservedBytes;
+	void* StackLimit;
+	void* CommittedLimit;
 	void* EndOfStackAllocation;
 	void* CurrentStackPointer;
 };
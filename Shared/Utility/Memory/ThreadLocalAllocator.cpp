@@ -10,12 +10,33 @@
 // pass thread-local memory into other areas of the code that might try to
 // free the memory or access it post-release.
 //
+// The arena interface is intended for small, short-lived objects which are
+// allocated at a high rate, such as r-values and activated scopes. Each
+// thread owns an arena containing one free list per size class; requests
+// are rounded up to the nearest class and satisfied from the free list,
+// which is refilled by carving fixed-size chunks of memory into blocks.
+// Requests too large for any size class go directly to the process heap.
+//
+// Unlike the thread-local heap, arena memory may be freed by any thread.
+// Each block is prefixed by a small header identifying the owning arena;
+// blocks freed by their owner go straight back onto its free list, while
+// blocks freed elsewhere are pushed onto a lock-free list of remote frees,
+// which the owner reclaims the next time one of its free lists runs dry.
+//
+// Since blocks can outlive the thread which allocated them, arenas are not
+// destroyed when their threads exit; instead they are retired and handed
+// to the next thread that starts up, so the total number of arenas never
+// exceeds the peak number of concurrently running threads.
+//
 
 #include "pch.h"
 
 #include "Utility/Memory/ThreadLocalAllocator.h"
 
 #include "Utility/Threading/Threads.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Threading/Lockless.h"
+#include "Utility/Threading/ThreadExceptions.h"
 
 
 //
@@ -33,3 +54,359 @@ void ThreadLocalFree(void* ptr)
 {
 	::HeapFree(Threads::GetInfoForThisThread().LocalHeapHandle, HEAP_NO_SERIALIZE, ptr);
 }
+
+
+namespace
+{
+
+	//
+	// Size classes available from the arenas
+	//
+	// The smaller classes cover the r-value types, while the larger ones
+	// are mainly used by activated scopes and small heap storage blocks.
+	//
+	const size_t SizeClasses[] = { 16, 32, 64, 128, 256, 512 };
+	const size_t NumSizeClasses = sizeof(SizeClasses) / sizeof(SizeClasses[0]);
+
+	// Amount of memory reserved each time a free list needs refilling
+	const size_t ChunkSize = 64 * 1024;
+
+
+	// Forward declarations
+	class Arena;
+
+	//
+	// Header prefixed to every block handed out by the arena interface
+	//
+	// The union ensures that the memory following the header is aligned
+	// suitably for any of the types stored in it.
+	//
+	union BlockHeader
+	{
+		struct
+		{
+			Arena* Owner;				// NULL for large blocks taken from the process heap
+			size_t SizeClass;
+		} Info;
+
+		double Alignment;
+	};
+
+	//
+	// Overlay used for linking together blocks which are not in use
+	//
+	struct FreeBlock
+	{
+		BlockHeader Header;
+		FreeBlock* Next;
+	};
+
+
+	// Number of blocks taken directly from the process heap
+	volatile LONG LargeAllocations = 0;
+
+
+	//
+	// Collection of size-classed free lists owned by a single thread
+	//
+	class Arena
+	{
+	// Construction
+	public:
+		Arena()
+			: RemoteFreeList(NULL),
+			  Allocations(0),
+			  Frees(0),
+			  RemoteFrees(0)
+		{
+			for(size_t i = 0; i < NumSizeClasses; ++i)
+				FreeLists[i] = NULL;
+		}
+
+	// Allocation interface
+	public:
+		//
+		// Allocate a block from the given size class
+		//
+		// Must only be called by the thread which currently owns the arena.
+		//
+		void* Allocate(size_t sizeclass)
+		{
+			if(!FreeLists[sizeclass])
+			{
+				ReclaimRemoteFrees();
+				if(!FreeLists[sizeclass])
+					Refill(sizeclass);
+			}
+
+			FreeBlock* block = FreeLists[sizeclass];
+			FreeLists[sizeclass] = block->Next;
+
+			++Allocations;
+			return &block->Header + 1;
+		}
+
+		//
+		// Return a block to the arena from the owning thread
+		//
+		void FreeLocal(BlockHeader* header)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+			block->Next = FreeLists[header->Info.SizeClass];
+			FreeLists[header->Info.SizeClass] = block;
+
+			++Frees;
+		}
+
+		//
+		// Return a block to the arena from some other thread
+		//
+		// The remote list is only ever pushed onto by other threads, and
+		// emptied in its entirety by the owner, so a simple compare and
+		// swap loop is sufficient and there is no risk of ABA problems.
+		//
+		void FreeRemote(BlockHeader* header)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+
+			void* head;
+			do
+			{
+				head = Atomic::LoadAcquire(&RemoteFreeList);
+				block->Next = static_cast<FreeBlock*>(head);
+			} while(!Atomic::CompareAndSwapPointer(&RemoteFreeList, head, static_cast<void*>(block)));
+
+			::InterlockedIncrement(&RemoteFrees);
+		}
+
+	// Instrumentation
+	public:
+		void AccumulateStatistics(ThreadLocalArena::Statistics& stats) const
+		{
+			stats.ChunksReserved += Chunks.size();
+			stats.Allocations += Allocations;
+			stats.Frees += Frees + RemoteFrees;
+			stats.RemoteFrees += RemoteFrees;
+		}
+
+	// Internal helpers
+	private:
+		//
+		// Move all blocks freed by other threads back onto our own free lists
+		//
+		void ReclaimRemoteFrees()
+		{
+			FreeBlock* block = static_cast<FreeBlock*>(::InterlockedExchangePointer(&RemoteFreeList, NULL));
+			while(block)
+			{
+				FreeBlock* next = block->Next;
+				block->Next = FreeLists[block->Header.Info.SizeClass];
+				FreeLists[block->Header.Info.SizeClass] = block;
+				block = next;
+			}
+		}
+
+		//
+		// Reserve a new chunk of memory and carve it into blocks of the given size class
+		//
+		void Refill(size_t sizeclass)
+		{
+			void* chunk = ::HeapAlloc(::GetProcessHeap(), 0, ChunkSize);
+			if(!chunk)
+				throw MemoryException("Failed to reserve memory for thread-local arena");
+
+			Chunks.push_back(chunk);
+
+			const size_t blocksize = sizeof(BlockHeader) + SizeClasses[sizeclass];
+			const size_t numblocks = ChunkSize / blocksize;
+
+			Byte* storage = static_cast<Byte*>(chunk);
+			for(size_t i = 0; i < numblocks; ++i)
+			{
+				FreeBlock* block = reinterpret_cast<FreeBlock*>(storage + i * blocksize);
+				block->Header.Info.Owner = this;
+				block->Header.Info.SizeClass = sizeclass;
+				block->Next = FreeLists[sizeclass];
+				FreeLists[sizeclass] = block;
+			}
+		}
+
+	// Internal tracking
+	private:
+		FreeBlock* FreeLists[NumSizeClasses];
+		void* volatile RemoteFreeList;
+
+		std::vector<void*> Chunks;
+
+		size_t Allocations;
+		size_t Frees;
+		volatile LONG RemoteFrees;
+	};
+
+
+	//
+	// Tracking for all arenas in existence
+	//
+	Threads::CriticalSection ArenaCriticalSection;
+	std::vector<Arena*> AllArenas;
+	std::vector<Arena*> RetiredArenas;
+
+	DWORD ArenaTLSIndex = TLS_OUT_OF_INDEXES;
+
+
+	//
+	// Retrieve the arena owned by the current thread, if any
+	//
+	Arena* GetArenaForThisThread()
+	{
+		if(ArenaTLSIndex == TLS_OUT_OF_INDEXES)
+			return NULL;
+
+		return static_cast<Arena*>(::TlsGetValue(ArenaTLSIndex));
+	}
+
+	//
+	// Select the smallest size class which can hold the given number of bytes
+	//
+	size_t GetSizeClass(size_t size)
+	{
+		for(size_t i = 0; i < NumSizeClasses; ++i)
+		{
+			if(size <= SizeClasses[i])
+				return i;
+		}
+
+		return NumSizeClasses;
+	}
+
+}
+
+
+//
+// Initialize the arena management logic
+//
+void ThreadLocalArena::Init()
+{
+	ArenaTLSIndex = ::TlsAlloc();
+	if(ArenaTLSIndex == TLS_OUT_OF_INDEXES)
+		throw Threads::ThreadException("Failed to allocate thread-local storage");
+}
+
+//
+// Shut down the arena management logic
+//
+// Note that the arenas themselves are deliberately kept alive, since
+// blocks allocated from them may still be released during teardown;
+// any subsequent allocations are serviced by the process heap.
+//
+void ThreadLocalArena::Shutdown()
+{
+	::TlsFree(ArenaTLSIndex);
+	ArenaTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+//
+// Provide the current thread with an arena, reusing a retired one if possible
+//
+void ThreadLocalArena::AttachToThisThread()
+{
+	if(ArenaTLSIndex == TLS_OUT_OF_INDEXES)
+		return;
+
+	Arena* arena;
+	{
+		Threads::CriticalSection::Auto mutex(ArenaCriticalSection);
+		if(RetiredArenas.empty())
+		{
+			std::auto_ptr<Arena> newarena(new Arena);
+			AllArenas.push_back(newarena.get());
+			arena = newarena.release();
+		}
+		else
+		{
+			arena = RetiredArenas.back();
+			RetiredArenas.pop_back();
+		}
+	}
+
+	::TlsSetValue(ArenaTLSIndex, arena);
+}
+
+//
+// Retire the current thread's arena, so it can be reused by other threads
+//
+void ThreadLocalArena::DetachFromThisThread()
+{
+	Arena* arena = GetArenaForThisThread();
+	if(!arena)
+		return;
+
+	::TlsSetValue(ArenaTLSIndex, NULL);
+
+	Threads::CriticalSection::Auto mutex(ArenaCriticalSection);
+	RetiredArenas.push_back(arena);
+}
+
+//
+// Allocate a block of memory, preferably from the current thread's arena
+//
+void* ThreadLocalArena::Allocate(size_t size)
+{
+	size_t sizeclass = GetSizeClass(size);
+	Arena* arena = GetArenaForThisThread();
+
+	if(arena && sizeclass < NumSizeClasses)
+		return arena->Allocate(sizeclass);
+
+	BlockHeader* header = static_cast<BlockHeader*>(::HeapAlloc(::GetProcessHeap(), 0, sizeof(BlockHeader) + size));
+	if(!header)
+		throw MemoryException("Failed to allocate memory from the process heap");
+
+	header->Info.Owner = NULL;
+	header->Info.SizeClass = NumSizeClasses;
+	::InterlockedIncrement(&LargeAllocations);
+
+	return header + 1;
+}
+
+//
+// Release a block of memory allocated via the arena interface
+//
+// The block may be freed by any thread, not just the one which allocated it.
+//
+void ThreadLocalArena::Free(void* ptr)
+{
+	if(!ptr)
+		return;
+
+	BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+	Arena* owner = header->Info.Owner;
+
+	if(!owner)
+		::HeapFree(::GetProcessHeap(), 0, header);
+	else if(owner == GetArenaForThisThread())
+		owner->FreeLocal(header);
+	else
+		owner->FreeRemote(header);
+}
+
+//
+// Retrieve a snapshot of the allocation counters for all arenas
+//
+ThreadLocalArena::Statistics ThreadLocalArena::GetStatistics()
+{
+	Statistics stats;
+	stats.ChunksReserved = 0;
+	stats.Allocations = 0;
+	stats.Frees = 0;
+	stats.RemoteFrees = 0;
+	stats.LargeAllocations = LargeAllocations;
+
+	Threads::CriticalSection::Auto mutex(ArenaCriticalSection);
+	stats.NumArenas = AllArenas.size();
+	for(std::vector<Arena*>::const_iterator iter = AllArenas.begin(); iter != AllArenas.end(); ++iter)
+		(*iter)->AccumulateStatistics(stats);
+
+	return stats;
+}
+
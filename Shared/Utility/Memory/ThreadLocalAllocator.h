@@ -4,6 +4,14 @@
 //
 // A lock-free allocator local to the current thread
 //
+// Two flavors of thread-local allocation are provided here. The STL
+// allocator dispenses memory from the current thread's private heap,
+// and is suitable only for memory which never leaves the thread; the
+// arena interface dispenses small objects from size-classed free lists
+// owned by the current thread, and does support objects being passed
+// to (and freed by) other threads. See ThreadLocalAllocator.cpp for
+// details on how the arenas work.
+//
 
 #pragma once
 
@@ -86,3 +94,41 @@ public:
 	}
 };
 
+
+namespace ThreadLocalArena
+{
+
+	//
+	// Allocation counters, aggregated across all arenas
+	//
+	// The counters are updated without synchronization by the owning
+	// threads, so a snapshot taken while tasks are running is only an
+	// approximation; this is fine for tracking allocation behavior.
+	//
+	struct Statistics
+	{
+		size_t NumArenas;
+		size_t ChunksReserved;
+		size_t Allocations;
+		size_t Frees;
+		size_t RemoteFrees;
+		size_t LargeAllocations;
+	};
+
+
+	// Arena management setup/teardown
+	void Init();
+	void Shutdown();
+
+	void AttachToThisThread();
+	void DetachFromThisThread();
+
+	// Allocation interface
+	void* Allocate(size_t size);
+	void Free(void* ptr);
+
+	// Instrumentation
+	Statistics GetStatistics();
+
+}
+
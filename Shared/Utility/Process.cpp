@@ -15,6 +15,18 @@
 // Spin off a process and wait until it completes before returning
 //
 unsigned LaunchProcessSynchronous(const std::wstring& executablefile, const std::wstring& parameters)
+{
+	return WaitForProcess(LaunchProcess(executablefile, parameters));
+}
+
+
+//
+// Spin off a process and return immediately
+//
+// The returned handle may be waited on along with other handles; it must
+// eventually be passed to WaitForProcess, which releases it.
+//
+HANDLE LaunchProcess(const std::wstring& executablefile, const std::wstring& parameters)
 {
 	std::vector<WCHAR> buffer(std::max(static_cast<size_t>(2048), parameters.length() + 2), L'\0');
 	std::copy(parameters.begin(), parameters.end(), buffer.begin());
@@ -31,13 +43,21 @@ unsigned LaunchProcessSynchronous(const std::wstring& executablefile, const std:
 	if(!::CreateProcess(executablefile.c_str(), &buffer[0], NULL, NULL, FALSE, 0, NULL, NULL, &startinfo, &procinfo))
 		throw ProcessLaunchException("Could not locate the requested executable file (CreateProcess failed)");
 
+	::CloseHandle(procinfo.hThread);
+	return procinfo.hProcess;
+}
+
+//
+// Wait for a process started by LaunchProcess to complete, and retrieve its exit code
+//
+unsigned WaitForProcess(HANDLE process)
+{
 	DWORD exitcode;
 
-	::WaitForSingleObject(procinfo.hProcess, INFINITE);
-	::GetExitCodeProcess(procinfo.hProcess, &exitcode);
+	::WaitForSingleObject(process, INFINITE);
+	::GetExitCodeProcess(process, &exitcode);
 
-	::CloseHandle(procinfo.hThread);
-	::CloseHandle(procinfo.hProcess);
+	::CloseHandle(process);
 
 	return exitcode;
 }
@@ -25,3 +25,6 @@ public:
 
 unsigned LaunchProcessSynchronous(const std::wstring& executablefile, const std::wstring& parameters);
 
+HANDLE LaunchProcess(const std::wstring& executablefile, const std::wstring& parameters);
+unsigned WaitForProcess(HANDLE process);
+
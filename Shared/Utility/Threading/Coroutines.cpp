@@ -0,0 +1,148 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Asymmetric coroutines built on fibers
+//
+
+#include "pch.h"
+
+#include "Utility/Threading/Coroutines.h"
+#include "Utility/Threading/Threads.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+
+using namespace Threads;
+
+
+namespace
+{
+	// Coroutine being run by each thread, if any
+	DWORD CurrentCoroutineTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+
+//
+// Initialize the coroutine tracking logic
+//
+void Coroutine::Init()
+{
+	CurrentCoroutineTLSIndex = ::TlsAlloc();
+	if(CurrentCoroutineTLSIndex == TLS_OUT_OF_INDEXES)
+		throw ThreadException("Failed to allocate thread-local storage");
+}
+
+//
+// Shut down the coroutine tracking logic
+//
+void Coroutine::Shutdown()
+{
+	if(CurrentCoroutineTLSIndex != TLS_OUT_OF_INDEXES)
+		::TlsFree(CurrentCoroutineTLSIndex);
+
+	CurrentCoroutineTLSIndex = TLS_OUT_OF_INDEXES;
+}
+
+
+//
+// Construct a coroutine; the entry point does not start
+// running until the coroutine is first resumed
+//
+Coroutine::Coroutine(EntryPointPtr entrypoint, void* param, size_t stacksize)
+	: ReturnFiber(NULL),
+	  EntryPoint(entrypoint),
+	  Param(param),
+	  Running(false),
+	  Finished(false)
+{
+	Fiber = ::CreateFiberEx(0, stacksize, FIBER_FLAG_FLOAT_SWITCH, &Coroutine::FiberProc, this);
+	if(!Fiber)
+		throw ThreadException("Failed to create a fiber for a coroutine");
+}
+
+//
+// Release the coroutine's stack
+//
+Coroutine::~Coroutine()
+{
+	if(Fiber)
+		::DeleteFiber(Fiber);
+}
+
+
+//
+// Run the coroutine until it suspends itself or finishes
+//
+// Returns true if the coroutine suspended, and can be resumed again.
+// The fiber is released as soon as the entry point finishes, so that
+// finished coroutines do not hold on to their stacks.
+//
+bool Coroutine::Resume()
+{
+	if(Finished)
+		throw ThreadException("Cannot resume a coroutine which has already finished");
+
+	if(Running)
+		throw ThreadException("Cannot resume a coroutine which is already running");
+
+	ReturnFiber = GetFiberForThisThread();
+
+	void* previous = ::TlsGetValue(CurrentCoroutineTLSIndex);
+	::TlsSetValue(CurrentCoroutineTLSIndex, this);
+
+	Running = true;
+	::SwitchToFiber(Fiber);
+	Running = false;
+
+	::TlsSetValue(CurrentCoroutineTLSIndex, previous);
+
+	if(Finished)
+	{
+		::DeleteFiber(Fiber);
+		Fiber = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+//
+// Hand control back to whoever resumed the coroutine; must be
+// called from within the coroutine's own entry point
+//
+void Coroutine::Suspend()
+{
+	if(GetCurrent() != this)
+		throw ThreadException("A coroutine can only be suspended from within itself");
+
+	::SwitchToFiber(ReturnFiber);
+}
+
+//
+// Retrieve the coroutine being run by the calling thread, if any
+//
+Coroutine* Coroutine::GetCurrent()
+{
+	if(CurrentCoroutineTLSIndex == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	return reinterpret_cast<Coroutine*>(::TlsGetValue(CurrentCoroutineTLSIndex));
+}
+
+
+//
+// Entry point stub for coroutine fibers
+//
+// Like green tasks, coroutine fibers must never return from their entry
+// point; the finished coroutine switches back to its resumer instead,
+// and the resumer deletes the fiber.
+//
+void __stdcall Coroutine::FiberProc(void* param)
+{
+	Coroutine* self = reinterpret_cast<Coroutine*>(param);
+	self->EntryPoint(self->Param);
+
+	self->Finished = true;
+	::SwitchToFiber(self->ReturnFiber);
+}
+
@@ -0,0 +1,85 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Asymmetric coroutines built on fibers
+//
+// A coroutine runs its entry point on a native stack of its own. Whoever
+// resumes the coroutine is suspended until the coroutine either suspends
+// itself or finishes, at which point control returns to the resumer, on
+// the same OS thread. Only one side ever runs at a time, so no locking is
+// needed between a coroutine and the code which drives it; however, a
+// coroutine must never be resumed by two threads at once.
+//
+// A coroutine may be resumed from a different thread than the one which
+// last resumed it; the coroutine simply continues on whichever thread
+// resumed it most recently.
+//
+// Entry points must not let exceptions escape, since there is no caller
+// on the coroutine's stack to catch them. Destroying a coroutine which is
+// suspended part way through its entry point discards its stack without
+// unwinding it; owners which need the entry point to clean up must let it
+// run to completion first.
+//
+
+#pragma once
+
+
+namespace Threads
+{
+
+	class Coroutine
+	{
+	// Handy type shortcuts
+	public:
+		typedef void (*EntryPointPtr)(void* param);
+
+	// Construction and destruction
+	public:
+		Coroutine(EntryPointPtr entrypoint, void* param, size_t stacksize);
+		~Coroutine();
+
+	// Control transfer
+	public:
+		bool Resume();
+		void Suspend();
+
+	// Queries
+	public:
+		bool IsFinished() const
+		{ return Finished; }
+
+		bool IsRunning() const
+		{ return Running; }
+
+		void* GetParam() const
+		{ return Param; }
+
+		static Coroutine* GetCurrent();
+
+	// Coroutine system setup/teardown
+	public:
+		static void Init();
+		static void Shutdown();
+
+	// Internal helpers
+	private:
+		static void __stdcall FiberProc(void* param);
+
+	// Internal tracking
+	private:
+		LPVOID Fiber;
+		LPVOID ReturnFiber;
+		EntryPointPtr EntryPoint;
+		void* Param;
+		bool Running;
+		bool Finished;
+
+	// Non-copyable
+	private:
+		Coroutine(const Coroutine&);
+		Coroutine& operator = (const Coroutine&);
+	};
+
+}
+
@@ -4,30 +4,167 @@
 //
 // Basic building blocks for creating lock-free algorithms
 //
+// All atomic operations are implemented with compiler intrinsics, so that
+// they are available on both x86 and x64 builds. Plain loads and stores of
+// aligned values are already atomic on these platforms, and the hardware
+// memory model already gives loads acquire semantics and stores release
+// semantics; the acquire and release helpers therefore only need to keep
+// the compiler from reordering memory accesses around them, and compile
+// down to ordinary moves. Read-modify-write operations use the interlocked
+// intrinsics, which imply a full barrier.
+//
 
 #pragma once
 
+
+// Dependencies
+#include <intrin.h>
+
+#pragma intrinsic(_ReadWriteBarrier)
+#pragma intrinsic(_InterlockedCompareExchange)
+#pragma intrinsic(_InterlockedExchangeAdd)
+
+
 //
-// Helper function for atomic compare-and-swap
-// Returns true on success
+// Initial alignment required for values used with double width compare-and-swap
 //
-template <class DataType>
-bool CompareAndSwap(DataType* field, DataType oldvalue, DataType newvalue)
+#ifdef _WIN64
+#define ATOMIC_DOUBLE_WIDTH_ALIGNMENT		16
+#else
+#define ATOMIC_DOUBLE_WIDTH_ALIGNMENT		8
+#endif
+
+
+namespace Atomic
 {
-	DataType retval;
 
-	_asm
+	//
+	// Read a value, ensuring that no later memory accesses are moved ahead of the read
+	//
+	template <typename T>
+	inline T LoadAcquire(const volatile T* field)
+	{
+		T value = *field;
+		_ReadWriteBarrier();
+		return value;
+	}
+
+	//
+	// Write a value, ensuring that no earlier memory accesses are moved after the write
+	//
+	template <typename T>
+	inline void StoreRelease(volatile T* field, T value)
+	{
+		_ReadWriteBarrier();
+		*field = value;
+	}
+
+
+	//
+	// Atomically replace a value if it matches the expected value
+	// Returns the value held by the field prior to the operation
+	//
+	inline LONG CompareExchange(volatile LONG* field, LONG expected, LONG desired)
+	{
+		return _InterlockedCompareExchange(field, desired, expected);
+	}
+
+	//
+	// Atomically replace a value if it matches the expected value
+	// Returns true on success
+	//
+	inline bool CompareAndSwap(volatile LONG* field, LONG expected, LONG desired)
+	{
+		return (_InterlockedCompareExchange(field, desired, expected) == expected);
+	}
+
+	template <typename T>
+	inline bool CompareAndSwapPointer(T* volatile* field, T* expected, T* desired)
+	{
+		return (::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(field), desired, expected) == expected);
+	}
+
+
+	//
+	// Atomically add to a pointer sized value
+	// Returns the value held by the field after the operation
+	//
+	inline LONG_PTR Add(volatile LONG_PTR* field, LONG_PTR amount)
+	{
+#ifdef _WIN64
+		return _InterlockedExchangeAdd64(reinterpret_cast<volatile __int64*>(field), amount) + amount;
+#else
+		return _InterlockedExchangeAdd(reinterpret_cast<volatile long*>(field), amount) + amount;
+#endif
+	}
+
+	//
+	// Raise a pointer sized value to the given value, if it is not already higher
+	//
+	inline void UpdateMaximum(volatile LONG_PTR* field, LONG_PTR value)
+	{
+		LONG_PTR current = LoadAcquire(field);
+		while(value > current)
+		{
+			LONG_PTR previous = reinterpret_cast<LONG_PTR>(::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(field), reinterpret_cast<PVOID>(value), reinterpret_cast<PVOID>(current)));
+			if(previous == current)
+				break;
+			current = previous;
+		}
+	}
+
+
+	//
+	// Pointer paired with a modification counter
+	//
+	// Lock-free structures which pop nodes off a shared list are exposed
+	// to the ABA problem: a node may be removed and pushed back between
+	// the time a thread reads the list head and the time its CAS is done,
+	// so that the CAS succeeds even though the list has changed. Bumping
+	// the tag on every update of a tagged pointer ensures that any such
+	// intervening changes cause the CAS to fail.
+	//
+	struct __declspec(align(ATOMIC_DOUBLE_WIDTH_ALIGNMENT)) TaggedPointer
+	{
+		void* Pointer;
+		size_t Tag;
+	};
+
+	//
+	// Read a tagged pointer for use as the expected value of a subsequent CAS
+	//
+	// The two halves are not read atomically, but a torn read simply
+	// causes the following CAS to fail and report the current value.
+	//
+	inline TaggedPointer LoadTagged(const volatile TaggedPointer* field)
+	{
+		TaggedPointer value;
+		value.Tag = field->Tag;
+		_ReadWriteBarrier();
+		value.Pointer = field->Pointer;
+		return value;
+	}
+
+	//
+	// Atomically replace both halves of a tagged pointer if they match the expected value
+	//
+	// Returns true on success. On failure, the expected value is updated
+	// with the current contents of the field, ready for a retry.
+	//
+	inline bool CompareAndSwapTagged(volatile TaggedPointer* field, TaggedPointer& expected, const TaggedPointer& desired)
 	{
-		mfence
-		mov eax, oldvalue
-		mov ecx, newvalue
-		mov edx, dword ptr [field]
+#ifdef _WIN64
+		return (_InterlockedCompareExchange128(reinterpret_cast<volatile __int64*>(field), static_cast<__int64>(desired.Tag), reinterpret_cast<__int64>(desired.Pointer), reinterpret_cast<__int64*>(&expected)) != 0);
+#else
+		__int64 comparand = *reinterpret_cast<const __int64*>(&expected);
+		__int64 previous = _InterlockedCompareExchange64(reinterpret_cast<volatile __int64*>(field), *reinterpret_cast<const __int64*>(&desired), comparand);
+		if(previous == comparand)
+			return true;
 
-		lock cmpxchg dword ptr[edx], ecx
-		mov retval, eax
-		mfence
+		*reinterpret_cast<__int64*>(&expected) = previous;
+		return false;
+#endif
 	}
 
-	return (retval == oldvalue);
 }
 
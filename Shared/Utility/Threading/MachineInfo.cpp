@@ -1,6 +1,91 @@
 #include "pch.h"
 #include "Utility/Threading/MachineInfo.h"
 
+#include <intrin.h>
+
+
+namespace
+{
+	//
+	// Feature flags reported by the CPUID instruction (function 1)
+	//
+	const int CPUIDFeatureSSE2_EDX = (1 << 26);
+	const int CPUIDFeatureSSE41_ECX = (1 << 19);
+	const int CPUIDFeatureSSE42_ECX = (1 << 20);
+
+	//
+	// Query the CPU feature flags; the results cannot change
+	// while the process is running, so cache them on first use.
+	//
+	const int* GetCPUFeatureFlags()
+	{
+		static int info[4] = { 0, 0, 0, 0 };
+		static bool queried = false;
+
+		if(!queried)
+		{
+			int basicinfo[4];
+			__cpuid(basicinfo, 0);
+			if(basicinfo[0] >= 1)
+				__cpuid(info, 1);
+			queried = true;
+		}
+
+		return info;
+	}
+
+	//
+	// Describe a node given the mask of its usable processors
+	//
+	Threads::ProcessorNode MakeProcessorNode(unsigned nodenumber, DWORD_PTR processormask)
+	{
+		Threads::ProcessorNode node;
+		node.NodeNumber = nodenumber;
+		node.ProcessorMask = processormask;
+		for(unsigned i = 0; i < sizeof(DWORD_PTR) * 8; ++i)
+		{
+			if(processormask & (static_cast<DWORD_PTR>(1) << i))
+				node.Processors.push_back(i);
+		}
+
+		return node;
+	}
+
+	//
+	// Build the list of NUMA nodes, along with the processors on each
+	// that this process is allowed to run on. Machines without NUMA
+	// support are reported as a single node holding every processor.
+	//
+	std::vector<Threads::ProcessorNode> EnumerateProcessorNodes()
+	{
+		std::vector<Threads::ProcessorNode> nodes;
+
+		DWORD_PTR processmask, systemmask;
+		if(!::GetProcessAffinityMask(::GetCurrentProcess(), &processmask, &systemmask))
+			processmask = 1;
+
+		ULONG highestnode = 0;
+		if(!::GetNumaHighestNodeNumber(&highestnode))
+			highestnode = 0;
+
+		for(ULONG nodenumber = 0; nodenumber <= highestnode; ++nodenumber)
+		{
+			ULONGLONG nodemask = 0;
+			if(!::GetNumaNodeProcessorMask(static_cast<UCHAR>(nodenumber), &nodemask))
+				continue;
+
+			DWORD_PTR usablemask = static_cast<DWORD_PTR>(nodemask) & processmask;
+			if(usablemask)
+				nodes.push_back(MakeProcessorNode(nodenumber, usablemask));
+		}
+
+		if(nodes.empty())
+			nodes.push_back(MakeProcessorNode(0, processmask));
+
+		return nodes;
+	}
+}
+
 
 unsigned Threads::GetCPUCount()
 {
@@ -9,3 +94,63 @@ unsigned Threads::GetCPUCount()
 	return info.dwNumberOfProcessors;
 }
 
+//
+// Determine the number of physical cores, counting each set of
+// hyperthreads sharing a core only once. Falls back on the number
+// of logical processors if the topology cannot be queried.
+//
+unsigned Threads::GetPhysicalCoreCount()
+{
+	DWORD length = 0;
+	::GetLogicalProcessorInformation(NULL, &length);
+	if(::GetLastError() != ERROR_INSUFFICIENT_BUFFER || !length)
+		return GetCPUCount();
+
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if(!::GetLogicalProcessorInformation(&info[0], &length))
+		return GetCPUCount();
+
+	unsigned numcores = 0;
+	for(std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION>::const_iterator iter = info.begin(); iter != info.end(); ++iter)
+	{
+		if(iter->Relationship == RelationProcessorCore)
+			++numcores;
+	}
+
+	return numcores ? numcores : GetCPUCount();
+}
+
+//
+// Retrieve the NUMA nodes of the machine, and the processors on each
+//
+// The topology cannot change while the process is running, so it is
+// only queried once.
+//
+const std::vector<Threads::ProcessorNode>& Threads::GetProcessorNodes()
+{
+	static std::vector<ProcessorNode> nodes;
+	static bool queried = false;
+
+	if(!queried)
+	{
+		nodes = EnumerateProcessorNodes();
+		queried = true;
+	}
+
+	return nodes;
+}
+
+bool Threads::CPUSupportsSSE2()
+{
+	return (GetCPUFeatureFlags()[3] & CPUIDFeatureSSE2_EDX) != 0;
+}
+
+bool Threads::CPUSupportsSSE41()
+{
+	return (GetCPUFeatureFlags()[2] & CPUIDFeatureSSE41_ECX) != 0;
+}
+
+bool Threads::CPUSupportsSSE42()
+{
+	return (GetCPUFeatureFlags()[2] & CPUIDFeatureSSE42_ECX) != 0;
+}
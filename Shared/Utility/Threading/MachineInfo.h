@@ -3,5 +3,21 @@
 
 namespace Threads
 {
+	//
+	// Set of logical processors sharing a NUMA node
+	//
+	struct ProcessorNode
+	{
+		unsigned NodeNumber;
+		DWORD_PTR ProcessorMask;
+		std::vector<unsigned> Processors;
+	};
+
 	unsigned GetCPUCount();
+	unsigned GetPhysicalCoreCount();
+	const std::vector<ProcessorNode>& GetProcessorNodes();
+
+	bool CPUSupportsSSE2();
+	bool CPUSupportsSSE41();
+	bool CPUSupportsSSE42();
 }
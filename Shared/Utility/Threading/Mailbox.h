@@ -13,41 +13,97 @@
 
 #include "Utility/Types/IDTypes.h"
 
-#include "Utility/Memory/ThreadLocalAllocator.h"
-
 #include "Configuration/RuntimeOptions.h"
 
 
 
+//
+// Policies for handling messages sent to a mailbox which is already full
+//
+enum MailboxOverflowPolicy
+{
+	MailboxOverflow_BlockSender,		// Wait until the consumer frees up a slot
+	MailboxOverflow_DropOldest,			// Discard the oldest pending message to make room
+	MailboxOverflow_FailSend			// Reject the new message
+};
+
+//
+// Outcomes of attempting to add a message to a mailbox without blocking
+//
+enum MailboxAddResult
+{
+	MailboxAdd_Accepted,				// The mailbox took ownership of the message
+	MailboxAdd_MustWait,				// The mailbox is full, and the policy says to wait
+	MailboxAdd_Rejected					// The mailbox is full, and the message was refused
+};
+
+
+//
+// Statistics tracked for each mailbox
+//
+// The enqueue and dequeue counts are the ring positions, which wrap
+// around once four billion messages have passed through the mailbox.
+// Messages discarded under the drop oldest policy count as dequeued.
+// Messages set aside by selective receives count as dequeued as well,
+// and are also counted separately until they are retrieved; the high
+// water mark includes them.
+//
+struct MailboxStatistics
+{
+	unsigned Capacity;
+	unsigned NumEnqueued;
+	unsigned NumDequeued;
+	unsigned NumDeferred;
+	unsigned HighWaterMark;
+	unsigned NumDropped;
+	unsigned NumRejected;
+};
+
+
 //
 // This class encapsulates a lockless mailbox algorithm for asynchronous message passing.
 // Each thread is granted a mailbox when it is started up; this mailbox is used for all
 // messages passed into that thread. Messages are dequeued in FIFO order.
 //
-// IMPORTANT: this algorithm is only safe for a many producer/single consumer scenario.
-//            Critical assumptions made by the code are only valid if a single consumer
-//            thread is used. However, any number of producer threads is permitted.
+// The mailbox is a bounded ring of slots, following the well-known queue algorithm of
+// Dmitry Vyukov. Each slot carries a sequence number which tells producers and consumers
+// whether the slot is ready to be written or read; positions in the ring are claimed with
+// a single CAS, and no locks are taken by any of the mailbox operations. The capacity is
+// set by Config::NumMessageSlots, rounded up to a power of two. All slots are allocated
+// up front, so passing messages never touches the heap.
+//
+// Although only the owning thread retrieves messages in normal operation, the algorithm
+// permits any number of consumers. This is what allows producers to implement the drop
+// oldest policy: a producer facing a full mailbox simply dequeues (and frees) the oldest
+// message itself before trying again.
+//
+// When the mailbox is full, the behavior of AddMessage is controlled by the overflow
+// policy given at construction time; see MailboxOverflowPolicy. Producers which block
+// yield their timeslice until a slot becomes free, so they rely on the consumer making
+// progress independently of the producer. Producers which must not wait while holding
+// other resources use TryAddMessage instead, and arrange the wait themselves.
+//
+// The consumer drains messages in batches: a single CAS claims every filled slot at the
+// head of the ring (up to the batch size), and the claimed messages are buffered on the
+// consumer side. Subsequent calls to GetMessage are served from this buffer without any
+// interlocked operations, so bursts of messages are cheap to process. Note that buffered
+// messages no longer occupy slots in the ring, and are not subject to the drop oldest
+// policy.
 //
-// The algorithm uses three distinct stacks: a read stack, a write stack, and a cache.
-// Producers push items onto the write stack using a simple and well-known CAS method.
-// When the consumer thread arrives to retrieve a message, it first checks the cache
-// for any waiting messages. If the cache is empty, the consumer thread swaps the read
-// and write stacks. At this point, the read stack is controlled entirely by the consumer
-// thread, so we don't need to worry about contention for elements in the read stack.
-// The entire read stack is then traversed and its contents pushed into the cache.
-// Note that we achieve FIFO semantics only by using this extra cache stack.
+// The consumer may also perform a selective receive, asking only for messages with one
+// of a given set of signatures. Messages which do not match are set aside in a separate
+// queue per signature, rather than being discarded; a later receive for those messages
+// finds them by checking only the queues for its own signatures. PayloadType must expose
+// a Signature member for this purpose. Set aside messages are owned by the consumer, but
+// still count against the capacity of the mailbox: producers treat the mailbox as full
+// once the ring and the set aside messages together reach the capacity, and apply the
+// overflow policy as usual. Only the consumer can discard set aside messages, so under
+// the drop oldest policy it drops the oldest of them itself when setting aside one more
+// would fill the mailbox.
 //
-// For additional performance, we use customized memory management internally to avoid
-// expensive serialized heap allocations/frees. We cannot directly use new/delete in
-// the implementation, because these incur serialized heap accesses, which defeats the
-// purpose of the lock-free mailbox. Instead, we use a two-pronged approach to memory
-// management for the mailbox. Mail messages are kept in a pre-allocated buffer, and
-// memory is supplied by this buffer using a simple lock-free LIFO stack of free slots.
-// We also use a special allocator class for the std::stack container, which uses a
-// thread-local heap provided by the OS. Since the thread-local heap is never accessed
-// by an outside thread, we can avoid the cost of serialized heap accesses to that
-// particular memory. The combination of these two approaches allows for maximum speed
-// in the mailbox container, while retaining lock-free semantics and thread safety.
+// Basic statistics (including the high-water mark of pending messages) are tracked for
+// each mailbox, to help with sizing the mailboxes for a given workload. The enqueue and
+// dequeue counts come from the ring positions, so they cost nothing extra to maintain.
 //
 template <class PayloadType>
 class LocklessMailbox
@@ -55,56 +111,63 @@ class LocklessMailbox
 // Construction and destruction
 public:
 	//
-	// Construct and initialize the read and write stacks
+	// Construct and initialize the slot ring
 	//
-	LocklessMailbox(HANDLE owner)
-		: Owner(owner)
+	explicit LocklessMailbox(MailboxOverflowPolicy policy)
+		: Policy(policy),
+		  EnqueuePosition(0),
+		  DequeuePosition(0),
+		  HighWaterMark(0),
+		  NumDropped(0),
+		  NumRejected(0),
+		  NumDeferred(0),
+		  NumDrained(0),
+		  NextDrained(0),
+		  NextDeferralSequence(0)
 	{
-		WriteHead = OriginalWriteHead = new Node;
-		ReadHead = OriginalReadHead = new Node;
-
-		unsigned buffersize = Config::NumMessageSlots;
-		NodeBuffer = new Node[buffersize];
-
-		NodeFreeList = NULL;
-		for(unsigned i = 0; i < buffersize; ++i)
-		{
-			NodeTracker* tracker = new NodeTracker(NodeFreeList, &NodeBuffer[i]);
-			FreeListHead = NodeFreeList = tracker;
-			NodeBuffer[i].Tracker = tracker;
-		}
+		AllocateSlots();
+		InitializeSlots();
 	}
 
 	//
-	// Clean up the read, write, and cache stacks, freeing any
-	// remaining messages from each stack.
+	// Clean up the slot ring, freeing any remaining messages
 	//
 	~LocklessMailbox()
 	{
-		for(MessageStackType::iterator iter = PendingReads.begin(); iter != PendingReads.end(); ++iter)
-			delete (*iter)->Payload;
+		DiscardMessages();
+		delete [] Slots;
+	}
 
-		Node* n = WriteHead;
-		while(n)
-		{
-			delete n->Payload;
-			n = n->Next;
-		}
+	//
+	// Free any remaining messages and return the mailbox to its initial
+	// state, so that it can be handed over to a new task
+	//
+	// No other thread may be using the mailbox while this is done. If
+	// the configured number of slots has been raised in the meantime,
+	// the ring is reallocated at the new size.
+	//
+	void Reset()
+	{
+		DiscardMessages();
+		DeferredMessages.clear();
+		NextDeferralSequence = 0;
+		NumDeferred = 0;
 
-		n = ReadHead;
-		while(n)
+		if(Capacity < Config::NumMessageSlots)
 		{
-			delete n->Payload;
-			n = n->Next;
+			delete [] Slots;
+			AllocateSlots();
 		}
 
-		for(unsigned i = 0; i < Config::NumMessageSlots; ++i)
-			delete NodeBuffer[i].Tracker;
+		InitializeSlots();
+		EnqueuePosition = 0;
+		DequeuePosition = 0;
+		NumDrained = 0;
+		NextDrained = 0;
 
-		delete OriginalReadHead;
-		delete OriginalWriteHead;
-
-		delete [] NodeBuffer;
+		HighWaterMark = 0;
+		NumDropped = 0;
+		NumRejected = 0;
 	}
 
 // Message passing interface
@@ -114,164 +177,446 @@ public:
 	// Register a message from a producer thread. Any number of threads
 	// may call this function.
 	//
-	void AddMessage(PayloadType* info)
+	// Returns false if the mailbox is full and the message was rejected,
+	// e.g. under the fail send policy; ownership of the message remains with
+	// the caller in that case. Otherwise, the mailbox takes ownership.
+	//
+	// Blocking may be disallowed when the caller knows it would never be
+	// released, such as a thread sending a message to itself; the send
+	// fails instead.
+	//
+	bool AddMessage(PayloadType* info, bool allowblocking = true)
 	{
-		Node* msgnode = AllocateNode(info);
 		while(true)
 		{
-			msgnode->Next = WriteHead;
-			bool success = CompareAndSwap(&WriteHead, msgnode->Next, msgnode);
-			if(success)
-				return;
+			switch(TryAddMessage(info))
+			{
+			case MailboxAdd_Accepted:
+				return true;
+
+			case MailboxAdd_MustWait:
+				if(!allowblocking)
+				{
+					RejectMessage();
+					return false;
+				}
+				::SwitchToThread();
+				break;
+
+			default:
+				return false;
+			}
 		}
 	}
 
 	//
-	// Retrieve a message from the mailbox.
-	// IMPORTANT: only ONE consumer thread (per mailbox) should call this function
+	// Register a message from a producer thread, without ever blocking
 	//
-	PayloadType* GetMessage()
+	// Under the block sender policy, a full mailbox yields MailboxAdd_MustWait;
+	// the caller keeps ownership of the message, and may retry once it is
+	// safe to wait, or give up by calling RejectMessage. The other policies
+	// behave exactly as for AddMessage.
+	//
+	MailboxAddResult TryAddMessage(PayloadType* info)
 	{
-		if(!PendingReads.empty())
-			return PopPendingRead();
-
-		if(ReadHead->Next == NULL)
-			SwapReadAndWrite();
-
-		Node* n = ReadHead;
-		while(ReadHead->Next)
+		while(!HasRoom() || !TryEnqueue(info))
 		{
-			PendingReads.push_back(n);
-			n = n->Next;
-			ReadHead = n;
+			switch(Policy)
+			{
+			case MailboxOverflow_BlockSender:
+				return MailboxAdd_MustWait;
+
+			case MailboxOverflow_DropOldest:
+				if(PayloadType* oldest = TryDequeue())
+				{
+					delete oldest;
+					::InterlockedIncrement(&NumDropped);
+				}
+				break;
+
+			default:
+				RejectMessage();
+				return MailboxAdd_Rejected;
+			}
 		}
 
-		if(PendingReads.empty())
-			return NULL;
+		return MailboxAdd_Accepted;
+	}
 
-		return PopPendingRead();
+	//
+	// Count a message which a producer gave up on sending
+	//
+	void RejectMessage()
+	{
+		::InterlockedIncrement(&NumRejected);
 	}
 
-// Internal helpers
-private:
+	//
+	// Retrieve a message from the mailbox, or NULL if no messages are waiting
+	//
+	// IMPORTANT: only ONE consumer thread (per mailbox) should call this
+	//            function or GetMessages, since the drained batch buffer
+	//            is not synchronized.
+	//
+	PayloadType* GetMessage()
+	{
+		if(NextDrained == NumDrained)
+		{
+			NumDrained = ClaimBatch(DrainedMessages, DrainBatchSize);
+			NextDrained = 0;
+			if(!NumDrained)
+				return NULL;
+		}
+
+		return DrainedMessages[NextDrained++];
+	}
 
 	//
-	// Pop a pending read from the cache stack
+	// Retrieve up to the given number of waiting messages at once
+	// Returns the number of messages written to the output array
 	//
-	PayloadType* PopPendingRead()
+	// The same single consumer restriction applies as for GetMessage.
+	//
+	unsigned GetMessages(PayloadType** messages, unsigned maxmessages)
 	{
-		Node* readnode = PendingReads.back();
-		PayloadType* payload = readnode->Payload;
-		FreeNode(readnode);
-		PendingReads.pop_back();
-		return payload;
+		unsigned count = 0;
+		while(count < maxmessages && NextDrained < NumDrained)
+			messages[count++] = DrainedMessages[NextDrained++];
+
+		unsigned remaining = maxmessages - count;
+		while(remaining)
+		{
+			unsigned claimed = ClaimBatch(messages + count, remaining);
+			if(!claimed)
+				break;
+
+			count += claimed;
+			remaining -= claimed;
+		}
+
+		return count;
 	}
 
 	//
-	// Internal helper for swapping the read/write stacks
-	// See class comment for details
+	// Retrieve the oldest message matching any of the given signatures,
+	// or NULL if no such message is waiting
 	//
-	void SwapReadAndWrite()
+	// Any non-matching messages encountered along the way are set aside
+	// for later receives; see the class comment for details. The single
+	// consumer restriction applies as for GetMessage.
+	//
+	PayloadType* GetMatchingMessage(const std::vector<MessageSignatureID>& signatures)
 	{
-		while(true)
+		// Set aside messages always predate anything still in the ring
+		PayloadType* deferred = TakeDeferredMessage(signatures);
+		if(deferred)
+			return deferred;
+
+		while(PayloadType* payload = GetMessage())
 		{
-			Node* readhead = ReadHead;
-			Node* oldwrite = WriteHead;
-			bool success = CompareAndSwap(&WriteHead, oldwrite, readhead);
-			if(success)
+			for(std::vector<MessageSignatureID>::const_iterator iter = signatures.begin(); iter != signatures.end(); ++iter)
 			{
-				ReadHead = oldwrite;
-				return;
+				if(payload->Signature == *iter)
+					return payload;
 			}
+
+			DeferMessage(payload);
 		}
+
+		return NULL;
 	}
 
-// Internal memory management
-private:
-	struct NodeTracker;
+	//
+	// Check if any messages have arrived which have not yet been retrieved
+	// Messages which were set aside by selective receives are not counted
+	//
+	bool HasNewMessages() const
+	{
+		if(NextDrained < NumDrained)
+			return true;
+
+		LONG position = Atomic::LoadAcquire(&DequeuePosition);
+		return (Atomic::LoadAcquire(&Slots[position & (Capacity - 1)].Sequence) == position + 1);
+	}
 
-	struct Node
+	//
+	// Determine if the ring and the set aside messages together leave room for another message
+	//
+	// Like the high-water mark, this is a snapshot taken without
+	// synchronizing against the consumer.
+	//
+	bool HasRoom() const
 	{
-		Node() : Next(NULL), Payload(NULL) { }
-		explicit Node(PayloadType* p) : Next(NULL), Payload(p) { }
+		LONG pending = Atomic::LoadAcquire(&EnqueuePosition) - Atomic::LoadAcquire(&DequeuePosition);
+		return (pending + Atomic::LoadAcquire(&NumDeferred) < static_cast<LONG>(Capacity));
+	}
 
-		Node* Next;
-		PayloadType* Payload;
-		NodeTracker* Tracker;
-	};
+// Statistics
+public:
+	typedef MailboxStatistics Statistics;
 
-	struct NodeTracker
+	Statistics GetStatistics() const
 	{
-		NodeTracker() : Next(NULL), AttachedNode(NULL) { }
-		explicit NodeTracker(Node* attached) : Next(NULL), AttachedNode(attached) { }
-		NodeTracker(NodeTracker* next, Node* attached) : Next(next), AttachedNode(attached) { }
+		Statistics stats;
+		stats.Capacity = Capacity;
+		stats.NumEnqueued = static_cast<unsigned>(Atomic::LoadAcquire(&EnqueuePosition));
+		stats.NumDequeued = static_cast<unsigned>(Atomic::LoadAcquire(&DequeuePosition));
+		stats.NumDeferred = static_cast<unsigned>(Atomic::LoadAcquire(&NumDeferred));
+		stats.HighWaterMark = static_cast<unsigned>(HighWaterMark);
+		stats.NumDropped = static_cast<unsigned>(NumDropped);
+		stats.NumRejected = static_cast<unsigned>(NumRejected);
+		return stats;
+	}
 
-		NodeTracker* Next;
-		Node* AttachedNode;
-	};
+// Internal helpers
+private:
+
+	//
+	// Allocate the slot ring, sized to the configured number of slots
+	//
+	void AllocateSlots()
+	{
+		Capacity = 1;
+		while(Capacity < Config::NumMessageSlots)
+			Capacity <<= 1;
+
+		Slots = new Slot[Capacity];
+	}
 
 	//
-	// Allocate space for a message node, using the local reserved pool
+	// Mark every slot as free for the first pass of the producers
 	//
-	// We trade off a limited amount of message space for the ability
-	// to allocate and free node storage without locking on the heap.
-	// Memory is managed with a simple free list that stores pointers
-	// into the pre-allocated node buffer. The list is implemented as
-	// a lock-free FILO stack; this allows multiple producers to send
-	// messages without blocking on the allocation routines.
+	void InitializeSlots()
+	{
+		for(LONG i = 0; i < static_cast<LONG>(Capacity); ++i)
+		{
+			Slots[i].Sequence = i;
+			Slots[i].Payload = NULL;
+		}
+	}
+
 	//
-	Node* AllocateNode(PayloadType* info)
+	// Free all messages still waiting in the ring or set aside
+	//
+	void DiscardMessages()
 	{
-		NodeTracker* rettracker;
+		while(PayloadType* payload = GetMessage())
+			delete payload;
 
-		if(!FreeListHead->Next)
+		for(typename DeferralTable::iterator iter = DeferredMessages.begin(); iter != DeferredMessages.end(); ++iter)
 		{
-			::TerminateThread(Owner, 0);
-			throw Exception("Too many messages backlogged; make sure task is accepting the sent messages!");
+			for(typename DeferralQueue::iterator msgiter = iter->begin(); msgiter != iter->end(); ++msgiter)
+				delete msgiter->second;
+			iter->clear();
 		}
 
-		// Pull node out of the free list
-		NodeTracker* newhead;
-		do
+		Atomic::StoreRelease(&NumDeferred, static_cast<LONG>(0));
+	}
+
+	//
+	// Set aside a message which did not match a selective receive
+	//
+	void DeferMessage(PayloadType* payload)
+	{
+		if(Policy == MailboxOverflow_DropOldest && Atomic::LoadAcquire(&NumDeferred) + 1 >= static_cast<LONG>(Capacity))
 		{
-			rettracker = FreeListHead;
-			newhead = rettracker->Next;
-		} while (!CompareAndSwap(&FreeListHead, rettracker, newhead));
+			delete TakeOldestDeferredMessage(NULL);
+			::InterlockedIncrement(&NumDropped);
+		}
+
+		if(payload->Signature >= DeferredMessages.size())
+			DeferredMessages.resize(payload->Signature + 1);
+		DeferredMessages[payload->Signature].push_back(std::make_pair(NextDeferralSequence++, payload));
 
-		rettracker->AttachedNode->Payload = info;
-		return rettracker->AttachedNode;
+		LONG deferred = ::InterlockedIncrement(&NumDeferred);
+		UpdateHighWaterMark(Atomic::LoadAcquire(&EnqueuePosition) - Atomic::LoadAcquire(&DequeuePosition) + deferred);
 	}
 
 	//
-	// Return a node to the free list
+	// Attempt to place a message in the next free slot
+	// Returns false if the mailbox is full
 	//
-	void FreeNode(Node* node)
+	bool TryEnqueue(PayloadType* info)
 	{
-		node->Payload = NULL;
+		LONG position = Atomic::LoadAcquire(&EnqueuePosition);
+		Slot* slot;
+		while(true)
+		{
+			slot = &Slots[position & (Capacity - 1)];
+			LONG difference = Atomic::LoadAcquire(&slot->Sequence) - position;
+			if(difference == 0)
+			{
+				LONG claimed = Atomic::CompareExchange(&EnqueuePosition, position, position + 1);
+				if(claimed == position)
+					break;
+				position = claimed;
+			}
+			else if(difference < 0)
+				return false;
+			else
+				position = Atomic::LoadAcquire(&EnqueuePosition);
+		}
+
+		slot->Payload = info;
+
+		// The release ensures the payload is visible before the slot is marked as filled
+		Atomic::StoreRelease(&slot->Sequence, position + 1);
+
+		UpdateHighWaterMark(position + 1 - Atomic::LoadAcquire(&DequeuePosition) + Atomic::LoadAcquire(&NumDeferred));
+		return true;
+	}
+
+	//
+	// Attempt to remove the oldest message from its slot
+	// Returns NULL if the mailbox is empty
+	//
+	PayloadType* TryDequeue()
+	{
+		LONG position = Atomic::LoadAcquire(&DequeuePosition);
+		Slot* slot;
+		while(true)
+		{
+			slot = &Slots[position & (Capacity - 1)];
+			LONG difference = Atomic::LoadAcquire(&slot->Sequence) - (position + 1);
+			if(difference == 0)
+			{
+				LONG claimed = Atomic::CompareExchange(&DequeuePosition, position, position + 1);
+				if(claimed == position)
+					break;
+				position = claimed;
+			}
+			else if(difference < 0)
+				return NULL;
+			else
+				position = Atomic::LoadAcquire(&DequeuePosition);
+		}
 
+		PayloadType* payload = slot->Payload;
+		slot->Payload = NULL;
+
+		// Mark the slot as free for the producer which will next wrap around to it
+		Atomic::StoreRelease(&slot->Sequence, position + static_cast<LONG>(Capacity));
+		return payload;
+	}
+
+	//
+	// Claim every filled slot at the head of the ring, up to the given limit,
+	// with a single CAS; returns the number of messages retrieved
+	//
+	unsigned ClaimBatch(PayloadType** messages, unsigned maxmessages)
+	{
+		LONG position;
+		unsigned count;
 		while(true)
 		{
-			node->Tracker->Next = FreeListHead;
-			if(CompareAndSwap(&FreeListHead, node->Tracker->Next, node->Tracker))
+			position = Atomic::LoadAcquire(&DequeuePosition);
+
+			count = 0;
+			while(count < maxmessages && Atomic::LoadAcquire(&Slots[(position + count) & (Capacity - 1)].Sequence) == position + static_cast<LONG>(count) + 1)
+				++count;
+
+			if(!count)
+				return 0;
+
+			if(Atomic::CompareAndSwap(&DequeuePosition, position, position + static_cast<LONG>(count)))
 				break;
 		}
+
+		for(unsigned i = 0; i < count; ++i)
+		{
+			Slot& slot = Slots[(position + i) & (Capacity - 1)];
+			messages[i] = slot.Payload;
+			slot.Payload = NULL;
+			Atomic::StoreRelease(&slot.Sequence, position + static_cast<LONG>(i + Capacity));
+		}
+
+		return count;
 	}
 
+	//
+	// Remove the oldest set aside message with any of the given signatures
+	//
+	PayloadType* TakeDeferredMessage(const std::vector<MessageSignatureID>& signatures)
+	{
+		return TakeOldestDeferredMessage(&signatures);
+	}
+
+	//
+	// Remove the oldest set aside message with any of the given signatures,
+	// or with any signature at all if no signatures are given
+	//
+	PayloadType* TakeOldestDeferredMessage(const std::vector<MessageSignatureID>* signatures)
+	{
+		DeferralQueue* oldest = NULL;
+		size_t numcandidates = signatures ? signatures->size() : DeferredMessages.size();
+		for(size_t i = 0; i < numcandidates; ++i)
+		{
+			MessageSignatureID signature = signatures ? (*signatures)[i] : static_cast<MessageSignatureID>(i);
+			if(signature >= DeferredMessages.size() || DeferredMessages[signature].empty())
+				continue;
+
+			// Sequence numbers are compared by difference, so wrapping is harmless
+			DeferralQueue& queue = DeferredMessages[signature];
+			if(!oldest || static_cast<int>(queue.front().first - oldest->front().first) < 0)
+				oldest = &queue;
+		}
+
+		if(!oldest)
+			return NULL;
+
+		PayloadType* payload = oldest->front().second;
+		oldest->pop_front();
+		::InterlockedDecrement(&NumDeferred);
+		return payload;
+	}
+
+	//
+	// Record the number of pending messages if it is the highest seen so far
+	//
+	// The count is a snapshot taken without synchronizing against the
+	// consumer, so it may slightly overestimate the true backlog.
+	//
+	void UpdateHighWaterMark(LONG pending)
+	{
+		LONG mark = Atomic::LoadAcquire(&HighWaterMark);
+		while(pending > mark)
+		{
+			LONG previous = Atomic::CompareExchange(&HighWaterMark, mark, pending);
+			if(previous == mark)
+				break;
+			mark = previous;
+		}
+	}
 
 // Internal tracking
 private:
-	Node* WriteHead, *OriginalWriteHead;
-	Node* ReadHead, *OriginalReadHead;
+	struct Slot
+	{
+		volatile LONG Sequence;
+		PayloadType* volatile Payload;
+	};
 
-	Node* NodeBuffer;
+	MailboxOverflowPolicy Policy;
 
-	NodeTracker* NodeFreeList;
-	NodeTracker* FreeListHead;
+	Slot* Slots;
+	unsigned Capacity;
 
-	typedef std::deque<Node*, ThreadLocalAllocator<Node*> > MessageStackType;
-	MessageStackType PendingReads;
+	volatile LONG EnqueuePosition;
+	volatile LONG DequeuePosition;
 
-	HANDLE Owner;
-};
+	volatile LONG HighWaterMark;
+	volatile LONG NumDropped;
+	volatile LONG NumRejected;
+	volatile LONG NumDeferred;
 
+	static const unsigned DrainBatchSize = 16;
+	PayloadType* DrainedMessages[DrainBatchSize];
+	unsigned NumDrained;
+	unsigned NextDrained;
+
+	typedef std::deque<std::pair<unsigned, PayloadType*> > DeferralQueue;
+	typedef std::vector<DeferralQueue> DeferralTable;
+	DeferralTable DeferredMessages;
+	unsigned NextDeferralSequence;
+};
 
@@ -0,0 +1,285 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Mailboxes held in named shared memory, for messages passed between processes
+//
+// The mapping starts with a fixed header, followed by the slots of the
+// ring. The enqueue and dequeue positions sit on cache lines of their own,
+// so producers and the consumer do not contend for the same line. The
+// header cookie is written last when a mailbox is created, so a process
+// which opens the mailbox early sees either a complete header or none.
+//
+
+#include "pch.h"
+
+#include "Utility/Threading/SharedMailbox.h"
+#include "Utility/Threading/ThreadExceptions.h"
+
+
+using namespace Threads;
+
+
+namespace
+{
+	const char MailboxCookie[] = "EpochMBX";
+	const UInteger32 MailboxVersion = 1;
+
+	const size_t CacheLineSize = 64;
+
+
+	//
+	// Fixed header at the start of each mailbox
+	//
+	struct MailboxHeader
+	{
+		char Cookie[sizeof(MailboxCookie) - 1];
+		UInteger32 Version;
+		UInteger32 Capacity;
+		UInteger32 MaxMessageSize;
+		UInteger32 SlotStride;
+
+		__declspec(align(64)) volatile LONG EnqueuePosition;
+		__declspec(align(64)) volatile LONG DequeuePosition;
+	};
+
+	//
+	// Header of each slot in the ring; the message bytes follow it
+	//
+	struct SlotHeader
+	{
+		volatile LONG Sequence;
+		UInteger32 Size;
+	};
+
+
+	//
+	// Helpers for deriving the names of the system objects backing a mailbox
+	//
+	std::wstring GetMappingName(const std::wstring& name)
+	{
+		return L"Local\\Epoch.Mailbox." + name;
+	}
+
+	std::wstring GetEventName(const std::wstring& name)
+	{
+		return L"Local\\Epoch.MailboxEvent." + name;
+	}
+
+
+	//
+	// Helpers for locating the slots of a mapped mailbox
+	//
+	MailboxHeader* GetHeader(void* view)
+	{
+		return reinterpret_cast<MailboxHeader*>(view);
+	}
+
+	SlotHeader* GetSlot(void* view, LONG position)
+	{
+		MailboxHeader* header = GetHeader(view);
+		size_t index = static_cast<size_t>(position) & (header->Capacity - 1);
+		return reinterpret_cast<SlotHeader*>(reinterpret_cast<Byte*>(view) + sizeof(MailboxHeader) + index * header->SlotStride);
+	}
+}
+
+
+//
+// Create a new shared mailbox, owned by the calling process
+//
+// The capacity is rounded up to a power of two. Fails if another process
+// already holds a mailbox under the same name.
+//
+SharedMailbox* SharedMailbox::Create(const std::wstring& name, unsigned capacity, size_t maxmessagesize)
+{
+	UInteger32 roundedcapacity = 1;
+	while(roundedcapacity < capacity)
+		roundedcapacity <<= 1;
+
+	size_t stride = (sizeof(SlotHeader) + maxmessagesize + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+	size_t totalsize = sizeof(MailboxHeader) + roundedcapacity * stride;
+
+	HANDLE mapping = ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(totalsize), GetMappingName(name).c_str());
+	if(!mapping)
+		throw ThreadException("Failed to allocate shared memory for a task mailbox");
+
+	if(::GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		::CloseHandle(mapping);
+		throw ThreadException("Another process already shares a task mailbox under this name");
+	}
+
+	void* view = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if(!view)
+	{
+		::CloseHandle(mapping);
+		throw ThreadException("Failed to map shared memory for a task mailbox");
+	}
+
+	HANDLE messageevent = ::CreateEvent(NULL, false, false, GetEventName(name).c_str());
+	if(!messageevent)
+	{
+		::UnmapViewOfFile(view);
+		::CloseHandle(mapping);
+		throw ThreadException("Failed to create the signalling event for a task mailbox");
+	}
+
+	MailboxHeader* header = GetHeader(view);
+	header->Version = MailboxVersion;
+	header->Capacity = roundedcapacity;
+	header->MaxMessageSize = static_cast<UInteger32>(maxmessagesize);
+	header->SlotStride = static_cast<UInteger32>(stride);
+	header->EnqueuePosition = 0;
+	header->DequeuePosition = 0;
+
+	for(UInteger32 i = 0; i < roundedcapacity; ++i)
+		GetSlot(view, static_cast<LONG>(i))->Sequence = static_cast<LONG>(i);
+
+	::MemoryBarrier();
+	memcpy(header->Cookie, MailboxCookie, sizeof(header->Cookie));
+
+	return new SharedMailbox(mapping, messageevent, view);
+}
+
+//
+// Open a mailbox shared by another process
+//
+// Returns NULL if no mailbox exists under the given name.
+//
+SharedMailbox* SharedMailbox::Open(const std::wstring& name)
+{
+	HANDLE mapping = ::OpenFileMapping(FILE_MAP_ALL_ACCESS, false, GetMappingName(name).c_str());
+	if(!mapping)
+		return NULL;
+
+	void* view = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if(!view)
+	{
+		::CloseHandle(mapping);
+		return NULL;
+	}
+
+	MailboxHeader* header = GetHeader(view);
+	if(memcmp(header->Cookie, MailboxCookie, sizeof(header->Cookie)) != 0 || header->Version != MailboxVersion)
+	{
+		::UnmapViewOfFile(view);
+		::CloseHandle(mapping);
+		return NULL;
+	}
+
+	HANDLE messageevent = ::OpenEvent(EVENT_MODIFY_STATE | SYNCHRONIZE, false, GetEventName(name).c_str());
+	if(!messageevent)
+	{
+		::UnmapViewOfFile(view);
+		::CloseHandle(mapping);
+		return NULL;
+	}
+
+	return new SharedMailbox(mapping, messageevent, view);
+}
+
+//
+// Internal constructor; takes ownership of the given system objects
+//
+SharedMailbox::SharedMailbox(HANDLE mapping, HANDLE messageevent, void* view)
+	: Mapping(mapping),
+	  MessageEvent(messageevent),
+	  View(view)
+{
+}
+
+//
+// Release this process's hold on the mailbox
+//
+SharedMailbox::~SharedMailbox()
+{
+	::CloseHandle(MessageEvent);
+	::UnmapViewOfFile(View);
+	::CloseHandle(Mapping);
+}
+
+
+//
+// Post a message into the mailbox, and wake up the owner
+//
+// Returns false if the mailbox is full. Messages too large for the
+// mailbox's slots are rejected with an error.
+//
+bool SharedMailbox::Post(const void* data, size_t size)
+{
+	MailboxHeader* header = GetHeader(View);
+	if(size > header->MaxMessageSize)
+		throw ThreadException("Message is too large to be passed through a shared task mailbox");
+
+	LONG position = header->EnqueuePosition;
+	SlotHeader* slot;
+	while(true)
+	{
+		slot = GetSlot(View, position);
+		LONG sequence = slot->Sequence;
+		LONG difference = sequence - position;
+		if(difference == 0)
+		{
+			LONG previous = ::InterlockedCompareExchange(&header->EnqueuePosition, position + 1, position);
+			if(previous == position)
+				break;
+			position = previous;
+		}
+		else if(difference < 0)
+			return false;
+		else
+			position = header->EnqueuePosition;
+	}
+
+	slot->Size = static_cast<UInteger32>(size);
+	memcpy(slot + 1, data, size);
+	::InterlockedExchange(&slot->Sequence, position + 1);
+
+	::SetEvent(MessageEvent);
+	return true;
+}
+
+//
+// Take the oldest message out of the mailbox
+//
+// Returns false if the mailbox is empty.
+//
+bool SharedMailbox::Take(std::vector<Byte>& data)
+{
+	MailboxHeader* header = GetHeader(View);
+
+	LONG position = header->DequeuePosition;
+	SlotHeader* slot;
+	while(true)
+	{
+		slot = GetSlot(View, position);
+		LONG sequence = slot->Sequence;
+		LONG difference = sequence - (position + 1);
+		if(difference == 0)
+		{
+			LONG previous = ::InterlockedCompareExchange(&header->DequeuePosition, position + 1, position);
+			if(previous == position)
+				break;
+			position = previous;
+		}
+		else if(difference < 0)
+			return false;
+		else
+			position = header->DequeuePosition;
+	}
+
+	const Byte* bytes = reinterpret_cast<const Byte*>(slot + 1);
+	data.assign(bytes, bytes + slot->Size);
+	::InterlockedExchange(&slot->Sequence, position + static_cast<LONG>(header->Capacity));
+	return true;
+}
+
+
+//
+// Return the largest message which fits in a slot of the mailbox
+//
+size_t SharedMailbox::GetMaxMessageSize() const
+{
+	return GetHeader(View)->MaxMessageSize;
+}
+
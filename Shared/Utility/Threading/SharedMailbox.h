@@ -0,0 +1,66 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Mailboxes held in named shared memory, for messages passed between processes
+//
+// Each shared mailbox is a bounded ring of fixed-size byte slots, placed in
+// a named file mapping so that every process on the machine can open it by
+// name. The ring follows the same algorithm as LocklessMailbox (see
+// Mailbox.h): slots carry sequence numbers, positions are claimed with a
+// single CAS, and any number of producers and consumers may use the ring
+// without taking locks. Since the ring lives outside of any one process,
+// slots hold the raw bytes of encoded messages rather than pointers.
+//
+// The process which creates a mailbox owns it, and is the only one which
+// takes messages out of it; other processes open the mailbox in order to
+// post messages. A named event is signalled whenever a message is posted,
+// so the owner can wait for messages without polling. The mapping goes
+// away once every process has closed it.
+//
+
+#pragma once
+
+
+namespace Threads
+{
+
+	class SharedMailbox
+	{
+	// Construction and destruction
+	public:
+		static SharedMailbox* Create(const std::wstring& name, unsigned capacity, size_t maxmessagesize);
+		static SharedMailbox* Open(const std::wstring& name);
+
+		~SharedMailbox();
+
+	// Message passing
+	public:
+		bool Post(const void* data, size_t size);
+		bool Take(std::vector<Byte>& data);
+
+	// Additional queries
+	public:
+		HANDLE GetMessageEvent() const
+		{ return MessageEvent; }
+
+		size_t GetMaxMessageSize() const;
+
+	// Internal construction
+	private:
+		SharedMailbox(HANDLE mapping, HANDLE messageevent, void* view);
+
+	// Internal tracking
+	private:
+		HANDLE Mapping;
+		HANDLE MessageEvent;
+		void* View;
+
+	// Non-copyable
+	private:
+		SharedMailbox(const SharedMailbox&);
+		SharedMailbox& operator = (const SharedMailbox&);
+	};
+
+}
+
@@ -8,7 +8,7 @@
 #include "pch.h"
 
 #include "Utility/Threading/Synchronization.h"
-#include "Utility/Threading/Lockless.h"
+#include "Utility/Threading/ThreadExceptions.h"
 
 
 using namespace Threads;
@@ -51,41 +51,106 @@ void CriticalSection::Exit()
 
 
 //-------------------------------------------------------------------------------
-// Synchronization counter
+// Countdown latch
 //-------------------------------------------------------------------------------
 
+namespace
+{
+	// Number of times a waiting thread polls the latch before blocking
+	const unsigned LatchSpinCount = 4000;
+}
+
+
+//
+// Construct the latch with the given initial count
+//
+CountdownLatch::CountdownLatch(unsigned count)
+	: Count(static_cast<LONG>(count)),
+	  NumBlockedWaiters(0),
+	  ReleaseEvent(NULL)
+{
+}
+
 //
-// Construct the counter wrapper and increment the counter
+// Release the system event used for blocking
 //
-SyncCounter::SyncCounter(unsigned* pcounter, HANDLE tripevent)
-	: PointerToCounter(pcounter), TripEvent(tripevent)
+CountdownLatch::~CountdownLatch()
 {
-	::ResetEvent(tripevent);
+	if(ReleaseEvent)
+		::CloseHandle(ReleaseEvent);
+}
 
-	while(true)
+//
+// Rearm the latch with a new count
+//
+void CountdownLatch::Reset(unsigned count)
+{
+	if(ReleaseEvent)
 	{
-		unsigned oldval = *pcounter;
-		bool success = CompareAndSwap(pcounter, oldval, oldval + 1);
-		if(success)
-			return;
+		if(count > 0)
+			::ResetEvent(ReleaseEvent);
+		else
+			::SetEvent(ReleaseEvent);
 	}
+
+	::InterlockedExchange(&Count, static_cast<LONG>(count));
 }
 
 //
-// Destruct the counter wrapper and decrement the counter
+// Count the latch down by one, releasing waiters if the count reaches zero
 //
-SyncCounter::~SyncCounter()
+void CountdownLatch::CountDown()
 {
-	while(true)
-	{
-		unsigned oldval = *PointerToCounter;
-		bool success = CompareAndSwap(PointerToCounter, oldval, oldval - 1);
-		if(success)
-		{
-			if(oldval - 1 == 0)
-				::SetEvent(TripEvent);
+	// The interlocked decrement orders the count before the waiter
+	// check, matching the order used by Wait, so that either we see
+	// the blocked waiter or the waiter sees the released latch; a
+	// blocked waiter always creates the event before registering
+	if(::InterlockedDecrement(&Count) == 0 && NumBlockedWaiters > 0)
+		::SetEvent(ReleaseEvent);
+}
 
+//
+// Wait until the latch has been counted down to zero
+//
+void CountdownLatch::Wait()
+{
+	for(unsigned i = 0; i < LatchSpinCount; ++i)
+	{
+		if(IsReleased())
 			return;
-		}
+
+		YieldProcessor();
 	}
+
+	HANDLE releaseevent = GetReleaseEvent();
+
+	::InterlockedIncrement(&NumBlockedWaiters);
+	if(!IsReleased())
+		::WaitForSingleObject(releaseevent, INFINITE);
+	::InterlockedDecrement(&NumBlockedWaiters);
+}
+
+//
+// Retrieve the OS event used for blocking, creating it if necessary
+//
+// Several waiters may race to create the event; the first one to
+// publish its event wins, and the others discard their own.
+//
+HANDLE CountdownLatch::GetReleaseEvent()
+{
+	if(ReleaseEvent)
+		return ReleaseEvent;
+
+	HANDLE newevent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!newevent)
+		throw ThreadException("Failed to create synchronization event for countdown latch!");
+
+	HANDLE existing = ::InterlockedCompareExchangePointer(&ReleaseEvent, newevent, NULL);
+	if(existing)
+	{
+		::CloseHandle(newevent);
+		return existing;
+	}
+
+	return newevent;
 }
@@ -55,22 +55,55 @@ namespace Threads
 
 
 	//
-	// RAII wrapper of a special synchronization counter.
-	// This counter is effectively an inverse semaphore;
-	// when its count is 0, it is "unlocked", and when
-	// the count is greater than 0, is is "locked."
+	// Countdown latch, used for waiting on a set of operations
+	// to complete. The latch is released once it has been
+	// counted down to zero, after which any number of threads
+	// may wait on it without blocking.
 	//
-	class SyncCounter
+	// Waiting threads first spin briefly in the hope that the
+	// latch is about to be released, and only block in the OS
+	// if that turns out not to be the case; likewise, releasing
+	// the latch only signals the OS if a thread has blocked.
+	// Short-lived joins therefore avoid kernel transitions.
+	//
+	// The OS event itself is only created once some thread
+	// actually has to block, so latches which are always found
+	// released (such as futures read after they have finished
+	// computing) never touch the kernel at all.
+	//
+	// The count may only be reset when no threads are waiting
+	// on the latch or counting it down.
+	//
+	class CountdownLatch
 	{
 	// Construction and destruction
 	public:
-		explicit SyncCounter(unsigned* pcounter, HANDLE tripevent);
-		~SyncCounter();
+		explicit CountdownLatch(unsigned count = 0);
+		~CountdownLatch();
+
+	// Make latches uncopyable
+	private:
+		CountdownLatch(const CountdownLatch& other);
+		CountdownLatch& operator=(const CountdownLatch& other);
+
+	// Latch interface
+	public:
+		void Reset(unsigned count);
+		void CountDown();
+		void Wait();
+
+		bool IsReleased() const
+		{ return (Count <= 0); }
+
+	// Internal helpers
+	private:
+		HANDLE GetReleaseEvent();
 
 	// Internal tracking
 	private:
-		unsigned* PointerToCounter;
-		HANDLE TripEvent;
+		volatile LONG Count;
+		volatile LONG NumBlockedWaiters;
+		HANDLE volatile ReleaseEvent;
 	};
 
 }
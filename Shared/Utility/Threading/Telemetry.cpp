@@ -0,0 +1,306 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Telemetry for the concurrency machinery
+//
+
+#include "pch.h"
+
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/ThreadPool.h"
+#include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Threading/Threads.h"
+
+#include "User Interface/Output.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+
+using namespace Threads;
+
+
+namespace
+{
+
+	//
+	// Totals of retired mailboxes and pools, and of timed waits
+	//
+	// All of these are protected by the telemetry critical section.
+	//
+	CriticalSection TelemetryCriticalSection;
+
+	Telemetry::Statistics RetiredTotals;
+	std::set<const ThreadPool*> LivePools;
+
+	unsigned __int64 FutureWaitTicks = 0;
+	unsigned __int64 MaxFutureWaitTicks = 0;
+	unsigned __int64 ParallelForJoinTicks = 0;
+	unsigned __int64 MaxParallelForJoinTicks = 0;
+
+	// Periodic dump thread
+	HANDLE DumpThread = NULL;
+	HANDLE StopDumpEvent = NULL;
+
+
+	//
+	// Retrieve the frequency of the timestamp counter
+	//
+	unsigned __int64 GetTimestampFrequency()
+	{
+		static unsigned __int64 frequency = 0;
+		if(!frequency)
+		{
+			LARGE_INTEGER value;
+			::QueryPerformanceFrequency(&value);
+			frequency = static_cast<unsigned __int64>(value.QuadPart);
+		}
+
+		return frequency;
+	}
+
+	//
+	// Add the statistics of a pool to the given totals
+	//
+	void AccumulatePool(Telemetry::Statistics& totals, const ThreadPool::Statistics& pool)
+	{
+		++totals.NumPools;
+		totals.NumWorkers += pool.NumWorkers;
+		totals.WorkItemsQueued += pool.NumQueued;
+		totals.WorkItemsClaimed += pool.NumClaimed;
+		totals.WorkItemsStolen += pool.NumStolen;
+		totals.WorkerIdleMilliseconds += Telemetry::TicksToMilliseconds(pool.IdleTicks);
+		totals.TotalClaimLatencyMilliseconds += Telemetry::TicksToMilliseconds(pool.ClaimLatencyTicks);
+
+		double maxlatency = Telemetry::TicksToMilliseconds(pool.MaxClaimLatencyTicks);
+		if(maxlatency > totals.MaxClaimLatencyMilliseconds)
+			totals.MaxClaimLatencyMilliseconds = maxlatency;
+	}
+
+	//
+	// Add the statistics of a mailbox to the given totals
+	//
+	void AccumulateMailbox(Telemetry::Statistics& totals, const MailboxStatistics& mailbox)
+	{
+		++totals.NumMailboxes;
+		totals.MessagesEnqueued += mailbox.NumEnqueued;
+		totals.MessagesDequeued += mailbox.NumDequeued;
+		totals.MessagesDropped += mailbox.NumDropped;
+		totals.MessagesRejected += mailbox.NumRejected;
+		if(mailbox.HighWaterMark > totals.MaxMailboxDepth)
+			totals.MaxMailboxDepth = mailbox.HighWaterMark;
+	}
+
+	//
+	// Write the timings of one kind of wait to the console
+	//
+	void DumpWaits(UI::OutputStream& output, const wchar_t* name, const Telemetry::WaitStatistics& waits)
+	{
+		output << L"  " << name << L": " << waits.NumWaits << L" blocking waits, " << waits.TotalMilliseconds << L" ms total";
+		if(waits.NumWaits)
+			output << L" (" << (waits.TotalMilliseconds / static_cast<double>(waits.NumWaits)) << L" ms average, " << waits.MaxMilliseconds << L" ms max)";
+		output << L"\n";
+	}
+
+}
+
+
+//
+// Gather a snapshot of all concurrency statistics
+//
+Telemetry::Statistics Telemetry::GetStatistics()
+{
+	Statistics stats;
+
+	{
+		CriticalSection::Auto mutex(TelemetryCriticalSection);
+
+		stats = RetiredTotals;
+		for(std::set<const ThreadPool*>::const_iterator iter = LivePools.begin(); iter != LivePools.end(); ++iter)
+			AccumulatePool(stats, (*iter)->GetStatistics());
+
+		stats.FutureWaits.TotalMilliseconds = TicksToMilliseconds(FutureWaitTicks);
+		stats.FutureWaits.MaxMilliseconds = TicksToMilliseconds(MaxFutureWaitTicks);
+		stats.ParallelForJoins.TotalMilliseconds = TicksToMilliseconds(ParallelForJoinTicks);
+		stats.ParallelForJoins.MaxMilliseconds = TicksToMilliseconds(MaxParallelForJoinTicks);
+	}
+
+	std::vector<MailboxStatistics> livemailboxes;
+	GetLiveMailboxStatistics(livemailboxes);
+	for(std::vector<MailboxStatistics>::const_iterator iter = livemailboxes.begin(); iter != livemailboxes.end(); ++iter)
+	{
+		AccumulateMailbox(stats, *iter);
+		stats.MessagesPending += iter->NumEnqueued - iter->NumDequeued + iter->NumDeferred;
+	}
+
+	return stats;
+}
+
+
+//
+// Begin timing a blocking wait
+//
+Telemetry::WaitTimer::WaitTimer(WaitKind kind)
+	: Kind(kind),
+	  StartTicks(GetTimestamp())
+{
+}
+
+//
+// Record the duration of the wait
+//
+Telemetry::WaitTimer::~WaitTimer()
+{
+	unsigned __int64 elapsed = GetTimestamp() - StartTicks;
+
+	CriticalSection::Auto mutex(TelemetryCriticalSection);
+	if(Kind == Wait_Future)
+	{
+		++RetiredTotals.FutureWaits.NumWaits;
+		FutureWaitTicks += elapsed;
+		if(elapsed > MaxFutureWaitTicks)
+			MaxFutureWaitTicks = elapsed;
+	}
+	else
+	{
+		++RetiredTotals.ParallelForJoins.NumWaits;
+		ParallelForJoinTicks += elapsed;
+		if(elapsed > MaxParallelForJoinTicks)
+			MaxParallelForJoinTicks = elapsed;
+	}
+}
+
+
+//
+// Start the periodic dump thread, if dumping is enabled
+//
+Telemetry::DumpSession::DumpSession()
+	: Active(Config::TelemetryDumpInterval != 0)
+{
+	if(!Active)
+		return;
+
+	if(DumpThread)
+		throw ThreadException("Cannot start a telemetry dump while another one is already running");
+
+	StopDumpEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!StopDumpEvent)
+		throw ThreadException("Failed to create synchronization event for the telemetry dump");
+
+	DumpThread = ::CreateThread(NULL, 0, DumpThreadProc, NULL, 0, NULL);
+	if(!DumpThread)
+	{
+		::CloseHandle(StopDumpEvent);
+		StopDumpEvent = NULL;
+		throw ThreadException("Failed to start the telemetry dump thread");
+	}
+}
+
+//
+// Stop the periodic dump thread, and write out the final statistics
+//
+Telemetry::DumpSession::~DumpSession()
+{
+	if(!Active)
+		return;
+
+	::SetEvent(StopDumpEvent);
+	::WaitForSingleObject(DumpThread, INFINITE);
+	::CloseHandle(DumpThread);
+	::CloseHandle(StopDumpEvent);
+	DumpThread = NULL;
+	StopDumpEvent = NULL;
+
+	try
+	{
+		DumpStatistics();
+	}
+	catch(...)
+	{
+		// Failing to write the statistics should not mask the program's own results
+	}
+}
+
+//
+// Entry point for the thread which periodically dumps the statistics
+//
+DWORD __stdcall Telemetry::DumpSession::DumpThreadProc(void* param)
+{
+	while(::WaitForSingleObject(StopDumpEvent, Config::TelemetryDumpInterval) == WAIT_TIMEOUT)
+		DumpStatistics();
+
+	return 0;
+}
+
+//
+// Write a summary of the current statistics to the console
+//
+void Telemetry::DumpStatistics()
+{
+	Statistics stats = GetStatistics();
+
+	UI::OutputStream output;
+	output << L"Telemetry:\n";
+	output << L"  Mailboxes: " << stats.NumMailboxes << L" mailboxes, " << stats.MessagesEnqueued << L" messages enqueued, " << stats.MessagesDequeued << L" dequeued, " << stats.MessagesPending << L" pending\n";
+	output << L"             peak depth " << stats.MaxMailboxDepth << L" of " << Config::NumMessageSlots << L" slots, " << stats.MessagesDropped << L" dropped, " << stats.MessagesRejected << L" rejected\n";
+	output << L"  Pools: " << stats.NumPools << L" pools, " << stats.NumWorkers << L" workers, " << stats.WorkItemsQueued << L" items queued, " << stats.WorkItemsClaimed << L" claimed (" << stats.WorkItemsStolen << L" stolen)\n";
+	output << L"         " << stats.WorkerIdleMilliseconds << L" ms worker idle time, claim latency " << stats.TotalClaimLatencyMilliseconds << L" ms total";
+	if(stats.WorkItemsClaimed)
+		output << L" (" << (stats.TotalClaimLatencyMilliseconds / static_cast<double>(stats.WorkItemsClaimed)) << L" ms average, " << stats.MaxClaimLatencyMilliseconds << L" ms max)";
+	output << L"\n";
+	DumpWaits(output, L"Futures", stats.FutureWaits);
+	DumpWaits(output, L"Parallel loop joins", stats.ParallelForJoins);
+	output << std::endl;
+}
+
+
+//
+// Read the high resolution timestamp counter
+//
+unsigned __int64 Telemetry::GetTimestamp()
+{
+	LARGE_INTEGER value;
+	::QueryPerformanceCounter(&value);
+	return static_cast<unsigned __int64>(value.QuadPart);
+}
+
+//
+// Convert a difference between timestamps into milliseconds
+//
+double Telemetry::TicksToMilliseconds(unsigned __int64 ticks)
+{
+	return static_cast<double>(ticks) * 1000.0 / static_cast<double>(GetTimestampFrequency());
+}
+
+
+//
+// Fold the final statistics of a mailbox into the retired totals
+//
+void Telemetry::RecordRetiredMailbox(const MailboxStatistics& stats)
+{
+	CriticalSection::Auto mutex(TelemetryCriticalSection);
+	AccumulateMailbox(RetiredTotals, stats);
+}
+
+//
+// Begin tracking a pool which has just been started
+//
+void Telemetry::RegisterPool(const ThreadPool& pool)
+{
+	CriticalSection::Auto mutex(TelemetryCriticalSection);
+	LivePools.insert(&pool);
+}
+
+//
+// Stop tracking a pool, folding its final statistics into the retired totals
+//
+// Pools which failed to start up were never registered, and are ignored.
+//
+void Telemetry::UnregisterPool(const ThreadPool& pool)
+{
+	CriticalSection::Auto mutex(TelemetryCriticalSection);
+	if(LivePools.erase(&pool))
+		AccumulatePool(RetiredTotals, pool.GetStatistics());
+}
+
@@ -0,0 +1,139 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Telemetry for the concurrency machinery: mailboxes, thread pools,
+// futures, and parallel loops
+//
+// The aim is to make the sizing of mailboxes and pools a matter of
+// measurement rather than guesswork. Counters are kept where they are
+// cheapest to maintain; mailboxes count messages through their ring
+// positions (which they track anyway), and each pool worker thread keeps
+// its own counters, which only it ever writes. The totals are gathered
+// on demand by GetStatistics, which combines the live mailboxes and pools
+// with those which have already been retired.
+//
+// Since live counters are read without synchronizing against the threads
+// which update them, the statistics are a snapshot, and counters which are
+// in the middle of being updated may be slightly out of date.
+//
+// Blocking waits (on futures and on parallel loops) are timed with the
+// WaitTimer helper. Waits which are found to be already satisfied never
+// block, and are not counted.
+//
+
+#pragma once
+
+
+// Forward declarations
+struct MailboxStatistics;
+namespace Threads { class ThreadPool; }
+
+
+namespace Threads
+{
+	namespace Telemetry
+	{
+
+		//
+		// Accumulated timings of one kind of blocking wait
+		//
+		struct WaitStatistics
+		{
+			unsigned __int64 NumWaits;
+			double TotalMilliseconds;
+			double MaxMilliseconds;
+		};
+
+		//
+		// Snapshot of all concurrency statistics gathered so far
+		//
+		// This structure is handed out by the VM DLL as is, so any
+		// changes to its layout must be made with care.
+		//
+		struct Statistics
+		{
+			// Mailboxes of all tasks, including those which have exited
+			unsigned NumMailboxes;
+			unsigned __int64 MessagesEnqueued;
+			unsigned __int64 MessagesDequeued;
+			unsigned MessagesPending;				// Waiting in the mailboxes of live tasks
+			unsigned MaxMailboxDepth;				// Highest backlog seen in any one mailbox
+			unsigned MessagesDropped;
+			unsigned MessagesRejected;
+
+			// Thread pools, including those which have been shut down
+			unsigned NumPools;
+			unsigned NumWorkers;
+			unsigned __int64 WorkItemsQueued;
+			unsigned __int64 WorkItemsClaimed;
+			unsigned __int64 WorkItemsStolen;		// Claimed from some other worker's queue
+			double WorkerIdleMilliseconds;
+			double TotalClaimLatencyMilliseconds;	// Time between queuing and claiming an item
+			double MaxClaimLatencyMilliseconds;
+
+			// Blocking waits
+			WaitStatistics FutureWaits;
+			WaitStatistics ParallelForJoins;
+		};
+
+		Statistics GetStatistics();
+
+
+		//
+		// Kinds of blocking wait which are timed
+		//
+		enum WaitKind
+		{
+			Wait_Future,
+			Wait_ParallelForJoin
+		};
+
+		//
+		// RAII helper for timing a blocking wait
+		//
+		class WaitTimer
+		{
+		public:
+			explicit WaitTimer(WaitKind kind);
+			~WaitTimer();
+
+		private:
+			WaitKind Kind;
+			unsigned __int64 StartTicks;
+		};
+
+
+		//
+		// RAII helper for periodically writing the statistics to the
+		// console while a program runs, if Config::TelemetryDumpInterval
+		// is set; a final dump is written when the session ends
+		//
+		class DumpSession
+		{
+		public:
+			DumpSession();
+			~DumpSession();
+
+		private:
+			static DWORD __stdcall DumpThreadProc(void* param);
+
+		private:
+			bool Active;
+		};
+
+		void DumpStatistics();
+
+
+		// Timing helpers
+		unsigned __int64 GetTimestamp();
+		double TicksToMilliseconds(unsigned __int64 ticks);
+
+		// Tracking of mailboxes and pools
+		void RecordRetiredMailbox(const MailboxStatistics& stats);
+		void RegisterPool(const ThreadPool& pool);
+		void UnregisterPool(const ThreadPool& pool);
+
+	}
+}
+
@@ -9,6 +9,9 @@
 
 #include "Utility/Threading/ThreadPool.h"
 #include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Threading/MachineInfo.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Tracing.h"
 
 
 using namespace Threads;
@@ -17,50 +20,103 @@ using namespace Threads;
 namespace
 {
 
+	//
+	// Idle states of worker threads
+	//
+	const LONG WorkerBusy = 0;
+	const LONG WorkerSpinning = 1;
+	const LONG WorkerSleeping = 2;
+
+	// Number of times an idle worker polls for work before sleeping
+	const unsigned IdleSpinCount = 256;
+
+
+	// Determine if a worker thread may claim work of the given priority
+	bool CanClaim(const ThreadPool::ThreadDetails& worker, WorkPriority priority)
+	{
+		return (priority <= worker.LowestPriority);
+	}
+
+
+	// Perform a work item, reporting any errors raised by the work
+	void PerformWorkItem(PoolWorkItem& workitem)
+	{
+		// Go do something. Hopefully something interesting.
+		Tracing::Span span("Work item");
+		try
+		{
+			workitem.PerformWork();
+		}
+		catch(std::exception& ex)
+		{
+			::MessageBoxA(0, ex.what(), Strings::WindowTitle, MB_ICONERROR);
+		}
+		catch(...)
+		{
+			::MessageBoxA(0, "An unexpected error has occurred while executing an Epoch task in a thread pool.", Strings::WindowTitle, MB_ICONERROR);
+		}
+	}
+
+	//
+	// Select the processors which a worker thread may run on
+	//
+	// Workers are spread evenly over the usable processors, which are
+	// ordered by node; consecutive workers thus share a node for as long
+	// as possible. Returns zero if the worker should not be restricted.
+	//
+	DWORD_PTR GetWorkerAffinityMask(unsigned workerindex, unsigned numworkers, WorkerPlacement placement)
+	{
+		if(placement == WorkerPlacement_Unrestricted)
+			return 0;
+
+		const std::vector<ProcessorNode>& nodes = GetProcessorNodes();
+
+		size_t numprocessors = 0;
+		for(std::vector<ProcessorNode>::const_iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+			numprocessors += iter->Processors.size();
+
+		size_t slot;
+		if(numworkers <= numprocessors)
+			slot = static_cast<size_t>(workerindex) * numprocessors / numworkers;
+		else
+			slot = workerindex % numprocessors;
+
+		for(std::vector<ProcessorNode>::const_iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+		{
+			if(slot < iter->Processors.size())
+			{
+				if(placement == WorkerPlacement_NodeLocal)
+					return iter->ProcessorMask;
+
+				return static_cast<DWORD_PTR>(1) << iter->Processors[slot];
+			}
+
+			slot -= iter->Processors.size();
+		}
+
+		return 0;
+	}
+
 	// Entry point stub for launching worker threads for a thread pool
 	DWORD __stdcall WorkerThreadProc(void* detailptr)
 	{
 		ThreadPool::ThreadDetails* mydetails = reinterpret_cast<ThreadPool::ThreadDetails*>(detailptr);
 		ThreadPool& mypool = *mydetails->OwningPool;
-		HANDLE shutdownevent = mypool.GetShutdownEvent();
 
 		Threads::Enter(&mydetails->Info);
 
-		while(true)
+		// Extract work items 'til the program is shut down
+		while(!mypool.IsShuttingDown())
 		{
-			// Exit the thread if the program is being shut down
-			if(::WaitForSingleObject(shutdownevent, 0) == WAIT_OBJECT_0)
-				break;
-
-			// Wait until the pool wakes us up, indicating that there is work to do
-			::WaitForSingleObject(mydetails->ThreadWakeEvent, INFINITE);
-
-			// Extract work items 'til there ain't no more
-			std::auto_ptr<PoolWorkItem> workitem(mypool.ClaimWorkItem(mydetails->ThreadHandle));
-			while(workitem.get() != NULL)
+			std::auto_ptr<PoolWorkItem> workitem(mypool.ClaimWorkItem(*mydetails));
+			if(workitem.get() == NULL)
 			{
-				// Don't do a work item if the program is trying to exit
-				if(::WaitForSingleObject(shutdownevent, 0) == WAIT_OBJECT_0)
-					break;
-
-				// Go do something. Hopefully something interesting.
-				try
-				{
-					workitem->PerformWork();
-				}
-				catch(std::exception& ex)
-				{
-					::MessageBoxA(0, ex.what(), Strings::WindowTitle, MB_ICONERROR);
-				}
-				catch(...)
-				{
-					::MessageBoxA(0, "An unexpected error has occurred while executing an Epoch task in a thread pool.", Strings::WindowTitle, MB_ICONERROR);
-				}
-
-				workitem.reset(mypool.ClaimWorkItem(mydetails->ThreadHandle));
+				// Wait until the pool wakes us up, indicating that there is work to do
+				mypool.WaitForWork(*mydetails);
+				continue;
 			}
 
-			::ResetEvent(mydetails->ThreadWakeEvent);
+			PerformWorkItem(*workitem);
 		}
 
 		Threads::Exit();
@@ -74,20 +130,43 @@ namespace
 //
 // Create a thread pool, allocating the requested number of threads
 //
-ThreadPool::ThreadPool(unsigned threadcount, VM::Program* runningprogram)
+// The given number of workers are reserved for normal priority work; at
+// least one worker must remain free to run batch work.
+//
+ThreadPool::ThreadPool(unsigned threadcount, VM::Program* runningprogram, WorkerPlacement placement, unsigned reservedworkers)
+	: NumReservedWorkers(reservedworkers),
+	  NextInboxIndex(0),
+	  NumIdleWorkers(0),
+	  NumQueued(0),
+	  ShuttingDown(false)
 {
+	if(!threadcount)
+		throw ThreadException("Cannot create a thread pool with no worker threads!");
+
+	if(reservedworkers >= threadcount)
+		throw ThreadException("Cannot reserve every worker thread of a thread pool for normal priority work!");
+
+	for(unsigned i = 0; i < NumWorkPriorities; ++i)
+		NumPending[i] = 0;
+
 	ShutdownEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
 	if(!ShutdownEvent)
 		throw ThreadException("Failed to create synchronization event for pool shutdown procedure!");
 
 	try
 	{
+		Workers.reserve(threadcount);
 		for(unsigned i = 0; i < threadcount; ++i)
 		{
-			ThreadDetails* details = new ThreadDetails;
+			std::auto_ptr<ThreadDetails> details(new ThreadDetails);
+			for(unsigned j = 0; j < NumWorkPriorities; ++j)
+				::InitializeSListHead(&details->Inbox[j]);
+			details->LowestPriority = (i < reservedworkers) ? WorkPriority_Normal : WorkPriority_Batch;
 			details->OwningPool = this;
-			details->ThreadHandle = INVALID_HANDLE_VALUE;
-			details->ThreadWakeEvent = INVALID_HANDLE_VALUE;
+			details->ThreadHandle = NULL;
+			details->ThreadWakeEvent = NULL;
+			details->Idle = WorkerBusy;
+			details->StealSeed = (i + 1) * 2654435761u;
 
 			details->Info.CodeBlock = NULL;
 			details->Info.BoundFuture = NULL;
@@ -95,28 +174,38 @@ ThreadPool::ThreadPool(unsigned threadcount, VM::Program* runningprogram)
 			details->Info.TaskOrigin = reinterpret_cast<Threads::ThreadInfo*>(::TlsGetValue(Threads::GetTLSIndex()))->HandleToSelf;
 			details->Info.LocalHeapHandle = NULL;
 			details->Info.MessageEvent = NULL;
+			details->Info.WaitingForMessage = 0;
 			details->Info.Mailbox = NULL;
+			details->Info.GreenTask = NULL;
 
-			details->ThreadHandle = ::CreateThread(NULL, 0, WorkerThreadProc, details, CREATE_SUSPENDED, &details->Info.HandleToSelf);
-			if(!details->ThreadHandle)
-				throw ThreadException("Failed to create a worker thread for a thread pool!");
+			details->ThreadWakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+			if(!details->ThreadWakeEvent)
+				throw ThreadException("Failed to create synchronization event for worker thread in a thread pool!");
 
-			Details[details->ThreadHandle] = details;
-			ThreadDetails* storeddetails = Details[details->ThreadHandle];
+			Workers.push_back(details.get());
+			ThreadDetails* storeddetails = details.release();
 
-			storeddetails->ThreadWakeEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
-			if(!storeddetails->ThreadWakeEvent)
-				throw ThreadException("Failed to create synchronization event for worker thread in a thread pool!");
+			storeddetails->ThreadHandle = ::CreateThread(NULL, 0, WorkerThreadProc, storeddetails, CREATE_SUSPENDED, &storeddetails->Info.HandleToSelf);
+			if(!storeddetails->ThreadHandle)
+				throw ThreadException("Failed to create a worker thread for a thread pool!");
+
+			// The thread has not started yet, so it will first run (and
+			// allocate its memory) on the processors chosen for it here
+			DWORD_PTR affinity = GetWorkerAffinityMask(i, threadcount, placement);
+			if(affinity && !::SetThreadAffinityMask(storeddetails->ThreadHandle, affinity))
+				throw ThreadException("Failed to assign processors to a worker thread in a thread pool!");
 		}
 	}
 	catch(...)
 	{
+		ShuttingDown = true;
 		::SetEvent(ShutdownEvent);
 		ResumeAllThreads();
 		Clean();
 		throw;
 	}
 
+	Telemetry::RegisterPool(*this);
 	ResumeAllThreads();
 }
 
@@ -136,35 +225,45 @@ ThreadPool::~ThreadPool()
 void ThreadPool::Clean()
 {
 	// Notify all threads to shut down, and wait until they exit
+	ShuttingDown = true;
 	::SetEvent(ShutdownEvent);
-	for(ThreadDetailMap::iterator iter = Details.begin(); iter != Details.end(); ++iter)
+	for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
 	{
-		// Wake the thread up, just in case it isn't already running
-		if(iter->second->ThreadWakeEvent != INVALID_HANDLE_VALUE)
-			::SetEvent(iter->second->ThreadWakeEvent);
+		if((*iter)->ThreadHandle)
+		{
+			::WaitForSingleObject((*iter)->ThreadHandle, INFINITE);
+			::CloseHandle((*iter)->ThreadHandle);
+		}
 
-		::WaitForSingleObject(iter->second->ThreadHandle, INFINITE);
-		delete iter->second;
+		if((*iter)->ThreadWakeEvent)
+			::CloseHandle((*iter)->ThreadWakeEvent);
 	}
 
-	// Now clean up our tracking resources
-	{
-		CriticalSection::Auto mutex(WorkItemCritSec);
+	// The workers are done, so their counters are final
+	Telemetry::UnregisterPool(*this);
 
-		Details.clear();
+	// Now discard any work items which never got a chance to run
+	for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
+	{
+		for(unsigned i = 0; i < NumWorkPriorities; ++i)
+		{
+			WorkPriority priority = static_cast<WorkPriority>(i);
 
-		for(WorkItemMap::iterator iter = UnassignedWorkItems.begin(); iter != UnassignedWorkItems.end(); ++iter)
-			delete iter->second;
-		UnassignedWorkItems.clear();
+			DrainInbox(**iter, priority);
+			while(QueuedWorkItem* item = (*iter)->LocalItems[priority].Pop())
+				delete ReleaseQueuedItem(item);
 
-		for(std::map<HANDLE, WorkItemMap>::iterator iter = AssignedWorkItems.begin(); iter != AssignedWorkItems.end(); ++iter)
-		{
-			for(WorkItemMap::iterator inneriter = iter->second.begin(); inneriter != iter->second.end(); ++inneriter)
-				delete inneriter->second;
-			iter->second.clear();
+			// Anything left over from a full deque is still in the inbox
+			while(PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&(*iter)->Inbox[priority]))
+				delete ReleaseQueuedItem(reinterpret_cast<QueuedWorkItem*>(entry));
 		}
-		AssignedWorkItems.clear();
+
+		delete *iter;
 	}
+	Workers.clear();
+
+	::CloseHandle(ShutdownEvent);
+	ShutdownEvent = NULL;
 }
 
 
@@ -175,69 +274,503 @@ void ThreadPool::Clean()
 //
 void ThreadPool::ResumeAllThreads()
 {
-	for(ThreadDetailMap::iterator iter = Details.begin(); iter != Details.end(); ++iter)
-		::ResumeThread(iter->second->ThreadHandle);
+	for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
+	{
+		if((*iter)->ThreadHandle)
+			::ResumeThread((*iter)->ThreadHandle);
+	}
 }
 
 
 //
-// Add a work item to the thread pool.
+// Add an anonymous work item to the thread pool.
 //
-// This function also assigns the work item to a specific thread, waking that
-// thread up to perform the work item if necessary. The work item will be
-// deleted by the thread pool, so the caller does not need to free it manually.
+// The work item will be deleted by the thread pool, so the caller does
+// not need to free it manually.
 //
-void ThreadPool::AddWorkItem(const std::wstring& taskname, PoolWorkItem* item)
+void ThreadPool::AddWorkItem(PoolWorkItem* item, WorkPriority priority)
 {
-	// TODO - assertion safety here (e.g. make sure nothing else is using the given taskname, etc.)
+	std::auto_ptr<PoolWorkItem> itemptr(item);
+	std::auto_ptr<QueuedWorkItem> queued(new QueuedWorkItem);
+	queued->Priority = priority;
+	queued->Item = itemptr.release();
+	Enqueue(queued.release());
+}
+
+//
+// Add a named work item to the thread pool.
+//
+// The name is recorded until a worker thread picks up the item, so that
+// the item can be looked up with IsWorkItemPending in the meantime.
+//
+void ThreadPool::AddWorkItem(const std::wstring& taskname, PoolWorkItem* item, WorkPriority priority)
+{
+	if(taskname.empty())
+	{
+		AddWorkItem(item, priority);
+		return;
+	}
+
+	std::auto_ptr<PoolWorkItem> itemptr(item);
+	std::auto_ptr<QueuedWorkItem> queued(new QueuedWorkItem);
+	queued->Name = taskname;
+	queued->Priority = priority;
 
-	for(ThreadDetailMap::iterator iter = Details.begin(); iter != Details.end(); ++iter)
 	{
-		// If the thread's wake event is not signalled, it must be idle
-		if(::WaitForSingleObject(iter->second->ThreadWakeEvent, 0) == WAIT_TIMEOUT)
+		CriticalSection::Auto mutex(NamedItemCritSec);
+		++PendingNamedItems[taskname];
+	}
+
+	queued->Item = itemptr.release();
+	Enqueue(queued.release());
+}
+
+//
+// Determine if a named work item is still waiting for a worker thread
+//
+bool ThreadPool::IsWorkItemPending(const std::wstring& taskname) const
+{
+	CriticalSection::Auto mutex(NamedItemCritSec);
+	return (PendingNamedItems.find(taskname) != PendingNamedItems.end());
+}
+
+
+//
+// Place a queued work item where a worker thread will find it
+//
+// Items queued from one of this pool's own worker threads are kept on
+// that thread's deque. Otherwise, the item goes into the inbox of an
+// idle worker (if there is one) or else the next worker in turn. Items
+// are never given to a worker which is not allowed to claim them.
+//
+// The pending count for the item's priority is raised before the item
+// becomes visible, and only dropped again once the item is claimed, so
+// a zero count reliably means no item of that priority can be found.
+//
+// Note that an idle worker is always claimed after the item is visible;
+// idle workers check for stealable work after flagging themselves as
+// idle, so either the worker finds the item or we find the worker. This
+// also matters because claimed workers which are still spinning are not
+// signalled, and simply go back to looking for work.
+//
+void ThreadPool::Enqueue(QueuedWorkItem* item)
+{
+	WorkPriority priority = item->Priority;
+
+	item->QueuedTimestamp = Telemetry::GetTimestamp();
+	::InterlockedIncrement(&NumQueued);
+	::InterlockedIncrement(&NumPending[priority]);
+
+	ThreadDetails* thisworker = GetWorkerForThisThread();
+	if(thisworker && CanClaim(*thisworker, priority) && thisworker->LocalItems[priority].Push(item))
+	{
+		WakeIdleWorker(priority);
+		return;
+	}
+
+	ThreadDetails* target = NULL;
+	if(NumIdleWorkers > 0)
+	{
+		for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
 		{
+			if((*iter)->Idle != WorkerBusy && CanClaim(**iter, priority))
 			{
-				CriticalSection::Auto mutex(WorkItemCritSec);
-				AssignedWorkItems[iter->first][taskname] = item;
+				target = *iter;
+				break;
 			}
+		}
+	}
+
+	if(!target)
+	{
+		// Reserved workers come first, and only take normal priority work
+		size_t first = (priority == WorkPriority_Normal) ? 0 : NumReservedWorkers;
+		target = Workers[first + static_cast<size_t>(::InterlockedIncrement(&NextInboxIndex)) % (Workers.size() - first)];
+	}
+
+	::InterlockedPushEntrySList(&target->Inbox[priority], &item->Entry);
+	WakeIdleWorker(priority);
+}
+
 
-			// Wake the thread up and bail
-			::SetEvent(iter->second->ThreadWakeEvent);
+//
+// Request a work item from the pool, on behalf of the given worker thread.
+//
+// Each priority the worker may claim is tried in turn, highest first.
+// At each priority, the worker's own deque is checked first, followed by
+// its inbox; if neither has anything, other workers are raided for work.
+// Returns NULL if no work could be found anywhere.
+//
+PoolWorkItem* ThreadPool::ClaimWorkItem(ThreadDetails& worker)
+{
+	for(unsigned i = 0; i <= static_cast<unsigned>(worker.LowestPriority); ++i)
+	{
+		WorkPriority priority = static_cast<WorkPriority>(i);
+		if(NumPending[priority] <= 0)
+			continue;
+
+		bool stolen = false;
+
+		QueuedWorkItem* item = worker.LocalItems[priority].Pop();
+		if(!item)
+		{
+			DrainInbox(worker, priority);
+			item = worker.LocalItems[priority].Pop();
+		}
+
+		if(!item)
+		{
+			item = StealWorkItem(&worker, priority);
+			stolen = true;
+		}
+
+		if(item)
+		{
+			CountClaim(worker.Counters, *item, stolen);
+			return ReleaseQueuedItem(item);
+		}
+	}
+
+	return NULL;
+}
+
+//
+// Run one queued work item on the calling thread, if any are available
+//
+// This allows threads which are waiting for work in the pool to finish
+// to help out, rather than sitting idle. It also allows worker threads
+// of the pool itself to wait on other items in the pool without risk of
+// deadlock, since the items they are waiting on can never be stuck in
+// their own deques. Returns false if no work item could be found.
+//
+bool ThreadPool::RunPendingWorkItem()
+{
+	std::auto_ptr<PoolWorkItem> workitem;
+
+	ThreadDetails* thisworker = GetWorkerForThisThread();
+	if(thisworker)
+		workitem.reset(ClaimWorkItem(*thisworker));
+	else
+	{
+		QueuedWorkItem* item = NULL;
+		for(unsigned i = 0; i < NumWorkPriorities && !item; ++i)
+		{
+			if(NumPending[i] > 0)
+				item = StealWorkItem(NULL, static_cast<WorkPriority>(i));
+		}
+
+		if(item)
+		{
+			{
+				CriticalSection::Auto mutex(HelperCritSec);
+				CountClaim(HelperCounters, *item, true);
+			}
+			workitem.reset(ReleaseQueuedItem(item));
+		}
+	}
+
+	if(workitem.get() == NULL)
+		return false;
+
+	PerformWorkItem(*workitem);
+	return true;
+}
+
+//
+// Discard all work items which are still waiting in the pool
+//
+// Items which have already been claimed by a thread are left to run to
+// completion; cancelling those is up to the work itself, via the tokens
+// described in CancellationToken.h. Each discarded item is given the
+// chance to release anyone waiting on it. Returns the number of items
+// which were discarded.
+//
+unsigned ThreadPool::CancelPendingWorkItems()
+{
+	unsigned numcancelled = 0;
+
+	for(unsigned i = 0; i < NumWorkPriorities; ++i)
+	{
+		while(NumPending[i] > 0)
+		{
+			QueuedWorkItem* item = StealWorkItem(NULL, static_cast<WorkPriority>(i));
+			if(!item)
+				break;
+
+			std::auto_ptr<PoolWorkItem> workitem(ReleaseQueuedItem(item));
+			workitem->Cancel();
+			++numcancelled;
+		}
+	}
+
+	return numcancelled;
+}
+
+//
+// Idle a worker thread until more work arrives
+//
+// The worker first spins, watching for work to show up or for some
+// producer to claim it; a claimed worker returns straight away, since
+// the producer does not signal workers which have not gone to sleep.
+// Only once the spin runs out does the worker block on its event.
+//
+void ThreadPool::WaitForWork(ThreadDetails& worker)
+{
+	unsigned __int64 start = Telemetry::GetTimestamp();
+	IdleUntilWorkArrives(worker);
+	worker.Counters.IdleTicks += Telemetry::GetTimestamp() - start;
+}
+
+//
+// Perform the actual idling for WaitForWork
+//
+void ThreadPool::IdleUntilWorkArrives(ThreadDetails& worker)
+{
+	::InterlockedExchange(&worker.Idle, WorkerSpinning);
+	::InterlockedIncrement(&NumIdleWorkers);
+
+	// Work may have been queued before we flagged ourselves as idle
+	for(unsigned i = 0; i < IdleSpinCount; ++i)
+	{
+		if(worker.Idle == WorkerBusy)
+			return;
+
+		if(HasAvailableWork(worker.LowestPriority) || IsShuttingDown())
+		{
+			LeaveIdleState(worker, WorkerSpinning);
 			return;
 		}
+
+		YieldProcessor();
+	}
+
+	if(::InterlockedCompareExchange(&worker.Idle, WorkerSleeping, WorkerSpinning) != WorkerSpinning)
+		return;
+
+	HANDLE handles[2] = { worker.ThreadWakeEvent, ShutdownEvent };
+	::WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+
+	// Shutdown wakes the worker without anyone having claimed it
+	LeaveIdleState(worker, WorkerSleeping);
+}
+
+//
+// Mark an idle worker as busy again, unless a producer has already done so
+//
+// If a producer claimed a sleeping worker at the same time, its wake-up
+// is left in the event, which results in nothing worse than a spurious
+// wake later on.
+//
+void ThreadPool::LeaveIdleState(ThreadDetails& worker, LONG idlestate)
+{
+	if(::InterlockedCompareExchange(&worker.Idle, WorkerBusy, idlestate) == idlestate)
+		::InterlockedDecrement(&NumIdleWorkers);
+}
+
+
+//
+// Move all work items of the given priority from a worker's inbox into its deque
+//
+// Must only be called by the owning worker thread, or after the worker
+// thread has exited.
+//
+void ThreadPool::DrainInbox(ThreadDetails& worker, WorkPriority priority)
+{
+	PSLIST_ENTRY entry = ::InterlockedFlushSList(&worker.Inbox[priority]);
+	while(entry)
+	{
+		PSLIST_ENTRY next = entry->Next;
+		QueuedWorkItem* item = reinterpret_cast<QueuedWorkItem*>(entry);
+
+		// Overflow goes back into the inbox, where thieves can take it
+		if(!worker.LocalItems[priority].Push(item))
+			::InterlockedPushEntrySList(&worker.Inbox[priority], entry);
+
+		entry = next;
+	}
+}
+
+//
+// Take a work item of the given priority from some other worker thread in the pool
+//
+// The thief may be NULL, in which case the calling thread is not one
+// of the pool's workers, and any worker may be robbed.
+//
+ThreadPool::QueuedWorkItem* ThreadPool::StealWorkItem(ThreadDetails* thief, WorkPriority priority)
+{
+	size_t numworkers = Workers.size();
+	size_t start;
+
+	if(thief)
+	{
+		// Cheap xorshift generator, to pick a starting victim
+		thief->StealSeed ^= thief->StealSeed << 13;
+		thief->StealSeed ^= thief->StealSeed >> 17;
+		thief->StealSeed ^= thief->StealSeed << 5;
+		start = thief->StealSeed % numworkers;
+	}
+	else
+		start = static_cast<size_t>(::InterlockedIncrement(&NextInboxIndex)) % numworkers;
+
+	for(size_t i = 0; i < numworkers; ++i)
+	{
+		ThreadDetails& victim = *Workers[(start + i) % numworkers];
+		if(&victim == thief)
+			continue;
+
+		QueuedWorkItem* item = victim.LocalItems[priority].Steal();
+		if(item)
+			return item;
+
+		PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&victim.Inbox[priority]);
+		if(entry)
+			return reinterpret_cast<QueuedWorkItem*>(entry);
 	}
 
-	// We didn't find any idle threads, so shove this item on the back burner
+	return NULL;
+}
+
+//
+// Check if any work items of the given priority or higher are waiting
+//
+bool ThreadPool::HasAvailableWork(WorkPriority lowestpriority) const
+{
+	for(unsigned i = 0; i <= static_cast<unsigned>(lowestpriority); ++i)
 	{
-		CriticalSection::Auto mutex(WorkItemCritSec);
-		UnassignedWorkItems[taskname] = item;
+		if(NumPending[i] > 0)
+			return true;
 	}
+
+	return false;
 }
 
 
 //
-// Request a work item from the pool.
+// Record the claiming of a queued work item in the given counters
 //
-PoolWorkItem* ThreadPool::ClaimWorkItem(HANDLE threadhandle)
+void ThreadPool::CountClaim(ClaimCounters& counters, const QueuedWorkItem& item, bool stolen)
 {
-	CriticalSection::Auto mutex(WorkItemCritSec);
+	unsigned __int64 latency = Telemetry::GetTimestamp() - item.QueuedTimestamp;
+
+	++counters.NumClaimed;
+	if(stolen)
+		++counters.NumStolen;
+
+	counters.ClaimLatencyTicks += latency;
+	if(latency > counters.MaxClaimLatencyTicks)
+		counters.MaxClaimLatencyTicks = latency;
+}
+
+//
+// Gather the counters of all workers (and helping threads) of the pool
+//
+// The counters of running workers are read without synchronization, so
+// the result is only a snapshot; see Utility/Threading/Telemetry.h.
+//
+ThreadPool::Statistics ThreadPool::GetStatistics() const
+{
+	Statistics stats;
+	stats.NumWorkers = GetNumThreads();
+	stats.NumQueued = static_cast<unsigned long>(NumQueued);
 
-	WorkItemMap& assigneditems = AssignedWorkItems[threadhandle];
-	if(assigneditems.empty())
 	{
-		if(UnassignedWorkItems.empty())
-			return NULL;
+		CriticalSection::Auto mutex(HelperCritSec);
+		stats.NumClaimed = HelperCounters.NumClaimed;
+		stats.NumStolen = HelperCounters.NumStolen;
+		stats.IdleTicks = HelperCounters.IdleTicks;
+		stats.ClaimLatencyTicks = HelperCounters.ClaimLatencyTicks;
+		stats.MaxClaimLatencyTicks = HelperCounters.MaxClaimLatencyTicks;
+	}
 
-		// If there are any unassigned work items, grab the first one and do it
-		std::auto_ptr<PoolWorkItem> item(UnassignedWorkItems.begin()->second);
-		std::wstring taskname = UnassignedWorkItems.begin()->first;
-		UnassignedWorkItems.erase(UnassignedWorkItems.begin());
-		assigneditems[taskname] = item.release();
+	for(std::vector<ThreadDetails*>::const_iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
+	{
+		const ClaimCounters& counters = (*iter)->Counters;
+		stats.NumClaimed += counters.NumClaimed;
+		stats.NumStolen += counters.NumStolen;
+		stats.IdleTicks += counters.IdleTicks;
+		stats.ClaimLatencyTicks += counters.ClaimLatencyTicks;
+		if(counters.MaxClaimLatencyTicks > stats.MaxClaimLatencyTicks)
+			stats.MaxClaimLatencyTicks = counters.MaxClaimLatencyTicks;
 	}
 
-	std::auto_ptr<PoolWorkItem> item(assigneditems.begin()->second);
-	assigneditems.erase(assigneditems.begin());
+	return stats;
+}
+
+
+//
+// Retrieve the tracking details of the calling thread, if it is a worker of this pool
+//
+ThreadPool::ThreadDetails* ThreadPool::GetWorkerForThisThread()
+{
+	const ThreadInfo* thisthread = reinterpret_cast<const ThreadInfo*>(::TlsGetValue(Threads::GetTLSIndex()));
+	for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
+	{
+		if(&(*iter)->Info == thisthread)
+			return *iter;
+	}
+
+	return NULL;
+}
+
+//
+// Find an idle worker thread able to claim work of the given priority,
+// and mark it as no longer idle
+// Returns NULL if all such worker threads are busy
+//
+// The caller must signal the worker's wake event if the worker has
+// already gone to sleep, as indicated by the needswake flag.
+//
+ThreadPool::ThreadDetails* ThreadPool::ClaimIdleWorker(WorkPriority priority, bool& needswake)
+{
+	needswake = false;
+	if(NumIdleWorkers <= 0)
+		return NULL;
+
+	for(std::vector<ThreadDetails*>::iterator iter = Workers.begin(); iter != Workers.end(); ++iter)
+	{
+		if(!CanClaim(**iter, priority))
+			continue;
+
+		LONG state = (*iter)->Idle;
+		if(state != WorkerBusy && ::InterlockedCompareExchange(&(*iter)->Idle, WorkerBusy, state) == state)
+		{
+			::InterlockedDecrement(&NumIdleWorkers);
+			needswake = (state == WorkerSleeping);
+			return *iter;
+		}
+	}
+
+	return NULL;
+}
+
+//
+// Wake up an idle worker thread, if there is one, so it can steal work of the given priority
+//
+void ThreadPool::WakeIdleWorker(WorkPriority priority)
+{
+	bool needswake;
+	ThreadDetails* idleworker = ClaimIdleWorker(priority, needswake);
+	if(idleworker && needswake)
+		::SetEvent(idleworker->ThreadWakeEvent);
+}
+
+
+//
+// Release the wrapper of a queued work item, returning the work item itself
+//
+PoolWorkItem* ThreadPool::ReleaseQueuedItem(QueuedWorkItem* item)
+{
+	std::auto_ptr<QueuedWorkItem> queued(item);
+	::InterlockedDecrement(&NumPending[queued->Priority]);
+
+	if(!queued->Name.empty())
+	{
+		CriticalSection::Auto mutex(NamedItemCritSec);
+		NamedItemMap::iterator iter = PendingNamedItems.find(queued->Name);
+		if(iter != PendingNamedItems.end() && --iter->second == 0)
+			PendingNamedItems.erase(iter);
+	}
 
-	return item.release();
+	return queued->Item;
 }
 
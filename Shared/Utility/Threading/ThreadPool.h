@@ -4,6 +4,50 @@
 //
 // Wrappers for creating thread pools and feeding them work
 //
+// Each worker thread in a pool owns a work stealing deque, which holds
+// the work items queued for that thread. Items submitted by one of the
+// pool's own worker threads go directly onto that thread's deque; items
+// submitted from outside the pool are pushed onto a lock-free inbox of
+// one of the workers, which the worker drains into its deque. Workers
+// which run out of work steal from the other workers, starting from a
+// randomly chosen victim so that thieves do not all pile onto the same
+// thread. None of this requires taking any locks.
+//
+// Workers which run out of work spin for a short while before going to
+// sleep on their wake event. Each worker's idle state is kept in a flag
+// which producers claim with a CAS, and the number of idle workers is
+// tracked separately; producers therefore skip the search for an idle
+// worker entirely while all workers are busy, and only signal the OS
+// when the worker they claimed has actually gone to sleep.
+//
+// Worker threads may optionally be tied to particular processors. Each
+// worker creates its heap and touches its stack only once it starts to
+// run, and Windows backs memory with pages from the node of the thread
+// which first touches it; confining a worker to one NUMA node before it
+// starts therefore also keeps its stack and heap in node-local memory.
+//
+// Work items are queued at one of several priorities, and each worker
+// keeps a separate deque and inbox for each priority. Workers always
+// look for work at the highest priority first, including by stealing,
+// so bulk batch work only runs while no normal priority work is waiting
+// anywhere in the pool. A pool may also reserve some of its workers for
+// normal priority work; reserved workers never pick up batch items, so
+// tasks and other latency sensitive work always have a worker available
+// no matter how much batch work is queued. A pool-wide count of pending
+// items at each priority lets workers skip empty priorities (and idle
+// workers check for work) without walking every queue in the pool.
+//
+// Work items can optionally be given a name. Named items are tracked in
+// a lookup table (which is protected by a critical section) so that it
+// is possible to find out whether a given task is still waiting to be
+// run; anonymous items bypass the table entirely.
+//
+// Each worker counts the items it claims, how long they waited in the
+// queues, and how long it spent idle; see Utility/Threading/Telemetry.h.
+// Workers only ever update their own counters. Items claimed by threads
+// outside the pool (which help out while waiting) are counted separately
+// under a critical section, since any number of such threads may exist.
+//
 
 #pragma once
 
@@ -11,6 +55,7 @@
 // Dependencies
 #include "Utility/Threading/Synchronization.h"
 #include "Utility/Threading/Threads.h"
+#include "Utility/Threading/WorkStealingDeque.h"
 #include <map>
 
 
@@ -24,10 +69,41 @@ namespace Threads
 	//
 	// Wrapper interface for work items that can be fed to a thread pool
 	//
+	// Cancel is invoked in place of PerformWork when a queued item is
+	// discarded by CancelPendingWorkItems. Items which have someone
+	// waiting on them must override it to release their waiters; the
+	// default simply runs the item, which is always safe.
+	//
 	struct PoolWorkItem
 	{
 		virtual ~PoolWorkItem() { }
 		virtual void PerformWork() = 0;
+
+		virtual void Cancel()
+		{ PerformWork(); }
+	};
+
+
+	//
+	// Priorities of work items queued in a pool, from highest to lowest
+	//
+	enum WorkPriority
+	{
+		WorkPriority_Normal,				// Tasks, futures, and other latency sensitive work
+		WorkPriority_Batch,					// Chunks of bulk data parallel work, such as parallel for loops
+
+		NumWorkPriorities
+	};
+
+
+	//
+	// Strategies for placing a pool's worker threads on processors
+	//
+	enum WorkerPlacement
+	{
+		WorkerPlacement_Unrestricted,		// Workers may run on any processor
+		WorkerPlacement_NodeLocal,			// Each worker is confined to the processors of one NUMA node
+		WorkerPlacement_PinToProcessor		// Each worker is pinned to a single processor
 	};
 
 
@@ -38,7 +114,7 @@ namespace Threads
 	{
 	// Construction and destruction
 	public:
-		ThreadPool(unsigned threadcount, VM::Program* runningprogram);
+		ThreadPool(unsigned threadcount, VM::Program* runningprogram, WorkerPlacement placement = WorkerPlacement_Unrestricted, unsigned reservedworkers = 0);
 		~ThreadPool();
 
 	// Make pools uncopyable (since a deep copy doesn't make sense)
@@ -48,43 +124,141 @@ namespace Threads
 
 	// Interface for supplying work to the pool
 	public:
-		void AddWorkItem(const std::wstring& taskname, PoolWorkItem* item);
+		void AddWorkItem(PoolWorkItem* item, WorkPriority priority = WorkPriority_Normal);
+		void AddWorkItem(const std::wstring& taskname, PoolWorkItem* item, WorkPriority priority = WorkPriority_Normal);
 
-	// Interface for dispatching work items to the pool threads
+	// Named work item lookup
+	public:
+		bool IsWorkItemPending(const std::wstring& taskname) const;
+
+	// Cancellation of queued work
+	public:
+		unsigned CancelPendingWorkItems();
+
+	// Interface for threads waiting on work in the pool
 	public:
-		PoolWorkItem* ClaimWorkItem(HANDLE threadhandle);
+		bool RunPendingWorkItem();
+
+	// Pool information
+	public:
+		unsigned GetNumThreads() const
+		{ return static_cast<unsigned>(Workers.size()); }
+
+		unsigned GetNumReservedThreads() const
+		{ return NumReservedWorkers; }
+
+	// Statistics
+	public:
+		struct Statistics
+		{
+			unsigned NumWorkers;
+			unsigned __int64 NumQueued;
+			unsigned __int64 NumClaimed;
+			unsigned __int64 NumStolen;
+			unsigned __int64 IdleTicks;
+			unsigned __int64 ClaimLatencyTicks;
+			unsigned __int64 MaxClaimLatencyTicks;
+		};
+
+		Statistics GetStatistics() const;
+
+	// Wrapper for tracking queued work items
+	public:
+		struct QueuedWorkItem
+		{
+			SLIST_ENTRY Entry;			// Must be first, for the inbox lists
+			PoolWorkItem* Item;
+			std::wstring Name;
+			WorkPriority Priority;
+			unsigned __int64 QueuedTimestamp;
+		};
+
+	// Counters of claimed work items, kept per worker thread
+	public:
+		struct ClaimCounters
+		{
+			ClaimCounters()
+				: NumClaimed(0),
+				  NumStolen(0),
+				  IdleTicks(0),
+				  ClaimLatencyTicks(0),
+				  MaxClaimLatencyTicks(0)
+			{ }
+
+			unsigned __int64 NumClaimed;
+			unsigned __int64 NumStolen;
+			unsigned __int64 IdleTicks;
+			unsigned __int64 ClaimLatencyTicks;
+			unsigned __int64 MaxClaimLatencyTicks;
+		};
 
 	// Thread tracking helpers
 	public:
 		struct ThreadDetails
 		{
+			SLIST_HEADER Inbox[NumWorkPriorities];
+			WorkStealingDeque<QueuedWorkItem> LocalItems[NumWorkPriorities];
+			WorkPriority LowestPriority;
+
 			ThreadPool* OwningPool;
 			HANDLE ThreadHandle;
 			HANDLE ThreadWakeEvent;
+			volatile LONG Idle;
+			unsigned StealSeed;
 			Threads::ThreadInfo Info;
+			ClaimCounters Counters;
 		};
 
 		HANDLE GetShutdownEvent() const
 		{ return ShutdownEvent; }
 
+		bool IsShuttingDown() const
+		{ return ShuttingDown; }
+
+	// Interface for dispatching work items to the pool threads
+	public:
+		PoolWorkItem* ClaimWorkItem(ThreadDetails& worker);
+		void WaitForWork(ThreadDetails& worker);
+
 	// Internal helpers
 	private:
 		void Clean();
 
 		void ResumeAllThreads();
 
+		void Enqueue(QueuedWorkItem* item);
+		void DrainInbox(ThreadDetails& worker, WorkPriority priority);
+		QueuedWorkItem* StealWorkItem(ThreadDetails* thief, WorkPriority priority);
+		bool HasAvailableWork(WorkPriority lowestpriority) const;
+		void IdleUntilWorkArrives(ThreadDetails& worker);
+
+		static void CountClaim(ClaimCounters& counters, const QueuedWorkItem& item, bool stolen);
+
+		ThreadDetails* GetWorkerForThisThread();
+		ThreadDetails* ClaimIdleWorker(WorkPriority priority, bool& needswake);
+		void WakeIdleWorker(WorkPriority priority);
+		void LeaveIdleState(ThreadDetails& worker, LONG idlestate);
+
+		PoolWorkItem* ReleaseQueuedItem(QueuedWorkItem* item);
+
 	// Internal tracking
 	private:
-		typedef std::map<HANDLE, ThreadDetails*> ThreadDetailMap;
-		ThreadDetailMap Details;
+		std::vector<ThreadDetails*> Workers;
+		unsigned NumReservedWorkers;
+		volatile LONG NextInboxIndex;
+		volatile LONG NumIdleWorkers;
+		volatile LONG NumQueued;
+		volatile LONG NumPending[NumWorkPriorities];
 
-		typedef std::map<std::wstring, PoolWorkItem*> WorkItemMap;
-		WorkItemMap UnassignedWorkItems;
-		std::map<HANDLE, WorkItemMap> AssignedWorkItems;
+		ClaimCounters HelperCounters;
+		mutable CriticalSection HelperCritSec;
 
 		HANDLE ShutdownEvent;
+		volatile bool ShuttingDown;
 
-		CriticalSection WorkItemCritSec;
+		typedef std::map<std::wstring, unsigned> NamedItemMap;
+		NamedItemMap PendingNamedItems;
+		mutable CriticalSection NamedItemCritSec;
 	};
 
 }
@@ -4,31 +4,69 @@
 //
 // Platform-dependent threading wrappers
 //
-// Note that we use a fairly intricate system here to provide certain semantics
-// during data read and write operations. In particular, we store a map that
-// links thread names with their descriptor blocks (which contain information
-// necessary to perform communication with the thread, etc.). Since this map
-// is modified each time a thread starts or exits, it is protected by a mutex
-// in the thread start/stop functions, and a set of cooperative operations for
-// functions which need to read the map but will never write to it.
-//
-// Although we are effectively locking on access to the lookup map, there is
-// a system established to allow readers to examine the map without locking
-// against each other. In other words, anyone who simply wants to read from
-// the map can do so without locking, unless a thread start/stop operation is
-// pending, in which case the read must wait for the write to be completed.
-//
-// The message send and receive operations both read from the map but do not
-// write to it. Therefore, these operations are guarded by a Windows Event.
-// This event is signalled during normal operation, and set to a non-signalled
-// state when a thread start/stop is being performed. Therefore, the read
-// operations will wait until the start/stop is completed before executing.
-//
-// The second element is a simple counter which tracks how many readers are
-// currently examining the map. If this counter is greater than zero, any
-// thread writes are blocked until the counter reaches zero. Once this
-// occurs, the pending write thread is woken back up, and performs its task
-// as usual.
+// Each thread is registered under its name in a lookup table, which holds
+// the information needed to communicate with the thread. The table changes
+// whenever a thread starts or exits, but it is read far more often, since
+// every message send has to look up the receiving thread; the table is
+// therefore built for cheap reads, in the style of read-copy-update.
+//
+// The table is a fixed set of hash buckets, each of which holds a singly
+// linked list of entries. Readers walk the lists without taking any locks.
+// Writers are serialized by a critical section, and only ever modify a list
+// by swinging a single pointer, so readers see either the old or the new
+// state of the list, and never anything in between.
+//
+// Entries which have been unlinked cannot be freed straight away, since a
+// reader may still be looking at them. Instead, the writer waits out a grace
+// period, using a simple epoch scheme: readers announce themselves in the
+// reader count of the current epoch, and the writer flips the epoch and then
+// waits for the count of the previous epoch to drain. Once this happens, no
+// reader can still be holding a reference to the unlinked entry, nor to the
+// information block of the thread it described. The cost of reclamation is
+// thus borne by exiting threads, while senders only pay for a pair of
+// interlocked operations.
+//
+// Each registered thread is also given a task handle, which is what Epoch
+// programs use to refer to tasks. Handles are direct indices into a second
+// table, which maps them to the threads' information blocks; the slots of
+// this table never move, so handles are resolved without any searching and
+// without locks, using the same grace periods as the name lookup table. A
+// generation count is mixed into each handle, so that handles of threads
+// which have exited cannot be confused with later occupants of the slot.
+// Names are therefore only looked up when a message is sent by name.
+//
+// Several programs may run in the same process, each on threads of its
+// own. Every thread belongs to the program it was forked by, and thread
+// names are scoped to that program: independent programs may use the same
+// task names without clashing, and messages sent by name only ever reach
+// tasks of the sender's program. The VM only waits for the threads of the
+// program being run. Host threads which are not forked by the VM join the
+// threading environment the first time a program is bound to them, and
+// leave it when they exit; see BindProgramToThisThread.
+//
+// Tasks may also be run as green tasks, which do not get an OS thread of
+// their own. Each green task is a fiber, which is run by the worker threads
+// of a thread pool; whenever the task waits for a message, its fiber is
+// parked and the worker thread goes back to running other work items. The
+// next message sent to the task queues a work item which resumes the fiber,
+// possibly on some other worker thread. The thread-local information block
+// is swapped whenever a worker switches into or out of a green task, so as
+// far as the rest of the code is concerned, each green task is its own
+// thread. Only waiting for messages parks a green task; any other blocking
+// operation holds on to the worker thread until it completes.
+//
+// Tasks which do get an OS thread of their own run on task host threads.
+// When a task ends, its host thread parks itself in a small cache, keeping
+// hold of the task's message event, mailbox and local heap; the next task
+// to be forked is handed to a parked thread along with those resources,
+// so forking a task usually costs no more than signaling an event. The
+// size of the cache is set by Config::TaskThreadCacheSize.
+//
+// Messages may also be sent with a delay, or repeatedly at a fixed period.
+// These are handed to the timer service (see TimerWheel.h), which delivers
+// them from its own thread when they come due; likewise, green tasks which
+// wait for a message with a timeout are woken by a timer, since they have
+// no thread of their own to wait on.
 //
 
 #include "pch.h"
@@ -36,11 +74,25 @@
 #include "Utility/Threading/Threads.h"
 #include "Utility/Threading/ThreadExceptions.h"
 #include "Utility/Threading/Synchronization.h"
+#include "Utility/Threading/ThreadPool.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/Tracing.h"
+#include "Utility/Threading/TimerWheel.h"
+#include "Utility/Threading/Coroutines.h"
+
+#include "Utility/Memory/ThreadLocalAllocator.h"
+#include "Utility/Memory/Stack.h"
 
 #include "Utility/Strings.h"
+#include "Utility/Hashing.h"
 
 #include "User Interface/Output.h"
 
+#include "Configuration/RuntimeOptions.h"
+#include "Configuration/AutoTuning.h"
+
+#include <malloc.h>
+
 
 using namespace Threads;
 
@@ -54,20 +106,267 @@ namespace
 {
 	CriticalSection ThreadManagementCriticalSection;
 
-	HANDLE ThreadStartStopGuard;
-	HANDLE ThreadAccessCounterIsZero;
-	unsigned ThreadAccessCounter;
 	DWORD TLSIndex;
 
-	std::map<std::wstring, ThreadInfo*> ThreadInfoTable;
+	// Fiber of each OS thread which has been converted to run green tasks
+	DWORD ThreadFiberTLSIndex;
+
+	// Information block of each host thread which has joined the threading environment
+	DWORD HostThreadTLSIndex;
+
+	// Number of threads (and green tasks) which have entered the threading
+	// environment and not yet exited, including the main thread
+	volatile LONG RunningThreadCount = 0;
+
+	//
+	// Entry in the thread lookup table
+	//
+	struct RegistryEntry
+	{
+		std::wstring Name;
+		const VM::Program* Owner;
+		ThreadInfo* Info;
+		RegistryEntry* volatile Next;
+	};
+
+	const size_t NumRegistryBuckets = 256;
+	RegistryEntry* volatile Registry[NumRegistryBuckets];
+
+	// Number of threads in the lookup table, including the main thread
+	volatile LONG NumRegisteredThreads = 0;
+
+	// Number of those threads which were not forked by the VM, including the main thread
+	volatile LONG NumHostThreads = 0;
+
+	//
+	// Slot in the task handle table
+	//
+	// Task handles are always odd, so that they can never be mistaken for
+	// the IDs of unregistered threads (such as pool workers), since Windows
+	// thread IDs are always multiples of 4.
+	//
+	struct TaskSlot
+	{
+		ThreadInfo* volatile Info;
+		DWORD Generation;
+	};
+
+	const unsigned TaskIndexBits = 20;
+	const DWORD TaskIndexMask = (1 << TaskIndexBits) - 1;
+	const DWORD TaskGenerationMask = 0xffffffff >> (TaskIndexBits + 1);
+
+	// Slots are allocated in chunks, which are never moved or freed
+	const size_t TaskSlotsPerChunk = 1024;
+	const size_t NumTaskChunks = (static_cast<size_t>(1) << TaskIndexBits) / TaskSlotsPerChunk;
+	TaskSlot* volatile TaskChunks[NumTaskChunks];
+
+	// These are protected by the thread management critical section
+	size_t NumTaskSlots = 0;
+	std::vector<size_t> FreeTaskSlots;
+
+	// Tracking for readers of the lookup tables; see the file comments
+	volatile LONG RegistryEpoch = 0;
+	volatile LONG RegistryReaders[2] = { 0, 0 };
+
+	//
+	// Number of threads belonging to each program
+	//
+	// Running threads include pool workers and host threads, while only
+	// forked tasks are registered.
+	//
+	struct ProgramThreadCounts
+	{
+		LONG Running;
+		LONG Registered;
+	};
+
+	CriticalSection ProgramThreadsCriticalSection;
+	std::map<const VM::Program*, ProgramThreadCounts> ProgramThreads;
+
+	//
+	// RAII wrapper for safely reading from the thread lookup table
+	//
+	// Entries found while the wrapper is alive (and the information blocks
+	// they refer to) remain valid until the wrapper is destroyed, or until
+	// the guard is temporarily released; anything found before a release
+	// must be looked up again afterwards.
+	//
+	class RegistryReadGuard
+	{
+	public:
+		RegistryReadGuard()
+		{
+			Acquire();
+		}
+
+		~RegistryReadGuard()
+		{
+			Release();
+		}
+
+		void Acquire()
+		{
+			while(true)
+			{
+				Epoch = RegistryEpoch;
+				::InterlockedIncrement(&RegistryReaders[Epoch]);
+
+				// If the epoch flipped in the meantime, the writer may not
+				// have seen us, so we have to announce ourselves again
+				if(RegistryEpoch == Epoch)
+					break;
+
+				::InterlockedDecrement(&RegistryReaders[Epoch]);
+			}
+
+			Held = true;
+		}
+
+		void Release()
+		{
+			if(Held)
+				::InterlockedDecrement(&RegistryReaders[Epoch]);
+			Held = false;
+		}
+
+	private:
+		LONG Epoch;
+		bool Held;
+	};
+
+	//
+	// Scheduling states of a green task
+	//
+	enum GreenTaskState
+	{
+		GreenTask_Running,				// Running on a worker thread, or queued to run
+		GreenTask_Parking,				// About to switch away to wait for a message
+		GreenTask_Parked,				// Waiting for a message, and not queued anywhere
+		GreenTask_Woken,				// A message or mailbox space arrived while the task was switching away
+		GreenTask_Blocking,				// About to switch away to wait for room in a full mailbox
+		GreenTask_Blocked,				// Waiting for room in a full mailbox, and not queued anywhere
+		GreenTask_Finished				// Done executing; the fiber can be released
+	};
+
+	//
+	// Work item for running a green task until it next parks or finishes
+	//
+	class ResumeGreenTaskWorkItem : public PoolWorkItem
+	{
+	public:
+		explicit ResumeGreenTaskWorkItem(ThreadInfo& task)
+			: Task(task)
+		{ }
+
+		virtual void PerformWork();
+
+	private:
+		ThreadInfo& Task;
+	};
+
+	//
+	// Pool of message headers
+	//
+	// Each send needs a fresh message header, which is typically freed
+	// by a different thread once the receiver is done with it. Headers are
+	// therefore carved out of slabs and recycled through a lock-free list,
+	// so a send costs a single pop from the list on top of the CAS which
+	// places the header in the receiving mailbox. The list grows by a whole
+	// slab whenever it runs dry; slabs are linked on a second lock-free
+	// list, and are only released when the thread manager shuts down.
+	//
+	// Statically zeroed list headers are valid empty lists.
+	//
+	const size_t MessageHeadersPerSlab = 256;
+	const size_t MessageHeaderStride = ((sizeof(MessageInfo) > sizeof(SLIST_ENTRY) ? sizeof(MessageInfo) : sizeof(SLIST_ENTRY)) + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(MEMORY_ALLOCATION_ALIGNMENT - 1);
+
+	SLIST_HEADER MessageHeaderPool;
+	SLIST_HEADER MessageHeaderSlabs;
+
+	//
+	// OS thread which runs forked tasks, one after another
+	//
+	// The message event, mailbox and local heap are only held here while
+	// the thread is parked between tasks; a running task owns them through
+	// its information block.
+	//
+	struct TaskThreadHost
+	{
+		HANDLE Thread;
+		HANDLE WakeEvent;
+
+		ThreadFuncPtr EntryPoint;			// NULL while parked, or once asked to exit
+		ThreadInfo* Task;
+
+		HANDLE MessageEvent;
+		HANDLE LocalHeapHandle;
+		LocklessMailbox<MessageInfo>* Mailbox;
+	};
+
+	// Host of each thread which is running tasks on behalf of the cache
+	DWORD TaskThreadHostTLSIndex;
+
+	CriticalSection TaskThreadCacheCriticalSection;
+	std::vector<TaskThreadHost*> ParkedTaskThreads;
+	bool TaskThreadCacheClosed = false;
 
 	// Internal helpers
 	void CleanupThisThread();
 	void WaitForThreadsToFinish();
 	void ClearThreadTracking();
+
+	ThreadInfo* CreateHostThreadInfo(const std::wstring& name);
+	void CountProgramThread(const VM::Program* program, LONG runningdelta, LONG registereddelta);
+	ProgramThreadCounts GetProgramThreadCounts(const VM::Program* program);
+
+	RegistryEntry* FindRegisteredThread(const std::wstring& name, const VM::Program* owner);
+	void RegisterThread(const std::wstring& name, ThreadInfo* info);
+	bool UnregisterThread(const ThreadInfo* info);
+	void WaitForRegistryReaders();
+
+	void AllocateTaskHandle(ThreadInfo* info);
+	void ReleaseTaskHandle(DWORD handle);
+	ThreadInfo* FindTask(TaskHandle handle);
+
+	PSLIST_ENTRY AllocateMessageHeaderSlab();
+	void FreeMessageHeaderSlabs();
+
+	LocklessMailbox<MessageInfo>* CreateMailbox();
+	void ReportMailboxOverflow(const LocklessMailbox<MessageInfo>& mailbox);
+
+	void StartTaskThread(const std::wstring& name, ThreadFuncPtr func, std::auto_ptr<ThreadInfo>& info);
+	DWORD __stdcall TaskThreadHostProc(void* param);
+	bool ParkTaskThread(TaskThreadHost& host);
+	bool HandBackTaskResources(ThreadInfo& info);
+	void ReleaseTaskThreadResources(TaskThreadHost& host);
+	void ReleaseParkedTaskThreads();
+	bool DeliverMessage(RegistryReadGuard& guard, ThreadInfo& target, MessageSignatureID signature, std::auto_ptr<HeapStorage>& storageblock, VM::Future* replyslot);
+	MailboxAddResult PlaceInMailbox(ThreadInfo& target, std::auto_ptr<MessageInfo>& msg);
+
+	void ReleaseFiberForThisThread();
+	void __stdcall GreenTaskFiberProc(void* info);
+	void WakeGreenTask(ThreadInfo& info);
+	void WakeWaitingGreenTask(ThreadInfo& info, LONG switchingstate, LONG waitingstate);
+	void ParkUntilMessageArrives(ThreadInfo& info);
+	void ParkUntilMailboxHasRoom(ThreadInfo& sender, ThreadInfo& receiver, RegistryReadGuard& guard);
+	void WakeBlockedSenders(ThreadInfo& receiver);
 }
 
 
+//
+// Scheduling details of a green task
+//
+struct Threads::GreenTaskInfo
+{
+	LPVOID Fiber;
+	LPVOID ReturnFiber;					// Fiber of the worker currently running the task
+	ThreadFuncPtr EntryPoint;
+	ThreadPool* Pool;
+	volatile LONG State;
+	ThreadInfo* NextBlockedSender;		// Next task waiting on the same receiver's mailbox
+};
+
+
 //-------------------------------------------------------------------------------
 // Thread functionality
 //-------------------------------------------------------------------------------
@@ -77,29 +376,31 @@ namespace
 //
 void Threads::Init()
 {
-	ThreadAccessCounter = 0;
-
 	TLSIndex = ::TlsAlloc();
 	if(TLSIndex == TLS_OUT_OF_INDEXES)
 		throw ThreadException("Failed to allocate thread-local storage");
 
-	ThreadAccessCounterIsZero = ::CreateEvent(NULL, true, true, NULL);
-	ThreadStartStopGuard = ::CreateEvent(NULL, true, true, NULL);
+	ThreadFiberTLSIndex = ::TlsAlloc();
+	if(ThreadFiberTLSIndex == TLS_OUT_OF_INDEXES)
+		throw ThreadException("Failed to allocate thread-local storage");
+
+	HostThreadTLSIndex = ::TlsAlloc();
+	if(HostThreadTLSIndex == TLS_OUT_OF_INDEXES)
+		throw ThreadException("Failed to allocate thread-local storage");
+
+	TaskThreadHostTLSIndex = ::TlsAlloc();
+	if(TaskThreadHostTLSIndex == TLS_OUT_OF_INDEXES)
+		throw ThreadException("Failed to allocate thread-local storage");
 
-	std::auto_ptr<ThreadInfo> threadinfo(new ThreadInfo);
-	threadinfo->CodeBlock = NULL;
-	threadinfo->HandleToSelf = ::GetCurrentThreadId();
-	threadinfo->TaskOrigin = 0;
-	threadinfo->MessageEvent = ::CreateEvent(NULL, false, false, NULL);
-	threadinfo->LocalHeapHandle = ::HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+	TaskThreadCacheClosed = false;
 
-	::TlsSetValue(TLSIndex, threadinfo.get());
+	ThreadLocalArena::Init();
+	StackSpace::Init();
+	Coroutine::Init();
 
-	// This must be set AFTER the TLS is set up, because the mailbox
-	// code will attempt to use the general use memory pool.
-	threadinfo->Mailbox = new LocklessMailbox<MessageInfo>(NULL);
+	::InterlockedExchange(&RunningThreadCount, 1);
 
-	ThreadInfoTable.insert(std::make_pair(L"@main-thread", threadinfo.release()));
+	CreateHostThreadInfo(L"@main-thread");
 }
 
 
@@ -109,12 +410,21 @@ void Threads::Init()
 void Threads::Shutdown()
 {
 	WaitForThreadsToFinish();
+	Timers::Shutdown();
+	ReleaseParkedTaskThreads();
 
 	CleanupThisThread();
 	ClearThreadTracking();
-	::CloseHandle(ThreadStartStopGuard);
-	::CloseHandle(ThreadAccessCounterIsZero);
+	::TlsFree(TaskThreadHostTLSIndex);
+	::TlsFree(HostThreadTLSIndex);
+	::TlsFree(ThreadFiberTLSIndex);
 	::TlsFree(TLSIndex);
+
+	HeapStorage::FreeAllPooled();
+	FreeMessageHeaderSlabs();
+	ThreadLocalArena::Shutdown();
+	StackSpace::Shutdown();
+	Coroutine::Shutdown();
 }
 
 
@@ -124,36 +434,21 @@ void Threads::Shutdown()
 void Threads::Create(const std::wstring& name, ThreadFuncPtr func, VM::Block* codeblock, VM::Program* runningprogram)
 {
 	CriticalSection::Auto mutex(ThreadManagementCriticalSection);
-	::WaitForSingleObject(ThreadAccessCounterIsZero, INFINITE);
-
-	struct safety
-	{
-		safety()		{ ::ResetEvent(ThreadStartStopGuard); }
-		~safety()		{ ::SetEvent(ThreadStartStopGuard); }
-	} safetywrapper;
 
-	std::map<std::wstring, ThreadInfo*>::const_iterator iter = ThreadInfoTable.find(name);
-	if(iter != ThreadInfoTable.end())
+	if(FindRegisteredThread(name, runningprogram))
 		throw ThreadException("Cannot fork a task with this name - name is already in use!");
 
 	std::auto_ptr<ThreadInfo> info(new ThreadInfo);
 
 	info->CodeBlock = codeblock;
-	info->MessageEvent = ::CreateEvent(NULL, false, false, NULL);
+	info->WaitingForMessage = 0;
 	info->TaskOrigin = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->HandleToSelf;
 	info->BoundFuture = NULL;
 	info->RunningProgram = runningprogram;
+	info->GreenTask = NULL;
+	info->BlockedSenders = NULL;
 
-	ThreadInfoTable[name] = info.get();
-
-	HANDLE newthread = ::CreateThread(NULL, 0, func, info.get(), CREATE_SUSPENDED, &info->HandleToSelf);
-
-	std::auto_ptr<LocklessMailbox<MessageInfo> > mailbox(new LocklessMailbox<MessageInfo>(newthread));
-	info->Mailbox = mailbox.get();
-
-	info.release();
-	mailbox.release();
-	::ResumeThread(newthread);
+	StartTaskThread(name, func, info);
 }
 
 //
@@ -165,46 +460,105 @@ void Threads::Create(const std::wstring& name, ThreadFuncPtr func, VM::Block* co
 void Threads::Create(const std::wstring& name, ThreadFuncPtr func, VM::Future* boundfuture, VM::Operation* op, VM::Program* runningprogram)
 {
 	CriticalSection::Auto mutex(ThreadManagementCriticalSection);
-	::WaitForSingleObject(ThreadAccessCounterIsZero, INFINITE);
-
-	struct safety
-	{
-		safety()		{ ::ResetEvent(ThreadStartStopGuard); }
-		~safety()		{ ::SetEvent(ThreadStartStopGuard); }
-	} safetywrapper;
 
-	std::map<std::wstring, ThreadInfo*>::const_iterator iter = ThreadInfoTable.find(name);
-	if(iter != ThreadInfoTable.end())
+	if(FindRegisteredThread(name, runningprogram))
 		throw ThreadException("Cannot fork a task with this name - name is already in use!");
 
 	std::auto_ptr<ThreadInfo> info(new ThreadInfo);
 
 	info->OpPointer = op;
-	info->MessageEvent = ::CreateEvent(NULL, false, false, NULL);
+	info->WaitingForMessage = 0;
 	info->TaskOrigin = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->HandleToSelf;
 	info->BoundFuture = boundfuture;
 	info->RunningProgram = runningprogram;
+	info->GreenTask = NULL;
+	info->BlockedSenders = NULL;
 
-	ThreadInfoTable[name] = info.get();
+	StartTaskThread(name, func, info);
+}
 
-	HANDLE newthread = ::CreateThread(NULL, 0, func, info.get(), CREATE_SUSPENDED, &info->HandleToSelf);
+//
+// Create a new green task, executing the specified function
+//
+// The task runs on the worker threads of the given pool, rather than on
+// a thread of its own; the function is invoked exactly as it would be
+// for a dedicated thread, and must use Enter and Exit in the same way.
+//
+void Threads::CreateGreenTask(const std::wstring& name, ThreadFuncPtr func, VM::Block* codeblock, VM::Program* runningprogram, ThreadPool& pool)
+{
+	ThreadInfo* newtask;
 
-	std::auto_ptr<LocklessMailbox<MessageInfo> > mailbox(new LocklessMailbox<MessageInfo>(newthread));
-	info->Mailbox = mailbox.get();
+	{
+		CriticalSection::Auto mutex(ThreadManagementCriticalSection);
+
+		if(FindRegisteredThread(name, runningprogram))
+			throw ThreadException("Cannot fork a task with this name - name is already in use!");
+
+		std::auto_ptr<ThreadInfo> info(new ThreadInfo);
+
+		info->CodeBlock = codeblock;
+		info->MessageEvent = NULL;
+		info->WaitingForMessage = 0;
+		info->LocalHeapHandle = NULL;
+		info->TaskOrigin = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->HandleToSelf;
+		info->BoundFuture = NULL;
+		info->RunningProgram = runningprogram;
+		info->BlockedSenders = NULL;
+
+		std::auto_ptr<LocklessMailbox<MessageInfo> > mailbox(CreateMailbox());
+		info->Mailbox = mailbox.get();
+
+		std::auto_ptr<GreenTaskInfo> greentask(new GreenTaskInfo);
+		greentask->EntryPoint = func;
+		greentask->Pool = &pool;
+		greentask->ReturnFiber = NULL;
+		greentask->State = GreenTask_Running;
+		greentask->NextBlockedSender = NULL;
+		greentask->Fiber = ::CreateFiberEx(0, Config::GreenTaskStackSize, FIBER_FLAG_FLOAT_SWITCH, GreenTaskFiberProc, info.get());
+		if(!greentask->Fiber)
+			throw ThreadException("Failed to create a fiber for a green task!");
+
+		info->GreenTask = greentask.get();
+
+		RegisterThread(name, info.get());
+
+		newtask = info.release();
+		greentask.release();
+		mailbox.release();
+	}
 
-	info.release();
-	mailbox.release();
-	::ResumeThread(newthread);
+	pool.AddWorkItem(new ResumeGreenTaskWorkItem(*newtask));
 }
 
 //
 // Initialize a thread environment.
 // All forked threads MUST call this function before executing
 //
+// Green tasks make use of the memory caches belonging to whichever
+// worker thread is running them, so they do not set up their own.
+//
 void Threads::Enter(void* info)
 {
+	ThreadInfo* threadinfo = static_cast<ThreadInfo*>(info);
+
 	::TlsSetValue(TLSIndex, info);
-	static_cast<ThreadInfo*>(info)->LocalHeapHandle = ::HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+
+	// Threads taken from the task thread cache bring their heap along
+	if(!threadinfo->LocalHeapHandle)
+		threadinfo->LocalHeapHandle = ::HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+
+	if(!threadinfo->GreenTask)
+	{
+		ThreadLocalArena::AttachToThisThread();
+		StackSpace::AttachCacheToThisThread();
+	}
+
+	::InterlockedIncrement(&RunningThreadCount);
+	CountProgramThread(threadinfo->RunningProgram, 1, 0);
+
+	// Pool worker threads are not tasks, and have no mailbox
+	if(threadinfo->Mailbox)
+		Tracing::RecordTaskBegin(threadinfo->HandleToSelf);
 }
 
 //
@@ -213,15 +567,73 @@ void Threads::Enter(void* info)
 //
 void Threads::Exit()
 {
-	CriticalSection::Auto mutex(ThreadManagementCriticalSection);
+	const VM::Program* program = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->RunningProgram;
+
+	CleanupThisThread();
+
+	::InterlockedDecrement(&RunningThreadCount);
+	CountProgramThread(program, -1, 0);
+}
+
+
+//
+// Bind a program to the calling thread, returning the program previously bound
+//
+// Pooled data is resolved against the bound program, and tasks forked by
+// the thread belong to it; see also ProgramBinding. A host thread which
+// has not yet joined the threading environment is set up on the spot, and
+// is cleaned up again by DetachHostThread once it exits.
+//
+VM::Program* Threads::BindProgramToThisThread(VM::Program* program)
+{
+	ThreadInfo* info = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+	if(!info && !program)
+		return NULL;
+
+	if(!info)
+	{
+		std::wostringstream name;
+		name << L"@host-thread-" << ::GetCurrentThreadId();
+
+		info = CreateHostThreadInfo(name.str());
+		::TlsSetValue(HostThreadTLSIndex, info);
+
+		StackSpace::AttachCacheToThisThread();
+		::InterlockedIncrement(&RunningThreadCount);
+	}
 
-	struct safety
+	VM::Program* previous = info->RunningProgram;
+	if(previous != program)
 	{
-		safety()		{ ::ResetEvent(ThreadStartStopGuard); }
-		~safety()		{ ::SetEvent(ThreadStartStopGuard); }
-	} safetywrapper;
+		CountProgramThread(previous, -1, 0);
+		CountProgramThread(program, 1, 0);
+		info->RunningProgram = program;
+	}
+
+	return previous;
+}
+
+//
+// Clean up after a host thread which joined the threading environment
+//
+// This is called whenever a thread exits; threads which never had a
+// program bound to them are left alone.
+//
+void Threads::DetachHostThread()
+{
+	ThreadInfo* info = reinterpret_cast<ThreadInfo*>(::TlsGetValue(HostThreadTLSIndex));
+	if(!info)
+		return;
+
+	CountProgramThread(info->RunningProgram, -1, 0);
 
+	::TlsSetValue(TLSIndex, info);
 	CleanupThisThread();
+	::InterlockedDecrement(&NumHostThreads);
+
+	::TlsSetValue(TLSIndex, NULL);
+	::TlsSetValue(HostThreadTLSIndex, NULL);
+	::InterlockedDecrement(&RunningThreadCount);
 }
 
 
@@ -229,142 +641,1413 @@ namespace
 {
 
 	//
-	// Free resources used to track this thread's information
+	// Set up the information block of a thread which was not forked by the VM
 	//
-	void CleanupThisThread()
+	// The block is attached to the calling thread, and registered under
+	// the given name; no program is bound to it yet.
+	//
+	ThreadInfo* CreateHostThreadInfo(const std::wstring& name)
 	{
-		for(std::map<std::wstring, ThreadInfo*>::iterator iter = ThreadInfoTable.begin(); iter != ThreadInfoTable.end(); )
-		{
-			if(iter->second->HandleToSelf == ::GetCurrentThreadId())
-			{
-				delete iter->second->Mailbox;
-				::HeapDestroy(iter->second->LocalHeapHandle);
-				::CloseHandle(iter->second->MessageEvent);
-				delete iter->second;
-				iter = ThreadInfoTable.erase(iter);
-			}
-			else
-				++iter;
-		}
+		std::auto_ptr<ThreadInfo> threadinfo(new ThreadInfo);
+		threadinfo->CodeBlock = NULL;
+		threadinfo->BoundFuture = NULL;
+		threadinfo->RunningProgram = NULL;
+		threadinfo->TaskOrigin = 0;
+		threadinfo->MessageEvent = ::CreateEvent(NULL, false, false, NULL);
+		threadinfo->WaitingForMessage = 0;
+		threadinfo->LocalHeapHandle = ::HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+		threadinfo->GreenTask = NULL;
+		threadinfo->BlockedSenders = NULL;
+
+		::TlsSetValue(TLSIndex, threadinfo.get());
+		ThreadLocalArena::AttachToThisThread();
+
+		// This must be set AFTER the TLS is set up, because the mailbox
+		// code will attempt to use the general use memory pool.
+		threadinfo->Mailbox = CreateMailbox();
+
+		RegisterThread(name, threadinfo.get());
+		::InterlockedIncrement(&NumHostThreads);
+		return threadinfo.release();
 	}
 
-}
+	//
+	// Adjust the number of threads belonging to a program
+	//
+	// Threads which are not running any program are not counted.
+	//
+	void CountProgramThread(const VM::Program* program, LONG runningdelta, LONG registereddelta)
+	{
+		if(!program)
+			return;
 
+		CriticalSection::Auto mutex(ProgramThreadsCriticalSection);
 
-//
-// Send a message to another thread
-//
-void Threads::SendEvent(const std::wstring& threadname, const std::wstring& eventname, const std::list<VM::EpochVariableTypeID>& payloadtypes, HeapStorage* storageblock)
-{
-	SyncCounter sync(&ThreadAccessCounter, ThreadAccessCounterIsZero);
-	::WaitForSingleObject(ThreadStartStopGuard, INFINITE);
+		std::map<const VM::Program*, ProgramThreadCounts>::iterator iter = ProgramThreads.find(program);
+		if(iter == ProgramThreads.end())
+		{
+			ProgramThreadCounts counts = { 0, 0 };
+			iter = ProgramThreads.insert(std::make_pair(program, counts)).first;
+		}
 
-	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+		iter->second.Running += runningdelta;
+		iter->second.Registered += registereddelta;
 
-	std::auto_ptr<MessageInfo> msg(new MessageInfo);
-	msg->MessageName = eventname;
-	msg->PayloadTypes = payloadtypes;
-	msg->StorageBlock = storageblock;
-	msg->Origin = ::GetCurrentThreadId();
+		if(!iter->second.Running && !iter->second.Registered)
+			ProgramThreads.erase(iter);
+	}
 
-	std::map<std::wstring, ThreadInfo*>::const_iterator iter = ThreadInfoTable.find(threadname);
-	if(iter == ThreadInfoTable.end())
+	//
+	// Retrieve the number of threads belonging to a program
+	//
+	ProgramThreadCounts GetProgramThreadCounts(const VM::Program* program)
 	{
-		UI::OutputStream output;
-		output << UI::lightred;
-		output << L"WARNING - failed to send message \"" << eventname << L"\" to task \"" << threadname;
-		output << L"\"\nHas the task already exited?" << std::endl;
-		output << UI::resetcolor;
-		return;
+		CriticalSection::Auto mutex(ProgramThreadsCriticalSection);
+
+		std::map<const VM::Program*, ProgramThreadCounts>::const_iterator iter = ProgramThreads.find(program);
+		if(iter == ProgramThreads.end())
+		{
+			ProgramThreadCounts counts = { 0, 0 };
+			return counts;
+		}
+
+		return iter->second;
 	}
 
-	iter->second->Mailbox->AddMessage(msg.release());
-	::SetEvent(iter->second->MessageEvent);
-	storageblockwrapper.release();
-}
+	//
+	// Free resources used to track this thread's information
+	//
+	// The information block of a green task is still needed by the worker
+	// thread once the task has switched away for the last time, so it is
+	// released by ResumeGreenTask rather than here.
+	//
+	void CleanupThisThread()
+	{
+		ThreadInfo* thisthread = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+		bool isgreentask = (thisthread->GreenTask != NULL);
 
+		if(thisthread->Mailbox)
+			Tracing::RecordTaskEnd(thisthread->HandleToSelf);
 
-//
-// Suspend the thread until a new message arrives
-//
-MessageInfo* Threads::WaitForEvent()
-{
-	LocklessMailbox<MessageInfo>* mailbox;
+		if(!isgreentask)
+		{
+			ThreadLocalArena::DetachFromThisThread();
+			StackSpace::DetachCacheFromThisThread();
+			ReleaseFiberForThisThread();
+		}
 
-	{
-		SyncCounter sync(&ThreadAccessCounter, ThreadAccessCounterIsZero);
-		::WaitForSingleObject(ThreadStartStopGuard, INFINITE);
+		// Pool worker threads are never registered, and own nothing to clean up
+		if(!UnregisterThread(thisthread))
+			return;
 
-		mailbox = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->Mailbox;
+		// Senders still waiting for room will find the task gone when they retry
+		WakeBlockedSenders(*thisthread);
 
-		MessageInfo* mail = mailbox->GetMessage();
-		if(mail)
-			return mail;
+		ReportMailboxOverflow(*thisthread->Mailbox);
+		Telemetry::RecordRetiredMailbox(thisthread->Mailbox->GetStatistics());
+		Config::AutoTuning::RecordMailboxUsage(thisthread->Mailbox->GetStatistics());
+
+		if(isgreentask || !HandBackTaskResources(*thisthread))
+		{
+			delete thisthread->Mailbox;
+			::HeapDestroy(thisthread->LocalHeapHandle);
+			if(thisthread->MessageEvent)
+				::CloseHandle(thisthread->MessageEvent);
+		}
+
+		if(!isgreentask)
+			delete thisthread;
 	}
 
-	::WaitForSingleObject(reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex))->MessageEvent, INFINITE);
-	return mailbox->GetMessage();
-}
 
-namespace
-{
+	//
+	// Start a newly forked task on an OS thread of its own
+	//
+	// A parked thread is taken from the cache if one is available, and
+	// the resources it kept from its last task are handed to the new one.
+	// Otherwise a fresh host thread is created, with fresh resources.
+	//
+	// Senders may find the task as soon as it is registered, so this must
+	// wait until the mailbox has been set up. The caller must hold the
+	// thread management critical section.
+	//
+	void StartTaskThread(const std::wstring& name, ThreadFuncPtr func, std::auto_ptr<ThreadInfo>& info)
+	{
+		TaskThreadHost* parkedhost = NULL;
+		{
+			CriticalSection::Auto mutex(TaskThreadCacheCriticalSection);
+			if(!ParkedTaskThreads.empty())
+			{
+				parkedhost = ParkedTaskThreads.back();
+				ParkedTaskThreads.pop_back();
+			}
+		}
+
+		if(parkedhost)
+		{
+			info->MessageEvent = parkedhost->MessageEvent;
+			info->LocalHeapHandle = parkedhost->LocalHeapHandle;
+			info->Mailbox = parkedhost->Mailbox;
+			parkedhost->MessageEvent = NULL;
+			parkedhost->LocalHeapHandle = NULL;
+			parkedhost->Mailbox = NULL;
+
+			// Senders to the previous task may have signaled the event on their way out
+			::ResetEvent(info->MessageEvent);
+
+			RegisterThread(name, info.get());
+
+			parkedhost->EntryPoint = func;
+			parkedhost->Task = info.release();
+			::SetEvent(parkedhost->WakeEvent);
+			return;
+		}
+
+		std::auto_ptr<TaskThreadHost> host(new TaskThreadHost);
+		host->EntryPoint = func;
+		host->Task = info.get();
+		host->MessageEvent = NULL;
+		host->LocalHeapHandle = NULL;
+		host->Mailbox = NULL;
+		host->WakeEvent = ::CreateEvent(NULL, false, false, NULL);
+
+		DWORD threadid;
+		host->Thread = ::CreateThread(NULL, 0, TaskThreadHostProc, host.get(), CREATE_SUSPENDED, &threadid);
+		if(!host->Thread)
+		{
+			::CloseHandle(host->WakeEvent);
+			throw ThreadException("Failed to create a thread for the task!");
+		}
+
+		info->MessageEvent = ::CreateEvent(NULL, false, false, NULL);
+		info->LocalHeapHandle = NULL;
+
+		std::auto_ptr<LocklessMailbox<MessageInfo> > mailbox(CreateMailbox());
+		info->Mailbox = mailbox.get();
+
+		RegisterThread(name, info.get());
+
+		info.release();
+		mailbox.release();
+		::ResumeThread(host.release()->Thread);
+	}
 
 	//
-	// Clean up all thread tracking
+	// Entry point of task host threads
 	//
-	void ClearThreadTracking()
+	// Each task is run to completion, after which the thread tries to park
+	// itself in the cache until it is handed another task. Threads which
+	// find the cache full simply exit, releasing the task's resources.
+	//
+	DWORD __stdcall TaskThreadHostProc(void* param)
 	{
-		for(std::map<std::wstring, ThreadInfo*>::iterator iter = ThreadInfoTable.begin(); iter != ThreadInfoTable.end(); ++iter)
+		TaskThreadHost* host = reinterpret_cast<TaskThreadHost*>(param);
+		::TlsSetValue(TaskThreadHostTLSIndex, host);
+
+		bool parked = false;
+		while(host->EntryPoint)
 		{
-			::HeapDestroy(iter->second->LocalHeapHandle);
-			::CloseHandle(iter->second->MessageEvent);
-			delete iter->second->Mailbox;
-			delete iter->second;
+			host->EntryPoint(host->Task);
+			host->Task = NULL;
+
+			parked = ParkTaskThread(*host);
+			if(!parked)
+				break;
+
+			::WaitForSingleObject(host->WakeEvent, INFINITE);
 		}
 
-		ThreadInfoTable.clear();
+		ReleaseTaskThreadResources(*host);
+		::CloseHandle(host->WakeEvent);
+
+		// Threads which were parked when the cache was closed are waited
+		// for by ReleaseParkedTaskThreads, which closes their handles
+		if(!parked)
+			::CloseHandle(host->Thread);
+
+		::TlsSetValue(TaskThreadHostTLSIndex, NULL);
+		delete host;
+		return 0;
 	}
 
-}
+	//
+	// Place a host thread in the cache once its task has ended
+	//
+	// Returns false if the thread should exit instead.
+	//
+	bool ParkTaskThread(TaskThreadHost& host)
+	{
+		// The task may have ended before its resources were handed back
+		if(!host.Mailbox)
+			return false;
 
+		host.Mailbox->Reset();
 
-//
-// Look up a thread's name given its ID number.
-// This has to do a little bit of magic to avoid searching the
-// name map without introducing synchronization problems.
-// See the header comments of this file for details.
-//
-std::wstring Threads::GetThreadNameGivenID(unsigned id)
-{
-	SyncCounter sync(&ThreadAccessCounter, ThreadAccessCounterIsZero);
-	::WaitForSingleObject(ThreadStartStopGuard, INFINITE);
+		CriticalSection::Auto mutex(TaskThreadCacheCriticalSection);
+
+		if(TaskThreadCacheClosed || ParkedTaskThreads.size() >= Config::TaskThreadCacheSize)
+			return false;
+
+		host.EntryPoint = NULL;
+		ParkedTaskThreads.push_back(&host);
+		return true;
+	}
 
-	for(std::map<std::wstring, ThreadInfo*>::iterator iter = ThreadInfoTable.begin(); iter != ThreadInfoTable.end(); ++iter)
+	//
+	// Give the resources of a finished task back to the host thread which ran it
+	//
+	// Returns false if the task was not run by a host thread, in which
+	// case the caller must release the resources itself. The task must
+	// already be unregistered, so that no senders can reach its mailbox.
+	//
+	bool HandBackTaskResources(ThreadInfo& info)
 	{
-		if(iter->second->HandleToSelf == id)
-			return iter->first;
+		TaskThreadHost* host = reinterpret_cast<TaskThreadHost*>(::TlsGetValue(TaskThreadHostTLSIndex));
+		if(!host || host->Task != &info)
+			return false;
+
+		host->MessageEvent = info.MessageEvent;
+		host->LocalHeapHandle = info.LocalHeapHandle;
+		host->Mailbox = info.Mailbox;
+		return true;
 	}
 
-	throw ThreadException("Could not locate any task with the given ID; has it already finished execution?");
-}
+	//
+	// Free the resources a host thread kept from its last task, if any
+	//
+	void ReleaseTaskThreadResources(TaskThreadHost& host)
+	{
+		delete host.Mailbox;
+		host.Mailbox = NULL;
 
+		if(host.LocalHeapHandle)
+			::HeapDestroy(host.LocalHeapHandle);
+		host.LocalHeapHandle = NULL;
 
-//
-// Sit around until all threads exit. Mainly useful
-// for when the VM shuts down and we need to let
-// things terminate gracefully.
-//
-void Threads::WaitForThreadsToFinish()
-{
-	while(ThreadInfoTable.size() > 1)		// The main thread will remain registered, so we count down to 1 instead of 0
-	{
-		::Sleep(100);
+		if(host.MessageEvent)
+			::CloseHandle(host.MessageEvent);
+		host.MessageEvent = NULL;
 	}
-}
 
-//
-// Retrieve the thread's information block from thread-local storage
-//
+	//
+	// Close the task thread cache, and wait for all parked threads to exit
+	//
+	void ReleaseParkedTaskThreads()
+	{
+		std::vector<TaskThreadHost*> parked;
+		{
+			CriticalSection::Auto mutex(TaskThreadCacheCriticalSection);
+			TaskThreadCacheClosed = true;
+			parked.swap(ParkedTaskThreads);
+		}
+
+		for(std::vector<TaskThreadHost*>::iterator iter = parked.begin(); iter != parked.end(); ++iter)
+		{
+			// The host deletes itself once woken without a task, so the handle is kept aside
+			HANDLE thread = (*iter)->Thread;
+			::SetEvent((*iter)->WakeEvent);
+			::WaitForSingleObject(thread, INFINITE);
+			::CloseHandle(thread);
+		}
+	}
+
+
+	//
+	// Select the lookup table bucket for the given thread name
+	//
+	size_t GetRegistryBucket(const std::wstring& name)
+	{
+		return Hashing::HashString32(Hashing::FNV32OffsetBasis, name) % NumRegistryBuckets;
+	}
+
+	//
+	// Find the lookup table entry of the given program's thread with the given name
+	//
+	// Callers must either hold a registry read guard, or be holding the
+	// thread management critical section. Returns NULL if no thread with
+	// the given name is registered for the program.
+	//
+	RegistryEntry* FindRegisteredThread(const std::wstring& name, const VM::Program* owner)
+	{
+		for(RegistryEntry* entry = Registry[GetRegistryBucket(name)]; entry; entry = entry->Next)
+		{
+			if(entry->Owner == owner && entry->Name == name)
+				return entry;
+		}
+
+		return NULL;
+	}
+
+	//
+	// Add a thread to the lookup tables, and assign its task handle
+	//
+	// The entry is fully set up before it is linked in, so readers can
+	// never encounter a partially constructed entry.
+	//
+	void RegisterThread(const std::wstring& name, ThreadInfo* info)
+	{
+		CriticalSection::Auto mutex(ThreadManagementCriticalSection);
+
+		AllocateTaskHandle(info);
+
+		size_t bucket = GetRegistryBucket(name);
+
+		std::auto_ptr<RegistryEntry> entry(new RegistryEntry);
+		entry->Name = name;
+		entry->Owner = info->RunningProgram;
+		entry->Info = info;
+		entry->Next = Registry[bucket];
+
+		::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&Registry[bucket]), entry.release());
+		::InterlockedIncrement(&NumRegisteredThreads);
+		CountProgramThread(info->RunningProgram, 0, 1);
+
+		Tracing::NameTask(info->HandleToSelf, name);
+		Tracing::RecordInstant("Fork task", info->HandleToSelf);
+	}
+
+	//
+	// Remove a thread from the lookup table
+	//
+	// Once this returns, no readers can still be using the entry or the
+	// thread's information block. Returns false if the thread was not
+	// registered in the first place.
+	//
+	bool UnregisterThread(const ThreadInfo* info)
+	{
+		CriticalSection::Auto mutex(ThreadManagementCriticalSection);
+
+		for(size_t bucket = 0; bucket < NumRegistryBuckets; ++bucket)
+		{
+			for(RegistryEntry* volatile* link = &Registry[bucket]; *link; link = &(*link)->Next)
+			{
+				RegistryEntry* entry = *link;
+				if(entry->Info != info)
+					continue;
+
+				// Readers currently on this entry can still follow its next
+				// pointer, which is left intact until the entry is freed
+				::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(link), entry->Next);
+				::InterlockedDecrement(&NumRegisteredThreads);
+				CountProgramThread(entry->Owner, 0, -1);
+				ReleaseTaskHandle(info->HandleToSelf);
+
+				WaitForRegistryReaders();
+				delete entry;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//
+	// Wait until all readers which may have seen the lookup table before the
+	// most recent change are finished with it
+	//
+	// Must be called with the thread management critical section held.
+	//
+	void WaitForRegistryReaders()
+	{
+		LONG previousepoch = RegistryEpoch;
+		::InterlockedExchange(&RegistryEpoch, 1 - previousepoch);
+
+		while(RegistryReaders[previousepoch] > 0)
+			::SwitchToThread();
+	}
+
+
+	//
+	// Retrieve the given slot of the task handle table, allocating its chunk
+	// if necessary; readers should use FindTask instead
+	//
+	// Must be called with the thread management critical section held.
+	//
+	TaskSlot& GetTaskSlot(size_t index)
+	{
+		TaskSlot* volatile& chunk = TaskChunks[index / TaskSlotsPerChunk];
+		if(!chunk)
+		{
+			TaskSlot* newchunk = new TaskSlot[TaskSlotsPerChunk];
+			for(size_t i = 0; i < TaskSlotsPerChunk; ++i)
+			{
+				newchunk[i].Info = NULL;
+				newchunk[i].Generation = 1;
+			}
+
+			::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&chunk), newchunk);
+		}
+
+		return chunk[index % TaskSlotsPerChunk];
+	}
+
+	//
+	// Give a thread a task handle, and make the handle resolvable
+	//
+	// Must be called with the thread management critical section held.
+	//
+	void AllocateTaskHandle(ThreadInfo* info)
+	{
+		size_t index;
+		if(FreeTaskSlots.empty())
+		{
+			if(NumTaskSlots > TaskIndexMask)
+				throw ThreadException("Too many tasks are running at once!");
+
+			index = NumTaskSlots++;
+		}
+		else
+		{
+			index = FreeTaskSlots.back();
+			FreeTaskSlots.pop_back();
+		}
+
+		TaskSlot& slot = GetTaskSlot(index);
+		info->HandleToSelf = (((slot.Generation << TaskIndexBits) | static_cast<DWORD>(index)) << 1) | 1;
+		::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&slot.Info), info);
+	}
+
+	//
+	// Stop a task handle from resolving, and recycle its slot
+	//
+	// The slot is not reused until a later registration, which always
+	// happens after a grace period has elapsed for the current removal.
+	// Must be called with the thread management critical section held.
+	//
+	void ReleaseTaskHandle(DWORD handle)
+	{
+		size_t index = (handle >> 1) & TaskIndexMask;
+
+		TaskSlot& slot = GetTaskSlot(index);
+		::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&slot.Info), NULL);
+
+		slot.Generation = (slot.Generation + 1) & TaskGenerationMask;
+		if(!slot.Generation)
+			slot.Generation = 1;
+
+		FreeTaskSlots.push_back(index);
+	}
+
+	//
+	// Resolve a task handle into the information block of its thread
+	//
+	// Callers must hold a registry read guard. Returns NULL if the handle
+	// does not refer to a running task.
+	//
+	ThreadInfo* FindTask(TaskHandle handle)
+	{
+		if(!(handle & 1))
+			return NULL;
+
+		size_t index = static_cast<size_t>(handle >> 1) & TaskIndexMask;
+		TaskSlot* chunk = TaskChunks[index / TaskSlotsPerChunk];
+		if(!chunk)
+			return NULL;
+
+		ThreadInfo* info = chunk[index % TaskSlotsPerChunk].Info;
+		if(!info || info->HandleToSelf != handle)
+			return NULL;
+
+		return info;
+	}
+
+
+	//
+	// Convert the calling thread back from a fiber, if it was converted
+	//
+	void ReleaseFiberForThisThread()
+	{
+		if(!::TlsGetValue(ThreadFiberTLSIndex))
+			return;
+
+		::ConvertFiberToThread();
+		::TlsSetValue(ThreadFiberTLSIndex, NULL);
+	}
+
+
+	//
+	// Run a green task on the calling thread until it parks or finishes
+	//
+	// Note that as soon as the task is marked as parked, a sender may queue
+	// it up to be resumed elsewhere, so the task must not be touched again.
+	//
+	void ResumeGreenTask(ThreadInfo& task)
+	{
+		GreenTaskInfo& greentask = *task.GreenTask;
+
+		ThreadInfo* previousinfo = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+		greentask.ReturnFiber = GetFiberForThisThread();
+
+		::TlsSetValue(TLSIndex, &task);
+		::SwitchToFiber(greentask.Fiber);
+		::TlsSetValue(TLSIndex, previousinfo);
+
+		if(greentask.State == GreenTask_Finished)
+		{
+			::DeleteFiber(greentask.Fiber);
+			delete &greentask;
+			delete &task;
+			return;
+		}
+
+		if(::InterlockedCompareExchange(&greentask.State, GreenTask_Parked, GreenTask_Parking) == GreenTask_Parking)
+			return;
+
+		if(::InterlockedCompareExchange(&greentask.State, GreenTask_Blocked, GreenTask_Blocking) == GreenTask_Blocking)
+			return;
+
+		// The task was woken before it finished switching away
+		::InterlockedExchange(&greentask.State, GreenTask_Running);
+		greentask.Pool->AddWorkItem(new ResumeGreenTaskWorkItem(task));
+	}
+
+	void ResumeGreenTaskWorkItem::PerformWork()
+	{
+		ResumeGreenTask(Task);
+	}
+
+	//
+	// Entry point stub for green task fibers
+	//
+	// Fibers must never return from their entry point, since that would
+	// terminate the worker thread; instead, the finished task switches
+	// back to its worker for the last time, and the worker deletes it.
+	//
+	void __stdcall GreenTaskFiberProc(void* info)
+	{
+		ThreadInfo* threadinfo = reinterpret_cast<ThreadInfo*>(info);
+		GreenTaskInfo* greentask = threadinfo->GreenTask;
+
+		greentask->EntryPoint(info);
+
+		::InterlockedExchange(&greentask->State, GreenTask_Finished);
+		::SwitchToFiber(greentask->ReturnFiber);
+	}
+
+	//
+	// Make sure a green task gets to see a message that was just sent to it
+	//
+	// Running tasks will find the message by themselves, as will tasks that
+	// are parking, since they check their mailbox once more after marking
+	// themselves as parking. Tasks which have fully parked are resumed.
+	// Tasks blocked on a full mailbox are left alone; they are woken by
+	// the receiver they are waiting on instead.
+	//
+	void WakeGreenTask(ThreadInfo& info)
+	{
+		WakeWaitingGreenTask(info, GreenTask_Parking, GreenTask_Parked);
+	}
+
+	//
+	// Resume a green task which is waiting in the given pair of states
+	//
+	// A task which is still switching away is marked as woken, so that
+	// the worker it is leaving queues it up again; a task which is fully
+	// waiting is queued up here. Tasks in any other state are left alone.
+	//
+	void WakeWaitingGreenTask(ThreadInfo& info, LONG switchingstate, LONG waitingstate)
+	{
+		GreenTaskInfo& greentask = *info.GreenTask;
+		while(true)
+		{
+			LONG state = greentask.State;
+			if(state == switchingstate)
+			{
+				if(::InterlockedCompareExchange(&greentask.State, GreenTask_Woken, switchingstate) == switchingstate)
+					return;
+			}
+			else if(state == waitingstate)
+			{
+				if(::InterlockedCompareExchange(&greentask.State, GreenTask_Running, waitingstate) == waitingstate)
+				{
+					greentask.Pool->AddWorkItem(new ResumeGreenTaskWorkItem(info));
+					return;
+				}
+			}
+			else
+				return;
+		}
+	}
+
+	//
+	// Switch a green task away from its worker thread until a message arrives
+	//
+	void ParkUntilMessageArrives(ThreadInfo& info)
+	{
+		GreenTaskInfo& greentask = *info.GreenTask;
+		::InterlockedExchange(&greentask.State, GreenTask_Parking);
+
+		// Senders do not wake running tasks, so a message which was sent
+		// before the state changed will only be found by checking again
+		if(info.Mailbox->HasNewMessages())
+		{
+			::InterlockedExchange(&greentask.State, GreenTask_Running);
+			return;
+		}
+
+		::SwitchToFiber(greentask.ReturnFiber);
+	}
+
+	//
+	// Switch a green task away from its worker thread until the receiver's
+	// mailbox has room again
+	//
+	// The task puts itself on the receiver's list of blocked senders, which
+	// the receiver wakes whenever it takes a message out of its mailbox, and
+	// once more as it exits. The registry guard is released only after the
+	// task is on the list, and reacquired once the task resumes; since the
+	// receiver unregisters before its final wakeup, it cannot exit without
+	// the task hearing of it.
+	//
+	void ParkUntilMailboxHasRoom(ThreadInfo& sender, ThreadInfo& receiver, RegistryReadGuard& guard)
+	{
+		GreenTaskInfo& greentask = *sender.GreenTask;
+		::InterlockedExchange(&greentask.State, GreenTask_Blocking);
+
+		ThreadInfo* head;
+		do
+		{
+			head = receiver.BlockedSenders;
+			greentask.NextBlockedSender = head;
+		} while(::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&receiver.BlockedSenders), &sender, head) != head);
+
+		// The receiver may have made room before the task was on its list,
+		// in which case nobody else would come to wake it
+		if(receiver.Mailbox->HasRoom())
+			WakeBlockedSenders(receiver);
+
+		guard.Release();
+		::SwitchToFiber(greentask.ReturnFiber);
+		guard.Acquire();
+	}
+
+	//
+	// Resume all green tasks which are waiting for room in the given mailbox
+	//
+	// Each task retries its send once it runs again, and blocks anew if
+	// other senders got there first. Callers take a message out of the
+	// mailbox (with an interlocked operation) before checking the list, so
+	// that either the sender sees the room or the receiver sees the sender.
+	//
+	void WakeBlockedSenders(ThreadInfo& receiver)
+	{
+		ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&receiver.BlockedSenders), NULL));
+		while(sender)
+		{
+			// Once woken, the task may put itself on another list straight away
+			ThreadInfo* next = sender->GreenTask->NextBlockedSender;
+			WakeWaitingGreenTask(*sender, GreenTask_Blocking, GreenTask_Blocked);
+			sender = next;
+		}
+	}
+
+}
+
+
+//
+// Send a message to another thread, identified by name
+//
+void Threads::SendEvent(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+
+	{
+		RegistryReadGuard guard;
+
+		// Names are only meaningful within the sender's own program
+		const ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+		RegistryEntry* entry = FindRegisteredThread(threadname, sender->RunningProgram);
+		if(entry && DeliverMessage(guard, *entry->Info, signature, storageblockwrapper, NULL))
+			return;
+	}
+
+	UI::OutputStream output;
+	output << UI::lightred;
+	output << L"WARNING - failed to send message to task \"" << threadname;
+	output << L"\"\nHas the task already exited?" << std::endl;
+	output << UI::resetcolor;
+}
+
+//
+// Determine if a task with the given name is running in the caller's program
+//
+// The answer may be out of date as soon as it is returned, since the task
+// can exit at any time; sending a message to a task which has exited is
+// harmless, however.
+//
+bool Threads::IsTaskRegistered(const std::wstring& threadname)
+{
+	RegistryReadGuard guard;
+
+	const ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+	return (FindRegisteredThread(threadname, sender->RunningProgram) != NULL);
+}
+
+//
+// Send a message to another thread, identified by task handle
+//
+void Threads::SendEvent(TaskHandle target, MessageSignatureID signature, HeapStorage* storageblock)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+
+	RegistryReadGuard guard;
+
+	ThreadInfo* info = FindTask(target);
+	if(!info || !DeliverMessage(guard, *info, signature, storageblockwrapper, NULL))
+		throw ThreadException("Could not locate any task with the given ID; has it already finished execution?");
+}
+
+//
+// Send a single message to every task in a group
+//
+// A task group is made up of all tasks of the sender's program whose
+// names start with the group name; the sender itself is never included.
+// The payload is not copied: each receiving mailbox gets the very same
+// block, which goes back to the pool once the last receiver has handled
+// the message. Returns the number of tasks the message was sent to.
+//
+size_t Threads::BroadcastEvent(const std::wstring& groupname, MessageSignatureID signature, HeapStorage* storageblock)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+
+	RegistryReadGuard guard;
+
+	const ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+
+	// Deliveries may have to release the guard while waiting for room in
+	// a mailbox, so the targets are remembered by handle rather than by
+	// their information blocks
+	std::vector<TaskHandle> targets;
+	for(size_t i = 0; i < NumRegistryBuckets; ++i)
+	{
+		for(RegistryEntry* entry = Registry[i]; entry; entry = entry->Next)
+		{
+			if(entry->Owner == sender->RunningProgram && entry->Info != sender && entry->Name.compare(0, groupname.length(), groupname) == 0)
+				targets.push_back(entry->Info->HandleToSelf);
+		}
+	}
+
+	if(targets.empty())
+	{
+		UI::OutputStream output;
+		output << UI::lightred;
+		output << L"WARNING - no tasks in group \"" << groupname;
+		output << L"\" received the broadcast message" << std::endl;
+		output << UI::resetcolor;
+		return 0;
+	}
+
+	storageblockwrapper->ShareAmong(static_cast<LONG>(targets.size()));
+	storageblockwrapper.release();
+
+	size_t delivered = 0;
+	size_t attempted = 0;
+	try
+	{
+		for(; attempted < targets.size(); ++attempted)
+		{
+			// Tasks which exit in the meantime drop their reference unused
+			ThreadInfo* target = FindTask(targets[attempted]);
+			if(!target)
+			{
+				HeapStorage::ReleasePooled(storageblock);
+				continue;
+			}
+
+			std::auto_ptr<HeapStorage> holder(storageblock);
+			if(DeliverMessage(guard, *target, signature, holder, NULL))
+				++delivered;
+		}
+	}
+	catch(...)
+	{
+		// The failed delivery has already dropped its own reference
+		for(size_t i = attempted + 1; i < targets.size(); ++i)
+			HeapStorage::ReleasePooled(storageblock);
+
+		throw;
+	}
+
+	return delivered;
+}
+
+//
+// Send a request to another thread, identified by name
+//
+// The receiving task fills in the given future directly when it replies,
+// so no reply message ever travels back through the sender's mailbox.
+// Unlike a plain message, a request that cannot be delivered is an error,
+// since the sender would otherwise wait forever on the future.
+//
+void Threads::SendRequest(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock, VM::Future* replyslot)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+
+	RegistryReadGuard guard;
+
+	const ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+	RegistryEntry* entry = FindRegisteredThread(threadname, sender->RunningProgram);
+	if(!entry || !DeliverMessage(guard, *entry->Info, signature, storageblockwrapper, replyslot))
+		throw ThreadException("Could not locate the task a request was sent to; has it already exited?");
+}
+
+//
+// Obtain storage for a message header from the pool
+//
+void* Threads::MessageInfo::operator new(size_t size)
+{
+	PSLIST_ENTRY entry = ::InterlockedPopEntrySList(&MessageHeaderPool);
+	if(!entry)
+		entry = AllocateMessageHeaderSlab();
+
+	return entry;
+}
+
+//
+// Return the storage of a message header to the pool
+//
+// This may be called from any thread.
+//
+void Threads::MessageInfo::operator delete(void* ptr)
+{
+	if(ptr)
+		::InterlockedPushEntrySList(&MessageHeaderPool, reinterpret_cast<PSLIST_ENTRY>(ptr));
+}
+
+namespace
+{
+
+	//
+	// Carve a new slab into message headers
+	//
+	// The first header's worth of the slab links it into the list of slabs.
+	// One of the new headers is handed straight back to the caller, and the
+	// rest go into the pool.
+	//
+	PSLIST_ENTRY AllocateMessageHeaderSlab()
+	{
+		Byte* slab = static_cast<Byte*>(::_aligned_malloc(MessageHeaderStride * (MessageHeadersPerSlab + 1), MEMORY_ALLOCATION_ALIGNMENT));
+		if(!slab)
+			throw std::bad_alloc();
+
+		::InterlockedPushEntrySList(&MessageHeaderSlabs, reinterpret_cast<PSLIST_ENTRY>(slab));
+
+		for(size_t i = 2; i <= MessageHeadersPerSlab; ++i)
+			::InterlockedPushEntrySList(&MessageHeaderPool, reinterpret_cast<PSLIST_ENTRY>(slab + i * MessageHeaderStride));
+
+		return reinterpret_cast<PSLIST_ENTRY>(slab + MessageHeaderStride);
+	}
+
+	//
+	// Release all message header slabs
+	//
+	// No messages may be in flight, since their headers would go with the slabs.
+	//
+	void FreeMessageHeaderSlabs()
+	{
+		::InterlockedFlushSList(&MessageHeaderPool);
+		while(PSLIST_ENTRY slab = ::InterlockedPopEntrySList(&MessageHeaderSlabs))
+			::_aligned_free(slab);
+	}
+
+	//
+	// Create a mailbox for a new thread, using the configured overflow policy
+	//
+	LocklessMailbox<MessageInfo>* CreateMailbox()
+	{
+		MailboxOverflowPolicy policy = MailboxOverflow_FailSend;
+		if(Config::MailboxOverflowMode == 0)
+			policy = MailboxOverflow_BlockSender;
+		else if(Config::MailboxOverflowMode == 1)
+			policy = MailboxOverflow_DropOldest;
+
+		return new LocklessMailbox<MessageInfo>(policy);
+	}
+
+	//
+	// Warn if a mailbox had to discard messages during its lifetime
+	//
+	void ReportMailboxOverflow(const LocklessMailbox<MessageInfo>& mailbox)
+	{
+		LocklessMailbox<MessageInfo>::Statistics stats = mailbox.GetStatistics();
+		if(!stats.NumDropped)
+			return;
+
+		UI::OutputStream output;
+		output << UI::lightred;
+		output << L"WARNING - " << stats.NumDropped << L" message(s) were discarded because a task's mailbox was full\n";
+		output << L"(peak backlog " << stats.HighWaterMark << L" of " << stats.Capacity << L" slots; consider raising the messageslots option)" << std::endl;
+		output << UI::resetcolor;
+	}
+
+	//
+	// Place a message in a thread's mailbox, and make sure the thread sees it
+	//
+	// Callers must hold a registry read guard while the target is in use.
+	// When the target's mailbox is full and its policy says to wait, the
+	// guard is released while waiting, so that the registry never stays
+	// locked on behalf of a blocked sender, and the target is looked up
+	// again afterwards. Returns false if the target exited in the meantime;
+	// the message is discarded in that case.
+	//
+	// Green task senders do not wait on their worker thread, since the
+	// receiver may itself be queued to run on it; they park their fiber
+	// until the receiver makes room instead. A task sending to its own
+	// mailbox could never be unblocked, so its send fails instead,
+	// whatever the configured overflow policy.
+	//
+	bool DeliverMessage(RegistryReadGuard& guard, ThreadInfo& target, MessageSignatureID signature, std::auto_ptr<HeapStorage>& storageblock, VM::Future* replyslot)
+	{
+		ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+
+		std::auto_ptr<MessageInfo> msg(new MessageInfo);
+		msg->Signature = signature;
+		msg->StorageBlock = storageblock.release();
+		msg->Origin = sender->HandleToSelf;
+		msg->ReplySlot = replyslot;
+
+		TaskHandle targethandle = target.HandleToSelf;
+		ThreadInfo* receiver = &target;
+		while(true)
+		{
+			MailboxAddResult result = PlaceInMailbox(*receiver, msg);
+			if(result == MailboxAdd_Accepted)
+				return true;
+
+			if(result == MailboxAdd_MustWait && sender == receiver)
+			{
+				receiver->Mailbox->RejectMessage();
+				result = MailboxAdd_Rejected;
+			}
+
+			if(result == MailboxAdd_Rejected)
+				throw ThreadException("Too many messages backlogged; make sure task is accepting the sent messages!");
+
+			if(sender->GreenTask)
+				ParkUntilMailboxHasRoom(*sender, *receiver, guard);
+			else
+			{
+				guard.Release();
+				::SwitchToThread();
+				guard.Acquire();
+			}
+
+			receiver = FindTask(targethandle);
+			if(!receiver)
+				return false;
+		}
+	}
+
+	//
+	// Add a message to a thread's mailbox and wake the thread if needed
+	//
+	// Never blocks; unless the message is accepted, the caller keeps
+	// ownership of it.
+	//
+	MailboxAddResult PlaceInMailbox(ThreadInfo& target, std::auto_ptr<MessageInfo>& msg)
+	{
+		MessageSignatureID signature = msg->Signature;
+		MailboxAddResult result = target.Mailbox->TryAddMessage(msg.get());
+		if(result != MailboxAdd_Accepted)
+			return result;
+
+		msg.release();
+		Tracing::RecordInstant("Send message", signature);
+
+		if(target.GreenTask)
+			WakeGreenTask(target);
+		else if(::InterlockedExchange(&target.WaitingForMessage, 0))
+			::SetEvent(target.MessageEvent);
+
+		return MailboxAdd_Accepted;
+	}
+
+
+	//
+	// Timer action which delivers a message once it comes due
+	//
+	// The target is looked up afresh each time the timer fires, since it
+	// may not have been started yet when the message was sent, or may have
+	// exited since. The timer thread must never block, so a full mailbox
+	// drops the message rather than waiting for space, whatever the
+	// overflow policy says.
+	//
+	// Periodic messages deliver a copy of the payload each time, and stop
+	// once their target can no longer be found.
+	//
+	class DelayedMessageTimer : public Timers::TimerAction
+	{
+	public:
+		DelayedMessageTimer(const std::wstring& targetname, TaskHandle target, MessageSignatureID signature, HeapStorage* storageblock, DWORD periodms)
+			: TargetName(targetname),
+			  Target(target),
+			  Signature(signature),
+			  StorageBlock(storageblock),
+			  PeriodMS(periodms)
+		{
+			const ThreadInfo* sender = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+			Origin = sender->HandleToSelf;
+			Owner = sender->RunningProgram;
+		}
+
+		virtual ~DelayedMessageTimer()
+		{
+			HeapStorage::ReleasePooled(StorageBlock);
+		}
+
+		virtual DWORD Fire()
+		{
+			RegistryReadGuard guard;
+
+			ThreadInfo* target = NULL;
+			if(TargetName.empty())
+				target = FindTask(Target);
+			else if(RegistryEntry* entry = FindRegisteredThread(TargetName, Owner))
+				target = entry->Info;
+
+			if(!target)
+			{
+				if(!PeriodMS)
+					ReportUndeliverable(L"has the task already exited?");
+				return 0;
+			}
+
+			std::auto_ptr<MessageInfo> msg(new MessageInfo);
+			msg->Signature = Signature;
+			msg->Origin = Origin;
+			msg->ReplySlot = NULL;
+
+			if(PeriodMS)
+			{
+				msg->StorageBlock = HeapStorage::AcquirePooled(StorageBlock->GetSize());
+				memcpy(msg->StorageBlock->GetStartOfStorage(), StorageBlock->GetStartOfStorage(), StorageBlock->GetSize());
+			}
+			else
+			{
+				msg->StorageBlock = StorageBlock;
+				StorageBlock = NULL;
+			}
+
+			MailboxAddResult result = PlaceInMailbox(*target, msg);
+			if(result == MailboxAdd_MustWait)
+				target->Mailbox->RejectMessage();
+			if(result != MailboxAdd_Accepted)
+				ReportUndeliverable(L"the task's mailbox was full");
+
+			return PeriodMS;
+		}
+
+	private:
+		void ReportUndeliverable(const wchar_t* reason) const
+		{
+			UI::OutputStream output;
+			output << UI::lightred;
+			output << L"WARNING - failed to deliver delayed message";
+			if(!TargetName.empty())
+				output << L" to task \"" << TargetName << L"\"";
+			output << L"; " << reason << std::endl;
+			output << UI::resetcolor;
+		}
+
+	private:
+		std::wstring TargetName;
+		TaskHandle Target;
+		const VM::Program* Owner;
+		DWORD Origin;
+		MessageSignatureID Signature;
+		HeapStorage* StorageBlock;
+		DWORD PeriodMS;
+	};
+
+	//
+	// Timer action which wakes a green task when its wait for a message times out
+	//
+	// The task may have received its message, or even exited, by the time
+	// the timer fires; waking a task which is not waiting is harmless, and
+	// a stale handle simply no longer resolves to a task.
+	//
+	class MessageWaitTimer : public Timers::TimerAction
+	{
+	public:
+		explicit MessageWaitTimer(TaskHandle task)
+			: Task(task)
+		{ }
+
+		virtual DWORD Fire()
+		{
+			RegistryReadGuard guard;
+
+			ThreadInfo* info = FindTask(Task);
+			if(info && info->GreenTask)
+				WakeGreenTask(*info);
+
+			return 0;
+		}
+
+	private:
+		TaskHandle Task;
+	};
+
+}
+
+
+//
+// Send a message to another thread, identified by name, once the given delay has passed
+//
+// If a period is given, the message is sent again at that interval for as
+// long as the task is still running. The timer service takes ownership of
+// the payload from the outset; see DelayedMessageTimer for details.
+//
+void Threads::SendDelayedEvent(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock, DWORD delayms, DWORD periodms)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+	std::auto_ptr<Timers::TimerAction> timer(new DelayedMessageTimer(threadname, 0, signature, storageblock, periodms));
+	storageblockwrapper.release();
+
+	Timers::Schedule(delayms, timer.release());
+}
+
+//
+// Send a message to another thread, identified by task handle, once the given delay has passed
+//
+void Threads::SendDelayedEvent(TaskHandle target, MessageSignatureID signature, HeapStorage* storageblock, DWORD delayms, DWORD periodms)
+{
+	std::auto_ptr<HeapStorage> storageblockwrapper(storageblock);
+	std::auto_ptr<Timers::TimerAction> timer(new DelayedMessageTimer(std::wstring(), target, signature, storageblock, periodms));
+	storageblockwrapper.release();
+
+	Timers::Schedule(delayms, timer.release());
+}
+
+//
+// Suspend the thread until a message with one of the given signatures arrives
+//
+// Green tasks are parked instead, which frees up the worker thread.
+//
+// The lookup table is not needed here, since a thread's own information
+// cannot go away while the thread is still running.
+//
+// Messages with other signatures are kept in the mailbox for later
+// receives, rather than being discarded, so tasks may accept different
+// sets of messages in different phases without losing any.
+//
+// Threads announce that they are about to block by raising their
+// waiting flag, and then check the mailbox once more before sleeping.
+// Senders only signal the message event if they are the one to lower
+// the flag again. A message sent before the flag went up is found by
+// the second check, and one sent afterwards always signals the event,
+// so no wakeup can be lost; meanwhile a thread which is busy draining
+// its mailbox is never signaled at all. The only stray signal left is
+// from a sender that lowered the flag just as the second check found
+// a message, which costs at most one extra pass through the loop.
+//
+MessageInfo* Threads::WaitForEvent(const std::vector<MessageSignatureID>& signatures)
+{
+	return WaitForEvent(signatures, INFINITE);
+}
+
+//
+// Suspend the thread until a message with one of the given signatures
+// arrives, or until the given number of milliseconds have passed
+//
+// Returns NULL if the wait timed out. Green tasks have no thread of their
+// own to wait with, so they ask the timer service to wake them up at the
+// deadline instead. Any other wakeup (such as a message with a signature
+// which is not being waited for) may come first, in which case the task
+// simply parks again, since the timer is still due to wake it. Timers
+// never fire ahead of their deadline by the system tick count, so once
+// the timer has woken the task, the wait is found to have timed out.
+//
+MessageInfo* Threads::WaitForEvent(const std::vector<MessageSignatureID>& signatures, DWORD timeoutms)
+{
+	ThreadInfo* thisthread = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+	Tracing::Span span("Receive message");
+
+	DWORD starttime = ::GetTickCount();
+	bool wakeuppending = false;
+
+	while(true)
+	{
+		MessageInfo* mail = thisthread->Mailbox->GetMatchingMessage(signatures);
+		if(mail)
+		{
+			if(thisthread->BlockedSenders)
+				WakeBlockedSenders(*thisthread);
+
+			span.SetValue(mail->Signature);
+			return mail;
+		}
+
+		DWORD remaining = INFINITE;
+		if(timeoutms != INFINITE)
+		{
+			DWORD now = ::GetTickCount();
+			if(now - starttime >= timeoutms)
+				return NULL;
+
+			remaining = timeoutms - (now - starttime);
+		}
+
+		if(thisthread->GreenTask)
+		{
+			if(remaining != INFINITE && !wakeuppending)
+			{
+				Timers::Schedule(remaining, new MessageWaitTimer(thisthread->HandleToSelf));
+				wakeuppending = true;
+			}
+
+			ParkUntilMessageArrives(*thisthread);
+			continue;
+		}
+
+		::InterlockedExchange(&thisthread->WaitingForMessage, 1);
+
+		mail = thisthread->Mailbox->GetMatchingMessage(signatures);
+		if(mail)
+		{
+			::InterlockedExchange(&thisthread->WaitingForMessage, 0);
+			if(thisthread->BlockedSenders)
+				WakeBlockedSenders(*thisthread);
+
+			span.SetValue(mail->Signature);
+			return mail;
+		}
+
+		if(::WaitForSingleObject(thisthread->MessageEvent, remaining) == WAIT_TIMEOUT)
+		{
+			// Lower the flag again, so that senders stop signaling the
+			// event; any signal already on its way costs one extra pass
+			::InterlockedExchange(&thisthread->WaitingForMessage, 0);
+		}
+	}
+}
+
+//
+// Suspend the thread until a new message arrives in its mailbox, or
+// a window message arrives in its Win32 message queue, or until the
+// given number of milliseconds have passed
+//
+// This lets a task which owns windows sleep until there is work of
+// either kind, rather than polling between the two. The same waiting
+// flag protocol is used as for WaitForEvent. Neither kind of message
+// is removed; the caller retrieves them as usual afterwards. Window
+// messages which were already queued, but not yet retrieved, count
+// as having arrived.
+//
+// Green tasks move between worker threads, and so have no message
+// queue of their own which could be waited on.
+//
+WindowWaitResult Threads::WaitForEventOrWindowMessage(DWORD timeoutms)
+{
+	ThreadInfo* thisthread = reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
+	if(thisthread->GreenTask)
+		return WindowWait_Unsupported;
+
+	Tracing::Span span("Receive message or window message");
+
+	DWORD starttime = ::GetTickCount();
+
+	while(true)
+	{
+		if(thisthread->Mailbox->HasNewMessages())
+			return WindowWait_TaskMessage;
+
+		DWORD remaining = INFINITE;
+		if(timeoutms != INFINITE)
+		{
+			DWORD now = ::GetTickCount();
+			if(now - starttime >= timeoutms)
+				return WindowWait_TimedOut;
+
+			remaining = timeoutms - (now - starttime);
+		}
+
+		::InterlockedExchange(&thisthread->WaitingForMessage, 1);
+
+		if(thisthread->Mailbox->HasNewMessages())
+		{
+			::InterlockedExchange(&thisthread->WaitingForMessage, 0);
+			return WindowWait_TaskMessage;
+		}
+
+		DWORD result = ::MsgWaitForMultipleObjectsEx(1, &thisthread->MessageEvent, remaining, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+		if(result == WAIT_OBJECT_0)
+			continue;
+
+		::InterlockedExchange(&thisthread->WaitingForMessage, 0);
+
+		if(result == WAIT_OBJECT_0 + 1)
+			return WindowWait_WindowMessage;
+		else if(result == WAIT_FAILED)
+			throw ThreadException("Failed to wait for task or window messages");
+	}
+}
+
+namespace
+{
+
+	//
+	// Clean up all thread tracking
+	//
+	void ClearThreadTracking()
+	{
+		for(size_t bucket = 0; bucket < NumRegistryBuckets; ++bucket)
+		{
+			RegistryEntry* entry = Registry[bucket];
+			while(entry)
+			{
+				RegistryEntry* next = entry->Next;
+
+				::HeapDestroy(entry->Info->LocalHeapHandle);
+				if(entry->Info->MessageEvent)
+					::CloseHandle(entry->Info->MessageEvent);
+				delete entry->Info->Mailbox;
+				delete entry->Info->GreenTask;
+				delete entry->Info;
+				delete entry;
+
+				entry = next;
+			}
+
+			Registry[bucket] = NULL;
+		}
+
+		NumRegisteredThreads = 0;
+		NumHostThreads = 0;
+	}
+
+}
+
+
+//
+// Sit around until all threads exit. Mainly useful
+// for when the VM shuts down and we need to let
+// things terminate gracefully.
+//
+void Threads::WaitForThreadsToFinish()
+{
+	while(NumRegisteredThreads > NumHostThreads)		// Host threads (including the main thread) remain registered, so they are not counted
+	{
+		::Sleep(100);
+	}
+}
+
+//
+// Sit around until all tasks forked by the given program exit
+//
+// Threads belonging to other programs are not waited for.
+//
+void Threads::WaitForThreadsToFinish(const VM::Program* program)
+{
+	while(GetProgramThreadCounts(program).Registered > 0)
+	{
+		::Sleep(100);
+	}
+}
+
+//
+// Retrieve the thread's information block from thread-local storage
+//
 const ThreadInfo& Threads::GetInfoForThisThread()
 {
 	return *reinterpret_cast<ThreadInfo*>(::TlsGetValue(TLSIndex));
@@ -379,3 +2062,63 @@ DWORD Threads::GetTLSIndex()
 	return TLSIndex;
 }
 
+//
+// Retrieve the fiber of the calling thread, converting the thread into
+// a fiber first if necessary, so that it can switch into green tasks
+// and coroutines
+//
+LPVOID Threads::GetFiberForThisThread()
+{
+	if(!::TlsGetValue(ThreadFiberTLSIndex))
+	{
+		LPVOID fiber = ::ConvertThreadToFiber(NULL);
+		if(!fiber)
+			throw ThreadException("Failed to prepare a thread for running fibers!");
+
+		::TlsSetValue(ThreadFiberTLSIndex, fiber);
+	}
+
+	return ::GetCurrentFiber();
+}
+
+//
+// Return the number of threads currently running in the threading system
+//
+// Note that idle thread pool workers count as running threads.
+//
+unsigned Threads::GetNumRunningThreads()
+{
+	return static_cast<unsigned>(RunningThreadCount);
+}
+
+//
+// Return the number of threads currently running the given program
+//
+// This includes the program's thread pool workers, and any host threads
+// the program is bound to.
+//
+unsigned Threads::GetNumRunningThreads(const VM::Program* program)
+{
+	return static_cast<unsigned>(GetProgramThreadCounts(program).Running);
+}
+
+//
+// Retrieve the statistics of the mailboxes of all registered threads
+//
+// The registry is walked under a read guard, so the mailboxes found
+// cannot be freed while their statistics are being read.
+//
+void Threads::GetLiveMailboxStatistics(std::vector<MailboxStatistics>& stats)
+{
+	RegistryReadGuard guard;
+
+	for(size_t i = 0; i < NumRegistryBuckets; ++i)
+	{
+		for(RegistryEntry* entry = Registry[i]; entry; entry = entry->Next)
+		{
+			if(entry->Info->Mailbox)
+				stats.push_back(entry->Info->Mailbox->GetStatistics());
+		}
+	}
+}
+
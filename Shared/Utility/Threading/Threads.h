@@ -33,28 +33,58 @@ namespace Threads
 	// Forward declarations
 	struct MessageInfo;
 	struct ThreadInfo;
+	struct GreenTaskInfo;
+	class ThreadPool;
 
 	// Handy type shortcuts
 	typedef DWORD (__stdcall *ThreadFuncPtr)(void* param);
 
+	// Outcomes of waiting for either a task message or a window message
+	enum WindowWaitResult
+	{
+		WindowWait_TimedOut,
+		WindowWait_TaskMessage,
+		WindowWait_WindowMessage,
+		WindowWait_Unsupported
+	};
+
 
 	// Thread forking
 	void Create(const std::wstring& name, ThreadFuncPtr func, VM::Block* codeblock, VM::Program* runningprogram);
 	void Create(const std::wstring& name, ThreadFuncPtr func, VM::Future* boundfuture, VM::Operation* op, VM::Program* runningprogram);
+	void CreateGreenTask(const std::wstring& name, ThreadFuncPtr func, VM::Block* codeblock, VM::Program* runningprogram, ThreadPool& pool);
 
 	// Helpers for setup/teardown of threads
 	void Enter(void* info);
 	void Exit();
 	void WaitForThreadsToFinish();
+	void WaitForThreadsToFinish(const VM::Program* program);
+
+	// Association of threads with the programs they run
+	VM::Program* BindProgramToThisThread(VM::Program* program);
+	void DetachHostThread();
 	
 	// Message passing
-	void SendEvent(const std::wstring& threadname, const std::wstring& eventname, const std::list<VM::EpochVariableTypeID>& payloadtypes, HeapStorage* storageblock);
-	Threads::MessageInfo* WaitForEvent();
+	void SendEvent(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock);
+	void SendEvent(TaskHandle target, MessageSignatureID signature, HeapStorage* storageblock);
+	size_t BroadcastEvent(const std::wstring& groupname, MessageSignatureID signature, HeapStorage* storageblock);
+	void SendRequest(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock, VM::Future* replyslot);
+	void SendDelayedEvent(const std::wstring& threadname, MessageSignatureID signature, HeapStorage* storageblock, DWORD delayms, DWORD periodms);
+	void SendDelayedEvent(TaskHandle target, MessageSignatureID signature, HeapStorage* storageblock, DWORD delayms, DWORD periodms);
+	Threads::MessageInfo* WaitForEvent(const std::vector<MessageSignatureID>& signatures);
+	Threads::MessageInfo* WaitForEvent(const std::vector<MessageSignatureID>& signatures, DWORD timeoutms);
+	WindowWaitResult WaitForEventOrWindowMessage(DWORD timeoutms);
+	bool IsTaskRegistered(const std::wstring& threadname);
 
 	// Thread info access
 	const ThreadInfo& GetInfoForThisThread();
-	std::wstring GetThreadNameGivenID(TaskHandle id);
 	DWORD GetTLSIndex();
+	LPVOID GetFiberForThisThread();
+	unsigned GetNumRunningThreads();
+	unsigned GetNumRunningThreads(const VM::Program* program);
+
+	// Diagnostics
+	void GetLiveMailboxStatistics(std::vector<MailboxStatistics>& stats);
 
 	// Thread manager setup/teardown
 	void Init();
@@ -77,21 +107,63 @@ namespace Threads
 		DWORD TaskOrigin;
 		HANDLE LocalHeapHandle;
 		HANDLE MessageEvent;
+		volatile LONG WaitingForMessage;	// Nonzero while the thread is about to block on its message event
 		LocklessMailbox<MessageInfo>* Mailbox;
+		GreenTaskInfo* GreenTask;			// NULL unless this is a green task running on a thread pool
+		ThreadInfo* volatile BlockedSenders;	// Green tasks waiting for room in this thread's mailbox
+	};
+
+	//
+	// RAII wrapper which runs the given program on the calling thread
+	//
+	// The thread's previous program is restored when the wrapper is
+	// destroyed, so wrappers may be nested freely.
+	//
+	class ProgramBinding
+	{
+	public:
+		explicit ProgramBinding(VM::Program* program)
+			: PreviousProgram(BindProgramToThisThread(program))
+		{ }
+
+		~ProgramBinding()
+		{ BindProgramToThisThread(PreviousProgram); }
+
+	private:
+		VM::Program* PreviousProgram;
+
+	// Non-copyable
+	private:
+		ProgramBinding(const ProgramBinding&);
+		ProgramBinding& operator = (const ProgramBinding&);
 	};
 
 	//
 	// Message payload structure for inter-thread communication
 	//
+	// Messages are identified by signature ID, which encodes both the
+	// message name and the types of the payload values; signatures are
+	// interned when programs are loaded, so no strings or type lists
+	// need to be copied or compared while messages are in flight.
+	//
+	// Requests carry the future which the sender expects the reply in;
+	// the reply slot is NULL for all other messages.
+	//
+	// Headers are drawn from a lock-free pool rather than the heap, since
+	// one is needed for every message sent; see Threads.cpp for details.
+	//
 	struct MessageInfo
 	{
-		std::wstring MessageName;
-		std::list<VM::EpochVariableTypeID> PayloadTypes;
+		MessageSignatureID Signature;
 		DWORD Origin;
 		HeapStorage* StorageBlock;
+		VM::Future* ReplySlot;
 
 		~MessageInfo()
-		{ delete StorageBlock; }
+		{ HeapStorage::ReleasePooled(StorageBlock); }
+
+		static void* operator new(size_t size);
+		static void operator delete(void* ptr);
 	};
 
 }
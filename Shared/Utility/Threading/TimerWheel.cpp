@@ -0,0 +1,413 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Timer service for delayed and periodic actions
+//
+
+#include "pch.h"
+
+#include "Utility/Threading/TimerWheel.h"
+#include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Threading/Synchronization.h"
+
+#include "User Interface/Output.h"
+
+
+using namespace Threads;
+using namespace Threads::Timers;
+
+
+namespace
+{
+
+	//
+	// Geometry of the wheel
+	//
+	// Level 0 has one slot per millisecond; each level above it has
+	// slots spanning a full turn of the level below.
+	//
+	const unsigned Level0Bits = 8;
+	const unsigned UpperLevelBits = 6;
+	const unsigned NumUpperLevels = 3;
+
+	const size_t Level0Slots = 1 << Level0Bits;
+	const size_t UpperLevelSlots = 1 << UpperLevelBits;
+
+	// Largest distance to a deadline which the wheel can represent
+	const unsigned __int64 WheelRange = static_cast<unsigned __int64>(1) << (Level0Bits + NumUpperLevels * UpperLevelBits);
+
+	//
+	// Timer waiting in the wheel, or in the queue of new timers
+	//
+	// New timers record the tick count at which they were scheduled,
+	// since they are only placed in the wheel once the timer thread
+	// picks them up; thereafter the deadline is measured in wheel time.
+	//
+	struct PendingTimer
+	{
+		TimerAction* Action;
+		unsigned __int64 Deadline;
+		DWORD ScheduledAt;
+		DWORD Delay;
+		PendingTimer* Next;
+	};
+
+	//
+	// Timers scheduled since the timer thread last woke up
+	//
+	// These are protected by the timer critical section.
+	//
+	CriticalSection TimerCriticalSection;
+	PendingTimer* IncomingTimers = NULL;
+	bool TimerServiceStopping = false;
+
+	HANDLE TimerThread = NULL;
+	HANDLE TimerWakeEvent = NULL;
+
+	//
+	// State of the wheel itself
+	//
+	// This is only touched by the timer thread, except during shutdown,
+	// once the thread has exited.
+	//
+	PendingTimer* Level0[Level0Slots];
+	PendingTimer* UpperLevels[NumUpperLevels][UpperLevelSlots];
+
+	unsigned __int64 WheelTime = 0;			// Milliseconds which the wheel has been advanced by
+	DWORD LastTickCount = 0;				// System tick count the wheel was last advanced to
+	size_t NumTimersInWheel = 0;
+
+
+	//
+	// Place a timer in the slot matching its deadline
+	//
+	// Deadlines which have already passed are moved up to the next tick,
+	// and deadlines beyond the range of the wheel are parked in the slot
+	// which comes round last; they are placed again when it is cascaded.
+	//
+	void InsertTimer(PendingTimer* timer)
+	{
+		if(timer->Deadline <= WheelTime)
+			timer->Deadline = WheelTime + 1;
+
+		unsigned __int64 placement = timer->Deadline;
+		if(placement - WheelTime >= WheelRange)
+			placement = WheelTime + WheelRange - 1;
+
+		unsigned __int64 distance = placement - WheelTime;
+		PendingTimer** slot;
+
+		if(distance < Level0Slots)
+			slot = &Level0[placement & (Level0Slots - 1)];
+		else
+		{
+			unsigned level = 0;
+			unsigned shift = Level0Bits;
+			while((distance >> (shift + UpperLevelBits)) != 0 && level < NumUpperLevels - 1)
+			{
+				++level;
+				shift += UpperLevelBits;
+			}
+
+			slot = &UpperLevels[level][(placement >> shift) & (UpperLevelSlots - 1)];
+		}
+
+		timer->Next = *slot;
+		*slot = timer;
+		++NumTimersInWheel;
+	}
+
+	//
+	// Move all timers out of a slot of an upper level into finer slots
+	//
+	void CascadeSlot(PendingTimer*& slot)
+	{
+		PendingTimer* timer = slot;
+		slot = NULL;
+
+		while(timer)
+		{
+			PendingTimer* next = timer->Next;
+			--NumTimersInWheel;
+			InsertTimer(timer);
+			timer = next;
+		}
+	}
+
+	//
+	// Fire a timer which has come due, rescheduling it if it asks to be
+	//
+	void FireTimer(PendingTimer* timer)
+	{
+		DWORD interval = 0;
+
+		try
+		{
+			interval = timer->Action->Fire();
+		}
+		catch(std::exception& e)
+		{
+			UI::OutputStream output;
+			output << UI::lightred;
+			output << L"WARNING - timer action failed: " << e.what() << std::endl;
+			output << UI::resetcolor;
+		}
+
+		if(interval)
+		{
+			timer->Deadline = WheelTime + interval;
+			InsertTimer(timer);
+		}
+		else
+		{
+			delete timer->Action;
+			delete timer;
+		}
+	}
+
+	//
+	// Advance the wheel by a single millisecond, firing any timers which come due
+	//
+	void AdvanceOneTick()
+	{
+		++WheelTime;
+
+		size_t index = static_cast<size_t>(WheelTime & (Level0Slots - 1));
+		if(index == 0)
+		{
+			unsigned shift = Level0Bits;
+			for(unsigned level = 0; level < NumUpperLevels; ++level)
+			{
+				size_t upperindex = static_cast<size_t>((WheelTime >> shift) & (UpperLevelSlots - 1));
+				CascadeSlot(UpperLevels[level][upperindex]);
+				if(upperindex != 0)
+					break;
+
+				shift += UpperLevelBits;
+			}
+		}
+
+		PendingTimer* timer = Level0[index];
+		Level0[index] = NULL;
+
+		while(timer)
+		{
+			PendingTimer* next = timer->Next;
+			--NumTimersInWheel;
+
+			if(timer->Deadline > WheelTime)
+				InsertTimer(timer);
+			else
+				FireTimer(timer);
+
+			timer = next;
+		}
+	}
+
+	//
+	// Determine how long the timer thread may sleep before the wheel next needs attention
+	//
+	// The thread only has to wake for the next occupied slot of the first
+	// level, or for the next turnover of the first level, whichever comes
+	// first; an empty wheel needs no attention at all.
+	//
+	DWORD GetTimeUntilNextEvent()
+	{
+		if(!NumTimersInWheel)
+			return INFINITE;
+
+		size_t index = static_cast<size_t>(WheelTime & (Level0Slots - 1));
+		DWORD ticks = 1;
+		for(; index + ticks < Level0Slots; ++ticks)
+		{
+			if(Level0[index + ticks])
+				break;
+		}
+
+		DWORD elapsed = ::GetTickCount() - LastTickCount;
+		return (elapsed >= ticks) ? 0 : ticks - elapsed;
+	}
+
+	//
+	// Bring the wheel up to date with the system tick count
+	//
+	void CatchUpWithClock()
+	{
+		DWORD now = ::GetTickCount();
+		DWORD elapsed = now - LastTickCount;
+		LastTickCount = now;
+
+		// Nothing can come due in an empty wheel, so there is no need to
+		// step through the time spent asleep one tick at a time
+		if(!NumTimersInWheel)
+		{
+			WheelTime += elapsed;
+			return;
+		}
+
+		for(DWORD i = 0; i < elapsed; ++i)
+			AdvanceOneTick();
+	}
+
+	//
+	// Move newly scheduled timers into the wheel
+	//
+	// Must be called right after catching up with the clock, so that the
+	// time each timer spent in the queue can be measured from LastTickCount.
+	//
+	void InsertIncomingTimers()
+	{
+		PendingTimer* timer;
+		{
+			CriticalSection::Auto mutex(TimerCriticalSection);
+			timer = IncomingTimers;
+			IncomingTimers = NULL;
+		}
+
+		while(timer)
+		{
+			PendingTimer* next = timer->Next;
+
+			DWORD queued = LastTickCount - timer->ScheduledAt;
+			timer->Deadline = WheelTime + ((queued < timer->Delay) ? (timer->Delay - queued) : 0);
+			InsertTimer(timer);
+
+			timer = next;
+		}
+	}
+
+	//
+	// Entry point for the timer thread
+	//
+	DWORD __stdcall TimerThreadProc(void* param)
+	{
+		LastTickCount = ::GetTickCount();
+
+		while(true)
+		{
+			::WaitForSingleObject(TimerWakeEvent, GetTimeUntilNextEvent());
+
+			{
+				CriticalSection::Auto mutex(TimerCriticalSection);
+				if(TimerServiceStopping)
+					break;
+			}
+
+			CatchUpWithClock();
+			InsertIncomingTimers();
+		}
+
+		return 0;
+	}
+
+	//
+	// Free a list of timers without firing them
+	//
+	void DiscardTimers(PendingTimer* timer)
+	{
+		while(timer)
+		{
+			PendingTimer* next = timer->Next;
+			delete timer->Action;
+			delete timer;
+			timer = next;
+		}
+	}
+
+}
+
+
+//
+// Arrange for an action to be fired once the given number of milliseconds have passed
+//
+// The timer thread is started the first time a timer is scheduled.
+//
+void Timers::Schedule(DWORD delayms, TimerAction* action)
+{
+	std::auto_ptr<TimerAction> actionwrapper(action);
+
+	std::auto_ptr<PendingTimer> timer(new PendingTimer);
+	timer->Action = action;
+	timer->Deadline = 0;
+	timer->ScheduledAt = ::GetTickCount();
+	timer->Delay = delayms;
+
+	CriticalSection::Auto mutex(TimerCriticalSection);
+
+	if(TimerServiceStopping)
+		throw ThreadException("Cannot schedule a timer while the timer service is shutting down");
+
+	if(!TimerThread)
+	{
+		TimerWakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+		if(!TimerWakeEvent)
+			throw ThreadException("Failed to create synchronization event for the timer service");
+
+		TimerThread = ::CreateThread(NULL, 0, TimerThreadProc, NULL, 0, NULL);
+		if(!TimerThread)
+		{
+			::CloseHandle(TimerWakeEvent);
+			TimerWakeEvent = NULL;
+			throw ThreadException("Failed to start the timer thread");
+		}
+	}
+
+	timer->Next = IncomingTimers;
+	IncomingTimers = timer.release();
+	actionwrapper.release();
+
+	::SetEvent(TimerWakeEvent);
+}
+
+//
+// Stop the timer thread, and discard any timers which have not yet fired
+//
+// Once the service has stopped, timers may be scheduled again, which
+// starts up a fresh timer thread.
+//
+void Timers::Shutdown()
+{
+	HANDLE thread;
+	{
+		CriticalSection::Auto mutex(TimerCriticalSection);
+		thread = TimerThread;
+		if(!thread)
+			return;
+
+		TimerServiceStopping = true;
+		::SetEvent(TimerWakeEvent);
+	}
+
+	::WaitForSingleObject(thread, INFINITE);
+
+	CriticalSection::Auto mutex(TimerCriticalSection);
+
+	::CloseHandle(TimerThread);
+	::CloseHandle(TimerWakeEvent);
+	TimerThread = NULL;
+	TimerWakeEvent = NULL;
+
+	DiscardTimers(IncomingTimers);
+	IncomingTimers = NULL;
+
+	for(size_t i = 0; i < Level0Slots; ++i)
+	{
+		DiscardTimers(Level0[i]);
+		Level0[i] = NULL;
+	}
+
+	for(unsigned level = 0; level < NumUpperLevels; ++level)
+	{
+		for(size_t i = 0; i < UpperLevelSlots; ++i)
+		{
+			DiscardTimers(UpperLevels[level][i]);
+			UpperLevels[level][i] = NULL;
+		}
+	}
+
+	WheelTime = 0;
+	NumTimersInWheel = 0;
+	TimerServiceStopping = false;
+}
+
@@ -0,0 +1,61 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Timer service for delayed and periodic actions
+//
+// A single timer thread serves every timer in the process, so programs
+// can wait out deadlines without tying up a thread of their own. Timers
+// are kept in a hierarchical timer wheel: the first level has one slot
+// per millisecond for the next 256 milliseconds, and each further level
+// has 64 slots, each spanning a whole turn of the level below it. When a
+// level turns over, the timers in the next slot of the level above are
+// cascaded down into finer slots, so each timer is moved at most once per
+// level, and scheduling and firing timers costs constant time regardless
+// of how many are pending. The wheel covers deadlines of up to about 18
+// hours; timers which are due later than that are parked in the coarsest
+// level and re-examined each time it turns over.
+//
+// Timers are scheduled by handing an action to the service; the action
+// is owned by the service from then on. Actions are fired on the timer
+// thread, and must not block, since every other timer waits for them.
+// An action may ask to be fired again after a given interval, which is
+// how periodic timers are built. Actions which are still pending when
+// the service shuts down are discarded without being fired.
+//
+
+#pragma once
+
+
+namespace Threads
+{
+	namespace Timers
+	{
+
+		//
+		// Interface for actions carried out when a timer expires
+		//
+		class TimerAction
+		{
+		public:
+			virtual ~TimerAction()
+			{ }
+
+			//
+			// Carry out the action; the return value is the number of
+			// milliseconds until the action should be fired again, or
+			// zero if the timer is finished with
+			//
+			virtual DWORD Fire() = 0;
+		};
+
+
+		// Timer scheduling
+		void Schedule(DWORD delayms, TimerAction* action);
+
+		// Service teardown
+		void Shutdown();
+
+	}
+}
+
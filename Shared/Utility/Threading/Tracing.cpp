@@ -0,0 +1,353 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Timeline tracing of the concurrency machinery
+//
+
+#include "pch.h"
+
+#include "Utility/Threading/Tracing.h"
+#include "Utility/Threading/Telemetry.h"
+#include "Utility/Threading/ThreadExceptions.h"
+#include "Utility/Threading/Synchronization.h"
+#include "Utility/Threading/Threads.h"
+
+#include "Utility/Strings.h"
+
+#include "User Interface/Output.h"
+
+#include "Configuration/RuntimeOptions.h"
+
+#include <fstream>
+#include <iomanip>
+
+
+using namespace Threads;
+
+
+volatile LONG Tracing::SessionActive = 0;
+
+
+namespace
+{
+
+	//
+	// Single entry in the trace ring buffer
+	//
+	// The phase is the Chrome trace event type: X for a span, i for an
+	// instant, and B/E for the beginning and end of a task. The sequence
+	// number is written last, and tells whether the entry was completely
+	// written (and not since overwritten) by the time the trace is saved.
+	//
+	struct TraceEvent
+	{
+		const char* Name;
+		unsigned __int64 StartTicks;
+		unsigned __int64 EndTicks;
+		unsigned __int64 Value;
+		DWORD Track;
+		char Phase;
+		volatile LONG Sequence;
+	};
+
+	// Ring buffer, allocated for the duration of a session
+	TraceEvent* Events = NULL;
+	LONG NumEventSlots = 0;
+	volatile LONG NextEvent = 0;
+
+	unsigned __int64 SessionStartTicks = 0;
+
+	//
+	// Task names and interned event names
+	//
+	// These are protected by the tracing critical section.
+	//
+	CriticalSection TracingCriticalSection;
+	std::map<DWORD, std::string> TaskNames;
+	std::set<std::string> InternedNames;
+
+
+	//
+	// Select the timeline track for events raised by the calling thread
+	//
+	// Tasks are identified by their handles, which are always odd, so they
+	// can never collide with OS thread IDs, which are multiples of 4. Only
+	// registered tasks have mailboxes; see Threads.cpp.
+	//
+	DWORD GetTrackForThisThread()
+	{
+		const ThreadInfo* info = reinterpret_cast<const ThreadInfo*>(::TlsGetValue(GetTLSIndex()));
+		if(info && info->Mailbox)
+			return info->HandleToSelf;
+
+		return ::GetCurrentThreadId();
+	}
+
+	//
+	// Claim the next slot of the ring buffer and fill it in
+	//
+	void RecordEvent(char phase, const char* name, DWORD track, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value)
+	{
+		if(!Tracing::IsEnabled())
+			return;
+
+		LONG sequence = ::InterlockedIncrement(&NextEvent);
+		TraceEvent& event = Events[static_cast<unsigned long>(sequence - 1) % static_cast<unsigned long>(NumEventSlots)];
+
+		Atomic::StoreRelease(&event.Sequence, 0L);
+		event.Name = name;
+		event.StartTicks = startticks;
+		event.EndTicks = endticks;
+		event.Value = value;
+		event.Track = track;
+		event.Phase = phase;
+		Atomic::StoreRelease(&event.Sequence, sequence);
+	}
+
+
+	//
+	// Write a string to the trace file, escaped for use in JSON
+	//
+	void WriteString(std::ostream& outfile, const std::string& str)
+	{
+		outfile << "\"";
+		for(std::string::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+		{
+			unsigned char c = static_cast<unsigned char>(*iter);
+			if(c == '"' || c == '\\')
+				outfile << "\\" << *iter;
+			else if(c < 0x20)
+				outfile << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned>(c) << std::dec << std::setfill(' ');
+			else
+				outfile << *iter;
+		}
+		outfile << "\"";
+	}
+
+	//
+	// Convert a timestamp into microseconds since the start of the session
+	//
+	double TicksToTraceTime(unsigned __int64 ticks)
+	{
+		if(ticks < SessionStartTicks)
+			return 0.0;
+
+		return Telemetry::TicksToMilliseconds(ticks - SessionStartTicks) * 1000.0;
+	}
+
+	bool CompareEventStart(const TraceEvent* lhs, const TraceEvent* rhs)
+	{
+		return lhs->StartTicks < rhs->StartTicks;
+	}
+
+}
+
+
+//
+// Record a span of time on the calling thread
+//
+void Tracing::RecordSpan(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value)
+{
+	RecordEvent('X', name, GetTrackForThisThread(), startticks, endticks, value);
+}
+
+//
+// Record a single point in time on the calling thread
+//
+void Tracing::RecordInstant(const char* name, unsigned __int64 value)
+{
+	unsigned __int64 now = Telemetry::GetTimestamp();
+	RecordEvent('i', name, GetTrackForThisThread(), now, now, value);
+}
+
+//
+// Record the start of a task; this must be called from the task itself
+//
+void Tracing::RecordTaskBegin(DWORD taskhandle)
+{
+	unsigned __int64 now = Telemetry::GetTimestamp();
+	RecordEvent('B', "Task", taskhandle, now, now, taskhandle);
+}
+
+//
+// Record the end of a task; this must be called from the task itself
+//
+void Tracing::RecordTaskEnd(DWORD taskhandle)
+{
+	unsigned __int64 now = Telemetry::GetTimestamp();
+	RecordEvent('E', "Task", taskhandle, now, now, taskhandle);
+}
+
+//
+// Label the timeline track of a task with the task's name
+//
+void Tracing::NameTask(DWORD taskhandle, const std::wstring& name)
+{
+	if(!IsEnabled())
+		return;
+
+	CriticalSection::Auto mutex(TracingCriticalSection);
+	TaskNames[taskhandle] = narrow(name);
+}
+
+//
+// Retrieve a copy of the given name which remains valid until the session ends
+//
+const char* Tracing::InternName(const char* name)
+{
+	CriticalSection::Auto mutex(TracingCriticalSection);
+	return InternedNames.insert(name).first->c_str();
+}
+
+
+//
+// Begin timing a span
+//
+Tracing::Span::Span(const char* name, unsigned __int64 value)
+	: Name(name),
+	  Value(value),
+	  StartTicks(IsEnabled() ? Telemetry::GetTimestamp() : 0)
+{
+}
+
+//
+// Record the span, if tracing was enabled when it began
+//
+Tracing::Span::~Span()
+{
+	if(StartTicks)
+		RecordSpan(Name, StartTicks, Telemetry::GetTimestamp(), Value);
+}
+
+
+//
+// Allocate the ring buffer and start recording, if tracing is enabled
+//
+Tracing::Session::Session(const std::string& tracefilename)
+	: Active(Config::TraceEvents && Config::TraceBufferSize != 0),
+	  TraceFileName(tracefilename)
+{
+	if(!Active)
+		return;
+
+	if(Events)
+		throw ThreadException("Cannot start a tracing session while another session is already running");
+
+	Events = new TraceEvent[Config::TraceBufferSize];
+	for(unsigned i = 0; i < Config::TraceBufferSize; ++i)
+		Events[i].Sequence = 0;
+
+	NumEventSlots = static_cast<LONG>(Config::TraceBufferSize);
+	NextEvent = 0;
+	SessionStartTicks = Telemetry::GetTimestamp();
+
+	::InterlockedExchange(&SessionActive, 1);
+}
+
+//
+// Stop recording, and write out the trace
+//
+Tracing::Session::~Session()
+{
+	if(!Active)
+		return;
+
+	::InterlockedExchange(&SessionActive, 0);
+
+	try
+	{
+		WriteTrace();
+	}
+	catch(...)
+	{
+		// Failing to write the trace should not mask the program's own results
+	}
+
+	{
+		CriticalSection::Auto mutex(TracingCriticalSection);
+		TaskNames.clear();
+		InternedNames.clear();
+	}
+
+	delete [] Events;
+	Events = NULL;
+	NumEventSlots = 0;
+}
+
+//
+// Write the surviving events to the trace file
+//
+// Only the most recent events fit in the ring buffer; entries which were
+// overwritten or only partially written are skipped. Begin and end events
+// of tasks may therefore come without their counterparts, which trace
+// viewers tolerate.
+//
+void Tracing::Session::WriteTrace()
+{
+	LONG numrecorded = NextEvent;
+	LONG first = (numrecorded > NumEventSlots) ? (numrecorded - NumEventSlots) : 0;
+
+	std::vector<const TraceEvent*> order;
+	order.reserve(static_cast<size_t>(numrecorded - first));
+	for(LONG sequence = first + 1; sequence <= numrecorded; ++sequence)
+	{
+		const TraceEvent& event = Events[static_cast<unsigned long>(sequence - 1) % static_cast<unsigned long>(NumEventSlots)];
+		if(Atomic::LoadAcquire(&event.Sequence) == sequence)
+			order.push_back(&event);
+	}
+
+	std::stable_sort(order.begin(), order.end(), CompareEventStart);
+
+	std::ofstream outfile(TraceFileName.c_str(), std::ios::trunc);
+	if(!outfile)
+		return;
+
+	DWORD processid = ::GetCurrentProcessId();
+
+	outfile << std::fixed << std::setprecision(3);
+	outfile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool firstevent = true;
+
+	{
+		CriticalSection::Auto mutex(TracingCriticalSection);
+		for(std::map<DWORD, std::string>::const_iterator iter = TaskNames.begin(); iter != TaskNames.end(); ++iter)
+		{
+			if(!firstevent)
+				outfile << ",\n";
+			firstevent = false;
+
+			outfile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processid << ",\"tid\":" << iter->first << ",\"args\":{\"name\":";
+			WriteString(outfile, iter->second);
+			outfile << "}}";
+		}
+	}
+
+	for(std::vector<const TraceEvent*>::const_iterator iter = order.begin(); iter != order.end(); ++iter)
+	{
+		const TraceEvent& event = **iter;
+
+		if(!firstevent)
+			outfile << ",\n";
+		firstevent = false;
+
+		outfile << "{\"name\":";
+		WriteString(outfile, event.Name);
+		outfile << ",\"cat\":\"epoch\",\"ph\":\"" << event.Phase << "\",\"ts\":" << TicksToTraceTime(event.StartTicks);
+		if(event.Phase == 'X')
+			outfile << ",\"dur\":" << (TicksToTraceTime(event.EndTicks) - TicksToTraceTime(event.StartTicks));
+		else if(event.Phase == 'i')
+			outfile << ",\"s\":\"t\"";
+		outfile << ",\"pid\":" << processid << ",\"tid\":" << event.Track << ",\"args\":{\"value\":" << event.Value << "}}";
+	}
+
+	outfile << "\n]}\n";
+
+	UI::OutputStream output;
+	output << L"Trace: " << order.size() << L" events written to " << widen(TraceFileName);
+	if(numrecorded > NumEventSlots)
+		output << L" (" << (numrecorded - NumEventSlots) << L" older events were overwritten; consider raising the tracebuffersize option)";
+	output << std::endl;
+}
+
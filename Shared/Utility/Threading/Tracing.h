@@ -0,0 +1,110 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Timeline tracing of the concurrency machinery
+//
+// Where the telemetry module keeps running totals, tracing records the
+// individual events behind them: the lifetimes of tasks, thread pool work
+// items and parallel loop chunks, message sends and receives, blocking
+// waits on futures, and whatever language extensions choose to report
+// (such as transfers to and from a GPU). Each event is timestamped with
+// the same high resolution counter used by the telemetry, so the trace
+// shows how the pieces of a program actually overlapped at run time.
+//
+// Events are written into a fixed size ring buffer; writers claim a slot
+// with a single interlocked increment, so tracing never takes a lock on
+// any of the paths it measures. Once the buffer is full, the oldest events
+// are overwritten. When the tracing session ends the surviving events are
+// written to a file in the Chrome trace event format, which can be loaded
+// into chrome://tracing and similar timeline viewers.
+//
+// Events are placed on one timeline track per task. Green tasks are thus
+// shown on their own tracks, even though they move between the worker
+// threads of the pool; threads which are not tasks (such as the pool
+// workers themselves) are shown under their OS thread IDs.
+//
+// Event names must be string literals, or otherwise remain valid until
+// the session ends; names from other sources should be interned first.
+//
+
+#pragma once
+
+
+// Dependencies
+#include "Utility/Threading/Lockless.h"
+
+
+namespace Threads
+{
+	namespace Tracing
+	{
+
+		// Set while a session is running; use IsEnabled to check this
+		extern volatile LONG SessionActive;
+
+		//
+		// Check if a tracing session is currently recording events
+		//
+		inline bool IsEnabled()
+		{
+			return Atomic::LoadAcquire(&SessionActive) != 0;
+		}
+
+
+		// Event recording
+		void RecordSpan(const char* name, unsigned __int64 startticks, unsigned __int64 endticks, unsigned __int64 value);
+		void RecordInstant(const char* name, unsigned __int64 value);
+		void RecordTaskBegin(DWORD taskhandle);
+		void RecordTaskEnd(DWORD taskhandle);
+		void NameTask(DWORD taskhandle, const std::wstring& name);
+
+		const char* InternName(const char* name);
+
+
+		//
+		// RAII helper for recording a span of time on the calling thread
+		//
+		// Spans which start before tracing is enabled are not recorded.
+		// The value is written to the trace alongside the span, and may
+		// be filled in at any time before the span ends.
+		//
+		class Span
+		{
+		public:
+			explicit Span(const char* name, unsigned __int64 value = 0);
+			~Span();
+
+			void SetValue(unsigned __int64 value)
+			{ Value = value; }
+
+		private:
+			const char* Name;
+			unsigned __int64 Value;
+			unsigned __int64 StartTicks;
+		};
+
+
+		//
+		// RAII helper for recording events while a program runs, if
+		// Config::TraceEvents is set; the trace is written to the
+		// given file when the session ends. Sessions must not end
+		// until all of the work being traced has finished.
+		//
+		class Session
+		{
+		public:
+			explicit Session(const std::string& tracefilename);
+			~Session();
+
+		private:
+			void WriteTrace();
+
+		private:
+			bool Active;
+			std::string TraceFileName;
+		};
+
+	}
+}
+
@@ -0,0 +1,131 @@
+//
+// The Epoch Language Project
+// Shared Library Code
+//
+// Lock-free double ended queue for distributing work between threads
+//
+
+#pragma once
+
+
+//
+// This class implements a fixed capacity work stealing deque, following
+// the well-known algorithm of Chase and Lev. Each deque is owned by one
+// thread, which pushes and pops items at the bottom end of the deque in
+// LIFO order. Any other thread may steal items from the top end; thieves
+// therefore take the oldest items, which tends to keep recently queued
+// (and thus cache-warm) work on the owning thread.
+//
+// The owner and thieves only contend when a single item remains, which
+// is resolved by a CAS on the top index. No locks are taken by any of
+// the deque operations.
+//
+// IMPORTANT: Push and Pop may only be called by the owning thread. Steal
+//            may be called by any thread, including the owner.
+//
+// The deque does not grow; Push fails when the deque is full, and the
+// caller is responsible for placing the item somewhere else. Capacity
+// must be a power of two.
+//
+template <class ItemType, unsigned Capacity = 1024>
+class WorkStealingDeque
+{
+// Construction
+public:
+	WorkStealingDeque()
+		: Top(0),
+		  Bottom(0)
+	{ }
+
+// Owner interface
+public:
+	//
+	// Add an item to the bottom of the deque
+	// Returns false if there is no room for the item
+	//
+	bool Push(ItemType* item)
+	{
+		LONG bottom = Bottom;
+		if(bottom - Top >= static_cast<LONG>(Capacity))
+			return false;
+
+		Items[bottom & IndexMask] = item;
+
+		// The interlocked write ensures the item is visible before the new bottom
+		::InterlockedExchange(&Bottom, bottom + 1);
+		return true;
+	}
+
+	//
+	// Remove the most recently pushed item from the bottom of the deque
+	// Returns NULL if the deque is empty
+	//
+	ItemType* Pop()
+	{
+		LONG bottom = Bottom - 1;
+
+		// The bottom must be published before the top is read, or
+		// a thief could take the same item we are about to claim
+		::InterlockedExchange(&Bottom, bottom);
+
+		LONG top = Top;
+		if(top > bottom)
+		{
+			Bottom = top;
+			return NULL;
+		}
+
+		ItemType* item = Items[bottom & IndexMask];
+		if(top != bottom)
+			return item;
+
+		// This is the last item, so we have to race any thieves for it
+		if(::InterlockedCompareExchange(&Top, top + 1, top) != top)
+			item = NULL;
+
+		Bottom = top + 1;
+		return item;
+	}
+
+// Thief interface
+public:
+	//
+	// Remove the oldest item from the top of the deque
+	// Returns NULL if the deque is empty or the steal lost a race
+	//
+	ItemType* Steal()
+	{
+		LONG top = Top;
+		::MemoryBarrier();
+		LONG bottom = Bottom;
+
+		if(top >= bottom)
+			return NULL;
+
+		ItemType* item = Items[top & IndexMask];
+		if(::InterlockedCompareExchange(&Top, top + 1, top) != top)
+			return NULL;
+
+		return item;
+	}
+
+	//
+	// Check if the deque appears to be empty
+	//
+	// This is only a snapshot; the result may be out of date by the
+	// time the caller acts on it.
+	//
+	bool IsEmpty() const
+	{
+		return (Top >= Bottom);
+	}
+
+// Internal tracking
+private:
+	static const LONG IndexMask = static_cast<LONG>(Capacity) - 1;
+
+	volatile LONG Top;
+	volatile LONG Bottom;
+	ItemType* volatile Items[Capacity];
+};
+
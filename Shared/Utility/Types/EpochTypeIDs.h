@@ -36,5 +36,7 @@ namespace VM
 		EpochVariableType_Array,
 
 		EpochVariableType_TaskHandle,
+
+		EpochVariableType_HashMap,
 	};
-}
\ No newline at end of file
+}
\ No newline at end of file
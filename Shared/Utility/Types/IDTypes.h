@@ -15,6 +15,7 @@ typedef IDType ScopeID;
 typedef IDType TupleTypeID;
 typedef IDType StructureTypeID;
 typedef IDType FunctionID;
+typedef IDType MessageSignatureID;
 
 typedef HandleType StringHandle;
 typedef HandleType TaskHandle;